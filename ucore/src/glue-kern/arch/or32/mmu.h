@@ -2,6 +2,7 @@
 #define __KERN_MM_MMU_H__
 
 #define NR_SETS         64	// 64 set TLB for both data and instruction
+#define TLB_PRELOAD     2	// pages loaded after one that is updated
 
 /* page directory and page table constants */
 #define NPDEENTRY       512	// page directory entries per page directory
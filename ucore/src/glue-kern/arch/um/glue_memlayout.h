@@ -70,6 +70,7 @@
 #define STUB_CODE          STUB_START
 #define STUB_DATA          (STUB_CODE + PGSIZE)
 #define STUB_END           (STUB_DATA + PGSIZE)
+#define STUB_BATCH         (STUB_DATA + 0x400)	// the queued host calls, see stub.h
 
 #define USERTOP            0xB0000000
 #define USTACKTOP          USERTOP
@@ -0,0 +1,9 @@
+#ifndef __HT_MKSFS_HOST_TYPES_H__
+#define __HT_MKSFS_HOST_TYPES_H__
+
+/* the types.h of the kernel headers built into the host tools */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#endif /* !__HT_MKSFS_HOST_TYPES_H__ */
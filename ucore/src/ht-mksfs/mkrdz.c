@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/* the compressor of the kernel, so that it reads back what is written */
+#include "../kern-ucore/libs/hash.c"
+#include "../kern-ucore/libs/lz4.c"
+#include <rdz.h>
+
+/*
+ * mkrdz - compress an image block by block for the compressed ramdisk of
+ * the kernel, see rdz.h. The image is padded with zeros to a whole block.
+ */
+
+static void die(const char *what, const char *name)
+{
+	fprintf(stderr, "mkrdz: %s %s: %s\n", what, name, strerror(errno));
+	exit(-1);
+}
+
+int main(int argc, char **argv)
+{
+	static uint8_t table[LZ4_TABLE_SIZE];
+	static uint8_t block[RDZ_BLOCK_SIZE], out[RDZ_BLOCK_SIZE];
+	struct stat st;
+	FILE *in, *rdz;
+	uint32_t i, *offsets;
+	if (argc != 3) {
+		fprintf(stderr, "usage: mkrdz <input *.img> <output *.rdz>\n");
+		return -1;
+	}
+	if ((in = fopen(argv[1], "rb")) == NULL || fstat(fileno(in), &st) != 0) {
+		die("open", argv[1]);
+	}
+	if ((rdz = fopen(argv[2], "wb")) == NULL) {
+		die("open", argv[2]);
+	}
+	struct rdz_header h = {
+		.magic = RDZ_MAGIC,
+		.block_size = RDZ_BLOCK_SIZE,
+		.nblocks = (st.st_size + RDZ_BLOCK_SIZE - 1) / RDZ_BLOCK_SIZE,
+	};
+	size_t head = sizeof(h) + (h.nblocks + 1) * sizeof(uint32_t);
+	if ((offsets = calloc(h.nblocks + 1, sizeof(uint32_t))) == NULL) {
+		die("alloc offsets of", argv[1]);
+	}
+	if (fseek(rdz, head, SEEK_SET) != 0) {
+		die("seek", argv[2]);
+	}
+	offsets[0] = head;
+	for (i = 0; i < h.nblocks; i++) {
+		size_t n = fread(block, 1, RDZ_BLOCK_SIZE, in), len;
+		if (n < RDZ_BLOCK_SIZE) {
+			if (ferror(in)) {
+				die("read", argv[1]);
+			}
+			memset(block + n, 0, RDZ_BLOCK_SIZE - n);
+		}
+		len = lz4_compress(block, RDZ_BLOCK_SIZE, out,
+				   RDZ_BLOCK_SIZE - 1, table);
+		if (len == 0 || len >= RDZ_BLOCK_SIZE) {
+			len = RDZ_BLOCK_SIZE;
+			memcpy(out, block, len);
+		}
+		if (fwrite(out, 1, len, rdz) != len) {
+			die("write", argv[2]);
+		}
+		offsets[i + 1] = offsets[i] + len;
+	}
+	if (fseek(rdz, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, rdz) != 1
+	    || fwrite(offsets, sizeof(uint32_t), h.nblocks + 1, rdz)
+	    != h.nblocks + 1 || fclose(rdz) != 0) {
+		die("write", argv[2]);
+	}
+	printf("create %s (%u blocks, %u bytes) successfully.\n", argv[2],
+	       h.nblocks, offsets[h.nblocks]);
+	return 0;
+}
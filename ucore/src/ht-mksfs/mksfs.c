@@ -114,6 +114,7 @@ void safe_fchdir(int fd)
 #define SFS_MAX_INFO_LEN                        31
 #define SFS_MAX_FNAME_LEN                       255
 #define SFS_MAX_FILE_SIZE                       (1024UL * 1024 * 128)	// 128M
+#define SFS_MAX_EXTENT_FILE_SIZE                (1024UL * 1024 * 1024)	// 1G
 
 #define SFS_BLKBITS                             (SFS_BLKSIZE * CHAR_BIT)
 #define SFS_TYPE_FILE                           1
@@ -124,6 +125,23 @@ void safe_fchdir(int fd)
 #define SFS_BLKN_ROOT                           1
 #define SFS_BLKN_FREEMAP                        2
 
+#define SFS_FEATURE_DIR_INDEX                   0x1
+#define SFS_FEATURE_EXTENTS                     0x2
+#define SFS_FEATURE_JOURNAL                     0x4
+#define SFS_FEATURE_INLINE_DATA                 0x8
+#define SFS_INODE_INLINE                        0x1
+#define SFS_JOURNAL_MAGIC                       0x4a534653
+#define SFS_JOURNAL_MAX_BLOCKS                  1024
+#define SFS_DIRINDEX_NBUCKETS                   512
+#define SFS_DIRINDEX_OFFSET                     128
+#define SFS_EXTENT_OFFSET                       128
+#define SFS_MAX_EXTENTS                         ((SFS_BLKSIZE - SFS_EXTENT_OFFSET) / sizeof(struct extent))
+#define SFS_INLINE_FILE_OFFSET                  SFS_EXTENT_OFFSET
+#define SFS_INLINE_FILE_MAX                     (SFS_BLKSIZE - SFS_INLINE_FILE_OFFSET)
+#define SFS_INLINE_DIR_OFFSET                   (SFS_DIRINDEX_OFFSET + sizeof(struct dirindex))
+#define SFS_INLINE_DENTRY_SIZE                  (sizeof(struct sfs_entry) + sizeof(uint32_t))
+#define SFS_INLINE_DIR_NSLOTS                   ((SFS_BLKSIZE - SFS_INLINE_DIR_OFFSET) / SFS_INLINE_DENTRY_SIZE)
+
 struct cache_block {
 	uint32_t ino;
 	struct cache_block *hash_next;
@@ -144,13 +162,30 @@ struct cache_inode {
 		uint16_t type;
 		uint16_t nlinks;
 		uint32_t blocks;
-		uint32_t direct[SFS_NDIRECT];
-		uint32_t indirect;
-		uint32_t db_indirect;
+		union {
+			struct {
+				uint32_t direct[SFS_NDIRECT];
+				uint32_t indirect;
+				uint32_t db_indirect;
+			};
+			struct {
+				uint32_t nextents;
+			} extinfo;
+		};
+		uint32_t flags;
 	} inode;
 	ino_t real;
 	uint32_t ino;
 	uint32_t nblks;
+	struct dirindex {
+		uint32_t free;
+		uint32_t buckets[SFS_DIRINDEX_NBUCKETS];
+	} *index;		/* directories only, links are slots + 1 */
+	struct extent {
+		uint32_t start;
+		uint32_t len;
+	} *extents;		/* files and links of an extent image only */
+	char *inline_data;	/* SFS_INODE_INLINE only, a block of it */
 	struct cache_block *l1, *l2;
 	struct cache_inode *hash_next;
 };
@@ -161,6 +196,9 @@ struct sfs_fs {
 		uint32_t blocks;
 		uint32_t unused_blocks;
 		char info[SFS_MAX_INFO_LEN + 1];
+		uint32_t features;
+		uint32_t journal_start;
+		uint32_t journal_blocks;
 	} super;
 	struct subpath {
 		struct subpath *next, *prev;
@@ -212,6 +250,10 @@ static struct cache_inode *alloc_cache_inode(struct sfs_fs *sfs, ino_t real,
 	struct cache_inode *ci = safe_malloc(sizeof(struct cache_inode));
 	ci->ino = (ino != 0) ? ino : sfs_alloc_ino(sfs);
 	ci->real = real, ci->nblks = 0, ci->l1 = ci->l2 = NULL;
+	ci->index = NULL, ci->extents = NULL, ci->inline_data = NULL;
+	if (type != SFS_TYPE_DIR && (sfs->super.features & SFS_FEATURE_EXTENTS)) {
+		ci->extents = safe_malloc(sizeof(struct extent) * SFS_MAX_EXTENTS);
+	}
 	struct inode *inode = &(ci->inode);
 	memset(inode, 0, sizeof(struct inode));
 	inode->type = type;
@@ -239,6 +281,9 @@ init_dir_cache_inode(struct cache_inode *current, struct cache_inode *parent)
 	       && inode->dirinfo.parent == 0);
 	inode->nlinks++, parent->inode.nlinks++, inode->dirinfo.parent =
 	    parent->ino;
+	current->index =
+	    memset(safe_malloc(sizeof(struct dirindex)), 0,
+		   sizeof(struct dirindex));
 }
 
 struct sfs_fs *create_sfs(int imgfd)
@@ -260,6 +305,8 @@ struct sfs_fs *create_sfs(int imgfd)
 	sfs->super.magic = SFS_MAGIC;
 	sfs->super.blocks = ninos, sfs->super.unused_blocks = ninos - next_ino;
 	snprintf(sfs->super.info, SFS_MAX_INFO_LEN, "simple file system");
+	sfs->super.features = SFS_FEATURE_DIR_INDEX;
+	sfs->super.journal_start = sfs->super.journal_blocks = 0;
 
 	sfs->ninos = ninos, sfs->next_ino = next_ino, sfs->imgfd = imgfd;
 	sfs->sp_root = sfs->sp_end = &(sfs->__sp_nil);
@@ -332,7 +379,27 @@ static void flush_cache_block(struct sfs_fs *sfs, struct cache_block *cb)
 
 static void flush_cache_inode(struct sfs_fs *sfs, struct cache_inode *ci)
 {
-	write_block(sfs, &(ci->inode), sizeof(ci->inode), ci->ino);
+	static char buffer[SFS_BLKSIZE];
+	memset(buffer, 0, sizeof(buffer));
+	memcpy(buffer, &(ci->inode), sizeof(ci->inode));
+	if (ci->index != NULL) {
+		memcpy(buffer + SFS_DIRINDEX_OFFSET, ci->index,
+		       sizeof(*(ci->index)));
+	}
+	if (ci->extents != NULL) {
+		memcpy(buffer + SFS_EXTENT_OFFSET, ci->extents,
+		       sizeof(struct extent) * ci->inode.extinfo.nextents);
+	}
+	if (ci->inline_data != NULL) {
+		if (ci->inode.type == SFS_TYPE_DIR) {
+			memcpy(buffer + SFS_INLINE_DIR_OFFSET, ci->inline_data,
+			       SFS_INLINE_DENTRY_SIZE * ci->inode.blocks);
+		} else {
+			memcpy(buffer + SFS_INLINE_FILE_OFFSET, ci->inline_data,
+			       ci->inode.fileinfo.size);
+		}
+	}
+	write_block(sfs, buffer, sizeof(buffer), ci->ino);
 }
 
 void close_sfs(struct sfs_fs *sfs)
@@ -430,6 +497,23 @@ __append_block(struct sfs_fs *sfs, struct cache_inode *file, uint32_t ino,
 	static_assert(SFS_LN_NBLKS <= SFS_L2_NBLKS);
 	uint32_t nblks = file->nblks;
 	struct inode *inode = &(file->inode);
+	if (file->extents != NULL) {
+		uint32_t n = inode->extinfo.nextents;
+		if (nblks >= SFS_MAX_EXTENT_FILE_SIZE / SFS_BLKSIZE) {
+			open_bug(sfs, filename, "file is too big.\n");
+		}
+		if (n != 0
+		    && file->extents[n - 1].start + file->extents[n - 1].len ==
+		    ino) {
+			file->extents[n - 1].len++;
+		} else if (n != SFS_MAX_EXTENTS) {
+			file->extents[n].start = ino, file->extents[n].len = 1;
+			inode->extinfo.nextents++;
+		} else {
+			open_bug(sfs, filename, "file has too many extents.\n");
+		}
+		goto out;
+	}
 	if (nblks >= SFS_LN_NBLKS) {
 		open_bug(sfs, filename, "file is too big.\n");
 	}
@@ -448,6 +532,7 @@ __append_block(struct sfs_fs *sfs, struct cache_inode *file, uint32_t ino,
 		uint32_t *data1 = file->l1->cache;
 		data1[nblks % SFS_BLK_NENTRY] = ino;
 	}
+out:
 	file->nblks++;
 	inode->blocks++;
 }
@@ -473,16 +558,80 @@ append_block_slot(struct sfs_fs *sfs, struct cache_inode *file, uint32_t ino,
 	__append_block(sfs, file, ino, filename);
 }
 
+/* file keeps its data in its inode block until it outgrows it */
+static void set_inline(struct cache_inode *file)
+{
+	file->inline_data =
+	    memset(safe_malloc(SFS_BLKSIZE), 0, SFS_BLKSIZE);
+	file->inode.flags |= SFS_INODE_INLINE;
+}
+
+/* the slots of an inline directory move out to a block each */
+static void
+spill_inline_dir(struct sfs_fs *sfs, struct cache_inode *current,
+		 const char *name)
+{
+	struct inode *inode = &(current->inode);
+	uint32_t i, nslots = inode->blocks;
+	assert(inode->type == SFS_TYPE_DIR && current->nblks == 0);
+	inode->blocks = 0;
+	for (i = 0; i < nslots; i++) {
+		uint32_t ino = sfs_alloc_ino(sfs);
+		write_block(sfs, current->inline_data + SFS_INLINE_DENTRY_SIZE * i,
+			    SFS_INLINE_DENTRY_SIZE, ino);
+		__append_block(sfs, current, ino, name);
+	}
+	free(current->inline_data);
+	current->inline_data = NULL;
+	inode->flags &= ~SFS_INODE_INLINE;
+}
+
+/* the bucket of name in the index of a directory, as the kernel hashes it */
+static uint32_t *dirindex_bucket(struct dirindex *index, const char *name)
+{
+	uint32_t hash = 2166136261U;
+	while (*name != '\0') {
+		hash = (hash ^ (uint8_t) * name++) * 16777619U;
+	}
+	return &(index->buckets[hash % SFS_DIRINDEX_NBUCKETS]);
+}
+
 static void
 add_entry(struct sfs_fs *sfs, struct cache_inode *current,
 	  struct cache_inode *file, const char *name)
 {
-	static struct sfs_entry __entry, *entry = &__entry;
+	static char buffer[SFS_BLKSIZE];
+	struct sfs_entry *entry = (struct sfs_entry *)buffer;
 	assert(current->inode.type == SFS_TYPE_DIR
 	       && strlen(name) <= SFS_MAX_FNAME_LEN);
+	memset(buffer, 0, sizeof(buffer));
 	entry->ino = file->ino, strcpy(entry->name, name);
+
+	/* the entry goes to the head of the chain of its bucket, its link
+	 * word follows it in the slot block */
+	uint32_t *bucket = dirindex_bucket(current->index, name);
+	*(uint32_t *) (buffer + sizeof(struct sfs_entry)) = *bucket;
+	*bucket = current->inode.blocks + 1;
+
+	/* the first slots of a directory stay in its inode block */
+	if (current->inode.blocks == 0
+	    && (sfs->super.features & SFS_FEATURE_INLINE_DATA)) {
+		set_inline(current);
+	}
+	if (current->inline_data != NULL) {
+		if (current->inode.blocks < SFS_INLINE_DIR_NSLOTS) {
+			memcpy(current->inline_data +
+			       SFS_INLINE_DENTRY_SIZE * current->inode.blocks,
+			       buffer, SFS_INLINE_DENTRY_SIZE);
+			current->inode.dirinfo.slots++, current->inode.blocks++;
+			file->inode.nlinks++;
+			return;
+		}
+		spill_inline_dir(sfs, current, name);
+	}
+
 	uint32_t entry_ino = sfs_alloc_ino(sfs);
-	write_block(sfs, entry, sizeof(entry->name), entry_ino);
+	write_block(sfs, buffer, sizeof(buffer), entry_ino);
 	append_block_slot(sfs, current, entry_ino, name);
 	file->inode.nlinks++;
 }
@@ -581,6 +730,22 @@ open_file(struct sfs_fs *sfs, struct cache_inode *file, const char *filename,
 {
 	static char buffer[SFS_BLKSIZE];
 	ssize_t ret, last = SFS_BLKSIZE;
+	if ((sfs->super.features & SFS_FEATURE_INLINE_DATA)
+	    && safe_fstat(fd)->st_size <= SFS_INLINE_FILE_MAX) {
+		set_inline(file);
+		while ((ret =
+			read(fd, buffer,
+			     SFS_INLINE_FILE_MAX - file->inode.fileinfo.size))
+		       > 0) {
+			memcpy(file->inline_data + file->inode.fileinfo.size,
+			       buffer, ret);
+			file->inode.fileinfo.size += ret;
+		}
+		if (ret < 0) {
+			open_bug(sfs, filename, "read file failed.\n");
+		}
+		return;
+	}
 	while ((ret = read(fd, buffer, sizeof(buffer))) != 0) {
 		assert(last == SFS_BLKSIZE);
 		uint32_t ino = sfs_alloc_ino(sfs);
@@ -597,11 +762,18 @@ void
 open_link(struct sfs_fs *sfs, struct cache_inode *file, const char *filename)
 {
 	static char buffer[SFS_BLKSIZE];
-	uint32_t ino = sfs_alloc_ino(sfs);
 	ssize_t ret = readlink(filename, buffer, sizeof(buffer));
 	if (ret < 0 || ret == SFS_BLKSIZE) {
 		open_bug(sfs, filename, "read link failed, %d", (int)ret);
 	}
+	if ((sfs->super.features & SFS_FEATURE_INLINE_DATA)
+	    && ret <= SFS_INLINE_FILE_MAX) {
+		set_inline(file);
+		memcpy(file->inline_data, buffer, ret);
+		file->inode.fileinfo.size = ret;
+		return;
+	}
+	uint32_t ino = sfs_alloc_ino(sfs);
 	write_block(sfs, buffer, ret, ino);
 	append_block_size(sfs, file, ret, ino, filename);
 }
@@ -629,16 +801,72 @@ static void static_check(void)
 	static_assert(sizeof(ino_t) == 8);
 	static_assert(SFS_MAX_NBLKS <= 0x80000000UL);
 	static_assert(SFS_MAX_FILE_SIZE <= 0x80000000UL);
+	static_assert(sizeof(struct inode) <= SFS_DIRINDEX_OFFSET);
+	static_assert(sizeof(struct inode) <= SFS_EXTENT_OFFSET);
+	static_assert(SFS_DIRINDEX_OFFSET + sizeof(struct dirindex) <=
+		      SFS_BLKSIZE);
+	static_assert(sizeof(struct sfs_entry) + sizeof(uint32_t) <=
+		      SFS_BLKSIZE);
+	static_assert(SFS_INLINE_DIR_OFFSET +
+		      SFS_INLINE_DENTRY_SIZE * SFS_INLINE_DIR_NSLOTS <=
+		      SFS_BLKSIZE);
+}
+
+/* reserve the journal right after the freemap, with an empty log */
+static void create_journal(struct sfs_fs *sfs)
+{
+	uint32_t i, nblks = sfs->ninos / 16;
+	if (nblks > SFS_JOURNAL_MAX_BLOCKS) {
+		nblks = SFS_JOURNAL_MAX_BLOCKS;
+	}
+	if (nblks < 4) {
+		bug("img file is too small for a journal.\n");
+	}
+	sfs->super.journal_start = sfs->next_ino;
+	for (i = 0; i < nblks; i++) {
+		sfs_alloc_ino(sfs);
+	}
+	sfs->super.journal_blocks = nblks;
+	sfs->super.features |= SFS_FEATURE_JOURNAL;
+
+	uint32_t header[2] = { SFS_JOURNAL_MAGIC, 1 };
+	write_block(sfs, header, sizeof(header), sfs->super.journal_start);
 }
 
 int main(int argc, char **argv)
 {
 	static_check();
+	bool extents = 0, journal = 0, inline_data = 0;
+	while (argc > 3 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-e") == 0) {
+			extents = 1;
+		} else if (strcmp(argv[1], "-j") == 0) {
+			journal = 1;
+		} else if (strcmp(argv[1], "-i") == 0) {
+			inline_data = 1;
+		} else {
+			break;
+		}
+		argc--, argv++;
+	}
 	if (argc != 3) {
-		bug("usage: <input *.img> <input dirname>\n");
+		bug("usage: [-e] [-j] [-i] <input *.img> <input dirname>\n"
+		    "\t-e: map the files by extents\n"
+		    "\t-j: journal the metadata\n"
+		    "\t-i: keep small files and directories in their inodes\n");
 	}
 	const char *imgname = argv[1], *home = argv[2];
-	if (create_img(open_img(imgname), home) != 0) {
+	struct sfs_fs *sfs = open_img(imgname);
+	if (extents) {
+		sfs->super.features |= SFS_FEATURE_EXTENTS;
+	}
+	if (journal) {
+		create_journal(sfs);
+	}
+	if (inline_data) {
+		sfs->super.features |= SFS_FEATURE_INLINE_DATA;
+	}
+	if (create_img(sfs, home) != 0) {
 		bug("create img failed.\n");
 	}
 	printf("create %s (%s) successfully.\n", imgname, home);
@@ -0,0 +1,61 @@
+#include <types.h>
+#include <arch.h>
+#include <stdio.h>
+#include <kio.h>
+#include <mp.h>
+#include <hz.h>
+#include <boottime.h>
+
+/*
+ * The boot phases, in the order they end. The tsc of the cpus is taken
+ * to be in step, as by the tsc clocksource; cpuhz is known from hz_init
+ * on, so the times are only converted when printed. The async initcalls
+ * of initcall.c end on other cpus, a slot is claimed by an atomic add.
+ */
+
+#define BOOT_TIME_MAX               64
+
+struct boot_phase {
+	const char *name;
+	int cpu;
+	uint64_t start, end;
+};
+
+static struct boot_phase phases[BOOT_TIME_MAX];
+static int nr_phases;
+
+void boot_time_add(const char *name, uint64_t start)
+{
+	uint64_t end = rdtsc();
+	int i = __sync_fetch_and_add(&nr_phases, 1);
+	if (i < BOOT_TIME_MAX) {
+		phases[i].name = name;
+		phases[i].cpu = myid();
+		phases[i].start = start, phases[i].end = end;
+	}
+}
+
+static uint64_t cyc2us(uint64_t cycles)
+{
+	uint64_t mhz = cpuhz / 1000000;
+	do_div(cycles, mhz ? mhz : 1);
+	return cycles;
+}
+
+// boot_time_print - the phases, with their start since the first one and
+//                 - their length, in us
+void boot_time_print(void)
+{
+	int i, n = (nr_phases < BOOT_TIME_MAX) ? nr_phases : BOOT_TIME_MAX;
+	uint64_t base = (n > 0) ? phases[0].start : 0;
+	kprintf("boot time, us:\n%10s %10s %4s  %s\n", "start", "length", "cpu",
+		"phase");
+	for (i = 0; i < n; i++) {
+		struct boot_phase *p = phases + i;
+		kprintf("%10llu %10llu %4d  %s\n", cyc2us(p->start - base),
+			cyc2us(p->end - p->start), p->cpu, p->name);
+	}
+	if (nr_phases > BOOT_TIME_MAX) {
+		kprintf("%d phases not recorded\n", nr_phases - BOOT_TIME_MAX);
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef __KERN_DEBUG_BOOTTIME_H__
+#define __KERN_DEBUG_BOOTTIME_H__
+
+#include <types.h>
+#include <arch.h>
+
+/* *
+ * boot_call - run the init call fn, e.g. boot_call(fs_init()), and record
+ * its name, its cpu and the tsc when it started and ended, for
+ * boot_time_print.
+ * */
+#ifdef UCONFIG_BOOT_TIME
+#define boot_call(fn)                                                   \
+    do {                                                                \
+        uint64_t __start = rdtsc();                                     \
+        fn;                                                             \
+        boot_time_add(#fn, __start);                                    \
+    } while (0)
+
+void boot_time_add(const char *name, uint64_t start);
+void boot_time_print(void);
+#else
+#define boot_call(fn)                   fn
+#endif
+
+#endif /* !__KERN_DEBUG_BOOTTIME_H__ */
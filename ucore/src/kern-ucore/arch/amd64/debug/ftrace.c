@@ -0,0 +1,297 @@
+#include <types.h>
+#include <arch.h>
+#include <stdio.h>
+#include <string.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <slab.h>
+#include <vmm.h>
+#include <proc.h>
+#include <unistd.h>
+#include <mod.h>
+#include <kdebug.h>
+#include <ftrace.h>
+#include <static_key.h>
+#include <error.h>
+#include <kio.h>
+
+/*
+ * The function entry tracer. With UCONFIG_PROFILER_ON every function calls
+ * mcount (init/mcount.S) in its prologue, which calls ftrace_mcount below
+ * while ftrace_enabled. This file is built without -pg, and the path from
+ * mcount calls nothing else, the inline functions are its own copies.
+ *
+ * Each cpu appends the entries, tsc stamped, to its own ring. A slot is
+ * taken by one xadd, so an interrupt or NMI tracing on the same cpu gets
+ * the next one; its seq is written last, the dump skips the slots in the
+ * middle of being written. Nothing is locked.
+ *
+ * The filters, if any, are the [start, end) of the functions or modules to
+ * trace, from the symbols of ksyms.sh and of the modules (kmodule/mod.c).
+ */
+
+#define FTRACE_ENTRIES              2048
+#define FTRACE_FILTERS              32
+#define FTRACE_BUFSIZE              (128 * 1024)
+
+struct ftrace_entry {
+	uint64_t tsc;
+	uintptr_t ip;		// in the function traced, after its mcount call
+	uintptr_t parent;	// in its caller
+	int pid;
+	uint32_t seq;		// low bits of the slot number + 1, 0 while written
+};
+
+struct ftrace_cpu {
+	struct ftrace_entry *ring;
+	uint64_t head;		// slots taken, the ring keeps the last ones
+};
+
+struct ftrace_filter {
+	uintptr_t start, end;
+};
+
+static DEFINE_PERCPU_NOINIT(struct ftrace_cpu, ftrace_cpus);
+
+static struct ftrace_filter ftrace_filters[FTRACE_FILTERS];
+static volatile int ftrace_nr_filters;
+
+/* read by mcount before it calls in, or its site patched by ftrace_key */
+volatile int ftrace_enabled;
+DEFINE_STATIC_KEY(ftrace_key);
+
+static inline bool ftrace_filtered(uintptr_t ip)
+{
+	int i, n = ftrace_nr_filters;
+	if (n == 0) {
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		if (ftrace_filters[i].start <= ip && ip < ftrace_filters[i].end) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void ftrace_mcount(uintptr_t frompc, uintptr_t selfpc)
+{
+	if (!ftrace_enabled || ftrace_filtered(selfpc)) {
+		return;
+	}
+	struct ftrace_cpu *cpu = get_cpu_ptr(ftrace_cpus);
+	if (cpu->ring == NULL) {
+		return;
+	}
+	uint64_t slot = __sync_fetch_and_add(&(cpu->head), 1);
+	struct ftrace_entry *e = cpu->ring + slot % FTRACE_ENTRIES;
+	e->seq = 0;
+	__asm__ __volatile__("":::"memory");
+	e->tsc = rdtsc();
+	e->ip = selfpc;
+	e->parent = frompc;
+	e->pid = (current != NULL) ? current->pid : -1;
+	__asm__ __volatile__("":::"memory");
+	e->seq = (uint32_t) slot + 1;
+}
+
+// ftrace_start - clear the rings and trace from now on
+int ftrace_start(void)
+{
+	int i;
+	ftrace_enabled = 0;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct ftrace_cpu *cpu = per_cpu_ptr(ftrace_cpus, i);
+		if (cpu->ring == NULL) {
+			struct ftrace_entry *ring =
+			    kmalloc(sizeof(struct ftrace_entry) * FTRACE_ENTRIES);
+			if (ring == NULL) {
+				return -E_NO_MEM;
+			}
+			memset(ring, 0,
+			       sizeof(struct ftrace_entry) * FTRACE_ENTRIES);
+			cpu->ring = ring;
+		}
+		cpu->head = 0;
+	}
+	__sync_synchronize();
+	ftrace_enabled = 1;
+	static_key_enable(&ftrace_key);
+	return 0;
+}
+
+void ftrace_stop(void)
+{
+	ftrace_enabled = 0;
+	static_key_disable(&ftrace_key);
+}
+
+// ftrace_set_filter - trace also the functions of spec: "name" of the
+//                   - kernel, "module:name" or "[module]" for all of one
+int ftrace_set_filter(const char *spec)
+{
+	char name[MODULE_SYM_LEN], *modname;
+	uintptr_t start, end;
+	unsigned long size;
+	size_t len = strlen(spec);
+	if (ftrace_nr_filters == FTRACE_FILTERS) {
+		return -E_NO_MEM;
+	}
+	if (len > 2 && spec[0] == '[' && spec[len - 1] == ']') {
+		struct module *mod;
+		if (len - 2 >= MODULE_SYM_LEN) {
+			return -E_INVAL;
+		}
+		memcpy(name, spec + 1, len - 2);
+		name[len - 2] = '\0';
+		if ((mod = find_module(name)) == NULL) {
+			return -E_NOENT;
+		}
+		start = (uintptr_t) mod->module_core;
+		end = start + mod->core_text_size;
+	} else if (strchr(spec, ':') != NULL) {
+		if (len >= MODULE_SYM_LEN) {
+			return -E_INVAL;
+		}
+		/* module_kallsyms_lookup_name cuts the name at the ':' */
+		strcpy(name, spec);
+		if ((start = module_kallsyms_lookup_name(name)) == 0) {
+			return -E_NOENT;
+		}
+		if (module_address_lookup_(start, &size, NULL, &modname, name)
+		    == NULL || size == 0) {
+			return -E_NOENT;
+		}
+		end = start + size;
+	} else if (ksym_lookup_name(spec, &start, &end) != 0) {
+		return -E_NOENT;
+	}
+	ftrace_filters[ftrace_nr_filters].start = start;
+	ftrace_filters[ftrace_nr_filters].end = end;
+	__sync_synchronize();
+	ftrace_nr_filters++;
+	return 0;
+}
+
+void ftrace_clear_filters(void)
+{
+	ftrace_nr_filters = 0;
+}
+
+static size_t ftrace_name(char *buf, size_t size, uintptr_t addr)
+{
+	char name[MODULE_SYM_LEN], *modname;
+	unsigned long off;
+	uintptr_t start;
+	const char *sym;
+	if ((sym = ksym_lookup(addr, &start)) != NULL) {
+		return snprintf(buf, size, "%s+0x%x", sym, addr - start);
+	}
+	if (module_address_lookup_(addr, NULL, &off, &modname, name) != NULL) {
+		return snprintf(buf, size, "%s+0x%x [%s]", name, off, modname);
+	}
+	return snprintf(buf, size, "%p", addr);
+}
+
+// ftrace_show - the entries of each cpu, oldest first, into buf as
+//             - "cpu tsc +delta pid function <- caller"
+size_t ftrace_show(char *buf, size_t size)
+{
+	size_t len = 0;
+	int i;
+	for (i = 0; i < sysconf.lcpu_count && len < size; i++) {
+		struct ftrace_cpu *cpu = per_cpu_ptr(ftrace_cpus, i);
+		uint64_t head = cpu->head, slot, last = 0;
+		if (cpu->ring == NULL) {
+			continue;
+		}
+		slot = (head > FTRACE_ENTRIES) ? head - FTRACE_ENTRIES : 0;
+		for (; slot < head && len < size; slot++) {
+			struct ftrace_entry *e = cpu->ring + slot % FTRACE_ENTRIES;
+			if (e->seq != (uint32_t) slot + 1) {
+				continue;
+			}
+			len += snprintf(buf + len, size - len,
+					"%d %llu +%llu %d ", i, e->tsc,
+					(last != 0) ? e->tsc - last : 0,
+					e->pid);
+			last = e->tsc;
+			if (len < size) {
+				len += ftrace_name(buf + len, size - len, e->ip);
+			}
+			if (len < size) {
+				len += snprintf(buf + len, size - len, " <- ");
+			}
+			if (len < size) {
+				len += ftrace_name(buf + len, size - len,
+						   e->parent);
+			}
+			if (len < size) {
+				len += snprintf(buf + len, size - len, "\n");
+			}
+		}
+	}
+	return (len < size) ? len : size;
+}
+
+// do_ftrace - SYS_ftrace, start or stop the tracer, set its filters or
+//           - dump it into buf
+int do_ftrace(int op, char __user * buf, size_t len)
+{
+	struct mm_struct *mm = current->mm;
+	char *kbuf;
+	size_t n;
+	int ret;
+	switch (op) {
+	case FTRACE_START:
+		return ftrace_start();
+	case FTRACE_STOP:
+		ftrace_stop();
+		return 0;
+	case FTRACE_CLEAR:
+		ftrace_clear_filters();
+		return 0;
+	case FTRACE_FILTER:
+		if (len == 0 || len >= MODULE_SYM_LEN) {
+			return -E_INVAL;
+		}
+		break;
+	case FTRACE_DUMP:
+		if (len > FTRACE_BUFSIZE) {
+			len = FTRACE_BUFSIZE;
+		}
+		if (len == 0) {
+			return -E_INVAL;
+		}
+		break;
+	default:
+		return -E_INVAL;
+	}
+	if ((kbuf = kmalloc((op == FTRACE_FILTER) ? len + 1 : len)) == NULL) {
+		return -E_NO_MEM;
+	}
+	if (op == FTRACE_FILTER) {
+		lock_mm(mm);
+		if (!copy_from_user(mm, kbuf, buf, len, 0)) {
+			unlock_mm(mm);
+			kfree(kbuf);
+			return -E_INVAL;
+		}
+		unlock_mm(mm);
+		kbuf[len] = '\0';
+		ret = ftrace_set_filter(kbuf);
+		kfree(kbuf);
+		return ret;
+	}
+	n = ftrace_show(kbuf, len);
+	lock_mm(mm);
+	if (!copy_to_user(mm, buf, kbuf, n)) {
+		unlock_mm(mm);
+		kfree(kbuf);
+		return -E_INVAL;
+	}
+	unlock_mm(mm);
+	kfree(kbuf);
+	return n;
+}
@@ -0,0 +1,16 @@
+#ifndef __KERN_DEBUG_FTRACE_H__
+#define __KERN_DEBUG_FTRACE_H__
+
+#include <types.h>
+
+void ftrace_mcount(uintptr_t frompc, uintptr_t selfpc);
+
+int ftrace_start(void);
+void ftrace_stop(void);
+int ftrace_set_filter(const char *spec);
+void ftrace_clear_filters(void);
+size_t ftrace_show(char *buf, size_t size);
+
+int do_ftrace(int op, char __user * buf, size_t len);
+
+#endif /* !__KERN_DEBUG_FTRACE_H__ */
@@ -0,0 +1,62 @@
+#include <types.h>
+#include <arch.h>
+#include <string.h>
+#include <trap.h>
+#include <static_key.h>
+
+/*
+ * The sites are patched while the other cpus may run them, and a cpu must
+ * never fetch half of the old instruction and half of the new one. As the
+ * text_poke_bp of Linux does, the first byte becomes an int3, then the
+ * other 4 bytes are written, then the first byte of the new instruction;
+ * each step is followed by jump_label_sync. A cpu on the site meanwhile
+ * takes the int3 and resumes where the site leads once patched. The kernel
+ * text is in the writable direct map.
+ *
+ * This file is built without -pg, as is trap(): the int3 may be the one of
+ * mcount.
+ */
+
+static const uint8_t jump_label_nop[JUMP_LABEL_NOP_SIZE] =
+    { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+
+/* the site being patched, and where its int3 resumes */
+static volatile uintptr_t poke_addr, poke_resume;
+
+// jump_label_int3 - resume a cpu that ran into the int3 of a site being
+//                 - patched, tf being the trap of the int3
+bool jump_label_int3(struct trapframe *tf)
+{
+	uintptr_t addr = poke_addr;
+	if (addr != 0 && tf->tf_rip - 1 == addr) {
+		tf->tf_rip = poke_resume;
+		return 1;
+	}
+	return 0;
+}
+
+void arch_jump_label_transform(struct jump_entry *e, bool enable)
+{
+	uint8_t code[JUMP_LABEL_NOP_SIZE], *site = (uint8_t *) e->code;
+	if (enable) {
+		int32_t rel = e->target - (e->code + JUMP_LABEL_NOP_SIZE);
+		code[0] = 0xe9;
+		memcpy(code + 1, &rel, sizeof(rel));
+	} else {
+		memcpy(code, jump_label_nop, sizeof(code));
+	}
+	if (memcmp(site, code, sizeof(code)) == 0) {
+		return;
+	}
+	poke_resume = enable ? e->target : e->code + JUMP_LABEL_NOP_SIZE;
+	poke_addr = e->code;
+	barrier();
+	site[0] = 0xcc;
+	jump_label_sync();
+	memcpy(site + 1, code + 1, sizeof(code) - 1);
+	jump_label_sync();
+	site[0] = code[0];
+	jump_label_sync();
+	/* the int3 handlers run with interrupts off, all have returned */
+	poke_addr = 0;
+}
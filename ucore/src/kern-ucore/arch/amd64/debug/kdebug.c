@@ -9,6 +9,16 @@
 
 #define STACKFRAME_DEPTH 20
 
+/* *
+ * The text symbols sorted by address, from `nm -n` of the kernel by
+ * ksyms.sh, linked in by a second pass with UCONFIG_SAMPLE_PROFILER or
+ * UCONFIG_PROFILER_ON.
+ * Absent otherwise, so the references are weak.
+ * */
+extern const uint64_t __ksym_count __attribute__ ((weak));
+extern const uintptr_t __ksym_addrs[] __attribute__ ((weak));
+extern const char *const __ksym_names[] __attribute__ ((weak));
+
 /* *
  * print_kerninfo - print the information about kernel, including the location
  * of kernel entry, the start addresses of data and text segements, the start
@@ -29,6 +39,50 @@ void print_kerninfo(void)
 		(end - kern_init + 1023) / 1024);
 }
 
+// ksym_lookup - the name of the function holding addr and its start in
+//             - *start, NULL if there is no symbol table or addr is not text
+const char *ksym_lookup(uintptr_t addr, uintptr_t * start)
+{
+	extern char __kern_ro_start[];
+	if (&__ksym_count == NULL || __ksym_count == 0
+	    || addr < __ksym_addrs[0] || addr >= (uintptr_t) __kern_ro_start) {
+		return NULL;
+	}
+	uint64_t l = 0, r = __ksym_count - 1;
+	while (l < r) {
+		uint64_t m = (l + r + 1) / 2;
+		if (__ksym_addrs[m] <= addr) {
+			l = m;
+		} else {
+			r = m - 1;
+		}
+	}
+	*start = __ksym_addrs[l];
+	return __ksym_names[l];
+}
+
+// ksym_lookup_name - the function name spans [*start, *end), 0 if found
+int ksym_lookup_name(const char *name, uintptr_t * start, uintptr_t * end)
+{
+	extern char __kern_ro_start[];
+	uint64_t i, j;
+	if (&__ksym_count == NULL) {
+		return -1;
+	}
+	for (i = 0; i < __ksym_count; i++) {
+		if (strcmp(__ksym_names[i], name) == 0) {
+			/* the aliases share the address */
+			for (j = i + 1; j < __ksym_count
+			     && __ksym_addrs[j] == __ksym_addrs[i]; j++) ;
+			*start = __ksym_addrs[i];
+			*end = (j < __ksym_count) ? __ksym_addrs[j] :
+			    (uintptr_t) __kern_ro_start;
+			return 0;
+		}
+	}
+	return -1;
+}
+
 static uint64_t read_rip(void) __attribute__ ((noinline));
 
 static uint64_t read_rip(void)
@@ -48,7 +102,14 @@ void print_stackframe(void)
 
 	int i, j;
 	for (i = 0; rbp != 0 && i < STACKFRAME_DEPTH; i++) {
-		kprintf("rbp:%p rip:%p\n", rbp, rip);
+		uintptr_t start;
+		const char *name = ksym_lookup(rip, &start);
+		if (name != NULL) {
+			kprintf("rbp:%p rip:%p %s+0x%x\n", rbp, rip, name,
+				rip - start);
+		} else {
+			kprintf("rbp:%p rip:%p\n", rbp, rip);
+		}
 		rip = ((uint64_t *) rbp)[1];
 		rbp = ((uint64_t *) rbp)[0];
 	}
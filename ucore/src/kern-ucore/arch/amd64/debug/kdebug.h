@@ -5,5 +5,7 @@
 
 void print_kerninfo(void);
 void print_stackframe(void);
+const char *ksym_lookup(uintptr_t addr, uintptr_t * start);
+int ksym_lookup_name(const char *name, uintptr_t * start, uintptr_t * end);
 
 #endif /* !__KERN_DEBUG_KDEBUG_H__ */
@@ -0,0 +1,411 @@
+#include <types.h>
+#include <arch.h>
+#include <msrbits.h>
+#include <stdio.h>
+#include <string.h>
+#include <trap.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <lapic.h>
+#include <cpuid.h>
+#include <slab.h>
+#include <vmm.h>
+#include <proc.h>
+#include <unistd.h>
+#include <kdebug.h>
+#include <kprof.h>
+#include <error.h>
+#include <kio.h>
+
+/*
+ * The sampling profiler. Each cpu keeps the last KPROF_SAMPLES samples in
+ * its own ring, written by itself only, from the interrupt that samples:
+ *
+ *   - with the PMU, the NMI of the overflow of the unhalted core cycles
+ *     counter, every KPROF_PERIOD cycles, so that the code run with the
+ *     interrupts off is seen too;
+ *   - else, or asked for, the LAPIC timer, on each clock tick;
+ *   - and the overflows of the counters opened with a period, see perf.c,
+ *     which counter 0 is left to.
+ *
+ * A sample is the interrupted rip, the kernel frames from its rbp (the
+ * kernel keeps the frame pointers, -O0) and the pid. kprof_state tells
+ * the cpus what to do, each arms or disarms its counter at its next tick.
+ *
+ * The dumps name the functions by ksym_lookup, the hottest first, or fold
+ * the stacks as "outer;...;inner count" lines for flamegraph.pl.
+ */
+
+#define KPROF_SAMPLES               1024
+#define KPROF_DEPTH                 12
+#define KPROF_PERIOD                1000000	// cycles between two samples
+#define KPROF_BUCKETS               512
+#define KPROF_BUFSIZE               (128 * 1024)
+
+/* unhalted core cycles, the architectural event 0x3c, umask 0 */
+#define KPROF_EVENT                 0x3c
+
+enum {
+	KPROF_OFF,
+	KPROF_PMU,
+	KPROF_TIMER,
+};
+
+struct kprof_sample {
+	int pid;
+	uint8_t user;
+	uint8_t depth;
+	uintptr_t pc[KPROF_DEPTH];
+};
+
+struct kprof_cpu {
+	struct kprof_sample *ring;
+	uint64_t head;		// samples taken, the ring keeps the last ones
+	bool armed;		// the counter of this cpu is counting
+};
+
+static DEFINE_PERCPU_NOINIT(struct kprof_cpu, kprof_cpus);
+
+static volatile int kprof_state = KPROF_OFF;
+static int kprof_pmu_version;
+static uint64_t kprof_cnt_mask;
+
+static void kprof_pmu_arm(struct kprof_cpu *cpu)
+{
+	writemsr(MSR_INTEL_PERF_SEL0, 0);
+	writemsr(MSR_INTEL_PERF_CNT0, -(uint64_t) KPROF_PERIOD & kprof_cnt_mask);
+	if (kprof_pmu_version >= 2) {
+		writemsr(MSR_INTEL_PERF_GLOBAL_CTRL,
+			 readmsr(MSR_INTEL_PERF_GLOBAL_CTRL) | 1);
+	}
+	lapic_pc_mask(0);
+	writemsr(MSR_INTEL_PERF_SEL0, KPROF_EVENT | PERF_SEL_USR | PERF_SEL_OS
+		 | PERF_SEL_INT | PERF_SEL_ENABLE);
+	cpu->armed = 1;
+}
+
+static void kprof_pmu_disarm(struct kprof_cpu *cpu)
+{
+	writemsr(MSR_INTEL_PERF_SEL0, 0);
+	cpu->armed = 0;
+}
+
+// kprof_record - take a sample of tf into the ring of cpu
+static void kprof_record(struct kprof_cpu *cpu, struct trapframe *tf)
+{
+	struct kprof_sample *s = cpu->ring + cpu->head % KPROF_SAMPLES;
+	s->pid = (current != NULL) ? current->pid : -1;
+	s->user = !trap_in_kernel(tf);
+	s->pc[0] = tf->tf_rip;
+	s->depth = 1;
+	if (s->user || current == NULL || current->kstack == 0) {
+		goto out;
+	}
+	/* only the frames within the kernel stack, each above the last */
+	uintptr_t lo = current->kstack, hi = lo + KSTACKSIZE;
+	uintptr_t rbp = tf->tf_regs.reg_rbp;
+	while (s->depth < KPROF_DEPTH && rbp >= lo && rbp + 16 <= hi
+	       && (rbp & 7) == 0) {
+		uintptr_t *frame = (uintptr_t *) rbp;
+		s->pc[s->depth++] = frame[1];
+		if (frame[0] <= rbp) {
+			break;
+		}
+		rbp = frame[0];
+	}
+out:
+	cpu->head++;
+}
+
+// kprof_tick - on the clock tick of each cpu
+void kprof_tick(struct trapframe *tf)
+{
+	struct kprof_cpu *cpu = get_cpu_ptr(kprof_cpus);
+	int state = kprof_state;
+	if (state == KPROF_PMU && !cpu->armed) {
+		kprof_pmu_arm(cpu);
+	} else if (state != KPROF_PMU && cpu->armed) {
+		kprof_pmu_disarm(cpu);
+	}
+	if (state == KPROF_TIMER) {
+		kprof_record(cpu, tf);
+	}
+}
+
+// kprof_nmi - take a sample if the NMI is the overflow of the counter,
+//           - false if it is not ours
+bool kprof_nmi(struct trapframe *tf)
+{
+	struct kprof_cpu *cpu = get_cpu_ptr(kprof_cpus);
+	if (!cpu->armed) {
+		return 0;
+	}
+	/* counting up from -KPROF_PERIOD, the top bit clears on overflow */
+	uint64_t cnt = readmsr(MSR_INTEL_PERF_CNT0);
+	if (cnt & ((kprof_cnt_mask >> 1) + 1)) {
+		return 0;
+	}
+	if (kprof_state != KPROF_PMU) {
+		kprof_pmu_disarm(cpu);
+		return 1;
+	}
+	kprof_record(cpu, tf);
+	writemsr(MSR_INTEL_PERF_CNT0, -(uint64_t) KPROF_PERIOD & kprof_cnt_mask);
+	if (kprof_pmu_version >= 2) {
+		writemsr(MSR_INTEL_PERF_GLOBAL_OVF_CTRL, 1);
+	}
+	/* the delivery masked the LVT */
+	lapic_pc_mask(0);
+	return 1;
+}
+
+// kprof_sample - take a sample of tf on the overflow of a counter of
+//              - perf.c, once the rings are there
+void kprof_sample(struct trapframe *tf)
+{
+	struct kprof_cpu *cpu = get_cpu_ptr(kprof_cpus);
+	if (cpu->ring != NULL) {
+		kprof_record(cpu, tf);
+	}
+}
+
+// kprof_alloc - the rings of the cpus, allocated if not yet
+int kprof_alloc(void)
+{
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct kprof_cpu *cpu = per_cpu_ptr(kprof_cpus, i);
+		if (cpu->ring == NULL) {
+			cpu->ring =
+			    kmalloc(sizeof(struct kprof_sample) * KPROF_SAMPLES);
+			if (cpu->ring == NULL) {
+				return -E_NO_MEM;
+			}
+		}
+	}
+	return 0;
+}
+
+// kprof_start - sample by the PMU if there is one and not timer, else by
+//             - the clock tick, from the next tick of each cpu on
+int kprof_start(bool timer)
+{
+	int i, ret;
+	if (kprof_state != KPROF_OFF) {
+		return -E_BUSY;
+	}
+	if ((ret = kprof_alloc()) != 0) {
+		return ret;
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		per_cpu_ptr(kprof_cpus, i)->head = 0;
+	}
+	if (!timer && cpuid_check_feature(CPUID_FEATURE_ARCH_PERFMON)) {
+		uint32_t eax = cpuid_perfmon();
+		kprof_pmu_version = eax & 0xff;
+		kprof_cnt_mask = (1ULL << ((eax >> 16) & 0xff)) - 1;
+		timer = 0;
+	} else {
+		timer = 1;
+	}
+	__sync_synchronize();
+	kprof_state = timer ? KPROF_TIMER : KPROF_PMU;
+	kprintf("kprof: sampling by the %s\n", timer ? "timer" : "pmu");
+	return 0;
+}
+
+void kprof_stop(void)
+{
+	kprof_state = KPROF_OFF;
+}
+
+/* a sample with each pc turned into the start of its function */
+struct kprof_stack {
+	int depth;
+	uintptr_t fn[KPROF_DEPTH];
+	int count;
+};
+
+static void kprof_symbolize(struct kprof_sample *s, struct kprof_stack *st)
+{
+	int i;
+	st->depth = s->depth;
+	for (i = 0; i < s->depth; i++) {
+		uintptr_t start;
+		st->fn[i] = (ksym_lookup(s->pc[i], &start) != NULL) ?
+		    start : s->pc[i];
+	}
+}
+
+static uint32_t kprof_hash(struct kprof_stack *st, int depth)
+{
+	uint32_t h = 0;
+	int i;
+	for (i = 0; i < depth; i++) {
+		h = h * 31 + (uint32_t) (st->fn[i] ^ (st->fn[i] >> 32));
+	}
+	return h;
+}
+
+// kprof_aggregate - count the samples of every cpu by their first depth
+//                 - functions (all of them if depth is 0) into buckets,
+//                 - the number of samples left out for a full table in
+//                 - *lost, the number of samples is returned
+static int kprof_aggregate(struct kprof_stack *buckets, int depth, int *lost)
+{
+	struct kprof_stack st;
+	int cpu, i, nr = 0;
+	*lost = 0;
+	for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+		struct kprof_cpu *kc = per_cpu_ptr(kprof_cpus, cpu);
+		uint64_t n = (kc->head < KPROF_SAMPLES) ? kc->head : KPROF_SAMPLES;
+		if (kc->ring == NULL) {
+			continue;
+		}
+		for (i = 0; i < n; i++, nr++) {
+			kprof_symbolize(kc->ring + i, &st);
+			int d = (depth == 0 || depth > st.depth) ? st.depth : depth;
+			uint32_t h = kprof_hash(&st, d) % KPROF_BUCKETS, probe;
+			for (probe = 0; probe < KPROF_BUCKETS; probe++) {
+				struct kprof_stack *b =
+				    buckets + (h + probe) % KPROF_BUCKETS;
+				if (b->count == 0) {
+					b->depth = d;
+					memcpy(b->fn, st.fn, sizeof(uintptr_t) * d);
+				} else if (b->depth != d || memcmp(b->fn, st.fn,
+								   sizeof(uintptr_t)
+								   * d) != 0) {
+					continue;
+				}
+				b->count++;
+				break;
+			}
+			if (probe == KPROF_BUCKETS) {
+				(*lost)++;
+			}
+		}
+	}
+	return nr;
+}
+
+static size_t kprof_name(char *buf, size_t size, uintptr_t fn)
+{
+	uintptr_t start;
+	const char *name = ksym_lookup(fn, &start);
+	if (name != NULL) {
+		return snprintf(buf, size, "%s", name);
+	}
+	return snprintf(buf, size, "%p", fn);
+}
+
+// kprof_show_top - the n functions most sampled in, into buf
+size_t kprof_show_top(char *buf, size_t size, int n)
+{
+	struct kprof_stack *buckets;
+	int nr, lost, i, j;
+	size_t len = 0;
+	if ((buckets =
+	     kmalloc(sizeof(struct kprof_stack) * KPROF_BUCKETS)) == NULL) {
+		return 0;
+	}
+	memset(buckets, 0, sizeof(struct kprof_stack) * KPROF_BUCKETS);
+	nr = kprof_aggregate(buckets, 1, &lost);
+	len += snprintf(buf + len, size - len, "%d samples, %d lost\n", nr,
+			lost);
+	for (i = 0; i < n && len < size; i++) {
+		struct kprof_stack *top = NULL;
+		for (j = 0; j < KPROF_BUCKETS; j++) {
+			if (buckets[j].count > 0
+			    && (top == NULL || buckets[j].count > top->count)) {
+				top = buckets + j;
+			}
+		}
+		if (top == NULL) {
+			break;
+		}
+		len += snprintf(buf + len, size - len, "%6d %3d%% ", top->count,
+				top->count * 100 / nr);
+		if (len < size) {
+			len += kprof_name(buf + len, size - len, top->fn[0]);
+		}
+		if (len < size) {
+			len += snprintf(buf + len, size - len, "\n");
+		}
+		top->count = 0;
+	}
+	kfree(buckets);
+	return (len < size) ? len : size;
+}
+
+// kprof_show_folded - the stacks folded for flamegraph.pl, into buf
+size_t kprof_show_folded(char *buf, size_t size)
+{
+	struct kprof_stack *buckets;
+	int lost, i, j;
+	size_t len = 0;
+	if ((buckets =
+	     kmalloc(sizeof(struct kprof_stack) * KPROF_BUCKETS)) == NULL) {
+		return 0;
+	}
+	memset(buckets, 0, sizeof(struct kprof_stack) * KPROF_BUCKETS);
+	kprof_aggregate(buckets, 0, &lost);
+	for (i = 0; i < KPROF_BUCKETS && len < size; i++) {
+		struct kprof_stack *b = buckets + i;
+		if (b->count == 0) {
+			continue;
+		}
+		/* the outermost frame first */
+		for (j = b->depth - 1; j >= 0 && len < size; j--) {
+			len += kprof_name(buf + len, size - len, b->fn[j]);
+			if (j > 0 && len < size) {
+				len += snprintf(buf + len, size - len, ";");
+			}
+		}
+		if (len < size) {
+			len += snprintf(buf + len, size - len, " %d\n",
+					b->count);
+		}
+	}
+	kfree(buckets);
+	return (len < size) ? len : size;
+}
+
+// do_profile - SYS_profile, start or stop the profiler, or dump it into buf
+int do_profile(int op, char __user * buf, size_t len)
+{
+	struct mm_struct *mm = current->mm;
+	char *kbuf;
+	size_t n;
+	switch (op) {
+	case PROFILE_START:
+		return kprof_start(0);
+	case PROFILE_START_TIMER:
+		return kprof_start(1);
+	case PROFILE_STOP:
+		kprof_stop();
+		return 0;
+	case PROFILE_TOP:
+	case PROFILE_FOLDED:
+		break;
+	default:
+		return -E_INVAL;
+	}
+	if (len > KPROF_BUFSIZE) {
+		len = KPROF_BUFSIZE;
+	}
+	if (len == 0 || (kbuf = kmalloc(len)) == NULL) {
+		return -E_NO_MEM;
+	}
+	n = (op == PROFILE_TOP) ? kprof_show_top(kbuf, len, 20) :
+	    kprof_show_folded(kbuf, len);
+	lock_mm(mm);
+	if (!copy_to_user(mm, buf, kbuf, n)) {
+		unlock_mm(mm);
+		kfree(kbuf);
+		return -E_INVAL;
+	}
+	unlock_mm(mm);
+	kfree(kbuf);
+	return n;
+}
@@ -0,0 +1,20 @@
+#ifndef __KERN_DEBUG_KPROF_H__
+#define __KERN_DEBUG_KPROF_H__
+
+#include <types.h>
+
+struct trapframe;
+
+void kprof_tick(struct trapframe *tf);
+bool kprof_nmi(struct trapframe *tf);
+void kprof_sample(struct trapframe *tf);
+
+int kprof_alloc(void);
+int kprof_start(bool timer);
+void kprof_stop(void);
+size_t kprof_show_top(char *buf, size_t size, int n);
+size_t kprof_show_folded(char *buf, size_t size);
+
+int do_profile(int op, char __user * buf, size_t len);
+
+#endif /* !__KERN_DEBUG_KPROF_H__ */
@@ -4,6 +4,20 @@
 #include <monitor.h>
 #include <kdebug.h>
 #include <kio.h>
+#include <spinlock.h>
+#if defined(UCONFIG_SAMPLE_PROFILER) || defined(UCONFIG_PROFILER_ON) \
+    || defined(UCONFIG_KMALLOC_PROFILE)
+#include <slab.h>
+#endif
+#ifdef UCONFIG_SAMPLE_PROFILER
+#include <kprof.h>
+#endif
+#ifdef UCONFIG_PROFILER_ON
+#include <ftrace.h>
+#endif
+#ifdef UCONFIG_BOOT_TIME
+#include <boottime.h>
+#endif
 
 /* *
  * Simple command-line kernel monitor useful for controlling the
@@ -21,6 +35,21 @@ static struct command commands[] = {
 	{"help", "Display this list of commands.", mon_help},
 	{"kerninfo", "Display information about the kernel.", mon_kerninfo},
 	{"backtrace", "Print backtrace of stack frame.", mon_backtrace},
+#ifdef UCONFIG_LOCK_STAT
+	{"lockstat", "Display the contention of the locks and their sites, or reset.", mon_lockstat},
+#endif
+#ifdef UCONFIG_SAMPLE_PROFILER
+	{"profile", "Sample the kernel: start [timer], stop, top or folded.", mon_profile},
+#endif
+#ifdef UCONFIG_PROFILER_ON
+	{"ftrace", "Trace the function entries: start, stop, filter <f>, clear or dump.", mon_ftrace},
+#endif
+#ifdef UCONFIG_KMALLOC_PROFILE
+	{"kmallocs", "Display the memory kmalloc'd by each call site.", mon_kmallocs},
+#endif
+#ifdef UCONFIG_BOOT_TIME
+	{"boottime", "Display the time taken by the boot phases.", mon_boottime},
+#endif
 };
 
 #define NCOMMANDS (sizeof(commands)/sizeof(struct command))
@@ -125,3 +154,140 @@ int mon_backtrace(int argc, char **argv, struct trapframe *tf)
 	print_stackframe();
 	return 0;
 }
+
+#ifdef UCONFIG_LOCK_STAT
+/* *
+ * mon_lockstat - call lock_stat_print in arch/amd64/libs/spinlock.c to
+ * print the counters of the registered locks and of the lock classes by
+ * site, or lock_stat_reset to clear them with "reset".
+ * */
+int mon_lockstat(int argc, char **argv, struct trapframe *tf)
+{
+	if (argc > 0 && strcmp(argv[0], "reset") == 0) {
+		lock_stat_reset();
+	} else {
+		lock_stat_print();
+	}
+	return 0;
+}
+#endif
+
+#ifdef UCONFIG_KMALLOC_PROFILE
+/* *
+ * mon_kmallocs - call kmalloc_profile_show in mm/slab.c to print the call
+ * sites of kmalloc with objs live, those holding the most bytes first.
+ * */
+int mon_kmallocs(int argc, char **argv, struct trapframe *tf)
+{
+	size_t size = 64 * 1024, len;
+	char *buf;
+	if ((buf = kmalloc(size)) == NULL) {
+		kprintf("kmallocs: no memory.\n");
+		return 0;
+	}
+	len = kmalloc_profile_show(buf, size - 1);
+	buf[len] = '\0';
+	kprintf("%s", buf);
+	kfree(buf);
+	return 0;
+}
+#endif
+
+#ifdef UCONFIG_BOOT_TIME
+/* *
+ * mon_boottime - call boot_time_print in arch/amd64/debug/boottime.c to
+ * print the boot phases recorded by boot_call and the async initcalls.
+ * */
+int mon_boottime(int argc, char **argv, struct trapframe *tf)
+{
+	boot_time_print();
+	return 0;
+}
+#endif
+
+#ifdef UCONFIG_SAMPLE_PROFILER
+/* *
+ * mon_profile - start or stop the sampling profiler of
+ * arch/amd64/debug/kprof.c, or print the hottest functions or the
+ * stacks folded for flamegraph.pl.
+ * */
+int mon_profile(int argc, char **argv, struct trapframe *tf)
+{
+	size_t size = 64 * 1024, len;
+	char *buf;
+	int ret;
+	if (argc == 0) {
+		kprintf("usage: profile start [timer] | stop | top | folded\n");
+		return 0;
+	}
+	if (strcmp(argv[0], "start") == 0) {
+		bool timer = (argc > 1 && strcmp(argv[1], "timer") == 0);
+		if ((ret = kprof_start(timer)) != 0) {
+			kprintf("profile: cannot start, %e.\n", ret);
+		}
+		return 0;
+	}
+	if (strcmp(argv[0], "stop") == 0) {
+		kprof_stop();
+		return 0;
+	}
+	if ((buf = kmalloc(size)) == NULL) {
+		kprintf("profile: no memory.\n");
+		return 0;
+	}
+	if (strcmp(argv[0], "top") == 0) {
+		len = kprof_show_top(buf, size - 1, 20);
+	} else if (strcmp(argv[0], "folded") == 0) {
+		len = kprof_show_folded(buf, size - 1);
+	} else {
+		kprintf("profile: unknown '%s'.\n", argv[0]);
+		len = 0;
+	}
+	buf[len] = '\0';
+	kprintf("%s", buf);
+	kfree(buf);
+	return 0;
+}
+#endif
+
+#ifdef UCONFIG_PROFILER_ON
+/* *
+ * mon_ftrace - start or stop the function tracer of
+ * arch/amd64/debug/ftrace.c, filter it by a function "name", a module
+ * function "module:name" or a whole "[module]", or print its entries.
+ * */
+int mon_ftrace(int argc, char **argv, struct trapframe *tf)
+{
+	size_t size = 64 * 1024, len;
+	char *buf;
+	int ret = 0;
+	if (argc == 0) {
+		kprintf("usage: ftrace start | stop | filter <f> | clear | dump\n");
+		return 0;
+	}
+	if (strcmp(argv[0], "start") == 0) {
+		ret = ftrace_start();
+	} else if (strcmp(argv[0], "stop") == 0) {
+		ftrace_stop();
+	} else if (strcmp(argv[0], "filter") == 0 && argc > 1) {
+		ret = ftrace_set_filter(argv[1]);
+	} else if (strcmp(argv[0], "clear") == 0) {
+		ftrace_clear_filters();
+	} else if (strcmp(argv[0], "dump") == 0) {
+		if ((buf = kmalloc(size)) == NULL) {
+			kprintf("ftrace: no memory.\n");
+			return 0;
+		}
+		len = ftrace_show(buf, size - 1);
+		buf[len] = '\0';
+		kprintf("%s", buf);
+		kfree(buf);
+	} else {
+		kprintf("ftrace: unknown '%s'.\n", argv[0]);
+	}
+	if (ret != 0) {
+		kprintf("ftrace: %s failed, %e.\n", argv[0], ret);
+	}
+	return 0;
+}
+#endif
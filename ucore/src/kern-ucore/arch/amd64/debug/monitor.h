@@ -8,5 +8,10 @@ void monitor(struct trapframe *tf);
 int mon_help(int argc, char **argv, struct trapframe *tf);
 int mon_kerninfo(int argc, char **argv, struct trapframe *tf);
 int mon_backtrace(int argc, char **argv, struct trapframe *tf);
+int mon_lockstat(int argc, char **argv, struct trapframe *tf);
+int mon_profile(int argc, char **argv, struct trapframe *tf);
+int mon_ftrace(int argc, char **argv, struct trapframe *tf);
+int mon_kmallocs(int argc, char **argv, struct trapframe *tf);
+int mon_boottime(int argc, char **argv, struct trapframe *tf);
 
 #endif /* !__KERN_DEBUG_MONITOR_H__ */
@@ -0,0 +1,483 @@
+#include <types.h>
+#include <arch.h>
+#include <msrbits.h>
+#include <string.h>
+#include <trap.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <lapic.h>
+#include <cpuid.h>
+#include <spinlock.h>
+#include <rcu.h>
+#include <vmm.h>
+#include <proc.h>
+#include <unistd.h>
+#include <perf_event.h>
+#include <kprof.h>
+#include <perf.h>
+#include <error.h>
+#include <assert.h>
+
+/*
+ * The counters of SYS_perf, on the general-purpose counters of the
+ * architectural PMU but counter 0, which kprof.c has. A counter is one of
+ * perf_counters, its id the index there, and has a PMC of its own:
+ *
+ *   - that of a task (arch.perf has the ids of its counters) is loaded
+ *     at proc_run into the task, and unloaded from it, the count kept;
+ *   - that of a cpu is loaded at the next tick of the cpu, and counts
+ *     all that runs there until closed.
+ *
+ * The counters of a task take the PMCs no cpu's takes, and the other way
+ * round, so they never meet on a cpu. Each tick folds the counts of the
+ * cpu into their counters, which are read from the other cpus that way,
+ * a tick late at most; the cpu a counter is loaded on reads it at once.
+ *
+ * A counter with a period starts at -left and interrupts by the NMI of
+ * the LVT on its overflow, which takes a sample into the ring of kprof.c
+ * and starts it again at -period. The NMI never takes perf_lock: it only
+ * touches the counters loaded on its cpu, and only while their PMC is
+ * enabled, which the tick and proc_run disable before they touch them.
+ */
+
+#define PERF_MAX_COUNTERS           32	// in arch.perf, a bit each
+#define PERF_MAX_PMC                8
+
+struct perf_counter {
+	bool used;
+	bool closed;		// to free once unloaded
+	bool loaded;		// in its PMC, on loaded_cpu
+	int loaded_cpu;
+	int pmc;
+	int cpu;		// that of a counter of a cpu, -1 for a task
+	struct proc_struct *task;	// counted, NULL once freed
+	struct proc_struct *owner;	// opened it, closes it at its end
+	uint64_t sel;		// the value of its PERF_SEL
+	uint64_t count;		// folded, as of the last fold
+	uint64_t start;		// the PMC since the last fold
+	uint64_t period, left;	// the events to the next sample
+};
+
+struct perf_cpu {
+	struct perf_counter *loaded[PERF_MAX_PMC];
+	struct perf_counter *cpu_counters[PERF_MAX_PMC];	// to load
+	bool dirty;		// cpu_counters changed since the last tick
+};
+
+static struct perf_counter perf_counters[PERF_MAX_COUNTERS];
+static DEFINE_PERCPU_NOINIT(struct perf_cpu, perf_cpus);
+static spinlock_s perf_lock;
+
+static int perf_nr_used;	// of perf_counters
+static bool perf_probed;
+static int perf_version, perf_nr_pmc;
+static uint64_t perf_cnt_mask;
+static uint32_t perf_events;	// PERF_EV_xxx the cpu counts, a bit each
+/* # of the counters, of a task or of a cpu, on each PMC */
+static int perf_task_pmc[PERF_MAX_PMC], perf_cpu_pmc[PERF_MAX_PMC];
+
+/* the event selects and umasks of the architectural events */
+static const uint16_t perf_event_sel[PERF_NR_EVENTS] = {
+	[PERF_EV_CYCLES] = 0x003c,
+	[PERF_EV_INSTRUCTIONS] = 0x00c0,
+	[PERF_EV_REF_CYCLES] = 0x013c,
+	[PERF_EV_LLC_REFERENCES] = 0x4f2e,
+	[PERF_EV_LLC_MISSES] = 0x412e,
+	[PERF_EV_BRANCHES] = 0x00c4,
+	[PERF_EV_BRANCH_MISSES] = 0x00c5,
+};
+
+// perf_probe - the counters and events of the PMU, from CPUID 0xa once;
+//            - perf_lock held
+static bool perf_probe(void)
+{
+	if (!perf_probed) {
+		uint32_t eax = cpuid_perfmon(), ebx = cpuid_perfmon_events();
+		int ev;
+		perf_probed = 1;
+		if (!cpuid_check_feature(CPUID_FEATURE_ARCH_PERFMON)) {
+			return 0;
+		}
+		perf_version = eax & 0xff;
+		perf_nr_pmc = (eax >> 8) & 0xff;
+		if (perf_nr_pmc > PERF_MAX_PMC) {
+			perf_nr_pmc = PERF_MAX_PMC;
+		}
+		perf_cnt_mask = (1ULL << ((eax >> 16) & 0xff)) - 1;
+		/* the length of the vector of ebx, the events past it lack */
+		for (ev = 0; ev < PERF_NR_EVENTS && ev < (eax >> 24); ev++) {
+			if (!(ebx & (1 << ev))) {
+				perf_events |= (1 << ev);
+			}
+		}
+	}
+	return perf_nr_pmc > 1 && perf_events != 0;
+}
+
+void perf_init(void)
+{
+	spinlock_init(&perf_lock);
+}
+
+// perf_load - load c into its PMC on this cpu, the interrupts off
+static void perf_load(struct perf_cpu *pc, struct perf_counter *c)
+{
+	assert(pc->loaded[c->pmc] == NULL);
+	c->start = (c->period != 0) ? -c->left & perf_cnt_mask : 0;
+	writemsr(MSR_INTEL_PERF_SEL0 + c->pmc, 0);
+	writemsr(MSR_INTEL_PERF_CNT0 + c->pmc, c->start);
+	if (perf_version >= 2) {
+		writemsr(MSR_INTEL_PERF_GLOBAL_CTRL,
+			 readmsr(MSR_INTEL_PERF_GLOBAL_CTRL) | (1 << c->pmc));
+	}
+	c->loaded = 1, c->loaded_cpu = myid();
+	pc->loaded[c->pmc] = c;
+	if (c->period != 0) {
+		lapic_pc_mask(0);
+	}
+	writemsr(MSR_INTEL_PERF_SEL0 + c->pmc, c->sel);
+}
+
+// perf_fold - add what the stopped PMC of c counted since the last fold
+static void perf_fold(struct perf_counter *c)
+{
+	uint64_t cnt = readmsr(MSR_INTEL_PERF_CNT0 + c->pmc);
+	uint64_t delta = (cnt - c->start) & perf_cnt_mask;
+	c->count += delta, c->start = cnt;
+	if (c->period == 0) {
+		return;
+	}
+	if (delta < c->left) {
+		c->left -= delta;
+	} else {
+		/* an overflow the NMI did not see starts the period over */
+		c->left = c->period, c->start = -c->period & perf_cnt_mask;
+		writemsr(MSR_INTEL_PERF_CNT0 + c->pmc, c->start);
+	}
+}
+
+// perf_release - c is not used any more, its PMC is free; perf_lock held
+static void perf_release(struct perf_counter *c)
+{
+	if (c->cpu >= 0) {
+		perf_cpu_pmc[c->pmc]--;
+	} else {
+		perf_task_pmc[c->pmc]--;
+	}
+	c->used = 0, perf_nr_used--;
+}
+
+// perf_unload - take c out of its PMC on this cpu, the count kept, and
+//             - free it if closed; perf_lock held
+static void perf_unload(struct perf_cpu *pc, struct perf_counter *c)
+{
+	writemsr(MSR_INTEL_PERF_SEL0 + c->pmc, 0);
+	perf_fold(c);
+	pc->loaded[c->pmc] = NULL;
+	c->loaded = 0;
+	if (c->closed) {
+		if (c->task != NULL) {
+			c->task->arch.perf &= ~(1 << (c - perf_counters));
+		}
+		perf_release(c);
+	}
+}
+
+void __perf_switch(struct proc_struct *prev, struct proc_struct *next)
+{
+	struct perf_cpu *pc = get_cpu_ptr(perf_cpus);
+	int i;
+	spinlock_acquire(&perf_lock);
+	for (i = 0; i < perf_nr_pmc; i++) {
+		struct perf_counter *c = pc->loaded[i];
+		if (c != NULL && c->cpu < 0) {
+			perf_unload(pc, c);
+		}
+	}
+	for (i = 0; i < PERF_MAX_COUNTERS; i++) {
+		if ((next->arch.perf & (1 << i)) && !perf_counters[i].closed) {
+			perf_load(pc, perf_counters + i);
+		}
+	}
+	spinlock_release(&perf_lock);
+}
+
+// perf_tick - on the clock tick of each cpu: fold the counts, and load or
+//           - unload the counters of the cpu opened or closed since
+void perf_tick(void)
+{
+	struct perf_cpu *pc = get_cpu_ptr(perf_cpus);
+	int i;
+	for (i = 0; i < perf_nr_pmc; i++) {
+		struct perf_counter *c = pc->loaded[i];
+		if (c != NULL) {
+			writemsr(MSR_INTEL_PERF_SEL0 + i, 0);
+			perf_fold(c);
+			writemsr(MSR_INTEL_PERF_SEL0 + i, c->sel);
+		}
+	}
+	if (!pc->dirty) {
+		return;
+	}
+	spinlock_acquire(&perf_lock);
+	pc->dirty = 0;
+	for (i = 0; i < perf_nr_pmc; i++) {
+		struct perf_counter *c = pc->loaded[i];
+		struct perf_counter *want = pc->cpu_counters[i];
+		if (c != NULL && c->cpu >= 0 && c != want) {
+			perf_unload(pc, c);
+		}
+		if (want != NULL && pc->loaded[i] == NULL) {
+			perf_load(pc, want);
+		}
+	}
+	spinlock_release(&perf_lock);
+}
+
+// perf_nmi - sample on the overflows of the counters loaded on this cpu,
+//          - false if the NMI is not theirs
+bool perf_nmi(struct trapframe *tf)
+{
+	struct perf_cpu *pc = get_cpu_ptr(perf_cpus);
+	uint64_t status = 0, ovf = 0;
+	int i;
+	if (perf_version >= 2) {
+		status = readmsr(MSR_INTEL_PERF_GLOBAL_STATUS);
+	}
+	for (i = 0; i < perf_nr_pmc; i++) {
+		struct perf_counter *c = pc->loaded[i];
+		if (c == NULL || c->period == 0) {
+			continue;
+		}
+		/* counting up from -left, the top bit clears on overflow */
+		uint64_t cnt = readmsr(MSR_INTEL_PERF_CNT0 + i);
+		if (perf_version >= 2 ? !(status & (1 << i))
+		    : (cnt & ((perf_cnt_mask >> 1) + 1)) != 0) {
+			continue;
+		}
+		ovf |= (1 << i);
+		/* stopped by the tick or proc_run, which fold it */
+		if (!(readmsr(MSR_INTEL_PERF_SEL0 + i) & PERF_SEL_ENABLE)) {
+			continue;
+		}
+		c->count += (cnt - c->start) & perf_cnt_mask;
+		kprof_sample(tf);
+		c->left = c->period, c->start = -c->period & perf_cnt_mask;
+		writemsr(MSR_INTEL_PERF_CNT0 + i, c->start);
+	}
+	if (ovf == 0) {
+		return 0;
+	}
+	if (perf_version >= 2) {
+		writemsr(MSR_INTEL_PERF_GLOBAL_OVF_CTRL, ovf);
+	}
+	/* the delivery masked the LVT */
+	lapic_pc_mask(0);
+	return 1;
+}
+
+// perf_pick_pmc - a PMC for a counter of task, or of a cpu if task is
+//               - NULL, -1 if none is free; perf_lock held
+static int perf_pick_pmc(struct proc_struct *task, int cpu)
+{
+	uint32_t taken = 0;
+	int i;
+	if (task != NULL) {
+		for (i = 0; i < PERF_MAX_COUNTERS; i++) {
+			if (task->arch.perf & (1 << i)) {
+				taken |= (1 << perf_counters[i].pmc);
+			}
+		}
+	} else {
+		struct perf_cpu *pc = per_cpu_ptr(perf_cpus, cpu);
+		for (i = 1; i < perf_nr_pmc; i++) {
+			if (pc->cpu_counters[i] != NULL) {
+				taken |= (1 << i);
+			}
+		}
+	}
+	/* a task may run on any cpu, so its PMC is taken by no cpu's */
+	for (i = 1; i < perf_nr_pmc; i++) {
+		int others = task ? perf_cpu_pmc[i] : perf_task_pmc[i];
+		if (!(taken & (1 << i)) && others == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// perf_open - a counter of attr, its id; perf_lock held
+static int perf_open(struct perf_attr *attr, struct proc_struct *task)
+{
+	struct perf_counter *c;
+	int id, pmc;
+	for (id = 0; id < PERF_MAX_COUNTERS; id++) {
+		if (!perf_counters[id].used) {
+			break;
+		}
+	}
+	if (id == PERF_MAX_COUNTERS
+	    || (pmc = perf_pick_pmc(task, attr->cpu)) < 0) {
+		return -E_BUSY;
+	}
+	c = perf_counters + id;
+	memset(c, 0, sizeof(struct perf_counter));
+	c->used = 1, c->pmc = pmc, c->owner = current;
+	perf_nr_used++;
+	c->sel = perf_event_sel[attr->event] | PERF_SEL_USR | PERF_SEL_ENABLE;
+	if (!(attr->flags & PERF_EXCLUDE_KERNEL)) {
+		c->sel |= PERF_SEL_OS;
+	}
+	if ((c->period = c->left = attr->period) != 0) {
+		c->sel |= PERF_SEL_INT;
+	}
+	if (task != NULL) {
+		c->cpu = -1, c->task = task;
+		perf_task_pmc[pmc]++;
+		task->arch.perf |= (1 << id);
+		if (task == current) {
+			perf_load(get_cpu_ptr(perf_cpus), c);
+		}
+	} else {
+		struct perf_cpu *pc = per_cpu_ptr(perf_cpus, attr->cpu);
+		c->cpu = attr->cpu;
+		perf_cpu_pmc[pmc]++;
+		pc->cpu_counters[pmc] = c, pc->dirty = 1;
+	}
+	return id;
+}
+
+// perf_close - close c, freed now or once unloaded; perf_lock held
+static void perf_close(struct perf_counter *c)
+{
+	c->closed = 1;
+	if (c->cpu >= 0) {
+		struct perf_cpu *pc = per_cpu_ptr(perf_cpus, c->cpu);
+		pc->cpu_counters[c->pmc] = NULL, pc->dirty = 1;
+	}
+	if (c->loaded && c->loaded_cpu == myid()) {
+		perf_unload(get_cpu_ptr(perf_cpus), c);
+	} else if (!c->loaded) {
+		if (c->task != NULL) {
+			c->task->arch.perf &= ~(1 << (c - perf_counters));
+		}
+		perf_release(c);
+	}
+}
+
+// perf_free - proc is freed: the counters it opened are closed, and those
+//           - of it keep their counts for their owners to read
+void perf_free(struct proc_struct *proc)
+{
+	bool intr_flag;
+	int i;
+	if (perf_nr_used == 0) {
+		return;
+	}
+	spin_lock_irqsave(&perf_lock, intr_flag);
+	for (i = 0; i < PERF_MAX_COUNTERS; i++) {
+		struct perf_counter *c = perf_counters + i;
+		if (!c->used) {
+			continue;
+		}
+		/* it ran for the last time: its counters are unloaded */
+		if (c->task == proc) {
+			c->task = NULL;
+		}
+		if (c->owner == proc && !c->closed) {
+			perf_close(c);
+		}
+	}
+	proc->arch.perf = 0;
+	spin_unlock_irqrestore(&perf_lock, intr_flag);
+}
+
+// perf_read - the count of c, at once if loaded on this cpu
+static uint64_t perf_read(struct perf_counter *c)
+{
+	uint64_t count = c->count;
+	if (c->loaded && c->loaded_cpu == myid()) {
+		count += (readmsr(MSR_INTEL_PERF_CNT0 + c->pmc) - c->start)
+		    & perf_cnt_mask;
+	}
+	return count;
+}
+
+// do_perf - SYS_perf, the ops of unistd.h on the counter id
+int do_perf(int op, int id, void __user * arg)
+{
+	struct mm_struct *mm = current->mm;
+	struct perf_counter *c;
+	struct perf_attr attr;
+	struct proc_struct *task = NULL;
+	uint64_t val;
+	bool intr_flag, ok;
+	int ret;
+	if (mm == NULL) {
+		return -E_INVAL;
+	}
+	spin_lock_irqsave(&perf_lock, intr_flag);
+	ok = perf_probe();
+	val = perf_events;
+	spin_unlock_irqrestore(&perf_lock, intr_flag);
+	if (!ok) {
+		return -E_NO_DEV;
+	}
+	switch (op) {
+	case PERF_EVENTS:
+		return val;
+	case PERF_OPEN:
+		lock_mm(mm);
+		ok = copy_from_user(mm, &attr, arg, sizeof(attr), 0);
+		unlock_mm(mm);
+		if (!ok || attr.event < 0 || attr.event >= PERF_NR_EVENTS
+		    || !(perf_events & (1 << attr.event))
+		    || (attr.pid == PERF_PID_CPU
+			&& (attr.cpu < 0 || attr.cpu >= sysconf.lcpu_count))) {
+			return -E_INVAL;
+		}
+		if (attr.period != 0 && (ret = kprof_alloc()) != 0) {
+			return ret;
+		}
+		rcu_read_lock();
+		if (attr.pid != PERF_PID_CPU) {
+			task = (attr.pid == PERF_PID_SELF) ? current :
+			    find_proc(attr.pid);
+			if (task == NULL || task->state == PROC_ZOMBIE) {
+				rcu_read_unlock();
+				return -E_INVAL;
+			}
+		}
+		spin_lock_irqsave(&perf_lock, intr_flag);
+		ret = perf_open(&attr, task);
+		spin_unlock_irqrestore(&perf_lock, intr_flag);
+		rcu_read_unlock();
+		return ret;
+	case PERF_READ:
+	case PERF_CLOSE:
+		break;
+	default:
+		return -E_INVAL;
+	}
+	if (id < 0 || id >= PERF_MAX_COUNTERS) {
+		return -E_INVAL;
+	}
+	c = perf_counters + id;
+	spin_lock_irqsave(&perf_lock, intr_flag);
+	if (!c->used || c->closed || c->owner != current) {
+		spin_unlock_irqrestore(&perf_lock, intr_flag);
+		return -E_INVAL;
+	}
+	if (op == PERF_CLOSE) {
+		perf_close(c);
+		spin_unlock_irqrestore(&perf_lock, intr_flag);
+		return 0;
+	}
+	val = perf_read(c);
+	spin_unlock_irqrestore(&perf_lock, intr_flag);
+	lock_mm(mm);
+	ok = copy_to_user(mm, arg, &val, sizeof(uint64_t));
+	unlock_mm(mm);
+	return ok ? 0 : -E_INVAL;
+}
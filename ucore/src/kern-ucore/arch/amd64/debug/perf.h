@@ -0,0 +1,28 @@
+#ifndef __KERN_DEBUG_PERF_H__
+#define __KERN_DEBUG_PERF_H__
+
+#include <types.h>
+#include <proc.h>
+
+struct trapframe;
+
+void __perf_switch(struct proc_struct *prev, struct proc_struct *next);
+
+// perf_switch - in proc_run, unload the counters of prev and load those
+//             - of next; nothing to do for the tasks without any
+static inline void
+perf_switch(struct proc_struct *prev, struct proc_struct *next)
+{
+	if ((prev->arch.perf | next->arch.perf) != 0) {
+		__perf_switch(prev, next);
+	}
+}
+
+void perf_init(void);
+void perf_tick(void);
+bool perf_nmi(struct trapframe *tf);
+void perf_free(struct proc_struct *proc);
+
+int do_perf(int op, int id, void __user * arg);
+
+#endif /* !__KERN_DEBUG_PERF_H__ */
@@ -35,6 +35,7 @@ static int table_inited = 0;
 static ACPI_TABLE_DESC table_desc[MAX_TABLE_DESC];
 static ACPI_TABLE_MADT *hdr_madt;
 static ACPI_TABLE_SRAT *hdr_srat;
+static ACPI_TABLE_SLIT *hdr_slit;
 static ACPI_TABLE_DMAR *hdr_dmar;
 
 /* Early ACPI Table Access */
@@ -62,6 +63,13 @@ int acpitables_init(void)
 	if (r == AE_OK)
 		hdr_srat = (ACPI_TABLE_SRAT*)hdr;
 
+	// Get the SLIT (distances between the nodes of the SRAT)
+	r = AcpiGetTable((char*)ACPI_SIG_SLIT, 0, &hdr);
+	if (ACPI_FAILURE(r) && r != AE_NOT_FOUND)
+		panic("acpi: AcpiGetTable failed: %s", AcpiFormatException(r));
+	if (r == AE_OK)
+		hdr_slit = (ACPI_TABLE_SLIT*)hdr;
+
 	// Get the DMAR (DMA remapping reporting table)
 	r = AcpiGetTable((char*)ACPI_SIG_DMAR, 0, &hdr);
 	if (ACPI_FAILURE(r) && r != AE_NOT_FOUND)
@@ -172,6 +180,66 @@ proximity_domain_to_node(uint32_t proximity_domain)
 	return NULL;
 }
 
+/* the SLIT is used if it covers the nodes and says local is nearest */
+static int slit_valid(void)
+{
+	int i, j;
+	uint64_t n;
+	if(!hdr_slit)
+		return 0;
+	n = hdr_slit->LocalityCount;
+	for(i=0;i<sysconf.lnuma_count;i++)
+		if(numa_nodes[i].hwid >= n)
+			return 0;
+	for(i=0;i<sysconf.lnuma_count;i++){
+		for(j=0;j<sysconf.lnuma_count;j++){
+			uint8_t d = hdr_slit->Entry[numa_nodes[i].hwid * n
+						    + numa_nodes[j].hwid];
+			if((i == j) != (d == NUMA_LOCAL_DISTANCE)
+			   || d < NUMA_LOCAL_DISTANCE)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* distances between the nodes, and the fallback order of each by them */
+static void numa_distance_init(void)
+{
+	int i, j, k;
+	int valid = slit_valid();
+	uint64_t n = valid ? hdr_slit->LocalityCount : 0;
+	uint8_t d;
+	if(hdr_slit && !valid)
+		kprintf("numa_init: SLIT invalid, ignored\n");
+	for(i=0;i<sysconf.lnuma_count;i++){
+		struct numa_node *node = &numa_nodes[i];
+		for(j=0;j<sysconf.lnuma_count;j++){
+			if(valid)
+				d = hdr_slit->Entry[node->hwid * n
+						    + numa_nodes[j].hwid];
+			else if(i == j)
+				d = NUMA_LOCAL_DISTANCE;
+			else
+				d = NUMA_REMOTE_DISTANCE;
+			node->distance[j] = d;
+		}
+		/* insertion sort, the nodes at a distance stay in id order */
+		node->nr_fallback = 0;
+		for(j=0;j<sysconf.lnuma_count;j++){
+			if(j == i)
+				continue;
+			k = node->nr_fallback++;
+			while(k > 0 && node->distance[node->fallback[k-1]]
+			      > node->distance[j]){
+				node->fallback[k] = node->fallback[k-1];
+				k--;
+			}
+			node->fallback[k] = j;
+		}
+	}
+}
+
 int numa_init(void)
 {
 	int numa_node_nr = 0;
@@ -188,6 +256,7 @@ int numa_init(void)
 		for(i=0;i<sysconf.lcpu_count;i++)
 			numa_nodes[0].cpu_ids[i] = i;
 		sysconf.lnuma_count = 1;
+		numa_distance_init();
 		return;
 	}
 	ACPI_SUBTABLE_HEADER *sub;
@@ -252,6 +321,7 @@ int numa_init(void)
 			panic("SRAT refers to unknown CPU APICID %d", apicid);
 				
 	}
+	numa_distance_init();
 
 	/* dump NUMA nodes */
 	for(i=0;i<sysconf.lnuma_count;i++){
@@ -263,6 +333,10 @@ int numa_init(void)
 		for(j=0;j<numa_nodes[i].nr_mems;j++)
 			kprintf("  %p - %p\n", numa_nodes[i].mems[j].base, 
 					numa_nodes[i].mems[j].base+numa_nodes[i].mems[j].length-1);
+		kprintf("  distances:");
+		for(j=0;j<sysconf.lnuma_count;j++)
+			kprintf(" %d", numa_nodes[i].distance[j]);
+		kprintf("\n");
 	}
 
 }
@@ -271,11 +345,15 @@ static int cpuacpi_init(void)
 {
 	int ncpu = sysconf.lcpu_count;
 	int i, j;
+	int smt_shift, pkg_shift;
+	cpuid_topology(&smt_shift, &pkg_shift);
 	for(i = 0;i < ncpu; i++){
 		struct cpu* c = per_cpu_ptr(cpus, i);
 		c->id = i;
 		c->node = NULL;
 		c->hwid = cpu_id_to_apicid[i];
+		c->core_id = c->hwid >> smt_shift;
+		c->pkg_id = c->hwid >> pkg_shift;
 	}
 	/* associate cpus and NUMA nodes */
 	for(i=0;i<sysconf.lnuma_count;i++){
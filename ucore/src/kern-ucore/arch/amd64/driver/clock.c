@@ -4,6 +4,15 @@
 #include <picirq.h>
 #include <kio.h>
 #include <lapic.h>
+#include <hz.h>
+#include <sched.h>
+#include <percpu.h>
+#include <clock.h>
+#include <cpuid.h>
+#include <timekeeping.h>
+#include <idle.h>
+#include <kvm.h>
+#include <hrtimer.h>
 
 /* *
  * Support for time-related hardware gadgets - the 8253 timer,
@@ -26,6 +35,25 @@
 #define TIMER_16BIT     0x30	// r/w counter 16 bits, LSB first
 
 volatile size_t ticks;
+#ifdef UCONFIG_HAVE_LINUX_DDE36_BASE
+/* the tick of the linux drivers is that of the kernel, one word here */
+extern volatile unsigned long jiffies __attribute__ ((alias("ticks")));
+extern volatile uint64_t jiffies_64 __attribute__ ((alias("ticks")));
+extern volatile unsigned long dde_kit_timer_ticks
+    __attribute__ ((alias("ticks")));
+#endif
+
+static uint64_t tsc_read(void)
+{
+	return rdtsc();
+}
+
+/* calibrated against the PIT by hz_init, the cpus are taken to be in step */
+static struct clocksource clocksource_tsc = {
+	.name = "tsc",
+	.user_tsc = 1,
+	.read = tsc_read,
+};
 
 /* *
  * clock_init - initialize 8253 clock to interrupt 100 times per second,
@@ -36,6 +64,196 @@ void clock_init(void)
 	//lapic_timer_set(100);
 	//percpu timer has been inited in lapic_init 
 
+	/* a tsc that does not keep its rate in all the P- and C-states is
+	 * still better than the tick */
+	clocksource_tsc.freq = cpuhz;
+	clocksource_tsc.rating =
+	    cpuid_check_feature(CPUID_FEATURE_INVARIANT_TSC) ? 300 : 100;
+#ifdef UCONFIG_KVM_GUEST
+	/* the host keeps the tsc of the vcpus in step, at its rate */
+	if (kvm_tsc_stable()) {
+		clocksource_tsc.rating = 300;
+	}
+	kvmclock_register();
+#endif
+	clocksource_register(&clocksource_tsc);
+
 	kprintf("++ setup timer interrupts\n");
 	pic_enable(IRQ_TIMER);
 }
+
+#ifdef UCONFIG_HIGH_RES_TIMERS
+/* *
+ * High-resolution timers: while an hrtimer is due before the next tick of
+ * a cpu, its LAPIC timer is taken off the periodic tick and programmed in
+ * one-shot mode, to interrupt at the hrtimer and then at the tick it would
+ * have taken. The first tick with no hrtimer due before the next one puts
+ * the timer back to periodic.
+ * */
+#define CLOCK_EVENT_SLACK           (10 * NSEC_PER_USEC)
+
+struct clock_event {
+	bool oneshot;		// one-shots in place of the periodic tick
+	uint64_t next_tick;	// the ktime_get_ns of the next tick, if so
+};
+
+static DEFINE_PERCPU_NOINIT(struct clock_event, clock_events);
+#endif
+
+#ifdef UCONFIG_NO_HZ_IDLE
+/* *
+ * Tickless idle: an idle cpu programs the LAPIC timer in one-shot mode
+ * for the next event of its timing wheel instead of taking a tick 100
+ * times a second. The periodic tick is restored by the first interrupt
+ * that wakes the cpu up, and the ticks slept are replayed on the wheel.
+ * NOTE: the global ticks counter is kept by cpu 0, it lags while cpu 0
+ *       is in tickless idle and catches up when it wakes up.
+ * */
+struct tick_nohz {
+	bool stopped;
+	unsigned int nticks;	// ticks until the one-shot interrupt
+	uint64_t idle_tsc;	// tsc when the tick was stopped
+};
+
+static DEFINE_PERCPU_NOINIT(struct tick_nohz, tick_nohz_state);
+
+// tick_nohz_idle_enter - stop the tick before the idle cpu halts,
+//                      - called with interrupts disabled
+void tick_nohz_idle_enter(void)
+{
+	struct lapic_chip *chip = lapic_get_chip();
+	struct tick_nohz *st = get_cpu_ptr(tick_nohz_state);
+	if (chip->timer_oneshot == NULL || st->stopped) {
+		return;
+	}
+#ifdef UCONFIG_HIGH_RES_TIMERS
+	if (get_cpu_ptr(clock_events)->oneshot) {
+		/* one-shots already, until the next tick */
+		return;
+	}
+#endif
+	unsigned int nticks = timer_nohz_enter();
+	if (nticks == 0) {
+		return;
+	}
+	st->stopped = 1;
+	st->nticks = nticks;
+	st->idle_tsc = rdtsc();
+	chip->timer_oneshot(chip, (uint64_t) nticks * TIMER_TICK_NSEC);
+}
+
+// tick_nohz_irq_enter - restart the tick of a tickless cpu on the first
+//                     - interrupt it takes
+void tick_nohz_irq_enter(int trapno)
+{
+	struct lapic_chip *chip = lapic_get_chip();
+	struct tick_nohz *st = get_cpu_ptr(tick_nohz_state);
+	if (!st->stopped) {
+		return;
+	}
+	st->stopped = 0;
+	chip->timer_periodic(chip);
+
+	uint64_t tick_tsc = cpuhz / TIMER_HZ, delta = rdtsc() - st->idle_tsc;
+	uint64_t elapsed;
+	if (trapno == IRQ_OFFSET + IRQ_TIMER) {
+		/* the tick of the timer interrupt itself is run by its handler,
+		 * round as it may fire a little early. */
+		elapsed = (delta + tick_tsc / 2) / tick_tsc;
+		elapsed = (elapsed > 0) ? elapsed - 1 : 0;
+	} else {
+		elapsed = delta / tick_tsc;
+	}
+	unsigned int nticks = (elapsed < st->nticks) ? elapsed : st->nticks;
+	if (myid() == 0) {
+		ticks += nticks;
+	}
+	timer_nohz_exit(nticks);
+}
+
+// tick_nohz_idle_exit - restart the tick of a cpu woken up from tickless
+//                     - idle by no interrupt, see mwait_idle
+void tick_nohz_idle_exit(void)
+{
+	tick_nohz_irq_enter(-1);
+}
+
+void tick_nohz_kick(int cpu)
+{
+#ifdef UCONFIG_MWAIT_IDLE
+	if (mwait_wake_cpu(cpu)) {
+		return;
+	}
+#endif
+	lapic_send_ipi(per_cpu_ptr(cpus, cpu), T_RESCHED);
+}
+#endif
+
+#ifdef UCONFIG_HIGH_RES_TIMERS
+// clock_event_program - have the timer of this cpu interrupt at expires,
+//                     - if it is due before the next tick
+void clock_event_program(uint64_t expires)
+{
+	struct lapic_chip *chip = lapic_get_chip();
+	struct clock_event *ce;
+	uint64_t now;
+	bool intr_flag;
+	if (chip->timer_oneshot == NULL || chip->timer_left == NULL) {
+		/* the tick expires the hrtimers */
+		return;
+	}
+	local_intr_save(intr_flag);
+	ce = get_cpu_ptr(clock_events);
+#ifdef UCONFIG_NO_HZ_IDLE
+	if (get_cpu_ptr(tick_nohz_state)->stopped) {
+		/* the interrupt which restarts the tick runs them */
+		goto out;
+	}
+#endif
+	now = ktime_get_ns();
+	if (!ce->oneshot) {
+		ce->next_tick = now + chip->timer_left(chip);
+		if (expires >= ce->next_tick) {
+			goto out;
+		}
+		ce->oneshot = 1;
+	} else if (expires > ce->next_tick) {
+		expires = ce->next_tick;
+	}
+	chip->timer_oneshot(chip, (expires > now) ? expires - now : 0);
+out:
+	local_intr_restore(intr_flag);
+}
+
+// clock_event_irq - the timer of this cpu interrupted, return whether it is
+//                 - a tick; if not, the hrtimers due are run
+bool clock_event_irq(void)
+{
+	struct lapic_chip *chip = lapic_get_chip();
+	struct clock_event *ce = get_cpu_ptr(clock_events);
+	uint64_t now;
+	if (!ce->oneshot) {
+		return 1;
+	}
+	now = ktime_get_ns();
+	if (now + CLOCK_EVENT_SLACK < ce->next_tick) {
+		/* the next one due is programmed in turn */
+		chip->timer_oneshot(chip, ce->next_tick - now);
+		hrtimer_run_queue();
+		return 0;
+	}
+	ce->next_tick += TIMER_TICK_NSEC;
+	if (ce->next_tick <= now) {
+		/* the interrupt came late, not a tick to catch up */
+		ce->next_tick = now + TIMER_TICK_NSEC;
+	}
+	if (hrtimer_next_expiry() >= ce->next_tick) {
+		ce->oneshot = 0;
+		chip->timer_periodic(chip);
+	} else {
+		/* run_timer_list programs the one due before it */
+		chip->timer_oneshot(chip, ce->next_tick - now);
+	}
+	return 1;
+}
+#endif
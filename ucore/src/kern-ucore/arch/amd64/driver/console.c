@@ -8,6 +8,8 @@
 #include <memlayout.h>
 #include <sync.h>
 #include <kio.h>
+#include <spinlock.h>
+#include <virtio_console.h>
 
 /* stupid I/O delay routine necessitated by historical PC design flaws */
 static void delay(void)
@@ -27,8 +29,13 @@ static void delay(void)
 #define COM_DLM         1	// Out: Divisor Latch High (DLAB=1)
 #define COM_IER         1	// Out: Interrupt Enable Register
 #define COM_IER_RDI     0x01	// Enable receiver data interrupt
+#define COM_IER_THRI    0x02	// Enable transmitter empty interrupt
 #define COM_IIR         2	// In:  Interrupt ID Register
 #define COM_FCR         2	// Out: FIFO Control Register
+#define COM_FCR_ENABLE  0x01	// Enable the FIFOs
+#define COM_FCR_CLR_RX  0x02	// Clear the receive FIFO
+#define COM_FCR_CLR_TX  0x04	// Clear the transmit FIFO
+#define COM_FCR_TRIG_8  0x80	// Receive interrupt at 8 bytes or timeout
 #define COM_LCR         3	// Out: Line Control Register
 #define COM_LCR_DLAB    0x80	// Divisor latch access bit
 #define COM_LCR_WLEN8   0x03	// Wordlength: 8 bits
@@ -41,6 +48,7 @@ static void delay(void)
 #define COM_LSR_TXRDY   0x20	// Transmit buffer avail
 #define COM_LSR_TSRE    0x40	// Transmitter off
 #define COM_BAUDRATE    115200
+#define COM_FIFO_SIZE   16
 
 #define MONO_BASE       0x3B4
 #define MONO_BUF        0xB0000
@@ -86,8 +94,14 @@ static bool serial_exists = 0;
 
 static void serial_init(void)
 {
+#ifdef UCONFIG_SERIAL_IRQ
+	// Turn on and clear the FIFOs
+	outb(COM1 + COM_FCR, COM_FCR_ENABLE | COM_FCR_CLR_RX | COM_FCR_CLR_TX
+	     | COM_FCR_TRIG_8);
+#else
 	// Turn off the FIFO
 	outb(COM1 + COM_FCR, 0);
+#endif
 
 	// Set speed; requires DLAB latch
 	outb(COM1 + COM_LCR, COM_LCR_DLAB);
@@ -183,6 +197,93 @@ static void cga_putc(int c)
 	outb(addr_6845 + 1, crt_pos);
 }
 
+#ifdef UCONFIG_SERIAL_IRQ
+/* *
+ * The bytes to transmit wait in serial_tx, and are moved to the FIFO of the
+ * uart a FIFO at a time whenever it is empty: by the putc that finds it so,
+ * or by its transmitter interrupt, which is enabled while bytes wait. rpos
+ * and wpos only grow. Until serial_tx_start, and from a panic on, putc
+ * polls, the ring flushed first.
+ * */
+#define SERIAL_TXBUFSIZE 4096
+
+static struct {
+	uint8_t buf[SERIAL_TXBUFSIZE];
+	uint32_t rpos;
+	uint32_t wpos;
+	bool thri;
+} serial_tx;
+
+static spinlock_s serial_tx_lock;
+static bool serial_tx_on = 0;
+
+bool is_kernel_panic(void);
+
+// serial_tx_fill - move a FIFO of bytes of serial_tx to the uart if its
+//                - FIFO is empty, or with wait once it is, and enable its
+//                - interrupt while bytes are left; with serial_tx_lock held
+static void serial_tx_fill(bool wait)
+{
+	int i;
+	for (i = 0; !(inb(COM1 + COM_LSR) & COM_LSR_TXRDY); i++) {
+		if (!wait) {
+			return;
+		}
+		if (i == 12800) {
+			break;
+		}
+		delay();
+	}
+	for (i = 0; i < COM_FIFO_SIZE; i++) {
+		if (serial_tx.rpos == serial_tx.wpos) {
+			break;
+		}
+		outb(COM1 + COM_TX,
+		     serial_tx.buf[serial_tx.rpos++ % SERIAL_TXBUFSIZE]);
+	}
+	bool thri = (serial_tx.rpos != serial_tx.wpos);
+	if (thri != serial_tx.thri) {
+		serial_tx.thri = thri;
+		outb(COM1 + COM_IER, COM_IER_RDI | (thri ? COM_IER_THRI : 0));
+	}
+}
+
+/* serial_tx_start - let putc leave the bytes to the interrupt of the uart */
+void serial_tx_start(void)
+{
+	spinlock_init(&serial_tx_lock);
+	serial_tx_on = serial_exists;
+}
+
+static void serial_putc_sub(int c)
+{
+	if (!serial_tx_on || is_kernel_panic()) {
+		while (serial_tx.rpos != serial_tx.wpos) {
+			serial_tx_fill(1);
+		}
+		serial_tx_fill(1);
+		outb(COM1 + COM_TX, c);
+		return;
+	}
+	spinlock_acquire(&serial_tx_lock);
+	while (serial_tx.wpos - serial_tx.rpos == SERIAL_TXBUFSIZE) {
+		serial_tx_fill(1);
+	}
+	serial_tx.buf[serial_tx.wpos++ % SERIAL_TXBUFSIZE] = c;
+	serial_tx_fill(0);
+	spinlock_release(&serial_tx_lock);
+}
+
+/* serial_tx_intr - refill the uart from serial_tx if it has emptied */
+static void serial_tx_intr(void)
+{
+	if (serial_tx_on) {
+		spinlock_acquire(&serial_tx_lock);
+		serial_tx_fill(0);
+		spinlock_release(&serial_tx_lock);
+	}
+}
+#else
 static void serial_putc_sub(int c)
 {
 	int i;
@@ -192,6 +293,11 @@ static void serial_putc_sub(int c)
 	outb(COM1 + COM_TX, c);
 }
 
+static inline void serial_tx_intr(void)
+{
+}
+#endif /* UCONFIG_SERIAL_IRQ */
+
 /* serial_putc - print character to serial port */
 static void serial_putc(int c)
 {
@@ -248,11 +354,16 @@ static int serial_proc_data(void)
 	return c;
 }
 
-/* serial_intr - try to feed input characters from serial port */
+/* *
+ * serial_intr - try to feed input characters from serial port, and refill
+ * its transmitter, for its interrupt or a poll with interrupts disabled
+ * (e.g., by the kernel monitor) alike.
+ * */
 void serial_intr(void)
 {
 	if (serial_exists) {
 		cons_intr(serial_proc_data);
+		serial_tx_intr();
 	}
 }
 
@@ -434,7 +545,12 @@ void cons_putc(int c)
 	{
 		lpt_putc(c);
 		cga_putc(c);
-		serial_putc(c);
+#ifdef UCONFIG_VIRTIO_CONSOLE
+		if (virtio_console_valid()) {
+			virtio_console_putc(c);
+		} else
+#endif
+			serial_putc(c);
 	}
 	local_intr_restore(intr_flag);
 }
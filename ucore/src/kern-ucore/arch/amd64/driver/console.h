@@ -6,5 +6,8 @@ void cons_putc(int c);
 int cons_getc(void);
 void serial_intr(void);
 void kbd_intr(void);
+#ifdef UCONFIG_SERIAL_IRQ
+void serial_tx_start(void);
+#endif
 
 #endif /* !__KERN_DRIVER_CONSOLE_H__ */
@@ -20,6 +20,11 @@
 #include <types.h>
 #include "cpuid.h"
 
+/* read by __memcpy and __memset of arch.h, set by kern_init */
+bool x86_erms;
+/* read by tls_switch, set by kern_init */
+bool x86_fsgsbase;
+
 typedef enum {
 	basic = 0,
 	features = 1,
@@ -35,6 +40,9 @@ typedef enum {
 	ext_state = 0xd,            // Depends on ecx
 	qos = 0xf,                  // Depends on ecx
 
+	hypervisor_info = 0x40000000,
+	kvm_features = 0x40000001,
+
 	extended_info = 0x80000000,
 	extended_features = 0x80000001,
 }cpuid_types;
@@ -96,6 +104,38 @@ int cpuid_check_feature(CPUID_INFO_TYPE type)
 			return features_.d & (1<<9);
 		case CPUID_FEATURE_PAGE1G:
 			return extended_features_.d & (1<<26);
+		case CPUID_FEATURE_PCID:
+			return features_.c & (1<<17);
+		case CPUID_FEATURE_INVARIANT_TSC:
+			/* advanced power management, 0x80000007 */
+			return extended_[7].valid && (extended_[7].d & (1<<8));
+		case CPUID_FEATURE_ARCH_PERFMON:
+			/* version and counters of 0xa, with unhalted core cycles */
+			return basic_[perfmon].valid && (basic_[perfmon].a & 0xff)
+			    && ((basic_[perfmon].a >> 8) & 0xff)
+			    && !(basic_[perfmon].b & 1);
+		case CPUID_FEATURE_ERMS:
+			/* enhanced rep movsb/stosb, structured extended features */
+			return basic_[ext_features].valid
+			    && (basic_[ext_features].b & (1<<9));
+		case CPUID_FEATURE_FXSR:
+			return features_.d & (1<<24);
+		case CPUID_FEATURE_XSAVE:
+			return features_.c & (1<<26);
+		case CPUID_FEATURE_XSAVEOPT:
+			/* sub-leaf 1 of 0xd, not among those read above */
+			return (features_.c & (1<<26))
+			    && (read_one(ext_state, 1).a & 1);
+		case CPUID_FEATURE_FSGSBASE:
+			return basic_[ext_features].valid
+			    && (basic_[ext_features].b & 1);
+		case CPUID_FEATURE_MONITOR:
+			return features_.c & (1<<3);
+		case CPUID_FEATURE_MWAIT_BREAK:
+			/* the extensions of 5, with interrupts as break events
+			 * while they are masked */
+			return basic_[mwait].valid
+			    && (basic_[mwait].c & 0x3) == 0x3;
 		default:
 			return 0;
 	}
@@ -107,4 +147,87 @@ const char* cpuid_vendor_string()
 	return vendor_;
 }
 
+uint32_t cpuid_perfmon(void)
+{
+	cpuid_readall();
+	return basic_[perfmon].valid ? basic_[perfmon].a : 0;
+}
+
+uint32_t cpuid_perfmon_events(void)
+{
+	cpuid_readall();
+	return basic_[perfmon].valid ? basic_[perfmon].b : 0;
+}
+
+
+
+uint64_t cpuid_xstate_mask(void)
+{
+	cpuid_readall();
+	if (!basic_[ext_state].valid)
+		return 0;
+	return ((uint64_t)basic_[ext_state].d << 32) | basic_[ext_state].a;
+}
+
+uint32_t cpuid_xstate_size(void)
+{
+	/* it changes with XCR0, read it again */
+	return read_one(ext_state, 0).b;
+}
 
+uint32_t cpuid_mwait_substates(void)
+{
+	cpuid_readall();
+	return basic_[mwait].valid ? basic_[mwait].d : 0;
+}
+
+uint32_t cpuid_kvm_features(void)
+{
+	struct leaf l;
+	cpuid_readall();
+	/* the hypervisor bit, then the signature of its leaves */
+	if(!(features_.c & (1u<<31)))
+		return 0;
+	l = read_one(hypervisor_info, 0);
+	if(l.b != 0x4b4d564b || l.c != 0x564b4d56 || l.d != 0x4d)
+		return 0;
+	return read_one(kvm_features, 0).a;
+}
+
+/* the bits to hold n ids */
+static int id_bits(uint32_t n)
+{
+	int bits = 0;
+	while((1u << bits) < n)
+		bits++;
+	return bits;
+}
+
+void cpuid_topology(int *smt_shift, int *pkg_shift)
+{
+	struct leaf l;
+	int i, type;
+	cpuid_readall();
+	*smt_shift = *pkg_shift = 0;
+	if(basic_[topology].valid && basic_[topology].b != 0){
+		/* the levels of 0xb, each with the shift to the next one */
+		for(i=0;;i++){
+			l = read_one(topology, i);
+			if((type = (l.c >> 8) & 0xff) == 0)
+				break;
+			if(type == 1)
+				*smt_shift = l.a & 0x1f;
+			else if(type == 2)
+				*pkg_shift = l.a & 0x1f;
+		}
+		if(*pkg_shift < *smt_shift)
+			*pkg_shift = *smt_shift;
+	}else if(features_.d & (1<<28)){
+		/* the logical cpus of a package in 1, its cores in 4 */
+		uint32_t logical = (features_.b >> 16) & 0xff, cores = 1;
+		if(basic_[cache_params].valid)
+			cores = ((basic_[cache_params].a >> 26) & 0x3f) + 1;
+		*pkg_shift = id_bits(logical);
+		*smt_shift = id_bits(logical / cores);
+	}
+}
@@ -23,11 +23,35 @@ typedef enum{
 	CPUID_FEATURE_X2APIC,
 	CPUID_FEATURE_APIC,
 	CPUID_FEATURE_PAGE1G,
+	CPUID_FEATURE_PCID,
+	CPUID_FEATURE_INVARIANT_TSC,
+	CPUID_FEATURE_ARCH_PERFMON,
+	CPUID_FEATURE_ERMS,
+	CPUID_FEATURE_FXSR,
+	CPUID_FEATURE_XSAVE,
+	CPUID_FEATURE_XSAVEOPT,
+	CPUID_FEATURE_FSGSBASE,
+	CPUID_FEATURE_MONITOR,
+	CPUID_FEATURE_MWAIT_BREAK,
 }CPUID_INFO_TYPE;
 
 
 int cpuid_check_feature(CPUID_INFO_TYPE type);
 const char* cpuid_vendor_string();
+/* eax of 0xa: version, counters and their width, 0 without */
+uint32_t cpuid_perfmon(void);
+/* ebx of 0xa: bit i set if the architectural event i is not there */
+uint32_t cpuid_perfmon_events(void);
+/* the state components XCR0 may enable, edx:eax of 0xd */
+uint64_t cpuid_xstate_mask(void);
+/* ebx of 0xd, the size of an XSAVE area for the components XCR0 enables now */
+uint32_t cpuid_xstate_size(void);
+/* edx of 5, the sub-states of each mwait c-state, 4 bits each */
+uint32_t cpuid_mwait_substates(void);
+/* eax of 0x40000001 under KVM, its paravirtual features; 0 on others */
+uint32_t cpuid_kvm_features(void);
+/* the apic id bits below the core, and below the package */
+void cpuid_topology(int *smt_shift, int *pkg_shift);
 
 #endif
 
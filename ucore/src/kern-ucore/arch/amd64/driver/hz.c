@@ -18,6 +18,7 @@
 
 #include <arch.h>
 #include <hz.h>
+#include <kvm.h>
 
 #define IO_TIMER1       0x040           // 8253 Timer #1
 #define TIMER_FREQ      1193182
@@ -43,6 +44,13 @@ microdelay(uint64_t delay)
 void
 hz_init(void)
 {
+#ifdef UCONFIG_KVM_GUEST
+  // The host tells the rate of the tsc, the emulated PIT only guesses it
+  if ((cpuhz = kvm_tsc_hz()) != 0) {
+    kprintf("inithz: kvmclock tsc %llu Hz\n", cpuhz);
+    return;
+  }
+#endif
   // Setup PIT for terminal count starting from 2^16 - 1
   uint64_t xticks = 0x000000000000FFFFull;
   outb(TIMER_MODE, TIMER_SEL0 | TIMER_TCOUNT | TIMER_16BIT);  
@@ -4,11 +4,18 @@
 #include <picirq.h>
 #include <fs.h>
 #include <ide.h>
+#include <iobuf.h>
 #include <arch.h>
 #include <sem.h>
 #include <assert.h>
 #include <kio.h>
+#include <sync.h>
+#include <proc.h>
+#include <sched.h>
+#include <blkqueue.h>
 #include <ramdisk.h>
+#include <pmm.h>
+#include <pci.h>
 
 #define ISA_DATA                0x00
 #define ISA_ERROR               0x01
@@ -45,14 +52,58 @@
 #define IO_CTRL1                0x374
 
 #define MAX_IDE                 4
-#define MAX_NSECS               128
+#define MAX_NSECS               IDE_MAX_NSECS
 #define MAX_DISK_NSECS          0x10000000U
 #define VALID_IDE(ideno)        (((ideno) >= 0) && ((ideno) < MAX_IDE) && (ide_devices[ideno].valid))
 
+/* status polls before a transfer of the queue worker sleeps */
+#define IDE_SPIN_POLLS          1024
+
+#ifdef UCONFIG_IDE_DMA
+/* the registers of a channel of the bus master, from BM_BASE on */
+#define BM_COMMAND              0x00
+#define BM_STATUS               0x02
+#define BM_PRDT                 0x04
+
+#define BM_CMD_START            0x01
+#define BM_CMD_READ             0x08	// the device writes to memory
+#define BM_STATUS_ERR           0x02
+#define BM_STATUS_INTR          0x04
+
+#define IDE_CMD_READ_DMA        0xC8
+#define IDE_CMD_WRITE_DMA       0xCA
+
+/* in the capabilities of the identification space */
+#define IDE_CAP_DMA             0x100
+
+#define PCI_CLASS_STORAGE       0x01
+#define PCI_SUBCLASS_IDE        0x01
+#define PCI_PROGIF_MASTER       0x80
+
+/* a physical region descriptor, one buffer of a DMA transfer */
+struct ide_prd {
+	uint32_t addr;
+	uint16_t len;		// in bytes, 0 for 64KB
+	uint16_t flags;
+} __attribute__ ((packed));
+
+#define PRD_EOT                 0x8000	// the last descriptor
+#define PRD_MAX_LEN             0x10000	// and a buffer does not cross 64KB
+#define IDE_NR_PRD              (PGSIZE / sizeof(struct ide_prd))
+#define BM_MAX_PADDR            0x100000000ULL
+#endif
+
 static struct {
 	const unsigned short base;	// I/O Base
 	const unsigned short ctrl;	// Control Base
 	semaphore_t sem;
+#ifdef UCONFIG_BLK_QUEUE
+	wait_queue_t intr_wait;	// the worker waits for the interrupt
+#endif
+#ifdef UCONFIG_IDE_DMA
+	unsigned short bmbase;	// Bus Master Base, 0 for PIO only
+	struct ide_prd *prdt;	// a page of descriptors
+#endif
 } channels[2] = {
 	{
 	IO_BASE0, IO_CTRL0}, {
@@ -84,16 +135,220 @@ static int ide_wait_ready(unsigned short iobase, bool check_error)
 	return 0;
 }
 
+#ifdef UCONFIG_BLK_QUEUE
+static struct blk_queue ide_queues[MAX_IDE];
+
+static void ide_queue_init(void);
+
+/*
+ * Sleep until the interrupt of the channel of ideno, or the next tick if
+ * it does not come, so that a lost interrupt costs a tick at most.
+ */
+static void ide_sleep(unsigned short ideno)
+{
+	wait_queue_t *queue = &(channels[ideno >> 1].intr_wait);
+	wait_t __wait, *wait = &__wait;
+	timer_t __timer, *timer = timer_init(&__timer, current, 1);
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	wait_current_set(queue, wait, WT_IO);
+	add_timer(timer);
+	local_intr_restore(intr_flag);
+
+	schedule();
+
+	local_intr_save(intr_flag);
+	del_timer(timer);
+	wait_current_del(queue, wait);
+	local_intr_restore(intr_flag);
+}
+
+// ide_intr - the interrupt of channel IRQ_IDE1 or IRQ_IDE2
+void ide_intr(int irq)
+{
+	int chan = (irq == IRQ_IDE1) ? 0 : 1;
+	/* reading the status acknowledges it */
+	inb(channels[chan].base + ISA_STATUS);
+	if (!wait_queue_empty(&(channels[chan].intr_wait))) {
+		wakeup_queue(&(channels[chan].intr_wait), WT_IO, 1);
+	}
+}
+#else
+void ide_intr(int irq)
+{
+}
+#endif
+
+/*
+ * Wait for the drive ideno to be done with a sector. A transfer that can
+ * sleep only spins for a while, then sleeps until the drive interrupts,
+ * so that the cpu runs others while the disk works.
+ */
+static int ide_wait_io(unsigned short ideno, bool check_error, bool can_sleep)
+{
+	unsigned short iobase = IO_BASE(ideno);
+	int r;
+#ifdef UCONFIG_BLK_QUEUE
+	int polls = 0;
+#endif
+	while ((r = inb(iobase + ISA_STATUS)) & IDE_BSY) {
+#ifdef UCONFIG_BLK_QUEUE
+		if (can_sleep && ++polls == IDE_SPIN_POLLS) {
+			ide_sleep(ideno);
+			polls = 0;
+		}
+#endif
+	}
+	if (check_error && (r & (IDE_DF | IDE_ERR)) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+/* send the command cmd for nsecs sectors from secno on to ideno */
+static void
+ide_command(unsigned short ideno, uint32_t secno, size_t nsecs, uint8_t cmd)
+{
+	unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
+
+	// generate interrupt
+	outb(ioctrl + ISA_CTRL, 0);
+	outb(iobase + ISA_SECCNT, nsecs);
+	outb(iobase + ISA_SECTOR, secno & 0xFF);
+	outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
+	outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
+	outb(iobase + ISA_SDH,
+	     0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
+	outb(iobase + ISA_COMMAND, cmd);
+}
+
+#ifdef UCONFIG_IDE_DMA
+#define BM_BASE(ideno)          (channels[(ideno) >> 1].bmbase)
+
+/*
+ * Find the bus master of the PCI IDE controller and give each channel a
+ * page of descriptors below 4GB. Without it the channels stay with PIO.
+ */
+static void ide_dma_init(void)
+{
+	struct pci_func f;
+	uint32_t bar;
+	int chan;
+	if (pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &f) != 0
+	    || ((pci_conf_read(&f, PCI_CLASS) >> 8) & PCI_PROGIF_MASTER) == 0
+	    || ((bar = pci_conf_read(&f, PCI_BAR(4))) & 1) == 0) {
+		return;
+	}
+	pci_conf_write(&f, PCI_COMMAND, pci_conf_read(&f, PCI_COMMAND)
+		       | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+	for (chan = 0; chan < 2; chan++) {
+		struct Page *page;
+		if ((page = alloc_page()) == NULL) {
+			continue;
+		}
+		if (page2pa(page) + PGSIZE > BM_MAX_PADDR) {
+			free_page(page);
+			continue;
+		}
+		channels[chan].prdt = page2kva(page);
+		channels[chan].bmbase = (bar & 0xFFFC) + chan * 8;
+	}
+	kprintf("ide: bus master at 0x%x.\n", bar & 0xFFFC);
+}
+
+/*
+ * Describe the buffers of iov in the descriptors of the channel of ideno.
+ * Returns 0 if the bus master cannot reach one of them: outside of the
+ * direct map, as a buffer of a user, or above 4GB.
+ */
+static bool ide_dma_map(unsigned short ideno, const struct iovec *iov,
+			int iovcnt)
+{
+	struct ide_prd *prd = channels[ideno >> 1].prdt;
+	int i, n = 0;
+	for (i = 0; i < iovcnt; i++) {
+		uintptr_t va = (uintptr_t) iov[i].iov_base, pa;
+		size_t len = iov[i].iov_len;
+		if (va < KERNBASE || (va & 1) != 0) {
+			return 0;
+		}
+		pa = va - KERNBASE;
+		if (pa + len > npage * PGSIZE || pa + len > BM_MAX_PADDR) {
+			return 0;
+		}
+		while (len != 0) {
+			size_t seg = PRD_MAX_LEN - (pa & (PRD_MAX_LEN - 1));
+			if (seg > len) {
+				seg = len;
+			}
+			if (n == IDE_NR_PRD) {
+				return 0;
+			}
+			prd[n].addr = pa, prd[n].len = seg & 0xFFFF;
+			prd[n++].flags = 0;
+			pa += seg, len -= seg;
+		}
+	}
+	prd[n - 1].flags = PRD_EOT;
+	return 1;
+}
+
+/*
+ * Transfer nsecs sectors from secno on with the descriptors ide_dma_map
+ * made, with the channel locked. The drive interrupts when it is done,
+ * which sets BM_STATUS_INTR.
+ */
+static int
+ide_dma_rw(unsigned short ideno, uint32_t secno, size_t nsecs, bool write,
+	   bool can_sleep)
+{
+	unsigned short bmbase = BM_BASE(ideno);
+	uint8_t dir = write ? 0 : BM_CMD_READ, status;
+	outl(bmbase + BM_PRDT, (uint32_t) PADDR(channels[ideno >> 1].prdt));
+	outb(bmbase + BM_COMMAND, dir);
+	outb(bmbase + BM_STATUS,
+	     inb(bmbase + BM_STATUS) | BM_STATUS_ERR | BM_STATUS_INTR);
+
+	ide_command(ideno, secno, nsecs,
+		    write ? IDE_CMD_WRITE_DMA : IDE_CMD_READ_DMA);
+	outb(bmbase + BM_COMMAND, dir | BM_CMD_START);
+
+	while (((status = inb(bmbase + BM_STATUS))
+		& (BM_STATUS_INTR | BM_STATUS_ERR)) == 0) {
+		if (can_sleep) {
+			ide_sleep(ideno);
+		}
+	}
+	outb(bmbase + BM_COMMAND, dir);
+	outb(bmbase + BM_STATUS, status | BM_STATUS_ERR | BM_STATUS_INTR);
+	if ((status & BM_STATUS_ERR) != 0
+	    || ide_wait_ready(IO_BASE(ideno), 1) != 0) {
+		return -1;
+	}
+	return 0;
+}
+#endif /* UCONFIG_IDE_DMA */
+
 void ide_init(void)
 {
 	static_assert((SECTSIZE % 4) == 0);
+#ifdef UCONFIG_BLK_QUEUE
+	wait_queue_init(&(channels[0].intr_wait));
+	wait_queue_init(&(channels[1].intr_wait));
+#endif
 	if(initrd_begin){
 		struct ide_device *dev = &ide_devices[DISK0_DEV_NO];
 		ramdisk_init_struct(dev);
 		ramdisk_init(dev);
+#ifdef UCONFIG_BLK_QUEUE
+		ide_queue_init();
+#endif
 		return;
 	}
 	unsigned short ideno, iobase;
+#ifdef UCONFIG_IDE_DMA
+	ide_dma_init();
+#endif
 	for (ideno = 0; ideno < MAX_IDE; ideno++) {
 		/* assume that no device here */
 		ide_devices[ideno].valid = 0;
@@ -142,6 +397,12 @@ void ide_init(void)
 		/* check if supports LBA */
 		assert((*(unsigned short *)(ident + IDE_IDENT_CAPABILITIES) &
 			0x200) != 0);
+#ifdef UCONFIG_IDE_DMA
+		ide_devices[ideno].dma = (BM_BASE(ideno) != 0
+					  && (*(unsigned short *)(ident +
+								  IDE_IDENT_CAPABILITIES)
+					      & IDE_CAP_DMA) != 0);
+#endif
 
 		unsigned char *model = ide_devices[ideno].model, *data =
 		    ident + IDE_IDENT_MODEL;
@@ -163,6 +424,9 @@ void ide_init(void)
 
 	sem_init(&(channels[0].sem), 1);
 	sem_init(&(channels[1].sem), 1);
+#ifdef UCONFIG_BLK_QUEUE
+	ide_queue_init();
+#endif
 }
 
 bool ide_device_valid(unsigned short ideno)
@@ -178,34 +442,74 @@ size_t ide_device_size(unsigned short ideno)
 	return 0;
 }
 
-int ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs)
+// ide_device_mem - the kernel address of the sectors of ideno if they are
+//                - memory that may be read, written and mapped in place
+void *ide_device_mem(unsigned short ideno)
 {
+	if (ide_device_valid(ideno)) {
+		return ide_devices[ideno].mem;
+	}
+	return NULL;
+}
+
+/*
+ * Transfer the sectors from secno on to or from the iovcnt buffers of iov
+ * with one command. Each buffer holds a whole # of sectors, and they hold
+ * at most IDE_MAX_NSECS together.
+ */
+static int
+ide_rw_secsv(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+	     int iovcnt, bool write, bool can_sleep)
+{
+	size_t nsecs = 0;
+	int i;
+	for (i = 0; i < iovcnt; i++) {
+		assert(iov[i].iov_len % SECTSIZE == 0);
+		nsecs += iov[i].iov_len / SECTSIZE;
+	}
 	assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
 	assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
-	if(ide_devices[ideno].ramdisk)
-		return ramdisk_read(&ide_devices[ideno], secno, dst, nsecs);
-	unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
+	if (ide_devices[ideno].ramdisk) {
+		int i, ret = 0;
+		for (i = 0; i < iovcnt && ret == 0; i++) {
+			size_t n = iov[i].iov_len / SECTSIZE;
+			ret = write
+			    ? ramdisk_write(&ide_devices[ideno], secno,
+					    iov[i].iov_base, n)
+			    : ramdisk_read(&ide_devices[ideno], secno,
+					   iov[i].iov_base, n);
+			secno += n;
+		}
+		return ret;
+	}
+	unsigned short iobase = IO_BASE(ideno);
 
 	lock_channel(ideno);
 
 	ide_wait_ready(iobase, 0);
 
-	// generate interrupt
-	outb(ioctrl + ISA_CTRL, 0);
-	outb(iobase + ISA_SECCNT, nsecs);
-	outb(iobase + ISA_SECTOR, secno & 0xFF);
-	outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
-	outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
-	outb(iobase + ISA_SDH,
-	     0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-	outb(iobase + ISA_COMMAND, IDE_CMD_READ);
-
 	int ret = 0;
-	for (; nsecs > 0; nsecs--, dst += SECTSIZE) {
-		if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-			goto out;
+#ifdef UCONFIG_IDE_DMA
+	if (ide_devices[ideno].dma && ide_dma_map(ideno, iov, iovcnt)) {
+		ret = ide_dma_rw(ideno, secno, nsecs, write, can_sleep);
+		goto out;
+	}
+#endif
+	ide_command(ideno, secno, nsecs, write ? IDE_CMD_WRITE : IDE_CMD_READ);
+	for (i = 0; i < iovcnt; i++) {
+		char *buf = iov[i].iov_base;
+		size_t n;
+		for (n = iov[i].iov_len / SECTSIZE; n > 0;
+		     n--, buf += SECTSIZE) {
+			if ((ret = ide_wait_io(ideno, 1, can_sleep)) != 0) {
+				goto out;
+			}
+			if (write) {
+				outsl(iobase, buf, SECTSIZE / sizeof(uint32_t));
+			} else {
+				insl(iobase, buf, SECTSIZE / sizeof(uint32_t));
+			}
 		}
-		insl(iobase, dst, SECTSIZE / sizeof(uint32_t));
 	}
 
 out:
@@ -213,40 +517,79 @@ out:
 	return ret;
 }
 
-int
-ide_write_secs(unsigned short ideno, uint32_t secno, const void *src,
-	       size_t nsecs)
+#ifdef UCONFIG_BLK_QUEUE
+static int
+ide_xfer(struct blk_queue *q, uint32_t secno, const struct iovec *iov,
+	 int iovcnt, bool write, bool can_sleep)
 {
-	assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
-	assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
+	unsigned short ideno = (uintptr_t) q->private;
+	return ide_rw_secsv(ideno, secno, iov, iovcnt, write, can_sleep);
+}
 
-	if(ide_devices[ideno].ramdisk)
-		return ramdisk_write(&ide_devices[ideno], secno, src, nsecs);
-	unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
+// ide_queue_init - start the request queues of the valid devices
+static void ide_queue_init(void)
+{
+	unsigned short ideno;
+	for (ideno = 0; ideno < MAX_IDE; ideno++) {
+		if (ide_devices[ideno].valid) {
+			char name[16];
+			snprintf(name, sizeof(name), "ide%d", ideno);
+			blk_queue_init(ide_queues + ideno, name, ide_xfer, MAX_NSECS,
+				       (void *)(uintptr_t) ideno);
+			if (blk_queue_start(ide_queues + ideno) != 0) {
+				panic("ide %d: no request queue.\n", ideno);
+			}
+		}
+	}
+}
 
-	lock_channel(ideno);
+// ide_submit - queue req to device ideno, see blk_submit
+void ide_submit(unsigned short ideno, struct blk_request *req)
+{
+	assert(VALID_IDE(ideno));
+	blk_submit(ide_queues + ideno, req);
+}
 
-	ide_wait_ready(iobase, 0);
+static int
+ide_rw(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+       int iovcnt, bool write)
+{
+	assert(VALID_IDE(ideno));
+	return blk_rw(ide_queues + ideno, secno, iov, iovcnt, write);
+}
+#else
+static int
+ide_rw(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+       int iovcnt, bool write)
+{
+	return ide_rw_secsv(ideno, secno, iov, iovcnt, write, 0);
+}
+#endif
 
-	// generate interrupt
-	outb(ioctrl + ISA_CTRL, 0);
-	outb(iobase + ISA_SECCNT, nsecs);
-	outb(iobase + ISA_SECTOR, secno & 0xFF);
-	outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
-	outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
-	outb(iobase + ISA_SDH,
-	     0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-	outb(iobase + ISA_COMMAND, IDE_CMD_WRITE);
+int ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs)
+{
+	struct iovec iov = { dst, nsecs * SECTSIZE };
+	return ide_rw(ideno, secno, &iov, 1, 0);
+}
 
-	int ret = 0;
-	for (; nsecs > 0; nsecs--, src += SECTSIZE) {
-		if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-			goto out;
-		}
-		outsl(iobase, src, SECTSIZE / sizeof(uint32_t));
-	}
+int
+ide_write_secs(unsigned short ideno, uint32_t secno, const void *src,
+	       size_t nsecs)
+{
+	struct iovec iov = { (char *)src, nsecs * SECTSIZE };
+	return ide_rw(ideno, secno, &iov, 1, 1);
+}
 
-out:
-	unlock_channel(ideno);
-	return ret;
+int
+ide_read_secsv(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+	       int iovcnt)
+{
+	return ide_rw(ideno, secno, iov, iovcnt, 0);
+}
+
+int
+ide_write_secsv(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+		int iovcnt)
+{
+	return ide_rw(ideno, secno, iov, iovcnt, 1);
 }
@@ -3,20 +3,42 @@
 
 #include <types.h>
 
+struct iovec;
+
+/* the slave of the second channel, a second swap disk if there is one */
+#define SWAP1_DEV_NO                    3
+
+/* # of sectors one command transfers at most */
+#define IDE_MAX_NSECS                   128
+
 struct ide_device {
 	unsigned char valid;	// 0 or 1 (If Device Really Exists)
 	unsigned int sets;	// Commend Sets Supported
 	unsigned int size;	// Size in Sectors
 	unsigned int ramdisk;
+	void *mem;		// the sectors, if read and written in place
+	unsigned char dma;	// 0 or 1 (If Bus-master DMA Is Used)
 	unsigned char model[41];	// Model in String
 }; 
 void ide_init(void);
 bool ide_device_valid(unsigned short ideno);
 size_t ide_device_size(unsigned short ideno);
+/* ide_device_mem is there, see dev_disk0.c */
+#define IDE_DEVICE_MEM
+void *ide_device_mem(unsigned short ideno);
 
 int ide_read_secs(unsigned short ideno, uint32_t secno, void *dst,
 		  size_t nsecs);
 int ide_write_secs(unsigned short ideno, uint32_t secno, const void *src,
 		   size_t nsecs);
+int ide_read_secsv(unsigned short ideno, uint32_t secno,
+		   const struct iovec *iov, int iovcnt);
+int ide_write_secsv(unsigned short ideno, uint32_t secno,
+		    const struct iovec *iov, int iovcnt);
+void ide_intr(int irq);
+#ifdef UCONFIG_BLK_QUEUE
+struct blk_request;
+void ide_submit(unsigned short ideno, struct blk_request *req);
+#endif
 
 #endif /* !__KERN_DRIVER_IDE_H__ */
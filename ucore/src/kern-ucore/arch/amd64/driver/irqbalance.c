@@ -0,0 +1,355 @@
+#include <types.h>
+#include <string.h>
+#include <stdio.h>
+#include <kio.h>
+#include <assert.h>
+#include <error.h>
+#include <unistd.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <spinlock.h>
+#include <cmdline.h>
+#include <proc.h>
+#include <vmm.h>
+#include <ioapic.h>
+#include <pci.h>
+#include <workqueue.h>
+#include <sched.h>
+#include <irqbalance.h>
+
+/* *
+ * The cpus the IRQs of the devices go to. Each IRQ has an affinity, the
+ * cpus it may be routed to: all of them but the isolated ones, those of
+ * irqaffinity= on the command line, or those SYS_irqaffinity sets. It goes to one of them at
+ * a time, through the redirection entry of its IOAPIC pin, or the address
+ * of the MSI-X table entry it was allocated for.
+ *
+ * With UCONFIG_IRQ_BALANCE a work on cpu 0 looks every IRQ_BALANCE_TICKS
+ * at how many interrupts each IRQ took since, and hands them out again,
+ * the busiest first, each to the cpu of its affinity with the least load
+ * handed out so far. A cpu of another numa node counts the IRQ's own load
+ * more, so it only leaves its node for a clearly idler one. An IRQ stays
+ * where it is on a tie, and one that took none is not moved at all.
+ * */
+#define IRQ_BALANCE_TICKS               100
+
+struct irq_desc {
+	cpuset_t affinity;	// the cpus it may go to
+	int cpu;		// the one it goes to, -1 before irq_route
+	bool routed;		// enabled, see irq_route
+	bool msi;		// taken by irq_alloc_msi
+	struct pci_msix *msix;	// the table of its entry, NULL for a pin
+	int msix_entry;
+	uint64_t last_count;	// the interrupts at the last balance
+};
+
+struct irq_stat {
+	uint64_t count[IRQ_COUNT];	// the interrupts this cpu took
+};
+
+static struct irq_desc irq_descs[IRQ_COUNT];
+static spinlock_s irq_lock;	// the descs, and the writes to the IOAPIC
+static cpuset_t irq_default_affinity;
+static DEFINE_PERCPU_NOINIT(struct irq_stat, irq_stats);
+
+#ifdef UCONFIG_IRQ_BALANCE
+static bool irq_balance_on;
+static struct work_struct irq_balance_work;
+static void irq_balance(struct work_struct *work);
+#endif
+
+// irq_affinity_init - every IRQ may go to any cpu not isolated, or to those
+//                   - of irqaffinity= of the command line
+void irq_affinity_init(const char *cmdline)
+{
+	const char *arg;
+	cpuset_t set;
+	int i;
+	spinlock_init(&irq_lock);
+	memset(&irq_default_affinity, 0, sizeof(cpuset_t));
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (!sched_cpu_isolated(i)) {
+			cpuset_set(&irq_default_affinity, i);
+		}
+	}
+	if (cmdline != NULL
+	    && (arg = cmdline_arg(cmdline, "irqaffinity=")) != NULL) {
+		if (cpulist_parse(arg, &set, sysconf.lcpu_count)) {
+			irq_default_affinity = set;
+		} else {
+			kprintf("irq: bad irqaffinity=, ignored.\n");
+		}
+	}
+	for (i = 0; i < IRQ_COUNT; i++) {
+		irq_descs[i].affinity = irq_default_affinity;
+		irq_descs[i].cpu = -1;
+	}
+#ifdef UCONFIG_IRQ_BALANCE
+	irq_balance_on = (cmdline == NULL
+			  || cmdline_arg(cmdline, "noirqbalance") == NULL);
+	init_work(&irq_balance_work, irq_balance);
+#endif
+}
+
+// irq_first_cpu - the cpu of mask an IRQ goes to at first: the boot cpu
+//               - if it may
+static int irq_first_cpu(const cpuset_t * mask)
+{
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (cpuset_test(mask, i)) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+// __irq_route - (re)write where irq goes, with irq_lock held
+static void __irq_route(int irq)
+{
+	struct irq_desc *desc = irq_descs + irq;
+	uint32_t apic_id = per_cpu_ptr(cpus, desc->cpu)->hwid;
+	if (desc->msix != NULL) {
+		pci_msix_route(desc->msix, desc->msix_entry, IRQ_OFFSET + irq,
+			       apic_id);
+	} else {
+		ioapic_enable(0, irq, apic_id);
+	}
+}
+
+// irq_route - enable irq, routed to a cpu of its affinity
+void irq_route(int irq)
+{
+	struct irq_desc *desc = irq_descs + irq;
+	bool intr_flag;
+	assert(irq >= 0 && irq < IRQ_COUNT);
+	spin_lock_irqsave(&irq_lock, intr_flag);
+	if (desc->cpu < 0 || !cpuset_test(&(desc->affinity), desc->cpu)) {
+		desc->cpu = irq_first_cpu(&(desc->affinity));
+	}
+	desc->routed = 1;
+	__irq_route(irq);
+	spin_unlock_irqrestore(&irq_lock, intr_flag);
+}
+
+void irq_unroute(int irq)
+{
+	struct irq_desc *desc = irq_descs + irq;
+	bool intr_flag;
+	assert(irq >= 0 && irq < IRQ_COUNT);
+	spin_lock_irqsave(&irq_lock, intr_flag);
+	desc->routed = 0;
+	if (desc->msix != NULL) {
+		pci_msix_mask(desc->msix, desc->msix_entry);
+	} else {
+		ioapic_disable(0, irq);
+	}
+	spin_unlock_irqrestore(&irq_lock, intr_flag);
+}
+
+// irq_set_affinity - have irq go to the cpus of mask only, moving it now
+//                  - if it is on another one
+int irq_set_affinity(int irq, const cpuset_t * mask)
+{
+	struct irq_desc *desc = irq_descs + irq;
+	cpuset_t set;
+	bool intr_flag, any = 0;
+	int i;
+	/* the timer is the lapic of each cpu */
+	if (irq < 0 || irq >= IRQ_COUNT || irq == IRQ_TIMER) {
+		return -E_INVAL;
+	}
+	memset(&set, 0, sizeof(cpuset_t));
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (cpuset_test(mask, i)) {
+			cpuset_set(&set, i);
+			any = 1;
+		}
+	}
+	if (!any) {
+		return -E_INVAL;
+	}
+	spin_lock_irqsave(&irq_lock, intr_flag);
+	desc->affinity = set;
+	if (desc->cpu < 0 || !cpuset_test(&set, desc->cpu)) {
+		desc->cpu = irq_first_cpu(&set);
+		if (desc->routed) {
+			__irq_route(irq);
+		}
+	}
+	spin_unlock_irqrestore(&irq_lock, intr_flag);
+	return 0;
+}
+
+// irq_target - the cpu irq goes to, -1 if it is not routed yet
+int irq_target(int irq)
+{
+	assert(irq >= 0 && irq < IRQ_COUNT);
+	return irq_descs[irq].cpu;
+}
+
+// irq_alloc_msi - an IRQ for the entry of the MSI-X table msix, routed by
+//               - irq_route as a pin is
+int irq_alloc_msi(struct pci_msix *msix, int entry)
+{
+	bool intr_flag;
+	int irq, ret = -E_BUSY;
+	spin_lock_irqsave(&irq_lock, intr_flag);
+	for (irq = IRQ_MSI_BASE; irq < IRQ_MSI_END; irq++) {
+		struct irq_desc *desc = irq_descs + irq;
+		if (!desc->msi) {
+			desc->msi = 1;
+			desc->msix = msix, desc->msix_entry = entry;
+			desc->affinity = irq_default_affinity;
+			desc->cpu = -1;
+			ret = irq;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&irq_lock, intr_flag);
+	return ret;
+}
+
+void irq_free_msi(int irq)
+{
+	struct irq_desc *desc = irq_descs + irq;
+	bool intr_flag;
+	assert(irq >= IRQ_MSI_BASE && irq < IRQ_MSI_END && desc->msi);
+	spin_lock_irqsave(&irq_lock, intr_flag);
+	if (desc->routed) {
+		pci_msix_mask(desc->msix, desc->msix_entry);
+		desc->routed = 0;
+	}
+	desc->msi = 0;
+	desc->msix = NULL;
+	spin_unlock_irqrestore(&irq_lock, intr_flag);
+}
+
+// irq_count - this cpu took irq, called with interrupts disabled
+void irq_count(int irq)
+{
+	get_cpu_ptr(irq_stats)->count[irq]++;
+}
+
+// irq_cpu_count - the times cpu took irq
+uint64_t irq_cpu_count(int cpu, int irq)
+{
+	return per_cpu_ptr(irq_stats, cpu)->count[irq];
+}
+
+#ifdef UCONFIG_IRQ_BALANCE
+static uint64_t irq_total(int irq)
+{
+	uint64_t total = 0;
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		total += per_cpu_ptr(irq_stats, i)->count[irq];
+	}
+	return total;
+}
+
+static int cpu_node(int cpu)
+{
+	struct cpu *c = per_cpu_ptr(cpus, cpu);
+	return c->node != NULL ? c->node->id : -1;
+}
+
+static void irq_balance(struct work_struct *work)
+{
+	uint64_t load[NCPU], delta[IRQ_COUNT];
+	int order[IRQ_COUNT], n = 0, i, j, cpu;
+	bool intr_flag;
+	memset(load, 0, sizeof(load));
+	spin_lock_irqsave(&irq_lock, intr_flag);
+	for (i = 0; i < IRQ_COUNT; i++) {
+		struct irq_desc *desc = irq_descs + i;
+		uint64_t total;
+		if (!desc->routed) {
+			continue;
+		}
+		total = irq_total(i);
+		delta[i] = total - desc->last_count;
+		desc->last_count = total;
+		/* the busiest first */
+		for (j = n; j > 0 && delta[order[j - 1]] < delta[i]; j--) {
+			order[j] = order[j - 1];
+		}
+		order[j] = i, n++;
+	}
+	for (j = 0; j < n && delta[order[j]] != 0; j++) {
+		struct irq_desc *desc = irq_descs + (i = order[j]);
+		int best = desc->cpu, node = cpu_node(desc->cpu);
+		uint64_t best_cost = load[best];
+		for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+			uint64_t cost = load[cpu]
+			    + (cpu_node(cpu) != node ? delta[i] : 0);
+			if (cpuset_test(&(desc->affinity), cpu)
+			    && cost < best_cost) {
+				best = cpu, best_cost = cost;
+			}
+		}
+		load[best] += delta[i];
+		if (best != desc->cpu) {
+			desc->cpu = best;
+			__irq_route(i);
+		}
+	}
+	spin_unlock_irqrestore(&irq_lock, intr_flag);
+}
+
+// irq_balance_tick - called on the ticks of cpu 0
+void irq_balance_tick(void)
+{
+	static int nticks;
+	if (irq_balance_on && ++nticks >= IRQ_BALANCE_TICKS) {
+		nticks = 0;
+		schedule_work(&irq_balance_work);
+	}
+}
+#endif
+
+// do_irqaffinity - SYS_irqaffinity, the cpus are those of the bits of
+//                - *mask, up to 64 of them
+int do_irqaffinity(int op, int irq, uint64_t __user * mask)
+{
+	struct mm_struct *mm = current->mm;
+	uint64_t m = 0;
+	cpuset_t set;
+	bool intr_flag, ok;
+	int i;
+	if (irq < 0 || irq >= IRQ_COUNT) {
+		return -E_INVAL;
+	}
+	switch (op) {
+	case IRQ_AFFINITY_SET:
+		lock_mm(mm);
+		ok = copy_from_user(mm, &m, mask, sizeof(uint64_t), 0);
+		unlock_mm(mm);
+		if (!ok) {
+			return -E_INVAL;
+		}
+		memset(&set, 0, sizeof(cpuset_t));
+		for (i = 0; i < 64 && i < sysconf.lcpu_count; i++) {
+			if (m & (1ULL << i)) {
+				cpuset_set(&set, i);
+			}
+		}
+		return irq_set_affinity(irq, &set);
+	case IRQ_AFFINITY_GET:
+		spin_lock_irqsave(&irq_lock, intr_flag);
+		for (i = 0; i < 64 && i < sysconf.lcpu_count; i++) {
+			if (cpuset_test(&(irq_descs[irq].affinity), i)) {
+				m |= (1ULL << i);
+			}
+		}
+		spin_unlock_irqrestore(&irq_lock, intr_flag);
+		lock_mm(mm);
+		ok = copy_to_user(mm, mask, &m, sizeof(uint64_t));
+		unlock_mm(mm);
+		return ok ? 0 : -E_INVAL;
+	case IRQ_AFFINITY_CPU:
+		return irq_target(irq);
+	}
+	return -E_INVAL;
+}
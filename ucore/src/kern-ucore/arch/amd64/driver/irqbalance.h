@@ -0,0 +1,28 @@
+#ifndef __KERN_DRIVER_IRQBALANCE_H__
+#define __KERN_DRIVER_IRQBALANCE_H__
+
+#include <types.h>
+#include <trap.h>
+#include <cpuset.h>
+
+struct pci_msix;
+
+/* the IRQs of the MSI-X vectors, above the pins of the IOAPIC */
+#define IRQ_MSI_BASE                    24
+#define IRQ_MSI_END                     IRQ_SPURIOUS
+
+void irq_affinity_init(const char *cmdline);
+void irq_route(int irq);
+void irq_unroute(int irq);
+int irq_set_affinity(int irq, const cpuset_t * mask);
+int irq_target(int irq);
+int irq_alloc_msi(struct pci_msix *msix, int entry);
+void irq_free_msi(int irq);
+void irq_count(int irq);
+uint64_t irq_cpu_count(int cpu, int irq);
+#ifdef UCONFIG_IRQ_BALANCE
+void irq_balance_tick(void);
+#endif
+int do_irqaffinity(int op, int irq, uint64_t __user * mask);
+
+#endif /* !__KERN_DRIVER_IRQBALANCE_H__ */
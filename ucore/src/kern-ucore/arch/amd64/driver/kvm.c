@@ -0,0 +1,325 @@
+#include <types.h>
+#include <arch.h>
+#include <kio.h>
+#include <sync.h>
+#include <pmm.h>
+#include <mp.h>
+#include <sysconf.h>
+#include <spinlock.h>
+#include <timekeeping.h>
+#include <cpuid.h>
+#include <kvm.h>
+
+/* *
+ * The paravirtual interfaces of KVM, for a kernel run as its guest:
+ *
+ *  - kvmclock: the host keeps in a page of each vcpu the ns it counted
+ *    at a tsc stamp, and the scale from the tsc to ns. It gives the rate
+ *    of the tsc, without timing it against the emulated PIT, see hz_init,
+ *    and a clocksource for the tsc of vcpus that are not kept in step;
+ *  - steal time: the ns each vcpu could run but the host ran something
+ *    else, which the scheduler does not charge, see account_tick, and
+ *    whether the vcpu is preempted right now;
+ *  - PV TLB flush: a shootdown to a preempted vcpu only sets a flag in
+ *    its steal time, the host flushes its TLB before it runs it again;
+ *  - PV spinlocks: a waiter spinning long on a lock halts until the
+ *    release kicks its vcpu by a hypercall, so the holder, likely
+ *    preempted, gets the physical cpu back. See spinlock.h and
+ *    qspin_lock.
+ *
+ * Each vcpu gives the host the physical address of its areas by MSRs, the
+ * BSP in hz_init and kvm_guest_init, the APs in kvm_guest_init_ap.
+ * */
+
+#define KVM_FEATURE_CLOCKSOURCE2        3
+#define KVM_FEATURE_STEAL_TIME          5
+#define KVM_FEATURE_PV_UNHALT           7
+#define KVM_FEATURE_PV_TLB_FLUSH        9
+#define KVM_FEATURE_CLOCKSOURCE_STABLE  24
+
+#define MSR_KVM_SYSTEM_TIME_NEW         0x4b564d01
+#define MSR_KVM_STEAL_TIME              0x4b564d03
+#define KVM_MSR_ENABLED                 1
+
+#define KVM_HC_KICK_CPU                 5
+
+#define PVCLOCK_TSC_STABLE              0x1	// in flags of pvclock
+#define KVM_VCPU_PREEMPTED              0x1	// in preempted of steal time
+#define KVM_VCPU_FLUSH_TLB              0x2
+
+/* the kvmclock area of a vcpu, seqlocked by version */
+struct pvclock {
+	volatile uint32_t version;
+	uint32_t pad0;
+	uint64_t tsc_timestamp;
+	uint64_t system_time;	// ns at tsc_timestamp
+	uint32_t tsc_to_system_mul;	// ns per tsc << 32, after tsc_shift
+	int8_t tsc_shift;
+	uint8_t flags;
+	uint8_t pad[2];
+};
+
+/* the steal time area of a vcpu, seqlocked by version */
+struct kvm_steal_time {
+	uint64_t steal;		// ns runnable but not run
+	volatile uint32_t version;
+	uint32_t flags;
+	volatile uint8_t preempted;
+	uint8_t pad0[3];
+	uint32_t pad[11];
+};
+
+/* indexed by cpu id, the BSP registers its clock before percpu_init */
+static struct pvclock kvmclock_areas[NCPU] __attribute__ ((aligned(64)));
+static struct kvm_steal_time kvm_steal_areas[NCPU]
+    __attribute__ ((aligned(64)));
+
+static uint32_t kvm_features;
+static bool kvmclock_on, kvmclock_stable;
+static bool kvm_steal_on, kvm_pv_tlb_on;
+static volatile uint64_t kvmclock_last;
+
+/* read by spinlock_acquire and qspin_lock */
+bool kvm_pv_spin;
+
+static inline bool kvm_has(int feature)
+{
+	return (kvm_features >> feature) & 1;
+}
+
+static inline long kvm_hypercall2(unsigned int nr, unsigned long a0,
+				  unsigned long a1)
+{
+	long ret;
+	/* emulated by the host on AMD, where it is vmmcall */
+	__asm volatile ("vmcall":"=a" (ret):"a"(nr), "b"(a0), "c"(a1)
+			:"memory");
+	return ret;
+}
+
+static uint64_t pvclock_read(struct pvclock *pv)
+{
+	uint32_t version;
+	uint64_t delta, ns;
+	do {
+		version = pv->version;
+		barrier();
+		delta = rdtsc() - pv->tsc_timestamp;
+		if (pv->tsc_shift < 0) {
+			delta >>= -pv->tsc_shift;
+		} else {
+			delta <<= pv->tsc_shift;
+		}
+		ns = pv->system_time +
+		    (uint64_t) (((unsigned __int128)delta *
+				 pv->tsc_to_system_mul) >> 32);
+		barrier();
+	} while ((version & 1) || version != pv->version);
+	return ns;
+}
+
+static void kvmclock_enable(int cpu)
+{
+	writemsr(MSR_KVM_SYSTEM_TIME_NEW,
+		 PADDR(&kvmclock_areas[cpu]) | KVM_MSR_ENABLED);
+}
+
+// kvm_tsc_hz - the rate of the tsc the host gives the BSP, 0 if it is not
+//            - KVM or has no kvmclock; called by hz_init before tls_init
+uint64_t kvm_tsc_hz(void)
+{
+	struct pvclock *pv = &kvmclock_areas[0];
+	uint64_t hz;
+	kvm_features = cpuid_kvm_features();
+	if (!kvm_has(KVM_FEATURE_CLOCKSOURCE2)) {
+		return 0;
+	}
+	kvmclock_enable(0);
+	while (pv->version == 0 || (pv->version & 1)) ;
+	/* mul is the ns of a tsc cycle, shifted, in 32.32 fixed point */
+	hz = (NSEC_PER_SEC << 32) / pv->tsc_to_system_mul;
+	if (pv->tsc_shift < 0) {
+		hz <<= -pv->tsc_shift;
+	} else {
+		hz >>= pv->tsc_shift;
+	}
+	kvmclock_on = 1;
+	kvmclock_stable = kvm_has(KVM_FEATURE_CLOCKSOURCE_STABLE)
+	    && (pv->flags & PVCLOCK_TSC_STABLE);
+	return hz;
+}
+
+// kvm_tsc_stable - whether the host keeps the tsc of all the vcpus in step
+bool kvm_tsc_stable(void)
+{
+	return kvmclock_stable;
+}
+
+static uint64_t kvmclock_read(void)
+{
+	uint64_t ns, last;
+	bool intr_flag;
+	if (kvmclock_stable) {
+		return pvclock_read(&kvmclock_areas[0]);
+	}
+	local_intr_save(intr_flag);
+	ns = pvclock_read(&kvmclock_areas[myid()]);
+	local_intr_restore(intr_flag);
+	/* the clocks of the vcpus may be a little apart, never go back */
+	do {
+		if ((last = kvmclock_last) >= ns) {
+			return last;
+		}
+	} while (!__sync_bool_compare_and_swap(&kvmclock_last, last, ns));
+	return ns;
+}
+
+/* above a tsc that may drift, below one that is invariant or stable */
+static struct clocksource clocksource_kvm = {
+	.name = "kvm-clock",
+	.rating = 200,
+	.freq = NSEC_PER_SEC,
+	.user_tsc = 0,
+	.read = kvmclock_read,
+};
+
+void kvmclock_register(void)
+{
+	if (kvmclock_on) {
+		clocksource_register(&clocksource_kvm);
+	}
+}
+
+static void kvm_guest_init_cpu(int cpu)
+{
+	if (kvmclock_on && cpu != 0) {
+		kvmclock_enable(cpu);
+	}
+	if (kvm_steal_on) {
+		writemsr(MSR_KVM_STEAL_TIME,
+			 PADDR(&kvm_steal_areas[cpu]) | KVM_MSR_ENABLED);
+	}
+}
+
+// kvm_guest_init - turn the paravirtual interfaces the host has on, on the
+//                - BSP after percpu_init
+void kvm_guest_init(void)
+{
+	if (kvm_features == 0) {
+		return;
+	}
+	kvm_steal_on = kvm_has(KVM_FEATURE_STEAL_TIME);
+	kvm_pv_tlb_on = kvm_steal_on && kvm_has(KVM_FEATURE_PV_TLB_FLUSH);
+	kvm_pv_spin = kvm_has(KVM_FEATURE_PV_UNHALT) && sysconf.lcpu_count > 1;
+	kvm_guest_init_cpu(0);
+	kprintf("kvm: features 0x%x, kvmclock %s, steal time %d, "
+		"pv tlb flush %d, pv spinlocks %d\n", kvm_features,
+		kvmclock_on ? (kvmclock_stable ? "stable" : "on") : "off",
+		kvm_steal_on, kvm_pv_tlb_on, kvm_pv_spin);
+}
+
+void kvm_guest_init_ap(void)
+{
+	if (kvm_features != 0) {
+		kvm_guest_init_cpu(myid());
+	}
+}
+
+// kvm_steal_clock - the ns this vcpu was runnable but not run by the host
+uint64_t kvm_steal_clock(void)
+{
+	struct kvm_steal_time *st;
+	uint32_t version;
+	uint64_t steal;
+	if (!kvm_steal_on) {
+		return 0;
+	}
+	st = &kvm_steal_areas[myid()];
+	do {
+		version = st->version;
+		barrier();
+		steal = st->steal;
+		barrier();
+	} while ((version & 1) || version != st->version);
+	return steal;
+}
+
+// kvm_tlb_defer - a shootdown for cpu, return true if the host flushes its
+//               - TLB instead, as the vcpu is preempted
+bool kvm_tlb_defer(int cpu)
+{
+	struct kvm_steal_time *st = &kvm_steal_areas[cpu];
+	uint8_t state;
+	if (!kvm_pv_tlb_on) {
+		return 0;
+	}
+	state = st->preempted;
+	/* it may run again meanwhile, the flag is set only if not */
+	return (state & KVM_VCPU_PREEMPTED)
+	    && __sync_bool_compare_and_swap(&(st->preempted), state,
+					    state | KVM_VCPU_FLUSH_TLB);
+}
+
+// kvm_halt - halt until an interrupt or a kick, which wakes the vcpu even
+//          - with interrupts off; a kick sent before the halt is not lost
+void kvm_halt(bool intr_on)
+{
+	if (intr_on) {
+		__asm volatile ("sti; hlt":::"memory");
+	} else {
+		__asm volatile ("hlt":::"memory");
+	}
+}
+
+void kvm_kick_cpu(int cpu)
+{
+	kvm_hypercall2(KVM_HC_KICK_CPU, 0, per_cpu_ptr(cpus, cpu)->hwid);
+}
+
+/* *
+ * The ticket lock waiters halted: at most one a cpu, an interrupt handler
+ * waiting for another lock takes the entry over; the one it interrupted
+ * finds out when it spins again. A release kicks the cpu whose ticket
+ * comes next.
+ * */
+static struct kvm_lock_waiting {
+	spinlock_t volatile lock;
+	volatile uint16_t want;
+} kvm_lock_waiting[NCPU];
+
+/* read by spinlock_release */
+volatile int kvm_lock_nr_waiting;
+
+// kvm_lock_wait - halt until the ticket of lock is want, or an interrupt
+//               - comes
+void kvm_lock_wait(spinlock_t lock, uint16_t want)
+{
+	struct kvm_lock_waiting *w;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	w = &kvm_lock_waiting[myid()];
+	w->want = want;
+	w->lock = lock;
+	/* a full barrier, the release reads nr_waiting after owner */
+	__sync_fetch_and_add(&kvm_lock_nr_waiting, 1);
+	if (lock->owner != want) {
+		kvm_halt(intr_flag);
+		cli();
+	}
+	w->lock = NULL;
+	__sync_fetch_and_sub(&kvm_lock_nr_waiting, 1);
+	local_intr_restore(intr_flag);
+}
+
+// kvm_unlock_kick - lock was released to owner, kick its waiter if halted
+void kvm_unlock_kick(spinlock_t lock, uint16_t owner)
+{
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct kvm_lock_waiting *w = &kvm_lock_waiting[i];
+		if (w->lock == lock && w->want == owner) {
+			kvm_kick_cpu(i);
+			break;
+		}
+	}
+}
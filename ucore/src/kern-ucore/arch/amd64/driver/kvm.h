@@ -0,0 +1,17 @@
+#ifndef __KERN_DRIVER_KVM_H__
+#define __KERN_DRIVER_KVM_H__
+
+#include <types.h>
+
+#ifdef UCONFIG_KVM_GUEST
+uint64_t kvm_tsc_hz(void);
+bool kvm_tsc_stable(void);
+void kvmclock_register(void);
+void kvm_guest_init(void);
+void kvm_guest_init_ap(void);
+bool kvm_tlb_defer(int cpu);
+void kvm_halt(bool intr_on);
+void kvm_kick_cpu(int cpu);
+#endif
+
+#endif /* !__KERN_DRIVER_KVM_H__ */
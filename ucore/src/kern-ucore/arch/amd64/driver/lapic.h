@@ -5,6 +5,7 @@
 #include <mmu.h>
 #include <pmm.h>
 #include <mp.h>
+#include <trace.h>
 
 int lapic_init(void);
 int lapic_init_ap(void);
@@ -20,7 +21,18 @@ struct lapic_chip{
 	void (*eoi)(struct lapic_chip*);
 	void (*init_late)(struct lapic_chip*);
 	void (*start_ap)(struct lapic_chip*, struct cpu*, uint32_t addr);
+	/* optional, start n cpus at once, sharing the waits of start_ap */
+	void (*start_aps)(struct lapic_chip*, struct cpu**, int n, uint32_t addr);
 	void (*send_ipi)(struct lapic_chip*, struct cpu*, int num);
+	/* optional, one IPI to every cpu but the sender */
+	void (*send_ipi_allbutself)(struct lapic_chip*, int num);
+	/* optional, used by tickless idle */
+	void (*timer_oneshot)(struct lapic_chip*, uint64_t nsec);
+	void (*timer_periodic)(struct lapic_chip*);
+	/* optional, the ns to the next interrupt, used by the hrtimers */
+	uint64_t (*timer_left)(struct lapic_chip*);
+	/* optional, the performance counter LVT as NMI, used by the profiler */
+	void (*pc_mask)(struct lapic_chip*, int mask);
 	void *private_data;
 };
 
@@ -34,6 +46,7 @@ struct lapic_chip *lapic_get_chip();
 	__c->eoi(__c);}while(0)
 
 #define lapic_send_ipi(cpu, num) do{struct lapic_chip* __c = lapic_get_chip(); \
+	trace_event(TRACE_IPI_SEND, (int)(cpu)->id, num); \
 	__c->send_ipi(__c, cpu, num);}while(0)
 
 #define lapic_start_ap(cpuid, addr) do{struct lapic_chip* __c = lapic_get_chip(); \
@@ -43,5 +56,8 @@ struct lapic_chip *lapic_get_chip();
 #define lapic_init_late() do{struct lapic_chip* __c = lapic_get_chip(); \
 	__c->init_late(__c);}while(0)
 
+#define lapic_pc_mask(mask) do{struct lapic_chip* __c = lapic_get_chip(); \
+	if (__c->pc_mask != NULL) __c->pc_mask(__c, mask);}while(0)
+
 #endif
 
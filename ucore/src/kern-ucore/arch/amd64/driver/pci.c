@@ -0,0 +1,218 @@
+#include <types.h>
+#include <arch.h>
+#include <error.h>
+#include <assert.h>
+#include <pmm.h>
+#include <pci.h>
+
+/*
+ * The configuration space through mechanism #1: the address of a register
+ * goes to CONFIG_ADDRESS, then CONFIG_DATA reads or writes it.
+ */
+#define PCI_CONFIG_ADDRESS              0xCF8
+#define PCI_CONFIG_DATA                 0xCFC
+
+#define PCI_MAX_BUS                     256
+#define PCI_MAX_DEV                     32
+#define PCI_MAX_FUNC                    8
+
+static void pci_conf_select(struct pci_func *f, int reg)
+{
+	outl(PCI_CONFIG_ADDRESS, (1U << 31) | (f->bus << 16) | (f->dev << 11)
+	     | (f->func << 8) | (reg & 0xFC));
+}
+
+uint32_t pci_conf_read(struct pci_func *f, int reg)
+{
+	pci_conf_select(f, reg);
+	return inl(PCI_CONFIG_DATA);
+}
+
+void pci_conf_write(struct pci_func *f, int reg, uint32_t val)
+{
+	pci_conf_select(f, reg);
+	outl(PCI_CONFIG_DATA, val);
+}
+
+/*
+ * Call match on every function, store in f the first one it accepts.
+ * The functions above 0 of a device are looked at only if it has them.
+ */
+static int pci_scan(bool (*match) (struct pci_func * f, uint32_t id, void *arg),
+		    void *arg, struct pci_func *f)
+{
+	int bus, dev, func;
+	for (bus = 0; bus < PCI_MAX_BUS; bus++) {
+		for (dev = 0; dev < PCI_MAX_DEV; dev++) {
+			for (func = 0; func < PCI_MAX_FUNC; func++) {
+				f->bus = bus, f->dev = dev, f->func = func;
+				uint32_t id = pci_conf_read(f, 0);
+				if ((id & 0xFFFF) == 0xFFFF) {
+					/* no such function */
+					if (func == 0) {
+						break;
+					}
+					continue;
+				}
+				if (match(f, id, arg)) {
+					return 0;
+				}
+				if (func == 0
+				    && (pci_conf_read(f, PCI_HEADER) &
+					PCI_HEADER_MULTI) == 0) {
+					break;
+				}
+			}
+		}
+	}
+	return -E_NOENT;
+}
+
+static bool pci_match_class(struct pci_func *f, uint32_t id, void *arg)
+{
+	uint32_t cls = pci_conf_read(f, PCI_CLASS), want = *(uint32_t *) arg;
+	return (cls >> 16) == want;
+}
+
+// pci_find_class - store in f the first function of class/subclass
+int pci_find_class(uint8_t class, uint8_t subclass, struct pci_func *f)
+{
+	uint32_t want = (class << 8) | subclass;
+	return pci_scan(pci_match_class, &want, f);
+}
+
+struct pci_id {
+	uint32_t id;
+	int index;
+};
+
+static bool pci_match_id(struct pci_func *f, uint32_t id, void *arg)
+{
+	struct pci_id *want = arg;
+	return id == want->id && want->index-- == 0;
+}
+
+// pci_find_device - store in f the index-th function of vendor/device
+int pci_find_device(uint16_t vendor, uint16_t device, int index,
+		    struct pci_func *f)
+{
+	struct pci_id want = { ((uint32_t) device << 16) | vendor, index };
+	return pci_scan(pci_match_id, &want, f);
+}
+
+// pci_find_cap - the offset of the capability id of f, 0 if it has none
+int pci_find_cap(struct pci_func *f, uint8_t id)
+{
+	int off, n;
+	if ((pci_conf_read(f, PCI_STATUS) & PCI_STATUS_CAPS) == 0) {
+		return 0;
+	}
+	off = pci_conf_read(f, PCI_CAPS) & 0xFC;
+	/* a broken list must not loop */
+	for (n = 0; off != 0 && n < 48; n++) {
+		uint32_t cap = pci_conf_read(f, off);
+		if ((cap & 0xFF) == id) {
+			return off;
+		}
+		off = (cap >> 8) & 0xFC;
+	}
+	return 0;
+}
+
+/* the message control word is the upper half of the first dword */
+#define PCI_MSIX_CTRL_SIZE(ctrl)        ((((ctrl) >> 16) & 0x7FF) + 1)
+#define PCI_MSIX_CTRL_MASKALL           0x40000000
+#define PCI_MSIX_CTRL_ENABLE            0x80000000
+#define PCI_MSIX_TABLE                  0x04	/* BIR and offset */
+#define PCI_MSIX_BIR_MASK               0x7
+
+/* an entry of the table, in dwords */
+#define PCI_MSIX_ENTRY_ADDR_LO          0
+#define PCI_MSIX_ENTRY_ADDR_HI          1
+#define PCI_MSIX_ENTRY_DATA             2
+#define PCI_MSIX_ENTRY_CTRL             3
+#define PCI_MSIX_ENTRY_MASKED           0x1
+
+/* the messages to the lapics, see the Intel SDM 10.11 */
+#define MSI_ADDR_BASE                   0xFEE00000
+#define MSI_ADDR_DEST_SHIFT             12
+
+/*
+ * pci_msix_init - find the MSI-X table of f and map it uncached, with all
+ * its entries masked. MSI-X itself stays off until pci_msix_enable.
+ */
+int pci_msix_init(struct pci_func *f, struct pci_msix *msix)
+{
+	int cap, bir, i;
+	uint32_t ctrl, table, bar;
+	uint64_t phys;
+	if ((cap = pci_find_cap(f, PCI_CAP_MSIX)) == 0) {
+		return -E_NODEV;
+	}
+	ctrl = pci_conf_read(f, cap);
+	table = pci_conf_read(f, cap + PCI_MSIX_TABLE);
+	bir = table & PCI_MSIX_BIR_MASK;
+	if (bir > 5 || ((bar = pci_conf_read(f, PCI_BAR(bir))) & 1) != 0) {
+		return -E_NODEV;
+	}
+	phys = bar & ~0xFULL;
+	if (((bar >> 1) & 0x3) == 0x2 && bir < 5) {
+		/* a 64-bit BAR */
+		phys |= (uint64_t) pci_conf_read(f, PCI_BAR(bir + 1)) << 32;
+	}
+	if (phys == 0) {
+		return -E_NODEV;
+	}
+	pci_conf_write(f, PCI_COMMAND,
+		       pci_conf_read(f, PCI_COMMAND) | PCI_COMMAND_MEM);
+	phys += table & ~PCI_MSIX_BIR_MASK;
+	msix->f = f, msix->cap = cap;
+	msix->nvec = PCI_MSIX_CTRL_SIZE(ctrl);
+	msix->table = VADDR_DIRECT(phys);
+	uintptr_t va = ROUNDDOWN((uintptr_t) msix->table, PGSIZE);
+	for (; va < (uintptr_t) (msix->table + 4 * msix->nvec); va += PGSIZE) {
+		*get_pte(boot_pgdir, va, 1) = (va - KERNBASE)
+		    | PTE_P | PTE_W | PTE_PWT | PTE_PCD;
+		invlpg((void *)va);
+	}
+	for (i = 0; i < msix->nvec; i++) {
+		msix->table[4 * i + PCI_MSIX_ENTRY_CTRL] |=
+		    PCI_MSIX_ENTRY_MASKED;
+	}
+	return 0;
+}
+
+// pci_msix_enable - switch the interrupts of the function from the INTx
+//                 - line to the entries of its table, or back
+void pci_msix_enable(struct pci_msix *msix, bool on)
+{
+	uint32_t ctrl = pci_conf_read(msix->f, msix->cap);
+	ctrl &= ~(PCI_MSIX_CTRL_ENABLE | PCI_MSIX_CTRL_MASKALL);
+	pci_conf_write(msix->f, msix->cap,
+		       ctrl | (on ? PCI_MSIX_CTRL_ENABLE : 0));
+}
+
+/*
+ * pci_msix_route - have entry raise vector on the lapic apic_id. The entry
+ * is masked while its message changes, an interrupt meanwhile is held by
+ * the function until it is unmasked.
+ */
+void pci_msix_route(struct pci_msix *msix, int entry, int vector,
+		    uint32_t apic_id)
+{
+	volatile uint32_t *e = msix->table + 4 * entry;
+	assert(entry >= 0 && entry < msix->nvec);
+	e[PCI_MSIX_ENTRY_CTRL] |= PCI_MSIX_ENTRY_MASKED;
+	e[PCI_MSIX_ENTRY_ADDR_LO] =
+	    MSI_ADDR_BASE | ((apic_id & 0xFF) << MSI_ADDR_DEST_SHIFT);
+	e[PCI_MSIX_ENTRY_ADDR_HI] = 0;
+	/* fixed delivery, edge triggered */
+	e[PCI_MSIX_ENTRY_DATA] = vector & 0xFF;
+	e[PCI_MSIX_ENTRY_CTRL] &= ~PCI_MSIX_ENTRY_MASKED;
+}
+
+void pci_msix_mask(struct pci_msix *msix, int entry)
+{
+	assert(entry >= 0 && entry < msix->nvec);
+	msix->table[4 * entry + PCI_MSIX_ENTRY_CTRL] |= PCI_MSIX_ENTRY_MASKED;
+}
@@ -0,0 +1,53 @@
+#ifndef __KERN_DRIVER_PCI_H__
+#define __KERN_DRIVER_PCI_H__
+
+#include <types.h>
+
+/* the registers of the configuration space header */
+#define PCI_COMMAND                     0x04
+#define PCI_STATUS                      0x04	/* the upper 16 bits */
+#define PCI_CLASS                       0x08
+#define PCI_HEADER                      0x0C
+#define PCI_BAR(n)                      (0x10 + 4 * (n))
+#define PCI_CAPS                        0x34
+#define PCI_INTERRUPT                   0x3C
+
+#define PCI_COMMAND_IO                  0x1
+#define PCI_COMMAND_MEM                 0x2
+#define PCI_COMMAND_MASTER              0x4
+#define PCI_HEADER_MULTI                0x00800000	/* in PCI_HEADER */
+#define PCI_STATUS_CAPS                 0x00100000	/* in PCI_STATUS */
+
+/* the capabilities, a list from PCI_CAPS */
+#define PCI_CAP_MSIX                    0x11
+
+/* a function of a device on a bus */
+struct pci_func {
+	uint8_t bus, dev, func;
+};
+
+/*
+ * The MSI-X table of a function: each entry is the address and data of a
+ * message the function writes to raise one of its interrupts, a vector of
+ * the lapic of some cpu.
+ */
+struct pci_msix {
+	struct pci_func *f;
+	int cap;		/* the offset of the capability */
+	int nvec;		/* the entries of the table */
+	volatile uint32_t *table;
+};
+
+uint32_t pci_conf_read(struct pci_func *f, int reg);
+void pci_conf_write(struct pci_func *f, int reg, uint32_t val);
+int pci_find_class(uint8_t class, uint8_t subclass, struct pci_func *f);
+int pci_find_device(uint16_t vendor, uint16_t device, int index,
+		    struct pci_func *f);
+int pci_find_cap(struct pci_func *f, uint8_t id);
+int pci_msix_init(struct pci_func *f, struct pci_msix *msix);
+void pci_msix_enable(struct pci_msix *msix, bool on);
+void pci_msix_route(struct pci_msix *msix, int entry, int vector,
+		    uint32_t apic_id);
+void pci_msix_mask(struct pci_msix *msix, int entry);
+
+#endif /* !__KERN_DRIVER_PCI_H__ */
@@ -6,4 +6,8 @@ void pic_enable(unsigned int irq);
 
 #define IRQ_OFFSET      32
 
+typedef int (*ucore_irq_handler_t) (int, void *);
+
+void register_irq(int irq, ucore_irq_handler_t handler, void *opaque);
+
 #endif /* !__KERN_DRIVER_PICIRQ_H__ */
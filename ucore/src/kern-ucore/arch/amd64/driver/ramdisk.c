@@ -24,15 +24,147 @@
 #include <fs.h>
 #include <ramdisk.h>
 #include <ide.h>
+#include <pmm.h>
+#ifdef UCONFIG_RAMDISK_LZ4
+#include <list.h>
+#include <slab.h>
+#include <stdlib.h>
+#include <sem.h>
+#include <lz4.h>
+#include <rdz.h>
+#endif
 
 #define MIN(x,y) (((x)<(y))?(x):(y))
 
+#ifdef UCONFIG_RAMDISK_LZ4
+/*
+ * The compressed initrd, see rdz.h: its blocks are decompressed on the
+ * first read into pages of a cache, which keeps RDZ_CACHE_BLOCKS of them
+ * and drops the least recently used. A block written is kept for good,
+ * off the lru, as the image has no room for it. Under rdz_sem.
+ */
+#define RDZ_CACHE_BLOCKS            256
+#define RDZ_HASH_SHIFT              6
+#define RDZ_HASH_SIZE               (1 << RDZ_HASH_SHIFT)
+
+struct rdz_block {
+	uint32_t blkno;
+	bool dirty;
+	void *data;
+	list_entry_t hash_link;
+	list_entry_t lru_link;	// of the clean ones, the coldest first
+};
+
+#define le2rdzblock(le, member)                                         \
+    to_struct((le), struct rdz_block, member)
+
+static struct rdz_header *rdz;
+static list_entry_t rdz_hash[RDZ_HASH_SIZE];
+static list_entry_t rdz_lru;
+static int rdz_nr_clean;
+static semaphore_t rdz_sem;
+
+// rdz_fill - decompress block blkno of the image into data
+static int rdz_fill(uint32_t blkno, void *data)
+{
+	uint32_t *offsets = RDZ_OFFSETS(rdz);
+	const char *src = (const char *)rdz + offsets[blkno];
+	size_t len = offsets[blkno + 1] - offsets[blkno];
+	if (len == RDZ_BLOCK_SIZE) {
+		memcpy(data, src, RDZ_BLOCK_SIZE);
+		return 0;
+	}
+	if (lz4_decompress(src, len, data, RDZ_BLOCK_SIZE) != RDZ_BLOCK_SIZE) {
+		kprintf("ramdisk: block %d of the image is corrupt\n", blkno);
+		return -1;
+	}
+	return 0;
+}
+
+// rdz_get - the block blkno cached, decompressed if it was not
+static struct rdz_block *rdz_get(uint32_t blkno)
+{
+	list_entry_t *list = rdz_hash + hash32(blkno, RDZ_HASH_SHIFT), *le = list;
+	struct rdz_block *b;
+	while ((le = list_next(le)) != list) {
+		b = le2rdzblock(le, hash_link);
+		if (b->blkno == blkno) {
+			if (!b->dirty) {
+				list_del(&(b->lru_link));
+				list_add_before(&rdz_lru, &(b->lru_link));
+			}
+			return b;
+		}
+	}
+	if (rdz_nr_clean >= RDZ_CACHE_BLOCKS) {
+		b = le2rdzblock(list_next(&rdz_lru), lru_link);
+		list_del(&(b->lru_link));
+		list_del(&(b->hash_link));
+		rdz_nr_clean--;
+	} else {
+		struct Page *page;
+		if ((b = kmalloc(sizeof(struct rdz_block))) == NULL) {
+			return NULL;
+		}
+		if ((page = alloc_page()) == NULL) {
+			kfree(b);
+			return NULL;
+		}
+		b->data = page2kva(page);
+	}
+	if (rdz_fill(blkno, b->data) != 0) {
+		free_page(kva2page(b->data));
+		kfree(b);
+		return NULL;
+	}
+	b->blkno = blkno, b->dirty = 0;
+	list_add(list, &(b->hash_link));
+	list_add_before(&rdz_lru, &(b->lru_link));
+	rdz_nr_clean++;
+	return b;
+}
+
+// rdz_rw - copy the bytes [off, off + len) of the image to or from buf
+static int rdz_rw(size_t off, void *buf, size_t len, bool write)
+{
+	int ret = 0;
+	down(&rdz_sem);
+	while (len > 0) {
+		uint32_t blkno = off / RDZ_BLOCK_SIZE;
+		size_t blkoff = off % RDZ_BLOCK_SIZE;
+		size_t n = MIN(len, RDZ_BLOCK_SIZE - blkoff);
+		struct rdz_block *b = rdz_get(blkno);
+		if (b == NULL) {
+			ret = -1;
+			break;
+		}
+		if (write) {
+			if (!b->dirty) {
+				list_del(&(b->lru_link));
+				rdz_nr_clean--;
+				b->dirty = 1;
+			}
+			memcpy(b->data + blkoff, buf, n);
+		} else {
+			memcpy(buf, b->data + blkoff, n);
+		}
+		off += n, buf += n, len -= n;
+	}
+	up(&rdz_sem);
+	return ret;
+}
+#endif
+
 int ramdisk_read(struct ide_device *dev, unsigned long secno, void *dst,
 			unsigned long nsecs)
 {
 	nsecs = MIN(nsecs, dev->size - secno);
 	if (nsecs < 0)
 		return -1;
+#ifdef UCONFIG_RAMDISK_LZ4
+	if (rdz != NULL)
+		return rdz_rw(secno * SECTSIZE, dst, nsecs * SECTSIZE, 0);
+#endif
 	memcpy(dst, (void *)(initrd_begin + secno * SECTSIZE), nsecs * SECTSIZE);
 	return 0;
 }
@@ -44,26 +176,80 @@ int ramdisk_write(struct ide_device *dev, unsigned long secno,
 	nsecs = MIN(nsecs, dev->size - secno);
 	if (nsecs < 0)
 		return -1;
+#ifdef UCONFIG_RAMDISK_LZ4
+	if (rdz != NULL)
+		return rdz_rw(secno * SECTSIZE, (void *)src, nsecs * SECTSIZE, 1);
+#endif
 	memcpy((void *)(initrd_begin + secno * SECTSIZE), src, nsecs * SECTSIZE);
 	return 0;
 }
 
 void ramdisk_init(struct ide_device *dev)
 {
-	kprintf("ramdisk_init(): initrd found, magic: %p, 0x%08x secs\n",
-	initrd_begin, dev->size);
+	kprintf("ramdisk_init(): initrd found, magic: %p, 0x%08x secs%s\n",
+	initrd_begin, dev->size,
+#ifdef UCONFIG_RAMDISK_LZ4
+	(rdz != NULL) ? ", lz4 compressed" :
+#endif
+	"");
+
+}
+
+#ifdef UCONFIG_RAMDISK_LZ4
+// rdz_init - take the initrd as a compressed image if it is one
+static bool rdz_init(void)
+{
+	struct rdz_header *h = (struct rdz_header *)initrd_begin;
+	int i;
+	if (INITRD_SIZE() < sizeof(struct rdz_header) || h->magic != RDZ_MAGIC)
+		return 0;
+	if (h->block_size != RDZ_BLOCK_SIZE
+	    || RDZ_OFFSETS(h)[h->nblocks] > INITRD_SIZE()) {
+		kprintf("ramdisk: bad compressed image, taken as it is\n");
+		return 0;
+	}
+	for (i = 0; i < RDZ_HASH_SIZE; i++)
+		list_init(rdz_hash + i);
+	list_init(&rdz_lru);
+	sem_init(&rdz_sem, 1);
+	rdz = h;
+	return 1;
+}
+#endif
 
+/*
+ * The image as it is is the disk: the filesystem on it reads and writes it
+ * in place and maps its pages to the user, see vop_direct. The pages were
+ * reserved by pmm with no reference; one for the ramdisk keeps them from
+ * being freed when the last user mapping goes.
+ */
+static void ramdisk_init_mem(struct ide_device *dev)
+{
+	char *p;
+	if ((uintptr_t) initrd_begin % PGSIZE != 0)
+		return;
+	for (p = initrd_begin; p < initrd_end; p += PGSIZE)
+		set_page_ref(kva2page(p), 1);
+	dev->mem = initrd_begin;
 }
 
 void ramdisk_init_struct(struct ide_device *dev)
 {
 	memset(dev, 0, sizeof(struct ide_device));
-	assert(INITRD_SIZE() % SECTSIZE == 0);
 	if (CHECK_INITRD_EXIST()) {
 		dev->valid = 1;
 		dev->sets = ~0;
 		dev->ramdisk = 1;
+#ifdef UCONFIG_RAMDISK_LZ4
+		if (rdz_init()) {
+			dev->size = rdz->nblocks * (RDZ_BLOCK_SIZE / SECTSIZE);
+			strcpy(dev->model, "KERN_INITRD");
+			return;
+		}
+#endif
+		assert(INITRD_SIZE() % SECTSIZE == 0);
 		dev->size = INITRD_SIZE() / SECTSIZE;
+		ramdisk_init_mem(dev);
 		//dev->iobase = (void *) DISK_FS_VBASE;
 		strcpy(dev->model, "KERN_INITRD");
 		//dev->init = ramdisk_init;
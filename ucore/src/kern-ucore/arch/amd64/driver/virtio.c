@@ -0,0 +1,365 @@
+#include <types.h>
+#include <arch.h>
+#include <string.h>
+#include <stdio.h>
+#include <trap.h>
+#include <picirq.h>
+#include <pmm.h>
+#include <slab.h>
+#include <error.h>
+#include <assert.h>
+#include <kio.h>
+#include <irqbalance.h>
+#include <virtio.h>
+#include <virtio_blk.h>
+#include <virtio_console.h>
+#include <virtio_balloon.h>
+#include <virtio_net.h>
+
+/*
+ * The legacy virtio-pci transport, as QEMU/KVM offers it: the registers of
+ * a device are in the I/O space of BAR0, and each virtqueue is one block
+ * of physical pages whose frame # is written to VIRTIO_PCI_QUEUE_PFN.
+ *
+ * The devices of an IRQ line share one handler, which reads the ISR of
+ * each of them (that acknowledges it) and calls the intr of those that
+ * raised it. A device with MSI-X gives each of its queues a vector of its
+ * own instead, an IRQ which goes to a cpu of its own: nothing is shared,
+ * there is no ISR to read, and the queues can be spread over the cpus,
+ * see irqbalance.c.
+ */
+
+#define VIRTIO_MAX_DEVS                 4
+#define VIRTIO_PCI_QUEUE_ADDR_SHIFT     12
+
+#define virtio_barrier() asm volatile ("" ::: "memory")
+
+static struct virtio_dev *virtio_devs[VIRTIO_MAX_DEVS];
+static int nr_virtio_devs;
+
+// virtio_probe - reset the index-th virtio device of the PCI id device
+int virtio_probe(uint16_t device, int index, struct virtio_dev *vdev)
+{
+	uint32_t bar, line;
+	if (pci_find_device(VIRTIO_PCI_VENDOR, device, index, &(vdev->pci)) != 0) {
+		return -E_NODEV;
+	}
+	if (((bar = pci_conf_read(&(vdev->pci), PCI_BAR(0))) & 1) == 0) {
+		return -E_NODEV;
+	}
+	pci_conf_write(&(vdev->pci), PCI_COMMAND,
+		       pci_conf_read(&(vdev->pci), PCI_COMMAND)
+		       | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+	vdev->iobase = bar & 0xFFFC;
+	line = pci_conf_read(&(vdev->pci), PCI_INTERRUPT) & 0xFF;
+	vdev->irq = (line != 0 && line < IRQ_COUNT) ? line : -1;
+	vdev->intr = NULL, vdev->private = NULL;
+	vdev->nr_vqs = 0, vdev->msix_on = 0;
+
+	outb(vdev->iobase + VIRTIO_PCI_STATUS, 0);
+	outb(vdev->iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+	outb(vdev->iobase + VIRTIO_PCI_STATUS,
+	     VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+	return 0;
+}
+
+// virtio_negotiate - accept those of features the device offers
+uint32_t virtio_negotiate(struct virtio_dev *vdev, uint32_t features)
+{
+	features &= inl(vdev->iobase + VIRTIO_PCI_HOST_FEATURES);
+	outl(vdev->iobase + VIRTIO_PCI_GUEST_FEATURES, features);
+	return features;
+}
+
+void virtio_ready(struct virtio_dev *vdev)
+{
+	uint8_t status = inb(vdev->iobase + VIRTIO_PCI_STATUS);
+	outb(vdev->iobase + VIRTIO_PCI_STATUS,
+	     status | VIRTIO_STATUS_DRIVER_OK);
+}
+
+void virtio_fail(struct virtio_dev *vdev)
+{
+	uint8_t status = inb(vdev->iobase + VIRTIO_PCI_STATUS);
+	outb(vdev->iobase + VIRTIO_PCI_STATUS, status | VIRTIO_STATUS_FAILED);
+}
+
+// virtio_config_read - read size (1, 2 or 4) bytes of the device config
+uint32_t virtio_config_read(struct virtio_dev *vdev, int offset, int size)
+{
+	uint16_t port = vdev->iobase + offset
+	    + (vdev->msix_on ? VIRTIO_PCI_CONFIG_MSIX : VIRTIO_PCI_CONFIG);
+	switch (size) {
+	case 1:
+		return inb(port);
+	case 2:
+		return inw(port);
+	default:
+		return inl(port);
+	}
+}
+
+// virtio_config_write - write size (1, 2 or 4) bytes of the device config
+void virtio_config_write(struct virtio_dev *vdev, int offset, uint32_t val,
+			 int size)
+{
+	uint16_t port = vdev->iobase + offset
+	    + (vdev->msix_on ? VIRTIO_PCI_CONFIG_MSIX : VIRTIO_PCI_CONFIG);
+	switch (size) {
+	case 1:
+		outb(port, val);
+		break;
+	case 2:
+		outw(port, val);
+		break;
+	default:
+		outl(port, val);
+	}
+}
+
+static int virtio_irq(int irq, void *opaque)
+{
+	int i;
+	for (i = 0; i < nr_virtio_devs; i++) {
+		struct virtio_dev *vdev = virtio_devs[i];
+		/* reading the ISR acknowledges it */
+		if (vdev->irq == irq
+		    && inb(vdev->iobase + VIRTIO_PCI_ISR) != 0) {
+			vdev->intr(vdev);
+		}
+	}
+	return 0;
+}
+
+static int virtio_vq_irq(int irq, void *opaque)
+{
+	struct virtq *vq = opaque;
+	vq->vdev->intr(vq->vdev);
+	return 0;
+}
+
+static void virtio_msix_off(struct virtio_dev *vdev)
+{
+	int i;
+	for (i = 0; i < vdev->nr_vqs; i++) {
+		struct virtq *vq = vdev->vqs[i];
+		if (vq->irq >= 0) {
+			outw(vdev->iobase + VIRTIO_PCI_QUEUE_SEL, vq->index);
+			outw(vdev->iobase + VIRTIO_MSI_QUEUE_VECTOR,
+			     VIRTIO_MSI_NO_VECTOR);
+			irq_free_msi(vq->irq);
+			vq->irq = -1;
+		}
+	}
+	pci_msix_enable(&(vdev->msix), 0);
+	vdev->msix_on = 0;
+}
+
+// virtio_msix_setup - give each queue of vdev an MSI-X vector of its own,
+//                   - entry i of the table for the i-th queue
+static int virtio_msix_setup(struct virtio_dev *vdev)
+{
+	int i, irq;
+	if (vdev->nr_vqs == 0
+	    || pci_msix_init(&(vdev->pci), &(vdev->msix)) != 0
+	    || vdev->msix.nvec < vdev->nr_vqs) {
+		return -E_NODEV;
+	}
+	pci_msix_enable(&(vdev->msix), 1);
+	vdev->msix_on = 1;
+	outw(vdev->iobase + VIRTIO_MSI_CONFIG_VECTOR, VIRTIO_MSI_NO_VECTOR);
+	for (i = 0; i < vdev->nr_vqs; i++) {
+		struct virtq *vq = vdev->vqs[i];
+		if ((irq = irq_alloc_msi(&(vdev->msix), i)) < 0) {
+			goto failed;
+		}
+		vq->irq = irq;
+		outw(vdev->iobase + VIRTIO_PCI_QUEUE_SEL, vq->index);
+		outw(vdev->iobase + VIRTIO_MSI_QUEUE_VECTOR, i);
+		/* the device says no by reading back NO_VECTOR */
+		if (inw(vdev->iobase + VIRTIO_MSI_QUEUE_VECTOR) != i) {
+			goto failed;
+		}
+	}
+	for (i = 0; i < vdev->nr_vqs; i++) {
+		register_irq(vdev->vqs[i]->irq, virtio_vq_irq, vdev->vqs[i]);
+	}
+	vdev->irq = vdev->vqs[0]->irq;
+	return 0;
+
+failed:
+	virtio_msix_off(vdev);
+	return -E_BUSY;
+}
+
+// virtio_intr_register - call intr on the interrupts of vdev, those of the
+//                      - MSI-X vectors of its queues if it can; -E_NODEV
+//                      - if it has no interrupt at all
+int
+virtio_intr_register(struct virtio_dev *vdev,
+		     void (*intr) (struct virtio_dev * vdev))
+{
+	int i;
+	vdev->intr = intr;
+	if (virtio_msix_setup(vdev) == 0) {
+		return 0;
+	}
+	if (vdev->irq < 0) {
+		return -E_NODEV;
+	}
+	assert(nr_virtio_devs < VIRTIO_MAX_DEVS);
+	for (i = 0; i < nr_virtio_devs; i++) {
+		if (virtio_devs[i]->irq == vdev->irq) {
+			break;
+		}
+	}
+	virtio_devs[nr_virtio_devs++] = vdev;
+	if (i == nr_virtio_devs - 1) {
+		register_irq(vdev->irq, virtio_irq, NULL);
+	}
+	return 0;
+}
+
+/* the bytes of the descriptors and the avail ring, the used ring follows */
+static size_t virtq_avail_bytes(uint16_t size)
+{
+	return ROUNDUP(sizeof(struct vring_desc) * size
+		       + sizeof(struct vring_avail) + sizeof(uint16_t) * (size + 1),
+		       VIRTIO_PCI_VRING_ALIGN);
+}
+
+static size_t virtq_used_bytes(uint16_t size)
+{
+	return ROUNDUP(sizeof(struct vring_used)
+		       + sizeof(struct vring_used_elem) * size
+		       + sizeof(uint16_t), VIRTIO_PCI_VRING_ALIGN);
+}
+
+// virtq_init - set up the virtqueue index of vdev in vq
+int virtq_init(struct virtio_dev *vdev, struct virtq *vq, uint16_t index)
+{
+	uint16_t size, i;
+	outw(vdev->iobase + VIRTIO_PCI_QUEUE_SEL, index);
+	size = inw(vdev->iobase + VIRTIO_PCI_QUEUE_NUM);
+	if (size == 0 || inl(vdev->iobase + VIRTIO_PCI_QUEUE_PFN) != 0) {
+		return -E_INVAL;
+	}
+	size_t bytes = virtq_avail_bytes(size) + virtq_used_bytes(size);
+	struct Page *page;
+	if ((page = alloc_pages(bytes / PGSIZE)) == NULL) {
+		return -E_NO_MEM;
+	}
+	if ((vq->cookies = kmalloc(sizeof(void *) * size)) == NULL) {
+		free_pages(page, bytes / PGSIZE);
+		return -E_NO_MEM;
+	}
+	char *base = page2kva(page);
+	memset(base, 0, bytes);
+	vq->vdev = vdev, vq->index = index, vq->size = size;
+	vq->desc = (struct vring_desc *)base;
+	vq->avail = (struct vring_avail *)(base + sizeof(struct vring_desc) * size);
+	vq->used = (struct vring_used *)(base + virtq_avail_bytes(size));
+	for (i = 0; i < size; i++) {
+		vq->desc[i].next = i + 1;
+	}
+	vq->free_head = 0, vq->num_free = size, vq->last_used = 0;
+	spinlock_init(&(vq->lock));
+	vq->irq = -1;
+	if (vdev->nr_vqs < VIRTIO_MAX_VQS) {
+		vdev->vqs[vdev->nr_vqs++] = vq;
+	}
+	outl(vdev->iobase + VIRTIO_PCI_QUEUE_PFN,
+	     page2pa(page) >> VIRTIO_PCI_QUEUE_ADDR_SHIFT);
+	return 0;
+}
+
+// virtq_reachable - the device can reach len bytes from base
+bool virtq_reachable(const void *base, size_t len)
+{
+	uintptr_t va = (uintptr_t) base;
+	return va >= KERNBASE && va - KERNBASE + len <= npage * PGSIZE;
+}
+
+/*
+ * virtq_add - add the chain of nbufs buffers of bufs to vq, with vq->lock
+ * held, which comes back with cookie. The chain starts at vq->free_head.
+ * Returns -E_NO_MEM if vq has too few free descriptors. The device is not
+ * told before virtq_kick.
+ */
+int virtq_add(struct virtq *vq, struct virtq_buf *bufs, int nbufs, void *cookie)
+{
+	uint16_t head = vq->free_head, i = head;
+	int n;
+	assert(nbufs > 0);
+	if (vq->num_free < nbufs) {
+		return -E_NO_MEM;
+	}
+	for (n = 0; n < nbufs; n++) {
+		struct vring_desc *desc = vq->desc + i;
+		assert(virtq_reachable(bufs[n].base, bufs[n].len));
+		desc->addr = PADDR(bufs[n].base);
+		desc->len = bufs[n].len;
+		desc->flags = (bufs[n].in ? VRING_DESC_F_WRITE : 0)
+		    | (n + 1 < nbufs ? VRING_DESC_F_NEXT : 0);
+		i = desc->next;
+	}
+	vq->free_head = i, vq->num_free -= nbufs;
+	vq->cookies[head] = cookie;
+	vq->avail->ring[vq->avail->idx % vq->size] = head;
+	virtio_barrier();
+	vq->avail->idx++;
+	return head;
+}
+
+void virtq_kick(struct virtq *vq)
+{
+	virtio_barrier();
+	outw(vq->vdev->iobase + VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+}
+
+/*
+ * virtq_get - take a chain the device is done with from vq, with vq->lock
+ * held. Returns its cookie, the # of bytes the device wrote is stored in
+ * lenp, or NULL if there is none.
+ */
+void *virtq_get(struct virtq *vq, uint32_t * lenp)
+{
+	if (vq->last_used == *(volatile uint16_t *)&(vq->used->idx)) {
+		return NULL;
+	}
+	virtio_barrier();
+	struct vring_used_elem *elem =
+	    vq->used->ring + vq->last_used++ % vq->size;
+	uint16_t head = elem->id, i = head, n = 1;
+	if (lenp != NULL) {
+		*lenp = elem->len;
+	}
+	while (vq->desc[i].flags & VRING_DESC_F_NEXT) {
+		i = vq->desc[i].next, n++;
+	}
+	vq->desc[i].next = vq->free_head;
+	vq->free_head = head, vq->num_free += n;
+	return vq->cookies[head];
+}
+
+// virtq_has_used - vq has chains for virtq_get, read without vq->lock
+bool virtq_has_used(struct virtq *vq)
+{
+	return vq->last_used != *(volatile uint16_t *)&(vq->used->idx);
+}
+
+void virtio_init(void)
+{
+#ifdef UCONFIG_VIRTIO_BLK
+	virtio_blk_init();
+#endif
+#ifdef UCONFIG_VIRTIO_CONSOLE
+	virtio_console_init();
+#endif
+#ifdef UCONFIG_VIRTIO_BALLOON
+	virtio_balloon_init();
+#endif
+#ifdef UCONFIG_VIRTIO_NET
+	virtio_net_init();
+#endif
+}
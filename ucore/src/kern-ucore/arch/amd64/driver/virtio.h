@@ -0,0 +1,129 @@
+#ifndef __KERN_DRIVER_VIRTIO_H__
+#define __KERN_DRIVER_VIRTIO_H__
+
+#include <types.h>
+#include <spinlock.h>
+#include <pci.h>
+
+#define VIRTIO_PCI_VENDOR               0x1AF4
+
+/* the PCI device ids of the legacy (transitional) devices */
+#define VIRTIO_ID_NET                   0x1000
+#define VIRTIO_ID_BLK                   0x1001
+#define VIRTIO_ID_BALLOON               0x1002
+#define VIRTIO_ID_CONSOLE               0x1003
+
+/* the registers of the legacy transport, from the I/O port of BAR0 */
+#define VIRTIO_PCI_HOST_FEATURES        0x00
+#define VIRTIO_PCI_GUEST_FEATURES       0x04
+#define VIRTIO_PCI_QUEUE_PFN            0x08
+#define VIRTIO_PCI_QUEUE_NUM            0x0C
+#define VIRTIO_PCI_QUEUE_SEL            0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY         0x10
+#define VIRTIO_PCI_STATUS               0x12
+#define VIRTIO_PCI_ISR                  0x13
+#define VIRTIO_PCI_CONFIG               0x14	/* without MSI-X */
+/* with MSI-X on, two more registers come before the config */
+#define VIRTIO_MSI_CONFIG_VECTOR        0x14
+#define VIRTIO_MSI_QUEUE_VECTOR         0x16
+#define VIRTIO_PCI_CONFIG_MSIX          0x18
+
+#define VIRTIO_MSI_NO_VECTOR            0xFFFF
+
+#define VIRTIO_STATUS_ACKNOWLEDGE       0x01
+#define VIRTIO_STATUS_DRIVER            0x02
+#define VIRTIO_STATUS_DRIVER_OK         0x04
+#define VIRTIO_STATUS_FAILED            0x80
+
+#define VIRTIO_PCI_VRING_ALIGN          4096
+
+/* the split virtqueue, as the device sees it */
+struct vring_desc {
+	uint64_t addr;
+	uint32_t len;
+	uint16_t flags;
+	uint16_t next;
+} __attribute__ ((packed));
+
+#define VRING_DESC_F_NEXT               1
+#define VRING_DESC_F_WRITE              2	/* the device writes it */
+
+struct vring_avail {
+	uint16_t flags;
+	uint16_t idx;
+	uint16_t ring[0];
+} __attribute__ ((packed));
+
+struct vring_used_elem {
+	uint32_t id;
+	uint32_t len;
+} __attribute__ ((packed));
+
+struct vring_used {
+	uint16_t flags;
+	uint16_t idx;
+	struct vring_used_elem ring[0];
+} __attribute__ ((packed));
+
+struct virtio_dev;
+
+/*
+ * A virtqueue. The driver protects it with lock, each chain of
+ * descriptors it adds comes back from virtq_get with its cookie.
+ */
+struct virtq {
+	struct virtio_dev *vdev;
+	uint16_t index, size;
+	struct vring_desc *desc;
+	struct vring_avail *avail;
+	struct vring_used *used;
+	uint16_t free_head, num_free;
+	uint16_t last_used;	/* the next entry of used to look at */
+	void **cookies;		/* by the head of each chain */
+	spinlock_s lock;
+	int irq;		/* of its own MSI-X vector, -1 without */
+};
+
+/* a buffer of a chain: the device reads it, or writes it if in */
+struct virtq_buf {
+	void *base;
+	size_t len;
+	bool in;
+};
+
+/* the queue pairs of a virtio-net and its control queue */
+#define VIRTIO_MAX_VQS                  10
+
+struct virtio_dev {
+	struct pci_func pci;
+	uint16_t iobase;
+	int irq;		/* the INTx line, or the irq of the first queue */
+	void (*intr) (struct virtio_dev * vdev);	/* the queues are used */
+	void *private;
+	struct virtq *vqs[VIRTIO_MAX_VQS];
+	int nr_vqs;
+	bool msix_on;		/* each queue has its vector */
+	struct pci_msix msix;
+};
+
+int virtio_probe(uint16_t device, int index, struct virtio_dev *vdev);
+uint32_t virtio_negotiate(struct virtio_dev *vdev, uint32_t features);
+void virtio_ready(struct virtio_dev *vdev);
+void virtio_fail(struct virtio_dev *vdev);
+uint32_t virtio_config_read(struct virtio_dev *vdev, int offset, int size);
+void virtio_config_write(struct virtio_dev *vdev, int offset, uint32_t val,
+			 int size);
+int virtio_intr_register(struct virtio_dev *vdev,
+			 void (*intr) (struct virtio_dev * vdev));
+
+int virtq_init(struct virtio_dev *vdev, struct virtq *vq, uint16_t index);
+bool virtq_reachable(const void *base, size_t len);
+int virtq_add(struct virtq *vq, struct virtq_buf *bufs, int nbufs,
+	      void *cookie);
+void virtq_kick(struct virtq *vq);
+void *virtq_get(struct virtq *vq, uint32_t * lenp);
+bool virtq_has_used(struct virtq *vq);
+
+void virtio_init(void);
+
+#endif /* !__KERN_DRIVER_VIRTIO_H__ */
@@ -0,0 +1,257 @@
+#include <types.h>
+#include <stdio.h>
+#include <list.h>
+#include <pmm.h>
+#include <sync.h>
+#include <wait.h>
+#include <proc.h>
+#include <sched.h>
+#include <sysconf.h>
+#include <assert.h>
+#include <kio.h>
+#include <virtio.h>
+#include <virtio_balloon.h>
+
+/*
+ * The virtio balloon, for the host to take back memory the guest does
+ * not use. The host sets num_pages in the config, the # of pages it wants
+ * the guest to give up; vballoon allocates pages toward it and tells the
+ * host their frames on the inflate queue, or, when the host wants fewer,
+ * tells it on the deflate queue first and frees them. The # held goes
+ * back to the config as actual. The host is not waited for on a config
+ * interrupt, which the transport leaves without a vector under MSI-X:
+ * vballoon reads num_pages every VBALLOON_POLL_TICKS instead.
+ *
+ * With VIRTIO_BALLOON_F_REPORTING, the free blocks of VBALLOON_REPORT_ORDER
+ * or more are reported too, every VBALLOON_REPORT_TICKS: they are taken
+ * off the free lists, handed to the host on the reporting queue, which
+ * discards their memory, and freed back marked reported, so that they are
+ * not reported again, see buddy_pmm.c. The guest gets the memory back on
+ * the next touch, as zeros.
+ */
+
+#define VIRTIO_BALLOON_F_MUST_TELL_HOST (1 << 0)
+/* not used, but the queues are numbered as if: QEMU has it always */
+#define VIRTIO_BALLOON_F_STATS_VQ       (1 << 1)
+#define VIRTIO_BALLOON_F_REPORTING      (1 << 5)
+
+/* in the device config */
+#define VIRTIO_BALLOON_CONFIG_NUM_PAGES 0x00
+#define VIRTIO_BALLOON_CONFIG_ACTUAL    0x04
+
+#define VIRTIO_BALLOON_INFLATEQ         0
+#define VIRTIO_BALLOON_DEFLATEQ         1
+
+/* frames of 4K, whatever the page size */
+#define VIRTIO_BALLOON_PFN_SHIFT        12
+
+#define VBALLOON_BATCH                  256
+#define VBALLOON_POLL_TICKS             100
+#define VBALLOON_REPORT_TICKS           200
+/* that of a huge page, smaller blocks are not worth the exits */
+#define VBALLOON_REPORT_ORDER           9
+#define VBALLOON_REPORT_MAX             32
+
+static struct {
+	bool valid, reporting;
+	struct virtio_dev vdev;
+	struct virtq inflateq, deflateq, reportq;
+	wait_queue_t wait;	/* vballoon waits for the host */
+	list_entry_t pages;	/* those in the balloon, by page_link */
+	uint32_t nr_pages;
+	uint32_t pfns[VBALLOON_BATCH];
+} vballoon;
+
+bool virtio_balloon_valid(void)
+{
+	return vballoon.valid;
+}
+
+static void vballoon_intr(struct virtio_dev *vdev)
+{
+	bool intr_flag;
+	int i;
+	/* vballoon looks at its queue and goes to sleep under its lock */
+	for (i = 0; i < vdev->nr_vqs; i++) {
+		spin_lock_irqsave(&(vdev->vqs[i]->lock), intr_flag);
+		if (!wait_queue_empty(&(vballoon.wait))) {
+			wakeup_queue(&(vballoon.wait), WT_IO, 1);
+		}
+		spin_unlock_irqrestore(&(vdev->vqs[i]->lock), intr_flag);
+	}
+}
+
+// vballoon_send - give the chain of bufs to the host on vq and wait until
+//               - it is done with it; one chain at a time
+static void vballoon_send(struct virtq *vq, struct virtq_buf *bufs, int nbufs)
+{
+	wait_t __wait, *wait = &__wait;
+	bool intr_flag;
+	spin_lock_irqsave(&(vq->lock), intr_flag);
+	if (virtq_add(vq, bufs, nbufs, vq) < 0) {
+		panic("virtio-balloon: no descriptors.\n");
+	}
+	virtq_kick(vq);
+	while (virtq_get(vq, NULL) == NULL) {
+		if (vballoon.vdev.irq < 0) {
+			spin_unlock_irqrestore(&(vq->lock), intr_flag);
+			do_sleep(1);
+			spin_lock_irqsave(&(vq->lock), intr_flag);
+			continue;
+		}
+		wait_current_set(&(vballoon.wait), wait, WT_IO);
+		spin_unlock_irqrestore(&(vq->lock), intr_flag);
+		schedule();
+		spin_lock_irqsave(&(vq->lock), intr_flag);
+		wait_current_del(&(vballoon.wait), wait);
+	}
+	spin_unlock_irqrestore(&(vq->lock), intr_flag);
+}
+
+// vballoon_send_pfns - tell the host of the first n frames of pfns on vq
+static void vballoon_send_pfns(struct virtq *vq, int n)
+{
+	struct virtq_buf buf = { vballoon.pfns, n * sizeof(uint32_t), 0 };
+	vballoon_send(vq, &buf, 1);
+}
+
+static void vballoon_set_actual(void)
+{
+	virtio_config_write(&(vballoon.vdev), VIRTIO_BALLOON_CONFIG_ACTUAL,
+			    vballoon.nr_pages, 4);
+}
+
+// vballoon_inflate - put up to n pages more in the balloon; # put
+static int vballoon_inflate(uint32_t n)
+{
+	struct Page *page;
+	int i;
+	for (i = 0; i < n && i < VBALLOON_BATCH; i++) {
+		if ((page = alloc_page()) == NULL) {
+			break;
+		}
+		vballoon.pfns[i] = page2pa(page) >> VIRTIO_BALLOON_PFN_SHIFT;
+		list_add(&(vballoon.pages), &(page->page_link));
+	}
+	if (i != 0) {
+		vballoon_send_pfns(&(vballoon.inflateq), i);
+		vballoon.nr_pages += i;
+		vballoon_set_actual();
+	}
+	return i;
+}
+
+// vballoon_deflate - take up to n pages out of the balloon, the host told
+//                  - before they are freed
+static void vballoon_deflate(uint32_t n)
+{
+	list_entry_t *le;
+	int i, j;
+	for (i = 0; i < n && i < VBALLOON_BATCH
+	     && (le = list_next(&(vballoon.pages))) != &(vballoon.pages); i++) {
+		list_del(le);
+		vballoon.pfns[i] = page2pa(le2page(le, page_link))
+		    >> VIRTIO_BALLOON_PFN_SHIFT;
+	}
+	if (i == 0) {
+		return;
+	}
+	vballoon_send_pfns(&(vballoon.deflateq), i);
+	for (j = 0; j < i; j++) {
+		free_page(pa2page((uintptr_t) vballoon.pfns[j]
+				  << VIRTIO_BALLOON_PFN_SHIFT));
+	}
+	vballoon.nr_pages -= i;
+	vballoon_set_actual();
+}
+
+// vballoon_report - report the free blocks of each node not reported yet
+static void vballoon_report(void)
+{
+	struct virtq_buf bufs[VBALLOON_REPORT_MAX];
+	list_entry_t isolated, *le;
+	int max = VBALLOON_REPORT_MAX, n;
+	uint32_t i;
+	if (max > vballoon.reportq.size) {
+		max = vballoon.reportq.size;
+	}
+	list_init(&isolated);
+	for (i = 0; i < sysconf.lnuma_count; i++) {
+		do {
+			n = isolate_unreported(i, VBALLOON_REPORT_ORDER,
+					       &isolated, max);
+			if (n == 0) {
+				break;
+			}
+			for (n = 0, le = &isolated;
+			     (le = list_next(le)) != &isolated; n++) {
+				struct Page *page = le2page(le, page_link);
+				bufs[n].base = page2kva(page);
+				bufs[n].len = PGSIZE << page->property;
+				bufs[n].in = 1;
+			}
+			vballoon_send(&(vballoon.reportq), bufs, n);
+			putback_reported(&isolated);
+		} while (n == max);
+	}
+}
+
+int vballoon_main(void *arg)
+{
+	int rounds = 0;
+	uint32_t target;
+	while (1) {
+		target = virtio_config_read(&(vballoon.vdev),
+					    VIRTIO_BALLOON_CONFIG_NUM_PAGES, 4);
+		if (target > vballoon.nr_pages
+		    && vballoon_inflate(target - vballoon.nr_pages) != 0) {
+			continue;
+		}
+		if (target < vballoon.nr_pages) {
+			vballoon_deflate(vballoon.nr_pages - target);
+			continue;
+		}
+		if (vballoon.reporting && ++rounds
+		    >= VBALLOON_REPORT_TICKS / VBALLOON_POLL_TICKS) {
+			vballoon_report();
+			rounds = 0;
+		}
+		do_sleep(VBALLOON_POLL_TICKS);
+	}
+}
+
+void virtio_balloon_init(void)
+{
+	uint32_t features;
+	uint16_t reportq;
+	if (virtio_probe(VIRTIO_ID_BALLOON, 0, &(vballoon.vdev)) != 0) {
+		return;
+	}
+	features = virtio_negotiate(&(vballoon.vdev),
+				    VIRTIO_BALLOON_F_MUST_TELL_HOST
+				    | VIRTIO_BALLOON_F_STATS_VQ
+				    | VIRTIO_BALLOON_F_REPORTING);
+	/* after the stats queue, when there is one */
+	reportq = (features & VIRTIO_BALLOON_F_STATS_VQ) ? 3 : 2;
+	if (virtq_init(&(vballoon.vdev), &(vballoon.inflateq),
+		       VIRTIO_BALLOON_INFLATEQ) != 0
+	    || virtq_init(&(vballoon.vdev), &(vballoon.deflateq),
+			  VIRTIO_BALLOON_DEFLATEQ) != 0) {
+		virtio_fail(&(vballoon.vdev));
+		kprintf("virtio-balloon: no virtqueues.\n");
+		return;
+	}
+	vballoon.reporting = ((features & VIRTIO_BALLOON_F_REPORTING) != 0
+			      && virtq_init(&(vballoon.vdev),
+					    &(vballoon.reportq), reportq) == 0);
+	wait_queue_init(&(vballoon.wait));
+	list_init(&(vballoon.pages));
+	if (virtio_intr_register(&(vballoon.vdev), vballoon_intr) != 0) {
+		/* the queues are polled */
+		vballoon.vdev.irq = -1;
+	}
+	virtio_ready(&(vballoon.vdev));
+	vballoon.valid = 1;
+	kprintf("virtio-balloon: irq %d%s.\n", vballoon.vdev.irq,
+		vballoon.reporting ? ", free page reporting" : "");
+}
@@ -0,0 +1,10 @@
+#ifndef __KERN_DRIVER_VIRTIO_BALLOON_H__
+#define __KERN_DRIVER_VIRTIO_BALLOON_H__
+
+#include <types.h>
+
+void virtio_balloon_init(void);
+bool virtio_balloon_valid(void);
+int vballoon_main(void *arg);
+
+#endif /* !__KERN_DRIVER_VIRTIO_BALLOON_H__ */
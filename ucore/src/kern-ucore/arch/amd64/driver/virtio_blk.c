@@ -0,0 +1,220 @@
+#include <types.h>
+#include <stdio.h>
+#include <string.h>
+#include <slab.h>
+#include <sync.h>
+#include <wait.h>
+#include <proc.h>
+#include <sched.h>
+#include <fs.h>
+#include <iobuf.h>
+#include <error.h>
+#include <assert.h>
+#include <kio.h>
+#include <blkqueue.h>
+#include <virtio.h>
+#include <virtio_blk.h>
+
+/*
+ * The virtio disk. A request goes straight into the virtqueue, with a
+ * header before its buffers and a status byte after them, so that as many
+ * requests as there are descriptors are in flight; the host orders them
+ * itself. The interrupt takes the chains back and completes the requests.
+ *
+ * Without an IRQ line, at boot and from the idle process, the submitter
+ * polls the virtqueue until its request is done instead.
+ */
+
+#define VIRTIO_BLK_F_SEG_MAX            (1 << 2)
+#define VIRTIO_BLK_F_RO                 (1 << 5)
+
+/* in the device config */
+#define VIRTIO_BLK_CONFIG_CAPACITY      0x00
+#define VIRTIO_BLK_CONFIG_SEG_MAX       0x0C
+
+#define VIRTIO_BLK_T_IN                 0
+#define VIRTIO_BLK_T_OUT                1
+#define VIRTIO_BLK_S_OK                 0
+
+struct virtio_blk_outhdr {
+	uint32_t type;
+	uint32_t ioprio;
+	uint64_t sector;
+} __attribute__ ((packed));
+
+/* the header and the status of the request whose chain starts at a slot */
+struct vblk_slot {
+	struct virtio_blk_outhdr hdr;
+	uint8_t status;
+	struct blk_request *req;
+};
+
+static struct {
+	bool valid, readonly;
+	struct virtio_dev vdev;
+	struct virtq vq;
+	struct vblk_slot *slots;	/* by the head of each chain */
+	uint64_t capacity;	/* in sectors */
+	int max_iov;
+	struct blk_queue queue;	/* no worker, for the completions */
+	wait_queue_t free_wait;	/* the submitters wait for descriptors */
+} vblk;
+
+bool virtio_blk_valid(void)
+{
+	return vblk.valid;
+}
+
+size_t virtio_blk_size(void)
+{
+	return vblk.capacity;
+}
+
+// virtio_blk_max_iov - the # of buffers of a request at most
+int virtio_blk_max_iov(void)
+{
+	return vblk.max_iov;
+}
+
+bool virtio_blk_reachable(const void *base, size_t len)
+{
+	return virtq_reachable(base, len);
+}
+
+// virtio_blk_reap - complete the requests the device is done with
+static void virtio_blk_reap(void)
+{
+	struct vblk_slot *slot;
+	while ((slot = virtq_get(&(vblk.vq), NULL)) != NULL) {
+		int error = (slot->status == VIRTIO_BLK_S_OK) ? 0 : -E_IO;
+		blk_end_request(&(vblk.queue), slot->req, error);
+	}
+	if (!wait_queue_empty(&(vblk.free_wait))) {
+		wakeup_queue(&(vblk.free_wait), WT_IO, 1);
+	}
+}
+
+static void virtio_blk_intr(struct virtio_dev *vdev)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&(vblk.vq.lock), intr_flag);
+	virtio_blk_reap();
+	spin_unlock_irqrestore(&(vblk.vq.lock), intr_flag);
+}
+
+/*
+ * virtio_blk_submit - put req in the virtqueue, see blk_submit. Its
+ * buffers must be reachable by the device.
+ */
+void virtio_blk_submit(struct blk_request *req)
+{
+	struct virtq *vq = &(vblk.vq);
+	struct virtq_buf bufs[BLK_MAX_IOV + 2];
+	int i, nbufs = 0;
+	assert(vblk.valid && req->iovcnt <= vblk.max_iov);
+	blk_start_request(&(vblk.queue), req);
+	if ((req->write && vblk.readonly)
+	    || req->secno + req->nsecs > vblk.capacity) {
+		blk_end_request(&(vblk.queue), req, -E_INVAL);
+		return;
+	}
+
+	bool can_sleep = (vblk.vdev.irq >= 0 && current != NULL
+			  && current != idleproc);
+	wait_t __wait, *wait = &__wait;
+	bool intr_flag;
+	spin_lock_irqsave(&(vq->lock), intr_flag);
+	while (vq->num_free < req->iovcnt + 2) {
+		if (!can_sleep) {
+			virtio_blk_reap();
+			continue;
+		}
+		wait_current_set(&(vblk.free_wait), wait, WT_IO);
+		spin_unlock_irqrestore(&(vq->lock), intr_flag);
+		schedule();
+		spin_lock_irqsave(&(vq->lock), intr_flag);
+		wait_current_del(&(vblk.free_wait), wait);
+	}
+	/* the chain starts at the free head, so does its slot */
+	struct vblk_slot *slot = vblk.slots + vq->free_head;
+	slot->hdr.type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	slot->hdr.ioprio = 0, slot->hdr.sector = req->secno;
+	slot->status = 0xFF, slot->req = req;
+
+	bufs[nbufs].base = &(slot->hdr), bufs[nbufs].len = sizeof(slot->hdr);
+	bufs[nbufs++].in = 0;
+	for (i = 0; i < req->iovcnt; i++, nbufs++) {
+		bufs[nbufs].base = req->iov[i].iov_base;
+		bufs[nbufs].len = req->iov[i].iov_len;
+		bufs[nbufs].in = !req->write;
+	}
+	bufs[nbufs].base = &(slot->status), bufs[nbufs].len = 1;
+	bufs[nbufs++].in = 1;
+	if (virtq_add(vq, bufs, nbufs, slot) < 0) {
+		panic("virtio-blk: no descriptors.\n");
+	}
+	virtq_kick(vq);
+
+	if (!can_sleep) {
+		/* all of the chains are back once this one is */
+		while (vq->num_free != vq->size) {
+			virtio_blk_reap();
+		}
+	}
+	spin_unlock_irqrestore(&(vq->lock), intr_flag);
+}
+
+// virtio_blk_rw - transfer with the virtio disk and wait for it
+int
+virtio_blk_rw(uint32_t secno, const struct iovec *iov, int iovcnt, bool write)
+{
+	struct blk_request __req, *req = &__req;
+	blk_request_init(req, secno, iov, iovcnt, write);
+	virtio_blk_submit(req);
+	return blk_wait(req);
+}
+
+void virtio_blk_init(void)
+{
+	uint32_t features, seg_max = BLK_MAX_IOV;
+	if (virtio_probe(VIRTIO_ID_BLK, 0, &(vblk.vdev)) != 0) {
+		return;
+	}
+	features = virtio_negotiate(&(vblk.vdev),
+				    VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO);
+	if (virtq_init(&(vblk.vdev), &(vblk.vq), 0) != 0
+	    || (vblk.slots =
+		kmalloc(sizeof(struct vblk_slot) * vblk.vq.size)) == NULL) {
+		virtio_fail(&(vblk.vdev));
+		kprintf("virtio-blk: no virtqueue.\n");
+		return;
+	}
+	vblk.capacity =
+	    virtio_config_read(&(vblk.vdev), VIRTIO_BLK_CONFIG_CAPACITY, 4)
+	    | ((uint64_t)
+	       virtio_config_read(&(vblk.vdev), VIRTIO_BLK_CONFIG_CAPACITY + 4,
+				  4) << 32);
+	if (features & VIRTIO_BLK_F_SEG_MAX) {
+		seg_max = virtio_config_read(&(vblk.vdev),
+					     VIRTIO_BLK_CONFIG_SEG_MAX, 4);
+	}
+	vblk.max_iov = seg_max;
+	if (vblk.max_iov > BLK_MAX_IOV) {
+		vblk.max_iov = BLK_MAX_IOV;
+	}
+	if (vblk.max_iov > vblk.vq.size - 2) {
+		vblk.max_iov = vblk.vq.size - 2;
+	}
+	vblk.readonly = ((features & VIRTIO_BLK_F_RO) != 0);
+	blk_queue_init(&(vblk.queue), "vblk", NULL, 0, NULL);
+	wait_queue_init(&(vblk.free_wait));
+	if (virtio_intr_register(&(vblk.vdev), virtio_blk_intr) != 0) {
+		/* the requests are polled for */
+		vblk.vdev.irq = -1;
+	}
+	virtio_ready(&(vblk.vdev));
+	vblk.valid = 1;
+	kprintf("virtio-blk: %10u(sectors)%s, irq %d.\n",
+		(unsigned int)vblk.capacity, vblk.readonly ? " readonly" : "",
+		vblk.vdev.irq);
+}
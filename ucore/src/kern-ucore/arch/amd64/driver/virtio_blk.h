@@ -0,0 +1,18 @@
+#ifndef __KERN_DRIVER_VIRTIO_BLK_H__
+#define __KERN_DRIVER_VIRTIO_BLK_H__
+
+#include <types.h>
+
+struct iovec;
+struct blk_request;
+
+void virtio_blk_init(void);
+bool virtio_blk_valid(void);
+size_t virtio_blk_size(void);
+int virtio_blk_max_iov(void);
+bool virtio_blk_reachable(const void *base, size_t len);
+void virtio_blk_submit(struct blk_request *req);
+int virtio_blk_rw(uint32_t secno, const struct iovec *iov, int iovcnt,
+		  bool write);
+
+#endif /* !__KERN_DRIVER_VIRTIO_BLK_H__ */
@@ -0,0 +1,131 @@
+#include <types.h>
+#include <stdio.h>
+#include <pmm.h>
+#include <sync.h>
+#include <kio.h>
+#include <virtio.h>
+#include <virtio_console.h>
+
+/*
+ * The output of the console to the first port of a virtio console. The
+ * characters are gathered in the buffers of one page and a buffer goes to
+ * the transmit queue at the end of a line, when it is full or at the next
+ * tick, so that the host is told once per line rather than trapped on
+ * every character as with the serial port.
+ *
+ * The host hands the buffers back at once, they are taken back when the
+ * next one is needed; the input stays with the serial port and keyboard.
+ */
+
+#define VIRTIO_CONSOLE_TRANSMITQ        1
+
+#define VCONS_NR_BUFS                   8
+#define VCONS_BUFSIZE                   (PGSIZE / VCONS_NR_BUFS)
+
+static struct {
+	bool valid;
+	struct virtio_dev vdev;
+	struct virtq txq;
+	char *bufs;
+	bool busy[VCONS_NR_BUFS];	/* given to the host */
+	int cur, len;		/* the buffer being filled, -1 for none */
+} vcons;
+
+bool virtio_console_valid(void)
+{
+	return vcons.valid;
+}
+
+static void vcons_reclaim(void)
+{
+	void *cookie;
+	while ((cookie = virtq_get(&(vcons.txq), NULL)) != NULL) {
+		vcons.busy[(uintptr_t) cookie - 1] = 0;
+	}
+}
+
+// vcons_send - give the buffer being filled to the host, with the lock held
+static void vcons_send(void)
+{
+	if (vcons.cur < 0 || vcons.len == 0) {
+		return;
+	}
+	struct virtq_buf buf = {
+		vcons.bufs + vcons.cur * VCONS_BUFSIZE, vcons.len, 0
+	};
+	while (virtq_add(&(vcons.txq), &buf, 1,
+			 (void *)(uintptr_t) (vcons.cur + 1)) < 0) {
+		vcons_reclaim();
+	}
+	virtq_kick(&(vcons.txq));
+	vcons.busy[vcons.cur] = 1;
+	vcons.cur = -1, vcons.len = 0;
+}
+
+static void vcons_putc_sub(int c)
+{
+	if (vcons.cur < 0) {
+		int i;
+		while (1) {
+			for (i = 0; i < VCONS_NR_BUFS && vcons.busy[i]; i++)
+				/* nothing */ ;
+			if (i < VCONS_NR_BUFS) {
+				break;
+			}
+			vcons_reclaim();
+		}
+		vcons.cur = i;
+	}
+	vcons.bufs[vcons.cur * VCONS_BUFSIZE + vcons.len++] = c;
+	if (c == '\n' || vcons.len == VCONS_BUFSIZE) {
+		vcons_send();
+	}
+}
+
+/* virtio_console_putc - print character to the virtio console */
+void virtio_console_putc(int c)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&(vcons.txq.lock), intr_flag);
+	if (c == '\b') {
+		vcons_putc_sub('\b');
+		vcons_putc_sub(' ');
+		vcons_putc_sub('\b');
+	} else {
+		vcons_putc_sub(c);
+	}
+	spin_unlock_irqrestore(&(vcons.txq.lock), intr_flag);
+}
+
+// virtio_console_flush - send a partial line, called on the ticks
+void virtio_console_flush(void)
+{
+	if (!vcons.valid || vcons.len == 0) {
+		return;
+	}
+	bool intr_flag;
+	spin_lock_irqsave(&(vcons.txq.lock), intr_flag);
+	vcons_send();
+	spin_unlock_irqrestore(&(vcons.txq.lock), intr_flag);
+}
+
+void virtio_console_init(void)
+{
+	struct Page *page;
+	if (virtio_probe(VIRTIO_ID_CONSOLE, 0, &(vcons.vdev)) != 0) {
+		return;
+	}
+	virtio_negotiate(&(vcons.vdev), 0);
+	if (virtq_init(&(vcons.vdev), &(vcons.txq),
+		       VIRTIO_CONSOLE_TRANSMITQ) != 0
+	    || (page = alloc_page()) == NULL) {
+		virtio_fail(&(vcons.vdev));
+		kprintf("virtio-console: no transmit queue.\n");
+		return;
+	}
+	vcons.bufs = page2kva(page);
+	vcons.cur = -1, vcons.len = 0;
+	virtio_ready(&(vcons.vdev));
+	kprintf("virtio-console: the console writes to it from now on.\n");
+	vcons.valid = 1;
+}
@@ -0,0 +1,11 @@
+#ifndef __KERN_DRIVER_VIRTIO_CONSOLE_H__
+#define __KERN_DRIVER_VIRTIO_CONSOLE_H__
+
+#include <types.h>
+
+void virtio_console_init(void);
+bool virtio_console_valid(void);
+void virtio_console_putc(int c);
+void virtio_console_flush(void);
+
+#endif /* !__KERN_DRIVER_VIRTIO_CONSOLE_H__ */
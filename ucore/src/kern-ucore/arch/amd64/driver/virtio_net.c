@@ -0,0 +1,627 @@
+#include <types.h>
+#include <string.h>
+#include <stdio.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <sync.h>
+#include <wait.h>
+#include <proc.h>
+#include <sched.h>
+#include <sysconf.h>
+#include <unistd.h>
+#include <error.h>
+#include <assert.h>
+#include <kio.h>
+#include <pktio.h>
+#include <virtio.h>
+#include <virtio_net.h>
+#ifdef UCONFIG_NET
+#include <list.h>
+#include <softirq.h>
+#include <irqbalance.h>
+#include <net.h>
+#endif
+
+/*
+ * The virtio network card, with a queue pair per cpu up to VNET_MAX_QUEUES.
+ * With the stack of the kernel, see net.h, the queues are its own: each
+ * has VNET_RX_BUFS receive buffers, and a tasklet, run on the cpu its
+ * interrupt is steered to, that hands the frames to netdev_rx and frees
+ * the netbufs sent. A netbuf goes to the card as a chain of its headers
+ * and its payload page, which the card reads where it is.
+ *
+ * Without it, the packets go to the processes that map the
+ * rings of a queue pair with SYS_pktio, see pktio.h. The buffers of the
+ * slots are those the card reads and writes, the header of virtio-net
+ * just before the frame in the headroom, so a packet is neither copied
+ * nor the kernel entered for it alone.
+ *
+ * The rings of a queue are allocated by its first PKTIO_MAP and never
+ * freed, as the trace rings are, so that the mappings stay valid across
+ * fork and exit. Each sync takes the slots the process moved its cursor
+ * over: the receive buffers go back to the card and the filled transmit
+ * slots to it. The cursors the process writes are only believed when
+ * they stay within the slots it holds. The interrupt of a receive queue
+ * only wakes those waiting in PKTIO_RXWAIT; the used chains are taken at
+ * the next sync.
+ */
+
+#define VIRTIO_NET_F_MAC                (1 << 5)
+#define VIRTIO_NET_F_CTRL_VQ            (1 << 17)
+#define VIRTIO_NET_F_MQ                 (1 << 22)
+/* the header may share a descriptor with the frame */
+#define VIRTIO_F_ANY_LAYOUT             (1 << 27)
+
+/* in the device config */
+#define VIRTIO_NET_CONFIG_MAC           0x00
+#define VIRTIO_NET_CONFIG_MAX_PAIRS     0x08
+
+#define VIRTIO_NET_CTRL_MQ              4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+#define VIRTIO_NET_OK                   0
+
+/* without offloads nor merged buffers */
+struct virtio_net_hdr {
+	uint8_t flags;
+	uint8_t gso_type;
+	uint16_t hdr_len;
+	uint16_t gso_size;
+	uint16_t csum_start;
+	uint16_t csum_offset;
+} __attribute__ ((packed));
+
+#define VNET_HDR_LEN                    sizeof(struct virtio_net_hdr)
+#define VNET_MAX_QUEUES                 4
+#define VNET_SLOT_MASK                  (PKTIO_NR_SLOTS - 1)
+
+#ifdef UCONFIG_NET
+/* the receive buffers of a queue, each room for the header and a frame */
+#define VNET_RX_BUF_SIZE                2048
+#define VNET_RX_BUFS                    64
+#define VNET_RX_PAGES                   (VNET_RX_BUFS * VNET_RX_BUF_SIZE / PGSIZE)
+/* the frames a tasklet hands to the stack in a round at most */
+#define VNET_RX_BATCH                   64
+#endif
+
+struct vnet_queue {
+	struct virtq rxq, txq;
+	struct pktio_ring *rx, *tx;	/* NULL until the first map */
+	char *rx_bufs, *tx_bufs;
+	struct Page *pages;
+	/* the cursors as the kernel holds them: the process has the receive
+	 * slots [rx_head, rx_tail), the card those [rx_tail, rx_posted);
+	 * the card has the transmit slots [tx_head, tx_sent), and those
+	 * [tx_sent, tx_tail) are to send */
+	uint32_t rx_head, rx_tail, rx_posted;
+	uint32_t tx_head, tx_sent, tx_tail;
+	bool rx_done[PKTIO_NR_SLOTS], tx_done[PKTIO_NR_SLOTS];
+	wait_queue_t wait;	/* in PKTIO_RXWAIT, under rxq.lock */
+#ifdef UCONFIG_NET
+	struct tasklet tasklet;
+#endif
+};
+
+static struct {
+	bool valid;
+	struct virtio_dev vdev;
+	struct virtq ctrlq;
+	uint8_t mac[6];
+	int nr_queues;
+#ifdef UCONFIG_NET
+	struct netdev netdev;
+#endif
+	struct vnet_queue queues[VNET_MAX_QUEUES];
+	/* a control command, reachable by the card */
+	struct {
+		uint8_t class, cmd;
+		uint16_t pairs;
+		uint8_t ack;
+	} ctrl;
+} vnet;
+
+#define vnet_barrier()                  __asm__ __volatile__ ("" ::: "memory")
+
+bool virtio_net_valid(void)
+{
+	return vnet.valid;
+}
+
+static void virtio_net_intr(struct virtio_dev *vdev)
+{
+	bool intr_flag;
+	int i;
+	for (i = 0; i < vnet.nr_queues; i++) {
+		struct vnet_queue *q = vnet.queues + i;
+#ifdef UCONFIG_NET
+		if (virtq_has_used(&(q->rxq)) || virtq_has_used(&(q->txq))) {
+			tasklet_schedule(&(q->tasklet));
+		}
+		continue;
+#endif
+		spin_lock_irqsave(&(q->rxq.lock), intr_flag);
+		if (!wait_queue_empty(&(q->wait))) {
+			wakeup_queue(&(q->wait), WT_PKTIO, 1);
+		}
+		spin_unlock_irqrestore(&(q->rxq.lock), intr_flag);
+	}
+}
+
+#ifdef UCONFIG_NET
+// vnet_rx_post - give the receive buffer s of q to the card; rxq.lock held
+static bool vnet_rx_post(struct vnet_queue *q, uint32_t s)
+{
+	struct virtq_buf buf = {
+		q->rx_bufs + s * VNET_RX_BUF_SIZE, VNET_RX_BUF_SIZE, 1
+	};
+	return virtq_add(&(q->rxq), &buf, 1, (void *)(uintptr_t) (s + 1)) >= 0;
+}
+
+// vnet_tx_reclaim - free the netbufs the card has sent from q
+static void vnet_tx_reclaim(struct vnet_queue *q)
+{
+	list_entry_t done, *le;
+	bool intr_flag;
+	void *cookie;
+	list_init(&done);
+	spin_lock_irqsave(&(q->txq.lock), intr_flag);
+	while ((cookie = virtq_get(&(q->txq), NULL)) != NULL) {
+		list_add_before(&done, &(((struct netbuf *)cookie)->link));
+	}
+	spin_unlock_irqrestore(&(q->txq.lock), intr_flag);
+	while ((le = list_next(&done)) != &done) {
+		list_del(le);
+		netbuf_free(le2netbuf(le, link));
+	}
+}
+
+// vnet_poll - the tasklet of q: the frames received go to the stack and
+//           - their buffers back to the card, the netbufs sent are freed
+static void vnet_poll(unsigned long data)
+{
+	struct vnet_queue *q = (struct vnet_queue *)data;
+	bool intr_flag;
+	uint32_t len, s;
+	void *cookie;
+	int n;
+	for (n = 0; n < VNET_RX_BATCH; n++) {
+		spin_lock_irqsave(&(q->rxq.lock), intr_flag);
+		cookie = virtq_get(&(q->rxq), &len);
+		spin_unlock_irqrestore(&(q->rxq.lock), intr_flag);
+		if (cookie == NULL) {
+			break;
+		}
+		s = (uintptr_t) cookie - 1;
+		if (len > VNET_HDR_LEN) {
+			netdev_rx(&(vnet.netdev), q - vnet.queues,
+				  (uint8_t *) q->rx_bufs + s * VNET_RX_BUF_SIZE
+				  + VNET_HDR_LEN, len - VNET_HDR_LEN);
+		}
+		spin_lock_irqsave(&(q->rxq.lock), intr_flag);
+		vnet_rx_post(q, s);
+		spin_unlock_irqrestore(&(q->rxq.lock), intr_flag);
+	}
+	if (n != 0) {
+		spin_lock_irqsave(&(q->rxq.lock), intr_flag);
+		virtq_kick(&(q->rxq));
+		spin_unlock_irqrestore(&(q->rxq.lock), intr_flag);
+	}
+	vnet_tx_reclaim(q);
+	if (n == VNET_RX_BATCH) {
+		tasklet_schedule(&(q->tasklet));
+	}
+}
+
+// vnet_xmit - the xmit of the netdev: nb, behind the header of virtio-net,
+//           - goes on the transmit queue as its headers then its payload
+static int vnet_xmit(struct netdev *dev, int queue, struct netbuf *nb)
+{
+	struct vnet_queue *q = vnet.queues + queue;
+	struct virtq_buf bufs[2];
+	bool intr_flag;
+	int nbufs = 1, ret;
+	memset(netbuf_push(nb, VNET_HDR_LEN), 0, VNET_HDR_LEN);
+	bufs[0].base = nb->data, bufs[0].len = nb->len, bufs[0].in = 0;
+	if (nb->plen != 0) {
+		bufs[1].base = (char *)page2kva(nb->page) + nb->off;
+		bufs[1].len = nb->plen, bufs[1].in = 0;
+		nbufs = 2;
+	}
+	vnet_tx_reclaim(q);
+	spin_lock_irqsave(&(q->txq.lock), intr_flag);
+	if ((ret = virtq_add(&(q->txq), bufs, nbufs, nb)) >= 0) {
+		virtq_kick(&(q->txq));
+	}
+	spin_unlock_irqrestore(&(q->txq.lock), intr_flag);
+	if (ret < 0) {
+		/* the ring is full: dropped, as a card would */
+		netbuf_free(nb);
+		return ret;
+	}
+	return 0;
+}
+
+// vnet_net_init - give the queues to the stack: their receive buffers to
+//               - the card, and the interrupt of queue i to cpu i
+static int vnet_net_init(void)
+{
+	cpuset_t set;
+	bool intr_flag;
+	int i, s;
+	if (vnet.vdev.irq < 0) {
+		return -E_NODEV;
+	}
+	for (i = 0; i < vnet.nr_queues; i++) {
+		struct vnet_queue *q = vnet.queues + i;
+		if ((q->pages = alloc_pages(VNET_RX_PAGES)) == NULL) {
+			return -E_NO_MEM;
+		}
+		q->rx_bufs = page2kva(q->pages);
+		spin_lock_irqsave(&(q->rxq.lock), intr_flag);
+		for (s = 0; s < VNET_RX_BUFS && vnet_rx_post(q, s); s++) ;
+		virtq_kick(&(q->rxq));
+		spin_unlock_irqrestore(&(q->rxq.lock), intr_flag);
+		cpuset_clear(&set);
+		cpuset_set(&set, i);
+		if (q->rxq.irq >= 0) {
+			irq_set_affinity(q->rxq.irq, &set);
+		}
+		if (q->txq.irq >= 0) {
+			irq_set_affinity(q->txq.irq, &set);
+		}
+	}
+	vnet.netdev.name = "virtio-net";
+	memcpy(vnet.netdev.mac, vnet.mac, ETH_ALEN);
+	vnet.netdev.nr_queues = vnet.nr_queues;
+	vnet.netdev.xmit = vnet_xmit;
+	netdev_register(&(vnet.netdev));
+	return 0;
+}
+#endif
+
+// vnet_rx_sync - take back the receive slots the process is done with,
+//              - the packets the card has put in the others, and give the
+//              - free ones to the card; rxq.lock held
+static void vnet_rx_sync(struct vnet_queue *q)
+{
+	struct pktio_ring *ring = q->rx;
+	uint32_t head = ring->head, len, s;
+	bool kick = 0;
+	void *cookie;
+	if (head - q->rx_head <= q->rx_tail - q->rx_head) {
+		q->rx_head = head;
+	}
+	while ((cookie = virtq_get(&(q->rxq), &len)) != NULL) {
+		s = (uintptr_t) cookie - 1;
+		ring->slots[s].len =
+		    (len > VNET_HDR_LEN) ? len - VNET_HDR_LEN : 0;
+		q->rx_done[s] = 1;
+	}
+	while (q->rx_tail != q->rx_posted
+	       && q->rx_done[s = q->rx_tail & VNET_SLOT_MASK]) {
+		q->rx_done[s] = 0, q->rx_tail++;
+	}
+	vnet_barrier();
+	ring->tail = q->rx_tail;
+	while (q->rx_posted - q->rx_head < PKTIO_NR_SLOTS) {
+		s = q->rx_posted & VNET_SLOT_MASK;
+		struct virtq_buf buf = {
+			q->rx_bufs + s * PKTIO_BUF_SIZE + PKTIO_HEADROOM
+			    - VNET_HDR_LEN, VNET_HDR_LEN + PKTIO_MAX_FRAME, 1
+		};
+		if (virtq_add(&(q->rxq), &buf, 1,
+			      (void *)(uintptr_t) (s + 1)) < 0) {
+			break;
+		}
+		q->rx_posted++, kick = 1;
+	}
+	if (kick) {
+		virtq_kick(&(q->rxq));
+	}
+}
+
+// vnet_tx_sync - send the transmit slots the process has filled, and take
+//              - back those sent; txq.lock held
+static void vnet_tx_sync(struct vnet_queue *q)
+{
+	struct pktio_ring *ring = q->tx;
+	uint32_t tail = ring->tail, len, s;
+	bool kick = 0;
+	void *cookie;
+	if (tail - q->tx_tail <= q->tx_head + PKTIO_NR_SLOTS - q->tx_tail) {
+		q->tx_tail = tail;
+	}
+	while ((cookie = virtq_get(&(q->txq), NULL)) != NULL) {
+		q->tx_done[(uintptr_t) cookie - 1] = 1;
+	}
+	while (q->tx_head != q->tx_sent
+	       && q->tx_done[s = q->tx_head & VNET_SLOT_MASK]) {
+		q->tx_done[s] = 0, q->tx_head++;
+	}
+	ring->head = q->tx_head;
+	vnet_barrier();
+	while (q->tx_sent != q->tx_tail) {
+		s = q->tx_sent & VNET_SLOT_MASK;
+		if ((len = ring->slots[s].len) > PKTIO_MAX_FRAME) {
+			len = PKTIO_MAX_FRAME;
+		}
+		char *hdr = q->tx_bufs + s * PKTIO_BUF_SIZE + PKTIO_HEADROOM
+		    - VNET_HDR_LEN;
+		struct virtq_buf buf = { hdr, VNET_HDR_LEN + len, 0 };
+		memset(hdr, 0, VNET_HDR_LEN);
+		if (virtq_add(&(q->txq), &buf, 1,
+			      (void *)(uintptr_t) (s + 1)) < 0) {
+			break;
+		}
+		q->tx_sent++, kick = 1;
+	}
+	if (kick) {
+		virtq_kick(&(q->txq));
+	}
+}
+
+// vnet_ring_init - ring, whose buffers start at buf_page of the map
+static void vnet_ring_init(struct pktio_ring *ring, int buf_page)
+{
+	memset(ring, 0, PGSIZE);
+	ring->nr_slots = PKTIO_NR_SLOTS;
+	ring->buf_size = PKTIO_BUF_SIZE;
+	ring->buf_offset = buf_page * PGSIZE;
+}
+
+// vnet_queue_alloc - the rings of q, allocated if not yet; the card gets
+//                  - the receive buffers
+static int vnet_queue_alloc(struct vnet_queue *q)
+{
+	struct Page *pages;
+	bool intr_flag;
+	int i;
+	if (q->rx != NULL) {
+		return 0;
+	}
+	if ((pages = alloc_pages(PKTIO_MAP_PAGES)) == NULL) {
+		return -E_NO_MEM;
+	}
+	for (i = 0; i < PKTIO_MAP_PAGES; i++) {
+		set_page_ref(pages + i, 1);
+	}
+	char *base = page2kva(pages);
+	vnet_ring_init((struct pktio_ring *)base, 2);
+	vnet_ring_init((struct pktio_ring *)(base + PGSIZE),
+		       2 + PKTIO_BUF_PAGES);
+	/* PKTIO_MAP may be run by two procs at once */
+	spin_lock_irqsave(&(q->rxq.lock), intr_flag);
+	if (q->rx == NULL) {
+		q->pages = pages;
+		q->rx_bufs = base + 2 * PGSIZE;
+		q->tx_bufs = q->rx_bufs + PKTIO_BUF_PAGES * PGSIZE;
+		q->tx = (struct pktio_ring *)(base + PGSIZE);
+		vnet_barrier();
+		q->rx = (struct pktio_ring *)base;
+		vnet_rx_sync(q);
+		pages = NULL;
+	}
+	spin_unlock_irqrestore(&(q->rxq.lock), intr_flag);
+	if (pages != NULL) {
+		for (i = 0; i < PKTIO_MAP_PAGES; i++) {
+			set_page_ref(pages + i, 0);
+		}
+		free_pages(pages, PKTIO_MAP_PAGES);
+	}
+	return 0;
+}
+
+// vnet_queue_map - map the rings of q read-write in mm, the address in
+//                - *addr_store
+static int
+vnet_queue_map(struct mm_struct *mm, struct vnet_queue *q,
+	       uintptr_t * addr_store)
+{
+	uintptr_t addr;
+	int i, ret;
+	if ((addr = get_unmapped_area(mm, PKTIO_MAP_SIZE)) == 0) {
+		return -E_NO_MEM;
+	}
+	/* VM_IO: never faulted in nor swapped out, the ptes are set here */
+	if ((ret = mm_map(mm, addr, PKTIO_MAP_SIZE,
+			  VM_READ | VM_WRITE | VM_IO, NULL)) != 0) {
+		return ret;
+	}
+	pte_perm_t perm = 0;
+	ptep_set_u_read(&perm);
+	ptep_set_u_write(&perm);
+	for (i = 0; i < PKTIO_MAP_PAGES; i++) {
+		if ((ret = page_insert(mm->pgdir, q->pages + i,
+				       addr + i * PGSIZE, perm)) != 0) {
+			mm_unmap(mm, addr, PKTIO_MAP_SIZE);
+			return ret;
+		}
+	}
+	*addr_store = addr;
+	return 0;
+}
+
+// vnet_rx_wait - PKTIO_RXSYNC on q, and with wait sleep until a packet is
+//              - in the ring; # of packets there
+static int vnet_rx_wait(struct vnet_queue *q, bool wait)
+{
+	wait_t __wait, *w = &__wait;
+	bool intr_flag;
+	int ret = 0;
+	spin_lock_irqsave(&(q->rxq.lock), intr_flag);
+	vnet_rx_sync(q);
+	while (wait && q->rx_tail == q->rx_head) {
+		if (vnet.vdev.irq < 0) {
+			spin_unlock_irqrestore(&(q->rxq.lock), intr_flag);
+			do_sleep(1);
+			spin_lock_irqsave(&(q->rxq.lock), intr_flag);
+		} else {
+			wait_current_set(&(q->wait), w, WT_PKTIO);
+			spin_unlock_irqrestore(&(q->rxq.lock), intr_flag);
+			schedule();
+			spin_lock_irqsave(&(q->rxq.lock), intr_flag);
+			wait_current_del(&(q->wait), w);
+			if (w->wakeup_flags != WT_PKTIO) {
+				ret = -E_KILLED;
+				break;
+			}
+		}
+		vnet_rx_sync(q);
+	}
+	if (ret == 0) {
+		ret = q->rx_tail - q->rx_head;
+	}
+	spin_unlock_irqrestore(&(q->rxq.lock), intr_flag);
+	return ret;
+}
+
+// do_pktio - SYS_pktio, the ops of unistd.h on queue pair queue
+int do_pktio(int op, uint32_t queue, void __user * arg)
+{
+	struct mm_struct *mm = current->mm;
+	struct vnet_queue *q;
+	struct pktio_info info;
+	uintptr_t addr;
+	bool intr_flag, ok;
+	int ret;
+	if (!vnet.valid || mm == NULL) {
+		return -E_NO_DEV;
+	}
+#ifdef UCONFIG_NET
+	/* the queues are the stack's */
+	return -E_BUSY;
+#endif
+	if (op == PKTIO_INFO) {
+		memcpy(info.mac, vnet.mac, sizeof(info.mac));
+		info.nr_queues = vnet.nr_queues;
+		info.map_size = PKTIO_MAP_SIZE;
+		lock_mm(mm);
+		ok = copy_to_user(mm, arg, &info, sizeof(info));
+		unlock_mm(mm);
+		return ok ? 0 : -E_INVAL;
+	}
+	if (queue >= vnet.nr_queues) {
+		return -E_INVAL;
+	}
+	q = vnet.queues + queue;
+	if (op != PKTIO_MAP && q->rx == NULL) {
+		return -E_INVAL;
+	}
+	switch (op) {
+	case PKTIO_MAP:
+		if ((ret = vnet_queue_alloc(q)) != 0) {
+			return ret;
+		}
+		lock_mm(mm);
+		if ((ret = vnet_queue_map(mm, q, &addr)) == 0) {
+			if (!copy_to_user(mm, arg, &addr, sizeof(uintptr_t))) {
+				mm_unmap(mm, addr, PKTIO_MAP_SIZE);
+				ret = -E_INVAL;
+			}
+		}
+		unlock_mm(mm);
+		return ret;
+	case PKTIO_RXSYNC:
+	case PKTIO_RXWAIT:
+		return vnet_rx_wait(q, op == PKTIO_RXWAIT);
+	case PKTIO_TXSYNC:
+		spin_lock_irqsave(&(q->txq.lock), intr_flag);
+		vnet_tx_sync(q);
+		ret = q->tx_head + PKTIO_NR_SLOTS - q->tx_tail;
+		spin_unlock_irqrestore(&(q->txq.lock), intr_flag);
+		return ret;
+	}
+	return -E_INVAL;
+}
+
+// vnet_set_queues - have the card spread the packets over n queue pairs
+static int vnet_set_queues(int n)
+{
+	struct virtq_buf bufs[3] = {
+		{&(vnet.ctrl.class), 2, 0},
+		{&(vnet.ctrl.pairs), sizeof(uint16_t), 0},
+		{&(vnet.ctrl.ack), 1, 1},
+	};
+	bool intr_flag;
+	vnet.ctrl.class = VIRTIO_NET_CTRL_MQ;
+	vnet.ctrl.cmd = VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET;
+	vnet.ctrl.pairs = n, vnet.ctrl.ack = 0xFF;
+	spin_lock_irqsave(&(vnet.ctrlq.lock), intr_flag);
+	if (virtq_add(&(vnet.ctrlq), bufs, 3, &vnet) < 0) {
+		panic("virtio-net: no control descriptors.\n");
+	}
+	virtq_kick(&(vnet.ctrlq));
+	/* at boot, it answers at once */
+	while (virtq_get(&(vnet.ctrlq), NULL) == NULL) ;
+	spin_unlock_irqrestore(&(vnet.ctrlq.lock), intr_flag);
+	return (vnet.ctrl.ack == VIRTIO_NET_OK) ? 0 : -E_INVAL;
+}
+
+void virtio_net_init(void)
+{
+	uint32_t features, max_pairs = 1;
+	int i, n;
+	if (virtio_probe(VIRTIO_ID_NET, 0, &(vnet.vdev)) != 0) {
+		return;
+	}
+	features = virtio_negotiate(&(vnet.vdev),
+				    VIRTIO_NET_F_MAC | VIRTIO_NET_F_CTRL_VQ
+				    | VIRTIO_NET_F_MQ | VIRTIO_F_ANY_LAYOUT);
+	if (!(features & VIRTIO_F_ANY_LAYOUT)) {
+		virtio_fail(&(vnet.vdev));
+		kprintf("virtio-net: no header next to the frame.\n");
+		return;
+	}
+	if ((features & VIRTIO_NET_F_MQ) && (features & VIRTIO_NET_F_CTRL_VQ)) {
+		max_pairs = virtio_config_read(&(vnet.vdev),
+					       VIRTIO_NET_CONFIG_MAX_PAIRS, 2);
+	}
+	n = max_pairs;
+	if (n > VNET_MAX_QUEUES) {
+		n = VNET_MAX_QUEUES;
+	}
+	if (n > sysconf.lcpu_count) {
+		n = sysconf.lcpu_count;
+	}
+	for (i = 0; i < n; i++) {
+		struct vnet_queue *q = vnet.queues + i;
+		if (virtq_init(&(vnet.vdev), &(q->rxq), 2 * i) != 0
+		    || virtq_init(&(vnet.vdev), &(q->txq), 2 * i + 1) != 0) {
+			break;
+		}
+		wait_queue_init(&(q->wait));
+#ifdef UCONFIG_NET
+		tasklet_init(&(q->tasklet), vnet_poll, (unsigned long)q);
+#endif
+	}
+	/* the control queue comes after all the pairs the card has */
+	if (i == 0 || ((features & VIRTIO_NET_F_CTRL_VQ)
+		       && virtq_init(&(vnet.vdev), &(vnet.ctrlq),
+				     2 * max_pairs) != 0)) {
+		virtio_fail(&(vnet.vdev));
+		kprintf("virtio-net: no virtqueues.\n");
+		return;
+	}
+	vnet.nr_queues = i;
+	for (i = 0; i < sizeof(vnet.mac); i++) {
+		vnet.mac[i] = (features & VIRTIO_NET_F_MAC) ?
+		    virtio_config_read(&(vnet.vdev),
+				       VIRTIO_NET_CONFIG_MAC + i, 1) : 0;
+	}
+	if (virtio_intr_register(&(vnet.vdev), virtio_net_intr) != 0) {
+		/* PKTIO_RXWAIT polls */
+		vnet.vdev.irq = -1;
+	}
+	virtio_ready(&(vnet.vdev));
+	if (vnet.nr_queues > 1 && vnet_set_queues(vnet.nr_queues) != 0) {
+		vnet.nr_queues = 1;
+	}
+	vnet.valid = 1;
+	kprintf("virtio-net: %02x:%02x:%02x:%02x:%02x:%02x, %d queues, "
+		"irq %d.\n", vnet.mac[0], vnet.mac[1], vnet.mac[2], vnet.mac[3],
+		vnet.mac[4], vnet.mac[5], vnet.nr_queues, vnet.vdev.irq);
+#ifdef UCONFIG_NET
+	if (vnet_net_init() != 0) {
+		kprintf("virtio-net: no queues for the stack.\n");
+	}
+#endif
+}
@@ -0,0 +1,10 @@
+#ifndef __KERN_DRIVER_VIRTIO_NET_H__
+#define __KERN_DRIVER_VIRTIO_NET_H__
+
+#include <types.h>
+
+void virtio_net_init(void);
+bool virtio_net_valid(void);
+int do_pktio(int op, uint32_t queue, void __user * arg);
+
+#endif /* !__KERN_DRIVER_VIRTIO_NET_H__ */
@@ -8,6 +8,7 @@
 #include <picirq.h>
 #include <percpu.h>
 #include <sync.h>
+#include <sched.h>
 
 /* The LAPIC access */
 // Local APIC registers, divided by 4 for use as uint[] indices.
@@ -33,6 +34,7 @@
   #define DEASSERT   0x00000000
   #define LEVEL      0x00008000   // Level triggered
   #define BCAST      0x00080000   // Send to all APICs, including self.
+  #define OTHERS     0x000C0000   // Send to all APICs, excluding self.
   #define FIXED      0x00000000
 #define ICRHI   (0x0310/4)   // Interrupt Command [63:32]
 #define TIMER   (0x0320/4)   // Local Vector Table 0 (TIMER)
@@ -57,11 +59,9 @@
 
 #define LAPIC_PERIODIC 10000000
 
-//XXX
-#define QUANTUM 100
-
 static volatile uint32_t *xapic;
 static uint64_t xapichz;
+static uint32_t xapic_tick_count;	// TICR of one clock tick
 
 static void
 xapicw(uint32_t index, uint32_t value)
@@ -178,20 +178,27 @@ void lapic_eoi_send(struct lapic_chip* chip)
 	xapicw(EOI, 0);
 }
 
-static void x_lapic_start_ap(struct lapic_chip *_this, struct cpu *c,
-			     uint32_t addr)
+static void x_lapic_start_aps(struct lapic_chip *_this, struct cpu **cs,
+			      int n, uint32_t addr)
 {
-	int i;
+	int i, j;
 
 	// "Universal startup algorithm."
 	// Send INIT (level-triggered) interrupt to reset other CPU.
+	// Each step goes to every cpu before its delay, so that n cpus
+	// take as long to start as one.
 
-	xapicw(ICRHI, c->hwid << 24);
-	xapicw(ICRLO, INIT | LEVEL | ASSERT);
-	xapicwait();
+	for(j = 0; j < n; j++){
+		xapicw(ICRHI, cs[j]->hwid << 24);
+		xapicw(ICRLO, INIT | LEVEL | ASSERT);
+		xapicwait();
+	}
 	microdelay(10000);
-	xapicw(ICRLO, INIT | LEVEL);
-	xapicwait();
+	for(j = 0; j < n; j++){
+		xapicw(ICRHI, cs[j]->hwid << 24);
+		xapicw(ICRLO, INIT | LEVEL);
+		xapicwait();
+	}
 	microdelay(10000);    // should be 10ms, but too slow in Bochs!
 
 	// Send startup IPI (twice!) to enter bootstrap code.
@@ -200,12 +207,21 @@ static void x_lapic_start_ap(struct lapic_chip *_this, struct cpu *c,
 	// should be ignored, but it is part of the official Intel algorithm.
 	// Bochs complains about the second one.  Too bad for Bochs.
 	for(i = 0; i < 2; i++){
-		xapicw(ICRHI, c->hwid << 24);
-		xapicw(ICRLO, STARTUP | (addr>>12));
+		for(j = 0; j < n; j++){
+			xapicw(ICRHI, cs[j]->hwid << 24);
+			xapicw(ICRLO, STARTUP | (addr>>12));
+			xapicwait();
+		}
 		microdelay(200);
 	}
 }
 
+static void x_lapic_start_ap(struct lapic_chip *_this, struct cpu *c,
+			     uint32_t addr)
+{
+	x_lapic_start_aps(_this, &c, 1, addr);
+}
+
 
 static void x_cpu_init(struct lapic_chip* _this)
 {
@@ -227,9 +243,10 @@ static void x_cpu_init(struct lapic_chip* _this)
 		xapichz = 100 * (ccr0 - ccr1);
 	}
 
-	count = (QUANTUM*xapichz) / 1000;
+	count = xapichz / TIMER_HZ;
 	if (count > 0xffffffff)
-		panic("initxapic: QUANTUM too large");
+		panic("initxapic: TIMER_HZ too small");
+	xapic_tick_count = count;
 
 	// The timer repeatedly counts down at bus frequency
 	// from xapic[TICR] and then issues an interrupt.  
@@ -287,13 +304,63 @@ static void x_lapic_send_ipi(struct lapic_chip* thiz, struct cpu* c, int ino)
 	local_intr_restore(intr_flag);
 }
 
+static void x_lapic_send_ipi_allbutself(struct lapic_chip* thiz, int ino)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	xapicw(ICRHI, 0);
+	xapicw(ICRLO, OTHERS | FIXED | DEASSERT | ino);
+	if (xapicwait() < 0)
+		panic("xapic_lapic::send_ipi_allbutself: xapicwait failure");
+
+	local_intr_restore(intr_flag);
+}
+
+// x_timer_oneshot - stop the periodic tick, interrupt once after nsec
+static void x_timer_oneshot(struct lapic_chip *thiz, uint64_t nsec)
+{
+	uint64_t count = xapichz * (nsec / 1000) / 1000000;
+	if (count == 0)
+		count = 1;
+	if (count > 0xffffffff)
+		count = 0xffffffff;
+	xapicw(TDCR, X1);
+	xapicw(TIMER, IRQ_OFFSET + IRQ_TIMER);
+	xapicw(TICR, count);
+}
+
+static void x_timer_periodic(struct lapic_chip *thiz)
+{
+	xapicw(TDCR, X1);
+	xapicw(TIMER, PERIODIC | (IRQ_OFFSET + IRQ_TIMER));
+	xapicw(TICR, xapic_tick_count);
+}
+
+static uint64_t x_timer_left(struct lapic_chip *thiz)
+{
+	return (uint64_t) xapicr(TCCR) * 1000000000 / xapichz;
+}
+
+// x_pc_mask - the delivery of a counter overflow masks the LVT, the
+//           - profiler unmasks it for the next one
+static void x_pc_mask(struct lapic_chip *thiz, int mask)
+{
+	mask_pc(mask);
+}
+
 static struct lapic_chip xapic_chip = {
 	.cpu_init = x_cpu_init,
 	.id = x_lapic_id,
 	.eoi = lapic_eoi_send,
 	.init_late = x_init_late,
 	.start_ap = x_lapic_start_ap,
+	.start_aps = x_lapic_start_aps,
 	.send_ipi = x_lapic_send_ipi,
+	.send_ipi_allbutself = x_lapic_send_ipi_allbutself,
+	.timer_oneshot = x_timer_oneshot,
+	.timer_periodic = x_timer_periodic,
+	.timer_left = x_timer_left,
+	.pc_mask = x_pc_mask,
 };
 
 static xapic_init_once()
@@ -1,3 +1,3 @@
 ARCH_INLUCDES := . debug driver include libs mm numa process sync trap syscall kmodule driver/acpica/source/include
-ARCH_CFLAGS := -m64 -mcmodel=large -D__UCORE
+ARCH_CFLAGS := -m64 -mcmodel=large -fno-pie -fno-pic -mno-mmx -mno-sse -mno-sse2 -mno-avx -D__UCORE
 ARCH_LDFLAGS := -melf_x86_64
@@ -8,7 +8,10 @@
 #include <clock.h>
 #include <intr.h>
 #include <pmm.h>
+#include <slab.h>
 #include <vmm.h>
+#include <dma.h>
+#include <vmalloc.h>
 #include <ide.h>
 #include <fs.h>
 #include <swap.h>
@@ -22,20 +25,32 @@
 #include <lapic.h>
 #include <multiboot.h>
 #include <refcache.h>
+#include <virtio.h>
+#include <irqbalance.h>
+#include <cmdline.h>
+#include <spinlock.h>
+#include <cpuid.h>
+#include <fpu.h>
+#include <idle.h>
+#include <kvm.h>
+#include <initcall.h>
+#include <boottime.h>
+#include <static_key.h>
+#ifdef UCONFIG_NET
+#include <net.h>
+#endif
+#ifdef UCONFIG_PERF_EVENT
+#include <perf.h>
+#endif
 #include <dde_kit/dde_kit.h>
 
 int kern_init(uint64_t, uint64_t) __attribute__ ((noreturn));
 
 static void bootaps(void)
 {
-	int i;
 	kprintf("starting to boot Application Processors!\n");
-	for(i=0;i<sysconf.lcpu_count;i++){
-		if(i == myid())
-			continue;
-		kprintf("booting cpu%d\n", i);
-		cpu_up(i);
-	}
+	cpus_up();
+	kprintf("%d cpus up\n", sysconf.lcpu_count);
 }
 
 struct e820map *e820map_addr = (struct e820map *)(0x8000 + PBASE);
@@ -77,6 +92,25 @@ static void parse_initrd(Mbdata *mb)
 	initrd_end = VADDR_DIRECT(mods[0].end);
 }
 
+/* the command line of the boot loader, copied before pmm may reuse it */
+static char boot_cmdline[256];
+
+// isolcpus_init - keep the cpus of isolcpus= of the command line for the
+//               - procs pinned there, see sched.c
+static void isolcpus_init(const char *cmdline)
+{
+	const char *arg = cmdline_arg(cmdline, "isolcpus=");
+	cpuset_t set;
+	if (arg == NULL) {
+		return;
+	}
+	if (cpulist_parse(arg, &set, sysconf.lcpu_count)) {
+		sched_isolate_cpus(&set);
+	} else {
+		kprintf("sched: bad isolcpus=, ignored.\n");
+	}
+}
+
 int kern_init(uint64_t mbmagic, uint64_t mbmem)
 {
 	extern char edata[], end[];
@@ -86,6 +120,8 @@ int kern_init(uint64_t mbmagic, uint64_t mbmem)
 	percpu_offsets[0] = __percpu_start;
 
 	cons_init();		// init the console
+	x86_erms = cpuid_check_feature(CPUID_FEATURE_ERMS) != 0;
+	x86_fsgsbase = cpuid_check_feature(CPUID_FEATURE_FSGSBASE) != 0;
 
 	const char *message = "(THU.CST) os is loading ...";
 	kprintf("%s\n\n", message);
@@ -93,6 +129,11 @@ int kern_init(uint64_t mbmagic, uint64_t mbmem)
 		kprintf("Multiboot dectected: param %p\n", (void*)mbmem);
 		mbmem2e820((Mbdata*)VADDR_DIRECT(mbmem));
 		parse_initrd((Mbdata*)VADDR_DIRECT(mbmem));
+		Mbdata *mb = (Mbdata *) VADDR_DIRECT(mbmem);
+		if (mb->flags & (1 << 2)) {
+			strncpy(boot_cmdline, VADDR_DIRECT(mb->cmdline),
+				sizeof(boot_cmdline) - 1);
+		}
 	}
 
 	print_kerninfo();
@@ -101,11 +142,14 @@ int kern_init(uint64_t mbmagic, uint64_t mbmem)
 	hz_init();
 	gdt_init(per_cpu_ptr(cpus, 0));
 	tls_init(per_cpu_ptr(cpus, 0));
-	acpitables_init();
+#ifdef UCONFIG_LOCK_STAT
+	lock_stat_init();
+#endif
+	boot_call(acpitables_init());
 	lapic_init();
-	numa_init();
+	boot_call(numa_init());
 
-	pmm_init_numa();		// init physical memory management, numa awared
+	boot_call(pmm_init_numa());	// init physical memory management, numa awared
 	/* map the lapic */
 	lapic_init_late();
 
@@ -117,7 +161,7 @@ int kern_init(uint64_t mbmagic, uint64_t mbmem)
 //	acpi_conf_init();
 
 
-	percpu_init();
+	boot_call(percpu_init());
 	cpus_init();
 #ifdef UCONFIG_ENABLE_IPI
 	ipi_init();
@@ -125,33 +169,68 @@ int kern_init(uint64_t mbmagic, uint64_t mbmem)
 
 	refcache_init();
 
-	vmm_init();		// init virtual memory management
-	sched_init();		// init scheduler
-	proc_init();		// init process table
+	boot_call(vmm_init());	// init virtual memory management
+	vmalloc_init();		// before boot_pgdir is copied
+	dma_contig_init();	// before the pages fragment
+	boot_call(sched_init());	// init scheduler
+	isolcpus_init(boot_cmdline);
+	fpu_init();		// the xsave areas of the threads
+#ifdef UCONFIG_MWAIT_IDLE
+	mwait_idle_init();
+#endif
+#ifdef UCONFIG_KVM_GUEST
+	kvm_guest_init();	// steal time, PV spinlocks and TLB flush
+#endif
+	boot_call(proc_init());	// init process table
 	sync_init();		// init sync struct
+#ifdef UCONFIG_PERF_EVENT
+	perf_init();
+#endif
+	percpu_alloc_init();	// the dynamic per-cpu objects
+#ifdef UCONFIG_JUMP_LABEL
+	jump_label_init();
+#endif
 
 	/* ext int */
 	ioapic_init();
+	/* before the drivers register their irqs */
+	irq_affinity_init(boot_cmdline);
 	acpi_init();
+#ifdef UCONFIG_NET
+	net_init();		// before the cards register
+#endif
 
-	ide_init();		// init ide devices
+	boot_call(ide_init());	// init ide devices
+#if defined(UCONFIG_VIRTIO_BLK) || defined(UCONFIG_VIRTIO_CONSOLE) \
+    || defined(UCONFIG_VIRTIO_NET) || defined(UCONFIG_VIRTIO_BALLOON)
+	boot_call(virtio_init());	// init virtio devices
+#endif
 #ifdef UCONFIG_SWAP
-	swap_init();		// init swap
+	boot_call(swap_init());	// init swap
 #endif
-	fs_init();		// init fs
+	boot_call(fs_init());	// init fs
 
 	clock_init();		// init clock interrupt
-	mod_init();
+	boot_call(mod_init());
 
 	trap_init();
+#ifdef UCONFIG_SERIAL_IRQ
+	/* the console irq is routed: stop polling the serial port */
+	serial_tx_start();
+#endif
+
+	/* after the boot time checks, they count every free page & obj */
+	slab_magazine_init();
+	pmm_init_percpu();
 
 	//XXX put here?
-	bootaps();
+	boot_call(bootaps());
 
 	intr_enable();		// enable irq interrupt
 
 #ifdef UCONFIG_HAVE_LINUX_DDE36_BASE
-	dde_kit_init();
+	/* the linux drivers, while init_main starts the kernel threads */
+	async_initcall("dde_kit_init", dde_kit_init);
 #endif
 
 	/* do nothing */
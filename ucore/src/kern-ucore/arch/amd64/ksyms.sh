@@ -0,0 +1,33 @@
+#!/bin/sh
+# ksyms.sh - turn `nm -n kernel` on stdin into the assembly of the table
+#          - of the text symbols that ksym_lookup in debug/kdebug.c searches
+#
+# Only the text above KERNBASE is kept, the .ksyms section sits before edata
+# so that adding it moves no text of the first link.
+
+awk '
+BEGIN {
+	n = 0
+}
+$2 ~ /^[tTwW]$/ && $1 ~ /^ffff8/ {
+	addr[n] = $1
+	name[n] = $3
+	n++
+}
+END {
+	print "\t.section .ksyms, \"a\""
+	print "\t.align 8"
+	print "\t.globl __ksym_count"
+	print "__ksym_count:"
+	print "\t.quad " n
+	print "\t.globl __ksym_addrs"
+	print "__ksym_addrs:"
+	for (i = 0; i < n; i++)
+		print "\t.quad 0x" addr[i]
+	print "\t.globl __ksym_names"
+	print "__ksym_names:"
+	for (i = 0; i < n; i++)
+		print "\t.quad .Lksym_name" i
+	for (i = 0; i < n; i++)
+		print ".Lksym_name" i ":\t.asciz \"" name[i] "\""
+}'
@@ -7,7 +7,18 @@
 #define CACHELINE 64
 
 #define barrier() __asm__ __volatile__ ("" ::: "memory")
+
+/* x86 keeps the order of the loads, and of the stores, and no load passes
+ * a store before it to another place; only smp_mb needs an instruction, a
+ * locked op being cheaper than mfence. see memorder.h */
+#define smp_mb()    \
+    __asm__ __volatile__ ("lock; addl $0,-4(%%rsp)" ::: "memory", "cc")
+#define smp_rmb()   barrier()
+#define smp_wmb()   barrier()
+#define smp_acqrel() barrier()
 #define __noret__   __attribute__((noreturn))
+/* no mcount call in the prologue, even built with -pg */
+#define __notrace__ __attribute__((no_instrument_function))
 
 /* maxinum cpu number */
 #define MAX_IOAPIC     8
@@ -52,6 +63,8 @@ static inline uintptr_t rcr0(void) __attribute__ ((always_inline));
 static inline uintptr_t rcr1(void) __attribute__ ((always_inline));
 static inline uintptr_t rcr2(void) __attribute__ ((always_inline));
 static inline uintptr_t rcr3(void) __attribute__ ((always_inline));
+static inline void lcr4(uintptr_t cr4) __attribute__ ((always_inline));
+static inline uintptr_t rcr4(void) __attribute__ ((always_inline));
 static inline void invlpg(void *addr) __attribute__ ((always_inline));
 
 static inline uint8_t inb(uint16_t port)
@@ -171,6 +184,18 @@ static inline uintptr_t rcr3(void)
 	return cr3;
 }
 
+static inline void lcr4(uintptr_t cr4)
+{
+	asm volatile ("mov %0, %%cr4"::"r" (cr4):"memory");
+}
+
+static inline uintptr_t rcr4(void)
+{
+	uintptr_t cr4;
+	asm volatile ("mov %%cr4, %0":"=r" (cr4)::"memory");
+	return cr4;
+}
+
 static inline void invlpg(void *addr)
 {
 	asm volatile ("invlpg (%0)"::"r" (addr):"memory");
@@ -253,6 +278,21 @@ writemsr(uint64_t msr, uint64_t val)
   __asm volatile("wrmsr" : : "c" (msr), "a" (lo), "d" (hi) : "memory");
 }
 
+/* with CR4_FSGSBASE, far cheaper than the msr under a hypervisor */
+static inline uint64_t
+rdfsbase(void)
+{
+  uint64_t v;
+  __asm volatile("rdfsbase %0" : "=r" (v));
+  return v;
+}
+
+static inline void
+wrfsbase(uint64_t v)
+{
+  __asm volatile("wrfsbase %0" : : "r" (v) : "memory");
+}
+
 static inline uint64_t
 rdtsc(void)
 {
@@ -261,6 +301,20 @@ rdtsc(void)
   return ((uint64_t)lo)|(((uint64_t)hi)<<32);
 }
 
+/* arm the monitor on the cache line of addr, for cpu_mwait */
+static inline void
+cpu_monitor(const volatile void *addr)
+{
+  __asm volatile("monitor" : : "a"(addr), "c"(0), "d"(0));
+}
+
+/* wait for a write to the monitored line, or another break event */
+static inline void
+cpu_mwait(uint32_t hint, uint32_t ecx)
+{
+  __asm volatile("mwait" : : "a"(hint), "c"(ecx) : "memory");
+}
+
 static inline uint64_t
 rdpmc(uint32_t ecx)
 {
@@ -342,6 +396,43 @@ static inline void *__memmove(void *dst, const void *src, size_t n)
 static inline void *__memcpy(void *dst, const void *src, size_t n)
     __attribute__ ((always_inline));
 
+#ifdef __UCORE_64__
+/* *
+ * The copies and fills move 8 bytes per rep iteration, the tail bytewise.
+ * With ERMS (enhanced rep movsb/stosb, cpuid 7 ebx bit 9) a long rep movsb
+ * is as fast as the microcode gets, so the copies of X86_ERMS_MIN bytes or
+ * more use it alone. x86_erms is set by kern_init from cpuid.
+ * */
+#define X86_ERMS_MIN        512
+extern bool x86_erms;
+/* RDFSBASE/WRFSBASE, cpuid 7 ebx bit 0, enabled by tls_init */
+extern bool x86_fsgsbase;
+
+#define __HAVE_ARCH_COPY_PAGE
+#define __HAVE_ARCH_CLEAR_PAGE
+static inline void __copy_page(void *dst, const void *src)
+    __attribute__ ((always_inline));
+static inline void __clear_page(void *page) __attribute__ ((always_inline));
+
+// __copy_page - copy the 4KB page at src to dst, both page aligned
+static inline void __copy_page(void *dst, const void *src)
+{
+	long d0, d1, d2;
+	asm volatile ("rep; movsq;":"=&c" (d0), "=&D"(d1), "=&S"(d2)
+		      :"0"(4096 / 8), "1"(dst), "2"(src)
+		      :"memory");
+}
+
+// __clear_page - zero the 4KB page at page, page aligned
+static inline void __clear_page(void *page)
+{
+	long d0, d1;
+	asm volatile ("rep; stosq;":"=&c" (d0), "=&D"(d1)
+		      :"0"(4096 / 8), "a"(0L), "1"(page)
+		      :"memory");
+}
+#endif /* __UCORE_64__ */
+
 #ifndef __HAVE_ARCH_STRCMP
 #define __HAVE_ARCH_STRCMP
 static inline int __strcmp(const char *s1, const char *s2)
@@ -379,6 +470,27 @@ static inline char *__strcpy(char *dst, const char *src)
 
 #ifndef __HAVE_ARCH_MEMSET
 #define __HAVE_ARCH_MEMSET
+#ifdef __UCORE_64__
+static inline void *__memset(void *s, char c, size_t n)
+{
+	long d0, d1;
+	uint64_t v = (uint8_t) c * 0x0101010101010101ULL;
+	if (n >= X86_ERMS_MIN && x86_erms) {
+		asm volatile ("rep; stosb;":"=&c" (d0), "=&D"(d1)
+			      :"0"(n), "a"(v), "1"(s)
+			      :"memory");
+		return s;
+	}
+	asm volatile ("rep; stosq;"
+		      "movq %4, %%rcx;"
+		      "andq $7, %%rcx;"
+		      "jz 1f;"
+		      "rep; stosb;" "1:":"=&c" (d0), "=&D"(d1)
+		      :"0"(n / 8), "a"(v), "g"(n), "1"(s)
+		      :"memory");
+	return s;
+}
+#else
 static inline void *__memset(void *s, char c, size_t n)
 {
 	int d0, d1;
@@ -387,6 +499,7 @@ static inline void *__memset(void *s, char c, size_t n)
 		      :"memory");
 	return s;
 }
+#endif /* __UCORE_64__ */
 #endif /* __HAVE_ARCH_MEMSET */
 
 #ifndef __HAVE_ARCH_MEMMOVE
@@ -407,6 +520,26 @@ static inline void *__memmove(void *dst, const void *src, size_t n)
 
 #ifndef __HAVE_ARCH_MEMCPY
 #define __HAVE_ARCH_MEMCPY
+#ifdef __UCORE_64__
+static inline void *__memcpy(void *dst, const void *src, size_t n)
+{
+	long d0, d1, d2;
+	if (n >= X86_ERMS_MIN && x86_erms) {
+		asm volatile ("rep; movsb;":"=&c" (d0), "=&D"(d1), "=&S"(d2)
+			      :"0"(n), "1"(dst), "2"(src)
+			      :"memory");
+		return dst;
+	}
+	asm volatile ("rep; movsq;"
+		      "movq %4, %%rcx;"
+		      "andq $7, %%rcx;"
+		      "jz 1f;"
+		      "rep; movsb;" "1:":"=&c" (d0), "=&D"(d1), "=&S"(d2)
+		      :"0"(n / 8), "g"(n), "1"(dst), "2"(src)
+		      :"memory");
+	return dst;
+}
+#else
 static inline void *__memcpy(void *dst, const void *src, size_t n)
 {
 	int d0, d1, d2;
@@ -419,6 +552,7 @@ static inline void *__memcpy(void *dst, const void *src, size_t n)
 		      :"memory");
 	return dst;
 }
+#endif /* __UCORE_64__ */
 #endif /* __HAVE_ARCH_MEMCPY */
 
 #endif /* !__LIBS_X86_H__ */
@@ -0,0 +1,37 @@
+#ifndef __ARCH_AMD64_LIBS_JUMP_LABEL_H__
+#define __ARCH_AMD64_LIBS_JUMP_LABEL_H__
+
+#include <types.h>
+
+/* *
+ * The site of a static key is a 5-byte nop, patched into a jmp rel32 of the
+ * same size. A macro rather than an inline function, for the key has to be
+ * a link time constant even at -O0: "X" lets %P0 print the symbol, where
+ * "i" is refused under -mcmodel=large. The kernel is built -fno-pic, see
+ * include.mk, or %P0 would print key@PLT, a 4-byte relocation.
+ * */
+#define JUMP_LABEL_NOP_SIZE         5
+
+#define arch_static_branch(key)                                         \
+    ({                                                                  \
+        __label__ __l_yes;                                              \
+        bool __taken = 0;                                               \
+        do {                                                            \
+            asm goto ("1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"       \
+                      ".pushsection __jump_table, \"aw\"\n\t"           \
+                      ".balign 8\n\t"                                   \
+                      ".quad 1b, %l[__l_yes], %P0\n\t"                  \
+                      ".popsection"                                     \
+                      : : "X" (key) : : __l_yes);                       \
+            break;                                                      \
+        __l_yes:                                                        \
+            __taken = 1;                                                \
+        } while (0);                                                    \
+        __taken;                                                        \
+    })
+
+struct trapframe;
+
+bool jump_label_int3(struct trapframe *tf);
+
+#endif /* !__ARCH_AMD64_LIBS_JUMP_LABEL_H__ */
@@ -7,6 +7,16 @@
 #include <stdarg.h>
 #include <unistd.h>
 #include <mod.h>
+#ifdef UCONFIG_KLOG
+#include <string.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <slab.h>
+#include <proc.h>
+#include <wait.h>
+#include <softirq.h>
+#include <timekeeping.h>
+#endif
 
 /* *
  * cputch - writes a single character @c to stdout, and it will
@@ -20,6 +30,8 @@ static void cputch(int c, int *cnt, int fd)
 
 static spinlock_s kprintf_lock = { 0 };
 
+bool is_kernel_panic(void);
+
 /* *
  * vcprintf - format a string and writes it to stdout
  *
@@ -29,12 +41,263 @@ static spinlock_s kprintf_lock = { 0 };
  * Call this function if you are already dealing with a va_list.
  * Or you probably want cprintf() instead.
  * */
+#ifdef UCONFIG_KLOG
+/* *
+ * The kernel log. Once klogd runs, kprintf formats its message into the
+ * ring of its cpu, a record of the time and the text, and returns; klogd
+ * drains the rings to the console, the oldest record of all the cpus
+ * first, so that the slow writes to the CGA, the serial and the parallel
+ * ports are out of the way of the caller.
+ *
+ * A cpu is the only writer of its ring, with the interrupts off, and
+ * klogd, or whoever holds kprintf_lock, the only reader: head is moved by
+ * the writer once the record is whole, tail by the reader once it has
+ * printed it, so that neither takes a lock. A message that does not fit
+ * in what the ring has free is dropped and counted, and reported by the
+ * next drain. The writer only schedules a tasklet, which wakes klogd up
+ * from the softirq, since kprintf may be called with the locks of the
+ * scheduler held.
+ *
+ * Before klogd runs, and from a panic on, kprintf prints at once as it
+ * always did, the rings drained first.
+ * */
+#define KLOG_RING_SIZE          (64 * 1024)	// bytes, a power of 2
+#define KLOG_RING_MASK          (KLOG_RING_SIZE - 1)
+
+struct klog_rec {
+	uint64_t ns;
+	uint32_t len;		// of the text after it
+};
+
+struct klog_cpu {
+	char *buf;
+	volatile uint32_t head;	// bytes written, moved by the cpu
+	volatile uint32_t tail;	// bytes printed, moved by the reader
+	uint32_t lost;		// messages dropped, ring full
+	uint32_t lost_shown;	// of them, those reported
+};
+
+static DEFINE_PERCPU_NOINIT(struct klog_cpu, klog_cpus);
+
+static volatile bool klog_on = 0;
+
+static struct tasklet klog_tasklet;
+static wait_queue_t klog_wait;
+static spinlock_s klog_wait_lock;
+
+#define klog_barrier()          __asm__ __volatile__ ("" ::: "memory")
+
+/* a message being formatted into a ring */
+struct klog_put {
+	struct klog_cpu *kc;
+	uint32_t pos, end;	// the next byte, and the first not free
+	int cnt;
+};
+
+static void klog_copy_in(struct klog_cpu *kc, uint32_t pos, const void *src,
+			 size_t n)
+{
+	const char *s = src;
+	while (n-- > 0) {
+		kc->buf[pos++ & KLOG_RING_MASK] = *s++;
+	}
+}
+
+static void klog_copy_out(struct klog_cpu *kc, uint32_t pos, void *dst,
+			  size_t n)
+{
+	char *d = dst;
+	while (n-- > 0) {
+		*d++ = kc->buf[pos++ & KLOG_RING_MASK];
+	}
+}
+
+static void klog_putch(int c, struct klog_put *put, int fd)
+{
+	if (put->pos != put->end) {
+		put->kc->buf[put->pos++ & KLOG_RING_MASK] = c;
+	}
+	put->cnt++;
+}
+
+// klog_write - format the message into the ring of this cpu, with the
+//            - interrupts off; the # of chars of the message
+static int klog_write(const char *fmt, va_list ap)
+{
+	struct klog_cpu *kc = get_cpu_ptr(klog_cpus);
+	struct klog_rec rec;
+	struct klog_put put;
+	uint32_t head = kc->head;
+	put.kc = kc, put.cnt = 0;
+	put.end = kc->tail + KLOG_RING_SIZE;
+	if (put.end - head < sizeof(rec)) {
+		kc->lost++;
+		return 0;
+	}
+	put.pos = head + sizeof(rec);
+	vprintfmt((void *)klog_putch, NO_FD, &put, fmt, ap);
+	if (put.cnt == 0) {
+		return 0;
+	}
+	if (put.pos - head - sizeof(rec) != put.cnt) {
+		kc->lost++;
+		return put.cnt;
+	}
+	rec.ns = ktime_get_ns(), rec.len = put.cnt;
+	klog_copy_in(kc, head, &rec, sizeof(rec));
+	klog_barrier();
+	kc->head = put.pos;
+	tasklet_schedule(&klog_tasklet);
+	return put.cnt;
+}
+
+// klog_drain_one - print the oldest record of the rings, with kprintf_lock
+//                - held; 0 if there is none
+static bool klog_drain_one(void)
+{
+	struct klog_cpu *kc, *oldest = NULL;
+	struct klog_rec rec, oldest_rec;
+	uint32_t pos, lost;
+	char line[48];
+	int cpu, i, n;
+	for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+		kc = per_cpu_ptr(klog_cpus, cpu);
+		if ((lost = kc->lost) != kc->lost_shown) {
+			n = snprintf(line, sizeof(line),
+				     "klog: %u messages of cpu%d lost.\n",
+				     lost - kc->lost_shown, cpu);
+			for (i = 0; i < n; i++) {
+				cons_putc(line[i]);
+			}
+			kc->lost_shown = lost;
+			return 1;
+		}
+		if (kc->tail == kc->head) {
+			continue;
+		}
+		klog_barrier();
+		klog_copy_out(kc, kc->tail, &rec, sizeof(rec));
+		if (oldest == NULL || rec.ns < oldest_rec.ns) {
+			oldest = kc, oldest_rec = rec;
+		}
+	}
+	if (oldest == NULL) {
+		return 0;
+	}
+	pos = oldest->tail + sizeof(rec);
+	for (i = 0; i < oldest_rec.len; i++) {
+		cons_putc(oldest->buf[pos++ & KLOG_RING_MASK]);
+	}
+	klog_barrier();
+	oldest->tail = pos;
+	return 1;
+}
+
+// klog_empty - no record is left in the rings
+static bool klog_empty(void)
+{
+	int cpu;
+	for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+		struct klog_cpu *kc = per_cpu_ptr(klog_cpus, cpu);
+		if (kc->tail != kc->head || kc->lost != kc->lost_shown) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// klog_flush - print the records of the rings until they are empty, as
+//            - what writes to the console directly does before
+void klog_flush(void)
+{
+	bool more;
+	int flag;
+	if (!klog_on) {
+		return;
+	}
+	do {
+		local_intr_save_hw(flag);
+		spinlock_acquire(&kprintf_lock);
+		more = klog_drain_one();
+		spinlock_release(&kprintf_lock);
+		local_intr_restore_hw(flag);
+	} while (more);
+}
+
+static void klog_wakeup(unsigned long data)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&klog_wait_lock, intr_flag);
+	if (!wait_queue_empty(&klog_wait)) {
+		wakeup_queue(&klog_wait, WT_KLOG, 1);
+	}
+	spin_unlock_irqrestore(&klog_wait_lock, intr_flag);
+}
+
+static int klogd_main(void *arg)
+{
+	wait_t __wait, *wait = &__wait;
+	bool intr_flag;
+	current->nice = PROC_NICE_MAX;
+	while (1) {
+		klog_flush();
+		spin_lock_irqsave(&klog_wait_lock, intr_flag);
+		/* a record written from now on schedules klog_wakeup after */
+		if (klog_empty()) {
+			wait_current_set(&klog_wait, wait, WT_KLOG);
+			spin_unlock_irqrestore(&klog_wait_lock, intr_flag);
+			schedule();
+			spin_lock_irqsave(&klog_wait_lock, intr_flag);
+			wait_current_del(&klog_wait, wait);
+		}
+		spin_unlock_irqrestore(&klog_wait_lock, intr_flag);
+	}
+	return 0;
+}
+
+// klog_init - give every cpu its ring and start klogd, kprintf goes
+//           - through the rings from then on
+void klog_init(void)
+{
+	int cpu, pid;
+	tasklet_init(&klog_tasklet, klog_wakeup, 0);
+	wait_queue_init(&klog_wait);
+	spinlock_init(&klog_wait_lock);
+	for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+		struct klog_cpu *kc = per_cpu_ptr(klog_cpus, cpu);
+		memset(kc, 0, sizeof(struct klog_cpu));
+		if ((kc->buf = kmalloc(KLOG_RING_SIZE)) == NULL) {
+			kprintf("klog: no memory, the console stays sync.\n");
+			return;
+		}
+	}
+	if ((pid = ucore_kernel_thread(klogd_main, NULL, 0)) <= 0) {
+		kprintf("klog: cannot start klogd, the console stays sync.\n");
+		return;
+	}
+	set_proc_name(find_proc(pid), "klogd");
+	klog_on = 1;
+}
+#endif /* UCONFIG_KLOG */
+
 int vkprintf(const char *fmt, va_list ap)
 {
 	int cnt = 0;
 	int flag;
 	local_intr_save_hw(flag);
+#ifdef UCONFIG_KLOG
+	if (klog_on && !is_kernel_panic()) {
+		cnt = klog_write(fmt, ap);
+		local_intr_restore_hw(flag);
+		return cnt;
+	}
+#endif
 	spinlock_acquire(&kprintf_lock);
+#ifdef UCONFIG_KLOG
+	if (klog_on) {
+		while (klog_drain_one()) ;
+	}
+#endif
 	vprintfmt((void *)cputch, NO_FD, &cnt, fmt, ap);
 	spinlock_release(&kprintf_lock);
 	local_intr_restore_hw(flag);
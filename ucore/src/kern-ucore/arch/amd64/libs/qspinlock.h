@@ -0,0 +1,39 @@
+#ifndef __ARCH_AMD64_QSPINLOCK_H__
+#define __ARCH_AMD64_QSPINLOCK_H__
+
+#include <types.h>
+#include <spinlock.h>
+
+/* *
+ * qspinlock_s - MCS queue lock, for the hot global locks. Each waiter
+ * spins on its own per-cpu node, so a contended lock moves one cache line
+ * per hand-off instead of bouncing between all the waiters like a ticket
+ * lock does. tail codes the last queued node as cpu * MCS_NESTING + slot
+ * + 1, 0 when the lock is free; all zero is unlocked.
+ *
+ * A cpu may hold up to MCS_NESTING queue locks at once and must release
+ * them in the reverse order it took them, on the cpu it took them on.
+ * */
+#define MCS_NESTING 4
+
+typedef struct qspinlock_s {
+	volatile uint32_t tail;
+	uint32_t holder;	/* node of the holder, set once it owns the lock */
+#ifdef UCONFIG_LOCK_STAT
+	struct lock_stat stat;
+#endif
+} qspinlock_s;
+
+typedef qspinlock_s *qspinlock_t;
+
+#define qspinlock_init(x) do { (x)->tail = (x)->holder = 0; lock_stat_clear(&(x)->stat); } while (0)
+
+void qspin_lock(qspinlock_t lock);
+int qspin_trylock(qspinlock_t lock);
+void qspin_unlock(qspinlock_t lock);
+
+#define qspin_lock_irqsave(lock, x)      do { x = __intr_save();qspin_lock(lock); } while (0)
+
+#define qspin_unlock_irqrestore(lock, x)      do { qspin_unlock(lock);__intr_restore(x); } while (0)
+
+#endif /* !__ARCH_AMD64_QSPINLOCK_H__ */
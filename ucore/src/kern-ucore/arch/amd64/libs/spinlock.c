@@ -0,0 +1,455 @@
+#include <types.h>
+#include <arch.h>
+#include <stdio.h>
+#include <kio.h>
+#include <assert.h>
+#include <mp.h>
+#include <spinlock.h>
+#include <qspinlock.h>
+#ifdef UCONFIG_KVM_GUEST
+#include <sync.h>
+#include <kvm.h>
+#endif
+#ifdef UCONFIG_LOCK_STAT
+#include <slab.h>
+#include <vmm.h>
+#include <proc.h>
+#include <unistd.h>
+#include <error.h>
+#include <kdebug.h>
+#endif
+
+/* *
+ * mcs_node - a queue entry, spun on by its owner only. The nodes of a cpu
+ * are used as a stack, depth counts how many of them hold or wait for a
+ * lock.
+ * */
+struct mcs_node {
+	struct mcs_node *volatile next;
+	volatile int locked;
+#ifdef UCONFIG_KVM_GUEST
+	volatile int halted;	// its owner halts until kicked, see kvm.c
+#endif
+} __attribute__ ((aligned(64)));
+
+struct mcs_cpu {
+	struct mcs_node nodes[MCS_NESTING];
+	int depth;
+} __attribute__ ((aligned(64)));
+
+/* indexed by cpu id rather than per-cpu, the locks are used before
+ * percpu_init() */
+static struct mcs_cpu mcs_cpus[NCPU];
+
+static inline struct mcs_node *mcs_node_of(uint32_t code)
+{
+	code--;
+	return &mcs_cpus[code / MCS_NESTING].nodes[code % MCS_NESTING];
+}
+
+// mcs_node_get - take the next free node of this cpu, return its code
+static uint32_t mcs_node_get(struct mcs_node **nodep)
+{
+	int id = myid();
+	struct mcs_cpu *mc = &mcs_cpus[id];
+	int slot = mc->depth++;
+	assert(slot < MCS_NESTING);
+	struct mcs_node *node = &mc->nodes[slot];
+	node->next = NULL;
+	node->locked = 0;
+	*nodep = node;
+	return id * MCS_NESTING + slot + 1;
+}
+
+static void mcs_node_put(uint32_t code)
+{
+	struct mcs_cpu *mc = &mcs_cpus[myid()];
+	assert(code == myid() * MCS_NESTING + mc->depth);
+	mc->depth--;
+}
+
+#ifdef UCONFIG_KVM_GUEST
+static inline int mcs_node_cpu(struct mcs_node *node)
+{
+	return ((uintptr_t) node - (uintptr_t) mcs_cpus) /
+	    sizeof(struct mcs_cpu);
+}
+
+// mcs_node_halt - halt until node is handed the lock or an interrupt comes
+static void mcs_node_halt(struct mcs_node *node)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	node->halted = 1;
+	/* the release reads halted after it sets locked */
+	__sync_synchronize();
+	if (!node->locked) {
+		kvm_halt(intr_flag);
+		cli();
+	}
+	node->halted = 0;
+	local_intr_restore(intr_flag);
+}
+#endif
+
+void qspin_lock(qspinlock_t lock)
+{
+	uint64_t start = lock_stat_spin_start();
+	struct mcs_node *node;
+	uint32_t code = mcs_node_get(&node);
+	/* xchg is a full barrier, node is initialized before it is visible */
+	uint32_t prev = __sync_lock_test_and_set(&lock->tail, code);
+	if (prev) {
+		mcs_node_of(prev)->next = node;
+#ifdef UCONFIG_KVM_GUEST
+		unsigned int spins = 0;
+		while (!node->locked) {
+			if (++spins == SPIN_THRESHOLD && kvm_pv_spin) {
+				mcs_node_halt(node);
+				spins = 0;
+			}
+			nop_pause();
+		}
+#else
+		while (!node->locked)
+			nop_pause();
+#endif
+		barrier();
+	}
+	lock->holder = code;
+	lock_stat_acquired(&lock->stat, start, prev != 0,
+			   (uintptr_t) __builtin_return_address(0));
+}
+
+int qspin_trylock(qspinlock_t lock)
+{
+	struct mcs_node *node;
+	uint32_t code;
+	if (lock->tail != 0)
+		return 0;
+	code = mcs_node_get(&node);
+	if (!__sync_bool_compare_and_swap(&lock->tail, 0, code)) {
+		mcs_node_put(code);
+		return 0;
+	}
+	lock->holder = code;
+	lock_stat_acquired(&lock->stat, lock_stat_spin_start(), 0,
+			   (uintptr_t) __builtin_return_address(0));
+	return 1;
+}
+
+void qspin_unlock(qspinlock_t lock)
+{
+	uint32_t code = lock->holder;
+	struct mcs_node *node, *next;
+	assert(code != 0 && lock->tail != 0);
+	node = mcs_node_of(code);
+	lock_stat_released(&lock->stat);
+	lock->holder = 0;
+	next = node->next;
+	if (next == NULL) {
+		if (__sync_bool_compare_and_swap(&lock->tail, code, 0))
+			goto out;
+		/* a waiter swapped tail but has not linked itself in yet */
+		while ((next = node->next) == NULL)
+			nop_pause();
+	}
+	barrier();
+	next->locked = 1;
+#ifdef UCONFIG_KVM_GUEST
+	if (kvm_pv_spin) {
+		__sync_synchronize();
+		if (next->halted)
+			kvm_kick_cpu(mcs_node_cpu(next));
+	}
+#endif
+out:
+	mcs_node_put(code);
+}
+
+#ifdef UCONFIG_LOCK_STAT
+
+/* *
+ * The lock statistics. Every lock counts its own, see struct lock_stat;
+ * lock_stat_print lists those of the locks registered. The locks given a
+ * class, by lock_stat_register or lock_stat_class, are also counted by the
+ * site that took them, an address in the caller (in the caller of down(),
+ * lock_mm and the like for the sleeping locks): the site entries are made
+ * on first use in a fixed hash, keyed by the site alone, a site only ever
+ * taking locks of one class. The locks of a class are taken on many cpus
+ * at once, so the site counters are updated with atomics.
+ * */
+#define LOCK_STAT_MAX 32
+#define LOCK_STAT_SITES 512
+#define LOCK_STAT_BUFSIZE (128 * 1024)
+
+static struct lock_stat_entry {
+	const char *name;
+	int id;
+	struct lock_stat *st;
+} lock_stats[LOCK_STAT_MAX];
+static int lock_stat_count = 0;
+
+static struct lock_site {
+	volatile uintptr_t site;
+	const char *name;
+	uint64_t acquired;
+	uint64_t contended;
+	uint64_t wait_cycles;
+	uint64_t hold_cycles;
+	uint64_t max_wait;
+	uint64_t max_hold;
+} lock_sites[LOCK_STAT_SITES];
+
+/* mycpu() reads gs, which is only set up by tls_init() */
+static volatile bool lock_stat_on = 0;
+
+void lock_stat_init(void)
+{
+	lock_stat_on = 1;
+}
+
+// lock_site_get - the entry of site, made if new, NULL if the hash is full
+static struct lock_site *lock_site_get(const char *name, uintptr_t site)
+{
+	uint32_t i, h = (uint32_t) (site >> 2) * 2654435761U;
+	for (i = 0; i < LOCK_STAT_SITES; i++) {
+		struct lock_site *ls = lock_sites + (h + i) % LOCK_STAT_SITES;
+		if (ls->site == 0) {
+			__sync_bool_compare_and_swap(&(ls->site), 0, site);
+		}
+		if (ls->site == site) {
+			if (ls->name == NULL) {
+				ls->name = name;
+			}
+			return ls;
+		}
+	}
+	return NULL;
+}
+
+static inline void lock_stat_max(uint64_t * max, uint64_t val)
+{
+	uint64_t old;
+	while ((old = *(volatile uint64_t *)max) < val
+	       && !__sync_bool_compare_and_swap(max, old, val)) ;
+}
+
+static void lock_site_acquired(struct lock_stat *st, uintptr_t site,
+			       bool contended, uint64_t wait)
+{
+	struct lock_site *ls;
+	if (!lock_stat_on || (ls = lock_site_get(st->name, site)) == NULL) {
+		return;
+	}
+	__sync_fetch_and_add(&(ls->acquired), 1);
+	if (contended) {
+		__sync_fetch_and_add(&(ls->contended), 1);
+		__sync_fetch_and_add(&(ls->wait_cycles), wait);
+		lock_stat_max(&(ls->max_wait), wait);
+	}
+}
+
+void lock_stat_acquired(struct lock_stat *st, uint64_t wait_start,
+			bool contended, uintptr_t site)
+{
+	uint64_t now = rdtsc();
+	st->acquired++;
+	if (contended) {
+		st->contended++;
+		st->wait_cycles += now - wait_start;
+	}
+	st->hold_start = now;
+	st->hold_site = site;
+	st->owner = lock_stat_on ? myid() : -1;
+	if (st->name != NULL) {
+		lock_site_acquired(st, site, contended, now - wait_start);
+	}
+}
+
+// lock_stat_shared - a shared acquisition, by one of the readers holding
+//                  - the lock at once, its hold is not timed
+void lock_stat_shared(struct lock_stat *st, uint64_t wait_start,
+		      bool contended, uintptr_t site)
+{
+	uint64_t wait = rdtsc() - wait_start;
+	__sync_fetch_and_add(&(st->acquired), 1);
+	if (contended) {
+		__sync_fetch_and_add(&(st->contended), 1);
+		__sync_fetch_and_add(&(st->wait_cycles), wait);
+	}
+	if (st->name != NULL) {
+		lock_site_acquired(st, site, contended, wait);
+	}
+}
+
+void lock_stat_released(struct lock_stat *st)
+{
+	struct lock_site *ls;
+	uint64_t held = rdtsc() - st->hold_start;
+	st->hold_cycles += held;
+	if (held > st->max_hold)
+		st->max_hold = held;
+	if (st->name != NULL && lock_stat_on
+	    && (ls = lock_site_get(st->name, st->hold_site)) != NULL) {
+		__sync_fetch_and_add(&(ls->hold_cycles), held);
+		lock_stat_max(&(ls->max_hold), held);
+	}
+}
+
+// lock_stat_register - list the stats of a lock in lock_stat_print, id
+//                    - tells apart the instances of an array of locks
+void lock_stat_register(const char *name, int id, struct lock_stat *st)
+{
+	st->name = name;
+	int i = __sync_fetch_and_add(&lock_stat_count, 1);
+	if (i >= LOCK_STAT_MAX) {
+		lock_stat_count = LOCK_STAT_MAX;
+		return;
+	}
+	lock_stats[i].name = name;
+	lock_stats[i].id = id;
+	lock_stats[i].st = st;
+}
+
+// lock_stat_class - count the lock in the sites of class name, without
+//                 - listing it, for the locks made at run time
+void lock_stat_class(const char *name, struct lock_stat *st)
+{
+	st->name = name;
+}
+
+// lock_stat_reset - clear the counters of the registered locks and the sites
+void lock_stat_reset(void)
+{
+	int i;
+	for (i = 0; i < lock_stat_count; i++) {
+		struct lock_stat *st = lock_stats[i].st;
+		st->acquired = st->contended = 0;
+		st->wait_cycles = st->hold_cycles = st->max_hold = 0;
+	}
+	for (i = 0; i < LOCK_STAT_SITES; i++) {
+		struct lock_site *ls = lock_sites + i;
+		ls->acquired = ls->contended = 0;
+		ls->wait_cycles = ls->hold_cycles = 0;
+		ls->max_wait = ls->max_hold = 0;
+	}
+}
+
+// lock_stat_show - the registered locks, then the sites by class, into buf
+size_t lock_stat_show(char *buf, size_t size)
+{
+	size_t len = 0;
+	int i, j;
+	len += snprintf(buf + len, size - len,
+			"%-12s %10s %10s %14s %14s %12s %5s\n", "lock",
+			"acquired", "contended", "wait cycles", "hold cycles",
+			"max hold", "owner");
+	for (i = 0; i < lock_stat_count && len < size; i++) {
+		struct lock_stat *st = lock_stats[i].st;
+		if (st->acquired == 0)
+			continue;
+		len += snprintf(buf + len, size - len,
+				"%-9s[%2d] %10llu %10llu %14llu %14llu %12llu %5d\n",
+				lock_stats[i].name, lock_stats[i].id,
+				st->acquired, st->contended, st->wait_cycles,
+				st->hold_cycles, st->max_hold, st->owner);
+	}
+	if (len < size) {
+		len += snprintf(buf + len, size - len,
+				"\n%-12s %10s %10s %14s %14s %12s %12s %s\n",
+				"class", "acquired", "contended", "wait cycles",
+				"hold cycles", "max wait", "max hold", "site");
+	}
+	/* the sites of a class together, the class by its first site */
+	for (i = 0; i < LOCK_STAT_SITES && len < size; i++) {
+		const char *name = lock_sites[i].name;
+		if (lock_sites[i].site == 0 || name == NULL) {
+			continue;
+		}
+		for (j = 0; j < i; j++) {
+			if (lock_sites[j].name == name)
+				break;
+		}
+		if (j < i) {
+			continue;
+		}
+		for (j = i; j < LOCK_STAT_SITES && len < size; j++) {
+			struct lock_site *ls = lock_sites + j;
+			uintptr_t start;
+			const char *sym;
+			if (ls->name != name || ls->acquired == 0) {
+				continue;
+			}
+			len += snprintf(buf + len, size - len,
+					"%-12s %10llu %10llu %14llu %14llu %12llu %12llu ",
+					name, ls->acquired, ls->contended,
+					ls->wait_cycles, ls->hold_cycles,
+					ls->max_wait, ls->max_hold);
+			if (len >= size) {
+				break;
+			}
+			if ((sym = ksym_lookup(ls->site, &start)) != NULL) {
+				len += snprintf(buf + len, size - len,
+						"%s+0x%x\n", sym,
+						ls->site - start);
+			} else {
+				len += snprintf(buf + len, size - len, "%p\n",
+						ls->site);
+			}
+		}
+	}
+	return (len < size) ? len : size;
+}
+
+void lock_stat_print(void)
+{
+	size_t size = 64 * 1024, len;
+	char *buf;
+	if ((buf = kmalloc(size)) == NULL) {
+		kprintf("lockstat: no memory.\n");
+		return;
+	}
+	len = lock_stat_show(buf, size - 1);
+	buf[len] = '\0';
+	kprintf("%s", buf);
+	kfree(buf);
+}
+
+// do_lockstat - SYS_lockstat, dump the statistics into buf or clear them
+int do_lockstat(int op, char __user * buf, size_t len)
+{
+	struct mm_struct *mm = current->mm;
+	char *kbuf;
+	size_t n;
+	switch (op) {
+	case LOCKSTAT_RESET:
+		lock_stat_reset();
+		return 0;
+	case LOCKSTAT_DUMP:
+		break;
+	default:
+		return -E_INVAL;
+	}
+	if (len > LOCK_STAT_BUFSIZE) {
+		len = LOCK_STAT_BUFSIZE;
+	}
+	if (len == 0) {
+		return -E_INVAL;
+	}
+	if ((kbuf = kmalloc(len)) == NULL) {
+		return -E_NO_MEM;
+	}
+	n = lock_stat_show(kbuf, len);
+	lock_mm(mm);
+	if (!copy_to_user(mm, buf, kbuf, n)) {
+		unlock_mm(mm);
+		kfree(kbuf);
+		return -E_INVAL;
+	}
+	unlock_mm(mm);
+	kfree(kbuf);
+	return n;
+}
+
+#endif /* UCONFIG_LOCK_STAT */
@@ -5,30 +5,142 @@
 #include <assert.h>
 #include <sync.h>
 
+#ifdef UCONFIG_LOCK_STAT
+/* *
+ * lock_stat - contention statistics of one lock, in tsc cycles. Updated by
+ * the holder only, so the counters need no atomics; owner is the cpu that
+ * took the lock last (-1 before lock_stat_init). name is the class of the
+ * lock, set by lock_stat_register or lock_stat_class: the locks of a class
+ * are also counted by the call site that took them, see spinlock.c.
+ * */
+struct lock_stat {
+	uint64_t acquired;
+	uint64_t contended;
+	uint64_t wait_cycles;
+	uint64_t hold_cycles;
+	uint64_t max_hold;
+	uint64_t hold_start;
+	int owner;
+	const char *name;
+	uintptr_t hold_site;
+};
+
+void lock_stat_init(void);
+void lock_stat_acquired(struct lock_stat *st, uint64_t wait_start,
+			bool contended, uintptr_t site);
+void lock_stat_shared(struct lock_stat *st, uint64_t wait_start,
+		      bool contended, uintptr_t site);
+void lock_stat_released(struct lock_stat *st);
+void lock_stat_register(const char *name, int id, struct lock_stat *st);
+void lock_stat_class(const char *name, struct lock_stat *st);
+void lock_stat_reset(void);
+size_t lock_stat_show(char *buf, size_t size);
+void lock_stat_print(void);
+int do_lockstat(int op, char __user * buf, size_t len);
+
+static inline void lock_stat_clear(struct lock_stat *st)
+{
+	st->acquired = st->contended = 0;
+	st->wait_cycles = st->hold_cycles = st->max_hold = 0;
+	st->owner = -1;
+	st->name = NULL;
+}
+
+#define lock_stat_spin_start()		rdtsc()
+/* an address in the function taking the lock, spinlock_acquire being
+ * always inlined into it */
+#define lock_stat_this_ip()		({ __label__ __here; __here: (uintptr_t)&&__here; })
+#define LOCK_STAT_INLINE		__attribute__ ((always_inline))
+#else
+#define lock_stat_spin_start()		0
+#define lock_stat_acquired(st, start, c, site)	do { (void)(start); (void)(c); } while (0)
+#define lock_stat_released(st)		do { } while (0)
+#define lock_stat_clear(st)		do { } while (0)
+#define LOCK_STAT_INLINE
+#endif
+
+/* *
+ * spinlock_s - ticket lock. An acquirer takes the next ticket with one
+ * xadd and spins reading owner until its turn comes, so the waiters get
+ * the lock in FIFO order and only the release writes the shared line.
+ * All zero is unlocked, so { 0 } and zeroed memory stay valid initializers.
+ * */
 typedef struct spinlock_s {
-	volatile unsigned int lock;
+	volatile uint16_t owner;
+	volatile uint16_t next;
+#ifdef UCONFIG_LOCK_STAT
+	struct lock_stat stat;
+#endif
 } spinlock_s;
 
 typedef spinlock_s *spinlock_t;
 
-#define spinlock_init(x) do { (x)->lock = 0; } while (0)
+#define spinlock_init(x) do { (x)->owner = (x)->next = 0; lock_stat_clear(&(x)->stat); } while (0)
+
+#ifdef UCONFIG_KVM_GUEST
+/* *
+ * PV spinlocks under KVM: a waiter that spun SPIN_THRESHOLD times halts,
+ * the holder is likely a vcpu the host preempted, and the release kicks
+ * it when its turn comes, see kvm.c.
+ * */
+#define SPIN_THRESHOLD			(1 << 12)
+
+extern bool kvm_pv_spin;
+extern volatile int kvm_lock_nr_waiting;
+void kvm_lock_wait(spinlock_t lock, uint16_t want);
+void kvm_unlock_kick(spinlock_t lock, uint16_t owner);
+#endif
 
 
-static inline void spinlock_acquire(spinlock_t lock)
+static inline LOCK_STAT_INLINE void spinlock_acquire(spinlock_t lock)
 {
-	while(!atomic_compare_and_swap(&lock->lock, 0, 1))
+	uint64_t start = lock_stat_spin_start();
+	uint16_t ticket = __sync_fetch_and_add(&lock->next, 1);
+	bool contended = (lock->owner != ticket);
+#ifdef UCONFIG_KVM_GUEST
+	unsigned int spins = 0;
+	while (lock->owner != ticket) {
+		if (++spins == SPIN_THRESHOLD && kvm_pv_spin) {
+			kvm_lock_wait(lock, ticket);
+			spins = 0;
+		}
 		nop_pause();
+	}
+#else
+	while (lock->owner != ticket)
+		nop_pause();
+#endif
+	barrier();
+	lock_stat_acquired(&lock->stat, start, contended, lock_stat_this_ip());
 }
 
-static inline int spinlock_acquire_try(spinlock_t lock)
+static inline LOCK_STAT_INLINE int spinlock_acquire_try(spinlock_t lock)
 {
-	return atomic_compare_and_swap(&lock->lock, 0, 1);
+	uint16_t ticket = lock->owner;
+	/* next can only equal a stale owner if nobody holds the lock */
+	if (lock->next != ticket
+	    || !__sync_bool_compare_and_swap(&lock->next, ticket, ticket + 1))
+		return 0;
+	lock_stat_acquired(&lock->stat, lock_stat_spin_start(), 0,
+			   lock_stat_this_ip());
+	return 1;
 }
 
 static inline void spinlock_release(spinlock_t lock)
 {
-	assert(lock->lock != 0);
-	lock->lock = 0;
+	assert(lock->owner != lock->next);
+	lock_stat_released(&lock->stat);
+	barrier();
+#ifdef UCONFIG_KVM_GUEST
+	if (kvm_pv_spin) {
+		/* locked, kvm_lock_nr_waiting is read after owner is written */
+		uint16_t owner = __sync_add_and_fetch(&lock->owner, 1);
+		if (kvm_lock_nr_waiting != 0)
+			kvm_unlock_kick(lock, owner);
+		return;
+	}
+#endif
+	lock->owner++;
 }
 
 #define spin_lock_irqsave(lock, x)      do { x = __intr_save();spinlock_acquire(lock); } while (0)
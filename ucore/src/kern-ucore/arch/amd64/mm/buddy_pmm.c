@@ -6,28 +6,99 @@
 #include <sysconf.h>
 #include <mp.h>
 #include <spinlock.h>
+#include <qspinlock.h>
+#include <percpu.h>
 /* XXX struct page may contain race condition?? */
 
 struct numa_mem_zone;
-/* free_area_t - maintains a doubly linked list to record free (unused) pages */
+
+#ifdef UCONFIG_COMPACTION
+/* *
+ * The free blocks are grouped by mobility. Each pageblock of
+ * PAGEBLOCK_NR_PAGES pages is for the movable pages, the anonymous user
+ * memory compaction can move elsewhere, or for the others, and a free block
+ * is on the list of the type of its first pageblock. An allocation takes a
+ * block of its own type first, and else steals the largest one of the
+ * other type, claiming its pageblocks when it covers whole ones. So the
+ * kernel pages gather in few pageblocks, and the others can be emptied by
+ * moving their pages away, see compaction.c. The type is a flag of the
+ * first page of the pageblock, kept over the frees; all start movable.
+ * */
+#define MIGRATE_UNMOVABLE 0
+#define MIGRATE_MOVABLE 1
+#define MIGRATE_TYPES 2
+/* the type of a pageblock stays over the frees of its first page */
+#define PAGE_FLAGS_KEEP (1 << PG_unmovable_block)
+/* pageblocks scanned by a call of isolate_pageblock at most */
+#define ISOLATE_SCAN_BLOCKS 64
+/* fragmented: that many times the pages of the block wanted are free */
+#define FRAGMENTED_FREE_RATIO 4
+#else
+#define MIGRATE_UNMOVABLE 0
+#define MIGRATE_MOVABLE 0
+#define MIGRATE_TYPES 1
+#define PAGE_FLAGS_KEEP 0
+#endif
+
+/* free_area_t - maintains doubly linked lists to record free (unused) pages */
 typedef struct {
-	list_entry_t free_list;	// the list header
-	unsigned int nr_free;	// # of free pages in this free list
+	list_entry_t free_list[MIGRATE_TYPES];	// the list headers, by mobility
+	unsigned int nr_free;	// # of free blocks in these free lists
 	struct numa_mem_zone *zone;
 } free_area_t;
 
 // {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024}
 // from 2^0 ~ 2^10
 #define MAX_ORDER 10
-/* XXX contented lock? */
-static spinlock_s fa_lock[MAX_NUMA_NODES];
+/* every cpu of a node refills and drains its pcp here, so queue the waiters */
+static qspinlock_s fa_lock[MAX_NUMA_NODES];
 static free_area_t free_area[MAX_NUMA_NODES][MAX_ORDER + 1];
 static int buddy_numa_borrow = 1;
 
-//x from 0 ~ MAX_ORDER
-#define free_list(n,x) (free_area[n][x].free_list)
+//x from 0 ~ MAX_ORDER, mt the mobility
+#define free_list(n,x,mt) (free_area[n][x].free_list[mt])
 #define nr_free(n,x) (free_area[n][x].nr_free)
 
+/* *
+ * per_cpu_pages - single pages cached by a cpu in front of the free areas of
+ * its node, so most order-0 alloc/free never touch fa_lock. Freed pages go
+ * to the head (hot, likely still in cache), refill and drain work in batches
+ * of PCP_BATCH at the tail (cold). Only the owner touches it, with irq off;
+ * other cpus drain it by IPI.
+ * */
+#define PCP_BATCH 16
+#define PCP_HIGH (PCP_BATCH * 4)
+
+struct per_cpu_pages {
+	list_entry_t lists[MIGRATE_TYPES];
+	unsigned int count;	// over all lists
+	uint32_t numa_id;
+};
+
+static DEFINE_PERCPU_NOINIT(struct per_cpu_pages, pcp_lists);
+static bool pcp_enabled = 0;
+
+static struct Page *pcp_alloc_page(struct per_cpu_pages *pcp, int mt);
+
+#ifdef UCONFIG_PREZERO_PAGES
+/* *
+ * zero_area - single pages cleared by the idle cpus of a node, taken first
+ * by the anonymous faults. It holds at most ZERO_HIGH pages, is filled only
+ * while the node has ZERO_MIN_FREE pages free besides, and goes back to the
+ * free areas when memory runs low. Under fa_lock; its pages count as free.
+ * */
+#define ZERO_BATCH 8
+#define ZERO_HIGH 256
+#define ZERO_MIN_FREE 1024
+
+static free_area_t zero_area[MAX_NUMA_NODES];
+
+#define zero_list(n) (zero_area[n].free_list[0])
+#define nr_zero(n) (zero_area[n].nr_free)
+
+static size_t __buddy_nr_free_pages(uint32_t numa_id);
+#endif
+
 #if 0
 #define MAX_ZONE_NUM 10
 struct Zone {
@@ -39,23 +110,98 @@ NULL}};
 //buddy_init - init the free_list(0 ~ MAX_ORDER) & reset nr_free(0 ~ MAX_ORDER)
 static void buddy_init(void)
 {
-	int i, n;
+	int i, n, mt;
 	for (n = 0; n < MAX_NUMA_NODES; n++){
 		for (i = 0; i <= MAX_ORDER; i++) {
-			list_init(&free_list(n,i));
+			for (mt = 0; mt < MIGRATE_TYPES; mt++) {
+				list_init(&free_list(n,i,mt));
+			}
 			nr_free(n,i) = 0;
 		}
-		spinlock_init(&fa_lock[n]);
+		qspinlock_init(&fa_lock[n]);
+#ifdef UCONFIG_PREZERO_PAGES
+		list_init(&zero_list(n));
+		nr_zero(n) = 0;
+#endif
+#ifdef UCONFIG_LOCK_STAT
+		lock_stat_register("fa_lock", n, &fa_lock[n].stat);
+#endif
 	}
 }
 
+//page2idx - get the related index number idx of continuing page block which this page belongs to 
+static inline ppn_t page2idx(struct Page *page)
+{
+	return page - numa_mem_zones[page->zone_num].page;
+}
+
+//idx2page - get the related page according to the index number idx of continuing page block 
+static inline struct Page *idx2page(int zone_num, ppn_t idx)
+{
+	return numa_mem_zones[zone_num].page + idx;
+}
+
+#ifdef UCONFIG_COMPACTION
+//page_migratetype - the type of the pageblock of page
+static inline int page_migratetype(struct Page *page)
+{
+	ppn_t idx = page2idx(page) & ~(PAGEBLOCK_NR_PAGES - 1);
+	return PageUnmovableBlock(idx2page(page->zone_num, idx)) ?
+	    MIGRATE_UNMOVABLE : MIGRATE_MOVABLE;
+}
+
+//set_pageblocks_type - the pageblocks of the free block at page of order,
+//                    - whole ones, are for mt from now on
+static void set_pageblocks_type(struct Page *page, size_t order, int mt)
+{
+	size_t i;
+	for (i = 0; i < (1 << order); i += PAGEBLOCK_NR_PAGES) {
+		if (mt == MIGRATE_UNMOVABLE) {
+			SetPageUnmovableBlock(page + i);
+		} else {
+			ClearPageUnmovableBlock(page + i);
+		}
+	}
+}
+#else
+#define page_migratetype(page) MIGRATE_MOVABLE
+#endif
+
+//__buddy_add - page, a free block of order, goes on the list of its type
+static inline void __buddy_add(uint32_t numa_id, struct Page *page, size_t order)
+{
+	page->property = order;
+	SetPageProperty(page);
+	nr_free(numa_id, order)++;
+	list_add(&free_list(numa_id, order, page_migratetype(page)),
+		 &(page->page_link));
+}
+
+//__buddy_del - page, a free block of order, leaves its list
+static inline void __buddy_del(uint32_t numa_id, struct Page *page, size_t order)
+{
+	nr_free(numa_id, order)--;
+	list_del(&(page->page_link));
+	ClearPageProperty(page);
+#ifdef UCONFIG_VIRTIO_BALLOON
+	ClearPageReported(page);
+#endif
+}
+
+#ifdef UCONFIG_COMPACTION
+static struct numa_mem_zone *buddy_zones[MAX_NUMA_MEM_ZONES];
+#endif
+static int buddy_nr_zones = 0;
+
 //buddy_init_memmap - build free_list for Page base follow  n continuing pages.
 static void buddy_init_memmap(struct numa_mem_zone *zone)
 {
-	static int zone_num = 0;
 	size_t n = zone->n;
-	assert(n > 0 && zone_num < MAX_NUMA_MEM_ZONES);
-	zone_num ++;
+	assert(n > 0 && buddy_nr_zones < MAX_NUMA_MEM_ZONES);
+#ifdef UCONFIG_COMPACTION
+	buddy_zones[buddy_nr_zones] = zone;
+#endif
+	buddy_nr_zones ++;
 	struct Page *base = zone->page;
 	struct Page *p = base;
 	for (; p != base + n; p++) {
@@ -71,11 +217,8 @@ static void buddy_init_memmap(struct numa_mem_zone *zone)
 	assert(numa_id < sysconf.lnuma_count);
 	while (n != 0) {
 		while (n >= order_size) {
-			p->property = order;
-			SetPageProperty(p);
-			list_add(&free_list(numa_id, order), &(p->page_link));
+			__buddy_add(numa_id, p, order);
 			n -= order_size, p += order_size;
-			nr_free(numa_id, order)++;
 		}
 		order--;
 		order_size >>= 1;
@@ -95,84 +238,144 @@ static inline size_t getorder(size_t n)
 	panic("getorder failed. %d\n", n);
 }
 
-//buddy_alloc_pages_sub - the actual allocation implimentation, return a page whose size >=n,
-//                      - the remaining free parts insert to other free list
-static inline struct Page *buddy_alloc_pages_sub(uint32_t numa_id, size_t order)
+//__buddy_alloc_pages_sub - the actual allocation implimentation, return a page whose size >=n,
+//                        - the remaining free parts insert to other free list, fa_lock held
+static struct Page *__buddy_alloc_pages_sub(uint32_t numa_id, size_t order, int mt)
 {
-	assert(order <= MAX_ORDER);
 	size_t cur_order;
-
-	int intr_flag;
-	spin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	struct Page *page = NULL;
 	for (cur_order = order; cur_order <= MAX_ORDER; cur_order++) {
-		if (!list_empty(&free_list(numa_id, cur_order))) {
-			list_entry_t *le = list_next(&free_list(numa_id, cur_order));
-			struct Page *page = le2page(le, page_link);
-			nr_free(numa_id, cur_order)--;
-			list_del(le);
-			size_t size = 1 << cur_order;
-			while (cur_order > order) {
-				cur_order--;
-				size >>= 1;
-				struct Page *buddy = page + size;
-				buddy->property = cur_order;
-				SetPageProperty(buddy);
-				nr_free(numa_id, cur_order)++;
-				list_add(&free_list(numa_id, cur_order),
-					 &(buddy->page_link));
+		if (!list_empty(&free_list(numa_id, cur_order, mt))) {
+			page = le2page(list_next(&free_list(numa_id, cur_order, mt)),
+				       page_link);
+			break;
+		}
+	}
+#ifdef UCONFIG_COMPACTION
+	if (page == NULL) {
+		/* steal from the other type, the largest block first, so that
+		 * whole pageblocks change type rather than parts of many */
+		int other = MIGRATE_TYPES - 1 - mt;
+		for (cur_order = MAX_ORDER + 1; page == NULL && cur_order-- > order;) {
+			if (!list_empty(&free_list(numa_id, cur_order, other))) {
+				page = le2page(list_next(&free_list(numa_id, cur_order, other)),
+					       page_link);
 			}
-			ClearPageProperty(page);
-			spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
-			return page;
+		}
+		if (page != NULL && cur_order >= PAGEBLOCK_ORDER) {
+			set_pageblocks_type(page, cur_order, mt);
 		}
 	}
-	spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
-	return NULL;
+#endif
+	if (page == NULL) {
+		return NULL;
+	}
+	__buddy_del(numa_id, page, cur_order);
+	while (cur_order > order) {
+		cur_order--;
+		__buddy_add(numa_id, page + (1 << cur_order), cur_order);
+	}
+	return page;
+}
+
+//buddy_alloc_pages_sub - lock free_area of numa_id and alloc a 2^order block
+static inline struct Page *buddy_alloc_pages_sub(uint32_t numa_id, size_t order, int mt)
+{
+	assert(order <= MAX_ORDER);
+	struct Page *page;
+	int intr_flag;
+	qspin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	page = __buddy_alloc_pages_sub(numa_id, order, mt);
+	qspin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+	return page;
 }
 
-static struct Page *__buddy_alloc_pages_numa(uint32_t numa_id, size_t n)
+static struct Page *__buddy_alloc_pages_numa(uint32_t numa_id, size_t n, int mt)
 {
 	size_t order = getorder(n), order_size = (1 << order);
-	struct Page *page = buddy_alloc_pages_sub(numa_id, order);
+	struct Page *page = buddy_alloc_pages_sub(numa_id, order, mt);
 	if (page != NULL && n != order_size) {
 		free_pages(page + n, order_size - n);
 	}
 	return page;
 }
 
-static struct Page *buddy_alloc_pages_numa(struct numa_node *node, size_t n)
+static struct Page *buddy_alloc_pages_node(struct numa_node *node, size_t n, int mt)
 {
 	assert(n > 0 && node!=NULL);
-	return __buddy_alloc_pages_numa(node->id, n);
+	if (n == 1 && pcp_enabled) {
+		struct per_cpu_pages *pcp = get_cpu_ptr(pcp_lists);
+		if (pcp->numa_id == node->id) {
+			return pcp_alloc_page(pcp, mt);
+		}
+	}
+	return __buddy_alloc_pages_numa(node->id, n, mt);
 }
 
+static struct Page *buddy_alloc_pages_numa(struct numa_node *node, size_t n)
+{
+	return buddy_alloc_pages_node(node, n, MIGRATE_UNMOVABLE);
+}
 
-//buddy_alloc_pages - call buddy_alloc_pages_sub to alloc 2^order>=n pages
-static struct Page *buddy_alloc_pages(size_t n)
+//buddy_alloc_pages_local - alloc n pages of type mt on the node of this
+//                        - cpu, or borrow them from the nearest other one
+static struct Page *buddy_alloc_pages_local(size_t n, int mt)
 {
 	int i;
 	assert(n > 0);
-	size_t order = getorder(n), order_size = (1 << order);
 	uint32_t numa_id = 0;
 	if(mycpu()->node)
 		numa_id = mycpu()->node->id;
-	struct Page *page = __buddy_alloc_pages_numa(numa_id, n);
+	struct Page *page;
+	struct per_cpu_pages *pcp = get_cpu_ptr(pcp_lists);
+	if (n == 1 && pcp_enabled && pcp->numa_id == numa_id) {
+		page = pcp_alloc_page(pcp, mt);
+	} else {
+		page = __buddy_alloc_pages_numa(numa_id, n, mt);
+	}
 	if(page)
 		return page;
 	if(!buddy_numa_borrow)
 		return NULL;
-	for(i=0;i<sysconf.lnuma_count;i++){
-		if(i == numa_id)
-			continue;
-		page = __buddy_alloc_pages_numa(i, n);
+	/* from the nearest node first, see numa_distance_init */
+	struct numa_node *node = &numa_nodes[numa_id];
+	for(i=0;i<node->nr_fallback;i++){
+		uint32_t id = node->fallback[i];
+		page = __buddy_alloc_pages_numa(id, n, mt);
 		if(page){
-			kprintf("warning: cpu%d borrow page from node %d\n", myid(), i);
+			kprintf("warning: cpu%d borrow page from node %d\n",
+				myid(), id);
 			return page;
 		}
 	}
 	return NULL;
 }
 
+//buddy_alloc_pages - call buddy_alloc_pages_sub to alloc 2^order>=n pages
+static struct Page *buddy_alloc_pages(size_t n)
+{
+	return buddy_alloc_pages_local(n, MIGRATE_UNMOVABLE);
+}
+
+#ifdef UCONFIG_COMPACTION
+//buddy_alloc_pages_movable - alloc n pages compaction may move, on node,
+//                          - or on that of this cpu if NULL
+static struct Page *buddy_alloc_pages_movable(struct numa_node *node, size_t n)
+{
+	struct Page *page;
+	size_t i;
+	if (node != NULL) {
+		page = buddy_alloc_pages_node(node, n, MIGRATE_MOVABLE);
+	} else {
+		page = buddy_alloc_pages_local(n, MIGRATE_MOVABLE);
+	}
+	for (i = 0; page != NULL && i < n; i++) {
+		SetPageMovable(page + i);
+	}
+	return page;
+}
+#endif
+
 //page_is_buddy - Does this page belong to the No. zone_num Zone & this page
 //              -  be in the continuing page block whose size is 2^order pages?
 static inline bool page_is_buddy(struct Page *page, size_t order, int zone_num)
@@ -186,55 +389,244 @@ static inline bool page_is_buddy(struct Page *page, size_t order, int zone_num)
 	return 0;
 }
 
-//page2idx - get the related index number idx of continuing page block which this page belongs to 
-static inline ppn_t page2idx(struct Page *page)
-{
-	return page - numa_mem_zones[page->zone_num].page;
-}
-
-//idx2page - get the related page according to the index number idx of continuing page block 
-static inline struct Page *idx2page(int zone_num, ppn_t idx)
-{
-	return numa_mem_zones[zone_num].page + idx;
-}
-
-//buddy_free_pages_sub - the actual free implimentation, should consider how to 
-//                     - merge the adjacent buddy block
-static void buddy_free_pages_sub(uint32_t numa_id, struct Page *base, size_t order)
+//__buddy_free_pages_sub - the actual free implimentation, should consider how to 
+//                       - merge the adjacent buddy block, fa_lock held
+static void __buddy_free_pages_sub(uint32_t numa_id, struct Page *base, size_t order)
 {
 	ppn_t buddy_idx, page_idx = page2idx(base);
 	assert((page_idx & ((1 << order) - 1)) == 0);
 	struct Page *p = base;
 	for (; p != base + (1 << order); p++) {
 		assert(!PageReserved(p) && !PageProperty(p));
-		p->flags = 0;
+		p->flags &= PAGE_FLAGS_KEEP;
 		set_page_ref(p, 0);
 	}
 	int zone_num = base->zone_num;
-	int intr_flag;
 	while (order < MAX_ORDER) {
 		buddy_idx = page_idx ^ (1 << order);
 		struct Page *buddy = idx2page(zone_num, buddy_idx);
 		if (!page_is_buddy(buddy, order, zone_num)) {
 			break;
 		}
-		/* modify free_list, should lock first */
-		spin_lock_irqsave(&fa_lock[numa_id], intr_flag);
-		nr_free(numa_id, order)--;
-		list_del(&(buddy->page_link));
-		spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
-
-		ClearPageProperty(buddy);
+		__buddy_del(numa_id, buddy, order);
 		page_idx &= buddy_idx;
 		order++;
 	}
-	struct Page *page = idx2page(zone_num, page_idx);
-	page->property = order;
-	SetPageProperty(page);
-	spin_lock_irqsave(&fa_lock[numa_id], intr_flag);
-	nr_free(numa_id, order)++;
-	list_add(&free_list(numa_id, order), &(page->page_link));
-	spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+	__buddy_add(numa_id, idx2page(zone_num, page_idx), order);
+}
+
+//buddy_free_pages_sub - lock free_area of numa_id and free a 2^order block,
+//                     - the buddy lookup and merge must not race with others
+static void buddy_free_pages_sub(uint32_t numa_id, struct Page *base, size_t order)
+{
+	int intr_flag;
+	qspin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	__buddy_free_pages_sub(numa_id, base, order);
+	qspin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+}
+
+//pcp_refill - move a batch of single pages of type mt from the free areas
+//           - to pcp
+static void pcp_refill(struct per_cpu_pages *pcp, int mt)
+{
+	int intr_flag, i;
+	qspin_lock_irqsave(&fa_lock[pcp->numa_id], intr_flag);
+	for (i = 0; i < PCP_BATCH; i++) {
+		struct Page *page = __buddy_alloc_pages_sub(pcp->numa_id, 0, mt);
+		if (page == NULL) {
+			break;
+		}
+		list_add_before(&(pcp->lists[mt]), &(page->page_link));
+		pcp->count++;
+	}
+	qspin_unlock_irqrestore(&fa_lock[pcp->numa_id], intr_flag);
+}
+
+//pcp_drain - give back the n coldest pages of pcp to the free areas, in
+//          - turns from each list
+static void pcp_drain(struct per_cpu_pages *pcp, unsigned int n)
+{
+	int intr_flag, mt = 0;
+	qspin_lock_irqsave(&fa_lock[pcp->numa_id], intr_flag);
+	while (n > 0 && pcp->count > 0) {
+		while (list_empty(&(pcp->lists[mt]))) {
+			mt = (mt + 1) % MIGRATE_TYPES;
+		}
+		list_entry_t *le = list_prev(&(pcp->lists[mt]));
+		list_del(le);
+		pcp->count--, n--;
+		__buddy_free_pages_sub(pcp->numa_id, le2page(le, page_link), 0);
+		mt = (mt + 1) % MIGRATE_TYPES;
+	}
+	qspin_unlock_irqrestore(&fa_lock[pcp->numa_id], intr_flag);
+}
+
+static struct Page *pcp_alloc_page(struct per_cpu_pages *pcp, int mt)
+{
+	if (list_empty(&(pcp->lists[mt]))) {
+		pcp_refill(pcp, mt);
+		if (list_empty(&(pcp->lists[mt]))) {
+			return NULL;
+		}
+	}
+	list_entry_t *le = list_next(&(pcp->lists[mt]));
+	list_del(le);
+	pcp->count--;
+	return le2page(le, page_link);
+}
+
+static void pcp_free_page(struct per_cpu_pages *pcp, struct Page *page)
+{
+	assert(!PageReserved(page) && !PageProperty(page));
+	page->flags &= PAGE_FLAGS_KEEP;
+	set_page_ref(page, 0);
+	list_add(&(pcp->lists[page_migratetype(page)]), &(page->page_link));
+	if (++pcp->count >= PCP_HIGH) {
+		pcp_drain(pcp, PCP_BATCH);
+	}
+}
+
+//pcp_nr_free_pages - # of pages of numa_id sitting in the pcp lists
+static size_t pcp_nr_free_pages(uint32_t numa_id)
+{
+	size_t ret = 0;
+	int i;
+	if (pcp_enabled) {
+		for (i = 0; i < sysconf.lcpu_count; i++) {
+			struct per_cpu_pages *pcp = per_cpu_ptr(pcp_lists, i);
+			if (pcp->numa_id == numa_id) {
+				ret += pcp->count;
+			}
+		}
+	}
+	return ret;
+}
+
+//buddy_init_percpu - set up the pcp lists of every cpu, after the boot checks
+static void buddy_init_percpu(void)
+{
+	int i, mt;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct per_cpu_pages *pcp = per_cpu_ptr(pcp_lists, i);
+		struct cpu *c = per_cpu_ptr(cpus, i);
+		for (mt = 0; mt < MIGRATE_TYPES; mt++) {
+			list_init(&(pcp->lists[mt]));
+		}
+		pcp->count = 0;
+		pcp->numa_id = c->node ? c->node->id : 0;
+	}
+	pcp_enabled = 1;
+}
+
+static void pcp_drain_local(void)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		struct per_cpu_pages *pcp = get_cpu_ptr(pcp_lists);
+		pcp_drain(pcp, pcp->count);
+	}
+	local_intr_restore(intr_flag);
+}
+
+#ifdef UCONFIG_ENABLE_IPI
+static void pcp_drain_ipi(struct ipi_call *call)
+{
+	pcp_drain_local();
+}
+#endif
+
+#ifdef UCONFIG_PREZERO_PAGES
+//buddy_alloc_zeroed_page - a page of the zero pool of numa_id, NULL if empty
+static struct Page *buddy_alloc_zeroed_page(uint32_t numa_id)
+{
+	struct Page *page = NULL;
+	int intr_flag;
+	assert(numa_id < sysconf.lnuma_count);
+	qspin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	if (nr_zero(numa_id) != 0) {
+		list_entry_t *le = list_next(&zero_list(numa_id));
+		list_del(le);
+		nr_zero(numa_id)--;
+		page = le2page(le, page_link);
+#ifdef UCONFIG_COMPACTION
+		/* the pool is for the anonymous faults */
+		SetPageMovable(page);
+#endif
+	}
+	qspin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+	return page;
+}
+
+//buddy_prezero_pages - clear up to ZERO_BATCH free pages of the node of this
+//                    - cpu into its zero pool; the clearing is done unlocked
+static int buddy_prezero_pages(void)
+{
+	uint32_t numa_id = mycpu()->node ? mycpu()->node->id : 0;
+	int n = 0, intr_flag;
+	if (!pcp_enabled) {
+		return 0;
+	}
+	while (n < ZERO_BATCH && nr_zero(numa_id) < ZERO_HIGH
+	       && __buddy_nr_free_pages(numa_id) > ZERO_MIN_FREE) {
+		struct Page *page = buddy_alloc_pages_sub(numa_id, 0, MIGRATE_MOVABLE);
+		if (page == NULL) {
+			break;
+		}
+		clear_page(page2kva(page));
+		qspin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+		list_add_before(&zero_list(numa_id), &(page->page_link));
+		nr_zero(numa_id)++;
+		qspin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+		n++;
+	}
+	return n;
+}
+
+//zero_drain - give back the zero pools of all nodes to the free areas
+static void zero_drain(void)
+{
+	int intr_flag;
+	uint32_t n;
+	for (n = 0; n < sysconf.lnuma_count; n++) {
+		qspin_lock_irqsave(&fa_lock[n], intr_flag);
+		while (nr_zero(n) != 0) {
+			list_entry_t *le = list_next(&zero_list(n));
+			list_del(le);
+			nr_zero(n)--;
+			__buddy_free_pages_sub(n, le2page(le, page_link), 0);
+		}
+		qspin_unlock_irqrestore(&fa_lock[n], intr_flag);
+	}
+}
+#endif
+
+//buddy_drain_pages - give back the pages of all pcp lists, when memory runs low.
+//                  - remote lists are drained by their owners over IPI, which
+//                  - needs irq on here; otherwise only the local list goes
+static void buddy_drain_pages(void)
+{
+#ifdef UCONFIG_PREZERO_PAGES
+	zero_drain();
+#endif
+	if (!pcp_enabled) {
+		return;
+	}
+#ifdef UCONFIG_ENABLE_IPI
+	if (read_rflags() & FL_IF) {
+		cpuset_t cs;
+		int i;
+		memset(&cs, 0, sizeof(cs));
+		for (i = 0; i < sysconf.lcpu_count; i++) {
+			if (per_cpu_ptr(pcp_lists, i)->count != 0) {
+				cpuset_set(&cs, i);
+			}
+		}
+		ipi_run_on_cpu(&cs, NULL, pcp_drain_ipi);
+		return;
+	}
+#endif
+	pcp_drain_local();
 }
 
 //buddy_free_pages - call buddy_free_pages_sub to free n continuing page block
@@ -243,6 +635,13 @@ static void buddy_free_pages(struct Page *base, size_t n)
 	assert(n > 0);
 	uint32_t numa_id = numa_mem_zones[base->zone_num].node->id;
 	assert(numa_id < sysconf.lnuma_count);
+	if (n == 1 && pcp_enabled) {
+		struct per_cpu_pages *pcp = get_cpu_ptr(pcp_lists);
+		if (pcp->numa_id == numa_id) {
+			pcp_free_page(pcp, base);
+			return;
+		}
+	}
 	if (n == 1) {
 		buddy_free_pages_sub(numa_id, base, 0);
 	} else {
@@ -274,17 +673,27 @@ static size_t __buddy_nr_free_pages(uint32_t numa_id)
 {
 	size_t ret = 0, order = 0;
 	int intr_flag;
-	spin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	qspin_lock_irqsave(&fa_lock[numa_id], intr_flag);
 	for (; order <= MAX_ORDER; order++) {
 		ret += nr_free(numa_id, order) * (1 << order);
 	}
-	spin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+	qspin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
 	return ret;
 }
 
+//buddy_nr_cached_pages - # of free pages of numa_id out of the free areas
+static size_t buddy_nr_cached_pages(uint32_t numa_id)
+{
+#ifdef UCONFIG_PREZERO_PAGES
+	return pcp_nr_free_pages(numa_id) + nr_zero(numa_id);
+#else
+	return pcp_nr_free_pages(numa_id);
+#endif
+}
+
 static size_t buddy_nr_free_pages_numa(struct numa_node* node){
 	assert(node != NULL);
-	return __buddy_nr_free_pages(node->id);
+	return __buddy_nr_free_pages(node->id) + buddy_nr_cached_pages(node->id);
 }
 
 static size_t buddy_nr_free_pages()
@@ -292,10 +701,193 @@ static size_t buddy_nr_free_pages()
 	int i;
 	size_t s = 0;
 	for(i=0;i<sysconf.lnuma_count;i++)
-		s += __buddy_nr_free_pages(i);
+		s += __buddy_nr_free_pages(i) + buddy_nr_cached_pages(i);
 	return s;
 }
 
+//buddy_free_area_stat - nr_free of each order of numa_id, up to n orders
+static int buddy_free_area_stat(uint32_t numa_id, size_t *nr, int n)
+{
+	int order, intr_flag;
+	qspin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	for (order = 0; order <= MAX_ORDER && order < n; order++) {
+		nr[order] = nr_free(numa_id, order);
+	}
+	qspin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+	return order;
+}
+
+#ifdef UCONFIG_COMPACTION
+/* the next pageblock isolate_pageblock looks at, per node */
+static struct {
+	int zone;
+	ppn_t idx;
+} isolate_cursor[MAX_NUMA_NODES];
+
+//__pageblock_isolate - take the free blocks of the pageblock at head off
+//                    - the free lists onto isolated, if it is movable, used
+//                    - by movable pages only and at least a quarter free;
+//                    - fa_lock held
+static bool __pageblock_isolate(uint32_t numa_id, struct Page *head,
+				list_entry_t * isolated)
+{
+	size_t i, nr = 0;
+	if (PageUnmovableBlock(head)) {
+		return 0;
+	}
+	for (i = 0; i < PAGEBLOCK_NR_PAGES;) {
+		struct Page *p = head + i;
+		if (PageProperty(p)) {
+			nr += (1 << p->property);
+			i += (1 << p->property);
+		} else if (PageMovable(p) && !PageReserved(p)) {
+			i++;
+		} else {
+			return 0;
+		}
+	}
+	if (nr >= PAGEBLOCK_NR_PAGES || nr < PAGEBLOCK_NR_PAGES / 4) {
+		return 0;
+	}
+	for (i = 0; i < PAGEBLOCK_NR_PAGES;) {
+		struct Page *p = head + i;
+		if (PageProperty(p)) {
+			/* property stays, putback frees it as a block of it */
+			i += (1 << p->property);
+			__buddy_del(numa_id, p, p->property);
+			list_add_before(isolated, &(p->page_link));
+		} else {
+			i++;
+		}
+	}
+	return 1;
+}
+
+//buddy_isolate_pageblock - isolate the next pageblock of numa_id worth
+//                        - compacting, and return its first page; NULL if
+//                        - none of the ISOLATE_SCAN_BLOCKS looked at is
+static struct Page *buddy_isolate_pageblock(uint32_t numa_id,
+					    list_entry_t * isolated)
+{
+	int scanned, intr_flag;
+	bool ok;
+	for (scanned = 0; scanned < ISOLATE_SCAN_BLOCKS; scanned++) {
+		if (isolate_cursor[numa_id].zone >= buddy_nr_zones) {
+			isolate_cursor[numa_id].zone = 0;
+			isolate_cursor[numa_id].idx = 0;
+		}
+		struct numa_mem_zone *zone = buddy_zones[isolate_cursor[numa_id].zone];
+		ppn_t idx = isolate_cursor[numa_id].idx;
+		if (zone->node->id != numa_id || idx + PAGEBLOCK_NR_PAGES > zone->n) {
+			isolate_cursor[numa_id].zone++;
+			isolate_cursor[numa_id].idx = 0;
+			continue;
+		}
+		isolate_cursor[numa_id].idx += PAGEBLOCK_NR_PAGES;
+		qspin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+		ok = __pageblock_isolate(numa_id, zone->page + idx, isolated);
+		qspin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+		if (ok) {
+			return zone->page + idx;
+		}
+	}
+	return NULL;
+}
+
+//buddy_putback_pages - free the pages on isolated, each the first of a
+//                    - block of its property order
+static void buddy_putback_pages(list_entry_t * isolated)
+{
+	list_entry_t *le;
+	int intr_flag;
+	while ((le = list_next(isolated)) != isolated) {
+		struct Page *page = le2page(le, page_link);
+		uint32_t numa_id = numa_mem_zones[page->zone_num].node->id;
+		list_del(le);
+		qspin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+		__buddy_free_pages_sub(numa_id, page, page->property);
+		qspin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+	}
+}
+
+//buddy_fragmented - numa_id has no free block of order or more, while
+//                 - the pages for one are free many times over
+static bool buddy_fragmented(uint32_t numa_id, size_t order)
+{
+	size_t o;
+	int intr_flag;
+	qspin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	for (o = order; o <= MAX_ORDER && nr_free(numa_id, o) == 0; o++) ;
+	qspin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+	return o > MAX_ORDER && __buddy_nr_free_pages(numa_id) >=
+	    (FRAGMENTED_FREE_RATIO << order);
+}
+#endif
+
+#ifdef UCONFIG_VIRTIO_BALLOON
+/* *
+ * Free page reporting. The blocks the host was told are free go to the
+ * tail of their lists with PG_reported set, so the allocations take the
+ * others first, and those still to report are found at the heads. A block
+ * is no longer reported once it leaves its list, allocated or merged.
+ * */
+
+/* at most that part of the free pages of a node is off the lists at once */
+#define REPORT_FREE_RATIO 4
+
+//buddy_isolate_unreported - take up to max free blocks of numa_id of order
+//                         - or more not reported yet onto isolated, the
+//                         - largest first; # taken
+static int buddy_isolate_unreported(uint32_t numa_id, size_t order,
+				    list_entry_t * isolated, int max)
+{
+	size_t o, budget = __buddy_nr_free_pages(numa_id) / REPORT_FREE_RATIO;
+	int mt, n = 0, intr_flag;
+	qspin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+	for (o = MAX_ORDER + 1; o-- > order && n < max;) {
+		for (mt = 0; mt < MIGRATE_TYPES && n < max; mt++) {
+			list_entry_t *list = &free_list(numa_id, o, mt), *le;
+			while (n < max && budget >= (1 << o)
+			       && (le = list_next(list)) != list) {
+				struct Page *p = le2page(le, page_link);
+				if (PageReported(p)) {
+					break;
+				}
+				/* property stays, putback frees it by it */
+				__buddy_del(numa_id, p, o);
+				list_add_before(isolated, &(p->page_link));
+				budget -= (1 << o), n++;
+			}
+		}
+	}
+	qspin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+	return n;
+}
+
+//buddy_putback_reported - free the blocks on isolated; those that merge
+//                       - with no other go to the tail, reported
+static void buddy_putback_reported(list_entry_t * isolated)
+{
+	list_entry_t *le;
+	int intr_flag;
+	while ((le = list_next(isolated)) != isolated) {
+		struct Page *page = le2page(le, page_link);
+		uint32_t numa_id = numa_mem_zones[page->zone_num].node->id;
+		size_t order = page->property;
+		list_del(le);
+		qspin_lock_irqsave(&fa_lock[numa_id], intr_flag);
+		__buddy_free_pages_sub(numa_id, page, order);
+		if (PageProperty(page) && page->property == order) {
+			list_del(le);
+			list_add_before(&free_list(numa_id, order,
+						   page_migratetype(page)), le);
+			SetPageReported(page);
+		}
+		qspin_unlock_irqrestore(&fa_lock[numa_id], intr_flag);
+	}
+}
+#endif
+
 static void buddy_check_numa(void)
 {
 
@@ -308,14 +900,16 @@ static void buddy_check(void)
 	uint32_t numa_id = 0;
 	int can_borrow = buddy_numa_borrow;
 	buddy_numa_borrow = 0;
-	int i;
+	int i, mt;
 	int count = 0, total = 0;
 	for (i = 0; i <= MAX_ORDER; i++) {
-		list_entry_t *list = &free_list(numa_id, i), *le = list;
-		while ((le = list_next(le)) != list) {
-			struct Page *p = le2page(le, page_link);
-			assert(PageProperty(p) && p->property == i);
-			count++, total += (1 << i);
+		for (mt = 0; mt < MIGRATE_TYPES; mt++) {
+			list_entry_t *list = &free_list(numa_id, i, mt), *le = list;
+			while ((le = list_next(le)) != list) {
+				struct Page *p = le2page(le, page_link);
+				assert(PageProperty(p) && p->property == i);
+				count++, total += (1 << i);
+			}
 		}
 	}
 	assert(total == nr_free_pages());
@@ -326,14 +920,14 @@ static void buddy_check(void)
 	assert((page2idx(p0) & 7) == 0);
 	assert(!PageProperty(p0));
 
-	list_entry_t free_lists_store[MAX_ORDER + 1];
-	unsigned int nr_free_store[MAX_ORDER + 1];
+	free_area_t free_area_store[MAX_ORDER + 1];
 
 	for (i = 0; i <= MAX_ORDER; i++) {
-		free_lists_store[i] = free_list(numa_id, i);
-		list_init(&free_list(numa_id, i));
-		assert(list_empty(&free_list(numa_id, i)));
-		nr_free_store[i] = nr_free(numa_id, i);
+		free_area_store[i] = free_area[numa_id][i];
+		for (mt = 0; mt < MIGRATE_TYPES; mt++) {
+			list_init(&free_list(numa_id, i, mt));
+			assert(list_empty(&free_list(numa_id, i, mt)));
+		}
 		nr_free(numa_id, i) = 0;
 	}
 
@@ -371,8 +965,7 @@ static void buddy_check(void)
 	assert(alloc_page() == NULL && nr_free_pages() == 0);
 
 	for (i = 0; i <= MAX_ORDER; i++) {
-		free_list(numa_id, i) = free_lists_store[i];
-		nr_free(numa_id, i) = nr_free_store[i];
+		free_area[numa_id][i] = free_area_store[i];
 	}
 
 	free_pages(p0, 8);
@@ -381,11 +974,13 @@ static void buddy_check(void)
 	assert(total == nr_free_pages());
 
 	for (i = 0; i <= MAX_ORDER; i++) {
-		list_entry_t *list = &free_list(numa_id, i), *le = list;
-		while ((le = list_next(le)) != list) {
-			struct Page *p = le2page(le, page_link);
-			assert(PageProperty(p) && p->property == i);
-			count--, total -= (1 << i);
+		for (mt = 0; mt < MIGRATE_TYPES; mt++) {
+			list_entry_t *list = &free_list(numa_id, i, mt), *le = list;
+			while ((le = list_next(le)) != list) {
+				struct Page *p = le2page(le, page_link);
+				assert(PageProperty(p) && p->property == i);
+				count--, total -= (1 << i);
+			}
 		}
 	}
 	assert(count == 0);
@@ -405,5 +1000,22 @@ const struct pmm_manager buddy_pmm_manager = {
 	.nr_free_pages = buddy_nr_free_pages,
 	.nr_free_pages_numa = buddy_nr_free_pages_numa,
 	.check = buddy_check,
+	.init_percpu = buddy_init_percpu,
+	.drain_pages = buddy_drain_pages,
+#ifdef UCONFIG_PREZERO_PAGES
+	.alloc_zeroed_page = buddy_alloc_zeroed_page,
+	.prezero_pages = buddy_prezero_pages,
+#endif
+#ifdef UCONFIG_COMPACTION
+	.alloc_pages_movable = buddy_alloc_pages_movable,
+	.isolate_pageblock = buddy_isolate_pageblock,
+	.putback_pages = buddy_putback_pages,
+	.fragmented = buddy_fragmented,
+#endif
+#ifdef UCONFIG_VIRTIO_BALLOON
+	.isolate_unreported = buddy_isolate_unreported,
+	.putback_reported = buddy_putback_reported,
+#endif
+	.free_area_stat = buddy_free_area_stat,
 };
 
@@ -3,29 +3,32 @@
 
 /* This file contains the definitions for memory management in our OS. */
 
-/* global segment number */
+/* *
+ * global segment number: syscall and sysret take the kernel cs and ss, and
+ * the user ss and cs, from two adjacent pairs, see syscall_init. The tss
+ * descriptor is 16 bytes, two entries.
+ * */
 #define SEG_KTEXT   1
 #define SEG_KDATA   2
-//#define SEG_KPLS    3
-#define SEG_UTEXT   3
-#define SEG_UDATA   4
-//#define SEG_TLS1    6
-//#define SEG_TLS2    7
+#define SEG_UDATA   3
+#define SEG_UTEXT   4
 #define SEG_TSS     5
-#define SEG_COUNT  (SEG_TSS+1)
+#define SEG_COUNT  (SEG_TSS+2)
 
 /* global descrptor numbers */
-#define GD_KTEXT    ((SEG_KTEXT) << 4)	// kernel text
-#define GD_KDATA    ((SEG_KDATA) << 4)	// kernel data
-#define GD_UTEXT    ((SEG_UTEXT) << 4)	// user text
-#define GD_UDATA    ((SEG_UDATA) << 4)	// user data
-//#define GD_TLS1     ((SEG_TLS1) << 4)
-//#define GD_TLS2     ((SEG_TLS2) << 4)
-#define GD_TSS      ((SEG_TSS) << 4)	// task segment selector
+#define GD_KTEXT    ((SEG_KTEXT) << 3)	// kernel text
+#define GD_KDATA    ((SEG_KDATA) << 3)	// kernel data
+#define GD_UDATA    ((SEG_UDATA) << 3)	// user data
+#define GD_UTEXT    ((SEG_UTEXT) << 3)	// user text
+#define GD_TSS      ((SEG_TSS) << 3)	// task segment selector
 
 #define DPL_KERNEL  (0)
 #define DPL_USER    (3)
 
+/* offsets in struct syscall_area, for the syscall entry */
+#define SYSAREA_KSTACK      0x08
+#define SYSAREA_USER_RSP    0x10
+
 #define KERNEL_CS   ((GD_KTEXT) | DPL_KERNEL)
 #define KERNEL_DS   ((GD_KDATA) | DPL_KERNEL)
 #define USER_CS     ((GD_UTEXT) | DPL_USER)
@@ -42,10 +45,10 @@
  *                            +---------------------------------+ 0xFFFFD08000000000
  *                            |   Cur. Page Table (Kern, RW)    | RW/-- PUSIZE
  *     VPT -----------------> +---------------------------------+ 0xFFFFD00000000000
- *                            |                                 |
- *                            |  Linear Mapping of Physical Mem | RW/-- PHYSSIZE
- *                            |                                 |
- *     KERNTOP, PHYSBASE ---> +---------------------------------+ 0xFFFF900000000000
+ *                            |        Invalid Memory (*)       | --/--
+ *     VMALLOC_END ---------> +---------------------------------+ 0xFFFFC08000000000
+ *                            |     vmalloc Area (Kern, RW)     | RW/-- PUSIZE
+ *     KERNTOP, VMALLOC_START +---------------------------------+ 0xFFFFC00000000000
  *                            |                                 |
  *                            |    Remapped Physical Memory     | RW/-- KMEMSIZE
  *                            |                                 |
@@ -66,6 +69,14 @@
 #define KMEMSIZE         0x0000400000000000	// the maximum amount of physical memory
 #define KERNTOP          (KERNBASE + KMEMSIZE)
 
+/* *
+ * The pages of vmalloc, not contiguous, are mapped one by one above the
+ * physical memory. The region lies under a single pgd entry, whose pud is
+ * made at boot and so shared by every page table copied from boot_pgdir.
+ * */
+#define VMALLOC_START       KERNTOP
+#define VMALLOC_END         (VMALLOC_START + PUSIZE)
+
 /* *
  * * Virtual page table. Entry PGX[VPT] in the PGD (Page Global Directory) contains
  * a pointer to the page directory itself, thereby turning the PGD into a page
@@ -91,7 +102,12 @@
 	(USERBASE <= (start) && (start) < (end) && (end) <= USERTOP)
 
 #define KERN_ACCESS(start, end)						\
-	(PBASE <= (start) && (start) < (end) && (end) <= KERNTOP)
+	(PBASE <= (start) && (start) < (end)				\
+	 && ((end) <= KERNTOP						\
+	     || (VMALLOC_START <= (start) && (end) <= VMALLOC_END)))
+
+/* copy_to_user and copy_from_user survive their faults, see vmm.c */
+#define __HAVE_ARCH_UACCESS_FIXUP
 
 #ifndef __ASSEMBLER__
 
@@ -119,6 +135,8 @@ struct e820map {
  * physical page. In kern/mm/pmm.h, you can find lots of useful functions
  * that convert Page to other data types, such as phyical address.
  * */
+struct mem_group;
+
 struct Page {
 	uintptr_t pa;
 	atomic_t ref;		// page frame's reference counter
@@ -128,6 +146,13 @@ struct Page {
 	list_entry_t page_link;	// free list link
 	swap_entry_t index;	// stores a swapped-out page identifier
 	list_entry_t swap_link;	// swap hash link
+#ifdef UCONFIG_SWAP
+	struct anon_vma *anon_vma;	// where it may be mapped, while in the swap cache, see rmap.c
+	uintptr_t anon_index;	// its address there, or offset in the shmem
+#endif
+#ifdef UCONFIG_MEMCG
+	struct mem_group *memcg;	// the group it is charged to, see memcg.c
+#endif
 };
 
 /* Flags describing the status of a page frame */
@@ -138,6 +163,12 @@ struct Page {
 #define PG_swap                     4	// the page is in the active or inactive page list (and swap hash table)
 #define PG_active                   5	// the page is in the active page list
 #define PG_IO                       6	// dma page, never free in unmap_page
+#define PG_lazyfree                 7	// MADV_FREE: reclaim drops it if its pte is clean
+#define PG_age                      8	// and 9: the idle scans reclaim waits for, see swap.c
+#define PG_memcg                    10	// page->memcg is charged
+#define PG_movable                  11	// user memory compaction may move, see compaction.c
+#define PG_unmovable_block          12	// on the first page of a pageblock: it is for unmovable pages
+#define PG_reported                 13	// a free block the host was told of, see virtio_balloon.c
 
 #define SetPageReserved(page)       set_bit(PG_reserved, &((page)->flags))
 #define ClearPageReserved(page)     clear_bit(PG_reserved, &((page)->flags))
@@ -160,6 +191,21 @@ struct Page {
 #define SetPageIO(page)             set_bit(PG_IO, &((page)->flags))
 #define ClearPageIO(page)           clear_bit(PG_IO, &((page)->flags))
 #define PageIO(page)                test_bit(PG_IO, &((page)->flags))
+#define SetPageLazyFree(page)       set_bit(PG_lazyfree, &((page)->flags))
+#define ClearPageLazyFree(page)     clear_bit(PG_lazyfree, &((page)->flags))
+#define PageLazyFree(page)          test_bit(PG_lazyfree, &((page)->flags))
+#define SetPageMemcg(page)          set_bit(PG_memcg, &((page)->flags))
+#define ClearPageMemcg(page)        clear_bit(PG_memcg, &((page)->flags))
+#define PageMemcg(page)             test_bit(PG_memcg, &((page)->flags))
+#define SetPageMovable(page)        set_bit(PG_movable, &((page)->flags))
+#define ClearPageMovable(page)      clear_bit(PG_movable, &((page)->flags))
+#define PageMovable(page)           test_bit(PG_movable, &((page)->flags))
+#define SetPageUnmovableBlock(page) set_bit(PG_unmovable_block, &((page)->flags))
+#define ClearPageUnmovableBlock(page) clear_bit(PG_unmovable_block, &((page)->flags))
+#define PageUnmovableBlock(page)    test_bit(PG_unmovable_block, &((page)->flags))
+#define SetPageReported(page)       set_bit(PG_reported, &((page)->flags))
+#define ClearPageReported(page)     clear_bit(PG_reported, &((page)->flags))
+#define PageReported(page)          test_bit(PG_reported, &((page)->flags))
 
 // convert list entry to page
 #define le2page(le, member)                 \
@@ -49,17 +49,15 @@
 #ifdef __ASSEMBLER__
 
 #define SEG_NULL()                              \
-    .quad 0x0, 0x0
+    .quad 0x0
 
 #define SEG_CODE(type)                          \
     .word 0x0, 0x0;                             \
-    .byte 0x0, (0x90 | (type)), 0x20, 0x0;      \
-    .word 0x0, 0x0, 0x0, 0x0
+    .byte 0x0, (0x90 | (type)), 0x20, 0x0
 
 #define SEG_DATA(type)                          \
     .word 0x0, 0x0;                             \
-    .byte 0x0, (0x90 | (type)), 0x0, 0x0;       \
-    .word 0x0, 0x0, 0x0, 0x0
+    .byte 0x0, (0x90 | (type)), 0x0, 0x0
 
 #else /* not __ASSEMBLER__ */
 
@@ -119,7 +117,7 @@ struct gatedesc {
         (gate).gd_rsv2 = 0;                                 \
     }
 
-/* segment descriptors */
+/* segment descriptors, a system descriptor takes two of them */
 struct segdesc {
 	unsigned int sd_lim_15_0:16;	// [0 ~ 15] bits of segment limit
 	unsigned int sd_base_15_0:16;	// [0 ~ 15] bits of segment base address
@@ -134,26 +132,31 @@ struct segdesc {
 	unsigned int sd_db:1;	// 0 = 16-bit segment, 1 = 32-bit segment
 	unsigned int sd_g:1;	// granularity: limit scaled by 4K when set
 	unsigned int sd_base_31_24:8;	// [24 ~ 31] bits of segment base address
-	unsigned int sd_base_63_32:32;	// [32 ~ 63] bits of segment base address
-	unsigned int sd_rsv:32;	// reserved
 };
 
 #define SEG_NULL                                            \
-    (struct segdesc) {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+    (struct segdesc) {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
 
 #define SEG(type, dpl)                                      \
     (struct segdesc) {                                      \
         0, 0, 0, type, 1, dpl, 1,                           \
-        0, 0, 1, 0, 1, 0, 0, 0                              \
+        0, 0, 1, 0, 1, 0                                    \
     }
 
+/* the low entry of a tss descriptor */
 #define SEGTSS(type, base, lim, dpl)                        \
     (struct segdesc) {                                      \
         (lim) & 0xffff, (base) & 0xffff,                    \
         ((base) >> 16) & 0xff, type, 0, dpl, 1,             \
         ((lim) >> 16) & 0xf, 0, 0, 0, 0,                    \
-        ((base) >> 24) & 0xff,                              \
-        ((base) >> 32) & 0xffffffff, 0                      \
+        ((base) >> 24) & 0xff                               \
+    }
+
+/* the high entry: [32 ~ 63] bits of the base, the rest reserved */
+#define SEGTSS_HIGH(base)                                   \
+    (struct segdesc) {                                      \
+        ((base) >> 32) & 0xffff, ((base) >> 48) & 0xffff,   \
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0                     \
     }
 
 /* task state segment format (as described by the x86_64 architecture book) */
@@ -229,6 +232,9 @@ struct taskstate {
 #define PMSIZE         (1LLU * NPGENTRY * PTSIZE)	// bytes mapped by a pud entry
 #define PUSIZE         (1LLU * NPGENTRY * PMSIZE)	// bytes mapped by a pgd entry
 
+#define HPAGE_SIZE      PTSIZE	// bytes mapped by a huge (PTE_PS) pmd entry
+#define HPAGE_NR_PAGES  NPGENTRY	// # of pages in a huge page
+
 #define PTXSHIFT        12	// offset of PTX in a linear address
 #define PMXSHIFT        21	// offset of PMX in a linear address
 #define PUXSHIFT        30	// offset of PUX in a linear address
@@ -243,6 +249,7 @@ struct taskstate {
 #define PTE_A           0x020	// Accessed
 #define PTE_D           0x040	// Dirty
 #define PTE_PS          0x080	// Page Size
+#define PTE_G           0x100	// Global, kept in the TLB across cr3 loads
 #define PTE_MBZ         0x180	// Bits must be zero
 #define PTE_AVAIL       0xE00	// Available for software use
 							// The PTE_AVAIL bits aren't used by the kernel or interpreted by the
@@ -264,6 +271,11 @@ struct taskstate {
 #define CR0_CD          0x40000000	// Cache Disable
 #define CR0_PG          0x80000000	// Paging
 
+#define CR4_OSXSAVE     0x00040000	// XSAVE and Processor Extended States Enable
+#define CR4_PCIDE       0x00020000	// Process-Context Identifiers Enable
+#define CR4_FSGSBASE    0x00010000	// RDFSBASE/WRFSBASE and friends Enable
+#define CR4_OSXMMEXCPT  0x00000400	// Unmasked SIMD Floating-Point Exceptions
+#define CR4_OSFXSR      0x00000200	// FXSAVE/FXRSTOR and SSE Enable
 #define CR4_PCE         0x00000100	// Performance counter enable
 #define CR4_PGE         0x00000080	// Page Global Enable
 #define CR4_MCE         0x00000040	// Machine Check Enable
@@ -274,6 +286,10 @@ struct taskstate {
 #define CR4_PVI         0x00000002	// Protected-Mode Virtual Interrupts
 #define CR4_VME         0x00000001	// V86 Mode Extensions
 
+/* CR3 fields with CR4_PCIDE set */
+#define CR3_PCID_MASK   0x0000000000000FFFULL	// PCID of the loaded page table
+#define CR3_NOFLUSH     0x8000000000000000ULL	// keep the entries tagged with the PCID
+
 #ifndef __ASSEMBLER__
 
 typedef uintptr_t pgd_t;
@@ -303,6 +319,18 @@ static inline int ptep_present(pte_t * ptep)
 	return (*ptep & PTE_P);
 }
 
+static inline int pmd_huge(pmd_t * pmdp)
+{
+	return (*pmdp & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS);
+}
+
+// pmd_shared - whether the pte page of pmdp is shared by the mms forked
+//            - from one another, whose writes its clear write bit stops
+static inline int pmd_shared(pmd_t * pmdp)
+{
+	return (*pmdp & (PTE_P | PTE_PS | PTE_W)) == PTE_P;
+}
+
 static inline int ptep_s_read(pte_t * ptep)
 {
 	return (*ptep & PTE_P);
@@ -10,10 +10,19 @@
 #include <slab.h>
 #include <error.h>
 #include <proc.h>
+#include <swap.h>
 #include <kio.h>
 #include <mp.h>
+#include <percpu_counter.h>
 #include <sysconf.h>
 #include <ramdisk.h>
+#include <vmm.h>
+#include <hugepage.h>
+#include <memcg.h>
+#include <fpu.h>
+#include <cpuid.h>
+#include <compaction.h>
+#include <shrinker.h>
 
 /* *
  * Task State Segment:
@@ -52,23 +61,19 @@ pgd_t *const vgd = (pgd_t *) PGADDR(PGX(VPT), PGX(VPT), PGX(VPT), PGX(VPT), 0);
  * the %ss register, the CPL must equal the DPL. Thus, we must duplicate the
  * segments for the user and the kernel. Defined as follows:
  *   - 0x0 :  unused (always faults -- for trapping NULL far pointers)
- *   - 0x10:  kernel code segment
- *   - 0x20:  kernel data segment
- *   - 0x30:  kernel pls segment
- *   - 0x40:  user code segment
- *   - 0x50:  user data segment
- *   - 0x60:  defined for tss, initialized in gdt_init
+ *   - 0x08:  kernel code segment
+ *   - 0x10:  kernel data segment
+ *   - 0x18:  user data segment
+ *   - 0x20:  user code segment
+ *   - 0x28:  defined for tss, 16 bytes, initialized in gdt_init
+ * The order is the one syscall and sysret expect.
  * */
 static struct segdesc __gdt[SEG_COUNT] = {
 	SEG_NULL,
 	[SEG_KTEXT] = SEG(STA_X | STA_R, DPL_KERNEL),
 	[SEG_KDATA] = SEG(STA_W, DPL_KERNEL),
-	[SEG_UTEXT] = SEG(STA_X | STA_R, DPL_USER),
 	[SEG_UDATA] = SEG(STA_W, DPL_USER),
-	/*
-	[SEG_TLS1] = SEG(STA_W, DPL_USER),
-	[SEG_TLS2] = SEG(STA_W, DPL_USER),
-	*/
+	[SEG_UTEXT] = SEG(STA_X | STA_R, DPL_USER),
 };
 
 #if 0
@@ -77,7 +82,10 @@ static struct pseudodesc __gdt_pd = {
 };
 #endif
 
-static DEFINE_PERCPU_NOINIT(size_t, used_pages);
+DEFINE_PERCPU_COUNTER(used_pages);
+#ifdef UCONFIG_NUMA_POLICY
+static DEFINE_PERCPU_NOINIT(struct numa_stat, numa_stats[MAX_NUMA_NODES]);
+#endif
 DEFINE_PERCPU_NOINIT(list_entry_t, page_struct_free_list);
 
 // virtual address of physical page array
@@ -128,6 +136,7 @@ void load_rsp0(uintptr_t rsp0)
 {
 	//XXX
 	mycpu()->arch_data.ts.ts_rsp0 = rsp0;
+	mycpu()->arch_data.sysarea.kstack = rsp0;
 }
 
 /**
@@ -161,7 +170,7 @@ void map_pgdir(pgd_t * pgdir)
 
 size_t nr_used_pages(void)
 {
-	return get_cpu_var(used_pages);
+	return percpu_counter_sum(&used_pages);
 }
 
 /* gdt_init - initialize the default GDT and TSS */
@@ -177,6 +186,8 @@ void gdt_init(struct cpu *c)
 	c->arch_data.gdt[SEG_TSS] = 
 		SEGTSS(STS_T32A, (uintptr_t) &c->arch_data.ts,
 		sizeof(struct taskstate), DPL_KERNEL);
+	c->arch_data.gdt[SEG_TSS + 1] =
+	    SEGTSS_HIGH((uintptr_t) & c->arch_data.ts);
 
 	struct pseudodesc gdt_pd = {
 		sizeof(__gdt) - 1, (uintptr_t) c->arch_data.gdt
@@ -297,32 +308,169 @@ static void page_init(void)
 	}
 }
 
-/**
- * call pmm->alloc_pages to allocate a continuing n*PAGESIZE memory
- * @param n pages to be allocated
- */
-struct Page *alloc_pages(size_t n)
+static struct Page *__alloc_pages(size_t n, bool movable)
 {
 	struct Page *page;
-	bool intr_flag;
-#ifdef UCONFIG_SWAP
-try_again:
+	bool intr_flag, drained = 0, shrunk = 0;
+#ifdef UCONFIG_COMPACTION
+	bool compacted = 0;
 #endif
+try_again:
 	local_intr_save(intr_flag);
 	{
-		page = pmm_manager->alloc_pages(n);
+		if (movable && pmm_manager->alloc_pages_movable != NULL) {
+			page = pmm_manager->alloc_pages_movable(NULL, n);
+		} else {
+			page = pmm_manager->alloc_pages(n);
+		}
 	}
 	local_intr_restore(intr_flag);
+	if (page == NULL && !drained) {
+		drain_all_pages();
+		drained = 1;
+		goto try_again;
+	}
+#ifdef UCONFIG_COMPACTION
+	/* the pages may be free, only not together; it needs irq on */
+	if (page == NULL && n > 1 && !compacted && intr_flag) {
+		compacted = 1;
+		if (try_compact_pages(n)) {
+			goto try_again;
+		}
+	}
+#endif
+	/* the caches give pages back at once, the scans may sleep */
+	if (page == NULL && !shrunk && intr_flag
+	    && current != NULL && current != idleproc) {
+		shrunk = 1;
+		if (shrink_caches(n) != 0) {
+			goto try_again;
+		}
+	}
 #ifdef UCONFIG_SWAP
 	if (page == NULL && try_free_pages(n)) {
+		drained = 0;
 		goto try_again;
 	}
+	if (page != NULL) {
+		kswapd_balance(intr_flag);
+	}
 #endif
 
-	get_cpu_var(used_pages) += n;
+	if (page != NULL) {
+		percpu_counter_add(&used_pages, n);
+	}
+	return page;
+}
+
+/**
+ * call pmm->alloc_pages to allocate a continuing n*PAGESIZE memory
+ * @param n pages to be allocated
+ */
+struct Page *alloc_pages(size_t n)
+{
+	return __alloc_pages(n, 0);
+}
+
+#ifdef UCONFIG_COMPACTION
+/**
+ * alloc_page_movable - alloc_page for a page of anonymous user memory,
+ * which compaction may move to another page: it is kept with its kind
+ */
+struct Page *alloc_page_movable(void)
+{
+	return __alloc_pages(1, 1);
+}
+
+/**
+ * alloc_page_movable_numa - a movable page of node, without reclaim
+ */
+struct Page *alloc_page_movable_numa(struct numa_node *node)
+{
+	struct Page *page = NULL;
+	bool intr_flag;
+	if (pmm_manager->alloc_pages_movable != NULL) {
+		local_intr_save(intr_flag);
+		{
+			page = pmm_manager->alloc_pages_movable(node, 1);
+		}
+		local_intr_restore(intr_flag);
+	}
+	if (page != NULL) {
+		percpu_counter_inc(&used_pages);
+	}
 	return page;
 }
 
+/**
+ * isolate_pageblock - take the free pages of the next pageblock of numa_id
+ * worth compacting onto isolated, and return its first page, or NULL
+ */
+struct Page *isolate_pageblock(uint32_t numa_id, list_entry_t * isolated)
+{
+	if (pmm_manager->isolate_pageblock == NULL) {
+		return NULL;
+	}
+	return pmm_manager->isolate_pageblock(numa_id, isolated);
+}
+
+/**
+ * putback_pages - free the blocks on isolated, the free ones isolated and
+ * nr_used pages in use until compaction moved them away
+ */
+void putback_pages(list_entry_t * isolated, size_t nr_used)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		pmm_manager->putback_pages(isolated);
+	}
+	local_intr_restore(intr_flag);
+	percpu_counter_sub(&used_pages, nr_used);
+}
+
+/**
+ * pages_fragmented - numa_id has no free block of order pages, but enough
+ * free pages for compaction to make one
+ */
+bool pages_fragmented(uint32_t numa_id, size_t order)
+{
+	if (pmm_manager->fragmented == NULL) {
+		return 0;
+	}
+	return pmm_manager->fragmented(numa_id, order);
+}
+#endif
+
+#ifdef UCONFIG_VIRTIO_BALLOON
+/**
+ * isolate_unreported - take up to max free blocks of numa_id of order or
+ * more the host was not told of onto isolated, and return their #. They
+ * are neither free nor used until putback_reported
+ */
+int isolate_unreported(uint32_t numa_id, size_t order, list_entry_t * isolated,
+		       int max)
+{
+	if (pmm_manager->isolate_unreported == NULL) {
+		return 0;
+	}
+	return pmm_manager->isolate_unreported(numa_id, order, isolated, max);
+}
+
+/**
+ * putback_reported - free the blocks on isolated, which the host now knows
+ * are free
+ */
+void putback_reported(list_entry_t * isolated)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		pmm_manager->putback_reported(isolated);
+	}
+	local_intr_restore(intr_flag);
+}
+#endif
 
 struct Page *alloc_pages_cpu(struct cpu *cpu, size_t n)
 {
@@ -337,7 +485,7 @@ struct Page *alloc_pages_cpu(struct cpu *cpu, size_t n)
 		page = pmm_manager->alloc_pages_numa(cpu->node, n);
 	}
 	local_intr_restore(intr_flag);
-	per_cpu(used_pages, cpu->id) += n;
+	percpu_counter_add(&used_pages, n);
 	return page;
 }
 
@@ -358,6 +506,260 @@ struct Page *alloc_pages_numa(struct numa_node* node, size_t n)
 }
 
 
+#ifdef UCONFIG_NUMA_POLICY
+//mempolicy_node - the node the mempolicy of mm wants the page at la on
+static int mempolicy_node(struct mm_struct *mm, uintptr_t la)
+{
+	switch (mm->mempolicy) {
+	case MPOL_INTERLEAVE:
+		return (la >> PGSHIFT) % sysconf.lnuma_count;
+	case MPOL_BIND:
+		return mm->mempolicy_node;
+	}
+	return mycpu()->node ? mycpu()->node->id : 0;
+}
+
+#ifdef UCONFIG_COMPACTION
+#define alloc_user_page_node(node)          alloc_page_movable_numa(node)
+#define alloc_user_page()                   alloc_page_movable()
+#else
+//alloc_user_page_node - a page of node, without reclaim
+static struct Page *alloc_user_page_node(struct numa_node *node)
+{
+	struct Page *page;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		page = pmm_manager->alloc_pages_numa(node, 1);
+	}
+	local_intr_restore(intr_flag);
+	if (page != NULL) {
+		percpu_counter_inc(&used_pages);
+	}
+	return page;
+}
+
+#define alloc_user_page()                   alloc_page()
+#endif
+
+/* the placement counts of a mm are halved at this, the recent ones weigh */
+#define NUMA_PAGES_DECAY                    4096
+
+//numa_account_page - a page of mm was placed on node, which becomes its
+//                  - preferred one once it holds the most
+static void numa_account_page(struct mm_struct *mm, int node)
+{
+	int i;
+	if (++mm->numa_pages[node] >= NUMA_PAGES_DECAY) {
+		for (i = 0; i < sysconf.lnuma_count; i++) {
+			mm->numa_pages[i] /= 2;
+		}
+	}
+	if (mm->numa_preferred < 0
+	    || mm->numa_pages[node] > mm->numa_pages[mm->numa_preferred]) {
+		mm->numa_preferred = node;
+	}
+}
+
+//alloc_user_page_near - a page of the nodes nearest to want, without reclaim
+static struct Page *alloc_user_page_near(int want)
+{
+	struct numa_node *node = &numa_nodes[want];
+	struct Page *page = NULL;
+	int i;
+	for (i = 0; i < node->nr_fallback && page == NULL; i++) {
+		page = alloc_user_page_node(&numa_nodes[node->fallback[i]]);
+	}
+	return page;
+}
+
+/**
+ * alloc_page_policy - allocate a page for the user address la of mm.
+ * MPOL_LOCAL and MPOL_INTERLEAVE fall back to the nodes nearest to the
+ * wanted one when it is full, then to alloc_page (swap); MPOL_BIND only
+ * drains the per-cpu lists.
+ */
+struct Page *alloc_page_policy(struct mm_struct *mm, uintptr_t la)
+{
+	struct Page *page;
+	bool drained = 0;
+	int want = mempolicy_node(mm, la), got;
+try_again:
+	if ((page = alloc_user_page_node(&numa_nodes[want])) != NULL) {
+		/* counted already */
+	} else if (mm->mempolicy == MPOL_BIND) {
+		if (drained) {
+			return NULL;
+		}
+		drain_all_pages();
+		drained = 1;
+		goto try_again;
+	} else if ((page = alloc_user_page_near(want)) == NULL
+		   && (page = alloc_user_page()) == NULL) {
+		return NULL;
+	}
+
+	struct numa_stat *stats = get_cpu_var(numa_stats);
+	got = numa_mem_zones[page->zone_num].node->id;
+	numa_account_page(mm, got);
+	if (got == want) {
+		stats[got].hit++;
+		if (mm->mempolicy == MPOL_INTERLEAVE) {
+			stats[got].interleave++;
+		}
+	} else {
+		stats[got].miss++;
+		stats[want].foreign++;
+	}
+	return page;
+}
+
+//numa_stat_get - sum up the counters of node over all cpus
+void numa_stat_get(int node, struct numa_stat *stat)
+{
+	int i;
+	memset(stat, 0, sizeof(struct numa_stat));
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct numa_stat *s = &(per_cpu(numa_stats, i)[node]);
+		stat->hit += s->hit;
+		stat->miss += s->miss;
+		stat->foreign += s->foreign;
+		stat->interleave += s->interleave;
+	}
+}
+
+//numa_info_get - the cpus, memory and distances of node
+void numa_info_get(int node, struct numa_info *info)
+{
+	struct numa_node *n = &numa_nodes[node];
+	int i;
+	static_assert(MAX_NUMA_NODES <= NUMA_INFO_NODES);
+	memset(info, 0, sizeof(struct numa_info));
+	info->nr_nodes = sysconf.lnuma_count;
+	for (i = 0; i < n->nr_cpus && i < NUMA_INFO_CPUS; i++) {
+		info->cpus[info->nr_cpus++] = n->cpu_ids[i];
+	}
+	for (i = 0; i < numa_mem_zones_cnt; i++) {
+		if (numa_mem_zones[i].node == n) {
+			info->nr_pages += numa_mem_zones[i].n;
+		}
+	}
+	for (i = 0; i < sysconf.lnuma_count; i++) {
+		info->distance[i] = n->distance[i];
+	}
+	for (i = 0; i < n->nr_fallback; i++) {
+		info->fallback[i] = n->fallback[i];
+	}
+}
+#endif
+
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+static struct {
+	atomic_t fault_alloc;
+	atomic_t fault_fallback;
+	atomic_t split;
+	atomic_t mapped;
+} thp_counters;
+
+/**
+ * huge_pmd_map - back the empty pmd of la with a zeroed huge page.
+ * The page table a split will need is allocated here too and parked on
+ * the page_link of the head page, so that split_huge_pmd never fails.
+ */
+int huge_pmd_map(pgd_t * pgdir, uintptr_t la, pmd_t * pmdp, pte_perm_t perm)
+{
+	struct Page *page, *pt;
+	if ((pt = alloc_page()) == NULL) {
+		goto fallback;
+	}
+	if ((page = alloc_pages(HPAGE_NR_PAGES)) == NULL) {
+		free_page(pt);
+		goto fallback;
+	}
+	memset(page2kva(page), 0, HPAGE_SIZE);
+	set_page_ref(page, 1);
+	set_page_ref(pt, 1);
+	list_init(&(page->page_link));
+	list_add(&(page->page_link), &(pt->page_link));
+	if (!__sync_bool_compare_and_swap(pmdp, 0, page2pa(page) | perm | PTE_PS)) {
+		/* another thread of the mm filled the pmd first */
+		set_page_ref(page, 0);
+		set_page_ref(pt, 0);
+		free_page(pt);
+		free_pages(page, HPAGE_NR_PAGES);
+		return 0;
+	}
+	atomic_inc(&(thp_counters.fault_alloc));
+	atomic_inc(&(thp_counters.mapped));
+	return 0;
+
+fallback:
+	atomic_inc(&(thp_counters.fault_fallback));
+	return -E_NO_MEM;
+}
+
+//huge_pmd_pt - take back the page table parked by huge_pmd_map
+static struct Page *huge_pmd_pt(struct Page *page)
+{
+	list_entry_t *le = list_next(&(page->page_link));
+	assert(le != &(page->page_link));
+	list_del(le);
+	return le2page(le, page_link);
+}
+
+//huge_pmd_remove - unmap the huge page of pmdp, free it if it was the last map
+void huge_pmd_remove(pgd_t * pgdir, uintptr_t la, pmd_t * pmdp)
+{
+	struct Page *page = pmd2page(*pmdp);
+	*pmdp = 0;
+	/* one invlpg drops the whole huge entry */
+	mp_tlb_flush_range(pgdir, la, la + PGSIZE);
+	if (page_ref_dec(page) == 0) {
+		free_page(huge_pmd_pt(page));
+		free_pages(page, HPAGE_NR_PAGES);
+	}
+	atomic_dec(&(thp_counters.mapped));
+}
+
+//split_huge_pmd - turn the huge mapping of pmdp into NPGENTRY 4K ptes
+void split_huge_pmd(pgd_t * pgdir, uintptr_t la, pmd_t * pmdp)
+{
+	struct Page *page = pmd2page(*pmdp), *pt = huge_pmd_pt(page);
+	pte_perm_t perm = *pmdp & (PGSIZE - 1) & ~PTE_PS;
+	pte_t *pte = page2kva(pt);
+	int i, ref = page_ref(page);
+	for (i = 0; i < NPGENTRY; i++) {
+		set_page_ref(page + i, ref);
+		pte[i] = page2pa(page + i) | perm;
+	}
+	ptep_map(pmdp, page2pa(pt));
+	ptep_set_u_write(pmdp);
+	ptep_set_accessed(pmdp);
+	ptep_set_dirty(pmdp);
+	tlb_invalidate(pgdir, ROUNDDOWN(la, HPAGE_SIZE));
+	atomic_inc(&(thp_counters.split));
+	atomic_dec(&(thp_counters.mapped));
+}
+
+//split_huge_at - make sure no huge mapping crosses la, before a vma is cut there
+void split_huge_at(pgd_t * pgdir, uintptr_t la)
+{
+	pmd_t *pmdp;
+	if (la % HPAGE_SIZE != 0 && (pmdp = get_pmd(pgdir, la, 0)) != NULL
+	    && pmd_huge(pmdp)) {
+		split_huge_pmd(pgdir, la, pmdp);
+	}
+}
+
+void thp_stat_get(struct thp_stat *stat)
+{
+	stat->fault_alloc = atomic_read(&(thp_counters.fault_alloc));
+	stat->fault_fallback = atomic_read(&(thp_counters.fault_fallback));
+	stat->split = atomic_read(&(thp_counters.split));
+	stat->mapped = atomic_read(&(thp_counters.mapped));
+}
+#endif
+
 //boot_alloc_page - allocate one page using pmm->alloc_pages(1) 
 // return value: the kernel virtual address of this allocated page
 //note: this function is used to get the memory for PDT(Page Directory Table)&PT(Page Table)
@@ -378,14 +780,76 @@ void *boot_alloc_page(void)
 void free_pages(struct Page *base, size_t n)
 {
 	bool intr_flag;
+	memcg_uncharge_pages(base, n);
 	local_intr_save(intr_flag);
 	{
 		pmm_manager->free_pages(base, n);
 	}
 	local_intr_restore(intr_flag);
-	get_cpu_var(used_pages) -= n;
+	percpu_counter_sub(&used_pages, n);
 }
 
+/**
+ * pmm_init_percpu - turn on the per-cpu page lists of pmm, if it has them
+ */
+void pmm_init_percpu(void)
+{
+	if (pmm_manager->init_percpu != NULL) {
+		pmm_manager->init_percpu();
+	}
+}
+
+/**
+ * drain_all_pages - push the pages cached by every cpu back to pmm
+ */
+void drain_all_pages(void)
+{
+	if (pmm_manager->drain_pages != NULL) {
+		pmm_manager->drain_pages();
+	}
+}
+
+#ifdef UCONFIG_PREZERO_PAGES
+// prezero_pages - called by the idle loop, with irq on, to clear free pages
+//               - ahead of the faults; 0 once there is nothing left to do
+int prezero_pages(void)
+{
+	if (pmm_manager->prezero_pages == NULL) {
+		return 0;
+	}
+	return pmm_manager->prezero_pages();
+}
+
+/**
+ * alloc_zeroed_page_policy - alloc_page_policy for a page that must be zero.
+ * The page comes from the pool the idle cpus cleared on the node wanted,
+ * and is cleared here only when the pool is empty.
+ */
+struct Page *alloc_zeroed_page_policy(struct mm_struct *mm, uintptr_t la)
+{
+	struct Page *page = NULL;
+	bool intr_flag;
+#ifdef UCONFIG_NUMA_POLICY
+	int node = mempolicy_node(mm, la);
+#else
+	int node = mycpu()->node ? mycpu()->node->id : 0;
+#endif
+	if (pmm_manager->alloc_zeroed_page != NULL) {
+		local_intr_save(intr_flag);
+		{
+			page = pmm_manager->alloc_zeroed_page(node);
+		}
+		local_intr_restore(intr_flag);
+	}
+	if (page != NULL) {
+		percpu_counter_inc(&used_pages);
+	} else if ((page = alloc_page_policy(mm, la)) != NULL) {
+		clear_page(page2kva(page));
+	}
+	return page;
+}
+#endif
+
 /**
  * nr_free_pages - call pmm->nr_free_pages to get the size (nr*PAGESIZE) of current free memory
  * @return number of free pages
@@ -402,18 +866,96 @@ size_t nr_free_pages(void)
 	return ret;
 }
 
+/**
+ * free_area_stat - the free blocks of each order of numa_id into nr_free, up
+ * to n orders, and return the # of orders filled
+ */
+int free_area_stat(uint32_t numa_id, size_t * nr_free, int n)
+{
+	if (pmm_manager->free_area_stat == NULL) {
+		return 0;
+	}
+	return pmm_manager->free_area_stat(numa_id, nr_free, n);
+}
+
+/* *
+ * The kernel maps are global, so that the cr3 load of a switch keeps them
+ * in the tlb, and the memory is mapped with 1GB pages where the cpu has
+ * them and 2MB ones elsewhere. Only what is wholly usable memory in the
+ * e820 map is mapped large: get_pte does not see through a large page,
+ * and the drivers map their registers in the direct map with it.
+ * */
+static bool boot_page1g;
+
+// boot_map_ram - whether [pa, pa + size) is in a usable range of the e820 map
+static bool boot_map_ram(uintptr_t pa, size_t size)
+{
+	struct e820map *memmap = e820map_addr;
+	int i;
+	for (i = 0; i < memmap->nr_map; i++) {
+		uint64_t begin = memmap->map[i].addr, end =
+		    begin + memmap->map[i].size;
+		if (memmap->map[i].type == E820_ARM && begin <= pa
+		    && pa + size <= end) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// boot_map_large - whether [la, la + size) to pa may be one page of size
+static inline bool
+boot_map_large(uintptr_t la, uintptr_t pa, size_t left, size_t size)
+{
+	return la % size == 0 && pa % size == 0 && left >= size
+	    && boot_map_ram(pa, size);
+}
+
+// boot_map_pmd - map la to pa below a pud of tables, the bytes done
+static size_t
+boot_map_pmd(pgd_t * pgdir, uintptr_t la, uintptr_t pa, size_t left,
+	     uint32_t perm)
+{
+	pmd_t *pmdp = get_pmd(pgdir, la, 1);
+	assert(pmdp != NULL);
+	if (*pmdp & PTE_PS) {
+		/* mapped already, by a range before */
+		return PTSIZE - la % PTSIZE;
+	}
+	if (*pmdp == 0 && boot_map_large(la, pa, left, PTSIZE)) {
+		*pmdp = pa | PTE_PS | perm;
+		return PTSIZE;
+	}
+	pte_t *ptep = get_pte(pgdir, la, 1);
+	assert(ptep != NULL);
+	*ptep = pa | perm;
+	return PGSIZE;
+}
+
 	void
 boot_map_segment(pgd_t * pgdir, uintptr_t la, size_t size, uintptr_t pa,
 		uint32_t perm)
 {
 	assert(PGOFF(la) == PGOFF(pa));
-	size_t n = ROUNDUP(size + PGOFF(la), PGSIZE) / PGSIZE;
+	size_t n = ROUNDUP(size + PGOFF(la), PGSIZE) / PGSIZE, step;
 	la = ROUNDDOWN(la, PGSIZE);
 	pa = ROUNDDOWN(pa, PGSIZE);
-	for (; n > 0; n--, la += PGSIZE, pa += PGSIZE) {
-		pte_t *ptep = get_pte(pgdir, la, 1);
-		assert(ptep != NULL);
-		*ptep = pa | PTE_P | perm;
+	perm |= PTE_P | PTE_G;
+	for (; n > 0; n -= step / PGSIZE, la += step, pa += step) {
+		pud_t *pudp = get_pud(pgdir, la, 1);
+		assert(pudp != NULL);
+		if (*pudp & PTE_PS) {
+			step = PUSIZE - la % PUSIZE;
+		} else if (*pudp == 0 && boot_page1g
+			   && boot_map_large(la, pa, n * PGSIZE, PUSIZE)) {
+			*pudp = pa | PTE_PS | perm;
+			step = PUSIZE;
+		} else {
+			step = boot_map_pmd(pgdir, la, pa, n * PGSIZE, perm);
+		}
+		if (step >= n * PGSIZE) {
+			break;
+		}
 	}
 }
 
@@ -445,6 +987,7 @@ void pmm_init_numa(void)
 	boot_pgdir[PGX(VPT)] = PADDR_DIRECT(boot_pgdir) | PTE_P | PTE_W;
 
 	// map all physical memory at KERNBASE
+	boot_page1g = (cpuid_check_feature(CPUID_FEATURE_PAGE1G) != 0);
 	boot_map_segment(boot_pgdir, PBASE, npage * PGSIZE, 0, PTE_W);
 
 	lcr3(boot_cr3);
@@ -464,6 +1007,8 @@ void pmm_init_numa(void)
 	/* and map the first 1MB for the ap booting */
 	/* boot_map_segment(boot_pgdir, 0, 0x100000, 0, PTE_W); */
 
+	/* the pages of the boot page tables are not counted */
+	percpu_counter_init(&used_pages, 0);
 	//TODO put here?
 	pmm_init_ap();
 
@@ -475,6 +1020,9 @@ void pmm_init_ap(void)
 {
 
 	mp_lcr3(boot_cr3);
+#ifdef UCONFIG_PCID
+	pcid_init();
+#endif
 
 	// set CR0
 	uint64_t cr0 = rcr0();
@@ -483,13 +1031,14 @@ void pmm_init_ap(void)
 	    CR0_MP;
 	cr0 &= ~(CR0_TS | CR0_EM);
 	lcr0(cr0);
+	/* sets CR0_TS again, for the lazy restore */
+	fpu_init_cpu();
 
 	//gdt_init();
 
 	list_entry_t *page_struct_free_list =
 	    get_cpu_ptr(page_struct_free_list);
 	list_init(page_struct_free_list);
-	get_cpu_var(used_pages) = 0;
 }
 
 // invalidate a TLB entry, but only if the page tables being
@@ -503,9 +1052,15 @@ void tlb_update(pgd_t * pgdir, uintptr_t la)
 // edited are the ones currently in use by the processor.
 void tlb_invalidate(pgd_t * pgdir, uintptr_t la)
 {
-	if (rcr3() == PADDR_DIRECT(pgdir)) {
+	if ((rcr3() & ~CR3_PCID_MASK) == PADDR_DIRECT(pgdir)) {
 		invlpg((void *)la);
 	}
+#ifdef UCONFIG_PCID
+	else {
+		/* entries of pgdir may still sit under its pcid here */
+		pcid_flush_local(PADDR_DIRECT(pgdir));
+	}
+#endif
 }
 
 static void check_alloc_page(void)
@@ -550,8 +1105,9 @@ get_pgtable_items(size_t left, size_t right, size_t start, uintptr_t * table,
 		if (left_store != NULL) {
 			*left_store = start;
 		}
-		int perm = (table[start++] & PTE_USER);
-		while (start < right && (table[start] & PTE_USER) == perm) {
+		int perm = (table[start++] & (PTE_USER | PTE_PS));
+		while (start < right
+		       && (table[start] & (PTE_USER | PTE_PS)) == perm) {
 			start++;
 		}
 		if (right_store != NULL) {
@@ -581,8 +1137,12 @@ print_pgdir_sub(int deep, size_t left, size_t right,
 			}
 			printf(" %016llx-%016llx %016llx %s\n", lb, rb, rb - lb,
 			       perm2str(perm));
-			print_pgdir_sub(deep - 1, l * NPGENTRY, r * NPGENTRY,
-					s1 + 1, s2 + 1, s3 + 1, printf);
+			/* a large page has no table below */
+			if (!(perm & PTE_PS)) {
+				print_pgdir_sub(deep - 1, l * NPGENTRY,
+						r * NPGENTRY, s1 + 1, s2 + 1,
+						s3 + 1, printf);
+			}
 		}
 	}
 }
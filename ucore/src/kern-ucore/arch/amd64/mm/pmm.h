@@ -23,6 +23,33 @@ struct pmm_manager {
 	 size_t(*nr_free_pages) (void);
 	 size_t(*nr_free_pages_numa) (struct numa_node *node);
 	void (*check) (void);
+	/* optional: per-cpu page lists, enabled once the boot checks are done */
+	void (*init_percpu) (void);
+	/* optional: give back the pages cached per cpu, when memory runs low */
+	void (*drain_pages) (void);
+	/* optional: a page of the pre-zeroed pool of a node, NULL if empty */
+	struct Page *(*alloc_zeroed_page) (uint32_t numa_id);
+	/* optional: clear a batch of free pages into the pool, # cleared */
+	int (*prezero_pages) (void);
+	/* optional: pages compaction may move, on node or that of this cpu */
+	struct Page *(*alloc_pages_movable) (struct numa_node * node, size_t n);
+	/* optional: take the free blocks of the next pageblock of a node
+	 * worth compacting onto a list, and return its first page */
+	struct Page *(*isolate_pageblock) (uint32_t numa_id,
+					   list_entry_t * isolated);
+	/* optional: free the blocks of such a list, of property order each */
+	void (*putback_pages) (list_entry_t * isolated);
+	/* optional: no free block of order, but the pages for it are free */
+	 bool(*fragmented) (uint32_t numa_id, size_t order);
+	/* optional: take free blocks of order or more of a node the host was
+	 * not told of yet onto a list, up to max of them; # taken */
+	int (*isolate_unreported) (uint32_t numa_id, size_t order,
+				   list_entry_t * isolated, int max);
+	/* optional: free the blocks of such a list, reported from now on */
+	void (*putback_reported) (list_entry_t * isolated);
+	/* optional: the free blocks of each order of a node into nr_free, up
+	 * to n orders; # of orders filled */
+	int (*free_area_stat) (uint32_t numa_id, size_t * nr_free, int n);
 };
 struct proc_struct;
 
@@ -46,6 +73,42 @@ void *boot_alloc_page(void);
 void free_pages(struct Page *base, size_t n);
 size_t nr_used_pages(void);
 size_t nr_free_pages(void);
+int free_area_stat(uint32_t numa_id, size_t * nr_free, int n);
+void pmm_init_percpu(void);
+void drain_all_pages(void);
+#ifdef UCONFIG_PREZERO_PAGES
+int prezero_pages(void);
+#endif
+#ifdef UCONFIG_COMPACTION
+/* the unit of the grouping by mobility, that of a huge page */
+#define PAGEBLOCK_ORDER             9
+#define PAGEBLOCK_NR_PAGES          (1 << PAGEBLOCK_ORDER)
+
+struct Page *alloc_page_movable(void);
+struct Page *alloc_page_movable_numa(struct numa_node *node);
+struct Page *isolate_pageblock(uint32_t numa_id, list_entry_t * isolated);
+void putback_pages(list_entry_t * isolated, size_t nr_used);
+bool pages_fragmented(uint32_t numa_id, size_t order);
+#endif
+#ifdef UCONFIG_VIRTIO_BALLOON
+int isolate_unreported(uint32_t numa_id, size_t order, list_entry_t * isolated,
+		       int max);
+void putback_reported(list_entry_t * isolated);
+#endif
+#ifdef UCONFIG_NUMA_POLICY
+struct numa_stat;
+void numa_stat_get(int node, struct numa_stat *stat);
+struct numa_info;
+void numa_info_get(int node, struct numa_info *info);
+#endif
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+struct thp_stat;
+int huge_pmd_map(pgd_t * pgdir, uintptr_t la, pmd_t * pmdp, pte_perm_t perm);
+void huge_pmd_remove(pgd_t * pgdir, uintptr_t la, pmd_t * pmdp);
+void split_huge_pmd(pgd_t * pgdir, uintptr_t la, pmd_t * pmdp);
+void split_huge_at(pgd_t * pgdir, uintptr_t la);
+void thp_stat_get(struct thp_stat *stat);
+#endif
 
 #define alloc_page() alloc_pages(1)
 #define free_page(page) free_pages(page, 1)
@@ -15,11 +15,9 @@ typedef struct {
 } swap_list_t;
 
 extern unsigned short *mem_map;
-extern swap_list_t active_list;
-extern swap_list_t inactive_list;
 
-#define nr_active_pages                 (active_list.nr_pages)
-#define nr_inactive_pages               (inactive_list.nr_pages)
+#define nr_active_pages                 lru_nr_pages(1)
+#define nr_inactive_pages               lru_nr_pages(0)
 
 #define SWAP_UNUSED                     0xFFFF
 
@@ -232,9 +230,10 @@ void check_mm_swap(void)
 		*(char *)addr1 = (char)(i * i);
 	}
 
-	ret = 0;
-	ret += swap_out_mm(mm0, 10);
-	ret += swap_out_mm(mm0, 10);
+	// the pages just written age out within PAGE_AGE_MAX + 1 scans
+	for (ret = 0, j = 0; j <= PAGE_AGE_MAX; j++) {
+		ret += swap_out_mm(mm0, 10);
+	}
 	assert(ret == 4);
 
 	for (; i < 8; i++, addr1 += PGSIZE) {
@@ -386,7 +385,9 @@ void check_mm_shm_swap(void)
 
 	// check swap
 
-	ret = swap_out_mm(mm0, 8) + swap_out_mm(mm0, 8);
+	for (ret = 0, i = 0; i <= PAGE_AGE_MAX; i++) {
+		ret += swap_out_mm(mm0, 8);
+	}
 	assert(ret == 8 && nr_active_pages == 4 && nr_inactive_pages == 0);
 
 	refill_inactive_scan();
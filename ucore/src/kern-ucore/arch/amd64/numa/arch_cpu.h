@@ -3,10 +3,25 @@
 #include <arch.h>
 
 #define MAX_GDT_ITEMS SEG_COUNT
+
+/* where %gs points in the kernel: the syscall entry has nothing else to
+ * find the kernel stack with, see __syscall_entry */
+struct syscall_area {
+	struct cpu *cpu;	/* mycpu() reads it at %gs:0 */
+	uintptr_t kstack;	/* ts.ts_rsp0 */
+	uintptr_t user_rsp;	/* the entry saves the user stack here */
+};
+
 struct __arch_cpu{
+	struct syscall_area sysarea;
 	struct taskstate ts;
 	struct segdesc gdt[MAX_GDT_ITEMS];
 	uintptr_t tlb_cr3;
+	uintptr_t fs_base;	// the user tls loaded, see tls_switch
+#ifdef UCONFIG_LAZY_TLB
+	volatile bool tlb_lazy;		// a kernel thread borrows tlb_cr3
+	volatile bool tlb_lazy_flush;	// a shootdown skipped this cpu
+#endif
 };
 
 
@@ -16,8 +16,21 @@ static inline struct cpu* mycpu(void)
 
 static inline mp_lcr3(uintptr_t cr3)
 {
-	mycpu()->arch_data.tlb_cr3 = cr3;
+	mycpu()->arch_data.tlb_cr3 = cr3 & ~(CR3_PCID_MASK | CR3_NOFLUSH);
 	lcr3(cr3);
 }
 
+void cpus_up(void);
+void mp_tlb_flush_ipi(void);
+#ifdef UCONFIG_LAZY_TLB
+void mp_lazy_tlb_enter(void);
+void mp_lazy_tlb_drop(pgd_t * pgdir);
+#endif
+#ifdef UCONFIG_PCID
+void pcid_init(void);
+uint64_t pcid_new_ctx(void);
+void pcid_flush_local(uintptr_t cr3);
+void pcid_flush_all(void);
+#endif
+
 #endif /* __ARCH_AMD64_NUMA_ARCH_MP_H__ */
@@ -10,6 +10,11 @@
 #include <percpu.h>
 #include <lapic.h>
 #include <sysconf.h>
+#include <string.h>
+#include <cpuid.h>
+#include <sync.h>
+#include <idle.h>
+#include <kvm.h>
 
 void *percpu_offsets[NCPU];
 DEFINE_PERCPU_NOINIT(struct cpu, cpus);
@@ -26,10 +31,22 @@ tls_init(struct cpu *c)
 	// Initialize cpu-local storage.
 	writegs(KERNEL_DS);
 
+	static_assert(offsetof(struct syscall_area, kstack) == SYSAREA_KSTACK);
+	static_assert(offsetof(struct syscall_area, user_rsp) ==
+		      SYSAREA_USER_RSP);
+
 	/* gs base shadow reg in msr */
-	writemsr(MSR_GS_BASE, (uint64_t)&c->cpu);
-	writemsr(MSR_GS_KERNBASE, (uint64_t)&c->cpu);
+	c->arch_data.sysarea.cpu = c;
+	writemsr(MSR_GS_BASE, (uint64_t)&c->arch_data.sysarea);
+	writemsr(MSR_GS_KERNBASE, (uint64_t)&c->arch_data.sysarea);
 	c->cpu = c;
+
+	/* the user tls, see tls_switch */
+	if (x86_fsgsbase) {
+		lcr4(rcr4() | CR4_FSGSBASE);
+	}
+	writemsr(MSR_FS_BASE, 0);
+	c->arch_data.fs_base = 0;
 }
 
 /* alloc percpu var in the corresponding    NUMA nodes */
@@ -69,6 +86,13 @@ void percpu_init(void)
 	}
 }
 
+/* the units of the dynamic per-cpu objects, see numa/percpu_alloc.c */
+struct Page *percpu_alloc_pages(int cpu, size_t n)
+{
+	struct numa_node *node = per_cpu_ptr(cpus, cpu)->node;
+	return (node != NULL) ? alloc_pages_numa(node, n) : alloc_pages(n);
+}
+
 
 #define IO_RTC  0x70
 static void warmreset(uint32_t addr)
@@ -97,13 +121,33 @@ static void rstrreset(void)
 	wrv[1] = 0;
 }
 
-static int bcpuid;
+/* the boot stacks of the APs by apic id, read by kern_ap_entry64 */
+#define AP_MAX_HWID 256
+uintptr_t ap_boot_stacks[AP_MAX_HWID];
+
 static atomic_t bsync = ATOMIC_INIT(0);
+/* the APs come up at once, proc_init_ap is run by one at a time */
+static spinlock_s ap_lock;
+
+//ap_self - the cpu of this AP, by its apic id, before gs is loaded
+static struct cpu *ap_self(void)
+{
+	struct lapic_chip *chip = lapic_get_chip();
+	uint32_t hwid = chip->id(chip);
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct cpu *c = per_cpu_ptr(cpus, i);
+		if (c->hwid == hwid)
+			return c;
+	}
+	panic("ap_self: no cpu of lapic %d\n", hwid);
+}
 
 void ap_init(void)
 {
-	gdt_init(per_cpu_ptr(cpus, bcpuid));
-	tls_init(per_cpu_ptr(cpus, bcpuid));
+	struct cpu *c = ap_self();
+	gdt_init(c);
+	tls_init(c);
 	kprintf("CPU%d alive\n", myid());
 	/* load new pagetable(shared with bsp) */
 	pmm_init_ap();
@@ -118,7 +162,12 @@ void ap_init(void)
 	free_pages(p, 2);
 
 	lapic_init();
+#ifdef UCONFIG_KVM_GUEST
+	kvm_guest_init_ap();
+#endif
+	spinlock_acquire(&ap_lock);
 	proc_init_ap();
+	spinlock_release(&ap_lock);
 
 	atomic_inc(&bsync); /* let BSP know we are up */
 
@@ -126,36 +175,58 @@ void ap_init(void)
 	cpu_idle();
 }
 
-void cpu_up(int id)
+/* *
+ * cpus_up - start all the APs at once. Each gets its stack on its node,
+ * left in ap_boot_stacks for its apic id, and all share the trampoline
+ * and the waits of INIT/SIPI; ap_init then runs on all of them in
+ * parallel. Without start_aps the lapic starts them one by one, but
+ * still does not wait for one to come up before the next.
+ * */
+void cpus_up(void)
 {
 	extern char _bootother_start[];
 	extern uint64_t _bootother_size;
 	extern void (*apstart)(void);
-	char *stack;
+	static struct cpu *cs[NCPU];
+	struct lapic_chip *chip = lapic_get_chip();
+	int i, n = 0;
 
 	unsigned char *code = (unsigned char*)VADDR_DIRECT(0x7000);
-	struct cpu *c = per_cpu_ptr(cpus, id);
-	assert(c->id != myid());
-	assert(c->id == id);
 	memcpy(code, _bootother_start, _bootother_size);
 
-	stack = (char*)page2kva(alloc_pages_cpu(c, KSTACKPAGE));
-	assert(stack != NULL);
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct cpu *c = per_cpu_ptr(cpus, i);
+		if (c->id == myid())
+			continue;
+		assert(c->hwid < AP_MAX_HWID);
+		struct Page *p = alloc_pages_cpu(c, KSTACKPAGE);
+		assert(p != NULL);
+		char *stack = (char*)page2kva(p);
+		kprintf("LAPIC %d, STACK: %p\n", c->hwid, stack);
+		ap_boot_stacks[c->hwid] = (uintptr_t)stack + KSTACKSIZE;
+		cs[n++] = c;
+	}
+	if (n == 0)
+		return;
 
-	kprintf("LAPIC %d, CODE %p PA: %p, STACK: %p\n", c->hwid, code, PADDR_DIRECT(code), stack);
+	kprintf("CODE %p PA: %p\n", code, PADDR_DIRECT(code));
 	warmreset(PADDR_DIRECT(code));
 
 	*(uint32_t*)(code-4) = (uint32_t)PADDR_DIRECT(&apstart);
-	*(uint64_t*)(code-12) = (uint64_t)stack + KSTACKSIZE;
 	*(uint64_t*)(code-20) = (uint64_t)boot_cr3;
 	// bootother.S sets this to 0x0a55face early on
 	*(uint32_t*)(code-64) = 0;
-	bcpuid = c->id;
+	spinlock_init(&ap_lock);
 	atomic_set(&bsync, 0);
 
-	lapic_start_ap(c, PADDR_DIRECT(code));
+	if (chip->start_aps != NULL) {
+		chip->start_aps(chip, cs, n, PADDR_DIRECT(code));
+	} else {
+		for (i = 0; i < n; i++)
+			lapic_start_ap(cs[i], PADDR_DIRECT(code));
+	}
 
-	while(atomic_read(&bsync) == 0)
+	while(atomic_read(&bsync) != n)
 		nop_pause();
 	rstrreset();
 }
@@ -169,16 +240,241 @@ void kern_leave(void)
 {
 }
 
+#ifdef UCONFIG_PCID
+/* *
+ * Each cpu lends its PCID_NR pcids to the address spaces it switched to
+ * last, and takes them back round robin. A slot names its mm by tlb_ctx,
+ * which is never reused, so a pgdir page that gets recycled never finds
+ * the entries of its previous owner. pcid 0 stays with boot_cr3.
+ *
+ * A flush IPIs only the cpus that have the page table loaded. Every
+ * other cpu holding a pcid for it gets the slot marked stale, and drops
+ * the entries on its next switch there. The flusher marks first and
+ * reads tlb_cr3 after; a switch writes tlb_cr3 first and reads the mark
+ * after. With a fence on both sides, one of them sees the other.
+ * */
+#define PCID_NR                     8
+
+struct pcid_slot {
+	uint64_t ctx;		// tlb_ctx of the owner, 0 if free
+	uintptr_t cr3;		// page table of the owner
+	volatile bool stale;	// flushed while not loaded here
+};
+
+struct pcid_cpu {
+	struct pcid_slot slots[PCID_NR];	// slots[i] holds pcid i + 1
+	int next;		// next slot to recycle
+};
+
+static DEFINE_PERCPU_NOINIT(struct pcid_cpu, pcid_cpus);
+static bool pcid_enabled;
+static uint64_t pcid_last_ctx;
+
+void pcid_init(void)
+{
+	/* the boot cpu decides for all of them */
+	if (myid() == 0) {
+		pcid_enabled = (cpuid_check_feature(CPUID_FEATURE_PCID) != 0);
+		kprintf("pcid: %s\n", pcid_enabled ? "enabled" : "not supported");
+	}
+	if (pcid_enabled) {
+		lcr4(rcr4() | CR4_PCIDE);
+	}
+}
+
+uint64_t pcid_new_ctx(void)
+{
+	return __sync_add_and_fetch(&pcid_last_ctx, 1);
+}
+
+static void pcid_mark_stale(struct pcid_cpu *pc, uintptr_t cr3)
+{
+	int i;
+	for (i = 0; i < PCID_NR; i++) {
+		if (pc->slots[i].ctx != 0 && pc->slots[i].cr3 == cr3)
+			pc->slots[i].stale = 1;
+	}
+}
+
+//pcid_flush_local - the entries of cr3 on this cpu are out of date
+void pcid_flush_local(uintptr_t cr3)
+{
+	if (pcid_enabled)
+		pcid_mark_stale(get_cpu_ptr(pcid_cpus), cr3);
+}
+
+//pcid_flush_others - mark cr3 stale on the cpus that do not run it now
+static void pcid_flush_others(pgd_t * pgdir)
+{
+	int i;
+	uintptr_t cr3 = PADDR(pgdir);
+	if (!pcid_enabled)
+		return;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (i == myid() && mycpu()->arch_data.tlb_cr3 == cr3)
+			continue;
+		pcid_mark_stale(per_cpu_ptr(pcid_cpus, i), cr3);
+	}
+	__sync_synchronize();
+}
+
+//pcid_flush_all - drop the entries of every pcid on this cpu
+void pcid_flush_all(void)
+{
+	struct pcid_cpu *pc = get_cpu_ptr(pcid_cpus);
+	uintptr_t cr4 = rcr4();
+	int i;
+	/* toggling PGE flushes all pcids, globals too */
+	lcr4(cr4 ^ CR4_PGE);
+	lcr4(cr4);
+	for (i = 0; i < PCID_NR; i++)
+		pc->slots[i].stale = 0;
+}
+
+/* *
+ * pcid_flushed_current - the pcid loaded here was just flushed. Marks
+ * that arrived while it was loaded come with an IPI of their own, so
+ * they can go too.
+ * */
+static void pcid_flushed_current(void)
+{
+	int pcid = rcr3() & CR3_PCID_MASK;
+	if (pcid_enabled && pcid != 0)
+		get_cpu_ptr(pcid_cpus)->slots[pcid - 1].stale = 0;
+}
+
+//pcid_switch - the cr3 value that loads mm on this cpu
+static uintptr_t pcid_switch(struct mm_struct *mm)
+{
+	struct pcid_cpu *pc = get_cpu_ptr(pcid_cpus);
+	struct pcid_slot *s;
+	uintptr_t cr3 = PADDR(mm->pgdir);
+	int i;
+	mycpu()->arch_data.tlb_cr3 = cr3;
+	__sync_synchronize();
+	for (i = 0; i < PCID_NR; i++) {
+		s = &(pc->slots[i]);
+		if (s->ctx == mm->tlb_ctx) {
+			if (!s->stale)
+				return cr3 | (i + 1) | CR3_NOFLUSH;
+			s->stale = 0;
+			return cr3 | (i + 1);
+		}
+	}
+	i = pc->next, pc->next = (i + 1) % PCID_NR;
+	s = &(pc->slots[i]);
+	s->ctx = mm->tlb_ctx, s->cr3 = cr3, s->stale = 0;
+	/* without NOFLUSH, whatever the previous owner left is dropped */
+	return cr3 | (i + 1);
+}
+#endif
+
+#ifdef UCONFIG_LAZY_TLB
+/* *
+ * Lazy tlb: a kernel thread keeps the page table of whoever ran before
+ * it, as it never touches user addresses. Shootdowns skip a lazy cpu
+ * and leave tlb_lazy_flush behind instead. Coming back to the borrowed
+ * page table reloads cr3 only if a shootdown was skipped meanwhile.
+ * A shooter sets tlb_lazy_flush first and reads tlb_lazy after; leaving
+ * clears tlb_lazy first and reads tlb_lazy_flush after.
+ * */
+void mp_lazy_tlb_enter(void)
+{
+	mycpu()->arch_data.tlb_lazy = 1;
+}
+
+//lazy_tlb_leave - stop borrowing, return true if cr3 can stay as it is
+static bool lazy_tlb_leave(uintptr_t cr3)
+{
+	struct __arch_cpu *c = &(mycpu()->arch_data);
+	if (!c->tlb_lazy)
+		return 0;
+	c->tlb_lazy = 0;
+	__sync_synchronize();
+	if (c->tlb_cr3 != cr3 || c->tlb_lazy_flush) {
+		c->tlb_lazy_flush = 0;
+		return 0;
+	}
+	return 1;
+}
+
+//lazy_tlb_defer - a shootdown for cpu, return true if it can wait
+static bool lazy_tlb_defer(struct cpu *cpu)
+{
+	cpu->arch_data.tlb_lazy_flush = 1;
+	__sync_synchronize();
+	return cpu->arch_data.tlb_lazy;
+}
+
+/* *
+ * mp_lazy_tlb_drop - pgdir is about to be freed, make the cpus that
+ * borrow it switch to boot_cr3, see mp_tlb_flush_ipi
+ * */
+void mp_lazy_tlb_drop(pgd_t * pgdir)
+{
+	uintptr_t cr3 = PADDR(pgdir);
+	int i;
+	if (mycpu()->arch_data.tlb_cr3 == cr3) {
+		mycpu()->arch_data.tlb_lazy = 0;
+		mp_lcr3(boot_cr3);
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct cpu *cpu = per_cpu_ptr(cpus, i);
+		if (cpu->id == myid() || cpu->arch_data.tlb_cr3 != cr3)
+			continue;
+		lapic_send_ipi(cpu, T_TLBFLUSH);
+		while (cpu->arch_data.tlb_cr3 == cr3)
+			nop_pause();
+	}
+}
+#endif
+
 void mp_set_mm_pagetable(struct mm_struct *mm)
 {
-	struct cpu *cpu = mycpu();
 	uintptr_t new_cr3;
+	bool keep = 0;
 	if (mm != NULL && mm->pgdir != NULL)
 		new_cr3 = PADDR(mm->pgdir);
 	else
 		new_cr3 = boot_cr3;
+#ifdef UCONFIG_LAZY_TLB
+	keep = lazy_tlb_leave(new_cr3);
+#endif
+#ifdef UCONFIG_PCID
+	if (pcid_enabled && mm != NULL && mm->pgdir != NULL) {
+		bool intr_flag;
+		local_intr_save(intr_flag);
+		new_cr3 = pcid_switch(mm);
+		/* a thread of the same mm, and nothing to drop */
+		if ((rcr3() | CR3_NOFLUSH) != new_cr3)
+			lcr3(new_cr3);
+		local_intr_restore(intr_flag);
+		return;
+	}
+#endif
+	if (!keep)
+		mp_lcr3(new_cr3);
+}
 
-	mp_lcr3(new_cr3);
+//mp_tlb_flush_ipi - T_TLBFLUSH, flush the whole tlb of the page table loaded here
+void mp_tlb_flush_ipi(void)
+{
+#ifdef UCONFIG_LAZY_TLB
+	struct __arch_cpu *c = &(mycpu()->arch_data);
+	if (c->tlb_lazy) {
+		/* maybe mp_lazy_tlb_drop is waiting for us */
+		c->tlb_lazy = 0;
+		mp_lcr3(boot_cr3);
+		return;
+	}
+	c->tlb_lazy_flush = 0;
+#endif
+#ifdef UCONFIG_PCID
+	/* the sender did not say which pcid */
+	pcid_flush_all();
+#else
+	lcr3(rcr3());
+#endif
 }
 
 pgd_t *mpti_pgdir;
@@ -200,12 +496,23 @@ static void shootdown_tlb_all(pgd_t *pgdir)
 {
 	int i;
 	//dump_processors();
+#ifdef UCONFIG_PCID
+	pcid_flush_others(pgdir);
+#endif
 	for(i=0;i<sysconf.lcpu_count;i++){
 		struct cpu *cpu = per_cpu_ptr(cpus, i);
 		if(cpu->id == myid())
 			continue;
 		if(cpu->arch_data.tlb_cr3 != PADDR(pgdir))
 			continue;
+#ifdef UCONFIG_LAZY_TLB
+		if (lazy_tlb_defer(cpu))
+			continue;
+#endif
+#ifdef UCONFIG_KVM_GUEST
+		if (kvm_tlb_defer(i))
+			continue;
+#endif
 		//kprintf("XX_TLB_SHUTDOWN %d %d\n", myid(), i);
 		lapic_send_ipi(cpu, T_TLBFLUSH);
 	}
@@ -223,8 +530,169 @@ void mp_tlb_update(pgd_t * pgdir, uintptr_t la)
 	shootdown_tlb_all(pgdir);
 }
 
+struct tlb_flush_range {
+	pgd_t *pgdir;
+	uintptr_t start, end;
+};
+
+static void tlb_flush_range_local(struct tlb_flush_range *r)
+{
+	uintptr_t la;
+	if ((rcr3() & ~CR3_PCID_MASK) != PADDR_DIRECT(r->pgdir)) {
+#ifdef UCONFIG_PCID
+		/* switched away before the flush came */
+		pcid_flush_local(PADDR_DIRECT(r->pgdir));
+#endif
+		return;
+	}
+	if (r->end - r->start > TLB_FLUSH_ALL_PAGES * PGSIZE) {
+		lcr3(rcr3());
+	} else {
+		for (la = r->start; la < r->end; la += PGSIZE) {
+			invlpg((void *)la);
+		}
+	}
+#ifdef UCONFIG_LAZY_TLB
+	/* any shootdown that skipped us was seen when lazy mode ended */
+	if (!mycpu()->arch_data.tlb_lazy)
+		mycpu()->arch_data.tlb_lazy_flush = 0;
+#endif
+#ifdef UCONFIG_PCID
+	pcid_flushed_current();
+#endif
+}
+
+#ifdef UCONFIG_ENABLE_IPI
+static void tlb_flush_range_ipi(struct ipi_call *call)
+{
+	tlb_flush_range_local(call->private_data);
+}
+#endif
+
+/**
+ * mp_tlb_flush_range - flush [start, end) of pgdir here, and on the other
+ * cpus that have pgdir loaded with one IPI each. The IPI is synchronous
+ * when possible, so that the caller may free the pages afterwards.
+ */
+void mp_tlb_flush_range(pgd_t * pgdir, uintptr_t start, uintptr_t end)
+{
+	struct tlb_flush_range r = { pgdir, start, end };
+	cpuset_t cs;
+	int i, n = 0;
+	tlb_flush_range_local(&r);
+#ifdef UCONFIG_PCID
+	pcid_flush_others(pgdir);
+#endif
+
+	memset(&cs, 0, sizeof(cs));
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct cpu *cpu = per_cpu_ptr(cpus, i);
+		if (cpu->id == myid() || cpu->arch_data.tlb_cr3 != PADDR(pgdir))
+			continue;
+#ifdef UCONFIG_LAZY_TLB
+		if (lazy_tlb_defer(cpu))
+			continue;
+#endif
+#ifdef UCONFIG_KVM_GUEST
+		/* flushed by the host before it runs again */
+		if (kvm_tlb_defer(i))
+			continue;
+#endif
+		cpuset_set(&cs, i);
+		n++;
+	}
+	if (n == 0)
+		return;
+#ifdef UCONFIG_ENABLE_IPI
+	/* waiting with interrupts off could deadlock against another sender */
+	if (read_rflags() & FL_IF) {
+		ipi_run_on_cpu(&cs, &r, tlb_flush_range_ipi);
+		return;
+	}
+#endif
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (cpuset_test(&cs, i))
+			lapic_send_ipi(per_cpu_ptr(cpus, i), T_TLBFLUSH);
+	}
+}
+
+#ifdef UCONFIG_ENABLE_IPI
+static void tlb_flush_kernel_ipi(struct ipi_call *call)
+{
+	mp_tlb_flush_ipi();
+}
+#endif
+
+/**
+ * mp_tlb_flush_kernel - flush the whole tlb of every cpu, whatever page
+ * table it has loaded and however lazy, for the kernel mappings vmalloc
+ * has taken down. It waits for the others when possible, vmalloc hands
+ * the addresses out again afterwards.
+ */
+void mp_tlb_flush_kernel(void)
+{
+	cpuset_t cs;
+	int i;
+#ifdef UCONFIG_PCID
+	pcid_flush_all();
+#else
+	lcr3(rcr3());
+#endif
+	memset(&cs, 0, sizeof(cs));
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (i != myid())
+			cpuset_set(&cs, i);
+	}
+#ifdef UCONFIG_ENABLE_IPI
+	if (read_rflags() & FL_IF) {
+		ipi_run_on_cpu(&cs, NULL, tlb_flush_kernel_ipi);
+		return;
+	}
+#endif
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (cpuset_test(&cs, i))
+			lapic_send_ipi(per_cpu_ptr(cpus, i), T_TLBFLUSH);
+	}
+}
+
 void fire_ipi_one(int cpuid)
 {
 	lapic_send_ipi(per_cpu_ptr(cpus, cpuid), T_IPICALL);
 }
 
+//fire_ipi_mask - ring the cpus of cs, with a single broadcast if that is all the others
+void fire_ipi_mask(const cpuset_t *cs)
+{
+	struct lapic_chip *chip = lapic_get_chip();
+	int i, n = 0;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (cpuset_test(cs, i))
+			n++;
+	}
+	if (n == 0)
+		return;
+	if (chip->send_ipi_allbutself != NULL && n == sysconf.lcpu_count - 1
+	    && !cpuset_test(cs, myid())) {
+		trace_event(TRACE_IPI_SEND, -1, T_IPICALL);
+		chip->send_ipi_allbutself(chip, T_IPICALL);
+		return;
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (cpuset_test(cs, i))
+			fire_ipi_one(i);
+	}
+}
+
+
+// mp_resched_cpu - interrupt cpu so that it reschedules on its way back to
+//                - user mode, as need_resched of its current is set
+void mp_resched_cpu(int cpu)
+{
+#ifdef UCONFIG_MWAIT_IDLE
+	/* the flag written wakes it up if it idles in mwait */
+	if (mwait_wake_cpu(cpu)) {
+		return;
+	}
+#endif
+	lapic_send_ipi(per_cpu_ptr(cpus, cpu), T_RESCHED);
+}
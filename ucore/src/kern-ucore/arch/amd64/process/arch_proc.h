@@ -3,6 +3,8 @@
 
 #include <types.h>
 
+struct fpu_state;
+
 struct context {
 	uint64_t rip;
 	uint64_t rsp;
@@ -24,6 +26,9 @@ struct context {
 
 /* The architecture-dependent part of the PCB */
 struct arch_proc_struct {
+	struct fpu_state *fpu;	// NULL until its first use, see fpu.c
+	int fpu_cpu;		// where its state was last restored, -1 before
+	uint32_t perf;		// the ids of its counters, see perf.c
 };
 
 #endif /* !__ARCH_PROC_H__ */
@@ -0,0 +1,269 @@
+#include <types.h>
+#include <arch.h>
+#include <mmu.h>
+#include <string.h>
+#include <stdio.h>
+#include <kio.h>
+#include <error.h>
+#include <assert.h>
+#include <sync.h>
+#include <slab.h>
+#include <mp.h>
+#include <percpu.h>
+#include <proc.h>
+#include <sched.h>
+#include <cpuid.h>
+#include <fpu.h>
+
+/* *
+ * The x87/SSE/AVX registers are saved eagerly and restored lazily: the
+ * switch away from a thread whose state is in the registers saves it with
+ * XSAVEOPT, which skips what did not change since it was restored, and
+ * the switch to a thread sets CR0.TS unless its state is still the one in
+ * the registers of this cpu. Its first FPU or SIMD instruction then traps
+ * (#NM, T_DEVICE), and fpu_device_not_available clears CR0.TS and restores
+ * it with XRSTOR, so a thread which does not use them costs nothing more.
+ *
+ * A thread has no XSAVE area until it first uses them, and starts from
+ * fpu_init_state then. The owner of a cpu is the thread its registers were
+ * last restored for, valid only while the fpu_cpu of the thread is still
+ * that cpu: it may have run and used them elsewhere meanwhile.
+ *
+ * The kernel is built with -mno-sse and friends, and uses the registers
+ * only between kernel_fpu_begin and kernel_fpu_end.
+ * */
+
+/* the components enabled in XCR0, AVX at most */
+#define XSTATE_SUPPORTED                (XSTATE_FP | XSTATE_SSE | XSTATE_YMM)
+#define FXSAVE_SIZE                     512
+#define XSAVE_ALIGN                     64
+
+/* offsets in the legacy area of FXSAVE and XSAVE */
+#define FPU_FCW_OFFSET                  0
+#define FPU_MXCSR_OFFSET                24
+#define FPU_FCW_DEFAULT                 0x37f
+#define FPU_MXCSR_DEFAULT               0x1f80
+
+struct fpu_cpu {
+	struct proc_struct *owner;	// its state is in the registers
+};
+
+static DEFINE_PERCPU_NOINIT(struct fpu_cpu, fpu_cpus);
+
+static bool fpu_xsave, fpu_xsaveopt;
+static uint64_t fpu_xstate_mask;
+static size_t fpu_xstate_size = FXSAVE_SIZE;
+static kmem_cache_t *fpu_cachep;
+static struct fpu_state *fpu_init_state;
+
+static inline void clts(void)
+{
+	asm volatile ("clts":::"memory");
+}
+
+static inline void stts(void)
+{
+	lcr0(rcr0() | CR0_TS);
+}
+
+static inline void xsetbv(uint32_t index, uint64_t value)
+{
+	asm volatile ("xsetbv"::"c" (index), "a"((uint32_t) value),
+		      "d"((uint32_t) (value >> 32)));
+}
+
+// fpu_save - the registers into state, with CR0.TS clear
+static void fpu_save(struct fpu_state *state)
+{
+	if (fpu_xsaveopt) {
+		asm volatile ("xsaveopt64 (%0)"::"r" (state), "a"(-1), "d"(-1)
+			      :"memory");
+	} else if (fpu_xsave) {
+		asm volatile ("xsave64 (%0)"::"r" (state), "a"(-1), "d"(-1)
+			      :"memory");
+	} else {
+		asm volatile ("fxsave64 (%0)"::"r" (state):"memory");
+	}
+}
+
+// fpu_restore - state into the registers, with CR0.TS clear
+static void fpu_restore(struct fpu_state *state)
+{
+	if (fpu_xsave) {
+		asm volatile ("xrstor64 (%0)"::"r" (state), "a"(-1), "d"(-1)
+			      :"memory");
+	} else {
+		asm volatile ("fxrstor64 (%0)"::"r" (state):"memory");
+	}
+}
+
+// fpu_live - whether the registers of this cpu are those of proc, with
+//          - interrupts disabled
+static inline bool fpu_live(struct proc_struct *proc)
+{
+	return get_cpu_ptr(fpu_cpus)->owner == proc && !(rcr0() & CR0_TS);
+}
+
+// fpu_init_cpu - enable SSE, and XSAVE with the components of XCR0, on
+//              - this cpu; the boot cpu decides for all of them
+void fpu_init_cpu(void)
+{
+	uint64_t cr4;
+	if (myid() == 0) {
+		if (!cpuid_check_feature(CPUID_FEATURE_FXSR)) {
+			panic("fpu: no fxsave.\n");
+		}
+		fpu_xsave = (cpuid_check_feature(CPUID_FEATURE_XSAVE) != 0);
+		fpu_xsaveopt = (cpuid_check_feature(CPUID_FEATURE_XSAVEOPT) != 0);
+		if (fpu_xsave) {
+			fpu_xstate_mask = cpuid_xstate_mask() & XSTATE_SUPPORTED;
+		}
+	}
+	cr4 = rcr4() | CR4_OSFXSR | CR4_OSXMMEXCPT;
+	if (fpu_xsave) {
+		cr4 |= CR4_OSXSAVE;
+	}
+	lcr4(cr4);
+	if (fpu_xsave) {
+		xsetbv(0, fpu_xstate_mask);
+		if (myid() == 0) {
+			fpu_xstate_size = cpuid_xstate_size();
+		}
+	}
+	get_cpu_ptr(fpu_cpus)->owner = NULL;
+	/* the first use of each thread traps */
+	stts();
+}
+
+void fpu_init(void)
+{
+	fpu_cachep = kmem_cache_create("fpu_state", fpu_xstate_size,
+				       XSAVE_ALIGN, NULL);
+	if (fpu_cachep == NULL
+	    || (fpu_init_state = kmem_cache_alloc(fpu_cachep)) == NULL) {
+		panic("cannot create fpu_state cache.\n");
+	}
+	/* with XSTATE_BV of the header 0, XRSTOR loads the init state of
+	 * every component but MXCSR */
+	memset(fpu_init_state, 0, fpu_xstate_size);
+	*(uint16_t *) ((char *)fpu_init_state + FPU_FCW_OFFSET) =
+	    FPU_FCW_DEFAULT;
+	*(uint32_t *) ((char *)fpu_init_state + FPU_MXCSR_OFFSET) =
+	    FPU_MXCSR_DEFAULT;
+	kprintf("fpu: %s, %d bytes of state, xcr0 0x%x\n",
+		fpu_xsaveopt ? "xsaveopt" : (fpu_xsave ? "xsave" : "fxsave"),
+		(int)fpu_xstate_size, (uint32_t) fpu_xstate_mask);
+}
+
+// fpu_device_not_available - #NM of current in user mode: restore its
+//                          - state, the initial one on its first use
+int fpu_device_not_available(void)
+{
+	struct proc_struct *proc = current;
+	struct arch_proc_struct *arch = &(proc->arch);
+	bool intr_flag;
+	if (arch->fpu == NULL) {
+		if ((arch->fpu = kmem_cache_alloc(fpu_cachep)) == NULL) {
+			return -E_NO_MEM;
+		}
+		memcpy(arch->fpu, fpu_init_state, fpu_xstate_size);
+	}
+	local_intr_save(intr_flag);
+	{
+		clts();
+		fpu_restore(arch->fpu);
+		get_cpu_ptr(fpu_cpus)->owner = proc;
+		arch->fpu_cpu = myid();
+	}
+	local_intr_restore(intr_flag);
+	return 0;
+}
+
+// fpu_switch - from prev to next on this cpu, called by proc_run with
+//            - interrupts disabled
+void fpu_switch(struct proc_struct *prev, struct proc_struct *next)
+{
+	if (fpu_live(prev)) {
+		fpu_save(prev->arch.fpu);
+	}
+	if (get_cpu_ptr(fpu_cpus)->owner == next
+	    && next->arch.fpu_cpu == myid()) {
+		clts();
+	} else {
+		stts();
+	}
+}
+
+// fpu_copy - proc, forked from current, starts with its state
+int fpu_copy(struct proc_struct *proc, struct proc_struct *from)
+{
+	bool intr_flag;
+	assert(from == current);
+	if (from->arch.fpu == NULL) {
+		return 0;
+	}
+	if ((proc->arch.fpu = kmem_cache_alloc(fpu_cachep)) == NULL) {
+		return -E_NO_MEM;
+	}
+	local_intr_save(intr_flag);
+	{
+		if (fpu_live(from)) {
+			fpu_save(from->arch.fpu);
+		}
+		memcpy(proc->arch.fpu, from->arch.fpu, fpu_xstate_size);
+	}
+	local_intr_restore(intr_flag);
+	return 0;
+}
+
+// fpu_reset - current execs, its next use starts from the initial state
+void fpu_reset(struct proc_struct *proc)
+{
+	bool intr_flag;
+	assert(proc == current);
+	local_intr_save(intr_flag);
+	{
+		struct fpu_cpu *fc = get_cpu_ptr(fpu_cpus);
+		if (fc->owner == proc) {
+			fc->owner = NULL;
+			stts();
+		}
+		if (proc->arch.fpu != NULL) {
+			memcpy(proc->arch.fpu, fpu_init_state, fpu_xstate_size);
+		}
+	}
+	local_intr_restore(intr_flag);
+}
+
+// fpu_free - proc is freed; an owner left behind on a cpu never matches
+//          - again, the fpu_cpu of a new proc is -1 until its first use
+void fpu_free(struct proc_struct *proc)
+{
+	if (proc->arch.fpu != NULL) {
+		kmem_cache_free(fpu_cachep, proc->arch.fpu);
+		proc->arch.fpu = NULL;
+	}
+}
+
+void kernel_fpu_begin(void)
+{
+	bool intr_flag;
+	preempt_disable();
+	local_intr_save(intr_flag);
+	{
+		struct fpu_cpu *fc = get_cpu_ptr(fpu_cpus);
+		if (fpu_live(current)) {
+			fpu_save(current->arch.fpu);
+		}
+		/* whoever owned them restores them on its next use */
+		fc->owner = NULL;
+		clts();
+	}
+	local_intr_restore(intr_flag);
+}
+
+void kernel_fpu_end(void)
+{
+	stts();
+	preempt_enable();
+}
@@ -0,0 +1,37 @@
+#ifndef __ARCH_FPU_H__
+#define __ARCH_FPU_H__
+
+#include <types.h>
+
+struct proc_struct;
+
+/* the state components of XCR0 */
+#define XSTATE_FP                       0x1	// x87
+#define XSTATE_SSE                      0x2	// XMM and MXCSR
+#define XSTATE_YMM                      0x4	// the upper halves of YMM, AVX
+
+/* *
+ * fpu_state - the x87/SSE/AVX registers of a thread, an XSAVE area (an
+ * FXSAVE one without XSAVE) of fpu_xstate_size bytes from fpu_cachep,
+ * which is why it has no members: the layout is that of the cpu.
+ * */
+struct fpu_state;
+
+void fpu_init_cpu(void);
+void fpu_init(void);
+int fpu_device_not_available(void);
+void fpu_switch(struct proc_struct *prev, struct proc_struct *next);
+int fpu_copy(struct proc_struct *proc, struct proc_struct *from);
+void fpu_reset(struct proc_struct *proc);
+void fpu_free(struct proc_struct *proc);
+
+/* *
+ * kernel_fpu_begin/end - around kernel code using the x87/SSE/AVX
+ * registers, a SIMD copy or checksum: the state of current is saved first
+ * and restored on its next use. Not from an interrupt handler, and not
+ * sleeping in between, preemption is off.
+ * */
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+#endif /* !__ARCH_FPU_H__ */
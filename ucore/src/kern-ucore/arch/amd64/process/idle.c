@@ -0,0 +1,167 @@
+#include <types.h>
+#include <arch.h>
+#include <proc.h>
+#include <sched.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <clock.h>
+#include <kio.h>
+#include <hz.h>
+#include <cpuid.h>
+#include <idle.h>
+
+/* *
+ * The idle loop waits in MWAIT on the need_resched of its idleproc, armed
+ * by MONITOR, instead of in HLT. A cpu that wants it to reschedule sees
+ * polling set and just writes the flag, the write wakes it up: no IPI is
+ * sent, see mwait_wake_cpu. MWAIT runs with interrupts off, an interrupt
+ * breaking it, so that polling is cleared before anything else runs on the
+ * cpu: a waker seeing it set knows the cpu still idles.
+ *
+ * The deeper the c-state asked for, the less power is drawn and the longer
+ * the cpu takes to wake up, and the longer it has to stay there for that to
+ * pay. The deepest one is taken whose target residency the expected idle
+ * time covers, with an exit latency a small part of it. The idle times are
+ * expected from those of late, an average, and end at the next tick unless
+ * the tick is stopped.
+ * */
+
+/* the exit latency of a state is at most that part of the expected idle time */
+#define MWAIT_LATENCY_FACTOR            4
+#define MWAIT_MAX_STATES                8
+
+struct mwait_state {
+	uint32_t hint;		// eax of mwait, (c-state - 1) << 4
+	uint32_t exit_latency;	// us to wake up from it
+	uint32_t target_residency;	// us to idle there for it to pay
+};
+
+/* *
+ * The latencies of the c-states by their mwait number, those of the cores
+ * of late, taken for each rather than read per model or from ACPI _CST.
+ * A c-state is there if cpuid 5 lists a sub-state of it.
+ * */
+static const struct mwait_state mwait_cstates[MWAIT_MAX_STATES] = {
+	{0x00, 0, 0},		/* C0, not an idle state */
+	{0x00, 2, 2},		/* C1 */
+	{0x10, 40, 100},	/* C3 */
+	{0x20, 130, 400},	/* C6 */
+	{0x30, 250, 800},	/* C7 */
+	{0x40, 400, 1500},
+	{0x50, 600, 2500},
+	{0x60, 1000, 5000},
+};
+
+static struct mwait_state mwait_states[MWAIT_MAX_STATES];
+static int mwait_nr_states;
+
+struct mwait_cpu {
+	volatile bool polling;	// in mwait on need_resched of idleproc
+	uint64_t idle_us;	// the idle times of late, a running average
+};
+
+static DEFINE_PERCPU_NOINIT(struct mwait_cpu, mwait_cpus);
+
+// mwait_idle_init - the c-states mwait has, none without the break of
+//                 - masked interrupts
+void mwait_idle_init(void)
+{
+	uint32_t substates = cpuid_mwait_substates();
+	int i;
+	if (!cpuid_check_feature(CPUID_FEATURE_MONITOR)
+	    || !cpuid_check_feature(CPUID_FEATURE_MWAIT_BREAK)) {
+		kprintf("mwait idle: not supported, halting instead.\n");
+		return;
+	}
+	for (i = 1; i < MWAIT_MAX_STATES; i++) {
+		if ((substates >> (i * 4)) & 0xf) {
+			mwait_states[mwait_nr_states++] = mwait_cstates[i];
+		}
+	}
+	if (mwait_nr_states == 0) {
+		/* not enumerated, C1 is always there */
+		mwait_states[mwait_nr_states++] = mwait_cstates[1];
+	}
+	kprintf("mwait idle: %d c-states.\n", mwait_nr_states);
+}
+
+// mwait_select - the deepest state worth entering for the idle time mc
+//              - expects
+static const struct mwait_state *mwait_select(struct mwait_cpu *mc)
+{
+	uint64_t expected = mc->idle_us;
+	int i;
+#ifndef UCONFIG_NO_HZ_IDLE
+	/* woken up by the next tick at the latest */
+	if (expected > TIMER_TICK_NSEC / 1000) {
+		expected = TIMER_TICK_NSEC / 1000;
+	}
+#endif
+	for (i = mwait_nr_states - 1; i > 0; i--) {
+		const struct mwait_state *s = &mwait_states[i];
+		if (s->target_residency <= expected
+		    && s->exit_latency * MWAIT_LATENCY_FACTOR <= expected) {
+			break;
+		}
+	}
+	return &mwait_states[i];
+}
+
+// mwait_idle - idle once in mwait, or return 0 if it is not there; called
+//            - by idleproc with interrupts on
+bool mwait_idle(void)
+{
+	struct mwait_cpu *mc;
+	const struct mwait_state *state;
+	struct proc_struct *idle = current;
+	uint64_t start, us;
+	if (mwait_nr_states == 0) {
+		return 0;
+	}
+	cli();
+	mc = get_cpu_ptr(mwait_cpus);
+	state = mwait_select(mc);
+#ifdef UCONFIG_NO_HZ_IDLE
+	tick_nohz_idle_enter();
+#endif
+	mc->polling = 1;
+	/* polling is seen before need_resched is read, see mwait_wake_cpu */
+	__sync_synchronize();
+	start = rdtsc();
+	if (!idle->need_resched) {
+		cpu_monitor(&(idle->need_resched));
+		if (!idle->need_resched) {
+			/* a pending interrupt breaks it even though masked */
+			cpu_mwait(state->hint, 1);
+		}
+	}
+	mc->polling = 0;
+	if (cpuhz != 0) {
+		us = (rdtsc() - start) * 1000000 / cpuhz;
+		mc->idle_us = (mc->idle_us * 7 + us) / 8;
+	}
+#ifdef UCONFIG_NO_HZ_IDLE
+	/* woken by a write, no interrupt restarts the tick */
+	tick_nohz_idle_exit();
+#endif
+	sti();
+	if (idle->need_resched) {
+		schedule();
+	}
+	return 1;
+}
+
+// mwait_wake_cpu - make cpu reschedule by a write if it idles in mwait,
+//                - return 0 if it needs the IPI
+bool mwait_wake_cpu(int cpu)
+{
+	/* the work queued for it is seen before polling is read */
+	__sync_synchronize();
+	if (!per_cpu_ptr(mwait_cpus, cpu)->polling) {
+		return 0;
+	}
+	/* polling, the current of cpu is its idleproc */
+	per_cpu_ptr(cpus, cpu)->__current->need_resched = 1;
+	return 1;
+}
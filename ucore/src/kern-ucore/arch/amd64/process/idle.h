@@ -0,0 +1,12 @@
+#ifndef __ARCH_IDLE_H__
+#define __ARCH_IDLE_H__
+
+#include <types.h>
+
+#ifdef UCONFIG_MWAIT_IDLE
+void mwait_idle_init(void);
+bool mwait_idle(void);
+bool mwait_wake_cpu(int cpu);
+#endif
+
+#endif /* !__ARCH_IDLE_H__ */
@@ -5,6 +5,12 @@
 #include <types.h>
 #include <stdlib.h>
 #include <mp.h>
+#include <arch.h>
+#include <clock.h>
+#include <error.h>
+#include <fpu.h>
+#include <msrbits.h>
+#include <idle.h>
 
 void forkret(void);
 void forkrets(struct trapframe *tf);
@@ -12,7 +18,7 @@ void forkrets(struct trapframe *tf);
 // alloc_proc - create a proc struct and init fields
 struct proc_struct *alloc_proc(void)
 {
-	struct proc_struct *proc = kmalloc(sizeof(struct proc_struct));
+	struct proc_struct *proc = kmem_cache_alloc(proc_cachep);
 	if (proc != NULL) {
 		proc->state = PROC_UNINIT;
 		proc->pid = -1;
@@ -32,10 +38,41 @@ struct proc_struct *alloc_proc(void)
 		proc->rq = NULL;
 		list_init(&(proc->run_link));
 		proc->time_slice = 0;
+		proc->vruntime = 0;
+		proc->nice = 0;
+		proc->timer_slack = 0;
+		proc->policy = SCHED_NORMAL;
+		proc->rt_priority = 0;
+		proc->normal_policy = SCHED_NORMAL;
+		proc->normal_prio = 0;
+		proc->pi_prio = 0;
+		list_init(&(proc->pi_held));
+		proc->pi_blocked_on = NULL;
+		proc->pi_exited = 0;
+		proc->runtime = 0;
+		proc->exec_start = 0;
+		proc->last_ran = 0;
+		memset(&(proc->rusage), 0, sizeof(struct rusage));
+		memset(&(proc->child_rusage), 0, sizeof(struct rusage));
+#ifdef UCONFIG_SCHEDSTATS
+		proc->sched_enqueued = proc->sched_ran = 0;
+		memset(&(proc->sched_stat), 0, sizeof(struct sched_stat));
+#endif
 		proc->sem_queue = NULL;
 		event_box_init(&(proc->event_box));
 		proc->fs_struct = NULL;
+#ifdef UCONFIG_MEMCG
+		proc->memcg = NULL;
+#endif
+#ifdef UCONFIG_CPUCG
+		proc->cpucg = NULL;
+		list_init(&(proc->cg_link));
+#endif
 		proc->cpu_affinity = myid();
+		proc->arch.fpu = NULL;
+		proc->arch.fpu_cpu = -1;
+		proc->arch.perf = 0;
+		proc->tls_pointer = NULL;
 		spinlock_init(&proc->lock);
 	}
 	return proc;
@@ -46,6 +83,9 @@ copy_thread(uint32_t clone_flags, struct proc_struct *proc, uintptr_t rsp,
 	    struct trapframe *tf)
 {
 	uintptr_t kstacktop = proc->kstack + KSTACKSIZE;
+	if (fpu_copy(proc, current) != 0) {
+		return -E_NO_MEM;
+	}
 	proc->tf = (struct trapframe *)kstacktop - 1;
 	*(proc->tf) = *tf;
 	proc->tf->tf_regs.reg_rax = 0;
@@ -121,20 +161,87 @@ init_new_context(struct proc_struct *proc, struct elfhdr *elf,
 	return 0;
 }
 
+#ifdef UCONFIG_DYNAMIC_LINK
+// init_new_context_interp - as init_new_context, but start at entry, of the
+//                         - interpreter, with the program headers of the
+//                         - program and an aux vector pointing at them
+//                         - pushed under argv; rdx holds the aux vector
+int
+init_new_context_interp(struct proc_struct *proc, struct elfhdr *elf,
+			int argc, char **kargv, int envc, char **kenvp,
+			uintptr_t entry, struct exec_auxv *auxv)
+{
+	size_t phsize = sizeof(struct proghdr) * auxv->phnum;
+	uintptr_t phdr, *uauxv;
+	int ret;
+	ret = init_new_context(proc, elf, argc, kargv, envc, kenvp);
+	if (ret != 0) {
+		return ret;
+	}
+
+	struct trapframe *tf = current->tf;
+	phdr = ROUNDDOWN(tf->tf_rsp - phsize, 16);
+	memcpy((void *)phdr, auxv->phdr, phsize);
+	uauxv = (uintptr_t *) phdr - 12;
+	uauxv[0] = ELF_AT_PHDR, uauxv[1] = phdr;
+	uauxv[2] = ELF_AT_PHENT, uauxv[3] = sizeof(struct proghdr);
+	uauxv[4] = ELF_AT_PHNUM, uauxv[5] = auxv->phnum;
+	uauxv[6] = ELF_AT_ENTRY, uauxv[7] = auxv->entry;
+	uauxv[8] = ELF_AT_BASE, uauxv[9] = auxv->base;
+	uauxv[10] = ELF_AT_NULL, uauxv[11] = 0;
+
+	tf->tf_rsp = (uintptr_t) uauxv;
+	tf->tf_rip = entry;
+	tf->tf_regs.reg_rdx = (uintptr_t) uauxv;
+	return 0;
+}
+#endif
+
 // cpu_idle - at the end of kern_init, the first kernel thread idleproc will do below works
 void cpu_idle(void)
 {
 	while (1) {
 		assert((read_rflags() & FL_IF) != 0);
+#ifdef UCONFIG_PREZERO_PAGES
+		/* a wakeup preempts the clearing, idleproc reschedules on irq */
+		if (prezero_pages() != 0) {
+			continue;
+		}
+#endif
+#ifdef UCONFIG_MWAIT_IDLE
+		if (mwait_idle()) {
+			continue;
+		}
+#endif
+#ifdef UCONFIG_NO_HZ_IDLE
+		cli();
+		tick_nohz_idle_enter();
+		/* sti takes effect after hlt, no wakeup is lost in between */
+		asm volatile ("sti; hlt");
+#else
 		asm volatile ("hlt");
+#endif
 	}
 }
 
 int do_execve_arch_hook(int argc, char **kargv)
 {
+	fpu_reset(current);
 	return 0;
 }
 
+#ifdef UCONFIG_CHECKPOINT
+// restore_tf_arch_hook - the user registers of saved, of a checkpoint image,
+//                      - into tf; its segments and flags stay, an image may
+//                      - not raise its privileges
+void restore_tf_arch_hook(struct trapframe *tf, const struct trapframe *saved)
+{
+	tf->tf_regs = saved->tf_regs;
+	tf->tf_rip = saved->tf_rip;
+	tf->tf_rsp = saved->tf_rsp;
+}
+#endif
+
 int ucore_kernel_thread(int (*fn) (void *), void *arg, uint32_t clone_flags)
 {
 	kernel_thread(fn, arg, clone_flags);
@@ -143,3 +250,25 @@ int ucore_kernel_thread(int (*fn) (void *), void *arg, uint32_t clone_flags)
 void de_thread_arch_hook(struct proc_struct *proc)
 {
 }
+
+// tls_switch - the fs base of next, unless it is loaded already or next
+//            - is a kernel thread; with FSGSBASE user space may have moved
+//            - it with WRFSBASE, read back for prev first
+void tls_switch(struct proc_struct *prev, struct proc_struct *next)
+{
+	struct __arch_cpu *ac = &(mycpu()->arch_data);
+	uintptr_t tls = (uintptr_t) next->tls_pointer;
+	if (x86_fsgsbase && prev != NULL && prev->mm != NULL) {
+		ac->fs_base = rdfsbase();
+		prev->tls_pointer = (void *)ac->fs_base;
+	}
+	if (next->mm == NULL || (prev != NULL && tls == ac->fs_base)) {
+		return;
+	}
+	if (x86_fsgsbase) {
+		wrfsbase(tls);
+	} else {
+		writemsr(MSR_FS_BASE, tls);
+	}
+	ac->fs_base = tls;
+}
@@ -3,16 +3,38 @@
 #include <trap.h>
 #include <stdio.h>
 #include <pmm.h>
+#include <vmm.h>
+#include <memcg.h>
+#include <cpucg.h>
 #include <clock.h>
 #include <error.h>
 #include <assert.h>
 #include <sem.h>
+#include <futex.h>
 #include <event.h>
 #include <mbox.h>
 #include <stat.h>
 #include <dirent.h>
 #include <sysfile.h>
 #include <kio.h>
+#include <linux_misc_struct.h>
+#include <batch.h>
+#include <trace.h>
+#include <sysrec.h>
+#include <kbench.h>
+#ifdef UCONFIG_SAMPLE_PROFILER
+#include <kprof.h>
+#endif
+#ifdef UCONFIG_PERF_EVENT
+#include <perf.h>
+#endif
+#ifdef UCONFIG_PROFILER_ON
+#include <ftrace.h>
+#endif
+#include <irqbalance.h>
+#ifdef UCONFIG_VIRTIO_NET
+#include <virtio_net.h>
+#endif
 
 static uint64_t sys_exit(uint64_t arg[])
 {
@@ -42,6 +64,34 @@ static uint64_t sys_exec(uint64_t arg[])
 	return do_execve(name, argv, envp);
 }
 
+static uint64_t sys_spawn(uint64_t arg[])
+{
+	const char *name = (const char *)arg[0];
+	const char **argv = (const char **)arg[1];
+	const char **envp = (const char **)arg[2];
+	return do_spawn(name, argv, envp);
+}
+
+static uint64_t sys_checkpoint(uint64_t arg[])
+{
+#ifdef UCONFIG_CHECKPOINT
+	const char *path = (const char *)arg[0];
+	return do_checkpoint(path);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_restore(uint64_t arg[])
+{
+#ifdef UCONFIG_CHECKPOINT
+	const char *path = (const char *)arg[0];
+	return do_restore(path);
+#else
+	return -E_UNIMP;
+#endif
+}
+
 static uint64_t sys_clone(uint64_t arg[])
 {
 	struct trapframe *tf = current->tf;
@@ -76,6 +126,105 @@ static uint64_t sys_kill(uint64_t arg[])
 	return do_kill(pid, -E_KILLED);
 }
 
+static uint64_t sys_sched_setscheduler(uint64_t arg[])
+{
+	int pid = (int)arg[0];
+	int policy = (int)arg[1];
+	int prio = (int)arg[2];
+	return do_sched_setscheduler(pid, policy, prio);
+}
+
+static uint64_t sys_sched_getscheduler(uint64_t arg[])
+{
+	int pid = (int)arg[0];
+	return do_sched_getscheduler(pid);
+}
+
+static uint64_t sys_sched_getparam(uint64_t arg[])
+{
+	int pid = (int)arg[0];
+	return do_sched_getparam(pid);
+}
+
+static uint64_t sys_setpriority(uint64_t arg[])
+{
+	int pid = (int)arg[0];
+	int nice = (int)arg[1];
+	return do_setpriority(pid, nice);
+}
+
+static uint64_t sys_getpriority(uint64_t arg[])
+{
+	int pid = (int)arg[0];
+	int *nice_store = (int *)arg[1];
+	return do_getpriority(pid, nice_store);
+}
+
+static uint64_t sys_timerslack(uint64_t arg[])
+{
+	int pid = (int)arg[0];
+	int slack = (int)arg[1];
+	return do_timerslack(pid, slack);
+}
+
+static uint64_t sys_sched_setaffinity(uint64_t arg[])
+{
+	int pid = (int)arg[0];
+	size_t size = (size_t) arg[1];
+	const void *mask = (const void *)arg[2];
+	return do_sched_setaffinity(pid, size, mask);
+}
+
+static uint64_t sys_sched_getaffinity(uint64_t arg[])
+{
+	int pid = (int)arg[0];
+	size_t size = (size_t) arg[1];
+	void *mask = (void *)arg[2];
+	return do_sched_getaffinity(pid, size, mask);
+}
+
+static uint64_t sys_settls(uint64_t arg[])
+{
+	void *tls = (void *)arg[0];
+	return do_settls(tls);
+}
+
+static uint64_t sys_gettls(uint64_t arg[])
+{
+	return (uint64_t) do_gettls();
+}
+
+static uint64_t sys_irqaffinity(uint64_t arg[])
+{
+	int op = (int)arg[0];
+	int irq = (int)arg[1];
+	uint64_t *mask = (uint64_t *) arg[2];
+	return do_irqaffinity(op, irq, mask);
+}
+
+static uint64_t sys_pktio(uint64_t arg[])
+{
+#ifdef UCONFIG_VIRTIO_NET
+	int op = (int)arg[0];
+	uint32_t queue = (uint32_t) arg[1];
+	void *parg = (void *)arg[2];
+	return do_pktio(op, queue, parg);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_futex(uint64_t arg[])
+{
+	uintptr_t uaddr = (uintptr_t) arg[0];
+	int op = (int)arg[1];
+	int val = (int)arg[2];
+	uintptr_t utime = (uintptr_t) arg[3];
+	uintptr_t uaddr2 = (uintptr_t) arg[4];
+	/* no room for val3, the bitset ops wake and wait on any bit */
+	return do_futex(uaddr, op, val, utime, uaddr2, FUTEX_BITSET_MATCH_ANY);
+}
+
 static uint64_t sys_gettime(uint64_t arg[])
 {
 	return (int)ticks;
@@ -86,6 +235,125 @@ static uint64_t sys_getpid(uint64_t arg[])
 	return current->pid;
 }
 
+static uint64_t sys_vvar(uint64_t arg[])
+{
+	struct mm_struct *mm = current->mm;
+	return (mm != NULL) ? mm->vvar_addr : 0;
+}
+
+static uint64_t sys_settimeofday(uint64_t arg[])
+{
+	struct linux_timeval *tv = (struct linux_timeval *)arg[0];
+	return do_settimeofday(tv);
+}
+
+static uint64_t sys_adjtime(uint64_t arg[])
+{
+	struct linux_timeval *delta = (struct linux_timeval *)arg[0];
+	struct linux_timeval *olddelta = (struct linux_timeval *)arg[1];
+	return do_adjtime(delta, olddelta);
+}
+
+static uintptr_t syscall_dispatch(uintptr_t num, uintptr_t args[]);
+
+static uint64_t sys_batch(uint64_t arg[])
+{
+	struct syscall_rec *recs = (struct syscall_rec *)arg[0];
+	int n = (int)arg[1];
+	return do_syscall_batch(recs, n, syscall_dispatch);
+}
+
+static uint64_t sys_getrusage(uint64_t arg[])
+{
+	int who = (int)arg[0];
+	struct rusage *usage = (struct rusage *)arg[1];
+	return do_getrusage(who, usage);
+}
+
+static uint64_t sys_profile(uint64_t arg[])
+{
+#ifdef UCONFIG_SAMPLE_PROFILER
+	int op = (int)arg[0];
+	char *buf = (char *)arg[1];
+	size_t len = (size_t) arg[2];
+	return do_profile(op, buf, len);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_perf(uint64_t arg[])
+{
+#ifdef UCONFIG_PERF_EVENT
+	int op = (int)arg[0];
+	int id = (int)arg[1];
+	void *buf = (void *)arg[2];
+	return do_perf(op, id, buf);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_ftrace(uint64_t arg[])
+{
+#ifdef UCONFIG_PROFILER_ON
+	int op = (int)arg[0];
+	char *buf = (char *)arg[1];
+	size_t len = (size_t) arg[2];
+	return do_ftrace(op, buf, len);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_trace(uint64_t arg[])
+{
+#ifdef UCONFIG_TRACEPOINTS
+	int op = (int)arg[0];
+	uint32_t targ = (uint32_t) arg[1];
+	uintptr_t *addr_store = (uintptr_t *) arg[2];
+	return do_trace(op, targ, addr_store);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_sysrec(uint64_t arg[])
+{
+#ifdef UCONFIG_SYSREC
+	int op = (int)arg[0];
+	uint32_t sarg = (uint32_t) arg[1];
+	uintptr_t *addr_store = (uintptr_t *) arg[2];
+	return do_sysrec(op, sarg, addr_store);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_lockstat(uint64_t arg[])
+{
+#ifdef UCONFIG_LOCK_STAT
+	int op = (int)arg[0];
+	char *buf = (char *)arg[1];
+	size_t len = (size_t) arg[2];
+	return do_lockstat(op, buf, len);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_kbench(uint64_t arg[])
+{
+#ifdef UCONFIG_KBENCH
+	int op = (int)arg[0];
+	size_t karg = (size_t) arg[1];
+	int count = (int)arg[2];
+	return do_kbench(op, karg, count);
+#else
+	return -E_UNIMP;
+#endif
+}
+
 static uint64_t sys_brk(uint64_t arg[])
 {
 	uintptr_t *brk_store = (uintptr_t *) arg[0];
@@ -107,6 +375,21 @@ static uint64_t sys_munmap(uint64_t arg[])
 	return do_munmap(addr, len);
 }
 
+static uint64_t sys_mmap_file(uint64_t arg[])
+{
+#ifdef UCONFIG_DYNAMIC_LINK
+	uintptr_t *addr_store = (uintptr_t *) arg[0];
+	size_t len = (size_t) arg[1];
+	uint32_t mmap_flags = (uint32_t) arg[2];
+	int fd = (int)arg[3];
+	off_t offset = (off_t) arg[4];
+	size_t filesz = (size_t) arg[5];
+	return do_mmap_file(addr_store, len, mmap_flags, fd, offset, filesz);
+#else
+	return -E_UNIMP;
+#endif
+}
+
 static uint64_t sys_shmem(uint64_t arg[])
 {
 	uintptr_t *addr_store = (uintptr_t *) arg[0];
@@ -115,9 +398,92 @@ static uint64_t sys_shmem(uint64_t arg[])
 	return do_shmem(addr_store, len, mmap_flags);
 }
 
+static uint64_t sys_shm_open(uint64_t arg[])
+{
+	const char *name = (const char *)arg[0];
+	size_t len = (size_t) arg[1];
+	uint32_t mmap_flags = (uint32_t) arg[2];
+	uintptr_t *addr_store = (uintptr_t *) arg[3];
+	return do_shm_open(name, len, mmap_flags, addr_store);
+}
+
+static uint64_t sys_shm_unlink(uint64_t arg[])
+{
+	const char *name = (const char *)arg[0];
+	return do_shm_unlink(name);
+}
+
+static uint64_t sys_madvise(uint64_t arg[])
+{
+	void *addr = (void *)arg[0];
+	size_t len = (size_t) arg[1];
+	int advice = (int)arg[2];
+	return do_madvise(addr, len, advice);
+}
+
+static uint64_t sys_memcg(uint64_t arg[])
+{
+#ifdef UCONFIG_MEMCG
+	int op = (int)arg[0];
+	int id = (int)arg[1];
+	size_t arg0 = (size_t) arg[2];
+	uintptr_t arg1 = (uintptr_t) arg[3];
+	return do_memcg(op, id, arg0, arg1);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_cpucg(uint64_t arg[])
+{
+#ifdef UCONFIG_CPUCG
+	int op = (int)arg[0];
+	int id = (int)arg[1];
+	size_t arg0 = (size_t) arg[2];
+	uintptr_t arg1 = (uintptr_t) arg[3];
+	return do_cpucg(op, id, arg0, arg1);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+#ifdef UCONFIG_NUMA_POLICY
+static uint64_t sys_mempolicy(uint64_t arg[])
+{
+	int policy = (int)arg[0];
+	int node = (int)arg[1];
+	return do_mempolicy(policy, node);
+}
+
+static uint64_t sys_numa_stat(uint64_t arg[])
+{
+	int node = (int)arg[0];
+	struct numa_stat *stat = (struct numa_stat *)arg[1];
+	return do_numa_stat(node, stat);
+}
+
+static uint64_t sys_numa_info(uint64_t arg[])
+{
+	int node = (int)arg[0];
+	struct numa_info *info = (struct numa_info *)arg[1];
+	return do_numa_info(node, info);
+}
+#endif
+
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+static uint64_t sys_thp_stat(uint64_t arg[])
+{
+	struct thp_stat *stat = (struct thp_stat *)arg[0];
+	return do_thp_stat(stat);
+}
+#endif
+
 static uint64_t sys_putc(uint64_t arg[])
 {
 	int c = (int)arg[0];
+#ifdef UCONFIG_KLOG
+	klog_flush();
+#endif
 	cons_putc(c);
 	return 0;
 }
@@ -176,6 +542,15 @@ static uint64_t sys_event_recv(uint64_t arg[])
 	return ipc_event_recv(pid_store, event_store, timeout);
 }
 
+static uint64_t sys_event_call(uint64_t arg[])
+{
+	int pid = (int)arg[0];
+	int event = (int)arg[1];
+	int *reply_store = (int *)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return ipc_event_call(pid, event, reply_store, timeout);
+}
+
 static uint64_t sys_mbox_init(uint64_t arg[])
 {
 	unsigned int max_slots = (unsigned int)arg[0];
@@ -198,6 +573,24 @@ static uint64_t sys_mbox_recv(uint64_t arg[])
 	return ipc_mbox_recv(id, buf, timeout);
 }
 
+static uint64_t sys_mbox_sendm(uint64_t arg[])
+{
+	int id = (int)arg[0];
+	struct mboxbuf *bufs = (struct mboxbuf *)arg[1];
+	int n = (int)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return ipc_mbox_sendm(id, bufs, n, timeout);
+}
+
+static uint64_t sys_mbox_recvm(uint64_t arg[])
+{
+	int id = (int)arg[0];
+	struct mboxbuf *bufs = (struct mboxbuf *)arg[1];
+	int n = (int)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return ipc_mbox_recvm(id, bufs, n, timeout);
+}
+
 static uint64_t sys_mbox_free(uint64_t arg[])
 {
 	int id = (int)arg[0];
@@ -248,6 +641,24 @@ static uint64_t sys_seek(uint64_t arg[])
 	return sysfile_seek(fd, pos, whence);
 }
 
+static uint64_t sys_preadv(uint64_t arg[])
+{
+	int fd = (int)arg[0];
+	struct iovec *iov = (struct iovec *)arg[1];
+	int iovcnt = (int)arg[2];
+	off_t pos = (off_t) arg[3];
+	return sysfile_preadv(fd, iov, iovcnt, pos);
+}
+
+static uint64_t sys_pwritev(uint64_t arg[])
+{
+	int fd = (int)arg[0];
+	struct iovec *iov = (struct iovec *)arg[1];
+	int iovcnt = (int)arg[2];
+	off_t pos = (off_t) arg[3];
+	return sysfile_pwritev(fd, iov, iovcnt, pos);
+}
+
 static uint64_t sys_fstat(uint64_t arg[])
 {
 	int fd = (int)arg[0];
@@ -261,6 +672,15 @@ static uint64_t sys_fsync(uint64_t arg[])
 	return sysfile_fsync(fd);
 }
 
+static uint64_t sys_fallocate(uint64_t arg[])
+{
+	int fd = (int)arg[0];
+	int mode = (int)arg[1];
+	off_t off = (off_t) arg[2];
+	off_t len = (off_t) arg[3];
+	return sysfile_fallocate(fd, mode, off, len);
+}
+
 static uint64_t sys_chdir(uint64_t arg[])
 {
 	const char *path = (const char *)arg[0];
@@ -307,6 +727,14 @@ static uint64_t sys_getdirentry(uint64_t arg[])
 	return sysfile_getdirentry(fd, direntp, NULL);
 }
 
+static uint64_t sys_getdents(uint64_t arg[])
+{
+	int fd = (int)arg[0];
+	void *buf = (void *)arg[1];
+	size_t len = (size_t) arg[2];
+	return sysfile_getdents(fd, buf, len);
+}
+
 static uint64_t sys_dup(uint64_t arg[])
 {
 	int fd1 = (int)arg[0];
@@ -327,6 +755,136 @@ static uint64_t sys_mkfifo(uint64_t arg[])
 	return sysfile_mkfifo(name, open_flags);
 }
 
+static uint64_t sys_fcntl(uint64_t arg[])
+{
+	int fd = (int)arg[0];
+	int cmd = (int)arg[1];
+	int farg = (int)arg[2];
+	return sysfile_fcntl(fd, cmd, farg);
+}
+
+static uint64_t sys_splice(uint64_t arg[])
+{
+	int fd_in = (int)arg[0];
+	int fd_out = (int)arg[1];
+	size_t len = (size_t) arg[2];
+	return sysfile_splice(fd_in, fd_out, len, 0);
+}
+
+static uint64_t sys_tee(uint64_t arg[])
+{
+	int fd_in = (int)arg[0];
+	int fd_out = (int)arg[1];
+	size_t len = (size_t) arg[2];
+	return sysfile_splice(fd_in, fd_out, len, 1);
+}
+
+static uint64_t sys_sendfile(uint64_t arg[])
+{
+	int out_fd = (int)arg[0];
+	int in_fd = (int)arg[1];
+	off_t *offset = (off_t *) arg[2];
+	size_t count = (size_t) arg[3];
+	return sysfile_copy_file_range(in_fd, offset, out_fd, NULL, count);
+}
+
+static uint64_t sys_copy_file_range(uint64_t arg[])
+{
+	int fd_in = (int)arg[0];
+	off_t *off_in = (off_t *) arg[1];
+	int fd_out = (int)arg[2];
+	off_t *off_out = (off_t *) arg[3];
+	size_t len = (size_t) arg[4];
+	return sysfile_copy_file_range(fd_in, off_in, fd_out, off_out, len);
+}
+
+static uint64_t sys_epoll_create(uint64_t arg[])
+{
+	return sysfile_epoll_create();
+}
+
+static uint64_t sys_epoll_ctl(uint64_t arg[])
+{
+	int epfd = (int)arg[0];
+	int op = (int)arg[1];
+	int type = (int)arg[2];
+	int id = (int)arg[3];
+	struct epoll_event *event = (struct epoll_event *)arg[4];
+	return sysfile_epoll_ctl(epfd, op, type, id, event);
+}
+
+static uint64_t sys_epoll_wait(uint64_t arg[])
+{
+	int epfd = (int)arg[0];
+	struct epoll_event *events = (struct epoll_event *)arg[1];
+	int maxevents = (int)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return sysfile_epoll_wait(epfd, events, maxevents, timeout);
+}
+
+static uint64_t sys_socket(uint64_t arg[])
+{
+#ifdef UCONFIG_NET
+	int domain = (int)arg[0];
+	int type = (int)arg[1];
+	int protocol = (int)arg[2];
+	return sysfile_socket(domain, type, protocol);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_bind(uint64_t arg[])
+{
+#ifdef UCONFIG_NET
+	int fd = (int)arg[0];
+	const struct sockaddr_in *addr = (const struct sockaddr_in *)arg[1];
+	return sysfile_bind(fd, addr);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_listen(uint64_t arg[])
+{
+#ifdef UCONFIG_NET
+	int fd = (int)arg[0];
+	int backlog = (int)arg[1];
+	return sysfile_listen(fd, backlog);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_accept(uint64_t arg[])
+{
+#ifdef UCONFIG_NET
+	int fd = (int)arg[0];
+	struct sockaddr_in *addr = (struct sockaddr_in *)arg[1];
+	return sysfile_accept(fd, addr);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_connect(uint64_t arg[])
+{
+#ifdef UCONFIG_NET
+	int fd = (int)arg[0];
+	const struct sockaddr_in *addr = (const struct sockaddr_in *)arg[1];
+	return sysfile_connect(fd, addr);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint64_t sys_uring_enter(uint64_t arg[])
+{
+	struct uring_state *state = (struct uring_state *)arg[0];
+	unsigned int to_submit = (unsigned int)arg[1];
+	return sysfile_uring_enter(state, to_submit);
+}
+
 static uint64_t sys_halt(uint64_t arg[])
 {
 	do_halt();
@@ -338,17 +896,45 @@ static uint64_t(*syscalls[]) (uint64_t arg[]) = {
 	    [SYS_fork] sys_fork,
 	    [SYS_wait] sys_wait,
 	    [SYS_exec] sys_exec,
+	    [SYS_spawn] sys_spawn,
 	    [SYS_clone] sys_clone,
 	    [SYS_exit_thread] sys_exit_thread,
 	    [SYS_yield] sys_yield,
 	    [SYS_kill] sys_kill,
+	    [SYS_sched_setscheduler] sys_sched_setscheduler,
+	    [SYS_sched_getscheduler] sys_sched_getscheduler,
+	    [SYS_sched_getparam] sys_sched_getparam,
+	    [SYS_timerslack] sys_timerslack,
+	    [SYS_sched_setaffinity] sys_sched_setaffinity,
+	    [SYS_sched_getaffinity] sys_sched_getaffinity,
+	    [SYS_settls] sys_settls,
+	    [SYS_gettls] sys_gettls,
+	    [SYS_futex] sys_futex,
 	    [SYS_sleep] sys_sleep,
 	    [SYS_gettime] sys_gettime,
 	    [SYS_getpid] sys_getpid,
+	    [SYS_vvar] sys_vvar,
+	    [SYS_settimeofday] sys_settimeofday,
+	    [SYS_adjtime] sys_adjtime,
+	    [SYS_batch] sys_batch,
+	    [SYS_getrusage] sys_getrusage,
+	    [SYS_profile] sys_profile,
+	    [SYS_ftrace] sys_ftrace,
+	    [SYS_trace] sys_trace,
+	    [SYS_lockstat] sys_lockstat,
+	    [SYS_kbench] sys_kbench,
 	    [SYS_brk] sys_brk,
 	    [SYS_mmap] sys_mmap,
 	    [SYS_munmap] sys_munmap,
 	    [SYS_shmem] sys_shmem,
+#ifdef UCONFIG_NUMA_POLICY
+	    [SYS_mempolicy] sys_mempolicy,
+	    [SYS_numa_stat] sys_numa_stat,
+	    [SYS_numa_info] sys_numa_info,
+#endif
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+	    [SYS_thp_stat] sys_thp_stat,
+#endif
 	    [SYS_putc] sys_putc,
 	    [SYS_pgdir] sys_pgdir,
 	    [SYS_sem_init] sys_sem_init,
@@ -363,13 +949,31 @@ static uint64_t(*syscalls[]) (uint64_t arg[]) = {
 	    [SYS_mbox_recv] sys_mbox_recv,
 	    [SYS_mbox_free] sys_mbox_free,
 	    [SYS_mbox_info] sys_mbox_info,
+	    [SYS_mbox_sendm] sys_mbox_sendm,
+	    [SYS_mbox_recvm] sys_mbox_recvm,
+	    [SYS_sysrec] sys_sysrec,
+	    [SYS_setpriority] sys_setpriority,
+	    [SYS_getpriority] sys_getpriority,
+	    [SYS_shm_open] sys_shm_open,
+	    [SYS_shm_unlink] sys_shm_unlink,
+	    [SYS_madvise] sys_madvise,
+	    [SYS_memcg] sys_memcg,
+	    [SYS_cpucg] sys_cpucg,
+	    [SYS_irqaffinity] sys_irqaffinity,
+	    [SYS_pktio] sys_pktio,
+	    [SYS_event_call] sys_event_call,
+	    [SYS_checkpoint] sys_checkpoint,
+	    [SYS_restore] sys_restore,
 	    [SYS_open] sys_open,
 	    [SYS_close] sys_close,
 	    [SYS_read] sys_read,
 	    [SYS_write] sys_write,
 	    [SYS_seek] sys_seek,
+	    [SYS_preadv] sys_preadv,
+	    [SYS_pwritev] sys_pwritev,
 	    [SYS_fstat] sys_fstat,
 	    [SYS_fsync] sys_fsync,
+	    [SYS_fallocate] sys_fallocate,
 	    [SYS_chdir] sys_chdir,
 	    [SYS_getcwd] sys_getcwd,
 	    [SYS_mkdir] sys_mkdir,
@@ -377,11 +981,38 @@ static uint64_t(*syscalls[]) (uint64_t arg[]) = {
 	    [SYS_rename] sys_rename,
 	    [SYS_unlink] sys_unlink,
 	    [SYS_getdirentry] sys_getdirentry,
-	    [SYS_dup] sys_dup,[SYS_pipe] sys_pipe,[SYS_mkfifo] sys_mkfifo,
+	    [SYS_getdents] sys_getdents,
+	    [SYS_dup] sys_dup,
+	    [SYS_fcntl] sys_fcntl,
+	    [SYS_splice] sys_splice,
+	    [SYS_tee] sys_tee,
+	    [SYS_sendfile] sys_sendfile,
+	    [SYS_copy_file_range] sys_copy_file_range,
+	    [SYS_epoll_create] sys_epoll_create,
+	    [SYS_epoll_ctl] sys_epoll_ctl,
+	    [SYS_epoll_wait] sys_epoll_wait,
+	    [SYS_uring_enter] sys_uring_enter,
+	    [SYS_socket] sys_socket,
+	    [SYS_bind] sys_bind,
+	    [SYS_listen] sys_listen,
+	    [SYS_accept] sys_accept,
+	    [SYS_connect] sys_connect,
+	    [SYS_perf] sys_perf,
+	    [SYS_mmap_file] sys_mmap_file,
+	    [SYS_pipe] sys_pipe,[SYS_mkfifo] sys_mkfifo,
             [SYS_halt] sys_halt,};
 
 #define NUM_SYSCALLS        ((sizeof(syscalls)) / (sizeof(syscalls[0])))
 
+// syscall_dispatch - run a system call for SYS_batch, see batch.c
+static uintptr_t syscall_dispatch(uintptr_t num, uintptr_t args[])
+{
+	if (num < NUM_SYSCALLS && syscalls[num] != NULL) {
+		return syscalls[num] (args);
+	}
+	return -E_INVAL;
+}
+
 void syscall(void)
 {
 	struct trapframe *tf = current->tf;
@@ -395,7 +1026,13 @@ void syscall(void)
 			arg[3] = tf->tf_regs.reg_rcx;
 			arg[4] = tf->tf_regs.reg_r8;
 			arg[5] = tf->tf_regs.reg_r9;
+			uint64_t begin = sysrec_begin();
+			trace_event(TRACE_SYSCALL_ENTER, num, arg[0]);
 			tf->tf_regs.reg_rax = syscalls[num] (arg);
+			trace_event(TRACE_SYSCALL_EXIT, num,
+				    (int)tf->tf_regs.reg_rax);
+			sysrec_end(num, arg, 6,
+				   (long)tf->tf_regs.reg_rax, begin);
 			return;
 		}
 	}
@@ -3,6 +3,7 @@
 #include <memlayout.h>
 #include <trap.h>
 #include <arch.h>
+#include <msrbits.h>
 #include <stdio.h>
 #include <kdebug.h>
 #include <assert.h>
@@ -11,25 +12,58 @@
 #include <vmm.h>
 #include <proc.h>
 #include <sched.h>
+#include <softirq.h>
 #include <unistd.h>
 #include <syscall.h>
 #include <error.h>
 #include <kio.h>
 #include <clock.h>
+#include <ide.h>
 #include <intr.h>
 #include <mp.h>
 #include <ioapic.h>
+#include <irqbalance.h>
+#include <fpu.h>
 #include <sysconf.h>
 #include <refcache.h>
+#include <picirq.h>
+#include <virtio_console.h>
+#ifdef UCONFIG_SAMPLE_PROFILER
+#include <kprof.h>
+#endif
+#ifdef UCONFIG_PERF_EVENT
+#include <perf.h>
+#endif
+#include <static_key.h>
 
 #define TICK_NUM 30
 
+/* the handlers of the IRQs of the devices found at run time */
+static struct irq_action {
+	ucore_irq_handler_t handler;
+	void *opaque;
+} irq_actions[IRQ_COUNT];
+
 static struct gatedesc idt[256] = { {0} };
 
 struct pseudodesc idt_pd = {
 	sizeof(idt) - 1, (uintptr_t) idt
 };
 
+// syscall_init - enter the kernel at __syscall_entry on the syscall
+//              - instruction; sysret takes the user ss and cs from the
+//              - pair after the kernel data segment
+static void syscall_init(void)
+{
+	extern char __syscall_entry[];
+	writemsr(MSR_STAR, ((uint64_t) GD_KDATA << 48) |
+		 ((uint64_t) GD_KTEXT << 32));
+	writemsr(MSR_LSTAR, (uintptr_t) __syscall_entry);
+	/* as through the interrupt gate of int 0x80 */
+	writemsr(MSR_SFMASK, FL_IF | FL_DF | FL_TF | FL_AC);
+	writemsr(MSR_EFER, readmsr(MSR_EFER) | EFER_SCE);
+}
+
 void idt_init(void)
 {
 	extern uintptr_t __vectors[];
@@ -41,6 +75,7 @@ void idt_init(void)
 	SETGATE(idt[T_IPI], 0, GD_KTEXT, __vectors[T_IPI], DPL_USER);
 	SETGATE(idt[T_IPI_DOS], 0, GD_KTEXT, __vectors[T_IPI_DOS], DPL_USER);
 	lidt(&idt_pd);
+	syscall_init();
 }
 
 static const char *trapname(int trapno)
@@ -152,6 +187,28 @@ static inline void print_pgfault(struct trapframe *tf)
 		(tf->tf_err & 1) ? "protection fault" : "no page found");
 }
 
+/* an instruction of the user copies which may fault, and where it goes
+ * on when do_pgfault cannot fix the fault, see __copy_user in vmm.c */
+struct exception_table_entry {
+	uintptr_t insn, fixup;
+};
+
+extern const struct exception_table_entry __ex_table_start[], __ex_table_end[];
+
+// fixup_exception - resume tf at the fixup of its instruction, if it has one
+static bool fixup_exception(struct trapframe *tf)
+{
+	const struct exception_table_entry *e;
+	/* a handful of entries */
+	for (e = __ex_table_start; e < __ex_table_end; e++) {
+		if (e->insn == tf->tf_rip) {
+			tf->tf_rip = e->fixup;
+			return 1;
+		}
+	}
+	return 0;
+}
+
 static int pgfault_handler(struct trapframe *tf)
 {
 	extern struct mm_struct *check_mm_struct;
@@ -176,9 +233,16 @@ static void trap_dispatch(struct trapframe *tf)
 	int ret;
 	int id = myid();
 
+#ifdef UCONFIG_NO_HZ_IDLE
+	tick_nohz_irq_enter(tf->tf_trapno);
+#endif
 	switch (tf->tf_trapno) {
 	case T_PGFLT:
 		if ((ret = pgfault_handler(tf)) != 0) {
+			if (current != NULL && trap_in_kernel(tf)
+			    && fixup_exception(tf)) {
+				break;
+			}
 			print_trapframe(tf);
 			if (current == NULL) {
 				panic("handle pgfault failed. %e\n", ret);
@@ -193,6 +257,17 @@ static void trap_dispatch(struct trapframe *tf)
 			}
 		}
 		break;
+	case T_DEVICE:
+		/* the first FPU/SIMD use since the switch, see fpu.c */
+		if (trap_in_kernel(tf)) {
+			print_trapframe(tf);
+			panic("fpu used in kernel mode.\n");
+		}
+		if ((ret = fpu_device_not_available()) != 0) {
+			kprintf("killed by kernel, no fpu state. %e\n", ret);
+			do_exit(-E_KILLED);
+		}
+		break;
 	case T_SYSCALL:
 	case 0x6:
 		syscall();
@@ -201,33 +276,69 @@ static void trap_dispatch(struct trapframe *tf)
 		/* IPI */
 	case T_IPICALL:
 		do_ipicall();
+		lapic_eoi();
 		break;
 #endif
 	case T_TLBFLUSH:
-		lcr3(rcr3());	
+		mp_tlb_flush_ipi();
+		lapic_eoi();
+		break;
+	case T_RESCHED:
+		/* a tickless idle cpu or a preempted one, it reschedules
+		 * on the way out */
+		lapic_eoi();
 		break;
 	case IRQ_OFFSET + IRQ_TIMER:
+#ifdef UCONFIG_HIGH_RES_TIMERS
+		if (!clock_event_irq()) {
+			/* for an hrtimer, the tick is yet to come */
+			break;
+		}
+#endif
 		if(id==0){
 			ticks++;
-			run_timer_list();
+#ifdef UCONFIG_VIRTIO_CONSOLE
+			virtio_console_flush();
+#endif
+#ifdef UCONFIG_IRQ_BALANCE
+			irq_balance_tick();
+#endif
 		}
+		/* every cpu runs its own timing wheel */
+		run_timer_list();
 		refcache_tick();
+#ifdef UCONFIG_SAMPLE_PROFILER
+		kprof_tick(tf);
+#endif
+#ifdef UCONFIG_PERF_EVENT
+		perf_tick();
+#endif
 
 		assert(current != NULL);
 		break;
 	case IRQ_OFFSET + IRQ_COM1:
 	case IRQ_OFFSET + IRQ_KBD:
 	case IRQ_OFFSET + IRQ_LPT1:
-		c = cons_getc();
-
 		extern void dev_stdin_write(char c);
-		dev_stdin_write(c);
+		/* all that came, up to a FIFO of the uart at a time */
+		while ((c = cons_getc()) != 0) {
+			dev_stdin_write(c);
+		}
 		break;
 	case IRQ_OFFSET + IRQ_IDE1:
 	case IRQ_OFFSET + IRQ_IDE2:
-		/* do nothing */
+		ide_intr(tf->tf_trapno - IRQ_OFFSET);
 		break;
 	default:
+		if (tf->tf_trapno >= IRQ_OFFSET
+		    && tf->tf_trapno < IRQ_OFFSET + IRQ_COUNT
+		    && irq_actions[tf->tf_trapno - IRQ_OFFSET].handler != NULL) {
+			struct irq_action *action =
+			    irq_actions + tf->tf_trapno - IRQ_OFFSET;
+			action->handler(tf->tf_trapno - IRQ_OFFSET,
+					action->opaque);
+			break;
+		}
 		print_trapframe(tf);
 		if (current != NULL) {
 			kprintf("unhandled trap.\n");
@@ -237,12 +348,35 @@ static void trap_dispatch(struct trapframe *tf)
 	}
 
 	if (tf->tf_trapno >= IRQ_OFFSET &&
-	    tf->tf_trapno < IRQ_OFFSET + IRQ_COUNT)
+	    tf->tf_trapno < IRQ_OFFSET + IRQ_COUNT) {
+		irq_count(tf->tf_trapno - IRQ_OFFSET);
 		lapic_eoi();
+		irq_exit();
+	}
 }
 
-void trap(struct trapframe *tf)
+__notrace__ void trap(struct trapframe *tf)
 {
+#ifdef UCONFIG_JUMP_LABEL
+	/* a site of a static key being patched, see debug/jump_label.c;
+	 * nothing built with -pg is called before */
+	if (tf->tf_trapno == T_BRKPT && jump_label_int3(tf)) {
+		return;
+	}
+#endif
+#ifdef UCONFIG_SAMPLE_PROFILER
+	/* the NMI may come in the middle of anything, sample and go back */
+	if (tf->tf_trapno == T_NMI) {
+		/* both may overflow at once, each claims its own */
+		bool ours = kprof_nmi(tf);
+#ifdef UCONFIG_PERF_EVENT
+		ours = perf_nmi(tf) || ours;
+#endif
+		if (ours) {
+			return;
+		}
+	}
+#endif
 	// used for previous projects
 	if (current == NULL) {
 		trap_dispatch(tf);
@@ -266,7 +400,7 @@ void trap(struct trapframe *tf)
 			if (current->need_resched) {
 				schedule();
 			}
-		} else if (current == idleproc) {
+		} else if (current == idleproc && !in_softirq()) {
 			schedule();
 		}
 		// kprintf("%d %d }}}\n", lapic_id, current->pid);
@@ -280,16 +414,29 @@ int ucore_in_interrupt()
 	return 0;
 }
 
+// irq_enable - route irq to a cpu of its affinity, see irqbalance.c
 void irq_enable(int irq_no)
 {
-	//XXX
-	ioapic_enable(0, irq_no, 0);
+	irq_route(irq_no);
 }
 
 void irq_disable(int irq_no)
 {
-	//XXX
-	ioapic_disable(0, irq_no);
+	irq_unroute(irq_no);
+}
+
+// register_irq - call handler with opaque on irq; an MSI-X irq must have
+//              - been allocated by irq_alloc_msi
+void register_irq(int irq, ucore_irq_handler_t handler, void *opaque)
+{
+	assert(irq >= 0 && irq < IRQ_COUNT);
+	irq_actions[irq].opaque = opaque;
+	irq_actions[irq].handler = handler;
+	if (sysconf.lioapic_count || irq >= IRQ_MSI_BASE) {
+		irq_enable(irq);
+	} else {
+		pic_enable(irq);
+	}
 }
 
 void trap_init(void)
@@ -299,4 +446,9 @@ void trap_init(void)
 		return;
 	irq_enable(IRQ_KBD);
 	irq_enable(IRQ_COM1);
+#ifdef UCONFIG_BLK_QUEUE
+	/* the request queues sleep until the disks interrupt */
+	irq_enable(IRQ_IDE1);
+	irq_enable(IRQ_IDE2);
+#endif
 }
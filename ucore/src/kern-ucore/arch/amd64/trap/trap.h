@@ -49,6 +49,7 @@
 #define T_TLBFLUSH      65      // flush TLB
 #define T_SAMPCONF      66      // configure event counters
 #define T_IPICALL       67      // Queued IPI call
+#define T_RESCHED       68      // wake up a tickless idle cpu, or preempt it
 #define T_DEFAULT      500      // catchall
 
 
@@ -94,6 +95,7 @@ void idt_init(void);
 void print_trapframe(struct trapframe *tf);
 void print_regs(struct pushregs *regs);
 bool trap_in_kernel(struct trapframe *tf);
+int ucore_in_interrupt();
 
 #define local_intr_enable_hw  do { __asm __volatile ("sti"); } while (0)
 #define local_intr_disable_hw do { __asm __volatile ("cli"); } while (0)
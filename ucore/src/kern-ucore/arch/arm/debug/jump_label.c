@@ -0,0 +1,26 @@
+#include <types.h>
+#include <mmu.h>
+#include <static_key.h>
+
+/*
+ * A site is one aligned word, which the other cores fetch whole, the old
+ * instruction or the new one: "b" and the nop may be swapped under them.
+ * The word is written through the kernel mapping, cleaned to the point of
+ * unification and the I-cache dropped; jump_label_sync then has every core
+ * take an exception, which refetches what follows it.
+ */
+void arch_jump_label_transform(struct jump_entry *e, bool enable)
+{
+	uint32_t *site = (uint32_t *) e->code, insn = ARM_JUMP_LABEL_NOP;
+	if (enable) {
+		/* the pc reads 8 bytes past the b */
+		insn = ARM_JUMP_LABEL_B |
+		    (((e->target - (e->code + 8)) >> 2) & 0x00ffffff);
+	}
+	if (*site == insn) {
+		return;
+	}
+	*site = insn;
+	arm_icache_sync_range(e->code, sizeof(insn));
+	jump_label_sync();
+}
@@ -6,6 +6,10 @@
 extern volatile size_t ticks;
 
 void clock_init_arm(uint32_t base, int irq);
+#ifdef UCONFIG_ARM_SMP
+/* start the private timer of a core that comes up after clock_init_arm */
+void clock_init_ap(void);
+#endif
 //clear interrupt output after handling
 void clock_clear(void);
 void enable_timer_list();
@@ -11,6 +11,9 @@
 #include <nand_mtd.h>
 #include <ramdisk.h>
 #include <memlayout.h>
+#include <iobuf.h>
+#include <blkqueue.h>
+#include <error.h>
 
 #define VALID_IDE(ideno)        (((ideno) >= 0) && ((ideno) < MAX_IDE) && (ide_devices[ideno] && ide_devices[ideno]->valid))
 
@@ -22,6 +25,11 @@
 
 static struct ide_device *ide_devices[MAX_IDE];
 
+#ifdef UCONFIG_BLK_QUEUE
+/* the queues of the devices of ide_register_device, xfer set once started */
+static struct blk_queue ide_queues[MAX_IDE];
+#endif
+
 static void check_nandflash_blk()
 {
 #ifdef HAS_NANDFLASH
@@ -120,24 +128,119 @@ unsigned long ide_device_size(unsigned short ideno)
 	return 0;
 }
 
+unsigned long ide_device_erase_size(unsigned short ideno)
+{
+	if (ide_device_valid(ideno)) {
+		return ide_devices[ideno]->erase_size;
+	}
+	return 0;
+}
+
+/*
+ * Transfer the sectors from secno on to or from the iovcnt buffers of iov
+ * with one command of the device if it has rw_secsv, else one per buffer.
+ */
+static int
+ide_rw_secsv(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+	     int iovcnt, bool write)
+{
+	struct ide_device *dev = ide_devices[ideno];
+	int i, ret = 0;
+	if (!VALID_IDE(ideno)) {
+		return -E_INVAL;
+	}
+	if (dev->rw_secsv != NULL) {
+		return dev->rw_secsv(dev, secno, iov, iovcnt, write);
+	}
+	for (i = 0; i < iovcnt && ret == 0; i++) {
+		unsigned long nsecs = iov[i].iov_len / SECTSIZE;
+		if (write) {
+			ret = (dev->write_secs != NULL) ?
+			    dev->write_secs(dev, secno, iov[i].iov_base, nsecs) : 0;
+		} else {
+			ret = (dev->read_secs != NULL) ?
+			    dev->read_secs(dev, secno, iov[i].iov_base, nsecs) : 0;
+		}
+		secno += nsecs;
+	}
+	return ret;
+}
+
+#ifdef UCONFIG_BLK_QUEUE
+static int
+ide_xfer(struct blk_queue *q, uint32_t secno, const struct iovec *iov,
+	 int iovcnt, bool write, bool can_sleep)
+{
+	unsigned short ideno = (uintptr_t) q->private;
+	return ide_rw_secsv(ideno, secno, iov, iovcnt, write);
+}
+
+// ide_queue_init - start the request queue of device ideno
+static void ide_queue_init(unsigned short ideno)
+{
+	char name[16];
+	snprintf(name, sizeof(name), "ide%d", ideno);
+	blk_queue_init(ide_queues + ideno, name, ide_xfer, IDE_MAX_NSECS,
+		       (void *)(uintptr_t) ideno);
+	if (blk_queue_start(ide_queues + ideno) != 0) {
+		/* served by the submitters then */
+		kprintf("ide %d: no request queue worker.\n", ideno);
+	}
+}
+
+// ide_submit - queue req to device ideno, see blk_submit
+void ide_submit(unsigned short ideno, struct blk_request *req)
+{
+	assert(VALID_IDE(ideno) && ide_queues[ideno].xfer != NULL);
+	blk_submit(ide_queues + ideno, req);
+}
+
+static int
+ide_rw(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+       int iovcnt, bool write)
+{
+	if (VALID_IDE(ideno) && ide_queues[ideno].xfer != NULL) {
+		return blk_rw(ide_queues + ideno, secno, iov, iovcnt, write);
+	}
+	return ide_rw_secsv(ideno, secno, iov, iovcnt, write);
+}
+#else
+static int
+ide_rw(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+       int iovcnt, bool write)
+{
+	return ide_rw_secsv(ideno, secno, iov, iovcnt, write);
+}
+#endif
+
 int
 ide_read_secs(unsigned short ideno, unsigned long secno, void *dst,
 	      unsigned long nsecs)
 {
-	if (CHECK_CALL(ideno, read_secs))
-		return ide_devices[ideno]->read_secs(ide_devices[ideno], secno,
-						     dst, nsecs);
-	return 0;
+	struct iovec iov = { dst, nsecs * SECTSIZE };
+	return ide_rw(ideno, secno, &iov, 1, 0);
 }
 
 int
 ide_write_secs(unsigned short ideno, unsigned long secno, const void *src,
 	       unsigned long nsecs)
 {
-	if (CHECK_CALL(ideno, write_secs))
-		return ide_devices[ideno]->write_secs(ide_devices[ideno], secno,
-						      src, nsecs);
-	return 0;
+	struct iovec iov = { (char *)src, nsecs * SECTSIZE };
+	return ide_rw(ideno, secno, &iov, 1, 1);
+}
+
+int
+ide_read_secsv(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+	       int iovcnt)
+{
+	return ide_rw(ideno, secno, iov, iovcnt, 0);
+}
+
+int
+ide_write_secsv(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+		int iovcnt)
+{
+	return ide_rw(ideno, secno, iov, iovcnt, 1);
 }
 
 int ide_register_device(unsigned short ideno, struct ide_device *dev)
@@ -148,5 +251,8 @@ int ide_register_device(unsigned short ideno, struct ide_device *dev)
 		return -1;
 	}
 	ide_devices[ideno] = dev;
+#ifdef UCONFIG_BLK_QUEUE
+	ide_queue_init(ideno);
+#endif
 	return 0;
 }
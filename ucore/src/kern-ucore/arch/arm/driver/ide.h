@@ -10,6 +10,22 @@ int ide_read_secs(unsigned short ideno, unsigned long secno, void *dst,
 int ide_write_secs(unsigned short ideno, unsigned long secno, const void *src,
 		   unsigned long nsecs);
 
+struct iovec;
+struct blk_request;
+
+/* # of sectors ide_read_secsv or ide_write_secsv moves at most */
+#define IDE_MAX_NSECS                   128
+
+int ide_read_secsv(unsigned short ideno, uint32_t secno,
+		   const struct iovec *iov, int iovcnt);
+int ide_write_secsv(unsigned short ideno, uint32_t secno,
+		    const struct iovec *iov, int iovcnt);
+unsigned long ide_device_erase_size(unsigned short ideno);
+
+#ifdef UCONFIG_BLK_QUEUE
+void ide_submit(unsigned short ideno, struct blk_request *req);
+#endif
+
 #ifdef UCONFIG_SYS_64BIT_LBA
 typedef uint64_t lbaint_t;
 #else
@@ -31,6 +47,7 @@ struct ide_device {
 #endif
 	lbaint_t lba;		/* number of blocks */
 	unsigned long blksz;	/* block size */
+	unsigned long erase_size;	/* blocks of an erase unit, 0 if unknown */
 	char vendor[40 + 1];	/* IDE model, SCSI Vendor */
 	char product[20 + 1];	/* IDE Serial no, SCSI product */
 	char revision[8 + 1];	/* firmware revision */
@@ -46,6 +63,9 @@ struct ide_device {
 			  void *dst, unsigned long nsecs);
 	int (*write_secs) (struct ide_device * dev, unsigned long secno,
 			   const void *src, unsigned long nsecs);
+	/* optional, one transfer for all the buffers, each of whole blocks */
+	int (*rw_secsv) (struct ide_device * dev, unsigned long secno,
+			 const struct iovec * iov, int iovcnt, int write);
 
 };
 
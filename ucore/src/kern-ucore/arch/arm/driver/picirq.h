@@ -1,6 +1,8 @@
 #ifndef __KERN_DRIVER_PICIRQ_H__
 #define __KERN_DRIVER_PICIRQ_H__
 
+#include <types.h>
+
 void pic_init(void);
 void pic_enable(unsigned int irq);
 void pic_disable(unsigned int irq);
@@ -11,4 +13,10 @@ typedef int (*ucore_irq_handler_t) (int, void *);
 
 void register_irq(int irq, ucore_irq_handler_t handler, void *opaque);
 
+#ifdef UCONFIG_ARM_SMP
+/* the interface of the GIC banked for each core, and its SGIs */
+void pic_init_ap(void);
+void pic_send_sgi(uint32_t cpumask, int sgi);
+#endif
+
 #endif /* !__KERN_DRIVER_PICIRQ_H__ */
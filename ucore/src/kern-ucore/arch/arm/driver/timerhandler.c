@@ -19,11 +19,18 @@
 #include <arm.h>
 #include <board.h>
 #include <clock.h>
+#include <mp.h>
 
 volatile size_t ticks = 0;
 
-#if (defined UCONFIG_HAVE_LINUX_DDE_BASE) \
- || (defined UCONFIG_HAVE_LINUX_DDE36_BASE)
+#if defined UCONFIG_HAVE_LINUX_DDE36_BASE
+/* the tick of the linux drivers is that of the kernel, jiffies_64 is
+ * counted apart as it is wider */
+extern volatile unsigned long jiffies __attribute__ ((alias("ticks")));
+extern volatile unsigned long dde_kit_timer_ticks
+    __attribute__ ((alias("ticks")));
+volatile uint64_t jiffies_64;
+#elif defined UCONFIG_HAVE_LINUX_DDE_BASE
 extern volatile uint64_t jiffies_64;
 extern unsigned long volatile jiffies;
 #endif
@@ -37,12 +44,17 @@ void enable_timer_list()
 
 void __common_timer_int_handler()
 {
-	ticks++;
+	/* every core has its own tick, the time goes on with the first's */
+	if (myid() == 0) {
+		ticks++;
 #if (defined UCONFIG_HAVE_LINUX_DDE_BASE) \
  || (defined UCONFIG_HAVE_LINUX_DDE36_BASE)
-	jiffies++;
-	jiffies_64++;
+#ifndef UCONFIG_HAVE_LINUX_DDE36_BASE
+		jiffies++;
+#endif
+		jiffies_64++;
 #endif
+	}
 	//if(ticks % 100 == 0)
 	//  serial_putc('A');
 	extern void run_timer_list();
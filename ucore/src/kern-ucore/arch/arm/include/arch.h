@@ -20,4 +20,27 @@
 
 #include <arm.h>
 
+/* the smp barriers of memorder.h: a dmb on the cores that see each other's
+ * accesses out of order, a compiler barrier alone with one core */
+#ifdef UCONFIG_ARM_SMP
+#define smp_mb()                    asm volatile ("dmb ish":::"memory")
+#define smp_rmb()                   smp_mb()
+#define smp_wmb()                   asm volatile ("dmb ishst":::"memory")
+#else
+#define smp_mb()                    asm volatile ("":::"memory")
+#define smp_rmb()                   smp_mb()
+#define smp_wmb()                   smp_mb()
+#endif
+#define smp_acqrel()                smp_mb()
+
+/* the hint for the loops that poll what another core writes */
+static inline void nop_pause(void)
+{
+#ifdef UCONFIG_ARM_SMP
+	asm volatile ("yield":::"memory");
+#else
+	asm volatile ("":::"memory");
+#endif
+}
+
 #endif
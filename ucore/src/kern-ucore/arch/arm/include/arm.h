@@ -4,6 +4,7 @@
 #include <types.h>
 #include <div64.h>
 #include <string.h>
+#include <mmu.h>
 
 //#define BYPASS_CHECK
 //#define BYPASS_CHECK_SLAB
@@ -130,12 +131,53 @@ inline static void flush_clean_cache(void)
 #endif
 }
 
+#ifdef UCONFIG_ARM_SMP
+static inline void arm_dsb(void)
+{
+	asm volatile ("dsb":::"memory");
+}
+
+static inline void arm_isb(void)
+{
+	asm volatile ("isb":::"memory");
+}
+
+static inline void arm_sev(void)
+{
+	asm volatile ("dsb; sev":::"memory");
+}
+
+static inline void arm_wfe(void)
+{
+	asm volatile ("wfe":::"memory");
+}
+
+/* the MPIDR cpu id, 0 for the core that boots */
+static inline uint32_t arm_cpuid(void)
+{
+	uint32_t mpidr;
+	asm volatile ("mrc p15, 0, %0, c0, c0, 5":"=r" (mpidr));
+	return mpidr & 0x3;
+}
+#endif /* UCONFIG_ARM_SMP */
+
+#ifdef UCONFIG_ARM_ASID
+/* the ASID the table walks tag the nG entries with, in CONTEXTIDR */
+static inline void arm_set_asid(uint32_t asid)
+{
+	asm volatile ("mcr p15, 0, %0, c13, c0, 1; isb"::"r" (asid):"memory");
+}
+#endif
+
 /* ttbSet
  * sets the TTB of the master L1 page table. equivalent of lcr3 */
 inline static void ttbSet(uint32_t ttb)
 {
 	flush_clean_cache();
 	ttb &= 0xffffc000;
+#ifdef UCONFIG_ARM_SMP
+	ttb |= TTB_FLAGS_SMP;
+#endif
 	asm volatile ("MCR p15, 0, %0, c2, c0, 0"	/* set translation table base */
 		      ::"r" (ttb)
 	    );
@@ -61,6 +61,30 @@ static inline void atomic_set(atomic_t * v, int i)
 	v->counter = i;
 }
 
+#ifdef UCONFIG_ARM_SMP
+
+/* *
+ * With UCONFIG_ARM_SMP the other cores write the same words, so masking
+ * the interrupts of this one is not enough: the updates below are the
+ * ldrex/strex loops of the __sync builtins, each a full barrier.
+ * */
+static inline void atomic_add(atomic_t * v, int i)
+{
+	__sync_add_and_fetch(&v->counter, i);
+}
+
+static inline void atomic_sub(atomic_t * v, int i)
+{
+	__sync_sub_and_fetch(&v->counter, i);
+}
+
+static inline bool atomic_sub_test_zero(atomic_t * v, int i)
+{
+	return __sync_sub_and_fetch(&v->counter, i) == 0;
+}
+
+#else /* !UCONFIG_ARM_SMP */
+
 /*
  * atomic_add - add integer to atomic variable
  * @v:  pointer of type atomic_t
@@ -106,6 +130,8 @@ static inline bool atomic_sub_test_zero(atomic_t * v, int i)
 	return c != 0;
 }
 
+#endif /* UCONFIG_ARM_SMP */
+
 /* *
  * atomic_inc - increment atomic variable
  * @v:  pointer of type atomic_t
@@ -128,6 +154,32 @@ static inline void atomic_dec(atomic_t * v)
 	atomic_sub(v, 1);
 }
 
+#ifdef UCONFIG_ARM_SMP
+
+static inline bool atomic_inc_test_zero(atomic_t * v)
+{
+	return __sync_add_and_fetch(&v->counter, 1) == 0;
+}
+
+static inline bool atomic_dec_test_zero(atomic_t * v)
+{
+	return __sync_sub_and_fetch(&v->counter, 1) == 0;
+}
+
+static inline int atomic_add_return(atomic_t * v, int i)
+{
+	return __sync_add_and_fetch(&v->counter, i);
+}
+
+static inline int atomic_sub_return(atomic_t * v, int i)
+{
+	return __sync_sub_and_fetch(&v->counter, i);
+}
+
+#define atomic_compare_and_swap(ptr, oval, nval) __sync_bool_compare_and_swap(ptr, oval, nval)
+
+#else /* !UCONFIG_ARM_SMP */
+
 /* *
  * atomic_inc_test_zero - increment and test
  * @v:  pointer of type atomic_t
@@ -199,6 +251,8 @@ static inline int atomic_sub_return(atomic_t * v, int i)
 	return v->counter;
 }
 
+#endif /* UCONFIG_ARM_SMP */
+
 static inline void set_bit(int nr, volatile uint32_t * addr)
     __attribute__ ((always_inline));
 static inline void clear_bit(int nr, volatile uint32_t * addr)
@@ -214,6 +268,45 @@ static inline bool test_and_change_bit(int nr, volatile uint32_t * addr)
 static inline bool test_bit(int nr, volatile uint32_t * addr)
     __attribute__ ((always_inline));
 
+#ifdef UCONFIG_ARM_SMP
+
+static inline void set_bit(int nr, volatile uint32_t * addr)
+{
+	__sync_fetch_and_or(addr, 1 << nr);
+}
+
+static inline void clear_bit(int nr, volatile uint32_t * addr)
+{
+	__sync_fetch_and_and(addr, ~(1 << nr));
+}
+
+static inline void change_bit(int nr, volatile uint32_t * addr)
+{
+	__sync_fetch_and_xor(addr, 1 << nr);
+}
+
+static inline bool test_and_set_bit(int nr, volatile uint32_t * addr)
+{
+	return (__sync_fetch_and_or(addr, 1 << nr) >> nr) & 1;
+}
+
+static inline bool test_and_clear_bit(int nr, volatile uint32_t * addr)
+{
+	return (__sync_fetch_and_and(addr, ~(1 << nr)) >> nr) & 1;
+}
+
+static inline bool test_and_change_bit(int nr, volatile uint32_t * addr)
+{
+	return (__sync_fetch_and_xor(addr, 1 << nr) >> nr) & 1;
+}
+
+static inline bool test_bit(int nr, volatile uint32_t * addr)
+{
+	return (*addr >> nr) & 1;
+}
+
+#else /* !UCONFIG_ARM_SMP */
+
 /* *
  * set_bit - Atomically set a bit in memory
  * @nr:     the bit to set
@@ -290,7 +383,7 @@ static inline bool test_and_clear_bit(int nr, volatile uint32_t * addr)
 		c = 1;
 	*addr &= ~(1 << nr);
 	local_intr_restore(intr_flag);
-	return 0;
+	return c != 0;
 }
 
 /* *
@@ -309,7 +402,7 @@ static inline bool test_and_change_bit(int nr, volatile uint32_t * addr)
 //#error Fill HERE
 	*(volatile long *)addr ^= (1 << nr);
 	local_intr_restore(intr_flag);
-	return 0;
+	return c != 0;
 }
 
 /* *
@@ -328,4 +421,6 @@ static inline bool test_bit(int nr, volatile uint32_t * addr)
 	return c != 0;
 }
 
+#endif /* UCONFIG_ARM_SMP */
+
 #endif /* !__ARCH_TEMPLATE_INCLUDE_ATOMIC_H */
@@ -0,0 +1,32 @@
+#ifndef __ARCH_ARM_INCLUDE_JUMP_LABEL_H__
+#define __ARCH_ARM_INCLUDE_JUMP_LABEL_H__
+
+#include <types.h>
+
+/* *
+ * The site of a static key is one ARM instruction, "mov r0, r0" as the
+ * nop, patched into a "b" to the hook. A macro, for the key has to be a
+ * link time constant even at -O0.
+ * */
+#define ARM_JUMP_LABEL_NOP          0xe1a00000
+#define ARM_JUMP_LABEL_B            0xea000000
+
+#define arch_static_branch(key)                                         \
+    ({                                                                  \
+        __label__ __l_yes;                                              \
+        bool __taken = 0;                                               \
+        do {                                                            \
+            asm goto ("1: mov r0, r0\n\t"                               \
+                      ".pushsection __jump_table, \"aw\"\n\t"           \
+                      ".balign 4\n\t"                                   \
+                      ".word 1b, %l[__l_yes], %c0\n\t"                  \
+                      ".popsection"                                     \
+                      : : "i" (key) : : __l_yes);                       \
+            break;                                                      \
+        __l_yes:                                                        \
+            __taken = 1;                                                \
+        } while (0);                                                    \
+        __taken;                                                        \
+    })
+
+#endif /* !__ARCH_ARM_INCLUDE_JUMP_LABEL_H__ */
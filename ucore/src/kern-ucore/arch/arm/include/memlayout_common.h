@@ -64,6 +64,8 @@ struct mapped_addr {
  * physical page (1MB). In kern/mm/pmm.h, you can find lots of useful functions
  * that convert Page to other data types, such as phyical address.
  * */
+struct mem_group;
+
 struct Page {
 	atomic_t ref;		// page frame's reference counter
 	uint32_t flags;		// array of flags that describe the status of the page frame
@@ -72,6 +74,13 @@ struct Page {
 	list_entry_t page_link;	// free list link
 	swap_entry_t index;	// stores a swapped-out page identifier
 	list_entry_t swap_link;	// swap hash link
+#ifdef UCONFIG_SWAP
+	struct anon_vma *anon_vma;	// where it may be mapped, while in the swap cache, see rmap.c
+	uintptr_t anon_index;	// its address there, or offset in the shmem
+#endif
+#ifdef UCONFIG_MEMCG
+	struct mem_group *memcg;	// the group it is charged to, see memcg.c
+#endif
 };
 
 /* Flags describing the status of a page frame */
@@ -82,6 +91,9 @@ struct Page {
 #define PG_swap                     4	// the page is in the active or inactive page list (and swap hash table)
 #define PG_active                   5	// the page is in the active page list
 #define PG_IO                      6	//dma page, never free in unmap_page
+#define PG_lazyfree                 7	// MADV_FREE: reclaim drops it if its pte is clean
+#define PG_age                      8	// and 9: the idle scans reclaim waits for, see swap.c
+#define PG_memcg                    10	// page->memcg is charged
 
 #define SetPageReserved(page)       set_bit(PG_reserved, &((page)->flags))
 #define ClearPageReserved(page)     clear_bit(PG_reserved, &((page)->flags))
@@ -104,6 +116,12 @@ struct Page {
 #define SetPageIO(page)         set_bit(PG_IO, &((page)->flags))
 #define ClearPageIO(page)       clear_bit(PG_IO, &((page)->flags))
 #define PageIO(page)            test_bit(PG_IO, &((page)->flags))
+#define SetPageLazyFree(page)   set_bit(PG_lazyfree, &((page)->flags))
+#define ClearPageLazyFree(page) clear_bit(PG_lazyfree, &((page)->flags))
+#define PageLazyFree(page)      test_bit(PG_lazyfree, &((page)->flags))
+#define SetPageMemcg(page)          set_bit(PG_memcg, &((page)->flags))
+#define ClearPageMemcg(page)        clear_bit(PG_memcg, &((page)->flags))
+#define PageMemcg(page)             test_bit(PG_memcg, &((page)->flags))
 
 // convert list entry to page
 #define le2page(le, member)                 \
@@ -194,6 +194,8 @@ static inline pgd_t *init_pgdir_get(void)
 	return (pgd_t *)KADDR( boot_pgdir_pa);
 }
 
+extern uint32_t boot_pgdir_gen;
+
 void pmm_init_ap(void);
 
 extern char bootstack[], bootstacktop[];
@@ -10,6 +10,34 @@ typedef spinlock_s *spinlock_t;
 
 #define spinlock_init(x) do { (x)->lock = 0; } while (0)
 
+#ifdef UCONFIG_ARM_SMP
+
+/* *
+ * A test-and-set lock on ldrex/strex; the waiters sleep in wfe until the
+ * release sends the event, rather than hammering the line of the lock.
+ * */
+static inline void spinlock_acquire(spinlock_t lock)
+{
+	while (__sync_lock_test_and_set(&lock->lock, 1)) {
+		while (lock->lock)
+			arm_wfe();
+	}
+}
+
+static inline int spinlock_acquire_try(spinlock_t lock)
+{
+	return __sync_lock_test_and_set(&lock->lock, 1) == 0;
+}
+
+static inline void spinlock_release(spinlock_t lock)
+{
+	__sync_lock_release(&lock->lock);
+	arm_sev();
+}
+
+#else /* !UCONFIG_ARM_SMP */
+
+/* a single core, with the interrupts off there is none to race */
 static inline void spinlock_acquire(spinlock_t lock)
 {
 }
@@ -22,6 +50,8 @@ static inline int spinlock_acquire_try(spinlock_t lock)
 static inline void spinlock_release(spinlock_t lock)
 {
 }
+
+#endif /* UCONFIG_ARM_SMP */
 #define spin_lock_irqsave(lock, x)      do { x = __intr_save();spinlock_acquire(lock); } while (0)
 
 #define spin_unlock_irqrestore(lock, x)      do { spinlock_release(lock);__intr_restore(x); } while (0)
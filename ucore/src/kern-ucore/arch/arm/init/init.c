@@ -11,6 +11,7 @@
 #include <intr.h>
 #include <pmm.h>
 #include <vmm.h>
+#include <dma.h>
 #include <ide.h>
 #include <swap.h>
 #include <proc.h>
@@ -23,6 +24,8 @@
 #include <ramdisk.h>
 #include <kgdb-stub.h>
 #include <module.h>
+#include <sysconf.h>
+#include <static_key.h>
 #include <dde_kit/dde_kit.h>
 
 #ifdef UCONFIG_HAVE_YAFFS2
@@ -128,13 +131,17 @@ int kern_init(void)
 	//kgdb_init();
 	//check_bp();
 
-	/* Only to initialize lcpu_count. */
+	/* lcpu_count, and the struct cpu of this core */
 	mp_init();
 
 	print_kerninfo();
 
 	pmm_init();		// init physical memory management
 	pmm_init_ap();
+	percpu_init();		// the per-cpu areas of the other cores
+#ifdef UCONFIG_ENABLE_IPI
+	ipi_init();
+#endif
 #ifdef UCONFIG_HAVE_LINUX_DDE_BASE
 	dde_call_mapio_early();
 #endif
@@ -142,6 +149,7 @@ int kern_init(void)
 	kprintf("pmm_init() done.\n");
 
 	vmm_init();		// init virtual memory management
+	dma_contig_init();	// before the pages fragment
 	_PROBE_();
 
 	cons_init();		// init the console
@@ -151,6 +159,10 @@ int kern_init(void)
 	proc_init();		// init process table
 	_PROBE_();
 	sync_init();		// init sync struct
+	percpu_alloc_init();	// the dynamic per-cpu objects
+#ifdef UCONFIG_JUMP_LABEL
+	jump_label_init();
+#endif
 
 	ide_init();		// init ide devices
 	_PROBE_();
@@ -159,6 +171,11 @@ int kern_init(void)
 	fs_init();		// init fs
 	_PROBE_();
 
+#ifdef UCONFIG_ARM_SMP
+	cpus_up();		// start the other cores
+	kprintf("%d cpus up\n", sysconf.lcpu_count);
+#endif
+
 	intr_enable();		// enable irq interrupt
 
 #ifdef UCONFIG_HAVE_LINUX_DDE_BASE
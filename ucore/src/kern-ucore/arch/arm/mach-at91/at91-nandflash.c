@@ -166,6 +166,22 @@ static void atmel_nand_write_byte(unsigned char byte)
 	*(volatile unsigned char *)(ek_nand_config.io_addr_base) = byte;
 }
 
+static void atmel_nand_read_buf(unsigned char *buf, unsigned len)
+{
+	volatile unsigned char *io =
+	    (volatile unsigned char *)ek_nand_config.io_addr_base;
+	while (len-- > 0)
+		*buf++ = *io;
+}
+
+static void atmel_nand_write_buf(const unsigned char *buf, unsigned len)
+{
+	volatile unsigned char *io =
+	    (volatile unsigned char *)ek_nand_config.io_addr_base;
+	while (len-- > 0)
+		*io = *buf++;
+}
+
 static void atmel_wait_rdy()
 {
 	while (!(*(volatile unsigned int *)(AT91C_BASE_PIOC + PIO_PDSR)
@@ -201,9 +217,7 @@ static int atmel_read_page(struct nand_chip *chip, unsigned page_id,
 	chip->write_cmd(CMD_READ_2);
 	chip->wait_rdy();
 	chip->wait_rdy();
-	for (j = 0; j < chip->pg_size; j++) {
-		data[j] = chip->read_byte();
-	}
+	chip->read_buf(data, chip->pg_size);
 	/* read ECC */
 	uint32_t *eccpos = chip->ecclayout->eccpos;
 	if (eccpos[0] != 0) {
@@ -213,11 +227,7 @@ static int atmel_read_page(struct nand_chip *chip, unsigned page_id,
 		chip->write_addr((chip->pg_size + eccpos[0]) >> 8);
 		chip->write_cmd(CMD_RANDOM_READ_2);
 	}
-	for (j = 0; j < chip->ecclayout->eccbytes; j++) {
-		spare[j] = chip->read_byte();
-		//kprintf("%02x ", spare[j]);
-	}
-	//kprintf(" @@\n");
+	chip->read_buf(spare, chip->ecclayout->eccbytes);
 
 	*eccStatus = chip->ecc_correct(data, spare, NULL);
 
@@ -225,8 +235,23 @@ static int atmel_read_page(struct nand_chip *chip, unsigned page_id,
 	chip->write_addr(chip->pg_size & 0xff);
 	chip->write_addr(chip->pg_size >> 8);
 	chip->write_cmd(CMD_RANDOM_READ_2);
-	for (j = 0; j < chip->spare_size; j++)
-		spare[j] = chip->read_byte();
+	chip->read_buf(spare, chip->spare_size);
+	chip->enable_chip(0);
+
+	return 0;
+}
+
+/* the tags are in the spare area, so a scan reads none of the main one */
+static int atmel_read_spare(struct nand_chip *chip, unsigned page_id,
+			    unsigned char *spare)
+{
+	chip->enable_chip(1);
+	chip->write_cmd(CMD_READ_1);
+	chip->write_full_addr(page_id, chip->pg_size);	//read spare
+	chip->write_cmd(CMD_READ_2);
+	chip->wait_rdy();
+	chip->wait_rdy();
+	chip->read_buf(spare, chip->spare_size);
 	chip->enable_chip(0);
 
 	return 0;
@@ -249,16 +274,13 @@ static int atmel_write_page(struct nand_chip *chip, unsigned pageId,
 	chip->enable_chip(1);
 	chip->write_cmd(CMD_WRITE_1);
 	chip->write_full_addr(pageId, 0);	//write main
-	for (j = 0; j < dataLength; j++) {
-		chip->write_byte(data[j]);
-	}
-	for (; j < chip->pg_size; j++)
+	chip->write_buf(data, dataLength);
+	for (j = dataLength; j < chip->pg_size; j++)
 		chip->write_byte(0xFF);
 
 	chip->ecc_calculate(NULL, 0, spare_buf + chip->ecclayout->eccpos[0]);
 
-	for (j = 0; j < chip->spare_size; j++)
-		chip->write_byte(spare_buf[j]);
+	chip->write_buf(spare_buf, chip->spare_size);
 
 	chip->write_cmd(CMD_WRITE_2);
 
@@ -500,10 +522,13 @@ found:
 		chip.write_addr = atmel_nand_write_addr;
 		chip.read_byte = atmel_nand_read_byte;
 		chip.write_byte = atmel_nand_write_byte;
+		chip.read_buf = atmel_nand_read_buf;
+		chip.write_buf = atmel_nand_write_buf;
 		chip.write_full_addr = atmel_write_full_addr;
 		chip.ecc_calculate = atmel_nand_calculate;
 		chip.ecc_correct = atmel_nand_correct;
 		chip.read_page = atmel_read_page;
+		chip.read_spare = atmel_read_spare;
 		chip.write_page = atmel_write_page;
 		chip.erase_block = atmel_erase_block;
 		chip.check_block = atmel_check_block;
@@ -37,6 +37,11 @@
 #define PANDABOARD_UART3_IRQ  74
 #define PRIVATE_TIMER0_IRQ 29
 
+/* the services of the secure ROM the second core waits in until started */
+#define OMAP4_SMC_AUX_CORE_BOOT0_READ      0x103
+#define OMAP4_SMC_AUX_CORE_BOOT0_MODIFY    0x104
+#define OMAP4_SMC_AUX_CORE_BOOT1_WRITE     0x105
+
 //extern macro
 
 #define SDRAM0_START UCONFIG_DRAM_START
@@ -58,6 +63,14 @@
 extern void board_init_early(void);
 extern void board_init(void);
 
+#ifdef UCONFIG_ARM_SMP
+#include <types.h>
+
+extern int board_nr_cpus(void);
+extern void board_boot_cpu(int cpu, uintptr_t entry);
+extern void board_init_ap(void);
+#endif
+
 #endif
 
 #endif
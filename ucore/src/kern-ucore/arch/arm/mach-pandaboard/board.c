@@ -46,11 +46,66 @@ void board_init_early()
 	kprintf("PER_CLK = %dMhz\n", EXT_CLK / 1000 * mul / div / 1000);
 }
 
+#ifdef UCONFIG_ARM_SMP
+/* the snoop control unit, at the start of the MPU instance */
+#define SCU_CTRL          0x00
+#define SCU_CONFIG        0x04
+#define SCU_INV_ALL       0x0C
+
+static uint32_t omap_smc(uint32_t fn, uint32_t arg0, uint32_t arg1)
+{
+	register uint32_t r0 asm("r0") = arg0;
+	register uint32_t r1 asm("r1") = arg1;
+	register uint32_t r12 asm("r12") = fn;
+	asm volatile ("dsb;"
+		      ".word 0xe1600070"	/* smc #0 */
+		      :"+r" (r0)
+		      :"r"(r1), "r"(r12)
+		      :"r2", "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10",
+		      "r11", "memory", "cc");
+	return r0;
+}
+
+static void scu_enable(uint32_t mpu_base)
+{
+	uint32_t ctrl = inw(mpu_base + SCU_CTRL);
+	if (ctrl & 1)
+		return;
+	outw(mpu_base + SCU_INV_ALL, 0xffff);
+	outw(mpu_base + SCU_CTRL, ctrl | 1);
+}
+
+// board_nr_cpus - the cores of the MPCore; called before board_init, when
+//               - the io space is still mapped flat by the boot page table
+int board_nr_cpus(void)
+{
+	return (inw(CORTEX_A9_MPU_INSTANCE_BASE + SCU_CONFIG) & 0x3) + 1;
+}
+
+// board_boot_cpu - let core cpu out of the ROM to the physical entry, where
+//                - it waits for AUX_CORE_BOOT_0 to name it
+void board_boot_cpu(int cpu, uintptr_t entry)
+{
+	omap_smc(OMAP4_SMC_AUX_CORE_BOOT1_WRITE, entry, 0);
+	omap_smc(OMAP4_SMC_AUX_CORE_BOOT0_MODIFY, cpu << 9, ~(0xf << 9));
+	arm_sev();
+}
+
+void board_init_ap(void)
+{
+	pic_init_ap();
+	clock_init_ap();
+}
+#endif
+
 void board_init()
 {
 	uint32_t mpu_base =
 	    (uint32_t) __ucore_ioremap(CORTEX_A9_MPU_INSTANCE_BASE, 2 * PGSIZE,
 				       0);
+#ifdef UCONFIG_ARM_SMP
+	scu_enable(mpu_base);
+#endif
 	pic_init2(mpu_base + 0x100, mpu_base + 0x1000);
 	serial_init(PANDABOARD_UART0, PER_IRQ_BASE + PANDABOARD_UART3_IRQ);
 	clock_init_arm(mpu_base + 0x600, PRIVATE_TIMER0_IRQ);
@@ -48,12 +48,26 @@ static int clock_int_handler(int irq, void *data)
 	return 0;
 }
 
+static int timer_irq;
+
 void clock_init_arm(uint32_t base, int irq)
 {
 	//TODO
 	timer_base = base;
+	timer_irq = irq;
 	outw(timer_base + TIMER_LOAD, LOAD_VALUE);
 	outw(timer_base + TIMER_CONTROL, TIMER_CONTROL_VAL);
 	register_irq(irq, clock_int_handler, 0);
 	pic_enable(irq);
 }
+
+#ifdef UCONFIG_ARM_SMP
+// clock_init_ap - the private timer and its PPI are banked, each core
+//               - starts its own at the same address
+void clock_init_ap(void)
+{
+	outw(timer_base + TIMER_LOAD, LOAD_VALUE);
+	outw(timer_base + TIMER_CONTROL, TIMER_CONTROL_VAL);
+	pic_enable(timer_irq);
+}
+#endif
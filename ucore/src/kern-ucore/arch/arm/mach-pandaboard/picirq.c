@@ -123,10 +123,30 @@ void pic_init2(uint32_t g_base, uint32_t d_base)
 
 }
 
+#ifdef UCONFIG_ARM_SMP
+// pic_init_ap - the cpu interface and the SGIs and PPIs of the calling core
+//             - are banked, the distributor pic_init2 set up is shared
+void pic_init_ap(void)
+{
+	outw(gic_base + ICCPMR, 0xffff);
+	outw(gic_base + ICCICR, 3);
+}
+
+// pic_send_sgi - raise software interrupt sgi on the cores in cpumask
+void pic_send_sgi(uint32_t cpumask, int sgi)
+{
+	/* the stores the targets are to see go out first */
+	arm_dsb();
+	outw(dist_base + ICDSGIR, ((cpumask & 0xff) << 16) | (sgi & 0xf));
+}
+#endif
+
 void irq_handler()
 {
 	//TODO
-	uint32_t intnr = inw(gic_base + ICCIAR) & 0x3FF;
+	/* for an SGI, [12:10] is the core that raised it and goes to EOI too */
+	uint32_t iar = inw(gic_base + ICCIAR);
+	uint32_t intnr = iar & 0x3FF;
 	if (actions[intnr].handler) {
 		(*actions[intnr].handler) (intnr, actions[intnr].opaque);
 	} else {
@@ -134,7 +154,7 @@ void irq_handler()
 	}
 
 	//EOI
-	outw(gic_base + ICCEOIR, intnr & 0x3FF);
+	outw(gic_base + ICCEOIR, iar & 0x1FFF);
 }
 
 /* irq_clear
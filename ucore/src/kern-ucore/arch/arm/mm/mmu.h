@@ -115,6 +115,7 @@
 						// The PTE_AVAIL bits aren't used by the kernel or interpreted by the
 						// hardware, so user processes are allowed to set them arbitrarily.
 #define PTE_IOMEM       0x10000
+#define PTE_WC          0x20000	// Write-Combining, for a framebuffer
 
 #define PTE_USER        (PTE_U | PTE_W | PTE_P)
 
@@ -135,6 +136,16 @@
 /* Typical */
 #define PTEX_PWT (PTEX_WT << 2)	// Write Through
 #define PTEX_PIO (PTEX_cb << 2)	// Write Through
+#ifdef __MACH_ARM_ARMV5
+#define PTEX_PWC (PTEX_cB << 2)	// Write Combining, bufferable only
+#define PTEX_MT_MASK 0x0	// the rest is AP
+#elif defined UCONFIG_ARM_SMP
+#define PTEX_PWC 0x440		// TEX=001 C=0 B=0 normal uncached, S shareable
+#define PTEX_MT_MASK 0x5C0	// TEX and S
+#else
+#define PTEX_PWC 0x040		// TEX=001 C=0 B=0 normal uncached
+#define PTEX_MT_MASK 0x5C0	// TEX and S
+#endif
 
 #ifdef __MACH_ARM_ARMV5
 #define PTEX_R   0x000		// Supervisor/Readonly
@@ -158,9 +169,36 @@
 
 /* Chen Yuheng */
 #define PTEX_PROTECT_MASK 0xFF0
+#ifdef __MACH_ARM_ARMV5
+#define PTEX_AP_MASK 0xFF0
+#else
+#define PTEX_AP_MASK 0x230	// AP[2], AP[1:0], without TEX, S and nG
+#endif
 #define PTEX_CB_MASK 0xC
 #define PTEX_L1_PDTYPE 0x1	//coarse
 #define PTEX_L2_PGTYPE 0x2	//small page
+#define PTEX_L1_SECTYPE 0x2	//section, 1MB
+#ifdef __MACH_ARM_ARMV5
+#define PTEX_L1_SECT_W  0x410	// AP 01, supervisor rw; bit 4 should be 1
+#else
+#define PTEX_L1_SECT_W  0x400	// AP 01, supervisor rw; bit 4 is XN
+#endif
+
+#ifdef UCONFIG_ARM_SMP
+/* the cores keep their caches coherent for the normal shareable memory
+ * only: TEX=001 C B is write-back write-allocate, and S shareable */
+#define PTEX_SMP_NORMAL 0x44C
+/* the table walks are cacheable and shareable too, to see the page tables
+ * the other cores have in their caches */
+#define TTB_FLAGS_SMP 0x6a
+/* PTEX_SMP_NORMAL in a section: TEX at 14:12 and S at 16 */
+#define PTEX_SMP_SECT_NORMAL 0x1100C
+#endif
+
+#ifdef UCONFIG_ARM_ASID
+/* the entry is of the ASID it was walked with, see mp.c */
+#define PTEX_NG 0x800
+#endif
 
 #ifndef __ASSEMBLER__
 
@@ -208,6 +246,93 @@ typedef uintptr_t pgd_t;
 typedef pte_t swap_entry_t;	//the pte can also be a swap entry
 typedef uint32_t pte_perm_t;
 
+/* *
+ * Cache maintenance by virtual address, a line at a time, for the ranges
+ * a DMA, a core with its MMU off or the I-cache is to see, instead of the
+ * whole D-cache. The ops by MVA are the same on the ARM926 and on the
+ * Cortex-A8/A9, whose D-cache lines are all 32 bytes.
+ * */
+#define DCACHE_LINE 32
+
+static inline void arm_cache_barrier(void)
+{
+#ifdef __MACH_ARM_ARMV5
+	asm volatile ("mcr p15, 0, %0, c7, c10, 4"::"r" (0):"memory");	/* drain write buffer */
+#else
+	asm volatile ("dsb":::"memory");
+#endif
+}
+
+// arm_dcache_clean_range - write the dirty lines of [start, start + size)
+//                        - back to memory
+static inline void arm_dcache_clean_range(uintptr_t start, size_t size)
+{
+	uintptr_t p = start & ~(DCACHE_LINE - 1), end = start + size;
+	for (; p < end; p += DCACHE_LINE)
+		asm volatile ("mcr p15, 0, %0, c7, c10, 1"::"r" (p):"memory");	/* DCCMVAC */
+	arm_cache_barrier();
+}
+
+// arm_dcache_flush_range - write back and drop the lines of the range
+static inline void arm_dcache_flush_range(uintptr_t start, size_t size)
+{
+	uintptr_t p = start & ~(DCACHE_LINE - 1), end = start + size;
+	for (; p < end; p += DCACHE_LINE)
+		asm volatile ("mcr p15, 0, %0, c7, c14, 1"::"r" (p):"memory");	/* DCCIMVAC */
+	arm_cache_barrier();
+}
+
+// arm_dcache_inv_range - drop the lines of the range, for what a device
+//                      - wrote there; the lines it shares at either end
+//                      - with other data are written back first
+static inline void arm_dcache_inv_range(uintptr_t start, size_t size)
+{
+	uintptr_t p = start & ~(DCACHE_LINE - 1), end = start + size;
+	if (start & (DCACHE_LINE - 1)) {
+		asm volatile ("mcr p15, 0, %0, c7, c14, 1"::"r" (p):"memory");
+		p += DCACHE_LINE;
+	}
+	if ((end & (DCACHE_LINE - 1)) && p < end) {
+		end &= ~(DCACHE_LINE - 1);
+		asm volatile ("mcr p15, 0, %0, c7, c14, 1"::"r" (end):"memory");
+	}
+	for (; p < end; p += DCACHE_LINE)
+		asm volatile ("mcr p15, 0, %0, c7, c6, 1"::"r" (p):"memory");	/* DCIMVAC */
+	arm_cache_barrier();
+}
+
+// arm_icache_sync_range - make the code just written to the range seen by
+//                       - the I-cache; the I-cache is dropped whole, as
+//                       - the code may be run at another va than this one
+static inline void arm_icache_sync_range(uintptr_t start, size_t size)
+{
+	uintptr_t p = start & ~(DCACHE_LINE - 1), end = start + size;
+	for (; p < end; p += DCACHE_LINE)
+#ifdef __MACH_ARM_ARMV5
+		asm volatile ("mcr p15, 0, %0, c7, c10, 1"::"r" (p):"memory");
+#else
+		asm volatile ("mcr p15, 0, %0, c7, c11, 1"::"r" (p):"memory");	/* DCCMVAU */
+#endif
+	arm_cache_barrier();
+#ifdef UCONFIG_ARM_SMP
+	asm volatile ("mcr p15, 0, %0, c7, c1, 0;"	/* ICIALLUIS */
+		      "mcr p15, 0, %0, c7, c1, 6;"	/* BPIALLIS */
+		      "dsb; isb"::"r" (0):"memory");
+#elif defined __MACH_ARM_ARMV5
+	asm volatile ("mcr p15, 0, %0, c7, c5, 0"::"r" (0):"memory");	/* invalidate I-cache */
+#else
+	asm volatile ("mcr p15, 0, %0, c7, c5, 0;"	/* ICIALLU */
+		      "mcr p15, 0, %0, c7, c5, 6;"	/* BPIALL */
+		      "dsb; isb"::"r" (0):"memory");
+#endif
+}
+
+#ifdef UCONFIG_ARM_SMP
+/* arm_sync_icache_page - make the code just written to the page at pa
+ *                      - seen by the I-caches of all the cores, see pmm.c */
+void arm_sync_icache_page(uintptr_t pa);
+#endif
+
 // L2 PTE setter
 // Set the ucore flags directly, and the hardware flags under condition
 // flags are PTE_xxx
@@ -241,7 +366,26 @@ static inline void _arm_pte_setflags(pte_t * pte, pte_perm_t flags)
 	} else if (flags & PTE_IOMEM) {
 		*pte &= ~PTEX_CB_MASK;
 		*pte |= PTEX_PIO;
+	} else if (flags & PTE_WC) {
+		*pte &= ~(PTEX_CB_MASK | PTEX_MT_MASK);
+		*pte |= PTEX_PWC;
+	}
+#ifdef UCONFIG_ARM_SMP
+	else {
+		*pte &= ~PTEX_CB_MASK;
+		*pte |= PTEX_SMP_NORMAL;
+		if ((flags & (PTE_P | PTE_U)) == (PTE_P | PTE_U))
+			arm_sync_icache_page(PTE_ADDR(*pte));
 	}
+#ifdef UCONFIG_ARM_ASID
+	if (flags & PTE_U)
+		*pte |= PTEX_NG;
+	else
+		*pte &= ~PTEX_NG;
+#endif
+	/* the table walks see it before anything the caller does next */
+	asm volatile ("dsb":::"memory");
+#endif
 }
 
 #define _SET_PTE_BITS(pte, perm) do{pte_perm_t oldf = *(PTE_STATUS(pte));\
@@ -283,7 +427,7 @@ static inline int ptep_s_read(pte_t * ptep)
 
 static inline int ptep_s_write(pte_t * ptep)
 {
-	uint32_t p = *ptep & PTEX_PROTECT_MASK;
+	uint32_t p = *ptep & PTEX_AP_MASK;
 	return (p != PTEX_R);
 }
 
@@ -297,14 +441,14 @@ static inline int ptep_s_exec(pte_t * ptep)
 static inline int ptep_u_read(pte_t * ptep)
 {
 	//return (*ptep & PTEX_U);
-	uint32_t p = *ptep & PTEX_PROTECT_MASK;
+	uint32_t p = *ptep & PTEX_AP_MASK;
 	return (p == PTEX_U) || (p == PTEX_UW);
 }
 
 /* user writable */
 static inline int ptep_u_write(pte_t * ptep)
 {
-	uint32_t p = *ptep & PTEX_PROTECT_MASK;
+	uint32_t p = *ptep & PTEX_AP_MASK;
 	return (p == PTEX_UW);
 	//return (*ptep & PTEX_UW);
 }
@@ -8,6 +8,7 @@
 #include <pmm.h>
 #include <buddy_pmm.h>
 #include <sync.h>
+#include <spinlock.h>
 #include <slab.h>
 #include <swap.h>
 #include <error.h>
@@ -15,13 +16,11 @@
 #include <trap.h>
 #include <mp.h>
 #include <ramdisk.h>
+#include <memcg.h>
 
 uint32_t do_set_tls(struct user_tls_desc *tlsp)
 {
-	void *tp = (void *)tlsp;
-	current->tls_pointer = tp;
-	asm("mcr p15, 0, %0, c13, c0, 3"::"r"(tp));
-	return 0;
+	return do_settls((void *)tlsp);
 }
 
 /* machine dependent */
@@ -68,6 +67,16 @@ uintptr_t boot_pgdir_pa;
 // physical memory management
 const struct pmm_manager *pmm_manager;
 
+#ifdef UCONFIG_ARM_SMP
+/* the buddy free lists are shared by the cores */
+static spinlock_s pmm_lock;
+#define pmm_lock_save(x)            spin_lock_irqsave(&pmm_lock, x)
+#define pmm_unlock_restore(x)       spin_unlock_irqrestore(&pmm_lock, x)
+#else
+#define pmm_lock_save(x)            local_intr_save(x)
+#define pmm_unlock_restore(x)       local_intr_restore(x)
+#endif
+
 static void check_alloc_page(void);
 static void check_pgdir(void);
 static void check_boot_pgdir(void);
@@ -104,11 +113,11 @@ struct Page *alloc_pages(size_t n)
 {
 	bool intr_flag;
 	struct Page *page;
-	local_intr_save(intr_flag);
+	pmm_lock_save(intr_flag);
 	{
 		page = pmm_manager->alloc_pages(n);
 	}
-	local_intr_restore(intr_flag);
+	pmm_unlock_restore(intr_flag);
 	if (page)
 		get_cpu_var(used_pages) += n;
 	return page;
@@ -118,11 +127,12 @@ struct Page *alloc_pages(size_t n)
 void free_pages(struct Page *base, size_t n)
 {
 	bool intr_flag;
-	local_intr_save(intr_flag);
+	memcg_uncharge_pages(base, n);
+	pmm_lock_save(intr_flag);
 	{
 		pmm_manager->free_pages(base, n);
 	}
-	local_intr_restore(intr_flag);
+	pmm_unlock_restore(intr_flag);
 	get_cpu_var(used_pages) -= n;
 }
 
@@ -132,11 +142,11 @@ size_t nr_free_pages(void)
 {
 	size_t ret;
 	bool intr_flag;
-	local_intr_save(intr_flag);
+	pmm_lock_save(intr_flag);
 	{
 		ret = pmm_manager->nr_free_pages();
 	}
-	local_intr_restore(intr_flag);
+	pmm_unlock_restore(intr_flag);
 	return ret;
 }
 
@@ -239,6 +249,32 @@ boot_map_segment(pde_t * pgdir, uintptr_t la, size_t size, uintptr_t pa,
 	}
 }
 
+// boot_map_linear - map the linear memory of the kernel with 1MB sections,
+//                 - one TLB entry each instead of 256; the MBs the kernel
+//                 - text is in keep their page tables, to be readonly
+static void boot_map_linear(pde_t * pgdir)
+{
+	extern char __kernel_text_start[], __kernel_text_end[];
+	uintptr_t text_start =
+	    ROUNDDOWN((uintptr_t) __kernel_text_start, PTSIZE);
+	uintptr_t text_end = ROUNDUP((uintptr_t) __kernel_text_end, PTSIZE);
+	uintptr_t la;
+	for (la = KERNBASE; la < KERNTOP; la += PTSIZE) {
+		if (la >= text_start && la < text_end) {
+			boot_map_segment(pgdir, la, PTSIZE, PADDR(la), PTE_W);
+			continue;
+		}
+#ifdef UCONFIG_ARM_SMP
+		pgdir[PDX(la)] =
+		    PADDR(la) | PTEX_L1_SECTYPE | PTEX_L1_SECT_W |
+		    PTEX_SMP_SECT_NORMAL;
+#else
+		/* uncached, as the pages of boot_map_segment */
+		pgdir[PDX(la)] = PADDR(la) | PTEX_L1_SECTYPE | PTEX_L1_SECT_W;
+#endif
+	}
+}
+
 void __boot_map_iomem(uintptr_t la, size_t size, uintptr_t pa)
 {
 	//kprintf("mapping iomem 0x%08x to 0x%08x, size 0x%08x\n", pa, la,size);
@@ -313,7 +349,7 @@ void pmm_init(void)
 	//boot_map_segment(boot_pgdir, virtual, PGSIZE, physical, PTEX_W); // base location of vector table
 	extern char __kernel_text_start[], __kernel_text_end[];
 	//kprintf("## %08x %08x\n", __kernel_text_start, __kernel_text_end);
-	boot_map_segment(boot_pgdir, KERNBASE, KMEMSIZE, PADDR(KERNBASE), PTE_W);	// fixed address
+	boot_map_linear(boot_pgdir);	// fixed address
 	/* kernel code readonly protection */
 	boot_map_segment(boot_pgdir, (uintptr_t) __kernel_text_start,
 			 __kernel_text_end - __kernel_text_start,
@@ -419,10 +455,26 @@ void pmm_init(void)
 
 // invalidate both TLB 
 // (clean and flush, meaning we write the data back)
+// with UCONFIG_ARM_SMP, the TLBs of all the cores: TLBIMVAIS is broadcast
+// to the inner shareable domain, so there is no shootdown IPI to send;
+// with UCONFIG_ARM_ASID, the entries of la of every ASID, so the ASID of
+// pgdir need not be known
 void tlb_invalidate(pde_t * pgdir, uintptr_t la)
 {
+#ifdef UCONFIG_ARM_SMP
+	la &= ~(PGSIZE - 1);
+	asm volatile ("dsb;"
+#ifdef UCONFIG_ARM_ASID
+		      "mcr p15, 0, %0, c8, c3, 3;"	/* TLBIMVAAIS */
+#else
+		      "mcr p15, 0, %0, c8, c3, 1;"	/* TLBIMVAIS */
+#endif
+		      "mcr p15, 0, %1, c7, c1, 6;"	/* BPIALLIS */
+		      "dsb; isb"::"r" (la), "r"(0):"memory");
+#else
 	asm volatile ("mcr p15, 0, %0, c8, c5, 1"::"r" (la):"cc");
 	asm volatile ("mcr p15, 0, %0, c8, c6, 1"::"r" (la):"cc");
+#endif
 }
 
 void tlb_update(pgd_t * pgdir, uintptr_t la)
@@ -434,11 +486,25 @@ void tlb_invalidate_all()
 {
 	// tlb_invalidate(0,0);
 	const int zero = 0;
+#ifdef UCONFIG_ARM_SMP
+	asm volatile ("dsb;"
+		      "MCR p15, 0, %0, c8, c3, 0;"	/* TLBIALLIS */
+		      "MCR p15, 0, %0, c7, c1, 6;"	/* BPIALLIS */
+		      "dsb; isb"::"r" (zero):"memory");
+#else
 	asm volatile ("MCR p15, 0, %0, c8, c5, 0;"	/* invalidate TLB */
 		      "MCR p15, 0, %0, c8, c6, 0"	/* invalidate TLB */
 		      ::"r" (zero):"cc");
+#endif
 }
 
+#ifdef UCONFIG_ARM_SMP
+void arm_sync_icache_page(uintptr_t pa)
+{
+	arm_icache_sync_range((uintptr_t) KADDR(pa), PGSIZE);
+}
+#endif
+
 #if 0
 void tlb_clean_flush(pde_t * pgdir, uintptr_t la)
 {
@@ -507,6 +573,8 @@ void map_pgdir(pde_t * pgdir)
 		//*ptep |= PTEX_PWT; //write through
 		//tlb_clean_flush(boot_pgdir, (uint32_t) ptep); // clean cache, write
 		ptep++;
+		/* the table is shared, what it mapped before may be cached */
+		tlb_invalidate(pgdir, VPT_BASE + i * PGSIZE);
 	}
 }
 
@@ -705,6 +773,9 @@ void print_pgdir(int (*printf) (const char *fmt, ...))
 
 		size_t curr_pt_id;
 		for (curr_pt_id = left; curr_pt_id < right; curr_pt_id++) {
+			/* a section, see boot_map_linear */
+			if ((boot_pgdir[curr_pt_id] & PTEX_P) == PTEX_L1_SECTYPE)
+				continue;
 			pte_t *curr_pt =
 			    (pte_t *) PDE_ADDR(boot_pgdir[curr_pt_id]);
 			size_t range_perm;
@@ -748,6 +819,10 @@ void print_pgdir(int (*printf) (const char *fmt, ...))
 
 static uint32_t __current_ioremap_base = UCORE_IOREMAP_BASE;
 
+/* bumped as the ioremaps add page tables to the kernel half of boot_pgdir,
+ * which the pgdirs copied from it before lack, see setup_pgdir */
+uint32_t boot_pgdir_gen;
+
 void *__ucore_ioremap(unsigned long phys_addr, size_t size, unsigned int mtype)
 {
 	size = ROUNDUP(size, PGSIZE);
@@ -756,7 +831,8 @@ void *__ucore_ioremap(unsigned long phys_addr, size_t size, unsigned int mtype)
 	__boot_map_iomem(__current_ioremap_base, size, phys_addr);
 	uint32_t oldaddr = __current_ioremap_base;
 	__current_ioremap_base += size;
+	boot_pgdir_gen++;
 
-	tlb_invalidate_all();
+	mp_tlb_flush_range(boot_pgdir, oldaddr, __current_ioremap_base);
 	return (void *)oldaddr;
 }
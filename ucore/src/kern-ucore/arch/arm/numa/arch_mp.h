@@ -6,9 +6,25 @@
 
 #define PERCPU_SECTION	__section__(".percpu")
 
+#ifdef UCONFIG_ARM_SMP
+/* the GIC software interrupts the cores send each other */
+#define IPI_SGI_CALL	1
+#define IPI_SGI_RESCHED	2
+
+void cpus_up(void);
+void ap_init(void);
+#endif
+
 static inline struct cpu* mycpu(void)
 {
+#ifdef UCONFIG_ARM_SMP
+	/* TPIDRPRW, set by tls_init */
+	struct cpu *c;
+	asm volatile ("mrc p15, 0, %0, c13, c0, 4":"=r" (c));
+	return c;
+#else
 	return per_cpu_ptr(cpus, 0);
+#endif
 }
 
 #endif /* __ARCH_ARM_NUMA_ARCH_MP_H__ */
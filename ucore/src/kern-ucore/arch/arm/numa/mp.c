@@ -8,6 +8,10 @@
 #include <arch.h>
 #include <vmm.h>
 #include <sysconf.h>
+#include <string.h>
+#include <board.h>
+#include <picirq.h>
+#include <sync.h>
 
 void *percpu_offsets[NCPU];
 DEFINE_PERCPU_NOINIT(struct cpu, cpus);
@@ -18,16 +22,111 @@ DEFINE_PERCPU_NOINIT(struct cpu, cpus);
 #define mp_debug(a ...)
 #endif
 
+#ifdef UCONFIG_ARM_ASID
+/* *
+ * ASIDs tag the TLB entries of the user pages (nG), so that a switch
+ * keeps the entries of the other address spaces instead of dropping the
+ * whole TLB. An mm holds its ASID for a generation: asid_context is the
+ * generation in the high bits and the ASID in the low ASID_BITS. Once
+ * the ASIDs of a generation are all handed out, the next one begins and
+ * every core drops its TLB before its next switch, as it may still hold
+ * the entries of an ASID given to another mm since. ASID 0 stays with
+ * boot_pgdir, which maps no user page. The invalidations by MVA drop the
+ * entries of every ASID, see tlb_invalidate.
+ * */
+#define ASID_BITS                   8
+#define ASID_MASK                   ((1 << ASID_BITS) - 1)
+
+static uint32_t asid_last = 1 << ASID_BITS;
+static volatile bool asid_flush_pending[NCPU];
+static spinlock_s asid_lock;
+
+static inline bool asid_stale(struct mm_struct *mm)
+{
+	return ((mm->asid_context ^ asid_last) >> ASID_BITS) != 0;
+}
+
+// asid_new_context - give mm an ASID of the current generation
+static void asid_new_context(struct mm_struct *mm)
+{
+	int i;
+	spinlock_acquire(&asid_lock);
+	/* another core may have given it one meanwhile */
+	if (asid_stale(mm)) {
+		uint32_t ctx = asid_last + 1;
+		if ((ctx & ASID_MASK) == 0) {
+			ctx++;
+			for (i = 0; i < sysconf.lcpu_count; i++)
+				asid_flush_pending[i] = 1;
+			/* seen by whoever sees the new generation */
+			__sync_synchronize();
+		}
+		asid_last = mm->asid_context = ctx;
+	}
+	spinlock_release(&asid_lock);
+}
+#endif /* UCONFIG_ARM_ASID */
+
+void tls_init(struct cpu *c)
+{
+	c->cpu = c;
+#ifdef UCONFIG_ARM_SMP
+	asm volatile ("mcr p15, 0, %0, c13, c0, 4"::"r" (c));
+#endif
+}
+
 int mp_init(void)
 {
 	sysconf.lcpu_boot = 0;
 	sysconf.lnuma_count = 0;
 	sysconf.lcpu_count = 1;
+#ifdef UCONFIG_ARM_SMP
+	if ((sysconf.lcpu_count = board_nr_cpus()) > NCPU)
+		sysconf.lcpu_count = NCPU;
+#endif
+#ifdef UCONFIG_ARM_ASID
+	spinlock_init(&asid_lock);
+#endif
 	percpu_offsets[0] = __percpu_start;
 
+	struct cpu *c = per_cpu_ptr(cpus, 0);
+	c->id = c->hwid = 0;
+	c->core_id = c->pkg_id = 0;
+	c->percpu_base = __percpu_start;
+	tls_init(c);
 	return 0;
 }
 
+/* the per-cpu areas of the cores but the boot one, which has .percpu */
+void percpu_init(void)
+{
+	size_t percpu_size = ROUNDUP(__percpu_end - __percpu_start, CACHELINE);
+	int i;
+	if (!percpu_size || sysconf.lcpu_count <= 1)
+		return;
+	unsigned int pages =
+	    ROUNDUP_DIV(percpu_size * (sysconf.lcpu_count - 1), PGSIZE);
+	struct Page *p = alloc_pages(pages);
+	assert(p != NULL);
+	void *kva = page2kva(p);
+	memset(kva, 0, pages * PGSIZE);
+	for (i = 1; i < sysconf.lcpu_count; i++, kva += percpu_size) {
+		percpu_offsets[i] = kva;
+		struct cpu *c = per_cpu_ptr(cpus, i);
+		c->id = c->hwid = i;
+		/* the cores of a cluster, sharing its l2 */
+		c->core_id = i, c->pkg_id = 0;
+		c->percpu_base = kva;
+		kprintf("percpu_init: cpu%d get 0x%08x\n", i, kva);
+	}
+}
+
+/* the cores share the memory, see numa/percpu_alloc.c */
+struct Page *percpu_alloc_pages(int cpu, size_t n)
+{
+	return alloc_pages(n);
+}
+
 void kern_enter(int source)
 {
 	assert(0);
@@ -40,17 +139,41 @@ void kern_leave(void)
 
 void mp_set_mm_pagetable(struct mm_struct *mm)
 {
+#ifdef UCONFIG_ARM_ASID
+	uint32_t asid = 0;
+	if (mm != NULL && mm->pgdir != NULL) {
+		if (asid_stale(mm))
+			asid_new_context(mm);
+		asid = mm->asid_context & ASID_MASK;
+	}
+	/* no walk in between tags the new table with the old ASID */
+	arm_set_asid(0);
+#endif
 	if (mm != NULL && mm->pgdir != NULL)
 		ttbSet(PADDR(mm->pgdir));
 	else
 		ttbSet(boot_pgdir_pa);
+#ifdef UCONFIG_ARM_ASID
+	arm_isb();
+	arm_set_asid(asid);
+	__sync_synchronize();
+	if (asid_flush_pending[myid()]) {
+		asid_flush_pending[myid()] = 0;
+		asm volatile ("mcr p15, 0, %0, c8, c7, 0; dsb; isb"::"r" (0):"memory");
+	}
+#elif defined UCONFIG_ARM_SMP
+	/* no ASIDs, the old entries are of this core only */
+	asm volatile ("mcr p15, 0, %0, c8, c7, 0; dsb; isb"::"r" (0):"memory");
+#else
 	tlb_invalidate_all();
+#endif
 }
 
 pgd_t *mpti_pgdir;
 uintptr_t mpti_la;
 volatile int mpti_end;
 
+/* with UCONFIG_ARM_SMP tlb_invalidate is broadcast, see pmm.c */
 void mp_tlb_invalidate(pgd_t * pgdir, uintptr_t la)
 {
 	tlb_invalidate(pgdir, la);
@@ -60,3 +183,128 @@ void mp_tlb_update(pgd_t * pgdir, uintptr_t la)
 {
 	tlb_update(pgdir, la);
 }
+
+void mp_tlb_flush_range(pgd_t * pgdir, uintptr_t start, uintptr_t end)
+{
+	if (end - start > TLB_FLUSH_ALL_PAGES * PGSIZE) {
+		tlb_invalidate_all();
+		return;
+	}
+	for (; start < end; start += PGSIZE)
+		tlb_invalidate(pgdir, start);
+}
+
+#ifdef UCONFIG_ARM_SMP
+
+/* the stacks kern_entry_secondary switches to, by cpu id */
+uintptr_t ap_boot_stacks[NCPU];
+
+static atomic_t bsync;
+/* proc_init_ap is run by one core at a time */
+static spinlock_s ap_lock;
+
+void fire_ipi_one(int cpuid)
+{
+	pic_send_sgi(1 << per_cpu_ptr(cpus, cpuid)->hwid, IPI_SGI_CALL);
+}
+
+void fire_ipi_mask(const cpuset_t * cs)
+{
+	uint32_t mask = 0;
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (cpuset_test(cs, i))
+			mask |= 1 << per_cpu_ptr(cpus, i)->hwid;
+	}
+	if (mask != 0)
+		pic_send_sgi(mask, IPI_SGI_CALL);
+}
+
+static int ipi_call_handler(int irq, void *data)
+{
+#ifdef UCONFIG_ENABLE_IPI
+	do_ipicall();
+#endif
+	return 0;
+}
+
+/* the trap returns through schedule() as need_resched is set */
+static int ipi_resched_handler(int irq, void *data)
+{
+	return 0;
+}
+
+// mp_resched_cpu - interrupt cpu so that it reschedules on its way back to
+//                - user mode, as need_resched of its current is set
+void mp_resched_cpu(int cpu)
+{
+	if (cpu != myid())
+		pic_send_sgi(1 << per_cpu_ptr(cpus, cpu)->hwid,
+			     IPI_SGI_RESCHED);
+}
+
+void ap_init(void)
+{
+	struct cpu *c = per_cpu_ptr(cpus, arm_cpuid());
+	tls_init(c);
+	kprintf("CPU%d alive\n", myid());
+	pmm_init_ap();
+#ifdef UCONFIG_ENABLE_IPI
+	ipi_init();
+#endif
+	board_init_ap();
+
+	spinlock_acquire(&ap_lock);
+	proc_init_ap();
+	spinlock_release(&ap_lock);
+
+	atomic_inc(&bsync);	/* let the boot core know we are up */
+
+	intr_enable();		// enable irq interrupt
+	cpu_idle();
+}
+
+/* *
+ * cpus_up - start the other cores. Each gets a stack, left in
+ * ap_boot_stacks, and is let out of the ROM to kern_entry_secondary, which
+ * runs at its physical address as the kernel is mapped flat; ap_init then
+ * runs on all of them in parallel.
+ * */
+void cpus_up(void)
+{
+	extern char kern_entry_secondary[];
+	int i, n = 0;
+
+	register_irq(IPI_SGI_CALL, ipi_call_handler, NULL);
+	register_irq(IPI_SGI_RESCHED, ipi_resched_handler, NULL);
+
+	for (i = 1; i < sysconf.lcpu_count; i++) {
+		struct Page *p = alloc_pages(KSTACKPAGE);
+		assert(p != NULL);
+		ap_boot_stacks[i] = (uintptr_t) page2kva(p) + KSTACKSIZE;
+		n++;
+	}
+	if (n == 0)
+		return;
+	spinlock_init(&ap_lock);
+	atomic_set(&bsync, 0);
+	/* read before the MMU of the core is on */
+	arm_dcache_clean_range((uintptr_t) & boot_pgdir_pa,
+			       sizeof(boot_pgdir_pa));
+
+	for (i = 1; i < sysconf.lcpu_count; i++)
+		board_boot_cpu(per_cpu_ptr(cpus, i)->hwid,
+			       (uintptr_t) kern_entry_secondary);
+
+	while (atomic_read(&bsync) != n)
+		nop_pause();
+}
+
+#else /* !UCONFIG_ARM_SMP */
+
+void mp_resched_cpu(int cpu)
+{
+	/* a single cpu, it is the one rescheduling */
+}
+
+#endif /* UCONFIG_ARM_SMP */
@@ -103,7 +103,6 @@ int do_sigreturn()
 
 	lock_sig(sighand);
 	current->signal_info.blocked = kframe->old_blocked;
-	sig_recalc_pending(current);
 	unlock_sig(sighand);
 
 	*(current->tf) = kframe->tf;
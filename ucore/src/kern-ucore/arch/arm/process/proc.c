@@ -72,9 +72,13 @@ extern void forkrets(struct trapframe *tf);
 
 void switch_to(struct context *from, struct context *to);
 
-void tls_switch(struct proc_struct *proc)
+// tls_switch - TPIDRURO, the user read-only thread id register, holds
+//            - the tls of next unless it is that of prev already
+void tls_switch(struct proc_struct *prev, struct proc_struct *next)
 {
-	asm("mcr p15, 0, %0, c13, c0, 3"::"r"(proc->tls_pointer));
+	if (prev == NULL || prev->tls_pointer != next->tls_pointer) {
+		asm("mcr p15, 0, %0, c13, c0, 3"::"r"(next->tls_pointer));
+	}
 }
 
 static void proc_signal_init(struct proc_signal *ps)
@@ -92,7 +96,7 @@ static void proc_signal_init(struct proc_signal *ps)
 // alloc_proc - create a proc struct and init fields
 struct proc_struct *alloc_proc(void)
 {
-	struct proc_struct *proc = kmalloc(sizeof(struct proc_struct));
+	struct proc_struct *proc = kmem_cache_alloc(proc_cachep);
 	if (proc != NULL) {
 		memset(proc, 0, sizeof(struct proc_struct));
 		proc->state = PROC_UNINIT;
@@ -113,9 +117,37 @@ struct proc_struct *alloc_proc(void)
 		proc->rq = NULL;
 		list_init(&(proc->run_link));
 		proc->time_slice = 0;
+		proc->vruntime = 0;
+		proc->nice = 0;
+		proc->timer_slack = 0;
+		proc->policy = SCHED_NORMAL;
+		proc->rt_priority = 0;
+		proc->normal_policy = SCHED_NORMAL;
+		proc->normal_prio = 0;
+		proc->pi_prio = 0;
+		list_init(&(proc->pi_held));
+		proc->pi_blocked_on = NULL;
+		proc->pi_exited = 0;
+		proc->runtime = 0;
+		proc->exec_start = 0;
+		proc->last_ran = 0;
+		memset(&(proc->rusage), 0, sizeof(struct rusage));
+		memset(&(proc->child_rusage), 0, sizeof(struct rusage));
+#ifdef UCONFIG_SCHEDSTATS
+		proc->sched_enqueued = proc->sched_ran = 0;
+		memset(&(proc->sched_stat), 0, sizeof(struct sched_stat));
+#endif
 		proc->sem_queue = NULL;
 		event_box_init(&(proc->event_box));
 		proc->fs_struct = NULL;
+#ifdef UCONFIG_MEMCG
+		proc->memcg = NULL;
+#endif
+#ifdef UCONFIG_CPUCG
+		proc->cpucg = NULL;
+		list_init(&(proc->cg_link));
+#endif
+		spinlock_init(&proc->lock);
 
 		proc->tid = -1;
 		proc->gid = -1;
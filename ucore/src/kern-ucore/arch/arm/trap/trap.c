@@ -10,6 +10,7 @@
 #include <vmm.h>
 #include <proc.h>
 #include <sched.h>
+#include <softirq.h>
 #include <unistd.h>
 #include <kio.h>
 #include <picirq.h>
@@ -17,12 +18,14 @@
 #include <error.h>
 #include <signal.h>
 #include <kgdb-stub.h>
+#include <mp.h>
 
 #define TICK_NUM 5
 
 //handle hw irq, should be implemented in mach_xxx
 void irq_handler(void);
-static int __irq_level = 0;
+/* the nesting of the irqs each core is in */
+static DEFINE_PERCPU_NOINIT(int, __irq_level);
 
 static const char *trapname(int trapno)
 {
@@ -226,7 +229,7 @@ static void trap_dispatch(struct trapframe *tf)
 		break;
 #endif
 	case T_IRQ:
-		__irq_level++;
+		get_cpu_var(__irq_level)++;
 #if 0
 		if (!trap_in_kernel(tf)) {
 			uint32_t sp;
@@ -235,7 +238,8 @@ static void trap_dispatch(struct trapframe *tf)
 		}
 #endif
 		irq_handler();
-		__irq_level--;
+		get_cpu_var(__irq_level)--;
+		irq_exit();
 		break;
 #if 0
 	case T_PANIC:
@@ -286,7 +290,10 @@ void trap(struct trapframe *tf)
 			if (current->need_resched) {
 				schedule();
 			}
-			do_signal(tf, NULL);
+			/* nothing to lock for the common case */
+			if (proc_signal_pending(&(current->signal_info))) {
+				do_signal(tf, NULL);
+			}
 		}
 	}
 }
@@ -299,5 +306,5 @@ void raise(void)
 
 int ucore_in_interrupt()
 {
-	return __irq_level;
+	return get_cpu_var(__irq_level);
 }
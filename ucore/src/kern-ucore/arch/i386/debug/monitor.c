@@ -6,6 +6,7 @@
 #include <monitor.h>
 #include <kdebug.h>
 #include <kio.h>
+#include <zswap.h>
 
 /* *
  * Simple command-line kernel monitor useful for controlling the
@@ -42,6 +43,9 @@ static struct command commands[] = {
 	 "    @example: delbp 3", mon_delete_dr},
 	{"listdr", "List all breakpoints or watchpoints.", mon_list_dr},
 	{"halt", "shutdown qemu(modified)",mon_halt},
+#ifdef UCONFIG_ZSWAP
+	{"zswap", "Display the compression ratio and hits of zswap.", mon_zswap},
+#endif
 };
 
 /* return if kernel is panic, in kern/debug/panic.c */
@@ -341,3 +345,12 @@ int mon_halt(int argc, char **argv, struct trapframe *tf)
 
 	return 0;
 }
+
+#ifdef UCONFIG_ZSWAP
+/* mon_zswap - print the counters of zswap */
+int mon_zswap(int argc, char **argv, struct trapframe *tf)
+{
+	zswap_print_stat();
+	return 0;
+}
+#endif
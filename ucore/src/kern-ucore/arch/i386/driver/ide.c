@@ -4,10 +4,15 @@
 #include <picirq.h>
 #include <fs.h>
 #include <ide.h>
+#include <iobuf.h>
 #include <arch.h>
 #include <sem.h>
 #include <assert.h>
 #include <kio.h>
+#include <sync.h>
+#include <proc.h>
+#include <sched.h>
+#include <blkqueue.h>
 
 #define ISA_DATA                0x00
 #define ISA_ERROR               0x01
@@ -44,14 +49,20 @@
 #define IO_CTRL1                0x374
 
 #define MAX_IDE                 4
-#define MAX_NSECS               128
+#define MAX_NSECS               IDE_MAX_NSECS
 #define MAX_DISK_NSECS          0x10000000U
 #define VALID_IDE(ideno)        (((ideno) >= 0) && ((ideno) < MAX_IDE) && (ide_devices[ideno].valid))
 
+/* status polls before a transfer of the queue worker sleeps */
+#define IDE_SPIN_POLLS          1024
+
 static struct {
 	const unsigned short base;	// I/O Base
 	const unsigned short ctrl;	// Control Base
 	semaphore_t sem;
+#ifdef UCONFIG_BLK_QUEUE
+	wait_queue_t intr_wait;	// the worker waits for the interrupt
+#endif
 } channels[2] = {
 	{
 	IO_BASE0, IO_CTRL0}, {
@@ -88,9 +99,83 @@ static int ide_wait_ready(unsigned short iobase, bool check_error)
 	return 0;
 }
 
+#ifdef UCONFIG_BLK_QUEUE
+static struct blk_queue ide_queues[MAX_IDE];
+
+static void ide_queue_init(void);
+
+/*
+ * Sleep until the interrupt of the channel of ideno, or the next tick if
+ * it does not come, so that a lost interrupt costs a tick at most.
+ */
+static void ide_sleep(unsigned short ideno)
+{
+	wait_queue_t *queue = &(channels[ideno >> 1].intr_wait);
+	wait_t __wait, *wait = &__wait;
+	timer_t __timer, *timer = timer_init(&__timer, current, 1);
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	wait_current_set(queue, wait, WT_IO);
+	add_timer(timer);
+	local_intr_restore(intr_flag);
+
+	schedule();
+
+	local_intr_save(intr_flag);
+	del_timer(timer);
+	wait_current_del(queue, wait);
+	local_intr_restore(intr_flag);
+}
+
+// ide_intr - the interrupt of channel IRQ_IDE1 or IRQ_IDE2
+void ide_intr(int irq)
+{
+	int chan = (irq == IRQ_IDE1) ? 0 : 1;
+	/* reading the status acknowledges it */
+	inb(channels[chan].base + ISA_STATUS);
+	if (!wait_queue_empty(&(channels[chan].intr_wait))) {
+		wakeup_queue(&(channels[chan].intr_wait), WT_IO, 1);
+	}
+}
+#else
+void ide_intr(int irq)
+{
+}
+#endif
+
+/*
+ * Wait for the drive ideno to be done with a sector. A transfer that can
+ * sleep only spins for a while, then sleeps until the drive interrupts,
+ * so that the cpu runs others while the disk works.
+ */
+static int ide_wait_io(unsigned short ideno, bool check_error, bool can_sleep)
+{
+	unsigned short iobase = IO_BASE(ideno);
+	int r;
+#ifdef UCONFIG_BLK_QUEUE
+	int polls = 0;
+#endif
+	while ((r = inb(iobase + ISA_STATUS)) & IDE_BSY) {
+#ifdef UCONFIG_BLK_QUEUE
+		if (can_sleep && ++polls == IDE_SPIN_POLLS) {
+			ide_sleep(ideno);
+			polls = 0;
+		}
+#endif
+	}
+	if (check_error && (r & (IDE_DF | IDE_ERR)) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
 void ide_init(void)
 {
 	static_assert((SECTSIZE % 4) == 0);
+#ifdef UCONFIG_BLK_QUEUE
+	wait_queue_init(&(channels[0].intr_wait));
+	wait_queue_init(&(channels[1].intr_wait));
+#endif
 	unsigned short ideno, iobase;
 	for (ideno = 0; ideno < MAX_IDE; ideno++) {
 		/* assume that no device here */
@@ -161,6 +246,9 @@ void ide_init(void)
 
 	sem_init(&(channels[0].sem), 1);
 	sem_init(&(channels[1].sem), 1);
+#ifdef UCONFIG_BLK_QUEUE
+	ide_queue_init();
+#endif
 }
 
 bool ide_device_valid(unsigned short ideno)
@@ -176,8 +264,21 @@ size_t ide_device_size(unsigned short ideno)
 	return 0;
 }
 
-int ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs)
+/*
+ * Transfer the sectors from secno on to or from the iovcnt buffers of iov
+ * with one command. Each buffer holds a whole # of sectors, and they hold
+ * at most IDE_MAX_NSECS together.
+ */
+static int
+ide_rw_secsv(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+	     int iovcnt, bool write, bool can_sleep)
 {
+	size_t nsecs = 0;
+	int i;
+	for (i = 0; i < iovcnt; i++) {
+		assert(iov[i].iov_len % SECTSIZE == 0);
+		nsecs += iov[i].iov_len / SECTSIZE;
+	}
 	assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
 	assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
 	unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
@@ -194,14 +295,23 @@ int ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs)
 	outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
 	outb(iobase + ISA_SDH,
 	     0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-	outb(iobase + ISA_COMMAND, IDE_CMD_READ);
+	outb(iobase + ISA_COMMAND, write ? IDE_CMD_WRITE : IDE_CMD_READ);
 
 	int ret = 0;
-	for (; nsecs > 0; nsecs--, dst += SECTSIZE) {
-		if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-			goto out;
+	for (i = 0; i < iovcnt; i++) {
+		char *buf = iov[i].iov_base;
+		size_t n;
+		for (n = iov[i].iov_len / SECTSIZE; n > 0;
+		     n--, buf += SECTSIZE) {
+			if ((ret = ide_wait_io(ideno, 1, can_sleep)) != 0) {
+				goto out;
+			}
+			if (write) {
+				outsl(iobase, buf, SECTSIZE / sizeof(uint32_t));
+			} else {
+				insl(iobase, buf, SECTSIZE / sizeof(uint32_t));
+			}
 		}
-		insl(iobase, dst, SECTSIZE / sizeof(uint32_t));
 	}
 
 out:
@@ -209,37 +319,79 @@ out:
 	return ret;
 }
 
-int
-ide_write_secs(unsigned short ideno, uint32_t secno, const void *src,
-	       size_t nsecs)
+#ifdef UCONFIG_BLK_QUEUE
+static int
+ide_xfer(struct blk_queue *q, uint32_t secno, const struct iovec *iov,
+	 int iovcnt, bool write, bool can_sleep)
 {
-	assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
-	assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
-	unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
+	unsigned short ideno = (uintptr_t) q->private;
+	return ide_rw_secsv(ideno, secno, iov, iovcnt, write, can_sleep);
+}
 
-	lock_channel(ideno);
+// ide_queue_init - start the request queues of the valid devices
+static void ide_queue_init(void)
+{
+	unsigned short ideno;
+	for (ideno = 0; ideno < MAX_IDE; ideno++) {
+		if (ide_devices[ideno].valid) {
+			char name[16];
+			snprintf(name, sizeof(name), "ide%d", ideno);
+			blk_queue_init(ide_queues + ideno, name, ide_xfer, MAX_NSECS,
+				       (void *)(uintptr_t) ideno);
+			if (blk_queue_start(ide_queues + ideno) != 0) {
+				panic("ide %d: no request queue.\n", ideno);
+			}
+		}
+	}
+}
 
-	ide_wait_ready(iobase, 0);
+// ide_submit - queue req to device ideno, see blk_submit
+void ide_submit(unsigned short ideno, struct blk_request *req)
+{
+	assert(VALID_IDE(ideno));
+	blk_submit(ide_queues + ideno, req);
+}
 
-	// generate interrupt
-	outb(ioctrl + ISA_CTRL, 0);
-	outb(iobase + ISA_SECCNT, nsecs);
-	outb(iobase + ISA_SECTOR, secno & 0xFF);
-	outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
-	outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
-	outb(iobase + ISA_SDH,
-	     0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-	outb(iobase + ISA_COMMAND, IDE_CMD_WRITE);
+static int
+ide_rw(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+       int iovcnt, bool write)
+{
+	assert(VALID_IDE(ideno));
+	return blk_rw(ide_queues + ideno, secno, iov, iovcnt, write);
+}
+#else
+static int
+ide_rw(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+       int iovcnt, bool write)
+{
+	return ide_rw_secsv(ideno, secno, iov, iovcnt, write, 0);
+}
+#endif
 
-	int ret = 0;
-	for (; nsecs > 0; nsecs--, src += SECTSIZE) {
-		if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-			goto out;
-		}
-		outsl(iobase, src, SECTSIZE / sizeof(uint32_t));
-	}
+int ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs)
+{
+	struct iovec iov = { dst, nsecs * SECTSIZE };
+	return ide_rw(ideno, secno, &iov, 1, 0);
+}
 
-out:
-	unlock_channel(ideno);
-	return ret;
+int
+ide_write_secs(unsigned short ideno, uint32_t secno, const void *src,
+	       size_t nsecs)
+{
+	struct iovec iov = { (char *)src, nsecs * SECTSIZE };
+	return ide_rw(ideno, secno, &iov, 1, 1);
+}
+
+int
+ide_read_secsv(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+	       int iovcnt)
+{
+	return ide_rw(ideno, secno, iov, iovcnt, 0);
+}
+
+int
+ide_write_secsv(unsigned short ideno, uint32_t secno, const struct iovec *iov,
+		int iovcnt)
+{
+	return ide_rw(ideno, secno, iov, iovcnt, 1);
 }
@@ -3,6 +3,11 @@
 
 #include <types.h>
 
+struct iovec;
+
+/* # of sectors one command transfers at most */
+#define IDE_MAX_NSECS                   128
+
 void ide_init(void);
 bool ide_device_valid(unsigned short ideno);
 size_t ide_device_size(unsigned short ideno);
@@ -11,5 +16,14 @@ int ide_read_secs(unsigned short ideno, uint32_t secno, void *dst,
 		  size_t nsecs);
 int ide_write_secs(unsigned short ideno, uint32_t secno, const void *src,
 		   size_t nsecs);
+int ide_read_secsv(unsigned short ideno, uint32_t secno,
+		   const struct iovec *iov, int iovcnt);
+int ide_write_secsv(unsigned short ideno, uint32_t secno,
+		    const struct iovec *iov, int iovcnt);
+void ide_intr(int irq);
+#ifdef UCONFIG_BLK_QUEUE
+struct blk_request;
+void ide_submit(unsigned short ideno, struct blk_request *req);
+#endif
 
 #endif /* !__KERN_DRIVER_IDE_H__ */
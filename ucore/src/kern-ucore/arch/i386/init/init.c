@@ -9,6 +9,7 @@
 #include <intr.h>
 #include <pmm.h>
 #include <vmm.h>
+#include <vmalloc.h>
 #include <ide.h>
 #include <fs.h>
 #include <swap.h>
@@ -43,9 +44,11 @@ int kern_init(void)
 	idt_init();		// init interrupt descriptor table
 
 	vmm_init();		// init virtual memory management
+	vmalloc_init();		// before boot_pgdir is copied
 	sched_init();		// init scheduler
 	proc_init();		// init process table
 	sync_init();		// init sync struct
+	percpu_alloc_init();	// the dynamic per-cpu objects
 
 	ide_init();		// init ide devices
 #ifdef UCONFIG_SWAP
@@ -5,6 +5,17 @@
 
 #define CACHELINE 64
 
+#define barrier() __asm__ __volatile__ ("" ::: "memory")
+
+/* x86 keeps the order of the loads, and of the stores, and no load passes
+ * a store before it to another place; only smp_mb needs an instruction, a
+ * locked op being cheaper than mfence. see memorder.h */
+#define smp_mb()    \
+    __asm__ __volatile__ ("lock; addl $0,0(%%esp)" ::: "memory", "cc")
+#define smp_rmb()   barrier()
+#define smp_wmb()   barrier()
+#define smp_acqrel() barrier()
+
 #define do_div(n, base) ({                                          \
             unsigned long __upper, __low, __high, __mod, __base;    \
             __base = (base);                                        \
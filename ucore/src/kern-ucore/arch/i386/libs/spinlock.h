@@ -10,22 +10,26 @@ typedef spinlock_s *spinlock_t;
 
 #define spinlock_init(x) do { (x)->lock = 0; } while (0)
 
+/* a single cpu: holding a lock only keeps the others from preempting us */
 static inline void spinlock_acquire(spinlock_t lock)
 {
+	preempt_disable();
 }
 
 static inline int spinlock_acquire_try(spinlock_t lock)
 {
+	preempt_disable();
 	return 1;
 }
 
 static inline void spinlock_release(spinlock_t lock)
 {
+	preempt_enable();
 }
 
 #define spin_lock_irqsave(lock, x)      do { x = __intr_save();spinlock_acquire(lock); } while (0)
 
-#define spin_unlock_irqrestore(lock, x)      do { spinlock_release(lock);__intr_restore(x); } while (0)
+#define spin_unlock_irqrestore(lock, x)      do { spinlock_release(lock);local_intr_restore(x); } while (0)
 
 
 #endif
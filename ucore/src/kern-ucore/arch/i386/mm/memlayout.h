@@ -37,6 +37,10 @@
  *                            |   Cur. Page Table (Kern, RW)    | RW/-- PTSIZE
  *     VPT -----------------> +---------------------------------+ 0xFAC00000
  *                            |        Invalid Memory (*)       | --/--
+ *     VMALLOC_END ---------> +---------------------------------+ 0xFA800000
+ *                            |     vmalloc Area (Kern, RW)     | RW/--
+ *     VMALLOC_START -------> +---------------------------------+ 0xF8400000
+ *                            |        Invalid Memory (*)       | --/--
  *     KERNTOP -------------> +---------------------------------+ 0xF8000000
  *                            |                                 |
  *                            |    Remapped Physical Memory     | RW/-- KMEMSIZE
@@ -72,6 +76,15 @@
 #define KMEMSIZE            0x38000000	// the maximum amount of physical memory
 #define KERNTOP             (KERNBASE + KMEMSIZE)
 
+/* *
+ * The pages of vmalloc, not contiguous, are mapped one by one between the
+ * physical memory and VPT, a page table apart from both. Its page tables
+ * are made at boot and so shared by every page directory copied from
+ * boot_pgdir.
+ * */
+#define VMALLOC_START       0xF8400000
+#define VMALLOC_END         0xFA800000
+
 /* *
  * Virtual page table. Entry PDX[VPT] in the PD (Page Directory) contains
  * a pointer to the page directory itself, thereby turning the PD into a page
@@ -96,7 +109,12 @@
     (USERBASE <= (start) && (start) < (end) && (end) <= USERTOP)
 
 #define KERN_ACCESS(start, end)                     \
-    (KERNBASE <= (start) && (start) < (end) && (end) <= KERNTOP)
+    (KERNBASE <= (start) && (start) < (end)         \
+     && ((end) <= KERNTOP                           \
+         || (VMALLOC_START <= (start) && (end) <= VMALLOC_END)))
+
+/* copy_to_user and copy_from_user survive their faults, see vmm.c */
+#define __HAVE_ARCH_UACCESS_FIXUP
 
 #ifndef __ASSEMBLER__
 
@@ -124,6 +142,8 @@ struct e820map {
  * physical page. In kern/mm/pmm.h, you can find lots of useful functions
  * that convert Page to other data types, such as phyical address.
  * */
+struct mem_group;
+
 struct Page {
 	atomic_t ref;		// page frame's reference counter
 	uint32_t flags;		// array of flags that describe the status of the page frame
@@ -132,6 +152,13 @@ struct Page {
 	list_entry_t page_link;	// free list link
 	swap_entry_t index;	// stores a swapped-out page identifier
 	list_entry_t swap_link;	// swap hash link
+#ifdef UCONFIG_SWAP
+	struct anon_vma *anon_vma;	// where it may be mapped, while in the swap cache, see rmap.c
+	uintptr_t anon_index;	// its address there, or offset in the shmem
+#endif
+#ifdef UCONFIG_MEMCG
+	struct mem_group *memcg;	// the group it is charged to, see memcg.c
+#endif
 };
 
 /* Flags describing the status of a page frame */
@@ -142,6 +169,9 @@ struct Page {
 #define PG_swap                     4	// the page is in the active or inactive page list (and swap hash table)
 #define PG_active                   5	// the page is in the active page list
 #define PG_IO                       6	//dma page, never free in unmap_page
+#define PG_lazyfree                 7	// MADV_FREE: reclaim drops it if its pte is clean
+#define PG_age                      8	// and 9: the idle scans reclaim waits for, see swap.c
+#define PG_memcg                    10	// page->memcg is charged
 
 #define SetPageReserved(page)       set_bit(PG_reserved, &((page)->flags))
 #define ClearPageReserved(page)     clear_bit(PG_reserved, &((page)->flags))
@@ -164,6 +194,12 @@ struct Page {
 #define SetPageIO(page)         set_bit(PG_IO, &((page)->flags))
 #define ClearPageIO(page)       clear_bit(PG_IO, &((page)->flags))
 #define PageIO(page)            test_bit(PG_IO, &((page)->flags))
+#define SetPageLazyFree(page)   set_bit(PG_lazyfree, &((page)->flags))
+#define ClearPageLazyFree(page) clear_bit(PG_lazyfree, &((page)->flags))
+#define PageLazyFree(page)      test_bit(PG_lazyfree, &((page)->flags))
+#define SetPageMemcg(page)          set_bit(PG_memcg, &((page)->flags))
+#define ClearPageMemcg(page)        clear_bit(PG_memcg, &((page)->flags))
+#define PageMemcg(page)             test_bit(PG_memcg, &((page)->flags))
 
 // convert list entry to page
 #define le2page(le, member)                 \
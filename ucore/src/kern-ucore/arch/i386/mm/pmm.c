@@ -10,8 +10,10 @@
 #include <slab.h>
 #include <error.h>
 #include <proc.h>
+#include <swap.h>
 #include <kio.h>
 #include <mp.h>
+#include <memcg.h>
 
 /* *
  * Task State Segment:
@@ -396,9 +398,12 @@ try_again:
 	if (page == NULL && try_free_pages(n)) {
 		goto try_again;
 	}
+	if (page != NULL) {
+		kswapd_balance(intr_flag);
+	}
 #endif
 
-	get_cpu_var(used_pages) += n;
+	this_cpu_add(used_pages, n);
 	return page;
 }
 
@@ -424,12 +429,13 @@ void *boot_alloc_page(void)
 void free_pages(struct Page *base, size_t n)
 {
 	bool intr_flag;
+	memcg_uncharge_pages(base, n);
 	local_intr_save(intr_flag);
 	{
 		pmm_manager->free_pages(base, n);
 	}
 	local_intr_restore(intr_flag);
-	get_cpu_var(used_pages) -= n;
+	this_cpu_sub(used_pages, n);
 }
 
 // invalidate a TLB entry, but only if the page tables being
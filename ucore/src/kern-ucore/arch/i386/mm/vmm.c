@@ -1,10 +1,45 @@
 #include <vmm.h>
 #include <string.h>
+#include <proc.h>
+
+/* *
+ * The user copies do not walk the vmas first: they copy, and a fault on a
+ * user address is handled as one of the user would be, with mm locked
+ * shared by do_pgfault unless the caller holds it. A fault do_pgfault
+ * cannot fix resumes at the fixup of its instruction in __ex_table, see
+ * fixup_exception in trap.c, which leaves the bytes not copied in the
+ * count register. Only the copies of current->mm may fault, the others
+ * are checked against the vmas as before.
+ * */
+
+// __copy_user - the # of bytes of [src, src + len) not copied to dst
+static size_t __copy_user(void *dst, const void *src, size_t len)
+{
+	asm volatile ("1: rep movsb\n"
+		      "2:\n"
+		      ".section __ex_table, \"a\"\n"
+		      ".balign 4\n"
+		      ".long 1b, 2b\n"
+		      ".previous\n":"+D" (dst), "+S"(src), "+c"(len)::"memory");
+	return len;
+}
+
+// uaccess_direct - whether a copy of [addr, addr + len) of mm may fault
+static inline bool uaccess_direct(struct mm_struct *mm, uintptr_t addr,
+				  size_t len)
+{
+	return mm != NULL && current != NULL && mm == current->mm
+	    && USER_ACCESS(addr, addr + len);
+}
 
 bool
 copy_from_user(struct mm_struct *mm, void *dst, const void *src, size_t len,
 	       bool writable)
 {
+	/* a fault would not tell whether src is writable */
+	if (!writable && uaccess_direct(mm, (uintptr_t) src, len)) {
+		return __copy_user(dst, src, len) == 0;
+	}
 	if (!user_mem_check(mm, (uintptr_t) src, len, writable)) {
 		return 0;
 	}
@@ -14,6 +49,9 @@ copy_from_user(struct mm_struct *mm, void *dst, const void *src, size_t len,
 
 bool copy_to_user(struct mm_struct * mm, void *dst, const void *src, size_t len)
 {
+	if (uaccess_direct(mm, (uintptr_t) dst, len)) {
+		return __copy_user(dst, src, len) == 0;
+	}
 	if (!user_mem_check(mm, (uintptr_t) dst, len, 1)) {
 		return 0;
 	}
@@ -28,6 +28,11 @@ int mp_init(void)
 	return 0;
 }
 
+struct Page *percpu_alloc_pages(int cpu, size_t n)
+{
+	return alloc_pages(n);
+}
+
 void kern_enter(int source)
 {
 }
@@ -57,3 +62,25 @@ void mp_tlb_update(pgd_t * pgdir, uintptr_t la)
 {
 	tlb_update(pgdir, la);
 }
+
+void mp_tlb_flush_range(pgd_t * pgdir, uintptr_t start, uintptr_t end)
+{
+	if (end - start > TLB_FLUSH_ALL_PAGES * PGSIZE) {
+		if (rcr3() == PADDR(pgdir))
+			lcr3(rcr3());
+		return;
+	}
+	for (; start < end; start += PGSIZE)
+		tlb_invalidate(pgdir, start);
+}
+
+void mp_tlb_flush_kernel(void)
+{
+	/* the kernel mappings are not global here */
+	lcr3(rcr3());
+}
+
+void mp_resched_cpu(int cpu)
+{
+	/* a single cpu, it is the one rescheduling */
+}
@@ -25,7 +25,12 @@ static inline void __intr_restore(bool flag)
 }
 
 #define local_intr_save(x)      do { x = __intr_save(); } while (0)
+#ifdef UCONFIG_PREEMPT
+/* turning interrupts back on is a preemption point */
+#define local_intr_restore(x)   do { __intr_restore(x); preempt_check_resched(); } while (0)
+#else
 #define local_intr_restore(x)   __intr_restore(x);
+#endif
 
 void sync_init(void);
 
@@ -3,9 +3,13 @@
 #include <trap.h>
 #include <stdio.h>
 #include <pmm.h>
+#include <vmm.h>
+#include <memcg.h>
+#include <cpucg.h>
 #include <clock.h>
 #include <assert.h>
 #include <sem.h>
+#include <futex.h>
 #include <event.h>
 #include <mbox.h>
 #include <stat.h>
@@ -13,6 +17,11 @@
 #include <sysfile.h>
 #include <error.h>
 #include <kio.h>
+#include <linux_misc_struct.h>
+#include <batch.h>
+#include <trace.h>
+#include <sysrec.h>
+#include <kbench.h>
 
 static uint32_t sys_exit(uint32_t arg[])
 {
@@ -42,6 +51,14 @@ static uint32_t sys_exec(uint32_t arg[])
 	return do_execve(name, argv, envp);
 }
 
+static uint32_t sys_spawn(uint32_t arg[])
+{
+	const char *name = (const char *)arg[0];
+	const char **argv = (const char **)arg[1];
+	const char **envp = (const char **)arg[2];
+	return do_spawn(name, argv, envp);
+}
+
 static uint32_t sys_clone(uint32_t arg[])
 {
 	struct trapframe *tf = current->tf;
@@ -76,6 +93,85 @@ static uint32_t sys_kill(uint32_t arg[])
 	return do_kill(pid, -E_KILLED);
 }
 
+static uint32_t sys_sched_setscheduler(uint32_t arg[])
+{
+	int pid = (int)arg[0];
+	int policy = (int)arg[1];
+	int prio = (int)arg[2];
+	return do_sched_setscheduler(pid, policy, prio);
+}
+
+static uint32_t sys_sched_getscheduler(uint32_t arg[])
+{
+	int pid = (int)arg[0];
+	return do_sched_getscheduler(pid);
+}
+
+static uint32_t sys_sched_getparam(uint32_t arg[])
+{
+	int pid = (int)arg[0];
+	return do_sched_getparam(pid);
+}
+
+static uint32_t sys_setpriority(uint32_t arg[])
+{
+	int pid = (int)arg[0];
+	int nice = (int)arg[1];
+	return do_setpriority(pid, nice);
+}
+
+static uint32_t sys_getpriority(uint32_t arg[])
+{
+	int pid = (int)arg[0];
+	int *nice_store = (int *)arg[1];
+	return do_getpriority(pid, nice_store);
+}
+
+static uint32_t sys_timerslack(uint32_t arg[])
+{
+	int pid = (int)arg[0];
+	int slack = (int)arg[1];
+	return do_timerslack(pid, slack);
+}
+
+static uint32_t sys_sched_setaffinity(uint32_t arg[])
+{
+	int pid = (int)arg[0];
+	size_t size = (size_t) arg[1];
+	const void *mask = (const void *)arg[2];
+	return do_sched_setaffinity(pid, size, mask);
+}
+
+static uint32_t sys_sched_getaffinity(uint32_t arg[])
+{
+	int pid = (int)arg[0];
+	size_t size = (size_t) arg[1];
+	void *mask = (void *)arg[2];
+	return do_sched_getaffinity(pid, size, mask);
+}
+
+static uint32_t sys_settls(uint32_t arg[])
+{
+	void *tls = (void *)arg[0];
+	return do_settls(tls);
+}
+
+static uint32_t sys_gettls(uint32_t arg[])
+{
+	return (uint32_t) do_gettls();
+}
+
+static uint32_t sys_futex(uint32_t arg[])
+{
+	uintptr_t uaddr = (uintptr_t) arg[0];
+	int op = (int)arg[1];
+	int val = (int)arg[2];
+	uintptr_t utime = (uintptr_t) arg[3];
+	uintptr_t uaddr2 = (uintptr_t) arg[4];
+	/* no room for val3, the bitset ops wake and wait on any bit */
+	return do_futex(uaddr, op, val, utime, uaddr2, FUTEX_BITSET_MATCH_ANY);
+}
+
 static uint32_t sys_gettime(uint32_t arg[])
 {
 	return (int)ticks;
@@ -86,6 +182,95 @@ static uint32_t sys_getpid(uint32_t arg[])
 	return current->pid;
 }
 
+static uint32_t sys_vvar(uint32_t arg[])
+{
+	struct mm_struct *mm = current->mm;
+	return (mm != NULL) ? mm->vvar_addr : 0;
+}
+
+static uint32_t sys_settimeofday(uint32_t arg[])
+{
+	struct linux_timeval *tv = (struct linux_timeval *)arg[0];
+	return do_settimeofday(tv);
+}
+
+static uint32_t sys_adjtime(uint32_t arg[])
+{
+	struct linux_timeval *delta = (struct linux_timeval *)arg[0];
+	struct linux_timeval *olddelta = (struct linux_timeval *)arg[1];
+	return do_adjtime(delta, olddelta);
+}
+
+static uintptr_t syscall_dispatch(uintptr_t num, uintptr_t args[]);
+
+static uint32_t sys_batch(uint32_t arg[])
+{
+	struct syscall_rec *recs = (struct syscall_rec *)arg[0];
+	int n = (int)arg[1];
+	return do_syscall_batch(recs, n, syscall_dispatch);
+}
+
+static uint32_t sys_getrusage(uint32_t arg[])
+{
+	int who = (int)arg[0];
+	struct rusage *usage = (struct rusage *)arg[1];
+	return do_getrusage(who, usage);
+}
+
+static uint32_t sys_profile(uint32_t arg[])
+{
+	/* the sampling profiler is of amd64 only */
+	return -E_UNIMP;
+}
+
+static uint32_t sys_ftrace(uint32_t arg[])
+{
+	/* the function tracer is of amd64 only */
+	return -E_UNIMP;
+}
+
+static uint32_t sys_trace(uint32_t arg[])
+{
+#ifdef UCONFIG_TRACEPOINTS
+	int op = (int)arg[0];
+	uint32_t targ = (uint32_t) arg[1];
+	uintptr_t *addr_store = (uintptr_t *) arg[2];
+	return do_trace(op, targ, addr_store);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint32_t sys_sysrec(uint32_t arg[])
+{
+#ifdef UCONFIG_SYSREC
+	int op = (int)arg[0];
+	uint32_t sarg = (uint32_t) arg[1];
+	uintptr_t *addr_store = (uintptr_t *) arg[2];
+	return do_sysrec(op, sarg, addr_store);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint32_t sys_lockstat(uint32_t arg[])
+{
+	/* the lock statistics are of amd64 only */
+	return -E_UNIMP;
+}
+
+static uint32_t sys_kbench(uint32_t arg[])
+{
+#ifdef UCONFIG_KBENCH
+	int op = (int)arg[0];
+	size_t karg = (size_t) arg[1];
+	int count = (int)arg[2];
+	return do_kbench(op, karg, count);
+#else
+	return -E_UNIMP;
+#endif
+}
+
 static uint32_t sys_brk(uint32_t arg[])
 {
 	uintptr_t *brk_store = (uintptr_t *) arg[0];
@@ -115,6 +300,55 @@ static uint32_t sys_shmem(uint32_t arg[])
 	return do_shmem(addr_store, len, mmap_flags);
 }
 
+static uint32_t sys_shm_open(uint32_t arg[])
+{
+	const char *name = (const char *)arg[0];
+	size_t len = (size_t) arg[1];
+	uint32_t mmap_flags = (uint32_t) arg[2];
+	uintptr_t *addr_store = (uintptr_t *) arg[3];
+	return do_shm_open(name, len, mmap_flags, addr_store);
+}
+
+static uint32_t sys_shm_unlink(uint32_t arg[])
+{
+	const char *name = (const char *)arg[0];
+	return do_shm_unlink(name);
+}
+
+static uint32_t sys_madvise(uint32_t arg[])
+{
+	void *addr = (void *)arg[0];
+	size_t len = (size_t) arg[1];
+	int advice = (int)arg[2];
+	return do_madvise(addr, len, advice);
+}
+
+static uint32_t sys_memcg(uint32_t arg[])
+{
+#ifdef UCONFIG_MEMCG
+	int op = (int)arg[0];
+	int id = (int)arg[1];
+	size_t arg0 = (size_t) arg[2];
+	uintptr_t arg1 = (uintptr_t) arg[3];
+	return do_memcg(op, id, arg0, arg1);
+#else
+	return -E_UNIMP;
+#endif
+}
+
+static uint32_t sys_cpucg(uint32_t arg[])
+{
+#ifdef UCONFIG_CPUCG
+	int op = (int)arg[0];
+	int id = (int)arg[1];
+	size_t arg0 = (size_t) arg[2];
+	uintptr_t arg1 = (uintptr_t) arg[3];
+	return do_cpucg(op, id, arg0, arg1);
+#else
+	return -E_UNIMP;
+#endif
+}
+
 static uint32_t sys_putc(uint32_t arg[])
 {
 	int c = (int)arg[0];
@@ -176,6 +410,15 @@ static uint32_t sys_event_recv(uint32_t arg[])
 	return ipc_event_recv(pid_store, event_store, timeout);
 }
 
+static uint32_t sys_event_call(uint32_t arg[])
+{
+	int pid = (int)arg[0];
+	int event = (int)arg[1];
+	int *reply_store = (int *)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return ipc_event_call(pid, event, reply_store, timeout);
+}
+
 static uint32_t sys_mbox_init(uint32_t arg[])
 {
 	unsigned int max_slots = (unsigned int)arg[0];
@@ -198,6 +441,24 @@ static uint32_t sys_mbox_recv(uint32_t arg[])
 	return ipc_mbox_recv(id, buf, timeout);
 }
 
+static uint32_t sys_mbox_sendm(uint32_t arg[])
+{
+	int id = (int)arg[0];
+	struct mboxbuf *bufs = (struct mboxbuf *)arg[1];
+	int n = (int)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return ipc_mbox_sendm(id, bufs, n, timeout);
+}
+
+static uint32_t sys_mbox_recvm(uint32_t arg[])
+{
+	int id = (int)arg[0];
+	struct mboxbuf *bufs = (struct mboxbuf *)arg[1];
+	int n = (int)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return ipc_mbox_recvm(id, bufs, n, timeout);
+}
+
 static uint32_t sys_mbox_free(uint32_t arg[])
 {
 	int id = (int)arg[0];
@@ -248,6 +509,24 @@ static uint32_t sys_seek(uint32_t arg[])
 	return sysfile_seek(fd, pos, whence);
 }
 
+static uint32_t sys_preadv(uint32_t arg[])
+{
+	int fd = (int)arg[0];
+	struct iovec *iov = (struct iovec *)arg[1];
+	int iovcnt = (int)arg[2];
+	off_t pos = (off_t) arg[3];
+	return sysfile_preadv(fd, iov, iovcnt, pos);
+}
+
+static uint32_t sys_pwritev(uint32_t arg[])
+{
+	int fd = (int)arg[0];
+	struct iovec *iov = (struct iovec *)arg[1];
+	int iovcnt = (int)arg[2];
+	off_t pos = (off_t) arg[3];
+	return sysfile_pwritev(fd, iov, iovcnt, pos);
+}
+
 static uint32_t sys_fstat(uint32_t arg[])
 {
 	int fd = (int)arg[0];
@@ -261,6 +540,15 @@ static uint32_t sys_fsync(uint32_t arg[])
 	return sysfile_fsync(fd);
 }
 
+static uint32_t sys_fallocate(uint32_t arg[])
+{
+	int fd = (int)arg[0];
+	int mode = (int)arg[1];
+	off_t off = (off_t) arg[2];
+	off_t len = (off_t) arg[3];
+	return sysfile_fallocate(fd, mode, off, len);
+}
+
 static uint32_t sys_chdir(uint32_t arg[])
 {
 	const char *path = (const char *)arg[0];
@@ -307,6 +595,14 @@ static uint32_t sys_getdirentry(uint32_t arg[])
 	return sysfile_getdirentry(fd, direntp, NULL);
 }
 
+static uint32_t sys_getdents(uint32_t arg[])
+{
+	int fd = (int)arg[0];
+	void *buf = (void *)arg[1];
+	size_t len = (size_t) arg[2];
+	return sysfile_getdents(fd, buf, len);
+}
+
 static uint32_t sys_dup(uint32_t arg[])
 {
 	int fd1 = (int)arg[0];
@@ -327,6 +623,80 @@ static uint32_t sys_mkfifo(uint32_t arg[])
 	return sysfile_mkfifo(name, open_flags);
 }
 
+static uint32_t sys_fcntl(uint32_t arg[])
+{
+	int fd = (int)arg[0];
+	int cmd = (int)arg[1];
+	int farg = (int)arg[2];
+	return sysfile_fcntl(fd, cmd, farg);
+}
+
+static uint32_t sys_splice(uint32_t arg[])
+{
+	int fd_in = (int)arg[0];
+	int fd_out = (int)arg[1];
+	size_t len = (size_t) arg[2];
+	return sysfile_splice(fd_in, fd_out, len, 0);
+}
+
+static uint32_t sys_tee(uint32_t arg[])
+{
+	int fd_in = (int)arg[0];
+	int fd_out = (int)arg[1];
+	size_t len = (size_t) arg[2];
+	return sysfile_splice(fd_in, fd_out, len, 1);
+}
+
+static uint32_t sys_sendfile(uint32_t arg[])
+{
+	int out_fd = (int)arg[0];
+	int in_fd = (int)arg[1];
+	off_t *offset = (off_t *) arg[2];
+	size_t count = (size_t) arg[3];
+	return sysfile_copy_file_range(in_fd, offset, out_fd, NULL, count);
+}
+
+static uint32_t sys_copy_file_range(uint32_t arg[])
+{
+	int fd_in = (int)arg[0];
+	off_t *off_in = (off_t *) arg[1];
+	int fd_out = (int)arg[2];
+	off_t *off_out = (off_t *) arg[3];
+	size_t len = (size_t) arg[4];
+	return sysfile_copy_file_range(fd_in, off_in, fd_out, off_out, len);
+}
+
+static uint32_t sys_epoll_create(uint32_t arg[])
+{
+	return sysfile_epoll_create();
+}
+
+static uint32_t sys_epoll_ctl(uint32_t arg[])
+{
+	int epfd = (int)arg[0];
+	int op = (int)arg[1];
+	int type = (int)arg[2];
+	int id = (int)arg[3];
+	struct epoll_event *event = (struct epoll_event *)arg[4];
+	return sysfile_epoll_ctl(epfd, op, type, id, event);
+}
+
+static uint32_t sys_epoll_wait(uint32_t arg[])
+{
+	int epfd = (int)arg[0];
+	struct epoll_event *events = (struct epoll_event *)arg[1];
+	int maxevents = (int)arg[2];
+	unsigned int timeout = (unsigned int)arg[3];
+	return sysfile_epoll_wait(epfd, events, maxevents, timeout);
+}
+
+static uint32_t sys_uring_enter(uint32_t arg[])
+{
+	struct uring_state *state = (struct uring_state *)arg[0];
+	unsigned int to_submit = (unsigned int)arg[1];
+	return sysfile_uring_enter(state, to_submit);
+}
+
 static uint32_t sys_init_module(uint32_t arg[])
 {
 	void __user *umod = (void __user *)arg[0];
@@ -367,13 +737,33 @@ static uint32_t(*syscalls[]) (uint32_t arg[]) = {
 	    [SYS_fork] sys_fork,
 	    [SYS_wait] sys_wait,
 	    [SYS_exec] sys_exec,
+	    [SYS_spawn] sys_spawn,
 	    [SYS_clone] sys_clone,
 	    [SYS_exit_thread] sys_exit_thread,
 	    [SYS_yield] sys_yield,
 	    [SYS_kill] sys_kill,
+	    [SYS_sched_setscheduler] sys_sched_setscheduler,
+	    [SYS_sched_getscheduler] sys_sched_getscheduler,
+	    [SYS_sched_getparam] sys_sched_getparam,
+	    [SYS_timerslack] sys_timerslack,
+	    [SYS_sched_setaffinity] sys_sched_setaffinity,
+	    [SYS_sched_getaffinity] sys_sched_getaffinity,
+	    [SYS_settls] sys_settls,
+	    [SYS_gettls] sys_gettls,
+	    [SYS_futex] sys_futex,
 	    [SYS_sleep] sys_sleep,
 	    [SYS_gettime] sys_gettime,
 	    [SYS_getpid] sys_getpid,
+	    [SYS_vvar] sys_vvar,
+	    [SYS_settimeofday] sys_settimeofday,
+	    [SYS_adjtime] sys_adjtime,
+	    [SYS_batch] sys_batch,
+	    [SYS_getrusage] sys_getrusage,
+	    [SYS_profile] sys_profile,
+	    [SYS_ftrace] sys_ftrace,
+	    [SYS_trace] sys_trace,
+	    [SYS_lockstat] sys_lockstat,
+	    [SYS_kbench] sys_kbench,
 	    [SYS_brk] sys_brk,
 	    [SYS_mmap] sys_mmap,
 	    [SYS_munmap] sys_munmap,
@@ -387,18 +777,32 @@ static uint32_t(*syscalls[]) (uint32_t arg[]) = {
 	    [SYS_sem_get_value] sys_sem_get_value,
 	    [SYS_event_send] sys_event_send,
 	    [SYS_event_recv] sys_event_recv,
+	    [SYS_event_call] sys_event_call,
 	    [SYS_mbox_init] sys_mbox_init,
 	    [SYS_mbox_send] sys_mbox_send,
 	    [SYS_mbox_recv] sys_mbox_recv,
 	    [SYS_mbox_free] sys_mbox_free,
 	    [SYS_mbox_info] sys_mbox_info,
+	    [SYS_mbox_sendm] sys_mbox_sendm,
+	    [SYS_mbox_recvm] sys_mbox_recvm,
+	    [SYS_sysrec] sys_sysrec,
+	    [SYS_setpriority] sys_setpriority,
+	    [SYS_getpriority] sys_getpriority,
+	    [SYS_shm_open] sys_shm_open,
+	    [SYS_shm_unlink] sys_shm_unlink,
+	    [SYS_madvise] sys_madvise,
+	    [SYS_memcg] sys_memcg,
+	    [SYS_cpucg] sys_cpucg,
 	    [SYS_open] sys_open,
 	    [SYS_close] sys_close,
 	    [SYS_read] sys_read,
 	    [SYS_write] sys_write,
 	    [SYS_seek] sys_seek,
+	    [SYS_preadv] sys_preadv,
+	    [SYS_pwritev] sys_pwritev,
 	    [SYS_fstat] sys_fstat,
 	    [SYS_fsync] sys_fsync,
+	    [SYS_fallocate] sys_fallocate,
 	    [SYS_chdir] sys_chdir,
 	    [SYS_getcwd] sys_getcwd,
 	    [SYS_mkdir] sys_mkdir,
@@ -406,7 +810,17 @@ static uint32_t(*syscalls[]) (uint32_t arg[]) = {
 	    [SYS_rename] sys_rename,
 	    [SYS_unlink] sys_unlink,
 	    [SYS_getdirentry] sys_getdirentry,
+	    [SYS_getdents] sys_getdents,
 	    [SYS_dup] sys_dup,
+	    [SYS_fcntl] sys_fcntl,
+	    [SYS_splice] sys_splice,
+	    [SYS_tee] sys_tee,
+	    [SYS_sendfile] sys_sendfile,
+	    [SYS_copy_file_range] sys_copy_file_range,
+	    [SYS_epoll_create] sys_epoll_create,
+	    [SYS_epoll_ctl] sys_epoll_ctl,
+	    [SYS_epoll_wait] sys_epoll_wait,
+	    [SYS_uring_enter] sys_uring_enter,
 	    [SYS_pipe] sys_pipe,
 	    [SYS_mkfifo] sys_mkfifo,
 	    [SYS_init_module] sys_init_module,
@@ -416,6 +830,15 @@ static uint32_t(*syscalls[]) (uint32_t arg[]) = {
 
 #define NUM_SYSCALLS        ((sizeof(syscalls)) / (sizeof(syscalls[0])))
 
+// syscall_dispatch - run a system call for SYS_batch, see batch.c
+static uintptr_t syscall_dispatch(uintptr_t num, uintptr_t args[])
+{
+	if (num < NUM_SYSCALLS && syscalls[num] != NULL) {
+		return syscalls[num] (args);
+	}
+	return -E_INVAL;
+}
+
 void syscall(void)
 {
 	struct trapframe *tf = current->tf;
@@ -428,7 +851,13 @@ void syscall(void)
 			arg[2] = tf->tf_regs.reg_ebx;
 			arg[3] = tf->tf_regs.reg_edi;
 			arg[4] = tf->tf_regs.reg_esi;
+			uint64_t begin = sysrec_begin();
+			trace_event(TRACE_SYSCALL_ENTER, num, arg[0]);
 			tf->tf_regs.reg_eax = syscalls[num] (arg);
+			trace_event(TRACE_SYSCALL_EXIT, num,
+				    (int)tf->tf_regs.reg_eax);
+			sysrec_end(num, arg, 5,
+				   (int)tf->tf_regs.reg_eax, begin);
 			return;
 		}
 	}
@@ -2,6 +2,7 @@
 #include <mmu.h>
 #include <memlayout.h>
 #include <clock.h>
+#include <ide.h>
 #include <trap.h>
 #include <arch.h>
 #include <stdio.h>
@@ -13,6 +14,7 @@
 #include <vmm.h>
 #include <proc.h>
 #include <sched.h>
+#include <softirq.h>
 #include <unistd.h>
 #include <syscall.h>
 #include <error.h>
@@ -138,6 +140,28 @@ static inline void print_pgfault(struct trapframe *tf)
 		(tf->tf_err & 1) ? "protection fault" : "no page found");
 }
 
+/* an instruction of the user copies which may fault, and where it goes
+ * on when do_pgfault cannot fix the fault, see __copy_user in vmm.c */
+struct exception_table_entry {
+	uintptr_t insn, fixup;
+};
+
+extern const struct exception_table_entry __ex_table_start[], __ex_table_end[];
+
+// fixup_exception - resume tf at the fixup of its instruction, if it has one
+static bool fixup_exception(struct trapframe *tf)
+{
+	const struct exception_table_entry *e;
+	/* a handful of entries */
+	for (e = __ex_table_start; e < __ex_table_end; e++) {
+		if (e->insn == tf->tf_eip) {
+			tf->tf_eip = e->fixup;
+			return 1;
+		}
+	}
+	return 0;
+}
+
 static int pgfault_handler(struct trapframe *tf)
 {
 	extern struct mm_struct *check_mm_struct;
@@ -168,6 +192,10 @@ static void trap_dispatch(struct trapframe *tf)
 		break;
 	case T_PGFLT:
 		if ((ret = pgfault_handler(tf)) != 0) {
+			if (current != NULL && trap_in_kernel(tf)
+			    && fixup_exception(tf)) {
+				break;
+			}
 			print_trapframe(tf);
 			if (current == NULL) {
 				panic("handle pgfault failed. %e\n", ret);
@@ -189,6 +217,7 @@ static void trap_dispatch(struct trapframe *tf)
 		ticks++;
 		assert(current != NULL);
 		run_timer_list();
+		irq_exit();
 		break;
 	case IRQ_OFFSET + IRQ_COM1:
 	case IRQ_OFFSET + IRQ_KBD:
@@ -199,7 +228,7 @@ static void trap_dispatch(struct trapframe *tf)
 		break;
 	case IRQ_OFFSET + IRQ_IDE1:
 	case IRQ_OFFSET + IRQ_IDE2:
-		/* do nothing */
+		ide_intr(tf->tf_trapno - IRQ_OFFSET);
 		break;
 	default:
 		print_trapframe(tf);
@@ -232,6 +261,12 @@ void trap(struct trapframe *tf)
 				schedule();
 			}
 		}
+#ifdef UCONFIG_PREEMPT
+		else if ((tf->tf_eflags & FL_IF) && current->need_resched) {
+			/* the kernel path interrupted can give the cpu away */
+			preempt_schedule_irq();
+		}
+#endif
 	}
 }
 
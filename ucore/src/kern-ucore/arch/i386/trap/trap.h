@@ -73,6 +73,7 @@ void idt_init(void);
 void print_trapframe(struct trapframe *tf);
 void print_regs(struct pushregs *regs);
 bool trap_in_kernel(struct trapframe *tf);
+int ucore_in_interrupt();
 
 #define local_intr_enable_hw  do { __asm __volatile ("sti"); } while (0)
 #define local_intr_disable_hw do { __asm __volatile ("cli"); } while (0)
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <picirq.h>
 #include <sched.h>
+#include <softirq.h>
 #include <asm/mipsregs.h>
 
 volatile size_t ticks;
@@ -23,6 +24,7 @@ int clock_int_handler(void *data)
 //    cons_putc('A');
 	run_timer_list();
 	reload_timer();
+	irq_exit();
 	return 0;
 }
 
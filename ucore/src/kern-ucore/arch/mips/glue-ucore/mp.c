@@ -3,6 +3,7 @@
 #include <proc.h>
 #include <pmm.h>
 #include <vmm.h>
+#include <thumips_tlb.h>
 
 PLS int pls_lapic_id;
 PLS int pls_lcpu_idx;
@@ -13,17 +14,22 @@ void mp_set_mm_pagetable(struct mm_struct *mm)
 		lcr3(PADDR(mm->pgdir));
 	else
 		lcr3(boot_cr3);
-	tlb_invalidate_all();
+	tlb_switch(current_pgdir);
 }
 
 void mp_tlb_invalidate(pgd_t * pgdir, uintptr_t la)
 {
-	tlb_invalidate_all();
+	tlb_invalidate(pgdir, la);
 }
 
 void mp_tlb_update(pgd_t * pgdir, uintptr_t la)
 {
-	tlb_invalidate_all();
+	tlb_invalidate(pgdir, la);
+}
+
+void mp_tlb_flush_range(pgd_t * pgdir, uintptr_t start, uintptr_t end)
+{
+	tlb_flush_range(pgdir, start, end);
 }
 
 int mp_init(void)
@@ -26,6 +26,7 @@
 #define THUMIPS_TLB_ENTRYL_D (1<<2)
 #define THUMIPS_TLB_ENTRYL_G (1<<0)
 #define THUMIPS_TLB_ENTRYH_VPN2_MASK (~0x1FFF)
+#define THUMIPS_TLB_ENTRYH_ASID_MASK 0xFF
 
 static inline void write_one_tlb(int index, unsigned int pagemask,
 				 unsigned int hi, unsigned int low0,
@@ -56,23 +57,38 @@ static inline uint32_t pte2tlblow(pte_t pte)
 	if (!ptep_present(&pte))
 		return 0;
 	t |= THUMIPS_TLB_ENTRYL_V;
-	/* always ignore ASID */
-	t |= THUMIPS_TLB_ENTRYL_G;
+	/* tagged with the ASID of the mm, see thumips_tlb.c */
 	t |= (2 << 3);
 	if (ptep_s_write(&pte))
 		t |= THUMIPS_TLB_ENTRYL_D;
 	return t;
 }
 
+extern pde_t *current_pgdir;
+extern uint32_t tlb_current_asid;
+
+/* an entry of the pair may be there, invalid: it is replaced, not doubled */
 static inline void tlb_refill(uint32_t badaddr, pte_t * pte)
 {
+	uint32_t hi = (badaddr & THUMIPS_TLB_ENTRYH_VPN2_MASK) | tlb_current_asid;
+	int index;
 	if (!pte)
 		return;
 	if (badaddr & (1 << 12))
 		pte--;
-	tlb_replace_random(0, badaddr & THUMIPS_TLB_ENTRYH_VPN2_MASK,
-			   pte2tlblow(*pte), pte2tlblow(*(pte + 1)));
+	write_c0_entryhi(hi);
+	tlb_probe();
+	index = read_c0_index();
+	if (index >= 0)
+		write_one_tlb(index, 0, hi, pte2tlblow(*pte),
+			      pte2tlblow(*(pte + 1)));
+	else
+		tlb_replace_random(0, hi, pte2tlblow(*pte),
+				   pte2tlblow(*(pte + 1)));
 }
 
 void tlb_invalidate_all();
+void tlb_switch(pde_t * pgdir);
+void tlb_flush_pgdir(pde_t * pgdir);
+void tlb_flush_range(pde_t * pgdir, uintptr_t start, uintptr_t end);
 #endif
@@ -10,6 +10,7 @@
 #include <error.h>
 #include <mips_io.h>
 #include <proc.h>
+#include <thumips_tlb.h>
 
 // virtual address of physicall page array
 struct Page *pages;
@@ -222,7 +223,7 @@ static inline void page_remove_pte(pde_t * pgdir, uintptr_t la, pte_t * ptep)
 		*ptep = 0;
 	}
 	// flush tlb
-	tlb_invalidate_all();
+	tlb_invalidate(pgdir, la);
 }
 
 extern int swap_init_ok;
@@ -429,6 +430,8 @@ void map_pgdir(pde_t * pgdir)
 {
 #define VPT                 0xFAC00000
 	pgdir[PDX(VPT)] = PADDR(pgdir) | PTE_P | PTE_W;
+	/* the entries left of the mm that had this page as its table */
+	tlb_flush_pgdir(pgdir);
 }
 
 /**
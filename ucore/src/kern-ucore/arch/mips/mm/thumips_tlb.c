@@ -24,11 +24,107 @@
 #include <pmm.h>
 #include <thumips_tlb.h>
 
-// invalidate both TLB 
-// (clean and flush, meaning we write the data back)
+/*
+ * The entries are tagged with the ASID of their page table, so that a
+ * switch only loads the ASID in EntryHi instead of flushing the TLB. The
+ * ASIDs are handed out in order, asid_cache counting them with a version
+ * above the 8 bits; once they wrap the TLB is flushed and the table of
+ * owners cleared, so that no entry of an ASID outlives its owner. ASID 0
+ * is boot_pgdir's, that of the kernel threads.
+ */
+#define ASID_MASK                   THUMIPS_TLB_ENTRYH_ASID_MASK
+#define NR_ASIDS                    (ASID_MASK + 1)
+/* a larger range is flushed by giving its page table a new ASID */
+#define TLB_FLUSH_MAX_PAGES         32
+
+static uint32_t asid_cache = NR_ASIDS;
+static pde_t *asid_owner[NR_ASIDS];
+uint32_t tlb_current_asid;
+
+// asid_lookup - the ASID of pgdir, or -1 if it has none in this version
+static int asid_lookup(pde_t * pgdir)
+{
+	int i;
+	if (pgdir == boot_pgdir)
+		return 0;
+	for (i = 1; i < NR_ASIDS; i++)
+		if (asid_owner[i] == pgdir)
+			return i;
+	return -1;
+}
+
+// asid_new - a new ASID for pgdir, flushing the TLB when they wrap
+static int asid_new(pde_t * pgdir)
+{
+	int asid;
+	if (((++asid_cache) & ASID_MASK) == 0) {
+		tlb_invalidate_all();
+		memset(asid_owner, 0, sizeof(asid_owner));
+		asid_cache++;
+	}
+	asid = asid_cache & ASID_MASK;
+	asid_owner[asid] = pgdir;
+	return asid;
+}
+
+static inline void tlb_set_asid(int asid)
+{
+	tlb_current_asid = asid;
+	write_c0_entryhi(asid);
+}
+
+// tlb_switch - make the entries of pgdir, the current one, those matched
+void tlb_switch(pde_t * pgdir)
+{
+	int asid = asid_lookup(pgdir);
+	if (asid < 0)
+		asid = asid_new(pgdir);
+	tlb_set_asid(asid);
+}
+
+// tlb_flush_pgdir - drop the entries of pgdir by dropping its ASID; called
+//                 - as well for a page table set up anew, which may have
+//                 - been the one of an mm gone
+void tlb_flush_pgdir(pde_t * pgdir)
+{
+	int asid = asid_lookup(pgdir);
+	if (asid == 0) {
+		tlb_invalidate_all();
+		return;
+	}
+	if (asid > 0)
+		asid_owner[asid] = NULL;
+	if (pgdir == current_pgdir)
+		tlb_set_asid(asid_new(pgdir));
+}
+
+// invalidate the entry of la in pgdir only, found by tlbp
 void tlb_invalidate(pde_t * pgdir, uintptr_t la)
 {
-	tlb_invalidate_all();
+	int asid = (pgdir == current_pgdir) ? tlb_current_asid
+	    : asid_lookup(pgdir);
+	int index;
+	if (asid < 0)
+		return;
+	write_c0_entryhi((la & THUMIPS_TLB_ENTRYH_VPN2_MASK) | asid);
+	tlb_probe();
+	index = read_c0_index();
+	if (index >= 0)
+		write_one_tlb(index, 0, 0x80000000 + (index << 20), 0, 0);
+	write_c0_entryhi(tlb_current_asid);
+}
+
+void tlb_flush_range(pde_t * pgdir, uintptr_t start, uintptr_t end)
+{
+	uintptr_t la;
+	start = ROUNDDOWN(start, 2 * PGSIZE);
+	if (end - start > TLB_FLUSH_MAX_PAGES * PGSIZE) {
+		tlb_flush_pgdir(pgdir);
+		return;
+	}
+	/* an entry maps two pages */
+	for (la = start; la < end; la += 2 * PGSIZE)
+		tlb_invalidate(pgdir, la);
 }
 
 void tlb_invalidate_all()
@@ -36,4 +132,5 @@ void tlb_invalidate_all()
 	int i;
 	for (i = 0; i < 128 * 128; i++)
 		write_one_tlb(i, 0, 0x80000000 + (i << 20), 0, 0);
+	write_c0_entryhi(tlb_current_asid);
 }
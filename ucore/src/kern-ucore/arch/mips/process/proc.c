@@ -65,13 +65,6 @@ SYS_getpid      : get the process's pid
 // the process set's list
 list_entry_t proc_list;
 
-#define HASH_SHIFT          10
-#define HASH_LIST_SIZE      (1 << HASH_SHIFT)
-#define pid_hashfn(x)       (hash32(x, HASH_SHIFT))
-
-// has list for process set based on pid
-static list_entry_t hash_list[HASH_LIST_SIZE];
-
 #define current (pls_read(current))
 
 static int nr_process = 0;
@@ -83,7 +76,7 @@ void switch_to(struct context *from, struct context *to);
 // alloc_proc - alloc a proc_struct and init all fields of proc_struct
 struct proc_struct *alloc_proc(void)
 {
-	struct proc_struct *proc = kmalloc(sizeof(struct proc_struct));
+	struct proc_struct *proc = kmem_cache_alloc(proc_cachep);
 	if (proc != NULL) {
 		proc->state = PROC_UNINIT;
 		proc->pid = -1;
@@ -103,9 +96,25 @@ struct proc_struct *alloc_proc(void)
 		list_init(&(proc->run_link));
 		list_init(&(proc->list_link));
 		proc->time_slice = 0;
+		proc->vruntime = 0;
+		proc->nice = 0;
+		proc->timer_slack = 0;
+		proc->policy = SCHED_NORMAL;
+		proc->rt_priority = 0;
+		proc->normal_policy = SCHED_NORMAL;
+		proc->normal_prio = 0;
+		proc->pi_prio = 0;
+		list_init(&(proc->pi_held));
+		proc->pi_blocked_on = NULL;
+		proc->pi_exited = 0;
+		proc->runtime = 0;
+		proc->exec_start = 0;
+		proc->last_ran = 0;
 		proc->cptr = proc->yptr = proc->optr = NULL;
 		event_box_init(&(proc->event_box));
 		proc->fs_struct = NULL;
+		proc->tls_pointer = NULL;
+		spinlock_init(&proc->lock);
 		proc->sem_queue = sem_queue_create();
 	}
 	return proc;
@@ -185,18 +194,6 @@ static void forkret(void)
 	forkrets(current->tf);
 }
 
-// hash_proc - add proc into proc hash_list
-static void hash_proc(struct proc_struct *proc)
-{
-	list_add(hash_list + pid_hashfn(proc->pid), &(proc->hash_link));
-}
-
-// unhash_proc - delete proc from proc hash_list
-static void unhash_proc(struct proc_struct *proc)
-{
-	list_del(&(proc->hash_link));
-}
-
 // kernel_thread - create a kernel thread using "fn" function
 // NOTE: the contents of temp trapframe tf will be copied to 
 //       proc->tf in do_fork-->copy_thread function
@@ -452,6 +449,12 @@ void de_thread_arch_hook(struct proc_struct *proc)
 {
 }
 
+// tls_switch - no thread register here, user space reads the tls back with
+//            - SYS_gettls
+void tls_switch(struct proc_struct *prev, struct proc_struct *next)
+{
+}
+
 int
 init_new_context(struct proc_struct *proc, struct elfhdr *elf,
 		 int argc, char **kargv, int envc, char **kenvp)
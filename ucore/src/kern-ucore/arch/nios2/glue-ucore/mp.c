@@ -7,6 +7,7 @@
 #include <assert.h>
 #include <arch.h>
 #include <vmm.h>
+#include <system.h>
 
 PLS int pls_lapic_id;
 PLS int pls_lcpu_idx;
@@ -58,6 +59,18 @@ void mp_tlb_invalidate(pgd_t * pgdir, uintptr_t la)
 
 void mp_tlb_update(pgd_t * pgdir, uintptr_t la)
 {
-//      tlb_update (pgdir, la);
-	tlb_invalidate(pgdir, la);
+	tlb_update(pgdir, la);
+}
+
+void mp_tlb_flush_range(pgd_t * pgdir, uintptr_t start, uintptr_t end)
+{
+	// each page is a search of all the ways; past the size of the tlb
+	// one flush of all of it is cheaper
+	if ((end - start) / PGSIZE > TLB_NUM_ENTRIES) {
+		if (rcr3() == pgdir)
+			tlb_init();
+		return;
+	}
+	for (; start < end; start += PGSIZE)
+		tlb_invalidate(pgdir, start);
 }
@@ -67,6 +67,8 @@ void map_pgdir(pde_t * pgdir);
 
 void load_esp0(uintptr_t esp0);
 void tlb_invalidate(pde_t * pgdir, uintptr_t la);
+void tlb_update(pde_t * pgdir, uintptr_t la);
+void tlb_preload(pde_t * pgdir, uintptr_t la);
 struct Page *pgdir_alloc_page(pde_t * pgdir, uintptr_t la, uint32_t perm);
 void unmap_range(pde_t * pgdir, uintptr_t start, uintptr_t end);
 void exit_range(pde_t * pgdir, uintptr_t start, uintptr_t end);
@@ -11,6 +11,7 @@
 #include <syscall.h>
 #include <error.h>
 #include <sched.h>
+#include <softirq.h>
 #include <sync.h>
 #include <arch.h>
 #include <system.h>
@@ -120,6 +121,7 @@ static inline int irq_dispatch(struct trapframe *tf)
 			}
 			NIOS2_READ_IPENDING(ipending);
 		}
+		irq_exit();
 	}
 	return irq_count;
 }
@@ -345,7 +345,7 @@ static inline void page_remove_pte(pde_t * pgdir, uintptr_t la, pte_t * ptep)
 void tlb_invalidate(pde_t * pgdir, uintptr_t la)
 {
 	if (rcr3() == pgdir) {
-		tlb_init();
+		tlb_flush_one(la);
 	}
 	/*
 	   if (rcr3() == PADDR(pgdir)) {
@@ -9,8 +9,10 @@
 #include <kio.h>
 
 #define current (pls_read(current))
+#define PID ((current != NULL) ? current->pid : 0)
 
-static int way = 0;
+// the way the next new entry goes to, shared with the refill in trapentry.S
+int tlb_way = 0;
 
 void local_flush_tlb_all(void)
 {
@@ -49,7 +51,8 @@ static inline void print_pgfault(uintptr_t la)
 void tlb_init(void)
 {
 	local_flush_tlb_all();
-	way = 0;
+	tlb_way = 0;
+	tlb_setpid(PID);
 }
 
 void tlb_setpid(int pid)
@@ -57,15 +60,90 @@ void tlb_setpid(int pid)
 	NIOS2_WRITE_TLBMISC((pid << 4));
 }
 
-#define PID ((current != NULL) ? current->pid : 0)
+//tlb_find - the way holding the entry of la for the current pid, or -1.
+//         - a read leaves the vpn and pid of the entry read in pteaddr
+//         - and tlbmisc, so the pid is written back afterwards
+static int tlb_find(uintptr_t la)
+{
+	uint32_t vpn = PPN(la), pid = PID & TLBMISC_PID_MASK;
+	uint32_t pteaddr, tlbmisc;
+	int w, found = -1;
+	for (w = 0; w < TLB_NUM_WAYS && found < 0; w++) {
+		NIOS2_WRITE_PTEADDR(vpn << 2);
+		NIOS2_WRITE_TLBMISC(TLBMISC_RD | (w << 20) | (pid << 4));
+		NIOS2_READ_PTEADDR(pteaddr);
+		NIOS2_READ_TLBMISC(tlbmisc);
+		if (((pteaddr >> 2) & 0xFFFFF) == vpn
+		    && ((tlbmisc >> 4) & TLBMISC_PID_MASK) == pid) {
+			found = w;
+		}
+	}
+	tlb_setpid(pid);
+	return found;
+}
 
+//tlb_write - an entry already holding la is rewritten in its way, since
+//          - two ways matching the same vpn is undefined; a new one
+//          - takes tlb_way
 void tlb_write(uintptr_t la, uintptr_t pa, bool write)
 {
+	int w = tlb_find(la);
+	if (w < 0) {
+		w = tlb_way;
+		tlb_way = (tlb_way + 1) % TLB_NUM_WAYS;
+	}
 	NIOS2_WRITE_PTEADDR(PPN(la) << 2);
-	NIOS2_WRITE_TLBMISC(TLBMISC_WE | (way << 20) | (PID << 4));
+	NIOS2_WRITE_TLBMISC(TLBMISC_WE | (w << 20) | (PID << 4));
 	NIOS2_WRITE_TLBACC(PPN(pa) | TLBACC_C | TLBACC_R | TLBACC_X |
 			   (write ? TLBACC_W : 0));
-	way = (way + 1) % TLB_NUM_WAYS;
+}
+
+//tlb_flush_one - point the entry of la, if any, at the io region with no
+//              - access, the way local_flush_tlb_all does for all of them
+void tlb_flush_one(uintptr_t la)
+{
+	int w;
+	if ((w = tlb_find(la)) >= 0) {
+		uint32_t line = PPN(la) & (TLB_NUM_LINES - 1);
+		NIOS2_WRITE_PTEADDR((PPN(IO_REGION_BASE) | line) << 2);
+		NIOS2_WRITE_TLBMISC(TLBMISC_WE | (w << 20));
+		NIOS2_WRITE_TLBACC(PPN(MAX_PHYS_ADDR));
+		tlb_setpid(PID);
+	}
+}
+
+//tlb_preload - after la is mapped, load the present pages following it in
+//            - the same page table, so a sequential walk over them does
+//            - not take a miss per page
+void tlb_preload(pde_t * pgdir, uintptr_t la)
+{
+	pte_t *ptep = get_pte(pgdir, la, 0);
+	int i;
+	if (ptep == NULL) {
+		return;
+	}
+	for (i = 1; i <= TLB_PRELOAD && PTX(la) + i < NPTEENTRY; i++) {
+		if ((ptep[i] & PTE_P) && tlb_find(la + i * PGSIZE) < 0) {
+			tlb_write(la + i * PGSIZE, ptep[i], (ptep[i] & PTE_W));
+		}
+	}
+}
+
+//tlb_update - the pte of la changed: load it, and the pages after it,
+//           - when pgdir is the one in use, rather than flushing
+void tlb_update(pde_t * pgdir, uintptr_t la)
+{
+	pte_t *ptep;
+	if (rcr3() != pgdir) {
+		return;
+	}
+	la = ROUNDDOWN(la, PGSIZE);
+	if ((ptep = get_pte(pgdir, la, 0)) == NULL || !(*ptep & PTE_P)) {
+		tlb_flush_one(la);
+		return;
+	}
+	tlb_write(la, *ptep, (*ptep & PTE_W));
+	tlb_preload(pgdir, la);
 }
 
 int tlb_miss_handler(uintptr_t la, bool perm)
@@ -106,6 +184,7 @@ int tlb_miss_handler(uintptr_t la, bool perm)
 	}
 	if (*ptep & PTE_P) {
 		tlb_write(la, *ptep, (*ptep & PTE_W));
+		tlb_preload(NIOS2_PGDIR, ROUNDDOWN(la, PGSIZE));
 	} else {
 		int badaddr;
 		NIOS2_READ_BADADDR(badaddr);
@@ -14,6 +14,11 @@
 #define TLBMISC_RD (1<<19)
 #define TLBMISC_WE (1<<18)
 
+#define TLBMISC_PID_MASK 0x3FFF
+
+#define TLB_NUM_LINES (TLB_NUM_ENTRIES / TLB_NUM_WAYS)
+#define TLB_PRELOAD 3		// pages loaded after the one of a miss
+
 #define TLBMISC_SET_PID(tlbmisc, pid) ((tlbmisc)=((tlbmisc)&0xFFFC000F)|((pid<<4)&0x3FFF0))
 
 void tlb_init(void);
@@ -26,4 +31,6 @@ void tlb_write(uintptr_t la, uintptr_t pa, bool write);
 
 void tlb_setpid(int pid);
 
+void tlb_flush_one(uintptr_t la);
+
 #endif /* !__NIOS2_TLB_H__ */
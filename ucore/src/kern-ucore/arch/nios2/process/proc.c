@@ -20,7 +20,7 @@ void forkrets(struct trapframe *tf);
 // alloc_proc - create a proc struct and init fields
 struct proc_struct *alloc_proc(void)
 {
-	struct proc_struct *proc = kmalloc(sizeof(struct proc_struct));
+	struct proc_struct *proc = kmem_cache_alloc(proc_cachep);
 	if (proc != NULL) {
 		proc->state = PROC_UNINIT;
 		proc->pid = -1;
@@ -40,9 +40,25 @@ struct proc_struct *alloc_proc(void)
 		proc->rq = NULL;
 		list_init(&(proc->run_link));
 		proc->time_slice = 0;
+		proc->vruntime = 0;
+		proc->nice = 0;
+		proc->timer_slack = 0;
+		proc->policy = SCHED_NORMAL;
+		proc->rt_priority = 0;
+		proc->normal_policy = SCHED_NORMAL;
+		proc->normal_prio = 0;
+		proc->pi_prio = 0;
+		list_init(&(proc->pi_held));
+		proc->pi_blocked_on = NULL;
+		proc->pi_exited = 0;
+		proc->runtime = 0;
+		proc->exec_start = 0;
+		proc->last_ran = 0;
 		proc->sem_queue = NULL;
 		event_box_init(&(proc->event_box));
 		proc->fs_struct = NULL;
+		proc->tls_pointer = NULL;
+		spinlock_init(&proc->lock);
 	}
 	return proc;
 }
@@ -78,6 +94,12 @@ void de_thread_arch_hook(struct proc_struct *proc)
 {
 }
 
+// tls_switch - no thread register here, user space reads the tls back with
+//            - SYS_gettls
+void tls_switch(struct proc_struct *prev, struct proc_struct *next)
+{
+}
+
 // copy_thread - setup the trapframe on the  process's kernel stack top and
 //             - setup the kernel entry point and stack of process
 int
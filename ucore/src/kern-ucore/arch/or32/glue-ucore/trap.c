@@ -16,6 +16,7 @@
 #include <syscall.h>
 #include <error.h>
 #include <sched.h>
+#include <softirq.h>
 #include <kio.h>
 
 void bus_error_exception(struct trapframe *tf)
@@ -133,6 +134,7 @@ void tick_timer_exception()
 	/* Tell the timer that we have done. */
 	mtspr(SPR_TTMR, mfspr(SPR_TTMR) & (~SPR_TTMR_IP));
 	mtspr(SPR_PICSR, mfspr(SPR_PICSR) & (~0x8));
+	irq_exit();
 }
 
 /**
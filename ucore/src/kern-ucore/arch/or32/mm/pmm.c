@@ -197,13 +197,43 @@ void pmm_init(void)
 	slab_init();
 }
 
-// invalidate a TLB entry, but only if the page tables being
-// edited are the ones currently in use by the processor.
+// tlb_dload - fill the DTLB set of la from pte the way __post_boot_dtlb_miss
+//           - in reset.S does: no read access without PTE_A and no write
+//           - access without PTE_D, so the first of each still faults
+static void tlb_dload(uintptr_t la, pte_t pte)
+{
+	uint32_t set = (la >> PGSHIFT) & (NR_SETS - 1);
+	uint32_t tr = pte & (~(PGSIZE - 1) | PTE_SPR_W | PTE_SPR_R |
+			     PTE_USER_W | PTE_USER_R);
+	if (!(pte & PTE_A))
+		tr &= ~(PTE_SPR_R | PTE_USER_R);
+	if (!(pte & PTE_D))
+		tr &= ~(PTE_SPR_W | PTE_USER_W);
+	mtspr(SPR_DTLBTR_BASE(0) + set, tr);
+	mtspr(SPR_DTLBMR_BASE(0) + set, (la & ~(PGSIZE - 1)) | SPR_DTLBMR_V);
+}
+
+// tlb_update - the pte of la changed. If pgdir is the one in use, load it
+// into the DTLB, along with the accessed pages after it in the same page
+// table, instead of leaving them to a refill each; the ITLB set is only
+// invalidated, as data pages would evict code from the one-way ITLB.
 void tlb_update(pde_t * pgdir, uintptr_t la)
 {
 	uint32_t set = (la >> PGSHIFT) & (NR_SETS - 1);
-	mtspr(SPR_DTLBMR_BASE(0) + set, 0);
+	pte_t *ptep;
+	int i;
 	mtspr(SPR_ITLBMR_BASE(0) + set, 0);
+	if (PADDR(pgdir) != current_pgdir_pa
+	    || (ptep = get_pte(pgdir, la, 0)) == NULL || !(*ptep & PTE_P)) {
+		mtspr(SPR_DTLBMR_BASE(0) + set, 0);
+		asm("l.nop;l.nop;");
+		return;
+	}
+	tlb_dload(la, *ptep);
+	for (i = 1; i <= TLB_PRELOAD && PTX(la) + i < NPTEENTRY; i++) {
+		if ((ptep[i] & (PTE_P | PTE_A)) == (PTE_P | PTE_A))
+			tlb_dload(la + i * PGSIZE, ptep[i]);
+	}
 	asm("l.nop;l.nop;");
 }
 
@@ -2,6 +2,7 @@
 #define __ARCH_UM_INCLUDE_STUB_H__
 
 #include <types.h>
+#include <memlayout.h>
 
 /*
  * Some actions must be carried out by the container process like map/unmap a range of space.
@@ -26,6 +27,13 @@
  *	  |                              |
  *	  :                              :
  *	  |                              |
+ *	  +------------------------------+ <---------- STUB_BATCH
+ *	  |                              |
+ *	  |   Queued Host Calls (ops)    |
+ *	  |                              |
+ *	  +------------------------------+ <---------- STUB_DATA + 0x800
+ *	  |          Fault Info          |
+ *	  :                              :
  *	  +------------------------------+ <---------- STUB_END
  *
  * Address is used by the stub interpreting code (see stub_exec_syscall.S) which determines what to do
@@ -34,6 +42,10 @@
  * Note that the page STUB_DATA is writable by the user (to fill eax with the return value)
  *     and may be visited illegally.
  *
+ * The host mmap/munmap calls mirroring the page table are not made one stub call each:
+ *     they are queued as ops at STUB_BATCH, and one stub call (eax = -2, ebx = # of ops)
+ *     runs them all before the container runs anything else. See host_flush.
+ *
  */
 
 /**
@@ -53,6 +65,23 @@ struct stub_frame {
 	uint32_t data[10];
 };
 
+/**
+ * A queued host call.
+ *   For mmap, args is the mmap_arg_struct and ebx points to it;
+ *     for the others, args[0], args[1] and args[2] go to ebx, ecx and edx.
+ */
+struct stub_op {
+	uint32_t nr;
+	uint32_t args[6];
+};
+
+#define STUB_MAX_OPS							\
+	((STUB_DATA + 0x800 - STUB_BATCH) / sizeof(struct stub_op))
+
+/* the ops at STUB_BATCH, seen from the kernel */
+#define stub_ops(stack)							\
+	((struct stub_op *)((uintptr_t)(stack) + STUB_BATCH - STUB_DATA))
+
 struct stub_stack {
 	uintptr_t current_addr;
 	uint32_t current_no;
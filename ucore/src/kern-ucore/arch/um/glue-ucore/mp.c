@@ -54,3 +54,9 @@ void mp_tlb_update(pgd_t * pgdir, uintptr_t la)
 {
 	tlb_update(pgdir, la);
 }
+
+void mp_tlb_flush_range(pgd_t * pgdir, uintptr_t start, uintptr_t end)
+{
+	for (; start < end; start += PGSIZE)
+		tlb_invalidate(pgdir, start);
+}
@@ -7,6 +7,7 @@
 #include <vmm.h>		/* do_pgfault */
 #include <clock.h>		/* ticks */
 #include <sched.h>		/* run_timer_list */
+#include <softirq.h>		/* irq_exit */
 #include <console.h>
 #include <kio.h>
 #include <proc.h>
@@ -247,5 +248,6 @@ int vtimer_handler(int sig, struct um_pt_regs *regs)
 	ticks++;
 	assert(current != NULL);
 	run_timer_list();
+	irq_exit();
 	return 0;
 }
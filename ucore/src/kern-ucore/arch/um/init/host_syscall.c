@@ -8,13 +8,14 @@
 #include <vmm.h>
 #include <arch.h>
 #include <kio.h>
+#include <string.h>
 
 /**
  * Carry out the syscall specified in the stub stack.
  * @param proc the PCB of the process to execute the stub call
  * @return the return value of the call
  */
-static int host_syscall_in_child(struct proc_struct *proc)
+static int host_stub_call(struct proc_struct *proc)
 {
 	struct user_regs_struct regs;
 	int err, pid = proc->arch.host->host_pid;
@@ -50,8 +51,83 @@ static int host_syscall_in_child(struct proc_struct *proc)
 	return err;
 }
 
+/**
+ * Run the host calls queued for the container of @proc, all by one stub call.
+ *     It must be done before the container runs anything else,
+ *     the user code or another stub call, which may touch the pages they map.
+ * @param proc the PCB whose container process is going to be operated on
+ */
+void host_flush(struct proc_struct *proc)
+{
+	struct host_container *host = proc->arch.host;
+	if (host == NULL || host->nr_ops == 0)
+		return;
+
+	struct stub_frame *frame = current_stub_frame(host->stub_stack);
+	frame->eax = -2;
+	frame->ebx = host->nr_ops;
+	host->nr_ops = 0;
+	if (host_stub_call(proc) != 0)
+		panic("host calls in child failed.\n");
+}
+
+/**
+ * Carry out the syscall specified in the stub stack, after those queued.
+ * @param proc the PCB of the process to execute the stub call
+ * @return the return value of the call
+ */
+static int host_syscall_in_child(struct proc_struct *proc)
+{
+	struct stub_frame saved, *frame =
+	    current_stub_frame(proc->arch.host->stub_stack);
+	if (proc->arch.host->nr_ops != 0) {
+		saved = *frame;
+		host_flush(proc);
+		*frame = saved;
+	}
+	return host_stub_call(proc);
+}
+
+/**
+ * Queue a host call for the container of @proc, run at the next host_flush.
+ *     A mmap/munmap going on where the last one queued ends is merged into it,
+ *     so a run of PTEs changed one by one costs a single host call.
+ * @param proc the PCB whose container process is going to be operated on
+ * @param nr __NR_mmap or __NR_munmap
+ * @param args the mmap_arg_struct for mmap, or the address and the length
+ */
+static void host_queue(struct proc_struct *proc, uint32_t nr,
+		       uint32_t args[6])
+{
+	struct host_container *host = proc->arch.host;
+	struct stub_op *ops = stub_ops(host->stub_stack);
+
+	if (host->nr_ops > 0) {
+		struct stub_op *last = ops + host->nr_ops - 1;
+		int merge = (last->nr == nr
+			     && last->args[0] + last->args[1] == args[0]);
+		if (merge && nr == __NR_mmap) {
+			/* the same file and permission, the pages going on */
+			merge = (last->args[2] == args[2]
+				 && last->args[3] == args[3]
+				 && last->args[4] == args[4]
+				 && last->args[5] + last->args[1] == args[5]);
+		}
+		if (merge) {
+			last->args[1] += args[1];
+			return;
+		}
+	}
+	if (host->nr_ops == STUB_MAX_OPS)
+		host_flush(proc);
+	ops[host->nr_ops].nr = nr;
+	memcpy(ops[host->nr_ops].args, args, sizeof(ops->args));
+	host->nr_ops++;
+}
+
 /**
  * Map a part of file to the container process when we are in the main one.
+ *     The map is queued, and done at the next host_flush.
  * @param proc the PCB whose container process is going to be mapped
  * @param addr the address where to map the content (should be the beginning of a page)
  * @param length the size of the content (should be a multiple of the PGSIZE)
@@ -59,45 +135,31 @@ static int host_syscall_in_child(struct proc_struct *proc)
  * @param flags map flags. see 'man mmap' for details
  * @param fd the file descriptor of the file to be mapped
  * @param offset the offset of the content to be mapped in the file
- * @return same as host syscall 'mmap' (beginning address of the mapped area on success)
+ * @return 0 (a host mmap failing panics in host_flush)
  */
 int
 host_mmap(struct proc_struct *proc,
 	  void *addr, size_t length, int prot, int flags,
 	  int fd, uint32_t offset)
 {
-	struct stub_stack *stub_stack = proc->arch.host->stub_stack;
-	struct stub_frame *frame = (current_stub_frame(stub_stack));
-
-	frame->eax = __NR_mmap;
-	frame->ebx =
-	    STUB_DATA + (unsigned long)frame->data -
-	    (unsigned long)(stub_stack);
-	struct mmap_arg_struct *args = (struct mmap_arg_struct *)frame->data;
-	args->addr = (long)addr;
-	args->len = length;
-	args->prot = prot;
-	args->flags = flags;
-	args->fd = fd;
-	args->offset = offset;
-	return host_syscall_in_child(proc);
+	uint32_t args[6] = { (uint32_t) addr, length, prot, flags, fd, offset };
+	host_queue(proc, __NR_mmap, args);
+	return 0;
 }
 
 /**
  * Unmap a range of the container process's space when we are in the main one.
+ *     The unmap is queued, and done at the next host_flush.
  * @param proc the PCB whose container process is going to be operated on
  * @param addr the beginning address of the area to be unmapped (should be the beginning of a page)
  * @param length the size of the area to be unmapped (should be a multiple of PGSIZE)
+ * @return 0 (a host munmap failing panics in host_flush)
  */
 int host_munmap(struct proc_struct *proc, void *addr, size_t length)
 {
-	struct stub_stack *stub_stack = proc->arch.host->stub_stack;
-	struct stub_frame *frame = current_stub_frame(stub_stack);
-
-	frame->eax = __NR_munmap;
-	frame->ebx = (long)addr;
-	frame->ecx = length;
-	return host_syscall_in_child(proc);
+	uint32_t args[6] = { (uint32_t) addr, length };
+	host_queue(proc, __NR_munmap, args);
+	return 0;
 }
 
 /**
@@ -95,14 +95,11 @@ void tlb_update(pde_t * pgdir, uintptr_t la)
 	else if (Get_PTE_W(pte) == 0 || Get_PTE_D(pte) == 0)
 		w = 0;
 
-	/* Make sure that the page is invalid before mapping
-	 *     It is better to use 'mprotect' here actually.
-	 */
-	tlb_invalidate(pgdir, la);
-
 	struct proc_struct *proc = find_proc_by_pgdir(pgdir);
 	if (current != NULL && proc != NULL) {
-		/* Map the page to the container process found using the stub code */
+		/* Map the page to the container process found using the stub code.
+		 *     MAP_FIXED replaces the old map, no munmap is queued before it.
+		 */
 		if (host_mmap(proc,
 			      (void *)la, PGSIZE,
 			      (r ? PROT_READ : 0) | (w ? PROT_WRITE : 0) | (x ?
@@ -113,6 +110,11 @@ void tlb_update(pde_t * pgdir, uintptr_t la)
 			      pa) == MAP_FAILED)
 			panic("map in child failed.\n");
 	} else {
+		/* Make sure that the page is invalid before mapping
+		 *     It is better to use 'mprotect' here actually.
+		 */
+		tlb_invalidate(pgdir, la);
+
 		/* Map the page to the host process */
 		struct mmap_arg_struct args = {
 			.addr = la,
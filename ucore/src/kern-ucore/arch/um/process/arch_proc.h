@@ -20,6 +20,7 @@ struct host_container {
 	uint32_t host_pid;	/* The pid of the container in the host system */
 	uint32_t nr_threads;	/* Number of threads the process contains */
 	struct stub_stack *stub_stack;	/* The address of the stub stack of the container in kernel */
+	uint32_t nr_ops;	/* Number of host calls queued in the stub stack, see host_flush */
 };
 
 /* The architecture-dependent part of the PCB */
@@ -41,7 +41,7 @@ void switch_to(struct context *from, struct context *to)
  */
 struct proc_struct *alloc_proc(void)
 {
-	struct proc_struct *proc = kmalloc(sizeof(struct proc_struct));
+	struct proc_struct *proc = kmem_cache_alloc(proc_cachep);
 	if (proc != NULL) {
 		proc->state = PROC_UNINIT;
 		proc->pid = -1;
@@ -62,6 +62,20 @@ struct proc_struct *alloc_proc(void)
 		proc->rq = NULL;
 		list_init(&(proc->run_link));
 		proc->time_slice = 0;
+		proc->vruntime = 0;
+		proc->nice = 0;
+		proc->timer_slack = 0;
+		proc->policy = SCHED_NORMAL;
+		proc->rt_priority = 0;
+		proc->normal_policy = SCHED_NORMAL;
+		proc->normal_prio = 0;
+		proc->pi_prio = 0;
+		list_init(&(proc->pi_held));
+		proc->pi_blocked_on = NULL;
+		proc->pi_exited = 0;
+		proc->runtime = 0;
+		proc->exec_start = 0;
+		proc->last_ran = 0;
 
 		/* These are arch-dependent parts. */
 		proc->arch.host = NULL;
@@ -69,6 +83,8 @@ struct proc_struct *alloc_proc(void)
 		proc->sem_queue = NULL;
 		event_box_init(&(proc->event_box));
 		proc->fs_struct = NULL;
+		proc->tls_pointer = NULL;
+		spinlock_init(&proc->lock);
 	}
 	return proc;
 }
@@ -112,6 +128,12 @@ void de_thread_arch_hook(struct proc_struct *proc)
 	}
 }
 
+// tls_switch - no thread register here, user space reads the tls back with
+//            - SYS_gettls
+void tls_switch(struct proc_struct *prev, struct proc_struct *next)
+{
+}
+
 /**
  * Make a copy of the current thread/process, giving the parent the child's pid and the child 0.
  *     This is called in do_fork after all structures in the child's PCB are ready.
@@ -159,6 +181,7 @@ copy_thread(uint32_t clone_flags, struct proc_struct *proc,
 			proc->arch.host->nr_threads = 1;
 			proc->arch.host->stub_stack =
 			    (struct stub_stack *)stub_stack;
+			proc->arch.host->nr_ops = 0;
 			/* unmap kernel area. */
 			if (host_munmap
 			    (proc, (void *)KERNBASE, KERNTOP - KERNBASE) < 0)
@@ -254,6 +277,7 @@ int do_execve_arch_hook(int argc, char **kargv)
 	current->arch.host->stub_stack = stub_stack;
 	current->arch.host->host_pid = ret;
 	current->arch.host->nr_threads = 1;
+	current->arch.host->nr_ops = 0;
 
 	/* unmap kernel area */
 	if (host_munmap(current, (void *)KERNBASE, KERNTOP - KERNBASE) < 0)
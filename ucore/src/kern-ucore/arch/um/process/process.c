@@ -257,6 +257,9 @@ void userspace(struct um_pt_regs *regs)
 		/* As a host process may be the container of multiple threads, we need to reread 'regs' */
 		regs = &(pls_read(current)->arch.regs);
 
+		/* The maps changed since it stopped, before it runs again */
+		host_flush(pls_read(current));
+
 		err =
 		    syscall4(__NR_ptrace, PTRACE_SETREGS, pid, 0,
 			     (long)&(regs->regs));
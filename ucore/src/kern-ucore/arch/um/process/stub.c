@@ -23,6 +23,7 @@ void stub_push_frame(struct stub_stack *stack)
 {
 	stack->current_no++;
 	stack->current_addr += sizeof(struct stub_frame);
+	assert(stack->current_addr + sizeof(struct stub_frame) <= STUB_BATCH);
 }
 
 void stub_pop_frame(struct stub_stack *stack)
@@ -16,9 +16,12 @@
  * =====================================================================================
  */
 
+#include <types.h>
 #include <slab.h>
+#include <dma.h>
 
 #include <dde_kit/memory.h>
+#include <dde_kit/pgtab.h>
 
 void *dde_kit_simple_malloc(dde_kit_size_t size)
 {
@@ -31,3 +34,27 @@ void dde_kit_simple_free(void *p)
     return;
   kfree(p);
 }
+
+/* the large blocks are for the DMA of the drivers: physically contiguous,
+ * from the region of dma.c, and known to the pgtab with their size */
+void *dde_kit_large_malloc(dde_kit_size_t size)
+{
+  uintptr_t paddr;
+  void *p = dma_contig_alloc(size, &paddr);
+  if (!p)
+    return NULL;
+  dde_kit_pgtab_set_region_with_size(p, paddr, size);
+  if (dde_kit_pgtab_get_size(p) != size) {
+    dma_contig_free(p, size);
+    return NULL;
+  }
+  return p;
+}
+
+void dde_kit_large_free(void *p)
+{
+  if(!p)
+    return;
+  dma_contig_free(p, dde_kit_pgtab_get_size(p));
+  dde_kit_pgtab_clear_region(p);
+}
@@ -0,0 +1,119 @@
+#include <types.h>
+#include <list.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <slab.h>
+#include <pmm.h>
+
+#include <dde_kit/pgtab.h>
+
+/* *
+ * The regions set by the drivers, the large blocks of dde_memory.c among
+ * them, with their sizes. An address in none of them is one of the direct
+ * mapping of the kernel, translated as such.
+ * */
+struct pgtab_region {
+	list_entry_t link;
+	void *virt;
+	dde_kit_addr_t phys;
+	dde_kit_size_t size;
+};
+
+#define le2region(le, member)           \
+    to_struct((le), struct pgtab_region, member)
+
+static list_entry_t regions = { &regions, &regions };
+static spinlock_s regions_lock;
+
+// region_find - the region holding virt, or the one at phys if virt is
+//             - NULL; with regions_lock held
+static struct pgtab_region *region_find(void *virt, dde_kit_addr_t phys)
+{
+	list_entry_t *le = &regions;
+	while ((le = list_next(le)) != &regions) {
+		struct pgtab_region *r = le2region(le, link);
+		if (virt != NULL ? ((char *)virt >= (char *)r->virt
+				    && (char *)virt < (char *)r->virt + r->size)
+		    : (phys >= r->phys && phys < r->phys + r->size)) {
+			return r;
+		}
+	}
+	return NULL;
+}
+
+void dde_kit_pgtab_set_region_with_size(void *virt, dde_kit_addr_t phys,
+					dde_kit_size_t size)
+{
+	struct pgtab_region *r = kmalloc(sizeof(struct pgtab_region));
+	bool intr_flag;
+	if (r == NULL) {
+		return;
+	}
+	r->virt = virt, r->phys = phys, r->size = size;
+	spin_lock_irqsave(&regions_lock, intr_flag);
+	list_add(&regions, &(r->link));
+	spin_unlock_irqrestore(&regions_lock, intr_flag);
+}
+
+void dde_kit_pgtab_set_region(void *virt, dde_kit_addr_t phys, unsigned pages)
+{
+	dde_kit_pgtab_set_region_with_size(virt, phys, pages * PGSIZE);
+}
+
+void dde_kit_pgtab_clear_region(void *virt)
+{
+	struct pgtab_region *r;
+	bool intr_flag;
+	spin_lock_irqsave(&regions_lock, intr_flag);
+	if ((r = region_find(virt, 0)) != NULL) {
+		list_del(&(r->link));
+	}
+	spin_unlock_irqrestore(&regions_lock, intr_flag);
+	if (r != NULL) {
+		kfree(r);
+	}
+}
+
+dde_kit_addr_t dde_kit_pgtab_get_physaddr(void *virt)
+{
+	struct pgtab_region *r;
+	dde_kit_addr_t phys;
+	bool intr_flag;
+	spin_lock_irqsave(&regions_lock, intr_flag);
+	if ((r = region_find(virt, 0)) != NULL) {
+		phys = r->phys + ((char *)virt - (char *)r->virt);
+	} else {
+		phys = PADDR(virt);
+	}
+	spin_unlock_irqrestore(&regions_lock, intr_flag);
+	return phys;
+}
+
+dde_kit_addr_t dde_kit_pgtab_get_virtaddr(dde_kit_addr_t phys)
+{
+	struct pgtab_region *r;
+	dde_kit_addr_t virt;
+	bool intr_flag;
+	spin_lock_irqsave(&regions_lock, intr_flag);
+	if ((r = region_find(NULL, phys)) != NULL) {
+		virt = (dde_kit_addr_t) r->virt + (phys - r->phys);
+	} else {
+		virt = (dde_kit_addr_t) KADDR(phys);
+	}
+	spin_unlock_irqrestore(&regions_lock, intr_flag);
+	return virt;
+}
+
+// dde_kit_pgtab_get_size - the size of the region holding virt, 0 if none
+dde_kit_size_t dde_kit_pgtab_get_size(void *virt)
+{
+	struct pgtab_region *r;
+	dde_kit_size_t size = 0;
+	bool intr_flag;
+	spin_lock_irqsave(&regions_lock, intr_flag);
+	if ((r = region_find(virt, 0)) != NULL) {
+		size = r->size;
+	}
+	spin_unlock_irqrestore(&regions_lock, intr_flag);
+	return size;
+}
@@ -15,9 +15,73 @@
  *
  * =====================================================================================
  */
+#include <types.h>
+#include <slab.h>
+#include <sched.h>
+#include <clock.h>
 #include <dde_kit/types.h>
 #include <dde_kit/timer.h>
 
-dde_kit_uint64_t jiffies_64;
-unsigned long volatile jiffies;
+/* *
+ * The dde_kit timers are timers of the kernel wheel, embedded: arming one
+ * again allocates nothing, its function is called in the timer softirq of
+ * the cpu it was armed on. jiffies is the kernel tick itself, see the
+ * clock of the arch.
+ * */
+struct dde_kit_timer {
+	timer_t timer;
+	void (*fn) (void *);
+	void *priv;
+};
+
+static void dde_kit_timer_fire(unsigned long data)
+{
+	struct dde_kit_timer *t = (struct dde_kit_timer *)data;
+	t->fn(t->priv);
+}
+
+// dde_kit_timer_arm - put t on the wheel of this cpu for the tick timeout
+static void dde_kit_timer_arm(struct dde_kit_timer *t, unsigned long timeout)
+{
+	long delta = (long)(timeout - ticks);
+	del_timer(&(t->timer));
+	t->timer.expires = (delta > 0) ? delta : 1;
+	add_timer(&(t->timer));
+}
+
+struct dde_kit_timer *dde_kit_timer_add(void (*fn) (void *), void *priv,
+					unsigned long timeout)
+{
+	struct dde_kit_timer *t = kmalloc(sizeof(struct dde_kit_timer));
+	if (t == NULL) {
+		return NULL;
+	}
+	t->fn = fn, t->priv = priv;
+	timer_setup(&(t->timer), t, dde_kit_timer_fire, (unsigned long)t);
+	dde_kit_timer_arm(t, timeout);
+	return t;
+}
+
+void dde_kit_timer_del(struct dde_kit_timer *timer)
+{
+	del_timer_sync(&(timer->timer));
+	kfree(timer);
+}
+
+void dde_kit_timer_schedule_absolute(struct dde_kit_timer *timer,
+				     unsigned long timeout)
+{
+	dde_kit_timer_arm(timer, timeout);
+}
+
+int dde_kit_timer_pending(struct dde_kit_timer *timer)
+{
+	return timer_pending(&(timer->timer));
+}
+
+// dde_kit_timer_init - the functions run in the timer softirq, there is no
+//                    - timer thread to set up
+void dde_kit_timer_init(void (*thread_init) (void *), void *priv)
+{
+}
 
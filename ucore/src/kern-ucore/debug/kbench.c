@@ -0,0 +1,40 @@
+#include <types.h>
+#include <slab.h>
+#include <unistd.h>
+#include <error.h>
+#include <kbench.h>
+
+/* bounds the time a single call spends in the kernel */
+#define KBENCH_MAX_COUNT            (1 << 20)
+#define KBENCH_MAX_SIZE             (128 * 1024)
+
+// kbench_kmalloc - count rounds of kmalloc of size, each freed at once
+static int kbench_kmalloc(size_t size, int count)
+{
+	void *obj;
+	int i;
+	if (size == 0 || size > KBENCH_MAX_SIZE) {
+		return -E_INVAL;
+	}
+	for (i = 0; i < count; i++) {
+		if ((obj = kmalloc(size)) == NULL) {
+			return -E_NO_MEM;
+		}
+		*(volatile char *)obj = 0;
+		kfree(obj);
+	}
+	return 0;
+}
+
+// do_kbench - SYS_kbench, run count rounds of op with arg in the kernel
+int do_kbench(int op, size_t arg, int count)
+{
+	if (count < 0 || count > KBENCH_MAX_COUNT) {
+		return -E_INVAL;
+	}
+	switch (op) {
+	case KBENCH_KMALLOC:
+		return kbench_kmalloc(arg, count);
+	}
+	return -E_INVAL;
+}
@@ -0,0 +1,16 @@
+#ifndef __KERN_DEBUG_KBENCH_H__
+#define __KERN_DEBUG_KBENCH_H__
+
+#include <types.h>
+
+/* *
+ * The kernel side of the benchmarks of user-ucore/tests, for the paths a
+ * user program has no direct way to drive; see kbench.c.
+ * */
+#ifdef UCONFIG_KBENCH
+
+int do_kbench(int op, size_t arg, int count);
+
+#endif /* UCONFIG_KBENCH */
+
+#endif /* !__KERN_DEBUG_KBENCH_H__ */
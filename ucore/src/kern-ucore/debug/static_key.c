@@ -0,0 +1,75 @@
+#include <types.h>
+#include <string.h>
+#include <sem.h>
+#include <mp.h>
+#include <sysconf.h>
+#include <static_key.h>
+
+/* *
+ * Each static_key_false of the kernel leaves an entry in __jump_table, the
+ * site, where it jumps to and its key. Switching a key walks the table and
+ * has arch_jump_label_transform patch the sites of the key, one at a time;
+ * it calls jump_label_sync between its steps so that no cpu still runs the
+ * old code. One key is switched at a time, under jump_label_sem.
+ * */
+extern struct jump_entry __jump_table_start[], __jump_table_end[];
+
+static semaphore_t jump_label_sem;
+
+void jump_label_init(void)
+{
+	sem_init(&jump_label_sem, 1);
+}
+
+#ifdef UCONFIG_ENABLE_IPI
+static void jump_label_sync_ipi(struct ipi_call *call)
+{
+	/* the return from the interrupt serializes the cpu */
+}
+#endif
+
+// jump_label_sync - return once every cpu is done with what it fetched of
+//                 - the code before the call
+void jump_label_sync(void)
+{
+#ifdef UCONFIG_ENABLE_IPI
+	cpuset_t cs;
+	int i;
+	memset(&cs, 0, sizeof(cs));
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		cpuset_set(&cs, i);
+	}
+	ipi_run_on_cpu(&cs, NULL, jump_label_sync_ipi);
+#endif
+}
+
+static void static_key_switch(struct static_key *key, bool enable)
+{
+	struct jump_entry *e;
+	down(&jump_label_sem);
+	if (key->enabled != enable) {
+		/* the hook sees the key on as long as a site jumps to it */
+		if (enable) {
+			key->enabled = 1;
+		}
+		for (e = __jump_table_start; e < __jump_table_end; e++) {
+			if (e->key == (uintptr_t) key) {
+				arch_jump_label_transform(e, enable);
+			}
+		}
+		if (!enable) {
+			key->enabled = 0;
+		}
+	}
+	up(&jump_label_sem);
+}
+
+void static_key_enable(struct static_key *key)
+{
+	static_key_switch(key, 1);
+}
+
+void static_key_disable(struct static_key *key)
+{
+	static_key_switch(key, 0);
+}
@@ -0,0 +1,64 @@
+#ifndef __KERN_DEBUG_STATIC_KEY_H__
+#define __KERN_DEBUG_STATIC_KEY_H__
+
+#include <types.h>
+
+/* *
+ * Static keys, for the hooks that are off but for the odd debug session.
+ * static_key_false(&key) is true while key is on. With UCONFIG_JUMP_LABEL
+ * it is no test at all: the code has a nop while the key is off, patched
+ * into a jump to the hook by static_key_enable and back by
+ * static_key_disable, see static_key.c and jump_label.h of the arch.
+ * Without it, it is a test of key->enabled.
+ *
+ * Switching a key patches the running kernel and interrupts every cpu, it
+ * is slow and may sleep.
+ * */
+struct static_key {
+	volatile int enabled;
+};
+
+#define DEFINE_STATIC_KEY(name)                 \
+    struct static_key name = { 0 }
+
+static inline bool static_key_enabled(struct static_key *key)
+{
+	return key->enabled;
+}
+
+#ifdef UCONFIG_JUMP_LABEL
+
+/* an entry of __jump_table, one per site, see ucore.ld.in */
+struct jump_entry {
+	uintptr_t code;		// the nop, or the jump
+	uintptr_t target;	// where the jump goes
+	uintptr_t key;
+};
+
+#include <jump_label.h>
+
+#define static_key_false(key)       arch_static_branch(key)
+
+void jump_label_init(void);
+void jump_label_sync(void);
+void arch_jump_label_transform(struct jump_entry *e, bool enable);
+void static_key_enable(struct static_key *key);
+void static_key_disable(struct static_key *key);
+
+#else
+
+#define static_key_false(key)       __builtin_expect((key)->enabled, 0)
+
+static inline void static_key_enable(struct static_key *key)
+{
+	key->enabled = 1;
+}
+
+static inline void static_key_disable(struct static_key *key)
+{
+	key->enabled = 0;
+}
+
+#endif /* UCONFIG_JUMP_LABEL */
+
+#endif /* !__KERN_DEBUG_STATIC_KEY_H__ */
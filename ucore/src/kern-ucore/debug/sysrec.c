@@ -0,0 +1,227 @@
+#include <types.h>
+#include <arch.h>
+#include <string.h>
+#include <sync.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <proc.h>
+#include <unistd.h>
+#include <error.h>
+#include <memorder.h>
+#include <timekeeping.h>
+#include <sysrecbuf.h>
+#include <sysrec.h>
+
+/*
+ * The syscall recorder. syscall() of each arch times the syscalls of the
+ * procs with PF_SYSREC, see sysrec.h, and __sysrec_record appends them to
+ * the ring of the cpu as __trace_event does its events: the cpu is the
+ * only writer of its ring, with interrupts off, and seq tells the reader
+ * the records being written.
+ *
+ * SYSREC_START flags a proc; its children inherit the flag at fork and it
+ * is kept across exec, so that the whole of a workload started by it is
+ * recorded. SYSREC_STOP clears the flag of every proc. The rings are
+ * allocated by the first SYSREC_START and never freed, as those of
+ * trace.c, so that the mappings of SYSREC_MAP stay valid.
+ */
+
+struct sysrec_cpu {
+	struct sysrec_ring *ring;
+	struct sysrec_record *records;
+};
+
+static DEFINE_PERCPU_NOINIT(struct sysrec_cpu, sysrec_cpus);
+
+volatile bool sysrec_enabled;
+
+// sysrec_put - the next slot of the ring of sc, with interrupts off; the
+//            - record is seen once sysrec_commit is called
+static struct sysrec_record *sysrec_put(struct sysrec_cpu *sc, int num,
+					uint64_t ns)
+{
+	uint32_t slot = sc->ring->head;
+	struct sysrec_record *r = sc->records + slot % SYSREC_RING_ENTRIES;
+	r->seq = 0;
+	smp_wmb();
+	r->ns = ns, r->num = num;
+	r->pid = (current != NULL) ? current->pid : 0;
+	return r;
+}
+
+static void sysrec_commit(struct sysrec_cpu *sc, struct sysrec_record *r)
+{
+	uint32_t slot = sc->ring->head;
+	smp_wmb();
+	r->seq = slot + 1;
+	sc->ring->head = slot + 1;
+}
+
+void __sysrec_record(int num, const uintptr_t * arg, int nargs, long ret,
+		     uint64_t begin)
+{
+	uint64_t end = ktime_get_ns();
+	char path[SYSREC_PATH_MAX];
+	bool has_path = sysrec_has_path(num), intr_flag;
+	int i;
+	if (has_path) {
+		/* the path is still where the syscall took it from */
+		struct mm_struct *mm = current->mm;
+		memset(path, 0, sizeof(path));
+		if (mm != NULL) {
+			lock_mm_shared(mm);
+			if (!copy_string(mm, path, (const char *)arg[0],
+					 sizeof(path))) {
+				memset(path, 0, sizeof(path));
+			}
+			unlock_mm_shared(mm);
+		}
+	}
+	local_intr_save(intr_flag);
+	{
+		struct sysrec_cpu *sc = get_cpu_ptr(sysrec_cpus);
+		if (sc->ring != NULL) {
+			struct sysrec_record *r = sysrec_put(sc, num, begin);
+			r->lat_ns = end - begin, r->ret = ret;
+			for (i = 0; i < SYSREC_NR_ARGS; i++) {
+				r->arg[i] = (i < nargs) ? arg[i] : 0;
+			}
+			sysrec_commit(sc, r);
+			if (has_path) {
+				r = sysrec_put(sc, SYSREC_PATH, begin);
+				r->lat_ns = 0, r->ret = 0;
+				memcpy(r->arg, path, sizeof(path));
+				sysrec_commit(sc, r);
+			}
+		}
+	}
+	local_intr_restore(intr_flag);
+}
+
+// sysrec_ring_alloc - the ring of cpu, allocated if not yet
+static int sysrec_ring_alloc(int cpu)
+{
+	struct sysrec_cpu *sc = per_cpu_ptr(sysrec_cpus, cpu);
+	struct Page *head, *records;
+	int i;
+	if (sc->ring != NULL) {
+		return 0;
+	}
+	if ((head = alloc_page()) == NULL) {
+		return -E_NO_MEM;
+	}
+	if ((records = alloc_pages(SYSREC_RING_PAGES)) == NULL) {
+		free_page(head);
+		return -E_NO_MEM;
+	}
+	struct sysrec_ring *ring = page2kva(head);
+	memset(ring, 0, PGSIZE);
+	ring->entries = SYSREC_RING_ENTRIES;
+	ring->cpu = cpu;
+	set_page_ref(head, 1);
+	for (i = 0; i < SYSREC_RING_PAGES; i++) {
+		set_page_ref(records + i, 1);
+	}
+	sc->records = page2kva(records);
+	memset(sc->records, 0, SYSREC_RING_PAGES * PGSIZE);
+	smp_wmb();
+	/* SYSREC_START may be run by two procs at once */
+	if (!__sync_bool_compare_and_swap(&(sc->ring), NULL, ring)) {
+		set_page_ref(head, 0), free_page(head);
+		for (i = 0; i < SYSREC_RING_PAGES; i++) {
+			set_page_ref(records + i, 0);
+		}
+		free_pages(records, SYSREC_RING_PAGES);
+	}
+	return 0;
+}
+
+// sysrec_start - record the proc pid, current if 0, and its children
+static int sysrec_start(int pid)
+{
+	struct proc_struct *proc;
+	int i, ret;
+	if ((proc = (pid == 0) ? current : find_proc(pid)) == NULL
+	    || proc->mm == NULL) {
+		return -E_INVAL;
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if ((ret = sysrec_ring_alloc(i)) != 0) {
+			return ret;
+		}
+	}
+	proc->flags |= PF_SYSREC;
+	sysrec_enabled = 1;
+	return 0;
+}
+
+// sysrec_map - map the ring of cpu read-only in mm, the address in
+//            - *addr_store
+static int sysrec_map(struct mm_struct *mm, int cpu, uintptr_t * addr_store)
+{
+	struct sysrec_cpu *sc;
+	uintptr_t addr;
+	int i, ret;
+	if (cpu < 0 || cpu >= sysconf.lcpu_count) {
+		return -E_INVAL;
+	}
+	if ((sc = per_cpu_ptr(sysrec_cpus, cpu))->ring == NULL) {
+		return -E_INVAL;
+	}
+	if ((addr = get_unmapped_area(mm, SYSREC_MAP_SIZE)) == 0) {
+		return -E_NO_MEM;
+	}
+	/* VM_IO: never faulted in nor swapped out, the ptes are set here */
+	if ((ret = mm_map(mm, addr, SYSREC_MAP_SIZE, VM_READ | VM_IO,
+			  NULL)) != 0) {
+		return ret;
+	}
+	pte_perm_t perm = 0;
+	ptep_set_u_read(&perm);
+	for (i = 0; i <= SYSREC_RING_PAGES; i++) {
+		struct Page *page = (i == 0) ? kva2page(sc->ring)
+		    : kva2page((char *)sc->records + (i - 1) * PGSIZE);
+		if ((ret = page_insert(mm->pgdir, page, addr + i * PGSIZE,
+				       perm)) != 0) {
+			mm_unmap(mm, addr, SYSREC_MAP_SIZE);
+			return ret;
+		}
+	}
+	*addr_store = addr;
+	return 0;
+}
+
+// do_sysrec - SYS_sysrec, start recording the proc arg or stop, or map the
+//           - ring of cpu arg and store where in addr_store
+int do_sysrec(int op, uint32_t arg, uintptr_t __user * addr_store)
+{
+	struct mm_struct *mm = current->mm;
+	uintptr_t addr;
+	int ret;
+	switch (op) {
+	case SYSREC_START:
+		return sysrec_start(arg);
+	case SYSREC_STOP:
+		sysrec_enabled = 0;
+		proc_clear_flags(PF_SYSREC);
+		return 0;
+	case SYSREC_MAP:
+		if (mm == NULL) {
+			return -E_INVAL;
+		}
+		lock_mm(mm);
+		if ((ret = sysrec_map(mm, arg, &addr)) == 0) {
+			if (!copy_to_user
+			    (mm, addr_store, &addr, sizeof(uintptr_t))) {
+				mm_unmap(mm, addr, SYSREC_MAP_SIZE);
+				ret = -E_INVAL;
+			}
+		}
+		unlock_mm(mm);
+		return ret;
+	}
+	return -E_INVAL;
+}
@@ -0,0 +1,41 @@
+#ifndef __KERN_DEBUG_SYSREC_H__
+#define __KERN_DEBUG_SYSREC_H__
+
+#include <types.h>
+#include <proc.h>
+#include <timekeeping.h>
+
+/* *
+ * The hooks of syscall() of each arch for the syscall recorder, see
+ * sysrec.c: sysrec_begin is the entry time of a syscall to record, 0 if
+ * current is not recorded, and sysrec_end records it on its return. A
+ * proc not recorded pays a test of sysrec_enabled.
+ * */
+#ifdef UCONFIG_SYSREC
+
+extern volatile bool sysrec_enabled;
+
+void __sysrec_record(int num, const uintptr_t * arg, int nargs, long ret,
+		     uint64_t begin);
+int do_sysrec(int op, uint32_t arg, uintptr_t __user * addr_store);
+
+#define sysrec_begin()                                                  \
+    ((__builtin_expect(sysrec_enabled, 0)                               \
+      && (current->flags & PF_SYSREC)) ? ktime_get_ns() : 0)
+
+#define sysrec_end(num, arg, nargs, ret, begin)                         \
+    do {                                                                \
+        if ((begin) != 0) {                                             \
+            __sysrec_record((num), (const uintptr_t *)(arg), (nargs),   \
+                            (ret), (begin));                            \
+        }                                                               \
+    } while (0)
+
+#else
+
+#define sysrec_begin()                  0
+#define sysrec_end(num, arg, nargs, ret, begin)     ((void)(begin))
+
+#endif /* UCONFIG_SYSREC */
+
+#endif /* !__KERN_DEBUG_SYSREC_H__ */
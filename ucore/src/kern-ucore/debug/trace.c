@@ -0,0 +1,190 @@
+#include <types.h>
+#include <arch.h>
+#include <string.h>
+#include <sync.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <proc.h>
+#include <unistd.h>
+#include <error.h>
+#include <timekeeping.h>
+#include <trace.h>
+
+/*
+ * The event tracer. The tracepoints of trace.h call __trace_event for the
+ * events of trace_mask, which appends them to the ring of the cpu, see
+ * tracebuf.h. The cpu is the only writer of its ring, and with interrupts
+ * off an event is written whole before the next, so nothing is locked;
+ * seq, written last, tells the reader the slots being written.
+ *
+ * The rings are allocated by the first TRACE_ENABLE and never freed, so
+ * that the mappings TRACE_MAP gives the consumer, read-only, stay valid
+ * across fork and exit: the kernel keeps a ref on each page.
+ */
+
+struct trace_cpu {
+	struct trace_ring *ring;
+	struct trace_event *events;
+};
+
+static DEFINE_PERCPU_NOINIT(struct trace_cpu, trace_cpus);
+
+volatile uint32_t trace_mask;
+/* on while trace_mask is not 0 */
+DEFINE_STATIC_KEY(trace_key);
+
+#define trace_barrier()         __asm__ __volatile__ ("" ::: "memory")
+
+void __trace_event(int id, uint64_t arg0, uint64_t arg1)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		struct trace_cpu *tc = get_cpu_ptr(trace_cpus);
+		struct trace_ring *ring = tc->ring;
+		if (ring != NULL) {
+			uint32_t slot = ring->head;
+			struct trace_event *e =
+			    tc->events + slot % TRACE_RING_ENTRIES;
+			e->seq = 0;
+			trace_barrier();
+			e->ns = ktime_get_ns();
+			e->id = id;
+			e->pid = (current != NULL) ? current->pid : 0;
+			e->arg[0] = arg0, e->arg[1] = arg1;
+			trace_barrier();
+			e->seq = slot + 1;
+			ring->head = slot + 1;
+		}
+	}
+	local_intr_restore(intr_flag);
+}
+
+// trace_ring_alloc - the ring of cpu, allocated if not yet
+static int trace_ring_alloc(int cpu)
+{
+	struct trace_cpu *tc = per_cpu_ptr(trace_cpus, cpu);
+	struct Page *head, *events;
+	int i;
+	if (tc->ring != NULL) {
+		return 0;
+	}
+	if ((head = alloc_page()) == NULL) {
+		return -E_NO_MEM;
+	}
+	if ((events = alloc_pages(TRACE_RING_PAGES)) == NULL) {
+		free_page(head);
+		return -E_NO_MEM;
+	}
+	struct trace_ring *ring = page2kva(head);
+	memset(ring, 0, PGSIZE);
+	ring->entries = TRACE_RING_ENTRIES;
+	ring->cpu = cpu;
+	set_page_ref(head, 1);
+	for (i = 0; i < TRACE_RING_PAGES; i++) {
+		set_page_ref(events + i, 1);
+	}
+	tc->events = page2kva(events);
+	memset(tc->events, 0, TRACE_RING_PAGES * PGSIZE);
+	trace_barrier();
+	/* TRACE_ENABLE may be run by two procs at once */
+	if (!__sync_bool_compare_and_swap(&(tc->ring), NULL, ring)) {
+		set_page_ref(head, 0), free_page(head);
+		for (i = 0; i < TRACE_RING_PAGES; i++) {
+			set_page_ref(events + i, 0);
+		}
+		free_pages(events, TRACE_RING_PAGES);
+	}
+	return 0;
+}
+
+// trace_enable - record the events of mask, only those
+static int trace_enable(uint32_t mask)
+{
+	int i, ret;
+	if ((mask & ~TRACE_MASK_ALL) != 0) {
+		return -E_INVAL;
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if ((ret = trace_ring_alloc(i)) != 0) {
+			return ret;
+		}
+	}
+	trace_mask = mask;
+	if (mask != 0) {
+		static_key_enable(&trace_key);
+	} else {
+		static_key_disable(&trace_key);
+	}
+	return 0;
+}
+
+// trace_map - map the ring of cpu read-only in mm, the address in *addr_store
+static int trace_map(struct mm_struct *mm, int cpu, uintptr_t * addr_store)
+{
+	struct trace_cpu *tc;
+	uintptr_t addr;
+	int i, ret;
+	if (cpu < 0 || cpu >= sysconf.lcpu_count) {
+		return -E_INVAL;
+	}
+	if ((tc = per_cpu_ptr(trace_cpus, cpu))->ring == NULL) {
+		return -E_INVAL;
+	}
+	if ((addr = get_unmapped_area(mm, TRACE_MAP_SIZE)) == 0) {
+		return -E_NO_MEM;
+	}
+	/* VM_IO: never faulted in nor swapped out, the ptes are set here */
+	if ((ret = mm_map(mm, addr, TRACE_MAP_SIZE, VM_READ | VM_IO,
+			  NULL)) != 0) {
+		return ret;
+	}
+	pte_perm_t perm = 0;
+	ptep_set_u_read(&perm);
+	for (i = 0; i <= TRACE_RING_PAGES; i++) {
+		struct Page *page = (i == 0) ? kva2page(tc->ring)
+		    : kva2page((char *)tc->events + (i - 1) * PGSIZE);
+		if ((ret = page_insert(mm->pgdir, page, addr + i * PGSIZE,
+				       perm)) != 0) {
+			mm_unmap(mm, addr, TRACE_MAP_SIZE);
+			return ret;
+		}
+	}
+	*addr_store = addr;
+	return 0;
+}
+
+// do_trace - SYS_trace, enable or disable the events, or map the ring of
+//          - cpu arg and store where in addr_store
+int do_trace(int op, uint32_t arg, uintptr_t __user * addr_store)
+{
+	struct mm_struct *mm = current->mm;
+	uintptr_t addr;
+	int ret;
+	switch (op) {
+	case TRACE_ENABLE:
+		return trace_enable(arg);
+	case TRACE_DISABLE:
+		trace_mask = 0;
+		static_key_disable(&trace_key);
+		return 0;
+	case TRACE_MAP:
+		if (mm == NULL) {
+			return -E_INVAL;
+		}
+		lock_mm(mm);
+		if ((ret = trace_map(mm, arg, &addr)) == 0) {
+			if (!copy_to_user
+			    (mm, addr_store, &addr, sizeof(uintptr_t))) {
+				mm_unmap(mm, addr, TRACE_MAP_SIZE);
+				ret = -E_INVAL;
+			}
+		}
+		unlock_mm(mm);
+		return ret;
+	}
+	return -E_INVAL;
+}
@@ -0,0 +1,44 @@
+#ifndef __KERN_DEBUG_TRACE_H__
+#define __KERN_DEBUG_TRACE_H__
+
+#include <types.h>
+#include <tracebuf.h>
+
+/* *
+ * trace_event - a static tracepoint, the event id of tracebuf.h with its
+ * two args. It is one test of trace_mask while the event is disabled, a
+ * nop while no event is enabled under UCONFIG_JUMP_LABEL, and nothing at
+ * all without UCONFIG_TRACEPOINTS; see trace.c.
+ * */
+#ifdef UCONFIG_TRACEPOINTS
+
+#include <static_key.h>
+
+extern volatile uint32_t trace_mask;
+extern struct static_key trace_key;
+
+void __trace_event(int id, uint64_t arg0, uint64_t arg1);
+
+#ifdef UCONFIG_JUMP_LABEL
+#define trace_on(id)                                                    \
+    (static_key_false(&trace_key) && (trace_mask & TRACE_MASK(id)))
+#else
+#define trace_on(id)    __builtin_expect(trace_mask & TRACE_MASK(id), 0)
+#endif
+
+#define trace_event(id, arg0, arg1)                                     \
+    do {                                                                \
+        if (trace_on(id)) {                                             \
+            __trace_event((id), (arg0), (arg1));                        \
+        }                                                               \
+    } while (0)
+
+int do_trace(int op, uint32_t arg, uintptr_t __user * addr_store);
+
+#else
+
+#define trace_event(id, arg0, arg1)     do { } while (0)
+
+#endif /* UCONFIG_TRACEPOINTS */
+
+#endif /* !__KERN_DEBUG_TRACE_H__ */
@@ -0,0 +1,270 @@
+#include <types.h>
+#include <stdio.h>
+#include <string.h>
+#include <list.h>
+#include <wait.h>
+#include <proc.h>
+#include <sched.h>
+#include <clock.h>
+#include <fs.h>
+#include <iobuf.h>
+#include <blkqueue.h>
+#include <trace.h>
+#include <assert.h>
+
+/*
+ * The request queue of a block device.
+ *
+ * Submitting a request only puts it in the queue. The worker thread of
+ * the queue takes the requests out in the order of the elevator, merges
+ * those that follow each other on the disk into one transfer, runs it
+ * with the driver (which sleeps until the device is done) and completes
+ * them, so that a submitter may keep several requests in flight and only
+ * waits for those it needs.
+ *
+ * The elevator is a deadline one: the requests are kept sorted by sector
+ * and served in one direction from the head, so that the device is swept
+ * rather than sought back and forth, but a read older than
+ * BLK_READ_EXPIRE ticks or a write older than BLK_WRITE_EXPIRE ticks goes
+ * first. Reads expire sooner, someone is usually waiting for them.
+ *
+ * Until the worker runs, in the boot code, and from the idle process,
+ * which must not sleep, a request is served at once by the submitter.
+ */
+
+void
+blk_queue_init(struct blk_queue *q, const char *name, blk_xfer_t xfer,
+	       uint32_t max_nsecs, void *private)
+{
+	snprintf(q->name, sizeof(q->name), "%s", name);
+	q->xfer = xfer, q->max_nsecs = max_nsecs, q->private = private;
+	spinlock_init(&(q->lock));
+	list_init(&(q->sort_list));
+	list_init(&(q->fifo[0]));
+	list_init(&(q->fifo[1]));
+	q->nr_pending = 0, q->head = 0, q->running = 0;
+	wait_queue_init(&(q->work_wait));
+	wait_queue_init(&(q->done_wait));
+	iostat_init(&(q->stat), name);
+}
+
+void
+blk_request_init(struct blk_request *req, uint32_t secno,
+		 const struct iovec *iov, int iovcnt, bool write)
+{
+	size_t len = 0;
+	int i;
+	for (i = 0; i < iovcnt; i++) {
+		assert(iov[i].iov_len % SECTSIZE == 0);
+		len += iov[i].iov_len;
+	}
+	req->secno = secno, req->nsecs = len / SECTSIZE;
+	req->iov = iov, req->iovcnt = iovcnt, req->write = write;
+	req->completed = 0, req->error = 0;
+	req->end_io = NULL, req->private = NULL, req->queue = NULL;
+}
+
+/*
+ * blk_end_request - complete req of q with error. A driver that takes the
+ * requests itself rather than through the worker calls it when they are
+ * done, possibly from its interrupt.
+ */
+void blk_end_request(struct blk_queue *q, struct blk_request *req, int error)
+{
+	trace_event(TRACE_BLOCK_COMPLETE, req->secno, error);
+	iostat_done(&(q->stat), req->write, req->nsecs, req->begin_ns);
+	req->error = error;
+	if (req->end_io != NULL) {
+		req->end_io(req);
+		return;
+	}
+	bool intr_flag;
+	spin_lock_irqsave(&(q->lock), intr_flag);
+	req->completed = 1;
+	spin_unlock_irqrestore(&(q->lock), intr_flag);
+	if (!wait_queue_empty(&(q->done_wait))) {
+		wakeup_queue(&(q->done_wait), WT_IO, 1);
+	}
+}
+
+// blk_next - the request the elevator serves next, with q->lock held
+static struct blk_request *blk_next(struct blk_queue *q)
+{
+	struct blk_request *req;
+	int dir;
+	for (dir = 0; dir < 2; dir++) {
+		if (!list_empty(&(q->fifo[dir]))) {
+			req = le2req(list_next(&(q->fifo[dir])), fifo_link);
+			if ((long)(ticks - req->deadline) >= 0) {
+				return req;
+			}
+		}
+	}
+	list_entry_t *list = &(q->sort_list), *le = list;
+	while ((le = list_next(le)) != list) {
+		if ((req = le2req(le, sort_link))->secno >= q->head) {
+			return req;
+		}
+	}
+	/* past the last one, sweep again from the start */
+	return le2req(list_next(list), sort_link);
+}
+
+static void blk_dequeue(struct blk_queue *q, struct blk_request *req)
+{
+	list_del(&(req->sort_link));
+	list_del(&(req->fifo_link));
+	q->nr_pending--;
+}
+
+/*
+ * Take the next request out of q, with q->lock held, and the ones right
+ * behind it in the same direction while they fit in one transfer. They
+ * are stored in reqs, and their # is returned.
+ */
+static int blk_dispatch(struct blk_queue *q, struct blk_request **reqs)
+{
+	struct blk_request *req = blk_next(q), *next;
+	uint32_t end = req->secno + req->nsecs, nsecs = req->nsecs;
+	int n = 0, iovcnt = req->iovcnt;
+	while (1) {
+		list_entry_t *le = list_next(&(req->sort_link));
+		blk_dequeue(q, reqs[n++] = req);
+		if (le == &(q->sort_list)) {
+			break;
+		}
+		next = le2req(le, sort_link);
+		if (next->write != req->write || next->secno != end
+		    || nsecs + next->nsecs > q->max_nsecs
+		    || iovcnt + next->iovcnt > BLK_MAX_IOV) {
+			break;
+		}
+		req = next, end += req->nsecs, nsecs += req->nsecs;
+		iovcnt += req->iovcnt;
+	}
+	q->head = end;
+	return n;
+}
+
+// blk_serve - transfer reqs, which follow each other, and complete them
+static void blk_serve(struct blk_queue *q, struct blk_request **reqs, int n,
+		      bool can_sleep)
+{
+	struct iovec iov[BLK_MAX_IOV];
+	int i, j, iovcnt = 0, ret;
+	for (i = 0; i < n; i++) {
+		reqs[i]->begin_ns = iostat_dispatch(&(q->stat), reqs[i]->write,
+						    reqs[i]->begin_ns, i > 0);
+		for (j = 0; j < reqs[i]->iovcnt; j++) {
+			iov[iovcnt++] = reqs[i]->iov[j];
+		}
+	}
+	ret = q->xfer(q, reqs[0]->secno, iov, iovcnt, reqs[0]->write, can_sleep);
+	for (i = 0; i < n; i++) {
+		blk_end_request(q, reqs[i], ret);
+	}
+}
+
+static int blk_worker(void *arg)
+{
+	struct blk_queue *q = arg;
+	struct blk_request *reqs[BLK_MAX_IOV];
+	wait_t __wait, *wait = &__wait;
+	bool intr_flag;
+	q->running = 1;
+	while (1) {
+		spin_lock_irqsave(&(q->lock), intr_flag);
+		while (q->nr_pending == 0) {
+			wait_current_set(&(q->work_wait), wait, WT_IO);
+			spin_unlock_irqrestore(&(q->lock), intr_flag);
+			schedule();
+			spin_lock_irqsave(&(q->lock), intr_flag);
+			wait_current_del(&(q->work_wait), wait);
+		}
+		int n = blk_dispatch(q, reqs);
+		spin_unlock_irqrestore(&(q->lock), intr_flag);
+		blk_serve(q, reqs, n, 1);
+	}
+}
+
+// blk_queue_start - create the worker of q, which serves it from then on
+int blk_queue_start(struct blk_queue *q)
+{
+	int pid;
+	if ((pid = ucore_kernel_thread(blk_worker, q, 0)) <= 0) {
+		return pid;
+	}
+	set_proc_name(find_proc(pid), q->name);
+	return 0;
+}
+
+// blk_start_request - req goes to q, by blk_submit or by a driver that
+//                   - takes the requests itself
+void blk_start_request(struct blk_queue *q, struct blk_request *req)
+{
+	req->queue = q;
+	req->begin_ns = iostat_begin(&(q->stat));
+}
+
+// blk_submit - queue req to q
+void blk_submit(struct blk_queue *q, struct blk_request *req)
+{
+	assert(req->nsecs != 0 && req->nsecs <= q->max_nsecs
+	       && req->iovcnt <= BLK_MAX_IOV);
+	trace_event(TRACE_BLOCK_SUBMIT, req->secno,
+		    req->nsecs | ((uint32_t) req->write << 31));
+	blk_start_request(q, req);
+	if (!q->running || current == NULL || current == idleproc) {
+		blk_serve(q, &req, 1, 0);
+		return;
+	}
+	bool intr_flag;
+	spin_lock_irqsave(&(q->lock), intr_flag);
+	{
+		req->deadline =
+		    ticks + (req->write ? BLK_WRITE_EXPIRE : BLK_READ_EXPIRE);
+		list_add_before(&(q->fifo[req->write ? 1 : 0]),
+				&(req->fifo_link));
+		list_entry_t *list = &(q->sort_list), *le = list;
+		while ((le = list_prev(le)) != list
+		       && le2req(le, sort_link)->secno > req->secno) {
+			/* new requests mostly go at the end */
+		}
+		list_add(le, &(req->sort_link));
+		q->nr_pending++;
+	}
+	spin_unlock_irqrestore(&(q->lock), intr_flag);
+	if (!wait_queue_empty(&(q->work_wait))) {
+		wakeup_queue(&(q->work_wait), WT_IO, 1);
+	}
+}
+
+// blk_wait - wait for req, submitted without an end_io, to be done
+int blk_wait(struct blk_request *req)
+{
+	struct blk_queue *q = req->queue;
+	wait_t __wait, *wait = &__wait;
+	bool intr_flag;
+	assert(req->end_io == NULL);
+	spin_lock_irqsave(&(q->lock), intr_flag);
+	while (!req->completed) {
+		wait_current_set(&(q->done_wait), wait, WT_IO);
+		spin_unlock_irqrestore(&(q->lock), intr_flag);
+		schedule();
+		spin_lock_irqsave(&(q->lock), intr_flag);
+		wait_current_del(&(q->done_wait), wait);
+	}
+	spin_unlock_irqrestore(&(q->lock), intr_flag);
+	return req->error;
+}
+
+// blk_rw - transfer through q and wait for it
+int
+blk_rw(struct blk_queue *q, uint32_t secno, const struct iovec *iov,
+       int iovcnt, bool write)
+{
+	struct blk_request __req, *req = &__req;
+	blk_request_init(req, secno, iov, iovcnt, write);
+	blk_submit(q, req);
+	return blk_wait(req);
+}
@@ -0,0 +1,84 @@
+#ifndef __KERN_FS_DEVS_BLKQUEUE_H__
+#define __KERN_FS_DEVS_BLKQUEUE_H__
+
+#include <types.h>
+#include <list.h>
+#include <wait.h>
+#include <spinlock.h>
+#include <iostat.h>
+
+struct iovec;
+struct blk_queue;
+
+/*
+ * A request to transfer the sectors from secno on to or from the iovcnt
+ * buffers of iov, each holding a whole # of sectors. The submitter keeps
+ * the request and the buffers until it is done: end_io is called then,
+ * from the worker of the queue or the interrupt of the driver, or else
+ * blk_wait returns.
+ */
+struct blk_request {
+	list_entry_t sort_link;	/* entry in sort_list of the queue */
+	list_entry_t fifo_link;	/* entry in the fifo of its direction */
+	uint32_t secno, nsecs;
+	const struct iovec *iov;
+	int iovcnt;
+	bool write;
+	size_t deadline;	/* the elevator passes it over until then */
+	bool completed;
+	int error;
+	void (*end_io) (struct blk_request * req);
+	void *private;
+	struct blk_queue *queue;
+	uint64_t begin_ns;	/* of its submit, then of its dispatch */
+};
+
+#define le2req(le, member)                          \
+    to_struct((le), struct blk_request, member)
+
+typedef int (*blk_xfer_t) (struct blk_queue * q, uint32_t secno,
+			   const struct iovec * iov, int iovcnt, bool write,
+			   bool can_sleep);
+
+/*
+ * The pending requests of a device. Its worker thread serves them with
+ * the deadline elevator: the next request up from the head in sector
+ * order, together with those right behind it, unless the oldest read or
+ * write has expired.
+ */
+struct blk_queue {
+	char name[16];
+	blk_xfer_t xfer;	/* one command, may sleep if can_sleep */
+	uint32_t max_nsecs;	/* # of sectors xfer moves at most */
+	void *private;		/* of the driver */
+	spinlock_s lock;
+	list_entry_t sort_list;	/* the pending requests, by secno */
+	list_entry_t fifo[2];	/* the pending reads and writes, oldest first */
+	int nr_pending;
+	uint32_t head;		/* the sector after the last dispatched */
+	bool running;		/* the worker serves the requests */
+	wait_queue_t work_wait;	/* the worker waits for requests */
+	wait_queue_t done_wait;	/* blk_wait waits for completions */
+	struct io_stat stat;	/* named as the queue, see iostat.h */
+};
+
+/* ticks a read or a write may be passed over by the elevator */
+#define BLK_READ_EXPIRE                 50
+#define BLK_WRITE_EXPIRE                500
+
+/* # of buffers one dispatch moves at most */
+#define BLK_MAX_IOV                     32
+
+void blk_queue_init(struct blk_queue *q, const char *name, blk_xfer_t xfer,
+		    uint32_t max_nsecs, void *private);
+int blk_queue_start(struct blk_queue *q);
+void blk_request_init(struct blk_request *req, uint32_t secno,
+		      const struct iovec *iov, int iovcnt, bool write);
+void blk_start_request(struct blk_queue *q, struct blk_request *req);
+void blk_submit(struct blk_queue *q, struct blk_request *req);
+int blk_wait(struct blk_request *req);
+void blk_end_request(struct blk_queue *q, struct blk_request *req, int error);
+int blk_rw(struct blk_queue *q, uint32_t secno, const struct iovec *iov,
+	   int iovcnt, bool write);
+
+#endif /* !__KERN_FS_DEVS_BLKQUEUE_H__ */
@@ -3,9 +3,29 @@
 #include <stat.h>
 #include <dev.h>
 #include <inode.h>
+#include <iobuf.h>
+#include <fs.h>
+#include <iostat.h>
 #include <unistd.h>
 #include <error.h>
 
+/*
+ * dop_io goes here, to count the I/O in the io_stat of dev if it has one:
+ * the time from the call to the return, and the whole sectors moved.
+ */
+int dev_io(struct device *dev, struct iobuf *iob, bool write)
+{
+	struct io_stat *stat = dev->d_stat;
+	if (stat == NULL) {
+		return dev->d_io(dev, iob, write);
+	}
+	size_t resid = iob->io_resid;
+	uint64_t begin = iostat_begin(stat);
+	int ret = dev->d_io(dev, iob, write);
+	iostat_done(stat, write, (resid - iob->io_resid) / SECTSIZE, begin);
+	return ret;
+}
+
 /*
  * Called for each open().
  *
@@ -168,9 +188,13 @@ void dev_init(void)
 	init_device(null);
 	init_device(stdin);
 	init_device(stdout);
+	init_device(stat);
 	init_device(disk0);
 	/* for Nand flash */
 	init_device(disk1);
+#ifdef UCONFIG_VIRTIO_BLK
+	init_device(vdisk0);
+#endif
 }
 
 /*
@@ -180,6 +204,7 @@ struct inode *dev_create_inode(void)
 {
 	struct inode *node;
 	if ((node = alloc_inode(device)) != NULL) {
+		vop_info(node, device)->d_stat = NULL;
 		vop_init(node, &dev_node_ops, NULL);
 	}
 	return node;
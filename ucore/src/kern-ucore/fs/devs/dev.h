@@ -5,6 +5,7 @@
 
 struct inode;
 struct iobuf;
+struct io_stat;
 
 struct file_operations;
 
@@ -23,6 +24,9 @@ struct device {
 #endif
 	size_t d_blocks;
 	size_t d_blocksize;
+	size_t d_erasesize;	/* bytes the medium erases at once, 0 if unknown */
+	void *d_mem;		/* the medium if it is memory, the ramdisk */
+	struct io_stat *d_stat;	/* dop_io counts there if not NULL */
 	/* for Linux */
 	/* 
 	   unsigned long i_rdev;
@@ -49,12 +53,13 @@ struct device {
 
 #define dop_open(dev, open_flags)           ((dev)->d_open(dev, open_flags))
 #define dop_close(dev)                      ((dev)->d_close(dev))
-#define dop_io(dev, iob, write)             ((dev)->d_io(dev, iob, write))
+#define dop_io(dev, iob, write)             (dev_io(dev, iob, write))
 #define dop_ioctl(dev, op, data)            ((dev)->d_ioctl(dev, op, data))
 
 #define dev_is_linux_dev(dev) ((dev)->linux_dentry != NULL)
 
 void dev_init(void);
+int dev_io(struct device *dev, struct iobuf *iob, bool write);
 /* Create inode for a vfs-level device. */
 struct inode *dev_create_inode(void);
 
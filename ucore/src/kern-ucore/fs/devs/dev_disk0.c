@@ -3,10 +3,12 @@
 #include <slab.h>
 #include <sem.h>
 #include <ide.h>
+#include <blkqueue.h>
 #include <inode.h>
 #include <dev.h>
 #include <vfs.h>
 #include <iobuf.h>
+#include <iostat.h>
 #include <error.h>
 #include <assert.h>
 
@@ -16,6 +18,7 @@
 
 static char *disk0_buffer;
 static semaphore_t disk0_sem;
+static struct io_stat disk0_stat;
 
 static void lock_disk0(void)
 {
@@ -63,6 +66,94 @@ static void disk0_write_blks_nolock(uint32_t blkno, uint32_t nblks)
 	}
 }
 
+#ifdef IDE_MAX_NSECS
+#define DISK0_MAX_IOV                   (IDE_MAX_NSECS * SECTSIZE / DISK0_BLKSIZE)
+
+/*
+ * Describe in iov the buffers of iob from its position on that one IDE
+ * command moves straight, up to the first that does not hold whole
+ * blocks. Returns their #, the # of bytes they hold is stored in lenp.
+ */
+static int disk0_iov_direct(struct iobuf *iob, struct iovec *iov, size_t *lenp)
+{
+	size_t len;
+	int i, n = iobuf_iov(iob, iov, DISK0_MAX_IOV,
+			     IDE_MAX_NSECS * SECTSIZE, &len);
+	for (i = 0, len = 0; i < n; i++) {
+		if (iov[i].iov_len % DISK0_BLKSIZE != 0) {
+			break;
+		}
+		len += iov[i].iov_len;
+	}
+	*lenp = len;
+	return i;
+}
+
+#ifdef UCONFIG_BLK_QUEUE
+/* # of commands disk0_io_direct keeps in the queue at once */
+#define DISK0_MAX_INFLIGHT              4
+
+/* under disk0_sem */
+static struct iovec disk0_iov[DISK0_MAX_INFLIGHT][DISK0_MAX_IOV];
+static struct blk_request disk0_reqs[DISK0_MAX_INFLIGHT];
+
+/*
+ * Transfer straight to or from the buffers of iob, as disk0_io_direct
+ * below, but submit up to DISK0_MAX_INFLIGHT commands before waiting for
+ * them, so that the disk goes on with the next while the first completes.
+ */
+static void disk0_io_direct(struct iobuf *iob, bool write)
+{
+	size_t len;
+	int i, n, nreqs;
+	do {
+		for (nreqs = 0; nreqs < DISK0_MAX_INFLIGHT; nreqs++) {
+			struct iovec *iov = disk0_iov[nreqs];
+			if ((n = disk0_iov_direct(iob, iov, &len)) == 0) {
+				break;
+			}
+			blk_request_init(disk0_reqs + nreqs,
+					 iob->io_offset / SECTSIZE, iov, n, write);
+			ide_submit(DISK0_DEV_NO, disk0_reqs + nreqs);
+			iobuf_skip(iob, len);
+		}
+		for (i = 0; i < nreqs; i++) {
+			struct blk_request *req = disk0_reqs + i;
+			int ret;
+			if ((ret = blk_wait(req)) != 0) {
+				panic("disk0: %s sectno = %d, nsecs = %d: 0x%08x.\n",
+				      write ? "write" : "read", req->secno,
+				      req->nsecs, ret);
+			}
+		}
+	} while (nreqs == DISK0_MAX_INFLIGHT);
+}
+#else
+/*
+ * Transfer straight to or from the buffers of iob, one IDE command for as
+ * many of them as it takes, until a buffer that does not hold whole blocks
+ * is met; the rest then goes through disk0_buffer.
+ */
+static void disk0_io_direct(struct iobuf *iob, bool write)
+{
+	struct iovec iov[DISK0_MAX_IOV];
+	size_t len;
+	int n;
+	while ((n = disk0_iov_direct(iob, iov, &len)) != 0) {
+		uint32_t sectno = iob->io_offset / SECTSIZE;
+		int ret = write ? ide_write_secsv(DISK0_DEV_NO, sectno, iov, n)
+		    : ide_read_secsv(DISK0_DEV_NO, sectno, iov, n);
+		if (ret != 0) {
+			panic("disk0: %s sectno = %d, nsecs = %d: 0x%08x.\n",
+			      write ? "write" : "read", sectno, len / SECTSIZE,
+			      ret);
+		}
+		iobuf_skip(iob, len);
+	}
+}
+#endif /* UCONFIG_BLK_QUEUE */
+#endif
+
 static int disk0_io(struct device *dev, struct iobuf *iob, bool write)
 {
 	off_t offset = iob->io_offset;
@@ -86,6 +177,10 @@ static int disk0_io(struct device *dev, struct iobuf *iob, bool write)
 	}
 
 	lock_disk0();
+#ifdef IDE_MAX_NSECS
+	disk0_io_direct(iob, write);
+	resid = iob->io_resid, blkno = iob->io_offset / DISK0_BLKSIZE;
+#endif
 	while (resid != 0) {
 		size_t copied, alen = DISK0_BUFSIZE;
 		if (write) {
@@ -123,10 +218,15 @@ static void disk0_device_init(struct device *dev)
 	}
 	dev->d_blocks = ide_device_size(DISK0_DEV_NO) / DISK0_BLK_NSECT;
 	dev->d_blocksize = DISK0_BLKSIZE;
+#ifdef IDE_DEVICE_MEM
+	dev->d_mem = ide_device_mem(DISK0_DEV_NO);
+#endif
 	dev->d_open = disk0_open;
 	dev->d_close = disk0_close;
 	dev->d_io = disk0_io;
 	dev->d_ioctl = disk0_ioctl;
+	iostat_init(&(disk0_stat), "disk0");
+	dev->d_stat = &(disk0_stat);
 	sem_init(&(disk0_sem), 1);
 
 	static_assert(DISK0_BUFSIZE % DISK0_BLKSIZE == 0);
@@ -3,10 +3,12 @@
 #include <slab.h>
 #include <sem.h>
 #include <ide.h>
+#include <blkqueue.h>
 #include <inode.h>
 #include <dev.h>
 #include <vfs.h>
 #include <iobuf.h>
+#include <iostat.h>
 #include <error.h>
 #include <assert.h>
 
@@ -16,6 +18,7 @@
 
 static char *mmc0_buffer;
 static semaphore_t mmc0_sem;
+static struct io_stat mmc0_stat;
 
 static void lock_mmc0(void)
 {
@@ -62,6 +65,94 @@ static void mmc0_write_blks_nolock(uint32_t blkno, uint32_t nblks)
 	}
 }
 
+#ifdef IDE_MAX_NSECS
+#define MMC0_MAX_IOV                    (IDE_MAX_NSECS * SECTSIZE / MMC0_BLKSIZE)
+
+/*
+ * Describe in iov the buffers of iob from its position on that one
+ * multi-block command moves straight, up to the first that does not hold
+ * whole blocks. Returns their #, the # of bytes they hold is stored in lenp.
+ */
+static int mmc0_iov_direct(struct iobuf *iob, struct iovec *iov, size_t *lenp)
+{
+	size_t len;
+	int i, n = iobuf_iov(iob, iov, MMC0_MAX_IOV,
+			     IDE_MAX_NSECS * SECTSIZE, &len);
+	for (i = 0, len = 0; i < n; i++) {
+		if (iov[i].iov_len % MMC0_BLKSIZE != 0) {
+			break;
+		}
+		len += iov[i].iov_len;
+	}
+	*lenp = len;
+	return i;
+}
+
+#ifdef UCONFIG_BLK_QUEUE
+/* # of commands mmc0_io_direct keeps in the queue at once */
+#define MMC0_MAX_INFLIGHT               4
+
+/* under mmc0_sem */
+static struct iovec mmc0_iov[MMC0_MAX_INFLIGHT][MMC0_MAX_IOV];
+static struct blk_request mmc0_reqs[MMC0_MAX_INFLIGHT];
+
+/*
+ * Transfer straight to or from the buffers of iob, submitting up to
+ * MMC0_MAX_INFLIGHT commands before waiting for them, so that the card
+ * is programming the next while the first completes.
+ */
+static void mmc0_io_direct(struct iobuf *iob, bool write)
+{
+	size_t len;
+	int i, n, nreqs;
+	do {
+		for (nreqs = 0; nreqs < MMC0_MAX_INFLIGHT; nreqs++) {
+			struct iovec *iov = mmc0_iov[nreqs];
+			if ((n = mmc0_iov_direct(iob, iov, &len)) == 0) {
+				break;
+			}
+			blk_request_init(mmc0_reqs + nreqs,
+					 iob->io_offset / SECTSIZE, iov, n, write);
+			ide_submit(MMC0_DEV_NO, mmc0_reqs + nreqs);
+			iobuf_skip(iob, len);
+		}
+		for (i = 0; i < nreqs; i++) {
+			struct blk_request *req = mmc0_reqs + i;
+			int ret;
+			if ((ret = blk_wait(req)) != 0) {
+				panic("mmc0: %s sectno = %d, nsecs = %d: 0x%08x.\n",
+				      write ? "write" : "read", req->secno,
+				      req->nsecs, ret);
+			}
+		}
+	} while (nreqs == MMC0_MAX_INFLIGHT);
+}
+#else
+/*
+ * Transfer straight to or from the buffers of iob, one multi-block
+ * command for as many of them as it takes, until a buffer that does not
+ * hold whole blocks is met; the rest then goes through mmc0_buffer.
+ */
+static void mmc0_io_direct(struct iobuf *iob, bool write)
+{
+	struct iovec iov[MMC0_MAX_IOV];
+	size_t len;
+	int n;
+	while ((n = mmc0_iov_direct(iob, iov, &len)) != 0) {
+		uint32_t sectno = iob->io_offset / SECTSIZE;
+		int ret = write ? ide_write_secsv(MMC0_DEV_NO, sectno, iov, n)
+		    : ide_read_secsv(MMC0_DEV_NO, sectno, iov, n);
+		if (ret != 0) {
+			panic("mmc0: %s sectno = %d, nsecs = %d: 0x%08x.\n",
+			      write ? "write" : "read", sectno, len / SECTSIZE,
+			      ret);
+		}
+		iobuf_skip(iob, len);
+	}
+}
+#endif /* UCONFIG_BLK_QUEUE */
+#endif
+
 static int mmc0_io(struct device *dev, struct iobuf *iob, bool write)
 {
 	off_t offset = iob->io_offset;
@@ -85,6 +176,10 @@ static int mmc0_io(struct device *dev, struct iobuf *iob, bool write)
 	}
 
 	lock_mmc0();
+#ifdef IDE_MAX_NSECS
+	mmc0_io_direct(iob, write);
+	resid = iob->io_resid, blkno = iob->io_offset / MMC0_BLKSIZE;
+#endif
 	while (resid != 0) {
 		size_t copied, alen = MMC0_BUFSIZE;
 		if (write) {
@@ -122,10 +217,13 @@ static void mmc0_device_init(struct device *dev)
 	}
 	dev->d_blocks = ide_device_size(MMC0_DEV_NO) / MMC0_BLK_NSECT;
 	dev->d_blocksize = MMC0_BLKSIZE;
+	dev->d_erasesize = ide_device_erase_size(MMC0_DEV_NO) * SECTSIZE;
 	dev->d_open = mmc0_open;
 	dev->d_close = mmc0_close;
 	dev->d_io = mmc0_io;
 	dev->d_ioctl = mmc0_ioctl;
+	iostat_init(&(mmc0_stat), "mmc0");
+	dev->d_stat = &(mmc0_stat);
 	sem_init(&(mmc0_sem), 1);
 
 	static_assert(MMC0_BUFSIZE % MMC0_BLKSIZE == 0);
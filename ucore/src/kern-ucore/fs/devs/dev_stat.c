@@ -0,0 +1,109 @@
+/*
+ * The stat device, "stat:", a text view of the time of each cpu and of
+ * the resources used by each process, as /proc/stat and /proc/<pid>/stat
+ * give them on Linux. The times are in clock ticks, see rusage.h:
+ *
+ *     cpu<n> <user> <system> <idle> <switches>
+ *     ...
+ *     <pid> <state> <utime> <stime> <nvcsw> <nivcsw> <minflt> <majflt> <name>
+ *     ...
+ *
+ * Each read formats it anew, up to STAT_BUFSIZE bytes.
+ */
+#include <types.h>
+#include <stdio.h>
+#include <string.h>
+#include <slab.h>
+#include <dev.h>
+#include <vfs.h>
+#include <iobuf.h>
+#include <inode.h>
+#include <unistd.h>
+#include <proc.h>
+#include <sched.h>
+#include <sysconf.h>
+#include <rusage.h>
+#include <error.h>
+#include <assert.h>
+
+#define STAT_BUFSIZE                (4 * PGSIZE)
+
+static int stat_open(struct device *dev, uint32_t open_flags)
+{
+	if (open_flags != O_RDONLY) {
+		return -E_INVAL;
+	}
+	return 0;
+}
+
+static int stat_close(struct device *dev)
+{
+	return 0;
+}
+
+static size_t stat_show(char *buf, size_t size)
+{
+	struct cpu_usage usage;
+	size_t len = 0;
+	int cpu;
+	for (cpu = 0; cpu < sysconf.lcpu_count && len < size; cpu++) {
+		sched_cpu_usage(cpu, &usage);
+		len += snprintf(buf + len, size - len,
+				"cpu%d %llu %llu %llu %llu %llu\n", cpu,
+				usage.user, usage.system, usage.idle,
+				usage.nr_switches, usage.steal);
+	}
+	if (len < size) {
+		len += proc_rusage_show(buf + len, size - len);
+	}
+	return (len < size) ? len : size;
+}
+
+static int stat_io(struct device *dev, struct iobuf *iob, bool write)
+{
+	char *buf;
+	size_t len, copied;
+	if (write) {
+		return -E_INVAL;
+	}
+	if ((buf = kmalloc(STAT_BUFSIZE)) == NULL) {
+		return -E_NO_MEM;
+	}
+	len = stat_show(buf, STAT_BUFSIZE);
+	if (iob->io_offset < len) {
+		iobuf_move(iob, buf + iob->io_offset, len - iob->io_offset, 1,
+			   &copied);
+	}
+	kfree(buf);
+	return 0;
+}
+
+static int stat_ioctl(struct device *dev, int op, void *data)
+{
+	return -E_INVAL;
+}
+
+static void stat_device_init(struct device *dev)
+{
+	memset(dev, 0, sizeof(*dev));
+	dev->d_blocks = 0;
+	dev->d_blocksize = 1;
+	dev->d_open = stat_open;
+	dev->d_close = stat_close;
+	dev->d_io = stat_io;
+	dev->d_ioctl = stat_ioctl;
+}
+
+void dev_init_stat(void)
+{
+	struct inode *node;
+	if ((node = dev_create_inode()) == NULL) {
+		panic("stat: dev_create_node.\n");
+	}
+	stat_device_init(vop_info(node, device));
+
+	int ret;
+	if ((ret = vfs_add_dev("stat", node, 0)) != 0) {
+		panic("stat: vfs_add_dev: %e.\n", ret);
+	}
+}
@@ -9,6 +9,7 @@
 #include <iobuf.h>
 #include <inode.h>
 #include <unistd.h>
+#include <poll.h>
 #include <error.h>
 #include <assert.h>
 
@@ -17,6 +18,7 @@
 static char stdin_buffer[STDIN_BUFSIZE];
 static off_t p_rpos, p_wpos;
 static wait_queue_t __wait_queue, *wait_queue = &__wait_queue;
+static poll_head_t stdin_poll;
 
 void dev_stdin_write(char c)
 {
@@ -31,6 +33,7 @@ void dev_stdin_write(char c)
 			if (!wait_queue_empty(wait_queue)) {
 				wakeup_queue(wait_queue, WT_KBD, 1);
 			}
+			poll_notify(&stdin_poll, EPOLLIN);
 		}
 		local_intr_restore(intr_flag);
 	}
@@ -102,6 +105,12 @@ static int stdin_io(struct device *dev, struct iobuf *iob, bool write)
 
 static int stdin_ioctl(struct device *dev, int op, void *data)
 {
+	if (op == IOCTL_POLL) {
+		struct poll_query *q = data;
+		q->events = (p_rpos < p_wpos) ? EPOLLIN : 0;
+		q->head = &stdin_poll;
+		return 0;
+	}
 	return -E_INVAL;
 }
 
@@ -117,6 +126,7 @@ static void stdin_device_init(struct device *dev)
 
 	p_rpos = p_wpos = 0;
 	wait_queue_init(wait_queue);
+	poll_head_init(&stdin_poll);
 }
 
 void dev_init_stdin(void)
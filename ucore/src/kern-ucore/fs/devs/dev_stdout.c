@@ -5,6 +5,7 @@
 #include <iobuf.h>
 #include <inode.h>
 #include <unistd.h>
+#include <kio.h>
 #include <error.h>
 #include <assert.h>
 
@@ -25,6 +26,9 @@ static int stdout_io(struct device *dev, struct iobuf *iob, bool write)
 {
 	if (write) {
 		char *data = iob->io_base;
+#ifdef UCONFIG_KLOG
+		klog_flush();
+#endif
 		for (; iob->io_resid != 0; iob->io_resid--) {
 			cons_putc(*data++);
 		}
@@ -0,0 +1,188 @@
+#include <types.h>
+#include <string.h>
+#include <mmu.h>
+#include <slab.h>
+#include <sem.h>
+#include <inode.h>
+#include <dev.h>
+#include <vfs.h>
+#include <iobuf.h>
+#include <iostat.h>
+#include <error.h>
+#include <assert.h>
+#include <blkqueue.h>
+#include <virtio_blk.h>
+
+/*
+ * The virtio disk, "vdisk0:". As disk0 it moves whole blocks, straight to
+ * or from the buffers of the caller when the device can reach them, with
+ * up to VDISK0_MAX_INFLIGHT requests in the virtqueue at once; the others
+ * go through vdisk0_buffer.
+ */
+
+#define VDISK0_BLKSIZE                  PGSIZE
+#define VDISK0_BUFSIZE                  (4 * VDISK0_BLKSIZE)
+#define VDISK0_MAX_XFER                 (16 * VDISK0_BLKSIZE)
+#define VDISK0_MAX_INFLIGHT             8
+
+static char *vdisk0_buffer;
+static semaphore_t vdisk0_sem;
+static struct io_stat vdisk0_stat;
+
+/* under vdisk0_sem */
+static struct iovec vdisk0_iov[VDISK0_MAX_INFLIGHT][BLK_MAX_IOV];
+static struct blk_request vdisk0_reqs[VDISK0_MAX_INFLIGHT];
+
+static void lock_vdisk0(void)
+{
+	down(&(vdisk0_sem));
+}
+
+static void unlock_vdisk0(void)
+{
+	up(&(vdisk0_sem));
+}
+
+static int vdisk0_open(struct device *dev, uint32_t open_flags)
+{
+	return 0;
+}
+
+static int vdisk0_close(struct device *dev)
+{
+	return 0;
+}
+
+/*
+ * Describe in iov the buffers of iob from its position on that one request
+ * moves straight, up to the first that does not hold whole blocks or that
+ * the device cannot reach. Returns their #, the # of bytes they hold is
+ * stored in lenp.
+ */
+static int vdisk0_iov_direct(struct iobuf *iob, struct iovec *iov,
+			     size_t * lenp)
+{
+	size_t len;
+	int i, n = iobuf_iov(iob, iov, virtio_blk_max_iov(), VDISK0_MAX_XFER,
+			     &len);
+	for (i = 0, len = 0; i < n; i++) {
+		if (iov[i].iov_len % VDISK0_BLKSIZE != 0
+		    || !virtio_blk_reachable(iov[i].iov_base, iov[i].iov_len)) {
+			break;
+		}
+		len += iov[i].iov_len;
+	}
+	*lenp = len;
+	return i;
+}
+
+// vdisk0_io_buffer - move the next blocks of iob through vdisk0_buffer
+static int vdisk0_io_buffer(struct iobuf *iob, bool write)
+{
+	uint32_t secno = iob->io_offset / SECTSIZE;
+	size_t copied, alen = VDISK0_BUFSIZE;
+	struct iovec iov;
+	int ret;
+	if (alen > iob->io_resid) {
+		alen = iob->io_resid;
+	}
+	iov.iov_base = vdisk0_buffer, iov.iov_len = alen;
+	if (write) {
+		iobuf_move(iob, vdisk0_buffer, alen, 0, &copied);
+		assert(copied == alen);
+		return virtio_blk_rw(secno, &iov, 1, 1);
+	}
+	if ((ret = virtio_blk_rw(secno, &iov, 1, 0)) == 0) {
+		iobuf_move(iob, vdisk0_buffer, alen, 1, &copied);
+		assert(copied == alen);
+	}
+	return ret;
+}
+
+static int vdisk0_io(struct device *dev, struct iobuf *iob, bool write)
+{
+	off_t offset = iob->io_offset;
+	size_t resid = iob->io_resid;
+	uint32_t blkno = offset / VDISK0_BLKSIZE;
+	uint32_t nblks = resid / VDISK0_BLKSIZE;
+
+	/* don't allow I/O that isn't block-aligned */
+	if ((offset % VDISK0_BLKSIZE) != 0 || (resid % VDISK0_BLKSIZE) != 0) {
+		return -E_INVAL;
+	}
+
+	/* don't allow I/O past the end of vdisk0 */
+	if (blkno + nblks > dev->d_blocks) {
+		return -E_INVAL;
+	}
+
+	int ret = 0;
+	lock_vdisk0();
+	while (ret == 0 && iob->io_resid != 0) {
+		size_t len;
+		int i, n, nreqs;
+		for (nreqs = 0; nreqs < VDISK0_MAX_INFLIGHT; nreqs++) {
+			struct iovec *iov = vdisk0_iov[nreqs];
+			if ((n = vdisk0_iov_direct(iob, iov, &len)) == 0) {
+				break;
+			}
+			blk_request_init(vdisk0_reqs + nreqs,
+					 iob->io_offset / SECTSIZE, iov, n, write);
+			virtio_blk_submit(vdisk0_reqs + nreqs);
+			iobuf_skip(iob, len);
+		}
+		for (i = 0; i < nreqs; i++) {
+			int r = blk_wait(vdisk0_reqs + i);
+			if (ret == 0) {
+				ret = r;
+			}
+		}
+		if (ret == 0 && nreqs == 0) {
+			ret = vdisk0_io_buffer(iob, write);
+		}
+	}
+	unlock_vdisk0();
+	return ret;
+}
+
+static int vdisk0_ioctl(struct device *dev, int op, void *data)
+{
+	return -E_UNIMP;
+}
+
+static void vdisk0_device_init(struct device *dev)
+{
+	memset(dev, 0, sizeof(*dev));
+	static_assert(VDISK0_BLKSIZE % SECTSIZE == 0);
+	dev->d_blocks = virtio_blk_size() / (VDISK0_BLKSIZE / SECTSIZE);
+	dev->d_blocksize = VDISK0_BLKSIZE;
+	dev->d_open = vdisk0_open;
+	dev->d_close = vdisk0_close;
+	dev->d_io = vdisk0_io;
+	dev->d_ioctl = vdisk0_ioctl;
+	iostat_init(&(vdisk0_stat), "vdisk0");
+	dev->d_stat = &(vdisk0_stat);
+	sem_init(&(vdisk0_sem), 1);
+
+	static_assert(VDISK0_BUFSIZE % VDISK0_BLKSIZE == 0);
+	if ((vdisk0_buffer = kmalloc(VDISK0_BUFSIZE)) == NULL) {
+		panic("vdisk0 alloc buffer failed.\n");
+	}
+}
+
+void dev_init_vdisk0(void)
+{
+	if (!virtio_blk_valid()) {
+		return;
+	}
+	struct inode *node;
+	if ((node = dev_create_inode()) == NULL) {
+		panic("vdisk0: dev_create_node.\n");
+	}
+	vdisk0_device_init(vop_info(node, device));
+
+	int ret;
+	if ((ret = vfs_add_dev("vdisk0", node, 1)) != 0) {
+		panic("vdisk0: vfs_add_dev: %e.\n", ret);
+	}
+}
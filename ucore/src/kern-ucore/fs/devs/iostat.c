@@ -0,0 +1,111 @@
+#include <types.h>
+#include <stdio.h>
+#include <string.h>
+#include <list.h>
+#include <spinlock.h>
+#include <timekeeping.h>
+#include <iostat.h>
+
+#define le2iostat(le, member)                       \
+    to_struct((le), struct io_stat, member)
+
+/* all the io_stats, which are never removed */
+static list_entry_t iostat_list = { &iostat_list, &iostat_list };
+
+static spinlock_s iostat_list_lock = { 0 };
+
+// iostat_init - clear stat and list it as name
+void iostat_init(struct io_stat *stat, const char *name)
+{
+	memset(stat, 0, sizeof(struct io_stat));
+	snprintf(stat->name, sizeof(stat->name), "%s", name);
+	spinlock_init(&(stat->lock));
+	bool intr_flag;
+	spin_lock_irqsave(&iostat_list_lock, intr_flag);
+	list_add_before(&iostat_list, &(stat->stat_link));
+	spin_unlock_irqrestore(&iostat_list_lock, intr_flag);
+}
+
+// iostat_begin - an I/O of stat begins; its time is returned, to be passed
+//              - to iostat_dispatch or iostat_done
+uint64_t iostat_begin(struct io_stat *stat)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&(stat->lock), intr_flag);
+	stat->inflight++;
+	spin_unlock_irqrestore(&(stat->lock), intr_flag);
+	return ktime_get_ns();
+}
+
+// iostat_dispatch - an I/O of stat begun at begin leaves the queue, merged
+//                 - into the one before or not; the time of its service
+//                 - begin is returned, to be passed to iostat_done
+uint64_t
+iostat_dispatch(struct io_stat *stat, bool write, uint64_t begin,
+		bool merged)
+{
+	uint64_t now = ktime_get_ns();
+	bool intr_flag;
+	spin_lock_irqsave(&(stat->lock), intr_flag);
+	log2_hist_add(&(stat->queue), now - begin);
+	if (merged) {
+		stat->merges[write ? 1 : 0]++;
+	}
+	spin_unlock_irqrestore(&(stat->lock), intr_flag);
+	return now;
+}
+
+// iostat_done - an I/O of stat moving nsecs sectors, begun or dispatched
+//             - at begin, is done
+void
+iostat_done(struct io_stat *stat, bool write, size_t nsecs, uint64_t begin)
+{
+	uint64_t now = ktime_get_ns();
+	bool intr_flag;
+	spin_lock_irqsave(&(stat->lock), intr_flag);
+	stat->inflight--;
+	stat->ios[write ? 1 : 0]++;
+	stat->sectors[write ? 1 : 0] += nsecs;
+	log2_hist_add(&(stat->service), now - begin);
+	spin_unlock_irqrestore(&(stat->lock), intr_flag);
+}
+
+/*
+ * iostat_show - three lines of each io_stat into buf of size bytes, its
+ * length is returned:
+ *
+ *     <name> <reads> <sectors read> <reads merged> <writes>
+ *         <sectors written> <writes merged> <in flight>
+ *     <name> queue <ns> <the counts of each bucket>
+ *     <name> service <ns> <the counts of each bucket>
+ *
+ * The counts are read without the locks.
+ */
+size_t iostat_show(char *buf, size_t size)
+{
+	char name[32];
+	size_t len = 0;
+	bool intr_flag;
+	spin_lock_irqsave(&iostat_list_lock, intr_flag);
+	list_entry_t *list = &iostat_list, *le = list;
+	while ((le = list_next(le)) != list && len < size) {
+		struct io_stat *stat = le2iostat(le, stat_link);
+		len += snprintf(buf + len, size - len,
+				"%s %llu %llu %llu %llu %llu %llu %d\n",
+				stat->name, stat->ios[0], stat->sectors[0],
+				stat->merges[0], stat->ios[1], stat->sectors[1],
+				stat->merges[1], stat->inflight);
+		if (len < size) {
+			snprintf(name, sizeof(name), "%s queue", stat->name);
+			len += log2_hist_show(&(stat->queue), name, buf + len,
+					      size - len);
+		}
+		if (len < size) {
+			snprintf(name, sizeof(name), "%s service", stat->name);
+			len += log2_hist_show(&(stat->service), name, buf + len,
+					      size - len);
+		}
+	}
+	spin_unlock_irqrestore(&iostat_list_lock, intr_flag);
+	return (len < size) ? len : size;
+}
@@ -0,0 +1,42 @@
+#ifndef __KERN_FS_DEVS_IOSTAT_H__
+#define __KERN_FS_DEVS_IOSTAT_H__
+
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+#include <loghist.h>
+
+/*
+ * The I/O counts of a block device, or of a request queue, or of swapfs.
+ * A device counts each dop_io, from its call to its return, which
+ * includes any wait for the device lock and the copies through its
+ * buffer; a queue counts each request, in the queue from its submit until
+ * the elevator dispatches it, and in service from then until it is
+ * completed, and the requests merged into the transfer of the one before.
+ * So for a filesystem on a queued disk, device time well over queue plus
+ * service time is spent above the disk, and queue time well over service
+ * time waiting behind other requests.
+ *
+ * All are listed by proc:iostat, see iostat_show.
+ */
+struct io_stat {
+	char name[16];
+	list_entry_t stat_link;	/* entry in the list of all */
+	spinlock_s lock;
+	uint64_t ios[2];	/* the reads and writes done */
+	uint64_t sectors[2];	/* the sectors they moved */
+	uint64_t merges[2];	/* those merged into the one before */
+	int inflight;		/* begun and not done yet */
+	struct log2_hist queue;	/* submit to dispatch, of a queue */
+	struct log2_hist service;	/* dispatch, or begin, to done */
+};
+
+void iostat_init(struct io_stat *stat, const char *name);
+uint64_t iostat_begin(struct io_stat *stat);
+uint64_t iostat_dispatch(struct io_stat *stat, bool write, uint64_t begin,
+			 bool merged);
+void iostat_done(struct io_stat *stat, bool write, size_t nsecs,
+		 uint64_t begin);
+size_t iostat_show(char *buf, size_t size);
+
+#endif /* !__KERN_FS_DEVS_IOSTAT_H__ */
@@ -0,0 +1,417 @@
+#include <types.h>
+#include <list.h>
+#include <string.h>
+#include <stdlib.h>
+#include <slab.h>
+#include <sync.h>
+#include <kmutex.h>
+#include <wait.h>
+#include <ipc.h>
+#include <mbox.h>
+#include <poll.h>
+#include <epoll.h>
+#include <vfs.h>
+#include <inode.h>
+#include <stat.h>
+#include <eventpoll.h>
+#include <error.h>
+#include <assert.h>
+
+/*
+ * An epoll object keeps the sources it watches, the epitems, hashed by
+ * source, and a ready list of the ones that may be ready. Each epitem hangs
+ * a poll_entry on the poll_head of its source: the source calls it back as
+ * its state changes and the callback puts the epitem on the ready list and
+ * wakes the waiters. epoll_wait only looks at the ready list, so it costs
+ * the number of ready sources, not of the watched ones.
+ *
+ * The ready list is a hint: epoll_wait asks each source on it what is
+ * really ready before reporting it. A level-triggered epitem goes back on
+ * the list after being reported, and drops out of it once its source says
+ * it is not ready; an EPOLLET one is reported once per callback.
+ */
+
+#define EPOLL_HASH_SHIFT                6
+#define EPOLL_HASH_SIZE                 (1 << EPOLL_HASH_SHIFT)
+#define epoll_hashfn(type, id)                                          \
+    hash32(((uint32_t)(type) << 24) ^ (uint32_t)(id), EPOLL_HASH_SHIFT)
+
+struct eventpoll {
+	/* serializes epoll_ctl and the collecting of epoll_wait */
+	kmutex_t mutex;
+	/* protects ready_list and the ready_link of the epitems, the
+	 * callbacks take it in any context */
+	spinlock_s lock;
+	list_entry_t ready_list;
+	wait_queue_t wait_queue;
+	list_entry_t item_hash[EPOLL_HASH_SIZE];
+};
+
+struct epitem {
+	list_entry_t hash_link;	/* entry in item_hash of ep */
+	list_entry_t ready_link;	/* entry in ready_list of ep, or empty */
+	struct eventpoll *ep;
+	int type, id;		/* the source, EPOLL_SRC_* and fd or mbox id */
+	struct inode *node;	/* the inode of an fd source, referenced */
+	uint32_t events;	/* the interest, with EPOLLET */
+	uintptr_t data;
+	poll_entry_t entry;
+};
+
+#define le2epitem(le, member)           \
+    to_struct((le), struct epitem, member)
+
+#define entry2epitem(entry)             \
+    to_struct((entry), struct epitem, entry)
+
+// epitem_poll - ask the source of item what is ready, and its poll head;
+//             - a source that cannot tell has hung up
+static uint32_t epitem_poll(struct epitem *item, struct poll_query *q)
+{
+	int ret;
+	q->events = 0, q->head = NULL;
+	if (item->type == EPOLL_SRC_MBOX) {
+		ret = ipc_mbox_poll(item->id, q);
+	} else {
+		ret = vop_ioctl(item->node, IOCTL_POLL, q);
+	}
+	return (ret == 0) ? q->events : EPOLLHUP;
+}
+
+static inline uint32_t epitem_mask(struct epitem *item)
+{
+	return (item->events & ~EPOLLET) | EPOLLERR | EPOLLHUP;
+}
+
+// epitem_ready - put item on the ready list and wake a waiter, called
+//              - with ep->lock held
+static void epitem_ready(struct eventpoll *ep, struct epitem *item)
+{
+	if (list_empty(&(item->ready_link))) {
+		list_add_before(&(ep->ready_list), &(item->ready_link));
+		if (!wait_queue_empty(&(ep->wait_queue))) {
+			wakeup_queue(&(ep->wait_queue), WT_EPOLL, 1);
+		}
+	}
+}
+
+static void epitem_notify(poll_entry_t * entry, uint32_t events)
+{
+	struct epitem *item = entry2epitem(entry);
+	struct eventpoll *ep = item->ep;
+	bool intr_flag;
+	if (events & epitem_mask(item)) {
+		spin_lock_irqsave(&ep->lock, intr_flag);
+		epitem_ready(ep, item);
+		spin_unlock_irqrestore(&ep->lock, intr_flag);
+	}
+}
+
+static struct epitem *epitem_lookup(struct eventpoll *ep, int type, int id)
+{
+	list_entry_t *list = ep->item_hash + epoll_hashfn(type, id), *le = list;
+	while ((le = list_next(le)) != list) {
+		struct epitem *item = le2epitem(le, hash_link);
+		if (item->type == type && item->id == id) {
+			return item;
+		}
+	}
+	return NULL;
+}
+
+static void epitem_free(struct eventpoll *ep, struct epitem *item)
+{
+	bool intr_flag;
+	poll_del(&(item->entry));
+	spin_lock_irqsave(&ep->lock, intr_flag);
+	list_del_init(&(item->ready_link));
+	spin_unlock_irqrestore(&ep->lock, intr_flag);
+	list_del(&(item->hash_link));
+	if (item->node != NULL) {
+		vop_ref_dec(item->node);
+	}
+	kfree(item);
+}
+
+static int
+epoll_add(struct eventpoll *ep, int type, int id, struct inode *src,
+	  struct epoll_event *event)
+{
+	struct poll_query q;
+	struct epitem *item;
+	bool intr_flag;
+	if ((item = kmalloc(sizeof(struct epitem))) == NULL) {
+		return -E_NO_MEM;
+	}
+	list_init(&(item->ready_link));
+	item->ep = ep, item->type = type, item->id = id, item->node = src;
+	item->events = event->events, item->data = event->data;
+	epitem_poll(item, &q);
+	if (q.head == NULL) {
+		/* not a source of events */
+		kfree(item);
+		return -E_INVAL;
+	}
+	if (src != NULL) {
+		vop_ref_inc(src);
+	}
+	poll_add(q.head, &(item->entry), epitem_notify);
+	list_add(ep->item_hash + epoll_hashfn(type, id), &(item->hash_link));
+
+	/* the source may have turned ready before the entry was added */
+	if (epitem_poll(item, &q) & epitem_mask(item)) {
+		spin_lock_irqsave(&ep->lock, intr_flag);
+		epitem_ready(ep, item);
+		spin_unlock_irqrestore(&ep->lock, intr_flag);
+	}
+	return 0;
+}
+
+static void
+epoll_mod(struct eventpoll *ep, struct epitem *item, struct epoll_event *event)
+{
+	struct poll_query q;
+	bool intr_flag;
+	item->events = event->events, item->data = event->data;
+	if (epitem_poll(item, &q) & epitem_mask(item)) {
+		spin_lock_irqsave(&ep->lock, intr_flag);
+		epitem_ready(ep, item);
+		spin_unlock_irqrestore(&ep->lock, intr_flag);
+	}
+}
+
+// epoll_collect - report up to maxevents ready sources of ep into events
+static int
+epoll_collect(struct eventpoll *ep, struct epoll_event *events, int maxevents)
+{
+	struct poll_query q;
+	list_entry_t ready, *le;
+	bool intr_flag;
+	int nr = 0;
+
+	list_init(&ready);
+	spin_lock_irqsave(&ep->lock, intr_flag);
+	while ((le = list_next(&(ep->ready_list))) != &(ep->ready_list)) {
+		list_del(le);
+		list_add_before(&ready, le);
+	}
+	spin_unlock_irqrestore(&ep->lock, intr_flag);
+
+	while (nr < maxevents && (le = list_next(&ready)) != &ready) {
+		struct epitem *item = le2epitem(le, ready_link);
+		spin_lock_irqsave(&ep->lock, intr_flag);
+		list_del_init(le);
+		spin_unlock_irqrestore(&ep->lock, intr_flag);
+
+		uint32_t revents = epitem_poll(item, &q) & epitem_mask(item);
+		if (revents == 0) {
+			continue;
+		}
+		events[nr].events = revents, events[nr].data = item->data;
+		nr++;
+		if (!(item->events & EPOLLET)) {
+			spin_lock_irqsave(&ep->lock, intr_flag);
+			epitem_ready(ep, item);
+			spin_unlock_irqrestore(&ep->lock, intr_flag);
+		}
+	}
+
+	/* not looked at, keep them first for the next round */
+	spin_lock_irqsave(&ep->lock, intr_flag);
+	while ((le = list_prev(&ready)) != &ready) {
+		list_del(le);
+		list_add(&(ep->ready_list), le);
+	}
+	spin_unlock_irqrestore(&ep->lock, intr_flag);
+	return nr;
+}
+
+static struct eventpoll *epoll_get(struct inode *node)
+{
+	if (check_inode_type(node, epoll_inode)) {
+		return vop_info(node, epoll_inode)->ep;
+	}
+	return NULL;
+}
+
+int
+epoll_ctl(struct inode *node, int op, int type, int id, struct inode *src,
+	  struct epoll_event *event)
+{
+	struct eventpoll *ep;
+	if ((ep = epoll_get(node)) == NULL || src == node) {
+		return -E_INVAL;
+	}
+	if (type != EPOLL_SRC_FD && type != EPOLL_SRC_MBOX) {
+		return -E_INVAL;
+	}
+	if ((type == EPOLL_SRC_FD) != (src != NULL)) {
+		return -E_INVAL;
+	}
+
+	int ret = 0;
+	kmutex_lock(&(ep->mutex));
+	struct epitem *item = epitem_lookup(ep, type, id);
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		ret = (item != NULL) ? -E_EXISTS :
+		    epoll_add(ep, type, id, src, event);
+		break;
+	case EPOLL_CTL_DEL:
+		if (item == NULL) {
+			ret = -E_NOENT;
+		} else {
+			epitem_free(ep, item);
+		}
+		break;
+	case EPOLL_CTL_MOD:
+		if (item == NULL) {
+			ret = -E_NOENT;
+		} else {
+			epoll_mod(ep, item, event);
+		}
+		break;
+	default:
+		ret = -E_INVAL;
+	}
+	kmutex_unlock(&(ep->mutex));
+	return ret;
+}
+
+// epoll_wait - wait for some of the sources of node to turn ready, timeout
+//            - 0 waits forever
+int
+epoll_wait(struct inode *node, struct epoll_event *events, int maxevents,
+	   unsigned int timeout)
+{
+	struct eventpoll *ep;
+	if ((ep = epoll_get(node)) == NULL || maxevents <= 0) {
+		return -E_INVAL;
+	}
+
+	unsigned long saved_ticks;
+	timer_t __timer, *timer =
+	    ipc_timer_init(timeout, &saved_ticks, &__timer);
+
+	wait_t __wait, *wait = &__wait;
+	bool intr_flag;
+	int nr;
+	while (1) {
+		kmutex_lock(&(ep->mutex));
+		nr = epoll_collect(ep, events, maxevents);
+		kmutex_unlock(&(ep->mutex));
+		if (nr != 0) {
+			return nr;
+		}
+
+		spin_lock_irqsave(&ep->lock, intr_flag);
+		if (!list_empty(&(ep->ready_list))) {
+			spin_unlock_irqrestore(&ep->lock, intr_flag);
+			continue;
+		}
+		wait_current_set(&(ep->wait_queue), wait, WT_EPOLL);
+		ipc_add_timer(timer);
+		spin_unlock_irqrestore(&ep->lock, intr_flag);
+
+		schedule();
+
+		spin_lock_irqsave(&ep->lock, intr_flag);
+		ipc_del_timer(timer);
+		wait_current_del(&(ep->wait_queue), wait);
+		spin_unlock_irqrestore(&ep->lock, intr_flag);
+		if (wait->wakeup_flags != WT_EPOLL) {
+			return ipc_check_timeout(timeout, saved_ticks);
+		}
+	}
+}
+
+static int epoll_inode_close(struct inode *node)
+{
+	return 0;
+}
+
+static int epoll_inode_fstat(struct inode *node, struct stat *stat)
+{
+	int ret;
+	memset(stat, 0, sizeof(struct stat));
+	if ((ret = vop_gettype(node, &(stat->st_mode))) != 0) {
+		return ret;
+	}
+	stat->st_nlinks = 1;
+	return 0;
+}
+
+static int epoll_inode_reclaim(struct inode *node)
+{
+	struct eventpoll *ep = vop_info(node, epoll_inode)->ep;
+	int i;
+	for (i = 0; i < EPOLL_HASH_SIZE; i++) {
+		list_entry_t *list = ep->item_hash + i, *le;
+		while ((le = list_next(list)) != list) {
+			epitem_free(ep, le2epitem(le, hash_link));
+		}
+	}
+	assert(wait_queue_empty(&(ep->wait_queue)));
+	kfree(ep);
+	vop_kill(node);
+	return 0;
+}
+
+static int epoll_inode_gettype(struct inode *node, uint32_t * type_store)
+{
+	*type_store = S_IFCHR;
+	return 0;
+}
+
+static const struct inode_ops epoll_node_ops = {
+	.vop_magic = VOP_MAGIC,
+	.vop_open = NULL_VOP_INVAL,
+	.vop_close = epoll_inode_close,
+	.vop_read = NULL_VOP_INVAL,
+	.vop_write = NULL_VOP_INVAL,
+	.vop_fstat = epoll_inode_fstat,
+	.vop_fsync = NULL_VOP_PASS,
+	.vop_mkdir = NULL_VOP_NOTDIR,
+	.vop_link = NULL_VOP_NOTDIR,
+	.vop_rename = NULL_VOP_NOTDIR,
+	.vop_readlink = NULL_VOP_INVAL,
+	.vop_symlink = NULL_VOP_NOTDIR,
+	.vop_namefile = NULL_VOP_INVAL,
+	.vop_getdirentry = NULL_VOP_INVAL,
+	.vop_reclaim = epoll_inode_reclaim,
+	.vop_ioctl = NULL_VOP_INVAL,
+	.vop_gettype = epoll_inode_gettype,
+	.vop_tryseek = NULL_VOP_INVAL,
+	.vop_truncate = NULL_VOP_INVAL,
+	.vop_create = NULL_VOP_NOTDIR,
+	.vop_unlink = NULL_VOP_NOTDIR,
+	.vop_lookup = NULL_VOP_NOTDIR,
+	.vop_lookup_parent = NULL_VOP_NOTDIR,
+};
+
+// epoll_open - create an empty epoll object, opened once
+int epoll_open(struct inode **node_store)
+{
+	struct eventpoll *ep;
+	struct inode *node;
+	int i;
+	if ((ep = kmalloc(sizeof(struct eventpoll))) == NULL) {
+		return -E_NO_MEM;
+	}
+	if ((node = alloc_inode(epoll_inode)) == NULL) {
+		kfree(ep);
+		return -E_NO_MEM;
+	}
+	kmutex_init(&(ep->mutex));
+	spinlock_init(&ep->lock);
+	list_init(&(ep->ready_list));
+	wait_queue_init(&(ep->wait_queue));
+	for (i = 0; i < EPOLL_HASH_SIZE; i++) {
+		list_init(ep->item_hash + i);
+	}
+	vop_init(node, &epoll_node_ops, NULL);
+	vop_info(node, epoll_inode)->ep = ep;
+	vop_open_inc(node);
+	*node_store = node;
+	return 0;
+}
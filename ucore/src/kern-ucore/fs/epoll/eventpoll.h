@@ -0,0 +1,20 @@
+#ifndef __KERN_FS_EPOLL_EVENTPOLL_H__
+#define __KERN_FS_EPOLL_EVENTPOLL_H__
+
+#include <types.h>
+
+struct inode;
+struct eventpoll;
+struct epoll_event;
+
+struct epoll_inode {
+	struct eventpoll *ep;
+};
+
+int epoll_open(struct inode **node_store);
+int epoll_ctl(struct inode *node, int op, int type, int id,
+	      struct inode *src, struct epoll_event *event);
+int epoll_wait(struct inode *node, struct epoll_event *events, int maxevents,
+	       unsigned int timeout);
+
+#endif /* !__KERN_FS_EPOLL_EVENTPOLL_H__ */
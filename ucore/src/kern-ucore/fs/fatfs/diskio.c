@@ -4,85 +4,267 @@
     
 #include <kio.h>
 #include <fs.h>
-#include <ide.h>
+#include <dev.h>
 #include <inode.h>
+#include <iobuf.h>
+#include <error.h>
+#include <assert.h>
+#include <slab.h>
+#include <string.h>
+#include "fatfs/ff.h"
 #include "fatfs/diskio.h"
     
 #define PRINTFSINFO 1
     
-/*---------------------------------------*/ 
-/* Prototypes for disk control functions */ 
-int assign_drives(int st, int ed)
+/*
+ * The device of each FatFs drive, bound by the ffs mounted on it, see
+ * ffs_do_mount. The sectors go through the d_io of the device: a run of
+ * whole blocks straight from or to the buffer of FatFs, the sectors in
+ * part of a block through the block buffer of the drive, read, patched
+ * and written back for a write. The calls on a drive come one at a time
+ * under the sync object of its volume (_FS_REENTRANT), which is what
+ * keeps the block buffer and the sector cache below to one user.
+ */
+struct ffs_drive {
+	struct device *dev;	/* NULL if no ffs is mounted on the drive */
+	BYTE *block;		/* a block of dev */
+	struct ffs_scache *cache;
+};
+
+static struct ffs_drive ffs_drives[_VOLUMES];
+
+/*
+ * FatFs reads the FAT and the directories a sector at a time through the
+ * window of the volume, so following a cluster chain costs a read for
+ * each FAT sector it crosses, again and again. The single sectors read
+ * are kept in a direct-mapped cache per drive. The writes go through to
+ * the disk and drop the sectors they cover from the cache, so the disk is
+ * always up to date and the reads of many sectors, the data of the files,
+ * bypass the cache. A sector in part of a block brings the rest of its
+ * block in along.
+ */
+#define FFS_SCACHE_SIZE         64	/* a power of 2 */
+#define FFS_SCACHE_EMPTY        0xFFFFFFFF
+
+struct ffs_scache {
+	DWORD sectno[FFS_SCACHE_SIZE];	/* of each slot, or FFS_SCACHE_EMPTY */
+	BYTE data[FFS_SCACHE_SIZE][_MAX_SS];
+};
+
+static struct ffs_scache *ffs_scache_create(void)
 {
-	
+	struct ffs_scache *cache;
+	int i;
+	if ((cache = kmalloc(sizeof(struct ffs_scache))) != NULL) {
+		for (i = 0; i < FFS_SCACHE_SIZE; i++) {
+			cache->sectno[i] = FFS_SCACHE_EMPTY;
+		}
+	}
+	return cache;
+}
+
+#define ffs_scache_slot(sectno)         ((sectno) & (FFS_SCACHE_SIZE - 1))
+
+static void
+ffs_scache_fill(struct ffs_scache *cache, const BYTE * buffer, DWORD sectno)
+{
+	int slot = ffs_scache_slot(sectno);
+	memcpy(cache->data[slot], buffer, _MAX_SS);
+	cache->sectno[slot] = sectno;
+}
+
+// ffs_scache_invalidate - forget the sectors from sectno on, being written
+static void
+ffs_scache_invalidate(struct ffs_scache *cache, DWORD sectno, BYTE count)
+{
+	for (; count > 0; count--, sectno++) {
+		if (cache->sectno[ffs_scache_slot(sectno)] == sectno) {
+			cache->sectno[ffs_scache_slot(sectno)] = FFS_SCACHE_EMPTY;
+		}
+	}
+}
+
+/*---------------------------------------*/
+/* Prototypes for disk control functions */
+
+// ffs_disk_bind - make dev the disk of drive, which has none
+int ffs_disk_bind(BYTE drive, struct device *dev)
+{
+	struct ffs_drive *d = ffs_drives + drive;
 #if PRINTFSINFO
-	    FAT_PRINTF("[FATFS], assign %d to %d\n", st, ed);
-	
-#endif /*  */
-	    return 1;
+	FAT_PRINTF("[FATFS], bind drive%d\n", drive);
+#endif
+	assert(drive < _VOLUMES && d->dev == NULL);
+	if (dev->d_blocksize == 0 || dev->d_blocksize % _MAX_SS != 0) {
+		return -E_INVAL;
+	}
+	if ((d->block = kmalloc(dev->d_blocksize)) == NULL) {
+		return -E_NO_MEM;
+	}
+	d->dev = dev;
+	return 0;
+}
+
+void ffs_disk_unbind(BYTE drive)
+{
+	struct ffs_drive *d = ffs_drives + drive;
+	assert(drive < _VOLUMES && d->dev != NULL);
+	if (d->cache != NULL) {
+		kfree(d->cache);
+		d->cache = NULL;
+	}
+	kfree(d->block);
+	d->block = NULL, d->dev = NULL;
+}
+
+// ffs_disk_io - move count sectors from sectno on between buffer and the
+//             - device of d
+static int
+ffs_disk_io(struct ffs_drive *d, BYTE * buffer, DWORD sectno, UINT count,
+	    bool write)
+{
+	struct device *dev = d->dev;
+	struct iobuf __iob, *iob;
+	UINT nsecs = dev->d_blocksize / _MAX_SS, first, n, i;
+	int ret;
+	while (count > 0) {
+		DWORD blkno = sectno / nsecs;
+		if ((first = sectno % nsecs) == 0 && count >= nsecs) {
+			n = count - count % nsecs;
+			iob = iobuf_init(&__iob, buffer, n * _MAX_SS,
+					 blkno * dev->d_blocksize);
+			if ((ret = dop_io(dev, iob, write)) != 0) {
+				return ret;
+			}
+		} else {
+			if ((n = nsecs - first) > count) {
+				n = count;
+			}
+			iob = iobuf_init(&__iob, d->block, dev->d_blocksize,
+					 blkno * dev->d_blocksize);
+			if ((ret = dop_io(dev, iob, 0)) != 0) {
+				return ret;
+			}
+			if (write) {
+				memcpy(d->block + first * _MAX_SS, buffer,
+				       n * _MAX_SS);
+				iob = iobuf_init(&__iob, d->block,
+						 dev->d_blocksize,
+						 blkno * dev->d_blocksize);
+				if ((ret = dop_io(dev, iob, 1)) != 0) {
+					return ret;
+				}
+			} else {
+				memcpy(buffer, d->block + first * _MAX_SS,
+				       n * _MAX_SS);
+			}
+			/* the rest of the block comes for free */
+			for (i = 0; d->cache != NULL && i < nsecs; i++) {
+				ffs_scache_fill(d->cache,
+						d->block + i * _MAX_SS,
+						blkno * nsecs + i);
+			}
+		}
+		buffer += n * _MAX_SS, sectno += n, count -= n;
+	}
+	return 0;
 }
 
 DSTATUS disk_initialize(BYTE drive)
 {
-	
 #if PRINTFSINFO
-	    FAT_PRINTF("[FATFS], disk_init on drive%d\n", drive);
-	
-#endif /*  */
-	    return 0;
+	FAT_PRINTF("[FATFS], disk_init on drive%d\n", drive);
+#endif
+	DSTATUS status;
+	if ((status = disk_status(drive)) == 0
+	    && ffs_drives[drive].cache == NULL) {
+		/* without one the sectors are read each time */
+		ffs_drives[drive].cache = ffs_scache_create();
+	}
+	return status;
 }
 
- DSTATUS disk_status(BYTE drive)
+DSTATUS disk_status(BYTE drive)
 {
-	
-	    //FAT_PRINTF("[FATFS], disk_status on drive%d\n", drive);
-	    return 0;
-}
-
- DRESULT disk_read(BYTE drive, BYTE * buffer, DWORD sectorNumber,
-		     BYTE sectorCount)
-{
-	
-	    //FAT_PRINTF("[FATFS], disk_read on drive%d\n", drive);
-	    //from dev_diso0.c read_blks
-	int ret;
-	
-//  kprintf("disk_read ## %d\n", drive);
-	    if ((ret =
-		 ide_read_secs(MMC0_DEV_NO, sectorNumber, buffer,
-			       sectorCount)) != 0) {
-		panic
-		    ("fat: read blkno = %d (sectno = %d), nblks = %d (nsecs = %d): 0x%08x.\n",
-		     -1, sectorNumber, 0, sectorCount, ret);
+	if (drive >= _VOLUMES || ffs_drives[drive].dev == NULL) {
+		return STA_NOINIT | STA_NODISK;
 	}
 	return 0;
 }
 
+DRESULT disk_read(BYTE drive, BYTE * buffer, DWORD sectorNumber,
+		  BYTE sectorCount)
+{
+	struct ffs_scache *cache;
+	int ret;
+	if (disk_status(drive) != 0) {
+		return RES_NOTRDY;
+	}
+	cache = ffs_drives[drive].cache;
+	if (cache != NULL && sectorCount == 1
+	    && cache->sectno[ffs_scache_slot(sectorNumber)] == sectorNumber) {
+		memcpy(buffer, cache->data[ffs_scache_slot(sectorNumber)],
+		       _MAX_SS);
+		return RES_OK;
+	}
+	if ((ret = ffs_disk_io(ffs_drives + drive, buffer, sectorNumber,
+			       sectorCount, 0)) != 0) {
+		warn("fat: read sectno = %d, nsecs = %d: %e.\n",
+		     sectorNumber, sectorCount, ret);
+		return RES_ERROR;
+	}
+	return RES_OK;
+}
 
 #if	_READONLY == 0
-    DRESULT disk_write(BYTE drive, const BYTE * buffer, DWORD sectorNumber,
-		       BYTE sectorCount)
+DRESULT disk_write(BYTE drive, const BYTE * buffer, DWORD sectorNumber,
+		   BYTE sectorCount)
 {
-	
-	    //FAT_PRINTF("[FATFS], disk_write on drive%d\n", drive);
+	struct ffs_scache *cache;
 	int ret;
-	if ((ret =
-	      ide_write_secs(MMC0_DEV_NO, sectorNumber, buffer,
-			     sectorCount)) != 0) {
-		panic
-		    ("fat: write blkno = %d (sectno = %d), nblks = %d (nsecs = %d): 0x%08x.\n",
-		     -1, sectorNumber, 0, sectorCount, ret);
+	if (disk_status(drive) != 0) {
+		return RES_NOTRDY;
 	}
-	return 0;
-}
-
+	if ((cache = ffs_drives[drive].cache) != NULL) {
+		/* first, a failed write leaves the sectors unknown */
+		ffs_scache_invalidate(cache, sectorNumber, sectorCount);
+	}
+	if ((ret = ffs_disk_io(ffs_drives + drive, (BYTE *) buffer,
+			       sectorNumber, sectorCount, 1)) != 0) {
+		warn("fat: write sectno = %d, nsecs = %d: %e.\n",
+		     sectorNumber, sectorCount, ret);
+		return RES_ERROR;
+	}
+	return RES_OK;
+}
+#endif
 
-#endif /*  */
-    DRESULT disk_ioctl(BYTE drive, BYTE command, void *buffer)
-{
-	
-	    //FAT_PRINTF("[FATFS], disk_ioctl on drive%d, command = %d\n", drive, command);
-	    return 0;
+/*
+ * The writes go through to the device at once, so there is nothing to
+ * sync. GET_BLOCK_SIZE is the erase unit of the device in sectors, which
+ * f_mkfs aligns the data area to, 1 if it is not known.
+ */
+DRESULT disk_ioctl(BYTE drive, BYTE command, void *buffer)
+{
+	struct device *dev;
+	//FAT_PRINTF("[FATFS], disk_ioctl on drive%d, command = %d\n", drive, command);
+	if (disk_status(drive) != 0) {
+		return RES_NOTRDY;
+	}
+	dev = ffs_drives[drive].dev;
+	switch (command) {
+	case CTRL_SYNC:
+		return RES_OK;
+	case GET_SECTOR_COUNT:
+		*(DWORD *) buffer = dev->d_blocks * (dev->d_blocksize / _MAX_SS);
+		return RES_OK;
+	case GET_SECTOR_SIZE:
+		*(WORD *) buffer = _MAX_SS;
+		return RES_OK;
+	case GET_BLOCK_SIZE:
+		*(DWORD *) buffer = (dev->d_erasesize >= _MAX_SS) ?
+		    dev->d_erasesize / _MAX_SS : 1;
+		return RES_OK;
+	}
+	return RES_PARERR;
 }
-
-   
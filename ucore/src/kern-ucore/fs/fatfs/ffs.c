@@ -1,6 +1,9 @@
 #include <types.h>
 #include <error.h>
 #include <assert.h>
+#include <slab.h>
+#include <sem.h>
+#include <vfs.h>
 #include "fatfs/ffconf.h"
 #include "ffs.h"
 
@@ -17,6 +20,9 @@ DWORD get_fattime(void)
 void ffs_init()
 {
 	int ret;
+	if ((ret = register_filesystem("fat", ffs_mount)) != 0) {
+		panic("failed: ffs: register_filesystem: %e.\n", ret);
+	}
 	if ((ret = ffs_mount("mmc0")) != 0) {
 		panic("failed: ffs: ffs_mount: %e.\n", ret);
 	}
@@ -24,25 +30,39 @@ void ffs_init()
 
 #if _FS_REENTRANT
 
-bool ff_cre_syncobj(BYTE _vol, _SYNC_t * sobj)
+/*
+ * The sync object of a volume is a semaphore: the FatFs calls on one
+ * volume go one at a time, those on different volumes side by side.
+ * _FS_TIMEOUT is not used, a call waits for the grant as long as it takes.
+ */
+int ff_cre_syncobj(BYTE vol, _SYNC_t * sobj)
 {
-	bool ret = false;
-	return ret;
+	semaphore_t *sem;
+	if ((sem = kmalloc(sizeof(semaphore_t))) == NULL) {
+		return 0;
+	}
+	sem_init(sem, 1);
+	*sobj = sem;
+	return 1;
 }
 
-bool ff_del_syncobj(_SYNC_t sobj)
+int ff_del_syncobj(_SYNC_t sobj)
 {
-	bool ret = false;
-	return ret;
+	kfree(sobj);
+	return 1;
 }
 
-bool ff_req_grant(_SYNC_t sobj)
+int ff_req_grant(_SYNC_t sobj)
 {
-	bool ret = false;
-	return ret;
+	down((semaphore_t *) sobj);
+	return 1;
 }
 
 void ff_rel_grant(_SYNC_t sobj)
+{
+	up((semaphore_t *) sobj);
+}
+
 #endif
 #if _USE_LFN == 3
 void *ff_memalloc(UINT size)
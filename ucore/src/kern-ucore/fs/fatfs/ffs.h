@@ -5,6 +5,7 @@
 #include <mmu.h>
 #include <list.h>
 #include <sem.h>
+#include <rhash.h>
 #include <unistd.h>
 #include "fatfs/ff.h"
 
@@ -17,6 +18,7 @@
 #define FFS_BLKN_SUPER      0	/* block the superblock lives in */
 #define FFS_BLKN_ROOT       1	/* location of the root dir inode */
 #define FFS_BLKN_FREEMAP    2	/* 1st block of the freemap */
+#define FFS_CLMT_ITEMS      64	/* the DWORDs of a cluster link map at first */
 
 /* # of bits in a block */
 #define FFS_BLKBITS                                 (FFS_BLKSIZE * CHAR_BIT)
@@ -65,15 +67,17 @@ struct ffs_disk_entry {
 /* inode for ffs */
 struct ffs_inode {
 	struct ffs_disk_inode *din;	/* on-disk inode */
-	uint32_t hashno;	/* hash number */
+	uint32_t hashno;	/* hash of path */
 	TCHAR *path;		/* absolute path */
 	struct ffs_inode *parent;	/* parent inode */
 	bool dirty;		/* true if inode modified */
 	int reclaim_count;	/* kill inode if it hits zero */
 	semaphore_t sem;	/* semaphore for din */
 	//list_entry_t inode_link;                        /* entry for linked-list in ffs_fs */
-	//list_entry_t hash_link;                         /* entry for hash linked-list in ffs_fs */
+	struct rhash_node hash_link;	/* in path_hash of ffs_fs */
 	struct ffs_inode_list *inode_link;	/* entry for linked-list in ffs_fs */
+	DWORD *clmt;		/* cluster link map of the open file, see ffs_clmt_attach */
+	DWORD clmt_items;	/* # of DWORDs clmt holds */
 };
 
 struct ffs_inode_list {
@@ -91,12 +95,21 @@ struct ffs_fs {
 	struct device *dev;
 	bool super_dirty;
 	struct ffs_inode_list *inode_list;
+	struct rhash path_hash;	/* the inodes by path */
 	uint32_t inocnt;
 	FATFS *fatfs;
+	BYTE vol;		/* the FatFs drive it is mounted on */
+	TCHAR root_path[4];	/* "N:/" of drive N, all paths carry "N:" */
 };
 
-#define FFS_HLIST_SHIFT	10
-#define FFS_HLIST_SIZE	(1 << FFS_HLIST_SHIFT)
+/* the paths of ffs begin with the drive of the volume, "N:" */
+#define ffs_path_has_drive(path)                    \
+	((path)[0] >= '0' && (path)[0] <= '9' && (path)[1] == ':')
+#define ffs_path_is_root(path)                      \
+	(ffs_path_has_drive(path) && (path)[2] == '/' && (path)[3] == '\0')
+
+/* the size path_hash starts with, it grows with the inodes */
+#define FFS_HLIST_SHIFT	6
 
 struct fs;
 struct inode;
@@ -121,6 +134,9 @@ int ffs_sync_super(struct ffs_fs *ffs);
 int ffs_sync_freemap(struct ffs_fs *ffs);
 int ffs_clear_block(struct ffs_fs *ffs, uint32_t blkno, uint32_t nblks);
 
+int ffs_disk_bind(BYTE drive, struct device *dev);
+void ffs_disk_unbind(BYTE drive);
+
 int ffs_load_inode(struct ffs_fs *ffs, struct inode **node_store, TCHAR * path,
 		   struct ffs_inode *parent);
 
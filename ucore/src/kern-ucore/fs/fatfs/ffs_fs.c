@@ -13,6 +13,13 @@
 #include "ffs.h"
 #include "fatfs/ff.h"
 
+/*
+ * The ffs mounted on each FatFs drive. A mount takes the first drive free
+ * and binds its device to it, so that each device is a volume of its own;
+ * vfs_mount and vfs_unmount are serialized by the vdev list lock.
+ */
+static struct ffs_fs *ffs_volumes[_VOLUMES];
+
 /* 
  * flush all dirty buffers to disk
  * return 0 if sync successful
@@ -37,7 +44,8 @@ static struct inode *ffs_get_root(struct fs *fs)
 {
 	struct inode *node;
 	int ret;
-	if ((ret = ffs_load_inode(fsop_info(fs, ffs), &node, "0:/", NULL)) != 0) {
+	struct ffs_fs *ffs = fsop_info(fs, ffs);
+	if ((ret = ffs_load_inode(ffs, &node, ffs->root_path, NULL)) != 0) {
 		panic("load ffs root failed: %e", ret);
 	}
 
@@ -53,8 +61,12 @@ static int ffs_unmount(struct fs *fs)
 	if (ffs->inode_list->next != NULL) {
 		return -E_BUSY;
 	}
+	f_mount(ffs->vol, NULL);
+	ffs_disk_unbind(ffs->vol);
+	ffs_volumes[ffs->vol] = NULL;
 	kfree(ffs->fatfs);
 	kfree(ffs->inode_list);
+	rhash_destroy(&(ffs->path_hash));
 	kfree(ffs);
 
 	return 0;
@@ -95,13 +107,34 @@ static int ffs_do_mount(struct device *dev, struct fs **fs_store)
 	}
 	struct ffs_fs *ffs = fsop_info(fs, ffs);
 
+	int vol, ret = -E_NO_MEM;
+	for (vol = 0; vol < _VOLUMES; vol++) {
+		if (ffs_volumes[vol] == NULL) {
+			break;
+		}
+	}
+	if (vol == _VOLUMES) {
+		ret = -E_BUSY;
+		goto failed_cleanup_fs;
+	}
+
 	FRESULT result;
-	struct FATFS *fatfs = kmalloc(FFS_BLKSIZE);
-	if ((result = f_mount(0, fatfs)) != FR_OK) {
+	struct FATFS *fatfs;
+	if ((fatfs = kmalloc(sizeof(struct FATFS))) == NULL) {
+		goto failed_cleanup_fs;
+	}
+	if ((ret = ffs_disk_bind(vol, dev)) != 0) {
+		goto failed_cleanup_fatfs;
+	}
+	if ((result = f_mount(vol, fatfs)) != FR_OK) {
 		FAT_PRINTF("[ffs_do_mount], failed = %d\n", result);
-		goto failed_cleanup_ffs;
+		ret = -E_NO_MEM;
+		goto failed_cleanup_disk;
 	}
 	ffs->fatfs = fatfs;
+	ffs->dev = dev;
+	ffs->vol = vol;
+	snprintf(ffs->root_path, sizeof(ffs->root_path), "%d:/", vol);
 
 	/***********************/
 	/* read dir test */
@@ -153,23 +186,35 @@ static int ffs_do_mount(struct device *dev, struct fs **fs_store)
 	/* alloc and initialize inode_list */
 	struct ffs_inode_list *head;
 	if ((ffs->inode_list = head = kmalloc(FFS_BLKSIZE)) == NULL) {
-		goto failed_cleanup_ffs;
+		ret = -E_NO_MEM;
+		goto failed_cleanup_mount;
 	}
 	ffs->inode_list->next = ffs->inode_list->prev = NULL;
 	ffs->inocnt = 0;
+	if (rhash_init(&(ffs->path_hash), FFS_HLIST_SHIFT, 0) != 0) {
+		kfree(ffs->inode_list);
+		ret = -E_NO_MEM;
+		goto failed_cleanup_mount;
+	}
 
 	FAT_PRINTF("ffs_do_mount done\n");
 	fs->fs_sync = ffs_sync;
 	fs->fs_get_root = ffs_get_root;
 	fs->fs_unmount = ffs_unmount;
 	fs->fs_cleanup = ffs_cleanup;
+	ffs_volumes[vol] = ffs;
 	*fs_store = fs;
 	return 0;
 
-failed_cleanup_ffs:
+failed_cleanup_mount:
+	f_mount(vol, NULL);
+failed_cleanup_disk:
+	ffs_disk_unbind(vol);
+failed_cleanup_fatfs:
 	kfree(fatfs);
+failed_cleanup_fs:
 	kfree(fs);
-	return -E_NO_MEM;
+	return ret;
 }
 
 int ffs_mount(const char *devname)
@@ -32,60 +32,63 @@ static const struct inode_ops *ffs_get_ops(uint16_t type)
 	panic("invalid file type %d.\n", type);
 }
 
-static uint32_t hashstr(char *name)
+/* *
+ *  hash:   compute a hash value of an absolute path, of all of it: the
+ *          paths of a directory share their first bytes.
+ *  @path:  the absolute path to be computed the hash value.
+ */
+static uint32_t hash(TCHAR * path)
 {
 	uint32_t hash = 47;
-	int i;
-	for (i = 0; i < 8 && name[i] != '\0'; ++i) {
-		hash = hash * 31 + name[i];
+	for (; *path != '\0'; path++) {
+		hash = hash * 31 + *path;
 	}
 	return hash;
 }
 
+static bool ffs_path_match(struct rhash_node *node, void *key)
+{
+	return strcmp(le2fin(node, hash_link)->path, (char *)key) == 0;
+}
+
 /* *
- *  hash:   compute a hash value of an absolute path.
- *  @path:  the absolute path to be computed the hash value.
+ *  ffs_lookup_path:    the ffs_inode of the absolute path in path_hash.
  */
-static uint32_t hash(TCHAR * path)
+static struct ffs_inode *ffs_lookup_path(struct ffs_fs *ffs, char *path,
+					 uint32_t hashno)
 {
-	return hash32(hashstr(path), FFS_HLIST_SHIFT);
+	struct rhash_node *node;
+	if ((node = rhash_lookup(&(ffs->path_hash), hashno, ffs_path_match,
+				 path)) != NULL) {
+		return le2fin(node, hash_link);
+	}
+	return NULL;
 }
 
 /* *
  *  getAbsolutePath:    compute absolute path according to father inode and relative path.
- *  @fin:   the father inode.
- *  @path:  the relative path according to fin.
+ *  @fin:   the father inode, NULL for the root.
+ *  @path:  the relative path according to fin, or an absolute one.
+ *  The paths all begin with the drive of the volume, so that FatFs never
+ *  takes the current drive, one for all volumes.
  */
 static char *getAbsolutePath(struct ffs_inode *fin, char *path)
 {
 #if PRINTFSINFO
 	FAT_PRINTF("[getAbsolutePath]\n");
 #endif
-	int len = strlen(path);
-	struct ffs_inode *_fin = fin;
-	if (_fin != NULL && strcmp("0:/", _fin->path)) {
-		len += strlen(_fin->path);
-		/* for '/' in path */
-		++len;
-		_fin = _fin->parent;
-	}
-	char *ret = kmalloc(sizeof(char) * (len + 1));
-	len -= strlen(path);
-	_fin = fin;
-	char *p;
-	strcpy(ret + len, path);
-	int tlen, i;
-	if (_fin != NULL && strcmp("0:/", _fin->path)) {
-		p = _fin->path;
-		tlen = strlen(_fin->path);
-		len = len - tlen - 1;
-		assert(len >= 0);
-		for (i = 0; i < tlen; ++i) {
-			*(ret + len + i) = *(p + i);
-		}
-		*(ret + len + tlen) = '/';
-		_fin = _fin->parent;
-	}
+	int len = strlen(path), plen = 0;
+	char *ret;
+	if (fin != NULL && !ffs_path_has_drive(path)) {
+		/* "N:" alone of the root, then the path of fin and a '/' */
+		plen = ffs_path_is_root(fin->path) ? 2 : strlen(fin->path) + 1;
+	}
+	ret = kmalloc(sizeof(char) * (plen + len + 1));
+	if (plen != 0) {
+		memcpy(ret, fin->path, plen);
+		ret[plen - 1] = (plen == 2) ? ':' : '/';
+	}
+	strcpy(ret + plen, path);
 #if PRINTFSINFO
 	FAT_PRINTF("[getAbsolutePath] path = %s\n", ret);
 #endif
@@ -156,7 +159,7 @@ ffs_lookup_once(struct ffs_fs *ffs, struct ffs_inode *fin, TCHAR * name,
 	}
 	if (!strcmp(name, "..")) {
 		ret = 0;
-		if (fin->parent == NULL || !strcmp("0:/", fin->path)) {
+		if (fin->parent == NULL || ffs_path_is_root(fin->path)) {
 			/* if it's root */
 			*node_store = info2node(fin, ffs_inode);
 			vop_ref_inc(*node_store);
@@ -178,7 +181,7 @@ label_out:
 	return ret;
 }
 
-/*  lookup_ffs_nolock:  search if there's an inode in ffs->inode_list according
+/*  lookup_ffs_nolock:  search if there's an inode in ffs->path_hash according
  *                      whose information same as path.
  *  @ffs:   the fat32 file system.
  *  @path:  the absolute path to match.
@@ -194,26 +197,22 @@ static struct inode *lookup_ffs_nolock(struct ffs_fs *ffs, TCHAR * path,
 #if PRINTFSINFO
 	FAT_PRINTF("[lookup_ffs_nolock] path = %s\n", path);
 #endif
-	struct inode *node;
-	uint32_t hashValue = hash(path);
-	struct ffs_inode_list *head = ffs->inode_list;
-	while (head->next != NULL) {
-		head = head->next;
-		struct ffs_inode *fin = head->f_inode;
-		if (fin->hashno == hashValue && !strcmp(fin->path, path)) {
+	struct inode *node = NULL;
+	char *absPath = getAbsolutePath(parent, path);
+	struct ffs_inode *fin;
+	if ((fin = ffs_lookup_path(ffs, absPath, hash(absPath))) != NULL) {
 #if PRINTFSINFO
-			FAT_PRINTF
-			    ("[lookup_ffs_nolock] find defined node, path = %s, value = %d\n",
-			     path, hashValue);
+		FAT_PRINTF
+		    ("[lookup_ffs_nolock] find defined node, path = %s, value = %d\n",
+		     absPath, fin->hashno);
 #endif
-			node = info2node(fin, ffs_inode);
-			if (vop_ref_inc(node) == 1) {
-				fin->reclaim_count++;
-			}
-			return node;
+		node = info2node(fin, ffs_inode);
+		if (vop_ref_inc(node) == 1) {
+			fin->reclaim_count++;
 		}
 	}
-	return NULL;
+	kfree(absPath);
+	return node;
 }
 
 /* ffs_create_inode:    create a new ffs_inode according to path and store it into node_store.
@@ -239,6 +238,8 @@ ffs_create_inode(struct ffs_fs *ffs, struct ffs_disk_inode *din,
 		fin->path = absPath;
 		fin->hashno = hash(absPath);
 		fin->parent = parent;
+		fin->clmt = NULL;
+		fin->clmt_items = 0;
 		vop_ref_inc(node);
 		*node_store = node;
 		return 0;
@@ -265,6 +266,7 @@ static void ffs_set_links(struct ffs_fs *ffs, struct ffs_inode *fin)
 	newEntry->next = NULL;
 	head->next = newEntry;
 	fin->inode_link = newEntry;
+	rhash_add(&(ffs->path_hash), &(fin->hash_link), fin->hashno);
 	++ffs->inocnt;
 }
 
@@ -281,6 +283,7 @@ static void ffs_remove_links(struct ffs_fs *ffs, struct ffs_inode *fin)
 	if (next != NULL)
 		next->prev = prev;
 	kfree(fin->inode_link);
+	rhash_del(&(ffs->path_hash), &(fin->hash_link));
 	//kfree(fin->path);
 	//kfree(fin);
 	--ffs->inocnt;
@@ -317,25 +320,15 @@ ffs_load_inode(struct ffs_fs *ffs, struct inode **node_store, TCHAR * path,
 	struct FILINFO fno;
 	FRESULT result;
 
-	if (strcmp(path, "0:/")) {
+	char *absPath = getAbsolutePath(parent, path);
+	if (!ffs_path_is_root(absPath)) {
 		/* if not root inode */
-		char *actualPath = NULL;
-		char *absPath;
-		/* chrinstr */
-		if (strchr(path, '/')) {
-			actualPath = path;
-		} else {
-			absPath = getAbsolutePath(parent, path);
-			actualPath = absPath;
-		}
-
-		if ((result = f_stat(actualPath, &fno)) != FR_OK) {
+		if ((result = f_stat(absPath, &fno)) != FR_OK) {
 			FAT_PRINTF
 			    ("[ffs_load_inode] get stat failed, f_stat %s %d\n",
 			     absPath, result);
 			kfree(absPath);
 			goto failed_cleanup_din;
-			return ret;
 		} else {
 #if PRINTFSINFO
 			FAT_PRINTF
@@ -343,7 +336,6 @@ ffs_load_inode(struct ffs_fs *ffs, struct inode **node_store, TCHAR * path,
 			     absPath);
 #endif
 		}
-		kfree(absPath);
 
 		/* decide the type */
 		if (!(fno.fattrib & AM_DIR)) {
@@ -362,6 +354,7 @@ ffs_load_inode(struct ffs_fs *ffs, struct inode **node_store, TCHAR * path,
 		/* root inode */
 		din->type = FFS_TYPE_DIR;
 	}
+	kfree(absPath);
 	if (ffs_create_inode(ffs, din, path, &node, parent) != 0) {
 		ret = -E_NO_MEM;
 		goto failed_cleanup_din;
@@ -401,6 +394,47 @@ static int ffs_opendir(struct inode *node, uint32_t open_flags)
 
 }
 
+/*
+ *  ffs_clmt_attach:    let the file of fin seek by a cluster link map.
+ *  Without one, FatFs follows the cluster chain through the FAT from the
+ *  top of the file at every seek backwards, so a seek costs O(file size).
+ *  The map holds the fragments of the chain, (length, first cluster) each.
+ *  It is made at the open of a file for reading only, as FatFs can't grow
+ *  a file accessed through a map.
+ */
+static void ffs_clmt_attach(struct ffs_inode *fin)
+{
+	FIL *fp = fin->din->entity.file;
+	DWORD items = FFS_CLMT_ITEMS;
+	FRESULT result;
+	if (fp->cltbl != NULL || fp->sclust == 0) {
+		return;
+	}
+	while (1) {
+		if (fin->clmt_items < items) {
+			DWORD *clmt;
+			if ((clmt = kmalloc(items * sizeof(DWORD))) == NULL) {
+				return;
+			}
+			if (fin->clmt != NULL) {
+				kfree(fin->clmt);
+			}
+			fin->clmt = clmt, fin->clmt_items = items;
+		}
+		fin->clmt[0] = fin->clmt_items;
+		fp->cltbl = fin->clmt;
+		if ((result = f_lseek(fp, CREATE_LINKMAP)) == FR_OK) {
+			return;
+		}
+		fp->cltbl = NULL;
+		if (result != FR_NOT_ENOUGH_CORE) {
+			return;
+		}
+		/* too fragmented, the map needs that many */
+		items = fin->clmt[0];
+	}
+}
+
 /*  ffs_openfile:   open file according to open_flags and
  *  store the information into node.
  *  @node:  the corresponding file to be opened.
@@ -440,6 +474,9 @@ static int ffs_openfile(struct inode *node, uint32_t open_flags)
 		return -E_INVAL;
 	}
 	fin->din->size = fin->din->entity.file->fsize;
+	if (mode == FA_READ) {
+		ffs_clmt_attach(fin);
+	}
 #if PRINTFSINFO
 	FAT_PRINTF("[ffs_openfile], open %s success, mode = %d\n", fin->path,
 		   mode);
@@ -464,6 +501,11 @@ static int ffs_close(struct inode *node)
 	}
 	kfree(fin->din->entity.file);
 	fin->din->entity.file = NULL;
+	if (fin->clmt != NULL) {
+		kfree(fin->clmt);
+		fin->clmt = NULL;
+		fin->clmt_items = 0;
+	}
 	return vop_fsync(node);
 }
 
@@ -484,72 +526,85 @@ static int ffs_closedir(struct inode *node)
 }
 
 /*
- *  ffs_read:   read data in file and store it in iob.
- *  @node:  the file to be read.
- *  @iob:   io buffer to store the data.
- *  we use io_len stands for the bytes want to read and rc stands for the bytes actually read.
- *  after the read operation, io_base += rc, io_offset += rc, io_resid -= rc.
+ *  ffs_seek:   move the file pointer of fp to offset.
+ *  FatFs keeps the position of the last transfer in fp->fptr, so a
+ *  sequential read or write skips f_lseek, which walks the cluster chain.
  */
-static int ffs_read(struct inode *node, struct iobuf *iob)
+static FRESULT ffs_seek(FIL * fp, off_t offset)
+{
+	if (f_tell(fp) == offset) {
+		return FR_OK;
+	}
+	return f_lseek(fp, offset);
+}
+
+/*
+ *  ffs_rw:     read data in file into iob, or write the data of iob into it.
+ *  @node:  the file.
+ *  @iob:   io buffer, its segments are handed to FatFs as they are, whose
+ *          whole sectors go straight between the disk and them.
+ *  after the operation, io_base, io_offset and io_resid move by the bytes
+ *  transferred.
+ */
+static int ffs_rw(struct inode *node, struct iobuf *iob, bool write)
 {
-#if PRINTFSINFO
-	FAT_PRINTF("[ffs_read]\n");
-#endif
 	struct ffs_inode *fin = vop_info(node, ffs_inode);
+	FIL *fp = fin->din->entity.file;
 	FRESULT result;
 
 #if PRINTFSINFO
-	FAT_PRINTF("[ffs_read], io_offset = %d, io_len = %d, io_resid = %d\n",
-		   iob->io_offset, iob->io_len, iob->io_resid);
+	FAT_PRINTF("[ffs_rw], io_offset = %d, io_resid = %d, write = %d\n",
+		   iob->io_offset, iob->io_resid, write);
 #endif
-	UINT rc = 0;
-	BYTE buf[iob->io_len + 10];
-	FIL *temp = fin->din->entity.file;
-	/* move the start point to offset */
-	f_lseek(temp, iob->io_offset);
-	if ((result = f_read(temp, buf, iob->io_len, &rc)) != FR_OK) {
-		FAT_PRINTF("[ffs_read], f_read failed, result = %d\n", result);
-	} else {
-		int i;
-		assert(iob->io_len >= rc);
-		for (i = 0; i < rc; ++i) {
-			*((BYTE *) (iob->io_base)) = buf[i];
-			iob->io_base = ((BYTE *) (iob->io_base)) + 1;
+	if ((result = ffs_seek(fp, iob->io_offset)) != FR_OK) {
+		FAT_PRINTF("[ffs_rw], f_lseek failed, result = %d\n", result);
+		return -E_BUSY;
+	}
+	while (iob->io_resid != 0) {
+		UINT len = iobuf_seg(iob), rc = 0;
+		if (write) {
+			result = f_write(fp, iob->io_base, len, &rc);
+		} else {
+			result = f_read(fp, iob->io_base, len, &rc);
+		}
+		if (result != FR_OK) {
+			FAT_PRINTF("[ffs_rw], failed, result = %d\n", result);
+			return -E_BUSY;
+		}
+		assert(len >= rc);
+		iobuf_skip(iob, rc);
+		/* the end of the file, or of the disk */
+		if (rc < len) {
+			break;
 		}
-		iob->io_offset += rc;
-		iob->io_resid -= rc;
 	}
-
 	return 0;
 }
 
 /*
- *  ffs_read:   write data in iob into file.
+ *  ffs_read:   read data in file and store it in iob.
+ *  @node:  the file to be read.
+ *  @iob:   io buffer to store the data.
+ */
+static int ffs_read(struct inode *node, struct iobuf *iob)
+{
+#if PRINTFSINFO
+	FAT_PRINTF("[ffs_read]\n");
+#endif
+	return ffs_rw(node, iob, 0);
+}
+
+/*
+ *  ffs_write:  write data in iob into file.
  *  @node:  the file to be write.
  *  @iob:   io buffer where get the data.
- *  we use io_len stands for the bytes want to write and rc stands for the bytes actually write.
- *  after the write operation, io_base += rc, io_offset += rc, io_resid -= rc.
  */
 static int ffs_write(struct inode *node, struct iobuf *iob)
 {
 #if PRINTFSINFO
 	FAT_PRINTF("[ffs_write]\n");
 #endif
-	int ret = -E_BUSY;
-	UINT rc = 0;
-	struct ffs_inode *fin = vop_info(node, ffs_inode);
-	FIL *temp = fin->din->entity.file;
-	/* move the start point to offset */
-	f_lseek(temp, iob->io_offset);
-	if ((ret = f_write(temp, iob->io_base, iob->io_len, &rc)) != FR_OK) {
-		FAT_PRINTF("[ffs_write] result = %d\n", ret);
-		return -E_BUSY;
-	}
-	assert(iob->io_len >= rc);
-	iob->io_offset += rc;
-	iob->io_base = ((BYTE *) iob->io_base) + rc;
-	iob->io_resid -= rc;
-	return ret;
+	return ffs_rw(node, iob, 1);
 }
 
 /* 
@@ -701,7 +756,7 @@ ffs_link(struct inode *node, const char *name, struct inode *link_node)
 }
 
 /*
- *  findNode:   find the ffs_inode in ffs->inodelist according
+ *  findNode:   find the ffs_inode in ffs->path_hash according
  *  to hashno and absolute path.
  *  @ffs:   the fat32 file system.
  *  @name:  the absolute path of the file or dir.
@@ -710,15 +765,7 @@ ffs_link(struct inode *node, const char *name, struct inode *link_node)
 static struct ffs_inode *findNode(struct ffs_fs *ffs, const char *name,
 				  uint32_t hashno)
 {
-	struct ffs_inode_list *head = ffs->inode_list;
-	while (head->next != NULL) {
-		head = head->next;
-		struct ffs_inode *fin = head->f_inode;
-		if (fin->hashno == hashno && !strcmp(fin->path, name)) {
-			return fin;
-		}
-	}
-	return NULL;
+	return ffs_lookup_path(ffs, (char *)name, hashno);
 }
 
 /* *
@@ -760,12 +807,16 @@ ffs_rename(struct inode *node, const char *name, struct inode *new_node,
 
 	char *absPath = getAbsolutePath(fin, (char *)name);
 	char *newAbsPath = getAbsolutePath(newfin, (char *)new_name);
-	f_rename(absPath, newAbsPath);
+	/* the new name of f_rename goes without the drive */
+	f_rename(absPath, newAbsPath + 2);
 
 	struct ffs_inode *filnode = findNode(ffs, absPath, hash(absPath));
 	if (filnode != NULL) {
+		rhash_del(&(ffs->path_hash), &(filnode->hash_link));
 		filnode->path = newAbsPath;
 		filnode->hashno = hash(newAbsPath);
+		rhash_add(&(ffs->path_hash), &(filnode->hash_link),
+			  filnode->hashno);
 		fin->dirty = newfin->dirty = 1;
 
 		if (fin != newfin) {
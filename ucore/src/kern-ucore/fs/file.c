@@ -1,5 +1,6 @@
 #include <types.h>
 #include <string.h>
+#include <stdio.h>
 #include <slab.h>
 #include <vfs.h>
 #include <proc.h>
@@ -7,133 +8,105 @@
 #include <unistd.h>
 #include <iobuf.h>
 #include <inode.h>
+#include <pmm.h>
+#include <pipe.h>
+#include <pipe_state.h>
+#include <eventpoll.h>
+#include <epoll.h>
+#ifdef UCONFIG_NET
+#include <sock.h>
+#endif
 #include <stat.h>
 #include <dirent.h>
 #include <error.h>
 #include <assert.h>
 
 #include <vmm.h>
+#include <fs.h>
 
-#define testfd(fd)                          ((fd) >= 0 && (fd) < FS_STRUCT_NENTRY)
+/*
+ * A struct file is the open file itself, shared by the fds dup'd from it
+ * and by the processes forked with it, and freed when open_count drops to
+ * 0. An fd holds one count, and so does each call in progress on the file,
+ * taken by fd2file, so a close in another thread never frees it under the
+ * call.
+ */
 
-static struct file *get_filemap(void)
+static kmem_cache_t *file_cachep;
+
+void file_init(void)
 {
-	struct fs_struct *fs_struct = current->fs_struct;
-	assert(fs_struct != NULL && fs_count(fs_struct) > 0);
-	return fs_struct->filemap;
+	file_cachep = kmem_cache_create("file", sizeof(struct file), 0, NULL);
+	if (file_cachep == NULL) {
+		panic("cannot create the file cache.\n");
+	}
 }
 
-void filemap_init(struct file *filemap)
+static struct fs_struct *get_fs_struct(void)
 {
-	int fd;
-	struct file *file = filemap;
-	for (fd = 0; fd < FS_STRUCT_NENTRY; fd++, file++) {
-		atomic_set(&(file->open_count), 0);
-		file->status = FD_NONE, file->fd = fd;
-	}
+	struct fs_struct *fs_struct = current->fs_struct;
+	assert(fs_struct != NULL && fs_count(fs_struct) > 0);
+	return fs_struct;
 }
 
+// filemap_alloc - a new file, to be opened at fd, or at the lowest free fd
+//               - if fd is NO_FD; the fd is returned
 static int filemap_alloc(int fd, struct file **file_store)
 {
-	struct file *file = get_filemap();
-	if (fd == NO_FD) {
-		for (fd = 0; fd < FS_STRUCT_NENTRY; fd++, file++) {
-			if (file->status == FD_NONE) {
-				goto found;
-			}
-		}
-		return -E_MAX_OPEN;
-	} else {
-		if (testfd(fd)) {
-			file += fd;
-			if (file->status == FD_NONE) {
-				goto found;
-			}
-			return -E_BUSY;
-		}
-		return -E_INVAL;
+	struct file *file;
+	if ((file = kmem_cache_alloc(file_cachep)) == NULL) {
+		return -E_NO_MEM;
 	}
-found:
-	assert(fopen_count(file) == 0);
+	if ((fd = fd_reserve(get_fs_struct(), fd)) < 0) {
+		kmem_cache_free(file_cachep, file);
+		return fd;
+	}
+	atomic_set(&(file->open_count), 0);
 	file->status = FD_INIT, file->node = NULL;
 	*file_store = file;
-	return 0;
+	return fd;
 }
 
-static void filemap_free(struct file *file)
+// filemap_free - undo filemap_alloc, of a file never opened
+static void filemap_free(int fd, struct file *file)
 {
-	assert(file->status == FD_INIT || file->status == FD_CLOSED);
-	assert(fopen_count(file) == 0);
-	if (file->status == FD_CLOSED) {
-		vfs_close(file->node);
-	}
-	file->status = FD_NONE;
+	assert(file->status == FD_INIT && fopen_count(file) == 0);
+	fd_unreserve(get_fs_struct(), fd);
+	kmem_cache_free(file_cachep, file);
 }
 
-void filemap_acquire(struct file *file)
+// filemap_open - install the file at fd, which holds the first count
+static void filemap_open(int fd, struct file *file)
 {
-	assert(file->status == FD_OPENED || file->status == FD_CLOSED);
+	assert(file->status == FD_INIT && file->node != NULL);
+	file->status = FD_OPENED;
 	fopen_count_inc(file);
+	fd_install(get_fs_struct(), fd, file);
 }
 
-void filemap_release(struct file *file)
-{
-	assert(file->status == FD_OPENED || file->status == FD_CLOSED);
-	assert(fopen_count(file) > 0);
-	if (fopen_count_dec(file) == 0) {
-		filemap_free(file);
-	}
-}
-
-void filemap_open(struct file *file)
+void filemap_acquire(struct file *file)
 {
-	assert((file->status == FD_INIT || file->status == FD_OPENED)
-	       && file->node != NULL);
-	file->status = FD_OPENED;
+	assert(file->status == FD_OPENED);
 	fopen_count_inc(file);
 }
 
-void filemap_close(struct file *file)
+void filemap_release(struct file *file)
 {
 	assert(file->status == FD_OPENED);
 	assert(fopen_count(file) > 0);
-	file->status = FD_CLOSED;
 	if (fopen_count_dec(file) == 0) {
-		filemap_free(file);
+		vfs_close(file->node);
+		kmem_cache_free(file_cachep, file);
 	}
 }
 
-void filemap_dup(struct file *to, struct file *from)
-{
-	assert(to->status == FD_INIT && from->status == FD_OPENED);
-	to->pos = from->pos;
-	to->readable = from->readable;
-	to->writable = from->writable;
-	struct inode *node = from->node;
-	vop_ref_inc(node), vop_open_inc(node);
-	to->node = node;
-	filemap_open(to);
-}
-
-void filemap_dup_close(struct file *to, struct file *from)
-{
-	assert(to->status == FD_CLOSED && from->status == FD_CLOSED);
-	to->pos = from->pos;
-	to->readable = from->readable;
-	to->writable = from->writable;
-	struct inode *node = from->node;
-	vop_ref_inc(node), vop_open_inc(node);
-	to->node = node;
-}
-
+// fd2file - the file at fd, with a count the caller drops by filemap_release
 static inline int fd2file(int fd, struct file **file_store)
 {
-	if (testfd(fd)) {
-		struct file *file = get_filemap() + fd;
-		if (file->status == FD_OPENED && file->fd == fd) {
-			*file_store = file;
-			return 0;
-		}
+	struct file *file;
+	if ((file = fd_get(get_fs_struct(), fd)) != NULL) {
+		*file_store = file;
+		return 0;
 	}
 	return -E_INVAL;
 }
@@ -141,16 +114,13 @@ static inline int fd2file(int fd, struct file **file_store)
 #ifdef UCONFIG_BIONIC_LIBC
 struct file*
 fd2file_onfs(int fd, struct fs_struct *fs_struct) {
-	if(testfd(fd)) {
-		assert(fs_struct != NULL && fs_count(fs_struct) > 0);
-		struct file *file = fs_struct->filemap + fd;
-		if((file->status == FD_OPENED || file->status == FD_CLOSED) && file->fd == fd) {
-			return file;
-		}
-	} else {
-		panic("testfd() failed");
+	assert(fs_struct != NULL && fs_count(fs_struct) > 0);
+	struct file *file = fd_get(fs_struct, fd);
+	if (file != NULL) {
+		/* the caller takes its own count */
+		filemap_release(file);
 	}
-	return NULL;
+	return file;
 }
 #endif //UCONFIG_BIONIC_LIBC
 
@@ -161,13 +131,9 @@ bool file_testfd(int fd, bool readable, bool writable)
 	if ((ret = fd2file(fd, &file)) != 0) {
 		return 0;
 	}
-	if (readable && !file->readable) {
-		return 0;
-	}
-	if (writable && !file->writable) {
-		return 0;
-	}
-	return 1;
+	ret = (!readable || file->readable) && (!writable || file->writable);
+	filemap_release(file);
+	return ret;
 }
 
 int file_open(char *path, uint32_t open_flags)
@@ -187,15 +153,15 @@ int file_open(char *path, uint32_t open_flags)
 		return -E_INVAL;
 	}
 
-	int ret;
+	int ret, fd;
 	struct file *file;
-	if ((ret = filemap_alloc(NO_FD, &file)) != 0) {
-		return ret;
+	if ((fd = filemap_alloc(NO_FD, &file)) < 0) {
+		return fd;
 	}
 
 	struct inode *node;
 	if ((ret = vfs_open(path, open_flags, &node)) != 0) {
-		filemap_free(file);
+		filemap_free(fd, file);
 		return ret;
 	}
 
@@ -204,7 +170,7 @@ int file_open(char *path, uint32_t open_flags)
 		struct stat __stat, *stat = &__stat;
 		if ((ret = vop_fstat(node, stat)) != 0) {
 			vfs_close(node);
-			filemap_free(file);
+			filemap_free(fd, file);
 			return ret;
 		}
 		file->pos = stat->st_size;
@@ -213,22 +179,24 @@ int file_open(char *path, uint32_t open_flags)
 	file->node = node;
 	file->readable = readable;
 	file->writable = writable;
-	filemap_open(file);
-	return file->fd;
+	filemap_open(fd, file);
+	return fd;
 }
 
 int file_close(int fd)
 {
-	int ret;
 	struct file *file;
-	if ((ret = fd2file(fd, &file)) != 0) {
-		return ret;
+	if ((file = fd_remove(get_fs_struct(), fd)) == NULL) {
+		return -E_INVAL;
 	}
-	filemap_close(file);
+	filemap_release(file);
 	return 0;
 }
 
-int file_read(int fd, void *base, size_t len, size_t * copied_store)
+// file_io - move iob at pos, or at the position of fd if pos is FILE_POS_CUR,
+//         - moving that past the data; iob->io_offset is set here
+static int file_io(int fd, struct iobuf *iob, off_t pos, bool write,
+		   size_t * copied_store)
 {
 	int ret;
 	struct file *file;
@@ -236,16 +204,28 @@ int file_read(int fd, void *base, size_t len, size_t * copied_store)
 	if ((ret = fd2file(fd, &file)) != 0) {
 		return ret;
 	}
-	if (!file->readable) {
+	if (!(write ? file->writable : file->readable)) {
+		filemap_release(file);
 		return -E_INVAL;
 	}
-	filemap_acquire(file);
 
-	struct iobuf __iob, *iob = iobuf_init(&__iob, base, len, file->pos);
-	ret = vop_read(file->node, iob);
+	if (pos == FILE_POS_CUR) {
+		iob->io_offset = file->pos;
+	} else if (pos < 0) {
+		ret = -E_INVAL;
+	} else {
+		/* a read past the end must not grow the file as a seek there
+		 * does, the seek to 0 only tells whether the node seeks */
+		ret = vop_tryseek(file->node, write ? pos : 0);
+		iob->io_offset = pos;
+	}
+	if (ret == 0) {
+		ret = write ? vop_write(file->node, iob) :
+		    vop_read(file->node, iob);
+	}
 
 	size_t copied = iobuf_used(iob);
-	if (file->status == FD_OPENED) {
+	if (pos == FILE_POS_CUR) {
 		file->pos += copied;
 	}
 	*copied_store = copied;
@@ -253,29 +233,67 @@ int file_read(int fd, void *base, size_t len, size_t * copied_store)
 	return ret;
 }
 
+int file_read(int fd, void *base, size_t len, size_t * copied_store)
+{
+	struct iobuf __iob, *iob = iobuf_init(&__iob, base, len, 0);
+	return file_io(fd, iob, FILE_POS_CUR, 0, copied_store);
+}
+
 int file_write(int fd, void *base, size_t len, size_t * copied_store)
 {
-	int ret;
-	struct file *file;
-	*copied_store = 0;
-	if ((ret = fd2file(fd, &file)) != 0) {
-		return ret;
-	}
-	if (!file->writable) {
-		return -E_INVAL;
-	}
-	filemap_acquire(file);
+	struct iobuf __iob, *iob = iobuf_init(&__iob, base, len, 0);
+	return file_io(fd, iob, FILE_POS_CUR, 1, copied_store);
+}
 
-	struct iobuf __iob, *iob = iobuf_init(&__iob, base, len, file->pos);
-	ret = vop_write(file->node, iob);
+// file_pread - file_read at pos, the position of fd is left as it is, so
+//            - that the threads sharing fd need not seek it in turn
+int
+file_pread(int fd, void *base, size_t len, off_t pos, size_t * copied_store)
+{
+	struct iobuf __iob, *iob = iobuf_init(&__iob, base, len, 0);
+	return file_io(fd, iob, pos, 0, copied_store);
+}
 
-	size_t copied = iobuf_used(iob);
-	if (file->status == FD_OPENED) {
-		file->pos += copied;
+int
+file_pwrite(int fd, void *base, size_t len, off_t pos, size_t * copied_store)
+{
+	struct iobuf __iob, *iob = iobuf_init(&__iob, base, len, 0);
+	return file_io(fd, iob, pos, 1, copied_store);
+}
+
+// file_vectored - whether the inode of fd moves data through the segments
+//               - of a vectored iobuf; the others only look at io_base
+bool file_vectored(int fd, bool write)
+{
+	struct file *file;
+	if (fd2file(fd, &file) != 0) {
+		return 0;
 	}
-	*copied_store = copied;
+	struct inode *node = file->node;
+	/* a pipe read would wait for a writer again between two segments */
+	bool vectored = check_inode_type(node, sfs_inode)
+	    || (write && check_inode_type(node, pipe_inode));
 	filemap_release(file);
-	return ret;
+	return vectored;
+}
+
+// file_readv - file_pread into the kernel buffers of iov, one request for
+//            - all of them; pos may be FILE_POS_CUR. see file_vectored
+int
+file_readv(int fd, struct iovec *iov, int iovcnt, off_t pos,
+	   size_t * copied_store)
+{
+	struct iobuf __iob, *iob = iobuf_init_vec(&__iob, iov, iovcnt, 0);
+	return file_io(fd, iob, pos, 0, copied_store);
+}
+
+// file_writev - file_pwrite from the kernel buffers of iov
+int
+file_writev(int fd, struct iovec *iov, int iovcnt, off_t pos,
+	    size_t * copied_store)
+{
+	struct iobuf __iob, *iob = iobuf_init_vec(&__iob, iov, iovcnt, 0);
+	return file_io(fd, iob, pos, 1, copied_store);
 }
 
 int file_seek(int fd, off_t pos, int whence)
@@ -286,7 +304,6 @@ int file_seek(int fd, off_t pos, int whence)
 	if ((ret = fd2file(fd, &file)) != 0) {
 		return ret;
 	}
-	filemap_acquire(file);
 
 	switch (whence) {
 	case LSEEK_SET:
@@ -319,7 +336,6 @@ int file_fstat(int fd, struct stat *stat)
 	if ((ret = fd2file(fd, &file)) != 0) {
 		return ret;
 	}
-	filemap_acquire(file);
 	ret = vop_fstat(file->node, stat);
 	filemap_release(file);
 	return ret;
@@ -332,12 +348,349 @@ int file_fsync(int fd)
 	if ((ret = fd2file(fd, &file)) != 0) {
 		return ret;
 	}
-	filemap_acquire(file);
 	ret = vop_fsync(file->node);
 	filemap_release(file);
 	return ret;
 }
 
+// file_fallocate - allocate the blocks of fd, open for writing, up to
+//                - off + len, see vop_fallocate
+int file_fallocate(int fd, int mode, off_t off, off_t len)
+{
+	int ret;
+	struct file *file;
+	if ((ret = fd2file(fd, &file)) != 0) {
+		return ret;
+	}
+	if (!file->writable) {
+		ret = -E_INVAL;
+	} else if (!vop_has_fallocate(file->node)) {
+		ret = -E_UNIMP;
+	} else {
+		ret = vop_fallocate(file->node, mode, off, len);
+	}
+	filemap_release(file);
+	return ret;
+}
+
+// file_getnode - the inode of fd, with a reference the caller drops
+int file_getnode(int fd, struct inode **node_store)
+{
+	int ret;
+	struct file *file;
+	if ((ret = fd2file(fd, &file)) != 0) {
+		return ret;
+	}
+	vop_ref_inc(file->node);
+	*node_store = file->node;
+	filemap_release(file);
+	return 0;
+}
+
+// file_fcntl - the fcntl commands of ucore, the size of a pipe only
+// file_describe - the path of the regular file at fd, "<dev>:/<path>" in
+//               - path of len bytes, with its access mode of O_ACCMODE and
+//               - its position, for it to be opened again; -E_INVAL for the
+//               - others, devices and pipes
+int
+file_describe(int fd, char *path, size_t len, uint32_t * open_flags_store,
+	      off_t * pos_store)
+{
+	struct file *file;
+	struct iobuf __iob, *iob;
+	uint32_t type;
+	size_t n;
+	int ret;
+	if ((ret = fd2file(fd, &file)) != 0) {
+		return ret;
+	}
+	ret = -E_INVAL;
+	if (file->node->in_fs == NULL || vop_gettype(file->node, &type) != 0
+	    || !S_ISREG(type)) {
+		goto out;
+	}
+	memset(path, 0, len);
+	n = snprintf(path, len, "%s:", vfs_get_devname(file->node->in_fs));
+	if (n + 2 >= len) {
+		goto out;
+	}
+	/* the last byte stays 0 */
+	iob = iobuf_init(&__iob, path + n, len - n - 1, 0);
+	if ((ret = vop_namefile(file->node, iob)) != 0) {
+		goto out;
+	}
+	*open_flags_store = (file->readable && file->writable) ? O_RDWR :
+	    (file->writable ? O_WRONLY : O_RDONLY);
+	*pos_store = file->pos;
+out:
+	filemap_release(file);
+	return ret;
+}
+
+int file_fcntl(int fd, int cmd, int arg)
+{
+	int ret;
+	struct file *file;
+	if ((ret = fd2file(fd, &file)) != 0) {
+		return ret;
+	}
+	if ((cmd != F_SETPIPE_SZ && cmd != F_GETPIPE_SZ)
+	    || !check_inode_type(file->node, pipe_inode)) {
+		filemap_release(file);
+		return -E_INVAL;
+	}
+	ret = vop_ioctl(file->node, cmd, &arg);
+	filemap_release(file);
+	return (ret == 0) ? arg : ret;
+}
+
+static struct pipe_state *file_pipe_state(struct file *file)
+{
+	if (check_inode_type(file->node, pipe_inode)) {
+		return vop_info(file->node, pipe_inode)->state;
+	}
+	return NULL;
+}
+
+// splice_from_pipe - write the first page of data of the pipe to fd
+static int
+splice_from_pipe(struct pipe_state *state, int fd, size_t len,
+		 size_t * copied_store)
+{
+	struct Page *page;
+	size_t offset, n;
+	int ret = 0;
+	if ((n = pipe_state_peek(state, len, &page, &offset)) != 0) {
+		ret =
+		    file_write(fd, page2kva(page) + offset, n, copied_store);
+		pipe_state_consume(state, *copied_store);
+		pipe_page_put(page);
+	}
+	return ret;
+}
+
+// splice_to_pipe - read a page from fd and queue the page itself
+static int
+splice_to_pipe(int fd, struct pipe_state *state, size_t len,
+	       size_t * copied_store)
+{
+	struct Page *page;
+	size_t copied;
+	if ((page = alloc_page()) == NULL) {
+		return -E_NO_MEM;
+	}
+	set_page_ref(page, 1);
+	int ret = file_read(fd, page2kva(page), (len < PGSIZE) ? len : PGSIZE,
+			    &copied);
+	if (copied != 0 && pipe_state_put_page(state, page, copied) == 0) {
+		*copied_store = copied;
+		return ret;
+	}
+	pipe_page_put(page);
+	return (copied != 0) ? -E_PIPE : ret;
+}
+
+/*
+ * file_splice - move up to len bytes from fd_in to fd_out, at least one of
+ * them a pipe, without a copy through user space. Between two pipes the
+ * pages themselves move, and tee leaves them in fd_in too; between a pipe
+ * and a file one page goes per call, read into or written from the page
+ * that sits in the pipe.
+ */
+int
+file_splice(int fd_in, int fd_out, size_t len, bool tee, size_t * copied_store)
+{
+	int ret;
+	struct file *in, *out;
+	*copied_store = 0;
+	if ((ret = fd2file(fd_in, &in)) != 0) {
+		return ret;
+	}
+	if ((ret = fd2file(fd_out, &out)) != 0) {
+		filemap_release(in);
+		return ret;
+	}
+	struct pipe_state *from = file_pipe_state(in), *to =
+	    file_pipe_state(out);
+	if (!in->readable || !out->writable || from == to
+	    || (tee && (from == NULL || to == NULL))) {
+		ret = -E_INVAL;
+		goto out;
+	}
+	if (from != NULL && to != NULL) {
+		*copied_store = pipe_state_splice(from, to, len, tee);
+	} else if (from != NULL) {
+		ret = splice_from_pipe(from, fd_out, len, copied_store);
+	} else {
+		ret = splice_to_pipe(fd_in, to, len, copied_store);
+	}
+out:
+	filemap_release(out), filemap_release(in);
+	return ret;
+}
+
+// file_io_at - move len bytes of buf at pos of node; # bytes moved
+static int
+file_io_at(struct inode *node, void *buf, size_t len, off_t pos, bool write,
+	   size_t * copied_store)
+{
+	struct iobuf __iob, *iob = iobuf_init(&__iob, buf, len, pos);
+	int ret = write ? vop_write(node, iob) : vop_read(node, iob);
+	*copied_store = iobuf_used(iob);
+	return ret;
+}
+
+// copy_to_pipe - queue the pages read from node at *pos in the pipe, the
+//              - pages themselves; blocks while the pipe is full
+static int
+copy_to_pipe(struct inode *node, off_t * pos, struct pipe_state *state,
+	     size_t len, size_t * copied_store)
+{
+	struct Page *page;
+	size_t copied;
+	int ret = 0;
+	while (len != 0) {
+		if ((page = alloc_page()) == NULL) {
+			return -E_NO_MEM;
+		}
+		set_page_ref(page, 1);
+		ret = file_io_at(node, page2kva(page),
+				 (len < PGSIZE) ? len : PGSIZE, *pos, 0,
+				 &copied);
+		if (copied == 0
+		    || pipe_state_put_page(state, page, copied) != 0) {
+			pipe_page_put(page);
+			return (copied != 0) ? -E_PIPE : ret;
+		}
+		*pos += copied, *copied_store += copied, len -= copied;
+		if (ret != 0 || copied < PGSIZE) {
+			break;
+		}
+	}
+	return ret;
+}
+
+#ifdef UCONFIG_NET
+// copy_to_socket - queue the pages read from node at *pos to send on the
+//                - socket to_node, the pages themselves
+static int
+copy_to_socket(struct inode *node, off_t * pos, struct inode *to_node,
+	       size_t len, size_t * copied_store)
+{
+	struct Page *page;
+	size_t copied;
+	int ret = 0, ret2 = 0;
+	while (len != 0) {
+		if ((page = alloc_page()) == NULL) {
+			return -E_NO_MEM;
+		}
+		set_page_ref(page, 1);
+		ret = file_io_at(node, page2kva(page),
+				 (len < PGSIZE) ? len : PGSIZE, *pos, 0,
+				 &copied);
+		if (copied == 0
+		    || (ret2 = socket_sendpage(to_node, page, copied)) != 0) {
+			free_page(page);
+			return (copied != 0) ? ret2 : ret;
+		}
+		*pos += copied, *copied_store += copied, len -= copied;
+		if (ret != 0 || copied < PGSIZE) {
+			break;
+		}
+	}
+	return ret;
+}
+#endif
+
+// copy_through_page - read node at *pos and write to_node at *to_pos by
+//                   - turns through a page of the kernel
+static int
+copy_through_page(struct inode *node, off_t * pos, struct inode *to_node,
+		  off_t * to_pos, size_t len, size_t * copied_store)
+{
+	struct Page *page;
+	size_t rlen, wlen;
+	int ret = 0;
+	if ((page = alloc_page()) == NULL) {
+		return -E_NO_MEM;
+	}
+	while (len != 0) {
+		ret = file_io_at(node, page2kva(page),
+				 (len < PGSIZE) ? len : PGSIZE, *pos, 0, &rlen);
+		if (rlen == 0) {
+			break;
+		}
+		int ret2 =
+		    file_io_at(to_node, page2kva(page), rlen, *to_pos, 1, &wlen);
+		*pos += wlen, *to_pos += wlen, len -= wlen;
+		*copied_store += wlen;
+		if (ret == 0) {
+			ret = ret2;
+		}
+		if (ret != 0 || wlen < rlen || rlen < PGSIZE) {
+			break;
+		}
+	}
+	free_page(page);
+	return ret;
+}
+
+/*
+ * file_copy_range - copy up to len bytes of the file fd_in to fd_out,
+ * without a copy through user space: the file at *off_in, or at its
+ * position if off_in is NULL, to fd_out at *off_out, or its position. The
+ * offsets or positions move past the bytes copied. Within a filesystem
+ * that has a vop_copyrange it does the whole copy; to a pipe the pages
+ * read are queued themselves, as splice does, and to a socket they are
+ * queued to send, the card reading them; anything else goes through a
+ * page of the kernel, one copy less than read and write have.
+ */
+int
+file_copy_range(int fd_in, off_t * off_in, int fd_out, off_t * off_out,
+		size_t len, size_t * copied_store)
+{
+	int ret;
+	struct file *in, *out;
+	*copied_store = 0;
+	if ((ret = fd2file(fd_in, &in)) != 0) {
+		return ret;
+	}
+	if ((ret = fd2file(fd_out, &out)) != 0) {
+		filemap_release(in);
+		return ret;
+	}
+	struct pipe_state *to = file_pipe_state(out);
+	off_t pos = (off_in != NULL) ? *off_in : in->pos;
+	off_t to_pos = (off_out != NULL) ? *off_out : out->pos;
+	if (!in->readable || !out->writable || file_pipe_state(in) != NULL
+	    || (to != NULL && off_out != NULL)) {
+		ret = -E_INVAL;
+		goto out;
+	}
+	if (to != NULL) {
+		ret = copy_to_pipe(in->node, &pos, to, len, copied_store);
+#ifdef UCONFIG_NET
+	} else if (socket_node(out->node)) {
+		ret = copy_to_socket(in->node, &pos, out->node, len,
+				     copied_store);
+#endif
+	} else if (vop_has_copyrange(out->node, in->node)) {
+		ret = vop_copyrange(out->node, to_pos, in->node, pos, len,
+				    copied_store);
+		pos += *copied_store, to_pos += *copied_store;
+	} else {
+		ret = copy_through_page(in->node, &pos, out->node, &to_pos,
+					len, copied_store);
+	}
+	*((off_in != NULL) ? off_in : &(in->pos)) = pos;
+	if (to == NULL) {
+		*((off_out != NULL) ? off_out : &(out->pos)) = to_pos;
+	}
+out:
+	filemap_release(out), filemap_release(in);
+	return ret;
+}
+
 int file_getdirentry(int fd, struct dirent *direntp)
 {
 	int ret;
@@ -345,63 +698,113 @@ int file_getdirentry(int fd, struct dirent *direntp)
 	if ((ret = fd2file(fd, &file)) != 0) {
 		return ret;
 	}
-	filemap_acquire(file);
 
 	struct iobuf __iob, *iob =
 	    iobuf_init(&__iob, direntp->d_name, sizeof(direntp->d_name),
 		       direntp->d_off);
+	/* the fs moves the offset on, by what it likes */
 	if ((ret = vop_getdirentry(file->node, iob)) == 0) {
-		direntp->d_off += iobuf_used(iob);
+		direntp->d_off = iob->io_offset;
 	}
 	filemap_release(file);
 	return ret;
 }
 
-int file_dup(int fd1, int fd2)
+// file_getdents - read the entries of the directory fd from its position on
+//               - into the dirent64 records of buf, as many as fit in len;
+//               - the position is left after the last one. *copied_store
+//               - is the bytes filled, 0 at the end of the directory
+int file_getdents(int fd, void *buf, size_t len, size_t * copied_store)
 {
+	char name[FS_MAX_FNAME_LEN + 1];
+	size_t copied = 0;
 	int ret;
-	struct file *file1, *file2;
-	if ((ret = fd2file(fd1, &file1)) != 0) {
+	struct file *file;
+	*copied_store = 0;
+	if ((ret = fd2file(fd, &file)) != 0) {
 		return ret;
 	}
-	if ((ret = filemap_alloc(fd2, &file2)) != 0) {
+	if (!file->readable) {
+		ret = -E_INVAL;
+		goto out;
+	}
+	while (1) {
+		struct iobuf __iob, *iob =
+		    iobuf_init(&__iob, name, sizeof(name), file->pos);
+		if ((ret = vop_getdirentry(file->node, iob)) != 0) {
+			if (ret == -E_NOENT) {
+				ret = 0;
+			}
+			break;
+		}
+		name[sizeof(name) - 1] = '\0';
+		size_t namelen = strlen(name), reclen = DIRENT64_RECLEN(namelen);
+		if (copied + reclen > len) {
+			/* read again by the next call */
+			ret = (copied == 0) ? -E_INVAL : 0;
+			break;
+		}
+		struct dirent64 *dirent = buf + copied;
+		dirent->d_ino = 1;
+		dirent->d_off = iob->io_offset;
+		dirent->d_reclen = reclen;
+		memcpy(dirent->d_name, name, namelen + 1);
+		copied += reclen;
+		file->pos = iob->io_offset;
+	}
+	*copied_store = copied;
+out:
+	filemap_release(file);
+	return ret;
+}
+
+int file_dup(int fd1, int fd2)
+{
+	int ret;
+	struct file *file;
+	if ((ret = fd2file(fd1, &file)) != 0) {
 		return ret;
 	}
-	filemap_dup(file2, file1);
-	return file2->fd;
+	/* fd2 shares the file, with the count of fd2file */
+	if ((fd2 = fd_reserve(get_fs_struct(), fd2)) < 0) {
+		filemap_release(file);
+		return fd2;
+	}
+	fd_install(get_fs_struct(), fd2, file);
+	return fd2;
 }
 
 int file_pipe(int fd[])
 {
 	int ret;
 	struct file *file[2] = { NULL, NULL };
-	if ((ret = filemap_alloc(NO_FD, &file[0])) != 0) {
+	if ((ret = filemap_alloc(NO_FD, &file[0])) < 0) {
 		goto failed_cleanup;
 	}
-	if ((ret = filemap_alloc(NO_FD, &file[1])) != 0) {
+	fd[0] = ret;
+	if ((ret = filemap_alloc(NO_FD, &file[1])) < 0) {
 		goto failed_cleanup;
 	}
+	fd[1] = ret;
 
 	if ((ret = pipe_open(&(file[0]->node), &(file[1]->node))) != 0) {
 		goto failed_cleanup;
 	}
 	file[0]->pos = 0;
 	file[0]->readable = 1, file[0]->writable = 0;
-	filemap_open(file[0]);
+	filemap_open(fd[0], file[0]);
 
 	file[1]->pos = 0;
 	file[1]->readable = 0, file[1]->writable = 1;
-	filemap_open(file[1]);
-
-	fd[0] = file[0]->fd, fd[1] = file[1]->fd;
+	filemap_open(fd[1], file[1]);
 	return 0;
 
 failed_cleanup:
 	if (file[0] != NULL) {
-		filemap_free(file[0]);
+		filemap_free(fd[0], file[0]);
 	}
 	if (file[1] != NULL) {
-		filemap_free(file[1]);
+		filemap_free(fd[1], file[1]);
 	}
 	return ret;
 }
@@ -418,10 +821,10 @@ int file_mkfifo(const char *__name, uint32_t open_flags)
 		return -E_INVAL;
 	}
 
-	int ret;
+	int ret, fd;
 	struct file *file;
-	if ((ret = filemap_alloc(NO_FD, &file)) != 0) {
-		return ret;
+	if ((fd = filemap_alloc(NO_FD, &file)) < 0) {
+		return fd;
 	}
 
 	char *name;
@@ -437,17 +840,167 @@ int file_mkfifo(const char *__name, uint32_t open_flags)
 	}
 	file->pos = 0;
 	file->readable = readonly, file->writable = !readonly;
-	filemap_open(file);
+	filemap_open(fd, file);
 	kfree(name);
-	return file->fd;
+	return fd;
 
 failed_cleanup_name:
 	kfree(name);
 failed_cleanup_file:
-	filemap_free(file);
+	filemap_free(fd, file);
+	return ret;
+}
+
+// file_epoll_create - an fd for a new epoll object
+int file_epoll_create(void)
+{
+	int ret, fd;
+	struct file *file;
+	if ((fd = filemap_alloc(NO_FD, &file)) < 0) {
+		return fd;
+	}
+	if ((ret = epoll_open(&(file->node))) != 0) {
+		filemap_free(fd, file);
+		return ret;
+	}
+	file->pos = 0;
+	file->readable = 1, file->writable = 0;
+	filemap_open(fd, file);
+	return fd;
+}
+
+// file_epoll_ctl - add, modify or delete the interest of epfd in a source,
+//                - fd id or mbox id as type says
+int file_epoll_ctl(int epfd, int op, int type, int id, struct epoll_event *event)
+{
+	int ret;
+	struct inode *node, *src = NULL;
+	if ((ret = file_getnode(epfd, &node)) != 0) {
+		return ret;
+	}
+	if (type == EPOLL_SRC_FD && (ret = file_getnode(id, &src)) != 0) {
+		goto out;
+	}
+	ret = epoll_ctl(node, op, type, id, src, event);
+	if (src != NULL) {
+		vop_ref_dec(src);
+	}
+out:
+	vop_ref_dec(node);
+	return ret;
+}
+
+int
+file_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+		unsigned int timeout)
+{
+	int ret;
+	struct inode *node;
+	if ((ret = file_getnode(epfd, &node)) != 0) {
+		return ret;
+	}
+	ret = epoll_wait(node, events, maxevents, timeout);
+	vop_ref_dec(node);
+	return ret;
+}
+
+#ifdef UCONFIG_NET
+// file_socket - an fd for a new TCP socket
+int file_socket(void)
+{
+	int ret, fd;
+	struct file *file;
+	if ((fd = filemap_alloc(NO_FD, &file)) < 0) {
+		return fd;
+	}
+	if ((ret = socket_open(&(file->node))) != 0) {
+		filemap_free(fd, file);
+		return ret;
+	}
+	file->pos = 0;
+	file->readable = 1, file->writable = 1;
+	filemap_open(fd, file);
+	return fd;
+}
+
+// file_socket_node - the inode of the socket fd, as file_getnode
+static int file_socket_node(int fd, struct inode **node_store)
+{
+	int ret;
+	if ((ret = file_getnode(fd, node_store)) != 0) {
+		return ret;
+	}
+	if (!socket_node(*node_store)) {
+		vop_ref_dec(*node_store);
+		return -E_INVAL;
+	}
+	return 0;
+}
+
+int file_bind(int fd, uint32_t addr, uint16_t port)
+{
+	int ret;
+	struct inode *node;
+	if ((ret = file_socket_node(fd, &node)) != 0) {
+		return ret;
+	}
+	ret = socket_bind(node, addr, port);
+	vop_ref_dec(node);
 	return ret;
 }
 
+int file_listen(int fd, int backlog)
+{
+	int ret;
+	struct inode *node;
+	if ((ret = file_socket_node(fd, &node)) != 0) {
+		return ret;
+	}
+	ret = socket_listen(node, backlog);
+	vop_ref_dec(node);
+	return ret;
+}
+
+// file_accept - an fd for the next connection to the socket fd, with the
+//             - address and port of the peer
+int file_accept(int fd, uint32_t * addr_store, uint16_t * port_store)
+{
+	int ret, newfd;
+	struct inode *node;
+	struct file *file;
+	if ((ret = file_socket_node(fd, &node)) != 0) {
+		return ret;
+	}
+	if ((ret = newfd = filemap_alloc(NO_FD, &file)) < 0) {
+		goto out;
+	}
+	if ((ret = socket_accept(node, &(file->node), addr_store,
+				 port_store)) != 0) {
+		filemap_free(newfd, file);
+		goto out;
+	}
+	file->pos = 0;
+	file->readable = 1, file->writable = 1;
+	filemap_open(newfd, file);
+	ret = newfd;
+out:
+	vop_ref_dec(node);
+	return ret;
+}
+
+int file_connect(int fd, uint32_t addr, uint16_t port)
+{
+	int ret;
+	struct inode *node;
+	if ((ret = file_socket_node(fd, &node)) != 0) {
+		return ret;
+	}
+	ret = socket_connect(node, addr, port);
+	vop_ref_dec(node);
+	return ret;
+}
+#endif
+
 /* linux devfile adaptor */
 bool __is_linux_devfile(int fd)
 {
@@ -456,10 +1009,10 @@ bool __is_linux_devfile(int fd)
 	if ((ret = fd2file(fd, &file)) != 0) {
 		return 0;
 	}
-	if (file->node && check_inode_type(file->node, device)
-	    && dev_is_linux_dev(vop_info(file->node, device)))
-		return 1;
-	return 0;
+	ret = file->node && check_inode_type(file->node, device)
+	    && dev_is_linux_dev(vop_info(file->node, device));
+	filemap_release(file);
+	return ret;
 }
 
 int linux_devfile_read(int fd, void *base, size_t len, size_t * copied_store)
@@ -474,9 +1027,9 @@ int linux_devfile_read(int fd, void *base, size_t len, size_t * copied_store)
 	}
 
 	if (!file->readable) {
+		filemap_release(file);
 		return -E_INVAL;
 	}
-	filemap_acquire(file);
 	offset = file->pos;
 	struct device *dev = vop_info(file->node, device);
 	assert(dev);
@@ -502,9 +1055,9 @@ int linux_devfile_write(int fd, void *base, size_t len, size_t * copied_store)
 	}
 
 	if (!file->writable) {
+		filemap_release(file);
 		return -E_INVAL;
 	}
-	filemap_acquire(file);
 	offset = file->pos;
 	struct device *dev = vop_info(file->node, device);
 	assert(dev);
@@ -525,7 +1078,6 @@ int linux_devfile_ioctl(int fd, unsigned int cmd, unsigned long arg)
 	if ((ret = fd2file(fd, &file)) != 0) {
 		return 0;
 	}
-	filemap_acquire(file);
 	struct device *dev = vop_info(file->node, device);
 	assert(dev);
 	ret = dev->d_linux_ioctl(dev, cmd, arg);
@@ -541,7 +1093,6 @@ void *linux_devfile_mmap2(void *addr, size_t len, int prot, int flags, int fd,
 	if ((ret = fd2file(fd, &file)) != 0) {
 		return NULL;
 	}
-	filemap_acquire(file);
 	struct device *dev = vop_info(file->node, device);
 	assert(dev);
 	void *r = dev->d_linux_mmap(dev, addr, len, prot, flags, pgoff);
@@ -614,6 +1165,9 @@ void *linux_regfile_mmap2(void *addr, size_t len, int prot, int flags, int fd,
 	if (!(flags & MAP_ANONYMOUS)) {
 		vma_mapfile(vma, fd, off << 12, NULL);
 	}
+	if (flags & MAP_POPULATE) {
+		mm_populate(mm, start, start + len);
+	}
 	subret = 0;
 out_unlock:
 	unlock_mm(mm);
@@ -634,9 +1188,7 @@ int filestruct_read(struct file *file, void *base, size_t len)
 	struct iobuf __iob, *iob = iobuf_init(&__iob, base, len, file->pos);
 	vop_read(file->node, iob);
 	size_t copied = iobuf_used(iob);
-	if (file->status == FD_OPENED) {
-		file->pos += copied;
-	}
+	file->pos += copied;
 	return copied;
 }
 
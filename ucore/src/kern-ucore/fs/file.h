@@ -10,6 +10,11 @@
 struct inode;
 struct stat;
 struct dirent;
+struct iovec;
+struct epoll_event;
+
+/* the pos of file_pread and the like that stands for the position of fd */
+#define FILE_POS_CUR                ((off_t)-1)
 
 #ifdef __NO_UCORE_FILE__
 struct ucore_file {
@@ -17,20 +22,16 @@ struct ucore_file {
 struct file {
 #endif
 	enum {
-		FD_NONE, FD_INIT, FD_OPENED, FD_CLOSED,
+		FD_INIT, FD_OPENED,
 	} status;
 	bool readable;
 	bool writable;
-	int fd;
 	off_t pos;
 	struct inode *node;
-	atomic_t open_count;
+	atomic_t open_count;	// the fds, mappings and calls in progress on it
 };
 
-void filemap_init(struct file *filemap);
-void filemap_open(struct file *file);
-void filemap_close(struct file *file);
-void filemap_dup(struct file *to, struct file *from);
+void file_init(void);
 
 void filemap_acquire(struct file *file);
 void filemap_release(struct file *file);
@@ -41,14 +42,44 @@ int file_open(char *path, uint32_t open_flags);
 int file_close(int fd);
 int file_read(int fd, void *base, size_t len, size_t * copied_store);
 int file_write(int fd, void *base, size_t len, size_t * copied_store);
+int file_pread(int fd, void *base, size_t len, off_t pos,
+	       size_t * copied_store);
+int file_pwrite(int fd, void *base, size_t len, off_t pos,
+		size_t * copied_store);
+bool file_vectored(int fd, bool write);
+int file_readv(int fd, struct iovec *iov, int iovcnt, off_t pos,
+	       size_t * copied_store);
+int file_writev(int fd, struct iovec *iov, int iovcnt, off_t pos,
+		size_t * copied_store);
 int file_seek(int fd, off_t pos, int whence);
 int file_fstat(int fd, struct stat *stat);
 int file_fsync(int fd);
+int file_fallocate(int fd, int mode, off_t off, off_t len);
+int file_getnode(int fd, struct inode **node_store);
+int file_describe(int fd, char *path, size_t len, uint32_t * open_flags_store,
+		  off_t * pos_store);
+int file_fcntl(int fd, int cmd, int arg);
+int file_splice(int fd_in, int fd_out, size_t len, bool tee,
+		size_t * copied_store);
+int file_copy_range(int fd_in, off_t * off_in, int fd_out, off_t * off_out,
+		    size_t len, size_t * copied_store);
 int file_getdirentry(int fd, struct dirent *dirent);
+int file_getdents(int fd, void *buf, size_t len, size_t * copied_store);
 int file_dup(int fd1, int fd2);
 int file_pipe(int fd[]);
 int file_mkfifo(const char *name, uint32_t open_flags);
+int file_epoll_create(void);
+int file_epoll_ctl(int epfd, int op, int type, int id,
+		   struct epoll_event *event);
+int file_socket(void);
+int file_bind(int fd, uint32_t addr, uint16_t port);
+int file_listen(int fd, int backlog);
+int file_accept(int fd, uint32_t * addr_store, uint16_t * port_store);
+int file_connect(int fd, uint32_t addr, uint16_t port);
+int file_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+		    unsigned int timeout);
 
+bool __is_linux_devfile(int fd);
 int linux_devfile_read(int fd, void *base, size_t len, size_t * copied_store);
 int linux_devfile_write(int fd, void *base, size_t len, size_t * copied_store);
 int linux_devfile_ioctl(int fd, unsigned int cmd, unsigned long arg);
@@ -1,19 +1,27 @@
 #include <types.h>
+#include <string.h>
+#include <stdio.h>
 #include <slab.h>
+#include <vmalloc.h>
 #include <sem.h>
 #include <vfs.h>
 #include <dev.h>
 #include <file.h>
 #include <pipe.h>
+#include <procfs.h>
 #include <sfs.h>
 #include <inode.h>
+#include <unistd.h>
+#include <error.h>
 #include <assert.h>
 
 void fs_init(void)
 {
 	vfs_init();
+	file_init();
 	dev_init();
 	pipe_init();
+	procfs_init();
 	sfs_init();
 }
 
@@ -33,17 +41,92 @@ void unlock_fs(struct fs_struct *fs_struct)
 	up(&(fs_struct->fs_sem));
 }
 
+/* 32 fds a word of open_fds */
+#define FDS_PER_WORD                32
+
+static struct fdtable *fdtable_alloc(int max_fds)
+{
+	struct fdtable *fdt;
+	size_t fd_size = max_fds * sizeof(struct file *);
+	size_t bits_size = max_fds / FDS_PER_WORD * sizeof(uint32_t);
+	fdt = kvmalloc(sizeof(struct fdtable) + fd_size + bits_size);
+	if (fdt != NULL) {
+		fdt->max_fds = max_fds, fdt->next_fd = 0;
+		fdt->fd = (struct file **)(fdt + 1);
+		fdt->open_fds = (uint32_t *) ((void *)fdt->fd + fd_size);
+		memset(fdt->fd, 0, fd_size + bits_size);
+	}
+	return fdt;
+}
+
+static inline bool fdtable_test(struct fdtable *fdt, int fd)
+{
+	return (fdt->open_fds[fd / FDS_PER_WORD] >> (fd % FDS_PER_WORD)) & 1;
+}
+
+static inline void fdtable_set(struct fdtable *fdt, int fd)
+{
+	fdt->open_fds[fd / FDS_PER_WORD] |= 1U << (fd % FDS_PER_WORD);
+}
+
+static inline void fdtable_clear(struct fdtable *fdt, int fd)
+{
+	fdt->open_fds[fd / FDS_PER_WORD] &= ~(1U << (fd % FDS_PER_WORD));
+	if (fd < fdt->next_fd) {
+		fdt->next_fd = fd;
+	}
+}
+
+// fdtable_find_free - the lowest free fd from start on, -1 if none
+static int fdtable_find_free(struct fdtable *fdt, int start)
+{
+	int i = start / FDS_PER_WORD, n = fdt->max_fds / FDS_PER_WORD;
+	if (i >= n) {
+		return -1;
+	}
+	uint32_t word = fdt->open_fds[i] | ((1U << (start % FDS_PER_WORD)) - 1);
+	while (word == 0xFFFFFFFF) {
+		if (++i == n) {
+			return -1;
+		}
+		word = fdt->open_fds[i];
+	}
+	return i * FDS_PER_WORD + __builtin_ctz(~word);
+}
+
+/* *
+ * The fd table is locked only while the fs_struct is shared by threads: a
+ * process of its own is the only one to look at its table, and cannot start
+ * sharing it in the middle of a lookup.
+ * */
+static inline bool files_lock(struct fs_struct *fs_struct)
+{
+	if (fs_count(fs_struct) > 1) {
+		spinlock_acquire(&(fs_struct->files_lock));
+		return 1;
+	}
+	return 0;
+}
+
+static inline void files_unlock(struct fs_struct *fs_struct, bool locked)
+{
+	if (locked) {
+		spinlock_release(&(fs_struct->files_lock));
+	}
+}
+
 struct fs_struct *fs_create(void)
 {
-	static_assert((int)FS_STRUCT_NENTRY > 128);
 	struct fs_struct *fs_struct;
-	if ((fs_struct =
-	     kmalloc(sizeof(struct fs_struct) + FS_STRUCT_BUFSIZE)) != NULL) {
+	if ((fs_struct = kmalloc(sizeof(struct fs_struct))) != NULL) {
+		if ((fs_struct->fdt = fdtable_alloc(FS_DEFAULT_FDS)) == NULL) {
+			kfree(fs_struct);
+			return NULL;
+		}
 		fs_struct->pwd = NULL;
-		fs_struct->filemap = (void *)(fs_struct + 1);
+		spinlock_init(&(fs_struct->files_lock));
 		atomic_set(&(fs_struct->fs_count), 0);
 		sem_init(&(fs_struct->fs_sem), 1);
-		filemap_init(fs_struct->filemap);
 	}
 	return fs_struct;
 }
@@ -54,50 +137,196 @@ void fs_destroy(struct fs_struct *fs_struct)
 	if (fs_struct->pwd != NULL) {
 		vop_ref_dec(fs_struct->pwd);
 	}
-	int i;
-	struct file *file = fs_struct->filemap;
-	for (i = 0; i < FS_STRUCT_NENTRY; i++, file++) {
-		if (file->status == FD_OPENED) {
-			filemap_close(file);
+	int fd;
+	struct fdtable *fdt = fs_struct->fdt;
+	for (fd = 0; fd < fdt->max_fds; fd++) {
+		if (fdt->fd[fd] != NULL) {
+			filemap_release(fdt->fd[fd]);
 		}
-		if (file->status != FD_NONE)
-			kprintf("file->fd:%d\n", file->fd);
-		assert(file->status == FD_NONE);
 	}
+	kvfree(fdt);
 	kfree(fs_struct);
 }
 
 void fs_closeall(struct fs_struct *fs_struct)
 {
 	assert(fs_struct != NULL && fs_count(fs_struct) > 0);
-	int i;
-	struct file *file = fs_struct->filemap;
-	for (i = 3, file += 2; i < FS_STRUCT_NENTRY; i++, file++) {
-		if (file->status == FD_OPENED) {
-			filemap_close(file);
+	int fd;
+	struct file *file;
+	for (fd = 3; fd < fs_struct->fdt->max_fds; fd++) {
+		if ((file = fd_remove(fs_struct, fd)) != NULL) {
+			filemap_release(file);
 		}
 	}
 }
 
+// dup_fs - to shares the open files of from, each with a reference more
 int dup_fs(struct fs_struct *to, struct fs_struct *from)
 {
 	assert(to != NULL && from != NULL);
 	assert(fs_count(to) == 0 && fs_count(from) > 0);
+	struct fdtable *fdt = NULL, *from_fdt;
+	bool locked;
+	int fd;
+	while (1) {
+		locked = files_lock(from);
+		from_fdt = from->fdt;
+		if (fdt != NULL && fdt->max_fds == from_fdt->max_fds) {
+			break;
+		}
+		int max_fds = from_fdt->max_fds;
+		files_unlock(from, locked);
+		if (fdt != NULL) {
+			kvfree(fdt);
+		}
+		if ((fdt = fdtable_alloc(max_fds)) == NULL) {
+			return -E_NO_MEM;
+		}
+	}
+	/* the fds taken but not installed yet stay with from */
+	for (fd = 0; fd < from_fdt->max_fds; fd++) {
+		struct file *file = from_fdt->fd[fd];
+		if (file != NULL) {
+			filemap_acquire(file);
+			fdt->fd[fd] = file;
+			fdtable_set(fdt, fd);
+		}
+	}
+	files_unlock(from, locked);
+
 	if ((to->pwd = from->pwd) != NULL) {
 		vop_ref_inc(to->pwd);
 	}
-	int i;
-	struct file *to_file = to->filemap, *from_file = from->filemap;
-	for (i = 0; i < FS_STRUCT_NENTRY; i++, to_file++, from_file++) {
-		if (from_file->status == FD_OPENED) {
-			/* alloc_fd first */
-			to_file->status = FD_INIT;
-			filemap_dup(to_file, from_file);
+	kvfree(to->fdt);
+	to->fdt = fdt;
+	return 0;
+}
+
+// fd_reserve - take fd, or the lowest free fd if fd is NO_FD, for a file
+//            - fd_install puts there later; the table grows if need be
+int fd_reserve(struct fs_struct *fs_struct, int fd)
+{
+	struct fdtable *fdt, *nfdt = NULL;
+	bool locked, grow;
+	int ret, max_fds;
+	if (fd != NO_FD && (fd < 0 || fd >= FS_MAX_FDS)) {
+		return -E_INVAL;
+	}
+	while (1) {
+		locked = files_lock(fs_struct);
+		fdt = fs_struct->fdt;
+		if (nfdt != NULL && nfdt->max_fds > fdt->max_fds) {
+			/* nfdt takes over, the old table is freed below */
+			memcpy(nfdt->fd, fdt->fd, fdt->max_fds * sizeof(struct file *));
+			memcpy(nfdt->open_fds, fdt->open_fds,
+			       fdt->max_fds / FDS_PER_WORD * sizeof(uint32_t));
+			nfdt->next_fd = fdt->next_fd;
+			fs_struct->fdt = nfdt, nfdt = fdt, fdt = fs_struct->fdt;
+		}
+		grow = 0, ret = fd;
+		if (fd == NO_FD) {
+			if ((ret = fdtable_find_free(fdt, fdt->next_fd)) < 0) {
+				grow = 1;
+			} else {
+				fdt->next_fd = ret + 1;
+			}
+		} else if (fd >= fdt->max_fds) {
+			grow = 1;
+		} else if (fdtable_test(fdt, fd)) {
+			ret = -E_BUSY;
 		}
-		else if(from_file->status != FD_NONE) {
-			to_file->status = from_file->status;
-			filemap_dup_close(to_file, from_file);
+		if (!grow && ret >= 0) {
+			fdtable_set(fdt, ret);
+		}
+		max_fds = fdt->max_fds;
+		files_unlock(fs_struct, locked);
+
+		if (nfdt != NULL) {
+			kvfree(nfdt);
+			nfdt = NULL;
+		}
+		if (!grow) {
+			return ret;
+		}
+		if (max_fds >= FS_MAX_FDS) {
+			return -E_MAX_OPEN;
+		}
+		do {
+			max_fds *= 2;
+		} while (fd != NO_FD && fd >= max_fds);
+		if ((nfdt = fdtable_alloc(max_fds)) == NULL) {
+			return -E_NO_MEM;
 		}
 	}
-	return 0;
+}
+
+// fd_unreserve - give back fd, taken by fd_reserve but never installed
+void fd_unreserve(struct fs_struct *fs_struct, int fd)
+{
+	bool locked = files_lock(fs_struct);
+	struct fdtable *fdt = fs_struct->fdt;
+	assert(fdtable_test(fdt, fd) && fdt->fd[fd] == NULL);
+	fdtable_clear(fdt, fd);
+	files_unlock(fs_struct, locked);
+}
+
+// fd_install - put file at fd, taken by fd_reserve; the table keeps the
+//            - reference of the caller
+void fd_install(struct fs_struct *fs_struct, int fd, struct file *file)
+{
+	bool locked = files_lock(fs_struct);
+	struct fdtable *fdt = fs_struct->fdt;
+	assert(fdtable_test(fdt, fd) && fdt->fd[fd] == NULL);
+	fdt->fd[fd] = file;
+	files_unlock(fs_struct, locked);
+}
+
+// fd_remove - free fd, the file there is returned with the reference the
+//           - table had, NULL if none
+struct file *fd_remove(struct fs_struct *fs_struct, int fd)
+{
+	struct file *file = NULL;
+	bool locked = files_lock(fs_struct);
+	struct fdtable *fdt = fs_struct->fdt;
+	if (fd >= 0 && fd < fdt->max_fds && (file = fdt->fd[fd]) != NULL) {
+		fdt->fd[fd] = NULL;
+		fdtable_clear(fdt, fd);
+	}
+	files_unlock(fs_struct, locked);
+	return file;
+}
+
+// fd_show - a line for each fd of fs_struct in use, its access and offset,
+//         - into buf of size bytes; the length is returned. The table of
+//         - another proc is read without its lock, as a hint
+size_t fd_show(struct fs_struct *fs_struct, char *buf, size_t size)
+{
+	size_t len = 0;
+	bool locked = files_lock(fs_struct);
+	struct fdtable *fdt = fs_struct->fdt;
+	struct file *file;
+	int fd;
+	for (fd = 0; fd < fdt->max_fds && len < size; fd++) {
+		if ((file = fdt->fd[fd]) != NULL) {
+			len += snprintf(buf + len, size - len, "%d %c%c %lld\n",
+					fd, file->readable ? 'r' : '-',
+					file->writable ? 'w' : '-',
+					(long long)file->pos);
+		}
+	}
+	files_unlock(fs_struct, locked);
+	return (len < size) ? len : size;
+}
+
+// fd_get - the file at fd with a reference for the caller, NULL if none
+struct file *fd_get(struct fs_struct *fs_struct, int fd)
+{
+	struct file *file = NULL;
+	bool locked = files_lock(fs_struct);
+	struct fdtable *fdt = fs_struct->fdt;
+	if (fd >= 0 && fd < fdt->max_fds && (file = fdt->fd[fd]) != NULL) {
+		filemap_acquire(file);
+	}
+	files_unlock(fs_struct, locked);
+	return file;
 }
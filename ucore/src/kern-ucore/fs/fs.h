@@ -5,6 +5,7 @@
 #include <mmu.h>
 #include <sem.h>
 #include <atomic.h>
+#include <spinlock.h>
 
 #define SECTSIZE            512
 #define PAGE_NSECT          (PGSIZE / SECTSIZE)
@@ -19,16 +20,29 @@ void fs_cleanup(void);
 struct inode;
 struct file;
 
+/* *
+ * The fd table. fd[i] is the file open at fd i, bit i of open_fds is set
+ * once i is taken, before the file is installed, and next_fd is below the
+ * lowest free fd. The table doubles when it fills up, to FS_MAX_FDS.
+ * */
+struct fdtable {
+	int max_fds;
+	int next_fd;
+	struct file **fd;
+	uint32_t *open_fds;
+};
+
+#define FS_DEFAULT_FDS                          32
+#define FS_MAX_FDS                              1024
+
 struct fs_struct {
 	struct inode *pwd;
-	struct file *filemap;
+	struct fdtable *fdt;
+	spinlock_s files_lock;	// guards fdt, when the fs_struct is shared
 	atomic_t fs_count;
 	semaphore_t fs_sem;
 };
 
-#define FS_STRUCT_BUFSIZE                       (2 * PGSIZE - sizeof(struct fs_struct))
-#define FS_STRUCT_NENTRY                        (FS_STRUCT_BUFSIZE / sizeof(struct file))
-
 void lock_fs(struct fs_struct *fs_struct);
 void unlock_fs(struct fs_struct *fs_struct);
 
@@ -37,6 +51,13 @@ void fs_destroy(struct fs_struct *fs_struct);
 void fs_closeall(struct fs_struct *fs_struct);
 int dup_fs(struct fs_struct *to, struct fs_struct *from);
 
+int fd_reserve(struct fs_struct *fs_struct, int fd);
+void fd_unreserve(struct fs_struct *fs_struct, int fd);
+void fd_install(struct fs_struct *fs_struct, int fd, struct file *file);
+struct file *fd_remove(struct fs_struct *fs_struct, int fd);
+struct file *fd_get(struct fs_struct *fs_struct, int fd);
+size_t fd_show(struct fs_struct *fs_struct, char *buf, size_t size);
+
 static inline int fs_count(struct fs_struct *fs_struct)
 {
 	return atomic_read(&(fs_struct->fs_count));
@@ -10,6 +10,26 @@ struct iobuf *iobuf_init(struct iobuf *iob, void *base, size_t len,
 	iob->io_base = base;
 	iob->io_offset = offset;
 	iob->io_len = iob->io_resid = len;
+	iob->io_iov = NULL, iob->io_iovcnt = 0, iob->io_seg_resid = 0;
+	return iob;
+}
+
+struct iobuf *iobuf_init_vec(struct iobuf *iob, struct iovec *iov,
+			     int iovcnt, off_t offset)
+{
+	assert(iovcnt > 0);
+	size_t len = 0;
+	int i;
+	for (i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+	iob->io_base = iov->iov_base;
+	iob->io_offset = offset;
+	iob->io_len = iob->io_resid = len;
+	iob->io_iov = iov, iob->io_iovcnt = iovcnt;
+	iob->io_seg_resid = iov->iov_len;
+	/* steps over the empty segments in front */
+	iobuf_skip(iob, 0);
 	return iob;
 }
 
@@ -17,37 +37,47 @@ int
 iobuf_move(struct iobuf *iob, void *data, size_t len, bool m2b,
 	   size_t * copiedp)
 {
-	size_t alen;
+	size_t alen, copied = 0;
 	if ((alen = iob->io_resid) > len) {
 		alen = len;
 	}
-	if (alen > 0) {
+	while (alen > 0) {
+		size_t n = iobuf_seg(iob);
+		if (n > alen) {
+			n = alen;
+		}
 		void *src = iob->io_base, *dst = data;
 		if (m2b) {
 			void *tmp = src;
 			src = dst, dst = tmp;
 		}
-		memmove(dst, src, alen);
-		iobuf_skip(iob, alen), len -= alen;
+		memmove(dst, src, n);
+		iobuf_skip(iob, n), len -= n, alen -= n;
+		data += n, copied += n;
 	}
 	if (copiedp != NULL) {
-		*copiedp = alen;
+		*copiedp = copied;
 	}
 	return (len == 0) ? 0 : -E_NO_MEM;
 }
 
 int iobuf_move_zeros(struct iobuf *iob, size_t len, size_t * copiedp)
 {
-	size_t alen;
+	size_t alen, copied = 0;
 	if ((alen = iob->io_resid) > len) {
 		alen = len;
 	}
-	if (alen > 0) {
-		memset(iob->io_base, 0, alen);
-		iobuf_skip(iob, alen), len -= alen;
+	while (alen > 0) {
+		size_t n = iobuf_seg(iob);
+		if (n > alen) {
+			n = alen;
+		}
+		memset(iob->io_base, 0, n);
+		iobuf_skip(iob, n), len -= n, alen -= n;
+		copied += n;
 	}
 	if (copiedp != NULL) {
-		*copiedp = alen;
+		*copiedp = copied;
 	}
 	return (len == 0) ? 0 : -E_NO_MEM;
 }
@@ -55,5 +85,59 @@ int iobuf_move_zeros(struct iobuf *iob, size_t len, size_t * copiedp)
 void iobuf_skip(struct iobuf *iob, size_t n)
 {
 	assert(iob->io_resid >= n);
-	iob->io_base += n, iob->io_offset += n, iob->io_resid -= n;
+	iob->io_offset += n, iob->io_resid -= n;
+	if (iob->io_iov == NULL) {
+		iob->io_base += n;
+		return;
+	}
+	while (n >= iob->io_seg_resid && iob->io_iovcnt > 1) {
+		n -= iob->io_seg_resid;
+		iob->io_iov++, iob->io_iovcnt--;
+		iob->io_base = iob->io_iov->iov_base;
+		iob->io_seg_resid = iob->io_iov->iov_len;
+	}
+	assert(n <= iob->io_seg_resid);
+	iob->io_base += n, iob->io_seg_resid -= n;
+}
+
+/*
+ * iobuf_iov - describe up to len bytes from the current position of iob
+ * with at most iovcnt segments, without moving it. Returns the # of
+ * segments, the # of bytes they hold is stored in lenp.
+ */
+int
+iobuf_iov(struct iobuf *iob, struct iovec *iov, int iovcnt, size_t len,
+	  size_t * lenp)
+{
+	size_t total = 0;
+	int n = 0;
+	if (len > iob->io_resid) {
+		len = iob->io_resid;
+	}
+	if (iob->io_iov == NULL) {
+		if (len != 0 && iovcnt != 0) {
+			iov[n].iov_base = iob->io_base, iov[n++].iov_len = len;
+			total = len;
+		}
+	} else {
+		char *base = iob->io_base;
+		size_t seg = iob->io_seg_resid;
+		struct iovec *next = iob->io_iov + 1;
+		int left = iob->io_iovcnt - 1;
+		while (total < len && n < iovcnt) {
+			if (seg != 0) {
+				if (seg > len - total) {
+					seg = len - total;
+				}
+				iov[n].iov_base = base, iov[n++].iov_len = seg;
+				total += seg;
+			}
+			if (left-- == 0) {
+				break;
+			}
+			base = next->iov_base, seg = next->iov_len, next++;
+		}
+	}
+	*lenp = total;
+	return n;
 }
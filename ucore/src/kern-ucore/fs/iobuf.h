@@ -7,18 +7,25 @@
  * Like BSD uio, but simplified a lot. (In BSD, there can be one or more
  * iovec in a uio.)
  *
+ * A vectored iobuf, set up by iobuf_init_vec, moves data through a list
+ * of segments instead; io_base then points into io_iov[0], which has
+ * io_seg_resid bytes left. Drivers that can transfer to several buffers
+ * with one request get the segments through iobuf_iov.
  */
 
+struct iovec {
+	char *iov_base;
+	size_t iov_len;
+};
+
 struct iobuf {
 	void *io_base;		/* The base addr of object       */
 	off_t io_offset;	/* Desired offset into object    */
 	size_t io_len;		/* The lenght of Data            */
 	size_t io_resid;	/* Remaining amt of data to xfer */
-};
-
-struct iovec {
-	char *iov_base;
-	size_t iov_len;
+	struct iovec *io_iov;	/* segments of a vectored iobuf, else NULL */
+	int io_iovcnt;		/* # of segments left in io_iov */
+	size_t io_seg_resid;	/* data left in io_iov[0] */
 };
 
 /*
@@ -48,8 +55,13 @@ struct iovec {
 
 #define iobuf_used(iob)                         ((size_t)((iob)->io_len - (iob)->io_resid))
 
+/* the contiguous data left at io_base */
+#define iobuf_seg(iob)                          ((iob)->io_iov == NULL ? (iob)->io_resid : (iob)->io_seg_resid)
+
 struct iobuf *iobuf_init(struct iobuf *iob, void *base, size_t len,
 			 off_t offset);
+struct iobuf *iobuf_init_vec(struct iobuf *iob, struct iovec *iov,
+			     int iovcnt, off_t offset);
 int iobuf_move(struct iobuf *iob, void *data, size_t len, bool m2b,
 	       size_t * copiedp);
 /*
@@ -57,5 +69,7 @@ int iobuf_move(struct iobuf *iob, void *data, size_t len, bool m2b,
  */
 int iobuf_move_zeros(struct iobuf *iob, size_t len, size_t * copiedp);
 void iobuf_skip(struct iobuf *iob, size_t n);
+int iobuf_iov(struct iobuf *iob, struct iovec *iov, int iovcnt, size_t len,
+	      size_t * lenp);
 
 #endif /* !__KERN_FS_IOBUF_H__ */
@@ -52,6 +52,9 @@ struct nand_chip {
 	void (*write_byte) (unsigned char byte);
 	void (*wait_rdy) ();
 	void (*write_full_addr) (unsigned int row, unsigned int col);
+	/* len bytes through the data register in a row */
+	void (*read_buf) (unsigned char *buf, unsigned len);
+	void (*write_buf) (const unsigned char *buf, unsigned len);
 
 	int (*ecc_calculate) (const unsigned char *dat, size_t sz,
 			      unsigned char *ecc_code);
@@ -63,6 +66,11 @@ struct nand_chip {
 			  unsigned char *data, unsigned char *spare,
 			  int *eccStatus);
 
+	/* the spare area alone, size of spare buffer>=spare_size; NULL if
+	 * the chip cannot start a read past the main area */
+	int (*read_spare) (struct nand_chip * chip, unsigned page_id,
+			   unsigned char *spare);
+
 	/* spare data only contain user data, ecc auto-appended */
 	int (*write_page) (struct nand_chip * chip, unsigned pageId,
 			   const unsigned char *data, unsigned dataLength,
@@ -1,7 +1,7 @@
 #include <types.h>
 #include <slab.h>
 #include <list.h>
-#include <sem.h>
+#include <kmutex.h>
 #include <vfs.h>
 #include <inode.h>
 #include <pipe.h>
@@ -10,12 +10,12 @@
 
 void lock_pipe(struct pipe_fs *pipe)
 {
-	down(&(pipe->pipe_sem));
+	kmutex_lock(&(pipe->pipe_mutex));
 }
 
 void unlock_pipe(struct pipe_fs *pipe)
 {
-	up(&(pipe->pipe_sem));
+	kmutex_unlock(&(pipe->pipe_mutex));
 }
 
 static int pipe_sync(struct fs *fs)
@@ -47,7 +47,7 @@ static void pipe_fs_init(struct fs *fs)
 	if ((pipe->root = pipe_create_root(fs)) == NULL) {
 		panic("pipe: create root inode failed.\n");
 	}
-	sem_init(&(pipe->pipe_sem), 1);
+	kmutex_init(&(pipe->pipe_mutex));
 	list_init(&(pipe->pipe_list));
 
 	fs->fs_sync = pipe_sync;
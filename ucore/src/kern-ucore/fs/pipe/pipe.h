@@ -3,7 +3,7 @@
 
 #include <types.h>
 #include <list.h>
-#include <sem.h>
+#include <kmutex.h>
 
 struct fs;
 struct inode;
@@ -11,7 +11,7 @@ struct pipe_state;
 
 struct pipe_fs {
 	struct inode *root;
-	semaphore_t pipe_sem;
+	kmutex_t pipe_mutex;
 	list_entry_t pipe_list;
 };
 
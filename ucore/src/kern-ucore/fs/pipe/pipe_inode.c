@@ -1,4 +1,5 @@
 #include <types.h>
+#include <mmu.h>
 #include <string.h>
 #include <slab.h>
 #include <vfs.h>
@@ -8,6 +9,7 @@
 #include <iobuf.h>
 #include <stat.h>
 #include <unistd.h>
+#include <poll.h>
 #include <error.h>
 #include <assert.h>
 
@@ -54,11 +56,12 @@ static int pipe_inode_write(struct inode *node, struct iobuf *iob)
 	if (pin->pin_type != PIN_WRONLY) {
 		return -E_INVAL;
 	}
-	size_t ret;
-	if ((ret =
-	     pipe_state_write(pin->state, iob->io_base, iob->io_resid)) != 0) {
+	size_t ret, seg;
+	do {
+		seg = iobuf_seg(iob);
+		ret = pipe_state_write(pin->state, iob->io_base, seg);
 		iobuf_skip(iob, ret);
-	}
+	} while (ret == seg && iob->io_resid != 0);
 	return 0;
 }
 
@@ -112,6 +115,33 @@ static int pipe_inode_reclaim(struct inode *node)
 	return 0;
 }
 
+// pipe_inode_ioctl - F_GETPIPE_SZ and F_SETPIPE_SZ, the size in bytes at data,
+//                  - and IOCTL_POLL
+static int pipe_inode_ioctl(struct inode *node, int op, void *data)
+{
+	struct pipe_inode *pin = vop_info(node, pipe_inode);
+	int ret, *size = data;
+	switch (op) {
+	case IOCTL_POLL:
+		pipe_state_poll(pin->state, pin->pin_type == PIN_WRONLY, data);
+		return 0;
+	case F_SETPIPE_SZ:
+		if (*size <= 0) {
+			return -E_INVAL;
+		}
+		if ((ret =
+		     pipe_state_resize(pin->state,
+				       ROUNDUP(*size, PGSIZE) / PGSIZE)) != 0) {
+			return ret;
+		}
+		/* fall through */
+	case F_GETPIPE_SZ:
+		*size = pipe_state_capacity(pin->state);
+		return 0;
+	}
+	return -E_INVAL;
+}
+
 static int pipe_inode_gettype(struct inode *node, uint32_t * type_store)
 {
 	*type_store = S_IFCHR;
@@ -134,7 +164,7 @@ static const struct inode_ops pipe_node_ops = {
 	.vop_namefile = pipe_inode_namefile,
 	.vop_getdirentry = NULL_VOP_INVAL,
 	.vop_reclaim = pipe_inode_reclaim,
-	.vop_ioctl = NULL_VOP_INVAL,
+	.vop_ioctl = pipe_inode_ioctl,
 	.vop_gettype = pipe_inode_gettype,
 	.vop_tryseek = NULL_VOP_INVAL,
 	.vop_truncate = NULL_VOP_INVAL,
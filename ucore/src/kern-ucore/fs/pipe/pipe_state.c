@@ -1,64 +1,156 @@
 #include <types.h>
+#include <string.h>
+#include <pmm.h>
 #include <wait.h>
 #include <slab.h>
+#include <vmalloc.h>
 #include <mmu.h>
 #include <sync.h>
 #include <proc.h>
 #include <sched.h>
-#include <sem.h>
+#include <kmutex.h>
+#include <poll.h>
 #include <atomic.h>
 #include <pipe.h>
 #include <pipe_state.h>
 #include <error.h>
 #include <assert.h>
 
+/*
+ * The data of a pipe is a ring of up to nr_bufs pages, each with the range
+ * of it that holds data. A write fills the last page while the pipe is its
+ * only holder, then takes a new one, and a read frees the pages it empties.
+ * splice and tee hand the page references to another pipe instead of the
+ * bytes; a page held by several pipes is never written again.
+ */
+struct pipe_buf {
+	struct Page *page;
+	size_t offset, len;
+};
+
 struct pipe_state {
-	off_t p_rpos;
-	off_t p_wpos;
-	uint8_t *buf;
+	struct pipe_buf *bufs;
+	int nr_bufs;		// slots of bufs, the capacity in pages
+	int head, used;		// the first slot holding data, # of them
+	size_t bytes;
 	bool isclosed;
 	int ref_count;
-	semaphore_t sem;
+	kmutex_t mutex;
 	wait_queue_t reader_queue;
 	wait_queue_t writer_queue;
+	poll_head_t poll;	/* EPOLLIN on writes, EPOLLOUT on reads */
 };
 
-#define PIPE_BUFSIZE                            (PGSIZE - sizeof(struct pipe_state))
+#define PIPE_DEF_BUFS                           4
+#define PIPE_MAX_BUFS                           1024
 
 struct pipe_state *pipe_state_create(void)
 {
-	static_assert((int)PIPE_BUFSIZE > 128);
 	struct pipe_state *state;
-	if ((state = kmalloc(sizeof(struct pipe_state) + PIPE_BUFSIZE)) != NULL) {
-		state->p_rpos = state->p_wpos = 0;
-		state->buf = (uint8_t *) (state + 1);
+	if ((state = kmalloc(sizeof(struct pipe_state))) != NULL) {
+		if ((state->bufs =
+		     kvmalloc(sizeof(struct pipe_buf) * PIPE_DEF_BUFS)) == NULL) {
+			kfree(state);
+			return NULL;
+		}
+		state->nr_bufs = PIPE_DEF_BUFS;
+		state->head = state->used = 0;
+		state->bytes = 0;
 		state->isclosed = 0;
 		state->ref_count = 1;
-		sem_init(&(state->sem), 1);
+		kmutex_init(&(state->mutex));
 		wait_queue_init(&(state->reader_queue));
 		wait_queue_init(&(state->writer_queue));
+		poll_head_init(&(state->poll));
 	}
 	return state;
 }
 
 static void lock_state(struct pipe_state *state)
 {
-	down(&(state->sem));
+	kmutex_lock(&(state->mutex));
 }
 
 static void unlock_state(struct pipe_state *state)
 {
-	up(&(state->sem));
+	kmutex_unlock(&(state->mutex));
+}
+
+static void lock_two(struct pipe_state *a, struct pipe_state *b)
+{
+	if (a < b) {
+		lock_state(a), lock_state(b);
+	} else {
+		lock_state(b), lock_state(a);
+	}
+}
+
+static void unlock_two(struct pipe_state *a, struct pipe_state *b)
+{
+	unlock_state(a), unlock_state(b);
 }
 
 static inline bool is_empty(struct pipe_state *state)
 {
-	return state->p_rpos == state->p_wpos;
+	return state->used == 0;
 }
 
 static inline bool is_full(struct pipe_state *state)
 {
-	return state->p_wpos - state->p_rpos >= PIPE_BUFSIZE;
+	return state->used == state->nr_bufs;
+}
+
+static inline struct pipe_buf *pipe_buf_at(struct pipe_state *state, int i)
+{
+	return state->bufs + (state->head + i) % state->nr_bufs;
+}
+
+// pipe_buf_tail - the last buf if a write may go on filling it
+static struct pipe_buf *pipe_buf_tail(struct pipe_state *state)
+{
+	if (state->used != 0) {
+		struct pipe_buf *pb = pipe_buf_at(state, state->used - 1);
+		if (page_ref(pb->page) == 1 && pb->offset + pb->len < PGSIZE) {
+			return pb;
+		}
+	}
+	return NULL;
+}
+
+// pipe_page_put - drop a reference to a page of pipe data
+void pipe_page_put(struct Page *page)
+{
+	if (page_ref_dec(page) == 0) {
+		free_page(page);
+	}
+}
+
+// pipe_buf_push - queue len bytes of page at offset, the caller's reference
+//               - to page moves to the pipe
+static void
+pipe_buf_push(struct pipe_state *state, struct Page *page, size_t offset,
+	      size_t len)
+{
+	assert(!is_full(state));
+	struct pipe_buf *pb = pipe_buf_at(state, state->used++);
+	pb->page = page, pb->offset = offset, pb->len = len;
+	state->bytes += len;
+}
+
+// pipe_buf_consume - drop the first n bytes of the pipe
+static void pipe_buf_consume(struct pipe_state *state, size_t n)
+{
+	while (n != 0 && !is_empty(state)) {
+		struct pipe_buf *pb = pipe_buf_at(state, 0);
+		size_t len = (pb->len < n) ? pb->len : n;
+		pb->offset += len, pb->len -= len;
+		state->bytes -= len, n -= len;
+		if (pb->len == 0) {
+			pipe_page_put(pb->page);
+			state->head = (state->head + 1) % state->nr_bufs;
+			state->used--;
+		}
+	}
 }
 
 static bool pipe_state_wait(wait_queue_t * queue)
@@ -91,8 +183,16 @@ static void pipe_state_wakeup(wait_queue_t * queue)
 
 #define wait_reader(state)                          pipe_state_wait(&((state)->writer_queue))
 #define wait_writer(state)                          pipe_state_wait(&((state)->reader_queue))
-#define wakeup_reader(state)                        pipe_state_wakeup(&((state)->reader_queue))
-#define wakeup_writer(state)                        pipe_state_wakeup(&((state)->writer_queue))
+#define wakeup_reader(state)                                            \
+    do {                                                                \
+        pipe_state_wakeup(&((state)->reader_queue));                    \
+        poll_notify(&((state)->poll), EPOLLIN);                         \
+    } while (0)
+#define wakeup_writer(state)                                            \
+    do {                                                                \
+        pipe_state_wakeup(&((state)->writer_queue));                    \
+        poll_notify(&((state)->poll), EPOLLOUT);                        \
+    } while (0)
 
 void pipe_state_acquire(struct pipe_state *state)
 {
@@ -106,6 +206,9 @@ void pipe_state_release(struct pipe_state *state)
 	if (--state->ref_count == 0) {
 		assert(wait_queue_empty(&(state->reader_queue)));
 		assert(wait_queue_empty(&(state->writer_queue)));
+		assert(list_empty(&(state->poll.poll_list)));
+		pipe_buf_consume(state, state->bytes);
+		kvfree(state->bufs);
 		kfree(state);
 	}
 }
@@ -120,14 +223,64 @@ void pipe_state_close(struct pipe_state *state)
 
 size_t pipe_state_size(struct pipe_state *state, bool write)
 {
-	size_t size = state->p_wpos - state->p_rpos;
 	if (write) {
 		if (state->isclosed) {
 			return 0;
 		}
-		return PIPE_BUFSIZE - size;
+		struct pipe_buf *pb = pipe_buf_tail(state);
+		return (state->nr_bufs - state->used) * PGSIZE
+		    + ((pb != NULL) ? PGSIZE - pb->offset - pb->len : 0);
+	}
+	return state->bytes;
+}
+
+// pipe_state_poll - the events ready on the write or the read end
+void
+pipe_state_poll(struct pipe_state *state, bool write, struct poll_query *q)
+{
+	q->head = &(state->poll);
+	if (write) {
+		q->events = state->isclosed ? EPOLLERR
+		    : (pipe_state_size(state, 1) != 0) ? EPOLLOUT : 0;
+	} else {
+		q->events = ((state->bytes != 0) ? EPOLLIN : 0)
+		    | (state->isclosed ? EPOLLHUP : 0);
+	}
+}
+
+// pipe_state_capacity - the bytes the pipe holds at most
+size_t pipe_state_capacity(struct pipe_state *state)
+{
+	return state->nr_bufs * PGSIZE;
+}
+
+// pipe_state_resize - hold up to nr_bufs pages from now on, -E_BUSY if more
+//                   - than that are queued
+int pipe_state_resize(struct pipe_state *state, int nr_bufs)
+{
+	if (nr_bufs <= 0 || nr_bufs > PIPE_MAX_BUFS) {
+		return -E_INVAL;
+	}
+	struct pipe_buf *bufs;
+	if ((bufs = kvmalloc(sizeof(struct pipe_buf) * nr_bufs)) == NULL) {
+		return -E_NO_MEM;
+	}
+	int i, ret = 0;
+	lock_state(state);
+	if (state->used > nr_bufs) {
+		ret = -E_BUSY;
+	} else {
+		for (i = 0; i < state->used; i++) {
+			bufs[i] = *pipe_buf_at(state, i);
+		}
+		struct pipe_buf *old = state->bufs;
+		state->bufs = bufs, bufs = old;
+		state->nr_bufs = nr_bufs, state->head = 0;
+		wakeup_writer(state);
 	}
-	return size;
+	unlock_state(state);
+	kvfree(bufs);
+	return ret;
 }
 
 size_t pipe_state_read(struct pipe_state * state, void *buf, size_t n)
@@ -146,9 +299,12 @@ try_again:
 			goto try_again;
 		}
 	}
-	for (; ret < n && !is_empty(state); ret++, state->p_rpos++) {
-		*(uint8_t *) (buf + ret) =
-		    state->buf[state->p_rpos % PIPE_BUFSIZE];
+	while (ret < n && !is_empty(state)) {
+		struct pipe_buf *pb = pipe_buf_at(state, 0);
+		size_t len = (pb->len < n - ret) ? pb->len : n - ret;
+		memcpy(buf + ret, page2kva(pb->page) + pb->offset, len);
+		pipe_buf_consume(state, len);
+		ret += len;
 	}
 	if (ret != 0) {
 		wakeup_writer(state);
@@ -168,17 +324,31 @@ try_again:
 	if (state->isclosed) {
 		goto out_unlock;
 	}
-	for (step = 0; ret < n; ret++, step++, state->p_wpos++) {
-		if (is_full(state)) {
-			wakeup_reader(state);
-			unlock_state(state);
-			if (!wait_reader(state)) {
-				goto out;
+	for (step = 0; ret < n; step++) {
+		struct pipe_buf *pb;
+		if ((pb = pipe_buf_tail(state)) == NULL) {
+			struct Page *page;
+			if (is_full(state)) {
+				wakeup_reader(state);
+				unlock_state(state);
+				if (!wait_reader(state)) {
+					goto out;
+				}
+				goto try_again;
 			}
-			goto try_again;
+			if ((page = alloc_page()) == NULL) {
+				break;
+			}
+			set_page_ref(page, 1);
+			pipe_buf_push(state, page, 0, 0);
+			pb = pipe_buf_at(state, state->used - 1);
+		}
+		size_t end = pb->offset + pb->len, len = PGSIZE - end;
+		if (len > n - ret) {
+			len = n - ret;
 		}
-		state->buf[state->p_wpos % PIPE_BUFSIZE] =
-		    *(uint8_t *) (buf + ret);
+		memcpy(page2kva(pb->page) + end, buf + ret, len);
+		pb->len += len, state->bytes += len, ret += len;
 	}
 	if (step != 0) {
 		wakeup_reader(state);
@@ -189,3 +359,123 @@ out_unlock:
 out:
 	return ret;
 }
+
+// pipe_state_splice - move up to n bytes from the pipe from to the pipe to
+//                   - by their pages; tee leaves them in from as well
+size_t
+pipe_state_splice(struct pipe_state *from, struct pipe_state *to, size_t n,
+		  bool tee)
+{
+	size_t ret = 0;
+	int i = 0;
+try_again:
+	lock_two(from, to);
+	if (to->isclosed) {
+		goto out_unlock;
+	}
+	if (is_empty(from)) {
+		if (from->isclosed) {
+			goto out_unlock;
+		}
+		unlock_two(from, to);
+		if (!wait_writer(from)) {
+			goto out;
+		}
+		goto try_again;
+	}
+	if (is_full(to)) {
+		unlock_two(from, to);
+		if (!wait_reader(to)) {
+			goto out;
+		}
+		goto try_again;
+	}
+	while (ret < n && i < from->used && !is_full(to)) {
+		struct pipe_buf *pb = pipe_buf_at(from, i);
+		size_t len = (pb->len < n - ret) ? pb->len : n - ret;
+		page_ref_inc(pb->page);
+		pipe_buf_push(to, pb->page, pb->offset, len);
+		ret += len;
+		if (tee) {
+			i++;
+		} else {
+			pipe_buf_consume(from, len);
+		}
+	}
+	wakeup_reader(to);
+	if (!tee) {
+		wakeup_writer(from);
+	}
+
+out_unlock:
+	unlock_two(from, to);
+out:
+	return ret;
+}
+
+// pipe_state_peek - the first page of data, up to n bytes of it from
+//                 - *offset_store on, with a reference for the caller; the
+//                 - bytes stay in the pipe until pipe_state_consume
+size_t
+pipe_state_peek(struct pipe_state *state, size_t n, struct Page **page_store,
+		size_t * offset_store)
+{
+	size_t ret = 0;
+try_again:
+	lock_state(state);
+	if (is_empty(state)) {
+		if (state->isclosed) {
+			goto out_unlock;
+		}
+		unlock_state(state);
+		if (!wait_writer(state)) {
+			goto out;
+		}
+		goto try_again;
+	}
+	struct pipe_buf *pb = pipe_buf_at(state, 0);
+	ret = (pb->len < n) ? pb->len : n;
+	page_ref_inc(pb->page);
+	*page_store = pb->page, *offset_store = pb->offset;
+
+out_unlock:
+	unlock_state(state);
+out:
+	return ret;
+}
+
+void pipe_state_consume(struct pipe_state *state, size_t n)
+{
+	lock_state(state);
+	pipe_buf_consume(state, n);
+	wakeup_writer(state);
+	unlock_state(state);
+}
+
+// pipe_state_put_page - queue len bytes at the start of page, the reference
+//                     - of the caller moves to the pipe; -E_PIPE if it
+//                     - cannot, the caller keeps it then
+int pipe_state_put_page(struct pipe_state *state, struct Page *page, size_t len)
+{
+	int ret = -E_PIPE;
+try_again:
+	lock_state(state);
+	if (state->isclosed) {
+		goto out_unlock;
+	}
+	if (is_full(state)) {
+		unlock_state(state);
+		if (!wait_reader(state)) {
+			goto out;
+		}
+		goto try_again;
+	}
+	pipe_buf_push(state, page, 0, len);
+	wakeup_reader(state);
+	ret = 0;
+
+out_unlock:
+	unlock_state(state);
+out:
+	return ret;
+}
@@ -2,6 +2,8 @@
 #define __KERN_FS_PIPE_PIPE_STATE_H__
 
 struct pipe_state;
+struct poll_query;
+struct Page;
 
 struct pipe_state *pipe_state_create(void);
 void pipe_state_acquire(struct pipe_state *state);
@@ -12,4 +14,18 @@ size_t pipe_state_size(struct pipe_state *state, bool write);
 size_t pipe_state_read(struct pipe_state *state, void *buf, size_t n);
 size_t pipe_state_write(struct pipe_state *state, void *buf, size_t n);
 
+void pipe_state_poll(struct pipe_state *state, bool write,
+		     struct poll_query *q);
+size_t pipe_state_capacity(struct pipe_state *state);
+int pipe_state_resize(struct pipe_state *state, int nr_bufs);
+
+size_t pipe_state_splice(struct pipe_state *from, struct pipe_state *to,
+			 size_t n, bool tee);
+size_t pipe_state_peek(struct pipe_state *state, size_t n,
+		       struct Page **page_store, size_t * offset_store);
+void pipe_state_consume(struct pipe_state *state, size_t n);
+int pipe_state_put_page(struct pipe_state *state, struct Page *page,
+			size_t len);
+void pipe_page_put(struct Page *page);
+
 #endif /* !__KERN_FS_PIPE_PIPE_STATE_H__ */
@@ -0,0 +1,56 @@
+#include <types.h>
+#include <vfs.h>
+#include <inode.h>
+#include <procfs.h>
+#include <error.h>
+#include <assert.h>
+
+static int procfs_sync(struct fs *fs)
+{
+	return 0;
+}
+
+static struct inode *procfs_get_root(struct fs *fs)
+{
+	struct procfs_fs *procfs = fsop_info(fs, procfs);
+	vop_ref_inc(procfs->root);
+	return procfs->root;
+}
+
+static int procfs_unmount(struct fs *fs)
+{
+	return -E_INVAL;
+}
+
+static int procfs_cleanup(struct fs *fs)
+{
+	/* do nothing */
+	return 0;
+}
+
+static void procfs_fs_init(struct fs *fs)
+{
+	struct procfs_fs *procfs = fsop_info(fs, procfs);
+	if ((procfs->root = procfs_create_inode(fs, 0, NULL)) == NULL) {
+		panic("procfs: create root inode failed.\n");
+	}
+
+	fs->fs_sync = procfs_sync;
+	fs->fs_get_root = procfs_get_root;
+	fs->fs_unmount = procfs_unmount;
+	fs->fs_cleanup = procfs_cleanup;
+}
+
+void procfs_init(void)
+{
+	struct fs *fs;
+	if ((fs = alloc_fs(procfs)) == NULL) {
+		panic("procfs: create procfs_fs failed.\n");
+	}
+	procfs_fs_init(fs);
+
+	int ret;
+	if ((ret = vfs_add_fs("proc", fs)) != 0) {
+		panic("procfs: vfs_add_fs: %e.\n", ret);
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef __KERN_FS_PROC_PROCFS_H__
+#define __KERN_FS_PROC_PROCFS_H__
+
+#include <types.h>
+
+struct fs;
+struct inode;
+
+/* *
+ * procfs, "proc:", a read-only view of the kernel as /proc gives it on
+ * Linux: a file for each entry of procfs_root_entries, and a directory for
+ * each process, named by its pid, with a file for each entry of
+ * procfs_pid_entries. The inodes are made by each lookup and freed once
+ * unused; a file is formatted anew by each read, nothing is kept.
+ * */
+struct procfs_fs {
+	struct inode *root;
+};
+
+struct procfs_entry {
+	const char *name;
+	/* the text of the file of the process pid, 0 out of them, into buf
+	 * of size bytes; its length */
+	 size_t(*show) (int pid, char *buf, size_t size);
+};
+
+struct procfs_inode {
+	int pid;		// of its process directory, 0 out of them
+	const struct procfs_entry *entry;	// NULL for a directory
+};
+
+/* the last entry has a NULL name */
+extern const struct procfs_entry procfs_root_entries[];
+extern const struct procfs_entry procfs_pid_entries[];
+
+void procfs_init(void);
+struct inode *procfs_create_inode(struct fs *fs, int pid,
+				  const struct procfs_entry *entry);
+
+#endif /* !__KERN_FS_PROC_PROCFS_H__ */
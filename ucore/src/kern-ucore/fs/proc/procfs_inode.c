@@ -0,0 +1,260 @@
+#include <types.h>
+#include <stdio.h>
+#include <string.h>
+#include <slab.h>
+#include <vfs.h>
+#include <inode.h>
+#include <iobuf.h>
+#include <stat.h>
+#include <unistd.h>
+#include <proc.h>
+#include <procfs.h>
+#include <error.h>
+#include <assert.h>
+
+/* the text of a file is cut there */
+#define PROCFS_BUFSIZE              (4 * PGSIZE)
+
+static int procfs_nr_entries(const struct procfs_entry *entries)
+{
+	int n = 0;
+	while (entries[n].name != NULL) {
+		n++;
+	}
+	return n;
+}
+
+static inline const struct procfs_entry *procfs_entries(int pid)
+{
+	return (pid == 0) ? procfs_root_entries : procfs_pid_entries;
+}
+
+static int procfs_open(struct inode *node, uint32_t open_flags)
+{
+	if ((open_flags & O_ACCMODE) != O_RDONLY || (open_flags & O_APPEND)) {
+		return -E_INVAL;
+	}
+	return 0;
+}
+
+static int procfs_close(struct inode *node)
+{
+	return 0;
+}
+
+// procfs_read - format the file into a buffer and copy what is past the
+//             - offset of iob from it
+static int procfs_read(struct inode *node, struct iobuf *iob)
+{
+	struct procfs_inode *pin = vop_info(node, procfs_inode);
+	char *buf;
+	size_t len, copied;
+	if ((buf = kmalloc(PROCFS_BUFSIZE)) == NULL) {
+		return -E_NO_MEM;
+	}
+	len = pin->entry->show(pin->pid, buf, PROCFS_BUFSIZE);
+	if (iob->io_offset < len) {
+		iobuf_move(iob, buf + iob->io_offset, len - iob->io_offset, 1,
+			   &copied);
+	}
+	kfree(buf);
+	return 0;
+}
+
+static int procfs_gettype(struct inode *node, uint32_t * type_store)
+{
+	struct procfs_inode *pin = vop_info(node, procfs_inode);
+	*type_store = (pin->entry == NULL) ? S_IFDIR : S_IFREG;
+	return 0;
+}
+
+/* the files have no size before they are read, as on Linux */
+static int procfs_fstat(struct inode *node, struct stat *stat)
+{
+	struct procfs_inode *pin = vop_info(node, procfs_inode);
+	int ret;
+	memset(stat, 0, sizeof(struct stat));
+	if ((ret = vop_gettype(node, &(stat->st_mode))) != 0) {
+		return ret;
+	}
+	stat->st_nlinks = (pin->entry == NULL) ? 2 : 1;
+	return 0;
+}
+
+static int procfs_tryseek(struct inode *node, off_t pos)
+{
+	return (pos < 0) ? -E_INVAL : 0;
+}
+
+/*
+ * The offset is a cursor: 0 for ".", 1 for "..", 2 + i for the i-th entry
+ * of the directory, and in the root 2 + # of entries + the pid to look from
+ * for the processes, so that one coming or going meanwhile shifts no other.
+ */
+static int procfs_getdirentry(struct inode *node, struct iobuf *iob)
+{
+	struct procfs_inode *pin = vop_info(node, procfs_inode);
+	const struct procfs_entry *entries = procfs_entries(pin->pid);
+	char name[16];
+	off_t slot = iob->io_offset;
+	int n = procfs_nr_entries(entries), pid, ret;
+	if (slot < 0) {
+		return -E_INVAL;
+	}
+	if (slot < 2) {
+		strcpy(name, (slot == 0) ? "." : "..");
+	} else if (slot < 2 + n) {
+		snprintf(name, sizeof(name), "%s", entries[slot - 2].name);
+	} else {
+		if (pin->pid != 0 || (pid = proc_next_pid(slot - 2 - n)) < 0) {
+			return -E_NOENT;
+		}
+		snprintf(name, sizeof(name), "%d", pid);
+		slot = 2 + n + pid;
+	}
+	if ((ret = iobuf_move(iob, name, strlen(name) + 1, 1, NULL)) == 0) {
+		iob->io_offset = slot + 1;
+	}
+	return ret;
+}
+
+static int procfs_reclaim(struct inode *node)
+{
+	vop_kill(node);
+	return 0;
+}
+
+// procfs_lookup_once - the file or directory name in the directory of pid,
+//                    - *pid_store and *entry_store are set to its
+static int
+procfs_lookup_once(int pid, const char *name, int *pid_store,
+		   const struct procfs_entry **entry_store)
+{
+	const struct procfs_entry *entry;
+	char *end;
+	*pid_store = pid, *entry_store = NULL;
+	if (strcmp(name, ".") == 0) {
+		return 0;
+	}
+	if (strcmp(name, "..") == 0) {
+		*pid_store = 0;
+		return 0;
+	}
+	for (entry = procfs_entries(pid); entry->name != NULL; entry++) {
+		if (strcmp(name, entry->name) == 0) {
+			*entry_store = entry;
+			return 0;
+		}
+	}
+	if (pid == 0) {
+		pid = strtol(name, &end, 10);
+		if (*end == '\0' && proc_next_pid(pid) == pid) {
+			*pid_store = pid;
+			return 0;
+		}
+	}
+	return -E_NOENT;
+}
+
+static int
+procfs_lookup(struct inode *node, char *path, struct inode **node_store)
+{
+	const struct procfs_entry *entry = NULL;
+	int ret, pid = vop_info(node, procfs_inode)->pid;
+	char *name;
+	assert(*path != '\0' && *path != '/');
+	while (*path != '\0') {
+		if (entry != NULL) {
+			return -E_NOTDIR;
+		}
+		name = path;
+		if ((path = strchr(name, '/')) != NULL) {
+			*path++ = '\0';
+			while (*path == '/') {
+				path++;
+			}
+		} else {
+			path = name + strlen(name);
+		}
+		if ((ret = procfs_lookup_once(pid, name, &pid, &entry)) != 0) {
+			return ret;
+		}
+	}
+	if (pid == 0 && entry == NULL) {
+		*node_store = fsop_info(vop_fs(node), procfs)->root;
+		vop_ref_inc(*node_store);
+		return 0;
+	}
+	if ((*node_store = procfs_create_inode(vop_fs(node), pid, entry)) ==
+	    NULL) {
+		return -E_NO_MEM;
+	}
+	return 0;
+}
+
+static const struct inode_ops procfs_dirops = {
+	.vop_magic = VOP_MAGIC,
+	.vop_open = procfs_open,
+	.vop_close = procfs_close,
+	.vop_read = NULL_VOP_ISDIR,
+	.vop_write = NULL_VOP_ISDIR,
+	.vop_fstat = procfs_fstat,
+	.vop_fsync = NULL_VOP_PASS,
+	.vop_mkdir = NULL_VOP_INVAL,
+	.vop_link = NULL_VOP_INVAL,
+	.vop_rename = NULL_VOP_INVAL,
+	.vop_readlink = NULL_VOP_ISDIR,
+	.vop_symlink = NULL_VOP_INVAL,
+	.vop_namefile = NULL_VOP_INVAL,
+	.vop_getdirentry = procfs_getdirentry,
+	.vop_reclaim = procfs_reclaim,
+	.vop_ioctl = NULL_VOP_INVAL,
+	.vop_gettype = procfs_gettype,
+	.vop_tryseek = procfs_tryseek,
+	.vop_truncate = NULL_VOP_ISDIR,
+	.vop_create = NULL_VOP_INVAL,
+	.vop_unlink = NULL_VOP_INVAL,
+	.vop_lookup = procfs_lookup,
+	.vop_lookup_parent = NULL_VOP_INVAL,
+};
+
+static const struct inode_ops procfs_fileops = {
+	.vop_magic = VOP_MAGIC,
+	.vop_open = procfs_open,
+	.vop_close = procfs_close,
+	.vop_read = procfs_read,
+	.vop_write = NULL_VOP_INVAL,
+	.vop_fstat = procfs_fstat,
+	.vop_fsync = NULL_VOP_PASS,
+	.vop_mkdir = NULL_VOP_NOTDIR,
+	.vop_link = NULL_VOP_NOTDIR,
+	.vop_rename = NULL_VOP_NOTDIR,
+	.vop_readlink = NULL_VOP_NOTDIR,
+	.vop_symlink = NULL_VOP_NOTDIR,
+	.vop_namefile = NULL_VOP_NOTDIR,
+	.vop_getdirentry = NULL_VOP_NOTDIR,
+	.vop_reclaim = procfs_reclaim,
+	.vop_ioctl = NULL_VOP_INVAL,
+	.vop_gettype = procfs_gettype,
+	.vop_tryseek = procfs_tryseek,
+	.vop_truncate = NULL_VOP_INVAL,
+	.vop_create = NULL_VOP_NOTDIR,
+	.vop_unlink = NULL_VOP_NOTDIR,
+	.vop_lookup = NULL_VOP_NOTDIR,
+	.vop_lookup_parent = NULL_VOP_NOTDIR,
+};
+
+// procfs_create_inode - the directory of pid, 0 for the root, or its file
+//                     - entry if not NULL
+struct inode *procfs_create_inode(struct fs *fs, int pid,
+				  const struct procfs_entry *entry)
+{
+	struct inode *node;
+	if ((node = alloc_inode(procfs_inode)) != NULL) {
+		struct procfs_inode *pin = vop_info(node, procfs_inode);
+		pin->pid = pid, pin->entry = entry;
+		vop_init(node, (entry == NULL) ? &procfs_dirops :
+			 &procfs_fileops, fs);
+	}
+	return node;
+}
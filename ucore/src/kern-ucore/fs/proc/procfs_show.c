@@ -0,0 +1,179 @@
+/*
+ * The files of procfs, each formatted by its show when it is read:
+ *
+ *     meminfo     the free and slab memory; on amd64 the free blocks of
+ *                 each order of each node too, as /proc/buddyinfo
+ *     slabinfo    <name> <objsize> <objs a slab> <pages a slab> <slabs>
+ *                 <objs in use> of each cache
+ *     sched       cpu<n> <procs queued> <switches>
+ *     interrupts  <irq>: <the times each cpu took it>, of those taken (amd64)
+ *     schedstat   cpu<n> wait|run|idle <ns> <the counts of each bucket>,
+ *                 with UCONFIG_SCHEDSTATS, see schedstat.h
+ *     iostat      the reads, writes and latencies of each block device,
+ *                 request queue and of swap, see iostat_show
+ *     kmallocs    <bytes> <objs> <allocs> <site> of the call sites of
+ *                 kmalloc, with UCONFIG_KMALLOC_PROFILE
+ *     <pid>/status    the state, memory and files of the process
+ *     <pid>/fd        <fd> <access> <offset> of each fd it has open
+ *     <pid>/schedstat wait|run <ns> <the counts of each bucket>
+ */
+#include <types.h>
+#include <stdio.h>
+#include <slab.h>
+#include <pmm.h>
+#include <proc.h>
+#include <sched.h>
+#include <sysconf.h>
+#include <rusage.h>
+#include <iostat.h>
+#include <procfs.h>
+#ifdef ARCH_AMD64
+#include <irqbalance.h>
+#endif
+
+/* the caches reported at most */
+#define PROCFS_MAX_CACHES           128
+/* the orders of the free blocks reported at most */
+#define PROCFS_MAX_ORDERS           16
+
+static size_t procfs_meminfo(int pid, char *buf, size_t size)
+{
+	size_t len = 0;
+	len += snprintf(buf + len, size - len,
+			"MemFree:\t%lu kB\nSlab:\t%lu kB\n",
+			(unsigned long)nr_free_pages() * (PGSIZE / 1024),
+			(unsigned long)slab_allocated() / 1024);
+#ifdef ARCH_AMD64
+	size_t nr[PROCFS_MAX_ORDERS];
+	int node, order, n;
+	for (node = 0; node < sysconf.lnuma_count && len < size; node++) {
+		n = free_area_stat(node, nr, PROCFS_MAX_ORDERS);
+		len += snprintf(buf + len, size - len, "Node %d", node);
+		for (order = 0; order < n && len < size; order++) {
+			len += snprintf(buf + len, size - len, " %6lu",
+					(unsigned long)nr[order]);
+		}
+		if (len < size) {
+			len += snprintf(buf + len, size - len, "\n");
+		}
+	}
+#endif
+	return (len < size) ? len : size;
+}
+
+static size_t procfs_slabinfo(int pid, char *buf, size_t size)
+{
+	struct slab_cache_stat *stat;
+	size_t len = 0;
+	int i, n;
+	if ((stat = kmalloc(PROCFS_MAX_CACHES * sizeof(*stat))) == NULL) {
+		return 0;
+	}
+	n = slab_cache_stat(stat, PROCFS_MAX_CACHES);
+	for (i = 0; i < n && len < size; i++) {
+		if (stat[i].name != NULL) {
+			len += snprintf(buf + len, size - len, "%s",
+					stat[i].name);
+		} else {
+			len += snprintf(buf + len, size - len, "kmalloc-%lu",
+					(unsigned long)stat[i].objsize);
+		}
+		if (len < size) {
+			len += snprintf(buf + len, size - len,
+					" %lu %lu %lu %lu %lu\n",
+					(unsigned long)stat[i].objsize,
+					(unsigned long)stat[i].num,
+					1UL << stat[i].page_order,
+					(unsigned long)stat[i].nr_slabs,
+					(unsigned long)stat[i].inuse);
+		}
+	}
+	kfree(stat);
+	return (len < size) ? len : size;
+}
+
+static size_t procfs_sched(int pid, char *buf, size_t size)
+{
+	struct cpu_usage usage;
+	size_t len = 0;
+	int cpu;
+	for (cpu = 0; cpu < sysconf.lcpu_count && len < size; cpu++) {
+		sched_cpu_usage(cpu, &usage);
+		len += snprintf(buf + len, size - len, "cpu%d %u %llu\n", cpu,
+				sched_nr_running(cpu), usage.nr_switches);
+	}
+	return (len < size) ? len : size;
+}
+
+#ifdef UCONFIG_SCHEDSTATS
+static size_t procfs_schedstat(int pid, char *buf, size_t size)
+{
+	return sched_stat_show(buf, size);
+}
+#endif
+
+static size_t procfs_iostat(int pid, char *buf, size_t size)
+{
+	return iostat_show(buf, size);
+}
+
+#ifdef UCONFIG_KMALLOC_PROFILE
+static size_t procfs_kmallocs(int pid, char *buf, size_t size)
+{
+	return kmalloc_profile_show(buf, size);
+}
+#endif
+
+#ifdef ARCH_AMD64
+static size_t procfs_interrupts(int pid, char *buf, size_t size)
+{
+	uint64_t count, total;
+	size_t len = 0;
+	int irq, cpu;
+	for (irq = 0; irq < IRQ_COUNT && len < size; irq++) {
+		total = 0;
+		for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+			total += irq_cpu_count(cpu, irq);
+		}
+		if (total == 0) {
+			continue;
+		}
+		len += snprintf(buf + len, size - len, "%3d:", irq);
+		for (cpu = 0; cpu < sysconf.lcpu_count && len < size; cpu++) {
+			count = irq_cpu_count(cpu, irq);
+			len +=
+			    snprintf(buf + len, size - len, " %10llu", count);
+		}
+		if (len < size) {
+			len += snprintf(buf + len, size - len, "\n");
+		}
+	}
+	return (len < size) ? len : size;
+}
+#endif
+
+const struct procfs_entry procfs_root_entries[] = {
+	{"meminfo", procfs_meminfo},
+	{"slabinfo", procfs_slabinfo},
+	{"sched", procfs_sched},
+#ifdef ARCH_AMD64
+	{"interrupts", procfs_interrupts},
+#endif
+#ifdef UCONFIG_SCHEDSTATS
+	{"schedstat", procfs_schedstat},
+#endif
+	{"iostat", procfs_iostat},
+#ifdef UCONFIG_KMALLOC_PROFILE
+	{"kmallocs", procfs_kmallocs},
+#endif
+	{NULL, NULL},
+};
+
+const struct procfs_entry procfs_pid_entries[] = {
+	{"status", proc_status_show},
+	{"fd", proc_fd_show},
+#ifdef UCONFIG_SCHEDSTATS
+	{"schedstat", proc_schedstat_show},
+#endif
+	{NULL, NULL},
+};
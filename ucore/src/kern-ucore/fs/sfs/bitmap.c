@@ -4,14 +4,26 @@
 #include <bitmap.h>
 #include <error.h>
 #include <assert.h>
+#include <findbit.h>
 
 #define WORD_TYPE           uint32_t
-#define WORD_BITS           (sizeof(WORD_TYPE) * CHAR_BIT)
+#define WORD_BITS           BITS_PER_WORD
+
+/*
+ * The bits are split in allocation groups of BITMAP_GROUP_WORDS words, the
+ * size of an sfs freemap block. A group keeps its # of free bits, so full
+ * groups are skipped, and the first of its words that may hold one.
+ */
+#define BITMAP_GROUP_WORDS  (4096 / sizeof(WORD_TYPE))
+#define BITMAP_GROUP_BITS   (BITMAP_GROUP_WORDS * WORD_BITS)
 
 struct bitmap {
 	uint32_t nbits;
 	uint32_t nwords;
 	WORD_TYPE *map;
+	uint32_t ngroups;
+	uint32_t *group_free;	/* # of free bits in each group */
+	uint32_t *group_hint;	/* no free bit before this word of the group */
 };
 
 struct bitmap *bitmap_create(uint32_t nbits)
@@ -25,44 +37,126 @@ struct bitmap *bitmap_create(uint32_t nbits)
 	}
 
 	uint32_t nwords = ROUNDUP_DIV(nbits, WORD_BITS);
+	uint32_t ngroups = ROUNDUP_DIV(nwords, BITMAP_GROUP_WORDS);
 	WORD_TYPE *map;
 	if ((map = kmalloc(sizeof(WORD_TYPE) * nwords)) == NULL) {
-		kfree(bitmap);
-		return NULL;
+		goto failed_cleanup_bitmap;
+	}
+	if ((bitmap->group_free = kmalloc(sizeof(uint32_t) * ngroups)) == NULL) {
+		goto failed_cleanup_map;
+	}
+	if ((bitmap->group_hint = kmalloc(sizeof(uint32_t) * ngroups)) == NULL) {
+		goto failed_cleanup_group_free;
 	}
 
 	bitmap->nbits = nbits, bitmap->nwords = nwords;
+	bitmap->ngroups = ngroups;
 	bitmap->map = memset(map, 0xFF, sizeof(WORD_TYPE) * nwords);
 
 	/* mark any leftover bits at the end in use(0) */
-	if (nbits != nwords * WORD_BITS) {
-		uint32_t ix = nwords - 1, overbits = nbits - ix * WORD_BITS;
+	bits_clear_range(bitmap->map, nbits, nwords * WORD_BITS - nbits);
+	bitmap_rescan(bitmap);
+	return bitmap;
 
-		assert(nbits / WORD_BITS == ix);
-		assert(overbits > 0 && overbits < WORD_BITS);
+failed_cleanup_group_free:
+	kfree(bitmap->group_free);
+failed_cleanup_map:
+	kfree(map);
+failed_cleanup_bitmap:
+	kfree(bitmap);
+	return NULL;
+}
 
-		for (; overbits < WORD_BITS; overbits++) {
-			bitmap->map[ix] ^= (1 << overbits);
+// bitmap_rescan - count the free bits again after the map was filled in
+uint32_t bitmap_rescan(struct bitmap *bitmap)
+{
+	uint32_t g, start, n, nfree = 0;
+	for (g = 0; g < bitmap->ngroups; g++) {
+		start = g * BITMAP_GROUP_BITS;
+		n = bitmap->nbits - start;
+		if (n > BITMAP_GROUP_BITS) {
+			n = BITMAP_GROUP_BITS;
 		}
+		bitmap->group_free[g] = bits_weight(bitmap->map, start, n);
+		bitmap->group_hint[g] = g * BITMAP_GROUP_WORDS;
+		nfree += bitmap->group_free[g];
 	}
-	return bitmap;
+	return nfree;
+}
+
+// bitmap_take - allocate the lowest free bit of word ix
+static uint32_t bitmap_take(struct bitmap *bitmap, uint32_t ix)
+{
+	WORD_TYPE *word = bitmap->map + ix;
+	uint32_t offset = word_ffs(*word);
+	*word ^= (1 << offset);
+	assert(bitmap->group_free[ix / BITMAP_GROUP_WORDS] > 0);
+	bitmap->group_free[ix / BITMAP_GROUP_WORDS]--;
+	return ix * WORD_BITS + offset;
+}
+
+// bitmap_alloc_group - allocate the first free bit of group g from word ix on
+static int
+bitmap_alloc_group(struct bitmap *bitmap, uint32_t g, uint32_t ix,
+		   uint32_t * index_store)
+{
+	uint32_t end = (g + 1) * BITMAP_GROUP_WORDS;
+	bool from_hint = (ix == bitmap->group_hint[g]);
+	if (bitmap->group_free[g] == 0) {
+		return -E_NO_MEM;
+	}
+	if (end > bitmap->nwords) {
+		end = bitmap->nwords;
+	}
+	size_t size = end * WORD_BITS;
+	size_t bit = find_next_bit(bitmap->map, size, ix * WORD_BITS);
+	if (bit == size) {
+		return -E_NO_MEM;
+	}
+	ix = bit / WORD_BITS;
+	if (from_hint) {
+		bitmap->group_hint[g] = ix;
+	}
+	*index_store = bitmap_take(bitmap, ix);
+	return 0;
 }
 
 int bitmap_alloc(struct bitmap *bitmap, uint32_t * index_store)
 {
-	WORD_TYPE *map = bitmap->map;
-	uint32_t ix, offset, nwords = bitmap->nwords;
-	for (ix = 0; ix < nwords; ix++) {
-		if (map[ix] != 0) {
-			for (offset = 0; offset < WORD_BITS; offset++) {
-				WORD_TYPE mask = (1 << offset);
-				if (map[ix] & mask) {
-					map[ix] ^= mask;
-					*index_store = ix * WORD_BITS + offset;
-					return 0;
-				}
-			}
-			assert(0);
+	uint32_t g;
+	for (g = 0; g < bitmap->ngroups; g++) {
+		if (bitmap_alloc_group(bitmap, g, bitmap->group_hint[g],
+				       index_store) == 0) {
+			return 0;
+		}
+	}
+	return -E_NO_MEM;
+}
+
+/* *
+ * bitmap_alloc_near - allocate the goal bit if it is free, else the first
+ * free one after it in its group, else the first free bit of the groups
+ * that follow, wrapping around
+ * */
+int bitmap_alloc_near(struct bitmap *bitmap, uint32_t goal,
+		      uint32_t * index_store)
+{
+	if (goal >= bitmap->nbits) {
+		goal = 0;
+	}
+	if (bitmap_alloc_at(bitmap, goal) == 0) {
+		*index_store = goal;
+		return 0;
+	}
+	uint32_t g = goal / BITMAP_GROUP_BITS, i;
+	if (bitmap_alloc_group(bitmap, g, goal / WORD_BITS, index_store) == 0) {
+		return 0;
+	}
+	for (i = 1; i <= bitmap->ngroups; i++) {
+		uint32_t next = (g + i) % bitmap->ngroups;
+		if (bitmap_alloc_group(bitmap, next, bitmap->group_hint[next],
+				       index_store) == 0) {
+			return 0;
 		}
 	}
 	return -E_NO_MEM;
@@ -85,16 +179,80 @@ bool bitmap_test(struct bitmap *bitmap, uint32_t index)
 	return (*word & mask);
 }
 
+// bitmap_alloc_at - allocate the given bit if it is free
+int bitmap_alloc_at(struct bitmap *bitmap, uint32_t index)
+{
+	WORD_TYPE *word, mask;
+	if (index >= bitmap->nbits) {
+		return -E_NO_MEM;
+	}
+	bitmap_translate(bitmap, index, &word, &mask);
+	if (!(*word & mask)) {
+		return -E_NO_MEM;
+	}
+	*word ^= mask;
+	bitmap->group_free[index / BITMAP_GROUP_BITS]--;
+	return 0;
+}
+
+/* *
+ * bitmap_alloc_run - allocate up to n free bits in a row, at least one: from
+ * goal if it is free, else from the first wholly free word after it rather
+ * than from the holes left there, else wherever bitmap_alloc_near finds one
+ * */
+int
+bitmap_alloc_run(struct bitmap *bitmap, uint32_t goal, uint32_t n,
+		 uint32_t * index_store, uint32_t * n_store)
+{
+	uint32_t index, got = 1, ix, i;
+	int ret;
+	assert(n != 0);
+	if (goal >= bitmap->nbits) {
+		goal = 0;
+	}
+	if (n > 1 && !bitmap_test(bitmap, goal)) {
+		ix = goal / WORD_BITS;
+		for (i = 0; i < bitmap->nwords;
+		     i++, ix = (ix + 1) % bitmap->nwords) {
+			/* a group with less free has no free word */
+			uint32_t g = ix / BITMAP_GROUP_WORDS;
+			if (bitmap->group_free[g] < WORD_BITS) {
+				continue;
+			}
+			if (bitmap->map[ix] == (WORD_TYPE) - 1) {
+				goal = ix * WORD_BITS;
+				break;
+			}
+		}
+	}
+	if ((ret = bitmap_alloc_near(bitmap, goal, &index)) != 0) {
+		return ret;
+	}
+	while (got < n && bitmap_alloc_at(bitmap, index + got) == 0) {
+		got++;
+	}
+	*index_store = index, *n_store = got;
+	return 0;
+}
+
 void bitmap_free(struct bitmap *bitmap, uint32_t index)
 {
 	WORD_TYPE *word, mask;
 	bitmap_translate(bitmap, index, &word, &mask);
 	assert(!(*word & mask));
 	*word |= mask;
+
+	uint32_t g = index / BITMAP_GROUP_BITS;
+	bitmap->group_free[g]++;
+	if (bitmap->group_hint[g] > index / WORD_BITS) {
+		bitmap->group_hint[g] = index / WORD_BITS;
+	}
 }
 
 void bitmap_destroy(struct bitmap *bitmap)
 {
+	kfree(bitmap->group_hint);
+	kfree(bitmap->group_free);
 	kfree(bitmap->map);
 	kfree(bitmap);
 }
@@ -7,6 +7,12 @@
 void sfs_init(void)
 {
 	int ret;
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	sfs_cache_init();
+#endif
+#ifdef UCONFIG_SFS_JOURNAL
+	sfs_journal_init();
+#endif
 	if ((ret = register_filesystem("sfs", sfs_mount)) != 0) {
 		panic("failed: sfs: register_filesystem: %e.\n", ret);
 	}
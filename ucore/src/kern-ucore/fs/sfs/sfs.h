@@ -5,6 +5,10 @@
 #include <mmu.h>
 #include <list.h>
 #include <sem.h>
+#include <kmutex.h>
+#include <wait.h>
+#include <spinlock.h>
+#include <rhash.h>
 #include <atomic.h>
 #include <unistd.h>
 
@@ -14,6 +18,7 @@
 #define SFS_MAX_INFO_LEN                            31	/* max length of infomation */
 #define SFS_MAX_FNAME_LEN                           FS_MAX_FNAME_LEN	/* max length of filename */
 #define SFS_MAX_FILE_SIZE                           (1024UL * 1024 * 128)	/* max file size (128M) */
+#define SFS_MAX_EXTENT_FILE_SIZE                    (1024UL * 1024 * 1024)	/* of an extent mapped file (1G) */
 #define SFS_BLKN_SUPER                              0	/* block the superblock lives in */
 #define SFS_BLKN_ROOT                               1	/* location of the root dir inode */
 #define SFS_BLKN_FREEMAP                            2	/* 1st block of the freemap */
@@ -30,6 +35,20 @@
 #define SFS_TYPE_DIR                                2
 #define SFS_TYPE_LINK                               3
 
+/* features of the fs (in its superblock) */
+#define SFS_FEATURE_DIR_INDEX                       0x1	/* directories are hash indexed */
+#define SFS_FEATURE_EXTENTS                         0x2	/* files are mapped by extents */
+#define SFS_FEATURE_JOURNAL                         0x4	/* metadata goes through a journal */
+#define SFS_FEATURE_INLINE_DATA                     0x8	/* small inodes keep their data inline */
+#ifdef UCONFIG_SFS_JOURNAL
+#define SFS_FEATURE_ALL                             (SFS_FEATURE_DIR_INDEX | SFS_FEATURE_EXTENTS | SFS_FEATURE_JOURNAL | SFS_FEATURE_INLINE_DATA)
+#else
+#define SFS_FEATURE_ALL                             (SFS_FEATURE_DIR_INDEX | SFS_FEATURE_EXTENTS | SFS_FEATURE_INLINE_DATA)
+#endif
+
+/* inode flags (on disk) */
+#define SFS_INODE_INLINE                            0x1	/* data in the inode block, see below */
+
 /*
  * On-disk superblock
  */
@@ -38,6 +57,9 @@ struct sfs_super {
 	uint32_t blocks;	/* # of blocks in fs */
 	uint32_t unused_blocks;	/* # of unused blocks in fs */
 	char info[SFS_MAX_INFO_LEN + 1];	/* infomation for sfs  */
+	uint32_t features;	/* SFS_FEATURE_*, 0 for older images */
+	uint32_t journal_start;	/* first block of the journal */
+	uint32_t journal_blocks;	/* # of blocks of the journal */
 };
 
 /* inode (on disk) */
@@ -54,9 +76,64 @@ struct sfs_disk_inode {
 	uint16_t type;		/* one of SYS_TYPE_* above */
 	uint16_t nlinks;	/* # of hard links to this file */
 	uint32_t blocks;	/* # of blocks */
-	uint32_t direct[SFS_NDIRECT];	/* direct blocks */
-	uint32_t indirect;	/* indirect blocks */
-	uint32_t db_indirect;	/* double indirect blocks */
+	union {
+		struct {
+			uint32_t direct[SFS_NDIRECT];	/* direct blocks */
+			uint32_t indirect;	/* indirect blocks */
+			uint32_t db_indirect;	/* double indirect blocks */
+		};
+		struct {
+			uint32_t nextents;	/* # of extents */
+		} extinfo;
+	};
+	uint32_t flags;		/* SFS_INODE_*, 0 for older images */
+};
+
+/*
+ * extent map of a file or a link (on disk) in an image with
+ * SFS_FEATURE_EXTENTS, in the block of its inode after the inode itself.
+ * Directories keep the block map, their index lives there.
+ */
+#define SFS_EXTENT_OFFSET                           128	/* in the inode block */
+#define SFS_MAX_EXTENTS                             \
+    ((SFS_BLKSIZE - SFS_EXTENT_OFFSET) / sizeof(struct sfs_disk_extent))
+
+struct sfs_disk_extent {
+	uint32_t start;		/* first block */
+	uint32_t len;		/* # of blocks */
+};
+
+/*
+ * metadata journal (on disk) of an image with SFS_FEATURE_JOURNAL, the
+ * journal_blocks blocks from journal_start on. The first one holds the
+ * header, the committed transaction is logged after it: a descriptor
+ * listing the blocks, their copies and a commit block with a checksum of
+ * the copies. The transaction is the one to replay if its descriptor and
+ * commit block carry the seq of the header, which moves on once the
+ * blocks are all in place.
+ */
+#define SFS_JOURNAL_MAGIC                           0x4a534653	/* "SFSJ" */
+#define SFS_JOURNAL_DESC_MAGIC                      0x44534653	/* "SFSD" */
+#define SFS_JOURNAL_COMMIT_MAGIC                    0x43534653	/* "SFSC" */
+#define SFS_JOURNAL_DESC_NENTRY                     (SFS_BLK_NENTRY - 3)
+
+struct sfs_journal_header {
+	uint32_t magic;		/* SFS_JOURNAL_MAGIC */
+	uint32_t seq;		/* of the next transaction */
+};
+
+struct sfs_journal_desc {
+	uint32_t magic;		/* SFS_JOURNAL_DESC_MAGIC */
+	uint32_t seq;		/* of the transaction */
+	uint32_t nblocks;	/* # of blocks logged */
+	uint32_t blknos[SFS_JOURNAL_DESC_NENTRY];	/* where they go */
+};
+
+struct sfs_journal_commit {
+	uint32_t magic;		/* SFS_JOURNAL_COMMIT_MAGIC */
+	uint32_t seq;		/* of the transaction */
+	uint32_t nblocks;	/* # of blocks logged */
+	uint32_t checksum;	/* of the copies */
 };
 
 /* file entry (on disk) */
@@ -68,16 +145,57 @@ struct sfs_disk_entry {
 #define sfs_dentry_size                             \
     sizeof(((struct sfs_disk_entry *)0)->name)
 
+/*
+ * hash index of a directory (on disk), in the block of its inode after the
+ * inode itself. The slots whose names hash to a bucket are chained through
+ * the link word that follows the entry in each slot block, and so are the
+ * free slots. Links are slot numbers plus 1, 0 ends a chain.
+ */
+#define SFS_DIRINDEX_NBUCKETS                       512
+#define SFS_DIRINDEX_OFFSET                         128	/* in the inode block */
+#define SFS_DIRENT_LINK_OFFSET                      sizeof(struct sfs_disk_entry)	/* in a slot block */
+
+struct sfs_disk_dirindex {
+	uint32_t free;		/* chain of the free slots */
+	uint32_t buckets[SFS_DIRINDEX_NBUCKETS];	/* chains of the used slots */
+};
+
+/*
+ * inline data (on disk) of an image with SFS_FEATURE_INLINE_DATA, in the
+ * block of an inode with SFS_INODE_INLINE, which has no block of its own:
+ * the bytes of a file up to SFS_INLINE_FILE_MAX where its extents would
+ * be, and the first SFS_INLINE_DIR_NSLOTS slots of a directory after its
+ * index, each an entry and its link as in a slot block. blocks counts the
+ * slots of an inline directory. Growing past them moves the data out to
+ * blocks, for good.
+ */
+#define SFS_INLINE_FILE_OFFSET                      SFS_EXTENT_OFFSET
+#define SFS_INLINE_FILE_MAX                         (SFS_BLKSIZE - SFS_INLINE_FILE_OFFSET)
+#define SFS_INLINE_DIR_OFFSET                       \
+    (SFS_DIRINDEX_OFFSET + sizeof(struct sfs_disk_dirindex))
+#define SFS_INLINE_DENTRY_SIZE                      (SFS_DIRENT_LINK_OFFSET + sizeof(uint32_t))
+#define SFS_INLINE_DIR_NSLOTS                       \
+    ((SFS_BLKSIZE - SFS_INLINE_DIR_OFFSET) / SFS_INLINE_DENTRY_SIZE)
+
 /* inode for sfs */
 struct sfs_inode {
 	struct sfs_disk_inode *din;	/* on-disk inode */
 	uint32_t ino;		/* inode number */
+	struct sfs_disk_extent *extents;	/* NULL if block mapped */
+	uint32_t alloc_goal;	/* where its next block is looked for */
+	uint32_t prealloc_start;	/* free blocks taken for its appends, */
+	uint32_t prealloc_len;	/* handed out from prealloc_start on */
 	uint32_t flags;		/* inode flags */
 	bool dirty;		/* true if inode modified */
 	int reclaim_count;	/* kill inode if it hits zero */
-	semaphore_t sem;	/* semaphore for din */
+	kmutex_t mutex;	/* mutex for din */
 	list_entry_t inode_link;	/* entry for linked-list in sfs_fs */
-	list_entry_t hash_link;	/* entry for hash linked-list in sfs_fs */
+	struct rhash_node hash_link;	/* in inode_hash of sfs_fs */
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	uint32_t ra_next;	/* block a sequential read would start at */
+	uint32_t ra_end;	/* end of the blocks read ahead */
+	uint32_t ra_pages;	/* readahead window, 0 for random reads */
+#endif
 };
 
 #define SFS_removed                 0	// the inode has been removed
@@ -89,24 +207,89 @@ struct sfs_inode {
 #define le2sin(le, member)                          \
     to_struct((le), struct sfs_inode, member)
 
+#ifdef UCONFIG_SFS_PAGE_CACHE
+/*
+ * page cache of the blocks of an sfs, see sfs_cache.c. Protected by the
+ * io_mutex of the sfs.
+ */
+struct sfs_cache {
+	list_entry_t *hash_list;	/* cached pages hashed by block number */
+	list_entry_t active_list;	/* pages hit again since they were read */
+	list_entry_t inactive_list;	/* reclaimed first */
+	size_t nr_active, nr_inactive;
+	size_t nr_dirty;	/* pages to be written back */
+	list_entry_t read_list;	/* reads of missing blocks in flight */
+	wait_queue_t read_wait;	/* waiting for one of those to end */
+};
+#endif
+
+/* the inodes in memory hashed by ino, the table grows with them */
+#define SFS_HLIST_SHIFT                             6
+
+/* the inos are locked in groups, an inode is loaded or reclaimed with the
+ * lock of its group held only */
+#define SFS_HLOCK_SHIFT                             5
+#define SFS_HLOCK_SIZE                              (1 << SFS_HLOCK_SHIFT)
+#define sin_hlockfn(x)                              (hash32(x, SFS_HLOCK_SHIFT))
+
 /* filesystem for sfs */
 struct sfs_fs {
 	struct sfs_super super;	/* on-disk superblock */
 	struct device *dev;	/* device mounted on */
+	void *mem;		/* the d_mem of dev, NULL if it has none */
 	struct bitmap *freemap;	/* blocks in use are mared 0 */
 	bool super_dirty;	/* true if super/freemap modified */
+	bool *freemap_dirty;	/* freemap blocks modified since the last sync */
+	spinlock_s freemap_lock;	/* lock for freemap and its counts */
 	void *sfs_buffer;	/* buffer for non-block aligned io */
-	semaphore_t fs_sem;	/* semaphore for fs */
-	semaphore_t io_sem;	/* semaphore for io */
-	semaphore_t mutex_sem;	/* semaphore for link/unlink and rename */
+	kmutex_t fs_mutex;	/* mutex for inode_list */
+	kmutex_t io_mutex;	/* mutex for sfs_buffer and the cache */
+	kmutex_t link_mutex;	/* mutex for link/unlink and rename */
 	list_entry_t inode_list;	/* inode linked-list */
-	list_entry_t *hash_list;	/* inode hash linked-list */
+	struct rhash inode_hash;	/* the inodes by ino */
+	kmutex_t hash_mutex[SFS_HLOCK_SIZE];	/* mutexes for inode_hash */
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	struct sfs_cache cache;	/* cached blocks */
+	list_entry_t cache_link;	/* entry in the list of all sfs caches */
+#endif
+#ifdef UCONFIG_SFS_JOURNAL
+	struct sfs_journal *journal;	/* NULL unless SFS_FEATURE_JOURNAL */
+#endif
 };
 
-/* hash for sfs */
-#define SFS_HLIST_SHIFT                             10
-#define SFS_HLIST_SIZE                              (1 << SFS_HLIST_SHIFT)
-#define sin_hashfn(x)                               (hash32(x, SFS_HLIST_SHIFT))
+struct proc_struct;
+
+/*
+ * an update of a journaled sfs, from sfs_journal_start to sfs_journal_stop
+ * around an operation that changes metadata, see sfs_journal.c. Updates
+ * nest, the inner ones of a process only ride on its outermost one.
+ */
+struct sfs_handle {
+	list_entry_t link;	/* entry in the updates of the journal */
+	struct proc_struct *proc;	/* running the update */
+	struct sfs_handle *outer;	/* outermost update of proc, if nested */
+};
+
+#define sfs_dir_indexed(sfs)                        \
+    (((sfs)->super.features & SFS_FEATURE_DIR_INDEX) != 0)
+
+#define sfs_extent_mapped(sfs, type)                \
+    (((sfs)->super.features & SFS_FEATURE_EXTENTS) != 0 && (type) != SFS_TYPE_DIR)
+
+#define sfs_inline_data(sfs)                        \
+    (((sfs)->super.features & SFS_FEATURE_INLINE_DATA) != 0)
+
+#define sfs_inlined(sin)                            \
+    (((sin)->din->flags & SFS_INODE_INLINE) != 0)
+
+#define sfs_max_file_size(sin)                      \
+    (((sin)->extents != NULL) ? SFS_MAX_EXTENT_FILE_SIZE : SFS_MAX_FILE_SIZE)
+
+#ifdef UCONFIG_SFS_JOURNAL
+#define sfs_journaled(sfs)                          ((sfs)->journal != NULL)
+#else
+#define sfs_journaled(sfs)                          0
+#endif
 
 /* size of freemap (in bits) */
 #define sfs_freemap_bits(super)                     ROUNDUP((super)->blocks, SFS_BLKBITS)
@@ -116,6 +299,7 @@ struct sfs_fs {
 
 struct fs;
 struct inode;
+struct Page;
 
 void sfs_init(void);
 int sfs_mount(const char *devname);
@@ -123,20 +307,84 @@ int sfs_mount(const char *devname);
 void lock_sfs_fs(struct sfs_fs *sfs);
 void lock_sfs_io(struct sfs_fs *sfs);
 void lock_sfs_mutex(struct sfs_fs *sfs);
+void lock_sfs_hash(struct sfs_fs *sfs, uint32_t ino);
 void unlock_sfs_fs(struct sfs_fs *sfs);
 void unlock_sfs_io(struct sfs_fs *sfs);
 void unlock_sfs_mutex(struct sfs_fs *sfs);
+void unlock_sfs_hash(struct sfs_fs *sfs, uint32_t ino);
 
 int sfs_rblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
 int sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
+int sfs_wblock_data(struct sfs_fs *sfs, void *buf, uint32_t blkno,
+		    uint32_t nblks);
 int sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
 	     off_t offset);
 int sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
 	     off_t offset);
+int sfs_rbuf_data(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
+		  off_t offset);
+int sfs_wbuf_data(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
+		  off_t offset);
 int sfs_sync_super(struct sfs_fs *sfs);
 int sfs_sync_freemap(struct sfs_fs *sfs);
 int sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks);
 
+#ifdef UCONFIG_SFS_PAGE_CACHE
+/* limits of the page cache of an sfs, in pages */
+#define SFS_CACHE_MAX_PAGES                         1024
+#define SFS_CACHE_DIRTY_HIGH                        (SFS_CACHE_MAX_PAGES / 4)
+#define SFS_CACHE_RA_BATCH                          16	/* blocks per batched request */
+#define SFS_CACHE_HLIST_SHIFT                       8
+#define SFS_CACHE_HLIST_SIZE                        (1 << SFS_CACHE_HLIST_SHIFT)
+
+/* readahead window of a sequentially read file, in blocks */
+#define SFS_RA_MIN_PAGES                            4
+#define SFS_RA_MAX_PAGES                            32
+
+/* the flusher writes the dirty pages back this often, in ticks */
+#define SFS_FLUSH_INTERVAL                          500
+
+void sfs_cache_init(void);
+int sfs_cache_create(struct sfs_fs *sfs);
+void sfs_cache_destroy(struct sfs_fs *sfs);
+int sfs_bread_nolock(struct sfs_fs *sfs, uint32_t blkno, bool read, bool write,
+		     struct Page **page_store);
+void sfs_brelse(struct Page *page);
+void sfs_cache_readahead(struct sfs_fs *sfs, const uint32_t * blknos, int n);
+void sfs_cache_prefetch(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks);
+void sfs_cache_forget(struct sfs_fs *sfs, uint32_t blkno);
+int sfs_cache_flush(struct sfs_fs *sfs);
+int sfs_cache_drop(struct sfs_fs *sfs);
+void sfs_cache_drain(void);
+int sfs_flusher_main(void *arg) __attribute__ ((noreturn));
+#endif
+
+#ifdef UCONFIG_SFS_JOURNAL
+/* the journal thread commits every journaled sfs this often, in ticks */
+#define SFS_JOURNAL_INTERVAL                        500
+#define SFS_JOURNAL_HLIST_SHIFT                     6
+#define SFS_JOURNAL_HLIST_SIZE                      (1 << SFS_JOURNAL_HLIST_SHIFT)
+
+void sfs_journal_init(void);
+int sfs_journal_create(struct sfs_fs *sfs);
+void sfs_journal_destroy(struct sfs_fs *sfs);
+void sfs_journal_start(struct sfs_fs *sfs, struct sfs_handle *handle);
+void sfs_journal_stop(struct sfs_fs *sfs, struct sfs_handle *handle);
+int sfs_journal_rbuf(struct sfs_fs *sfs, void *buf, size_t len,
+		     uint32_t blkno, off_t offset);
+int sfs_journal_wbuf(struct sfs_fs *sfs, void *buf, size_t len,
+		     uint32_t blkno, off_t offset);
+int sfs_journal_free(struct sfs_fs *sfs, uint32_t blkno);
+int sfs_journal_commit(struct sfs_fs *sfs);
+int sfs_journal_main(void *arg) __attribute__ ((noreturn));
+#else
+#define sfs_journal_start(sfs, handle)              ((void)(handle))
+#define sfs_journal_stop(sfs, handle)               ((void)(handle))
+#endif
+
+int sfs_sync_nolock(struct sfs_fs *sfs);
+int sfs_fsync_nolock(struct sfs_fs *sfs, struct sfs_inode *sin);
+void sfs_block_release(struct sfs_fs *sfs, uint32_t ino);
 int sfs_load_inode(struct sfs_fs *sfs, struct inode **node_store, uint32_t ino);
 
 #endif /* !__KERN_FS_SFS_SFS_H__ */
@@ -0,0 +1,650 @@
+#include <types.h>
+#include <string.h>
+#include <stdlib.h>
+#include <slab.h>
+#include <list.h>
+#include <sem.h>
+#include <pmm.h>
+#include <proc.h>
+#include <sched.h>
+#include <dev.h>
+#include <sfs.h>
+#include <iobuf.h>
+#include <error.h>
+#include <assert.h>
+#include <memcg.h>
+#include <shrinker.h>
+
+/*
+ * The page cache of sfs.
+ *
+ * SFS_BLKSIZE is PGSIZE, so a cached block is one page frame, and the
+ * struct Page of the frame is the cache entry:
+ *
+ *     page->index       number of the block
+ *     page->swap_link   entry in the hash list of the cache
+ *     page->page_link   entry in the active or the inactive list
+ *     PG_dirty          the page must be written back
+ *     PG_active         the page is in the active list
+ *     page->ref         # of users of the buffer, see sfs_bread_nolock
+ *
+ * File data, directory entries, indirect blocks and inodes all reach the
+ * disk through sfs_rbuf/sfs_wbuf/sfs_rblock/sfs_wblock, so keying the
+ * cache by block number caches all of them with one copy of each block.
+ *
+ * Reclaim follows the swap lists of mm/swap.c: a new page starts in the
+ * inactive list and moves to the active list when it is hit again, the
+ * inactive list is reclaimed from its head and refilled from the head of
+ * the active list. A file read in a single pass thus only ever cycles
+ * through the inactive list and leaves the hot blocks alone.
+ *
+ * Writes only dirty the cached pages. The flusher thread writes them back
+ * every SFS_FLUSH_INTERVAL ticks, or as soon as SFS_CACHE_DIRTY_HIGH pages
+ * of an sfs are dirty; sync writes them back at once. Under memory pressure
+ * the shrinker of the cache frees inactive pages of all sfs, see
+ * sfs_cache_reclaim.
+ *
+ * A missing block is read with the io_mutex dropped, so that a hit or the
+ * miss of another block does not wait for the disk. The pages being read
+ * are not in the cache yet, the read is in read_list instead, and whoever
+ * wants one of its blocks waits in read_wait for the read to end and
+ * looks again.
+ */
+
+/* a read of missing blocks in flight, see cache_read_start */
+struct cache_read {
+	list_entry_t link;
+	uint32_t blkno, n;
+};
+
+#define le2read(le, member)                         \
+    to_struct((le), struct cache_read, member)
+
+#define sfs_cache_hashfn(x)                         (hash32(x, SFS_CACHE_HLIST_SHIFT))
+
+#define le2sfs(le, member)                          \
+    to_struct((le), struct sfs_fs, member)
+
+/* list of the caches of all mounted sfs */
+static list_entry_t cache_list;
+static semaphore_t cache_list_sem;
+
+static struct proc_struct *flusher = NULL;
+
+static struct shrinker sfs_cache_shrinker;
+
+void sfs_cache_init(void)
+{
+	list_init(&cache_list);
+	sem_init(&cache_list_sem, 1);
+	register_shrinker(&sfs_cache_shrinker);
+}
+
+static inline size_t cache_nr_pages(struct sfs_cache *cache)
+{
+	return cache->nr_active + cache->nr_inactive;
+}
+
+static inline void cache_active_list_add(struct sfs_cache *cache,
+					 struct Page *page)
+{
+	SetPageActive(page);
+	cache->nr_active++;
+	list_add_before(&(cache->active_list), &(page->page_link));
+}
+
+static inline void cache_inactive_list_add(struct sfs_cache *cache,
+					   struct Page *page)
+{
+	ClearPageActive(page);
+	cache->nr_inactive++;
+	list_add_before(&(cache->inactive_list), &(page->page_link));
+}
+
+static inline void cache_list_del(struct sfs_cache *cache, struct Page *page)
+{
+	if (PageActive(page)) {
+		cache->nr_active--;
+	} else {
+		cache->nr_inactive--;
+	}
+	list_del(&(page->page_link));
+}
+
+static struct Page *cache_lookup(struct sfs_cache *cache, uint32_t blkno)
+{
+	list_entry_t *list =
+	    cache->hash_list + sfs_cache_hashfn(blkno), *le = list;
+	while ((le = list_next(le)) != list) {
+		struct Page *page = le2page(le, swap_link);
+		if (page->index == blkno) {
+			return page;
+		}
+	}
+	return NULL;
+}
+
+// cache_reading - return true if blkno is being read into the cache
+static bool cache_reading(struct sfs_cache *cache, uint32_t blkno)
+{
+	list_entry_t *list = &(cache->read_list), *le = list;
+	while ((le = list_next(le)) != list) {
+		struct cache_read *rd = le2read(le, link);
+		if (blkno >= rd->blkno && blkno - rd->blkno < rd->n) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// cache_wait_read - sleep with the io_mutex of sfs dropped until a read in
+//                 - flight ends, the io_mutex is held again on return
+static void cache_wait_read(struct sfs_fs *sfs)
+{
+	struct sfs_cache *cache = &(sfs->cache);
+	wait_t __wait, *wait = &__wait;
+	wait_current_set(&(cache->read_wait), wait, WT_KSEM);
+	unlock_sfs_io(sfs);
+	schedule();
+	lock_sfs_io(sfs);
+	wait_current_del(&(cache->read_wait), wait);
+}
+
+// cache_read_start - put rd in read_list for the n blocks from blkno on and
+//                  - drop the io_mutex, the blocks are read next
+static void
+cache_read_start(struct sfs_fs *sfs, struct cache_read *rd, uint32_t blkno,
+		 uint32_t n)
+{
+	rd->blkno = blkno, rd->n = n;
+	list_add(&(sfs->cache.read_list), &(rd->link));
+	unlock_sfs_io(sfs);
+}
+
+// cache_read_end - take the io_mutex again once rd has been read, and wake up
+//                - those waiting for it
+static void cache_read_end(struct sfs_fs *sfs, struct cache_read *rd)
+{
+	struct sfs_cache *cache = &(sfs->cache);
+	lock_sfs_io(sfs);
+	list_del(&(rd->link));
+	if (!wait_queue_empty(&(cache->read_wait))) {
+		wakeup_queue(&(cache->read_wait), WT_KSEM, 1);
+	}
+}
+
+static void cache_insert(struct sfs_cache *cache, struct Page *page,
+			 uint32_t blkno)
+{
+	page->index = blkno;
+	set_page_ref(page, 0);
+	ClearPageDirty(page);
+	list_add(cache->hash_list + sfs_cache_hashfn(blkno),
+		 &(page->swap_link));
+	cache_inactive_list_add(cache, page);
+}
+
+static void cache_free_page(struct sfs_cache *cache, struct Page *page)
+{
+	cache_list_del(cache, page);
+	list_del(&(page->swap_link));
+	if (PageDirty(page)) {
+		ClearPageDirty(page);
+		cache->nr_dirty--;
+	}
+	ClearPageActive(page);
+	free_page(page);
+}
+
+static void flusher_wakeup(void)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		if (flusher != NULL && flusher->state == PROC_SLEEPING
+		    && flusher->wait_state == WT_TIMER) {
+			wakeup_proc(flusher);
+		}
+	}
+	local_intr_restore(intr_flag);
+}
+
+static void cache_set_dirty(struct sfs_cache *cache, struct Page *page)
+{
+	if (!PageDirty(page)) {
+		SetPageDirty(page);
+		if (++cache->nr_dirty == SFS_CACHE_DIRTY_HIGH) {
+			flusher_wakeup();
+		}
+	}
+}
+
+/*
+ * Write page back, together with the dirty pages of the blocks right
+ * after it, with one request. Pinned pages end the run, they may be half
+ * written.
+ */
+static int cache_writeback(struct sfs_fs *sfs, struct Page *page)
+{
+	struct sfs_cache *cache = &(sfs->cache);
+	struct Page *pages[SFS_CACHE_RA_BATCH];
+	struct iovec iov[SFS_CACHE_RA_BATCH];
+	struct iobuf __iob, *iob;
+	uint32_t blkno = page->index;
+	int ret, i, n = 0;
+	do {
+		pages[n] = page;
+		iov[n].iov_base = page2kva(page), iov[n].iov_len = SFS_BLKSIZE;
+	} while (++n < SFS_CACHE_RA_BATCH
+		 && (page = cache_lookup(cache, blkno + n)) != NULL
+		 && PageDirty(page) && page_ref(page) == 0);
+	iob = iobuf_init_vec(&__iob, iov, n, blkno * SFS_BLKSIZE);
+	if ((ret = dop_io(sfs->dev, iob, 1)) == 0) {
+		for (i = 0; i < n; i++) {
+			ClearPageDirty(pages[i]);
+		}
+		cache->nr_dirty -= n;
+	}
+	return ret;
+}
+
+// cache_refill_inactive - move up to n of the oldest active pages to the
+//                       - inactive list
+static void cache_refill_inactive(struct sfs_cache *cache, size_t n)
+{
+	list_entry_t *list = &(cache->active_list), *le = list_next(list);
+	while (n-- > 0 && le != list) {
+		struct Page *page = le2page(le, page_link);
+		le = list_next(le);
+		cache_list_del(cache, page);
+		cache_inactive_list_add(cache, page);
+	}
+}
+
+// cache_shrink - free up to n pages from the head of the inactive list,
+//              - writing the dirty ones back first. returns the # freed.
+static size_t cache_shrink(struct sfs_fs *sfs, size_t n)
+{
+	struct sfs_cache *cache = &(sfs->cache);
+	if (cache->nr_inactive < n) {
+		cache_refill_inactive(cache, n - cache->nr_inactive);
+	}
+	size_t free_count = 0;
+	list_entry_t *list = &(cache->inactive_list), *le = list_next(list);
+	while (free_count < n && le != list) {
+		struct Page *page = le2page(le, page_link);
+		le = list_next(le);
+		if (page_ref(page) != 0
+		    || (PageDirty(page) && cache_writeback(sfs, page) != 0)) {
+			continue;
+		}
+		cache_free_page(cache, page);
+		free_count++;
+	}
+	return free_count;
+}
+
+static struct Page *cache_alloc_page(struct sfs_fs *sfs)
+{
+	struct Page *page;
+	if (cache_nr_pages(&(sfs->cache)) >= SFS_CACHE_MAX_PAGES) {
+		cache_shrink(sfs, SFS_CACHE_RA_BATCH);
+	}
+	if ((page = alloc_page()) == NULL) {
+		if (cache_shrink(sfs, 1) != 0) {
+			page = alloc_page();
+		}
+	}
+	if (page != NULL) {
+		memcg_charge_cache(page);
+	}
+	return page;
+}
+
+/*
+ * Get the cached page of blkno, reading the block in if it is not cached
+ * yet and read is set. Returns -E_NO_MEM if the block is not cached and
+ * there is no page for it, the caller then goes to the disk directly.
+ */
+static int
+cache_get_page(struct sfs_fs *sfs, uint32_t blkno, bool read,
+	       struct Page **page_store)
+{
+	struct sfs_cache *cache = &(sfs->cache);
+	struct Page *page;
+	int ret;
+again:
+	if ((page = cache_lookup(cache, blkno)) != NULL) {
+		cache_list_del(cache, page);
+		cache_active_list_add(cache, page);
+		goto out;
+	}
+	if (cache_reading(cache, blkno)) {
+		cache_wait_read(sfs);
+		goto again;
+	}
+	if ((page = cache_alloc_page(sfs)) == NULL) {
+		return -E_NO_MEM;
+	}
+	if (read) {
+		struct cache_read __rd, *rd = &__rd;
+		struct iobuf __iob, *iob = iobuf_init(&__iob, page2kva(page),
+						      SFS_BLKSIZE,
+						      blkno * SFS_BLKSIZE);
+		cache_read_start(sfs, rd, blkno, 1);
+		ret = dop_io(sfs->dev, iob, 0);
+		cache_read_end(sfs, rd);
+		if (ret != 0) {
+			free_page(page);
+			return ret;
+		}
+	}
+	cache_insert(cache, page, blkno);
+out:
+	*page_store = page;
+	return 0;
+}
+
+int sfs_cache_create(struct sfs_fs *sfs)
+{
+	struct sfs_cache *cache = &(sfs->cache);
+	int i;
+	if ((cache->hash_list =
+	     kmalloc(sizeof(list_entry_t) * SFS_CACHE_HLIST_SIZE)) == NULL) {
+		return -E_NO_MEM;
+	}
+	for (i = 0; i < SFS_CACHE_HLIST_SIZE; i++) {
+		list_init(cache->hash_list + i);
+	}
+	list_init(&(cache->active_list));
+	list_init(&(cache->inactive_list));
+	cache->nr_active = cache->nr_inactive = cache->nr_dirty = 0;
+	list_init(&(cache->read_list));
+	wait_queue_init(&(cache->read_wait));
+
+	down(&cache_list_sem);
+	list_add(&cache_list, &(sfs->cache_link));
+	up(&cache_list_sem);
+	return 0;
+}
+
+void sfs_cache_destroy(struct sfs_fs *sfs)
+{
+	struct sfs_cache *cache = &(sfs->cache);
+	down(&cache_list_sem);
+	list_del(&(sfs->cache_link));
+	up(&cache_list_sem);
+
+	/* the pages that could not be written back are lost */
+	sfs_cache_drop(sfs);
+	cache_refill_inactive(cache, cache->nr_active);
+	while (!list_empty(&(cache->inactive_list))) {
+		cache_free_page(cache,
+				le2page(list_next(&(cache->inactive_list)),
+					page_link));
+	}
+	kfree(cache->hash_list);
+}
+
+/*
+ * sfs_bread_nolock - get the buffer of block blkno, reading it in unless
+ * read is clear. The io_mutex is dropped meanwhile if the block is read.
+ * The buffer is pinned: until sfs_brelse it is neither reclaimed nor
+ * written back, so the caller may drop the io_mutex it holds here and work
+ * on the buffer outside of it. A buffer taken for write is
+ * dirty already and gets written back after its release, by the flusher or
+ * by sfs_sync. Returns -E_NO_MEM if there is no page for the block.
+ */
+int
+sfs_bread_nolock(struct sfs_fs *sfs, uint32_t blkno, bool read, bool write,
+		 struct Page **page_store)
+{
+	assert(blkno != 0 && blkno < sfs->super.blocks);
+	struct Page *page;
+	int ret;
+	if ((ret = cache_get_page(sfs, blkno, read, &page)) != 0) {
+		return ret;
+	}
+	page_ref_inc(page);
+	if (write) {
+		cache_set_dirty(&(sfs->cache), page);
+	}
+	*page_store = page;
+	return 0;
+}
+
+void sfs_brelse(struct Page *page)
+{
+	assert(page_ref(page) > 0);
+	page_ref_dec(page);
+}
+
+// cache_fill - read n missing blocks from blkno on straight into new pages
+//            - with one request, and cache them
+static int cache_fill(struct sfs_fs *sfs, uint32_t blkno, int n)
+{
+	struct Page *pages[SFS_CACHE_RA_BATCH];
+	struct iovec iov[SFS_CACHE_RA_BATCH];
+	struct cache_read __rd, *rd = &__rd;
+	struct iobuf __iob, *iob;
+	int ret, i;
+	assert(n <= SFS_CACHE_RA_BATCH);
+	for (i = 0; i < n; i++) {
+		if ((pages[i] = cache_alloc_page(sfs)) == NULL) {
+			break;
+		}
+		iov[i].iov_base = page2kva(pages[i]), iov[i].iov_len = SFS_BLKSIZE;
+	}
+	if ((n = i) == 0) {
+		return -E_NO_MEM;
+	}
+	iob = iobuf_init_vec(&__iob, iov, n, blkno * SFS_BLKSIZE);
+	cache_read_start(sfs, rd, blkno, n);
+	ret = dop_io(sfs->dev, iob, 0);
+	cache_read_end(sfs, rd);
+	if (ret != 0) {
+		for (i = 0; i < n; i++) {
+			free_page(pages[i]);
+		}
+		return ret;
+	}
+	for (i = 0; i < n; i++) {
+		cache_insert(&(sfs->cache), pages[i], blkno + i);
+	}
+	return 0;
+}
+
+// cache_cached - return true if blkno is cached or on its way there
+static inline bool cache_cached(struct sfs_cache *cache, uint32_t blkno)
+{
+	return cache_lookup(cache, blkno) != NULL
+	    || cache_reading(cache, blkno);
+}
+
+// cache_prefetch - cache the nblks blocks from blkno on, one request for
+//                - each run of up to SFS_CACHE_RA_BATCH missing ones
+static void cache_prefetch(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks)
+{
+	struct sfs_cache *cache = &(sfs->cache);
+	uint32_t run;
+	while (nblks != 0) {
+		assert(blkno != 0 && blkno < sfs->super.blocks);
+		if (cache_cached(cache, blkno)) {
+			blkno++, nblks--;
+			continue;
+		}
+		for (run = 1; run < SFS_CACHE_RA_BATCH && run < nblks; run++) {
+			if (cache_cached(cache, blkno + run)) {
+				break;
+			}
+		}
+		if (cache_fill(sfs, blkno, run) != 0) {
+			break;
+		}
+		blkno += run, nblks -= run;
+	}
+}
+
+/*
+ * Read the blocks in blknos that are not cached yet. The pages join the
+ * inactive list, they are only marked active once they are really read.
+ */
+void sfs_cache_readahead(struct sfs_fs *sfs, const uint32_t * blknos, int n)
+{
+	int i = 0, run;
+	lock_sfs_io(sfs);
+	while (i < n) {
+		for (run = 1; i + run < n; run++) {
+			if (blknos[i + run] != blknos[i] + run) {
+				break;
+			}
+		}
+		cache_prefetch(sfs, blknos[i], run);
+		i += run;
+	}
+	unlock_sfs_io(sfs);
+}
+
+// sfs_cache_prefetch - cache the nblks blocks from blkno on before they
+//                    - are read one by one
+void sfs_cache_prefetch(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks)
+{
+	lock_sfs_io(sfs);
+	cache_prefetch(sfs, blkno, nblks);
+	unlock_sfs_io(sfs);
+}
+
+// sfs_cache_forget - drop block blkno, which has just been freed
+void sfs_cache_forget(struct sfs_fs *sfs, uint32_t blkno)
+{
+	struct Page *page;
+	lock_sfs_io(sfs);
+	while (cache_reading(&(sfs->cache), blkno)) {
+		cache_wait_read(sfs);
+	}
+	if ((page = cache_lookup(&(sfs->cache), blkno)) != NULL) {
+		assert(page_ref(page) == 0);
+		cache_free_page(&(sfs->cache), page);
+	}
+	unlock_sfs_io(sfs);
+}
+
+static int cache_flush_list(struct sfs_fs *sfs, list_entry_t * list)
+{
+	int ret = 0;
+	list_entry_t *le = list;
+	while (sfs->cache.nr_dirty != 0 && (le = list_next(le)) != list) {
+		struct Page *page = le2page(le, page_link);
+		/* a pinned page may be half written, it goes after sfs_brelse */
+		if (PageDirty(page) && page_ref(page) == 0) {
+			int err;
+			if ((err = cache_writeback(sfs, page)) != 0 && ret == 0) {
+				ret = err;
+			}
+		}
+	}
+	return ret;
+}
+
+static int sfs_cache_flush_nolock(struct sfs_fs *sfs)
+{
+	int ret1 = cache_flush_list(sfs, &(sfs->cache.inactive_list));
+	int ret2 = cache_flush_list(sfs, &(sfs->cache.active_list));
+	return (ret1 != 0) ? ret1 : ret2;
+}
+
+// sfs_cache_flush - write all the dirty pages of sfs back
+int sfs_cache_flush(struct sfs_fs *sfs)
+{
+	int ret;
+	lock_sfs_io(sfs);
+	ret = sfs_cache_flush_nolock(sfs);
+	unlock_sfs_io(sfs);
+	return ret;
+}
+
+// sfs_cache_drop - write all the dirty pages of sfs back and free the
+//                - pages, but for those whose write-back failed
+int sfs_cache_drop(struct sfs_fs *sfs)
+{
+	struct sfs_cache *cache = &(sfs->cache);
+	int ret;
+	lock_sfs_io(sfs);
+	ret = sfs_cache_flush_nolock(sfs);
+	cache_refill_inactive(cache, cache->nr_active);
+	cache_shrink(sfs, cache->nr_inactive);
+	unlock_sfs_io(sfs);
+	return ret;
+}
+
+// sfs_cache_drain - empty the caches of all sfs, like slab_drain
+void sfs_cache_drain(void)
+{
+	list_entry_t *le = &cache_list;
+	down(&cache_list_sem);
+	while ((le = list_next(le)) != &cache_list) {
+		sfs_cache_drop(le2sfs(le, cache_link));
+	}
+	up(&cache_list_sem);
+}
+
+/*
+ * Free up to n cached pages under memory pressure. The caches in use are
+ * skipped: the holder of an io_mutex may itself be waiting for kswapd in
+ * alloc_page.
+ */
+static size_t sfs_cache_reclaim(size_t n)
+{
+	size_t free_count = 0;
+	list_entry_t *le = &cache_list;
+	if (!try_down(&cache_list_sem)) {
+		return 0;
+	}
+	while (free_count < n && (le = list_next(le)) != &cache_list) {
+		struct sfs_fs *sfs = le2sfs(le, cache_link);
+		if (kmutex_trylock(&(sfs->io_mutex))) {
+			free_count += cache_shrink(sfs, n - free_count);
+			unlock_sfs_io(sfs);
+		}
+	}
+	up(&cache_list_sem);
+	return free_count;
+}
+
+// sfs_cache_count - the cached pages of all sfs, 0 while the list is busy
+static size_t sfs_cache_count(void)
+{
+	size_t count = 0;
+	list_entry_t *le = &cache_list;
+	if (!try_down(&cache_list_sem)) {
+		return 0;
+	}
+	while ((le = list_next(le)) != &cache_list) {
+		count += cache_nr_pages(&(le2sfs(le, cache_link)->cache));
+	}
+	up(&cache_list_sem);
+	return count;
+}
+
+static struct shrinker sfs_cache_shrinker = {
+	.name = "sfs_cache",
+	.count = sfs_cache_count,
+	.scan = sfs_cache_reclaim,
+};
+
+int sfs_flusher_main(void *arg)
+{
+	flusher = current;
+	while (1) {
+		list_entry_t *le = &cache_list;
+		down(&cache_list_sem);
+		while ((le = list_next(le)) != &cache_list) {
+			struct sfs_fs *sfs = le2sfs(le, cache_link);
+			if (sfs->cache.nr_dirty != 0) {
+				sfs_cache_flush(sfs);
+			}
+		}
+		up(&cache_list_sem);
+		do_sleep(SFS_FLUSH_INTERVAL);
+	}
+}
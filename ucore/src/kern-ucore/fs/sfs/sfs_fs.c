@@ -19,9 +19,13 @@
  * sfs filesystem structure.
  */
 
-static int sfs_sync(struct fs *fs)
+/*
+ * sfs_sync_nolock - write the dirty inodes, the superblock and the freemap
+ * of sfs back. Those of a journaled sfs go to the running transaction,
+ * which is held still by its commit calling this.
+ */
+int sfs_sync_nolock(struct sfs_fs *sfs)
 {
-	struct sfs_fs *sfs = fsop_info(fs, sfs);
 	lock_sfs_fs(sfs);
 /*
  * Get the sfs_fs from the generic abstract fs.
@@ -56,7 +60,11 @@ static int sfs_sync(struct fs *fs)
 		list_entry_t *list = &(sfs->inode_list), *le = list;
 		while ((le = list_next(le)) != list) {
 			struct sfs_inode *sin = le2sin(le, inode_link);
-			vop_fsync(info2node(sin, sfs_inode));
+			if (sfs_journaled(sfs)) {
+				sfs_fsync_nolock(sfs, sin);
+			} else {
+				vop_fsync(info2node(sin, sfs_inode));
+			}
 		}
 	}
 	unlock_sfs_fs(sfs);
@@ -75,7 +83,23 @@ static int sfs_sync(struct fs *fs)
 			return ret;
 		}
 	}
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	/* the inodes, the freemap and the data above only went to the cache */
+	return sfs_cache_flush(sfs);
+#else
 	return 0;
+#endif
+}
+
+static int sfs_sync(struct fs *fs)
+{
+	struct sfs_fs *sfs = fsop_info(fs, sfs);
+#ifdef UCONFIG_SFS_JOURNAL
+	if (sfs_journaled(sfs)) {
+		return sfs_journal_commit(sfs);
+	}
+#endif
+	return sfs_sync_nolock(sfs);
 }
 
 /*
@@ -107,9 +131,16 @@ static int sfs_cleanup(struct fs *fs)
 		return -E_BUSY;
 	}
 	assert(!sfs->super_dirty);
+#ifdef UCONFIG_SFS_JOURNAL
+	sfs_journal_destroy(sfs);
+#endif
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	sfs_cache_destroy(sfs);
+#endif
 	bitmap_destroy(sfs->freemap);
+	kfree(sfs->freemap_dirty);
 	kfree(sfs->sfs_buffer);
-	kfree(sfs->hash_list);
+	rhash_destroy(&(sfs->inode_hash));
 	kfree(sfs);
 	return 0;
 }
@@ -130,6 +161,11 @@ static int sfs_unmount(struct fs *fs)
 	if (ret != 0) {
 		warn("sfs: sync error: '%s': %e.\n", sfs->super.info, ret);
 	}
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	else {
+		sfs_cache_drop(sfs);
+	}
+#endif
 	return ret;
 }
 
@@ -180,6 +216,16 @@ static int sfs_do_mount(struct device *dev, struct fs **fs_store)
 	static_assert(SFS_BLKSIZE >= sizeof(struct sfs_super));
 	static_assert(SFS_BLKSIZE >= sizeof(struct sfs_disk_inode));
 	static_assert(SFS_BLKSIZE >= sizeof(struct sfs_disk_entry));
+	static_assert(SFS_DIRINDEX_OFFSET >= sizeof(struct sfs_disk_inode));
+	static_assert(SFS_EXTENT_OFFSET >= sizeof(struct sfs_disk_inode));
+	static_assert(SFS_BLKSIZE >=
+		      SFS_DIRINDEX_OFFSET + sizeof(struct sfs_disk_dirindex));
+	static_assert(SFS_BLKSIZE >= SFS_DIRENT_LINK_OFFSET + sizeof(uint32_t));
+	static_assert(SFS_BLKSIZE >=
+		      SFS_INLINE_DIR_OFFSET +
+		      SFS_INLINE_DIR_NSLOTS * SFS_INLINE_DENTRY_SIZE);
+	static_assert(SFS_BLKSIZE >= sizeof(struct sfs_journal_desc));
+	static_assert(SFS_BLKSIZE >= sizeof(struct sfs_journal_commit));
 
 /*
  * We can't mount on devices with the wrong sector size.
@@ -202,6 +248,10 @@ static int sfs_do_mount(struct device *dev, struct fs **fs_store)
 	/* get sfs from fs.fs_info.__sfs_info */
 	struct sfs_fs *sfs = fsop_info(fs, sfs);
 	sfs->dev = dev;
+	sfs->mem = dev->d_mem;
+#ifdef UCONFIG_SFS_JOURNAL
+	sfs->journal = NULL;
+#endif
 
 	int ret = -E_NO_MEM;
 
@@ -231,22 +281,30 @@ static int sfs_do_mount(struct device *dev, struct fs **fs_store)
 			super->blocks, dev->d_blocks);
 		goto failed_cleanup_sfs_buffer;
 	}
+	if (super->features & ~SFS_FEATURE_ALL) {
+		kprintf("sfs: unknown features %08x in superblock.\n",
+			super->features & ~SFS_FEATURE_ALL);
+		goto failed_cleanup_sfs_buffer;
+	}
 	super->info[SFS_MAX_INFO_LEN] = '\0';
 	sfs->super = *super;
 
+#ifdef UCONFIG_SFS_JOURNAL
+	/* replay the journal before anything else is read */
+	if ((ret = sfs_journal_create(sfs)) != 0) {
+		goto failed_cleanup_sfs_buffer;
+	}
+	*super = sfs->super;
+#endif
+
 	ret = -E_NO_MEM;
 
 	uint32_t i;
 
-	/* alloc and initialize hash list */
-	list_entry_t *hash_list;
-	if ((sfs->hash_list = hash_list =
-	     kmalloc(sizeof(list_entry_t) * SFS_HLIST_SIZE)) == NULL) {
+	/* the inode table */
+	if (rhash_init(&(sfs->inode_hash), SFS_HLIST_SHIFT, 0) != 0) {
 		goto failed_cleanup_sfs_buffer;
 	}
-	for (i = 0; i < SFS_HLIST_SIZE; i++) {
-		list_init(hash_list + i);
-	}
 
 	/* load and check freemap (free space bitmap in disk) */
 	struct bitmap *freemap;
@@ -256,26 +314,40 @@ static int sfs_do_mount(struct device *dev, struct fs **fs_store)
 		goto failed_cleanup_hash_list;
 	}
 	uint32_t freemap_size_nblks = sfs_freemap_blocks(super);
+	if ((sfs->freemap_dirty =
+	     kmalloc(sizeof(bool) * freemap_size_nblks)) == NULL) {
+		goto failed_cleanup_freemap;
+	}
+	memset(sfs->freemap_dirty, 0, sizeof(bool) * freemap_size_nblks);
 	if ((ret =
 	     sfs_init_freemap(dev, freemap, SFS_BLKN_FREEMAP,
 			      freemap_size_nblks, sfs_buffer)) != 0) {
-		goto failed_cleanup_freemap;
+		goto failed_cleanup_freemap_dirty;
 	}
 
-	uint32_t blocks = sfs->super.blocks, unused_blocks = 0;
-	for (i = 0; i < freemap_size_nbits; i++) {
-		if (bitmap_test(freemap, i)) {
-			unused_blocks++;
-		}
-	}
+	/* counts the free blocks of the allocation groups as well */
+	uint32_t blocks = sfs->super.blocks, unused_blocks =
+	    bitmap_rescan(freemap);
 	assert(unused_blocks == sfs->super.unused_blocks);
 
 	/* and other fields */
 	sfs->super_dirty = 0;
-	sem_init(&(sfs->fs_sem), 1);
-	sem_init(&(sfs->io_sem), 1);
-	sem_init(&(sfs->mutex_sem), 1);
+	spinlock_init(&(sfs->freemap_lock));
+	kmutex_init(&(sfs->fs_mutex));
+	kmutex_init(&(sfs->io_mutex));
+#ifdef UCONFIG_LOCK_STAT
+	lock_stat_class("sfs_io", &(sfs->io_mutex.stat));
+#endif
+	kmutex_init(&(sfs->link_mutex));
+	for (i = 0; i < SFS_HLOCK_SIZE; i++) {
+		kmutex_init(&(sfs->hash_mutex[i]));
+	}
 	list_init(&(sfs->inode_list));
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	if ((ret = sfs_cache_create(sfs)) != 0) {
+		goto failed_cleanup_freemap_dirty;
+	}
+#endif
 	kprintf("sfs: mount: '%s' (%d/%d/%d)\n", sfs->super.info,
 		blocks - unused_blocks, unused_blocks, blocks);
 
@@ -288,11 +360,16 @@ static int sfs_do_mount(struct device *dev, struct fs **fs_store)
 	*fs_store = fs;
 	return 0;
 
+failed_cleanup_freemap_dirty:
+	kfree(sfs->freemap_dirty);
 failed_cleanup_freemap:
 	bitmap_destroy(freemap);
 failed_cleanup_hash_list:
-	kfree(hash_list);
+	rhash_destroy(&(sfs->inode_hash));
 failed_cleanup_sfs_buffer:
+#ifdef UCONFIG_SFS_JOURNAL
+	sfs_journal_destroy(sfs);
+#endif
 	kfree(sfs_buffer);
 failed_cleanup_fs:
 	kfree(fs);
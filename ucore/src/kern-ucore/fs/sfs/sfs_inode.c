@@ -19,18 +19,18 @@ static const struct inode_ops sfs_node_fileops;
 static inline int trylock_sin(struct sfs_inode *sin)
 {
 	if (!SFSInodeRemoved(sin)) {
-		down(&(sin->sem));
+		kmutex_lock(&(sin->mutex));
 		if (!SFSInodeRemoved(sin)) {
 			return 0;
 		}
-		up(&(sin->sem));
+		kmutex_unlock(&(sin->mutex));
 	}
 	return -E_NOENT;
 }
 
 static inline void unlock_sin(struct sfs_inode *sin)
 {
-	up(&(sin->sem));
+	kmutex_unlock(&(sin->mutex));
 }
 
 static const struct inode_ops *sfs_get_ops(uint16_t type)
@@ -44,21 +44,30 @@ static const struct inode_ops *sfs_get_ops(uint16_t type)
 	panic("invalid file type %d.\n", type);
 }
 
-static list_entry_t *sfs_hash_list(struct sfs_fs *sfs, uint32_t ino)
+static bool sfs_inode_match(struct rhash_node *node, void *key)
 {
-	return sfs->hash_list + sin_hashfn(ino);
+	return to_struct(node, struct sfs_inode, hash_link)->ino ==
+	    *(uint32_t *) key;
 }
 
+/* *
+ * sfs_set_links/sfs_remove_links - add sin to or take it off the inode
+ * table, with the hash lock of sin->ino held
+ * */
 static void sfs_set_links(struct sfs_fs *sfs, struct sfs_inode *sin)
 {
+	rhash_add(&(sfs->inode_hash), &(sin->hash_link), sin->ino);
+	lock_sfs_fs(sfs);
 	list_add(&(sfs->inode_list), &(sin->inode_link));
-	list_add(sfs_hash_list(sfs, sin->ino), &(sin->hash_link));
+	unlock_sfs_fs(sfs);
 }
 
-static void sfs_remove_links(struct sfs_inode *sin)
+static void sfs_remove_links(struct sfs_fs *sfs, struct sfs_inode *sin)
 {
+	rhash_del(&(sfs->inode_hash), &(sin->hash_link));
+	lock_sfs_fs(sfs);
 	list_del(&(sin->inode_link));
-	list_del(&(sin->hash_link));
+	unlock_sfs_fs(sfs);
 }
 
 static bool sfs_block_inuse(struct sfs_fs *sfs, uint32_t ino)
@@ -70,62 +79,216 @@ static bool sfs_block_inuse(struct sfs_fs *sfs, uint32_t ino)
 	      sfs->super.blocks, ino);
 }
 
+/* *
+ * The freemap is shared by the inodes of sfs, which allocate and free
+ * their blocks under their own locks, so it is changed with freemap_lock
+ * held. Clearing a new block is left to after the unlock.
+ * */
+static void sfs_block_taken_nolock(struct sfs_fs *sfs, uint32_t ino)
+{
+	assert(sfs->super.unused_blocks > 0);
+	sfs->super.unused_blocks--, sfs->super_dirty = 1;
+	sfs->freemap_dirty[ino / SFS_BLKBITS] = 1;
+	assert(sfs_block_inuse(sfs, ino));
+}
+
 static int sfs_block_alloc(struct sfs_fs *sfs, uint32_t * ino_store)
 {
+	bool intr_flag;
 	int ret;
-	if ((ret = bitmap_alloc(sfs->freemap, ino_store)) != 0) {
+	spin_lock_irqsave(&(sfs->freemap_lock), intr_flag);
+	if ((ret = bitmap_alloc(sfs->freemap, ino_store)) == 0) {
+		sfs_block_taken_nolock(sfs, *ino_store);
+	}
+	spin_unlock_irqrestore(&(sfs->freemap_lock), intr_flag);
+	if (ret != 0) {
 		return ret;
 	}
-	assert(sfs->super.unused_blocks > 0);
-	sfs->super.unused_blocks--, sfs->super_dirty = 1;
-	assert(sfs_block_inuse(sfs, *ino_store));
 	return sfs_clear_block(sfs, *ino_store, 1);
 }
 
-static void sfs_block_free(struct sfs_fs *sfs, uint32_t ino)
+/* *
+ * sfs_block_alloc_near - allocate a block of sin, at its goal if that one is
+ * free or else close after it, so that a file is laid out in order
+ * */
+static int
+sfs_block_alloc_near(struct sfs_fs *sfs, struct sfs_inode *sin,
+		     uint32_t * ino_store)
+{
+	bool intr_flag;
+	int ret;
+	spin_lock_irqsave(&(sfs->freemap_lock), intr_flag);
+	if ((ret =
+	     bitmap_alloc_near(sfs->freemap, sin->alloc_goal,
+			       ino_store)) == 0) {
+		sfs_block_taken_nolock(sfs, *ino_store);
+	}
+	spin_unlock_irqrestore(&(sfs->freemap_lock), intr_flag);
+	if (ret != 0) {
+		return ret;
+	}
+	sin->alloc_goal = *ino_store + 1;
+	return sfs_clear_block(sfs, *ino_store, 1);
+}
+
+/* *
+ * Preallocation: a file growing at its end takes SFS_PREALLOC_BLOCKS free
+ * blocks in a row at once and hands them out to its next appends, so that
+ * files appended to side by side get runs of their own instead of taking
+ * blocks in turn, and the freemap is locked once per run. What is left of
+ * a run is given back at the last close and at reclaim; a crash before
+ * leaves those blocks taken.
+ * */
+#define SFS_PREALLOC_BLOCKS             16
+
+static int
+sfs_block_alloc_run(struct sfs_fs *sfs, uint32_t goal, uint32_t n,
+		    uint32_t * ino_store, uint32_t * n_store)
 {
+	bool intr_flag;
+	uint32_t i;
+	int ret;
+	spin_lock_irqsave(&(sfs->freemap_lock), intr_flag);
+	if ((ret =
+	     bitmap_alloc_run(sfs->freemap, goal, n, ino_store,
+			      n_store)) == 0) {
+		for (i = 0; i < *n_store; i++) {
+			sfs_block_taken_nolock(sfs, *ino_store + i);
+		}
+	}
+	spin_unlock_irqrestore(&(sfs->freemap_lock), intr_flag);
+	return ret;
+}
+
+// sfs_block_alloc_data - a data block for the end of sin, the next one of
+//                      - its preallocation for a file
+static int
+sfs_block_alloc_data(struct sfs_fs *sfs, struct sfs_inode *sin,
+		     uint32_t * ino_store)
+{
+	int ret;
+	if (sin->din->type != SFS_TYPE_FILE) {
+		return sfs_block_alloc_near(sfs, sin, ino_store);
+	}
+	if (sin->prealloc_len == 0
+	    && (ret =
+		sfs_block_alloc_run(sfs, sin->alloc_goal, SFS_PREALLOC_BLOCKS,
+				    &(sin->prealloc_start),
+				    &(sin->prealloc_len))) != 0) {
+		return ret;
+	}
+	*ino_store = sin->prealloc_start++;
+	sin->prealloc_len--;
+	sin->alloc_goal = *ino_store + 1;
+	return sfs_clear_block(sfs, *ino_store, 1);
+}
+
+// sfs_block_release - put block ino back in the freemap
+void sfs_block_release(struct sfs_fs *sfs, uint32_t ino)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&(sfs->freemap_lock), intr_flag);
 	assert(sfs_block_inuse(sfs, ino));
 	bitmap_free(sfs->freemap, ino);
 	sfs->super.unused_blocks++, sfs->super_dirty = 1;
+	sfs->freemap_dirty[ino / SFS_BLKBITS] = 1;
+	spin_unlock_irqrestore(&(sfs->freemap_lock), intr_flag);
+}
+
+// sfs_prealloc_release_nolock - give back the blocks sin took ahead
+static void sfs_prealloc_release_nolock(struct sfs_fs *sfs,
+					struct sfs_inode *sin)
+{
+	/* never mapped, so not to be held off by the journal */
+	while (sin->prealloc_len != 0) {
+		sin->prealloc_len--;
+		sfs_block_release(sfs, sin->prealloc_start + sin->prealloc_len);
+	}
+}
+
+static void sfs_block_free(struct sfs_fs *sfs, uint32_t ino)
+{
+#ifdef UCONFIG_SFS_JOURNAL
+	/* not to be used again before the transaction freeing it commits */
+	if (!sfs_journaled(sfs) || sfs_journal_free(sfs, ino) != 0)
+#endif
+		sfs_block_release(sfs, ino);
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	sfs_cache_forget(sfs, ino);
+#endif
 }
 
 static int
 sfs_create_inode(struct sfs_fs *sfs, struct sfs_disk_inode *din, uint32_t ino,
 		 struct inode **node_store)
 {
+	struct sfs_disk_extent *extents = NULL;
+	int ret;
+	if (sfs_extent_mapped(sfs, din->type)) {
+		if (din->extinfo.nextents > SFS_MAX_EXTENTS) {
+			warn("sfs: bad extent map of inode %u.\n", ino);
+			return -E_INVAL;
+		}
+		if ((extents =
+		     kmalloc(sizeof(struct sfs_disk_extent) *
+			     SFS_MAX_EXTENTS)) == NULL) {
+			return -E_NO_MEM;
+		}
+		size_t len =
+		    sizeof(struct sfs_disk_extent) * din->extinfo.nextents;
+		if (len != 0
+		    && (ret =
+			sfs_rbuf(sfs, extents, len, ino,
+				 SFS_EXTENT_OFFSET)) != 0) {
+			kfree(extents);
+			return ret;
+		}
+	}
 	struct inode *node;
 	if ((node = alloc_inode(sfs_inode)) != NULL) {
 		vop_init(node, sfs_get_ops(din->type), info2fs(sfs, sfs));
 		struct sfs_inode *sin = vop_info(node, sfs_inode);
 		sin->din = din, sin->ino = ino, sin->dirty = 0, sin->flags =
 		    0, sin->reclaim_count = 1;
-		sem_init(&(sin->sem), 1);
+		sin->extents = extents, sin->alloc_goal = ino + 1;
+		sin->prealloc_start = sin->prealloc_len = 0;
+#ifdef UCONFIG_SFS_PAGE_CACHE
+		sin->ra_next = sin->ra_end = sin->ra_pages = 0;
+#endif
+		kmutex_init(&(sin->mutex));
+		/* every path lookup goes through directories */
+		if (din->type == SFS_TYPE_DIR) {
+			inode_ref_cache(node);
+		}
 		*node_store = node;
 		return 0;
 	}
+	if (extents != NULL) {
+		kfree(extents);
+	}
 	return -E_NO_MEM;
 }
 
 static struct inode *lookup_sfs_nolock(struct sfs_fs *sfs, uint32_t ino)
 {
 	struct inode *node;
-	list_entry_t *list = sfs_hash_list(sfs, ino), *le = list;
-	while ((le = list_next(le)) != list) {
-		struct sfs_inode *sin = le2sin(le, hash_link);
-		if (sin->ino == ino) {
-			node = info2node(sin, sfs_inode);
-			if (vop_ref_inc(node) == 1) {
-				sin->reclaim_count++;
-			}
-			return node;
+	struct rhash_node *hn;
+	if ((hn = rhash_lookup(&(sfs->inode_hash), ino, sfs_inode_match,
+			       &ino)) != NULL) {
+		struct sfs_inode *sin = to_struct(hn, struct sfs_inode,
+						  hash_link);
+		node = info2node(sin, sfs_inode);
+		if (vop_ref_get(node)) {
+			sin->reclaim_count++;
 		}
+		return node;
 	}
 	return NULL;
 }
 
 int sfs_load_inode(struct sfs_fs *sfs, struct inode **node_store, uint32_t ino)
 {
-	lock_sfs_fs(sfs);
+	lock_sfs_hash(sfs, ino);
 	struct inode *node;
 	if ((node = lookup_sfs_nolock(sfs, ino)) != NULL) {
 		goto out_unlock;
@@ -150,20 +313,26 @@ int sfs_load_inode(struct sfs_fs *sfs, struct inode **node_store, uint32_t ino)
 	sfs_set_links(sfs, vop_info(node, sfs_inode));
 
 out_unlock:
-	unlock_sfs_fs(sfs);
+	unlock_sfs_hash(sfs, ino);
 	*node_store = node;
 	return 0;
 
 failed_cleanup_din:
 	kfree(din);
 failed_unlock:
-	unlock_sfs_fs(sfs);
+	unlock_sfs_hash(sfs, ino);
 	return ret;
 }
 
+/* *
+ * sfs_bmap_get_sub_nolock - entry index of the index block at *entp, which
+ * is created with it if need be; data tells a data block from the index
+ * block of a double indirect
+ * */
 static int
-sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, uint32_t * entp, uint32_t index,
-			bool create, uint32_t * ino_store)
+sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, struct sfs_inode *sin,
+			uint32_t * entp, uint32_t index, bool create, bool data,
+			uint32_t * ino_store)
 {
 	assert(index < SFS_BLK_NENTRY);
 	int ret;
@@ -181,12 +350,14 @@ sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, uint32_t * entp, uint32_t index,
 		if (!create) {
 			goto out;
 		}
-		if ((ret = sfs_block_alloc(sfs, &ent)) != 0) {
+		if ((ret = sfs_block_alloc_near(sfs, sin, &ent)) != 0) {
 			return ret;
 		}
 	}
 
-	if ((ret = sfs_block_alloc(sfs, &ino)) != 0) {
+	if ((ret =
+	     (data) ? sfs_block_alloc_data(sfs, sin, &ino) :
+	     sfs_block_alloc_near(sfs, sin, &ino)) != 0) {
 		goto failed_cleanup;
 	}
 	if ((ret = sfs_wbuf(sfs, &ino, sizeof(uint32_t), ent, offset)) != 0) {
@@ -208,6 +379,73 @@ failed_cleanup:
 	return ret;
 }
 
+/*
+ * The extent map of a file: extents cover the blocks of the file in order,
+ * a new block grows the last extent when the block after it is free.
+ */
+static int
+sfs_extent_find(struct sfs_inode *sin, uint32_t index, uint32_t * ino_store,
+		uint32_t * run_store)
+{
+	struct sfs_disk_extent *ext = sin->extents;
+	uint32_t i, nextents = sin->din->extinfo.nextents;
+	for (i = 0; i < nextents; i++, ext++) {
+		if (index < ext->len) {
+			*ino_store = ext->start + index;
+			if (run_store != NULL) {
+				*run_store = ext->len - index;
+			}
+			return 0;
+		}
+		index -= ext->len;
+	}
+	return -E_INVAL;
+}
+
+static int
+sfs_extent_append_nolock(struct sfs_fs *sfs, struct sfs_inode *sin,
+			 uint32_t * ino_store)
+{
+	struct sfs_disk_inode *din = sin->din;
+	uint32_t nextents = din->extinfo.nextents, ino;
+	int ret;
+	struct sfs_disk_extent *ext = NULL;
+	if (nextents != 0) {
+		ext = &(sin->extents[nextents - 1]);
+		sin->alloc_goal = ext->start + ext->len;
+	}
+	if ((ret = sfs_block_alloc_data(sfs, sin, &ino)) != 0) {
+		return ret;
+	}
+	if (ext != NULL && ino == ext->start + ext->len) {
+		ext->len++;
+		goto out;
+	}
+	if (nextents == SFS_MAX_EXTENTS) {
+		sfs_block_free(sfs, ino);
+		return -E_TOO_BIG;
+	}
+	sin->extents[nextents].start = ino;
+	sin->extents[nextents].len = 1;
+	din->extinfo.nextents++;
+out:
+	sin->dirty = 1;
+	*ino_store = ino;
+	return 0;
+}
+
+static void sfs_extent_truncate_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
+{
+	struct sfs_disk_inode *din = sin->din;
+	assert(din->extinfo.nextents != 0);
+	struct sfs_disk_extent *ext = &(sin->extents[din->extinfo.nextents - 1]);
+	sfs_block_free(sfs, ext->start + (--ext->len));
+	if (ext->len == 0) {
+		din->extinfo.nextents--;
+	}
+	sin->dirty = 1;
+}
+
 static int
 sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
 		    bool create, uint32_t * ino_store)
@@ -215,9 +453,25 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
 	struct sfs_disk_inode *din = sin->din;
 	int ret;
 	uint32_t ent, ino;
+	if (sin->extents != NULL) {
+		if (index < din->blocks) {
+			if ((ret = sfs_extent_find(sin, index, &ino, NULL)) != 0) {
+				return ret;
+			}
+		} else if (create) {
+			/* the only block created is the one after the last */
+			assert(index == din->blocks);
+			if ((ret = sfs_extent_append_nolock(sfs, sin, &ino)) != 0) {
+				return ret;
+			}
+		} else {
+			ino = 0;
+		}
+		goto out;
+	}
 	if (index < SFS_NDIRECT) {
 		if ((ino = din->direct[index]) == 0 && create) {
-			if ((ret = sfs_block_alloc(sfs, &ino)) != 0) {
+			if ((ret = sfs_block_alloc_data(sfs, sin, &ino)) != 0) {
 				return ret;
 			}
 			din->direct[index] = ino;
@@ -230,7 +484,7 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
 	if (index < SFS_BLK_NENTRY) {
 		ent = din->indirect;
 		if ((ret =
-		     sfs_bmap_get_sub_nolock(sfs, &ent, index, create,
+		     sfs_bmap_get_sub_nolock(sfs, sin, &ent, index, create, 1,
 					     &ino)) != 0) {
 			return ret;
 		}
@@ -245,8 +499,8 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
 	index -= SFS_BLK_NENTRY;
 	ent = din->db_indirect;
 	if ((ret =
-	     sfs_bmap_get_sub_nolock(sfs, &ent, index / SFS_BLK_NENTRY, create,
-				     &ino)) != 0) {
+	     sfs_bmap_get_sub_nolock(sfs, sin, &ent, index / SFS_BLK_NENTRY,
+				     create, 0, &ino)) != 0) {
 		return ret;
 	}
 	if (ent != din->db_indirect) {
@@ -256,8 +510,9 @@ sfs_bmap_get_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
 	}
 	if ((ent = ino) != 0) {
 		if ((ret =
-		     sfs_bmap_get_sub_nolock(sfs, &ent, index % SFS_BLK_NENTRY,
-					     create, &ino)) != 0) {
+		     sfs_bmap_get_sub_nolock(sfs, sin, &ent,
+					     index % SFS_BLK_NENTRY, create, 1,
+					     &ino)) != 0) {
 			return ret;
 		}
 	}
@@ -295,6 +550,12 @@ sfs_bmap_free_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index)
 	struct sfs_disk_inode *din = sin->din;
 	int ret;
 	uint32_t ent, ino;
+	if (sin->extents != NULL) {
+		/* only the last block is ever freed */
+		assert(index + 1 == din->blocks);
+		sfs_extent_truncate_nolock(sfs, sin);
+		return 0;
+	}
 	if (index < SFS_NDIRECT) {
 		if ((ino = din->direct[index]) != 0) {
 			sfs_block_free(sfs, ino);
@@ -318,8 +579,9 @@ sfs_bmap_free_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index)
 	index -= SFS_BLK_NENTRY;
 	if ((ent = din->db_indirect) != 0) {
 		if ((ret =
-		     sfs_bmap_get_sub_nolock(sfs, &ent, index / SFS_BLK_NENTRY,
-					     0, &ino)) != 0) {
+		     sfs_bmap_get_sub_nolock(sfs, sin, &ent,
+					     index / SFS_BLK_NENTRY, 0, 0,
+					     &ino)) != 0) {
 			return ret;
 		}
 		if ((ent = ino) != 0) {
@@ -356,6 +618,54 @@ sfs_bmap_load_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
 	return 0;
 }
 
+/* *
+ * sfs_bmap_run_nolock - load block index of sin as sfs_bmap_load_nolock does,
+ * and count how many of the nblks blocks from there lie one after the other
+ * on disk. An extent mapped file grows by all of them first, so that they
+ * join its last extent.
+ * */
+static int
+sfs_bmap_run_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t index,
+		    uint32_t nblks, uint32_t * ino_store, uint32_t * run_store)
+{
+	assert(nblks != 0);
+	int ret;
+	uint32_t ino, next, run;
+	if (sin->extents != NULL) {
+		while (sin->din->blocks < index + nblks) {
+			if ((ret =
+			     sfs_bmap_load_nolock(sfs, sin, sin->din->blocks,
+						  NULL)) != 0) {
+				if (sin->din->blocks <= index) {
+					return ret;
+				}
+				/* reported by the call for the next block */
+				break;
+			}
+		}
+		if ((ret = sfs_extent_find(sin, index, &ino, &run)) != 0) {
+			return ret;
+		}
+		if (run > nblks) {
+			run = nblks;
+		}
+		goto out;
+	}
+	if ((ret = sfs_bmap_load_nolock(sfs, sin, index, &ino)) != 0) {
+		return ret;
+	}
+	for (run = 1; run < nblks; run++) {
+		/* a failed lookup is retried, and reported, by the next call */
+		if (sfs_bmap_load_nolock(sfs, sin, index + run, &next) != 0
+		    || next != ino + run) {
+			break;
+		}
+	}
+out:
+	*ino_store = ino, *run_store = run;
+	return 0;
+}
+
 static int sfs_bmap_truncate_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
 {
 	struct sfs_disk_inode *din = sin->din;
@@ -369,6 +679,85 @@ static int sfs_bmap_truncate_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
 	return 0;
 }
 
+/*
+ * sfs_inline_dir_expand_nolock - move the slots of an inline directory out
+ * to a block each, see sfs.h; the slot numbers, and so the links of its
+ * index, stay the same
+ */
+static int
+sfs_inline_dir_expand_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
+{
+	struct sfs_disk_inode *din = sin->din;
+	uint32_t i, nslots = din->blocks, ino;
+	void *buffer;
+	int ret;
+	assert(sfs_inlined(sin) && nslots <= SFS_INLINE_DIR_NSLOTS);
+	if ((buffer = kmalloc(SFS_INLINE_DIR_NSLOTS * SFS_INLINE_DENTRY_SIZE))
+	    == NULL) {
+		return -E_NO_MEM;
+	}
+	if ((ret =
+	     sfs_rbuf(sfs, buffer, nslots * SFS_INLINE_DENTRY_SIZE, sin->ino,
+		      SFS_INLINE_DIR_OFFSET)) != 0) {
+		goto out;
+	}
+	din->blocks = 0;
+	for (i = 0; i < nslots; i++) {
+		if ((ret = sfs_bmap_load_nolock(sfs, sin, i, &ino)) != 0
+		    || (ret =
+			sfs_wbuf(sfs, buffer + i * SFS_INLINE_DENTRY_SIZE,
+				 SFS_INLINE_DENTRY_SIZE, ino, 0)) != 0) {
+			break;
+		}
+	}
+	if (ret != 0) {
+		while (din->blocks != 0) {
+			sfs_bmap_truncate_nolock(sfs, sin);
+		}
+		din->blocks = nslots;
+		goto out;
+	}
+	din->flags &= ~SFS_INODE_INLINE;
+	sin->dirty = 1;
+out:
+	kfree(buffer);
+	return ret;
+}
+
+/*
+ * sfs_dirent_locate_nolock - the block and the offset of slot of the
+ * directory sin, a new one if slot is the one after the last
+ */
+static int
+sfs_dirent_locate_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot,
+			 uint32_t * blkno_store, off_t * offset_store)
+{
+	struct sfs_disk_inode *din = sin->din;
+	assert(din->type == SFS_TYPE_DIR && (slot >= 0 && slot <= din->blocks));
+	int ret;
+	if (sfs_inlined(sin)) {
+		if (slot < SFS_INLINE_DIR_NSLOTS) {
+			if (slot == din->blocks) {
+				din->blocks++, sin->dirty = 1;
+			}
+			*blkno_store = sin->ino;
+			*offset_store =
+			    SFS_INLINE_DIR_OFFSET +
+			    slot * SFS_INLINE_DENTRY_SIZE;
+			return 0;
+		}
+		if ((ret = sfs_inline_dir_expand_nolock(sfs, sin)) != 0) {
+			return ret;
+		}
+	}
+	if ((ret = sfs_bmap_load_nolock(sfs, sin, slot, blkno_store)) != 0) {
+		return ret;
+	}
+	assert(sfs_block_inuse(sfs, *blkno_store));
+	*offset_store = 0;
+	return 0;
+}
+
 static int
 sfs_dirent_read_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot,
 		       struct sfs_disk_entry *entry)
@@ -377,13 +766,14 @@ sfs_dirent_read_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot,
 	       && (slot >= 0 && slot < sin->din->blocks));
 	int ret;
 	uint32_t ino;
-	if ((ret = sfs_bmap_load_nolock(sfs, sin, slot, &ino)) != 0) {
+	off_t offset;
+	if ((ret =
+	     sfs_dirent_locate_nolock(sfs, sin, slot, &ino, &offset)) != 0) {
 		return ret;
 	}
-	assert(sfs_block_inuse(sfs, ino));
 	if ((ret =
 	     sfs_rbuf(sfs, entry, sizeof(struct sfs_disk_entry), ino,
-		      0)) != 0) {
+		      offset)) != 0) {
 		return ret;
 	}
 	entry->name[SFS_MAX_FNAME_LEN] = '\0';
@@ -407,25 +797,176 @@ sfs_dirent_write_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot,
 		entry->ino = ino, strcpy(entry->name, name);
 	}
 	int ret;
-	if ((ret = sfs_bmap_load_nolock(sfs, sin, slot, &ino)) != 0) {
+	off_t offset;
+	if ((ret =
+	     sfs_dirent_locate_nolock(sfs, sin, slot, &ino, &offset)) != 0) {
 		goto out;
 	}
-	assert(sfs_block_inuse(sfs, ino));
-	ret = sfs_wbuf(sfs, entry, sizeof(struct sfs_disk_entry), ino, 0);
+	ret = sfs_wbuf(sfs, entry, sizeof(struct sfs_disk_entry), ino, offset);
 out:
 	kfree(entry);
 	return ret;
 }
 
+/*
+ * The hash index of a directory, see sfs.h. A link of a chain is read and
+ * written at a block and an offset: the inode block of the directory for
+ * the free chain and the buckets, a slot block for the link after its entry,
+ * or the inode block too for a slot inline.
+ */
+#define SFS_DIRINDEX_FREE                                                           \
+    (SFS_DIRINDEX_OFFSET + offsetof(struct sfs_disk_dirindex, free))
+
+static off_t sfs_dirindex_bucket(const char *name)
+{
+	/* FNV-1a, mksfs hashes the names the same way */
+	uint32_t hash = 2166136261U;
+	while (*name != '\0') {
+		hash = (hash ^ (uint8_t) * name++) * 16777619U;
+	}
+	return SFS_DIRINDEX_OFFSET + offsetof(struct sfs_disk_dirindex, buckets)
+	    + sizeof(uint32_t) * (hash % SFS_DIRINDEX_NBUCKETS);
+}
+
+// sfs_dirindex_push - put slot at the head of the chain at (blkno, offset)
+static int
+sfs_dirindex_push(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t blkno,
+		  off_t offset, int slot)
+{
+	int ret;
+	uint32_t head, link = slot + 1, slotblk;
+	off_t slotoff;
+	if ((ret = sfs_rbuf(sfs, &head, sizeof(uint32_t), blkno, offset)) != 0) {
+		return ret;
+	}
+	if ((ret =
+	     sfs_dirent_locate_nolock(sfs, sin, slot, &slotblk,
+				      &slotoff)) != 0) {
+		return ret;
+	}
+	if ((ret =
+	     sfs_wbuf(sfs, &head, sizeof(uint32_t), slotblk,
+		      slotoff + SFS_DIRENT_LINK_OFFSET)) != 0) {
+		return ret;
+	}
+	return sfs_wbuf(sfs, &link, sizeof(uint32_t), blkno, offset);
+}
+
+// sfs_dirindex_del - take slot off the chain at (blkno, offset)
+static int
+sfs_dirindex_del(struct sfs_fs *sfs, struct sfs_inode *sin, uint32_t blkno,
+		 off_t offset, int slot)
+{
+	int ret;
+	uint32_t link, slotblk, nlinks = 0;
+	off_t slotoff;
+	while (1) {
+		if ((ret =
+		     sfs_rbuf(sfs, &link, sizeof(uint32_t), blkno,
+			      offset)) != 0) {
+			return ret;
+		}
+		/* off the chain or a loop in it, the index is broken */
+		if (link == 0 || link > sin->din->blocks
+		    || nlinks++ == sin->din->blocks) {
+			warn("sfs: bad index of dir %u.\n", sin->ino);
+			return -E_INVAL;
+		}
+		if ((ret =
+		     sfs_dirent_locate_nolock(sfs, sin, link - 1, &slotblk,
+					      &slotoff)) != 0) {
+			return ret;
+		}
+		if (link == slot + 1) {
+			break;
+		}
+		blkno = slotblk, offset = slotoff + SFS_DIRENT_LINK_OFFSET;
+	}
+	if ((ret =
+	     sfs_rbuf(sfs, &link, sizeof(uint32_t), slotblk,
+		      slotoff + SFS_DIRENT_LINK_OFFSET)) != 0) {
+		return ret;
+	}
+	return sfs_wbuf(sfs, &link, sizeof(uint32_t), blkno, offset);
+}
+
+static int
+sfs_dirindex_search_nolock(struct sfs_fs *sfs, struct sfs_inode *sin,
+			   const char *name, uint32_t * ino_store, int *slot,
+			   int *empty_slot, struct sfs_disk_entry *entry)
+{
+	int ret;
+	uint32_t link, blkno = sin->ino, nlinks = 0;
+	off_t offset = sfs_dirindex_bucket(name);
+	if (empty_slot != NULL) {
+		if ((ret =
+		     sfs_rbuf(sfs, &link, sizeof(uint32_t), sin->ino,
+			      SFS_DIRINDEX_FREE)) != 0) {
+			return ret;
+		}
+		*empty_slot = (link != 0) ? link - 1 : sin->din->blocks;
+	}
+	while (1) {
+		if ((ret =
+		     sfs_rbuf(sfs, &link, sizeof(uint32_t), blkno,
+			      offset)) != 0) {
+			return ret;
+		}
+		if (link == 0) {
+			return -E_NOENT;
+		}
+		if (link > sin->din->blocks || nlinks++ == sin->din->blocks) {
+			warn("sfs: bad index of dir %u.\n", sin->ino);
+			return -E_INVAL;
+		}
+		if ((ret =
+		     sfs_dirent_locate_nolock(sfs, sin, link - 1, &blkno,
+					      &offset)) != 0) {
+			return ret;
+		}
+		if ((ret =
+		     sfs_rbuf(sfs, entry, sizeof(struct sfs_disk_entry), blkno,
+			      offset)) != 0) {
+			return ret;
+		}
+		entry->name[SFS_MAX_FNAME_LEN] = '\0';
+		if (entry->ino != 0 && strcmp(name, entry->name) == 0) {
+			if (slot != NULL) {
+				*slot = link - 1;
+			}
+			if (ino_store != NULL) {
+				*ino_store = entry->ino;
+			}
+			return 0;
+		}
+		offset += SFS_DIRENT_LINK_OFFSET;
+	}
+}
+
 static int
 sfs_dirent_link_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot,
 		       struct sfs_inode *lnksin, const char *name)
 {
 	int ret;
+	/* a slot before the end is the head of the free chain */
+	bool reuse = (slot < sin->din->blocks);
 	if ((ret =
 	     sfs_dirent_write_nolock(sfs, sin, slot, lnksin->ino, name)) != 0) {
 		return ret;
 	}
+	if (sfs_dir_indexed(sfs)) {
+		if ((reuse && (ret =
+			       sfs_dirindex_del(sfs, sin, sin->ino,
+						SFS_DIRINDEX_FREE, slot)) != 0)
+		    || (ret =
+			sfs_dirindex_push(sfs, sin, sin->ino,
+					  sfs_dirindex_bucket(name),
+					  slot)) != 0) {
+			sfs_dirent_write_nolock(sfs, sin, slot, 0, NULL);
+			return ret;
+		}
+	}
+	vfs_dcache_add(info2fs(sfs, sfs), sin->ino, name, lnksin->ino);
 	sin->dirty = 1;
 	sin->din->dirinfo.slots++;
 	lnksin->dirty = 1;
@@ -435,9 +976,19 @@ sfs_dirent_link_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot,
 
 static int
 sfs_dirent_unlink_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot,
-			 struct sfs_inode *lnksin)
+			 struct sfs_inode *lnksin, const char *name)
 {
 	int ret;
+	if (sfs_dir_indexed(sfs)) {
+		if ((ret =
+		     sfs_dirindex_del(sfs, sin, sin->ino,
+				      sfs_dirindex_bucket(name), slot)) != 0
+		    || (ret =
+			sfs_dirindex_push(sfs, sin, sin->ino, SFS_DIRINDEX_FREE,
+					  slot)) != 0) {
+			return ret;
+		}
+	}
 	if ((ret = sfs_dirent_write_nolock(sfs, sin, slot, 0, NULL)) != 0) {
 		return ret;
 	}
@@ -458,10 +1009,10 @@ sfs_dirent_unlink_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot,
         err;                                                                        \
     })
 
-#define sfs_dirent_unlink_nolock_check(sfs, sin, slot, lnksin)                      \
+#define sfs_dirent_unlink_nolock_check(sfs, sin, slot, lnksin, name)                \
     ({                                                                              \
         int err;                                                                    \
-        if ((err = sfs_dirent_unlink_nolock(sfs, sin, slot, lnksin)) != 0) {        \
+        if ((err = sfs_dirent_unlink_nolock(sfs, sin, slot, lnksin, name)) != 0) {  \
             warn("sfs_dirent_unlink error: %e.\n", err);                            \
         }                                                                           \
         err;                                                                        \
@@ -477,8 +1028,13 @@ sfs_dirent_search_nolock(struct sfs_fs *sfs, struct sfs_inode *sin,
 	if ((entry = kmalloc(sizeof(struct sfs_disk_entry))) == NULL) {
 		return -E_NO_MEM;
 	}
-#define set_pvalue(x, v)            do { if ((x) != NULL) { *(x) = (v); } } while (0)
 	int ret, i, nslots = sin->din->blocks;
+	if (sfs_dir_indexed(sfs)) {
+		ret = sfs_dirindex_search_nolock(sfs, sin, name, ino_store, slot,
+						 empty_slot, entry);
+		goto out;
+	}
+#define set_pvalue(x, v)            do { if ((x) != NULL) { *(x) = (v); } } while (0)
 	set_pvalue(empty_slot, nslots);
 	for (i = 0; i < nslots; i++) {
 		if ((ret = sfs_dirent_read_nolock(sfs, sin, i, entry)) != 0) {
@@ -527,6 +1083,10 @@ sfs_dirent_create_inode(struct sfs_fs *sfs, uint16_t type,
 	}
 	memset(din, 0, sizeof(struct sfs_disk_inode));
 	din->type = type;
+	if (sfs_inline_data(sfs)) {
+		/* the inode block is new, zeroed, and so the data in it */
+		din->flags = SFS_INODE_INLINE;
+	}
 
 	int ret;
 	uint32_t ino;
@@ -537,11 +1097,11 @@ sfs_dirent_create_inode(struct sfs_fs *sfs, uint16_t type,
 	if ((ret = sfs_create_inode(sfs, din, ino, &node)) != 0) {
 		goto failed_cleanup_ino;
 	}
-	lock_sfs_fs(sfs);
+	lock_sfs_hash(sfs, ino);
 	{
 		sfs_set_links(sfs, vop_info(node, sfs_inode));
 	}
-	unlock_sfs_fs(sfs);
+	unlock_sfs_hash(sfs, ino);
 	*node_store = node;
 	return 0;
 
@@ -568,7 +1128,17 @@ sfs_lookup_once(struct sfs_fs *sfs, struct sfs_inode *sin, const char *name,
 		return ret;
 	}
 	uint32_t ino;
-	ret = sfs_dirent_search_nolock(sfs, sin, name, &ino, slot, NULL);
+	if (slot == NULL
+	    && vfs_dcache_lookup(info2fs(sfs, sfs), sin->ino, name, &ino)) {
+		ret = (ino != 0) ? 0 : -E_NOENT;
+	} else {
+		ret =
+		    sfs_dirent_search_nolock(sfs, sin, name, &ino, slot, NULL);
+		if (ret == 0 || ret == -E_NOENT) {
+			vfs_dcache_add(info2fs(sfs, sfs), sin->ino, name,
+				       (ret == 0) ? ino : 0);
+		}
+	}
 	unlock_sin(sin);
 	if (ret != 0) {
 		return ret;
@@ -597,9 +1167,147 @@ static int sfs_openfile(struct inode *node, uint32_t open_flags)
 	return 0;
 }
 
+/* *
+ * sfs_fsync_nolock - write sin back if it is dirty, with sin->mutex held or
+ * the updates of the journal held off by its commit
+ * */
+int sfs_fsync_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
+{
+	int ret = 0;
+	if (sin->din->nlinks != 0 && sin->dirty) {
+		sin->dirty = 0;
+		if ((ret =
+		     sfs_wbuf(sfs, sin->din, sizeof(struct sfs_disk_inode),
+			      sin->ino, 0)) == 0 && sin->extents != NULL
+		    && sin->din->extinfo.nextents != 0) {
+			ret =
+			    sfs_wbuf(sfs, sin->extents,
+				     sizeof(struct sfs_disk_extent) *
+				     sin->din->extinfo.nextents, sin->ino,
+				     SFS_EXTENT_OFFSET);
+		}
+		if (ret != 0) {
+			sin->dirty = 1;
+		}
+	}
+	return ret;
+}
+
+static int sfs_fsync_sin(struct sfs_fs *sfs, struct sfs_inode *sin)
+{
+	if (sin->din->nlinks == 0 || !sin->dirty) {
+		return 0;
+	}
+	int ret;
+	if ((ret = trylock_sin(sin)) != 0) {
+		return ret;
+	}
+	ret = sfs_fsync_nolock(sfs, sin);
+	unlock_sin(sin);
+	return ret;
+}
+
 static int sfs_close(struct inode *node)
 {
-	return vop_fsync(node);
+	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
+	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	struct sfs_handle handle;
+	int ret;
+	if (sin->prealloc_len != 0) {
+		kmutex_lock(&(sin->mutex));
+		sfs_prealloc_release_nolock(sfs, sin);
+		kmutex_unlock(&(sin->mutex));
+	}
+	/* only fsync commits the transaction it went to */
+	sfs_journal_start(sfs, &handle);
+	ret = sfs_fsync_sin(sfs, sin);
+	sfs_journal_stop(sfs, &handle);
+	return ret;
+}
+
+#ifdef UCONFIG_SFS_PAGE_CACHE
+/*
+ * Adaptive readahead. A read that goes on where the last one stopped, or
+ * in the block it stopped in, is sequential: once less than half of the
+ * window lies ahead of it, the window doubles up to SFS_RA_MAX_PAGES and
+ * the blocks up to its end are read in batches. Any other read closes the
+ * window, so random reads only read what they ask for.
+ */
+static void
+sfs_readahead_nolock(struct sfs_fs *sfs, struct sfs_inode *sin,
+		     uint32_t first, uint32_t last)
+{
+	uint32_t blknos[SFS_RA_MAX_PAGES], index, end, ino;
+	int n = 0;
+	if (first != sin->ra_next && first + 1 != sin->ra_next) {
+		sin->ra_next = last + 1, sin->ra_end = sin->ra_pages = 0;
+		return;
+	}
+	sin->ra_next = last + 1;
+	if (sin->ra_end > last + 1 + sin->ra_pages / 2) {
+		return;
+	}
+	if (sin->ra_pages == 0) {
+		sin->ra_pages = SFS_RA_MIN_PAGES;
+	} else if ((sin->ra_pages *= 2) > SFS_RA_MAX_PAGES) {
+		sin->ra_pages = SFS_RA_MAX_PAGES;
+	}
+	index = (first > sin->ra_end) ? first : sin->ra_end;
+	if ((end = last + 1 + sin->ra_pages) > sin->din->blocks) {
+		end = sin->din->blocks;
+	}
+	for (; index < end && n < SFS_RA_MAX_PAGES; index++) {
+		if (sfs_bmap_get_nolock(sfs, sin, index, 0, &ino) != 0
+		    || ino == 0) {
+			break;
+		}
+		blknos[n++] = ino;
+	}
+	sin->ra_end = index;
+	if (n != 0) {
+		sfs_cache_readahead(sfs, blknos, n);
+	}
+}
+#endif
+
+/*
+ * sfs_inline_expand_nolock - move the data of an inline file out to its
+ * first block, see sfs.h
+ */
+static int sfs_inline_expand_nolock(struct sfs_fs *sfs, struct sfs_inode *sin)
+{
+	struct sfs_disk_inode *din = sin->din;
+	size_t size = din->fileinfo.size;
+	uint32_t ino;
+	void *buffer = NULL;
+	int ret;
+	assert(sfs_inlined(sin) && din->blocks == 0
+	       && size <= SFS_INLINE_FILE_MAX);
+	if (size != 0) {
+		if ((buffer = kmalloc(size)) == NULL) {
+			return -E_NO_MEM;
+		}
+		if ((ret =
+		     sfs_rbuf(sfs, buffer, size, sin->ino,
+			      SFS_INLINE_FILE_OFFSET)) != 0) {
+			goto out;
+		}
+	}
+	if ((ret = sfs_bmap_load_nolock(sfs, sin, 0, &ino)) != 0) {
+		goto out;
+	}
+	if (size != 0
+	    && (ret = sfs_wbuf_data(sfs, buffer, size, ino, 0)) != 0) {
+		sfs_bmap_truncate_nolock(sfs, sin);
+		goto out;
+	}
+	din->flags &= ~SFS_INODE_INLINE;
+	sin->dirty = 1;
+out:
+	if (buffer != NULL) {
+		kfree(buffer);
+	}
+	return ret;
 }
 
 static int
@@ -608,16 +1316,16 @@ sfs_io_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, void *buf,
 {
 	struct sfs_disk_inode *din = sin->din;
 	assert(din->type != SFS_TYPE_DIR);
-	off_t endpos = offset + *alenp, blkoff;
+	off_t endpos = offset + *alenp, blkoff, maxsize = sfs_max_file_size(sin);
 	*alenp = 0;
-	if (offset < 0 || offset >= SFS_MAX_FILE_SIZE || offset > endpos) {
+	if (offset < 0 || offset >= maxsize || offset > endpos) {
 		return -E_INVAL;
 	}
 	if (offset == endpos) {
 		return 0;
 	}
-	if (endpos > SFS_MAX_FILE_SIZE) {
-		endpos = SFS_MAX_FILE_SIZE;
+	if (endpos > maxsize) {
+		endpos = maxsize;
 	}
 	if (!write) {
 		if (offset >= din->fileinfo.size) {
@@ -628,22 +1336,45 @@ sfs_io_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, void *buf,
 		}
 	}
 
+	int ret = 0;
+	size_t size, alen = 0;
+	if (sfs_inlined(sin)) {
+		if (endpos <= SFS_INLINE_FILE_MAX) {
+			/* in the inode block, read and written as metadata */
+			off_t pos = SFS_INLINE_FILE_OFFSET + offset;
+			size = endpos - offset;
+			ret = (write) ? sfs_wbuf(sfs, buf, size, sin->ino, pos)
+			    : sfs_rbuf(sfs, buf, size, sin->ino, pos);
+			if (ret == 0) {
+				alen = size;
+			}
+			goto out;
+		}
+		if ((ret = sfs_inline_expand_nolock(sfs, sin)) != 0) {
+			return ret;
+		}
+	}
+
 	int (*sfs_buf_op) (struct sfs_fs * sfs, void *buf, size_t len,
 			   uint32_t blkno, off_t offset);
 	int (*sfs_block_op) (struct sfs_fs * sfs, void *buf, uint32_t blkno,
 			     uint32_t nblks);
 	if (write) {
-		sfs_buf_op = sfs_wbuf, sfs_block_op = sfs_wblock;
+		sfs_buf_op = sfs_wbuf_data, sfs_block_op = sfs_wblock_data;
 	} else {
-		sfs_buf_op = sfs_rbuf, sfs_block_op = sfs_rblock;
+		sfs_buf_op = sfs_rbuf_data, sfs_block_op = sfs_rblock;
 	}
 
-	int ret = 0;
-	size_t size, alen = 0;
 	uint32_t ino;
 	uint32_t blkno = offset / SFS_BLKSIZE;
 	uint32_t nblks = endpos / SFS_BLKSIZE - blkno;
 
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	if (!write && sfs->mem == NULL) {
+		sfs_readahead_nolock(sfs, sin, blkno, (endpos - 1) / SFS_BLKSIZE);
+	}
+#endif
+
 	if ((blkoff = offset % SFS_BLKSIZE) != 0) {
 		size =
 		    (nblks != 0) ? (SFS_BLKSIZE - blkoff) : (endpos - offset);
@@ -660,15 +1391,19 @@ sfs_io_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, void *buf,
 		buf += size, blkno++, nblks--;
 	}
 
-	size = SFS_BLKSIZE;
+	/* the blocks that lie one after the other on disk go together */
 	while (nblks != 0) {
-		if ((ret = sfs_bmap_load_nolock(sfs, sin, blkno, &ino)) != 0) {
+		uint32_t run;
+		if ((ret =
+		     sfs_bmap_run_nolock(sfs, sin, blkno, nblks, &ino,
+					 &run)) != 0) {
 			goto out;
 		}
-		if ((ret = sfs_block_op(sfs, buf, ino, 1)) != 0) {
+		if ((ret = sfs_block_op(sfs, buf, ino, run)) != 0) {
 			goto out;
 		}
-		alen += size, buf += size, blkno++, nblks--;
+		size = run * SFS_BLKSIZE;
+		alen += size, buf += size, blkno += run, nblks -= run;
 	}
 
 	if ((size = endpos % SFS_BLKSIZE) != 0) {
@@ -698,11 +1433,18 @@ static inline int sfs_io(struct inode *node, struct iobuf *iob, bool write)
 	if ((ret = trylock_sin(sin)) != 0) {
 		return ret;
 	}
-	size_t alen = iob->io_resid;
-	ret =
-	    sfs_io_nolock(sfs, sin, iob->io_base, iob->io_offset, &alen, write);
-	if (alen != 0) {
-		iobuf_skip(iob, alen);
+	/* a segment at a time, a vectored iob holds no flat buffer */
+	while (iob->io_resid != 0) {
+		size_t seg = iobuf_seg(iob), alen = seg;
+		ret =
+		    sfs_io_nolock(sfs, sin, iob->io_base, iob->io_offset, &alen,
+				  write);
+		if (alen != 0) {
+			iobuf_skip(iob, alen);
+		}
+		if (ret != 0 || alen < seg) {
+			break;
+		}
 	}
 	unlock_sin(sin);
 	return ret;
@@ -715,7 +1457,109 @@ static int sfs_read(struct inode *node, struct iobuf *iob)
 
 static int sfs_write(struct inode *node, struct iobuf *iob)
 {
-	return sfs_io(node, iob, 1);
+	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
+	struct sfs_handle handle;
+	int ret;
+	sfs_journal_start(sfs, &handle);
+	ret = sfs_io(node, iob, 1);
+	sfs_journal_stop(sfs, &handle);
+	return ret;
+}
+
+#define SFS_COPY_BLOCKS                 8
+
+/*
+ * sfs_copyrange - copy len bytes of from at from_off to node at off, a
+ * chunk of SFS_COPY_BLOCKS at a time through one buffer, with both inodes
+ * locked in the order of their addresses and an update of the journal of
+ * its own for each. Where the offsets are aligned the blocks go whole
+ * between the disk and the buffer, see sfs_io_nolock, and no page of the
+ * caller is touched. A copy within one file must not overlap.
+ */
+static int
+sfs_copyrange(struct inode *node, off_t off, struct inode *from,
+	      off_t from_off, size_t len, size_t * copied_store)
+{
+	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
+	struct sfs_inode *sin = vop_info(node, sfs_inode), *fromsin =
+	    vop_info(from, sfs_inode);
+	struct sfs_inode *first = (sin < fromsin) ? sin : fromsin, *second =
+	    (sin < fromsin) ? fromsin : sin;
+	struct sfs_handle handle;
+	void *buffer;
+	int ret = 0;
+	*copied_store = 0;
+	if (fromsin->din->type != SFS_TYPE_FILE) {
+		return -E_ISDIR;
+	}
+	if (off < 0 || from_off < 0 || (sin == fromsin && off < from_off + len
+					 && from_off < off + len)) {
+		return -E_INVAL;
+	}
+	if ((buffer = kmalloc(SFS_COPY_BLOCKS * SFS_BLKSIZE)) == NULL) {
+		return -E_NO_MEM;
+	}
+	while (len != 0) {
+		size_t alen = (len < SFS_COPY_BLOCKS * SFS_BLKSIZE) ? len :
+		    SFS_COPY_BLOCKS * SFS_BLKSIZE, wlen = 0;
+		sfs_journal_start(sfs, &handle);
+		if ((ret = trylock_sin(first)) == 0) {
+			if (first == second
+			    || (ret = trylock_sin(second)) == 0) {
+				ret =
+				    sfs_io_nolock(sfs, fromsin, buffer,
+						  from_off, &alen, 0);
+				if (ret == 0 && (wlen = alen) != 0) {
+					ret =
+					    sfs_io_nolock(sfs, sin, buffer, off,
+							  &wlen, 1);
+				}
+				if (first != second) {
+					unlock_sin(second);
+				}
+			}
+			unlock_sin(first);
+		}
+		sfs_journal_stop(sfs, &handle);
+		*copied_store += wlen;
+		off += wlen, from_off += wlen, len -= wlen;
+		if (ret != 0 || wlen == 0 || wlen < alen) {
+			break;
+		}
+	}
+	kfree(buffer);
+	return ret;
+}
+
+/*
+ * sfs_direct - the address in sfs->mem of the block of the file at off, to
+ * be mapped in place. -E_NOENT unless sfs is in memory and the block is
+ * wholly of the file: not inlined, not a hole, nor the tail of the file,
+ * whose block goes on with what the file does not hold.
+ */
+static int sfs_direct(struct inode *node, off_t off, void **kva_store)
+{
+	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
+	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	struct sfs_disk_inode *din = sin->din;
+	uint32_t index = off / SFS_BLKSIZE, ino;
+	int ret;
+	static_assert(SFS_BLKSIZE == PGSIZE);
+	if (sfs->mem == NULL || off < 0 || off % SFS_BLKSIZE != 0) {
+		return -E_NOENT;
+	}
+	if ((ret = trylock_sin(sin)) != 0) {
+		return ret;
+	}
+	ret = -E_NOENT;
+	if (!sfs_inlined(sin) && off + SFS_BLKSIZE <= din->fileinfo.size
+	    && index < din->blocks
+	    && sfs_bmap_get_nolock(sfs, sin, index, 0, &ino) == 0 && ino != 0) {
+		*kva_store = sfs->mem + (size_t)ino * SFS_BLKSIZE;
+		ret = 0;
+	}
+	unlock_sin(sin);
+	return ret;
 }
 
 static int sfs_fstat(struct inode *node, struct stat *stat)
@@ -727,7 +1571,8 @@ static int sfs_fstat(struct inode *node, struct stat *stat)
 	}
 	struct sfs_disk_inode *din = vop_info(node, sfs_inode)->din;
 	stat->st_nlinks = din->nlinks;
-	stat->st_blocks = din->blocks;
+	/* the slots of an inline directory take no block of their own */
+	stat->st_blocks = (din->flags & SFS_INODE_INLINE) ? 0 : din->blocks;
 	if (din->type != SFS_TYPE_DIR) {
 		stat->st_size = din->fileinfo.size;
 	} else {
@@ -757,23 +1602,20 @@ sfs_dirinfo_set_parent(struct sfs_inode *sin, struct sfs_inode *parent)
 static int sfs_fsync(struct inode *node)
 {
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
-	struct sfs_inode *sin = vop_info(node, sfs_inode);
-	if (sin->din->nlinks == 0 || !sin->dirty) {
-		return 0;
-	}
+	struct sfs_handle handle;
 	int ret;
-	if ((ret = trylock_sin(sin)) != 0) {
+	sfs_journal_start(sfs, &handle);
+	ret = sfs_fsync_sin(sfs, vop_info(node, sfs_inode));
+	sfs_journal_stop(sfs, &handle);
+	if (ret != 0) {
 		return ret;
 	}
-	if (sin->dirty) {
-		sin->dirty = 0;
-		if ((ret =
-		     sfs_wbuf(sfs, sin->din, sizeof(struct sfs_disk_inode),
-			      sin->ino, 0)) != 0) {
-			sin->dirty = 1;
-		}
+#ifdef UCONFIG_SFS_JOURNAL
+	/* on the disk once the transaction holding it commits */
+	if (sfs_journaled(sfs)) {
+		ret = sfs_journal_commit(sfs);
 	}
-	unlock_sin(sin);
+#endif
 	return ret;
 }
 
@@ -822,11 +1664,14 @@ static int sfs_mkdir(struct inode *node, const char *name)
 	}
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	struct sfs_handle handle;
 	int ret;
+	sfs_journal_start(sfs, &handle);
 	if ((ret = trylock_sin(sin)) == 0) {
 		ret = sfs_mkdir_nolock(sfs, sin, name);
 		unlock_sin(sin);
 	}
+	sfs_journal_stop(sfs, &handle);
 	return ret;
 }
 
@@ -858,11 +1703,14 @@ sfs_link(struct inode *node, const char *name, struct inode *link_node)
 	}
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	struct sfs_handle handle;
 	int ret;
+	sfs_journal_start(sfs, &handle);
 	if ((ret = trylock_sin(sin)) == 0) {
 		ret = sfs_link_nolock(sfs, sin, lnksin, name);
 		unlock_sin(sin);
 	}
+	sfs_journal_stop(sfs, &handle);
 	return ret;
 }
 
@@ -885,7 +1733,22 @@ sfs_rename1_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, const char *name,
 				      NULL)) != -E_NOENT) {
 		return (ret != 0) ? ret : -E_EXISTS;
 	}
-	return sfs_dirent_write_nolock(sfs, sin, slot, ino, new_name);
+	vfs_dcache_remove(info2fs(sfs, sfs), sin->ino, name);
+	if (sfs_dir_indexed(sfs)) {
+		if ((ret =
+		     sfs_dirindex_del(sfs, sin, sin->ino,
+				      sfs_dirindex_bucket(name), slot)) != 0
+		    || (ret =
+			sfs_dirindex_push(sfs, sin, sin->ino,
+					  sfs_dirindex_bucket(new_name),
+					  slot)) != 0) {
+			return ret;
+		}
+	}
+	if ((ret = sfs_dirent_write_nolock(sfs, sin, slot, ino, new_name)) == 0) {
+		vfs_dcache_add(info2fs(sfs, sfs), sin->ino, new_name, ino);
+	}
+	return ret;
 }
 
 static int
@@ -911,9 +1774,11 @@ sfs_rename2_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, const char *name,
 	}
 
 	struct sfs_inode *lnksin = vop_info(link_node, sfs_inode);
-	if ((ret = sfs_dirent_unlink_nolock(sfs, sin, slot1, lnksin)) != 0) {
+	if ((ret =
+	     sfs_dirent_unlink_nolock(sfs, sin, slot1, lnksin, name)) != 0) {
 		goto out;
 	}
+	vfs_dcache_remove(info2fs(sfs, sfs), sin->ino, name);
 
 	int isdir = (lnksin->din->type == SFS_TYPE_DIR);
 
@@ -965,7 +1830,9 @@ sfs_rename(struct inode *node, const char *name, struct inode *new_node,
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode), *newsin =
 	    vop_info(new_node, sfs_inode);
+	struct sfs_handle handle;
 	int ret;
+	sfs_journal_start(sfs, &handle);
 	lock_sfs_mutex(sfs);
 	{
 		if ((ret = trylock_sin(sin)) == 0) {
@@ -983,6 +1850,7 @@ sfs_rename(struct inode *node, const char *name, struct inode *new_node,
 		}
 	}
 	unlock_sfs_mutex(sfs);
+	sfs_journal_stop(sfs, &handle);
 	return ret;
 }
 
@@ -1046,25 +1914,33 @@ failed:
 	return ret;
 }
 
+// sfs_getdirentry_sub_nolock - the first entry in use at slot *slot_store
+//                            - or after it, *slot_store is set to its slot
 static int
-sfs_getdirentry_sub_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, int slot,
-			   struct sfs_disk_entry *entry)
+sfs_getdirentry_sub_nolock(struct sfs_fs *sfs, struct sfs_inode *sin,
+			   int *slot_store, struct sfs_disk_entry *entry)
 {
 	int ret, i, nslots = sin->din->blocks;
-	for (i = 0; i < nslots; i++) {
+	for (i = *slot_store; i < nslots; i++) {
 		if ((ret = sfs_dirent_read_nolock(sfs, sin, i, entry)) != 0) {
 			return ret;
 		}
 		if (entry->ino != 0) {
-			if (slot == 0) {
-				return 0;
-			}
-			slot--;
+			*slot_store = i;
+			return 0;
 		}
 	}
 	return -E_NOENT;
 }
 
+/*
+ * The offset is a cursor over the slots of the directory, not a count of
+ * the entries: sfs_dentry_size times 0 for ".", 1 for "..", and 2 + the
+ * slot to look from for the others. It is left after the slot of the entry
+ * read, so that the next read goes on from there instead of skipping the
+ * entries before it again, and stays valid when entries are added or
+ * removed meanwhile.
+ */
 static int sfs_getdirentry(struct inode *node, struct iobuf *iob)
 {
 	struct sfs_disk_entry *entry;
@@ -1082,7 +1958,7 @@ static int sfs_getdirentry(struct inode *node, struct iobuf *iob)
 	}
 
 	int ret, slot = offset / sfs_dentry_size;
-	if (slot >= sin->din->dirinfo.slots + 2) {
+	if (slot >= sin->din->blocks + 2) {
 		kfree(entry);
 		return -E_NOENT;
 	}
@@ -1097,13 +1973,17 @@ static int sfs_getdirentry(struct inode *node, struct iobuf *iob)
 		if ((ret = trylock_sin(sin)) != 0) {
 			goto out;
 		}
-		ret = sfs_getdirentry_sub_nolock(sfs, sin, slot - 2, entry);
+		slot -= 2;
+		ret = sfs_getdirentry_sub_nolock(sfs, sin, &slot, entry);
 		unlock_sin(sin);
 		if (ret != 0) {
 			goto out;
 		}
+		slot += 2;
+	}
+	if ((ret = iobuf_move(iob, entry->name, sfs_dentry_size, 1, NULL)) == 0) {
+		iob->io_offset = (off_t) (slot + 1) * sfs_dentry_size;
 	}
-	ret = iobuf_move(iob, entry->name, sfs_dentry_size, 1, NULL);
 out:
 	kfree(entry);
 	return ret;
@@ -1113,8 +1993,10 @@ static int sfs_reclaim(struct inode *node)
 {
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	struct sfs_handle handle;
 
-	lock_sfs_fs(sfs);
+	sfs_journal_start(sfs, &handle);
+	lock_sfs_hash(sfs, sin->ino);
 
 	int ret = -E_BUSY;
 	assert(sin->reclaim_count > 0);
@@ -1123,21 +2005,24 @@ static int sfs_reclaim(struct inode *node)
 	}
 	assert(inode_ref_count(node) == 0 && inode_open_count(node) == 0);
 
-	if (sin->din->nlinks == 0) {
+	sfs_prealloc_release_nolock(sfs, sin);
+	if (sin->din->nlinks == 0 && !sfs_inlined(sin)) {
 		uint32_t nblks;
 		for (nblks = sin->din->blocks; nblks != 0; nblks--) {
 			sfs_bmap_truncate_nolock(sfs, sin);
 		}
 	} else if (sin->dirty) {
-		if ((ret = vop_fsync(node)) != 0) {
+		if ((ret = sfs_fsync_sin(sfs, sin)) != 0) {
 			goto failed_unlock;
 		}
 	}
 
-	sfs_remove_links(sin);
-	unlock_sfs_fs(sfs);
+	sfs_remove_links(sfs, sin);
+	unlock_sfs_hash(sfs, sin->ino);
 
-	if (sin->din->nlinks == 0) {
+	if (sin->din->nlinks == 0 && sin->extents != NULL) {
+		sfs_block_free(sfs, sin->ino);
+	} else if (sin->din->nlinks == 0) {
 		sfs_block_free(sfs, sin->ino);
 		uint32_t ent;
 		if ((ent = sin->din->indirect) != 0) {
@@ -1151,12 +2036,17 @@ static int sfs_reclaim(struct inode *node)
 			sfs_block_free(sfs, ent);
 		}
 	}
+	if (sin->extents != NULL) {
+		kfree(sin->extents);
+	}
 	kfree(sin->din);
 	vop_kill(node);
+	sfs_journal_stop(sfs, &handle);
 	return 0;
 
 failed_unlock:
-	unlock_sfs_fs(sfs);
+	unlock_sfs_hash(sfs, sin->ino);
+	sfs_journal_stop(sfs, &handle);
 	return ret;
 }
 
@@ -1179,35 +2069,81 @@ static int sfs_gettype(struct inode *node, uint32_t * type_store)
 
 static int sfs_tryseek(struct inode *node, off_t pos)
 {
-	if (pos < 0 || pos >= SFS_MAX_FILE_SIZE) {
+	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	if (pos < 0 || pos >= sfs_max_file_size(sin)) {
 		return -E_INVAL;
 	}
-	struct sfs_disk_inode *din = vop_info(node, sfs_inode)->din;
+	struct sfs_disk_inode *din = sin->din;
 	if (pos > din->fileinfo.size) {
 		return vop_truncate(node, pos);
 	}
 	return 0;
 }
 
-static int sfs_truncfile(struct inode *node, off_t len)
+// sfs_dir_tryseek - a directory seeks to the cursors of sfs_getdirentry
+static int sfs_dir_tryseek(struct inode *node, off_t pos)
 {
-	if (len < 0 || len > SFS_MAX_FILE_SIZE) {
+	if (pos < 0 || pos % sfs_dentry_size != 0) {
 		return -E_INVAL;
 	}
+	return 0;
+}
+
+// sfs_inline_zero_nolock - clear the inline data of sin past len
+static int
+sfs_inline_zero_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, off_t len)
+{
+	size_t size = sin->din->fileinfo.size - len;
+	void *zeros;
+	int ret;
+	if ((zeros = kmalloc(size)) == NULL) {
+		return -E_NO_MEM;
+	}
+	memset(zeros, 0, size);
+	ret =
+	    sfs_wbuf(sfs, zeros, size, sin->ino, SFS_INLINE_FILE_OFFSET + len);
+	kfree(zeros);
+	return ret;
+}
+
+static int sfs_truncfile(struct inode *node, off_t len)
+{
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	if (len < 0 || len > sfs_max_file_size(sin)) {
+		return -E_INVAL;
+	}
 	struct sfs_disk_inode *din = sin->din;
 	assert(din->type != SFS_TYPE_DIR);
 
 	int ret = 0;
 	uint32_t nblks, tblks = ROUNDUP_DIV(len, SFS_BLKSIZE);
+	/* the blocks past the end from sfs_fallocate go with a shrink only */
 	if (din->fileinfo.size == len) {
-		assert(tblks == din->blocks);
+		assert(sfs_inlined(sin) || tblks <= din->blocks);
 		return 0;
 	}
 
+	struct sfs_handle handle;
+	sfs_journal_start(sfs, &handle);
 	if ((ret = trylock_sin(sin)) != 0) {
-		return ret;
+		goto out;
+	}
+	if (sfs_inlined(sin)) {
+		if (len <= SFS_INLINE_FILE_MAX) {
+			/* a growth reads back zeros past what a shrink left */
+			if (len < din->fileinfo.size
+			    && (ret =
+				sfs_inline_zero_nolock(sfs, sin, len)) != 0) {
+				goto out_unlock;
+			}
+			din->fileinfo.size = len;
+			sin->dirty = 1;
+			goto out_unlock;
+		}
+		if ((ret = sfs_inline_expand_nolock(sfs, sin)) != 0) {
+			goto out_unlock;
+		}
 	}
 	nblks = din->blocks;
 	if (nblks < tblks) {
@@ -1219,7 +2155,7 @@ static int sfs_truncfile(struct inode *node, off_t len)
 			}
 			nblks++;
 		}
-	} else if (tblks < nblks) {
+	} else if (tblks < nblks && len < din->fileinfo.size) {
 		while (tblks != nblks) {
 			if ((ret = sfs_bmap_truncate_nolock(sfs, sin)) != 0) {
 				goto out_unlock;
@@ -1227,12 +2163,74 @@ static int sfs_truncfile(struct inode *node, off_t len)
 			nblks--;
 		}
 	}
-	assert(din->blocks == tblks);
+	assert(din->blocks >= tblks);
 	din->fileinfo.size = len;
 	sin->dirty = 1;
 
 out_unlock:
 	unlock_sin(sin);
+out:
+	sfs_journal_stop(sfs, &handle);
+	return ret;
+}
+
+/* *
+ * sfs_fallocate - give the file the blocks up to off + len, which read as
+ * zeros, and its size goes there too unless FALLOC_FL_KEEP_SIZE. A file
+ * only has blocks from the first on, so all those missing before off + len
+ * are allocated, taken as few runs as the freemap allows.
+ * */
+static int sfs_fallocate(struct inode *node, int mode, off_t off, off_t len)
+{
+	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
+	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	struct sfs_disk_inode *din = sin->din;
+	off_t end = off + len;
+	if ((mode & ~FALLOC_FL_KEEP_SIZE) != 0 || off < 0 || len <= 0
+	    || end < off || end > sfs_max_file_size(sin)) {
+		return -E_INVAL;
+	}
+
+	int ret;
+	uint32_t nblks, tblks = ROUNDUP_DIV(end, SFS_BLKSIZE);
+	struct sfs_handle handle;
+	sfs_journal_start(sfs, &handle);
+	if ((ret = trylock_sin(sin)) != 0) {
+		goto out;
+	}
+	if (sfs_inlined(sin)) {
+		if (end <= SFS_INLINE_FILE_MAX) {
+			goto out_size;
+		}
+		if ((ret = sfs_inline_expand_nolock(sfs, sin)) != 0) {
+			goto out_unlock;
+		}
+	}
+	while (din->blocks < tblks) {
+		/* the blocks mapped next are taken from the preallocation */
+		if (sin->prealloc_len == 0) {
+			nblks = tblks - din->blocks;
+			if ((ret =
+			     sfs_block_alloc_run(sfs, sin->alloc_goal, nblks,
+						 &(sin->prealloc_start),
+						 &(sin->prealloc_len))) != 0) {
+				goto out_unlock;
+			}
+		}
+		if ((ret =
+		     sfs_bmap_load_nolock(sfs, sin, din->blocks, NULL)) != 0) {
+			goto out_unlock;
+		}
+	}
+out_size:
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && end > din->fileinfo.size) {
+		din->fileinfo.size = end;
+		sin->dirty = 1;
+	}
+out_unlock:
+	unlock_sin(sin);
+out:
+	sfs_journal_stop(sfs, &handle);
 	return ret;
 }
 
@@ -1292,11 +2290,14 @@ sfs_create(struct inode *node, const char *name, bool excl,
 	}
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	struct sfs_handle handle;
 	int ret;
+	sfs_journal_start(sfs, &handle);
 	if ((ret = trylock_sin(sin)) == 0) {
 		ret = sfs_create_nolock(sfs, sin, name, excl, node_store);
 		unlock_sin(sin);
 	}
+	sfs_journal_stop(sfs, &handle);
 	return ret;
 }
 
@@ -1316,7 +2317,7 @@ sfs_unlink_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, const char *name)
 	}
 	struct sfs_inode *lnksin = vop_info(link_node, sfs_inode);
 	if (lnksin->din->type != SFS_TYPE_DIR) {
-		ret = sfs_dirent_unlink_nolock(sfs, sin, slot, lnksin);
+		ret = sfs_dirent_unlink_nolock(sfs, sin, slot, lnksin, name);
 	} else {
 		if ((ret = trylock_sin(lnksin)) == 0) {
 			if (lnksin->din->dirinfo.slots != 0) {
@@ -1324,7 +2325,7 @@ sfs_unlink_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, const char *name)
 			} else
 			    if ((ret =
 				 sfs_dirent_unlink_nolock(sfs, sin, slot,
-							  lnksin)) == 0) {
+							  lnksin, name)) == 0) {
 				/* lnksin must be empty, so set SFS_removed bit to invalidate further trylock opts */
 				SetSFSInodeRemoved(lnksin);
 
@@ -1333,10 +2334,17 @@ sfs_unlink_nolock(struct sfs_fs *sfs, struct sfs_inode *sin, const char *name)
 
 				/* remove '..' link */
 				sfs_nlinks_dec_nolock(sin);
+
+				/* its block may come back as a new directory */
+				vfs_dcache_purge(info2fs(sfs, sfs),
+						 lnksin->ino);
 			}
 			unlock_sin(lnksin);
 		}
 	}
+	if (ret == 0) {
+		vfs_dcache_add(info2fs(sfs, sfs), sin->ino, name, 0);
+	}
 	vop_ref_dec(link_node);
 	return ret;
 }
@@ -1351,7 +2359,9 @@ static int sfs_unlink(struct inode *node, const char *name)
 	}
 	struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
 	struct sfs_inode *sin = vop_info(node, sfs_inode);
+	struct sfs_handle handle;
 	int ret;
+	sfs_journal_start(sfs, &handle);
 	lock_sfs_mutex(sfs);
 	{
 		if ((ret = trylock_sin(sin)) == 0) {
@@ -1360,6 +2370,7 @@ static int sfs_unlink(struct inode *node, const char *name)
 		}
 	}
 	unlock_sfs_mutex(sfs);
+	sfs_journal_stop(sfs, &handle);
 	return ret;
 }
 
@@ -1483,7 +2494,7 @@ static const struct inode_ops sfs_node_dirops = {
 	.vop_reclaim = sfs_reclaim,
 	.vop_ioctl = NULL_VOP_INVAL,
 	.vop_gettype = sfs_gettype,
-	.vop_tryseek = NULL_VOP_ISDIR,
+	.vop_tryseek = sfs_dir_tryseek,
 	.vop_truncate = NULL_VOP_ISDIR,
 	.vop_create = sfs_create,
 	.vop_unlink = sfs_unlink,
@@ -1511,6 +2522,9 @@ static const struct inode_ops sfs_node_fileops = {
 	.vop_gettype = sfs_gettype,
 	.vop_tryseek = sfs_tryseek,
 	.vop_truncate = sfs_truncfile,
+	.vop_copyrange = sfs_copyrange,
+	.vop_fallocate = sfs_fallocate,
+	.vop_direct = sfs_direct,
 	.vop_create = NULL_VOP_NOTDIR,
 	.vop_unlink = NULL_VOP_NOTDIR,
 	.vop_lookup = NULL_VOP_NOTDIR,
@@ -1,11 +1,116 @@
 #include <types.h>
 #include <string.h>
+#include <pmm.h>
 #include <dev.h>
 #include <sfs.h>
 #include <iobuf.h>
+#include <slab.h>
 #include <bitmap.h>
+#include <error.h>
 #include <assert.h>
 
+/*
+ * A sfs on a device that is memory, the ramdisk, is read and written in
+ * place with one copy between buf and the image: sfs->mem is all of the
+ * blocks, the cache and sfs_buffer are never used. Copy len bytes at
+ * offset of block blkno, or of the blocks from there on; buf NULL writes
+ * zeros. False if sfs is on no such device.
+ */
+static bool
+sfs_rwmem(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
+	  off_t offset, bool write)
+{
+	void *data;
+	if (sfs->mem == NULL) {
+		return 0;
+	}
+	assert(blkno + (offset + len + SFS_BLKSIZE - 1) / SFS_BLKSIZE <=
+	       sfs->super.blocks);
+	data = sfs->mem + (size_t)blkno * SFS_BLKSIZE + offset;
+	if (!write) {
+		memcpy(buf, data, len);
+	} else if (buf != NULL) {
+		memcpy(data, buf, len);
+	} else {
+		memset(data, 0, len);
+	}
+	return 1;
+}
+
+#ifdef UCONFIG_SFS_PAGE_CACHE
+/*
+ * Copy len bytes at offset of block blkno from or to buf through the
+ * page cache, buf NULL writes zeros. The io_mutex only covers the lookup, a
+ * missing block is read with it dropped and the copy is done on the pinned
+ * buffer, so the cached path never touches sfs_buffer. -E_NO_MEM means
+ * there was no page for the block and the caller goes to the disk through
+ * sfs_buffer, which is also all there is without the cache. A sfs in
+ * memory bypasses the cache, see sfs_rwmem.
+ */
+static int
+sfs_rwcache(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
+	    off_t offset, bool write)
+{
+	struct Page *page;
+	int ret;
+	if (sfs_rwmem(sfs, buf, len, blkno, offset, write)) {
+		return 0;
+	}
+	lock_sfs_io(sfs);
+	ret = sfs_bread_nolock(sfs, blkno, !(write && len == SFS_BLKSIZE),
+			       write, &page);
+	unlock_sfs_io(sfs);
+	if (ret == 0) {
+		void *data = page2kva(page) + offset;
+		if (!write) {
+			memcpy(buf, data, len);
+		} else if (buf != NULL) {
+			memcpy(data, buf, len);
+		} else {
+			memset(data, 0, len);
+		}
+		sfs_brelse(page);
+	}
+	return ret;
+}
+#else
+#define sfs_rwcache(sfs, buf, len, blkno, offset, write)                \
+    (sfs_rwmem(sfs, buf, len, blkno, offset, write) ? 0 : -E_NO_MEM)
+#endif
+
+/*
+ * The disk queues the requests given to it, so the io_mutex is only needed
+ * for sfs_buffer, and for the cache. Without the cache a request that finds
+ * sfs_buffer in use takes a block buffer of its own rather than waiting for
+ * an unrelated inode: a block is only ever written in part by the holder of
+ * the lock of the inode it belongs to. With the cache sfs_buffer is only
+ * used when there is no page left, and then io_mutex also keeps the block
+ * out of the cache until it is on the disk.
+ */
+static void *sfs_buffer_get(struct sfs_fs *sfs)
+{
+#ifndef UCONFIG_SFS_PAGE_CACHE
+	void *buffer;
+	if (kmutex_trylock(&(sfs->io_mutex))) {
+		return sfs->sfs_buffer;
+	}
+	if ((buffer = kmalloc(SFS_BLKSIZE)) != NULL) {
+		return buffer;
+	}
+#endif
+	lock_sfs_io(sfs);
+	return sfs->sfs_buffer;
+}
+
+static void sfs_buffer_put(struct sfs_fs *sfs, void *buffer)
+{
+	if (buffer == sfs->sfs_buffer) {
+		unlock_sfs_io(sfs);
+	} else {
+		kfree(buffer);
+	}
+}
+
 static int
 sfs_rwblock_nolock(struct sfs_fs *sfs, void *buf, uint32_t blkno, bool write,
 		   bool check)
@@ -21,19 +126,34 @@ sfs_rwblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks,
 	    bool write)
 {
 	int ret = 0;
-	lock_sfs_io(sfs);
-	{
-		while (nblks != 0) {
-			if ((ret =
-			     sfs_rwblock_nolock(sfs, buf, blkno, write,
-						1)) != 0) {
-				break;
-			}
-			blkno++, nblks--;
-			buf += SFS_BLKSIZE;
+	if (sfs_rwmem(sfs, buf, nblks * SFS_BLKSIZE, blkno, 0, write)) {
+		return 0;
+	}
+#ifndef UCONFIG_SFS_PAGE_CACHE
+	/* all the blocks with one request, the device splits it as it needs */
+	assert(blkno != 0 && blkno + nblks <= sfs->super.blocks);
+	struct iobuf __iob, *iob = iobuf_init(&__iob, buf, nblks * SFS_BLKSIZE,
+					      blkno * SFS_BLKSIZE);
+	ret = dop_io(sfs->dev, iob, write);
+#else
+	if (!write && nblks > 1) {
+		sfs_cache_prefetch(sfs, blkno, nblks);
+	}
+	while (nblks != 0) {
+		if ((ret =
+		     sfs_rwcache(sfs, buf, SFS_BLKSIZE, blkno, 0,
+				 write)) == -E_NO_MEM) {
+			lock_sfs_io(sfs);
+			ret = sfs_rwblock_nolock(sfs, buf, blkno, write, 1);
+			unlock_sfs_io(sfs);
 		}
+		if (ret != 0) {
+			break;
+		}
+		blkno++, nblks--;
+		buf += SFS_BLKSIZE;
 	}
-	unlock_sfs_io(sfs);
+#endif
 	return ret;
 }
 
@@ -42,89 +162,159 @@ int sfs_rblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks)
 	return sfs_rwblock(sfs, buf, blkno, nblks, 0);
 }
 
+/*
+ * sfs_wblock/sfs_rbuf/sfs_wbuf are for metadata: those of a journaled sfs
+ * go to the running transaction of its journal rather than in place, and
+ * are read back from there until the transaction is checkpointed. File
+ * data goes through the _data ones, straight to the cache or the disk.
+ */
 int sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks)
 {
-	return sfs_rwblock(sfs, buf, blkno, nblks, 1);
+#ifdef UCONFIG_SFS_JOURNAL
+	if (sfs_journaled(sfs)) {
+		int ret = 0;
+		while (nblks != 0 && ret == 0) {
+			ret = sfs_journal_wbuf(sfs, buf, SFS_BLKSIZE, blkno, 0);
+			blkno++, nblks--;
+			buf += SFS_BLKSIZE;
+		}
+		return ret;
+	}
+#endif
+	return sfs_wblock_data(sfs, buf, blkno, nblks);
 }
 
 int
 sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
 	 off_t offset)
+{
+#ifdef UCONFIG_SFS_JOURNAL
+	if (sfs_journaled(sfs)
+	    && sfs_journal_rbuf(sfs, buf, len, blkno, offset) == 0) {
+		return 0;
+	}
+#endif
+	return sfs_rbuf_data(sfs, buf, len, blkno, offset);
+}
+
+int
+sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
+	 off_t offset)
+{
+#ifdef UCONFIG_SFS_JOURNAL
+	if (sfs_journaled(sfs)) {
+		return sfs_journal_wbuf(sfs, buf, len, blkno, offset);
+	}
+#endif
+	return sfs_wbuf_data(sfs, buf, len, blkno, offset);
+}
+
+int
+sfs_wblock_data(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks)
+{
+	return sfs_rwblock(sfs, buf, blkno, nblks, 1);
+}
+
+int
+sfs_rbuf_data(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
+	      off_t offset)
 {
 	assert(offset >= 0 && offset < SFS_BLKSIZE
 	       && offset + len <= SFS_BLKSIZE);
 	int ret;
-	lock_sfs_io(sfs);
-	{
-		if ((ret =
-		     sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 0,
-					1)) == 0) {
-			memcpy(buf, sfs->sfs_buffer + offset, len);
-		}
+	if ((ret = sfs_rwcache(sfs, buf, len, blkno, offset, 0)) != -E_NO_MEM) {
+		return ret;
 	}
-	unlock_sfs_io(sfs);
+	void *buffer = sfs_buffer_get(sfs);
+	if ((ret = sfs_rwblock_nolock(sfs, buffer, blkno, 0, 1)) == 0) {
+		memcpy(buf, buffer + offset, len);
+	}
+	sfs_buffer_put(sfs, buffer);
 	return ret;
 }
 
 int
-sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
-	 off_t offset)
+sfs_wbuf_data(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
+	      off_t offset)
 {
 	assert(offset >= 0 && offset < SFS_BLKSIZE
 	       && offset + len <= SFS_BLKSIZE);
 	int ret;
-	lock_sfs_io(sfs);
-	{
-		if ((ret =
-		     sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 0,
-					1)) == 0) {
-			memcpy(sfs->sfs_buffer + offset, buf, len);
-			ret =
-			    sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 1,
-					       1);
-		}
+	if ((ret = sfs_rwcache(sfs, buf, len, blkno, offset, 1)) != -E_NO_MEM) {
+		return ret;
 	}
-	unlock_sfs_io(sfs);
+	void *buffer = sfs_buffer_get(sfs);
+	if ((ret = sfs_rwblock_nolock(sfs, buffer, blkno, 0, 1)) == 0) {
+		memcpy(buffer + offset, buf, len);
+		ret = sfs_rwblock_nolock(sfs, buffer, blkno, 1, 1);
+	}
+	sfs_buffer_put(sfs, buffer);
 	return ret;
 }
 
 int sfs_sync_super(struct sfs_fs *sfs)
 {
 	int ret;
-	lock_sfs_io(sfs);
-	{
-		memset(sfs->sfs_buffer, 0, SFS_BLKSIZE);
-		memcpy(sfs->sfs_buffer, &(sfs->super), sizeof(sfs->super));
-		ret =
-		    sfs_rwblock_nolock(sfs, sfs->sfs_buffer, SFS_BLKN_SUPER, 1,
-				       0);
+#ifdef UCONFIG_SFS_JOURNAL
+	if (sfs_journaled(sfs)) {
+		void *buffer;
+		if ((buffer = kmalloc(SFS_BLKSIZE)) == NULL) {
+			return -E_NO_MEM;
+		}
+		memset(buffer, 0, SFS_BLKSIZE);
+		memcpy(buffer, &(sfs->super), sizeof(sfs->super));
+		ret = sfs_journal_wbuf(sfs, buffer, SFS_BLKSIZE,
+				       SFS_BLKN_SUPER, 0);
+		kfree(buffer);
+		return ret;
 	}
-	unlock_sfs_io(sfs);
+#endif
+	void *buffer = sfs_buffer_get(sfs);
+	memset(buffer, 0, SFS_BLKSIZE);
+	memcpy(buffer, &(sfs->super), sizeof(sfs->super));
+	ret = sfs_rwblock_nolock(sfs, buffer, SFS_BLKN_SUPER, 1, 0);
+	sfs_buffer_put(sfs, buffer);
 	return ret;
 }
 
+// sfs_sync_freemap - write the freemap blocks changed since the last sync
 int sfs_sync_freemap(struct sfs_fs *sfs)
 {
-	uint32_t nblks = sfs_freemap_blocks(&(sfs->super));
-	return sfs_wblock(sfs, bitmap_getdata(sfs->freemap, NULL),
-			  SFS_BLKN_FREEMAP, nblks);
+	uint32_t i, nblks = sfs_freemap_blocks(&(sfs->super));
+	void *data = bitmap_getdata(sfs->freemap, NULL);
+	int ret;
+	for (i = 0; i < nblks; i++) {
+		if (!sfs->freemap_dirty[i]) {
+			continue;
+		}
+		/* cleared first, the block may change again while it is written */
+		sfs->freemap_dirty[i] = 0;
+		if ((ret =
+		     sfs_wblock(sfs, data + i * SFS_BLKSIZE,
+				SFS_BLKN_FREEMAP + i, 1)) != 0) {
+			sfs->freemap_dirty[i] = 1;
+			return ret;
+		}
+	}
+	return 0;
 }
 
 int sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks)
 {
-	int ret;
-	lock_sfs_io(sfs);
-	{
-		memset(sfs->sfs_buffer, 0, SFS_BLKSIZE);
-		while (nblks != 0) {
-			if ((ret =
-			     sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 1,
-						1)) != 0) {
-				break;
-			}
-			blkno++, nblks--;
+	int ret = 0;
+	while (nblks != 0) {
+		if ((ret =
+		     sfs_rwcache(sfs, NULL, SFS_BLKSIZE, blkno, 0,
+				 1)) == -E_NO_MEM) {
+			void *buffer = sfs_buffer_get(sfs);
+			memset(buffer, 0, SFS_BLKSIZE);
+			ret = sfs_rwblock_nolock(sfs, buffer, blkno, 1, 1);
+			sfs_buffer_put(sfs, buffer);
 		}
+		if (ret != 0) {
+			break;
+		}
+		blkno++, nblks--;
 	}
-	unlock_sfs_io(sfs);
 	return ret;
 }
@@ -0,0 +1,654 @@
+#include <types.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <slab.h>
+#include <list.h>
+#include <sem.h>
+#include <kmutex.h>
+#include <wait.h>
+#include <proc.h>
+#include <sched.h>
+#include <dev.h>
+#include <sfs.h>
+#include <iobuf.h>
+#include <error.h>
+#include <assert.h>
+#include <kio.h>
+
+/*
+ * The metadata journal of sfs.
+ *
+ * Inodes, directory entries, indirect blocks, the freemap and the
+ * superblock of a journaled sfs are not written in place: sfs_wbuf and
+ * sfs_wblock copy them into a jbuf, one per block, of the running
+ * transaction, and sfs_rbuf reads them back from there. A commit writes
+ * the jbufs to the log area of the journal with a descriptor in front and
+ * a commit block behind, then checkpoints them to their blocks and moves
+ * the seq of the header on. A crash leaves either no committed
+ * transaction to replay or one that is replayed in whole at mount, so
+ * the metadata is always that of the end of some commit.
+ *
+ * The data of the files goes straight to the cache or the disk, and is
+ * flushed by the commit before the log is written, so that committed
+ * metadata never points at blocks that were not written. A freed block
+ * is only put back in the freemap by the commit of its transaction: it
+ * still belongs to the last committed metadata until then.
+ *
+ * Every vop that changes metadata runs as an update, between
+ * sfs_journal_start and sfs_journal_stop. A commit waits for the running
+ * updates to stop and holds new ones off until it is done, so the
+ * operations it takes are never half done.
+ */
+
+struct sfs_jbuf {
+	list_entry_t link;	/* entry in buf_list */
+	list_entry_t hash_link;	/* entry in the hash list of the journal */
+	uint32_t blkno;		/* the block it goes to */
+	void *data;		/* SFS_BLKSIZE bytes */
+};
+
+#define le2jbuf(le, member)                         \
+    to_struct((le), struct sfs_jbuf, member)
+
+struct sfs_journal {
+	struct sfs_fs *sfs;	/* the sfs journaled */
+	uint32_t start, size;	/* the blocks of the journal */
+	uint32_t capacity;	/* # of blocks one transaction may log */
+	uint32_t seq;		/* of the running transaction */
+	kmutex_t buf_mutex;	/* the jbufs */
+	list_entry_t buf_list;
+	list_entry_t hash_list[SFS_JOURNAL_HLIST_SIZE];
+	uint32_t nr_bufs;
+	uint32_t *freed;	/* blocks freed by the running transaction */
+	uint32_t nr_freed, max_freed;
+	kmutex_t state_mutex;	/* the fields below */
+	list_entry_t handle_list;	/* the outermost running updates */
+	int nr_updates;
+	bool committing;	/* new updates wait in commit_wait */
+	bool changed;		/* an update ran since the last commit */
+	wait_queue_t update_wait;	/* the commit waits for the updates */
+	wait_queue_t commit_wait;
+	semaphore_t commit_sem;	/* one commit at a time */
+	void *buffer;		/* the header, the descriptor or the commit */
+	list_entry_t journal_link;	/* entry in journal_list */
+};
+
+#define sfs_journal_hashfn(x)                       (hash32(x, SFS_JOURNAL_HLIST_SHIFT))
+
+#define le2journal(le, member)                      \
+    to_struct((le), struct sfs_journal, member)
+
+/* list of the journals of all mounted sfs */
+static list_entry_t journal_list;
+static semaphore_t journal_list_sem;
+
+void sfs_journal_init(void)
+{
+	list_init(&journal_list);
+	sem_init(&journal_list_sem, 1);
+}
+
+static int
+journal_rwblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, bool write)
+{
+	struct iobuf __iob, *iob =
+	    iobuf_init(&__iob, buf, SFS_BLKSIZE, blkno * SFS_BLKSIZE);
+	return dop_io(sfs->dev, iob, write);
+}
+
+static uint32_t journal_checksum(uint32_t sum, const uint32_t * data, int n)
+{
+	while (n-- > 0) {
+		sum = ((sum << 5) | (sum >> 27)) ^ *data++;
+	}
+	return sum;
+}
+
+// journal_wait - sleep in queue with the state_mutex dropped, it is held
+//              - again on return
+static void journal_wait(struct sfs_journal *jn, wait_queue_t * queue)
+{
+	wait_t __wait, *wait = &__wait;
+	wait_current_set(queue, wait, WT_KSEM);
+	kmutex_unlock(&(jn->state_mutex));
+	schedule();
+	kmutex_lock(&(jn->state_mutex));
+	wait_current_del(queue, wait);
+}
+
+static struct sfs_jbuf *journal_lookup(struct sfs_journal *jn, uint32_t blkno)
+{
+	list_entry_t *list =
+	    jn->hash_list + sfs_journal_hashfn(blkno), *le = list;
+	while ((le = list_next(le)) != list) {
+		struct sfs_jbuf *jb = le2jbuf(le, hash_link);
+		if (jb->blkno == blkno) {
+			return jb;
+		}
+	}
+	return NULL;
+}
+
+static void journal_free_buf(struct sfs_journal *jn, struct sfs_jbuf *jb)
+{
+	list_del(&(jb->link));
+	list_del(&(jb->hash_link));
+	jn->nr_bufs--;
+	kfree(jb->data);
+	kfree(jb);
+}
+
+static void journal_free_bufs(struct sfs_journal *jn)
+{
+	while (!list_empty(&(jn->buf_list))) {
+		journal_free_buf(jn, le2jbuf(list_next(&(jn->buf_list)), link));
+	}
+	assert(jn->nr_bufs == 0);
+}
+
+/*
+ * Replay the transaction left in the log if it is complete: its
+ * descriptor and its commit block carry the seq of the header and the
+ * checksum matches the copies. On return the header has moved on, so the
+ * log is free for the next transaction.
+ */
+static int journal_recover(struct sfs_fs *sfs)
+{
+	struct sfs_journal *jn = sfs->journal;
+	struct sfs_journal_header *header = jn->buffer;
+	struct sfs_journal_desc *desc;
+	struct sfs_journal_commit *commit;
+	void *block = NULL;
+	uint32_t i, nblocks = 0, sum;
+	int ret;
+
+	if ((ret = journal_rwblock(sfs, header, jn->start, 0)) != 0) {
+		return ret;
+	}
+	if (header->magic != SFS_JOURNAL_MAGIC) {
+		kprintf("sfs: wrong magic in journal header (%08x).\n",
+			header->magic);
+		return -E_INVAL;
+	}
+	jn->seq = header->seq;
+
+	ret = -E_NO_MEM;
+	if ((desc = kmalloc(SFS_BLKSIZE)) == NULL) {
+		return ret;
+	}
+	if ((block = kmalloc(SFS_BLKSIZE)) == NULL) {
+		goto out;
+	}
+	if ((ret = journal_rwblock(sfs, desc, jn->start + 1, 0)) != 0) {
+		goto out;
+	}
+	if (desc->magic != SFS_JOURNAL_DESC_MAGIC || desc->seq != jn->seq
+	    || desc->nblocks == 0 || desc->nblocks > jn->capacity) {
+		goto done;
+	}
+	nblocks = desc->nblocks;
+	sum = journal_checksum(jn->seq, desc->blknos, nblocks);
+	for (i = 0; i < nblocks; i++) {
+		if ((ret =
+		     journal_rwblock(sfs, block, jn->start + 2 + i, 0)) != 0) {
+			goto out;
+		}
+		sum = journal_checksum(sum, block, SFS_BLK_NENTRY);
+	}
+	if ((ret =
+	     journal_rwblock(sfs, block, jn->start + 2 + nblocks, 0)) != 0) {
+		goto out;
+	}
+	commit = block;
+	if (commit->magic != SFS_JOURNAL_COMMIT_MAGIC || commit->seq != jn->seq
+	    || commit->nblocks != nblocks || commit->checksum != sum) {
+		nblocks = 0;
+		goto done;
+	}
+	for (i = 0; i < nblocks; i++) {
+		if (desc->blknos[i] >= sfs->super.blocks) {
+			ret = -E_INVAL;
+			goto out;
+		}
+	}
+	for (i = 0; i < nblocks; i++) {
+		if ((ret =
+		     journal_rwblock(sfs, block, jn->start + 2 + i, 0)) != 0
+		    || (ret =
+			journal_rwblock(sfs, block, desc->blknos[i], 1)) != 0) {
+			goto out;
+		}
+	}
+
+done:
+	memset(header, 0, SFS_BLKSIZE);
+	header->magic = SFS_JOURNAL_MAGIC;
+	header->seq = ++jn->seq;
+	if ((ret = journal_rwblock(sfs, header, jn->start, 1)) == 0
+	    && nblocks != 0) {
+		kprintf("sfs: journal: replayed %u blocks.\n", nblocks);
+	}
+out:
+	if (block != NULL) {
+		kfree(block);
+	}
+	kfree(desc);
+	return ret;
+}
+
+/*
+ * sfs_journal_create - set up the journal of sfs, whose superblock has
+ * just been read, and replay it. The superblock in sfs is read again if
+ * the replay rewrote it.
+ */
+int sfs_journal_create(struct sfs_fs *sfs)
+{
+	struct sfs_super *super = &(sfs->super);
+	sfs->journal = NULL;
+	if (!(super->features & SFS_FEATURE_JOURNAL)) {
+		return 0;
+	}
+	if (super->journal_blocks < 4 || super->journal_start <= SFS_BLKN_ROOT
+	    || super->journal_start + super->journal_blocks > super->blocks) {
+		kprintf("sfs: bad journal (%u blocks from %u on).\n",
+			super->journal_blocks, super->journal_start);
+		return -E_INVAL;
+	}
+
+	struct sfs_journal *jn;
+	if ((jn = kmalloc(sizeof(struct sfs_journal))) == NULL) {
+		return -E_NO_MEM;
+	}
+	if ((jn->buffer = kmalloc(SFS_BLKSIZE)) == NULL) {
+		kfree(jn);
+		return -E_NO_MEM;
+	}
+	jn->sfs = sfs;
+	jn->start = super->journal_start, jn->size = super->journal_blocks;
+	jn->capacity = jn->size - 3;
+	if (jn->capacity > SFS_JOURNAL_DESC_NENTRY) {
+		jn->capacity = SFS_JOURNAL_DESC_NENTRY;
+	}
+	kmutex_init(&(jn->buf_mutex));
+	list_init(&(jn->buf_list));
+	int i, ret;
+	for (i = 0; i < SFS_JOURNAL_HLIST_SIZE; i++) {
+		list_init(jn->hash_list + i);
+	}
+	jn->nr_bufs = 0;
+	jn->freed = NULL, jn->nr_freed = jn->max_freed = 0;
+	kmutex_init(&(jn->state_mutex));
+	list_init(&(jn->handle_list));
+	jn->nr_updates = 0, jn->committing = jn->changed = 0;
+	wait_queue_init(&(jn->update_wait));
+	wait_queue_init(&(jn->commit_wait));
+	sem_init(&(jn->commit_sem), 1);
+	sfs->journal = jn;
+
+	if ((ret = journal_recover(sfs)) != 0
+	    || (ret = journal_rwblock(sfs, jn->buffer, SFS_BLKN_SUPER, 0)) != 0) {
+		goto failed;
+	}
+	if (((struct sfs_super *)(jn->buffer))->magic != SFS_MAGIC) {
+		ret = -E_INVAL;
+		goto failed;
+	}
+	memcpy(super, jn->buffer, sizeof(struct sfs_super));
+	super->info[SFS_MAX_INFO_LEN] = '\0';
+
+	down(&journal_list_sem);
+	list_add(&journal_list, &(jn->journal_link));
+	up(&journal_list_sem);
+	return 0;
+
+failed:
+	sfs->journal = NULL;
+	kfree(jn->buffer);
+	kfree(jn);
+	return ret;
+}
+
+void sfs_journal_destroy(struct sfs_fs *sfs)
+{
+	struct sfs_journal *jn = sfs->journal;
+	if (jn != NULL) {
+		assert(jn->nr_updates == 0 && jn->nr_freed == 0);
+		down(&journal_list_sem);
+		list_del(&(jn->journal_link));
+		up(&journal_list_sem);
+		journal_free_bufs(jn);
+		if (jn->freed != NULL) {
+			kfree(jn->freed);
+		}
+		kfree(jn->buffer);
+		kfree(jn);
+		sfs->journal = NULL;
+	}
+}
+
+static struct sfs_handle *journal_find_handle(struct sfs_journal *jn)
+{
+	list_entry_t *list = &(jn->handle_list), *le = list;
+	while ((le = list_next(le)) != list) {
+		struct sfs_handle *handle = to_struct(le, struct sfs_handle, link);
+		if (handle->proc == current) {
+			return handle;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * sfs_journal_start - begin an update of sfs in handle, before the locks
+ * of the operation are taken: it may have to wait for a commit, which
+ * itself waits for the updates holding them. An update of a process
+ * that is in one already, like the reclaim of an inode in unlink, rides
+ * on the outer one.
+ */
+void sfs_journal_start(struct sfs_fs *sfs, struct sfs_handle *handle)
+{
+	struct sfs_journal *jn = sfs->journal;
+	if (jn == NULL) {
+		return;
+	}
+	kmutex_lock(&(jn->state_mutex));
+	if ((handle->outer = journal_find_handle(jn)) != NULL) {
+		kmutex_unlock(&(jn->state_mutex));
+		return;
+	}
+	if (jn->nr_bufs >= jn->capacity / 2 && !jn->committing) {
+		/* commit while the transaction still fits in the log */
+		kmutex_unlock(&(jn->state_mutex));
+		sfs_journal_commit(sfs);
+		kmutex_lock(&(jn->state_mutex));
+	}
+	while (jn->committing) {
+		journal_wait(jn, &(jn->commit_wait));
+	}
+	handle->proc = current;
+	list_add(&(jn->handle_list), &(handle->link));
+	jn->nr_updates++, jn->changed = 1;
+	kmutex_unlock(&(jn->state_mutex));
+}
+
+void sfs_journal_stop(struct sfs_fs *sfs, struct sfs_handle *handle)
+{
+	struct sfs_journal *jn = sfs->journal;
+	if (jn == NULL || handle->outer != NULL) {
+		return;
+	}
+	kmutex_lock(&(jn->state_mutex));
+	list_del(&(handle->link));
+	if (--jn->nr_updates == 0 && !wait_queue_empty(&(jn->update_wait))) {
+		wakeup_queue(&(jn->update_wait), WT_KSEM, 1);
+	}
+	kmutex_unlock(&(jn->state_mutex));
+}
+
+// sfs_journal_rbuf - read len bytes at offset of block blkno from its jbuf,
+//                  - -E_NOENT if the running transaction has none
+int
+sfs_journal_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
+		 off_t offset)
+{
+	struct sfs_journal *jn = sfs->journal;
+	struct sfs_jbuf *jb;
+	int ret = -E_NOENT;
+	assert(offset >= 0 && offset < SFS_BLKSIZE
+	       && offset + len <= SFS_BLKSIZE);
+	kmutex_lock(&(jn->buf_mutex));
+	if ((jb = journal_lookup(jn, blkno)) != NULL) {
+		memcpy(buf, jb->data + offset, len);
+		ret = 0;
+	}
+	kmutex_unlock(&(jn->buf_mutex));
+	return ret;
+}
+
+// sfs_journal_wbuf - write len bytes at offset of block blkno to its jbuf,
+//                  - which starts as a copy of the block
+int
+sfs_journal_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno,
+		 off_t offset)
+{
+	struct sfs_journal *jn = sfs->journal;
+	struct sfs_jbuf *jb, *new_jb = NULL;
+	int ret;
+	assert(offset >= 0 && offset < SFS_BLKSIZE
+	       && offset + len <= SFS_BLKSIZE);
+	kmutex_lock(&(jn->buf_mutex));
+	if ((jb = journal_lookup(jn, blkno)) == NULL) {
+		kmutex_unlock(&(jn->buf_mutex));
+		ret = -E_NO_MEM;
+		if ((new_jb = kmalloc(sizeof(struct sfs_jbuf))) == NULL) {
+			return ret;
+		}
+		if ((new_jb->data = kmalloc(SFS_BLKSIZE)) == NULL) {
+			goto failed_cleanup_jbuf;
+		}
+		if (len != SFS_BLKSIZE) {
+			if (blkno == SFS_BLKN_SUPER) {
+				ret = journal_rwblock(sfs, new_jb->data, blkno, 0);
+			} else {
+				ret = sfs_rbuf_data(sfs, new_jb->data,
+						    SFS_BLKSIZE, blkno, 0);
+			}
+			if (ret != 0) {
+				goto failed_cleanup_data;
+			}
+		}
+		kmutex_lock(&(jn->buf_mutex));
+		/* another update may have put it in meanwhile */
+		if ((jb = journal_lookup(jn, blkno)) == NULL) {
+			jb = new_jb, new_jb = NULL;
+			jb->blkno = blkno;
+			list_add_before(&(jn->buf_list), &(jb->link));
+			list_add(jn->hash_list + sfs_journal_hashfn(blkno),
+				 &(jb->hash_link));
+			jn->nr_bufs++;
+		}
+	}
+	memcpy(jb->data + offset, buf, len);
+	kmutex_unlock(&(jn->buf_mutex));
+	if (new_jb == NULL) {
+		return 0;
+	}
+	ret = 0;
+
+failed_cleanup_data:
+	kfree(new_jb->data);
+failed_cleanup_jbuf:
+	kfree(new_jb);
+	return ret;
+}
+
+// sfs_journal_free - put off the release of block blkno to the commit,
+//                  - -E_NO_MEM if it must be released at once instead
+int sfs_journal_free(struct sfs_fs *sfs, uint32_t blkno)
+{
+	struct sfs_journal *jn = sfs->journal;
+	struct sfs_jbuf *jb;
+	int ret = 0;
+	kmutex_lock(&(jn->buf_mutex));
+	if (jn->nr_freed == jn->max_freed) {
+		uint32_t max_freed = (jn->max_freed != 0) ? jn->max_freed * 2 : 64;
+		uint32_t *freed;
+		if ((freed = kmalloc(sizeof(uint32_t) * max_freed)) == NULL) {
+			ret = -E_NO_MEM;
+			goto out;
+		}
+		if (jn->freed != NULL) {
+			memcpy(freed, jn->freed, sizeof(uint32_t) * jn->nr_freed);
+			kfree(jn->freed);
+		}
+		jn->freed = freed, jn->max_freed = max_freed;
+	}
+	jn->freed[jn->nr_freed++] = blkno;
+out:
+	/* what the transaction wrote to it goes nowhere now */
+	if ((jb = journal_lookup(jn, blkno)) != NULL) {
+		journal_free_buf(jn, jb);
+	}
+	kmutex_unlock(&(jn->buf_mutex));
+	return ret;
+}
+
+// journal_log - write the jbufs to the log with one request
+static int journal_log(struct sfs_fs *sfs)
+{
+	struct sfs_journal *jn = sfs->journal;
+	struct sfs_journal_desc *desc;
+	struct sfs_journal_commit *commit = jn->buffer;
+	struct iovec *iov;
+	uint32_t i, n = jn->nr_bufs;
+	int ret = -E_NO_MEM;
+	assert(n != 0 && n <= jn->capacity);
+	if ((desc = kmalloc(SFS_BLKSIZE)) == NULL) {
+		return ret;
+	}
+	if ((iov = kmalloc(sizeof(struct iovec) * (n + 2))) == NULL) {
+		goto out;
+	}
+	memset(desc, 0, SFS_BLKSIZE);
+	memset(commit, 0, SFS_BLKSIZE);
+	desc->magic = SFS_JOURNAL_DESC_MAGIC;
+	desc->seq = jn->seq, desc->nblocks = n;
+	iov[0].iov_base = (void *)desc, iov[0].iov_len = SFS_BLKSIZE;
+
+	list_entry_t *list = &(jn->buf_list), *le = list;
+	for (i = 0; (le = list_next(le)) != list; i++) {
+		struct sfs_jbuf *jb = le2jbuf(le, link);
+		desc->blknos[i] = jb->blkno;
+		iov[i + 1].iov_base = jb->data, iov[i + 1].iov_len = SFS_BLKSIZE;
+	}
+	assert(i == n);
+
+	uint32_t sum = journal_checksum(jn->seq, desc->blknos, n);
+	for (i = 0; i < n; i++) {
+		sum = journal_checksum(sum, (void *)iov[i + 1].iov_base,
+				       SFS_BLK_NENTRY);
+	}
+	commit->magic = SFS_JOURNAL_COMMIT_MAGIC;
+	commit->seq = jn->seq, commit->nblocks = n, commit->checksum = sum;
+	iov[n + 1].iov_base = (void *)commit, iov[n + 1].iov_len = SFS_BLKSIZE;
+
+	struct iobuf __iob, *iob = iobuf_init_vec(&__iob, iov, n + 2,
+						  (jn->start + 1) * SFS_BLKSIZE);
+	ret = dop_io(sfs->dev, iob, 1);
+	kfree(iov);
+out:
+	kfree(desc);
+	return ret;
+}
+
+// journal_checkpoint - write the jbufs in place and move the header on
+static int journal_checkpoint(struct sfs_fs *sfs)
+{
+	struct sfs_journal *jn = sfs->journal;
+	struct sfs_journal_header *header = jn->buffer;
+	list_entry_t *list = &(jn->buf_list), *le = list;
+	int ret;
+	while ((le = list_next(le)) != list) {
+		struct sfs_jbuf *jb = le2jbuf(le, link);
+		/* the superblock is never cached */
+		if (jb->blkno == SFS_BLKN_SUPER) {
+			ret = journal_rwblock(sfs, jb->data, jb->blkno, 1);
+		} else {
+			ret = sfs_wblock_data(sfs, jb->data, jb->blkno, 1);
+		}
+		if (ret != 0) {
+			return ret;
+		}
+	}
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	if ((ret = sfs_cache_flush(sfs)) != 0) {
+		return ret;
+	}
+#endif
+	memset(header, 0, SFS_BLKSIZE);
+	header->magic = SFS_JOURNAL_MAGIC, header->seq = jn->seq + 1;
+	if ((ret = journal_rwblock(sfs, header, jn->start, 1)) != 0) {
+		return ret;
+	}
+	jn->seq++;
+	journal_free_bufs(jn);
+	return 0;
+}
+
+// journal_commit - commit the running transaction, with the commit_sem
+//                - held and the updates held off
+static int journal_commit(struct sfs_fs *sfs)
+{
+	struct sfs_journal *jn = sfs->journal;
+	uint32_t i;
+	int ret;
+	for (i = 0; i < jn->nr_freed; i++) {
+		sfs_block_release(sfs, jn->freed[i]);
+	}
+	jn->nr_freed = 0;
+	/* the inodes, the freemap and the super go to jbufs, the data to disk */
+	if ((ret = sfs_sync_nolock(sfs)) != 0) {
+		return ret;
+	}
+	if (jn->nr_bufs == 0) {
+		return 0;
+	}
+	if (jn->nr_bufs <= jn->capacity) {
+		if ((ret = journal_log(sfs)) != 0) {
+			return ret;
+		}
+	} else {
+		warn("sfs: journal: %u blocks do not fit in the journal, "
+		     "written in place.\n", jn->nr_bufs);
+	}
+	return journal_checkpoint(sfs);
+}
+
+/*
+ * sfs_journal_commit - wait for the running updates of sfs to stop and
+ * commit the transaction they made, and everything that was written
+ * before. This is what sync and fsync of a journaled sfs do.
+ */
+int sfs_journal_commit(struct sfs_fs *sfs)
+{
+	struct sfs_journal *jn = sfs->journal;
+	int ret;
+	down(&(jn->commit_sem));
+	kmutex_lock(&(jn->state_mutex));
+	jn->committing = 1;
+	while (jn->nr_updates != 0) {
+		journal_wait(jn, &(jn->update_wait));
+	}
+	jn->changed = 0;
+	kmutex_unlock(&(jn->state_mutex));
+
+	if ((ret = journal_commit(sfs)) != 0) {
+		jn->changed = 1;
+	}
+
+	kmutex_lock(&(jn->state_mutex));
+	jn->committing = 0;
+	if (!wait_queue_empty(&(jn->commit_wait))) {
+		wakeup_queue(&(jn->commit_wait), WT_KSEM, 1);
+	}
+	kmutex_unlock(&(jn->state_mutex));
+	up(&(jn->commit_sem));
+	return ret;
+}
+
+int sfs_journal_main(void *arg)
+{
+	while (1) {
+		list_entry_t *le = &journal_list;
+		down(&journal_list_sem);
+		while ((le = list_next(le)) != &journal_list) {
+			struct sfs_journal *jn = le2journal(le, journal_link);
+			if (jn->changed || jn->nr_bufs != 0) {
+				sfs_journal_commit(jn->sfs);
+			}
+		}
+		up(&journal_list_sem);
+		do_sleep(SFS_JOURNAL_INTERVAL);
+	}
+}
@@ -1,33 +1,45 @@
 #include <types.h>
-#include <sem.h>
+#include <stdlib.h>
+#include <kmutex.h>
 #include <sfs.h>
 
 void lock_sfs_fs(struct sfs_fs *sfs)
 {
-	down(&(sfs->fs_sem));
+	kmutex_lock(&(sfs->fs_mutex));
 }
 
 void lock_sfs_io(struct sfs_fs *sfs)
 {
-	down(&(sfs->io_sem));
+	kmutex_lock_site(&(sfs->io_mutex),
+			 (uintptr_t) __builtin_return_address(0));
 }
 
 void lock_sfs_mutex(struct sfs_fs *sfs)
 {
-	down(&(sfs->mutex_sem));
+	kmutex_lock(&(sfs->link_mutex));
+}
+
+void lock_sfs_hash(struct sfs_fs *sfs, uint32_t ino)
+{
+	kmutex_lock(&(sfs->hash_mutex[sin_hlockfn(ino)]));
 }
 
 void unlock_sfs_fs(struct sfs_fs *sfs)
 {
-	up(&(sfs->fs_sem));
+	kmutex_unlock(&(sfs->fs_mutex));
 }
 
 void unlock_sfs_io(struct sfs_fs *sfs)
 {
-	up(&(sfs->io_sem));
+	kmutex_unlock(&(sfs->io_mutex));
 }
 
 void unlock_sfs_mutex(struct sfs_fs *sfs)
 {
-	up(&(sfs->mutex_sem));
+	kmutex_unlock(&(sfs->link_mutex));
+}
+
+void unlock_sfs_hash(struct sfs_fs *sfs, uint32_t ino)
+{
+	kmutex_unlock(&(sfs->hash_mutex[sin_hlockfn(ino)]));
 }
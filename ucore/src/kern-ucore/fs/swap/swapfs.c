@@ -4,28 +4,391 @@
 #include <fs.h>
 #include <ide.h>
 #include <pmm.h>
+#include <iobuf.h>
 #include <assert.h>
+#include <error.h>
+#include <zswap.h>
+#include <iostat.h>
+#include <kio.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <wait.h>
+#include <proc.h>
+#include <sched.h>
+#include <blkqueue.h>
 
 #ifdef UCONFIG_SWAP
+struct swap_area swap_areas[SWAP_MAX_AREAS];
+int swap_nr_areas;
+
+/* the disks that may hold swap, in the order their areas are made */
+static const unsigned short swapfs_devs[] = {
+	SWAP_DEV_NO,
+#ifdef SWAP1_DEV_NO
+	SWAP1_DEV_NO,
+#endif
+};
+
+#define SWAPFS_NR_DEVS                  (sizeof(swapfs_devs) / sizeof(swapfs_devs[0]))
+
+/* the reads and writes of all the areas, those of zswap left out */
+static struct io_stat swapfs_stat;
+
+#ifdef IDE_MAX_NSECS
+/* # of slots one command of swapfs_write_pages writes at most */
+#define SWAPFS_WB_PAGES                 (IDE_MAX_NSECS / PAGE_NSECT)
+#else
+#define SWAPFS_WB_PAGES                 1
+#endif
+
+#ifdef UCONFIG_BLK_QUEUE
+/*
+ * A write of swapfs_write_pages in the request queue of its disk. There
+ * are SWAPFS_NR_WB of them, so that reclaim has that many writes in flight
+ * at most, and waits for one to complete only past that; they are not
+ * allocated, as reclaim runs short of memory.
+ */
+#define SWAPFS_NR_WB                    8
+
+struct swapfs_wb {
+	struct blk_request req;
+	struct iovec iov[SWAPFS_WB_PAGES];
+	struct Page *pages[SWAPFS_WB_PAGES];
+	swapfs_end_t end;
+	uint64_t begin;
+	list_entry_t free_link;
+};
+
+#define le2wb(le, member)               \
+    to_struct((le), struct swapfs_wb, member)
+
+static struct swapfs_wb swapfs_wbs[SWAPFS_NR_WB];
+static list_entry_t swapfs_wb_free;
+static int swapfs_wb_nr_free;
+static spinlock_s swapfs_wb_lock;
+static wait_queue_t swapfs_wb_wait;
+#endif
+
+// swapfs_add_area - the disk ideno holds the slots after the others, in
+//                 - an area put after those of the same prio
+static void swapfs_add_area(unsigned short ideno)
+{
+	size_t nslots = ide_device_size(ideno) / PAGE_NSECT;
+	int prio = SWAP_PRIO_DISK, i;
+	struct swap_area *area;
+#ifdef IDE_DEVICE_MEM
+	if (ide_device_mem(ideno) != NULL) {
+		prio = SWAP_PRIO_MEM;
+	}
+#endif
+	if (nslots > MAX_SWAP_OFFSET_LIMIT - 1 - max_swap_offset) {
+		nslots = MAX_SWAP_OFFSET_LIMIT - 1 - max_swap_offset;
+	}
+	if (nslots == 0 || swap_nr_areas == SWAP_MAX_AREAS) {
+		return;
+	}
+	for (i = swap_nr_areas; i > 0 && swap_areas[i - 1].prio < prio; i--) {
+		swap_areas[i] = swap_areas[i - 1];
+	}
+	area = swap_areas + i;
+	area->ideno = ideno, area->prio = prio;
+	area->base = max_swap_offset, area->nslots = nslots;
+	/* the slot at offset 0 is never used */
+	area->next = (area->base != 0) ? area->base : 1;
+	area->cluster_next = area->cluster_left = 0;
+	max_swap_offset += nslots;
+	swap_nr_areas++;
+	kprintf("swapfs: disk %d, %d slots from %d, prio %d.\n", ideno,
+		nslots, area->base, prio);
+}
+
 void swapfs_init(void)
 {
+	int i;
 	static_assert((PGSIZE % SECTSIZE) == 0);
-	if (!ide_device_valid(SWAP_DEV_NO)) {
+	max_swap_offset = 0;
+	iostat_init(&swapfs_stat, "swap");
+#ifdef UCONFIG_BLK_QUEUE
+	spinlock_init(&swapfs_wb_lock);
+	wait_queue_init(&swapfs_wb_wait);
+	list_init(&swapfs_wb_free);
+	for (i = 0; i < SWAPFS_NR_WB; i++) {
+		list_add(&swapfs_wb_free, &(swapfs_wbs[i].free_link));
+	}
+	swapfs_wb_nr_free = SWAPFS_NR_WB;
+#endif
+	for (i = 0; i < SWAPFS_NR_DEVS; i++) {
+		if (ide_device_valid(swapfs_devs[i])) {
+			swapfs_add_area(swapfs_devs[i]);
+		}
+	}
+	if (swap_nr_areas == 0) {
 		panic("swap fs isn't available.\n");
 	}
-	max_swap_offset = ide_device_size(SWAP_DEV_NO) / (PGSIZE / SECTSIZE);
+#ifdef UCONFIG_ZSWAP
+	zswap_init(max_swap_offset);
+#endif
+}
+
+// swapfs_area - the area holding the slot at offset
+static struct swap_area *swapfs_area(size_t offset)
+{
+	int i;
+	for (i = 0; i < swap_nr_areas; i++) {
+		if (offset - swap_areas[i].base < swap_areas[i].nslots) {
+			return swap_areas + i;
+		}
+	}
+	panic("swapfs: no area holds slot %d.\n", offset);
 }
 
+#define swapfs_secno(area, offset)      (((offset) - (area)->base) * PAGE_NSECT)
+
 int swapfs_read(swap_entry_t entry, struct Page *page)
 {
-	return ide_read_secs(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT,
-			     page2kva(page), PAGE_NSECT);
+	size_t offset = swap_offset(entry);
+	struct swap_area *area = swapfs_area(offset);
+	uint64_t begin;
+	int ret;
+#ifdef UCONFIG_ZSWAP
+	if ((ret = zswap_load(offset, page)) != -E_NOENT) {
+		return ret;
+	}
+#endif
+	begin = iostat_begin(&swapfs_stat);
+	ret = ide_read_secs(area->ideno, swapfs_secno(area, offset),
+			    page2kva(page), PAGE_NSECT);
+	iostat_done(&swapfs_stat, 0, PAGE_NSECT, begin);
+	return ret;
+}
+
+// swapfs_read_each - read the n slots from the one of entry on one by one
+static int swapfs_read_each(swap_entry_t entry, struct Page **pages, int n)
+{
+	int i, ret;
+	for (i = 0; i < n; i++) {
+		if ((ret = swapfs_read(entry + (i << 8), pages[i])) != 0) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/*
+ * swapfs_read_pages - read the n slots from the one of entry on into
+ * pages, with one command if they are of one area, the disk takes vectors
+ * and zswap has none of them.
+ */
+int swapfs_read_pages(swap_entry_t entry, struct Page **pages, int n)
+{
+	size_t offset = swap_offset(entry);
+	struct swap_area *area = swapfs_area(offset);
+	int i;
+	if (offset + n - 1 - area->base >= area->nslots) {
+		return swapfs_read_each(entry, pages, n);
+	}
+#ifdef UCONFIG_ZSWAP
+	for (i = 0; i < n; i++) {
+		if (zswap_contains(offset + i)) {
+			return swapfs_read_each(entry, pages, n);
+		}
+	}
+#endif
+#ifdef IDE_MAX_NSECS
+	struct iovec iov[IDE_MAX_NSECS / PAGE_NSECT];
+	uint64_t begin;
+	int ret;
+	assert(n <= IDE_MAX_NSECS / PAGE_NSECT);
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = page2kva(pages[i]), iov[i].iov_len = PGSIZE;
+	}
+	begin = iostat_begin(&swapfs_stat);
+	ret = ide_read_secsv(area->ideno, swapfs_secno(area, offset), iov, n);
+	iostat_done(&swapfs_stat, 0, n * PAGE_NSECT, begin);
+	return ret;
+#else
+	return swapfs_read_each(entry, pages, n);
+#endif
 }
 
 int swapfs_write(swap_entry_t entry, struct Page *page)
 {
-	return ide_write_secs(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT,
-			      page2kva(page), PAGE_NSECT);
+#ifdef UCONFIG_ZSWAP
+	if (zswap_store(swap_offset(entry), page) == 0) {
+		return 0;
+	}
+#endif
+	return swapfs_write_area(swap_offset(entry), page);
+}
+
+// swapfs_write_area - write page to the slot at offset on its disk, as
+//                   - zswap does to write back
+int swapfs_write_area(size_t offset, struct Page *page)
+{
+	struct swap_area *area = swapfs_area(offset);
+	uint64_t begin = iostat_begin(&swapfs_stat);
+	int ret = ide_write_secs(area->ideno, swapfs_secno(area, offset),
+				 page2kva(page), PAGE_NSECT);
+	iostat_done(&swapfs_stat, 1, PAGE_NSECT, begin);
+	return ret;
+}
+
+#ifdef UCONFIG_BLK_QUEUE
+// swapfs_wb_get - a free swapfs_wb, waiting for a write to complete if
+//               - all are in flight
+static struct swapfs_wb *swapfs_wb_get(void)
+{
+	struct swapfs_wb *wb;
+	wait_t __wait, *wait = &__wait;
+	bool intr_flag;
+	spin_lock_irqsave(&swapfs_wb_lock, intr_flag);
+	while (list_empty(&swapfs_wb_free)) {
+		wait_current_set(&swapfs_wb_wait, wait, WT_IO);
+		spin_unlock_irqrestore(&swapfs_wb_lock, intr_flag);
+		schedule();
+		spin_lock_irqsave(&swapfs_wb_lock, intr_flag);
+		wait_current_del(&swapfs_wb_wait, wait);
+	}
+	wb = le2wb(list_next(&swapfs_wb_free), free_link);
+	list_del(&(wb->free_link));
+	swapfs_wb_nr_free--;
+	spin_unlock_irqrestore(&swapfs_wb_lock, intr_flag);
+	return wb;
+}
+
+// swapfs_wb_end - the end_io of a write, from the worker of the queue:
+//               - end each of its pages, then give it back
+static void swapfs_wb_end(struct blk_request *req)
+{
+	struct swapfs_wb *wb = req->private;
+	int i, n = req->iovcnt;
+	bool intr_flag;
+	iostat_done(&swapfs_stat, 1, req->nsecs, wb->begin);
+	for (i = 0; i < n; i++) {
+		wb->end(wb->pages[i], req->error);
+	}
+	spin_lock_irqsave(&swapfs_wb_lock, intr_flag);
+	list_add(&swapfs_wb_free, &(wb->free_link));
+	swapfs_wb_nr_free++;
+	spin_unlock_irqrestore(&swapfs_wb_lock, intr_flag);
+	if (!wait_queue_empty(&swapfs_wb_wait)) {
+		wakeup_queue(&swapfs_wb_wait, WT_IO, 1);
+	}
+}
+
+// swapfs_write_run - queue the write of the n pages, in the slots from
+//                  - offset on of area, and return
+static void
+swapfs_write_run(struct swap_area *area, size_t offset, struct Page **pages,
+		 int n, swapfs_end_t end)
+{
+	struct swapfs_wb *wb = swapfs_wb_get();
+	int i;
+	for (i = 0; i < n; i++) {
+		wb->pages[i] = pages[i];
+		wb->iov[i].iov_base = page2kva(pages[i]);
+		wb->iov[i].iov_len = PGSIZE;
+	}
+	wb->end = end;
+	blk_request_init(&(wb->req), swapfs_secno(area, offset), wb->iov, n, 1);
+	wb->req.end_io = swapfs_wb_end, wb->req.private = wb;
+	wb->begin = iostat_begin(&swapfs_stat);
+	ide_submit(area->ideno, &(wb->req));
+}
+#else
+// swapfs_write_run - write the n pages, in the slots from offset on of
+//                  - area, with one command, and end them
+static void
+swapfs_write_run(struct swap_area *area, size_t offset, struct Page **pages,
+		 int n, swapfs_end_t end)
+{
+	uint64_t begin = iostat_begin(&swapfs_stat);
+	int i, ret;
+#ifdef IDE_MAX_NSECS
+	struct iovec iov[SWAPFS_WB_PAGES];
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = page2kva(pages[i]), iov[i].iov_len = PGSIZE;
+	}
+	ret = ide_write_secsv(area->ideno, swapfs_secno(area, offset), iov, n);
+#else
+	ret = ide_write_secs(area->ideno, swapfs_secno(area, offset),
+			     page2kva(pages[0]), PAGE_NSECT);
+#endif
+	iostat_done(&swapfs_stat, 1, n * PAGE_NSECT, begin);
+	for (i = 0; i < n; i++) {
+		end(pages[i], ret);
+	}
+}
+#endif /* UCONFIG_BLK_QUEUE */
+
+/*
+ * swapfs_write_pages - write the n swap cache pages, sorted by the slots of
+ * their entries, and call end for each once it is written; the pages in
+ * consecutive slots of an area go in one command. With UCONFIG_BLK_QUEUE
+ * the writes are queued, end is called from the worker of the queue, and
+ * this waits only if SWAPFS_NR_WB writes are in flight already. pages is
+ * left reordered.
+ */
+void swapfs_write_pages(struct Page **pages, int n, swapfs_end_t end)
+{
+	int i, j;
+#ifdef UCONFIG_ZSWAP
+	int m = 0;
+	for (i = 0; i < n; i++) {
+		if (zswap_store(swap_offset(pages[i]->index), pages[i]) == 0) {
+			end(pages[i], 0);
+		} else {
+			pages[m++] = pages[i];
+		}
+	}
+	n = m;
+#endif
+	for (i = 0; i < n; i = j) {
+		size_t offset = swap_offset(pages[i]->index);
+		struct swap_area *area = swapfs_area(offset);
+		for (j = i + 1; j < n && j - i < SWAPFS_WB_PAGES; j++) {
+			size_t next = offset + (j - i);
+			if (swap_offset(pages[j]->index) != next
+			    || next - area->base >= area->nslots) {
+				break;
+			}
+		}
+		swapfs_write_run(area, offset, pages + i, j - i, end);
+	}
+}
+
+// swapfs_write_wait - wait for the writes of swapfs_write_pages in flight
+void swapfs_write_wait(void)
+{
+#ifdef UCONFIG_BLK_QUEUE
+	wait_t __wait, *wait = &__wait;
+	bool intr_flag;
+	spin_lock_irqsave(&swapfs_wb_lock, intr_flag);
+	while (swapfs_wb_nr_free != SWAPFS_NR_WB) {
+		wait_current_set(&swapfs_wb_wait, wait, WT_IO);
+		spin_unlock_irqrestore(&swapfs_wb_lock, intr_flag);
+		schedule();
+		spin_lock_irqsave(&swapfs_wb_lock, intr_flag);
+		wait_current_del(&swapfs_wb_wait, wait);
+	}
+	spin_unlock_irqrestore(&swapfs_wb_lock, intr_flag);
+#endif
+}
+
+// swapfs_free - the slot of entry is no longer used
+void swapfs_free(swap_entry_t entry)
+{
+#ifdef UCONFIG_ZSWAP
+	zswap_invalidate(swap_offset(entry));
+#endif
+}
+
+// swapfs_ready - the checks of swap are done
+void swapfs_ready(void)
+{
+#ifdef UCONFIG_ZSWAP
+	zswap_enable();
+#endif
 }
 
 #endif
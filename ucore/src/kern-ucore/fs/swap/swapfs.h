@@ -5,9 +5,44 @@
 #include <swap.h>
 
 #ifdef UCONFIG_SWAP
+
+/* *
+ * A swap area, a disk of its own. The offsets of swap are those of the
+ * areas one after the other: the area holds the nslots from base on, its
+ * slot i at sector i * PAGE_NSECT of the disk. try_alloc_swap_entry fills
+ * the areas of the highest prio first, and stripes those of equal prio a
+ * cluster at a time, each with a cluster allocator of its own.
+ * */
+#define SWAP_MAX_AREAS                  4
+
+/* the prio of an area on memory, of one on a disk */
+#define SWAP_PRIO_MEM                   1
+#define SWAP_PRIO_DISK                  0
+
+struct swap_area {
+	unsigned short ideno;
+	int prio;
+	size_t base, nslots;
+	size_t next;		// where the next cluster is looked for
+	size_t cluster_next, cluster_left;
+};
+
+/* by prio, the highest first, then in the order they were found */
+extern struct swap_area swap_areas[SWAP_MAX_AREAS];
+extern int swap_nr_areas;
+
+/* called once the write of page is done, with its error */
+typedef void (*swapfs_end_t) (struct Page * page, int error);
+
 void swapfs_init(void);
 int swapfs_read(swap_entry_t entry, struct Page *page);
 int swapfs_write(swap_entry_t entry, struct Page *page);
+int swapfs_write_area(size_t offset, struct Page *page);
+int swapfs_read_pages(swap_entry_t entry, struct Page **pages, int n);
+void swapfs_write_pages(struct Page **pages, int n, swapfs_end_t end);
+void swapfs_write_wait(void);
+void swapfs_free(swap_entry_t entry);
+void swapfs_ready(void);
 
 #endif
 
@@ -0,0 +1,315 @@
+#include <types.h>
+#include <string.h>
+#include <list.h>
+#include <pmm.h>
+#include <slab.h>
+#include <sync.h>
+#include <sem.h>
+#include <fs.h>
+#include <lz4.h>
+#include <error.h>
+#include <assert.h>
+#include <kio.h>
+#include <swapfs.h>
+#include <zswap.h>
+
+#ifdef UCONFIG_ZSWAP
+
+/*
+ * zswap keeps the pages swapfs writes compressed in memory, in front of
+ * the swap device: a page that compresses to ZSWAP_MAX_BYTES at most goes
+ * to an obj of the smallest size class of zswap_classes that holds it, the
+ * others to the device. The copy stays until the slot is freed or written
+ * again, so that a page swapped in and out clean costs nothing.
+ *
+ * The objs take up to 1/ZSWAP_POOL_RATIO of the pages free at boot. When
+ * they are all taken, the oldest slots are written back to the device; a
+ * slot being written back is still read from zswap until it is there.
+ *
+ * The stores and the write backs come from the writes of swapfs, that is
+ * kswapd, and are serialized by zswap_sem; the map, the lru and the
+ * counters are under zswap_lock, as the loads and the slots freed come
+ * from any process.
+ */
+
+#define ZSWAP_POOL_RATIO                8
+#define ZSWAP_MAX_BYTES                 (PGSIZE * 3 / 4)
+
+static const size_t zswap_classes[] = {
+	256, 512, 768, 1024, 1536, 2048, 3072
+};
+
+static const char *zswap_class_names[] = {
+	"zswap-256", "zswap-512", "zswap-768", "zswap-1024", "zswap-1536",
+	"zswap-2048", "zswap-3072"
+};
+
+#define ZSWAP_NR_CLASSES                (sizeof(zswap_classes) / sizeof(size_t))
+
+struct zswap_entry {
+	list_entry_t lru_link;	/* oldest first, not while written back */
+	size_t offset;
+	uint16_t length;
+	uint8_t class;
+	bool writeback;
+	bool dead;		/* freed while written back */
+	void *data;
+};
+
+#define le2zentry(le, member)           to_struct((le), struct zswap_entry, member)
+
+static bool zswap_enabled = 0;
+static struct zswap_entry **zswap_map;	/* by the offset of the slot */
+static list_entry_t zswap_lru;
+static kmem_cache_t *zswap_entry_cachep;
+static kmem_cache_t *zswap_cachep[ZSWAP_NR_CLASSES];
+static spinlock_s zswap_lock;
+static struct zswap_stat zswap_stat;
+
+/* under zswap_sem */
+static semaphore_t zswap_sem;
+static void *zswap_buf;		/* ZSWAP_MAX_BYTES, for the compressor */
+static void *zswap_table;	/* LZ4_TABLE_SIZE */
+static struct Page *zswap_wb_page;
+
+// zswap_free_entry - give back the objs of entry, with zswap_lock held
+static void zswap_free_entry(struct zswap_entry *entry)
+{
+	zswap_stat.stored_pages--;
+	zswap_stat.stored_bytes -= entry->length;
+	zswap_stat.pool_bytes -= zswap_classes[entry->class];
+	kmem_cache_free(zswap_cachep[entry->class], entry->data);
+	kmem_cache_free(zswap_entry_cachep, entry);
+}
+
+// zswap_drop - forget the copy of the slot at offset, with zswap_lock held
+static void zswap_drop(size_t offset)
+{
+	struct zswap_entry *entry;
+	if ((entry = zswap_map[offset]) == NULL) {
+		return;
+	}
+	zswap_map[offset] = NULL;
+	if (entry->writeback) {
+		/* zswap_writeback frees it */
+		entry->dead = 1;
+		return;
+	}
+	list_del(&(entry->lru_link));
+	zswap_free_entry(entry);
+}
+
+/*
+ * zswap_writeback - write the oldest slot back to the device, with
+ * zswap_sem held. Returns 0 if its objs are free again.
+ */
+static int zswap_writeback(void)
+{
+	struct zswap_entry *entry;
+	bool intr_flag;
+	int ret = 0;
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	if (list_empty(&zswap_lru)) {
+		spin_unlock_irqrestore(&zswap_lock, intr_flag);
+		return -E_NO_MEM;
+	}
+	entry = le2zentry(list_next(&zswap_lru), lru_link);
+	list_del(&(entry->lru_link));
+	entry->writeback = 1;
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+
+	/* only this frees it now, nor does anyone change its data */
+	if (!entry->dead) {
+		void *kva = page2kva(zswap_wb_page);
+		if (lz4_decompress(entry->data, entry->length, kva, PGSIZE) != PGSIZE) {
+			ret = -E_SWAP_FAULT;
+		} else {
+			ret = swapfs_write_area(entry->offset, zswap_wb_page);
+		}
+	}
+
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	entry->writeback = 0;
+	if (entry->dead) {
+		zswap_free_entry(entry);
+		ret = 0;
+	} else if (ret == 0) {
+		zswap_map[entry->offset] = NULL;
+		zswap_free_entry(entry);
+		zswap_stat.evictions++;
+	} else {
+		list_add(&zswap_lru, &(entry->lru_link));
+	}
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+	return ret;
+}
+
+/*
+ * zswap_store - keep a compressed copy of page for the slot at offset.
+ * Returns -E_NO_MEM if it does not compress well enough or there is no
+ * room for it; the slot has to be written to the device then.
+ */
+int zswap_store(size_t offset, struct Page *page)
+{
+	if (!zswap_enabled) {
+		return -E_INVAL;
+	}
+	struct zswap_entry *entry = NULL;
+	void *data = NULL;
+	size_t len, class;
+	bool intr_flag;
+	int ret = -E_NO_MEM;
+
+	down(&zswap_sem);
+	len = lz4_compress(page2kva(page), PGSIZE, zswap_buf, ZSWAP_MAX_BYTES,
+			   zswap_table);
+	for (class = 0; class < ZSWAP_NR_CLASSES; class++) {
+		if (len <= zswap_classes[class]) {
+			break;
+		}
+	}
+	if (len != 0 && class < ZSWAP_NR_CLASSES) {
+		while (zswap_stat.pool_bytes + zswap_classes[class] >
+		       zswap_stat.pool_limit) {
+			if (zswap_writeback() != 0) {
+				break;
+			}
+		}
+		if (zswap_stat.pool_bytes + zswap_classes[class] <=
+		    zswap_stat.pool_limit
+		    && (entry = kmem_cache_alloc(zswap_entry_cachep)) != NULL
+		    && (data = kmem_cache_alloc(zswap_cachep[class])) != NULL) {
+			memcpy(data, zswap_buf, len);
+			entry->offset = offset, entry->length = len;
+			entry->class = class, entry->data = data;
+			entry->writeback = entry->dead = 0;
+			ret = 0;
+		}
+	}
+
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	/* the old copy is stale either way */
+	zswap_drop(offset);
+	if (ret == 0) {
+		zswap_map[offset] = entry;
+		list_add_before(&zswap_lru, &(entry->lru_link));
+		zswap_stat.stores++, zswap_stat.stored_pages++;
+		zswap_stat.stored_bytes += len;
+		zswap_stat.pool_bytes += zswap_classes[class];
+	} else {
+		zswap_stat.rejects++;
+	}
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+	up(&zswap_sem);
+
+	if (ret != 0 && entry != NULL) {
+		kmem_cache_free(zswap_entry_cachep, entry);
+	}
+	return ret;
+}
+
+/*
+ * zswap_load - read the slot at offset into page from its compressed copy.
+ * Returns -E_NOENT if there is none.
+ */
+int zswap_load(size_t offset, struct Page *page)
+{
+	if (!zswap_enabled) {
+		return -E_NOENT;
+	}
+	struct zswap_entry *entry;
+	bool intr_flag;
+	int ret = 0;
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	if ((entry = zswap_map[offset]) == NULL) {
+		zswap_stat.misses++;
+		ret = -E_NOENT;
+	} else {
+		zswap_stat.loads++;
+		if (lz4_decompress(entry->data, entry->length, page2kva(page),
+				   PGSIZE) != PGSIZE) {
+			ret = -E_SWAP_FAULT;
+		}
+	}
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+	return ret;
+}
+
+// zswap_contains - the slot at offset has a compressed copy, as a hint
+bool zswap_contains(size_t offset)
+{
+	return zswap_enabled && zswap_map[offset] != NULL;
+}
+
+// zswap_invalidate - forget the copy of the slot at offset, which is freed
+void zswap_invalidate(size_t offset)
+{
+	if (!zswap_enabled) {
+		return;
+	}
+	bool intr_flag;
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	zswap_drop(offset);
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+}
+
+void zswap_stat_get(struct zswap_stat *stat)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&zswap_lock, intr_flag);
+	*stat = zswap_stat;
+	spin_unlock_irqrestore(&zswap_lock, intr_flag);
+}
+
+// zswap_print_stat - the compression ratio and the hits of zswap
+void zswap_print_stat(void)
+{
+	struct zswap_stat stat;
+	zswap_stat_get(&stat);
+	kprintf("zswap: %d pages in %d KB of %d KB, ratio %d%%.\n",
+		(int)stat.stored_pages, (int)(stat.pool_bytes / 1024),
+		(int)(stat.pool_limit / 1024),
+		(stat.stored_bytes == 0) ? 0 :
+		(int)(stat.stored_pages * PGSIZE * 100 / stat.stored_bytes));
+	kprintf("zswap: %d stores, %d rejects, %d evictions, %d/%d loads hit.\n",
+		(int)stat.stores, (int)stat.rejects, (int)stat.evictions,
+		(int)stat.loads, (int)(stat.loads + stat.misses));
+}
+
+// zswap_init - set up zswap for the nslots slots of the swap device
+void zswap_init(size_t nslots)
+{
+	size_t i;
+	static_assert(ZSWAP_MAX_BYTES <= 3072 && PGSIZE <= LZ4_MAX_INPUT);
+	if ((zswap_map = kmalloc(sizeof(struct zswap_entry *) * nslots)) == NULL
+	    || (zswap_buf = kmalloc(ZSWAP_MAX_BYTES)) == NULL
+	    || (zswap_table = kmalloc(LZ4_TABLE_SIZE)) == NULL
+	    || (zswap_wb_page = alloc_page()) == NULL) {
+		panic("zswap: no memory.\n");
+	}
+	memset(zswap_map, 0, sizeof(struct zswap_entry *) * nslots);
+	zswap_entry_cachep = kmem_cache_create("zswap_entry",
+					       sizeof(struct zswap_entry), 0,
+					       NULL);
+	assert(zswap_entry_cachep != NULL);
+	for (i = 0; i < ZSWAP_NR_CLASSES; i++) {
+		zswap_cachep[i] = kmem_cache_create(zswap_class_names[i],
+						    zswap_classes[i], 0, NULL);
+		assert(zswap_cachep[i] != NULL);
+	}
+	list_init(&zswap_lru);
+	spinlock_init(&zswap_lock);
+	sem_init(&zswap_sem, 1);
+	memset(&zswap_stat, 0, sizeof(zswap_stat));
+	zswap_stat.pool_limit = nr_free_pages() / ZSWAP_POOL_RATIO * PGSIZE;
+}
+
+// zswap_enable - start taking the writes of swapfs, once swap is checked
+void zswap_enable(void)
+{
+	zswap_enabled = 1;
+	kprintf("zswap: up to %d KB of compressed pages.\n",
+		(int)(zswap_stat.pool_limit / 1024));
+}
+
+#endif /* UCONFIG_ZSWAP */
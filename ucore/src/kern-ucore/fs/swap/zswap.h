@@ -0,0 +1,33 @@
+#ifndef __KERN_FS_SWAP_ZSWAP_H__
+#define __KERN_FS_SWAP_ZSWAP_H__
+
+#include <types.h>
+#include <memlayout.h>
+
+#ifdef UCONFIG_ZSWAP
+
+/* the counters of zswap, the ratio is stored_pages * PGSIZE : stored_bytes */
+struct zswap_stat {
+	size_t stored_pages;	/* the slots kept compressed */
+	size_t stored_bytes;	/* their compressed bytes */
+	size_t pool_bytes;	/* the bytes of the objs that hold them */
+	size_t pool_limit;
+	size_t stores;
+	size_t rejects;		/* not compressible or no room, to the device */
+	size_t loads;		/* the reads of swapfs it served */
+	size_t misses;		/* the reads that went to the device */
+	size_t evictions;	/* the slots written back to make room */
+};
+
+void zswap_init(size_t nslots);
+void zswap_enable(void);
+int zswap_store(size_t offset, struct Page *page);
+int zswap_load(size_t offset, struct Page *page);
+bool zswap_contains(size_t offset);
+void zswap_invalidate(size_t offset);
+void zswap_stat_get(struct zswap_stat *stat);
+void zswap_print_stat(void);
+
+#endif /* UCONFIG_ZSWAP */
+
+#endif /* !__KERN_FS_SWAP_ZSWAP_H__ */
@@ -1,6 +1,7 @@
 #include <types.h>
 #include <string.h>
 #include <slab.h>
+#include <pmm.h>
 #include <vmm.h>
 #include <proc.h>
 #include <vfs.h>
@@ -9,11 +10,20 @@
 #include <sysfile.h>
 #include <stat.h>
 #include <dirent.h>
+#include <epoll.h>
+#include <socket.h>
+#include <uringbuf.h>
 #include <unistd.h>
 #include <error.h>
 #include <assert.h>
 
 #define IOBUF_SIZE                          4096
+/* user pages pinned by one round of sysfile_pinned_io */
+#define UIO_MAX_PAGES                       16
+/* buffers of one readv or writev */
+#define UIO_MAX_IOV                         1024
+/* events reported by one epoll_wait */
+#define EPOLL_MAX_EVENTS                    256
 
 static int copy_path(char **to, const char *from)
 {
@@ -22,12 +32,12 @@ static int copy_path(char **to, const char *from)
 	if ((buffer = kmalloc(FS_MAX_FPATH_LEN + 1)) == NULL) {
 		return -E_NO_MEM;
 	}
-	lock_mm(mm);
+	lock_mm_shared(mm);
 	if (!copy_string(mm, buffer, from, FS_MAX_FPATH_LEN + 1)) {
-		unlock_mm(mm);
+		unlock_mm_shared(mm);
 		goto failed_cleanup;
 	}
-	unlock_mm(mm);
+	unlock_mm_shared(mm);
 	*to = buffer;
 	return 0;
 
@@ -36,6 +46,228 @@ failed_cleanup:
 	return -E_INVAL;
 }
 
+// sysfile_pinned_io - move data between fd at pos and the user segments of
+//                   - uio through the kernel addresses of their pinned
+//                   - pages, one vectored request without the bounce
+//                   - buffer; -E_UNIMP if the inode of fd or the pages of
+//                   - the first segment do not allow it. uio is not moved
+static int
+sysfile_pinned_io(struct mm_struct *mm, int fd, struct iobuf *uio, off_t pos,
+		  bool write, size_t * copied_store)
+{
+	struct Page *pages[UIO_MAX_PAGES];
+	struct iovec iov[UIO_MAX_PAGES];
+	struct iobuf __u = *uio, *u = &__u;
+	int npages = 0, iovcnt = 0, i, ret;
+	*copied_store = 0;
+	if (!file_vectored(fd, write)) {
+		return -E_UNIMP;
+	}
+	lock_mm_shared(mm);
+	while (u->io_resid != 0 && npages < UIO_MAX_PAGES) {
+		uintptr_t base = (uintptr_t) u->io_base;
+		size_t off = PGOFF(base), seg = iobuf_seg(u), len = seg;
+		int room = UIO_MAX_PAGES - npages, n;
+		if (len > room * PGSIZE - off) {
+			len = room * PGSIZE - off;
+		}
+		/* a read stores to the user pages */
+		n = get_user_pages(mm, base, len, !write, pages + npages, room);
+		if (n == 0) {
+			break;
+		}
+		if (len > n * PGSIZE - off) {
+			len = n * PGSIZE - off;
+		}
+		size_t resid = len;
+		for (i = npages; i < npages + n; i++, off = 0) {
+			char *kva = (char *)page2kva(pages[i]) + off;
+			size_t size = PGSIZE - off;
+			if (size > resid) {
+				size = resid;
+			}
+			/* physically adjacent pages make one segment */
+			if (iovcnt != 0
+			    && iov[iovcnt - 1].iov_base +
+			    iov[iovcnt - 1].iov_len == kva) {
+				iov[iovcnt - 1].iov_len += size;
+			} else {
+				iov[iovcnt].iov_base = kva;
+				iov[iovcnt++].iov_len = size;
+			}
+			resid -= size;
+		}
+		npages += n;
+		iobuf_skip(u, len);
+		/* the rest of a segment not all mapped goes another way */
+		if (len < seg) {
+			break;
+		}
+	}
+	unlock_mm_shared(mm);
+	if (npages == 0) {
+		return -E_UNIMP;
+	}
+	if (write) {
+		ret = file_writev(fd, iov, iovcnt, pos, copied_store);
+	} else {
+		ret = file_readv(fd, iov, iovcnt, pos, copied_store);
+	}
+	put_user_pages(pages, npages, !write);
+	return ret;
+}
+
+// sysfile_uio_copy - copy len bytes between buffer and the user segments of
+//                  - uio from where it is, without moving it
+static bool
+sysfile_uio_copy(struct mm_struct *mm, struct iobuf *uio, void *buffer,
+		 size_t len, bool to_user)
+{
+	struct iobuf __u = *uio, *u = &__u;
+	bool ok = 1;
+	lock_mm_uaccess(mm);
+	while (ok && len != 0) {
+		size_t n = iobuf_seg(u);
+		if (n > len) {
+			n = len;
+		}
+		ok = to_user ? copy_to_user(mm, u->io_base, buffer, n)
+		    : copy_from_user(mm, buffer, u->io_base, n, 0);
+		iobuf_skip(u, n), buffer += n, len -= n;
+	}
+	unlock_mm_uaccess(mm);
+	return ok;
+}
+
+// sysfile_io - move data between fd at pos, FILE_POS_CUR for the position
+//            - of fd, and the user segments of uio: straight through their
+//            - pinned pages if it may, else through the bounce buffer,
+//            - which gathers several small segments for one request
+static int sysfile_io(int fd, struct iobuf *uio, off_t pos, bool write)
+{
+	struct mm_struct *mm = current->mm;
+	size_t copied = 0, alen;
+	int ret;
+	while (uio->io_resid != 0
+	       && (ret =
+		   sysfile_pinned_io(mm, fd, uio, pos, write,
+				     &alen)) != -E_UNIMP) {
+		iobuf_skip(uio, alen), copied += alen;
+		if (pos != FILE_POS_CUR) {
+			pos += alen;
+		}
+		if (ret != 0 || alen == 0) {
+			goto out_copied;
+		}
+	}
+	ret = 0;
+	if (uio->io_resid == 0) {
+		goto out_copied;
+	}
+
+	void *buffer;
+	if ((buffer = kmalloc(IOBUF_SIZE)) == NULL) {
+		ret = -E_NO_MEM;
+		goto out_copied;
+	}
+
+	while (uio->io_resid != 0) {
+		if ((alen = IOBUF_SIZE) > uio->io_resid) {
+			alen = uio->io_resid;
+		}
+		if (write) {
+			if (!sysfile_uio_copy(mm, uio, buffer, alen, 0)) {
+				ret = -E_INVAL, alen = 0;
+			} else {
+				ret = file_pwrite(fd, buffer, alen, pos, &alen);
+			}
+		} else {
+			ret = file_pread(fd, buffer, alen, pos, &alen);
+			if (alen != 0
+			    && !sysfile_uio_copy(mm, uio, buffer, alen, 1)) {
+				if (ret == 0) {
+					ret = -E_INVAL;
+				}
+				alen = 0;
+			}
+		}
+		iobuf_skip(uio, alen), copied += alen;
+		if (pos != FILE_POS_CUR) {
+			pos += alen;
+		}
+		if (ret != 0 || alen == 0) {
+			break;
+		}
+	}
+	kfree(buffer);
+out_copied:
+	if (copied != 0) {
+		return copied;
+	}
+	return ret;
+}
+
+// sysfile_vectored - move data between fd at pos and the iovcnt user
+//                  - buffers of __iov, in as few requests as their pages
+//                  - allow; pos is FILE_POS_CUR for the position of fd
+static int
+sysfile_vectored(int fd, struct iovec __user * __iov, int iovcnt, off_t pos,
+		 bool write)
+{
+	struct mm_struct *mm = current->mm;
+	struct iovec *iov;
+	struct iobuf __uio, *uio = &__uio;
+	size_t len = 0;
+	int ret, i;
+	if (iovcnt <= 0 || iovcnt > UIO_MAX_IOV) {
+		return -E_INVAL;
+	}
+	if (!file_testfd(fd, !write, write)) {
+		return -E_INVAL;
+	}
+	if ((iov = kmalloc(sizeof(struct iovec) * iovcnt)) == NULL) {
+		return -E_NO_MEM;
+	}
+	lock_mm_shared(mm);
+	ret = copy_from_user(mm, iov, __iov, sizeof(struct iovec) * iovcnt, 0);
+	unlock_mm_shared(mm);
+	if (!ret) {
+		ret = -E_INVAL;
+		goto out;
+	}
+	for (i = 0; i < iovcnt; i++) {
+		/* the total is returned as an int */
+		if ((len += iov[i].iov_len) > 0x7fffffff) {
+			ret = -E_INVAL;
+			goto out;
+		}
+	}
+	ret = 0;
+	if (len == 0) {
+		goto out;
+	}
+	if (__is_linux_devfile(fd)) {
+		/* for linux inode, a buffer at a time from its position */
+		size_t copied = 0;
+		for (i = 0; pos == FILE_POS_CUR && i < iovcnt; i++) {
+			void *base = iov[i].iov_base;
+			size_t n = iov[i].iov_len;
+			ret = write ? sysfile_write(fd, base, n)
+			    : sysfile_read(fd, base, n);
+			if (ret < 0 || (copied += ret, ret < n)) {
+				break;
+			}
+		}
+		ret = (pos != FILE_POS_CUR) ? -E_INVAL
+		    : (copied != 0) ? copied : ret;
+		goto out;
+	}
+	ret = sysfile_io(fd, iobuf_init_vec(uio, iov, iovcnt, 0), pos, write);
+out:
+	kfree(iov);
+	return ret;
+}
+
 int sysfile_open(const char *__path, uint32_t open_flags)
 {
 	int ret;
@@ -56,7 +288,6 @@ int sysfile_close(int fd)
 int sysfile_read(int fd, void *base, size_t len)
 {
 	int ret = 0;
-	struct mm_struct *mm = current->mm;
 	if (len == 0) {
 		return 0;
 	}
@@ -71,47 +302,12 @@ int sysfile_read(int fd, void *base, size_t len)
 			return ret;
 		return alen;
 	}
-	void *buffer;
-	if ((buffer = kmalloc(IOBUF_SIZE)) == NULL) {
-		return -E_NO_MEM;
-	}
-
-	size_t copied = 0, alen;
-	while (len != 0) {
-		if ((alen = IOBUF_SIZE) > len) {
-			alen = len;
-		}
-		ret = file_read(fd, buffer, alen, &alen);
-		if (alen != 0) {
-			lock_mm(mm);
-			{
-				if (copy_to_user(mm, base, buffer, alen)) {
-					assert(len >= alen);
-					base += alen, len -= alen, copied +=
-					    alen;
-				} else if (ret == 0) {
-					ret = -E_INVAL;
-				}
-			}
-			unlock_mm(mm);
-		}
-		if (ret != 0 || alen == 0) {
-			goto out;
-		}
-	}
-
-out:
-	kfree(buffer);
-	if (copied != 0) {
-		return copied;
-	}
-	return ret;
+	return sysfile_pread(fd, base, len, FILE_POS_CUR);
 }
 
 int sysfile_write(int fd, void *base, size_t len)
 {
 	int ret = 0;
-	struct mm_struct *mm = current->mm;
 	if (len == 0) {
 		return 0;
 	}
@@ -128,67 +324,56 @@ int sysfile_write(int fd, void *base, size_t len)
 			return ret;
 		return alen;
 	}
-	void *buffer;
-	if ((buffer = kmalloc(IOBUF_SIZE)) == NULL) {
-		return -E_NO_MEM;
-	}
+	return sysfile_pwrite(fd, base, len, FILE_POS_CUR);
+}
 
-	size_t copied = 0, alen;
-	while (len != 0) {
-		if ((alen = IOBUF_SIZE) > len) {
-			alen = len;
-		}
-		lock_mm(mm);
-		{
-			if (!copy_from_user(mm, buffer, base, alen, 0)) {
-				ret = -E_INVAL;
-			}
-		}
-		unlock_mm(mm);
-		if (ret == 0) {
-			ret = file_write(fd, buffer, alen, &alen);
-			if (alen != 0) {
-				assert(len >= alen);
-				base += alen, len -= alen, copied += alen;
-			}
-		}
-		if (ret != 0 || alen == 0) {
-			goto out;
-		}
+// sysfile_pread - read at pos, the position of fd left as it is
+int sysfile_pread(int fd, void *base, size_t len, off_t pos)
+{
+	struct iovec iov = {.iov_base = base,.iov_len = len };
+	struct iobuf __uio, *uio = &__uio;
+	if (len == 0) {
+		return 0;
+	}
+	if (!file_testfd(fd, 1, 0)) {
+		return -E_INVAL;
 	}
+	return sysfile_io(fd, iobuf_init_vec(uio, &iov, 1, 0), pos, 0);
+}
 
-out:
-	kfree(buffer);
-	if (copied != 0) {
-		return copied;
+int sysfile_pwrite(int fd, void *base, size_t len, off_t pos)
+{
+	struct iovec iov = {.iov_base = base,.iov_len = len };
+	struct iobuf __uio, *uio = &__uio;
+	if (len == 0) {
+		return 0;
 	}
-	return ret;
+	if (!file_testfd(fd, 0, 1)) {
+		return -E_INVAL;
+	}
+	return sysfile_io(fd, iobuf_init_vec(uio, &iov, 1, 0), pos, 1);
+}
+
+int sysfile_readv(int fd, struct iovec __user * iov, int iovcnt)
+{
+	return sysfile_vectored(fd, iov, iovcnt, FILE_POS_CUR, 0);
 }
 
 int sysfile_writev(int fd, struct iovec __user * iov, int iovcnt)
 {
-	/* do nothing but return 0 */
-	kprintf("writev: fd=%08x iov=%08x iovcnt=%d\n", fd, iov, iovcnt);
-	struct iovec *tv;
-	int rcode = 0, count = 0, i;
-	struct mm_struct *mm = current->mm;
-	for (i = 0; i < iovcnt; ++i) {
-		char *pbase;
-		size_t plen;
+	return sysfile_vectored(fd, iov, iovcnt, FILE_POS_CUR, 1);
+}
 
-		copy_from_user(mm, &pbase, &(iov[i].iov_base), sizeof(char *),
-			       0);
-		copy_from_user(mm, &plen, &(iov[i].iov_len), sizeof(size_t), 0);
+// sysfile_preadv - readv at pos, or at the position of fd if pos is
+//                - FILE_POS_CUR; the buffers reach the inode as one request
+int sysfile_preadv(int fd, struct iovec __user * iov, int iovcnt, off_t pos)
+{
+	return sysfile_vectored(fd, iov, iovcnt, pos, 0);
+}
 
-		rcode = sysfile_write(fd, pbase, plen);
-		if (rcode < 0)
-			break;
-		count += rcode;
-	}
-	if (count == 0)
-		return (rcode);
-	else
-		return (count);
+int sysfile_pwritev(int fd, struct iovec __user * iov, int iovcnt, off_t pos)
+{
+	return sysfile_vectored(fd, iov, iovcnt, pos, 1);
 }
 
 int sysfile_seek(int fd, off_t pos, int whence)
@@ -205,13 +390,13 @@ int sysfile_fstat(int fd, struct stat *__stat)
 		return ret;
 	}
 
-	lock_mm(mm);
+	lock_mm_uaccess(mm);
 	{
 		if (!copy_to_user(mm, __stat, stat, sizeof(struct stat))) {
 			ret = -E_INVAL;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_uaccess(mm);
 	return ret;
 }
 
@@ -237,13 +422,13 @@ int sysfile_linux_fstat(int fd, struct linux_stat __user * buf)
 	kls->st_size = kstat->st_size;
 
 	ret = 0;
-	lock_mm(mm);
+	lock_mm_uaccess(mm);
 	{
 		if (!copy_to_user(mm, buf, kls, sizeof(struct linux_stat))) {
 			ret = -1;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_uaccess(mm);
 	kfree(kls);
 	return ret;
 }
@@ -270,19 +455,304 @@ int sysfile_linux_fstat64(int fd, struct linux_stat64 __user * buf)
 	kls->st_size = kstat->st_size;
 
 	ret = 0;
-	lock_mm(mm);
+	lock_mm_uaccess(mm);
 	{
 		if (!copy_to_user(mm, buf, kls, sizeof(struct linux_stat64))) {
 			ret = -1;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_uaccess(mm);
 	kfree(kls);
 	return ret;
 }
 
+int sysfile_fcntl(int fd, int cmd, int arg)
+{
+	return file_fcntl(fd, cmd, arg);
+}
+
+// sysfile_splice - splice or tee up to len bytes, see file_splice; returns
+//                - the # of bytes moved
+int sysfile_splice(int fd_in, int fd_out, size_t len, bool tee)
+{
+	size_t copied;
+	if (len == 0) {
+		return 0;
+	}
+	int ret = file_splice(fd_in, fd_out, len, tee, &copied);
+	return (copied != 0) ? copied : ret;
+}
+
+// copy_offset - the offset at __off of the user, or write it back
+static bool copy_offset(off_t * off, off_t * __off, bool write)
+{
+	struct mm_struct *mm = current->mm;
+	bool ret;
+	lock_mm_uaccess(mm);
+	ret = write ? copy_to_user(mm, __off, off, sizeof(off_t)) :
+	    copy_from_user(mm, off, __off, sizeof(off_t), 0);
+	unlock_mm_uaccess(mm);
+	return ret;
+}
+
+// sysfile_copy_file_range - copy up to len bytes of fd_in to fd_out, at
+//                         - the offsets of the user or at the positions
+//                         - of the files, see file_copy_range; returns the
+//                         - # of bytes copied. sendfile is the one with
+//                         - no offset for fd_out
+int
+sysfile_copy_file_range(int fd_in, off_t * __off_in, int fd_out,
+			off_t * __off_out, size_t len)
+{
+	off_t off_in, off_out;
+	size_t copied;
+	if ((__off_in != NULL && !copy_offset(&off_in, __off_in, 0))
+	    || (__off_out != NULL && !copy_offset(&off_out, __off_out, 0))) {
+		return -E_INVAL;
+	}
+	if (len == 0) {
+		return 0;
+	}
+	int ret = file_copy_range(fd_in, (__off_in != NULL) ? &off_in : NULL,
+				  fd_out, (__off_out != NULL) ? &off_out : NULL,
+				  len, &copied);
+	if ((__off_in != NULL && !copy_offset(&off_in, __off_in, 1))
+	    || (__off_out != NULL && !copy_offset(&off_out, __off_out, 1))) {
+		return -E_INVAL;
+	}
+	return (copied != 0) ? copied : ret;
+}
+
+int sysfile_epoll_create(void)
+{
+	return file_epoll_create();
+}
+
+int
+sysfile_epoll_ctl(int epfd, int op, int type, int id,
+		  struct epoll_event *__event)
+{
+	struct mm_struct *mm = current->mm;
+	struct epoll_event event = { 0 };
+	if (op != EPOLL_CTL_DEL) {
+		lock_mm_shared(mm);
+		if (!copy_from_user
+		    (mm, &event, __event, sizeof(struct epoll_event), 0)) {
+			unlock_mm_shared(mm);
+			return -E_INVAL;
+		}
+		unlock_mm_shared(mm);
+	}
+	return file_epoll_ctl(epfd, op, type, id, &event);
+}
+
+// sysfile_epoll_wait - wait for up to maxevents ready sources of epfd, at
+//                    - most EPOLL_MAX_EVENTS of them are reported at once
+int
+sysfile_epoll_wait(int epfd, struct epoll_event *__events, int maxevents,
+		   unsigned int timeout)
+{
+	struct mm_struct *mm = current->mm;
+	struct epoll_event *events;
+	int ret;
+	if (maxevents <= 0) {
+		return -E_INVAL;
+	}
+	if (maxevents > EPOLL_MAX_EVENTS) {
+		maxevents = EPOLL_MAX_EVENTS;
+	}
+	size_t len = maxevents * sizeof(struct epoll_event);
+	if (!user_mem_check(mm, (uintptr_t) __events, len, 1)) {
+		return -E_INVAL;
+	}
+	if ((events = kmalloc(len)) == NULL) {
+		return -E_NO_MEM;
+	}
+	if ((ret = file_epoll_wait(epfd, events, maxevents, timeout)) > 0) {
+		lock_mm_shared(mm);
+		if (!copy_to_user
+		    (mm, __events, events, ret * sizeof(struct epoll_event))) {
+			ret = -E_INVAL;
+		}
+		unlock_mm_shared(mm);
+	}
+	kfree(events);
+	return ret;
+}
+
+#ifdef UCONFIG_NET
+int sysfile_socket(int domain, int type, int protocol)
+{
+	if (domain != AF_INET || type != SOCK_STREAM
+	    || (protocol != 0 && protocol != IPPROTO_TCP)) {
+		return -E_INVAL;
+	}
+	return file_socket();
+}
+
+// copy_sockaddr - the address and port, in host order, of the user's addr
+static bool
+copy_sockaddr(const struct sockaddr_in *__addr, uint32_t * addr_store,
+	      uint16_t * port_store)
+{
+	struct mm_struct *mm = current->mm;
+	struct sockaddr_in addr;
+	lock_mm_shared(mm);
+	if (!copy_from_user(mm, &addr, __addr, sizeof(addr), 0)) {
+		unlock_mm_shared(mm);
+		return 0;
+	}
+	unlock_mm_shared(mm);
+	if (addr.sin_family != AF_INET) {
+		return 0;
+	}
+	*addr_store = ntohl(addr.sin_addr), *port_store = ntohs(addr.sin_port);
+	return 1;
+}
+
+int sysfile_bind(int fd, const struct sockaddr_in *__addr)
+{
+	uint32_t addr;
+	uint16_t port;
+	if (!copy_sockaddr(__addr, &addr, &port)) {
+		return -E_INVAL;
+	}
+	return file_bind(fd, addr, port);
+}
+
+int sysfile_listen(int fd, int backlog)
+{
+	return file_listen(fd, backlog);
+}
+
+// sysfile_accept - an fd for the next connection to fd, its peer stored in
+//                - __addr unless NULL
+int sysfile_accept(int fd, struct sockaddr_in *__addr)
+{
+	struct mm_struct *mm = current->mm;
+	struct sockaddr_in addr = { 0 };
+	uint32_t peer;
+	uint16_t port;
+	int ret;
+	if (__addr != NULL
+	    && !user_mem_check(mm, (uintptr_t) __addr, sizeof(addr), 1)) {
+		return -E_INVAL;
+	}
+	if ((ret = file_accept(fd, &peer, &port)) < 0 || __addr == NULL) {
+		return ret;
+	}
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port), addr.sin_addr = htonl(peer);
+	lock_mm_shared(mm);
+	if (!copy_to_user(mm, __addr, &addr, sizeof(addr))) {
+		unlock_mm_shared(mm);
+		file_close(ret);
+		return -E_INVAL;
+	}
+	unlock_mm_shared(mm);
+	return ret;
+}
+
+int sysfile_connect(int fd, const struct sockaddr_in *__addr)
+{
+	uint32_t addr;
+	uint16_t port;
+	if (!copy_sockaddr(__addr, &addr, &port)) {
+		return -E_INVAL;
+	}
+	return file_connect(fd, addr, port);
+}
+#endif
+
+// uring_issue - run one submission entry the way its syscall would
+static int uring_issue(struct uring_sqe *sqe)
+{
+	off_t pos;
+	switch (sqe->opcode) {
+	case URING_OP_NOP:
+		return 0;
+	case URING_OP_READ:
+	case URING_OP_WRITE:
+		/* an offset given leaves the position of fd alone */
+		pos = (sqe->off == URING_OFF_CUR) ? FILE_POS_CUR : sqe->off;
+		if (sqe->opcode == URING_OP_READ) {
+			return (pos == FILE_POS_CUR)
+			    ? sysfile_read(sqe->fd, (void *)sqe->addr, sqe->len)
+			    : sysfile_pread(sqe->fd, (void *)sqe->addr,
+					    sqe->len, pos);
+		}
+		return (pos == FILE_POS_CUR)
+		    ? sysfile_write(sqe->fd, (void *)sqe->addr, sqe->len)
+		    : sysfile_pwrite(sqe->fd, (void *)sqe->addr, sqe->len, pos);
+	case URING_OP_FSYNC:
+		return sysfile_fsync(sqe->fd);
+	case URING_OP_OPEN:
+		return sysfile_open((const char *)sqe->addr, sqe->open_flags);
+	case URING_OP_CLOSE:
+		return sysfile_close(sqe->fd);
+	}
+	return -E_INVAL;
+}
+
+// sysfile_uring_enter - run up to to_submit queued entries of the ring at
+//                     - __state in order, posting a completion for each;
+//                     - stops early when the completion ring is full.
+//                     - returns the # of entries run
+int sysfile_uring_enter(struct uring_state *__state, unsigned int to_submit)
+{
+	struct mm_struct *mm = current->mm;
+	struct uring_state state;
+	lock_mm_shared(mm);
+	if (!copy_from_user(mm, &state, __state, sizeof(state), 1)) {
+		unlock_mm_shared(mm);
+		return -E_INVAL;
+	}
+	unlock_mm_shared(mm);
+	uint32_t n = state.entries;
+	if (n == 0 || n > URING_MAX_ENTRIES || (n & (n - 1)) != 0
+	    || !user_mem_check(mm, (uintptr_t) __state, URING_SIZE(n), 1)) {
+		return -E_INVAL;
+	}
+
+	struct uring_sqe *sqes = URING_SQES(__state);
+	struct uring_cqe *cqes = (struct uring_cqe *)(sqes + n);
+	uint32_t sq_head = state.sq_head, cq_tail = state.cq_tail;
+	int nr = 0;
+	while (nr < to_submit && sq_head != state.sq_tail
+	       && cq_tail - state.cq_head < 2 * n) {
+		struct uring_sqe sqe;
+		struct uring_cqe cqe;
+		lock_mm_shared(mm);
+		bool ok = copy_from_user(mm, &sqe, sqes + (sq_head & (n - 1)),
+					 sizeof(sqe), 0);
+		unlock_mm_shared(mm);
+		cqe.user_data = sqe.user_data;
+		cqe.res = ok ? uring_issue(&sqe) : -E_FAULT;
+		sq_head++, nr++;
+
+		lock_mm_shared(mm);
+		ok = copy_to_user(mm, cqes + (cq_tail & (2 * n - 1)), &cqe,
+				  sizeof(cqe));
+		if (ok) {
+			cq_tail++;
+			ok = copy_to_user(mm, (void *)&(__state->sq_head),
+					  &sq_head, sizeof(uint32_t))
+			    && copy_to_user(mm, (void *)&(__state->cq_tail),
+					    &cq_tail, sizeof(uint32_t));
+		}
+		unlock_mm_shared(mm);
+		if (!ok) {
+			return -E_FAULT;
+		}
+	}
+	return nr;
+}
+
 int sysfile_linux_fcntl64(int fd, int cmd, int arg)
 {
+	if (cmd == F_SETPIPE_SZ || cmd == F_GETPIPE_SZ) {
+		return sysfile_fcntl(fd, cmd, arg);
+	}
 	kprintf("sysfile_linux_fcntl64:fd=%08x cmd=%08x arg=%08x\n", fd, cmd,
 		arg);
 	return 0;
@@ -316,6 +786,11 @@ int sysfile_fsync(int fd)
 	return file_fsync(fd);
 }
 
+int sysfile_fallocate(int fd, int mode, off_t off, off_t len)
+{
+	return file_fallocate(fd, mode, off, len);
+}
+
 int sysfile_chdir(const char *__path)
 {
 	int ret;
@@ -391,7 +866,7 @@ int sysfile_getcwd(char *buf, size_t len)
 		return -E_INVAL;
 	}
 
-	lock_mm(mm);
+	lock_mm_shared(mm);
 	{
 		if (user_mem_check(mm, (uintptr_t) buf, len, 1)) {
 			struct iobuf __iob, *iob =
@@ -399,7 +874,7 @@ int sysfile_getcwd(char *buf, size_t len)
 			vfs_getcwd(iob);
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_shared(mm);
 	return 0;
 }
 
@@ -416,7 +891,7 @@ int sysfile_getdirentry(int fd, struct dirent *__direntp, uint32_t * len_store)
 	direntp->d_ino = 1;
 
 	int ret = 0;
-	lock_mm(mm);
+	lock_mm_shared(mm);
 	{
 		if (!copy_from_user
 		    (mm, &(direntp->d_off), &(__direntp->d_off),
@@ -424,20 +899,20 @@ int sysfile_getdirentry(int fd, struct dirent *__direntp, uint32_t * len_store)
 			ret = -E_INVAL;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_shared(mm);
 
 	if (ret != 0 || (ret = file_getdirentry(fd, direntp)) != 0) {
 		goto out;
 	}
 
-	lock_mm(mm);
+	lock_mm_shared(mm);
 	{
 		if (!copy_to_user
 		    (mm, __direntp, direntp, sizeof(struct dirent))) {
 			ret = -E_INVAL;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_shared(mm);
 	if (len_store) {
 		*len_store = (direntp->d_name[0]) ? direntp->d_reclen : 0;
 	}
@@ -446,6 +921,49 @@ out:
 	return ret;
 }
 
+// sysfile_getdents - fill buf with the dirent64 records of as many entries
+//                  - of the directory fd as fit in len, going on from the
+//                  - last call; # bytes filled, 0 at the end
+int sysfile_getdents(int fd, void *buf, size_t len)
+{
+	struct mm_struct *mm = current->mm;
+	size_t copied = 0, alen;
+	void *buffer;
+	int ret = 0;
+	if (!file_testfd(fd, 1, 0)) {
+		return -E_INVAL;
+	}
+	if ((buffer = kmalloc(IOBUF_SIZE)) == NULL) {
+		return -E_NO_MEM;
+	}
+	/* a page of records per round, copied out at once */
+	while (len != 0) {
+		if ((alen = IOBUF_SIZE) > len) {
+			alen = len;
+		}
+		ret = file_getdents(fd, buffer, alen, &alen);
+		if (alen != 0) {
+			lock_mm_uaccess(mm);
+			{
+				if (copy_to_user(mm, buf, buffer, alen)) {
+					buf += alen, len -= alen, copied += alen;
+				} else if (ret == 0) {
+					ret = -E_INVAL;
+				}
+			}
+			unlock_mm_uaccess(mm);
+		}
+		if (ret != 0 || alen == 0) {
+			break;
+		}
+	}
+	kfree(buffer);
+	if (copied != 0) {
+		return copied;
+	}
+	return ret;
+}
+
 #if 0
 int sysfile_linux_getdents(int fd, struct linux_dirent *__dir, uint32_t count)
 {
@@ -460,7 +978,7 @@ int sysfile_linux_getdents(int fd, struct linux_dirent *__dir, uint32_t count)
 	}
 	memset(dir, 0, sizeof(struct linux_dirent));
 
-	lock_mm(mm);
+	lock_mm_shared(mm);
 	{
 		if (!copy_from_user
 		    (mm, &(dir->d_off), &(__dir->d_off), sizeof(dir->d_off),
@@ -468,7 +986,7 @@ int sysfile_linux_getdents(int fd, struct linux_dirent *__dir, uint32_t count)
 			ret = -1;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_shared(mm);
 	direntp->offset = dir->d_off;
 
 	if (ret != 0 || (ret = file_getdirentry(fd, direntp)) != 0) {
@@ -480,13 +998,13 @@ int sysfile_linux_getdents(int fd, struct linux_dirent *__dir, uint32_t count)
 	dir->d_ino = 1;
 	strcpy(dir->d_name, direntp->name);
 
-	lock_mm(mm);
+	lock_mm_shared(mm);
 	{
 		if (!copy_to_user(mm, __dir, dir, sizeof(struct linux_dirent))) {
 			ret = -1;
 		}
 	}
-	unlock_mm(mm);
+	unlock_mm_shared(mm);
 	ret = dir->d_reclen;
 	/* done */
 	if (!dir->d_name[0])
@@ -512,13 +1030,13 @@ int sysfile_pipe(int *fd_store)
 		return -E_INVAL;
 	}
 	if ((ret = file_pipe(fd)) == 0) {
-		lock_mm(mm);
+		lock_mm_shared(mm);
 		{
 			if (!copy_to_user(mm, fd_store, fd, sizeof(fd))) {
 				ret = -E_INVAL;
 			}
 		}
-		unlock_mm(mm);
+		unlock_mm_shared(mm);
 		if (ret != 0) {
 			file_close(fd[0]), file_close(fd[1]);
 		}
@@ -5,15 +5,26 @@
 
 struct stat;
 struct dirent;
+struct epoll_event;
+struct uring_state;
+struct sockaddr_in;
+struct iovec;
 
 int sysfile_open(const char *path, uint32_t open_flags);
 int sysfile_close(int fd);
 int sysfile_read(int fd, void *base, size_t len);
 int sysfile_write(int fd, void *base, size_t len);
+int sysfile_pread(int fd, void *base, size_t len, off_t pos);
+int sysfile_pwrite(int fd, void *base, size_t len, off_t pos);
+int sysfile_readv(int fd, struct iovec *iov, int iovcnt);
+int sysfile_writev(int fd, struct iovec *iov, int iovcnt);
+int sysfile_preadv(int fd, struct iovec *iov, int iovcnt, off_t pos);
+int sysfile_pwritev(int fd, struct iovec *iov, int iovcnt, off_t pos);
 int sysfile_seek(int fd, off_t pos, int whence);
 int sysfile_fstat(int fd, struct stat *stat);
 int sysfile_stat(const char *fn, struct stat *stat);
 int sysfile_fsync(int fd);
+int sysfile_fallocate(int fd, int mode, off_t off, off_t len);
 int sysfile_chdir(const char *path);
 int sysfile_mkdir(const char *path);
 int sysfile_link(const char *path1, const char *path2);
@@ -21,9 +32,25 @@ int sysfile_rename(const char *path1, const char *path2);
 int sysfile_unlink(const char *path);
 int sysfile_getcwd(char *buf, size_t len);
 int sysfile_getdirentry(int fd, struct dirent *direntp, uint32_t * len);
+int sysfile_getdents(int fd, void *buf, size_t len);
 int sysfile_dup(int fd1, int fd2);
 int sysfile_pipe(int *fd_store);
 int sysfile_mkfifo(const char *name, uint32_t open_flags);
+int sysfile_fcntl(int fd, int cmd, int arg);
+int sysfile_splice(int fd_in, int fd_out, size_t len, bool tee);
+int sysfile_copy_file_range(int fd_in, off_t * off_in, int fd_out,
+			    off_t * off_out, size_t len);
+int sysfile_epoll_create(void);
+int sysfile_epoll_ctl(int epfd, int op, int type, int id,
+		      struct epoll_event *event);
+int sysfile_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+		       unsigned int timeout);
+int sysfile_socket(int domain, int type, int protocol);
+int sysfile_bind(int fd, const struct sockaddr_in *addr);
+int sysfile_listen(int fd, int backlog);
+int sysfile_accept(int fd, struct sockaddr_in *addr);
+int sysfile_connect(int fd, const struct sockaddr_in *addr);
+int sysfile_uring_enter(struct uring_state *state, unsigned int to_submit);
 
 int sysfile_ioctl(int fd, unsigned int cmd, unsigned long arg);
 void *sysfile_linux_mmap2(void *addr, size_t len, int prot, int flags, int fd,
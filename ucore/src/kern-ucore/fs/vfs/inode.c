@@ -8,6 +8,19 @@
 #include <error.h>
 #include <assert.h>
 #include <kio.h>
+#include <execmap.h>
+
+static kmem_cache_t *inode_cachep;
+
+/* *
+ * inode_cache_init - create the cache that all inode structures come from
+ * invoked by vfs_init
+ * */
+void inode_cache_init(void)
+{
+	inode_cachep = kmem_cache_create("inode", sizeof(struct inode), 0, NULL);
+	assert(inode_cachep != NULL);
+}
 
 /* *
  * __alloc_inode - alloc a inode structure and initialize in_type
@@ -15,7 +28,7 @@
 struct inode *__alloc_inode(int type)
 {
 	struct inode *node;
-	if ((node = kmalloc(sizeof(struct inode))) != NULL) {
+	if ((node = kmem_cache_alloc(inode_cachep)) != NULL) {
 		node->in_type = type;
 	}
 	return node;
@@ -29,10 +42,16 @@ void inode_init(struct inode *node, const struct inode_ops *ops, struct fs *fs)
 {
 	atomic_set(&(node->ref_count), 0);
 	atomic_set(&(node->open_count), 0);
+#ifdef UCONFIG_VFS_REFCACHE
+	node->in_refcached = node->in_dying = 0;
+#endif
 	node->in_ops = ops, node->in_fs = fs;
 #ifdef UCONFIG_BIONIC_LIBC
 	list_init(&(node->mapped_addr_list));
 #endif //UCONFIG_BIONIC_LIBC
+#ifdef UCONFIG_DEMAND_EXEC
+	list_init(&(node->in_exec_pages));
+#endif
 	vop_ref_inc(node);
 }
 
@@ -44,7 +63,10 @@ void inode_kill(struct inode *node)
 {
 	assert(inode_ref_count(node) == 0);
 	assert(inode_open_count(node) == 0);
-	kfree(node);
+#ifdef UCONFIG_DEMAND_EXEC
+	execmap_invalidate(node);
+#endif
+	kmem_cache_free(inode_cachep, node);
 }
 
 /* *
@@ -53,6 +75,12 @@ void inode_kill(struct inode *node)
  * */
 int inode_ref_inc(struct inode *node)
 {
+#ifdef UCONFIG_VFS_REFCACHE
+	if (node->in_refcached) {
+		refcache_refobj_inc(&(node->in_ref));
+		return inode_ref_count(node);
+	}
+#endif
 	return atomic_add_return(&(node->ref_count), 1);
 }
 
@@ -63,6 +91,13 @@ int inode_ref_inc(struct inode *node)
  * */
 int inode_ref_dec(struct inode *node)
 {
+#ifdef UCONFIG_VFS_REFCACHE
+	/* it is reclaimed once the refcache sees it stay at zero */
+	if (node->in_refcached) {
+		refcache_refobj_dec(&(node->in_ref));
+		return inode_ref_count(node);
+	}
+#endif
 	assert(inode_ref_count(node) > 0);
 	int ref_count, ret;
 	if ((ref_count = atomic_sub_return(&(node->ref_count), 1)) == 0) {
@@ -73,6 +108,69 @@ int inode_ref_dec(struct inode *node)
 	return ref_count;
 }
 
+/* *
+ * inode_ref_get - take a reference of an inode found in a lookup table
+ * invoked by vop_ref_get, with the lock of the table held
+ * */
+bool inode_ref_get(struct inode *node)
+{
+#ifdef UCONFIG_VFS_REFCACHE
+	if (node->in_refcached) {
+		/* counted in the global count, so that the refcache cannot
+		 * decide it has stayed at zero behind our back */
+		struct refobj *obj = &(node->in_ref);
+		bool intr_flag, revived;
+		spin_lock_irqsave(&(obj->lock), intr_flag);
+		obj->refcount++;
+		revived = node->in_dying, node->in_dying = 0;
+		spin_unlock_irqrestore(&(obj->lock), intr_flag);
+		return revived;
+	}
+#endif
+	return inode_ref_inc(node) == 1;
+}
+
+#ifdef UCONFIG_VFS_REFCACHE
+/* in the timer interrupt, with obj->lock held */
+static void inode_ref_onzero(struct refobj *obj)
+{
+	struct inode *node = to_struct(obj, struct inode, in_ref);
+	node->in_dying = 1;
+	refcache_refobj_defer(obj);
+}
+
+/* in krefcache_cleaner, the last of these may kill the inode */
+static void inode_ref_release(struct refobj *obj)
+{
+	struct inode *node = to_struct(obj, struct inode, in_ref);
+	int ret;
+	if ((ret = vop_reclaim(node)) != 0 && ret != -E_BUSY) {
+		kprintf("vfs: warning: vop_reclaim: %e.\n", ret);
+	}
+}
+
+/* *
+ * inode_ref_cache - keep the ref_count of a new inode in the per-cpu
+ * refcache, so that taking and dropping references from many cpus does
+ * not bounce a shared line. Called once by the filesystem, before the
+ * inode is visible to anyone else. The count of such an inode is only
+ * known once the refcache has flushed it: it is reclaimed some ticks
+ * after the last reference is dropped, and lookups of its filesystem
+ * must take references with vop_ref_get.
+ * */
+void inode_ref_cache(struct inode *node)
+{
+	assert(!node->in_refcached && inode_open_count(node) == 0);
+	struct refobj *obj = &(node->in_ref);
+	refcache_refobj_init(obj);
+	set_refobj_callback(obj, inode_ref_onzero);
+	set_refobj_release(obj, inode_ref_release);
+	obj->refcount = atomic_read(&(node->ref_count));
+	atomic_set(&(node->ref_count), 0);
+	node->in_refcached = 1;
+}
+#endif
+
 /* *
  * inode_open_inc - increment the open_count
  * invoked by vop_open_inc
@@ -107,6 +205,12 @@ void inode_check(struct inode *node, const char *opstr)
 {
 	assert(node != NULL && node->in_ops != NULL);
 	assert(node->in_ops->vop_magic == VOP_MAGIC);
+#ifdef UCONFIG_VFS_REFCACHE
+	/* the global count of a refcached inode may lag behind */
+	if (node->in_refcached) {
+		return;
+	}
+#endif
 	int ref_count = inode_ref_count(node), open_count =
 	    inode_open_count(node);
 	assert(ref_count >= open_count && open_count >= 0);
@@ -4,11 +4,19 @@
 #include <types.h>
 #include <dev.h>
 #include <pipe.h>
+#include <procfs.h>
+#include <eventpoll.h>
 #include <sfs.h>
 #include <fatfs/ffs.h>
 #include <yaffs2_direct/yaffs_vfs.h>
 #include <atomic.h>
 #include <assert.h>
+#ifdef UCONFIG_VFS_REFCACHE
+#include <refcache.h>
+#endif
+#ifdef UCONFIG_NET
+#include <sock.h>
+#endif
 
 struct stat;
 struct iobuf;
@@ -34,33 +42,52 @@ struct inode {
 		struct device __device_info;
 		struct pipe_root __pipe_root_info;
 		struct pipe_inode __pipe_inode_info;
+		struct epoll_inode __epoll_inode_info;
+		struct procfs_inode __procfs_inode_info;
 		struct sfs_inode __sfs_inode_info;
 #ifdef UCONFIG_HAVE_YAFFS2
 		struct yaffs2_inode __yaffs2_inode_info;
 #endif
 #ifdef UCONFIG_HAVE_FATFS
 		struct ffs_inode __ffs_inode_info;
+#endif
+#ifdef UCONFIG_NET
+		struct socket_inode __socket_inode_info;
 #endif
 	} in_info;
 	enum {
 		inode_type_device_info = 0x1234,
 		inode_type_pipe_root_info,
 		inode_type_pipe_inode_info,
+		inode_type_epoll_inode_info,
+		inode_type_procfs_inode_info,
 		inode_type_sfs_inode_info,
 #ifdef UCONFIG_HAVE_YAFFS2
 		inode_type_yaffs2_inode_info,
 #endif
 #ifdef UCONFIG_HAVE_FATFS
 		inode_type_ffs_inode_info,
+#endif
+#ifdef UCONFIG_NET
+		inode_type_socket_inode_info,
 #endif
 	} in_type;
 	atomic_t ref_count;
 	atomic_t open_count;
+#ifdef UCONFIG_VFS_REFCACHE
+	/* set by inode_ref_cache, the count lives in in_ref then */
+	bool in_refcached;
+	bool in_dying;		/* hit zero, a vop_reclaim is on its way */
+	struct refobj in_ref;
+#endif
 	struct fs *in_fs;
 	const struct inode_ops *in_ops;
 #ifdef UCONFIG_BIONIC_LIBC
 	list_entry_t mapped_addr_list;
 #endif				//UCONFIG_BIONIC_LIBC
+#ifdef UCONFIG_DEMAND_EXEC
+	list_entry_t in_exec_pages;	/* its pages in the exec cache */
+#endif
 };
 
 #define __in_type(type)                                             inode_type_##type##_info
@@ -79,6 +106,7 @@ struct inode {
 #define info2node(info, type)                                       \
     to_struct((info), struct inode, in_info.__##type##_info)
 
+void inode_cache_init(void);
 struct inode *__alloc_inode(int type);
 
 #define alloc_inode(type)                                           __alloc_inode(__in_type(type))
@@ -87,6 +115,12 @@ struct inode *__alloc_inode(int type);
 
 int inode_ref_inc(struct inode *node);
 int inode_ref_dec(struct inode *node);
+bool inode_ref_get(struct inode *node);
+#ifdef UCONFIG_VFS_REFCACHE
+void inode_ref_cache(struct inode *node);
+#else
+#define inode_ref_cache(node)                                       do { } while (0)
+#endif
 int inode_open_inc(struct inode *node);
 int inode_open_dec(struct inode *node);
 
@@ -176,6 +210,24 @@ void inode_kill(struct inode *node);
  *                      uio. Need not work on objects that are not
  *                      directories.
  *
+ *    vop_copyrange   - Copy LEN bytes of file FROM at offset FROM_OFF
+ *                      to the file at offset OFF, both of the same
+ *                      filesystem, without going through the caller.
+ *                      Optional: NULL if the filesystem has none, see
+ *                      vop_has_copyrange.
+ *
+ *    vop_fallocate   - Allocate the blocks of the file up to OFF + LEN,
+ *                      which read as zeros, and extend its size there
+ *                      unless MODE has FALLOC_FL_KEEP_SIZE. Optional:
+ *                      NULL if the filesystem has none.
+ *
+ *    vop_direct      - Hand back the kernel address of the PGSIZE bytes
+ *                      of the file at OFF, a multiple of PGSIZE, where
+ *                      the filesystem is in memory and they may be
+ *                      mapped in place; -E_NOENT if they may not.
+ *                      Optional: NULL if the filesystem has none, see
+ *                      vop_has_direct.
+ *
  *****************************************
  *
  *    vop_creat       - Create a regular file named NAME in the passed
@@ -238,6 +290,12 @@ struct inode_ops {
 	int (*vop_gettype) (struct inode * node, uint32_t * type_store);
 	int (*vop_tryseek) (struct inode * node, off_t pos);
 	int (*vop_truncate) (struct inode * node, off_t len);
+	int (*vop_copyrange) (struct inode * node, off_t off,
+			      struct inode * from, off_t from_off, size_t len,
+			      size_t * copied_store);
+	int (*vop_fallocate) (struct inode * node, int mode, off_t off,
+			      off_t len);
+	int (*vop_direct) (struct inode * node, off_t off, void **kva_store);
 	int (*vop_create) (struct inode * node, const char *name, bool excl,
 			   struct inode ** node_store);
 	int (*vop_unlink) (struct inode * node, const char *name);
@@ -284,6 +342,13 @@ void inode_check(struct inode *node, const char *opstr);
 #define vop_gettype(node, type_store)                               (__vop_op(node, gettype)(node, type_store))
 #define vop_tryseek(node, pos)                                      (__vop_op(node, tryseek)(node, pos))
 #define vop_truncate(node, len)                                     (__vop_op(node, truncate)(node, len))
+#define vop_copyrange(node, off, from, from_off, len, copied_store) (__vop_op(node, copyrange)(node, off, from, from_off, len, copied_store))
+#define vop_has_copyrange(node, from)                                                               \
+    ((node)->in_ops->vop_copyrange != NULL && vop_fs(node) == vop_fs(from))
+#define vop_fallocate(node, mode, off, len)                         (__vop_op(node, fallocate)(node, mode, off, len))
+#define vop_has_fallocate(node)                                     ((node)->in_ops->vop_fallocate != NULL)
+#define vop_direct(node, off, kva_store)                            (__vop_op(node, direct)(node, off, kva_store))
+#define vop_has_direct(node)                                        ((node)->in_ops->vop_direct != NULL)
 #define vop_create(node, name, excl, node_store)                    (__vop_op(node, create)(node, name, excl, node_store))
 #define vop_unlink(node, name)                                      (__vop_op(node, unlink)(node, name))
 #define vop_lookup(node, path, node_store)                          (__vop_op(node, lookup)(node, path, node_store))
@@ -298,6 +363,12 @@ void inode_check(struct inode *node, const char *opstr);
  */
 #define vop_ref_inc(node)                                           inode_ref_inc(node)
 #define vop_ref_dec(node)                                           inode_ref_dec(node)
+/*
+ * vop_ref_get takes a reference of an inode found in a lookup table of its
+ * filesystem, true if it has hit zero since, and so a vop_reclaim is on its
+ * way or has been called (and must fail with -E_BUSY).
+ */
+#define vop_ref_get(node)                                           inode_ref_get(node)
 /*
  * Open count manipulation (handled above filesystem level)
  *
@@ -319,6 +390,12 @@ void inode_check(struct inode *node, const char *opstr);
 
 static inline int inode_ref_count(struct inode *node)
 {
+#ifdef UCONFIG_VFS_REFCACHE
+	/* leaves out the deltas not yet flushed from the cpus */
+	if (node->in_refcached) {
+		return node->in_ref.refcount;
+	}
+#endif
 	return atomic_read(&(node->ref_count));
 }
 
@@ -24,6 +24,8 @@ struct fs *__alloc_fs(int type)
 void vfs_init(void)
 {
 	sem_init(&bootfs_sem, 1);
+	inode_cache_init();
+	vfs_dcache_init();
 	vfs_devlist_init();
 	file_system_type_list_init();
 }
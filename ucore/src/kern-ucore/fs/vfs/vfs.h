@@ -4,6 +4,7 @@
 #include <types.h>
 #include <fs.h>
 #include <pipe.h>
+#include <procfs.h>
 #include <sfs.h>
 #include <fatfs/ffs.h>
 #include <yaffs2_direct/yaffs_vfs.h>
@@ -16,7 +17,7 @@ struct iobuf;			// kernel or userspace I/O buffer (iobuf.h)
  * Abstract filesystem. (Or device accessible as a file.)
  *
  * Information:
- *      fs_info   : filesystem-specific data (pipe_fs/sfs_fs)
+ *      fs_info   : filesystem-specific data (pipe_fs/procfs_fs/sfs_fs)
  *      fs_type   : filesystem type
  * Operations:
  *
@@ -38,6 +39,7 @@ struct iobuf;			// kernel or userspace I/O buffer (iobuf.h)
 struct fs {
 	union {
 		struct pipe_fs __pipe_info;
+		struct procfs_fs __procfs_info;
 		struct sfs_fs __sfs_info;
 #ifdef UCONFIG_HAVE_YAFFS2
 		struct yaffs2_fs __yaffs2_info;
@@ -48,6 +50,7 @@ struct fs {
 	} fs_info;
 	enum {
 		fs_type_pipe_info = 0x5678,
+		fs_type_procfs_info,
 		fs_type_sfs_info,
 #ifdef UCONFIG_HAVE_YAFFS2
 		fs_type_yaffs2_info,
@@ -103,6 +106,29 @@ void vfs_init(void);
 void vfs_cleanup(void);
 void vfs_devlist_init(void);
 
+/*
+ * Name cache of the directories, see vfscache.c. Names longer than
+ * DCACHE_NAME_LEN are never cached.
+ */
+#define DCACHE_NAME_LEN                     31
+#define DCACHE_ALL_DIRS                     ((uint32_t)-1)
+
+#ifdef UCONFIG_VFS_DCACHE
+void vfs_dcache_init(void);
+bool vfs_dcache_lookup(struct fs *fs, uint32_t dir, const char *name,
+		       uint32_t * ino_store);
+void vfs_dcache_add(struct fs *fs, uint32_t dir, const char *name,
+		    uint32_t ino);
+void vfs_dcache_remove(struct fs *fs, uint32_t dir, const char *name);
+void vfs_dcache_purge(struct fs *fs, uint32_t dir);
+#else
+#define vfs_dcache_init()                   do { } while (0)
+#define vfs_dcache_lookup(fs, dir, name, ino_store)     0
+#define vfs_dcache_add(fs, dir, name, ino)  do { } while (0)
+#define vfs_dcache_remove(fs, dir, name)    do { } while (0)
+#define vfs_dcache_purge(fs, dir)           do { } while (0)
+#endif
+
 /*
  * VFS layer low-level operations. 
  * See inode.h for direct operations on inodes.
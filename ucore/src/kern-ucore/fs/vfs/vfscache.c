@@ -0,0 +1,222 @@
+/*
+ * VFS name cache: maps (filesystem, directory, name) to the inode number
+ * the filesystem found under that name, or to nothing for a negative
+ * entry, so that resolving a path does not scan the directories again.
+ *
+ * The directory and the inode are named by numbers of the filesystem
+ * (sfs uses its block numbers), which stay valid while the name is
+ * linked. A filesystem adds an entry once a name is looked up, linked or
+ * known to be missing, and must drop it, under the same lock of the
+ * directory, before the name goes away or a directory is removed.
+ */
+
+#include <types.h>
+#include <string.h>
+#include <stdlib.h>
+#include <slab.h>
+#include <vfs.h>
+#include <sem.h>
+#include <list.h>
+#include <assert.h>
+#include <memlayout.h>
+#include <shrinker.h>
+
+#define DCACHE_HASH_SHIFT                   8
+#define DCACHE_HASH_SIZE                    (1 << DCACHE_HASH_SHIFT)
+#define DCACHE_MAX_ENTRIES                  1024
+
+struct dentry {
+	list_entry_t hash_link;
+	list_entry_t lru_link;
+	struct fs *fs;
+	uint32_t dir;
+	uint32_t ino;		/* 0 for a negative entry */
+	uint32_t hash;
+	char name[DCACHE_NAME_LEN + 1];
+};
+
+#define le2dentry(le, member)                                       \
+    to_struct((le), struct dentry, member)
+
+static list_entry_t dcache_hash[DCACHE_HASH_SIZE];
+/* the least recently used entry first */
+static list_entry_t dcache_lru;
+static int dcache_count;
+static semaphore_t dcache_sem;
+static kmem_cache_t *dentry_cachep;
+static struct shrinker dcache_shrinker;
+
+void vfs_dcache_init(void)
+{
+	int i;
+	for (i = 0; i < DCACHE_HASH_SIZE; i++) {
+		list_init(&dcache_hash[i]);
+	}
+	list_init(&dcache_lru);
+	dcache_count = 0;
+	sem_init(&dcache_sem, 1);
+	dentry_cachep =
+	    kmem_cache_create("dentry", sizeof(struct dentry), 0, NULL);
+	assert(dentry_cachep != NULL);
+	register_shrinker(&dcache_shrinker);
+}
+
+static uint32_t dcache_hashfn(struct fs *fs, uint32_t dir, const char *name)
+{
+	uint32_t h = (uint32_t) (uintptr_t) fs ^ dir;
+	while (*name != '\0') {
+		h = h * 31 + (uint8_t) * name++;
+	}
+	return h;
+}
+
+static list_entry_t *dcache_bucket(uint32_t hash)
+{
+	return &dcache_hash[hash32(hash, DCACHE_HASH_SHIFT)];
+}
+
+static struct dentry *dcache_find_nolock(struct fs *fs, uint32_t dir,
+					 const char *name, uint32_t hash)
+{
+	list_entry_t *list = dcache_bucket(hash), *le = list;
+	while ((le = list_next(le)) != list) {
+		struct dentry *de = le2dentry(le, hash_link);
+		if (de->hash == hash && de->fs == fs && de->dir == dir
+		    && strcmp(de->name, name) == 0) {
+			return de;
+		}
+	}
+	return NULL;
+}
+
+static void dcache_free_nolock(struct dentry *de)
+{
+	list_del(&(de->hash_link));
+	list_del(&(de->lru_link));
+	dcache_count--;
+	kmem_cache_free(dentry_cachep, de);
+}
+
+/* *
+ * vfs_dcache_lookup - look name up in dir, return 1 if it is cached and
+ * store its inode number there, which is 0 for a negative entry
+ * */
+bool vfs_dcache_lookup(struct fs *fs, uint32_t dir, const char *name,
+		       uint32_t * ino_store)
+{
+	if (strlen(name) > DCACHE_NAME_LEN) {
+		return 0;
+	}
+	uint32_t hash = dcache_hashfn(fs, dir, name);
+	struct dentry *de;
+	down(&dcache_sem);
+	if ((de = dcache_find_nolock(fs, dir, name, hash)) != NULL) {
+		list_del(&(de->lru_link));
+		list_add_before(&dcache_lru, &(de->lru_link));
+		*ino_store = de->ino;
+	}
+	up(&dcache_sem);
+	return de != NULL;
+}
+
+/* *
+ * vfs_dcache_add - remember that name in dir is ino, or is missing if ino
+ * is 0; replaces what was cached for the name
+ * */
+void vfs_dcache_add(struct fs *fs, uint32_t dir, const char *name,
+		    uint32_t ino)
+{
+	if (strlen(name) > DCACHE_NAME_LEN) {
+		return;
+	}
+	uint32_t hash = dcache_hashfn(fs, dir, name);
+	struct dentry *de;
+	down(&dcache_sem);
+	if ((de = dcache_find_nolock(fs, dir, name, hash)) == NULL) {
+		if (dcache_count >= DCACHE_MAX_ENTRIES) {
+			dcache_free_nolock(le2dentry
+					   (list_next(&dcache_lru), lru_link));
+		}
+		if ((de = kmem_cache_alloc(dentry_cachep)) == NULL) {
+			goto out;
+		}
+		de->fs = fs, de->dir = dir, de->hash = hash;
+		strcpy(de->name, name);
+		list_add(dcache_bucket(hash), &(de->hash_link));
+		dcache_count++;
+	} else {
+		list_del(&(de->lru_link));
+	}
+	de->ino = ino;
+	list_add_before(&dcache_lru, &(de->lru_link));
+out:
+	up(&dcache_sem);
+}
+
+/* *
+ * vfs_dcache_remove - forget name in dir
+ * */
+void vfs_dcache_remove(struct fs *fs, uint32_t dir, const char *name)
+{
+	if (strlen(name) > DCACHE_NAME_LEN) {
+		return;
+	}
+	uint32_t hash = dcache_hashfn(fs, dir, name);
+	struct dentry *de;
+	down(&dcache_sem);
+	if ((de = dcache_find_nolock(fs, dir, name, hash)) != NULL) {
+		dcache_free_nolock(de);
+	}
+	up(&dcache_sem);
+}
+
+/* *
+ * vfs_dcache_purge - forget every name in dir of fs, or every name of fs if
+ * dir is DCACHE_ALL_DIRS; for a removed directory or an unmounted fs
+ * */
+void vfs_dcache_purge(struct fs *fs, uint32_t dir)
+{
+	down(&dcache_sem);
+	list_entry_t *le = list_next(&dcache_lru);
+	while (le != &dcache_lru) {
+		struct dentry *de = le2dentry(le, lru_link);
+		le = list_next(le);
+		if (de->fs == fs && (dir == DCACHE_ALL_DIRS || de->dir == dir)) {
+			dcache_free_nolock(de);
+		}
+	}
+	up(&dcache_sem);
+}
+
+#define DCACHE_PER_PAGE                     (PGSIZE / sizeof(struct dentry))
+
+// dcache_count_pages - the pages the entries fill, racy
+static size_t dcache_count_pages(void)
+{
+	return dcache_count / DCACHE_PER_PAGE;
+}
+
+// dcache_shrink - forget the least recently used entries, as many as fill
+//               - nr pages, and return the pages they filled; their slabs
+//               - give the pages back once empty. Nothing is done while
+//               - the cache is busy, vfs_dcache_add may be allocating.
+static size_t dcache_shrink(size_t nr)
+{
+	size_t free_count = 0;
+	if (!try_down(&dcache_sem)) {
+		return 0;
+	}
+	while (free_count < nr * DCACHE_PER_PAGE
+	       && !list_empty(&dcache_lru)) {
+		dcache_free_nolock(le2dentry(list_next(&dcache_lru), lru_link));
+		free_count++;
+	}
+	up(&dcache_sem);
+	return free_count / DCACHE_PER_PAGE;
+}
+
+static struct shrinker dcache_shrinker = {
+	.name = "dcache",
+	.count = dcache_count_pages,
+	.scan = dcache_shrink,
+};
@@ -338,8 +338,10 @@ int vfs_unmount(const char *devname)
 	if ((ret = fsop_sync(vdev->fs)) != 0) {
 		goto out;
 	}
-	if ((ret = fsop_unmount(vdev->fs)) == 0) {
+	struct fs *fs = vdev->fs;
+	if ((ret = fsop_unmount(fs)) == 0) {
 		/* now drop the filesystem */
+		vfs_dcache_purge(fs, DCACHE_ALL_DIRS);
 		vdev->fs = NULL;
 		kprintf("vfs: unmount %s.\n", vdev->devname);
 	}
@@ -375,6 +377,8 @@ int vfs_unmount_all(void)
 						continue;
 					}
 					/* now drop the filesystem */
+					vfs_dcache_purge(vdev->fs,
+							 DCACHE_ALL_DIRS);
 					vdev->fs = NULL;
 					kprintf("vfs: unmount %s.\n",
 						vdev->devname);
@@ -9,6 +9,7 @@
 #include <unistd.h>
 #include <error.h>
 #include <assert.h>
+#include <execmap.h>
 
 /* Does most of the work for open(). */
 int vfs_open(char *path, uint32_t open_flags, struct inode **node_store)
@@ -56,6 +57,12 @@ int vfs_open(char *path, uint32_t open_flags, struct inode **node_store)
 	}
 
 	vop_open_inc(node);
+#ifdef UCONFIG_DEMAND_EXEC
+	if (can_write) {
+		/* the programs run from now on must not see the old pages */
+		execmap_invalidate(node);
+	}
+#endif
 	if (open_flags & O_TRUNC) {
 		if ((ret = vop_truncate(node, 0)) != 0) {
 			vop_open_dec(node);
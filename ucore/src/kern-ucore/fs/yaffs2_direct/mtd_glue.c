@@ -82,7 +82,11 @@ static int mtd_read_page(struct yaffs_dev *dev,
   unsigned char tmp_spare[MAX_SPARE_BUF];
   int ret = YAFFS_OK;
 
-  if(dataLength>=chip->pg_size)
+  if(dataLength == 0 && chip->read_spare){
+    /* the tags alone, as a scan wants: they have an ecc of their own */
+    ret = chip->read_spare(chip, pageId, tmp_spare);
+    *eccStatus = 0;
+  }else if(dataLength>=chip->pg_size)
     ret = chip->read_page(chip, pageId, data, tmp_spare, eccStatus);
   else{
     ret = chip->read_page(chip, pageId, data_page_buf, tmp_spare, eccStatus);
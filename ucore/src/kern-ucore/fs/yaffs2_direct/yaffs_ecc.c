@@ -68,14 +68,69 @@ static const unsigned char column_parity_table[] = {
 };
 
 
-/* Calculate the ECC for a 256-byte block of data */
+/* Parity of the bits of x */
+static inline unsigned yaffs_ecc_parity32(u32 x)
+{
+	x ^= x >> 16;
+	x ^= x >> 8;
+	x ^= x >> 4;
+	return (0x6996 >> (x & 0x0f)) & 1;
+}
+
+static void yaffs_ecc_calc_bytes(const unsigned char *data,
+				 unsigned char *ecc);
+static void yaffs_ecc_pack(unsigned char col_parity, unsigned char line_parity,
+			   unsigned char line_parity_prime, unsigned char *ecc);
+
+/* Calculate the ECC for a 256-byte block of data
+ *
+ * The data is taken a word at a time where it is aligned. The parities
+ * being linear, the column parity is that of all the bytes XORed together.
+ * Bit n of the line parity is that of the bytes whose offset has bit n
+ * set: bits 0 and 1 of the offset pick the byte lanes of a word, taken
+ * little-endian, and the others the word, so those come from the offsets
+ * of the words of odd parity as the offsets of the bytes do below.
+ */
 void yaffs_ecc_calc(const unsigned char *data, unsigned char *ecc)
+{
+	const u32 *words = (const u32 *)data;
+	u32 all = 0;
+	u32 w;
+	unsigned int i;
+	unsigned char line_parity = 0;
+
+	if (((unsigned long)data) & 3) {
+		yaffs_ecc_calc_bytes(data, ecc);
+		return;
+	}
+
+	for (i = 0; i < 64; i++) {
+		w = words[i];
+		all ^= w;
+		if (yaffs_ecc_parity32(w))
+			line_parity ^= i;
+	}
+
+	line_parity <<= 2;
+	line_parity |= yaffs_ecc_parity32(all & 0xffff0000) << 1;
+	line_parity |= yaffs_ecc_parity32(all & 0xff00ff00);
+
+	w = all ^ (all >> 16);
+	w ^= w >> 8;
+
+	/* an odd number of odd bytes flips all the primes */
+	yaffs_ecc_pack(column_parity_table[w & 0xff], line_parity,
+		       line_parity ^ (yaffs_ecc_parity32(all) ? 0xff : 0x00),
+		       ecc);
+}
+
+/* Calculate the ECC for a 256-byte block of data a byte at a time */
+static void yaffs_ecc_calc_bytes(const unsigned char *data, unsigned char *ecc)
 {
 	unsigned int i;
 	unsigned char col_parity = 0;
 	unsigned char line_parity = 0;
 	unsigned char line_parity_prime = 0;
-	unsigned char t;
 	unsigned char b;
 
 	for (i = 0; i < 256; i++) {
@@ -88,6 +143,14 @@ void yaffs_ecc_calc(const unsigned char *data, unsigned char *ecc)
 		}
 	}
 
+	yaffs_ecc_pack(col_parity, line_parity, line_parity_prime, ecc);
+}
+
+static void yaffs_ecc_pack(unsigned char col_parity, unsigned char line_parity,
+			   unsigned char line_parity_prime, unsigned char *ecc)
+{
+	unsigned char t;
+
 	ecc[2] = (~col_parity) | 0x03;
 
 	t = 0;
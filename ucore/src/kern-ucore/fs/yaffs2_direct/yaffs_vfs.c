@@ -25,6 +25,7 @@
 #include <inode.h>
 #include <iobuf.h>
 #include <error.h>
+#include <proc.h>
 
 #include "yaffsfs.h"
 #include "yaffs_guts.h"
@@ -41,6 +42,11 @@ static const struct inode_ops yaffs_node_fileops;
 
 static const char *mount_partition = "/data";
 
+/* ticks between the rounds of the background gc, see yaffs_bg_gc_main */
+#define YAFFS_BG_GC_URGENT   5
+#define YAFFS_BG_GC_SOON     10
+#define YAFFS_BG_GC_IDLE     200
+
 #define yaffs_inode_to_obj_lv(iptr) (vop_info(node, yaffs2_inode)->obj)
 #define yaffs_inode_to_obj(iptr)\
 	((struct yaffs_obj *)(yaffs_inode_to_obj_lv(iptr)))
@@ -51,8 +57,10 @@ static int yaffs_vfs_do_sync(struct fs *fs)
   int ret;
   kprintf("yaffs_vfs_do_sync: sync disk\n");
   ret = yaffs_sync(mount_partition);
-  if(ret)
+  if(ret){
       kprintf("yaffs_vfs_do_sync: faild to sync %s\n", mount_partition);
+      return -E_IO;
+  }
   return 0;
 }
 
@@ -137,10 +145,45 @@ static int yaffs_vfs_do_unmount(struct fs *fs)
   return 0;
 }
 
-static void yaffs_vfs_do_cleanup(struct fs *fs)
+/* checkpoint on the way down, or the next boot scans the flash */
+static int yaffs_vfs_do_cleanup(struct fs *fs)
 {
   kprintf("yaffs_vfs_do_cleanup: \n");
-  return;
+  if(fsop_sync(fs) != 0)
+    kprintf("yaffs_vfs_do_cleanup: no checkpoint for %s\n", mount_partition);
+  return 0;
+}
+
+/*
+ * yaffs_bg_gc_main - collect in the background, so that the writers find
+ * erased blocks ready and do not stall collecting inline; the sooner the
+ * more urgent, and seldom when the flash is idle and mostly erased.
+ */
+static int yaffs_bg_gc_main(void *arg)
+{
+  while(1){
+    int urgency = yaffs_background_gc(mount_partition);
+    if(urgency > 1)
+      do_sleep(YAFFS_BG_GC_URGENT);
+    else if(urgency > 0)
+      do_sleep(YAFFS_BG_GC_SOON);
+    else
+      do_sleep(YAFFS_BG_GC_IDLE);
+  }
+}
+
+static void yaffs_bg_gc_start(void)
+{
+  static bool started = 0;
+  int pid;
+  if(started)
+    return;
+  if((pid = ucore_kernel_thread(yaffs_bg_gc_main, NULL, 0)) <= 0){
+    kprintf("yaffs_bg_gc_start: faild to start, gc stays inline\n");
+    return;
+  }
+  set_proc_name(find_proc(pid), "yaffsgc");
+  started = 1;
 }
 
 
@@ -157,6 +200,8 @@ yaffs_vfs_do_mount(struct device *dev, struct fs **fs_store)
 
   //TODO mount vfs here
   kprintf("yaffs_vfs_do_mount:  mount %s", mount_partition);
+  /* restores from the checkpoint of the last sync if nothing was written
+   * since, else scans backwards by the block summaries */
   int ret = yaffs_mount_common(mount_partition,0, 0, &(yfs->ydev));
   if(ret)
     panic("yaffs_vfs_do_mount: faild to mount %s", mount_partition);
@@ -167,6 +212,7 @@ yaffs_vfs_do_mount(struct device *dev, struct fs **fs_store)
   fs->fs_unmount = yaffs_vfs_do_unmount;
   fs->fs_cleanup = yaffs_vfs_do_cleanup;
 
+  yaffs_bg_gc_start();
   *fs_store = fs;
   return 0;
 }
@@ -2513,6 +2513,23 @@ int yaffs_mount(const YCHAR *path)
 	return yaffs_mount_common(path, 0, 0, 0);
 }
 
+/*
+ * yaffsfs_SaveCheckpoint
+ * Write the checkpoint of a mounted device, so that the next mount restores
+ * from it rather than scanning the flash. The checkpoint goes in erased
+ * blocks of its own, so the collection runs for them if there are too few.
+ * Returns non-zero if the device is checkpointed.
+ */
+static int yaffsfs_SaveCheckpoint(struct yaffs_dev *dev)
+{
+	int tries;
+
+	for(tries = 0; !yaffs_checkpoint_save(dev) && tries < 3; tries++)
+		yaffs_bg_gc(dev, 2);
+
+	return dev->is_checkpointed;
+}
+
 int yaffs_sync(const YCHAR *path)
 {
         int retVal=-1;
@@ -2539,8 +2556,10 @@ int yaffs_sync(const YCHAR *path)
 		else {
 
                         yaffs_flush_whole_cache(dev);
-                        yaffs_checkpoint_save(dev);
-                        retVal = 0;
+                        if(yaffsfs_SaveCheckpoint(dev))
+                                retVal = 0;
+                        else
+                                yaffsfs_SetError(-ENOSPC);
 
                 }
         }else
@@ -2588,7 +2607,7 @@ int yaffs_remount(const YCHAR *path, int force, int read_only)
 
 			if(force || ! yaffsfs_IsDevBusy(dev)){
 				if(read_only)
-					yaffs_checkpoint_save(dev);
+					yaffsfs_SaveCheckpoint(dev);
 				dev->read_only =  read_only ? 1 : 0;
 				retVal = 0;
 			} else
@@ -2627,7 +2646,10 @@ int yaffs_unmount2(const YCHAR *path, int force)
 		if(dev->is_mounted){
 			int inUse;
 			yaffs_flush_whole_cache(dev);
-			yaffs_checkpoint_save(dev);
+			if(!dev->read_only && !yaffsfs_SaveCheckpoint(dev))
+				yaffs_trace(YAFFS_TRACE_ALWAYS,
+					"yaffs: no checkpoint for %s, the next mount scans",
+					path);
 			inUse = yaffsfs_IsDevBusy(dev);
 			if(!inUse || force){
 				if(inUse)
@@ -2654,6 +2676,63 @@ int yaffs_unmount(const YCHAR *path)
 	return yaffs_unmount2(path,0);
 }
 
+/*
+ * yaffsfs_GcUrgency
+ * How soon the background collection should run again: 0 while at least
+ * half the free chunks are in erased blocks or few are scattered, 1 while
+ * a quarter are, 2 below that, when the writers are about to collect.
+ */
+static int yaffsfs_GcUrgency(struct yaffs_dev *dev)
+{
+	int erased_chunks = dev->n_erased_blocks * dev->param.chunks_per_block;
+	int scattered = 0;	/* Free chunks not in an erased block */
+
+	if(erased_chunks < dev->n_free_chunks)
+		scattered = dev->n_free_chunks - erased_chunks;
+
+	if(scattered < dev->param.chunks_per_block * 2)
+		return 0;
+	else if(erased_chunks > dev->n_free_chunks / 2)
+		return 0;
+	else if(erased_chunks > dev->n_free_chunks / 4)
+		return 1;
+	return 2;
+}
+
+/*
+ * yaffs_background_gc
+ * A round of the collection for a background thread on the device of path,
+ * so that the writers seldom find too few erased blocks and collect inline.
+ * None while the device is checkpointed, as writing would throw the
+ * checkpoint away. Returns the urgency of the next round, see
+ * yaffsfs_GcUrgency, or -1 if the device is not mounted.
+ */
+int yaffs_background_gc(const YCHAR *path)
+{
+	int retVal = -1;
+	struct yaffs_dev *dev = NULL;
+	YCHAR *dummy;
+
+	if(!path){
+		yaffsfs_SetError(-EFAULT);
+		return -1;
+	}
+
+	yaffsfs_Lock();
+	dev = yaffsfs_FindDevice(path,&dummy);
+	if(dev && dev->is_mounted){
+		retVal = 0;
+		if(!dev->is_checkpointed && !dev->read_only){
+			yaffs_bg_gc(dev, yaffsfs_GcUrgency(dev));
+			retVal = yaffsfs_GcUrgency(dev);
+		}
+	} else
+		yaffsfs_SetError(-ENODEV);
+
+	yaffsfs_Unlock();
+	return retVal;
+}
+
 loff_t yaffs_freespace(const YCHAR *path)
 {
 	loff_t retVal=-1;
@@ -162,6 +162,7 @@ int yaffs_remount(const YCHAR *path, int force, int read_only);
 
 
 int yaffs_sync(const YCHAR *path) ;
+int yaffs_background_gc(const YCHAR *path);
 
 int yaffs_symlink(const YCHAR *oldpath, const YCHAR *newpath);
 int yaffs_readlink(const YCHAR *path, YCHAR *buf, int bufsiz);
@@ -4,6 +4,8 @@
 #include <file.h>
 #include <stat.h>
 #include <slab.h>
+#include <vmalloc.h>
+#include <pmm.h>
 #include <elf.h>
 #include <mmu.h>
 #include <vmm.h>
@@ -16,6 +18,8 @@
 #include <sem.h>
 #include <stdlib.h>
 #include <error.h>
+#include <mp.h>
+#include <sysconf.h>
 
 #ifndef ARCH_SHF_SMALL
 #define ARCH_SHF_SMALL 0
@@ -30,27 +34,186 @@ static list_entry_t modules = { &(modules), &(modules) };
 
 static char last_unloaded_module[MODULE_NAME_LEN + 1];
 
+/*
+ * The modules are allocated whole pages from an arena of contiguous ones,
+ * taken at the first load, so that their code sits together in the direct
+ * map instead of spread over the slabs of kmalloc; a module too large for
+ * what is left is given a kvmalloc. arena_run[i] is the # of pages of the
+ * allocation starting at page i, arena_used[i] whether page i is taken.
+ */
+#define MODULE_ARENA_PAGES          256
+
+static void *arena_base;
+static uint16_t arena_run[MODULE_ARENA_PAGES];
+static uint8_t arena_used[MODULE_ARENA_PAGES];
+
+static inline bool in_arena(void *region)
+{
+	return arena_base != NULL && region >= arena_base
+	    && region < arena_base + MODULE_ARENA_PAGES * PGSIZE;
+}
+
+// arena_alloc - the first npages free in a row of the arena
+static void *arena_alloc(size_t npages)
+{
+	size_t i, j;
+	if (arena_base == NULL) {
+		struct Page *page = alloc_pages(MODULE_ARENA_PAGES);
+		if (page == NULL)
+			return NULL;
+		arena_base = page2kva(page);
+	}
+	for (i = 0; i + npages <= MODULE_ARENA_PAGES; i = j + 1) {
+		for (j = i; j < i + npages && !arena_used[j]; j++) ;
+		if (j == i + npages) {
+			memset(arena_used + i, 1, npages);
+			arena_run[i] = npages;
+			return arena_base + i * PGSIZE;
+		}
+	}
+	return NULL;
+}
+
 void *module_alloc(unsigned long size)
 {
-	return size == 0 ? NULL : kmalloc(size);
+	void *ret;
+	if (size == 0)
+		return NULL;
+	if ((ret = arena_alloc(ROUNDUP(size, PGSIZE) / PGSIZE)) != NULL)
+		return ret;
+	return kvmalloc(size);
 }
 
 void module_free(struct module *module, void *region)
 {
-	kfree(region);
+	if (in_arena(region)) {
+		size_t i = (region - arena_base) / PGSIZE;
+		memset(arena_used + i, 0, arena_run[i]);
+		arena_run[i] = 0;
+	} else if (region != NULL) {
+		kvfree(region);
+	}
+}
+
+/*
+ * The cores of the modules unloaded last, kept with their text relocated.
+ * Loading the same image again takes its core back: the data is copied
+ * and relocated again, but the text is reused as it is when the undefined
+ * symbols resolve to the same values as before.
+ */
+#define MODULE_CACHE_MAX            4
+
+struct module_cache {
+	list_entry_t link;
+	char name[MODULE_NAME_LEN];
+	unsigned long image_len;
+	uint32_t image_hash, syms_hash;
+	void *core;
+	unsigned int core_size;
+};
+
+#define le2modcache(le, member)                        \
+    to_struct((le), struct module_cache, member)
+
+static list_entry_t module_cache_list = { &(module_cache_list),
+	&(module_cache_list)
+};
+
+static int module_cache_count;
+
+static uint32_t image_hashfn(const void *image, unsigned long len)
+{
+	const uint8_t *p = image;
+	uint32_t h = 0;
+	while (len-- > 0) {
+		h = h * 31 + *p++;
+	}
+	return h;
+}
+
+static void module_cache_drop(struct module_cache *mc)
+{
+	list_del(&(mc->link));
+	module_cache_count--;
+	module_free(NULL, mc->core);
+	kfree(mc);
+}
+
+// module_cache_put - keep the core of mod, unloaded, the oldest dropped
+static void module_cache_put(struct module *mod)
+{
+	struct module_cache *mc;
+	if (mod->module_core == NULL)
+		return;
+	if ((mc = kmalloc(sizeof(struct module_cache))) == NULL) {
+		module_free(mod, mod->module_core);
+		return;
+	}
+	strncpy(mc->name, mod->name, MODULE_NAME_LEN);
+	mc->image_len = mod->image_len;
+	mc->image_hash = mod->image_hash, mc->syms_hash = mod->syms_hash;
+	mc->core = mod->module_core, mc->core_size = mod->core_size;
+	list_add(&module_cache_list, &(mc->link));
+	if (++module_cache_count > MODULE_CACHE_MAX)
+		module_cache_drop(le2modcache
+				  (list_prev(&module_cache_list), link));
+}
+
+// module_cache_get - the core kept of the image of mod, or NULL, and the
+//                  - values its text was relocated against in *syms_hash
+static void *module_cache_get(struct module *mod, uint32_t * syms_hash)
+{
+	list_entry_t *list = &(module_cache_list), *le = list;
+	while ((le = list_next(le)) != list) {
+		struct module_cache *mc = le2modcache(le, link);
+		if (mc->image_hash == mod->image_hash
+		    && mc->image_len == mod->image_len
+		    && mc->core_size == mod->core_size
+		    && strcmp(mc->name, mod->name) == 0) {
+			void *core = mc->core;
+			*syms_hash = mc->syms_hash;
+			mc->core = NULL;
+			module_cache_drop(mc);
+			return core;
+		}
+	}
+	return NULL;
 }
 
+/* *
+ * The .percpu section of a module, its DEFINE_PERCPU vars, becomes a
+ * dynamic per-cpu object (numa/percpu_alloc.c) with a copy of the section
+ * for each cpu. The module reaches its vars by per_cpu_dyn_ptr(&var, id),
+ * not by per_cpu, which only knows the .percpu of the kernel.
+ * */
 static inline void *percpu_modalloc(unsigned long size, unsigned long align,
 				    const char *name)
 {
-	return NULL;
+	void *ptr;
+	if (align > PGSIZE) {
+		kprintf("%s: per-cpu alignment %lu > %lu\n", name, align,
+			(unsigned long)PGSIZE);
+		align = PGSIZE;
+	}
+	if ((ptr = __alloc_percpu(size, align)) == NULL) {
+		kprintf("%s: could not allocate %lu bytes per-cpu data\n",
+			name, size);
+	}
+	return ptr;
 }
 
-static inline unsigned int find_pcpusec(struct elfhdr *hdr,
-					struct secthdr *sechdrs,
-					const char *secstrings)
+static inline void percpu_modfree(void *ptr)
 {
-	return 0;
+	free_percpu(ptr);
+}
+
+// percpu_modcopy - the initial values of the vars, to the copy of each cpu
+static void percpu_modcopy(void *ptr, const void *from, unsigned long size)
+{
+	int cpu;
+	for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+		memcpy(per_cpu_dyn_ptr(ptr, cpu), from, size);
+	}
 }
 
 static inline int check_version(struct secthdr *sechdrs,
@@ -72,7 +235,6 @@ static const struct kernel_symbol *resolve_symbol(struct secthdr *sechdrs,
 	const unsigned long *crc;
 	sym = find_symbol(name, &owner, &crc, 1);
 	if (sym) {
-		kprintf("\tresolve_symbol: symbol %s found\n", name);
 		if (!check_version(sechdrs, versindex, name, mod, crc) ||
 		    !use_module(mod, owner))
 			sym = NULL;
@@ -153,6 +315,13 @@ static unsigned int find_sec(struct elfhdr *hdr,
 	return 0;
 }
 
+static inline unsigned int find_pcpusec(struct elfhdr *hdr,
+					struct secthdr *sechdrs,
+					const char *secstrings)
+{
+	return find_sec(hdr, sechdrs, secstrings, ".percpu");
+}
+
 static void *section_addr(struct elfhdr *hdr, struct secthdr *shdrs,
 			  const char *secstrings, const char *name)
 {
@@ -190,14 +359,86 @@ static const struct kernel_symbol *lookup_symbol(const char *name, const struct
 	return NULL;
 }
 
+/*
+ * The export tables hashed by name, the one of the kernel by mod_init and
+ * the one of a module as it is loaded, so that resolving the thousands of
+ * symbols of a module costs a string compare each, not one per export of
+ * the kernel. A table that could not be hashed is searched as it is.
+ */
+#define SYMHASH_MAX_SHIFT           14	// the slots fit in a kmalloc
+
+static struct symhash kernel_symhash;
+
+static uint32_t symhash_fn(const char *name)
+{
+	uint32_t h = 0;
+	while (*name != '\0') {
+		h = h * 31 + (uint8_t) * name++;
+	}
+	return h;
+}
+
+// symhash_build - hash the table [start, stop) into sh, left empty on failure
+static int symhash_build(struct symhash *sh, const struct kernel_symbol *start,
+			 const struct kernel_symbol *stop)
+{
+	unsigned int n = stop - start, shift = 1, i;
+	sh->slots = NULL;
+	while ((1U << shift) < n * 2)
+		shift++;
+	if (shift > SYMHASH_MAX_SHIFT)
+		return -E_NO_MEM;
+	if ((sh->slots = kmalloc(sizeof(struct symhash_slot) << shift)) == NULL)
+		return -E_NO_MEM;
+	memset(sh->slots, 0, sizeof(struct symhash_slot) << shift);
+	sh->shift = shift;
+	for (i = 0; i < n; i++) {
+		uint32_t hash = symhash_fn(start[i].name);
+		uint32_t j = hash32(hash, shift);
+		while (sh->slots[j].index != 0)
+			j = (j + 1) & ((1U << shift) - 1);
+		sh->slots[j].hash = hash;
+		sh->slots[j].index = i + 1;
+	}
+	return 0;
+}
+
+static void symhash_free(struct symhash *sh)
+{
+	if (sh->slots != NULL) {
+		kfree(sh->slots);
+		sh->slots = NULL;
+	}
+}
+
+// symhash_lookup - the symbol name of the table start hashed into sh
+static const struct kernel_symbol *symhash_lookup(struct symhash *sh,
+						  const char *name,
+						  const struct kernel_symbol
+						  *start, const struct kernel_symbol
+						  *stop)
+{
+	if (sh->slots == NULL)
+		return lookup_symbol(name, start, stop);
+	uint32_t hash = symhash_fn(name), j = hash32(hash, sh->shift);
+	for (; sh->slots[j].index != 0; j = (j + 1) & ((1U << sh->shift) - 1)) {
+		const struct kernel_symbol *ks = start + sh->slots[j].index - 1;
+		if (sh->slots[j].hash == hash && strcmp(ks->name, name) == 0)
+			return ks;
+	}
+	return NULL;
+}
+
 static int is_exported(const char *name, unsigned long value,
-		       const struct module *mod)
+		       struct module *mod)
 {
 	const struct kernel_symbol *ks;
 	if (!mod)
-		ks = lookup_symbol(name, __start___ksymtab, __stop___ksymtab);
+		ks = symhash_lookup(&kernel_symhash, name, __start___ksymtab,
+				    __stop___ksymtab);
 	else
-		ks = lookup_symbol(name, mod->syms, mod->syms + mod->num_syms);
+		ks = symhash_lookup(&mod->symhash, name, mod->syms,
+				    mod->syms + mod->num_syms);
 	return ks != NULL && ks->value == value;
 }
 
@@ -210,7 +451,7 @@ struct module *__module_text_address(unsigned long addr)
 		    && !within(addr, mod->module_core, mod->core_text_size))
 			mod = NULL;
 	}
-	return NULL;
+	return mod;
 }
 
 EXPORT_SYMBOL(__module_text_address);
@@ -320,22 +561,23 @@ struct find_symbol_arg {
 	const struct kernel_symbol *sym;
 };
 
-static bool find_symbol_in_section(const struct symsearch *syms,
-				   struct module *owner, unsigned int symnum,
-				   void *data)
+// find_symbol_in - the symbol name of the table of owner, or the kernel's
+static bool find_symbol_in(struct find_symbol_arg *fsa, struct module *owner)
 {
-	struct find_symbol_arg *fsa = data;
-	kprintf
-	    ("\tfind_symbol_in_section: kernel symbol %s, searching for %s\n",
-	     syms->start[symnum].name, fsa->name);
-	if (strcmp(syms->start[symnum].name, fsa->name) != 0)
-		return 0;
+	const struct kernel_symbol *ks;
+	if (owner == NULL) {
+		ks = symhash_lookup(&kernel_symhash, fsa->name,
+				    __start___ksymtab, __stop___ksymtab);
+		fsa->crc = NULL;	/* no __start___kcrctab */
+	} else {
+		ks = symhash_lookup(&owner->symhash, fsa->name, owner->syms,
+				    owner->syms + owner->num_syms);
+		fsa->crc = (ks != NULL) ?
+		    symversion(owner->crcs, ks - owner->syms) : NULL;
+	}
 	fsa->owner = owner;
-	fsa->crc = symversion(syms->crcs, symnum);
-	fsa->sym = &syms->start[symnum];
-	kprintf("\tfind_symbol_in_section: symbol %s matched\n",
-		syms->start[symnum].name);
-	return 1;
+	fsa->sym = ks;
+	return ks != NULL;
 }
 
 const struct kernel_symbol *find_symbol(const char *name,
@@ -343,10 +585,17 @@ const struct kernel_symbol *find_symbol(const char *name,
 					const unsigned long **crc, bool warn)
 {
 	struct find_symbol_arg fsa;
+	struct module *mod = NULL;
 	fsa.name = name;
 	fsa.warn = warn;
 
-	if (each_symbol(find_symbol_in_section, &fsa)) {
+	bool found = find_symbol_in(&fsa, NULL);
+	list_entry_t *list = &(modules), *le = list;
+	while (!found && (le = list_next(le)) != list) {
+		mod = le2mod(le, list);
+		found = find_symbol_in(&fsa, mod);
+	}
+	if (found) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -411,6 +660,44 @@ unsigned long module_kallsyms_lookup_name(const char *name)
 	return ret;
 }
 
+// module_address_lookup_ - the text symbol of a module holding addr,
+//                        - copied to namebuf of MODULE_SYM_LEN, NULL if
+//                        - addr is in no module
+const char *module_address_lookup_(unsigned long addr,
+				   unsigned long *symbolsize,
+				   unsigned long *offset,
+				   char **modname, char *namebuf)
+{
+	struct module *mod = __module_address(addr);
+	struct symtab_s *sym, *best = NULL;
+	unsigned int i;
+	if (mod == NULL)
+		return NULL;
+	/* the init symbols are stale once init is freed */
+	int core = within_module_core(addr, mod);
+	for (i = 1; i < mod->num_symtab; i++) {
+		sym = mod->symtab + i;
+		if ((sym->st_info != 't' && sym->st_info != 'T')
+		    || mod->strtab[sym->st_name] == '\0'
+		    || sym->st_value > addr
+		    || within_module_core(sym->st_value, mod) != core)
+			continue;
+		if (best == NULL || sym->st_value > best->st_value)
+			best = sym;
+	}
+	if (best == NULL)
+		return NULL;
+	if (symbolsize)
+		*symbolsize = best->st_size;
+	if (offset)
+		*offset = addr - best->st_value;
+	if (modname)
+		*modname = mod->name;
+	strncpy(namebuf, mod->strtab + best->st_name, MODULE_SYM_LEN - 1);
+	namebuf[MODULE_SYM_LEN - 1] = '\0';
+	return namebuf;
+}
+
 int module_kallsyms_on_each_symbol(int (*fn)
 				    (void *, const char *, struct module *,
 				     unsigned long), void *data)
@@ -542,8 +829,10 @@ static void free_module(struct module *mod)
 {
 	__unlink_module(mod);
 	module_unload_free(mod);
+	symhash_free(&mod->symhash);
+	percpu_modfree(mod->percpu);
 	module_free(mod, mod->module_init);
-	module_free(mod, mod->module_core);
+	module_cache_put(mod);
 }
 
 /* Additional bytes needed by arch in front of individual sections */
@@ -658,6 +947,40 @@ static int verify_export_symbols(struct module *mod)
 	return 0;
 }
 
+// elf_type - the type of sym as nm prints it
+static char elf_type(const struct symtab_s *sym, struct secthdr *sechdrs)
+{
+	char c;
+	if (sym->st_shndx == SHN_UNDEF)
+		return 'U';
+	if (sym->st_shndx == SHN_ABS)
+		return 'a';
+	if (sym->st_shndx >= SHN_LORESERVE)
+		return '?';
+	if (sechdrs[sym->st_shndx].sh_flags & SHF_EXECINSTR)
+		c = 't';
+	else if (sechdrs[sym->st_shndx].sh_flags & SHF_WRITE)
+		c = 'd';
+	else
+		c = 'r';
+	if (ELF_ST_BIND(sym->st_info) == STB_GLOBAL)
+		c += 'A' - 'a';
+	return c;
+}
+
+// add_kallsyms - keep the symbols of mod, in its core, for the lookups
+//              - below, with their nm type in st_info
+static void add_kallsyms(struct module *mod, struct secthdr *sechdrs,
+			 unsigned int symindex, unsigned int strindex)
+{
+	unsigned int i;
+	mod->symtab = (void *)sechdrs[symindex].sh_addr;
+	mod->num_symtab = sechdrs[symindex].sh_size / sizeof(struct symtab_s);
+	mod->strtab = (void *)sechdrs[strindex].sh_addr;
+	for (i = 0; i < mod->num_symtab; i++)
+		mod->symtab[i].st_info = elf_type(mod->symtab + i, sechdrs);
+}
+
 static int simplify_symbols(struct secthdr *sechdrs,
 			    unsigned int symindex,
 			    const char *strtab,
@@ -712,6 +1035,29 @@ static int simplify_symbols(struct secthdr *sechdrs,
 	return ret;
 }
 
+// in_core_text - whether the section s is laid out in the text of the core
+static inline bool in_core_text(struct module *mod, struct secthdr *s)
+{
+	return !(s->sh_entsize & INIT_OFFSET_MASK)
+	    && (s->sh_flags & SHF_EXECINSTR)
+	    && s->sh_entsize < mod->core_text_size;
+}
+
+// undef_syms_hash - the values the undefined symbols of symtab resolved to,
+//                 - and those of the per-cpu vars, which move with the area
+static uint32_t undef_syms_hash(struct secthdr *sechdrs, unsigned int symindex,
+				unsigned int pcpuindex)
+{
+	struct symtab_s *sym = (void *)sechdrs[symindex].sh_addr;
+	unsigned int i, n = sechdrs[symindex].sh_size / sizeof(struct symtab_s);
+	uint32_t h = 0;
+	for (i = 1; i < n; i++)
+		if (sym[i].st_shndx == SHN_UNDEF
+		    || (pcpuindex != 0 && sym[i].st_shndx == pcpuindex))
+			h = h * 31 + (uint32_t) sym[i].st_value;
+	return h;
+}
+
 static const char vermagic[] = "";
 
 static noinline struct module *load_module(void __user * umod,
@@ -729,7 +1075,9 @@ static noinline struct module *load_module(void __user * umod,
 	unsigned int modindex, versindex, infoindex, pcpuindex;
 	struct module *mod;
 	long err = 0;
-	void *ptr = NULL;
+	void *ptr = NULL, *percpu = NULL;
+	uint32_t image_hash, syms_hash = 0;
+	bool cached = 0;
 
 	kprintf("load_module: umod=%p, len=%lu, uargs=%p\n", umod, len, uargs);
 
@@ -747,6 +1095,8 @@ static noinline struct module *load_module(void __user * umod,
 		goto free_hdr;
 	}
 	unlock_mm(mm);
+	/* before the section headers are written */
+	image_hash = image_hashfn(hdr, len);
 
 	kprintf("load_module: hdr:%p\n", hdr);
 	// sanity check
@@ -836,16 +1186,33 @@ static noinline struct module *load_module(void __user * umod,
 	// err = module_frob_arch_sections(hdr, sechdrs, secstrings, mod);
 	// TODO: we do not need it for x86 or arm
 
-	// TODO: percpu is no longer needed.
+	if (pcpuindex) {
+		/* not laid out with the others, it has an area of its own */
+		percpu = percpu_modalloc(sechdrs[pcpuindex].sh_size,
+					 sechdrs[pcpuindex].sh_addralign,
+					 mod->name);
+		if (percpu == NULL) {
+			goto free_mod;
+		}
+		mod->percpu = percpu;
+		sechdrs[pcpuindex].sh_flags &= ~(unsigned long)SHF_ALLOC;
+	}
 
 	layout_sections(mod, hdr, sechdrs, secstrings);
+	mod->image_len = len, mod->image_hash = image_hash;
 
-	ptr = module_alloc_update_bounds(mod->core_size);
-
-	if (!ptr) {
-		goto free_percpu;
+	if ((ptr = module_cache_get(mod, &syms_hash)) != NULL) {
+		kprintf("load_module: %s core cached\n", mod->name);
+		cached = 1;
+		memset(ptr + mod->core_text_size, 0,
+		       mod->core_size - mod->core_text_size);
+	} else {
+		ptr = module_alloc_update_bounds(mod->core_size);
+		if (!ptr) {
+			goto free_percpu;
+		}
+		memset(ptr, 0, mod->core_size);
 	}
-	memset(ptr, 0, mod->core_size);
 	mod->module_core = ptr;
 
 	ptr = module_alloc_update_bounds(mod->init_size);
@@ -870,7 +1237,8 @@ static noinline struct module *load_module(void __user * umod,
 			    (sechdrs[i].sh_entsize & ~INIT_OFFSET_MASK);
 		else
 			dest = mod->module_core + sechdrs[i].sh_entsize;
-		if (sechdrs[i].sh_type != SHT_NOBITS)
+		if (sechdrs[i].sh_type != SHT_NOBITS
+		    && !(cached && in_core_text(mod, sechdrs + i)))
 			memcpy(dest, (void *)sechdrs[i].sh_addr,
 			       sechdrs[i].sh_size);
 		sechdrs[i].sh_addr = (unsigned long)dest;
@@ -892,6 +1260,19 @@ static noinline struct module *load_module(void __user * umod,
 	if (err < 0)
 		goto cleanup;
 
+	/* the text kept was relocated against other values, copy it again */
+	mod->syms_hash = undef_syms_hash(sechdrs, symindex, pcpuindex);
+	if (cached && mod->syms_hash != syms_hash) {
+		for (i = 1; i < hdr->e_shnum; i++)
+			if ((sechdrs[i].sh_flags & SHF_ALLOC)
+			    && sechdrs[i].sh_type != SHT_NOBITS
+			    && in_core_text(mod, sechdrs + i))
+				memcpy((void *)sechdrs[i].sh_addr,
+				       (void *)hdr + sechdrs[i].sh_offset,
+				       sechdrs[i].sh_size);
+		cached = 0;
+	}
+
 	mod->syms = section_objs(hdr, sechdrs, secstrings, "__ksymtab",
 				 sizeof(*mod->syms), &mod->num_syms);
 	mod->crcs = section_addr(hdr, sechdrs, secstrings, "__kcrctab");
@@ -909,6 +1290,10 @@ static noinline struct module *load_module(void __user * umod,
 		if (!(sechdrs[info].sh_flags & SHF_ALLOC))
 			continue;
 
+		/* Nor with the text kept relocated */
+		if (cached && in_core_text(mod, sechdrs + info))
+			continue;
+
 		if (sechdrs[i].sh_type == SHT_REL)
 			err = apply_relocate(sechdrs, strtab, symindex, i, mod);
 		else if (sechdrs[i].sh_type == SHT_RELA)
@@ -924,13 +1309,23 @@ static noinline struct module *load_module(void __user * umod,
 	if (err < 0)
 		goto cleanup;
 
-	// TODO: kallsyms is left for future use.
-	//add_kallsyms(mod, sechdrs, symindex, strindex, secstrings);
+	/* the per-cpu area is zeroed, as is a section of no bits */
+	if (pcpuindex && sechdrs[pcpuindex].sh_type != SHT_NOBITS)
+		percpu_modcopy(mod->percpu, (void *)sechdrs[pcpuindex].sh_addr,
+			       sechdrs[pcpuindex].sh_size);
+
+	add_kallsyms(mod, sechdrs, symindex, strindex);
 
 	err = module_finalize(hdr, sechdrs, mod);
 	if (err < 0)
 		goto cleanup;
 
+	/* the exports are searched by name from now on */
+	if (symhash_build(&mod->symhash, mod->syms,
+			  mod->syms + mod->num_syms) != 0)
+		kprintf("%s: exports not hashed, searched in order\n",
+			mod->name);
+
 	list_add(&modules, &mod->list);
 
 	kfree(hdr);
@@ -946,6 +1341,7 @@ free_core:
 	module_free(mod, mod->module_core);
 
 free_percpu:
+	percpu_modfree(percpu);
 
 free_mod:
 
@@ -1084,4 +1480,7 @@ int module_finalize(const struct elfhdr *hdr,
 void mod_init()
 {
 	// TODO: read mod dep file
+	if (symhash_build(&kernel_symhash, __start___ksymtab,
+			  __stop___ksymtab) != 0)
+		kprintf("mod_init: kernel exports not hashed, searched in order\n");
 }
@@ -67,6 +67,17 @@ struct modversion_info {
 struct mod_arch_specific {
 };
 
+/* an export table hashed by name, open addressed: slot index + 1, or 0 */
+struct symhash_slot {
+	uint32_t hash;
+	uint32_t index;
+};
+
+struct symhash {
+	struct symhash_slot *slots;
+	unsigned int shift;
+};
+
 /*
  * We don't need these. They are obsolete.
 
@@ -105,6 +116,7 @@ struct module {
 	const struct kernel_symbol *syms;
 	const unsigned long *crcs;
 	unsigned int num_syms;
+	struct symhash symhash;
 
 	// startup function
 	int (*init) (void);
@@ -119,6 +131,11 @@ struct module {
 
 	unsigned int init_text_size, core_text_size;
 
+	// the image loaded and the values of its undefined symbols, which
+	// tell whether the text kept by the module cache can be reused
+	unsigned long image_len;
+	uint32_t image_hash, syms_hash;
+
 	struct mod_arch_specific arch;
 
 	unsigned int taints;
@@ -248,7 +265,8 @@ int use_module(struct module *a, struct module *b);
 	__mod ? __mod->name : "kernel";	\
 })
 
-// TODO:
+#define MODULE_SYM_LEN 128
+
 const char *module_address_lookup_(unsigned long addr,
 				   unsigned long *symbolsize,
 				   unsigned long *offset,
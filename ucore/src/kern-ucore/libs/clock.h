@@ -6,5 +6,18 @@
 extern volatile size_t ticks;
 void clock_init(void);
 void clock_init_ap(void);
+#ifdef UCONFIG_NO_HZ_IDLE
+/* tickless idle, see timer_nohz_enter */
+void tick_nohz_idle_enter(void);
+void tick_nohz_irq_enter(int trapno);
+void tick_nohz_idle_exit(void);
+#endif
+#ifdef UCONFIG_HIGH_RES_TIMERS
+/* the clock event of a cpu, for the hrtimers due before its next tick */
+void clock_event_program(uint64_t expires);
+bool clock_event_irq(void);
+#else
+#define clock_event_program(expires)    do { } while (0)
+#endif
 
 #endif
@@ -0,0 +1,48 @@
+#include <types.h>
+#include <string.h>
+#include <cpuset.h>
+#include <cmdline.h>
+
+// cmdline_arg - what follows name in the words of cmdline, NULL if no
+//             - word starts with it
+const char *cmdline_arg(const char *cmdline, const char *name)
+{
+	size_t len = strlen(name);
+	const char *p = cmdline;
+	while (p != NULL && *p != '\0') {
+		while (*p == ' ') {
+			p++;
+		}
+		if (strncmp(p, name, len) == 0) {
+			return p + len;
+		}
+		p = strchr(p, ' ');
+	}
+	return NULL;
+}
+
+// cpulist_parse - the cpus below ncpu of a list like 0-3,6 into set, false
+//               - if there is none
+bool cpulist_parse(const char *s, cpuset_t * set, int ncpu)
+{
+	char *end;
+	bool any = 0;
+	cpuset_clear(set);
+	while (*s >= '0' && *s <= '9') {
+		long first = strtol(s, &end, 10), last = first;
+		if (*end == '-') {
+			last = strtol(end + 1, &end, 10);
+		}
+		for (; first <= last; first++) {
+			if (first < ncpu) {
+				cpuset_set(set, first);
+				any = 1;
+			}
+		}
+		if (*end != ',') {
+			break;
+		}
+		s = end + 1;
+	}
+	return any;
+}
@@ -0,0 +1,11 @@
+#ifndef __LIBS_CMDLINE_H__
+#define __LIBS_CMDLINE_H__
+
+#include <types.h>
+#include <cpuset.h>
+
+/* the words of the command line the boot loader passes, like isolcpus=1-3 */
+const char *cmdline_arg(const char *cmdline, const char *name);
+bool cpulist_parse(const char *s, cpuset_t * set, int ncpu);
+
+#endif /* !__LIBS_CMDLINE_H__ */
@@ -48,5 +48,22 @@ static inline int cpuset_test(const cpuset_t *s, size_t bit)
 	return s->map[ __cpuset_bit_to_index(bit) ] & (0x01 << (bit & 0x7));
 }
 
+static inline void cpuset_clear(cpuset_t *s)
+{
+	int i;
+	for (i = 0; i < sizeof(s->map); i++)
+		s->map[i] = 0;
+}
+
+// cpuset_first - the lowest cpu of s below n, -1 if there is none
+static inline int cpuset_first(const cpuset_t *s, int n)
+{
+	int i;
+	for (i = 0; i < n && i < NCPU; i++)
+		if (cpuset_test(s, i))
+			return i;
+	return -1;
+}
+
 #endif
 
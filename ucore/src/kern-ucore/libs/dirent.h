@@ -26,4 +26,19 @@ struct dirent {
 
 };
 
+/* *
+ * dirent64 - a record of getdents: the records of the entries read follow
+ * each other in the buffer, d_reclen bytes apart. d_off is the cursor of
+ * the directory after the entry, which seek takes back to.
+ * */
+struct dirent64 {
+	uint64_t d_ino;		/* Inode number, 1 if unknown */
+	int64_t d_off;		/* Offset to the next entry */
+	unsigned short d_reclen;	/* Length of this record, 8 aligned */
+	char d_name[0];		/* Filename (null-terminated) */
+};
+
+#define DIRENT64_RECLEN(namelen)                                    \
+    ROUNDUP(offsetof(struct dirent64, d_name) + (namelen) + 1, 8)
+
 #endif /* !__LIBS_DIRENT_H__ */
@@ -0,0 +1,28 @@
+#ifndef __LIBS_EPOLL_H__
+#define __LIBS_EPOLL_H__
+
+#include <types.h>
+
+/* events */
+#define EPOLLIN                     0x001	/* there is data to read */
+#define EPOLLOUT                    0x004	/* there is room to write */
+#define EPOLLERR                    0x008	/* the other end is gone */
+#define EPOLLHUP                    0x010	/* closed, or no longer exists */
+/* report a source once per change instead of while it is ready */
+#define EPOLLET                     0x80000000
+
+/* epoll_ctl ops */
+#define EPOLL_CTL_ADD               1
+#define EPOLL_CTL_DEL               2
+#define EPOLL_CTL_MOD               3
+
+/* the kinds of sources, the id is a file descriptor or an mbox id */
+#define EPOLL_SRC_FD                0
+#define EPOLL_SRC_MBOX              1
+
+struct epoll_event {
+	uint32_t events;
+	uintptr_t data;
+};
+
+#endif /* !__LIBS_EPOLL_H__ */
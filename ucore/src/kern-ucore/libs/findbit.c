@@ -0,0 +1,164 @@
+#include <types.h>
+#include <string.h>
+#include <assert.h>
+#include <findbit.h>
+
+// quad_empty - if none of the 4 words from map has a bit set, once xored
+//            - with invert
+static inline bool quad_empty(const uint32_t * map, uint32_t invert)
+{
+	return ((map[0] ^ invert) | (map[1] ^ invert) | (map[2] ^ invert) |
+		(map[3] ^ invert)) == 0;
+}
+
+// find_next - the first bit from start on that is set once its word is
+//           - xored with invert
+static size_t find_next(const uint32_t * map, size_t size, size_t start,
+			uint32_t invert)
+{
+	size_t ix, end = BITS_TO_WORDS(size);
+	uint32_t w;
+	if (start >= size) {
+		return size;
+	}
+	ix = start / BITS_PER_WORD;
+	w = (map[ix] ^ invert) & (~0U << (start % BITS_PER_WORD));
+	while (w == 0) {
+		ix++;
+		while (ix + 4 <= end && quad_empty(map + ix, invert)) {
+			ix += 4;
+		}
+		if (ix >= end) {
+			return size;
+		}
+		w = map[ix] ^ invert;
+	}
+	start = ix * BITS_PER_WORD + word_ffs(w);
+	return (start < size) ? start : size;
+}
+
+size_t find_next_bit(const uint32_t * map, size_t size, size_t start)
+{
+	return find_next(map, size, start, 0);
+}
+
+size_t find_next_zero_bit(const uint32_t * map, size_t size, size_t start)
+{
+	return find_next(map, size, start, ~0U);
+}
+
+size_t find_last_bit(const uint32_t * map, size_t size)
+{
+	size_t ix;
+	uint32_t w;
+	if (size == 0) {
+		return size;
+	}
+	ix = (size - 1) / BITS_PER_WORD;
+	w = map[ix];
+	if (size % BITS_PER_WORD != 0) {
+		w &= (1U << (size % BITS_PER_WORD)) - 1;
+	}
+	while (w == 0) {
+		if (ix == 0) {
+			return size;
+		}
+		w = map[--ix];
+	}
+	return ix * BITS_PER_WORD + word_fls(w);
+}
+
+// find_next_area - the first of n set bits in a row from start on, which
+//                - end before size
+size_t find_next_area(const uint32_t * map, size_t size, size_t start,
+		      size_t n)
+{
+	size_t end;
+	assert(n != 0);
+	while ((start = find_next_bit(map, size, start)) < size) {
+		end = find_next_zero_bit(map, size, start);
+		if (end - start >= n) {
+			return start;
+		}
+		start = end;
+	}
+	return size;
+}
+
+// range_mask - the bits of the word of bit from bit on, and before end
+static inline uint32_t range_mask(size_t bit, size_t end, size_t * len)
+{
+	size_t off = bit % BITS_PER_WORD;
+	*len = BITS_PER_WORD - off;
+	if (*len > end - bit) {
+		*len = end - bit;
+	}
+	return (*len == BITS_PER_WORD) ? ~0U : ((1U << *len) - 1) << off;
+}
+
+void bits_set_range(uint32_t * map, size_t start, size_t n)
+{
+	size_t end = start + n, len;
+	for (; start < end; start += len) {
+		map[start / BITS_PER_WORD] |= range_mask(start, end, &len);
+	}
+}
+
+void bits_clear_range(uint32_t * map, size_t start, size_t n)
+{
+	size_t end = start + n, len;
+	for (; start < end; start += len) {
+		map[start / BITS_PER_WORD] &= ~range_mask(start, end, &len);
+	}
+}
+
+// bits_weight - the # of set bits of the n from start
+size_t bits_weight(const uint32_t * map, size_t start, size_t n)
+{
+	size_t end = start + n, len, weight = 0;
+	for (; start < end; start += len) {
+		weight += word_weight(map[start / BITS_PER_WORD] &
+				      range_mask(start, end, &len));
+	}
+	return weight;
+}
+
+void check_findbit(void)
+{
+	const size_t size = 300;
+	uint32_t map[BITS_TO_WORDS(300)];
+	size_t i;
+	memset(map, 0, sizeof(map));
+	assert(find_first_bit(map, size) == size);
+	assert(find_first_zero_bit(map, size) == 0);
+	assert(find_last_bit(map, size) == size);
+
+	bits_set(map, 5), bits_set(map, 200), bits_set(map, 299);
+	assert(find_first_bit(map, size) == 5);
+	assert(find_next_bit(map, size, 6) == 200);
+	assert(find_next_bit(map, size, 201) == 299);
+	assert(find_next_bit(map, 299, 201) == 299);
+	assert(find_last_bit(map, size) == 299);
+	assert(find_last_bit(map, 299) == 200);
+	assert(bits_weight(map, 0, size) == 3);
+
+	bits_set_range(map, 40, 100);
+	assert(bits_weight(map, 0, size) == 103);
+	assert(find_next_bit(map, size, 6) == 40);
+	assert(find_next_zero_bit(map, size, 40) == 140);
+	assert(find_next_area(map, size, 0, 2) == 40);
+	assert(find_next_area(map, size, 41, 100) == size);
+	assert(find_next_area(map, size, 41, 99) == 41);
+	bits_clear_range(map, 63, 2);
+	assert(!bits_test(map, 63) && !bits_test(map, 64));
+	assert(bits_test(map, 62) && bits_test(map, 65));
+	assert(find_next_area(map, size, 0, 30) == 65);
+
+	memset(map, 0xFF, sizeof(map));
+	assert(find_first_zero_bit(map, size) == size);
+	bits_clear(map, 257);
+	assert(find_first_zero_bit(map, size) == 257);
+	for (i = 0; i < size; i++) {
+		assert(bits_test(map, i) == (i != 257));
+	}
+}
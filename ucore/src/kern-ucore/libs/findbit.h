@@ -0,0 +1,78 @@
+#ifndef __KERN_LIBS_FINDBIT_H__
+#define __KERN_LIBS_FINDBIT_H__
+
+#include <types.h>
+
+/* *
+ * Bit maps as arrays of 32-bit words, bit i being bit i % 32 of word i / 32.
+ * The searches go a word at a time, with bsf/bsr on x86, and skip runs of
+ * words with nothing to find four words per test. They return the bit found,
+ * or size if there is none; the bits at and past size are never looked at.
+ * */
+#define BITS_PER_WORD               32
+#define BITS_TO_WORDS(nbits)        (((nbits) + BITS_PER_WORD - 1) / BITS_PER_WORD)
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <bitsearch.h>
+
+// word_ffs - the lowest set bit of w, which is not 0
+static inline int word_ffs(uint32_t w)
+{
+	return bsf(w);
+}
+
+// word_fls - the highest set bit of w, which is not 0
+static inline int word_fls(uint32_t w)
+{
+	return bsr(w);
+}
+#else
+static inline int word_ffs(uint32_t w)
+{
+	return __builtin_ctz(w);
+}
+
+static inline int word_fls(uint32_t w)
+{
+	return BITS_PER_WORD - 1 - __builtin_clz(w);
+}
+#endif
+
+/* the kernel is not linked with libgcc, which __builtin_popcount needs */
+static inline uint32_t word_weight(uint32_t w)
+{
+	w = w - ((w >> 1) & 0x55555555);
+	w = (w & 0x33333333) + ((w >> 2) & 0x33333333);
+	return (((w + (w >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+static inline void bits_set(uint32_t * map, size_t bit)
+{
+	map[bit / BITS_PER_WORD] |= 1U << (bit % BITS_PER_WORD);
+}
+
+static inline void bits_clear(uint32_t * map, size_t bit)
+{
+	map[bit / BITS_PER_WORD] &= ~(1U << (bit % BITS_PER_WORD));
+}
+
+static inline bool bits_test(const uint32_t * map, size_t bit)
+{
+	return (map[bit / BITS_PER_WORD] >> (bit % BITS_PER_WORD)) & 1;
+}
+
+size_t find_next_bit(const uint32_t * map, size_t size, size_t start);
+size_t find_next_zero_bit(const uint32_t * map, size_t size, size_t start);
+size_t find_last_bit(const uint32_t * map, size_t size);
+size_t find_next_area(const uint32_t * map, size_t size, size_t start,
+		      size_t n);
+void bits_set_range(uint32_t * map, size_t start, size_t n);
+void bits_clear_range(uint32_t * map, size_t start, size_t n);
+size_t bits_weight(const uint32_t * map, size_t start, size_t n);
+
+#define find_first_bit(map, size)           find_next_bit(map, size, 0)
+#define find_first_zero_bit(map, size)      find_next_zero_bit(map, size, 0)
+
+void check_findbit(void);
+
+#endif /* !__KERN_LIBS_FINDBIT_H__ */
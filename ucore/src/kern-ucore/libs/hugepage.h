@@ -0,0 +1,14 @@
+#ifndef __LIBS_HUGEPAGE_H__
+#define __LIBS_HUGEPAGE_H__
+
+#include <types.h>
+
+/* transparent huge page counters, read by SYS_thp_stat */
+struct thp_stat {
+	size_t fault_alloc;	// faults served with a huge page
+	size_t fault_fallback;	// huge faults that fell back to 4K pages
+	size_t split;		// huge mappings split into page tables
+	size_t mapped;		// huge mappings alive now
+};
+
+#endif /* !__LIBS_HUGEPAGE_H__ */
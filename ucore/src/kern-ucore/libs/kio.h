@@ -9,6 +9,10 @@ int cons_getc(void);
 
 int kprintf(const char *fmt, ...);
 int vkprintf(const char *fmt, va_list ap);
+#ifdef UCONFIG_KLOG
+void klog_init(void);
+void klog_flush(void);
+#endif
 
 /* libs/readline.c */
 char *readline(const char *prompt);
@@ -0,0 +1,23 @@
+#include <types.h>
+#include <stdio.h>
+#include <loghist.h>
+
+// log2_hist_show - a line of h, the sum then the counts of its buckets,
+//                - after name into buf of size bytes; its length
+size_t log2_hist_show(const struct log2_hist *h, const char *name,
+		      char *buf, size_t size)
+{
+	size_t len;
+	int i;
+	if (size == 0) {
+		return 0;
+	}
+	len = snprintf(buf, size, "%s %llu", name, h->sum_ns);
+	for (i = 0; i < LOG2_HIST_BUCKETS && len < size; i++) {
+		len += snprintf(buf + len, size - len, " %u", h->count[i]);
+	}
+	if (len < size) {
+		len += snprintf(buf + len, size - len, "\n");
+	}
+	return (len < size) ? len : size;
+}
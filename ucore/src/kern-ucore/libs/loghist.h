@@ -0,0 +1,33 @@
+#ifndef __KERN_LIBS_LOGHIST_H__
+#define __KERN_LIBS_LOGHIST_H__
+
+#include <types.h>
+
+/* *
+ * Latency histograms. The times are in ns and binned by log2 of their us
+ * (1024 ns, so that no 64-bit division is needed): bucket 0 counts those
+ * under 1us, bucket i those in [2^(i-1), 2^i) us, and the last one all the
+ * longer ones. The sum is kept too, for the mean.
+ * */
+#define LOG2_HIST_BUCKETS           24
+
+struct log2_hist {
+	uint32_t count[LOG2_HIST_BUCKETS];
+	uint64_t sum_ns;
+};
+
+static inline void log2_hist_add(struct log2_hist *h, uint64_t ns)
+{
+	uint64_t us = ns >> 10;
+	int i = 0;
+	while (us != 0 && i < LOG2_HIST_BUCKETS - 1) {
+		us >>= 1, i++;
+	}
+	h->count[i]++;
+	h->sum_ns += ns;
+}
+
+size_t log2_hist_show(const struct log2_hist *h, const char *name,
+		      char *buf, size_t size);
+
+#endif /* !__KERN_LIBS_LOGHIST_H__ */
@@ -0,0 +1,179 @@
+#include <types.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <lz4.h>
+
+/*
+ * A sequence is a token, whose high nibble is the # of literals and low one
+ * the length of the match less LZ4_MINMATCH, 15 meaning that bytes adding
+ * up the rest follow; then the literals, and the offset back to the match
+ * in 2 bytes, little endian. The last sequence has literals only; the
+ * last match starts LZ4_MFLIMIT bytes before the end at the latest and
+ * ends LZ4_LASTLITERALS before it.
+ */
+
+#define LZ4_MINMATCH                    4
+#define LZ4_LASTLITERALS                5
+#define LZ4_MFLIMIT                     12
+#define LZ4_MAX_OFFSET                  0xFFFF
+
+static inline uint32_t lz4_read32(const uint8_t * p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// lz4_put_length - the bytes of the rest of a length, or NULL if past oend
+static uint8_t *lz4_put_length(uint8_t * op, uint8_t * oend, size_t len)
+{
+	for (; len >= 255; len -= 255) {
+		if (op >= oend) {
+			return NULL;
+		}
+		*op++ = 255;
+	}
+	if (op >= oend) {
+		return NULL;
+	}
+	*op++ = len;
+	return op;
+}
+
+// lz4_put_seq - a sequence of the literals from anchor and a match
+static uint8_t *lz4_put_seq(uint8_t * op, uint8_t * oend,
+			    const uint8_t * anchor, size_t lit, size_t offset,
+			    size_t mlen, bool last)
+{
+	uint8_t *token = op++;
+	if (token >= oend) {
+		return NULL;
+	}
+	*token = ((lit >= 15) ? 15 : lit) << 4;
+	if (lit >= 15 && (op = lz4_put_length(op, oend, lit - 15)) == NULL) {
+		return NULL;
+	}
+	if ((size_t)(oend - op) < lit) {
+		return NULL;
+	}
+	memcpy(op, anchor, lit);
+	op += lit;
+	if (last) {
+		return op;
+	}
+	if (oend - op < 2) {
+		return NULL;
+	}
+	*op++ = offset & 0xFF, *op++ = offset >> 8;
+	*token |= (mlen >= 15) ? 15 : mlen;
+	if (mlen >= 15) {
+		op = lz4_put_length(op, oend, mlen - 15);
+	}
+	return op;
+}
+
+/*
+ * lz4_compress - compress the n bytes of src into the cap bytes of dst.
+ * Returns the # of bytes of the block, or 0 if it does not fit in cap.
+ */
+size_t lz4_compress(const void *src, size_t n, void *dst, size_t cap,
+		    void *table)
+{
+	const uint8_t *base = src, *ip = base, *anchor = base;
+	const uint8_t *iend = base + n, *mlimit = iend - LZ4_MFLIMIT;
+	uint8_t *op = dst, *oend = op + cap;
+	uint16_t *pos = table;
+	assert(n <= LZ4_MAX_INPUT);
+
+	memset(table, 0, LZ4_TABLE_SIZE);
+	if (n >= LZ4_MFLIMIT) {
+		for (ip++; ip <= mlimit;) {
+			uint32_t seq = lz4_read32(ip);
+			uint32_t h = hash32(seq, LZ4_HASH_BITS);
+			const uint8_t *ref = base + pos[h];
+			pos[h] = ip - base;
+			if (ip - ref > LZ4_MAX_OFFSET || lz4_read32(ref) != seq) {
+				ip++;
+				continue;
+			}
+			const uint8_t *mp = ip + LZ4_MINMATCH;
+			const uint8_t *rp = ref + LZ4_MINMATCH;
+			while (mp < iend - LZ4_LASTLITERALS && *mp == *rp) {
+				mp++, rp++;
+			}
+			op = lz4_put_seq(op, oend, anchor, ip - anchor, ip - ref,
+					 mp - ip - LZ4_MINMATCH, 0);
+			if (op == NULL) {
+				return 0;
+			}
+			ip = anchor = mp;
+		}
+	}
+	op = lz4_put_seq(op, oend, anchor, iend - anchor, 0, 0, 1);
+	return (op == NULL) ? 0 : op - (uint8_t *) dst;
+}
+
+// lz4_get_length - add the bytes of the rest of a length to *lenp
+static int lz4_get_length(const uint8_t ** ipp, const uint8_t * iend,
+			  size_t * lenp)
+{
+	uint8_t b;
+	do {
+		if (*ipp >= iend) {
+			return -1;
+		}
+		b = *(*ipp)++;
+		*lenp += b;
+	} while (b == 255);
+	return 0;
+}
+
+/*
+ * lz4_decompress - decompress the block of n bytes at src into the cap
+ * bytes of dst. Returns the # of bytes decompressed, or -1 if the block is
+ * corrupt or does not fit in cap.
+ */
+int lz4_decompress(const void *src, size_t n, void *dst, size_t cap)
+{
+	const uint8_t *ip = src, *iend = ip + n;
+	uint8_t *ostart = dst, *op = ostart, *oend = op + cap;
+	while (ip < iend) {
+		uint8_t token = *ip++;
+		size_t len = token >> 4;
+		if (len == 15 && lz4_get_length(&ip, iend, &len) != 0) {
+			return -1;
+		}
+		if ((size_t)(iend - ip) < len || (size_t)(oend - op) < len) {
+			return -1;
+		}
+		memcpy(op, ip, len);
+		op += len, ip += len;
+		if (ip == iend) {
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return -1;
+		}
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - ostart)) {
+			return -1;
+		}
+		len = token & 15;
+		if (len == 15 && lz4_get_length(&ip, iend, &len) != 0) {
+			return -1;
+		}
+		len += LZ4_MINMATCH;
+		if ((size_t)(oend - op) < len) {
+			return -1;
+		}
+		/* the match may overlap what it writes, copy bytewise */
+		const uint8_t *ref = op - offset;
+		while (len-- > 0) {
+			*op++ = *ref++;
+		}
+	}
+	return op - ostart;
+}
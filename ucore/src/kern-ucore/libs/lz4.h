@@ -0,0 +1,18 @@
+#ifndef __LIBS_LZ4_H__
+#define __LIBS_LZ4_H__
+
+#include <types.h>
+
+/*
+ * The LZ4 block format, without the frame around it. The compressor takes
+ * up to LZ4_MAX_INPUT bytes and a table of LZ4_TABLE_SIZE bytes to work in.
+ */
+#define LZ4_HASH_BITS                   10
+#define LZ4_TABLE_SIZE                  (sizeof(uint16_t) << LZ4_HASH_BITS)
+#define LZ4_MAX_INPUT                   0x10000
+
+size_t lz4_compress(const void *src, size_t n, void *dst, size_t cap,
+		    void *table);
+int lz4_decompress(const void *src, size_t n, void *dst, size_t cap);
+
+#endif /* !__LIBS_LZ4_H__ */
@@ -5,6 +5,8 @@
 
 #define MAX_MSG_SLOTS               0x1000
 #define MAX_MSG_BYTES               0x10000
+/* the messages moved by one SYS_mbox_sendm or SYS_mbox_recvm */
+#define MAX_MSG_BATCH               16
 
 struct mboxbuf {
 	int from;
@@ -0,0 +1,23 @@
+#ifndef __LIBS_MEMGROUP_H__
+#define __LIBS_MEMGROUP_H__
+
+#include <types.h>
+
+/* SYS_memcg ops, the sizes in bytes */
+#define MEMCG_CREATE                1	// a child of group id (0: top), of limit and soft limit
+#define MEMCG_DESTROY               2	// once nothing is in it
+#define MEMCG_SET_LIMIT             3	// limit and soft limit, 0 for none
+#define MEMCG_ATTACH                4	// move proc arg0 (0: current) to id (0: none)
+#define MEMCG_STAT                  5	// the struct memcg_stat of id, into arg1
+
+/* the accounting of a memory group and its children, read by MEMCG_STAT */
+struct memcg_stat {
+	size_t usage;		// bytes charged now
+	size_t max_usage;	// the most ever charged
+	size_t limit;		// 0 for none
+	size_t soft_limit;
+	size_t failcnt;		// charges failed at the limit
+	size_t reclaimed;	// bytes reclaim took from it
+};
+
+#endif /* !__LIBS_MEMGROUP_H__ */
@@ -0,0 +1,56 @@
+#ifndef __LIBS_MEMORDER_H__
+#define __LIBS_MEMORDER_H__
+
+#include <types.h>
+#include <arch.h>
+#include <atomic.h>
+
+/* *
+ * The order in which the other cpus see the memory accesses of this one.
+ *
+ *   READ_ONCE, WRITE_ONCE - one access, which the compiler neither tears,
+ *                           merges, repeats nor moves across another
+ *   smp_mb                - orders the accesses before it with those after
+ *   smp_rmb, smp_wmb      - the same for the loads, for the stores only
+ *   smp_load_acquire      - a load that no later access moves before
+ *   smp_store_release     - a store that no earlier access moves after
+ *
+ * arch.h defines what its cpu does for less than a full fence: on x86 only
+ * a store followed by a load is reordered, so that all but smp_mb are
+ * compiler barriers; arm takes a dmb where it has several cores. smp_acqrel
+ * is the fence that makes a plain access an acquire or a release. What an
+ * arch leaves out is __sync_synchronize, which is right everywhere.
+ *
+ * The atomic_t ops that return a value are full barriers already.
+ * */
+
+#ifndef barrier
+#define barrier()                   __asm__ __volatile__ ("" ::: "memory")
+#endif
+
+#define READ_ONCE(x)                (*(const volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, v)                            \
+    do { *(volatile __typeof__(x) *)&(x) = (v); } while (0)
+
+#ifndef smp_mb
+#define smp_mb()                    __sync_synchronize()
+#endif
+#ifndef smp_rmb
+#define smp_rmb()                   smp_mb()
+#endif
+#ifndef smp_wmb
+#define smp_wmb()                   smp_mb()
+#endif
+#ifndef smp_acqrel
+#define smp_acqrel()                smp_mb()
+#endif
+
+#define smp_load_acquire(p)                         \
+    ({ __typeof__(*(p)) ___v = READ_ONCE(*(p)); smp_acqrel(); ___v; })
+#define smp_store_release(p, v)                     \
+    do { smp_acqrel(); WRITE_ONCE(*(p), (v)); } while (0)
+
+#define atomic_read_acquire(v)      smp_load_acquire(&(v)->counter)
+#define atomic_set_release(v, i)    smp_store_release(&(v)->counter, (i))
+
+#endif /* !__LIBS_MEMORDER_H__ */
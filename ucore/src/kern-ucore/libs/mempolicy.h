@@ -0,0 +1,32 @@
+#ifndef __LIBS_MEMPOLICY_H__
+#define __LIBS_MEMPOLICY_H__
+
+#include <types.h>
+
+/* where the user pages of a mm are placed, set by SYS_mempolicy */
+#define MPOL_LOCAL                  0	// node of the faulting cpu first
+#define MPOL_INTERLEAVE             1	// spread page by page over all nodes
+#define MPOL_BIND                   2	// only the given node
+
+/* page allocation counters of a numa node, read by SYS_numa_stat */
+struct numa_stat {
+	size_t hit;		// placed on this node as the policy wanted
+	size_t miss;		// placed on this node, but wanted elsewhere
+	size_t foreign;		// wanted on this node, but placed elsewhere
+	size_t interleave;	// interleaved pages that hit this node
+};
+
+#define NUMA_INFO_NODES             16	// nodes reported, at most
+#define NUMA_INFO_CPUS              64	// cpus listed of a node, at most
+
+/* the topology of a numa node, read by SYS_numa_info */
+struct numa_info {
+	int nr_nodes;		// of the machine
+	int nr_cpus;		// of this node, listed in cpus
+	int cpus[NUMA_INFO_CPUS];
+	size_t nr_pages;	// memory of this node
+	uint8_t distance[NUMA_INFO_NODES];	// to each node, 10 to itself
+	uint8_t fallback[NUMA_INFO_NODES];	// the others, nearest first
+};
+
+#endif /* !__LIBS_MEMPOLICY_H__ */
@@ -56,6 +56,11 @@ static const char *const error_string[MAXERROR + 1] = {
 	[E_KILLED] "Process is killed",
 	[E_UNSPECIFIED] "Unspecified or unknown problem",
 	[E_SWAP_FAULT] "SWAP READ/WRITE fault",
+	[E_DEADLK] "Resource deadlock would occur",
+	[E_ADDRINUSE] "Address already in use",
+	[E_NOTCONN] "Socket is not connected",
+	[E_CONNREFUSED] "Connection refused",
+	[E_CONNRESET] "Connection reset by peer",
 };
 
 /* *
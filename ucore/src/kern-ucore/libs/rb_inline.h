@@ -0,0 +1,299 @@
+#ifndef __KERN_LIBS_RB_INLINE_H__
+#define __KERN_LIBS_RB_INLINE_H__
+
+#include <types.h>
+
+/* *
+ * Intrusive red-black trees with the order and the augmentation compiled
+ * in, where rb_tree calls them through pointers.
+ *
+ * RB_INLINE_GENERATE(name, type, field, less, augment) defines name_insert,
+ * name_remove and name_update for trees of type linked by its struct
+ * rbi_node field. The tree is ordered by less(a, b), true if a goes left of
+ * b; an element equal to some goes right of them. augment(elm) recomputes
+ * what elm keeps of its subtree from elm and its children, called bottom up
+ * on each node whose subtree changes, or RBI_NO_AUGMENT. The struct
+ * rbi_root is embedded by the user: nothing is allocated. There is no
+ * search by key, the user walks down from root->node with its own compare.
+ * */
+struct rbi_node {
+	struct rbi_node *parent, *left, *right;
+	bool red;
+};
+
+struct rbi_root {
+	struct rbi_node *node;
+	struct rbi_node *leftmost;	// the first node, or NULL
+};
+
+#define RBI_NO_AUGMENT(elm)         do { } while (0)
+
+static inline void rbi_root_init(struct rbi_root *root)
+{
+	root->node = root->leftmost = NULL;
+}
+
+static inline bool rbi_empty(struct rbi_root *root)
+{
+	return root->node == NULL;
+}
+
+static inline struct rbi_node *rbi_first(struct rbi_root *root)
+{
+	return root->leftmost;
+}
+
+static inline struct rbi_node *rbi_last(struct rbi_root *root)
+{
+	struct rbi_node *node = root->node;
+	if (node != NULL) {
+		while (node->right != NULL) {
+			node = node->right;
+		}
+	}
+	return node;
+}
+
+static inline struct rbi_node *rbi_next(struct rbi_node *node)
+{
+	struct rbi_node *parent;
+	if (node->right != NULL) {
+		node = node->right;
+		while (node->left != NULL) {
+			node = node->left;
+		}
+		return node;
+	}
+	while ((parent = node->parent) != NULL && node == parent->right) {
+		node = parent;
+	}
+	return parent;
+}
+
+static inline struct rbi_node *rbi_prev(struct rbi_node *node)
+{
+	struct rbi_node *parent;
+	if (node->left != NULL) {
+		node = node->left;
+		while (node->right != NULL) {
+			node = node->right;
+		}
+		return node;
+	}
+	while ((parent = node->parent) != NULL && node == parent->left) {
+		node = parent;
+	}
+	return parent;
+}
+
+// rbi_replace - put node in the place of old under parent, the parent of old
+static inline void
+rbi_replace(struct rbi_root *root, struct rbi_node *old,
+	    struct rbi_node *node, struct rbi_node *parent)
+{
+	if (parent == NULL) {
+		root->node = node;
+	} else if (parent->left == old) {
+		parent->left = node;
+	} else {
+		parent->right = node;
+	}
+	if (node != NULL) {
+		node->parent = parent;
+	}
+}
+
+static inline bool rbi_is_red(struct rbi_node *node)
+{
+	return node != NULL && node->red;
+}
+
+#define RB_INLINE_GENERATE(name, type, field, less, augment)            \
+                                                                        \
+static inline void name##_augment(struct rbi_node *node)                \
+{                                                                       \
+    augment(to_struct(node, type, field));                              \
+}                                                                       \
+                                                                        \
+/* name_update - recompute elm and its ancestors, after what elm keeps  \
+ * of itself changed in place, not its order */                         \
+static inline void name##_update_node(struct rbi_node *node)            \
+{                                                                       \
+    for (; node != NULL; node = node->parent) {                         \
+        name##_augment(node);                                           \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static inline void name##_update(type *elm)                             \
+{                                                                       \
+    name##_update_node(&((elm)->field));                                \
+}                                                                       \
+                                                                        \
+static inline void                                                      \
+name##_rotate_left(struct rbi_root *root, struct rbi_node *x)           \
+{                                                                       \
+    struct rbi_node *y = x->right;                                      \
+    if ((x->right = y->left) != NULL) {                                 \
+        y->left->parent = x;                                            \
+    }                                                                   \
+    rbi_replace(root, x, y, x->parent);                                 \
+    y->left = x, x->parent = y;                                         \
+    name##_augment(x);                                                  \
+    name##_augment(y);                                                  \
+}                                                                       \
+                                                                        \
+static inline void                                                      \
+name##_rotate_right(struct rbi_root *root, struct rbi_node *x)          \
+{                                                                       \
+    struct rbi_node *y = x->left;                                       \
+    if ((x->left = y->right) != NULL) {                                 \
+        y->right->parent = x;                                           \
+    }                                                                   \
+    rbi_replace(root, x, y, x->parent);                                 \
+    y->right = x, x->parent = y;                                        \
+    name##_augment(x);                                                  \
+    name##_augment(y);                                                  \
+}                                                                       \
+                                                                        \
+static void name##_insert(struct rbi_root *root, type *elm)             \
+{                                                                       \
+    struct rbi_node *node = &((elm)->field), *parent = NULL, *g, *u;    \
+    struct rbi_node **link = &(root->node);                             \
+    bool leftmost = 1;                                                  \
+    while (*link != NULL) {                                             \
+        parent = *link;                                                 \
+        if (less(elm, to_struct(parent, type, field))) {                \
+            link = &(parent->left);                                     \
+        } else {                                                        \
+            link = &(parent->right), leftmost = 0;                      \
+        }                                                               \
+    }                                                                   \
+    node->parent = parent, node->left = node->right = NULL;             \
+    node->red = 1;                                                      \
+    *link = node;                                                       \
+    if (leftmost) {                                                     \
+        root->leftmost = node;                                          \
+    }                                                                   \
+    name##_update_node(node);                                           \
+    while ((parent = node->parent) != NULL && parent->red) {            \
+        g = parent->parent;                                             \
+        if (parent == g->left) {                                        \
+            if (rbi_is_red(u = g->right)) {                             \
+                parent->red = u->red = 0, g->red = 1;                   \
+                node = g;                                               \
+                continue;                                               \
+            }                                                           \
+            if (node == parent->right) {                                \
+                name##_rotate_left(root, parent);                       \
+                node = parent, parent = node->parent;                   \
+            }                                                           \
+            parent->red = 0, g->red = 1;                                \
+            name##_rotate_right(root, g);                               \
+        } else {                                                        \
+            if (rbi_is_red(u = g->left)) {                              \
+                parent->red = u->red = 0, g->red = 1;                   \
+                node = g;                                               \
+                continue;                                               \
+            }                                                           \
+            if (node == parent->left) {                                 \
+                name##_rotate_right(root, parent);                      \
+                node = parent, parent = node->parent;                   \
+            }                                                           \
+            parent->red = 0, g->red = 1;                                \
+            name##_rotate_left(root, g);                                \
+        }                                                               \
+    }                                                                   \
+    root->node->red = 0;                                                \
+}                                                                       \
+                                                                        \
+/* name_remove_fixup - node, maybe NULL, under parent lacks a black */  \
+static void name##_remove_fixup(struct rbi_root *root,                  \
+                                struct rbi_node *node,                  \
+                                struct rbi_node *parent)                \
+{                                                                       \
+    struct rbi_node *w;                                                 \
+    while (node != root->node && !rbi_is_red(node)) {                   \
+        if (node == parent->left) {                                     \
+            if ((w = parent->right)->red) {                             \
+                w->red = 0, parent->red = 1;                            \
+                name##_rotate_left(root, parent);                       \
+                w = parent->right;                                      \
+            }                                                           \
+            if (!rbi_is_red(w->left) && !rbi_is_red(w->right)) {        \
+                w->red = 1;                                             \
+                node = parent, parent = node->parent;                   \
+                continue;                                               \
+            }                                                           \
+            if (!rbi_is_red(w->right)) {                                \
+                w->left->red = 0, w->red = 1;                           \
+                name##_rotate_right(root, w);                           \
+                w = parent->right;                                      \
+            }                                                           \
+            w->red = parent->red, parent->red = 0;                      \
+            w->right->red = 0;                                          \
+            name##_rotate_left(root, parent);                           \
+        } else {                                                        \
+            if ((w = parent->left)->red) {                              \
+                w->red = 0, parent->red = 1;                            \
+                name##_rotate_right(root, parent);                      \
+                w = parent->left;                                       \
+            }                                                           \
+            if (!rbi_is_red(w->left) && !rbi_is_red(w->right)) {        \
+                w->red = 1;                                             \
+                node = parent, parent = node->parent;                   \
+                continue;                                               \
+            }                                                           \
+            if (!rbi_is_red(w->left)) {                                 \
+                w->right->red = 0, w->red = 1;                          \
+                name##_rotate_left(root, w);                            \
+                w = parent->left;                                       \
+            }                                                           \
+            w->red = parent->red, parent->red = 0;                      \
+            w->left->red = 0;                                           \
+            name##_rotate_right(root, parent);                          \
+        }                                                               \
+        node = root->node;                                              \
+    }                                                                   \
+    if (node != NULL) {                                                 \
+        node->red = 0;                                                  \
+    }                                                                   \
+}                                                                       \
+                                                                        \
+static void name##_remove(struct rbi_root *root, type *elm)             \
+{                                                                       \
+    struct rbi_node *z = &((elm)->field), *y, *child, *parent;          \
+    bool red;                                                           \
+    if (root->leftmost == z) {                                          \
+        root->leftmost = rbi_next(z);                                   \
+    }                                                                   \
+    if (z->left == NULL || z->right == NULL) {                          \
+        child = (z->left != NULL) ? z->left : z->right;                 \
+        parent = z->parent, red = z->red;                               \
+        rbi_replace(root, z, child, parent);                            \
+    } else {                                                            \
+        /* z is replaced by its successor y, taken out of its place */  \
+        for (y = z->right; y->left != NULL; y = y->left) {              \
+        }                                                               \
+        child = y->right, red = y->red;                                 \
+        if (y->parent == z) {                                           \
+            parent = y;                                                 \
+        } else {                                                        \
+            parent = y->parent;                                         \
+            if ((parent->left = child) != NULL) {                       \
+                child->parent = parent;                                 \
+            }                                                           \
+            y->right = z->right, z->right->parent = y;                  \
+        }                                                               \
+        y->left = z->left, z->left->parent = y;                         \
+        y->red = z->red;                                                \
+        rbi_replace(root, z, y, z->parent);                             \
+    }                                                                   \
+    name##_update_node(parent);                                         \
+    if (!red) {                                                         \
+        name##_remove_fixup(root, child, parent);                       \
+    }                                                                   \
+}
+
+void check_rb_inline(void);
+
+#endif /* !__KERN_LIBS_RB_INLINE_H__ */
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <slab.h>
 #include <rb_tree.h>
+#include <rb_inline.h>
 #include <assert.h>
 
 /* rb_node_create - create a new rb_node */
@@ -27,6 +28,20 @@ static inline bool rb_tree_empty(rb_tree * tree)
  * black and may have arbitrary children and parent node.
  * */
 rb_tree *rb_tree_create(int (*compare) (rb_node * node1, rb_node * node2))
+{
+	return rb_tree_create_augmented(compare, NULL);
+}
+
+/* *
+ * rb_tree_create_augmented - creates a red-black tree whose nodes keep a
+ * value of their subtree, as the widest hole between the vmas of it: the
+ * 'update' function recomputes it on a node from the node and its children,
+ * and is called bottom up on each node whose subtree changes.
+ * */
+rb_tree *rb_tree_create_augmented(int (*compare) (rb_node * node1,
+						  rb_node * node2),
+				  void (*update) (rb_tree * tree,
+						  rb_node * node))
 {
 	assert(compare != NULL);
 
@@ -38,6 +53,7 @@ rb_tree *rb_tree_create(int (*compare) (rb_node * node1, rb_node * node2))
 	}
 
 	tree->compare = compare;
+	tree->update = update;
 
 	if ((nil = rb_node_create()) == NULL) {
 		goto bad_node_cleanup_tree;
@@ -94,6 +110,10 @@ func_name(rb_tree *tree, rb_node *x) {                          \
     }                                                           \
     y->_left = x;                                               \
     x->parent = y;                                              \
+    if (tree->update != NULL) {                                 \
+        tree->update(tree, x);                                  \
+        tree->update(tree, y);                                  \
+    }                                                           \
     assert(!(nil->red));                                        \
 }
 
@@ -133,6 +153,7 @@ void rb_insert(rb_tree * tree, rb_node * node)
 {
 	rb_insert_binary(tree, node);
 	node->red = 1;
+	rb_node_update(tree, node);
 
 	rb_node *x = node, *y;
 
@@ -317,6 +338,8 @@ void rb_delete(rb_tree * tree, rb_node * node)
 		z->left->parent = z->right->parent = y;
 		*y = *z;
 	}
+	/* the subtrees changed from where y was taken out up to the root */
+	rb_node_update(tree, x->parent);
 	if (need_fixup) {
 		rb_delete_fixup(tree, x);
 	}
@@ -371,6 +394,22 @@ rb_node *rb_node_right(rb_tree * tree, rb_node * node)
 	return (right != tree->nil) ? right : NULL;
 }
 
+/* *
+ * rb_node_update - recomputes the value kept by @node and each of its
+ * ancestors, after what it keeps of itself changed in place, e.g. the end
+ * of a vma grew; the order of @node must not change.
+ * */
+void rb_node_update(rb_tree * tree, rb_node * node)
+{
+	if (tree->update == NULL) {
+		return;
+	}
+	while (node != tree->nil && node != tree->root) {
+		tree->update(tree, node);
+		node = node->parent;
+	}
+}
+
 int check_tree(rb_tree * tree, rb_node * node)
 {
 	rb_node *nil = tree->nil;
@@ -408,6 +447,7 @@ static void *check_safe_kmalloc(size_t size)
 
 struct check_data {
 	long data;
+	long size;		// the nodes of the subtree, kept by check_update
 	rb_node rb_link;
 };
 
@@ -424,6 +464,25 @@ static inline int check_compare2(rb_node * node, void *key)
 	return rbn2data(node)->data - (long)key;
 }
 
+static void check_update(rb_tree * tree, rb_node * node)
+{
+	rb_node *left = rb_node_left(tree, node), *right =
+	    rb_node_right(tree, node);
+	rbn2data(node)->size = 1 + ((left != NULL) ? rbn2data(left)->size : 0)
+	    + ((right != NULL) ? rbn2data(right)->size : 0);
+}
+
+static long check_size(rb_tree * tree, rb_node * node)
+{
+	if (node == tree->nil) {
+		return 0;
+	}
+	long size = 1 + check_size(tree, node->left) +
+	    check_size(tree, node->right);
+	assert(rbn2data(node)->size == size);
+	return size;
+}
+
 void check_rb_tree(void)
 {
 	rb_tree *tree = rb_tree_create(check_compare1);
@@ -514,6 +573,21 @@ void check_rb_tree(void)
 
 	rb_tree_destroy(tree);
 
+	/* the same, keeping the size of each subtree */
+	tree = rb_tree_create_augmented(check_compare1, check_update);
+	assert(tree != NULL);
+	for (i = 0; i < total; i++) {
+		all[i]->data = i;
+		rb_insert(tree, &(all[i]->rb_link));
+		check_size(tree, tree->root->left);
+	}
+	for (i = 0; i < total; i += 2) {
+		rb_delete(tree, &(all[i]->rb_link));
+		check_size(tree, tree->root->left);
+	}
+	assert(rbn2data(rb_node_root(tree))->size == total / 2);
+	rb_tree_destroy(tree);
+
 	for (i = 0; i < total; i++) {
 		kfree(all[i]);
 	}
@@ -521,3 +595,99 @@ void check_rb_tree(void)
 	kfree(mark);
 	kfree(all);
 }
+
+struct check_inline {
+	long data;
+	long size;		// the nodes of the subtree
+	struct rbi_node link;
+};
+
+#define rbi2data(node)              \
+    (to_struct(node, struct check_inline, link))
+
+#define check_less(a, b)            ((a)->data < (b)->data)
+
+static inline long check_inline_size(struct rbi_node *node)
+{
+	return (node != NULL) ? rbi2data(node)->size : 0;
+}
+
+static inline void check_augment(struct check_inline *elm)
+{
+	elm->size = 1 + check_inline_size(elm->link.left) +
+	    check_inline_size(elm->link.right);
+}
+
+RB_INLINE_GENERATE(check_rbi, struct check_inline, link, check_less,
+		   check_augment);
+
+// check_rbi_tree - check the subtree of node, return its black height
+static int check_rbi_tree(struct rbi_node *node, struct rbi_node *parent)
+{
+	if (node == NULL) {
+		return 1;
+	}
+	assert(node->parent == parent);
+	if (node->left != NULL) {
+		assert(rbi2data(node->left)->data <= rbi2data(node)->data);
+	}
+	if (node->right != NULL) {
+		assert(rbi2data(node->right)->data >= rbi2data(node)->data);
+	}
+	if (node->red) {
+		assert(!rbi_is_red(node->left) && !rbi_is_red(node->right));
+	}
+	int hb = check_rbi_tree(node->left, node);
+	assert(hb == check_rbi_tree(node->right, node));
+	assert(rbi2data(node)->size == 1 + check_inline_size(node->left) +
+	       check_inline_size(node->right));
+	return hb + !node->red;
+}
+
+static void check_rbi_root(struct rbi_root *root)
+{
+	struct rbi_node *node, *prev = NULL;
+	long n = 0;
+	assert(!rbi_is_red(root->node));
+	check_rbi_tree(root->node, NULL);
+	for (node = rbi_first(root); node != NULL; node = rbi_next(node), n++) {
+		if (prev != NULL) {
+			assert(rbi2data(prev)->data <= rbi2data(node)->data);
+			assert(rbi_prev(node) == prev);
+		}
+		prev = node;
+	}
+	assert(prev == rbi_last(root) && n == check_inline_size(root->node));
+}
+
+void check_rb_inline(void)
+{
+	struct rbi_root root;
+	int total = 100;
+	struct check_inline *all =
+	    check_safe_kmalloc(sizeof(struct check_inline) * total);
+	long i;
+	rbi_root_init(&root);
+	for (i = 0; i < total; i++) {
+		all[i].data = rand() % (total / 2);
+		check_rbi_insert(&root, all + i);
+		check_rbi_root(&root);
+	}
+	assert(check_inline_size(root.node) == total);
+	for (i = 0; i < total; i += 2) {
+		check_rbi_remove(&root, all + i);
+		check_rbi_root(&root);
+	}
+	/* the key of an element changed in place, its order kept */
+	for (i = 1; i < total; i += 2) {
+		all[i].size = 0;
+		check_rbi_update(all + i);
+		check_rbi_root(&root);
+	}
+	for (i = 1; i < total; i += 2) {
+		check_rbi_remove(&root, all + i);
+		check_rbi_root(&root);
+	}
+	assert(rbi_empty(&root) && rbi_first(&root) == NULL);
+	kfree(all);
+}
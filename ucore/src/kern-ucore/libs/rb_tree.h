@@ -12,10 +12,17 @@ typedef struct rb_node {
 typedef struct rb_tree {
 	// compare function should return -1 if *node1 < *node2, 1 if *node1 > *node2, and 0 otherwise
 	int (*compare) (rb_node * node1, rb_node * node2);
+	// update, if any, recomputes what a node keeps of its subtree from the node
+	// and its children; it is called on each node whose subtree changes
+	void (*update) (struct rb_tree * tree, rb_node * node);
 	struct rb_node *nil, *root;
 } rb_tree;
 
 rb_tree *rb_tree_create(int (*compare) (rb_node * node1, rb_node * node2));
+rb_tree *rb_tree_create_augmented(int (*compare) (rb_node * node1,
+						  rb_node * node2),
+				  void (*update) (rb_tree * tree,
+						  rb_node * node));
 void rb_tree_destroy(rb_tree * tree);
 void rb_insert(rb_tree * tree, rb_node * node);
 void rb_delete(rb_tree * tree, rb_node * node);
@@ -26,6 +33,7 @@ rb_node *rb_node_next(rb_tree * tree, rb_node * node);
 rb_node *rb_node_root(rb_tree * tree);
 rb_node *rb_node_left(rb_tree * tree, rb_node * node);
 rb_node *rb_node_right(rb_tree * tree, rb_node * node);
+void rb_node_update(rb_tree * tree, rb_node * node);
 
 void check_rb_tree(void);
 
@@ -0,0 +1,24 @@
+#ifndef __LIBS_RDZ_H__
+#define __LIBS_RDZ_H__
+
+#include <types.h>
+
+/*
+ * A compressed ramdisk image: struct rdz_header, then nblocks + 1 offsets
+ * from the start of the image, block i being the bytes [offset[i],
+ * offset[i + 1]). A block is LZ4 compressed, see lz4.h, or stored as it is
+ * when it is block_size long. Written by mkrdz of ht-mksfs from an image.
+ */
+#define RDZ_MAGIC                   0x345a4452	/* "RDZ4" */
+#define RDZ_BLOCK_SIZE              4096
+
+struct rdz_header {
+	uint32_t magic;
+	uint32_t block_size;
+	uint32_t nblocks;
+	uint32_t reserved;
+};
+
+#define RDZ_OFFSETS(h)              ((uint32_t *)((struct rdz_header *)(h) + 1))
+
+#endif /* !__LIBS_RDZ_H__ */
@@ -0,0 +1,352 @@
+#include <types.h>
+#include <stdlib.h>
+#include <slab.h>
+#include <sync.h>
+#include <assert.h>
+#include <rhash.h>
+
+struct rhash_buckets {
+	struct rcu_head rcu;
+	unsigned int shift;
+	struct rhash_node heads[0];
+};
+
+/* the old buckets an add or a del moves to the new table */
+#define RHASH_MOVE_STEP             4
+
+static struct rhash_buckets *rhash_buckets_alloc(unsigned int shift)
+{
+	struct rhash_buckets *b;
+	uint32_t i;
+	if ((b = kmalloc(sizeof(struct rhash_buckets) +
+			 (sizeof(struct rhash_node) << shift))) != NULL) {
+		b->shift = shift;
+		for (i = 0; i < (1 << shift); i++) {
+			list_init(&(b->heads[i].link));
+			b->heads[i].hash = i;
+			b->heads[i].flags = RHASH_HEAD;
+		}
+	}
+	return b;
+}
+
+static void rhash_buckets_free_rcu(struct rcu_head *head)
+{
+	kfree(to_struct(head, struct rhash_buckets, rcu));
+}
+
+static void rhash_buckets_free(struct rhash *t, struct rhash_buckets *b)
+{
+	if (t->rcu) {
+		/* a lookup may still walk them */
+		call_rcu(&(b->rcu), rhash_buckets_free_rcu);
+	} else {
+		kfree(b);
+	}
+}
+
+static inline uint32_t rhash_index(struct rhash_buckets *b, uint32_t hash)
+{
+	return hash32(hash, b->shift);
+}
+
+static inline struct rhash_node *rhash_bucket(struct rhash_buckets *b,
+					      uint32_t hash)
+{
+	return b->heads + rhash_index(b, hash);
+}
+
+// rhash_link - publish node at the front of the bucket of head
+static void rhash_link(struct rhash_node *head, struct rhash_node *node)
+{
+	list_entry_t *le = &(node->link), *next = list_next(&(head->link));
+	le->prev = &(head->link), le->next = next;
+	rcu_assign_pointer(head->link.next, le);
+	next->prev = le;
+}
+
+int rhash_init(struct rhash *t, unsigned int shift, bool rcu)
+{
+	assert(shift > 0 && shift <= RHASH_MAX_SHIFT);
+	if ((t->tbl = rhash_buckets_alloc(shift)) == NULL) {
+		return -1;
+	}
+	spinlock_init(&(t->lock));
+	t->old = NULL;
+	t->old_pos = 0;
+	t->nr = 0;
+	t->min_shift = shift;
+	t->rcu = rcu;
+	t->seq = 0;
+	return 0;
+}
+
+// rhash_destroy - free the buckets, the entries are the user's to free
+void rhash_destroy(struct rhash *t)
+{
+	if (t->old != NULL) {
+		kfree(t->old);
+	}
+	kfree(t->tbl);
+}
+
+static inline void rhash_write_begin(struct rhash *t)
+{
+	t->seq++;
+	__sync_synchronize();
+}
+
+static inline void rhash_write_end(struct rhash *t)
+{
+	__sync_synchronize();
+	t->seq++;
+}
+
+// rhash_move_step - move the next few old buckets to the new table, with
+//                 - t->lock held; return the old table once it is empty
+static struct rhash_buckets *rhash_move_step(struct rhash *t)
+{
+	struct rhash_buckets *old = t->old;
+	int n;
+	if (old == NULL) {
+		return NULL;
+	}
+	rhash_write_begin(t);
+	for (n = 0; n < RHASH_MOVE_STEP && t->old_pos < (1 << old->shift);
+	     n++, t->old_pos++) {
+		list_entry_t *list = &(old->heads[t->old_pos].link), *le;
+		while ((le = list_next(list)) != list) {
+			struct rhash_node *node = le2rhash(le, link);
+			list_del(le);
+			rhash_link(rhash_bucket(t->tbl, node->hash), node);
+		}
+	}
+	if (t->old_pos == (1 << old->shift)) {
+		t->old = NULL;
+	} else {
+		old = NULL;
+	}
+	rhash_write_end(t);
+	return old;
+}
+
+// rhash_want_shift - the size the table should have, with t->lock held;
+//                  - its own if none is to be made now
+static unsigned int rhash_want_shift(struct rhash *t)
+{
+	unsigned int shift = t->tbl->shift;
+	if (t->old != NULL) {
+		return shift;
+	}
+	if (t->nr > (RHASH_MAX_LOAD << shift) && shift < RHASH_MAX_SHIFT) {
+		return shift + 1;
+	}
+	if (shift > t->min_shift && t->nr < (1 << shift) / RHASH_MIN_LOAD) {
+		return shift - 1;
+	}
+	return shift;
+}
+
+// rhash_resize - start moving the entries to a table of the size they want;
+//              - called by rhash_add and rhash_del, without the lock as the
+//              - new buckets are allocated first, which may sleep
+void rhash_resize(struct rhash *t)
+{
+	struct rhash_buckets *b;
+	unsigned int shift;
+	bool intr_flag;
+	spin_lock_irqsave(&(t->lock), intr_flag);
+	shift = rhash_want_shift(t);
+	spin_unlock_irqrestore(&(t->lock), intr_flag);
+	if (shift == t->tbl->shift || (b = rhash_buckets_alloc(shift)) == NULL) {
+		return;
+	}
+	spin_lock_irqsave(&(t->lock), intr_flag);
+	if (rhash_want_shift(t) == shift) {
+		rhash_write_begin(t);
+		t->old = t->tbl;
+		t->old_pos = 0;
+		rcu_assign_pointer(t->tbl, b);
+		rhash_write_end(t);
+		b = NULL;
+	}
+	spin_unlock_irqrestore(&(t->lock), intr_flag);
+	if (b != NULL) {
+		/* resized by another meanwhile */
+		kfree(b);
+	}
+}
+
+void rhash_add(struct rhash *t, struct rhash_node *node, uint32_t hash)
+{
+	struct rhash_buckets *done;
+	bool intr_flag, resize;
+	node->hash = hash;
+	node->flags = 0;
+	spin_lock_irqsave(&(t->lock), intr_flag);
+	rhash_link(rhash_bucket(t->tbl, hash), node);
+	t->nr++;
+	done = rhash_move_step(t);
+	resize = (rhash_want_shift(t) != t->tbl->shift);
+	spin_unlock_irqrestore(&(t->lock), intr_flag);
+	if (done != NULL) {
+		rhash_buckets_free(t, done);
+	}
+	if (resize) {
+		rhash_resize(t);
+	}
+}
+
+// rhash_del - take node off t; under rcu, a lookup may still walk past it
+//           - until a grace period is over
+void rhash_del(struct rhash *t, struct rhash_node *node)
+{
+	struct rhash_buckets *done;
+	bool intr_flag, resize;
+	spin_lock_irqsave(&(t->lock), intr_flag);
+	list_del(&(node->link));
+	t->nr--;
+	done = rhash_move_step(t);
+	resize = (rhash_want_shift(t) != t->tbl->shift);
+	spin_unlock_irqrestore(&(t->lock), intr_flag);
+	if (done != NULL) {
+		rhash_buckets_free(t, done);
+	}
+	if (resize) {
+		rhash_resize(t);
+	}
+}
+
+// rhash_walk - the node of hash that match takes in the bucket of head;
+//            - *stray is set if the walk ends up in another bucket, as the
+//            - node it was on moved meanwhile
+static struct rhash_node *rhash_walk(struct rhash_node *head, uint32_t hash,
+				     bool (*match) (struct rhash_node * node,
+						    void *key), void *key,
+				     bool * stray)
+{
+	list_entry_t *list = &(head->link), *le = list;
+	while ((le = rcu_dereference(le->next)) != list) {
+		struct rhash_node *node = le2rhash(le, link);
+		if (node->flags & RHASH_HEAD) {
+			*stray = 1;
+			return NULL;
+		}
+		if (node->hash == hash && match(node, key)) {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+// rhash_find - look in the old bucket of hash, if not moved yet, and in
+//            - the new one
+static struct rhash_node *rhash_find(struct rhash_buckets *tbl,
+				     struct rhash_buckets *old,
+				     uint32_t old_pos, uint32_t hash,
+				     bool (*match) (struct rhash_node * node,
+						    void *key), void *key,
+				     bool * stray)
+{
+	struct rhash_node *node;
+	if (old != NULL && rhash_index(old, hash) >= old_pos) {
+		node = rhash_walk(rhash_bucket(old, hash), hash, match, key,
+				  stray);
+		if (node != NULL || *stray) {
+			return node;
+		}
+	}
+	return rhash_walk(rhash_bucket(tbl, hash), hash, match, key, stray);
+}
+
+// rhash_lookup - the entry of hash that match(node, key) takes, or NULL
+struct rhash_node *rhash_lookup(struct rhash *t, uint32_t hash,
+				bool (*match) (struct rhash_node * node,
+					       void *key), void *key)
+{
+	struct rhash_node *node;
+	bool intr_flag, stray = 0;
+	spin_lock_irqsave(&(t->lock), intr_flag);
+	node = rhash_find(t->tbl, t->old, t->old_pos, hash, match, key,
+			  &stray);
+	assert(!stray);
+	spin_unlock_irqrestore(&(t->lock), intr_flag);
+	return node;
+}
+
+// rhash_lookup_rcu - rhash_lookup without the lock, under rcu_read_lock,
+//                  - of a table made rcu. A walk that may have missed the
+//                  - entry, as entries moved during it, is done again.
+struct rhash_node *rhash_lookup_rcu(struct rhash *t, uint32_t hash,
+				    bool (*match) (struct rhash_node * node,
+						   void *key), void *key)
+{
+	struct rhash_node *node;
+	uint32_t seq;
+	bool stray;
+	assert(t->rcu);
+	do {
+		while ((seq = t->seq) & 1) {
+			/* entries are moving */
+		}
+		__sync_synchronize();
+		stray = 0;
+		node = rhash_find(rcu_dereference(t->tbl),
+				  rcu_dereference(t->old), t->old_pos, hash,
+				  match, key, &stray);
+		if (node != NULL) {
+			return node;
+		}
+		__sync_synchronize();
+	} while (stray || t->seq != seq);
+	return NULL;
+}
+
+struct check_entry {
+	struct rhash_node node;
+	uint32_t key;
+};
+
+static bool check_match(struct rhash_node *node, void *key)
+{
+	return to_struct(node, struct check_entry, node)->key ==
+	    *(uint32_t *) key;
+}
+
+static struct check_entry *check_find(struct rhash *t, uint32_t key)
+{
+	struct rhash_node *node = rhash_lookup(t, key, check_match, &key);
+	return (node != NULL) ? to_struct(node, struct check_entry, node) : NULL;
+}
+
+void check_rhash(void)
+{
+	struct rhash t;
+	const uint32_t total = 1000;
+	struct check_entry *all;
+	uint32_t i;
+	assert(rhash_init(&t, 4, 0) == 0);
+	assert((all = kmalloc(sizeof(struct check_entry) * total)) != NULL);
+	for (i = 0; i < total; i++) {
+		all[i].key = i * 7;
+		rhash_add(&t, &(all[i].node), all[i].key);
+		assert(check_find(&t, i * 7) == all + i);
+	}
+	assert(rhash_count(&t) == total && t.tbl->shift > 4);
+	for (i = 0; i < total; i++) {
+		assert(check_find(&t, i * 7) == all + i);
+		assert(check_find(&t, i * 7 + 1) == NULL);
+	}
+	for (i = 0; i < total; i += 2) {
+		rhash_del(&t, &(all[i].node));
+	}
+	for (i = 0; i < total; i++) {
+		assert(check_find(&t, i * 7) == ((i % 2) ? all + i : NULL));
+	}
+	for (i = 1; i < total; i += 2) {
+		rhash_del(&t, &(all[i].node));
+	}
+	assert(rhash_count(&t) == 0 && t.tbl->shift < RHASH_MAX_SHIFT);
+	rhash_destroy(&t);
+	kfree(all);
+}
@@ -0,0 +1,72 @@
+#ifndef __KERN_LIBS_RHASH_H__
+#define __KERN_LIBS_RHASH_H__
+
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+#include <rcu.h>
+
+/* *
+ * A chained hash table that resizes itself with the # of entries it holds.
+ * It doubles once there are RHASH_MAX_LOAD entries per bucket, and halves
+ * once there are fewer than one per RHASH_MIN_LOAD buckets, not under the
+ * size it was created with. The entries are moved to the new buckets a
+ * few old buckets at a time, by each add and del that follows, so no one
+ * call pays for the whole table; a lookup looks in both tables meanwhile.
+ *
+ * An rhash_node embedded in the object is its entry, under the hash the
+ * user gives. The table has a lock of its own, taken by rhash_add,
+ * rhash_del and rhash_lookup; the lookup calls match with it held, which
+ * must not sleep. A table made rcu also takes lookups without the lock,
+ * rhash_lookup_rcu under rcu_read_lock: the user then frees the objects
+ * deleted from it only after a grace period, see call_rcu.
+ * */
+struct rhash_node {
+	list_entry_t link;
+	uint32_t hash;
+	uint32_t flags;		// RHASH_HEAD for the heads of the buckets
+};
+
+#define RHASH_HEAD                  0x1
+
+#define le2rhash(le, member)                    \
+    to_struct((le), struct rhash_node, member)
+
+#define RHASH_MAX_LOAD              2
+#define RHASH_MIN_LOAD              8
+/* buckets as many as a kmalloc holds */
+#define RHASH_MAX_SHIFT             12
+
+struct rhash_buckets;
+
+struct rhash {
+	spinlock_s lock;
+	struct rhash_buckets *tbl;	// where the entries are added
+	struct rhash_buckets *old;	// being moved out of tbl, or NULL
+	uint32_t old_pos;	// the buckets of old below it are moved
+	size_t nr;		// # of entries
+	unsigned int min_shift;
+	bool rcu;
+	volatile uint32_t seq;	// odd while entries move
+};
+
+int rhash_init(struct rhash *t, unsigned int shift, bool rcu);
+void rhash_destroy(struct rhash *t);
+void rhash_add(struct rhash *t, struct rhash_node *node, uint32_t hash);
+void rhash_del(struct rhash *t, struct rhash_node *node);
+struct rhash_node *rhash_lookup(struct rhash *t, uint32_t hash,
+				bool (*match) (struct rhash_node * node,
+					       void *key), void *key);
+struct rhash_node *rhash_lookup_rcu(struct rhash *t, uint32_t hash,
+				    bool (*match) (struct rhash_node * node,
+						   void *key), void *key);
+void rhash_resize(struct rhash *t);
+
+static inline size_t rhash_count(struct rhash *t)
+{
+	return t->nr;
+}
+
+void check_rhash(void);
+
+#endif /* !__KERN_LIBS_RHASH_H__ */
@@ -0,0 +1,38 @@
+#ifndef __LIBS_SOCKET_H__
+#define __LIBS_SOCKET_H__
+
+#include <types.h>
+
+/* *
+ * The sockets of the kernel TCP/IP stack, TCP over IPv4 only. A socket is
+ * an fd: read and write move its bytes, close shuts it down, epoll watches
+ * it, and sendfile sends a file through it without a copy in user space.
+ * The addresses and ports are in the byte order of the network.
+ * */
+#define AF_INET                     2
+#define SOCK_STREAM                 1
+#define IPPROTO_TCP                 6
+
+#define INADDR_ANY                  0x00000000
+#define INADDR_LOOPBACK             0x7F000001	/* 127.0.0.1, host order */
+
+struct sockaddr_in {
+	uint16_t sin_family;
+	uint16_t sin_port;
+	uint32_t sin_addr;
+};
+
+static inline uint16_t htons(uint16_t x)
+{
+	return (x << 8) | (x >> 8);
+}
+
+static inline uint32_t htonl(uint32_t x)
+{
+	return ((uint32_t) htons(x) << 16) | htons(x >> 16);
+}
+
+#define ntohs(x)                    htons(x)
+#define ntohl(x)                    htonl(x)
+
+#endif /* !__LIBS_SOCKET_H__ */
@@ -1,6 +1,7 @@
 #include <string.h>
 #include <slab.h>
 #include <arch.h>
+#include <memlayout.h>
 
 /* *
  * strlen - calculate the length of the string @s, not including
@@ -344,6 +345,33 @@ void *memcpy(void *dst, const void *src, size_t n)
 #endif /* __HAVE_ARCH_MEMCPY */
 }
 
+/* *
+ * copy_page - copies the page at @src to @dst, both page aligned.
+ * @dst     the kernel address of the destination page
+ * @src     the kernel address of the source page
+ * */
+void copy_page(void *dst, const void *src)
+{
+#ifdef __HAVE_ARCH_COPY_PAGE
+	__copy_page(dst, src);
+#else
+	memcpy(dst, src, PGSIZE);
+#endif /* __HAVE_ARCH_COPY_PAGE */
+}
+
+/* *
+ * clear_page - zeroes the page at @page, page aligned.
+ * @page    the kernel address of the page
+ * */
+void clear_page(void *page)
+{
+#ifdef __HAVE_ARCH_CLEAR_PAGE
+	__clear_page(page);
+#else
+	memset(page, 0, PGSIZE);
+#endif /* __HAVE_ARCH_CLEAR_PAGE */
+}
+
 /* *
  * memcmp - compares two blocks of memory
  * @v1:     pointer to block of memory
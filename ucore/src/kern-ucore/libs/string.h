@@ -23,6 +23,8 @@ void *memset(void *s, char c, size_t n);
 void *memmove(void *dst, const void *src, size_t n);
 void *memcpy(void *dst, const void *src, size_t n);
 int memcmp(const void *v1, const void *v2, size_t n);
+void copy_page(void *dst, const void *src);
+void clear_page(void *page);
 
 int stricmp(const char *s1, const char *s2);
 #endif /* !__LIBS_STRING_H__ */
@@ -0,0 +1,28 @@
+#ifndef __LIBS_SYSBATCH_H__
+#define __LIBS_SYSBATCH_H__
+
+#include <types.h>
+
+/* the most records run by one SYS_batch */
+#define SYSBATCH_MAX                32
+
+/* *
+ * A record of SYS_batch, which runs the records in order as if each were a
+ * system call of its own, stores the result of each in ret and stops after
+ * the first that fails. Bit j of ref makes args[j] the index of an earlier
+ * record of the batch, whose ret is passed instead, so that an open may
+ * feed its fd to the read and close after it.
+ *
+ * exit, fork, exec, clone and the others that do not come back to the
+ * caller as they entered may not be batched, they fail with -E_INVAL.
+ * */
+struct syscall_rec {
+	uintptr_t num;
+	uintptr_t ref;
+	uintptr_t args[6];	// the first 5 only on i386 and arm
+	uintptr_t ret;
+};
+
+#define SYSBATCH_REF(j)             (1 << (j))
+
+#endif /* !__LIBS_SYSBATCH_H__ */
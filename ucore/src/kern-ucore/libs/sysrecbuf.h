@@ -0,0 +1,75 @@
+#ifndef __LIBS_SYSRECBUF_H__
+#define __LIBS_SYSRECBUF_H__
+
+#include <types.h>
+#include <unistd.h>
+
+/* *
+ * The syscall recorder, see debug/sysrec.c: a record of each syscall of
+ * the procs being recorded, appended to the ring of the cpu it returned
+ * on, which SYS_sysrec maps read-only in the consumer. A ring is a page
+ * holding struct sysrec_ring, then SYSREC_RING_PAGES of records, read as
+ * the events of tracebuf.h: the record of slot s is at records[s % entries]
+ * while its seq is s + 1, and the kernel overwrites the oldest ones.
+ *
+ * A syscall taking a path first, see sysrec_has_path, is followed by a
+ * SYSREC_PATH record holding the path in its args, empty if longer than
+ * SYSREC_PATH_MAX - 1 bytes.
+ *
+ * A recording, as user-ucore/sysrec writes it and sysreplay reads it, is
+ * a struct sysrec_header, then the records in the order they were taken
+ * from the rings, each syscall followed by its SYSREC_PATH record.
+ * */
+#define SYSREC_NR_ARGS              6
+#define SYSREC_PATH                 0xFFFF
+#define SYSREC_PATH_MAX             (SYSREC_NR_ARGS * sizeof(uint64_t))
+
+#define SYSREC_PAGE_SIZE            4096
+#define SYSREC_RING_PAGES           16
+#define SYSREC_RING_ENTRIES                                             \
+    (SYSREC_RING_PAGES * SYSREC_PAGE_SIZE / sizeof(struct sysrec_record))
+
+struct sysrec_record {
+	uint64_t ns;		/* monotonic clock at the entry */
+	uint64_t lat_ns;	/* from the entry to the return */
+	int64_t ret;
+	uint64_t arg[SYSREC_NR_ARGS];
+	volatile uint32_t seq;	/* slot + 1, 0 while written */
+	uint16_t num;		/* SYS_xxx, or SYSREC_PATH */
+	uint16_t pid;
+};
+
+struct sysrec_ring {
+	volatile uint32_t head;
+	uint32_t entries;
+	uint32_t cpu;
+};
+
+#define SYSREC_RECORDS(ring)                                            \
+    ((struct sysrec_record *)((char *)(ring) + SYSREC_PAGE_SIZE))
+#define SYSREC_MAP_SIZE             ((SYSREC_RING_PAGES + 1) * SYSREC_PAGE_SIZE)
+
+#define SYSREC_MAGIC                0x63657273	/* "srec" */
+#define SYSREC_VERSION              1
+
+struct sysrec_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nr_records;
+	uint32_t lost;		/* overwritten before they were taken */
+};
+
+// sysrec_has_path - syscall num takes a path as its first arg
+static inline bool sysrec_has_path(int num)
+{
+	switch (num) {
+	case SYS_open:
+	case SYS_chdir:
+	case SYS_mkdir:
+	case SYS_unlink:
+		return 1;
+	}
+	return 0;
+}
+
+#endif /* !__LIBS_SYSRECBUF_H__ */
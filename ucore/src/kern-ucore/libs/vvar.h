@@ -0,0 +1,38 @@
+#ifndef __LIBS_VVAR_H__
+#define __LIBS_VVAR_H__
+
+#include <types.h>
+#include <seqcount.h>
+
+#define CLOCK_REALTIME              0
+#define CLOCK_MONOTONIC             1
+
+/* how much faster or slower adjtime runs the realtime clock */
+#define SLEW_RATE_PPM               500
+
+/* *
+ * The vvar page, mapped read-only in every process and updated with the
+ * clocks, so that the user library reads the time without entering the
+ * kernel. A reader retries by seq as told in seqcount.h.
+ *
+ * With tsc_hz != 0 the monotonic time is tsc_nsec at tsc_stamp plus the
+ * tsc ticks since, otherwise it only goes by the clock ticks. The realtime
+ * clock is the monotonic one plus real_offset and the slew done since
+ * slew_mono, see timekeeping.c; real_sec and real_nsec split real_offset
+ * for the arches reading the clock ticks.
+ * */
+struct vvar_data {
+	seqcount_t seq;
+	uint32_t hz;		// clock ticks per second
+	unsigned long ticks;	// clock ticks since boot
+	uint64_t tsc_hz;	// tsc ticks per second, 0 if not usable
+	uint64_t tsc_stamp;	// tsc at tsc_nsec
+	uint64_t tsc_nsec;	// monotonic ns at tsc_stamp
+	int64_t real_offset;	// realtime - monotonic, at slew_mono
+	int64_t slew_left;	// ns of slew still to do from slew_mono on
+	uint64_t slew_mono;
+	long real_sec;		// real_offset = real_sec s + real_nsec ns,
+	long real_nsec;		// 0 <= real_nsec < 1s
+};
+
+#endif /* !__LIBS_VVAR_H__ */
@@ -0,0 +1,282 @@
+#include <types.h>
+#include <string.h>
+#include <list.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <proc.h>
+#include <sync.h>
+#include <sem.h>
+#include <mp.h>
+#include <sysconf.h>
+#include <memcg.h>
+#include <assert.h>
+#include <compaction.h>
+
+#ifdef UCONFIG_COMPACTION
+
+/*
+ * Compaction makes free blocks of many pages out of free pages scattered
+ * over memory, for the huge pages, the kernel stacks and the like. The
+ * buddy allocator keeps the pages it may move, those of private anonymous
+ * memory, in pageblocks of their own, see buddy_pmm.c. A round of it
+ *
+ *  - isolates up to COMPACT_MAX_BLOCKS of these pageblocks that are partly
+ *    free: their free blocks are taken off the free lists, so that no
+ *    page is allocated in them any more;
+ *  - walks the mms for the pages mapped in the pageblocks, and moves each
+ *    to a page allocated elsewhere, the way ksm_merge replaces a page: the
+ *    pte is made read-only and flushed, the page copied, and the new one
+ *    mapped with the permissions of the old. A page is moved only while
+ *    mapped once, not in the swap cache; the old pages join the isolated
+ *    ones;
+ *  - frees the isolated pages, which merge into whole pageblocks once all
+ *    the pages of one were moved.
+ *
+ * kcompactd runs a round on a node every KCOMPACTD_SLEEP_TICKS while it
+ * has no free block of a pageblock but the pages for several; an
+ * allocation of many pages that fails runs a few itself, see alloc_pages.
+ * The mms are locked shared without sleeping, and skipped when busy. The
+ * pages of the page cache are not moved, they are left to its reclaim.
+ */
+
+#define COMPACT_MAX_BLOCKS              4
+#define COMPACT_DIRECT_ROUNDS           4
+#define KCOMPACTD_SLEEP_TICKS           100
+
+struct compact_control {
+	uint32_t numa_id;
+	int nr_blocks;
+	struct Page *blocks[COMPACT_MAX_BLOCKS];	// the pageblocks isolated
+	list_entry_t isolated;	// their free blocks, and the pages moved out
+	size_t nr_to_move;	// pages of the pageblocks still in use
+	size_t nr_used;		// pages on isolated that were in use
+	size_t nr_moved;
+};
+
+/* one round at a time, the isolate cursors are not locked */
+static semaphore_t compact_sem;
+static bool compact_ready = 0;
+
+// compact_isolated - whether page is in one of the pageblocks isolated
+static bool compact_isolated(struct compact_control *cc, struct Page *page)
+{
+	int i;
+	for (i = 0; i < cc->nr_blocks; i++) {
+		if (page >= cc->blocks[i]
+		    && page < cc->blocks[i] + PAGEBLOCK_NR_PAGES) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// compact_keep - page, just given up, stays with the isolated ones
+static void compact_keep(struct compact_control *cc, struct Page *page)
+{
+	set_page_ref(page, 0);
+	page->property = 0;
+	list_add(&(cc->isolated), &(page->page_link));
+	cc->nr_used++;
+}
+
+// compact_alloc - a page of the node of cc out of the pageblocks isolated;
+//               - one freed into them meanwhile is kept there
+static struct Page *compact_alloc(struct compact_control *cc)
+{
+	struct Page *page;
+	while ((page = alloc_page_movable_numa(&numa_nodes[cc->numa_id])) != NULL
+	       && compact_isolated(cc, page)) {
+		compact_keep(cc, page);
+	}
+	return page;
+}
+
+// compact_move - move the page of orig at addr of mm, in an isolated
+//              - pageblock, to another page, if it is mapped there only
+static bool
+compact_move(struct compact_control *cc, struct mm_struct *mm, uintptr_t addr,
+	     pte_t * ptep, pte_t orig)
+{
+	struct Page *page = pte2page(orig), *newpage;
+	bool ret = 0;
+	if (!compact_isolated(cc, page) || !PageMovable(page)
+	    || PageSwap(page) || page_ref(page) != 1) {
+		return 0;
+	}
+	if ((newpage = compact_alloc(cc)) == NULL) {
+		return 0;
+	}
+	spinlock_acquire(&(mm->pt_lock));
+	if (*ptep == orig && page_ref(page) == 1 && !PageSwap(page)) {
+		if (ptep_s_write(ptep) || ptep_u_write(ptep)) {
+			ptep_unset_s_write(ptep);
+			ptep_unset_u_write(ptep);
+			mp_tlb_invalidate(mm->pgdir, addr);
+		}
+		copy_page(page2kva(newpage), page2kva(page));
+		memcg_move_charge(newpage, page);
+		/* held here, page_insert drops the ref of the pte only */
+		page_ref_inc(page);
+		page_insert(mm->pgdir, newpage, addr,
+			    ptep_get_perm(&orig, PTE_USER));
+		ret = 1;
+	}
+	spinlock_release(&(mm->pt_lock));
+	if (ret) {
+		compact_keep(cc, page);
+		cc->nr_to_move--, cc->nr_moved++;
+	} else {
+		free_page(newpage);
+	}
+	return ret;
+}
+
+// compact_vma - move the pages of vma in the pageblocks isolated
+static void
+compact_vma(struct compact_control *cc, struct mm_struct *mm,
+	    struct vma_struct *vma)
+{
+	uintptr_t addr = vma->vm_start;
+	while (addr < vma->vm_end && cc->nr_to_move > 0) {
+		/* get_pte would split a huge page or copy a shared table */
+		pmd_t *pmdp = get_pmd(mm->pgdir, addr, 0);
+		if (pmdp == NULL || !ptep_present(pmdp)
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+		    || pmd_huge(pmdp)
+#endif
+#ifdef UCONFIG_SHARED_PT
+		    || pmd_shared(pmdp)
+#endif
+		    ) {
+			addr = ROUNDDOWN(addr + PTSIZE, PTSIZE);
+			continue;
+		}
+		pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+		if (ptep != NULL && ptep_present(ptep)) {
+			compact_move(cc, mm, addr, ptep, *ptep);
+		}
+		addr += PGSIZE;
+	}
+}
+
+// compact_next_mm - the private anonymous memory of the mm at the head of
+//                 - proc_mm_list, which goes to the tail
+static void compact_next_mm(struct compact_control *cc)
+{
+	struct mm_struct *mm = NULL;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		list_entry_t *list = &proc_mm_list, *le;
+		if ((le = list_next(list)) != list) {
+			list_del(le);
+			list_add_before(list, le);
+			mm = le2mm(le, proc_mm_link);
+			/* an mm at zero is being freed by its last user */
+			if (mm_count(mm) == 0) {
+				mm = NULL;
+			} else {
+				mm_count_inc(mm);
+			}
+		}
+	}
+	local_intr_restore(intr_flag);
+	if (mm == NULL) {
+		return;
+	}
+	/* the allocating thread may hold its own */
+	if (try_down_read(&(mm->mm_rwsem))) {
+		list_entry_t *list = &(mm->mmap_list), *le = list;
+		while ((le = list_next(le)) != list && cc->nr_to_move > 0) {
+			struct vma_struct *vma = le2vma(le, list_link);
+			if (!(vma->vm_flags & (VM_SHARE | VM_IO))) {
+				compact_vma(cc, mm, vma);
+			}
+		}
+		up_read(&(mm->mm_rwsem));
+	}
+	put_mm(mm);
+}
+
+// compact_node - a round of compaction on numa_id; # of pages moved
+static size_t compact_node(uint32_t numa_id)
+{
+	struct compact_control cc;
+	struct Page *head;
+	int nr_mm = 0;
+	bool intr_flag;
+	if (!compact_ready || !try_down(&compact_sem)) {
+		return 0;
+	}
+	memset(&cc, 0, sizeof(cc));
+	cc.numa_id = numa_id;
+	list_init(&(cc.isolated));
+	/* the pages in the per-cpu lists keep their pageblocks in use */
+	drain_all_pages();
+	while (cc.nr_blocks < COMPACT_MAX_BLOCKS
+	       && (head = isolate_pageblock(numa_id, &(cc.isolated))) != NULL) {
+		cc.blocks[cc.nr_blocks++] = head;
+		cc.nr_to_move += PAGEBLOCK_NR_PAGES;
+	}
+	if (cc.nr_blocks != 0) {
+		list_entry_t *le = &(cc.isolated);
+		while ((le = list_next(le)) != &(cc.isolated)) {
+			cc.nr_to_move -= (1 << le2page(le, page_link)->property);
+		}
+		local_intr_save(intr_flag);
+		{
+			list_entry_t *list = &proc_mm_list, *le = list;
+			while ((le = list_next(le)) != list) {
+				nr_mm++;
+			}
+		}
+		local_intr_restore(intr_flag);
+		while (nr_mm-- > 0 && cc.nr_to_move > 0) {
+			compact_next_mm(&cc);
+		}
+		/* the pages freed meanwhile into the pageblocks merge too */
+		drain_all_pages();
+		putback_pages(&(cc.isolated), cc.nr_used);
+	}
+	up(&compact_sem);
+	return cc.nr_moved;
+}
+
+// try_compact_pages - an allocation of n pages failed: compact the node of
+//                   - this cpu a few rounds, if it is only fragmented;
+//                   - whether some pages were moved
+bool try_compact_pages(size_t n)
+{
+	uint32_t numa_id = mycpu()->node ? mycpu()->node->id : 0;
+	size_t order = 0;
+	int i;
+	bool ret = 0;
+	while ((1 << order) < n) {
+		order++;
+	}
+	for (i = 0; i < COMPACT_DIRECT_ROUNDS
+	     && pages_fragmented(numa_id, order); i++) {
+		if (compact_node(numa_id) == 0) {
+			break;
+		}
+		ret = 1;
+	}
+	return ret;
+}
+
+int kcompactd_main(void *arg)
+{
+	uint32_t i;
+	sem_init(&compact_sem, 1);
+	compact_ready = 1;
+	while (1) {
+		for (i = 0; i < sysconf.lnuma_count; i++) {
+			if (pages_fragmented(i, PAGEBLOCK_ORDER)) {
+				compact_node(i);
+			}
+		}
+		do_sleep(KCOMPACTD_SLEEP_TICKS);
+	}
+}
+
+#endif /* UCONFIG_COMPACTION */
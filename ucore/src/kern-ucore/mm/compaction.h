@@ -0,0 +1,11 @@
+#ifndef __KERN_MM_COMPACTION_H__
+#define __KERN_MM_COMPACTION_H__
+
+#include <types.h>
+
+#ifdef UCONFIG_COMPACTION
+bool try_compact_pages(size_t n);
+int kcompactd_main(void *arg);
+#endif
+
+#endif /* !__KERN_MM_COMPACTION_H__ */
@@ -0,0 +1,260 @@
+#include <types.h>
+#include <string.h>
+#include <stdio.h>
+#include <kio.h>
+#include <assert.h>
+#include <list.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <pmm.h>
+#include <slab.h>
+#include <dma.h>
+
+/* *
+ * The contiguous region: UCONFIG_DMA_CONTIG_PAGES pages taken from the page
+ * allocator at boot, before it fragments, and handed out in runs of pages,
+ * first fit, each run aligned on the power of two above its size up to
+ * DMA_CONTIG_MAX_ALIGN pages. A request the region can't meet falls back
+ * to alloc_pages, contiguous too, just not kept apart from the rest.
+ *
+ * A dmapool carves its chunks, DMA_POOL_CHUNK bytes or one block if that
+ * is larger, into blocks of its size and alignment, none crossing a
+ * multiple of the boundary. The free blocks of a chunk link through their
+ * first word; the chunks stay until the pool is destroyed.
+ * */
+#ifndef UCONFIG_DMA_CONTIG_PAGES
+#define UCONFIG_DMA_CONTIG_PAGES        0
+#endif
+#define DMA_CONTIG_MAX_ALIGN            16
+#define DMA_POOL_CHUNK                  PGSIZE
+
+static spinlock_s contig_lock;
+static struct Page *contig_base;	// NULL if there is no region
+static size_t contig_npages;
+static uint8_t contig_used[UCONFIG_DMA_CONTIG_PAGES + 1];
+
+void dma_contig_init(void)
+{
+	spinlock_init(&contig_lock);
+	if (UCONFIG_DMA_CONTIG_PAGES == 0) {
+		return;
+	}
+	if ((contig_base = alloc_pages(UCONFIG_DMA_CONTIG_PAGES)) == NULL) {
+		kprintf("dma: no %d pages for the contiguous region.\n",
+			UCONFIG_DMA_CONTIG_PAGES);
+		return;
+	}
+	contig_npages = UCONFIG_DMA_CONTIG_PAGES;
+	memset(contig_used, 0, sizeof(contig_used));
+	kprintf("dma: contiguous region of %d pages at 0x%08lx.\n",
+		(int)contig_npages, (unsigned long)page2pa(contig_base));
+}
+
+// contig_find - the first free run of n pages in the region, aligned on
+//             - align pages, -1 if there is none; with contig_lock held
+static int contig_find(size_t n, size_t align)
+{
+	size_t i, j;
+	for (i = 0; i + n <= contig_npages; i += align) {
+		for (j = 0; j < n && !contig_used[i + j]; j++) ;
+		if (j == n) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// dma_contig_alloc - size bytes of whole pages, contiguous, the physical
+//                  - address of which into *paddr
+void *dma_contig_alloc(size_t size, uintptr_t * paddr)
+{
+	size_t n = (size + PGSIZE - 1) / PGSIZE, align = 1;
+	struct Page *page = NULL;
+	bool intr_flag;
+	int i;
+	if (n == 0) {
+		return NULL;
+	}
+	while (align < n && align < DMA_CONTIG_MAX_ALIGN) {
+		align <<= 1;
+	}
+	spin_lock_irqsave(&contig_lock, intr_flag);
+	if ((i = contig_find(n, align)) >= 0) {
+		memset(contig_used + i, 1, n);
+		page = contig_base + i;
+	}
+	spin_unlock_irqrestore(&contig_lock, intr_flag);
+	if (page == NULL && (page = alloc_pages(n)) == NULL) {
+		return NULL;
+	}
+	*paddr = page2pa(page);
+	return page2kva(page);
+}
+
+void dma_contig_free(void *kva, size_t size)
+{
+	size_t n = (size + PGSIZE - 1) / PGSIZE;
+	struct Page *page = kva2page(kva);
+	bool intr_flag;
+	if (contig_base != NULL && page >= contig_base
+	    && page < contig_base + contig_npages) {
+		assert(page + n <= contig_base + contig_npages);
+		spin_lock_irqsave(&contig_lock, intr_flag);
+		memset(contig_used + (page - contig_base), 0, n);
+		spin_unlock_irqrestore(&contig_lock, intr_flag);
+	} else {
+		free_pages(page, n);
+	}
+}
+
+struct dma_chunk {
+	list_entry_t link;
+	void *kva;
+	uintptr_t paddr;
+	size_t nused;		// the blocks handed out
+	void *free;		// the first free block
+};
+
+struct dmapool {
+	char name[32];
+	size_t size;		// of a block, a multiple of the alignment
+	size_t boundary;	// no block crosses a multiple of it
+	size_t chunk_size;
+	spinlock_s lock;
+	list_entry_t chunks;
+};
+
+#define le2chunk(le, member)            \
+    to_struct((le), struct dma_chunk, member)
+
+// dmapool_create - a pool of blocks of size bytes, aligned on align, a
+//                - power of two, and not crossing a multiple of boundary,
+//                - 0 for none
+struct dmapool *dmapool_create(const char *name, size_t size, size_t align,
+			       size_t boundary)
+{
+	struct dmapool *pool;
+	if (align == 0) {
+		align = sizeof(void *);
+	}
+	if (size == 0 || (align & (align - 1)) != 0
+	    || (boundary != 0 && boundary < size)) {
+		return NULL;
+	}
+	if (size < sizeof(void *)) {
+		size = sizeof(void *);
+	}
+	size = (size + align - 1) & ~(align - 1);
+	if ((pool = kmalloc(sizeof(struct dmapool))) == NULL) {
+		return NULL;
+	}
+	strncpy(pool->name, name, sizeof(pool->name) - 1);
+	pool->name[sizeof(pool->name) - 1] = '\0';
+	pool->size = size;
+	pool->boundary = boundary;
+	pool->chunk_size = (size > DMA_POOL_CHUNK) ? size : DMA_POOL_CHUNK;
+	spinlock_init(&(pool->lock));
+	list_init(&(pool->chunks));
+	return pool;
+}
+
+// dmapool_destroy - free the chunks of pool, all its blocks freed
+void dmapool_destroy(struct dmapool *pool)
+{
+	list_entry_t *le;
+	while ((le = list_next(&(pool->chunks))) != &(pool->chunks)) {
+		struct dma_chunk *chunk = le2chunk(le, link);
+		if (chunk->nused != 0) {
+			kprintf("dma: pool %s destroyed with %d blocks in use.\n",
+				pool->name, (int)chunk->nused);
+		}
+		list_del(le);
+		dma_contig_free(chunk->kva, pool->chunk_size);
+		kfree(chunk);
+	}
+	kfree(pool);
+}
+
+// dma_chunk_create - a chunk of pool, all its blocks free
+static struct dma_chunk *dma_chunk_create(struct dmapool *pool)
+{
+	struct dma_chunk *chunk;
+	size_t off, next;
+	void **link;
+	if ((chunk = kmalloc(sizeof(struct dma_chunk))) == NULL) {
+		return NULL;
+	}
+	if ((chunk->kva = dma_contig_alloc(pool->chunk_size, &(chunk->paddr)))
+	    == NULL) {
+		kfree(chunk);
+		return NULL;
+	}
+	chunk->nused = 0;
+	link = &(chunk->free);
+	for (off = 0; off + pool->size <= pool->chunk_size; off = next) {
+		next = off + pool->size;
+		if (pool->boundary != 0
+		    && (chunk->paddr + off) / pool->boundary !=
+		    (chunk->paddr + next - 1) / pool->boundary) {
+			/* start again at the boundary it crosses */
+			next = (chunk->paddr + next - 1) / pool->boundary
+			    * pool->boundary - chunk->paddr;
+			continue;
+		}
+		*link = (char *)chunk->kva + off;
+		link = (void **)*link;
+	}
+	*link = NULL;
+	return chunk;
+}
+
+// dmapool_alloc - a block of pool, its physical address into *paddr
+void *dmapool_alloc(struct dmapool *pool, uintptr_t * paddr)
+{
+	struct dma_chunk *chunk = NULL;
+	bool intr_flag;
+	void *block;
+	list_entry_t *le = &(pool->chunks);
+	spin_lock_irqsave(&(pool->lock), intr_flag);
+	while ((le = list_next(le)) != &(pool->chunks)) {
+		if (le2chunk(le, link)->free != NULL) {
+			chunk = le2chunk(le, link);
+			break;
+		}
+	}
+	if (chunk == NULL) {
+		/* not with the lock held, the pages may be long to find */
+		spin_unlock_irqrestore(&(pool->lock), intr_flag);
+		if ((chunk = dma_chunk_create(pool)) == NULL) {
+			return NULL;
+		}
+		spin_lock_irqsave(&(pool->lock), intr_flag);
+		list_add(&(pool->chunks), &(chunk->link));
+	}
+	block = chunk->free;
+	chunk->free = *(void **)block;
+	chunk->nused++;
+	spin_unlock_irqrestore(&(pool->lock), intr_flag);
+	*paddr = chunk->paddr + ((char *)block - (char *)chunk->kva);
+	return block;
+}
+
+void dmapool_free(struct dmapool *pool, void *kva)
+{
+	bool intr_flag;
+	list_entry_t *le = &(pool->chunks);
+	spin_lock_irqsave(&(pool->lock), intr_flag);
+	while ((le = list_next(le)) != &(pool->chunks)) {
+		struct dma_chunk *chunk = le2chunk(le, link);
+		if ((char *)kva >= (char *)chunk->kva
+		    && (char *)kva < (char *)chunk->kva + pool->chunk_size) {
+			*(void **)kva = chunk->free;
+			chunk->free = kva;
+			chunk->nused--;
+			spin_unlock_irqrestore(&(pool->lock), intr_flag);
+			return;
+		}
+	}
+	spin_unlock_irqrestore(&(pool->lock), intr_flag);
+	panic("dmapool_free: %p is not of pool %s.\n", kva, pool->name);
+}
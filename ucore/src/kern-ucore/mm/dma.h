@@ -0,0 +1,23 @@
+#ifndef __KERN_MM_DMA_H__
+#define __KERN_MM_DMA_H__
+
+#include <types.h>
+
+/* *
+ * Buffers for the DMA of the drivers: physically contiguous however large,
+ * with the physical address the device is given. dma_contig_alloc takes
+ * whole pages, a dmapool hands out small blocks of such pages. See dma.c.
+ * */
+struct dmapool;
+
+void dma_contig_init(void);
+void *dma_contig_alloc(size_t size, uintptr_t * paddr);
+void dma_contig_free(void *kva, size_t size);
+
+struct dmapool *dmapool_create(const char *name, size_t size, size_t align,
+			       size_t boundary);
+void dmapool_destroy(struct dmapool *pool);
+void *dmapool_alloc(struct dmapool *pool, uintptr_t * paddr);
+void dmapool_free(struct dmapool *pool, void *kva);
+
+#endif /* !__KERN_MM_DMA_H__ */
@@ -0,0 +1,306 @@
+#include <types.h>
+#include <string.h>
+#include <list.h>
+#include <stdlib.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <slab.h>
+#include <sync.h>
+#include <error.h>
+#include <assert.h>
+#include <inode.h>
+#include <iobuf.h>
+#include <shrinker.h>
+#include <execmap.h>
+
+#ifdef UCONFIG_DEMAND_EXEC
+
+/*
+ * exec maps the PT_LOAD segments of the program without reading them: the
+ * vma of a segment remembers the file bytes it holds, see struct vma_exec,
+ * and the first fault on each page reads it in.
+ *
+ * A page lying wholly inside the file bytes is read into the exec cache,
+ * keyed by the inode and file offset, and mapped read-only from there, so
+ * that the processes running the same program share the text and the
+ * untouched data; a write to data copies it as with cow. The pages at the
+ * edges of a segment are private, as their tail is zeroed for the bss.
+ *
+ * The cache holds a reference to each page. The pages mapped nowhere else
+ * are dropped by its shrinker under memory pressure, all of them when the
+ * inode is killed or opened for writing.
+ *
+ * A file of a filesystem in memory, the ramdisk, is not read: its pages
+ * are mapped read-only in place, see vop_direct, and the cache is left out.
+ */
+
+#define EXECMAP_HASH_SHIFT              8
+#define EXECMAP_HASH_SIZE               (1 << EXECMAP_HASH_SHIFT)
+#define execmap_hashfn(node, offset)                                    \
+    hash32((uint32_t)(uintptr_t)(node) ^ (uint32_t)((offset) / PGSIZE), \
+           EXECMAP_HASH_SHIFT)
+
+struct exec_page {
+	list_entry_t hash_link;	/* entry in execmap_hash */
+	list_entry_t node_link;	/* entry in the in_exec_pages of node */
+	list_entry_t lru_link;	/* entry in execmap_lru, oldest first */
+	struct inode *node;
+	off_t offset;
+	struct Page *page;
+};
+
+#define le2epage(le, member)            to_struct((le), struct exec_page, member)
+
+static kmem_cache_t *exec_page_cachep;
+/* protects all of the below, and the in_exec_pages of the inodes */
+static spinlock_s execmap_lock;
+static list_entry_t execmap_hash[EXECMAP_HASH_SIZE];
+static list_entry_t execmap_lru;
+static size_t execmap_nr_pages;
+
+static struct shrinker execmap_shrinker;
+
+void execmap_init(void)
+{
+	int i;
+	exec_page_cachep =
+	    kmem_cache_create("exec_page", sizeof(struct exec_page), 0, NULL);
+	if (exec_page_cachep == NULL) {
+		panic("cannot create exec_page cache.\n");
+	}
+	spinlock_init(&execmap_lock);
+	for (i = 0; i < EXECMAP_HASH_SIZE; i++) {
+		list_init(execmap_hash + i);
+	}
+	list_init(&execmap_lru);
+	execmap_nr_pages = 0;
+	register_shrinker(&execmap_shrinker);
+}
+
+// vma_set_exec - vma maps the filesz bytes of node at offset from start on
+void
+vma_set_exec(struct vma_struct *vma, struct inode *node, uintptr_t start,
+	     size_t filesz, off_t offset)
+{
+	assert(vma->vm_start <= start && start + filesz <= vma->vm_end);
+	vop_ref_inc(node);
+	vma->exec.node = node;
+	vma->exec.start = start, vma->exec.end = start + filesz;
+	vma->exec.offset = offset;
+}
+
+void vma_copy_exec(struct vma_struct *to, struct vma_struct *from)
+{
+	to->exec = from->exec;
+	if (to->exec.node != NULL) {
+		vop_ref_inc(to->exec.node);
+	}
+}
+
+void vma_put_exec(struct vma_struct *vma)
+{
+	if (vma->exec.node != NULL) {
+		vop_ref_dec(vma->exec.node);
+		vma->exec.node = NULL;
+	}
+}
+
+// execmap_read - read len bytes of node at offset to off in the page at kva,
+//              - the rest of the page is zero
+static int
+execmap_read(struct inode *node, void *kva, size_t off, size_t len,
+	     off_t offset)
+{
+	struct iobuf __iob, *iob = iobuf_init(&__iob, kva + off, len, offset);
+	clear_page(kva);
+	return vop_read(node, iob);
+}
+
+static struct exec_page *execmap_lookup(struct inode *node, off_t offset)
+{
+	list_entry_t *list = execmap_hash + execmap_hashfn(node, offset), *le =
+	    list;
+	while ((le = list_next(le)) != list) {
+		struct exec_page *ep = le2epage(le, hash_link);
+		if (ep->node == node && ep->offset == offset) {
+			return ep;
+		}
+	}
+	return NULL;
+}
+
+// execmap_get - the cached page of the PGSIZE bytes of node at offset, with
+//             - a reference for the caller; read in if missing
+static int
+execmap_get(struct inode *node, off_t offset, struct Page **page_store)
+{
+	struct exec_page *ep, *nep = NULL;
+	struct Page *page;
+	int ret;
+
+	spinlock_acquire(&execmap_lock);
+	if ((ep = execmap_lookup(node, offset)) != NULL) {
+		goto found;
+	}
+	spinlock_release(&execmap_lock);
+
+	if ((page = alloc_page()) == NULL) {
+		return -E_NO_MEM;
+	}
+	if ((ret = execmap_read(node, page2kva(page), 0, PGSIZE, offset)) != 0
+	    || (nep = kmem_cache_alloc(exec_page_cachep)) == NULL) {
+		free_page(page);
+		return (ret != 0) ? ret : -E_NO_MEM;
+	}
+	nep->node = node, nep->offset = offset, nep->page = page;
+
+	spinlock_acquire(&execmap_lock);
+	if ((ep = execmap_lookup(node, offset)) != NULL) {
+		/* read in by another fault meanwhile */
+		goto found;
+	}
+	ep = nep, nep = NULL;
+	list_add(execmap_hash + execmap_hashfn(node, offset),
+		 &(ep->hash_link));
+	list_add(&(node->in_exec_pages), &(ep->node_link));
+	/* one for the cache */
+	set_page_ref(page, 1);
+	execmap_nr_pages++;
+	goto insert;
+
+found:
+	list_del(&(ep->lru_link));
+insert:
+	list_add_before(&execmap_lru, &(ep->lru_link));
+	page_ref_inc(ep->page);
+	*page_store = ep->page;
+	spinlock_release(&execmap_lock);
+	if (nep != NULL) {
+		free_page(nep->page);
+		kmem_cache_free(exec_page_cachep, nep);
+	}
+	return 0;
+}
+
+/*
+ * execmap_page - the page to map at addr of vma, which holds bytes of the
+ * file, with a reference for the caller to drop by execmap_put_page once it
+ * is mapped. *shared_store is set if it is the page of the exec cache, to
+ * be mapped read-only.
+ */
+int
+execmap_page(struct vma_struct *vma, uintptr_t addr, bool write,
+	     struct Page **page_store, bool * shared_store)
+{
+	struct vma_exec *exec = &(vma->exec);
+	assert(exec->node != NULL && addr % PGSIZE == 0 && addr < exec->end);
+	uintptr_t start = (addr > exec->start) ? addr : exec->start;
+	uintptr_t end = (addr + PGSIZE < exec->end) ? addr + PGSIZE : exec->end;
+	off_t offset = exec->offset + (start - exec->start);
+	struct Page *page;
+	int ret;
+
+	if (!write && start == addr && end == addr + PGSIZE) {
+		void *kva;
+		*shared_store = 1;
+		if (vop_has_direct(exec->node)
+		    && vop_direct(exec->node, offset, &kva) == 0) {
+			/* held by the device, it never goes to 0 */
+			page = kva2page(kva);
+			page_ref_inc(page);
+			*page_store = page;
+			return 0;
+		}
+		return execmap_get(exec->node, offset, page_store);
+	}
+	if ((page = alloc_page_policy(vma->vm_mm, addr)) == NULL) {
+		return -E_NO_MEM;
+	}
+	if ((ret =
+	     execmap_read(exec->node, page2kva(page), start - addr,
+			  end - start, offset)) != 0) {
+		free_page(page);
+		return ret;
+	}
+	set_page_ref(page, 1);
+	*shared_store = 0, *page_store = page;
+	return 0;
+}
+
+void execmap_put_page(struct Page *page)
+{
+	if (PageSwap(page)) {
+		page_ref_dec(page);
+	} else if (page_ref_dec(page) == 0) {
+		free_page(page);
+	}
+}
+
+static void execmap_free(list_entry_t * list)
+{
+	list_entry_t *le;
+	while ((le = list_next(list)) != list) {
+		struct exec_page *ep = le2epage(le, node_link);
+		list_del(le);
+		execmap_put_page(ep->page);
+		kmem_cache_free(exec_page_cachep, ep);
+	}
+}
+
+// execmap_invalidate - drop the cached pages of node, the pages mapped
+//                    - somewhere stay there
+void execmap_invalidate(struct inode *node)
+{
+	list_entry_t free_list, *le;
+	list_init(&free_list);
+	spinlock_acquire(&execmap_lock);
+	while ((le = list_next(&(node->in_exec_pages))) !=
+	       &(node->in_exec_pages)) {
+		struct exec_page *ep = le2epage(le, node_link);
+		list_del(&(ep->hash_link));
+		list_del(&(ep->lru_link));
+		list_del(le);
+		list_add(&free_list, le);
+		execmap_nr_pages--;
+	}
+	spinlock_release(&execmap_lock);
+	execmap_free(&free_list);
+}
+
+// execmap_reclaim - free up to n cached pages mapped nowhere
+static size_t execmap_reclaim(size_t n)
+{
+	list_entry_t free_list, *le = &execmap_lru;
+	size_t free_count = 0;
+	list_init(&free_list);
+	spinlock_acquire(&execmap_lock);
+	while (free_count < n && (le = list_next(le)) != &execmap_lru) {
+		struct exec_page *ep = le2epage(le, lru_link);
+		if (page_ref(ep->page) == 1) {
+			le = list_prev(le);
+			list_del(&(ep->hash_link));
+			list_del(&(ep->lru_link));
+			list_del(&(ep->node_link));
+			list_add(&free_list, &(ep->node_link));
+			free_count++;
+		}
+	}
+	execmap_nr_pages -= free_count;
+	spinlock_release(&execmap_lock);
+	execmap_free(&free_list);
+	return free_count;
+}
+
+// execmap_count - the cached pages, some may be mapped still
+static size_t execmap_count(void)
+{
+	return execmap_nr_pages;
+}
+
+static struct shrinker execmap_shrinker = {
+	.name = "execmap",
+	.count = execmap_count,
+	.scan = execmap_reclaim,
+};
+
+#endif /* UCONFIG_DEMAND_EXEC */
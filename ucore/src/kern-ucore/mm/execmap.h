@@ -0,0 +1,24 @@
+#ifndef __KERN_MM_EXECMAP_H__
+#define __KERN_MM_EXECMAP_H__
+
+#include <types.h>
+
+#ifdef UCONFIG_DEMAND_EXEC
+
+struct inode;
+struct vma_struct;
+struct Page;
+
+void execmap_init(void);
+void vma_set_exec(struct vma_struct *vma, struct inode *node, uintptr_t start,
+		  size_t filesz, off_t offset);
+void vma_copy_exec(struct vma_struct *to, struct vma_struct *from);
+void vma_put_exec(struct vma_struct *vma);
+int execmap_page(struct vma_struct *vma, uintptr_t addr, bool write,
+		 struct Page **page_store, bool * shared_store);
+void execmap_put_page(struct Page *page);
+void execmap_invalidate(struct inode *node);
+
+#endif
+
+#endif /* !__KERN_MM_EXECMAP_H__ */
@@ -0,0 +1,371 @@
+#include <types.h>
+#include <string.h>
+#include <list.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <slab.h>
+#include <proc.h>
+#include <sync.h>
+#include <mp.h>
+#include <assert.h>
+#include <kio.h>
+#include <ksm.h>
+
+#ifdef UCONFIG_KSM
+
+/*
+ * ksmd merges the identical pages of private writable anonymous memory.
+ * Each round it scans up to KSM_SCAN_PAGES pages of the next mm on
+ * proc_mm_list, from where the last round of that mm stopped. A page mapped
+ * once only (page_ref == 1, not in the swap cache) is
+ *
+ *  - replaced by the zero page if it is all zeros;
+ *  - replaced by a stable page with the same contents, if there is one;
+ *  - made a stable page itself, if a page seen before in this pass, a
+ *    candidate, has the same contents now;
+ *  - remembered as a candidate otherwise.
+ *
+ * The pages are compared only once their pte is read-only and flushed, so
+ * that they cannot change meanwhile; the pte of a page that turns out to
+ * differ stays read-only, and the next write takes it back without a copy.
+ *
+ * A stable page is mapped read-only wherever it is, and the table holds a
+ * reference to it, so that a write always copies it as with cow. Every
+ * KSM_PASS_ROUNDS rounds the candidates are forgotten and the stable pages
+ * that are mapped nowhere any more are dropped.
+ */
+
+#define KSM_SCAN_PAGES                  256
+#define KSM_SLEEP_TICKS                 20
+#define KSM_PASS_ROUNDS                 64
+#define KSM_MAX_CANDIDATES              4096
+#define KSM_HASH_SHIFT                  8
+#define KSM_HASH_SIZE                   (1 << KSM_HASH_SHIFT)
+#define ksm_hash(sum)                   ((sum) & (KSM_HASH_SIZE - 1))
+
+struct ksm_item {
+	list_entry_t hash_link;
+	uint32_t checksum;
+	struct Page *page;
+};
+
+#define le2kitem(le, member)            to_struct((le), struct ksm_item, member)
+
+static kmem_cache_t *ksm_item_cachep;
+/* only ksmd touches these */
+static list_entry_t ksm_stable[KSM_HASH_SIZE];
+static list_entry_t ksm_cands[KSM_HASH_SIZE];
+static size_t ksm_nr_cands;
+
+// ksm_checksum - FNV-1a over the words of the page at kva
+static uint32_t ksm_checksum(const void *kva)
+{
+	const uint32_t *p = kva;
+	uint32_t sum = 2166136261U;
+	size_t i;
+	for (i = 0; i < PGSIZE / sizeof(uint32_t); i++) {
+		sum = (sum ^ p[i]) * 16777619U;
+	}
+	return sum;
+}
+
+static bool ksm_page_zero(const void *kva)
+{
+	const uintptr_t *p = kva;
+	size_t i;
+	for (i = 0; i < PGSIZE / sizeof(uintptr_t); i++) {
+		if (p[i] != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// ksm_find - the item of table with the contents of page at kva, or NULL
+static struct ksm_item *ksm_find(list_entry_t * table, uint32_t sum,
+				 struct Page *page, const void *kva)
+{
+	list_entry_t *list = &table[ksm_hash(sum)], *le = list;
+	while ((le = list_next(le)) != list) {
+		struct ksm_item *item = le2kitem(le, hash_link);
+		if (item->checksum == sum && item->page != page
+		    && memcmp(page2kva(item->page), kva, PGSIZE) == 0) {
+			return item;
+		}
+	}
+	return NULL;
+}
+
+// ksm_wrprotect - make the pte of page at addr read-only, with pt_lock
+//               - held; returns 0 if it is not orig any more
+static bool
+ksm_wrprotect(struct mm_struct *mm, uintptr_t addr, pte_t * ptep, pte_t orig)
+{
+	if (*ptep != orig) {
+		return 0;
+	}
+	if (ptep_s_write(ptep) || ptep_u_write(ptep)) {
+		ptep_unset_s_write(ptep);
+		ptep_unset_u_write(ptep);
+		mp_tlb_invalidate(mm->pgdir, addr);
+	}
+	return 1;
+}
+
+// ksm_merge - map kpage at addr instead of the page of orig, if they are
+//           - the same; the page is freed then
+static bool
+ksm_merge(struct mm_struct *mm, uintptr_t addr, pte_t * ptep, pte_t orig,
+	  struct Page *kpage)
+{
+	bool ret = 0;
+	spinlock_acquire(&(mm->pt_lock));
+	struct Page *page = pte2page(orig);
+	if (ksm_wrprotect(mm, addr, ptep, orig) && page_ref(page) == 1
+	    && memcmp(page2kva(page), page2kva(kpage), PGSIZE) == 0) {
+		page_insert(mm->pgdir, kpage, addr, ptep_get_perm(ptep, PTE_USER));
+		ret = 1;
+	}
+	spinlock_release(&(mm->pt_lock));
+	return ret;
+}
+
+// ksm_promote - make the page of orig at addr a stable page
+static void
+ksm_promote(struct mm_struct *mm, uintptr_t addr, pte_t * ptep, pte_t orig)
+{
+	struct ksm_item *item;
+	if ((item = kmem_cache_alloc(ksm_item_cachep)) == NULL) {
+		return;
+	}
+	item->page = pte2page(orig);
+	spinlock_acquire(&(mm->pt_lock));
+	if (ksm_wrprotect(mm, addr, ptep, orig)) {
+		/* read-only from now on, the sum holds */
+		item->checksum = ksm_checksum(page2kva(item->page));
+		page_ref_inc(item->page);
+		list_add(&ksm_stable[ksm_hash(item->checksum)],
+			 &(item->hash_link));
+		item = NULL;
+	}
+	spinlock_release(&(mm->pt_lock));
+	if (item != NULL) {
+		kmem_cache_free(ksm_item_cachep, item);
+	}
+}
+
+static void ksm_scan_pte(struct mm_struct *mm, uintptr_t addr, pte_t * ptep)
+{
+	pte_t orig = *ptep;
+	if (!ptep_present(&orig)) {
+		return;
+	}
+	struct Page *page = pte2page(orig);
+	if (page == zero_page || PageReserved(page) || PageIO(page)
+	    || PageSwap(page) || page_ref(page) != 1) {
+		return;
+	}
+
+	void *kva = page2kva(page);
+	if (ksm_page_zero(kva)) {
+		ksm_merge(mm, addr, ptep, orig, zero_page);
+		return;
+	}
+	uint32_t sum = ksm_checksum(kva);
+	struct ksm_item *item;
+	if ((item = ksm_find(ksm_stable, sum, page, kva)) != NULL) {
+		ksm_merge(mm, addr, ptep, orig, item->page);
+	} else if ((item = ksm_find(ksm_cands, sum, page, kva)) != NULL) {
+		/* the candidate merges with this on its next scan */
+		list_del(&(item->hash_link));
+		kmem_cache_free(ksm_item_cachep, item);
+		ksm_nr_cands--;
+		ksm_promote(mm, addr, ptep, orig);
+	} else if (ksm_nr_cands < KSM_MAX_CANDIDATES
+		   && (item = kmem_cache_alloc(ksm_item_cachep)) != NULL) {
+		/* no reference, it is only compared against */
+		item->checksum = sum, item->page = page;
+		list_add(&ksm_cands[ksm_hash(sum)], &(item->hash_link));
+		ksm_nr_cands++;
+	}
+}
+
+static bool ksm_vma_mergeable(struct vma_struct *vma)
+{
+	if ((vma->vm_flags & (VM_SHARE | VM_IO | VM_WRITE)) != VM_WRITE) {
+		return 0;
+	}
+#ifdef UCONFIG_BIONIC_LIBC
+	if (vma->mfile.file != NULL) {
+		return 0;
+	}
+#endif
+	return 1;
+}
+
+// ksm_scan_vma - scan vma from *addrp on, returns the budget left
+static size_t
+ksm_scan_vma(struct mm_struct *mm, struct vma_struct *vma, uintptr_t * addrp,
+	     size_t budget)
+{
+	uintptr_t addr = *addrp;
+	while (addr < vma->vm_end && budget > 0) {
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+		pmd_t *pmdp = get_pmd(mm->pgdir, addr, 0);
+		if (pmdp != NULL && pmd_huge(pmdp)) {
+			addr = ROUNDDOWN(addr + HPAGE_SIZE, HPAGE_SIZE);
+			continue;
+		}
+#endif
+#ifdef UCONFIG_SHARED_PT
+		/* get_pte would copy it to merge what fork shares already */
+		pmd_t *spmdp = get_pmd(mm->pgdir, addr, 0);
+		if (spmdp != NULL && pmd_shared(spmdp)) {
+			addr = ROUNDDOWN(addr + PTSIZE, PTSIZE);
+			continue;
+		}
+#endif
+		pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+		if (ptep == NULL) {
+			if (get_pud(mm->pgdir, addr, 0) == NULL) {
+				addr = ROUNDDOWN(addr + PUSIZE, PUSIZE);
+			} else if (get_pmd(mm->pgdir, addr, 0) == NULL) {
+				addr = ROUNDDOWN(addr + PMSIZE, PMSIZE);
+			} else {
+				addr = ROUNDDOWN(addr + PTSIZE, PTSIZE);
+			}
+			continue;
+		}
+		ksm_scan_pte(mm, addr, ptep);
+		addr += PGSIZE, budget--;
+	}
+	*addrp = addr;
+	return budget;
+}
+
+// ksm_scan_mm - scan budget pages of mm from mm->ksm_address on, with mm
+//             - locked shared
+static void ksm_scan_mm(struct mm_struct *mm, size_t budget)
+{
+	uintptr_t addr = mm->ksm_address;
+	struct vma_struct *vma;
+	if (list_empty(&(mm->mmap_list))) {
+		return;
+	}
+	if ((vma = find_vma(mm, addr)) == NULL) {
+		addr = 0;
+		vma = le2vma(list_next(&(mm->mmap_list)), list_link);
+	}
+	while (budget > 0) {
+		if (addr < vma->vm_start) {
+			addr = vma->vm_start;
+		}
+		if (ksm_vma_mergeable(vma)) {
+			budget = ksm_scan_vma(mm, vma, &addr, budget);
+		} else {
+			addr = vma->vm_end;
+		}
+		if (addr < vma->vm_end) {
+			break;
+		}
+		list_entry_t *le = list_next(&(vma->list_link));
+		if (le == &(mm->mmap_list)) {
+			/* the next round of mm starts over */
+			addr = 0;
+			break;
+		}
+		vma = le2vma(le, list_link);
+	}
+	mm->ksm_address = addr;
+}
+
+// ksm_end_pass - forget the candidates, and drop the stable pages that are
+//              - mapped nowhere
+static void ksm_end_pass(void)
+{
+	int i;
+	for (i = 0; i < KSM_HASH_SIZE; i++) {
+		list_entry_t *list = &ksm_cands[i], *le;
+		while ((le = list_next(list)) != list) {
+			list_del(le);
+			kmem_cache_free(ksm_item_cachep, le2kitem(le, hash_link));
+		}
+		list = &ksm_stable[i], le = list_next(list);
+		while (le != list) {
+			struct ksm_item *item = le2kitem(le, hash_link);
+			struct Page *page = item->page;
+			le = list_next(le);
+			if (page_ref(page) != 1) {
+				continue;
+			}
+			list_del(&(item->hash_link));
+			kmem_cache_free(ksm_item_cachep, item);
+			/* the swap lists free a page in the swap cache */
+			if (PageSwap(page)) {
+				page_ref_dec(page);
+			} else if (page_ref_dec(page) == 0) {
+				free_page(page);
+			}
+		}
+	}
+	ksm_nr_cands = 0;
+}
+
+// ksm_scan_next - scan the mm at the head of proc_mm_list, which goes to
+//               - the tail
+static void ksm_scan_next(void)
+{
+	struct mm_struct *mm = NULL;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		list_entry_t *list = &proc_mm_list, *le;
+		if ((le = list_next(list)) != list) {
+			list_del(le);
+			list_add_before(list, le);
+			mm = le2mm(le, proc_mm_link);
+			/* an mm at zero is being freed by its last user */
+			if (mm_count(mm) == 0) {
+				mm = NULL;
+			} else {
+				mm_count_inc(mm);
+			}
+		}
+	}
+	local_intr_restore(intr_flag);
+	if (mm != NULL) {
+		lock_mm_shared(mm);
+		ksm_scan_mm(mm, KSM_SCAN_PAGES);
+		unlock_mm_shared(mm);
+		put_mm(mm);
+	}
+}
+
+int ksmd_main(void *arg)
+{
+	unsigned int rounds = 0;
+	while (1) {
+		ksm_scan_next();
+		if (++rounds % KSM_PASS_ROUNDS == 0) {
+			ksm_end_pass();
+		}
+		do_sleep(KSM_SLEEP_TICKS);
+	}
+}
+
+void ksm_init(void)
+{
+	int i;
+	ksm_item_cachep = kmem_cache_create("ksm_item", sizeof(struct ksm_item),
+					    0, NULL);
+	if (ksm_item_cachep == NULL) {
+		panic("cannot create ksm cache.\n");
+	}
+	for (i = 0; i < KSM_HASH_SIZE; i++) {
+		list_init(&ksm_stable[i]);
+		list_init(&ksm_cands[i]);
+	}
+	ksm_nr_cands = 0;
+}
+
+#endif /* UCONFIG_KSM */
@@ -0,0 +1,11 @@
+#ifndef __KERN_MM_KSM_H__
+#define __KERN_MM_KSM_H__
+
+#include <types.h>
+
+#ifdef UCONFIG_KSM
+void ksm_init(void);
+int ksmd_main(void *arg);
+#endif
+
+#endif /* !__KERN_MM_KSM_H__ */
@@ -0,0 +1,369 @@
+#include <types.h>
+#include <atomic.h>
+#include <sync.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <swap.h>
+#include <proc.h>
+#include <error.h>
+#include <assert.h>
+#include <string.h>
+#include <memcg.h>
+
+#ifdef UCONFIG_MEMCG
+
+/*
+ * Memory groups bound the user pages of the processes in them, so that
+ * the allocation storm of one tenant is reclaimed from itself rather than
+ * from the pages of everyone else through the global kswapd.
+ *
+ * A process is in the group of its parent unless moved by MEMCG_ATTACH,
+ * and an mm is in the group of the process it is made for; a page is
+ * charged, page->memcg, to the group of the mm that first maps it: a new
+ * page, a copy on write, a page read back from swap. The pages of the sfs
+ * page cache are charged to the group of the reader. A charge goes up to
+ * all the parents, so a group accounts for its children too, and a page
+ * stays charged until it is freed, whatever mm maps it since.
+ *
+ * A charge that would take a group over its limit asks kswapd to reclaim
+ * from that group (try_free_group_pages): the clock of swap_out_mm runs
+ * over the mms of the group and its children only, and the launder takes
+ * only their pages off the inactive lists. The charge fails, and so the
+ * fault, if the group is still full after MEMCG_RECLAIM_RETRIES rounds.
+ * When memory is short for all, kswapd first takes the groups over their
+ * soft limits down to them.
+ *
+ * A group is freed once it is destroyed, nothing refers to it and the
+ * last page charged to it is freed, see memcg_try_release.
+ */
+
+#define MAX_MEM_GROUPS                  64
+#define MEMCG_RECLAIM_RETRIES           4
+
+#define MEMCG_FREE                      0
+#define MEMCG_LIVE                      1
+#define MEMCG_DEAD                      2
+
+static struct mem_group mem_groups[MAX_MEM_GROUPS];
+static spinlock_s memcg_lock;
+
+#define bytes2pages(n)                  (((n) + PGSIZE - 1) / PGSIZE)
+
+void memcg_init(void)
+{
+	int i;
+	spinlock_init(&memcg_lock);
+	for (i = 0; i < MAX_MEM_GROUPS; i++) {
+		memset(mem_groups + i, 0, sizeof(struct mem_group));
+		mem_groups[i].id = i + 1;
+		mem_groups[i].state = MEMCG_FREE;
+	}
+}
+
+// memcg_lookup - the live group of id, memcg_lock held
+static struct mem_group *memcg_lookup(int id)
+{
+	if (id > 0 && id <= MAX_MEM_GROUPS
+	    && mem_groups[id - 1].state == MEMCG_LIVE) {
+		return mem_groups + id - 1;
+	}
+	return NULL;
+}
+
+struct mem_group *memcg_get(struct mem_group *g)
+{
+	if (g != NULL) {
+		atomic_inc(&(g->ref));
+	}
+	return g;
+}
+
+// memcg_try_release - free g if it is destroyed, unreferred and empty
+static void memcg_try_release(struct mem_group *g)
+{
+	struct mem_group *parent = NULL;
+	spinlock_acquire(&memcg_lock);
+	if (g->state == MEMCG_DEAD && atomic_read(&(g->ref)) == 0
+	    && atomic_read(&(g->usage)) == 0) {
+		g->state = MEMCG_FREE;
+		parent = g->parent, g->parent = NULL;
+	}
+	spinlock_release(&memcg_lock);
+	memcg_put(parent);
+}
+
+void memcg_put(struct mem_group *g)
+{
+	if (g != NULL && atomic_dec_test_zero(&(g->ref))) {
+		memcg_try_release(g);
+	}
+}
+
+// memcg_next - the group after g, or the first if g is NULL, that is not free
+struct mem_group *memcg_next(struct mem_group *g)
+{
+	int i = (g == NULL) ? 0 : g->id;
+	for (; i < MAX_MEM_GROUPS; i++) {
+		if (mem_groups[i].state != MEMCG_FREE) {
+			return mem_groups + i;
+		}
+	}
+	return NULL;
+}
+
+// memcg_within - g is root or one of its children
+bool memcg_within(struct mem_group *g, struct mem_group *root)
+{
+	for (; g != NULL; g = g->parent) {
+		if (g == root) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// try_charge - charge a page to g and its parents; the first of them
+//            - over its limit is returned, and then nothing is charged
+//            - unless force
+static struct mem_group *try_charge(struct mem_group *g, bool force)
+{
+	struct mem_group *p, *over = NULL;
+	for (p = g; p != NULL; p = p->parent) {
+		size_t usage = atomic_add_return(&(p->usage), 1);
+		if (p->limit != 0 && usage > p->limit && over == NULL) {
+			over = p;
+		}
+	}
+	if (over != NULL && !force) {
+		for (p = g; p != NULL; p = p->parent) {
+			atomic_sub(&(p->usage), 1);
+		}
+		return over;
+	}
+	for (p = g; p != NULL; p = p->parent) {
+		if (memcg_usage(p) > p->max_usage) {
+			p->max_usage = memcg_usage(p);
+		}
+	}
+	return over;
+}
+
+// page_set_memcg - make page charged to g, if another has not charged it
+//                - meanwhile, the same page read back from swap for two mms
+static bool page_set_memcg(struct Page *page, struct mem_group *g)
+{
+	if (test_and_set_bit(PG_memcg, &(page->flags))) {
+		return 0;
+	}
+	page->memcg = g;
+	return 1;
+}
+
+// memcg_charge - charge page, just mapped by mm, to the group of mm,
+//              - reclaiming from the group while it is full
+int memcg_charge(struct mm_struct *mm, struct Page *page)
+{
+	struct mem_group *g = mm->memcg, *over;
+	int retries = MEMCG_RECLAIM_RETRIES;
+	if (g == NULL || PageMemcg(page)) {
+		return 0;
+	}
+	while ((over = try_charge(g, 0)) != NULL) {
+		if (retries-- == 0 || !try_free_group_pages(over, 1)) {
+			over->failcnt++;
+			return -E_NO_MEM;
+		}
+	}
+	if (!page_set_memcg(page, g)) {
+		__memcg_uncharge_group(g);
+	}
+	return 0;
+}
+
+// memcg_charge_cache - charge a page of the page cache to the group of
+//                    - current; the read goes on over the limit, and the
+//                    - group is reclaimed from at the next round of kswapd
+void memcg_charge_cache(struct Page *page)
+{
+	struct mem_group *g, *over;
+	if (current == NULL || current->mm == NULL
+	    || (g = current->mm->memcg) == NULL) {
+		return;
+	}
+	if ((over = try_charge(g, 1)) != NULL) {
+		over->pressure++;
+	}
+	if (!page_set_memcg(page, g)) {
+		__memcg_uncharge_group(g);
+	}
+}
+
+// __memcg_uncharge_group - give a page charged to g and its parents back
+void __memcg_uncharge_group(struct mem_group *g)
+{
+	while (g != NULL) {
+		struct mem_group *parent = g->parent;
+		if (atomic_sub_return(&(g->usage), 1) == 0
+		    && g->state == MEMCG_DEAD) {
+			memcg_try_release(g);
+		}
+		g = parent;
+	}
+}
+
+void __memcg_uncharge(struct Page *page)
+{
+	struct mem_group *g = page->memcg;
+	page->memcg = NULL;
+	ClearPageMemcg(page);
+	__memcg_uncharge_group(g);
+}
+
+static int memcg_create(int parent_id, size_t limit, size_t soft_limit)
+{
+	struct mem_group *parent = NULL, *g = NULL;
+	int i, ret = -E_INVAL;
+	spinlock_acquire(&memcg_lock);
+	if (parent_id != 0 && (parent = memcg_lookup(parent_id)) == NULL) {
+		goto out;
+	}
+	ret = -E_NO_MEM;
+	for (i = 0; i < MAX_MEM_GROUPS; i++) {
+		if (mem_groups[i].state == MEMCG_FREE) {
+			g = mem_groups + i;
+			break;
+		}
+	}
+	if (g != NULL) {
+		g->state = MEMCG_LIVE;
+		g->parent = memcg_get(parent);
+		atomic_set(&(g->ref), 1);
+		atomic_set(&(g->usage), 0);
+		g->limit = bytes2pages(limit);
+		g->soft_limit = bytes2pages(soft_limit);
+		g->max_usage = g->failcnt = g->reclaimed = 0;
+		g->pressure = 0;
+		ret = g->id;
+	}
+out:
+	spinlock_release(&memcg_lock);
+	return ret;
+}
+
+// memcg_destroy - destroy group id, in which there must be neither procs
+//               - nor children any more; the pages still charged to it
+//               - keep it until they are freed
+static int memcg_destroy(int id)
+{
+	struct mem_group *g;
+	int ret = 0;
+	spinlock_acquire(&memcg_lock);
+	if ((g = memcg_lookup(id)) == NULL) {
+		ret = -E_INVAL;
+	} else if (atomic_read(&(g->ref)) != 1) {
+		ret = -E_BUSY;
+	} else {
+		g->state = MEMCG_DEAD;
+	}
+	spinlock_release(&memcg_lock);
+	if (ret == 0) {
+		memcg_put(g);
+	}
+	return ret;
+}
+
+static int memcg_set_limit(int id, size_t limit, size_t soft_limit)
+{
+	struct mem_group *g;
+	int ret = 0;
+	spinlock_acquire(&memcg_lock);
+	if ((g = memcg_lookup(id)) == NULL) {
+		ret = -E_INVAL;
+	} else {
+		g->limit = bytes2pages(limit);
+		g->soft_limit = bytes2pages(soft_limit);
+		/* the pages over a lowered limit go at the next round of kswapd */
+		if (g->limit != 0 && memcg_usage(g) > g->limit) {
+			g->pressure++;
+		}
+	}
+	spinlock_release(&memcg_lock);
+	return ret;
+}
+
+// memcg_attach - move proc pid, 0 for current, and its mm to group id, 0
+//              - for none; the pages already charged stay where they are
+static int memcg_attach(int id, int pid)
+{
+	struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+	struct mem_group *g = NULL, *old;
+	if (proc == NULL || proc->state == PROC_ZOMBIE || proc->mm == NULL) {
+		return -E_INVAL;
+	}
+	if (id != 0) {
+		spinlock_acquire(&memcg_lock);
+		g = memcg_get(memcg_lookup(id));
+		spinlock_release(&memcg_lock);
+		if (g == NULL) {
+			return -E_INVAL;
+		}
+	}
+	old = proc->memcg, proc->memcg = g;
+	memcg_put(old);
+
+	struct mm_struct *mm = proc->mm;
+	lock_mm(mm);
+	{
+		old = mm->memcg, mm->memcg = memcg_get(g);
+	}
+	unlock_mm(mm);
+	memcg_put(old);
+	return 0;
+}
+
+static int memcg_stat(int id, struct memcg_stat *stat)
+{
+	struct mm_struct *mm = current->mm;
+	struct memcg_stat kstat;
+	struct mem_group *g;
+	spinlock_acquire(&memcg_lock);
+	if ((g = memcg_lookup(id)) != NULL) {
+		kstat.usage = memcg_usage(g) * PGSIZE;
+		kstat.max_usage = g->max_usage * PGSIZE;
+		kstat.limit = g->limit * PGSIZE;
+		kstat.soft_limit = g->soft_limit * PGSIZE;
+		kstat.failcnt = g->failcnt;
+		kstat.reclaimed = g->reclaimed * PGSIZE;
+	}
+	spinlock_release(&memcg_lock);
+	if (g == NULL) {
+		return -E_INVAL;
+	}
+	lock_mm_shared(mm);
+	if (!copy_to_user(mm, stat, &kstat, sizeof(struct memcg_stat))) {
+		unlock_mm_shared(mm);
+		return -E_INVAL;
+	}
+	unlock_mm_shared(mm);
+	return 0;
+}
+
+// do_memcg - the MEMCG_xxx op of memgroup.h on group id
+int do_memcg(int op, int id, size_t arg0, uintptr_t arg1)
+{
+	switch (op) {
+	case MEMCG_CREATE:
+		return memcg_create(id, arg0, arg1);
+	case MEMCG_DESTROY:
+		return memcg_destroy(id);
+	case MEMCG_SET_LIMIT:
+		return memcg_set_limit(id, arg0, arg1);
+	case MEMCG_ATTACH:
+		return memcg_attach(id, (int)arg0);
+	case MEMCG_STAT:
+		return memcg_stat(id, (struct memcg_stat *)arg1);
+	}
+	return -E_INVAL;
+}
+
+#endif /* UCONFIG_MEMCG */
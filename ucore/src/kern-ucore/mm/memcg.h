@@ -0,0 +1,87 @@
+#ifndef __KERN_MM_MEMCG_H__
+#define __KERN_MM_MEMCG_H__
+
+#include <types.h>
+#include <atomic.h>
+#include <memlayout.h>
+#include <memgroup.h>
+
+struct mm_struct;
+struct proc_struct;
+
+#ifdef UCONFIG_MEMCG
+
+/* *
+ * mem_group - a group of processes whose user pages are accounted and
+ * limited together, see memcg.c. All counts are in pages.
+ * */
+struct mem_group {
+	int id;			// 1.. for user space, the slot + 1
+	int state;		// MEMCG_FREE, MEMCG_LIVE or MEMCG_DEAD
+	struct mem_group *parent;	// NULL for a top one
+	atomic_t ref;		// procs, mms, children and being live
+	atomic_t usage;		// pages charged to it and its children
+	size_t limit;		// 0 for none
+	size_t soft_limit;	// what global reclaim takes it down to first
+	size_t max_usage;
+	size_t failcnt;		// charges failed at the limit
+	size_t reclaimed;	// pages reclaim took from it and its children
+	int pressure;		// the reclaim asked for, see try_free_group_pages
+};
+
+void memcg_init(void);
+struct mem_group *memcg_get(struct mem_group *g);
+void memcg_put(struct mem_group *g);
+struct mem_group *memcg_next(struct mem_group *g);
+bool memcg_within(struct mem_group *g, struct mem_group *root);
+int memcg_charge(struct mm_struct *mm, struct Page *page);
+void memcg_charge_cache(struct Page *page);
+void __memcg_uncharge_group(struct mem_group *g);
+void __memcg_uncharge(struct Page *page);
+
+int do_memcg(int op, int id, size_t arg0, uintptr_t arg1);
+
+static inline size_t memcg_usage(struct mem_group *g)
+{
+	return atomic_read(&(g->usage));
+}
+
+// memcg_uncharge_pages - give the charges of the n pages from base back,
+//                      - as they are freed
+static inline void memcg_uncharge_pages(struct Page *base, size_t n)
+{
+	for (; n > 0; n--, base++) {
+		if (PageMemcg(base)) {
+			__memcg_uncharge(base);
+		}
+	}
+}
+
+// memcg_move_charge - newpage takes the place of page, and its charge
+static inline void memcg_move_charge(struct Page *newpage, struct Page *page)
+{
+	if (PageMemcg(page)) {
+		newpage->memcg = page->memcg;
+		SetPageMemcg(newpage);
+		page->memcg = NULL;
+		ClearPageMemcg(page);
+	}
+}
+
+#define page_memcg_within(page, g)          ((g) == NULL || memcg_within((page)->memcg, g))
+
+#else
+
+struct mem_group;
+
+#define memcg_get(g)                        (g)
+#define memcg_put(g)                        do { } while (0)
+#define memcg_charge(mm, page)              0
+#define memcg_charge_cache(page)            do { } while (0)
+#define memcg_uncharge_pages(base, n)       do { } while (0)
+#define memcg_move_charge(newpage, page)    do { } while (0)
+#define page_memcg_within(page, g)          1
+
+#endif /* UCONFIG_MEMCG */
+
+#endif /* !__KERN_MM_MEMCG_H__ */
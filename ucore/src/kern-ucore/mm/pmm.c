@@ -4,11 +4,147 @@
 #include <memlayout.h>
 #include <swap.h>
 #include <mp.h>
+#include <tlb.h>
 
 /**************************************************
  * Page table operations
  **************************************************/
 
+// pt_install - fill a page table entry read as old with a new table, the
+//            - page faults of an mm may race for it, the loser frees its one
+static void pt_install(pte_t * entry, pte_t old, pte_t val, struct Page *page)
+{
+	if (!__sync_bool_compare_and_swap(entry, old, val)) {
+		set_page_ref(page, 0);
+		free_page(page);
+	}
+}
+
+#ifdef UCONFIG_SHARED_PT
+/* *
+ * Shared page tables: copy_range shares the pte pages wholly inside a
+ * private vma of the parent with the child instead of copying them, see
+ * pt_share. Both pmds lose their write bit, so nothing writes through
+ * either, and the page_ref of the pte page counts the pmds on it. The
+ * first get_pte of an mm in its range gives the mm a copy of its own, see
+ * pt_unshare, and the ptes become copy-on-write in both then, as
+ * copy_range would have made them. The walkers drop a shared pte page
+ * they wholly unmap and unshare it otherwise. pt_share_lock orders the
+ * mms on a pte page, which do not hold the locks of one another.
+ * */
+static spinlock_s pt_share_lock;
+
+static void pt_entry(pte_t * entry, struct Page *page)
+{
+	pte_t e = 0;
+	ptep_map(&e, page2pa(page));
+	ptep_set_u_write(&e);
+	ptep_set_accessed(&e);
+	ptep_set_dirty(&e);
+	*entry = e;
+}
+
+// pt_unshare - give pgdir a pte page of its own at the shared pmdp of la
+static int pt_unshare(pgd_t * pgdir, uintptr_t la, pmd_t * pmdp)
+{
+	/* the allocation may sleep, it is wasted if someone was first */
+	struct Page *page = alloc_page();
+	int i, ret = 0;
+	spinlock_acquire(&pt_share_lock);
+	if (!pmd_shared(pmdp)) {
+		/* another thread of pgdir */
+		goto out;
+	}
+	struct Page *shared = pmd2page(*pmdp);
+	if (page_ref(shared) == 1) {
+		/* the others are gone, it is ours */
+		ptep_set_u_write(pmdp);
+		goto out_flush;
+	}
+	if (page == NULL) {
+		ret = -E_NO_MEM;
+		goto out;
+	}
+	pte_t *from = KADDR(PMD_ADDR(*pmdp)), *to = page2kva(page);
+	for (i = 0; i < NPGENTRY; i++) {
+		pte_t *ptep = from + i;
+		if (ptep_present(ptep)) {
+			page_ref_inc(pte2page(*ptep));
+			ptep_unset_s_write(ptep);
+			ptep_unset_u_write(ptep);
+		} else if (!ptep_invalid(ptep)) {
+#ifdef UCONFIG_SWAP
+			swap_duplicate(*ptep);
+#endif
+		}
+		to[i] = *ptep;
+	}
+	set_page_ref(page, 1);
+	page_ref_dec(shared);
+	pt_entry(pmdp, page);
+	page = NULL;
+out_flush:
+	spinlock_release(&pt_share_lock);
+	mp_tlb_flush_range(pgdir, ROUNDDOWN(la, PTSIZE),
+			   ROUNDDOWN(la, PTSIZE) + PTSIZE);
+	goto out_free;
+out:
+	spinlock_release(&pt_share_lock);
+out_free:
+	if (page != NULL) {
+		free_page(page);
+	}
+	return ret;
+}
+
+// pt_drop - the pte page of the shared pmdp is wholly unmapped from
+//         - tlb->pgdir: let it go unless it is the last one on it
+static void pt_drop(struct tlb_gather *tlb, uintptr_t la, pmd_t * pmdp)
+{
+	spinlock_acquire(&pt_share_lock);
+	struct Page *shared = pmd2page(*pmdp);
+	if (page_ref(shared) > 1) {
+		page_ref_dec(shared);
+		ptep_unmap(pmdp);
+	} else {
+		/* unmapped as any other */
+		ptep_set_u_write(pmdp);
+	}
+	spinlock_release(&pt_share_lock);
+	tlb_gather_add(tlb, la);
+	tlb_gather_add(tlb, la + PTSIZE - PGSIZE);
+}
+
+// pt_share - share the pte page of from at la with to, 1 if from has none
+//          - there; the tlb flush of from is left to tlb
+static int
+pt_share(struct tlb_gather *tlb, pgd_t * to, pgd_t * from, uintptr_t la)
+{
+	pmd_t *pmdp = get_pmd(from, la, 0), *npmdp;
+	if (pmdp == NULL || !ptep_present(pmdp)
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+	    || pmd_huge(pmdp)
+#endif
+	    ) {
+		return 1;
+	}
+	if ((npmdp = get_pmd(to, la, 1)) == NULL) {
+		return -E_NO_MEM;
+	}
+	assert(*npmdp == 0);
+	spinlock_acquire(&pt_share_lock);
+	page_ref_inc(pmd2page(*pmdp));
+	if (!pmd_shared(pmdp)) {
+		ptep_unset_u_write(pmdp);
+		tlb_gather_add(tlb, la);
+		tlb_gather_add(tlb, la + PTSIZE - PGSIZE);
+	}
+	*npmdp = *pmdp;
+	spinlock_release(&pt_share_lock);
+	return 0;
+}
+#endif /* UCONFIG_SHARED_PT */
+
 pgd_t *get_pgd(pgd_t * pgdir, uintptr_t la, bool create)
 {
 	return &pgdir[PGX(la)];
@@ -23,7 +159,8 @@ pud_t *get_pud(pgd_t * pgdir, uintptr_t la, bool create)
 	if ((pgdp = get_pgd(pgdir, la, create)) == NULL) {
 		return NULL;
 	}
-	if (!ptep_present(pgdp)) {
+	pte_t old = *pgdp;
+	if (!ptep_present(&old)) {
 		struct Page *page;
 		if (!create || (page = alloc_page()) == NULL) {
 			return NULL;
@@ -31,10 +168,12 @@ pud_t *get_pud(pgd_t * pgdir, uintptr_t la, bool create)
 		set_page_ref(page, 1);
 		uintptr_t pa = page2pa(page);
 		memset(KADDR(pa), 0, PGSIZE);
-		ptep_map(pgdp, pa);
-		ptep_set_u_write(pgdp);
-		ptep_set_accessed(pgdp);
-		ptep_set_dirty(pgdp);
+		pte_t e = 0;
+		ptep_map(&e, pa);
+		ptep_set_u_write(&e);
+		ptep_set_accessed(&e);
+		ptep_set_dirty(&e);
+		pt_install(pgdp, old, e, page);
 	}
 	return &((pud_t *) KADDR(PGD_ADDR(*pgdp)))[PUX(la)];
 #endif /* PUXSHIFT == PGXSHIFT */
@@ -49,7 +188,8 @@ pmd_t *get_pmd(pgd_t * pgdir, uintptr_t la, bool create)
 	if ((pudp = get_pud(pgdir, la, create)) == NULL) {
 		return NULL;
 	}
-	if (!ptep_present(pudp)) {
+	pte_t old = *pudp;
+	if (!ptep_present(&old)) {
 		struct Page *page;
 		if (!create || (page = alloc_page()) == NULL) {
 			return NULL;
@@ -57,10 +197,12 @@ pmd_t *get_pmd(pgd_t * pgdir, uintptr_t la, bool create)
 		set_page_ref(page, 1);
 		uintptr_t pa = page2pa(page);
 		memset(KADDR(pa), 0, PGSIZE);
-		ptep_map(pudp, pa);
-		ptep_set_u_write(pudp);
-		ptep_set_accessed(pudp);
-		ptep_set_dirty(pudp);
+		pte_t e = 0;
+		ptep_map(&e, pa);
+		ptep_set_u_write(&e);
+		ptep_set_accessed(&e);
+		ptep_set_dirty(&e);
+		pt_install(pudp, old, e, page);
 	}
 	return &((pmd_t *) KADDR(PUD_ADDR(*pudp)))[PMX(la)];
 #endif /* PMXSHIFT == PUXSHIFT */
@@ -75,7 +217,8 @@ pte_t *get_pte(pgd_t * pgdir, uintptr_t la, bool create)
 	if ((pmdp = get_pmd(pgdir, la, create)) == NULL) {
 		return NULL;
 	}
-	if (!ptep_present(pmdp)) {
+	pte_t old = *pmdp;
+	if (!ptep_present(&old)) {
 		struct Page *page;
 		if (!create || (page = alloc_page()) == NULL) {
 			return NULL;
@@ -83,18 +226,33 @@ pte_t *get_pte(pgd_t * pgdir, uintptr_t la, bool create)
 		set_page_ref(page, 1);
 		uintptr_t pa = page2pa(page);
 		memset(KADDR(pa), 0, PGSIZE);
+		pte_t e = 0;
 #ifdef ARCH_ARM
-		pdep_map(pmdp, pa);
+		pdep_map(&e, pa);
 #else
-		ptep_map(pmdp, pa);
+		ptep_map(&e, pa);
 #endif
 		/* ARM9 PDE does not have access field */
 #ifndef ARCH_ARM
-		ptep_set_u_write(pmdp);
-		ptep_set_accessed(pmdp);
-		ptep_set_dirty(pmdp);
+		ptep_set_u_write(&e);
+		ptep_set_accessed(&e);
+		ptep_set_dirty(&e);
 #endif
+		pt_install(pmdp, old, e, page);
+	}
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+	else if (pmd_huge(pmdp)) {
+		/* someone wants a 4K view of a huge page */
+		split_huge_pmd(pgdir, la, pmdp);
 	}
+#endif
+#ifdef UCONFIG_SHARED_PT
+	/* whoever asks for a pte may change it */
+	else if (pmd_shared(pmdp) && USER_ACCESS(la, la + PGSIZE)
+		 && pt_unshare(pgdir, la, pmdp) != 0) {
+		return NULL;
+	}
+#endif
 	return &((pte_t *) KADDR(PMD_ADDR(*pmdp)))[PTX(la)];
 #endif /* PTXSHIFT == PMXSHIFT */
 }
@@ -118,22 +276,62 @@ struct Page *get_page(pgd_t * pgdir, uintptr_t la, pte_t ** ptep_store)
 	return NULL;
 }
 
+/**************************************************
+ * Batched TLB invalidation
+ **************************************************/
+
+void tlb_gather_init(struct tlb_gather *tlb, pgd_t * pgdir)
+{
+	tlb->pgdir = pgdir;
+	tlb->start = ~(uintptr_t) 0, tlb->end = 0;
+	list_init(&(tlb->free_list));
+}
+
+void tlb_gather_add(struct tlb_gather *tlb, uintptr_t la)
+{
+	if (la < tlb->start) {
+		tlb->start = la;
+	}
+	if (la + PGSIZE > tlb->end) {
+		tlb->end = la + PGSIZE;
+	}
+}
+
+void tlb_gather_free_page(struct tlb_gather *tlb, struct Page *page)
+{
+	list_add(&(tlb->free_list), &(page->page_link));
+}
+
 /**
- * page_remove_pte - free an Page sturct which is related linear address la
- *                 - and clean(invalidate) pte which is related linear address la
- * @param pgdir page directory (not used)
- * @param la logical address of the page to be removed
- * @param page table entry of the page to be removed
- * note: PT is changed, so the TLB need to be invalidate 
+ * tlb_gather_finish - flush the gathered range on all cpus with a single
+ *                   - shootdown, then free the pages waiting for it
  */
-void page_remove_pte(pgd_t * pgdir, uintptr_t la, pte_t * ptep)
+void tlb_gather_finish(struct tlb_gather *tlb)
+{
+	if (tlb->start < tlb->end) {
+		mp_tlb_flush_range(tlb->pgdir, tlb->start, tlb->end);
+	}
+	list_entry_t *le;
+	while ((le = list_next(&(tlb->free_list))) != &(tlb->free_list)) {
+		list_del(le);
+		free_page(le2page(le, page_link));
+	}
+	tlb_gather_init(tlb, tlb->pgdir);
+}
+
+//__page_remove_pte - page_remove_pte, the invalidation is left to tlb if not NULL
+static void
+__page_remove_pte(pgd_t * pgdir, uintptr_t la, pte_t * ptep,
+		  struct tlb_gather *tlb)
 {
 	if (ptep_present(ptep)) {
 		struct Page *page = pte2page(*ptep);
 		if (!PageSwap(page)) {
-			if (page_ref_dec(page) == 0) {
-				//Don't free dma pages
-				if (!PageIO(page))
+			//Don't free dma pages
+			if (page_ref_dec(page) == 0 && !PageIO(page)) {
+				if (tlb != NULL)
+					tlb_gather_free_page(tlb, page);
+				else
 					free_page(page);
 			}
 		} else {
@@ -143,7 +341,10 @@ void page_remove_pte(pgd_t * pgdir, uintptr_t la, pte_t * ptep)
 			page_ref_dec(page);
 		}
 		ptep_unmap(ptep);
-		mp_tlb_invalidate(pgdir, la);
+		if (tlb != NULL)
+			tlb_gather_add(tlb, la);
+		else
+			mp_tlb_invalidate(pgdir, la);
 	} else if (!ptep_invalid(ptep)) {
 #ifdef UCONFIG_SWAP
 		swap_remove_entry(*ptep);
@@ -152,6 +353,19 @@ void page_remove_pte(pgd_t * pgdir, uintptr_t la, pte_t * ptep)
 	}
 }
 
+/**
+ * page_remove_pte - free an Page sturct which is related linear address la
+ *                 - and clean(invalidate) pte which is related linear address la
+ * @param pgdir page directory (not used)
+ * @param la logical address of the page to be removed
+ * @param page table entry of the page to be removed
+ * note: PT is changed, so the TLB need to be invalidate 
+ */
+void page_remove_pte(pgd_t * pgdir, uintptr_t la, pte_t * ptep)
+{
+	__page_remove_pte(pgdir, la, ptep, NULL);
+}
+
 /**
  * page_insert - build the map of phy addr of an Page with the linear addr @la
  * @param pgdir page directory
@@ -228,7 +442,7 @@ struct Page *pgdir_alloc_page(pgd_t * pgdir, uintptr_t la, uint32_t perm)
 	struct Page *page = alloc_page();
 	if (page != NULL) {
 		//zero it!
-		memset(page2kva(page), 0, PGSIZE);
+		clear_page(page2kva(page));
 		if (page_insert(pgdir, page, la, perm) != 0) {
 			free_page(page);
 			return NULL;
@@ -241,27 +455,38 @@ struct Page *pgdir_alloc_page(pgd_t * pgdir, uintptr_t la, uint32_t perm)
  * memory management for users
  **************************************************/
 
+/* *
+ * range_walk - what to do on each pte of a range: the walkers below go
+ * down the page table once per pud, pmd and pte page, not once per page,
+ * and leave the tlb flush of the range to the gather.
+ * */
+struct range_walk {
+	struct tlb_gather *tlb;
+	void (*pte_fn) (struct tlb_gather * tlb, uintptr_t la, pte_t * ptep);
+	bool remove_huge;	// drop the huge and shared pmds wholly in the range, not split them
+};
+
 static void
-unmap_range_pte(pgd_t * pgdir, pte_t * pte, uintptr_t base, uintptr_t start,
-		uintptr_t end)
+walk_range_pte(struct range_walk *w, pte_t * pte, uintptr_t base,
+	       uintptr_t start, uintptr_t end)
 {
 	assert(start >= 0 && start < end && end <= PTSIZE);
 	assert(start % PGSIZE == 0 && end % PGSIZE == 0);
 	do {
 		pte_t *ptep = &pte[PTX(start)];
 		if (*ptep != 0) {
-			page_remove_pte(pgdir, base + start, ptep);
+			w->pte_fn(w->tlb, base + start, ptep);
 		}
 		start += PGSIZE;
 	} while (start != 0 && start < end);
 }
 
 static void
-unmap_range_pmd(pgd_t * pgdir, pmd_t * pmd, uintptr_t base, uintptr_t start,
-		uintptr_t end)
+walk_range_pmd(struct range_walk *w, pmd_t * pmd, uintptr_t base,
+	       uintptr_t start, uintptr_t end)
 {
 #if PMXSHIFT == PUXSHIFT
-	unmap_range_pte(pgdir, pmd, base, start, end);
+	walk_range_pte(w, pmd, base, start, end);
 #else
 	assert(start >= 0 && start < end && end <= PMSIZE);
 	size_t off, size;
@@ -272,21 +497,44 @@ unmap_range_pmd(pgd_t * pgdir, pmd_t * pmd, uintptr_t base, uintptr_t start,
 			size = end - start;
 		}
 		pmd_t *pmdp = &pmd[PMX(la)];
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+		if (pmd_huge(pmdp)) {
+			if (size == PTSIZE && w->remove_huge) {
+				huge_pmd_remove(w->tlb->pgdir, base + la, pmdp);
+			} else {
+				split_huge_pmd(w->tlb->pgdir, base + la, pmdp);
+			}
+		}
+#endif
+#ifdef UCONFIG_SHARED_PT
+		if (pmd_shared(pmdp)) {
+			if (size == PTSIZE && w->remove_huge) {
+				pt_drop(w->tlb, base + la, pmdp);
+			} else if (pt_unshare(w->tlb->pgdir, base + la, pmdp)
+				   != 0) {
+				/* out of memory: it stays mapped read-only */
+				goto next;
+			}
+		}
+#endif
 		if (ptep_present(pmdp)) {
-			unmap_range_pte(pgdir, KADDR(PMD_ADDR(*pmdp)),
-					base + la, off, off + size);
+			walk_range_pte(w, KADDR(PMD_ADDR(*pmdp)),
+				       base + la, off, off + size);
 		}
+#ifdef UCONFIG_SHARED_PT
+next:
+#endif
 		start += size, la += PTSIZE;
 	} while (start != 0 && start < end);
 #endif
 }
 
 static void
-unmap_range_pud(pgd_t * pgdir, pud_t * pud, uintptr_t base, uintptr_t start,
-		uintptr_t end)
+walk_range_pud(struct range_walk *w, pud_t * pud, uintptr_t base,
+	       uintptr_t start, uintptr_t end)
 {
 #if PUXSHIFT == PGXSHIFT
-	unmap_range_pmd(pgdir, pud, base, start, end);
+	walk_range_pmd(w, pud, base, start, end);
 #else
 	assert(start >= 0 && start < end && end <= PUSIZE);
 	size_t off, size;
@@ -298,16 +546,20 @@ unmap_range_pud(pgd_t * pgdir, pud_t * pud, uintptr_t base, uintptr_t start,
 		}
 		pud_t *pudp = &pud[PUX(la)];
 		if (ptep_present(pudp)) {
-			unmap_range_pmd(pgdir, KADDR(PUD_ADDR(*pudp)),
-					base + la, off, off + size);
+			walk_range_pmd(w, KADDR(PUD_ADDR(*pudp)),
+				       base + la, off, off + size);
 		}
 		start += size, la += PMSIZE;
 	} while (start != 0 && start < end);
 #endif
 }
 
-static void unmap_range_pgd(pgd_t * pgd, uintptr_t start, uintptr_t end)
+static void
+walk_range_pgd(struct range_walk *w, pgd_t * pgd, uintptr_t start,
+	       uintptr_t end)
 {
+	assert(start % PGSIZE == 0 && end % PGSIZE == 0);
+	assert(USER_ACCESS(start, end));
 	size_t off, size;
 	uintptr_t la = ROUNDDOWN(start, PUSIZE);
 	do {
@@ -317,18 +569,72 @@ static void unmap_range_pgd(pgd_t * pgd, uintptr_t start, uintptr_t end)
 		}
 		pgd_t *pgdp = &pgd[PGX(la)];
 		if (ptep_present(pgdp)) {
-			unmap_range_pud(pgd, KADDR(PGD_ADDR(*pgdp)), la, off,
-					off + size);
+			walk_range_pud(w, KADDR(PGD_ADDR(*pgdp)), la, off,
+				       off + size);
 		}
 		start += size, la += PUSIZE;
 	} while (start != 0 && start < end);
 }
 
+static void unmap_pte(struct tlb_gather *tlb, uintptr_t la, pte_t * ptep)
+{
+	__page_remove_pte(tlb->pgdir, la, ptep, tlb);
+}
+
+// unmap_range_gather - unmap [start, end) of tlb->pgdir, the tlb flush is left to the caller
+void unmap_range_gather(struct tlb_gather *tlb, uintptr_t start, uintptr_t end)
+{
+	struct range_walk w = { tlb, unmap_pte, 1 };
+	walk_range_pgd(&w, tlb->pgdir, start, end);
+}
+
+static void wrprotect_pte(struct tlb_gather *tlb, uintptr_t la, pte_t * ptep)
+{
+	if (ptep_present(ptep) && (ptep_s_write(ptep) || ptep_u_write(ptep))) {
+		ptep_unset_s_write(ptep);
+		ptep_unset_u_write(ptep);
+		tlb_gather_add(tlb, la);
+	}
+}
+
+// wrprotect_range_gather - make the pages of [start, end) of tlb->pgdir read
+//                        - only, the tlb flush is left to the caller
+void
+wrprotect_range_gather(struct tlb_gather *tlb, uintptr_t start, uintptr_t end)
+{
+	struct range_walk w = { tlb, wrprotect_pte, 0 };
+	walk_range_pgd(&w, tlb->pgdir, start, end);
+}
+
+static void lazyfree_pte(struct tlb_gather *tlb, uintptr_t la, pte_t * ptep)
+{
+	if (ptep_present(ptep)) {
+		struct Page *page = pte2page(*ptep);
+		/* a shared or swap cached page may be wanted by another map */
+		if (page_ref(page) == 1 && !PageSwap(page) && !PageIO(page)) {
+			SetPageLazyFree(page);
+			ptep_unset_dirty(ptep);
+			tlb_gather_add(tlb, la);
+		}
+	}
+}
+
+// lazyfree_range_gather - let reclaim drop the pages of [start, end) of
+//                       - tlb->pgdir that are not written again before, see
+//                       - swap_out_vma; the tlb flush is left to the caller
+void
+lazyfree_range_gather(struct tlb_gather *tlb, uintptr_t start, uintptr_t end)
+{
+	struct range_walk w = { tlb, lazyfree_pte, 0 };
+	walk_range_pgd(&w, tlb->pgdir, start, end);
+}
+
 void unmap_range(pgd_t * pgdir, uintptr_t start, uintptr_t end)
 {
-	assert(start % PGSIZE == 0 && end % PGSIZE == 0);
-	assert(USER_ACCESS(start, end));
-	unmap_range_pgd(pgdir, start, end);
+	struct tlb_gather tlb;
+	tlb_gather_init(&tlb, pgdir);
+	unmap_range_gather(&tlb, start, end);
+	tlb_gather_finish(&tlb);
 }
 
 static void exit_range_pmd(pmd_t * pmd)
@@ -339,6 +645,20 @@ static void exit_range_pmd(pmd_t * pmd)
 	uintptr_t la = 0;
 	do {
 		pmd_t *pmdp = &pmd[PMX(la)];
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+		/* unmap_range has taken every huge page away */
+		assert(!pmd_huge(pmdp));
+#endif
+#ifdef UCONFIG_SHARED_PT
+		/* unmap_range has dropped those in a vma */
+		if (pmd_shared(pmdp)) {
+			spinlock_acquire(&pt_share_lock);
+			if (page_ref_dec(pmd2page(*pmdp)) != 0) {
+				*pmdp = 0;
+			}
+			spinlock_release(&pt_share_lock);
+		}
+#endif
 		if (ptep_present(pmdp)) {
 			free_page(pmd2page(*pmdp)), *pmdp = 0;
 		}
@@ -393,8 +713,28 @@ copy_range(pgd_t * to, pgd_t * from, uintptr_t start, uintptr_t end, bool share)
 {
 	assert(start % PGSIZE == 0 && end % PGSIZE == 0);
 	assert(USER_ACCESS(start, end));
+	int err = 0;
+#ifdef ARCH_ARM
+	uintptr_t from_start = start;
+#endif
+#ifdef UCONFIG_SHARED_PT
+	struct tlb_gather tlb;
+	tlb_gather_init(&tlb, from);
+#endif
 
 	do {
+#ifdef UCONFIG_SHARED_PT
+		/* before get_pte, which would unshare it */
+		if (!share && start % PTSIZE == 0 && end - start >= PTSIZE
+		    && (err = pt_share(&tlb, to, from, start)) <= 0) {
+			if (err != 0) {
+				goto out;
+			}
+			start += PTSIZE;
+			continue;
+		}
+		err = 0;
+#endif
 		pte_t *ptep = get_pte(from, start, 0), *nptep;
 		if (ptep == NULL) {
 			if (get_pud(from, start, 0) == NULL) {
@@ -408,7 +748,8 @@ copy_range(pgd_t * to, pgd_t * from, uintptr_t start, uintptr_t end, bool share)
 		}
 		if (*ptep != 0) {
 			if ((nptep = get_pte(to, start, 1)) == NULL) {
-				return -E_NO_MEM;
+				err = -E_NO_MEM;
+				goto out;
 			}
 			int ret;
 			//kprintf("%08x %08x %08x\n", nptep, *nptep, start);
@@ -464,10 +805,15 @@ copy_range(pgd_t * to, pgd_t * from, uintptr_t start, uintptr_t end, bool share)
 		}
 		start += PGSIZE;
 	} while (start != 0 && start < end);
+out:
 #ifdef ARCH_ARM
 	/* we have modified the PTE of the original
-	 * process, so invalidate TLB */
-	tlb_invalidate_all();
+	 * process, so invalidate its TLB entries of the range */
+	if (!share)
+		mp_tlb_flush_range(from, from_start, end);
 #endif
-	return 0;
+#ifdef UCONFIG_SHARED_PT
+	tlb_gather_finish(&tlb);
+#endif
+	return err;
 }
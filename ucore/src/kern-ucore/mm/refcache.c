@@ -25,6 +25,7 @@
 #include <sync.h>
 #include <proc.h>
 #include <string.h>
+#include <stdlib.h>
 
 //#define __REFCACHE_TEST
 #if 0
@@ -54,8 +55,9 @@ void refcache_init(void)
 		struct refcache *r = per_cpu_ptr(refcaches, i);
 		assert(r!=NULL);
 		list_init(&r->review_head);
+		list_init(&r->release_head);
 		for(j=0;j<REF_CACHE_SLOT;j++)
-			memset(&r->way[i], 0, sizeof(struct refway));
+			memset(&r->way[j], 0, sizeof(struct refway));
 	}
 	atomic_set(&global_epoch, 1);
 	atomic_set(&global_epoch_left, sysconf.lcpu_count);
@@ -76,6 +78,7 @@ void refcache_refobj_init(struct refobj *obj)
 	assert(obj!=NULL);
 	memset(obj, 0, sizeof(struct refobj));
 	list_init(&obj->review_link);
+	list_init(&obj->release_link);
 	spinlock_init(&obj->lock);
 }
 
@@ -112,10 +115,11 @@ static inline struct refway * __get_my_way(struct refobj* obj)
 {
 	struct refcache *r = get_cpu_ptr(refcaches);
 	struct refway* way = &r->way[__hash_refobj(obj)];
-	if(way->obj!= NULL && way->obj != obj){
+	/* a way left at zero delta may point to an object freed since */
+	if(way->obj!= NULL && way->obj != obj && way->delta != 0){
 		__evict(way);
 	}
-	if(way->obj == NULL){
+	if(way->obj != obj || way->delta == 0){
 		way->obj = obj;
 		way->delta = 0;
 	}
@@ -215,6 +219,53 @@ void refcache_tick(void)
 	review();
 }
 
+/* onzero runs in the timer interrupt with obj->lock held; an object whose
+ * release may sleep calls this from onzero, and release is then called
+ * once for each of these calls by the cleaner thread of this cpu */
+void refcache_refobj_defer(struct refobj *obj)
+{
+	assert(obj->release != NULL);
+	if(obj->release_count++ == 0){
+		struct refcache *r = get_cpu_ptr(refcaches);
+		list_add_before(&r->release_head, &obj->release_link);
+	}
+}
+
+static void release(void)
+{
+	bool intr_flag;
+	list_entry_t *le;
+	while(1){
+		local_intr_save(intr_flag);
+		struct refcache *r = get_cpu_ptr(refcaches);
+		if((le = list_next(&r->release_head)) == &r->release_head){
+			local_intr_restore(intr_flag);
+			break;
+		}
+		struct refobj *obj = le2refobj(le, release_link);
+		list_del_init(&obj->release_link);
+		spinlock_acquire(&obj->lock);
+		int n = obj->release_count;
+		obj->release_count = 0;
+		spinlock_release(&obj->lock);
+		local_intr_restore(intr_flag);
+		/* the last call may free obj */
+		while(n-- > 0)
+			obj->release(obj);
+	}
+}
+
+// refcache_drain - wait until the objects that have stayed at zero by now
+//                - are released, for the memory checks of init_main
+void refcache_drain(void)
+{
+	/* review_epoch is at most 3 epochs ahead of the global one */
+	int target = atomic_read(&global_epoch) + 4;
+	while(atomic_read(&global_epoch) < target)
+		do_sleep(1);
+	/* and the cleaners release once a tick */
+	do_sleep(2);
+}
 
 int krefcache_cleaner(void *arg)
 {
@@ -246,6 +297,7 @@ int krefcache_cleaner(void *arg)
 #else
 		do_sleep(1);
 #endif
+		release();
 	}
 }
 
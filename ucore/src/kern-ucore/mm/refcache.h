@@ -41,11 +41,18 @@ struct refobj{
 	list_entry_t review_link;
 	spinlock_s lock;
 	void (*onzero)(struct refobj*);
+	/* deferred by onzero to krefcache_cleaner, see refcache_refobj_defer */
+	void (*release)(struct refobj*);
+	int release_count;
+	list_entry_t release_link;
 };
 
 #define set_refobj_callback(obj, func) \
 	do{(obj)->onzero = func;}while(0)
 
+#define set_refobj_release(obj, func) \
+	do{(obj)->release = func;}while(0)
+
 struct refway{
 	int delta;
 	struct refobj *obj;
@@ -57,6 +64,7 @@ struct refcache
 	struct refway way[REF_CACHE_SLOT];
 	int local_epoch;
 	list_entry_t review_head;
+	list_entry_t release_head;
 };
 
 DECLARE_PERCPU(struct refcache, refcaches);
@@ -65,7 +73,9 @@ void refcache_init(void);
 void refcache_refobj_init(struct refobj *obj);
 void refcache_refobj_inc(struct refobj *obj);
 void refcache_refobj_dec(struct refobj *obj);
+void refcache_refobj_defer(struct refobj *obj);
 void refcache_tick(void);
+void refcache_drain(void);
 
 int krefcache_cleaner(void *arg) __attribute__ ((noreturn));
 #endif
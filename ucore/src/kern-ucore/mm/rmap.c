@@ -0,0 +1,261 @@
+#include <types.h>
+#include <list.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <swap.h>
+#include <shmem.h>
+#include <slab.h>
+#include <sync.h>
+#include <mp.h>
+#include <assert.h>
+#include <rmap.h>
+
+#ifdef UCONFIG_SWAP
+
+/*
+ * The reverse map lets reclaim go from a page on the lru to its ptes,
+ * instead of waiting for the scans of every mm to come by each of them.
+ * Only the pages in the swap cache are mapped back, as reclaim knows of no
+ * others: page->anon_vma is set when swap_out_vma puts a page there, or a
+ * fault maps one read back, and cleared when it leaves it.
+ *
+ * A walk holds the lock of the anon_vma, so the vmas on it stay, and locks
+ * the mm of each shared without sleeping, skipping those busy with vma
+ * changes: their ptes are left to the scans. exit_mmap takes the vmas off
+ * their anon_vma before it unmaps them, so no walk sees an mm going away.
+ * The pte found is checked to be that of the page, the rmap is only a
+ * hint of where to look.
+ */
+
+#define le2vma_anon(le)                     to_struct((le), struct vma_struct, anon_link)
+
+/* orders the rmap of a page with its leaving the swap cache */
+static spinlock_s rmap_page_lock;
+
+void rmap_init(void)
+{
+	spinlock_init(&rmap_page_lock);
+}
+
+struct anon_vma *anon_vma_create(void)
+{
+	struct anon_vma *anon_vma = kmalloc(sizeof(struct anon_vma));
+	if (anon_vma != NULL) {
+		spinlock_init(&(anon_vma->lock));
+		list_init(&(anon_vma->vma_list));
+		atomic_set(&(anon_vma->ref), 1);
+	}
+	return anon_vma;
+}
+
+static inline void anon_vma_get(struct anon_vma *anon_vma)
+{
+	atomic_inc(&(anon_vma->ref));
+}
+
+void anon_vma_put(struct anon_vma *anon_vma)
+{
+	if (anon_vma != NULL && atomic_sub_return(&(anon_vma->ref), 1) == 0) {
+		assert(list_empty(&(anon_vma->vma_list)));
+		kfree(anon_vma);
+	}
+}
+
+static void anon_vma_link(struct vma_struct *vma, struct anon_vma *anon_vma)
+{
+	assert(vma->anon_vma == NULL);
+	if (anon_vma != NULL) {
+		anon_vma_get(anon_vma);
+		spinlock_acquire(&(anon_vma->lock));
+		list_add(&(anon_vma->vma_list), &(vma->anon_link));
+		vma->anon_vma = anon_vma;
+		spinlock_release(&(anon_vma->lock));
+	}
+}
+
+// anon_vma_prepare - give vma an anon_vma if it has none yet: that of its
+//                  - shmem, or a new one. Without memory it goes on
+//                  - without, its pages are left to the scans
+void anon_vma_prepare(struct vma_struct *vma)
+{
+	if (vma->anon_vma != NULL) {
+		return;
+	}
+	if (vma->vm_flags & VM_SHARE) {
+		anon_vma_link(vma, vma->shmem->anon_vma);
+	} else {
+		struct anon_vma *anon_vma = anon_vma_create();
+		anon_vma_link(vma, anon_vma);
+		anon_vma_put(anon_vma);
+	}
+}
+
+// anon_vma_clone - vma, a fork or a split of from, maps its pages at the
+//                - same addresses
+void anon_vma_clone(struct vma_struct *vma, struct vma_struct *from)
+{
+	anon_vma_prepare(from);
+	anon_vma_link(vma, from->anon_vma);
+}
+
+void anon_vma_unlink(struct vma_struct *vma)
+{
+	struct anon_vma *anon_vma = vma->anon_vma;
+	if (anon_vma != NULL) {
+		spinlock_acquire(&(anon_vma->lock));
+		list_del(&(vma->anon_link));
+		vma->anon_vma = NULL;
+		spinlock_release(&(anon_vma->lock));
+		anon_vma_put(anon_vma);
+	}
+}
+
+// page_add_rmap - page, in the swap cache, is mapped by vma at addr; the
+//               - first vma seen is the one kept
+void page_add_rmap(struct Page *page, struct vma_struct *vma, uintptr_t addr)
+{
+	struct anon_vma *anon_vma = vma->anon_vma;
+	if (anon_vma == NULL) {
+		return;
+	}
+	spinlock_acquire(&rmap_page_lock);
+	if (PageSwap(page) && page->anon_vma == NULL) {
+		anon_vma_get(anon_vma);
+		page->anon_vma = anon_vma;
+		page->anon_index = (vma->vm_flags & VM_SHARE) ?
+		    addr - vma->vm_start + vma->shmem_off : addr;
+	}
+	spinlock_release(&rmap_page_lock);
+}
+
+// page_remove_rmap - page has left the swap cache
+void page_remove_rmap(struct Page *page)
+{
+	assert(!PageSwap(page));
+	spinlock_acquire(&rmap_page_lock);
+	struct anon_vma *anon_vma = page->anon_vma;
+	page->anon_vma = NULL;
+	spinlock_release(&rmap_page_lock);
+	anon_vma_put(anon_vma);
+}
+
+// vma_address - where vma maps page, if it can, or 0
+static uintptr_t vma_address(struct vma_struct *vma, struct Page *page)
+{
+	uintptr_t addr = page->anon_index;
+	if (vma->vm_flags & VM_SHARE) {
+		if (addr < vma->shmem_off) {
+			return 0;
+		}
+		addr += vma->vm_start - vma->shmem_off;
+	}
+	return (addr >= vma->vm_start && addr < vma->vm_end) ? addr : 0;
+}
+
+// rmap_get_pte - the pte at addr of pgdir, if there is one of 4K already;
+//              - get_pte would split a huge page or copy a shared table
+static pte_t *rmap_get_pte(pgd_t * pgdir, uintptr_t addr)
+{
+	pmd_t *pmdp = get_pmd(pgdir, addr, 0);
+	if (pmdp == NULL || !ptep_present(pmdp)
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+	    || pmd_huge(pmdp)
+#endif
+#ifdef UCONFIG_SHARED_PT
+	    || pmd_shared(pmdp)
+#endif
+	    ) {
+		return NULL;
+	}
+	return get_pte(pgdir, addr, 0);
+}
+
+typedef bool(*rmap_one_t) (struct vma_struct * vma, uintptr_t addr,
+			   pte_t * ptep, struct Page * page);
+
+// rmap_walk - call one on each pte mapping page that can be found, with
+//           - the pt_lock of its mm held; returns how many said yes
+static int rmap_walk(struct Page *page, rmap_one_t one)
+{
+	struct anon_vma *anon_vma = page->anon_vma;
+	int count = 0;
+	if (anon_vma == NULL) {
+		return 0;
+	}
+	spinlock_acquire(&(anon_vma->lock));
+	list_entry_t *list = &(anon_vma->vma_list), *le = list;
+	while ((le = list_next(le)) != list && page_ref(page) != 0) {
+		struct vma_struct *vma = le2vma_anon(le);
+		struct mm_struct *mm = vma->vm_mm;
+		/* the anon_vma lock is taken in there under mm_rwsem */
+		if (!try_down_read(&(mm->mm_rwsem))) {
+			continue;
+		}
+		uintptr_t addr = vma_address(vma, page);
+		pte_t *ptep;
+		if (addr != 0 && (ptep = rmap_get_pte(mm->pgdir, addr)) != NULL) {
+			spinlock_acquire(&(mm->pt_lock));
+			if (ptep_present(ptep) && pte2page(*ptep) == page
+			    && one(vma, addr, ptep, page)) {
+				count++;
+			}
+			spinlock_release(&(mm->pt_lock));
+		}
+		up_read(&(mm->mm_rwsem));
+	}
+	spinlock_release(&(anon_vma->lock));
+	return count;
+}
+
+static bool
+referenced_one(struct vma_struct *vma, uintptr_t addr, pte_t * ptep,
+	       struct Page *page)
+{
+	if (ptep_accessed(ptep)) {
+		/* no flush, as in swap_out_vma */
+		ptep_unset_accessed(ptep);
+		return 1;
+	}
+	return 0;
+}
+
+// page_referenced - the mappings of page found accessed since the last
+//                 - look, which clears their accessed bits
+int page_referenced(struct Page *page)
+{
+	return rmap_walk(page, referenced_one);
+}
+
+static bool
+unmap_one(struct vma_struct *vma, uintptr_t addr, pte_t * ptep,
+	  struct Page *page)
+{
+	swap_entry_t entry = page->index;
+	if (ptep_dirty(ptep)) {
+		SetPageDirty(page);
+	}
+	swap_duplicate(entry);
+	page_ref_dec(page);
+	ptep_copy(ptep, &entry);
+	mp_tlb_invalidate(vma->vm_mm->pgdir, addr);
+	if ((vma->vm_flags & VM_SHARE) && page_ref(page) == 1) {
+		/* the last mapping, the shmem holds the swap entry now */
+		uintptr_t shmem_addr = page->anon_index;
+		pte_t *sh_ptep = shmem_get_entry(vma->shmem, shmem_addr, 0);
+		assert(sh_ptep != NULL && !ptep_invalid(sh_ptep));
+		if (ptep_present(sh_ptep)) {
+			shmem_insert_entry(vma->shmem, shmem_addr, entry);
+		}
+	}
+	return 1;
+}
+
+// try_to_unmap - replace the ptes of page, in the swap cache, by its swap
+//              - entry wherever they are found; returns how many were
+int try_to_unmap(struct Page *page)
+{
+	assert(PageSwap(page));
+	return rmap_walk(page, unmap_one);
+}
+
+#endif /* UCONFIG_SWAP */
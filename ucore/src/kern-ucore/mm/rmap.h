@@ -0,0 +1,51 @@
+#ifndef __KERN_MM_RMAP_H__
+#define __KERN_MM_RMAP_H__
+
+#include <types.h>
+#include <list.h>
+#include <atomic.h>
+#include <sync.h>
+#include <memlayout.h>
+
+struct vma_struct;
+
+#ifdef UCONFIG_SWAP
+
+/* *
+ * anon_vma - the vmas a page of private anonymous memory may be mapped by:
+ * those of an mm_map and of the forks and splits of it, which keep the
+ * page at the same address. A shmem has one of its own for the vmas
+ * mapping it, where a page is at its offset in the shmem. A page in the
+ * swap cache points to the anon_vma of the vma it was seen mapped by, see
+ * page_add_rmap, and holds a reference to it, as the vmas may be gone by
+ * the time it is evicted.
+ * */
+struct anon_vma {
+	spinlock_s lock;	// for vma_list, and held over the walks of it
+	list_entry_t vma_list;	// vma_struct, by anon_link
+	atomic_t ref;		// the vmas, the pages and the shmem pointing to it
+};
+
+void rmap_init(void);
+struct anon_vma *anon_vma_create(void);
+void anon_vma_put(struct anon_vma *anon_vma);
+void anon_vma_prepare(struct vma_struct *vma);
+void anon_vma_clone(struct vma_struct *vma, struct vma_struct *from);
+void anon_vma_unlink(struct vma_struct *vma);
+
+#define page_rmapped(page)                  ((page)->anon_vma != NULL)
+
+void page_add_rmap(struct Page *page, struct vma_struct *vma, uintptr_t addr);
+void page_remove_rmap(struct Page *page);
+int page_referenced(struct Page *page);
+int try_to_unmap(struct Page *page);
+
+#else
+
+#define anon_vma_prepare(vma)               do { } while (0)
+#define anon_vma_clone(vma, from)           do { } while (0)
+#define anon_vma_unlink(vma)                do { } while (0)
+
+#endif /* UCONFIG_SWAP */
+
+#endif /* !__KERN_MM_RMAP_H__ */
@@ -7,37 +7,56 @@
 #include <swap.h>
 #include <error.h>
 #include <sem.h>
+#include <stdlib.h>
+#include <rmap.h>
+
+#define SHMEM_HASH_SHIFT        4
+
+/* the named shmems, each holding a reference while it is in here */
+static list_entry_t shmem_names[1 << SHMEM_HASH_SHIFT];
+static semaphore_t shmem_names_sem;
+
+// shmem_span - the pages under a node of the radix tree at level
+static size_t shmem_span(int level)
+{
+	size_t span = SHMN_NENTRY;
+	while (level-- > 0) {
+		span *= SHMR_NENTRY;
+	}
+	return span;
+}
 
 struct shmem_struct *shmem_create(size_t len)
 {
 	struct shmem_struct *shmem = kmalloc(sizeof(struct shmem_struct));
 	if (shmem != NULL) {
-		list_init(&(shmem->shmn_list));
-		shmem->shmn_cache = NULL;
+		size_t npages = ROUNDUP(len, PGSIZE) / PGSIZE;
+		shmem->root = NULL;
+		shmem->height = 0;
+		while (shmem_span(shmem->height) < npages) {
+			shmem->height++;
+		}
 		shmem->len = len;
 		set_shmem_ref(shmem, 0);
 		sem_init(&(shmem->shmem_sem), 1);
+		shmem->name[0] = '\0';
+		list_init(&(shmem->name_link));
+#ifdef UCONFIG_SWAP
+		shmem->anon_vma = anon_vma_create();
+#endif
 	}
 	return shmem;
 }
 
-static shmn_t *shmn_create(uintptr_t start)
+// shmr_create - a zeroed page, for a leaf or a node of the radix tree
+static void *shmr_create(void)
 {
-	assert(start % PGSIZE * SHMN_NENTRY == 0);
-	shmn_t *shmn = kmalloc(sizeof(shmn_t));
-	if (shmn != NULL) {
-		struct Page *page;
-		if ((page = alloc_page()) != NULL) {
-			shmn->entry = (pte_t *) page2kva(page);
-			shmn->start = start;
-			shmn->end = start + PGSIZE * SHMN_NENTRY;
-			memset(shmn->entry, 0, PGSIZE);
-		} else {
-			kfree(shmn);
-			shmn = NULL;
-		}
+	struct Page *page;
+	if ((page = alloc_page()) == NULL) {
+		return NULL;
 	}
-	return shmn;
+	memset(page2kva(page), 0, PGSIZE);
+	return page2kva(page);
 }
 
 static inline void shmem_remove_entry_pte(pte_t * ptep)
@@ -74,103 +93,65 @@ static inline void shmem_remove_entry_pte(pte_t * ptep)
 	}
 }
 
-static void shmn_destroy(shmn_t * shmn)
+// shmr_destroy - free the subtree of node, a leaf if level is 0
+static void shmr_destroy(void *node, int level)
 {
 	int i;
-	for (i = 0; i < SHMN_NENTRY; i++) {
-		shmem_remove_entry_pte(shmn->entry + i);
+	if (node == NULL) {
+		return;
 	}
-	free_page(kva2page(shmn->entry));
-	kfree(shmn);
-}
-
-static shmn_t *find_shmn(struct shmem_struct *shmem, uintptr_t addr)
-{
-	shmn_t *shmn = shmem->shmn_cache;
-	if (!(shmn != NULL && shmn->start <= addr && addr < shmn->end)) {
-		shmn = NULL;
-		list_entry_t *list = &(shmem->shmn_list), *le = list;
-		while ((le = list_next(le)) != list) {
-			shmn_t *tmp = le2shmn(le, list_link);
-			if (tmp->start <= addr && addr < tmp->end) {
-				shmn = tmp;
-				break;
-			}
+	if (level == 0) {
+		for (i = 0; i < SHMN_NENTRY; i++) {
+			shmem_remove_entry_pte((pte_t *) node + i);
 		}
-	}
-	if (shmn != NULL) {
-		shmem->shmn_cache = shmn;
-	}
-	return shmn;
-}
-
-static inline void check_shmn_overlap(shmn_t * prev, shmn_t * next)
-{
-	assert(prev->start < prev->end);
-	assert(prev->end <= next->start);
-	assert(next->start < next->end);
-}
-
-static void insert_shmn(struct shmem_struct *shmem, shmn_t * shmn)
-{
-	list_entry_t *list = &(shmem->shmn_list), *le = list;
-	list_entry_t *le_prev = list, *le_next;
-	while ((le = list_next(le)) != list) {
-		shmn_t *shmn_prev = le2shmn(le, list_link);
-		if (shmn_prev->start > shmn->start) {
-			break;
+	} else {
+		for (i = 0; i < SHMR_NENTRY; i++) {
+			shmr_destroy(((void **)node)[i], level - 1);
 		}
-		le_prev = le;
 	}
-
-	le_next = list_next(le_prev);
-
-	/* check overlap */
-	if (le_prev != list) {
-		check_shmn_overlap(le2shmn(le_prev, list_link), shmn);
-	}
-	if (le_next != list) {
-		check_shmn_overlap(shmn, le2shmn(le_next, list_link));
-	}
-
-	list_add_after(le_prev, &(shmn->list_link));
+	free_page(kva2page(node));
 }
 
 void shmem_destroy(struct shmem_struct *shmem)
 {
-	list_entry_t *list = &(shmem->shmn_list), *le;
-	while ((le = list_next(list)) != list) {
-		list_del(le);
-		shmn_destroy(le2shmn(le, list_link));
-	}
+	assert(shmem->name[0] == '\0');
+	shmr_destroy(shmem->root, shmem->height);
+#ifdef UCONFIG_SWAP
+	anon_vma_put(shmem->anon_vma);
+#endif
 	kfree(shmem);
 }
 
 pte_t *shmem_get_entry(struct shmem_struct *shmem, uintptr_t addr, bool create)
 {
 	assert(addr < shmem->len);
-	addr = ROUNDDOWN(addr, PGSIZE);
-	shmn_t *shmn = find_shmn(shmem, addr);
-
-	assert(shmn == NULL || (shmn->start <= addr && addr < shmn->end));
-	if (shmn == NULL) {
-		uintptr_t start = ROUNDDOWN(addr, PGSIZE * SHMN_NENTRY);
-		if (!create || (shmn = shmn_create(start)) == NULL) {
-			return NULL;
+	size_t index = addr / PGSIZE;
+	void **slot = &(shmem->root);
+	int level;
+	for (level = shmem->height;; level--) {
+		if (*slot == NULL) {
+			if (!create || (*slot = shmr_create()) == NULL) {
+				return NULL;
+			}
 		}
-		insert_shmn(shmem, shmn);
+		if (level == 0) {
+			break;
+		}
+		size_t span = shmem_span(level - 1);
+		slot = (void **)*slot + index / span;
+		index %= span;
 	}
-	int index = (addr - shmn->start) / PGSIZE;
-	if (shmn->entry[index] == 0) {
+	pte_t *ptep = (pte_t *) * slot + index;
+	if (*ptep == 0) {
 		if (create) {
 			struct Page *page = alloc_page();
 			if (page != NULL) {
-				ptep_map(&(shmn->entry[index]), page2pa(page));
+				ptep_map(ptep, page2pa(page));
 				page_ref_inc(page);
 			}
 		}
 	}
-	return shmn->entry + index;
+	return ptep;
 }
 
 int shmem_insert_entry(struct shmem_struct *shmem, uintptr_t addr, pte_t entry)
@@ -199,3 +180,93 @@ int shmem_remove_entry(struct shmem_struct *shmem, uintptr_t addr)
 {
 	return shmem_insert_entry(shmem, addr, 0);
 }
+
+void shmem_init(void)
+{
+	int i;
+	for (i = 0; i < (1 << SHMEM_HASH_SHIFT); i++) {
+		list_init(shmem_names + i);
+	}
+	sem_init(&shmem_names_sem, 1);
+}
+
+static list_entry_t *shmem_name_list(const char *name)
+{
+	uint32_t hash = 0;
+	while (*name != '\0') {
+		hash = hash * 31 + (unsigned char)*name++;
+	}
+	return shmem_names + hash32(hash, SHMEM_HASH_SHIFT);
+}
+
+// shmem_lookup - the shmem named name, under shmem_names_sem
+static struct shmem_struct *shmem_lookup(const char *name)
+{
+	list_entry_t *list = shmem_name_list(name), *le = list;
+	while ((le = list_next(le)) != list) {
+		struct shmem_struct *shmem =
+		    to_struct(le, struct shmem_struct, name_link);
+		if (strcmp(shmem->name, name) == 0) {
+			return shmem;
+		}
+	}
+	return NULL;
+}
+
+/* *
+ * shmem_open - find the shmem named name, or make one of len bytes if there
+ * is none and create is set, so that processes with nothing else in common
+ * can map the same pages. A reference is taken for the caller, to be
+ * dropped by shmem_put; the name holds one more until shmem_unlink.
+ * */
+int
+shmem_open(const char *name, size_t len, bool create,
+	   struct shmem_struct **shmem_store)
+{
+	struct shmem_struct *shmem;
+	int ret = 0;
+	if (name[0] == '\0' || strlen(name) > SHMEM_NAME_LEN) {
+		return -E_INVAL;
+	}
+	down(&shmem_names_sem);
+	if ((shmem = shmem_lookup(name)) != NULL) {
+		shmem_ref_inc(shmem);
+	} else if (!create || len == 0) {
+		ret = create ? -E_INVAL : -E_NOENT;
+	} else if ((shmem = shmem_create(len)) == NULL) {
+		ret = -E_NO_MEM;
+	} else {
+		strcpy(shmem->name, name);
+		list_add(shmem_name_list(name), &(shmem->name_link));
+		set_shmem_ref(shmem, 2);
+	}
+	up(&shmem_names_sem);
+	if (ret == 0) {
+		*shmem_store = shmem;
+	}
+	return ret;
+}
+
+// shmem_unlink - drop the name, the pages go with the last map of them
+int shmem_unlink(const char *name)
+{
+	struct shmem_struct *shmem;
+	down(&shmem_names_sem);
+	if ((shmem = shmem_lookup(name)) != NULL) {
+		list_del_init(&(shmem->name_link));
+		shmem->name[0] = '\0';
+	}
+	up(&shmem_names_sem);
+	if (shmem == NULL) {
+		return -E_NOENT;
+	}
+	shmem_put(shmem);
+	return 0;
+}
+
+void shmem_put(struct shmem_struct *shmem)
+{
+	if (shmem_ref_dec(shmem) == 0) {
+		shmem_destroy(shmem);
+	}
+}
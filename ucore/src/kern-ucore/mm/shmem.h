@@ -8,28 +8,33 @@
 #include <memlayout.h>
 #include <sem.h>
 
-typedef struct shmn_s {
-	uintptr_t start;
-	uintptr_t end;
-	pte_t *entry;
-	list_entry_t list_link;
-} shmn_t;
-
+/* *
+ * The entries of a shmem, ptes of its pages or of their swap entries, are
+ * the leaves of a radix tree of pages: a leaf holds SHMN_NENTRY entries, a
+ * node above it SHMR_NENTRY children, and the tree is as high as len needs.
+ * The entry of an offset is a walk of height + 1 steps, however large the
+ * shmem and wherever its pages have been touched.
+ * */
 #ifndef ARCH_ARM
 #define SHMN_NENTRY     (PGSIZE / sizeof(pte_t))
 #else
 #define SHMN_NENTRY     (PGSIZE / sizeof(pte_t)/4)
 #endif
+#define SHMR_NENTRY     (PGSIZE / sizeof(void *))
 
-#define le2shmn(le, member)                 \
-    to_struct((le), shmn_t, member)
+#define SHMEM_NAME_LEN  31
 
 struct shmem_struct {
-	list_entry_t shmn_list;
-	shmn_t *shmn_cache;
+	void *root;		// a leaf if height is 0, NULL until an entry is made
+	int height;		// the levels of nodes above the leaves
 	size_t len;
 	atomic_t shmem_ref;
 	semaphore_t shmem_sem;
+	char name[SHMEM_NAME_LEN + 1];	// "" unless named, see shmem_open
+	list_entry_t name_link;
+#ifdef UCONFIG_SWAP
+	struct anon_vma *anon_vma;	// the vmas mapping it, see rmap.h
+#endif
 };
 
 struct shmem_struct *shmem_create(size_t len);
@@ -38,6 +43,12 @@ pte_t *shmem_get_entry(struct shmem_struct *shmem, uintptr_t addr, bool create);
 int shmem_insert_entry(struct shmem_struct *shmem, uintptr_t addr, pte_t entry);
 int shmem_remove_entry(struct shmem_struct *shmem, uintptr_t addr);
 
+void shmem_init(void);
+int shmem_open(const char *name, size_t len, bool create,
+	       struct shmem_struct **shmem_store);
+int shmem_unlink(const char *name);
+void shmem_put(struct shmem_struct *shmem);
+
 static inline int shmem_ref(struct shmem_struct *shmem)
 {
 	return atomic_read(&(shmem->shmem_ref));
@@ -0,0 +1,77 @@
+#include <types.h>
+#include <list.h>
+#include <sem.h>
+#include <assert.h>
+#include <shrinker.h>
+
+/*
+ * The caches living on pages of their own, the sfs page cache, the exec
+ * cache, the vfs name cache and the magazines of the slabs, register a
+ * shrinker here, so that kswapd, and an allocation that finds no free
+ * pages, can take pages back from all of them the same way, each in
+ * proportion to what it holds.
+ */
+
+#define le2shrinker(le, member)             \
+    to_struct((le), struct shrinker, member)
+
+static list_entry_t shrinker_list;
+/* held over the scans, which may sleep */
+static semaphore_t shrinker_sem;
+
+void shrinker_init(void)
+{
+	list_init(&shrinker_list);
+	sem_init(&shrinker_sem, 1);
+}
+
+void register_shrinker(struct shrinker *shrinker)
+{
+	assert(shrinker->count != NULL && shrinker->scan != NULL);
+	down(&shrinker_sem);
+	list_add_before(&shrinker_list, &(shrinker->shrinker_link));
+	up(&shrinker_sem);
+}
+
+void unregister_shrinker(struct shrinker *shrinker)
+{
+	down(&shrinker_sem);
+	list_del(&(shrinker->shrinker_link));
+	up(&shrinker_sem);
+}
+
+// shrink_caches - free up to nr pages from the caches registered, asking
+//               - each for its share of what they all hold; # pages freed.
+//               - Nothing is done if another shrink is running
+size_t shrink_caches(size_t nr)
+{
+	size_t total = 0, free_count = 0;
+	list_entry_t *le = &shrinker_list;
+	if (nr == 0 || !try_down(&shrinker_sem)) {
+		return 0;
+	}
+	while ((le = list_next(le)) != &shrinker_list) {
+		total += le2shrinker(le, shrinker_link)->count();
+	}
+	le = &shrinker_list;
+	while (total != 0 && free_count < nr
+	       && (le = list_next(le)) != &shrinker_list) {
+		struct shrinker *shrinker = le2shrinker(le, shrinker_link);
+		size_t count = shrinker->count(), share;
+		if (count == 0) {
+			continue;
+		}
+		/* nr * count / total, without a 64-bit division on 32-bit cpus;
+		 * a small cache is still asked for a page */
+		share = (nr >= total) ? count : nr / (total / count);
+		if (share == 0) {
+			share = 1;
+		}
+		if (share > nr - free_count) {
+			share = nr - free_count;
+		}
+		free_count += shrinker->scan(share);
+	}
+	up(&shrinker_sem);
+	return free_count;
+}
@@ -0,0 +1,25 @@
+#ifndef __KERN_MM_SHRINKER_H__
+#define __KERN_MM_SHRINKER_H__
+
+#include <types.h>
+#include <list.h>
+
+/* *
+ * shrinker - a cache that can give pages back under memory pressure. count
+ * tells roughly how many it could free now, scan frees up to nr of them and
+ * returns how many it did. A scan may sleep, but must not wait for a lock
+ * the callers of alloc_pages may hold: it skips what is busy instead.
+ * */
+struct shrinker {
+	const char *name;
+	size_t (*count) (void);
+	size_t (*scan) (size_t nr);
+	list_entry_t shrinker_link;	// linked in shrinker_list
+};
+
+void shrinker_init(void);
+void register_shrinker(struct shrinker *shrinker);
+void unregister_shrinker(struct shrinker *shrinker);
+size_t shrink_caches(size_t nr);
+
+#endif /* !__KERN_MM_SHRINKER_H__ */
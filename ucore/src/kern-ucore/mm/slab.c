@@ -1,5 +1,6 @@
 #include <types.h>
 #include <list.h>
+#include <string.h>
 #include <memlayout.h>
 #include <assert.h>
 #include <slab.h>
@@ -7,9 +8,19 @@
 #include <pmm.h>
 #include <stdio.h>
 #include <rb_tree.h>
+#include <rb_inline.h>
+#include <rhash.h>
+#include <findbit.h>
 #include <kio.h>
 #include <mp.h>
 #include <spinlock.h>
+#include <percpu.h>
+#include <percpu_counter.h>
+#include <sysconf.h>
+#include <shrinker.h>
+#ifdef UCONFIG_KMALLOC_PROFILE
+#include <kdebug.h>
+#endif
 
 /* The slab allocator used in ucore is based on an algorithm first introduced by 
    Jeff Bonwick for the SunOS operating system. The paper can be download from 
@@ -57,11 +68,31 @@
    |
    obj1-obj2-obj3...objn  WITH slab_t+n*bufctl_t in another slab (the size of obj is BIG)
 
+   Besides the slab_cache array, named caches for the hot kernel objects are
+   created by kmem_cache_create. Their objs are sized and aligned for the
+   object, built once by the constructor when the slab is grown and kept
+   constructed while they are free. Successive slabs of a named cache start
+   their objs at different offsets (colors) within the unused tail of the
+   slab, so that the objs of different slabs don't compete for the same
+   cache lines.
+
    The important functions are:
      kmem_cache_grow(kmem_cache_t *cachep)
      kmem_slab_destroy(kmem_cache_t *cachep, slab_t *slabp)
      kmalloc(size_t size): used by outside functions need dynamicly get memory
      kfree(void *objp): used by outside functions need dynamicly release memory
+     kmem_cache_create/alloc/free/destroy: the named caches
+
+   In front of the slabs sits the magazine layer from Bonwick's second paper
+   ("Magazines and Vmem", USENIX 2001). Every cpu holds two magazines per
+   cache, each a small stack of free objs. kmalloc/kfree pop/push the loaded
+   magazine, and only when both magazines are empty (full) is one exchanged
+   with the depot of the cache. So the common path only takes the lock of
+   the local cpu cache, which is never contended but by slab_drain.
+
+   A slab is freed as soon as its last obj is, so what the slabs hold on to
+   under memory pressure is the free objs hoarded in the depots. The shrinker
+   of the slabs gives them back, see slab_shrink.
 */
 
 #define BUFCTL_END      0xFFFFFFFFL	// the signature of the last bufctl
@@ -81,7 +112,7 @@ typedef struct slab_s {
 #define le2slab(le, member)                 \
     to_struct((le), slab_t, member)
 
-typedef struct kmem_cache_s kmem_cache_t;
+struct kmem_cpu_cache;
 
 struct kmem_cache_s {
 	list_entry_t slabs_full;	// list for fully allocated slabs
@@ -94,9 +125,27 @@ struct kmem_cache_s {
 
 	/* order of pages per slab (2^n) */
 	size_t page_order;
+	size_t nr_slabs;	// the slabs allocated
 
 	kmem_cache_t *slab_cachep;
 
+	const char *name;	// the name of a named cache, NULL for kmalloc
+	void (*ctor) (void *objp);	// called on every obj of a new slab
+	list_entry_t cache_link;	// linked in cache_chain
+
+	/* cache coloring */
+	size_t align;		// obj alignment, also the offset between colors
+	size_t color_num;	// number of colors, 1 if not colored
+	size_t color_next;	// the color of the next slab
+
+	/* the magazine depot */
+	bool use_magazine;	// cache objs in the per-cpu magazines
+	list_entry_t depot_full;	// full magazines
+	list_entry_t depot_empty;	// empty magazines
+	size_t depot_nr_full;	// the magazines in depot_full
+	spinlock_s depot_lock;
+	struct kmem_cpu_cache *cpu_cache[NCPU];	// the magazines of each cpu
+
 	/* spinlock to protect a kmem_cache,
 	 * XXX contention when multicore parallel 
 	 * allocating/freeing objects of the same size
@@ -113,8 +162,53 @@ struct kmem_cache_s {
 
 static kmem_cache_t slab_cache[SLAB_CACHE_NUM];
 
+/* all caches, slab_cache[] included */
+static list_entry_t cache_chain;
+static spinlock_s cache_chain_lock;
+
+#define le2cache(le, member)                \
+    to_struct((le), kmem_cache_t, member)
+
+/* a magazine fits exactly in a 128B obj */
+#define MAGAZINE_OBJSIZE        128
+#define MAGAZINE_SIZE           ((MAGAZINE_OBJSIZE - sizeof(list_entry_t) - sizeof(size_t)) / sizeof(void *))
+/* don't hoard big objs in the magazines */
+#define MAGAZINE_MAX_OBJSIZE    PGSIZE
+
+typedef struct magazine_s {
+	list_entry_t mag_link;	// the list entry linked to the depot
+	size_t rounds;		// the number of objs held
+	void *objs[MAGAZINE_SIZE];
+} magazine_t;
+
+#define le2mag(le, member)                  \
+    to_struct((le), magazine_t, member)
+
+// the magazines of a cache on a cpu, the lock is only contended by
+// slab_drain from another cpu
+struct kmem_cpu_cache {
+	spinlock_s lock;
+	magazine_t *loaded;	// objs are taken from/put to this one
+	magazine_t *previous;	// full or empty, swapped with loaded
+	size_t hits;		// allocs/frees served by the magazines
+	size_t misses;		// allocs/frees which went to the slabs
+};
+
+struct kmem_cpu_caches {
+	struct kmem_cpu_cache cc[SLAB_CACHE_NUM];
+};
+
+static DEFINE_PERCPU_NOINIT(struct kmem_cpu_caches, kmem_cpu_caches);
+
+/* the bytes of the objs allocated from the slabs, magazines included */
+DEFINE_PERCPU_COUNTER(slab_bytes);
+
+static bool magazine_enabled = 0;
+static kmem_cache_t *magazine_cachep;
+static struct shrinker slab_shrinker;
+
 static void init_kmem_cache(kmem_cache_t * cachep, size_t objsize,
-			    size_t align);
+			    size_t align, bool coloring);
 static void check_slab(void);
 
 //slab_init - call init_kmem_cache function to reset the slab_cache array
@@ -123,37 +217,22 @@ void slab_init(void)
 	size_t i;
 	//the align bit for obj in slab. 2^n could be better for performance
 	size_t align = 16;
+	percpu_counter_init(&slab_bytes, 0);
+	list_init(&cache_chain);
+	spinlock_init(&cache_chain_lock);
 	for (i = 0; i < SLAB_CACHE_NUM; i++) {
 		init_kmem_cache(slab_cache + i, 1 << (i + MIN_SIZE_ORDER),
-				align);
+				align, 0);
+		list_add_before(&cache_chain, &(slab_cache[i].cache_link));
 	}
 	check_slab();
 }
 
 //slab_allocated - summary the total size of allocated objs
+//               - NOTE: the objs cached in magazines are counted, see slab_drain
 size_t slab_allocated(void)
 {
-	size_t total = 0;
-	int i;
-	bool intr_flag;
-	local_intr_save(intr_flag);
-	{
-		for (i = 0; i < SLAB_CACHE_NUM; i++) {
-			kmem_cache_t *cachep = slab_cache + i;
-			list_entry_t *list, *le;
-			list = le = &(cachep->slabs_full);
-			while ((le = list_next(le)) != list) {
-				total += cachep->num * cachep->objsize;
-			}
-			list = le = &(cachep->slabs_notfull);
-			while ((le = list_next(le)) != list) {
-				slab_t *slabp = le2slab(le, slab_link);
-				total += slabp->inuse * cachep->objsize;
-			}
-		}
-	}
-	local_intr_restore(intr_flag);
-	return total;
+	return percpu_counter_sum(&slab_bytes);
 }
 
 // slab_mgmt_size - get the size of slab control area (slab_t+num*kmem_bufctl_t)
@@ -246,11 +325,23 @@ static inline size_t getorder(size_t n)
 }
 
 // init_kmem_cache - initial a slab_cache cachep according to the obj with the size = objsize
-static void init_kmem_cache(kmem_cache_t * cachep, size_t objsize, size_t align)
+//                 - the unused tail of the slabs is spread over colors if coloring
+static void
+init_kmem_cache(kmem_cache_t * cachep, size_t objsize, size_t align,
+		bool coloring)
 {
 	list_init(&(cachep->slabs_full));
 	list_init(&(cachep->slabs_notfull));
 	spinlock_init(&cachep->lock);
+	cachep->nr_slabs = 0;
+	list_init(&(cachep->depot_full));
+	list_init(&(cachep->depot_empty));
+	cachep->depot_nr_full = 0;
+	spinlock_init(&cachep->depot_lock);
+	cachep->use_magazine = (objsize <= MAGAZINE_MAX_OBJSIZE);
+	memset(cachep->cpu_cache, 0, sizeof(cachep->cpu_cache));
+	cachep->name = NULL;
+	cachep->ctor = NULL;
 
 	objsize = ROUNDUP(objsize, align);
 	cachep->objsize = objsize;
@@ -266,8 +357,13 @@ static void init_kmem_cache(kmem_cache_t * cachep, size_t objsize, size_t align)
 
 	if (cachep->off_slab && left_over >= mgmt_size) {
 		cachep->off_slab = 0;
+		left_over -= mgmt_size;
 	}
 
+	cachep->align = align;
+	cachep->color_num = coloring ? left_over / align + 1 : 1;
+	cachep->color_next = 0;
+
 	if (cachep->off_slab) {
 		cachep->offset = 0;
 		cachep->slab_cachep =
@@ -277,7 +373,8 @@ static void init_kmem_cache(kmem_cache_t * cachep, size_t objsize, size_t align)
 	}
 }
 
-static void *kmem_cache_alloc(kmem_cache_t * cachep);
+static void *__kmem_cache_alloc(kmem_cache_t * cachep);
+static void __kmem_cache_free(kmem_cache_t * cachep, void *objp);
 
 #define slab_bufctl(slabp)              \
     ((kmem_bufctl_t*)(((slab_t *)(slabp)) + 1))
@@ -290,15 +387,20 @@ static slab_t *kmem_cache_slabmgmt(kmem_cache_t * cachep, struct Page *page)
 	slab_t *slabp;
 
 	if (cachep->off_slab) {
-		if ((slabp = kmem_cache_alloc(cachep->slab_cachep)) == NULL) {
+		if ((slabp = __kmem_cache_alloc(cachep->slab_cachep)) == NULL) {
 			return NULL;
 		}
 	} else {
 		slabp = page2kva(page);
 	}
+	/* racy, but a skipped or repeated color does no harm */
+	size_t color = cachep->color_next;
+	if (++cachep->color_next >= cachep->color_num) {
+		cachep->color_next = 0;
+	}
 	slabp->inuse = 0;
-	slabp->offset = cachep->offset;
-	slabp->s_mem = objp + cachep->offset;
+	slabp->offset = cachep->offset + color * cachep->align;
+	slabp->s_mem = objp + slabp->offset;
 	return slabp;
 }
 
@@ -348,10 +450,17 @@ static bool kmem_cache_grow(kmem_cache_t * cachep)
 	slab_bufctl(slabp)[cachep->num - 1] = BUFCTL_END;
 	slabp->free = 0;
 
+	if (cachep->ctor != NULL) {
+		for (i = 0; i < cachep->num; i++) {
+			cachep->ctor(slabp->s_mem + i * cachep->objsize);
+		}
+	}
+
 	local_intr_save(intr_flag);
 	{
 		spinlock_acquire(&cachep->lock);
 		list_add(&(cachep->slabs_notfull), &(slabp->slab_link));
+		cachep->nr_slabs++;
 		spinlock_release(&cachep->lock);
 	}
 	local_intr_restore(intr_flag);
@@ -368,6 +477,7 @@ failed:
 static void *__kmem_cache_alloc_one(kmem_cache_t * cachep, slab_t * slabp)
 {
 	slabp->inuse++;
+	percpu_counter_add(&slab_bytes, cachep->objsize);
 	void *objp = slabp->s_mem + slabp->free * cachep->objsize;
 	slabp->free = slab_bufctl(slabp)[slabp->free];
 
@@ -378,9 +488,9 @@ static void *__kmem_cache_alloc_one(kmem_cache_t * cachep, slab_t * slabp)
 	return objp;
 }
 
-// kmem_cache_alloc - call __kmem_cache_alloc_one function to allocate a obj
-//                  - if no free obj, try to allocate a slab
-static void *kmem_cache_alloc(kmem_cache_t * cachep)
+// __kmem_cache_alloc - call __kmem_cache_alloc_one function to allocate a obj
+//                    - if no free obj, try to allocate a slab
+static void *__kmem_cache_alloc(kmem_cache_t * cachep)
 {
 	void *objp;
 	bool intr_flag;
@@ -406,20 +516,296 @@ alloc_new_slab:
 	return NULL;
 }
 
+static inline struct kmem_cpu_cache *kmem_cpu_cache(kmem_cache_t * cachep)
+{
+	return cachep->cpu_cache[myid()];
+}
+
+// depot_get - take a magazine out of the depot list, NULL if none
+static magazine_t *depot_get(kmem_cache_t * cachep, list_entry_t * list)
+{
+	magazine_t *mag = NULL;
+	spinlock_acquire(&cachep->depot_lock);
+	list_entry_t *le = list_next(list);
+	if (le != list) {
+		list_del(le);
+		mag = le2mag(le, mag_link);
+		if (list == &(cachep->depot_full)) {
+			cachep->depot_nr_full--;
+		}
+	}
+	spinlock_release(&cachep->depot_lock);
+	return mag;
+}
+
+static void depot_put(kmem_cache_t * cachep, list_entry_t * list,
+		      magazine_t * mag)
+{
+	spinlock_acquire(&cachep->depot_lock);
+	list_add(list, &(mag->mag_link));
+	if (list == &(cachep->depot_full)) {
+		cachep->depot_nr_full++;
+	}
+	spinlock_release(&cachep->depot_lock);
+}
+
+// magazine_alloc - pop an obj from the magazines of this cpu,
+//                - NULL if both are empty and the depot has no full one
+// lock held
+static void *magazine_alloc(kmem_cache_t * cachep, struct kmem_cpu_cache *cc)
+{
+	magazine_t *mag;
+	if (cc->loaded == NULL || cc->loaded->rounds == 0) {
+		if (cc->previous != NULL && cc->previous->rounds > 0) {
+			mag = cc->loaded, cc->loaded = cc->previous;
+			cc->previous = mag;
+		} else if ((mag = depot_get(cachep, &(cachep->depot_full))) != NULL) {
+			if (cc->previous != NULL) {
+				depot_put(cachep, &(cachep->depot_empty),
+					  cc->previous);
+			}
+			cc->previous = cc->loaded, cc->loaded = mag;
+		} else {
+			return NULL;
+		}
+	}
+	mag = cc->loaded;
+	return mag->objs[--mag->rounds];
+}
+
+// magazine_free - push an obj to the magazines of this cpu,
+//               - return 0 if both are full and the depot has no empty one
+// lock held
+static bool magazine_free(kmem_cache_t * cachep, struct kmem_cpu_cache *cc,
+			  void *objp)
+{
+	magazine_t *mag;
+	if (cc->loaded == NULL || cc->loaded->rounds == MAGAZINE_SIZE) {
+		if (cc->previous != NULL && cc->previous->rounds < MAGAZINE_SIZE) {
+			mag = cc->loaded, cc->loaded = cc->previous;
+			cc->previous = mag;
+		} else if ((mag = depot_get(cachep, &(cachep->depot_empty))) != NULL) {
+			if (cc->previous != NULL) {
+				depot_put(cachep, &(cachep->depot_full),
+					  cc->previous);
+			}
+			cc->previous = cc->loaded, cc->loaded = mag;
+		} else {
+			return 0;
+		}
+	}
+	mag = cc->loaded;
+	mag->objs[mag->rounds++] = objp;
+	return 1;
+}
+
+// kmem_cache_alloc - allocate an obj from the magazines of this cpu,
+//                  - fall back to the slabs on a miss
+void *kmem_cache_alloc(kmem_cache_t * cachep)
+{
+	if (cachep->use_magazine && magazine_enabled) {
+		void *objp;
+		bool intr_flag;
+		local_intr_save(intr_flag);
+		{
+			struct kmem_cpu_cache *cc = kmem_cpu_cache(cachep);
+			spinlock_acquire(&cc->lock);
+			if ((objp = magazine_alloc(cachep, cc)) != NULL) {
+				cc->hits++;
+			} else {
+				cc->misses++;
+			}
+			spinlock_release(&cc->lock);
+		}
+		local_intr_restore(intr_flag);
+		if (objp != NULL) {
+			return objp;
+		}
+	}
+	return __kmem_cache_alloc(cachep);
+}
+
+#ifdef UCONFIG_KMALLOC_PROFILE
+/*
+ * The kmalloc profiler. Every kmalloc'd obj is tagged in its last bytes
+ * with the address kmalloc returns to, its site, and the size asked for,
+ * so that kfree knows whom to charge. Each cpu counts the sites it sees
+ * in a table of its own, an open hash written with the interrupts off by
+ * that cpu only: the objs allocated, and the objs and bytes still live,
+ * less those freed there, which may have been allocated on another cpu.
+ * kmalloc_profile_show sums the cpus up. The objs allocated before the
+ * per-cpu areas are set up are tagged with site 0 and not counted.
+ */
+#define KMPROF_SITES            256
+
+struct kmprof_tag {
+	uintptr_t site;
+	size_t size;
+};
+
+#define KMPROF_TAG_SIZE         sizeof(struct kmprof_tag)
+
+struct kmprof_site {
+	uintptr_t site;
+	size_t allocs;		// objs allocated here
+	long objs;		// objs live, allocated less freed here
+	long bytes;		// bytes live, the same
+};
+
+struct kmprof_cpu {
+	struct kmprof_site sites[KMPROF_SITES];
+	size_t lost;		// allocs and frees of sites left out, full
+};
+
+static DEFINE_PERCPU_NOINIT(struct kmprof_cpu, kmprof_cpus);
+
+static bool kmprof_on = 0;
+
+static inline struct kmprof_tag *kmprof_tag(kmem_cache_t * cachep,
+					    void *objp)
+{
+	return (struct kmprof_tag *)(objp + cachep->objsize) - 1;
+}
+
+// kmprof_count - count an alloc (1) or a free (-1) of size bytes at site on
+//              - this cpu, with the interrupts off
+static void kmprof_count(uintptr_t site, size_t size, int dir)
+{
+	struct kmprof_cpu *kc = get_cpu_ptr(kmprof_cpus);
+	uint32_t i, h = (uint32_t) (site >> 2) * 2654435761U;
+	for (i = 0; i < KMPROF_SITES; i++) {
+		struct kmprof_site *ks = kc->sites + (h + i) % KMPROF_SITES;
+		if (ks->site == 0) {
+			ks->site = site;
+		}
+		if (ks->site == site) {
+			if (dir > 0) {
+				ks->allocs++;
+			}
+			ks->objs += dir, ks->bytes += dir * (long)size;
+			return;
+		}
+	}
+	kc->lost++;
+}
+
+static void
+kmprof_alloc(kmem_cache_t * cachep, void *objp, size_t size, uintptr_t site)
+{
+	struct kmprof_tag *tag = kmprof_tag(cachep, objp);
+	tag->site = kmprof_on ? site : 0, tag->size = size;
+	if (tag->site != 0) {
+		bool intr_flag;
+		local_intr_save(intr_flag);
+		kmprof_count(site, size, 1);
+		local_intr_restore(intr_flag);
+	}
+}
+
+static void kmprof_free(kmem_cache_t * cachep, void *objp)
+{
+	struct kmprof_tag *tag;
+	/* a named cache, freed by kfree */
+	if (cachep->name != NULL) {
+		return;
+	}
+	if ((tag = kmprof_tag(cachep, objp))->site != 0) {
+		bool intr_flag;
+		local_intr_save(intr_flag);
+		kmprof_count(tag->site, tag->size, -1);
+		local_intr_restore(intr_flag);
+	}
+}
+
+// kmalloc_profile_show - the sites with objs live, most bytes first, into
+//                      - buf of size bytes; the length is returned
+size_t kmalloc_profile_show(char *buf, size_t size)
+{
+	struct kmprof_site *sites, *ks, tmp;
+	size_t len = 0, lost = 0;
+	uintptr_t start;
+	const char *sym;
+	int cpu, n = 0, i, j;
+	if ((sites = kmalloc(KMPROF_SITES * sizeof(*sites))) == NULL) {
+		return 0;
+	}
+	for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+		struct kmprof_cpu *kc = per_cpu_ptr(kmprof_cpus, cpu);
+		lost += kc->lost;
+		for (i = 0; i < KMPROF_SITES; i++) {
+			if ((ks = kc->sites + i)->site == 0) {
+				continue;
+			}
+			for (j = 0; j < n && sites[j].site != ks->site; j++) ;
+			if (j == n) {
+				if (n == KMPROF_SITES) {
+					continue;
+				}
+				memset(sites + n++, 0, sizeof(*sites));
+				sites[j].site = ks->site;
+			}
+			sites[j].allocs += ks->allocs;
+			sites[j].objs += ks->objs, sites[j].bytes += ks->bytes;
+		}
+	}
+	for (i = 1; i < n; i++) {
+		tmp = sites[i];
+		for (j = i; j > 0 && sites[j - 1].bytes < tmp.bytes; j--) {
+			sites[j] = sites[j - 1];
+		}
+		sites[j] = tmp;
+	}
+	len += snprintf(buf + len, size - len, "%12s %8s %10s %s\n",
+			"bytes", "objs", "allocs", "site");
+	for (i = 0; i < n && len < size; i++) {
+		if (sites[i].objs == 0) {
+			continue;
+		}
+		len += snprintf(buf + len, size - len, "%12ld %8ld %10lu ",
+				sites[i].bytes, sites[i].objs,
+				(unsigned long)sites[i].allocs);
+		if (len >= size) {
+			break;
+		}
+		if ((sym = ksym_lookup(sites[i].site, &start)) != NULL) {
+			len += snprintf(buf + len, size - len, "%s+0x%x\n", sym,
+					sites[i].site - start);
+		} else {
+			len += snprintf(buf + len, size - len, "%p\n",
+					sites[i].site);
+		}
+	}
+	if (len < size && lost != 0) {
+		len += snprintf(buf + len, size - len, "lost %lu\n",
+				(unsigned long)lost);
+	}
+	kfree(sites);
+	return (len < size) ? len : size;
+}
+#else
+#define KMPROF_TAG_SIZE         0
+#define kmprof_alloc(cachep, objp, size, site)  do { } while (0)
+#define kmprof_free(cachep, objp)               do { } while (0)
+#endif /* UCONFIG_KMALLOC_PROFILE */
+
 // kmalloc - simple interface used by outside functions 
 //         - to allocate a free memory using kmem_cache_alloc function
 void *kmalloc(size_t size)
 {
 	assert(size > 0);
-	size_t order = getorder(size);
+	size_t order = getorder(size + KMPROF_TAG_SIZE);
 	if (order > MAX_SIZE_ORDER) {
 		return NULL;
 	}
-	return kmem_cache_alloc(slab_cache + (order - MIN_SIZE_ORDER));
+	kmem_cache_t *cachep = slab_cache + (order - MIN_SIZE_ORDER);
+	void *objp = kmem_cache_alloc(cachep);
+	if (objp != NULL) {
+		kmprof_alloc(cachep, objp, size,
+			     (uintptr_t) __builtin_return_address(0));
+	}
+	return objp;
 }
 
-static void kmem_cache_free(kmem_cache_t * cachep, void *obj);
-
 // kmem_slab_destroy - call free_pages & kmem_cache_free to free a slab 
 static void kmem_slab_destroy(kmem_cache_t * cachep, slab_t * slabp)
 {
@@ -436,7 +822,7 @@ static void kmem_slab_destroy(kmem_cache_t * cachep, slab_t * slabp)
 	free_pages(page, 1 << cachep->page_order);
 
 	if (cachep->off_slab) {
-		kmem_cache_free(cachep->slab_cachep, slabp);
+		__kmem_cache_free(cachep->slab_cachep, slabp);
 	}
 }
 
@@ -452,9 +838,11 @@ __kmem_cache_free_one(kmem_cache_t * cachep, slab_t * slabp, void *objp)
 	slabp->free = objnr;
 
 	slabp->inuse--;
+	percpu_counter_sub(&slab_bytes, cachep->objsize);
 
 	if (slabp->inuse == 0) {
 		list_del(&(slabp->slab_link));
+		cachep->nr_slabs--;
 		kmem_slab_destroy(cachep, slabp);
 	} else if (slabp->inuse == cachep->num - 1) {
 		list_del(&(slabp->slab_link));
@@ -468,8 +856,8 @@ __kmem_cache_free_one(kmem_cache_t * cachep, slab_t * slabp, void *objp)
 #define GET_PAGE_SLAB(page)                                 \
     (slab_t *)((page)->page_link.prev)
 
-// kmem_cache_free - call kmem_cache_free_one function to free an obj 
-static void kmem_cache_free(kmem_cache_t * cachep, void *objp)
+// __kmem_cache_free - call kmem_cache_free_one function to free an obj 
+static void __kmem_cache_free(kmem_cache_t * cachep, void *objp)
 {
 	bool intr_flag;
 	struct Page *page = kva2page(objp);
@@ -486,6 +874,43 @@ static void kmem_cache_free(kmem_cache_t * cachep, void *objp)
 	local_intr_restore(intr_flag);
 }
 
+// kmem_cache_free - free an obj to the magazines of this cpu,
+//                 - give it back to its slab if they are full
+void kmem_cache_free(kmem_cache_t * cachep, void *objp)
+{
+	if (objp == NULL) {
+		return;
+	}
+	if (cachep->use_magazine && magazine_enabled) {
+		bool done;
+		bool intr_flag;
+		local_intr_save(intr_flag);
+		{
+			struct kmem_cpu_cache *cc = kmem_cpu_cache(cachep);
+			spinlock_acquire(&cc->lock);
+			if ((done = magazine_free(cachep, cc, objp))) {
+				cc->hits++;
+			} else {
+				cc->misses++;
+			}
+			spinlock_release(&cc->lock);
+		}
+		local_intr_restore(intr_flag);
+		if (done) {
+			return;
+		}
+		/* refill the depot for the next time */
+		magazine_t *mag = __kmem_cache_alloc(magazine_cachep);
+		if (mag != NULL) {
+			mag->rounds = 0;
+			local_intr_save(intr_flag);
+			depot_put(cachep, &(cachep->depot_empty), mag);
+			local_intr_restore(intr_flag);
+		}
+	}
+	__kmem_cache_free(cachep, objp);
+}
+
 // kfree - simple interface used by ooutside functions to free an obj
 void kfree(void *objp)
 {
@@ -493,7 +918,325 @@ void kfree(void *objp)
 	//according to Linux "If @objp is NULL, no operation is performed."
 	if (!objp)
 		return;
-	kmem_cache_free(GET_PAGE_CACHE(kva2page(objp)), objp);
+	kmem_cache_t *cachep = GET_PAGE_CACHE(kva2page(objp));
+	kmprof_free(cachep, objp);
+	kmem_cache_free(cachep, objp);
+}
+
+// kmem_cache_setup_cpu - set up the magazines of every cpu for cachep,
+//                      - the cache goes without magazines if out of memory
+static void kmem_cache_setup_cpu(kmem_cache_t * cachep)
+{
+	int i;
+	if (!cachep->use_magazine) {
+		return;
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct kmem_cpu_cache *cc;
+		if (cachep >= slab_cache && cachep < slab_cache + SLAB_CACHE_NUM) {
+			cc = per_cpu_ptr(kmem_cpu_caches, i)->cc + (cachep - slab_cache);
+		} else if ((cc = kmalloc(sizeof(struct kmem_cpu_cache))) == NULL) {
+			while (--i >= 0) {
+				kfree(cachep->cpu_cache[i]);
+				cachep->cpu_cache[i] = NULL;
+			}
+			cachep->use_magazine = 0;
+			return;
+		}
+		spinlock_init(&cc->lock);
+		cc->loaded = cc->previous = NULL;
+		cc->hits = cc->misses = 0;
+		cachep->cpu_cache[i] = cc;
+	}
+}
+
+// slab_magazine_init - turn the magazine layer on, the per-cpu areas of
+//                    - all cpus must be set up (see percpu_init)
+void slab_magazine_init(void)
+{
+	bool intr_flag;
+	assert(sizeof(magazine_t) <= MAGAZINE_OBJSIZE);
+	magazine_cachep = slab_cache + (getorder(sizeof(magazine_t)) - MIN_SIZE_ORDER);
+	local_intr_save(intr_flag);
+	spinlock_acquire(&cache_chain_lock);
+	{
+		list_entry_t *le = &cache_chain;
+		while ((le = list_next(le)) != &cache_chain) {
+			kmem_cache_setup_cpu(le2cache(le, cache_link));
+		}
+		magazine_enabled = 1;
+	}
+#ifdef UCONFIG_KMALLOC_PROFILE
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		memset(per_cpu_ptr(kmprof_cpus, i), 0,
+		       sizeof(struct kmprof_cpu));
+	}
+	kmprof_on = 1;
+#endif
+	spinlock_release(&cache_chain_lock);
+	local_intr_restore(intr_flag);
+	register_shrinker(&slab_shrinker);
+	kprintf("slab: per-cpu magazines of %d objs enabled.\n", MAGAZINE_SIZE);
+}
+
+// magazine_destroy - give the objs of mag back to the slabs, then mag itself
+static void magazine_destroy(kmem_cache_t * cachep, magazine_t * mag)
+{
+	while (mag->rounds > 0) {
+		__kmem_cache_free(cachep, mag->objs[--mag->rounds]);
+	}
+	__kmem_cache_free(magazine_cachep, mag);
+}
+
+// kmem_cache_drain - empty the magazines of all cpus and the depot of cachep
+static void kmem_cache_drain(kmem_cache_t * cachep)
+{
+	int i;
+	bool intr_flag;
+	magazine_t *mag;
+	if (!cachep->use_magazine || !magazine_enabled) {
+		return;
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct kmem_cpu_cache *cc = cachep->cpu_cache[i];
+		magazine_t *loaded, *previous;
+		local_intr_save(intr_flag);
+		spinlock_acquire(&cc->lock);
+		loaded = cc->loaded, previous = cc->previous;
+		cc->loaded = cc->previous = NULL;
+		spinlock_release(&cc->lock);
+		local_intr_restore(intr_flag);
+		if (loaded != NULL) {
+			magazine_destroy(cachep, loaded);
+		}
+		if (previous != NULL) {
+			magazine_destroy(cachep, previous);
+		}
+	}
+	local_intr_save(intr_flag);
+	while ((mag = depot_get(cachep, &(cachep->depot_full))) != NULL
+	       || (mag = depot_get(cachep, &(cachep->depot_empty))) != NULL) {
+		local_intr_restore(intr_flag);
+		magazine_destroy(cachep, mag);
+		local_intr_save(intr_flag);
+	}
+	local_intr_restore(intr_flag);
+}
+
+// slab_drain - empty the magazines of all caches, so that nr_used_pages
+//            - & slab_allocated only count the objs in use
+void slab_drain(void)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	spinlock_acquire(&cache_chain_lock);
+	{
+		list_entry_t *le = &cache_chain;
+		while ((le = list_next(le)) != &cache_chain) {
+			kmem_cache_drain(le2cache(le, cache_link));
+		}
+	}
+	spinlock_release(&cache_chain_lock);
+	local_intr_restore(intr_flag);
+}
+
+// slab_count - the pages the objs in the full magazines of the depots
+//            - fill, they may be spread over more slabs
+static size_t slab_count(void)
+{
+	size_t total = 0;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	spinlock_acquire(&cache_chain_lock);
+	{
+		list_entry_t *le = &cache_chain;
+		while ((le = list_next(le)) != &cache_chain) {
+			kmem_cache_t *cachep = le2cache(le, cache_link);
+			total +=
+			    cachep->depot_nr_full * MAGAZINE_SIZE * cachep->objsize;
+		}
+	}
+	spinlock_release(&cache_chain_lock);
+	local_intr_restore(intr_flag);
+	return total / PGSIZE;
+}
+
+// slab_shrink - empty the magazines of the depots back into the slabs, the
+//             - full ones first, until nr pages of slabs are freed; the
+//             - magazines loaded in the cpus are left alone
+static size_t slab_shrink(size_t nr)
+{
+	size_t free_count = 0;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	spinlock_acquire(&cache_chain_lock);
+	{
+		list_entry_t *le = &cache_chain;
+		while (free_count < nr && (le = list_next(le)) != &cache_chain) {
+			kmem_cache_t *cachep = le2cache(le, cache_link);
+			magazine_t *mag;
+			if (!cachep->use_magazine) {
+				continue;
+			}
+			while (free_count < nr
+			       && ((mag =
+				    depot_get(cachep, &(cachep->depot_full))) != NULL
+				   || (mag =
+				       depot_get(cachep,
+						 &(cachep->depot_empty))) != NULL)) {
+				/* racy, another cpu may grow the cache meanwhile */
+				size_t nr_slabs = cachep->nr_slabs;
+				magazine_destroy(cachep, mag);
+				if (cachep->nr_slabs < nr_slabs) {
+					free_count +=
+					    (nr_slabs -
+					     cachep->nr_slabs) << cachep->page_order;
+				}
+			}
+		}
+	}
+	spinlock_release(&cache_chain_lock);
+	local_intr_restore(intr_flag);
+	return free_count;
+}
+
+static struct shrinker slab_shrinker = {
+	.name = "slab",
+	.count = slab_count,
+	.scan = slab_shrink,
+};
+
+// slab_magazine_stat - sum up the magazine hits & misses of all cpus for
+//                    - each cache, return the number of entries filled
+int slab_magazine_stat(struct slab_magazine_stat *stat, int n)
+{
+	int i, num = 0;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	spinlock_acquire(&cache_chain_lock);
+	{
+		list_entry_t *le = &cache_chain;
+		while ((le = list_next(le)) != &cache_chain && num < n) {
+			kmem_cache_t *cachep = le2cache(le, cache_link);
+			if (!cachep->use_magazine) {
+				continue;
+			}
+			stat[num].name = cachep->name;
+			stat[num].objsize = cachep->objsize;
+			stat[num].hits = stat[num].misses = 0;
+			for (i = 0; magazine_enabled && i < sysconf.lcpu_count; i++) {
+				stat[num].hits += cachep->cpu_cache[i]->hits;
+				stat[num].misses += cachep->cpu_cache[i]->misses;
+			}
+			num++;
+		}
+	}
+	spinlock_release(&cache_chain_lock);
+	local_intr_restore(intr_flag);
+	return num;
+}
+
+// slab_cache_stat - the usage of each cache, return the number of entries
+//                 - filled
+int slab_cache_stat(struct slab_cache_stat *stat, int n)
+{
+	int num = 0;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	spinlock_acquire(&cache_chain_lock);
+	{
+		list_entry_t *le = &cache_chain, *list, *sle;
+		while ((le = list_next(le)) != &cache_chain && num < n) {
+			kmem_cache_t *cachep = le2cache(le, cache_link);
+			stat[num].name = cachep->name;
+			stat[num].objsize = cachep->objsize;
+			stat[num].num = cachep->num;
+			stat[num].page_order = cachep->page_order;
+			stat[num].inuse = 0;
+			spinlock_acquire(&cachep->lock);
+			stat[num].nr_slabs = cachep->nr_slabs;
+			list = &(cachep->slabs_full);
+			for (sle = list_next(list); sle != list;
+			     sle = list_next(sle)) {
+				stat[num].inuse += cachep->num;
+			}
+			list = &(cachep->slabs_notfull);
+			for (sle = list_next(list); sle != list;
+			     sle = list_next(sle)) {
+				slab_t *slabp = le2slab(sle, slab_link);
+				stat[num].inuse += slabp->inuse;
+			}
+			spinlock_release(&cachep->lock);
+			num++;
+		}
+	}
+	spinlock_release(&cache_chain_lock);
+	local_intr_restore(intr_flag);
+	return num;
+}
+
+// kmem_cache_create - create a named cache of objs of size bytes aligned
+//                   - on align (0 for the default), every obj is built by
+//                   - ctor (may be NULL) once, when its slab is grown.
+//                   - return NULL if failed
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align,
+				void (*ctor) (void *objp))
+{
+	kmem_cache_t *cachep;
+	bool intr_flag;
+	if (align < KMEM_CACHE_MIN_ALIGN) {
+		align = KMEM_CACHE_MIN_ALIGN;
+	}
+	if (size == 0 || (align & (align - 1)) != 0
+	    || ROUNDUP(size, align) > (1 << MAX_SIZE_ORDER)) {
+		return NULL;
+	}
+	if ((cachep = kmalloc(sizeof(kmem_cache_t))) == NULL) {
+		return NULL;
+	}
+	init_kmem_cache(cachep, size, align, 1);
+	cachep->name = name;
+	cachep->ctor = ctor;
+
+	local_intr_save(intr_flag);
+	spinlock_acquire(&cache_chain_lock);
+	{
+		if (magazine_enabled) {
+			kmem_cache_setup_cpu(cachep);
+		}
+		list_add_before(&cache_chain, &(cachep->cache_link));
+	}
+	spinlock_release(&cache_chain_lock);
+	local_intr_restore(intr_flag);
+	return cachep;
+}
+
+// kmem_cache_destroy - destroy a named cache, all its objs must be freed
+void kmem_cache_destroy(kmem_cache_t * cachep)
+{
+	int i;
+	bool intr_flag;
+	assert(cachep->name != NULL);
+	local_intr_save(intr_flag);
+	spinlock_acquire(&cache_chain_lock);
+	{
+		list_del(&(cachep->cache_link));
+		kmem_cache_drain(cachep);
+	}
+	spinlock_release(&cache_chain_lock);
+	local_intr_restore(intr_flag);
+
+	if (!list_empty(&(cachep->slabs_full))
+	    || !list_empty(&(cachep->slabs_notfull))) {
+		warn("kmem_cache_destroy: %s still has objs in use.\n",
+		     cachep->name);
+		return;
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		kfree(cachep->cpu_cache[i]);
+	}
+	kfree(cachep);
 }
 
 static inline void check_slab_empty(void)
@@ -619,7 +1362,7 @@ void check_slab(void)
 	assert(list_empty(&(cachep1->slabs_full)));
 	assert(list_empty(&(cachep1->slabs_notfull)));
 
-	v0 = kmalloc(cachep0->objsize);
+	v0 = kmalloc(cachep0->objsize - KMPROF_TAG_SIZE);
 	p0 = kva2page(v0);
 	assert(page2kva(p0) == v0);
 
@@ -657,6 +1400,9 @@ void check_slab(void)
 check_pass:
 
 	check_rb_tree();
+	check_rb_inline();
+	check_rhash();
+	check_findbit();
 	check_slab_empty();
 	assert(slab_allocated() == 0);
 	assert(nr_used_pages_store == nr_used_pages());
@@ -13,5 +13,44 @@ void *kmalloc(size_t n);
 void kfree(void *objp);
 
 size_t slab_allocated(void);
+#ifdef UCONFIG_KMALLOC_PROFILE
+size_t kmalloc_profile_show(char *buf, size_t size);
+#endif
+
+/* the named caches */
+typedef struct kmem_cache_s kmem_cache_t;
+
+#define KMEM_CACHE_MIN_ALIGN    sizeof(void *)
+#define KMEM_CACHE_LINE         64
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align,
+				void (*ctor) (void *objp));
+void kmem_cache_destroy(kmem_cache_t * cachep);
+void *kmem_cache_alloc(kmem_cache_t * cachep);
+void kmem_cache_free(kmem_cache_t * cachep, void *objp);
+
+/* the usage of a cache */
+struct slab_cache_stat {
+	const char *name;	// NULL for the kmalloc caches
+	size_t objsize;
+	size_t num;		// objs per slab
+	size_t page_order;	// of a slab
+	size_t nr_slabs;
+	size_t inuse;		// objs out of the slabs, in magazines too
+};
+
+int slab_cache_stat(struct slab_cache_stat *stat, int n);
+
+/* the per-cpu magazine layer */
+struct slab_magazine_stat {
+	const char *name;	// NULL for the kmalloc caches
+	size_t objsize;
+	size_t hits;
+	size_t misses;
+};
+
+void slab_magazine_init(void);
+void slab_drain(void);
+int slab_magazine_stat(struct slab_magazine_stat *stat, int n);
 
 #endif /* !__KERN_MM_SLAB_H__ */
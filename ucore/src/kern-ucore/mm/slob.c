@@ -204,6 +204,26 @@ size_t slab_allocated(void)
 	return 0;
 }
 
+/* SLOB has no magazine layer */
+void slab_magazine_init(void)
+{
+}
+
+void slab_drain(void)
+{
+}
+
+int slab_magazine_stat(struct slab_magazine_stat *stat, int n)
+{
+	return 0;
+}
+
+/* nor caches of slabs to report */
+int slab_cache_stat(struct slab_cache_stat *stat, int n)
+{
+	return 0;
+}
+
 static int find_order(int size)
 {
 	int order = 0;
@@ -300,3 +320,57 @@ void check_slab(void)
 {
 	kprintf("check_slab() success\n");
 }
+
+/* *
+ * The named caches on SLOB are plain blocks of the cache size, the
+ * constructor runs on every allocation since free blocks aren't kept.
+ * */
+struct kmem_cache_s {
+	const char *name;
+	size_t size, align;
+	void (*ctor) (void *objp);
+};
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align,
+				void (*ctor) (void *objp))
+{
+	kmem_cache_t *cachep = slob_alloc(sizeof(kmem_cache_t), 0, 0);
+	if (cachep != NULL) {
+		cachep->name = name;
+		cachep->size = size;
+		cachep->align = (align < KMEM_CACHE_MIN_ALIGN) ? KMEM_CACHE_MIN_ALIGN : align;
+		cachep->ctor = ctor;
+	}
+	return cachep;
+}
+
+void kmem_cache_destroy(kmem_cache_t * cachep)
+{
+	slob_free(cachep, sizeof(kmem_cache_t));
+}
+
+void *kmem_cache_alloc(kmem_cache_t * cachep)
+{
+	void *b;
+	if (cachep->size + SLOB_UNIT < PAGE_SIZE) {
+		b = slob_alloc(cachep->size, 0, cachep->align);
+	} else {
+		b = __slob_get_free_pages(0, find_order(cachep->size));
+	}
+	if (b != NULL && cachep->ctor != NULL) {
+		cachep->ctor(b);
+	}
+	return b;
+}
+
+void kmem_cache_free(kmem_cache_t * cachep, void *b)
+{
+	if (b == NULL) {
+		return;
+	}
+	if (cachep->size + SLOB_UNIT < PAGE_SIZE) {
+		slob_free(b, cachep->size);
+	} else {
+		__slob_free_pages((unsigned long)b, find_order(cachep->size));
+	}
+}
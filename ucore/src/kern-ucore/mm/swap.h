@@ -31,13 +31,26 @@ extern size_t max_swap_offset;
 
 void swap_init(void);
 bool try_free_pages(size_t n);
+void kswapd_balance(bool can_sleep);
 
 void swap_remove_entry(swap_entry_t entry);
 int swap_page_count(struct Page *page);
 void swap_duplicate(swap_entry_t entry);
 int swap_in_page(swap_entry_t entry, struct Page **pagep);
+int swap_in_page_ra(swap_entry_t entry, struct Page **pagep, uint32_t vm_flags);
 int swap_copy_entry(swap_entry_t entry, swap_entry_t * store);
 
+// an idle page is evicted after as many scans as its age, at most
+// PAGE_AGE_MAX, that the accessed bit found it used
+#define PAGE_AGE_MAX                    3
+
+size_t lru_nr_pages(bool active);
+
+#ifdef UCONFIG_MEMCG
+struct mem_group;
+bool try_free_group_pages(struct mem_group *g, size_t n);
+#endif
+
 int kswapd_main(void *arg) __attribute__ ((noreturn));
 
 #endif /*  UCONFIG_SWAP  */
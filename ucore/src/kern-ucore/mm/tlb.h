@@ -0,0 +1,32 @@
+#ifndef __KERN_MM_TLB_H__
+#define __KERN_MM_TLB_H__
+
+#include <types.h>
+#include <list.h>
+#include <memlayout.h>
+
+/* *
+ * tlb_gather - the tlb invalidations of one unmap or swap-out pass.
+ * The range is flushed once, on every cpu that has the page table
+ * loaded, by tlb_gather_finish. Pages that lost their last map wait on
+ * free_list until then, so no cpu can still reach them through a stale
+ * entry when they are reused.
+ * */
+struct tlb_gather {
+	pgd_t *pgdir;
+	uintptr_t start, end;	// [start, end) to be flushed, empty if start >= end
+	list_entry_t free_list;	// pages to be freed after the flush
+};
+
+void tlb_gather_init(struct tlb_gather *tlb, pgd_t * pgdir);
+void tlb_gather_add(struct tlb_gather *tlb, uintptr_t la);
+void tlb_gather_free_page(struct tlb_gather *tlb, struct Page *page);
+void tlb_gather_finish(struct tlb_gather *tlb);
+
+void unmap_range_gather(struct tlb_gather *tlb, uintptr_t start, uintptr_t end);
+void wrprotect_range_gather(struct tlb_gather *tlb, uintptr_t start,
+			    uintptr_t end);
+void lazyfree_range_gather(struct tlb_gather *tlb, uintptr_t start,
+			   uintptr_t end);
+
+#endif /* !__KERN_MM_TLB_H__ */
@@ -0,0 +1,91 @@
+#include <types.h>
+#include <string.h>
+#include <arch.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <sched.h>
+#include <clock.h>
+#include <error.h>
+#include <assert.h>
+#include <seqcount.h>
+#include <vvar.h>
+#include <vdso.h>
+#include <timekeeping.h>
+
+/*
+ * The time functions of the user library read the vvar page, see vvar.h,
+ * which exec maps read-only in every process. timekeeping.c publishes the
+ * clocks to it with each update, under its lock, so there is one writer.
+ *
+ * The page gives the tsc to the user only if it is the clocksource.
+ */
+
+static struct Page *vvar_page;
+static struct vvar_data *vvar;
+
+void vdso_init(void)
+{
+	if ((vvar_page = alloc_page()) == NULL) {
+		panic("cannot alloc the vvar page.\n");
+	}
+	/* this ref is never dropped, the page outlives every mapping */
+	set_page_ref(vvar_page, 1);
+	memset(page2kva(vvar_page), 0, PGSIZE);
+	vvar = page2kva(vvar_page);
+	vvar->hz = TIMER_HZ;
+}
+
+// vdso_update - publish the clocks, called by the writers of timekeeping.c
+void vdso_update(void)
+{
+	struct timekeeping_snapshot snap;
+	if (vvar == NULL) {
+		return;
+	}
+	timekeeping_snapshot(&snap);
+
+	/* real_offset split with the ns part positive */
+	uint64_t off = (snap.real_offset < 0) ?
+	    -snap.real_offset : snap.real_offset, off_nsec;
+	off_nsec = do_div(off, NSEC_PER_SEC);
+	long real_sec = off, real_nsec = off_nsec;
+	if (snap.real_offset < 0) {
+		real_sec = -real_sec;
+		if (real_nsec != 0) {
+			real_sec--, real_nsec = NSEC_PER_SEC - real_nsec;
+		}
+	}
+
+	write_seqcount_begin(&(vvar->seq));
+	vvar->ticks = ticks;
+	vvar->tsc_hz = (snap.cs->user_tsc) ? snap.cs->freq : 0;
+	vvar->tsc_stamp = snap.cycle_base;
+	vvar->tsc_nsec = snap.mono_base;
+	vvar->real_offset = snap.real_offset;
+	vvar->slew_left = snap.slew_left;
+	vvar->slew_mono = snap.slew_mono;
+	vvar->real_sec = real_sec, vvar->real_nsec = real_nsec;
+	write_seqcount_end(&(vvar->seq));
+}
+
+// vdso_map - map the vvar page read-only in mm, at mm->vvar_addr if it is
+//          - set already (by a restore), anywhere free otherwise
+int vdso_map(struct mm_struct *mm)
+{
+	uintptr_t addr = mm->vvar_addr;
+	int ret;
+	if (addr == 0 && (addr = get_unmapped_area(mm, PGSIZE)) == 0) {
+		return -E_NO_MEM;
+	}
+	/* VM_IO: never faulted in nor swapped out, the pte is set here */
+	if ((ret = mm_map(mm, addr, PGSIZE, VM_READ | VM_IO, NULL)) != 0) {
+		return ret;
+	}
+	pte_perm_t perm = 0;
+	ptep_set_u_read(&perm);
+	if ((ret = page_insert(mm->pgdir, vvar_page, addr, perm)) != 0) {
+		return ret;
+	}
+	mm->vvar_addr = addr;
+	return 0;
+}
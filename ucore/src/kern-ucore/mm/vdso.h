@@ -0,0 +1,12 @@
+#ifndef __KERN_MM_VDSO_H__
+#define __KERN_MM_VDSO_H__
+
+#include <types.h>
+
+struct mm_struct;
+
+void vdso_init(void);
+void vdso_update(void);
+int vdso_map(struct mm_struct *mm);
+
+#endif /* !__KERN_MM_VDSO_H__ */
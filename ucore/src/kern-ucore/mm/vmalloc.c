@@ -0,0 +1,240 @@
+#include <types.h>
+#include <string.h>
+#include <stdio.h>
+#include <kio.h>
+#include <assert.h>
+#include <list.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <pmm.h>
+#include <slab.h>
+#include <mp.h>
+#include <vmalloc.h>
+
+/* *
+ * vmalloc maps pages taken one at a time from the page allocator at
+ * addresses of the vmalloc region, so that a large buffer neither needs a
+ * high order block, which fragmented memory may not have, nor is rounded
+ * up to a power of two as by kmalloc. The areas handed out are kept in a
+ * list by address and a new one goes into the first gap large enough,
+ * with a page left unmapped after each to catch overruns.
+ *
+ * vfree unmaps and frees the pages at once, but the tlb is not flushed
+ * then: the area stays in the list, lazy, and its addresses are not given
+ * out again until a purge has flushed the tlb of every cpu. That is done
+ * once VMALLOC_LAZY_MAX pages are lazy, or when vmalloc finds no gap, a
+ * shootdown for many vfree's instead of one each.
+ * */
+#ifdef VMALLOC_START
+
+#define VMALLOC_LAZY_MAX            1024
+
+struct vm_area {
+	uintptr_t addr;
+	size_t size;		// mapped, the guard page not counted
+	unsigned int purge;	// VM_AREA_USED, VM_AREA_LAZY or a purge seq
+	list_entry_t area_link;	// linked by address in vm_areas
+};
+
+#define VM_AREA_USED                0
+#define VM_AREA_LAZY                (~0U)
+
+#define le2area(le, member)         \
+    to_struct((le), struct vm_area, member)
+
+static spinlock_s vm_lock;
+static list_entry_t vm_areas;
+static size_t vm_lazy_pages;
+static unsigned int vm_purge_seq;
+
+void vmalloc_init(void)
+{
+	uintptr_t la;
+	spinlock_init(&vm_lock);
+	list_init(&vm_areas);
+	/* the tables below the pgd entries, before any page table is copied */
+	for (la = VMALLOC_START; la < VMALLOC_END; la += (1ULL << PGXSHIFT)) {
+		assert(get_pte(boot_pgdir, la, 1) != NULL);
+	}
+}
+
+// vm_area_insert - put an area of size bytes in the first gap that holds
+//                - it and its guard page, with vm_lock held
+static struct vm_area *vm_area_insert(struct vm_area *area, size_t size)
+{
+	uintptr_t addr = VMALLOC_START;
+	list_entry_t *le = &vm_areas;
+	while ((le = list_next(le)) != &vm_areas) {
+		struct vm_area *next = le2area(le, area_link);
+		if (next->addr - addr >= size + PGSIZE) {
+			break;
+		}
+		addr = next->addr + next->size + PGSIZE;
+	}
+	if (le == &vm_areas && VMALLOC_END - addr < size + PGSIZE) {
+		return NULL;
+	}
+	area->addr = addr, area->size = size, area->purge = VM_AREA_USED;
+	list_add_before(le, &(area->area_link));
+	return area;
+}
+
+// vm_purge - flush the tlbs for the lazy areas and give their addresses
+//          - back; the areas that turn lazy meanwhile wait for the next one
+static void vm_purge(void)
+{
+	list_entry_t *le = &vm_areas;
+	unsigned int seq;
+	bool intr_flag;
+	spin_lock_irqsave(&vm_lock, intr_flag);
+	if ((seq = ++vm_purge_seq) == VM_AREA_USED || seq == VM_AREA_LAZY) {
+		seq = vm_purge_seq = 1;
+	}
+	while ((le = list_next(le)) != &vm_areas) {
+		struct vm_area *area = le2area(le, area_link);
+		if (area->purge == VM_AREA_LAZY) {
+			area->purge = seq;
+		}
+	}
+	spin_unlock_irqrestore(&vm_lock, intr_flag);
+
+	mp_tlb_flush_kernel();
+
+	spin_lock_irqsave(&vm_lock, intr_flag);
+	le = list_next(&vm_areas);
+	while (le != &vm_areas) {
+		struct vm_area *area = le2area(le, area_link);
+		le = list_next(le);
+		if (area->purge == seq) {
+			vm_lazy_pages -= area->size / PGSIZE;
+			list_del(&(area->area_link));
+			kfree(area);
+		}
+	}
+	spin_unlock_irqrestore(&vm_lock, intr_flag);
+}
+
+// vm_unmap - take the pages of [addr, addr + size) down and free them, the
+//          - tlb left for vm_purge
+static void vm_unmap(uintptr_t addr, size_t size)
+{
+	uintptr_t la;
+	for (la = addr; la < addr + size; la += PGSIZE) {
+		pte_t *ptep = get_pte(boot_pgdir, la, 0);
+		if (ptep != NULL && ptep_present(ptep)) {
+			struct Page *page = pte2page(*ptep);
+			ptep_unmap(ptep);
+			free_page(page);
+		}
+	}
+}
+
+// vm_area_lazy - area is unmapped, purge it with the others if they are
+//              - many and this may wait for the other cpus
+static void vm_area_lazy(struct vm_area *area)
+{
+	bool intr_flag, purge;
+	spin_lock_irqsave(&vm_lock, intr_flag);
+	area->purge = VM_AREA_LAZY;
+	vm_lazy_pages += area->size / PGSIZE;
+	purge = (vm_lazy_pages > VMALLOC_LAZY_MAX && intr_flag);
+	spin_unlock_irqrestore(&vm_lock, intr_flag);
+	if (purge) {
+		vm_purge();
+	}
+}
+
+// vmalloc - size bytes, rounded up to pages, virtually contiguous only;
+//         - not from interrupts, it may wait for the other cpus
+void *vmalloc(size_t size)
+{
+	struct vm_area *area;
+	bool intr_flag, purged = 0;
+	uintptr_t la;
+	size = ROUNDUP(size, PGSIZE);
+	if (size == 0 || size >= VMALLOC_END - VMALLOC_START) {
+		return NULL;
+	}
+	if ((area = kmalloc(sizeof(struct vm_area))) == NULL) {
+		return NULL;
+	}
+	while (1) {
+		struct vm_area *got;
+		spin_lock_irqsave(&vm_lock, intr_flag);
+		got = vm_area_insert(area, size);
+		/* or nothing to purge */
+		purged = purged || vm_lazy_pages == 0;
+		spin_unlock_irqrestore(&vm_lock, intr_flag);
+		if (got != NULL) {
+			break;
+		}
+		if (purged) {
+			kfree(area);
+			return NULL;
+		}
+		vm_purge();
+		purged = 1;
+	}
+
+	for (la = area->addr; la < area->addr + size; la += PGSIZE) {
+		struct Page *page;
+		pte_t *ptep = get_pte(boot_pgdir, la, 1);
+		if (ptep == NULL || (page = alloc_page()) == NULL) {
+			vm_unmap(area->addr, la - area->addr);
+			vm_area_lazy(area);
+			return NULL;
+		}
+		/* not PTE_G, so that a cr3 load drops it as well */
+		*ptep = page2pa(page) | PTE_P | PTE_W;
+	}
+	return (void *)area->addr;
+}
+
+void vfree(void *addr)
+{
+	struct vm_area *area = NULL;
+	list_entry_t *le = &vm_areas;
+	bool intr_flag;
+	if (addr == NULL) {
+		return;
+	}
+	spin_lock_irqsave(&vm_lock, intr_flag);
+	while ((le = list_next(le)) != &vm_areas) {
+		struct vm_area *a = le2area(le, area_link);
+		if (a->addr == (uintptr_t) addr && a->purge == VM_AREA_USED) {
+			area = a;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&vm_lock, intr_flag);
+	if (area == NULL) {
+		panic("vfree: %p was not vmalloc'd.\n", addr);
+	}
+	vm_unmap(area->addr, area->size);
+	vm_area_lazy(area);
+}
+#endif /* VMALLOC_START */
+
+// kvmalloc - size bytes from kmalloc if small, from vmalloc otherwise, or
+//          - from kmalloc still if vmalloc has none
+void *kvmalloc(size_t size)
+{
+	void *ret = NULL;
+#ifdef VMALLOC_START
+	if (size >= KVMALLOC_MIN && (ret = vmalloc(size)) != NULL) {
+		return ret;
+	}
+#endif
+	return kmalloc(size);
+}
+
+void kvfree(void *addr)
+{
+#ifdef VMALLOC_START
+	if (is_vmalloc_addr(addr)) {
+		vfree(addr);
+		return;
+	}
+#endif
+	kfree(addr);
+}
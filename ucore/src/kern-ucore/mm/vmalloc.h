@@ -0,0 +1,41 @@
+#ifndef __KERN_MM_VMALLOC_H__
+#define __KERN_MM_VMALLOC_H__
+
+#include <types.h>
+#include <memlayout.h>
+
+/* *
+ * Large kernel buffers of pages that need not be physically contiguous,
+ * mapped one by one in the vmalloc region of memlayout.h, on the arches
+ * that have one. kvmalloc takes a small size from kmalloc and a large one
+ * from vmalloc, kvfree frees either. See vmalloc.c.
+ * */
+
+/* from this size on, kvmalloc goes to vmalloc */
+#define KVMALLOC_MIN            (4 * PGSIZE)
+
+#ifdef VMALLOC_START
+void vmalloc_init(void);
+void *vmalloc(size_t size);
+void vfree(void *addr);
+
+static inline bool is_vmalloc_addr(const void *addr)
+{
+	uintptr_t la = (uintptr_t) addr;
+	return VMALLOC_START <= la && la < VMALLOC_END;
+}
+#else
+static inline void vmalloc_init(void)
+{
+}
+
+static inline bool is_vmalloc_addr(const void *addr)
+{
+	return 0;
+}
+#endif
+
+void *kvmalloc(size_t size);
+void kvfree(void *addr);
+
+#endif /* !__KERN_MM_VMALLOC_H__ */
@@ -12,6 +12,17 @@
 #include <proc.h>
 #include <sem.h>
 #include <kio.h>
+#include <sysconf.h>
+#include <hugepage.h>
+#include <tlb.h>
+#include <ksm.h>
+#include <execmap.h>
+#include <vdso.h>
+#include <trace.h>
+#include <unistd.h>
+#include <memcg.h>
+#include <rmap.h>
+#include <shrinker.h>
 
 #include <file.h>
 #include <proc.h>
@@ -38,9 +49,9 @@
    struct vma_struct * find_vma(struct mm_struct *mm, uintptr_t addr)
    local functions
    inline void check_vma_overlap(struct vma_struct *prev, struct vma_struct *next)
-   inline struct vma_struct * find_vma_rb(rb_tree *tree, uintptr_t addr) 
-   inline void insert_vma_rb(rb_tree *tree, struct vma_struct *vma, ....
-   inline int vma_compare(rb_node *node1, rb_node *node2)
+   inline struct vma_struct * find_vma_rb(struct rbi_root *tree, uintptr_t addr)
+   inline void insert_vma_rb(struct rbi_root *tree, struct vma_struct *vma, ....
+   void vma_update(struct vma_struct *vma)
    ---------------
    check correctness functions
    void check_vmm(void);
@@ -65,7 +76,8 @@ static void check_pgfault(void);
 void lock_mm(struct mm_struct *mm)
 {
 	if (mm != NULL) {
-		down(&(mm->mm_sem));
+		down_write_site(&(mm->mm_rwsem),
+				(uintptr_t) __builtin_return_address(0));
 		if (current != NULL) {
 			mm->locked_by = current->pid;
 		}
@@ -75,15 +87,15 @@ void lock_mm(struct mm_struct *mm)
 void unlock_mm(struct mm_struct *mm)
 {
 	if (mm != NULL) {
-		up(&(mm->mm_sem));
 		mm->locked_by = 0;
+		up_write(&(mm->mm_rwsem));
 	}
 }
 
 bool try_lock_mm(struct mm_struct *mm)
 {
 	if (mm != NULL) {
-		if (!try_down(&(mm->mm_sem))) {
+		if (!try_down_write(&(mm->mm_rwsem))) {
 			return 0;
 		}
 		if (current != NULL) {
@@ -93,22 +105,79 @@ bool try_lock_mm(struct mm_struct *mm)
 	return 1;
 }
 
+// lock_mm_shared - lock mm against vma changes only, for page faults and
+//                - user copies, which may run on many threads of mm at once
+void lock_mm_shared(struct mm_struct *mm)
+{
+	if (mm != NULL) {
+		down_read_site(&(mm->mm_rwsem),
+			       (uintptr_t) __builtin_return_address(0));
+		if (current != NULL) {
+			assert(!(current->flags & PF_MM_SHARED));
+			current->flags |= PF_MM_SHARED;
+		}
+	}
+}
+
+void unlock_mm_shared(struct mm_struct *mm)
+{
+	if (mm != NULL) {
+		if (current != NULL) {
+			current->flags &= ~PF_MM_SHARED;
+		}
+		up_read(&(mm->mm_rwsem));
+	}
+}
+
+/* dedicated caches for mm_struct and vma_struct, created in vmm_init */
+static kmem_cache_t *mm_cachep;
+static kmem_cache_t *vma_cachep;
+
+#ifdef UCONFIG_FAULT_AROUND
+/* read faults on private anonymous memory map this page read-only */
+struct Page *zero_page;
+#endif
+
 // mm_create -  alloc a mm_struct & initialize it.
 struct mm_struct *mm_create(void)
 {
-	struct mm_struct *mm = kmalloc(sizeof(struct mm_struct));
+	struct mm_struct *mm = kmem_cache_alloc(mm_cachep);
 	if (mm != NULL) {
 		list_init(&(mm->mmap_list));
-		mm->mmap_tree = NULL;
+		rbi_root_init(&(mm->mmap_tree));
+		mm->mmap_rb = 0;
 		mm->mmap_cache = NULL;
 		mm->pgdir = NULL;
 		mm->map_count = 0;
 		mm->swap_address = 0;
+#ifdef UCONFIG_KSM
+		mm->ksm_address = 0;
+#endif
 		set_mm_count(mm, 0);
 		mm->locked_by = 0;
 		mm->brk_start = mm->brk = 0;
+		mm->vvar_addr = 0;
 		list_init(&(mm->proc_mm_link));
-		sem_init(&(mm->mm_sem), 1);
+		rwsem_init(&(mm->mm_rwsem));
+#ifdef UCONFIG_LOCK_STAT
+		lock_stat_class("mm", &(mm->mm_rwsem.stat));
+#endif
+		spinlock_init(&(mm->pt_lock));
+#ifdef UCONFIG_NUMA_POLICY
+		mm->mempolicy = MPOL_LOCAL;
+		mm->mempolicy_node = 0;
+		memset(mm->numa_pages, 0, sizeof(mm->numa_pages));
+		mm->numa_preferred = -1;
+#endif
+#ifdef UCONFIG_MEMCG
+		mm->memcg = NULL;
+#endif
+#ifdef UCONFIG_PCID
+		mm->tlb_ctx = pcid_new_ctx();
+#endif
+#ifdef UCONFIG_ARM_ASID
+		mm->asid_context = 0;
+#endif
 	}
 	return mm;
 }
@@ -117,16 +186,22 @@ struct mm_struct *mm_create(void)
 struct vma_struct *vma_create(uintptr_t vm_start, uintptr_t vm_end,
 			      uint32_t vm_flags)
 {
-	struct vma_struct *vma = kmalloc(sizeof(struct vma_struct));
+	struct vma_struct *vma = kmem_cache_alloc(vma_cachep);
 	if (vma != NULL) {
 		vma->vm_start = vm_start;
 		vma->vm_end = vm_end;
 		vma->vm_flags = vm_flags;
 		vma->shmem = NULL;
 		vma->shmem_off = 0;
+#ifdef UCONFIG_SWAP
+		vma->anon_vma = NULL;
+#endif
 #ifdef UCONFIG_BIONIC_LIBC
 		vma->mfile.file = NULL;
 #endif //UCONFIG_BIONIC_LIBC
+#ifdef UCONFIG_DEMAND_EXEC
+		vma->exec.node = NULL;
+#endif
 	}
 	return vma;
 }
@@ -139,13 +214,18 @@ static void vma_destroy(struct vma_struct *vma)
 			shmem_destroy(vma->shmem);
 		}
 	}
-	kfree(vma);
+	anon_vma_unlink(vma);
+#ifdef UCONFIG_DEMAND_EXEC
+	vma_put_exec(vma);
+#endif
+	kmem_cache_free(vma_cachep, vma);
 }
 
 // find_vma_rb - find a vma  (vma->vm_start <= addr < vma_vm_end) in rb tree
-static inline struct vma_struct *find_vma_rb(rb_tree * tree, uintptr_t addr)
+static inline struct vma_struct *find_vma_rb(struct rbi_root *tree,
+					     uintptr_t addr)
 {
-	rb_node *node = rb_node_root(tree);
+	struct rbi_node *node = tree->node;
 	struct vma_struct *vma = NULL, *tmp;
     //kprintf("  find_vma_rb begin:: addr is %d\n",addr);
 	while (node != NULL) {
@@ -157,10 +237,10 @@ static inline struct vma_struct *find_vma_rb(rb_tree * tree, uintptr_t addr)
 				break;
 			}
 			vma = NULL;
-			node = rb_node_left(tree, node);
+			node = node->left;
 		} else {
 			vma = NULL;
-			node = rb_node_right(tree, node);
+			node = node->right;
 		}
 	}
 #if 0
@@ -182,8 +262,8 @@ struct vma_struct *find_vma(struct mm_struct *mm, uintptr_t addr)
 		if (!
 		    (vma != NULL && vma->vm_start <= addr
 		     && vma->vm_end > addr)) {
-			if (mm->mmap_tree != NULL) {
-				vma = find_vma_rb(mm->mmap_tree, addr);
+			if (mm->mmap_rb) {
+				vma = find_vma_rb(&(mm->mmap_tree), addr);
 			} else {
 				bool found = 0;
 				list_entry_t *list = &(mm->mmap_list), *le =
@@ -208,23 +288,86 @@ struct vma_struct *find_vma(struct mm_struct *mm, uintptr_t addr)
 	return vma;
 }
 
+// find_vma_above - find the lowest vma with addr < vma->vm_end
+static struct vma_struct *find_vma_above(struct mm_struct *mm, uintptr_t addr)
+{
+	struct vma_struct *vma = NULL, *tmp;
+	if (mm->mmap_rb) {
+		struct rbi_node *node = mm->mmap_tree.node;
+		while (node != NULL) {
+			tmp = rbn2vma(node, rb_link);
+			if (tmp->vm_end > addr) {
+				vma = tmp;
+				if (tmp->vm_start <= addr) {
+					break;
+				}
+				node = node->left;
+			} else {
+				node = node->right;
+			}
+		}
+	} else {
+		list_entry_t *list = &(mm->mmap_list), *le = list;
+		while ((le = list_next(le)) != list) {
+			tmp = le2vma(le, list_link);
+			if (tmp->vm_end > addr) {
+				vma = tmp;
+				break;
+			}
+		}
+	}
+	return vma;
+}
+
+// find_vma_intersection - find a vma overlapping [start, end), the lowest
 struct vma_struct *find_vma_intersection(struct mm_struct *mm, uintptr_t start,
 					 uintptr_t end)
 {
-	struct vma_struct *vma = find_vma(mm, start);
+	struct vma_struct *vma = find_vma_above(mm, start);
 	if (vma != NULL && end <= vma->vm_start) {
 		vma = NULL;
 	}
 	return vma;
 }
 
-// vma_compare - compare vma1->vm_start < vma2->vm_start ?
-static inline int vma_compare(rb_node * node1, rb_node * node2)
+// vma_less - vma1->vm_start < vma2->vm_start ?
+#define vma_less(vma1, vma2)        ((vma1)->vm_start < (vma2)->vm_start)
+
+// vma_update - recompute the span and the widest hole of the subtree of vma
+//            - from those of its children, see RB_INLINE_GENERATE
+static inline void vma_update(struct vma_struct *vma)
+{
+	struct vma_struct *child;
+	struct rbi_node *left = vma->rb_link.left, *right = vma->rb_link.right;
+	vma->rb_lo = vma->vm_start, vma->rb_hi = vma->vm_end, vma->rb_gap = 0;
+	if (left != NULL) {
+		child = rbn2vma(left, rb_link);
+		vma->rb_lo = child->rb_lo;
+		vma->rb_gap = vma->vm_start - child->rb_hi;
+		if (vma->rb_gap < child->rb_gap) {
+			vma->rb_gap = child->rb_gap;
+		}
+	}
+	if (right != NULL) {
+		child = rbn2vma(right, rb_link);
+		vma->rb_hi = child->rb_hi;
+		if (vma->rb_gap < child->rb_lo - vma->vm_end) {
+			vma->rb_gap = child->rb_lo - vma->vm_end;
+		}
+		if (vma->rb_gap < child->rb_gap) {
+			vma->rb_gap = child->rb_gap;
+		}
+	}
+}
+
+RB_INLINE_GENERATE(vma_rb, struct vma_struct, rb_link, vma_less, vma_update);
+
+// vma_changed - the bounds of vma in mm changed in place, keeping its order
+static inline void vma_changed(struct mm_struct *mm, struct vma_struct *vma)
 {
-	struct vma_struct *vma1 = rbn2vma(node1, rb_link);
-	struct vma_struct *vma2 = rbn2vma(node2, rb_link);
-	uintptr_t start1 = vma1->vm_start, start2 = vma2->vm_start;
-	return (start1 < start2) ? -1 : (start1 > start2) ? 1 : 0;
+	if (mm->mmap_rb) {
+		vma_rb_update(vma);
+	}
 }
 
 #ifdef UCONFIG_BIONIC_LIBC
@@ -283,13 +426,13 @@ check_vma_overlap(struct vma_struct *prev, struct vma_struct *next)
 
 // insert_vma_rb - insert vma in rb tree according vma->start_addr
 static inline void
-insert_vma_rb(rb_tree * tree, struct vma_struct *vma,
+insert_vma_rb(struct rbi_root *tree, struct vma_struct *vma,
 	      struct vma_struct **vma_prevp)
 {
-	rb_node *node = &(vma->rb_link), *prev;
-	rb_insert(tree, node);
+	struct rbi_node *prev;
+	vma_rb_insert(tree, vma);
 	if (vma_prevp != NULL) {
-		prev = rb_node_prev(tree, node);
+		prev = rbi_prev(&(vma->rb_link));
 		*vma_prevp = (prev != NULL) ? rbn2vma(prev, rb_link) : NULL;
 	}
 }
@@ -300,9 +443,9 @@ void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
 	assert(vma->vm_start < vma->vm_end);
 	list_entry_t *list = &(mm->mmap_list);
 	list_entry_t *le_prev = list, *le_next;
-	if (mm->mmap_tree != NULL) {
+	if (mm->mmap_rb) {
 		struct vma_struct *mmap_prev;
-		insert_vma_rb(mm->mmap_tree, vma, &mmap_prev);
+		insert_vma_rb(&(mm->mmap_tree), vma, &mmap_prev);
 		if (mmap_prev != NULL) {
 			le_prev = &(mmap_prev->list_link);
 		}
@@ -331,18 +474,14 @@ void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
 	list_add_after(le_prev, &(vma->list_link));
 
 	mm->map_count++;
-	if (mm->mmap_tree == NULL && mm->map_count >= RB_MIN_MAP_COUNT) {
-
-		/* try to build red-black tree now, but may fail. */
-		mm->mmap_tree = rb_tree_create(vma_compare);
-
-		if (mm->mmap_tree != NULL) {
-			list_entry_t *list = &(mm->mmap_list), *le = list;
-			while ((le = list_next(le)) != list) {
-				insert_vma_rb(mm->mmap_tree,
-					      le2vma(le, list_link), NULL);
-			}
+	if (!mm->mmap_rb && mm->map_count >= RB_MIN_MAP_COUNT) {
+		/* build the red-black tree now, the root is in mm */
+		list_entry_t *list = &(mm->mmap_list), *le = list;
+		while ((le = list_next(le)) != list) {
+			insert_vma_rb(&(mm->mmap_tree), le2vma(le, list_link),
+				      NULL);
 		}
+		mm->mmap_rb = 1;
 	}
 }
 
@@ -350,8 +489,8 @@ void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
 static int remove_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
 {
 	assert(mm == vma->vm_mm);
-	if (mm->mmap_tree != NULL) {
-		rb_delete(mm->mmap_tree, &(vma->rb_link));
+	if (mm->mmap_rb) {
+		vma_rb_remove(&(mm->mmap_tree), vma);
 	}
 	list_del(&(vma->list_link));
 	if (vma == mm->mmap_cache) {
@@ -365,24 +504,102 @@ static int remove_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
 void mm_destroy(struct mm_struct *mm)
 {
 	assert(mm_count(mm) == 0);
-	if (mm->mmap_tree != NULL) {
-		rb_tree_destroy(mm->mmap_tree);
-	}
 	list_entry_t *list = &(mm->mmap_list), *le;
 	while ((le = list_next(list)) != list) {
 		list_del(le);
 		vma_destroy(le2vma(le, list_link));
 	}
-	kfree(mm);
+#ifdef UCONFIG_MEMCG
+	memcg_put(mm->memcg);
+#endif
+	kmem_cache_free(mm_cachep, mm);
 }
 
 // vmm_init - initialize virtual memory management
 //          - now just call check_vmm to check correctness of vmm
 void vmm_init(void)
 {
+	shrinker_init();
+	mm_cachep = kmem_cache_create("mm_struct", sizeof(struct mm_struct),
+				      KMEM_CACHE_LINE, NULL);
+	vma_cachep = kmem_cache_create("vma_struct", sizeof(struct vma_struct),
+				       0, NULL);
+	if (mm_cachep == NULL || vma_cachep == NULL) {
+		panic("cannot create mm/vma caches.\n");
+	}
+#ifdef UCONFIG_FAULT_AROUND
+	if ((zero_page = alloc_page()) == NULL) {
+		panic("cannot alloc the zero page.\n");
+	}
+	clear_page(page2kva(zero_page));
+	/* this ref is never dropped, so a write always copies the page */
+	set_page_ref(zero_page, 1);
+#endif
+#ifdef UCONFIG_KSM
+	ksm_init();
+#endif
+#ifdef UCONFIG_DEMAND_EXEC
+	execmap_init();
+#endif
+	shmem_init();
+	vdso_init();
 	check_vmm();
 }
 
+// vma_mergeable - may vma grow over a neighbour mapped with vm_flags: plain
+//               - anonymous memory with nothing else attached to it
+static bool vma_mergeable(struct vma_struct *vma, uint32_t vm_flags)
+{
+	if (vma->vm_flags != vm_flags || !(vm_flags & VM_ANONYMOUS)
+	    || (vm_flags & (VM_SHARE | VM_STACK | VM_IO))) {
+		return 0;
+	}
+#ifdef UCONFIG_BIONIC_LIBC
+	if (vma->mfile.file != NULL) {
+		return 0;
+	}
+#endif
+#ifdef UCONFIG_DEMAND_EXEC
+	if (vma->exec.node != NULL) {
+		return 0;
+	}
+#endif
+	return 1;
+}
+
+// vma_merge - map the free [start, end) by growing the vmas right before or
+//           - after it instead of adding one; returns 0 if neither may grow
+static bool
+vma_merge(struct mm_struct *mm, uintptr_t start, uintptr_t end,
+	  uint32_t vm_flags)
+{
+	struct vma_struct *prev = NULL, *next;
+	if (start > 0 && (prev = find_vma(mm, start - 1)) != NULL
+	    && (prev->vm_end != start || !vma_mergeable(prev, vm_flags))) {
+		prev = NULL;
+	}
+	if ((next = find_vma(mm, end)) != NULL
+	    && (next->vm_start != end || !vma_mergeable(next, vm_flags))) {
+		next = NULL;
+	}
+	if (prev != NULL) {
+		if (next != NULL) {
+			end = next->vm_end;
+			remove_vma_struct(mm, next);
+			vma_destroy(next);
+		}
+		prev->vm_end = end;
+		vma_changed(mm, prev);
+		return 1;
+	}
+	if (next != NULL) {
+		next->vm_start = start;
+		vma_changed(mm, next);
+		return 1;
+	}
+	return 0;
+}
+
 int
 mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
        struct vma_struct **vma_store)
@@ -401,12 +618,17 @@ mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags,
 	if ((vma = find_vma(mm, start)) != NULL && end > vma->vm_start) {
 		goto out;
 	}
-	ret = -E_NO_MEM;
+	ret = 0;
 	vm_flags &= ~VM_SHARE;
+	if (vma_store == NULL && vma_merge(mm, start, end, vm_flags)) {
+		goto out;
+	}
+	ret = -E_NO_MEM;
 	if ((vma = vma_create(start, end, vm_flags)) == NULL) {
 		goto out;
 	}
 	insert_vma_struct(mm, vma);
+	anon_vma_prepare(vma);
 	if (vma_store != NULL) {
 		*vma_store = vma;
 	}
@@ -433,6 +655,9 @@ mm_map_shmem(struct mm_struct *mm, uintptr_t addr, uint32_t vm_flags,
 	vma->shmem = shmem;
 	vma->shmem_off = 0;
 	vma->vm_flags |= VM_SHARE;
+	/* its pages are found by the anon_vma of shmem */
+	anon_vma_unlink(vma);
+	anon_vma_prepare(vma);
 	if (vma_store != NULL) {
 		*vma_store = vma;
 	}
@@ -479,12 +704,20 @@ int mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len)
 #ifdef UCONFIG_BIONIC_LIBC
 		vma_copymapfile(nvma, vma);
 #endif //UCONFIG_BIONIC_LIBC
+#ifdef UCONFIG_DEMAND_EXEC
+		vma_copy_exec(nvma, vma);
+#endif
 		vma_resize(vma, end, vma->vm_end);
+		vma_changed(mm, vma);
 		insert_vma_struct(mm, nvma);
+		anon_vma_clone(nvma, vma);
 		unmap_range(mm->pgdir, start, end);
 		return 0;
 	}
 
+	/* the vmas of the range are unmapped under one tlb flush */
+	struct tlb_gather tlb;
+	tlb_gather_init(&tlb, mm->pgdir);
 	list_entry_t free_list, *le;
 	list_init(&free_list);
 	while (vma->vm_start < end) {
@@ -519,8 +752,9 @@ int mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len)
 				vma_destroy(vma);
 			}
 		}
-		unmap_range(mm->pgdir, un_start, un_end);
+		unmap_range_gather(&tlb, un_start, un_end);
 	}
+	tlb_gather_finish(&tlb);
 	return 0;
 }
 
@@ -548,8 +782,13 @@ int mm_unmap_keep_pages(struct mm_struct *mm, uintptr_t addr, size_t len)
 		}
 
 		vma_copymapfile(nvma, vma);
+#ifdef UCONFIG_DEMAND_EXEC
+		vma_copy_exec(nvma, vma);
+#endif
 		vma_resize(vma, end, vma->vm_end);
+		vma_changed(mm, vma);
 		insert_vma_struct(mm, nvma);
+		anon_vma_clone(nvma, vma);
 
 		return 0;
 	}
@@ -611,6 +850,9 @@ int dup_mmap(struct mm_struct *to, struct mm_struct *from)
 #ifdef UCONFIG_BIONIC_LIBC
 			nvma->mfile = vma->mfile;
 #endif //UCONFIG_BIONIC_LIBC
+#ifdef UCONFIG_DEMAND_EXEC
+			vma_copy_exec(nvma, vma);
+#endif
 		}
 		insert_vma_struct(to, nvma);
 		bool share = (vma->vm_flags & VM_SHARE);
@@ -619,6 +861,8 @@ int dup_mmap(struct mm_struct *to, struct mm_struct *from)
 		     share) != 0) {
 			return -E_NO_MEM;
 		}
+		/* not before its ptes are all there */
+		anon_vma_clone(nvma, vma);
 	}
 	return 0;
 }
@@ -628,46 +872,98 @@ void exit_mmap(struct mm_struct *mm)
 	assert(mm != NULL && mm_count(mm) == 0);
 	pgd_t *pgdir = mm->pgdir;
 	list_entry_t *list = &(mm->mmap_list), *le = list;
+	struct tlb_gather tlb;
+#ifdef UCONFIG_LAZY_TLB
+	/* no kernel thread may keep pgdir loaded once it is freed */
+	mp_lazy_tlb_drop(pgdir);
+#endif
+	/* no rmap walk may come into the ptes freed below */
+	while ((le = list_next(le)) != list) {
+		anon_vma_unlink(le2vma(le, list_link));
+	}
+	/* one shootdown for the whole address space */
+	tlb_gather_init(&tlb, pgdir);
 	while ((le = list_next(le)) != list) {
 		struct vma_struct *vma = le2vma(le, list_link);
-		unmap_range(pgdir, vma->vm_start, vma->vm_end);
+		unmap_range_gather(&tlb, vma->vm_start, vma->vm_end);
 
 #ifdef UCONFIG_BIONIC_LIBC
 		vma_unmapfile(vma);
 #endif //UCONFIG_BIONIC_LIBC
 	}
+	tlb_gather_finish(&tlb);
 	while ((le = list_next(le)) != list) {
 		struct vma_struct *vma = le2vma(le, list_link);
 		exit_range(pgdir, vma->vm_start, vma->vm_end);
 	}
 }
 
-#ifdef UCONFIG_BIONIC_LIBC
-int remapfile(struct mm_struct *mm, struct proc_struct *proc)
+// gap_fit - the highest start aligned to align of len bytes in [lo, hi), or 0
+static inline uintptr_t
+gap_fit(uintptr_t lo, uintptr_t hi, size_t len, size_t align)
 {
-	//kprintf("remap!!\n");
-	assert(mm != NULL);
-	list_entry_t *list = &(mm->mmap_list), *le = list;
-	while ((le = list_prev(le)) != list) {
-		struct vma_struct *vma = le2vma(le, list_link);
-		if (vma->mfile.file != NULL) {
-			/*
-			   kprintf("remapfile:0x%08x fd:%d offset:0x%08x\n", vma->mfile.file, vma->mfile.file->fd,
-			   vma->mfile.offset);
-			 */
-			vma_mapfile(vma, vma->mfile.file->fd, vma->mfile.offset, proc->fs_struct);
+	if (hi < lo || hi - lo < len) {
+		return 0;
+	}
+	uintptr_t start = ROUNDDOWN(hi - len, align);
+	return (start >= lo) ? start : 0;
+}
+
+// find_gap_rb - the highest fit of len in the holes between the vmas of the
+//             - subtree of node; a subtree whose widest hole is too small
+//             - is skipped whole, so it takes O(log n) but for the holes
+//             - wide enough that the alignment leaves too short
+static uintptr_t find_gap_rb(struct rbi_node *node, size_t len, size_t align)
+{
+	struct vma_struct *vma = rbn2vma(node, rb_link), *child;
+	struct rbi_node *left = node->left, *right = node->right;
+	uintptr_t start;
+	if (vma->rb_gap < len) {
+		return 0;
+	}
+	if (right != NULL) {
+		child = rbn2vma(right, rb_link);
+		if ((start = find_gap_rb(right, len, align)) != 0
+		    || (start = gap_fit(vma->vm_end, child->rb_lo, len,
+					align)) != 0) {
+			return start;
+		}
+	}
+	if (left != NULL) {
+		child = rbn2vma(left, rb_link);
+		if ((start = gap_fit(child->rb_hi, vma->vm_start, len,
+				     align)) != 0) {
+			return start;
 		}
+		return find_gap_rb(left, len, align);
 	}
 	return 0;
 }
-#endif //UCONFIG_BIONIC_LIBC
 
+// get_unmapped_area - the highest free range of len bytes below USERTOP
 uintptr_t get_unmapped_area(struct mm_struct * mm, size_t len)
 {
 	if (len == 0 || len > USERTOP) {
 		return 0;
 	}
-	uintptr_t start = USERTOP - len;
+	size_t align = PGSIZE;
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+	/* so that big maps can be backed by huge pages */
+	if (len >= HPAGE_SIZE) {
+		align = HPAGE_SIZE;
+	}
+#endif
+	uintptr_t start;
+	struct rbi_node *root;
+	if (mm->mmap_rb && (root = mm->mmap_tree.node) != NULL) {
+		struct vma_struct *all = rbn2vma(root, rb_link);
+		if ((start = gap_fit(all->rb_hi, USERTOP, len, align)) != 0
+		    || (start = find_gap_rb(root, len, align)) != 0) {
+			return start;
+		}
+		return gap_fit(USERBASE, all->rb_lo, len, align);
+	}
+	start = ROUNDDOWN(USERTOP - len, align);
 	list_entry_t *list = &(mm->mmap_list), *le = list;
 	while ((le = list_prev(le)) != list) {
 		struct vma_struct *vma = le2vma(le, list_link);
@@ -678,7 +974,7 @@ uintptr_t get_unmapped_area(struct mm_struct * mm, size_t len)
 			if (len >= vma->vm_start) {
 				return 0;
 			}
-			start = vma->vm_start - len;
+			start = ROUNDDOWN(vma->vm_start - len, align);
 		}
 	}
 	return (start >= USERBASE) ? start : 0;
@@ -700,12 +996,14 @@ int mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len)
 	struct vma_struct *vma = find_vma(mm, start - 1);
 	if (vma != NULL && vma->vm_end == start && vma->vm_flags == vm_flags) {
 		vma->vm_end = end;
+		vma_changed(mm, vma);
 		return 0;
 	}
 	if ((vma = vma_create(start, end, vm_flags)) == NULL) {
 		return -E_NO_MEM;
 	}
 	insert_vma_struct(mm, vma);
+	anon_vma_prepare(vma);
 	return 0;
 }
 
@@ -799,6 +1097,13 @@ static void check_vma_struct(void)
 
 		assert(vma1->vm_start == i  && vma1->vm_end == i  + 2);
 		assert(vma2->vm_start == i  && vma2->vm_end == i  + 2);
+
+		/* a range starting in a hole still meets the vma after it */
+		assert(find_vma_intersection(mm, i + 2, i + 5) == NULL);
+		if (i < 5 * step2) {
+			assert(find_vma_intersection(mm, i + 2, i + 6)
+			       == find_vma(mm, i + 5));
+		}
 	}
 
 	for (i =4; i>=0; i--) {
@@ -885,13 +1190,327 @@ static inline struct mapped_addr *find_maddr(struct file *file, off_t offset,
 }
 #endif //UCONFIG_BIONIC_LIBC
 
+// vma_private_anon - the pages of vma are its own, with nothing behind them
+static bool vma_private_anon(struct vma_struct *vma)
+{
+	if (vma->vm_flags & (VM_SHARE | VM_IO)) {
+		return 0;
+	}
+#ifdef UCONFIG_BIONIC_LIBC
+	if (vma->mfile.file != NULL) {
+		return 0;
+	}
+#endif
+#ifdef UCONFIG_DEMAND_EXEC
+	if (vma->exec.node != NULL) {
+		return 0;
+	}
+#endif
+	return 1;
+}
+
+// madvise_willneed - read in, ahead of the faults on them, the pages of
+//                  - [start, end) of vma that are out in swap or are still
+//                  - in the executable it maps; called with mm locked
+static void
+madvise_willneed(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start,
+		 uintptr_t end)
+{
+	uintptr_t la;
+	for (la = start; la < end; la += PGSIZE) {
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+		pmd_t *pmdp = get_pmd(mm->pgdir, la, 0);
+		if (pmdp != NULL && pmd_huge(pmdp)) {
+			la = ROUNDDOWN(la, HPAGE_SIZE) + HPAGE_SIZE - PGSIZE;
+			continue;
+		}
+#endif
+		pte_t *ptep = get_pte(mm->pgdir, la, 0);
+		bool out = 0;
+		if (ptep != NULL && !ptep_invalid(ptep)) {
+			out = !ptep_present(ptep);
+		}
+#ifdef UCONFIG_DEMAND_EXEC
+		else if (vma->exec.node != NULL) {
+			out = (la >= vma->exec.start && la < vma->exec.end);
+		}
+#endif
+		/* an advice, so a failed read is left to the fault */
+		if (out && do_pgfault(mm, 0, la) != 0) {
+			break;
+		}
+	}
+}
+
+/* *
+ * do_madvise - take the advice about the pages of [addr, addr + len) of the
+ * current mm:
+ *   - MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL set how far the faults
+ *     read around a swapped out page, and if reclaim keeps the pages it
+ *     finds accessed, for the whole of each vma of the range;
+ *   - MADV_WILLNEED reads in the pages out in swap, see madvise_willneed;
+ *   - MADV_DONTNEED drops the pages at once, the next touch finds zeros, or
+ *     the shmem or the executable the vma maps;
+ *   - MADV_FREE lets reclaim drop the pages of private anonymous memory
+ *     instead of writing them to swap, unless they are written again.
+ * The advice is taken on the vmas in the range even if it has holes, which
+ * fail it with -E_NO_MEM.
+ * */
 int do_madvise(void *addr, size_t len, int advice)
 {
+	struct mm_struct *mm = current->mm;
+	uintptr_t start = (uintptr_t) addr, end = ROUNDUP(start + len, PGSIZE);
+	if (mm == NULL || start % PGSIZE != 0 || end < start) {
+		return -E_INVAL;
+	}
+	switch (advice) {
+	case MADV_NORMAL:
+	case MADV_RANDOM:
+	case MADV_SEQUENTIAL:
+	case MADV_WILLNEED:
+	case MADV_DONTNEED:
+	case MADV_FREE:
+		break;
+	default:
+		return -E_INVAL;
+	}
+	if (start == end) {
+		return 0;
+	}
+	if (!USER_ACCESS(start, end)) {
+		return -E_INVAL;
+	}
+
+	int ret = 0;
+	struct tlb_gather tlb;
+	lock_mm(mm);
+	tlb_gather_init(&tlb, mm->pgdir);
+	uintptr_t la = start;
+	while (la < end) {
+		struct vma_struct *vma = find_vma_above(mm, la);
+		if (vma == NULL || vma->vm_start >= end) {
+			ret = -E_NO_MEM;
+			break;
+		}
+		if (vma->vm_start > la) {
+			ret = -E_NO_MEM, la = vma->vm_start;
+		}
+		uintptr_t vend = (vma->vm_end < end) ? vma->vm_end : end;
+		switch (advice) {
+		case MADV_NORMAL:
+			vma->vm_flags &= ~(VM_SEQ_READ | VM_RAND_READ);
+			break;
+		case MADV_RANDOM:
+			vma->vm_flags &= ~VM_SEQ_READ;
+			vma->vm_flags |= VM_RAND_READ;
+			break;
+		case MADV_SEQUENTIAL:
+			vma->vm_flags &= ~VM_RAND_READ;
+			vma->vm_flags |= VM_SEQ_READ;
+			break;
+		case MADV_WILLNEED:
+			if (!(vma->vm_flags & VM_IO)) {
+				madvise_willneed(mm, vma, la, vend);
+			}
+			break;
+		case MADV_DONTNEED:
+			if (vma->vm_flags & VM_IO) {
+				ret = -E_INVAL;
+			} else {
+				unmap_range_gather(&tlb, la, vend);
+			}
+			break;
+		case MADV_FREE:
+			if (!vma_private_anon(vma)) {
+				ret = -E_INVAL;
+			} else {
+				lazyfree_range_gather(&tlb, la, vend);
+			}
+			break;
+		}
+		la = vend;
+	}
+	tlb_gather_finish(&tlb);
+	unlock_mm(mm);
+	return ret;
+}
+
+// mm_alloc_page - like pgdir_alloc_page, but place the page as the mempolicy
+//               - of mm says, and charge it to the memory group of mm
+struct Page *mm_alloc_page(struct mm_struct *mm, uintptr_t la, uint32_t perm)
+{
+	struct Page *page = alloc_page_policy(mm, la);
+	if (page != NULL) {
+		clear_page(page2kva(page));
+		if (memcg_charge(mm, page) != 0
+		    || page_insert(mm->pgdir, page, la, perm) != 0) {
+			free_page(page);
+			return NULL;
+		}
+	}
+	return page;
+}
+
+#ifdef UCONFIG_NUMA_POLICY
+
+// do_mempolicy - set the placement policy of the user pages of current mm,
+//              - pages already there stay where they are
+int do_mempolicy(int policy, int node)
+{
+	struct mm_struct *mm = current->mm;
+	if (mm == NULL) {
+		return -E_INVAL;
+	}
+	if (policy == MPOL_BIND) {
+		if (node < 0 || node >= sysconf.lnuma_count) {
+			return -E_INVAL;
+		}
+	} else if (policy != MPOL_LOCAL && policy != MPOL_INTERLEAVE) {
+		return -E_INVAL;
+	}
+	lock_mm(mm);
+	{
+		mm->mempolicy = policy;
+		mm->mempolicy_node = (policy == MPOL_BIND) ? node : 0;
+	}
+	unlock_mm(mm);
+	return 0;
+}
+
+// do_numa_stat - copy the page allocation counters of node to user
+int do_numa_stat(int node, struct numa_stat *stat)
+{
+	struct mm_struct *mm = current->mm;
+	struct numa_stat kstat;
+	if (node < 0 || node >= sysconf.lnuma_count) {
+		return -E_INVAL;
+	}
+	numa_stat_get(node, &kstat);
+	lock_mm_shared(mm);
+	if (!copy_to_user(mm, stat, &kstat, sizeof(struct numa_stat))) {
+		unlock_mm_shared(mm);
+		return -E_INVAL;
+	}
+	unlock_mm_shared(mm);
 	return 0;
 }
 
+// do_numa_info - copy the topology of node to user
+int do_numa_info(int node, struct numa_info *info)
+{
+	struct mm_struct *mm = current->mm;
+	struct numa_info kinfo;
+	if (node < 0 || node >= sysconf.lnuma_count) {
+		return -E_INVAL;
+	}
+	numa_info_get(node, &kinfo);
+	lock_mm_shared(mm);
+	if (!copy_to_user(mm, info, &kinfo, sizeof(struct numa_info))) {
+		unlock_mm_shared(mm);
+		return -E_INVAL;
+	}
+	unlock_mm_shared(mm);
+	return 0;
+}
+#endif
+
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+// huge_pgfault - map the whole huge page around addr if the vma covers it,
+//              - return 0 if it is mapped, or the 4K path should go on
+static int
+huge_pgfault(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr,
+	     pte_perm_t perm)
+{
+	uintptr_t haddr = ROUNDDOWN(addr, HPAGE_SIZE);
+	if (!(vma->vm_flags & VM_HUGEPAGE) || haddr < vma->vm_start
+	    || haddr + HPAGE_SIZE > vma->vm_end) {
+		return -E_INVAL;
+	}
+	pmd_t *pmdp;
+	if ((pmdp = get_pmd(mm->pgdir, haddr, 1)) == NULL) {
+		return -E_NO_MEM;
+	}
+	if (pmd_huge(pmdp)) {
+		/* raced with another thread of mm */
+		return 0;
+	}
+	if (*pmdp != 0) {
+		return -E_EXISTS;
+	}
+	return huge_pmd_map(mm->pgdir, haddr, pmdp, perm);
+}
+
+// do_thp_stat - copy the huge page counters to user
+int do_thp_stat(struct thp_stat *stat)
+{
+	struct mm_struct *mm = current->mm;
+	struct thp_stat kstat;
+	thp_stat_get(&kstat);
+	lock_mm_shared(mm);
+	if (!copy_to_user(mm, stat, &kstat, sizeof(struct thp_stat))) {
+		unlock_mm_shared(mm);
+		return -E_INVAL;
+	}
+	unlock_mm_shared(mm);
+	return 0;
+}
+#endif
+
+#ifdef UCONFIG_FAULT_AROUND
+// fault_around - map the zero page at the empty ptes of the aligned
+//              - FAULT_AROUND_PAGES window around addr, as far as vma goes
+static void
+fault_around(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr,
+	     pte_perm_t perm)
+{
+	uintptr_t start = ROUNDDOWN(addr, FAULT_AROUND_PAGES * PGSIZE);
+	uintptr_t end = start + FAULT_AROUND_PAGES * PGSIZE, la;
+	pte_t *ptep;
+	if (start < vma->vm_start) {
+		start = vma->vm_start;
+	}
+	if (end > vma->vm_end) {
+		end = vma->vm_end;
+	}
+#ifdef UCONFIG_DEMAND_EXEC
+	/* the pages below are read from the file, they are not zero */
+	if (vma->exec.node != NULL && start < ROUNDUP(vma->exec.end, PGSIZE)) {
+		start = ROUNDUP(vma->exec.end, PGSIZE);
+	}
+#endif
+	ptep_unset_u_write(&perm);
+	/* the window never crosses a page table, addr has one already;
+	 * an empty pte is not cached by the tlb, nothing to flush */
+	spinlock_acquire(&(mm->pt_lock));
+	for (la = start; la < end; la += PGSIZE) {
+		if ((ptep = get_pte(mm->pgdir, la, 0)) != NULL && *ptep == 0) {
+			page_ref_inc(zero_page);
+			ptep_map(ptep, page2pa(zero_page));
+			ptep_set_perm(ptep, perm);
+		}
+	}
+	spinlock_release(&(mm->pt_lock));
+}
+#endif
+
+// pgfault_install - map page at addr, unless a fault of another thread
+//                 - changed the pte from orig meanwhile, return 1 then
+static int
+pgfault_install(struct mm_struct *mm, pte_t * ptep, pte_t orig,
+		struct Page *page, uintptr_t addr, pte_perm_t perm)
+{
+	int ret = 1;
+	spinlock_acquire(&(mm->pt_lock));
+	if (*ptep == orig) {
+		ret = page_insert(mm->pgdir, page, addr, perm);
+	}
+	spinlock_release(&(mm->pt_lock));
+	return ret;
+}
+
 int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 {
+	trace_event(TRACE_PAGE_FAULT, addr, error_code);
 	if (mm == NULL) {
 		assert(current != NULL);
 		/* Chen Yuheng 
@@ -903,20 +1522,36 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 		return -E_KILLED;
 	}
 
-	bool need_unlock = 1;
-	if (!try_lock_mm(mm)) {
-		if (current != NULL && mm->locked_by == current->pid) {
-			need_unlock = 0;
-		} else {
-			lock_mm(mm);
-		}
+	/* a fault in a user copy runs under the lock taken by the copier */
+	bool need_unlock = 1, shared = 1;
+	if (current != NULL && mm->locked_by == current->pid) {
+		need_unlock = 0, shared = 0;
+	} else if (current != NULL && mm == current->mm
+		   && (current->flags & PF_MM_SHARED)) {
+		need_unlock = 0;
+	} else {
+		lock_mm_shared(mm);
 	}
 
 	int ret = -E_INVAL;
-	struct vma_struct *vma = find_vma(mm, addr);
+	bool major = 0;		// the page is read in, see rusage.h
+	struct vma_struct *vma;
+#ifdef UCONFIG_BIONIC_LIBC
+retry:
+#endif
+	vma = find_vma(mm, addr);
 	if (vma == NULL || vma->vm_start > addr) {
 		goto failed;
 	}
+#ifdef UCONFIG_BIONIC_LIBC
+	/* the file read of a mapped file page is not safe to race with */
+	if (vma->mfile.file != NULL && shared && need_unlock) {
+		unlock_mm_shared(mm);
+		lock_mm(mm);
+		shared = 0;
+		goto retry;
+	}
+#endif
 	if (vma->vm_flags & VM_STACK) {
 		if (addr < vma->vm_start + PGSIZE) {
 			goto failed;
@@ -960,12 +1595,20 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 #endif
 	addr = ROUNDDOWN(addr, PGSIZE);
 
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+	if ((ret = huge_pgfault(mm, vma, addr, perm)) == 0) {
+		goto failed;
+	}
+#endif
 	ret = -E_NO_MEM;
 
-	pte_t *ptep;
+	pte_t *ptep, orig;
 	if ((ptep = get_pte(mm->pgdir, addr, 1)) == NULL) {
 		goto failed;
 	}
+	/* other threads of mm may fix the same pte meanwhile, see
+	 * pgfault_install */
+	orig = *ptep;
 	if (ptep_invalid(ptep)) {
 #ifdef UCONFIG_BIONIC_LIBC
 		if (vma->mfile.file != NULL) {
@@ -998,6 +1641,7 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 					goto failed;
 				}
 				filestruct_read(file, page2kva(page), PGSIZE);
+				major = 1;
 				if ((ret =
 				     filestruct_setpos(file, old_pos)) != 0) {
 					assert(false);
@@ -1031,10 +1675,57 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 
 		} else
 #endif //UCONFIG_BIONIC_LIBC
+#ifdef UCONFIG_DEMAND_EXEC
+		if (vma->exec.node != NULL && addr < vma->exec.end) {
+			struct Page *page;
+			bool exec_shared;
+			if ((ret =
+			     execmap_page(vma, addr, error_code & 2, &page,
+					  &exec_shared)) != 0) {
+				goto failed;
+			}
+			nperm = perm;
+			if (exec_shared) {
+				/* a write copies it, as with cow */
+				ptep_unset_u_write(&nperm);
+			}
+			ret = pgfault_install(mm, ptep, orig, page, addr, nperm);
+			execmap_put_page(page);
+			if (ret < 0) {
+				goto failed;
+			}
+		} else
+#endif
 		if (!(vma->vm_flags & VM_SHARE)) {
-			if (pgdir_alloc_page(mm->pgdir, addr, perm) == NULL) {
+			struct Page *page;
+#ifdef UCONFIG_FAULT_AROUND
+			if (!(error_code & 2)) {
+				fault_around(mm, vma, addr, perm);
+				goto out;
+			}
+#endif
+#ifdef UCONFIG_PREZERO_PAGES
+			if ((page = alloc_zeroed_page_policy(mm, addr)) == NULL) {
 				goto failed;
 			}
+#else
+			if ((page = alloc_page_policy(mm, addr)) == NULL) {
+				goto failed;
+			}
+			clear_page(page2kva(page));
+#endif
+			if (memcg_charge(mm, page) != 0) {
+				free_page(page);
+				goto failed;
+			}
+			int r = pgfault_install(mm, ptep, orig, page, addr, perm);
+			if (r != 0) {
+				free_page(page);
+				if (r < 0) {
+					goto failed;
+				}
+				goto out;
+			}
 #ifdef UCONFIG_BIONIC_LIBC
 			if (vma->vm_flags & VM_ANONYMOUS) {
 				memset((void *)addr, 0, PGSIZE);
@@ -1052,12 +1743,16 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 			}
 			unlock_shmem(vma->shmem);
 			if (ptep_present(sh_ptep)) {
-				page_insert(mm->pgdir, pa2page(*sh_ptep), addr,
-					    perm);
+				pgfault_install(mm, ptep, orig, pa2page(*sh_ptep),
+						addr, perm);
 			} else {
 #ifdef UCONFIG_SWAP
-				swap_duplicate(*ptep);
-				ptep_copy(ptep, sh_ptep);
+				spinlock_acquire(&(mm->pt_lock));
+				if (*ptep == orig) {
+					swap_duplicate(*ptep);
+					ptep_copy(ptep, sh_ptep);
+				}
+				spinlock_release(&(mm->pt_lock));
 #else
 				panic("NO SWAP\n");
 #endif
@@ -1067,31 +1762,30 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 		struct Page *page, *newpage = NULL;
 		bool cow =
 		    ((vma->vm_flags & (VM_SHARE | VM_WRITE)) == VM_WRITE),
-		    may_copy = 1;
+		    may_copy = 1, copied = 0;
 
-#if 1
 		if (!(!ptep_present(ptep)
 		      || ((error_code & 2) && !ptep_u_write(ptep) && cow))) {
-			//assert(PADDR(mm->pgdir) == rcr3());
-			kprintf("%p %p %d %d %x\n", *ptep, addr, error_code,
-				cow, vma->vm_flags);
-			assert(0);
+			/* fixed by another thread of mm, or a stale tlb entry */
+			ret = 0;
+			goto failed;
 		}
-#endif
 
 		if (cow) {
-			newpage = alloc_page();
+			newpage = alloc_page_policy(mm, addr);
 		}
 		if (ptep_present(ptep)) {
 			page = pte2page(*ptep);
 		} else {
 #ifdef UCONFIG_SWAP
-			if ((ret = swap_in_page(*ptep, &page)) != 0) {
+			if ((ret =
+			     swap_in_page_ra(*ptep, &page, vma->vm_flags)) != 0) {
 				if (newpage != NULL) {
 					free_page(newpage);
 				}
 				goto failed;
 			}
+			major = 1;
 #else
 			assert(0);
 #endif
@@ -1115,10 +1809,14 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 				if (newpage == NULL) {
 					goto failed;
 				}
-				memcpy(page2kva(newpage), page2kva(page),
-				       PGSIZE);
+				if (memcg_charge(mm, newpage) != 0) {
+					free_page(newpage);
+					ret = -E_NO_MEM;
+					goto failed;
+				}
+				copy_page(page2kva(newpage), page2kva(page));
 				//kprintf("COW!\n");
-				page = newpage, newpage = NULL;
+				page = newpage, newpage = NULL, copied = 1;
 			}
 		}
 #ifdef UCONFIG_BIONIC_LIBC
@@ -1146,16 +1844,141 @@ int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr)
 #endif //UCONFIG_BIONIC_LIBC
 		else {
 		}
-		page_insert(mm->pgdir, page, addr, perm);
+		/* a page read back from swap is charged again */
+		if (!copied && (ret = memcg_charge(mm, page)) != 0) {
+			if (newpage != NULL) {
+				free_page(newpage);
+			}
+			goto failed;
+		}
+		if (pgfault_install(mm, ptep, orig, page, addr, perm) != 0
+		    && copied) {
+			free_page(page);
+		}
+#ifdef UCONFIG_SWAP
+		/* read back, reclaim finds it by the rmap from now on */
+		if (major && !copied) {
+			page_add_rmap(page, vma, addr);
+		}
+#endif
 		if (newpage != NULL) {
 			free_page(newpage);
 		}
 	}
+out:
 	ret = 0;
+	if (current != NULL) {
+		if (major) {
+			current->rusage.ru_majflt++;
+		} else {
+			current->rusage.ru_minflt++;
+		}
+	}
 
 failed:
 	if (need_unlock) {
-		unlock_mm(mm);
+		if (shared) {
+			unlock_mm_shared(mm);
+		} else {
+			unlock_mm(mm);
+		}
 	}
 	return ret;
 }
+
+// mm_populate - fault in [start, end) of mm ahead of the first access, as a
+//             - write where the vma allows it; called with mm locked
+void mm_populate(struct mm_struct *mm, uintptr_t start, uintptr_t end)
+{
+	uintptr_t la = ROUNDDOWN(start, PGSIZE);
+	while (la < end) {
+		struct vma_struct *vma = find_vma(mm, la);
+		if (vma == NULL || vma->vm_start > la) {
+			break;
+		}
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+		/* get_pte would split it */
+		pmd_t *pmdp = get_pmd(mm->pgdir, la, 0);
+		if (pmdp != NULL && pmd_huge(pmdp)) {
+			la = ROUNDDOWN(la, HPAGE_SIZE) + HPAGE_SIZE;
+			continue;
+		}
+#endif
+		pte_t *ptep = get_pte(mm->pgdir, la, 0);
+		if (ptep == NULL || ptep_invalid(ptep)) {
+			machine_word_t error_code =
+			    (vma->vm_flags & VM_WRITE) ? 2 : 0;
+			if (do_pgfault(mm, error_code, la) != 0) {
+				break;
+			}
+		}
+		la += PGSIZE;
+	}
+}
+
+// get_user_pages - fault in and pin up to maxpages pages of [addr, addr + len)
+//                - of mm, writable ones if write, so that the caller may
+//                - access them through their kernel address after it unlocks
+//                - mm; called with mm locked, returns the # of pages pinned
+int
+get_user_pages(struct mm_struct *mm, uintptr_t addr, size_t len, bool write,
+	       struct Page **pages, int maxpages)
+{
+	if (mm == NULL || len == 0 || !user_mem_check(mm, addr, len, write)) {
+		return 0;
+	}
+	uintptr_t la = ROUNDDOWN(addr, PGSIZE), end = addr + len;
+	int n = 0;
+	bool faulted = 0;
+	while (la < end && n < maxpages) {
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+		/* get_pte would split it, leave it to the caller */
+		pmd_t *pmdp = get_pmd(mm->pgdir, la, 0);
+		if (pmdp != NULL && pmd_huge(pmdp)) {
+			break;
+		}
+#endif
+		pte_t *ptep = get_pte(mm->pgdir, la, 0);
+		if (ptep == NULL || !ptep_present(ptep)
+		    || (write && !ptep_u_write(ptep))) {
+			/* write, present breaks a copy-on-write share */
+			machine_word_t error_code = (ptep != NULL
+						     && ptep_present(ptep)) ? 3 : 0;
+			if (write) {
+				error_code |= 2;
+			}
+			if (faulted || do_pgfault(mm, error_code, la) != 0) {
+				break;
+			}
+			faulted = 1;
+			continue;
+		}
+		spinlock_acquire(&(mm->pt_lock));
+		struct Page *page = pte2page(*ptep);
+		page_ref_inc(page);
+		spinlock_release(&(mm->pt_lock));
+		pages[n++] = page, la += PGSIZE;
+		faulted = 0;
+	}
+	return n;
+}
+
+// put_user_pages - unpin the pages from get_user_pages, dirty if they have
+//                - been written through their kernel address
+void put_user_pages(struct Page **pages, int npages, bool dirty)
+{
+	int i;
+	for (i = 0; i < npages; i++) {
+		struct Page *page = pages[i];
+		if (PageSwap(page)) {
+			/* the pte dirty bit has missed these writes */
+			if (dirty) {
+				SetPageDirty(page);
+			}
+			page_ref_dec(page);
+		} else if (page_ref_dec(page) == 0) {
+			/* unmapped while pinned */
+			free_page(page);
+		}
+	}
+}
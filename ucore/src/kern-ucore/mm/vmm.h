@@ -5,11 +5,14 @@
 #include <types.h>
 #include <list.h>
 #include <memlayout.h>
-#include <rb_tree.h>
+#include <rb_inline.h>
 #include <sync.h>
 #include <shmem.h>
 #include <atomic.h>
 #include <sem.h>
+#include <rwsem.h>
+#include <mempolicy.h>
+#include <mplimits.h>
 #endif
 
 //pre define
@@ -22,6 +25,18 @@ struct mapped_file_struct {
 };
 #endif //UCONFIG_BIONIC_LIBC
 
+#ifdef UCONFIG_DEMAND_EXEC
+struct inode;
+
+// the part of an executable a vma maps: [start, end) holds the bytes of node
+// from offset on, read in by the faults on them, see execmap.c
+struct vma_exec {
+	struct inode *node;	// NULL if none
+	uintptr_t start, end;
+	off_t offset;
+};
+#endif
+
 // the virtual continuous memory area(vma), [vm_start, vm_end),
 // addr belong to a vma means  vma.vm_start<= addr <vma.vm_end
 struct vma_struct {
@@ -29,13 +44,22 @@ struct vma_struct {
 	uintptr_t vm_start;      // start addr of vma
 	uintptr_t vm_end;        // end addr of vma, not include the vm_end itself
 	uint32_t vm_flags;	// flags of vma
-	rb_node rb_link;	// redblack link which sorted by start addr of vma
+	struct rbi_node rb_link;	// redblack link which sorted by start addr of vma
+	uintptr_t rb_lo, rb_hi;	// the lowest start and highest end in the subtree of rb_link
+	size_t rb_gap;		// and the widest hole between two vmas of it
 	list_entry_t list_link;	// linear list link which sorted by start addr of vma
 	struct shmem_struct *shmem;
 	size_t shmem_off;
+#ifdef UCONFIG_SWAP
+	struct anon_vma *anon_vma;	// of its pages, see rmap.h
+	list_entry_t anon_link;	// in the vma_list of anon_vma
+#endif
 #ifdef UCONFIG_BIONIC_LIBC
 	struct mapped_file_struct mfile;
 #endif				//UCONFIG_BIONIC_LIBC
+#ifdef UCONFIG_DEMAND_EXEC
+	struct vma_exec exec;
+#endif
 };
 
 #define le2vma(le, member)                  \
@@ -51,6 +75,9 @@ struct vma_struct {
 #define VM_SHARE                0x00000010
 
 #define VM_ANONYMOUS			0x00000020
+#define VM_HUGEPAGE             0x00000040	// may be mapped with huge pages
+#define VM_SEQ_READ             0x00000080	// MADV_SEQUENTIAL: read ahead far, reclaim soon
+#define VM_RAND_READ            0x00000100	// MADV_RANDOM: read no more than faulted
 
 /* must the same as Linux */
 #define VM_IO           0x00004000
@@ -62,6 +89,7 @@ struct vma_struct {
 #define MAP_FIXED       0x10	/* Interpret addr exactly */
 #define MAP_ANONYMOUS   0x20	/* don't use a file */
 
+#define MAP_POPULATE	0x8000	/* prefault the whole mapping */
 #define MAP_STACK		0x20000
 
 #define PROT_READ       0x1	/* page can be read */
@@ -74,7 +102,8 @@ struct vma_struct {
 
 struct mm_struct {
 	list_entry_t mmap_list;
-	rb_tree *mmap_tree;
+	struct rbi_root mmap_tree;	// see RB_MIN_MAP_COUNT
+	bool mmap_rb;		// if mmap_tree is in use
 	struct vma_struct *mmap_cache;
 	pgd_t *pgdir;
 #ifdef ARCH_ARM
@@ -85,16 +114,82 @@ struct mm_struct {
 #endif
 	int map_count;
 	uintptr_t swap_address;
+#ifdef UCONFIG_KSM
+	uintptr_t ksm_address;	// where ksmd goes on in this mm
+#endif
 	atomic_t mm_count;
 	int locked_by;
 	uintptr_t brk_start, brk;
+	uintptr_t vvar_addr;	// where the vvar page is mapped, see vdso.c
 	list_entry_t proc_mm_link;
-	semaphore_t mm_sem;
+	rwsem_t mm_rwsem;	// exclusive for vma changes, shared for faults and copies
+	spinlock_s pt_lock;	// orders the pte fixes of faults holding mm_rwsem shared
+#ifdef UCONFIG_NUMA_POLICY
+	int mempolicy;		// MPOL_xxx in mempolicy.h
+	int mempolicy_node;	// the node of MPOL_BIND
+	/* where its pages were placed of late, the scheduler runs it there;
+	 * counted without a lock, a hint */
+	size_t numa_pages[MAX_NUMA_NODES];
+	int numa_preferred;	// the node with the most, -1 before any
+#endif
+#ifdef UCONFIG_MEMCG
+	struct mem_group *memcg;	// what its pages are charged to, see memcg.c
+#endif
+#ifdef UCONFIG_PCID
+	uint64_t tlb_ctx;	// never reused, names the pcid of this mm on each cpu
+#endif
+#ifdef UCONFIG_ARM_ASID
+	uint32_t asid_context;	// generation and ASID, see arch/arm/numa/mp.c
+#endif
 };
 
+#ifdef UCONFIG_NUMA_POLICY
+struct Page *alloc_page_policy(struct mm_struct *mm, uintptr_t la);
+int do_mempolicy(int policy, int node);
+int do_numa_stat(int node, struct numa_stat *stat);
+int do_numa_info(int node, struct numa_info *info);
+#else
+#ifdef UCONFIG_COMPACTION
+#define alloc_page_policy(mm, la)           alloc_page_movable()
+#else
+#define alloc_page_policy(mm, la)           alloc_page()
+#endif
+#endif
+struct Page *mm_alloc_page(struct mm_struct *mm, uintptr_t la, uint32_t perm);
+
+#ifdef UCONFIG_PREZERO_PAGES
+struct Page *alloc_zeroed_page_policy(struct mm_struct *mm, uintptr_t la);
+#endif
+
+#ifdef UCONFIG_FAULT_AROUND
+/* a read fault maps the zero page on up to this many pages around it */
+#define FAULT_AROUND_PAGES 16
+extern struct Page *zero_page;
+#endif
+
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+struct thp_stat;
+int do_thp_stat(struct thp_stat *stat);
+#endif
+
 void lock_mm(struct mm_struct *mm);
 void unlock_mm(struct mm_struct *mm);
 bool try_lock_mm(struct mm_struct *mm);
+void lock_mm_shared(struct mm_struct *mm);
+void unlock_mm_shared(struct mm_struct *mm);
+
+/* *
+ * lock_mm_uaccess - around a copy_to_user or copy_from_user (not writable)
+ * and nothing else: an arch whose copies survive their faults needs no
+ * lock there, the others lock mm shared for the vma check.
+ * */
+#ifdef __HAVE_ARCH_UACCESS_FIXUP
+#define lock_mm_uaccess(mm)             do { } while (0)
+#define unlock_mm_uaccess(mm)           do { } while (0)
+#else
+#define lock_mm_uaccess(mm)             lock_mm_shared(mm)
+#define unlock_mm_uaccess(mm)           unlock_mm_shared(mm)
+#endif
 
 #define le2mm(le, member)                   \
     to_struct((le), struct mm_struct, member)
@@ -123,6 +218,11 @@ uintptr_t get_unmapped_area(struct mm_struct *mm, size_t len);
 int mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len);
 
 int do_pgfault(struct mm_struct *mm, machine_word_t error_code, uintptr_t addr);
+void mm_populate(struct mm_struct *mm, uintptr_t start, uintptr_t end);
+int do_madvise(void *addr, size_t len, int advice);
+int get_user_pages(struct mm_struct *mm, uintptr_t addr, size_t len,
+		   bool write, struct Page **pages, int maxpages);
+void put_user_pages(struct Page **pages, int npages, bool dirty);
 bool user_mem_check(struct mm_struct *mm, uintptr_t start, size_t len,
 		    bool write);
 
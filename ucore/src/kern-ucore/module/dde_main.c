@@ -25,10 +25,13 @@
 #include <linux/init.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
+#include <linux/device.h>
+#include <linux/dmapool.h>
 
 #define __NO_UCORE_TYPE__
 #include <module.h>
 #include <kio.h>
+#include <pmm_glue.h>
 //#include <assert.h>
 
 #ifdef __DEBUG
@@ -445,19 +448,55 @@ void *dma_mark_declared_memory_occupied(struct device *dev,
 	return ERR_PTR(-EBUSY);
 }
 
+/* physically contiguous, from the region of dma.c; the boards have no
+ * uncached mapping for them, the lines are flushed before the device
+ * gets the buffer */
 void *dma_alloc_coherent(struct device *dev, size_t size,
 			 dma_addr_t * dma_handle, gfp_t flag)
 {
-	//        return pci_alloc_consistent(to_pci_dev(dev), size, dma_handle);
-	panic("TODO");
-	return NULL;
+	unsigned long paddr;
+	void *ret = ucore_dma_alloc(size, &paddr);
+	if (!ret)
+		return NULL;
+	memset(ret, 0, size);
+	ucore_dcache_flush_range(ret, size);
+	*dma_handle = paddr;
+	return ret;
 }
 
 void
 dma_free_coherent(struct device *dev, size_t size, void *cpu_addr,
 		  dma_addr_t dma_handle)
 {
-	printk(KERN_ALERT "TODO %s\n", __func__);
+	ucore_dma_free(cpu_addr, size);
+}
+
+/* the pools of dma.c, the blocks of which come from contiguous pages */
+struct dma_pool *dma_pool_create(const char *name, struct device *dev,
+				 size_t size, size_t align, size_t allocation)
+{
+	return ucore_dma_pool_create(name, size, align, allocation);
+}
+
+void dma_pool_destroy(struct dma_pool *pool)
+{
+	ucore_dma_pool_destroy(pool);
+}
+
+void *dma_pool_alloc(struct dma_pool *pool, gfp_t mem_flags,
+		     dma_addr_t * handle)
+{
+	unsigned long paddr;
+	void *ret = ucore_dma_pool_alloc(pool, &paddr);
+	if (!ret)
+		return NULL;
+	*handle = paddr;
+	return ret;
+}
+
+void dma_pool_free(struct dma_pool *pool, void *vaddr, dma_addr_t addr)
+{
+	ucore_dma_pool_free(pool, vaddr);
 }
 
 /* console */
@@ -560,8 +599,10 @@ int remap_pfn_range(struct vm_area_struct *vma, unsigned long addr,
 	if (vma->vm_start != addr || vma->vm_end != addr + size)
 		return -EINVAL;
 	vma->vm_pgoff = pfn;
-	//TODO
-	void *r = ucore_map_pfn_range(addr, pfn, size, VM_IO);
+	unsigned long flags = UCORE_MAP_IO;
+	if ((pgprot_val(prot) & L_PTE_MT_MASK) == L_PTE_MT_BUFFERABLE)
+		flags |= UCORE_MAP_WC;
+	void *r = ucore_map_pfn_range(addr, pfn, size, flags);
 	if (!r) {
 		return -ENOMEM;
 	}
@@ -20,6 +20,9 @@
 #include <linux/major.h>
 #include <linux/device.h>
 #include <linux/wakelock.h>
+#include <linux/mm.h>
+#include <wait_glue.h>
+#include <pmm_glue.h>
 #include "input-compat.h"
 
 struct evdev {
@@ -40,6 +43,11 @@ struct evdev_client {
 	struct input_event buffer[EVDEV_BUFFER_SIZE];
 	int head;
 	int tail;
+	int frame;		/* the start of the frame not reported yet */
+	int last_frame;		/* the start of the last frame if unread, or -1 */
+	struct input_event_ring *ring;	/* mapped by the reader, or NULL */
+	__u32 ring_head;	/* the end of the frame being put in ring */
+	bool ring_drop;		/* the frame being put has no room in ring */
 	spinlock_t buffer_lock;	/* protects access to buffer, head and tail */
 	struct fasync_struct *fasync;
 	struct evdev *evdev;
@@ -51,6 +59,117 @@ struct evdev_client {
 static struct evdev *evdev_table[EVDEV_MINORS];
 static DEFINE_MUTEX(evdev_table_mutex);
 
+static inline bool evdev_is_report(struct input_event *event)
+{
+	return event->type == EV_SYN && event->code == SYN_REPORT;
+}
+
+/*
+ * A frame of motion only, on the same axes in the same order as the last
+ * frame the reader has not started on, is folded into that one: the
+ * absolute values replace the old ones and the relative ones add up. So a
+ * reader behind a fast touchscreen gets the latest position rather than
+ * every sample on the way. report is the SYN_REPORT ending the new frame.
+ */
+static bool evdev_coalesce(struct evdev_client *client,
+			   struct input_event *report)
+{
+	int n = (client->head - client->frame) & (EVDEV_BUFFER_SIZE - 1);
+	int last = client->last_frame;
+	int i;
+
+	if (last < 0 || n == 0 ||
+	    ((client->frame - last) & (EVDEV_BUFFER_SIZE - 1)) != n + 1)
+		return false;
+
+	for (i = 0; i < n; i++) {
+		struct input_event *old =
+		    &client->buffer[(last + i) & (EVDEV_BUFFER_SIZE - 1)];
+		struct input_event *new =
+		    &client->buffer[(client->frame + i) & (EVDEV_BUFFER_SIZE - 1)];
+
+		if (old->type != new->type || old->code != new->code)
+			return false;
+		if (new->type != EV_ABS && new->type != EV_REL &&
+		    !(new->type == EV_SYN && new->code == SYN_MT_REPORT))
+			return false;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct input_event *old =
+		    &client->buffer[(last + i) & (EVDEV_BUFFER_SIZE - 1)];
+		struct input_event *new =
+		    &client->buffer[(client->frame + i) & (EVDEV_BUFFER_SIZE - 1)];
+
+		if (new->type == EV_REL)
+			old->value += new->value;
+		else
+			old->value = new->value;
+		old->time = new->time;
+	}
+	client->buffer[(last + n) & (EVDEV_BUFFER_SIZE - 1)] = *report;
+	client->head = client->frame;
+	return true;
+}
+
+static void evdev_buffer_put(struct evdev_client *client,
+			     struct input_event *event)
+{
+	bool report = evdev_is_report(event);
+
+	if (report && evdev_coalesce(client, event))
+		return;
+
+	client->buffer[client->head++] = *event;
+	client->head &= EVDEV_BUFFER_SIZE - 1;
+
+	if (unlikely(client->head == client->tail)) {
+		/*
+		 * The reader is too slow: drop all it has not read but
+		 * this event, and tell it so by SYN_DROPPED.
+		 */
+		client->tail = (client->head - 2) & (EVDEV_BUFFER_SIZE - 1);
+		client->buffer[client->tail].time = event->time;
+		client->buffer[client->tail].type = EV_SYN;
+		client->buffer[client->tail].code = SYN_DROPPED;
+		client->buffer[client->tail].value = 0;
+		client->frame = (client->head - 1) & (EVDEV_BUFFER_SIZE - 1);
+		client->last_frame = -1;
+	}
+
+	if (report) {
+		client->last_frame = client->frame;
+		client->frame = client->head;
+	}
+}
+
+/* the frame is published at its SYN_REPORT, or dropped whole */
+static void evdev_ring_put(struct evdev_client *client,
+			   struct input_event *event)
+{
+	struct input_event_ring *ring = client->ring;
+	__u32 tail = ACCESS_ONCE(ring->tail);
+
+	if (!client->ring_drop) {
+		/* a tail the reader put past head is as good as full */
+		if (client->ring_head - tail >= ring->size)
+			client->ring_drop = true;
+		else
+			ring->events[client->ring_head++ % ring->size] = *event;
+	}
+
+	if (evdev_is_report(event)) {
+		if (client->ring_drop) {
+			ring->dropped++;
+			client->ring_drop = false;
+			client->ring_head = ring->head;
+		} else {
+			smp_wmb();
+			ring->head = client->ring_head;
+		}
+	}
+}
+
 static void evdev_pass_event(struct evdev_client *client,
 			     struct input_event *event)
 {
@@ -59,8 +178,10 @@ static void evdev_pass_event(struct evdev_client *client,
 	 */
 	spin_lock(&client->buffer_lock);
 	wake_lock_timeout(&client->wake_lock, 5 * HZ);
-	client->buffer[client->head++] = *event;
-	client->head &= EVDEV_BUFFER_SIZE - 1;
+	if (client->ring)
+		evdev_ring_put(client, event);
+	else
+		evdev_buffer_put(client, event);
 	spin_unlock(&client->buffer_lock);
 
 	kill_fasync(&client->fasync, SIGIO, POLL_IN);
@@ -95,7 +216,9 @@ static void evdev_event(struct input_handle *handle,
 
 	rcu_read_unlock();
 
-	wake_up_interruptible(&evdev->wait);
+	/* the readers take whole frames, wake them once per frame */
+	if (evdev_is_report(&event))
+		wake_up_interruptible(&evdev->wait);
 }
 
 static int evdev_fasync(int fd, struct file *file, int on)
@@ -131,6 +254,7 @@ static void evdev_free(struct device *dev)
 {
 	struct evdev *evdev = container_of(dev, struct evdev, dev);
 
+	ucore_wait_unbind(&evdev->wait);
 	input_put_device(evdev->handle.dev);
 	kfree(evdev);
 }
@@ -244,6 +368,8 @@ static int evdev_release(struct inode *inode, struct file *file)
 
 	evdev_detach_client(evdev, client);
 	wake_lock_destroy(&client->wake_lock);
+	if (client->ring)
+		ucore_shared_page_put(client->ring);
 	kfree(client);
 
 	evdev_close_device(evdev);
@@ -280,6 +406,7 @@ static int evdev_open(struct inode *inode, struct file *file)
 	}
 
 	spin_lock_init(&client->buffer_lock);
+	client->last_frame = -1;
 	snprintf(client->name, sizeof(client->name), "%s-%d", evdev->name,
 		 task_tgid_vnr(current));
 	wake_lock_init(&client->wake_lock, WAKE_LOCK_SUSPEND, client->name);
@@ -342,8 +469,10 @@ static int evdev_fetch_next_event(struct evdev_client *client,
 
 	spin_lock_irq(&client->buffer_lock);
 
-	have_event = client->head != client->tail;
+	have_event = client->frame != client->tail;
 	if (have_event) {
+		if (client->tail == client->last_frame)
+			client->last_frame = -1;
 		*event = client->buffer[client->tail++];
 		client->tail &= EVDEV_BUFFER_SIZE - 1;
 		if (client->head == client->tail)
@@ -363,22 +492,18 @@ static ssize_t evdev_read(struct file *file, char __user * buffer,
 	struct input_event event;
 	int retval;
 
-	if (count < input_event_size())
+	if (count < input_event_size() || client->ring)
 		return -EINVAL;
 
-	if (client->head == client->tail && evdev->exist &&
+	if (client->frame == client->tail && evdev->exist &&
 	    (file->f_flags & O_NONBLOCK))
 		return -EAGAIN;
 
-#if 0
-	retval = wait_event_interruptible(evdev->wait,
-					  client->head != client->tail
-					  || !evdev->exist);
+	retval = ucore_wait_event_interruptible(evdev->wait,
+						client->frame != client->tail
+						|| !evdev->exist);
 	if (retval)
 		return retval;
-#else
-	retval = 0;
-#endif
 
 	if (!evdev->exist)
 		return -ENODEV;
@@ -401,11 +526,62 @@ static unsigned int evdev_poll(struct file *file, poll_table * wait)
 	struct evdev_client *client = file->private_data;
 	struct evdev *evdev = client->evdev;
 
+	bool ready;
+
 	poll_wait(file, &evdev->wait, wait);
-	return ((client->head == client->tail) ? 0 : (POLLIN | POLLRDNORM)) |
+	if (client->ring)
+		ready = ACCESS_ONCE(client->ring->head) !=
+		    ACCESS_ONCE(client->ring->tail);
+	else
+		ready = client->frame != client->tail;
+	return (ready ? (POLLIN | POLLRDNORM) : 0) |
 	    (evdev->exist ? 0 : (POLLHUP | POLLERR));
 }
 
+/*
+ * Map the ring of the client, see struct input_event_ring. The events go
+ * to the ring from then on, and read() is refused.
+ */
+static int evdev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct evdev_client *client = file->private_data;
+	struct evdev *evdev = client->evdev;
+	struct input_event_ring *ring;
+	int retval;
+
+	if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+
+	retval = mutex_lock_interruptible(&evdev->mutex);
+	if (retval)
+		return retval;
+
+	ring = client->ring;
+	if (!ring) {
+		ring = ucore_shared_page_alloc();
+		if (!ring) {
+			retval = -ENOMEM;
+			goto out;
+		}
+		ring->size = (PAGE_SIZE - sizeof(struct input_event_ring)) /
+		    sizeof(struct input_event);
+
+		spin_lock_irq(&client->buffer_lock);
+		client->head = client->tail = client->frame = 0;
+		client->last_frame = -1;
+		client->ring_head = 0;
+		client->ring_drop = false;
+		client->ring = ring;
+		spin_unlock_irq(&client->buffer_lock);
+	}
+
+	retval = remap_pfn_range(vma, vma->vm_start, ucore_kva_to_pfn(ring),
+				 PAGE_SIZE, vma->vm_page_prot);
+out:
+	mutex_unlock(&evdev->mutex);
+	return retval;
+}
+
 #ifdef CONFIG_COMPAT
 
 #define BITS_PER_LONG_COMPAT (sizeof(compat_long_t) * 8)
@@ -785,6 +961,7 @@ static const struct file_operations evdev_fops = {
 	.read = evdev_read,
 	.write = evdev_write,
 	.poll = evdev_poll,
+	.mmap = evdev_mmap,
 	.open = evdev_open,
 	.release = evdev_release,
 	.unlocked_ioctl = evdev_ioctl,
@@ -887,6 +1064,10 @@ static int evdev_connect(struct input_handler *handler, struct input_dev *dev,
 	evdev->dev.release = evdev_free;
 	device_initialize(&evdev->dev);
 
+	error = ucore_wait_bind(&evdev->wait);
+	if (error)
+		goto err_free_evdev;
+
 	error = input_register_handle(&evdev->handle);
 	if (error)
 		goto err_free_evdev;
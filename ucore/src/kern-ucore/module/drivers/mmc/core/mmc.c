@@ -150,6 +150,13 @@ static int mmc_decode_csd(struct mmc_card *card)
 	csd->write_blkbits = UNSTUFF_BITS(resp, 22, 4);
 	csd->write_partial = UNSTUFF_BITS(resp, 21, 1);
 
+	if (csd->write_blkbits >= 9) {
+		u8 a = UNSTUFF_BITS(resp, 42, 5);	/* ERASE_GRP_SIZE */
+		u8 b = UNSTUFF_BITS(resp, 37, 5);	/* ERASE_GRP_MULT */
+		csd->erase_size = (a + 1) * (b + 1);
+		csd->erase_size <<= csd->write_blkbits - 9;
+	}
+
 	return 0;
 }
 
@@ -432,6 +432,7 @@ void cfb_copyarea(struct fb_info *p, const struct fb_copyarea *area)
 			src_idx += bits_per_line;
 		}
 	}
+	fb_flush_damage(p, area->dx, area->dy, area->width, area->height);
 }
 
 EXPORT_SYMBOL(cfb_copyarea);
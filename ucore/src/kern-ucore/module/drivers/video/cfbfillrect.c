@@ -365,6 +365,7 @@ void cfb_fillrect(struct fb_info *p, const struct fb_fillrect *rect)
 			dst_idx += p->fix.line_length * 8;
 		}
 	}
+	fb_flush_damage(p, rect->dx, rect->dy, rect->width, rect->height);
 }
 
 EXPORT_SYMBOL(cfb_fillrect);
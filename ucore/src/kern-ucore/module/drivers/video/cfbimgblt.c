@@ -315,6 +315,7 @@ void cfb_imageblit(struct fb_info *p, const struct fb_image *image)
 				       start_index, pitch_index);
 	} else
 		color_imageblit(image, p, dst1, start_index, pitch_index);
+	fb_flush_damage(p, dx, dy, width, image->height);
 }
 
 EXPORT_SYMBOL(cfb_imageblit);
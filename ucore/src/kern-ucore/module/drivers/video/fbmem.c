@@ -33,6 +33,7 @@
 #include <linux/device.h>
 #include <linux/efi.h>
 #include <linux/fb.h>
+#include <linux/dma-mapping.h>
 
 #include <asm/fb.h>
 
@@ -760,6 +761,49 @@ fb_read(struct file *file, char __user * buf, size_t count, loff_t * ppos)
 	return (err) ? err : cnt;
 }
 
+/*
+ * fb_flush_range - write the bytes [off, off + len) of the screen back
+ * from the cpu cache, for the display to scan them out
+ */
+static void fb_flush_range(struct fb_info *info, unsigned long off,
+			   unsigned long len)
+{
+	unsigned long total_size = info->screen_size;
+
+	if (total_size == 0)
+		total_size = info->fix.smem_len;
+	if (off >= total_size)
+		return;
+	if (len > total_size - off)
+		len = total_size - off;
+	dma_cache_maint((void __force *)info->screen_base + off, len,
+			DMA_TO_DEVICE);
+}
+
+/*
+ * fb_flush_damage - the same for a rectangle of pixels just drawn: the
+ * bytes of its rows only, or one range when it spans whole lines
+ */
+void fb_flush_damage(struct fb_info *info, u32 x, u32 y, u32 width,
+		     u32 height)
+{
+	u32 line = info->fix.line_length, bpp = info->var.bits_per_pixel;
+	unsigned long off, row;
+
+	if (!info->screen_base || !line || !width || !height)
+		return;
+	off = y * line + (x * bpp) / 8;
+	row = ((x + width) * bpp + 7) / 8 - (x * bpp) / 8;
+	if (row >= line) {
+		fb_flush_range(info, y * line, height * line);
+		return;
+	}
+	for (; height--; off += line)
+		fb_flush_range(info, off, row);
+}
+
+EXPORT_SYMBOL(fb_flush_damage);
+
 static ssize_t
 fb_write(struct file *file, const char __user * buf, size_t count,
 	 loff_t * ppos)
@@ -840,6 +884,7 @@ fb_write(struct file *file, const char __user * buf, size_t count,
 	}
 
 	kfree(buffer);
+	fb_flush_range(info, p, cnt);
 
 	return (cnt) ? cnt : err;
 }
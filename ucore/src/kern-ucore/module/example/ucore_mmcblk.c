@@ -22,6 +22,7 @@
 #include <linux/mmc/mmc.h>
 
 #include <linux/scatterlist.h>
+#include <linux/uio.h>		/* the same struct iovec as ucore's */
 
 //ucore
 #include <ide.h>
@@ -38,6 +39,9 @@
 #define MAX_PARTITIONS 4
 #define MAX_LABEL_LEN  31
 
+/* # of scatterlist entries one request of mmc_disk_rw_secsv has at most */
+#define MMC_UCORE_MAX_SEGS	32
+
 //////////////////////////////
 
 struct mmc_ucore_card {
@@ -235,24 +239,68 @@ static int mmc_test_simple_transfer(struct mmc_ucore_card *test,
 
 	mmc_wait_for_req(test->card->host, &mrq);
 
-	mmc_test_wait_busy(test);
+	/* only a write leaves the card programming after the data */
+	if (write)
+		mmc_test_wait_busy(test);
 
 	return mmc_test_check_result(test, &mrq);
 }
 
+/*
+ * Transfer the sectors from secno on to or from the iovcnt buffers of iov
+ * with as few commands as the host takes: each one is a CMD18/CMD25 for
+ * as many buffers as fit in max_hw_segs entries, max_req_size bytes and
+ * max_blk_count blocks, which the host moves by DMA if it can.
+ */
+static int mmc_disk_rw_secsv(struct ide_device *dev, unsigned long secno,
+			     const struct iovec *iov, int iovcnt, int wr)
+{
+	struct mmc_ucore_card *ucard = (struct mmc_ucore_card *)dev->dev_data;
+	struct mmc_card *card = ucard->card;
+	struct mmc_host *host = card->host;
+	struct scatterlist sg[MMC_UCORE_MAX_SEGS];
+	unsigned int max_segs, max_bytes, max_seg;
+	size_t off = 0;
+	int i = 0, ret;
+
+	max_segs = min_t(unsigned int, host->max_hw_segs, MMC_UCORE_MAX_SEGS);
+	max_bytes = min_t(unsigned int, host->max_req_size,
+			  host->max_blk_count * 512) & ~511;
+	max_seg = host->max_seg_size & ~511;
+	if (max_segs == 0)
+		max_segs = 1;
+	BUG_ON(max_bytes == 0 || max_seg == 0);
+
+	while (i < iovcnt) {
+		unsigned int n = 0, bytes = 0;
+		sg_init_table(sg, max_segs);
+		while (i < iovcnt && n < max_segs && bytes < max_bytes) {
+			size_t len = iov[i].iov_len - off;
+			len = min_t(size_t, len, max_bytes - bytes);
+			len = min_t(size_t, len, max_seg);
+			sg_set_buf(sg + n, (char *)iov[i].iov_base + off, len);
+			n++, bytes += len, off += len;
+			if (off == iov[i].iov_len)
+				i++, off = 0;
+		}
+		sg_mark_end(sg + n - 1);
+		ret = mmc_test_simple_transfer(ucard, sg, n,
+					       mmc_card_blockaddr(card) ?
+					       secno : secno << 9,
+					       bytes / 512, 512, wr);
+		if (ret)
+			return ret;
+		secno += bytes / 512;
+	}
+	return 0;
+}
+
 static int mmc_disk_do_io(struct ide_device *dev, unsigned long secno,
 			  void *dst, unsigned long nsecs, int wr)
 {
-	struct mmc_ucore_card *ucard = (struct mmc_ucore_card *)dev->dev_data;
-	int ret = 0;
-	struct scatterlist sg;
+	struct iovec iov = { dst, nsecs * 512 };
 	//pr_debug("mmc_disk_%s: secno %d, nsces %d\n", wr?"write":"read", secno, nsecs);
-	sg_init_one(&sg, dst, nsecs * 512);
-	ret =
-	    mmc_test_simple_transfer(ucard, &sg, 1, secno << 9, nsecs, 512, wr);
-	if (ret)
-		return ret;
-	return 0;
+	return mmc_disk_rw_secsv(dev, secno, &iov, 1, wr);
 }
 
 static int mmc_disk_read(struct ide_device *dev, unsigned long secno, void *dst,
@@ -264,7 +312,7 @@ static int mmc_disk_read(struct ide_device *dev, unsigned long secno, void *dst,
 static int mmc_disk_write(struct ide_device *dev, unsigned long secno,
 			  const void *src, unsigned long nsecs)
 {
-	return mmc_disk_do_io(dev, secno, src, nsecs, 1);
+	return mmc_disk_do_io(dev, secno, (void *)src, nsecs, 1);
 }
 
 static void mmc_disk_init(struct ide_device *dev)
@@ -293,11 +341,14 @@ static void __init_mmc_ide_device(struct ide_device *dev)
 		 */
 		dev->lba = card->csd.capacity << (card->csd.read_blkbits - 9);
 	}
-	printk("ucore_mmcblk: lba: %d\n", dev->lba);
+	dev->erase_size = card->csd.erase_size;
+	printk("ucore_mmcblk: lba: %d, erase size: %d\n", dev->lba,
+	       dev->erase_size);
 	strcpy(dev->model, "mmcblk");
 	dev->init = mmc_disk_init;
 	dev->read_secs = mmc_disk_read;
 	dev->write_secs = mmc_disk_write;
+	dev->rw_secsv = mmc_disk_rw_secsv;
 }
 
 static int ucore_mmcblk_probe(struct mmc_card *card)
@@ -937,6 +937,8 @@ extern int fb_blank(struct fb_info *info, int blank);
 extern void cfb_fillrect(struct fb_info *info, const struct fb_fillrect *rect);
 extern void cfb_copyarea(struct fb_info *info, const struct fb_copyarea *area);
 extern void cfb_imageblit(struct fb_info *info, const struct fb_image *image);
+extern void fb_flush_damage(struct fb_info *info, u32 x, u32 y, u32 width,
+			    u32 height);
 /*
  * Drawing operations where framebuffer is in system RAM
  */
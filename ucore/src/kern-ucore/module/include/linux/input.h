@@ -30,6 +30,21 @@ struct input_event {
 	__s32 value;
 };
 
+/*
+ * The ring of an evdev client, mapped by an mmap() of one page at offset 0.
+ * The kernel puts the events at events[head % size] and moves head past
+ * whole frames, SYN_REPORT included; the reader takes the events up to
+ * head and moves tail past them. A frame with no room is dropped whole,
+ * and counted in dropped.
+ */
+struct input_event_ring {
+	__u32 head;
+	__u32 tail;
+	__u32 size;
+	__u32 dropped;
+	struct input_event events[0];
+};
+
 /*
  * Protocol version.
  */
@@ -107,6 +122,7 @@ struct input_absinfo {
 #define SYN_REPORT		0
 #define SYN_CONFIG		1
 #define SYN_MT_REPORT		2
+#define SYN_DROPPED		3
 
 /*
  * Keys and buttons
@@ -33,6 +33,7 @@ struct mmc_csd {
 	unsigned int read_blkbits;
 	unsigned int write_blkbits;
 	unsigned int capacity;
+	unsigned int erase_size;	/* in 512-byte sectors */
 	unsigned int read_partial:1,
 	    read_misalign:1, write_partial:1, write_misalign:1;
 };
@@ -21,6 +21,25 @@
 
 #define UCORE_KAP_IO 0x00000001
 
+/* flags of ucore_map_pfn_range */
+#define UCORE_MAP_IO 0x00000001
+#define UCORE_MAP_WC 0x00000002	/* write-combined, see fb_pgprotect */
+
 extern void *ucore_kva_alloc_pages(size_t n, unsigned int flags);
+extern void ucore_dcache_clean_range(const void *kaddr, size_t size);
+extern void ucore_dcache_inv_range(const void *kaddr, size_t size);
+extern void ucore_dcache_flush_range(const void *kaddr, size_t size);
+extern void *ucore_shared_page_alloc(void);
+extern void ucore_shared_page_put(void *kaddr);
+extern unsigned long ucore_kva_to_pfn(const void *kaddr);
+extern void *ucore_dma_alloc(size_t size, unsigned long *paddr);
+extern void ucore_dma_free(void *kaddr, size_t size);
+extern void *ucore_dma_pool_create(const char *name, size_t size,
+				   size_t align, size_t boundary);
+extern void ucore_dma_pool_destroy(void *pool);
+extern void *ucore_dma_pool_alloc(void *pool, unsigned long *paddr);
+extern void ucore_dma_pool_free(void *pool, void *kaddr);
+extern void *ucore_map_pfn_range(unsigned long addr, unsigned long pfn,
+				 unsigned long size, unsigned long flags);
 
 #endif
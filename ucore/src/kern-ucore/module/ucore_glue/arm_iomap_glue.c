@@ -19,6 +19,7 @@
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/dma-mapping.h>
+#include <linux/scatterlist.h>
 
 #include <mach/hardware.h>
 #include <asm/io.h>
@@ -78,6 +79,27 @@ void *dma_alloc_writecombine(struct device *dev, size_t size,
 	return cpuaddr;
 }
 
+/*
+ * dma_cache_maint - by the lines of the buffer only: clean the ones a
+ * device is to read, drop the ones it writes to, and both for a buffer
+ * it does both with
+ */
+void dma_cache_maint(const void *kaddr, size_t size, int dir)
+{
+	switch (dir) {
+	case DMA_TO_DEVICE:
+		ucore_dcache_clean_range(kaddr, size);
+		break;
+	case DMA_FROM_DEVICE:
+		ucore_dcache_inv_range(kaddr, size);
+		break;
+	default:
+		ucore_dcache_flush_range(kaddr, size);
+	}
+}
+
+EXPORT_SYMBOL(dma_cache_maint);
+
 /**
  * dma_map_sg - map a set of SG buffers for streaming mode DMA
  * @dev: valid struct device pointer, or NULL for ISA and EISA-like devices
@@ -115,6 +137,10 @@ bad_mapping:
 	return 0;
 #endif
 	//printk("TODO %s\n", __func__);
+	struct scatterlist *s;
+	int i;
+	for_each_sg(sg, s, nents, i)
+	    dma_cache_maint(sg_virt(s), s->length, dir);
 	return nents;
 }
 
@@ -140,6 +166,13 @@ void dma_unmap_sg(struct device *dev, struct scatterlist *sg, int nents,
 	for_each_sg(sg, s, nents, i)
 	    dma_unmap_page(dev, sg_dma_address(s), sg_dma_len(s), dir);
 #endif
+	/* the lines the cpu may have fetched again while the device wrote */
+	struct scatterlist *s;
+	int i;
+	if (dir != DMA_TO_DEVICE) {
+		for_each_sg(sg, s, nents, i)
+		    dma_cache_maint(sg_virt(s), s->length, DMA_FROM_DEVICE);
+	}
 }
 
 EXPORT_SYMBOL(dma_unmap_sg);
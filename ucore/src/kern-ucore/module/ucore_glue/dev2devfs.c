@@ -28,6 +28,7 @@
 #include <kio.h>
 #include <stat.h>
 #include <error.h>
+#include <poll.h>
 
 extern const struct file_operations def_chr_fops;
 
@@ -47,6 +48,11 @@ extern int __ucore_linux_inode_fops_stub_write(struct device *dev,
 extern int __ucore_linux_inode_fops_stub_mmap2(struct device *dev, void *addr,
 					       size_t len, int unused1,
 					       int unused2, size_t pgoff);
+extern int __ucore_linux_inode_fops_stub_poll(struct device *dev,
+					      unsigned int *mask_store,
+					      void **key_store);
+/* in wait_helper.c */
+extern poll_head_t *__ucore_wait_poll_head(const void *key);
 
 static int
 __ucore_vfs_device_caller_io(struct device *dev, struct iobuf *iob, bool write)
@@ -55,6 +61,28 @@ __ucore_vfs_device_caller_io(struct device *dev, struct iobuf *iob, bool write)
 	return -E_INVAL;
 }
 
+// __ucore_vfs_device_caller_ioctl - IOCTL_POLL, for epoll: the poll of the
+//                                 - Linux driver, its POLLxxx are EPOLLxxx,
+//                                 - and the head of the queue it polls on
+static int
+__ucore_vfs_device_caller_ioctl(struct device *dev, int op, void *data)
+{
+	if (op == IOCTL_POLL) {
+		struct poll_query *q = data;
+		unsigned int mask;
+		void *key;
+		int ret;
+		if ((ret = __ucore_linux_inode_fops_stub_poll(dev, &mask, &key))
+		    != 0) {
+			return ret;
+		}
+		q->events = mask & (EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLHUP);
+		q->head = __ucore_wait_poll_head(key);
+		return 0;
+	}
+	return -E_INVAL;
+}
+
 static void
 __ucore_vfs_device_init(struct device *dev, dev_t devno, mode_t mode)
 {
@@ -71,6 +99,7 @@ __ucore_vfs_device_init(struct device *dev, dev_t devno, mode_t mode)
 	dev->d_open = __ucore_linux_inode_fops_stub_open;
 	dev->d_close = __ucore_linux_inode_fops_stub_close;
 	dev->d_io = __ucore_vfs_device_caller_io;
+	dev->d_ioctl = __ucore_vfs_device_caller_ioctl;
 
 	/* linux */
 	dev->d_linux_write = __ucore_linux_inode_fops_stub_write;
@@ -18,6 +18,7 @@
 
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/poll.h>
 
 #define __NO_UCORE_TYPE__
 #define __NO_UCORE_DEVICE__
@@ -70,6 +71,8 @@ int __ucore_linux_inode_fops_stub_open(struct ucore_device *dev,
 		return -ENOMEM;
 	struct inode *node = d->d_inode;
 	struct file *file = (struct file *)dev->linux_file;
+	/* the O_NONBLOCK of ucore is the one of Linux */
+	file->f_flags = open_flags & O_NONBLOCK;
 	//kprintf("### f->fop %08x\n", file->f_op);
 	if (!node->i_fop->open)
 		return ret;
@@ -149,3 +152,36 @@ void *__ucore_linux_inode_fops_stub_mmap2(struct ucore_device *dev, void *addr,
 	//kprintf("## dd %08x\n", r);
 	return r;
 }
+
+struct __ucore_poll_table {
+	poll_table pt;
+	wait_queue_head_t *key;
+};
+
+static void __ucore_poll_qproc(struct file *file, wait_queue_head_t * q,
+			       poll_table * pt)
+{
+	struct __ucore_poll_table *t =
+	    container_of(pt, struct __ucore_poll_table, pt);
+	if (!t->key)
+		t->key = q;
+}
+
+/* the mask of the poll of the driver, and the first queue it polls on;
+ * a driver without poll is always ready, as in Linux */
+int __ucore_linux_inode_fops_stub_poll(struct ucore_device *dev,
+				       unsigned int *mask_store,
+				       void **key_store)
+{
+	struct __ucore_poll_table t;
+	struct file *file = (struct file *)dev->linux_file;
+	assert(file);
+	init_poll_funcptr(&t.pt, __ucore_poll_qproc);
+	t.key = NULL;
+	if (file->f_op && file->f_op->poll)
+		*mask_store = file->f_op->poll(file, &t.pt);
+	else
+		*mask_store = DEFAULT_POLLMASK;
+	*key_store = t.key;
+	return 0;
+}
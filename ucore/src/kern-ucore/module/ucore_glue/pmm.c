@@ -20,6 +20,7 @@
 #include <vmm.h>
 #include <proc.h>
 #include <assert.h>
+#include <dma.h>
 
 void *ucore_kva_alloc_pages(size_t n, unsigned int flags)
 {
@@ -34,15 +35,95 @@ void *ucore_kva_alloc_pages(size_t n, unsigned int flags)
 	return page2kva(pages);
 }
 
+/* a zeroed page a driver maps to user space by remap_pfn_range: the
+ * driver holds a reference, each mapping another, the last one frees it */
+void *ucore_shared_page_alloc(void)
+{
+	struct Page *page = alloc_page();
+	if (!page)
+		return NULL;
+	set_page_ref(page, 1);
+	memset(page2kva(page), 0, PGSIZE);
+	return page2kva(page);
+}
+
+void ucore_shared_page_put(void *kaddr)
+{
+	struct Page *page = kva2page(kaddr);
+	if (page_ref_dec(page) == 0)
+		free_page(page);
+}
+
+unsigned long ucore_kva_to_pfn(const void *kaddr)
+{
+	return PADDR(kaddr) >> PGSHIFT;
+}
+
+/* the cache ops by range of mmu.h, for the DMA of the drivers */
+void ucore_dcache_clean_range(const void *kaddr, size_t size)
+{
+	arm_dcache_clean_range((uintptr_t) kaddr, size);
+}
+
+void ucore_dcache_inv_range(const void *kaddr, size_t size)
+{
+	arm_dcache_inv_range((uintptr_t) kaddr, size);
+}
+
+void ucore_dcache_flush_range(const void *kaddr, size_t size)
+{
+	arm_dcache_flush_range((uintptr_t) kaddr, size);
+}
+
+/* the contiguous buffers and the pools of dma.c, for the DMA API */
+void *ucore_dma_alloc(size_t size, unsigned long *paddr)
+{
+	uintptr_t pa;
+	void *kva = dma_contig_alloc(size, &pa);
+	*paddr = pa;
+	return kva;
+}
+
+void ucore_dma_free(void *kaddr, size_t size)
+{
+	dma_contig_free(kaddr, size);
+}
+
+void *ucore_dma_pool_create(const char *name, size_t size, size_t align,
+			    size_t boundary)
+{
+	return dmapool_create(name, size, align, boundary);
+}
+
+void ucore_dma_pool_destroy(void *pool)
+{
+	dmapool_destroy(pool);
+}
+
+void *ucore_dma_pool_alloc(void *pool, unsigned long *paddr)
+{
+	uintptr_t pa;
+	void *kva = dmapool_alloc(pool, &pa);
+	*paddr = pa;
+	return kva;
+}
+
+void ucore_dma_pool_free(void *pool, void *kaddr)
+{
+	dmapool_free(pool, kaddr);
+}
+
 void *ucore_map_pfn_range(unsigned long addr, unsigned long pfn,
 			  unsigned long size, unsigned long flags)
 {
 	void *ret = NULL;
 	struct mm_struct *mm = current->mm;
 	uint32_t vm_flags = VM_READ | VM_WRITE;
-	if (flags & VM_IO)
+	if (flags & UCORE_MAP_IO)
 		vm_flags |= VM_IO;
 	pte_perm_t perm = PTE_P | PTE_U | PTE_W;
+	if (flags & UCORE_MAP_WC)
+		perm |= PTE_WC;
 	assert(mm);
 	lock_mm(mm);
 	if (addr == 0) {
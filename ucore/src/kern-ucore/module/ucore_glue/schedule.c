@@ -55,9 +55,10 @@ unsigned long msleep_interruptible(unsigned int msecs)
 	return msecs;
 }
 
+/* only the queues bound by wait_glue.h have sleepers */
 void __wake_up(wait_queue_head_t * q, unsigned int mode, int nr, void *key)
 {
-	_TODO_();
+	__ucore_wake_up_bound(q);
 }
 
 int autoremove_wake_function(wait_queue_t * wait, unsigned mode, int sync,
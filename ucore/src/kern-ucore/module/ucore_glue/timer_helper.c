@@ -22,7 +22,7 @@
 void __ucore_add_timer(void *linux_timer, int expires, unsigned long data,
 		       void (*function) (unsigned long))
 {
-	timer_t *t = (timer_t *) kmalloc(sizeof(timer_t));
+	timer_t *t = timer_alloc();
 	if (!t) {
 		panic("failed to add linux timer");
 		return;
@@ -32,5 +32,4 @@ void __ucore_add_timer(void *linux_timer, int expires, unsigned long data,
 	t->linux_timer.data = data;
 	t->linux_timer.function = function;
 	add_timer(t);
-	kprintf("__ucore_add_timer: %d\n", expires);
 }
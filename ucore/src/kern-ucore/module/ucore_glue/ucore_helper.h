@@ -30,5 +30,6 @@ int __ucore_kernel_thread(int (*fn) (void *), const char *name, void *arg,
 /* wait_helper.c */
 void __ucore_wait_self();
 int __ucore_wakeup_by_pid(int pid);
+void __ucore_wake_up_bound(const void *key);
 
 #endif
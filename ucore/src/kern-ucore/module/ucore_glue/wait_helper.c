@@ -16,6 +16,11 @@
  * =====================================================================================
  */
 
+#include <types.h>
+#include <sync.h>
+#include <wait.h>
+#include <poll.h>
+#include <epoll.h>
 #include <error.h>
 #include <proc.h>
 #include <sched.h>
@@ -49,3 +54,126 @@ int __ucore_wakeup_by_pid(int pid)
 	local_intr_restore(flag);
 	return 0;
 }
+
+/* *
+ * The Linux wait queues bound to ucore ones, see wait_glue.h. The drivers
+ * bind few of them, the queues of their char devices, so they are looked
+ * up by the address of the Linux queue in a small table. seq moves with
+ * each wake up, so that a reader checking its condition and then going to
+ * sleep does not miss a wake up in between.
+ * */
+#define MAX_WAIT_BINDS          16
+
+struct wait_bind {
+	const void *key;	// the Linux wait_queue_head_t, NULL if free
+	unsigned int seq;
+	wait_queue_t wait_queue;
+	poll_head_t poll;
+};
+
+static struct wait_bind wait_binds[MAX_WAIT_BINDS];
+static spinlock_s wait_bind_lock;
+
+// wait_bind_find - the binding of key, or a free one if key is NULL,
+//                - wait_bind_lock held
+static struct wait_bind *wait_bind_find(const void *key)
+{
+	int i;
+	for (i = 0; i < MAX_WAIT_BINDS; i++) {
+		if (wait_binds[i].key == key) {
+			return wait_binds + i;
+		}
+	}
+	return NULL;
+}
+
+int ucore_wait_bind(const void *key)
+{
+	struct wait_bind *b;
+	bool intr_flag;
+	int ret = 0;
+	spin_lock_irqsave(&wait_bind_lock, intr_flag);
+	if (wait_bind_find(key) == NULL) {
+		if ((b = wait_bind_find(NULL)) != NULL) {
+			b->key = key, b->seq = 0;
+			wait_queue_init(&(b->wait_queue));
+			poll_head_init(&(b->poll));
+		} else {
+			ret = -E_NO_MEM;
+		}
+	}
+	spin_unlock_irqrestore(&wait_bind_lock, intr_flag);
+	return ret;
+}
+
+// ucore_wait_unbind - the Linux queue is going away: its pollers are told
+//                   - it hung up, and its sleepers woken
+void ucore_wait_unbind(const void *key)
+{
+	struct wait_bind *b;
+	bool intr_flag;
+	spin_lock_irqsave(&wait_bind_lock, intr_flag);
+	if ((b = wait_bind_find(key)) != NULL) {
+		poll_head_kill(&(b->poll));
+		wakeup_queue(&(b->wait_queue), WT_KERNEL_SIGNAL, 1);
+		b->key = NULL;
+	}
+	spin_unlock_irqrestore(&wait_bind_lock, intr_flag);
+}
+
+unsigned int ucore_wait_seq(const void *key)
+{
+	struct wait_bind *b = wait_bind_find(key);
+	return (b != NULL) ? b->seq : 0;
+}
+
+// ucore_wait_sleep - sleep on the queue of key unless it was woken since
+//                  - seq; an unbound queue only yields, as its waker
+//                  - cannot wake anyone. -E_INTR, -EINTR too, on a signal
+int ucore_wait_sleep(const void *key, unsigned int seq)
+{
+	wait_t __wait, *wait = &__wait;
+	struct wait_bind *b;
+	bool intr_flag;
+	spin_lock_irqsave(&wait_bind_lock, intr_flag);
+	if ((b = wait_bind_find(key)) == NULL || b->seq != seq) {
+		spin_unlock_irqrestore(&wait_bind_lock, intr_flag);
+		if (b == NULL) {
+			schedule();
+		}
+		return 0;
+	}
+	wait_current_set(&(b->wait_queue), wait, WT_KERNEL_SIGNAL);
+	spin_unlock_irqrestore(&wait_bind_lock, intr_flag);
+
+	schedule();
+
+	local_intr_save(intr_flag);
+	wait_current_del(&(b->wait_queue), wait);
+	local_intr_restore(intr_flag);
+	return (wait->wakeup_flags == WT_KERNEL_SIGNAL) ? 0 : -E_INTR;
+}
+
+// __ucore_wake_up_bound - __wake_up of a Linux queue, from any context
+void __ucore_wake_up_bound(const void *key)
+{
+	struct wait_bind *b;
+	bool intr_flag;
+	spin_lock_irqsave(&wait_bind_lock, intr_flag);
+	if ((b = wait_bind_find(key)) != NULL) {
+		b->seq++;
+		if (!wait_queue_empty(&(b->wait_queue))) {
+			wakeup_queue(&(b->wait_queue), WT_KERNEL_SIGNAL, 1);
+		}
+		poll_notify(&(b->poll), EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLHUP);
+	}
+	spin_unlock_irqrestore(&wait_bind_lock, intr_flag);
+}
+
+// __ucore_wait_poll_head - the poll head of the queue of key, for the
+//                        - IOCTL_POLL of the Linux devices
+poll_head_t *__ucore_wait_poll_head(const void *key)
+{
+	struct wait_bind *b = wait_bind_find(key);
+	return (key != NULL && b != NULL) ? &(b->poll) : NULL;
+}
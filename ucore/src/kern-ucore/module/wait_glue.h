@@ -0,0 +1,42 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  wait_glue.h
+ *
+ *    Description:  a Linux wait queue bound to a ucore wait queue and poll
+ *                  head, see ucore_glue/wait_helper.c
+ *
+ * =====================================================================================
+ */
+
+#ifndef WAIT_GLUE_H
+#define WAIT_GLUE_H
+
+#include <linux/wait.h>
+
+/*
+ * The Linux wait queues are stubs here: current is not a Linux task, so
+ * nothing can sleep on them. A driver binds the queue it wakes its readers
+ * by instead; then its wake_up wakes the ucore sleepers of the queue and
+ * tells epoll, and the poll_wait of its poll gives epoll the head.
+ */
+extern int ucore_wait_bind(wait_queue_head_t * q);
+extern void ucore_wait_unbind(wait_queue_head_t * q);
+extern unsigned int ucore_wait_seq(wait_queue_head_t * q);
+extern int ucore_wait_sleep(wait_queue_head_t * q, unsigned int seq);
+
+/* wait_event_interruptible on a bound queue: 0, or -EINTR on a signal */
+#define ucore_wait_event_interruptible(wq, condition)			\
+({									\
+	int __ret = 0;							\
+	for (;;) {							\
+		unsigned int __seq = ucore_wait_seq(&(wq));		\
+		if (condition)						\
+			break;						\
+		if ((__ret = ucore_wait_sleep(&(wq), __seq)) != 0)	\
+			break;						\
+	}								\
+	__ret;								\
+})
+
+#endif
@@ -0,0 +1,156 @@
+#include <types.h>
+#include <string.h>
+#include <mp.h>
+#include <error.h>
+#include <net.h>
+#include <tcp.h>
+
+/* *
+ * IPv4, without options nor fragments: the packets sent have DF set and
+ * fit the MTU, since TCP sizes its segments to it, and the fragments
+ * received are dropped. ICMP answers the echo requests that fit in the
+ * headers of a netbuf, which covers those of ping.
+ * */
+struct ip_hdr {
+	uint8_t vhl, tos;
+	uint16_t len, id, frag;
+	uint8_t ttl, proto;
+	uint16_t csum;
+	uint32_t src, dst;
+} __attribute__ ((packed));
+
+#define IP_DF                       0x4000
+#define IP_MF                       0x2000
+#define IP_OFFMASK                  0x1FFF
+#define IP_TTL                      64
+
+struct icmp_hdr {
+	uint8_t type, code;
+	uint16_t csum;
+	uint16_t id, seq;
+} __attribute__ ((packed));
+
+#define ICMP_ECHO_REPLY             0
+#define ICMP_ECHO                   8
+/* the echo requests answered at most, with room for the lower headers */
+#define ICMP_MAX_ECHO               (NETBUF_HDR_SIZE - 64)
+
+// inet_csum_add - add the 16-bit words of data of len bytes, in the order
+//               - of the network, to the ones' complement sum
+uint32_t inet_csum_add(uint32_t sum, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	while (len > 1) {
+		sum += (p[0] << 8) | p[1];
+		p += 2, len -= 2;
+	}
+	if (len != 0) {
+		sum += p[0] << 8;
+	}
+	while (sum >> 16) {
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+	return sum;
+}
+
+// inet_csum_fold - the checksum of sum, in host order
+uint16_t inet_csum_fold(uint32_t sum)
+{
+	while (sum >> 16) {
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+	return ~sum & 0xFFFF;
+}
+
+// inet_pseudo_csum - the sum of the pseudo header of a segment of len bytes
+uint32_t
+inet_pseudo_csum(uint32_t src, uint32_t dst, uint8_t proto, size_t len)
+{
+	uint32_t sum = (src >> 16) + (src & 0xFFFF) + (dst >> 16)
+	    + (dst & 0xFFFF) + proto + len;
+	while (sum >> 16) {
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+	return sum;
+}
+
+bool ip_is_local(uint32_t addr)
+{
+	return addr == NET_ADDR
+	    || (addr & NET_LOOPBACK_MASK) == NET_LOOPBACK_NET;
+}
+
+// ip_route - the source address of the packets to dst, 0 if unreachable
+uint32_t ip_route(uint32_t dst)
+{
+	if ((dst & NET_LOOPBACK_MASK) == NET_LOOPBACK_NET) {
+		return INADDR_LOOPBACK;
+	}
+	return (dst == NET_ADDR || netdev_valid()) ? NET_ADDR : 0;
+}
+
+static void icmp_input(uint32_t src, uint32_t dst, uint8_t * pkt, size_t len)
+{
+	struct icmp_hdr *ih = (struct icmp_hdr *)pkt;
+	struct netbuf *nb;
+	if (len < sizeof(struct icmp_hdr) || len > ICMP_MAX_ECHO
+	    || ih->type != ICMP_ECHO
+	    || inet_csum_fold(inet_csum_add(0, pkt, len)) != 0) {
+		return;
+	}
+	if ((nb = netbuf_alloc()) == NULL) {
+		return;
+	}
+	ih = netbuf_push(nb, len);
+	memcpy(ih, pkt, len);
+	ih->type = ICMP_ECHO_REPLY, ih->csum = 0;
+	ih->csum = htons(inet_csum_fold(inet_csum_add(0, ih, len)));
+	ip_output(nb, dst, src, IPPROTO_ICMP, myid());
+}
+
+// ip_input - a packet of len bytes received, in the softirq
+void ip_input(uint8_t * pkt, size_t len)
+{
+	struct ip_hdr *ih = (struct ip_hdr *)pkt;
+	size_t hlen, tot;
+	if (len < sizeof(struct ip_hdr) || (ih->vhl >> 4) != 4) {
+		return;
+	}
+	hlen = (ih->vhl & 0xF) * 4, tot = ntohs(ih->len);
+	if (hlen < sizeof(struct ip_hdr) || tot < hlen || tot > len
+	    || inet_csum_fold(inet_csum_add(0, ih, hlen)) != 0
+	    || (ntohs(ih->frag) & (IP_MF | IP_OFFMASK)) != 0) {
+		return;
+	}
+	uint32_t src = ntohl(ih->src), dst = ntohl(ih->dst);
+	if (!ip_is_local(dst)) {
+		return;
+	}
+	switch (ih->proto) {
+	case IPPROTO_TCP:
+		tcp_input(src, dst, pkt + hlen, tot - hlen);
+		break;
+	case IPPROTO_ICMP:
+		icmp_input(src, dst, pkt + hlen, tot - hlen);
+		break;
+	}
+}
+
+// ip_output - send nb, the packet of proto above IP, from src to dst on the
+//           - transmit queue of cpu; nb is freed once sent or on error
+int
+ip_output(struct netbuf *nb, uint32_t src, uint32_t dst, uint8_t proto,
+	  int cpu)
+{
+	struct ip_hdr *ih = netbuf_push(nb, sizeof(struct ip_hdr));
+	ih->vhl = 0x45, ih->tos = 0;
+	ih->len = htons(nb->len + nb->plen);
+	ih->id = 0, ih->frag = htons(IP_DF);
+	ih->ttl = IP_TTL, ih->proto = proto, ih->csum = 0;
+	ih->src = htonl(src), ih->dst = htonl(dst);
+	ih->csum = htons(inet_csum_fold(inet_csum_add(0, ih, sizeof(*ih))));
+	uint32_t nexthop = (ip_is_local(dst)
+			    || (dst & NET_MASK) == (NET_ADDR & NET_MASK)) ?
+	    dst : NET_GATEWAY;
+	return netdev_output(nb, nexthop, cpu);
+}
@@ -0,0 +1,93 @@
+#ifndef __KERN_NET_NET_H__
+#define __KERN_NET_NET_H__
+
+#include <types.h>
+#include <list.h>
+#include <socket.h>
+
+/* *
+ * The TCP/IP stack of the kernel: ethernet and ARP, IPv4 with ICMP echo,
+ * and TCP, see tcp.c. The packets come in from the queues of the card in
+ * the softirq of the cpu their interrupt is steered to, and each cpu
+ * keeps the connections whose packets it receives, so that the cpus take
+ * the traffic of their flows without sharing a lock.
+ *
+ * The address is that of QEMU user networking, with its gateway. The
+ * packets to that address, or to 127.0.0.0/8, loop back through a softirq
+ * without a card.
+ * */
+#define NET_ADDR                    0x0A00020F	/* 10.0.2.15 */
+#define NET_MASK                    0xFFFFFF00
+#define NET_GATEWAY                 0x0A000202	/* 10.0.2.2 */
+#define NET_LOOPBACK_NET            0x7F000000
+#define NET_LOOPBACK_MASK           0xFF000000
+
+#define ETH_ALEN                    6
+#define ETH_HLEN                    14
+#define ETH_MTU                     1500
+
+struct Page;
+
+/* *
+ * netbuf - a packet to send: the headers, which each layer pushes in front
+ * of those above it, from the end of hdr backwards, then plen bytes of page
+ * at off, the payload, which the netbuf holds a reference to so that the
+ * card reads it where it is. The card frees the netbuf once it is sent.
+ * */
+#define NETBUF_HDR_SIZE             128
+
+struct netbuf {
+	list_entry_t link;
+	uint8_t *data;		/* the first header */
+	size_t len;		/* of the headers */
+	struct Page *page;	/* or NULL */
+	size_t off, plen;
+	uint8_t hdr[NETBUF_HDR_SIZE];
+};
+
+#define le2netbuf(le, member)           \
+    to_struct((le), struct netbuf, member)
+
+struct netbuf *netbuf_alloc(void);
+void netbuf_free(struct netbuf *nb);
+void netbuf_copy(struct netbuf *nb, void *buf);
+
+// netbuf_push - room for n bytes of header in front of those of nb
+static inline void *netbuf_push(struct netbuf *nb, size_t n)
+{
+	nb->data -= n, nb->len += n;
+	return nb->data;
+}
+
+/* *
+ * netdev - a card with nr_queues queue pairs. xmit sends nb on a queue and
+ * frees it once sent, or at once if it cannot; the card hands the frames
+ * it receives on a queue to netdev_rx, in the softirq.
+ * */
+struct netdev {
+	const char *name;
+	uint8_t mac[ETH_ALEN];
+	int nr_queues;
+	int (*xmit) (struct netdev * dev, int queue, struct netbuf * nb);
+};
+
+void net_init(void);
+void netdev_register(struct netdev *dev);
+bool netdev_valid(void);
+void netdev_rx(struct netdev *dev, int queue, uint8_t * frame, size_t len);
+int netdev_output(struct netbuf *nb, uint32_t nexthop, int cpu);
+void net_flush(void);
+
+#define IPPROTO_ICMP                1
+
+uint32_t inet_csum_add(uint32_t sum, const void *data, size_t len);
+uint16_t inet_csum_fold(uint32_t sum);
+uint32_t inet_pseudo_csum(uint32_t src, uint32_t dst, uint8_t proto,
+			  size_t len);
+bool ip_is_local(uint32_t addr);
+uint32_t ip_route(uint32_t dst);
+void ip_input(uint8_t * pkt, size_t len);
+int ip_output(struct netbuf *nb, uint32_t src, uint32_t dst, uint8_t proto,
+	      int cpu);
+
+#endif /* !__KERN_NET_NET_H__ */
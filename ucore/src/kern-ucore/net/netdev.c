@@ -0,0 +1,348 @@
+#include <types.h>
+#include <string.h>
+#include <stdio.h>
+#include <slab.h>
+#include <pmm.h>
+#include <list.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <softirq.h>
+#include <timekeeping.h>
+#include <error.h>
+#include <assert.h>
+#include <kio.h>
+#include <net.h>
+#include <tcp.h>
+
+/* *
+ * The link layer: the netbufs, the card, ARP, and the loopback. A packet
+ * to a local address never reaches the card: it is copied whole into a
+ * lo_pkt and handed to ip_input by the tasklet of the sending cpu, as a
+ * frame of the card would be. The ARP table is small and shared; it keeps
+ * the last packet waiting for each address being resolved, and asks again
+ * for an address unanswered after ARP_RETRY_NS.
+ * */
+#define ETH_P_IP                    0x0800
+#define ETH_P_ARP                   0x0806
+
+struct eth_hdr {
+	uint8_t dst[ETH_ALEN];
+	uint8_t src[ETH_ALEN];
+	uint16_t type;
+} __attribute__ ((packed));
+
+#define ARP_HRD_ETHER               1
+#define ARP_REQUEST                 1
+#define ARP_REPLY                   2
+
+struct arp_pkt {
+	uint16_t htype, ptype;
+	uint8_t hlen, plen;
+	uint16_t op;
+	uint8_t sha[ETH_ALEN];
+	uint32_t spa;
+	uint8_t tha[ETH_ALEN];
+	uint32_t tpa;
+} __attribute__ ((packed));
+
+#define ARP_TABLE_SIZE              32
+#define ARP_RETRY_NS                NSEC_PER_SEC
+
+struct arp_entry {
+	uint32_t addr;		/* 0 if free */
+	uint8_t mac[ETH_ALEN];
+	bool resolved;
+	uint64_t asked;		/* when last asked, if not resolved */
+	struct netbuf *pending;	/* the ethernet header filled but dst */
+	int queue;		/* to send pending on */
+};
+
+/* the packets a loopback tasklet hands to ip_input in a round at most */
+#define LO_BATCH                    64
+
+struct lo_pkt {
+	list_entry_t link;
+	size_t len;
+	uint8_t data[0];
+};
+
+#define le2lopkt(le, member)            \
+    to_struct((le), struct lo_pkt, member)
+
+struct lo_cpu {
+	spinlock_s lock;
+	list_entry_t queue;
+	struct tasklet tasklet;
+};
+
+static kmem_cache_t *netbuf_cachep;
+static struct netdev *netdev;
+static DEFINE_PERCPU_NOINIT(struct lo_cpu, lo_cpus);
+
+static struct arp_entry arp_table[ARP_TABLE_SIZE];
+static int arp_victim;
+static spinlock_s arp_lock;
+
+static const uint8_t eth_broadcast[ETH_ALEN] =
+    { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+struct netbuf *netbuf_alloc(void)
+{
+	struct netbuf *nb;
+	if ((nb = kmem_cache_alloc(netbuf_cachep)) != NULL) {
+		nb->data = nb->hdr + NETBUF_HDR_SIZE, nb->len = 0;
+		nb->page = NULL, nb->off = nb->plen = 0;
+	}
+	return nb;
+}
+
+void netbuf_free(struct netbuf *nb)
+{
+	if (nb->page != NULL && page_ref_dec(nb->page) == 0) {
+		free_page(nb->page);
+	}
+	kmem_cache_free(netbuf_cachep, nb);
+}
+
+// netbuf_copy - the headers then the payload of nb into buf
+void netbuf_copy(struct netbuf *nb, void *buf)
+{
+	memcpy(buf, nb->data, nb->len);
+	if (nb->plen != 0) {
+		memcpy((uint8_t *) buf + nb->len,
+		       (uint8_t *) page2kva(nb->page) + nb->off, nb->plen);
+	}
+}
+
+static int lo_xmit(struct netbuf *nb)
+{
+	size_t len = nb->len + nb->plen;
+	struct lo_pkt *pkt;
+	bool intr_flag;
+	if ((pkt = kmalloc(sizeof(struct lo_pkt) + len)) == NULL) {
+		netbuf_free(nb);
+		return -E_NO_MEM;
+	}
+	pkt->len = len;
+	netbuf_copy(nb, pkt->data);
+	netbuf_free(nb);
+	local_intr_save(intr_flag);
+	{
+		struct lo_cpu *lc = get_cpu_ptr(lo_cpus);
+		spinlock_acquire(&(lc->lock));
+		list_add_before(&(lc->queue), &(pkt->link));
+		spinlock_release(&(lc->lock));
+		tasklet_schedule(&(lc->tasklet));
+	}
+	local_intr_restore(intr_flag);
+	return 0;
+}
+
+static void lo_rx(unsigned long data)
+{
+	struct lo_cpu *lc = (struct lo_cpu *)data;
+	list_entry_t *le;
+	bool intr_flag;
+	int n;
+	for (n = 0; n < LO_BATCH; n++) {
+		spin_lock_irqsave(&(lc->lock), intr_flag);
+		if ((le = list_next(&(lc->queue))) != &(lc->queue)) {
+			list_del(le);
+		}
+		spin_unlock_irqrestore(&(lc->lock), intr_flag);
+		if (le == &(lc->queue)) {
+			return;
+		}
+		struct lo_pkt *pkt = le2lopkt(le, link);
+		ip_input(pkt->data, pkt->len);
+		kfree(pkt);
+	}
+	/* the ones queued meanwhile wait for the next round */
+	tasklet_schedule(&(lc->tasklet));
+}
+
+static struct arp_entry *arp_find(uint32_t addr)
+{
+	int i;
+	for (i = 0; i < ARP_TABLE_SIZE; i++) {
+		if (arp_table[i].addr == addr) {
+			return arp_table + i;
+		}
+	}
+	return NULL;
+}
+
+// arp_send - an ARP op for tpa, to tha or to all
+static void arp_send(uint16_t op, const uint8_t * tha, uint32_t tpa)
+{
+	struct netbuf *nb;
+	if ((nb = netbuf_alloc()) == NULL) {
+		return;
+	}
+	struct arp_pkt *arp = netbuf_push(nb, sizeof(struct arp_pkt));
+	arp->htype = htons(ARP_HRD_ETHER), arp->ptype = htons(ETH_P_IP);
+	arp->hlen = ETH_ALEN, arp->plen = sizeof(uint32_t);
+	arp->op = htons(op);
+	memcpy(arp->sha, netdev->mac, ETH_ALEN);
+	arp->spa = htonl(NET_ADDR);
+	memcpy(arp->tha, (op == ARP_REQUEST) ? eth_broadcast : tha, ETH_ALEN);
+	arp->tpa = htonl(tpa);
+	struct eth_hdr *eh = netbuf_push(nb, ETH_HLEN);
+	memcpy(eh->dst, (op == ARP_REQUEST) ? eth_broadcast : tha, ETH_ALEN);
+	memcpy(eh->src, netdev->mac, ETH_ALEN);
+	eh->type = htons(ETH_P_ARP);
+	netdev->xmit(netdev, 0, nb);
+}
+
+// arp_resolve - fill the destination of the ethernet header of nb with the
+//             - address of addr and return 1, or keep nb for the answer of
+//             - the card of addr and return 0
+static bool arp_resolve(uint32_t addr, struct netbuf *nb, int queue)
+{
+	struct eth_hdr *eh = (struct eth_hdr *)nb->data;
+	struct netbuf *old = NULL;
+	struct arp_entry *e;
+	uint64_t now = ktime_get_ns();
+	bool intr_flag, ask = 0;
+	spin_lock_irqsave(&arp_lock, intr_flag);
+	if ((e = arp_find(addr)) != NULL && e->resolved) {
+		memcpy(eh->dst, e->mac, ETH_ALEN);
+		spin_unlock_irqrestore(&arp_lock, intr_flag);
+		return 1;
+	}
+	if (e == NULL) {
+		e = arp_table + arp_victim;
+		arp_victim = (arp_victim + 1) % ARP_TABLE_SIZE;
+		old = e->pending;
+		e->addr = addr, e->resolved = 0, e->asked = 0;
+		e->pending = NULL;
+	}
+	if (e->pending != NULL) {
+		old = e->pending;
+	}
+	e->pending = nb, e->queue = queue;
+	if (e->asked == 0 || now - e->asked >= ARP_RETRY_NS) {
+		e->asked = now, ask = 1;
+	}
+	spin_unlock_irqrestore(&arp_lock, intr_flag);
+	if (old != NULL) {
+		netbuf_free(old);
+	}
+	if (ask) {
+		arp_send(ARP_REQUEST, NULL, addr);
+	}
+	return 0;
+}
+
+static void arp_input(uint8_t * pkt, size_t len)
+{
+	struct arp_pkt *arp = (struct arp_pkt *)pkt;
+	struct netbuf *nb = NULL;
+	struct arp_entry *e;
+	bool intr_flag;
+	int queue = 0;
+	if (len < sizeof(struct arp_pkt)
+	    || ntohs(arp->htype) != ARP_HRD_ETHER
+	    || ntohs(arp->ptype) != ETH_P_IP || arp->hlen != ETH_ALEN
+	    || arp->plen != sizeof(uint32_t)) {
+		return;
+	}
+	uint32_t spa = ntohl(arp->spa), tpa = ntohl(arp->tpa);
+	spin_lock_irqsave(&arp_lock, intr_flag);
+	if ((e = arp_find(spa)) != NULL) {
+		memcpy(e->mac, arp->sha, ETH_ALEN);
+		e->resolved = 1;
+		nb = e->pending, queue = e->queue;
+		e->pending = NULL;
+	}
+	spin_unlock_irqrestore(&arp_lock, intr_flag);
+	if (nb != NULL) {
+		memcpy(((struct eth_hdr *)nb->data)->dst, arp->sha, ETH_ALEN);
+		netdev->xmit(netdev, queue, nb);
+	}
+	if (ntohs(arp->op) == ARP_REQUEST && tpa == NET_ADDR) {
+		arp_send(ARP_REPLY, arp->sha, spa);
+	}
+}
+
+void net_init(void)
+{
+	int i;
+	netbuf_cachep = kmem_cache_create("netbuf", sizeof(struct netbuf), 0,
+					  NULL);
+	if (netbuf_cachep == NULL) {
+		panic("cannot create netbuf cache.\n");
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct lo_cpu *lc = per_cpu_ptr(lo_cpus, i);
+		spinlock_init(&(lc->lock));
+		list_init(&(lc->queue));
+		tasklet_init(&(lc->tasklet), lo_rx, (unsigned long)lc);
+	}
+	spinlock_init(&arp_lock);
+	tcp_init();
+}
+
+void netdev_register(struct netdev *dev)
+{
+	assert(netdev == NULL && dev->nr_queues > 0);
+	netdev = dev;
+	kprintf("net: %s, %d.%d.%d.%d.\n", dev->name, NET_ADDR >> 24,
+		(NET_ADDR >> 16) & 0xFF, (NET_ADDR >> 8) & 0xFF,
+		NET_ADDR & 0xFF);
+}
+
+bool netdev_valid(void)
+{
+	return netdev != NULL;
+}
+
+// netdev_rx - a frame received by dev on a queue, in the softirq
+void netdev_rx(struct netdev *dev, int queue, uint8_t * frame, size_t len)
+{
+	struct eth_hdr *eh = (struct eth_hdr *)frame;
+	if (len < ETH_HLEN) {
+		return;
+	}
+	switch (ntohs(eh->type)) {
+	case ETH_P_IP:
+		ip_input(frame + ETH_HLEN, len - ETH_HLEN);
+		break;
+	case ETH_P_ARP:
+		arp_input(frame + ETH_HLEN, len - ETH_HLEN);
+		break;
+	}
+}
+
+// netdev_output - send the IP packet nb to nexthop, from the transmit queue
+//               - of cpu; nb is freed once sent or at once on error
+int netdev_output(struct netbuf *nb, uint32_t nexthop, int cpu)
+{
+	if ((nexthop & NET_LOOPBACK_MASK) == NET_LOOPBACK_NET
+	    || nexthop == NET_ADDR) {
+		return lo_xmit(nb);
+	}
+	if (netdev == NULL) {
+		netbuf_free(nb);
+		return -E_NO_DEV;
+	}
+	int queue = cpu % netdev->nr_queues;
+	struct eth_hdr *eh = netbuf_push(nb, ETH_HLEN);
+	memcpy(eh->src, netdev->mac, ETH_ALEN);
+	eh->type = htons(ETH_P_IP);
+	if (!arp_resolve(nexthop, nb, queue)) {
+		return 0;
+	}
+	return netdev->xmit(netdev, queue, nb);
+}
+
+// net_flush - have the packets a proc has sent or queued for the loopback
+//           - processed now, rather than at the next interrupt; called
+//           - with no locks held
+void net_flush(void)
+{
+	do_softirq();
+}
@@ -0,0 +1,187 @@
+#include <types.h>
+#include <string.h>
+#include <vfs.h>
+#include <inode.h>
+#include <iobuf.h>
+#include <stat.h>
+#include <poll.h>
+#include <error.h>
+#include <assert.h>
+#include <net.h>
+#include <tcp.h>
+#include <sock.h>
+
+/*
+ * The sockets: an inode over a tcp_sock, whose read and write block as
+ * those of a pipe do. Each call lets the softirqs the connection raised
+ * run once it is done with the locks, see net_flush.
+ */
+
+static struct tcp_sock *socket_tsk(struct inode *node)
+{
+	return vop_info(node, socket_inode)->tsk;
+}
+
+static int socket_inode_close(struct inode *node)
+{
+	tcp_close(socket_tsk(node));
+	net_flush();
+	return 0;
+}
+
+static int socket_inode_read(struct inode *node, struct iobuf *iob)
+{
+	size_t copied;
+	int ret = tcp_recv(socket_tsk(node), iob->io_base, iob->io_resid,
+			   &copied);
+	iobuf_skip(iob, copied);
+	net_flush();
+	return ret;
+}
+
+static int socket_inode_write(struct inode *node, struct iobuf *iob)
+{
+	size_t copied;
+	int ret = tcp_send(socket_tsk(node), iob->io_base, iob->io_resid,
+			   &copied);
+	iobuf_skip(iob, copied);
+	net_flush();
+	return ret;
+}
+
+static int socket_inode_fstat(struct inode *node, struct stat *stat)
+{
+	int ret;
+	memset(stat, 0, sizeof(struct stat));
+	if ((ret = vop_gettype(node, &(stat->st_mode))) != 0) {
+		return ret;
+	}
+	stat->st_nlinks = 1;
+	return 0;
+}
+
+static int socket_inode_reclaim(struct inode *node)
+{
+	tcp_put(socket_tsk(node));
+	vop_kill(node);
+	return 0;
+}
+
+static int socket_inode_ioctl(struct inode *node, int op, void *data)
+{
+	if (op == IOCTL_POLL) {
+		tcp_poll(socket_tsk(node), data);
+		return 0;
+	}
+	return -E_INVAL;
+}
+
+static int socket_inode_gettype(struct inode *node, uint32_t * type_store)
+{
+	*type_store = S_IFSOCK;
+	return 0;
+}
+
+static const struct inode_ops socket_node_ops = {
+	.vop_magic = VOP_MAGIC,
+	.vop_open = NULL_VOP_INVAL,
+	.vop_close = socket_inode_close,
+	.vop_read = socket_inode_read,
+	.vop_write = socket_inode_write,
+	.vop_fstat = socket_inode_fstat,
+	.vop_fsync = NULL_VOP_PASS,
+	.vop_mkdir = NULL_VOP_NOTDIR,
+	.vop_link = NULL_VOP_NOTDIR,
+	.vop_rename = NULL_VOP_NOTDIR,
+	.vop_readlink = NULL_VOP_INVAL,
+	.vop_symlink = NULL_VOP_NOTDIR,
+	.vop_namefile = NULL_VOP_INVAL,
+	.vop_getdirentry = NULL_VOP_INVAL,
+	.vop_reclaim = socket_inode_reclaim,
+	.vop_ioctl = socket_inode_ioctl,
+	.vop_gettype = socket_inode_gettype,
+	.vop_tryseek = NULL_VOP_INVAL,
+	.vop_truncate = NULL_VOP_INVAL,
+	.vop_create = NULL_VOP_NOTDIR,
+	.vop_unlink = NULL_VOP_NOTDIR,
+	.vop_lookup = NULL_VOP_NOTDIR,
+	.vop_lookup_parent = NULL_VOP_NOTDIR,
+};
+
+// socket_new - an inode for tsk, opened once, taking its reference
+static int socket_new(struct tcp_sock *tsk, struct inode **node_store)
+{
+	struct inode *node;
+	if ((node = alloc_inode(socket_inode)) == NULL) {
+		return -E_NO_MEM;
+	}
+	vop_init(node, &socket_node_ops, NULL);
+	vop_info(node, socket_inode)->tsk = tsk;
+	vop_open_inc(node);
+	*node_store = node;
+	return 0;
+}
+
+// socket_open - a new TCP socket, unbound and unconnected
+int socket_open(struct inode **node_store)
+{
+	struct tcp_sock *tsk;
+	int ret;
+	if ((tsk = tcp_create()) == NULL) {
+		return -E_NO_MEM;
+	}
+	if ((ret = socket_new(tsk, node_store)) != 0) {
+		tcp_put(tsk);
+	}
+	return ret;
+}
+
+bool socket_node(struct inode *node)
+{
+	return check_inode_type(node, socket_inode);
+}
+
+int socket_bind(struct inode *node, uint32_t addr, uint16_t port)
+{
+	return tcp_bind(socket_tsk(node), addr, port);
+}
+
+int socket_listen(struct inode *node, int backlog)
+{
+	return tcp_listen(socket_tsk(node), backlog);
+}
+
+// socket_accept - a socket for the next connection to the listener node,
+//               - and the address and port of its peer
+int
+socket_accept(struct inode *node, struct inode **node_store,
+	      uint32_t * addr_store, uint16_t * port_store)
+{
+	struct tcp_sock *child;
+	int ret;
+	if ((ret = tcp_accept(socket_tsk(node), &child, addr_store,
+			      port_store)) != 0) {
+		return ret;
+	}
+	if ((ret = socket_new(child, node_store)) != 0) {
+		tcp_close(child);
+		tcp_put(child);
+		net_flush();
+	}
+	return ret;
+}
+
+int socket_connect(struct inode *node, uint32_t addr, uint16_t port)
+{
+	int ret = tcp_connect(socket_tsk(node), addr, port);
+	net_flush();
+	return ret;
+}
+
+// socket_sendpage - queue len bytes of page to send, see tcp_sendpage
+int socket_sendpage(struct inode *node, struct Page *page, size_t len)
+{
+	int ret = tcp_sendpage(socket_tsk(node), page, len);
+	net_flush();
+	return ret;
+}
@@ -0,0 +1,24 @@
+#ifndef __KERN_NET_SOCK_H__
+#define __KERN_NET_SOCK_H__
+
+#include <types.h>
+
+struct inode;
+struct tcp_sock;
+struct Page;
+
+/* the inode of a socket, an fd of its own as an epoll is */
+struct socket_inode {
+	struct tcp_sock *tsk;
+};
+
+int socket_open(struct inode **node_store);
+bool socket_node(struct inode *node);
+int socket_bind(struct inode *node, uint32_t addr, uint16_t port);
+int socket_listen(struct inode *node, int backlog);
+int socket_accept(struct inode *node, struct inode **node_store,
+		  uint32_t * addr_store, uint16_t * port_store);
+int socket_connect(struct inode *node, uint32_t addr, uint16_t port);
+int socket_sendpage(struct inode *node, struct Page *page, size_t len);
+
+#endif /* !__KERN_NET_SOCK_H__ */
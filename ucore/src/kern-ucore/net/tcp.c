@@ -0,0 +1,1555 @@
+#include <types.h>
+#include <string.h>
+#include <slab.h>
+#include <pmm.h>
+#include <list.h>
+#include <atomic.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <wait.h>
+#include <proc.h>
+#include <sched.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <timekeeping.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <epoll.h>
+#include <error.h>
+#include <assert.h>
+#include <net.h>
+#include <tcp.h>
+
+/* *
+ * TCP after RFC 793, with the congestion control of RFC 5681 and the
+ * retransmission timer of RFC 6298: slow start and congestion avoidance,
+ * a fast retransmit on the third duplicate ACK, and go-back-N on a
+ * timeout. There is no out-of-order queue, no SACK nor window scaling,
+ * and the segments in order are ACKed at once.
+ *
+ * The connections are sharded by cpu: each is hashed in the table of the
+ * cpu whose softirq took its first segment, that of the card queue its
+ * flow is steered to, and a lookup tries the table of its own cpu first;
+ * so the cpus take the segments of their own flows, each under its own
+ * lock, and send on their own transmit queue. Only the listening sockets
+ * are in a table of all the cpus.
+ *
+ * The data to send is queued in pages, TCP_SNDQ_BUFS at most, filled by
+ * the writes or handed over by sendfile, and a segment never crosses one:
+ * its payload is read by the card from the page, which the netbuf holds a
+ * reference to, so the data is not copied after the write. The data
+ * received is copied once, into the receive ring.
+ *
+ * A tcp_sock is freed with its last reference: its table holds one while
+ * it is hashed, the socket one until its inode is reclaimed, its timer
+ * one while armed, and the accept queue of its listener one. The lock of
+ * a tcp_sock is taken before that of a table, and that of a child before
+ * that of its listener, never both at once.
+ * */
+#define TCP_HASH_SHIFT              8
+#define TCP_HASH_SIZE               (1 << TCP_HASH_SHIFT)
+
+#define TCP_MSS                     (ETH_MTU - 40)
+#define TCP_DEFAULT_MSS             536
+#define TCP_RCVBUF                  (16 * 1024)
+#define TCP_SNDQ_BUFS               16
+#define TCP_MAX_CWND                (TCP_SNDQ_BUFS * PGSIZE)
+#define TCP_PORT_FIRST              49152
+#define TCP_MAX_RETRIES             8
+
+#define TCP_NSEC_MS                 (NSEC_PER_SEC / 1000)
+#define TCP_RTO_INIT                (1000 * TCP_NSEC_MS)
+#define TCP_RTO_MIN                 (200 * TCP_NSEC_MS)
+#define TCP_RTO_MAX                 (60000 * TCP_NSEC_MS)
+#define TCP_2MSL                    (2000 * TCP_NSEC_MS)
+/* of an orphan in FIN_WAIT_2, whose peer may never close */
+#define TCP_FIN_TIMEOUT             (10000 * TCP_NSEC_MS)
+
+struct tcp_hdr {
+	uint16_t sport, dport;
+	uint32_t seq, ack;
+	uint8_t off;		/* the words of the header, high nibble */
+	uint8_t flags;
+	uint16_t wnd, csum, urg;
+} __attribute__ ((packed));
+
+#define TCP_FIN                     0x01
+#define TCP_SYN                     0x02
+#define TCP_RST                     0x04
+#define TCP_PSH                     0x08
+#define TCP_ACK                     0x10
+
+#define TCP_OPT_END                 0
+#define TCP_OPT_NOP                 1
+#define TCP_OPT_MSS                 2
+
+#define SEQ_LT(a, b)                ((int32_t)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b)               ((int32_t)((a) - (b)) <= 0)
+#define SEQ_GT(a, b)                SEQ_LT(b, a)
+#define SEQ_GEQ(a, b)               SEQ_LEQ(b, a)
+
+enum tcp_state {
+	TCP_CLOSED,
+	TCP_LISTEN,
+	TCP_SYN_SENT,
+	TCP_SYN_RCVD,
+	TCP_ESTABLISHED,
+	TCP_FIN_WAIT_1,
+	TCP_FIN_WAIT_2,
+	TCP_CLOSE_WAIT,
+	TCP_CLOSING,
+	TCP_LAST_ACK,
+	TCP_TIME_WAIT,
+};
+
+/* a segment received, or to send */
+struct tcp_seg {
+	uint32_t seq, ack;
+	uint8_t flags;
+	uint16_t wnd;
+	uint16_t mss;		/* of the option, 0 without */
+	uint8_t *data;		/* received */
+	struct Page *page;	/* to send */
+	size_t off, len;
+};
+
+/* a page of the send queue, its bytes [off, off + len) not acked yet */
+struct tcp_sndbuf {
+	struct Page *page;
+	size_t off, len;
+	bool own;		/* filled by writes, which may append to it */
+};
+
+struct tcp_table {
+	spinlock_s lock;
+	list_entry_t hash[TCP_HASH_SIZE];
+};
+
+struct tcp_sock {
+	spinlock_s lock;
+	atomic_t ref;
+	enum tcp_state state;
+	int err;		/* the reason it was closed, to report */
+	bool connected;		/* has been established */
+	bool orphan;		/* closed by its socket */
+	bool fin_queued, fin_sent, fin_acked, fin_rcvd;
+	uint32_t laddr, raddr;
+	uint16_t lport, rport;
+	int cpu;		/* of its table and transmit queue */
+	struct tcp_table *table;	/* hashed in, or NULL */
+	list_entry_t hash_link;
+	/* send: the first byte of the queue is snd_una */
+	uint32_t iss, snd_una, snd_nxt, snd_max, snd_wl1, snd_wl2;
+	uint32_t snd_wnd, cwnd, ssthresh;
+	uint16_t mss;
+	int dupacks;
+	struct tcp_sndbuf sndq[TCP_SNDQ_BUFS];
+	int sndq_head, sndq_used;
+	size_t sndq_bytes;
+	/* receive: rcv_adv is the right edge of the window advertised */
+	uint32_t irs, rcv_nxt, rcv_adv;
+	uint8_t *rcvbuf;
+	size_t rcv_head, rcv_bytes;
+	/* the round trip of the segment of rtt_seq, and the timeout, in ns */
+	bool rtt_on;
+	uint32_t rtt_seq;
+	uint64_t rtt_start, srtt, rttvar, rto;
+	int retries;
+	/* the timer goes off at timer_due, or 0 for not; see tcp_timer */
+	timer_t timer;
+	uint64_t timer_due;
+	bool timer_armed;
+	/* a listener: its children established, not accepted yet */
+	list_entry_t accept_queue, accept_link;
+	int backlog, nr_queued;
+	struct tcp_sock *parent;	/* of a child not yet established */
+	wait_queue_t wait;
+	poll_head_t poll;
+};
+
+#define le2tsk(le, member)              \
+    to_struct((le), struct tcp_sock, member)
+
+static kmem_cache_t *tcp_cachep;
+static DEFINE_PERCPU_NOINIT(struct tcp_table, tcp_tables);
+/* the listening sockets, hashed by port */
+static struct tcp_table tcp_listeners;
+/* serializes the choice of the ports, with the tables locked under it */
+static spinlock_s tcp_bind_lock;
+static uint16_t tcp_port_next = TCP_PORT_FIRST;
+
+static void tcp_timer(unsigned long data);
+static void tcp_output(struct tcp_sock *tsk, bool probe);
+
+static uint32_t tcp_hashfn(uint32_t raddr, uint16_t rport, uint16_t lport)
+{
+	return hash32(raddr ^ (((uint32_t) rport << 16) | lport),
+		      TCP_HASH_SHIFT);
+}
+
+static uint32_t tcp_listen_hashfn(uint16_t lport)
+{
+	return hash32(lport, TCP_HASH_SHIFT);
+}
+
+static void tcp_table_init(struct tcp_table *table)
+{
+	int i;
+	spinlock_init(&(table->lock));
+	for (i = 0; i < TCP_HASH_SIZE; i++) {
+		list_init(table->hash + i);
+	}
+}
+
+void tcp_init(void)
+{
+	int i;
+	tcp_cachep = kmem_cache_create("tcp_sock", sizeof(struct tcp_sock),
+				       KMEM_CACHE_LINE, NULL);
+	if (tcp_cachep == NULL) {
+		panic("cannot create tcp_sock cache.\n");
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		tcp_table_init(per_cpu_ptr(tcp_tables, i));
+	}
+	tcp_table_init(&tcp_listeners);
+	spinlock_init(&tcp_bind_lock);
+}
+
+static struct tcp_sock *tcp_alloc(void)
+{
+	struct tcp_sock *tsk;
+	if ((tsk = kmem_cache_alloc(tcp_cachep)) == NULL) {
+		return NULL;
+	}
+	memset(tsk, 0, sizeof(struct tcp_sock));
+	if ((tsk->rcvbuf = kmalloc(TCP_RCVBUF)) == NULL) {
+		kmem_cache_free(tcp_cachep, tsk);
+		return NULL;
+	}
+	spinlock_init(&(tsk->lock));
+	atomic_set(&(tsk->ref), 1);
+	tsk->state = TCP_CLOSED;
+	tsk->cpu = myid();
+	list_init(&(tsk->hash_link));
+	tsk->mss = TCP_DEFAULT_MSS;
+	tsk->rto = TCP_RTO_INIT;
+	timer_setup(&(tsk->timer), tsk, tcp_timer, (unsigned long)tsk);
+	list_init(&(tsk->accept_queue));
+	list_init(&(tsk->accept_link));
+	wait_queue_init(&(tsk->wait));
+	poll_head_init(&(tsk->poll));
+	return tsk;
+}
+
+static void tcp_page_put(struct Page *page)
+{
+	if (page_ref_dec(page) == 0) {
+		free_page(page);
+	}
+}
+
+static void tcp_free(struct tcp_sock *tsk)
+{
+	assert(tsk->table == NULL && !tsk->timer_armed);
+	assert(list_empty(&(tsk->poll.poll_list)));
+	while (tsk->sndq_used > 0) {
+		tcp_page_put(tsk->sndq[tsk->sndq_head].page);
+		tsk->sndq_head = (tsk->sndq_head + 1) % TCP_SNDQ_BUFS;
+		tsk->sndq_used--;
+	}
+	kfree(tsk->rcvbuf);
+	kmem_cache_free(tcp_cachep, tsk);
+}
+
+// tcp_put - drop a reference to tsk
+void tcp_put(struct tcp_sock *tsk)
+{
+	if (atomic_sub_return(&(tsk->ref), 1) == 0) {
+		tcp_free(tsk);
+	}
+}
+
+// __tcp_find - the connection of the 4-tuple in table, locked
+static struct tcp_sock *__tcp_find(struct tcp_table *table, uint32_t laddr,
+				   uint16_t lport, uint32_t raddr,
+				   uint16_t rport)
+{
+	list_entry_t *list = table->hash + tcp_hashfn(raddr, rport, lport);
+	list_entry_t *le = list;
+	while ((le = list_next(le)) != list) {
+		struct tcp_sock *tsk = le2tsk(le, hash_link);
+		if (tsk->lport == lport && tsk->rport == rport
+		    && tsk->raddr == raddr && tsk->laddr == laddr) {
+			return tsk;
+		}
+	}
+	return NULL;
+}
+
+// __tcp_find_listener - the listener of port for addr, tcp_listeners locked;
+//                     - with exact, only the one bound to addr itself
+static struct tcp_sock *__tcp_find_listener(uint32_t addr, uint16_t port,
+					    bool exact)
+{
+	list_entry_t *list = tcp_listeners.hash + tcp_listen_hashfn(port);
+	list_entry_t *le = list;
+	while ((le = list_next(le)) != list) {
+		struct tcp_sock *tsk = le2tsk(le, hash_link);
+		if (tsk->lport == port && (tsk->laddr == addr
+					   || (!exact
+					       && tsk->laddr == INADDR_ANY))) {
+			return tsk;
+		}
+	}
+	return NULL;
+}
+
+// tcp_lookup - a reference to the connection of the 4-tuple, or NULL;
+//            - the table of this cpu is tried first
+static struct tcp_sock *tcp_lookup(uint32_t laddr, uint16_t lport,
+				   uint32_t raddr, uint16_t rport)
+{
+	struct tcp_sock *tsk = NULL;
+	bool intr_flag;
+	int cpu = myid(), i;
+	for (i = 0; i < sysconf.lcpu_count && tsk == NULL; i++) {
+		struct tcp_table *table =
+		    per_cpu_ptr(tcp_tables, (cpu + i) % sysconf.lcpu_count);
+		spin_lock_irqsave(&(table->lock), intr_flag);
+		if ((tsk = __tcp_find(table, laddr, lport, raddr, rport))
+		    != NULL) {
+			atomic_inc(&(tsk->ref));
+		}
+		spin_unlock_irqrestore(&(table->lock), intr_flag);
+	}
+	return tsk;
+}
+
+static struct tcp_sock *tcp_lookup_listener(uint32_t addr, uint16_t port)
+{
+	struct tcp_sock *tsk;
+	bool intr_flag;
+	spin_lock_irqsave(&(tcp_listeners.lock), intr_flag);
+	if ((tsk = __tcp_find_listener(addr, port, 0)) == NULL) {
+		tsk = __tcp_find_listener(INADDR_ANY, port, 0);
+	}
+	if (tsk != NULL) {
+		atomic_inc(&(tsk->ref));
+	}
+	spin_unlock_irqrestore(&(tcp_listeners.lock), intr_flag);
+	return tsk;
+}
+
+// tcp_hash - hash tsk in the table of its cpu, unless a connection of its
+//          - 4-tuple is there already
+static int tcp_hash(struct tcp_sock *tsk)
+{
+	struct tcp_table *table = per_cpu_ptr(tcp_tables, tsk->cpu);
+	bool intr_flag;
+	int ret = -E_ADDRINUSE;
+	spin_lock_irqsave(&(table->lock), intr_flag);
+	if (__tcp_find(table, tsk->laddr, tsk->lport, tsk->raddr, tsk->rport)
+	    == NULL) {
+		list_add(table->hash + tcp_hashfn(tsk->raddr, tsk->rport,
+						  tsk->lport),
+			 &(tsk->hash_link));
+		tsk->table = table;
+		atomic_inc(&(tsk->ref));
+		ret = 0;
+	}
+	spin_unlock_irqrestore(&(table->lock), intr_flag);
+	return ret;
+}
+
+// tcp_unhash - take tsk out of its table; the caller holds a reference
+static void tcp_unhash(struct tcp_sock *tsk)
+{
+	struct tcp_table *table = tsk->table;
+	bool intr_flag;
+	if (table != NULL) {
+		spin_lock_irqsave(&(table->lock), intr_flag);
+		list_del_init(&(tsk->hash_link));
+		spin_unlock_irqrestore(&(table->lock), intr_flag);
+		tsk->table = NULL;
+		atomic_dec(&(tsk->ref));
+	}
+}
+
+// tcp_port_used - a listener or a connection has port for laddr, bind lock
+//               - held; raddr:rport of the connection, or 0 for any
+static bool
+tcp_port_used(uint32_t laddr, uint16_t port, uint32_t raddr, uint16_t rport)
+{
+	bool intr_flag, used;
+	int i;
+	spin_lock_irqsave(&(tcp_listeners.lock), intr_flag);
+	used = (__tcp_find_listener(laddr, port, laddr != INADDR_ANY) != NULL);
+	spin_unlock_irqrestore(&(tcp_listeners.lock), intr_flag);
+	for (i = 0; i < sysconf.lcpu_count && !used && rport != 0; i++) {
+		struct tcp_table *table = per_cpu_ptr(tcp_tables, i);
+		spin_lock_irqsave(&(table->lock), intr_flag);
+		used = (__tcp_find(table, laddr, port, raddr, rport) != NULL);
+		spin_unlock_irqrestore(&(table->lock), intr_flag);
+	}
+	return used;
+}
+
+// tcp_pick_port - a port free for laddr and raddr:rport, bind lock held
+static uint16_t tcp_pick_port(uint32_t laddr, uint32_t raddr, uint16_t rport)
+{
+	int n;
+	for (n = 0; n < 0x10000 - TCP_PORT_FIRST; n++) {
+		uint16_t port = tcp_port_next;
+		tcp_port_next = (port == 0xFFFF) ? TCP_PORT_FIRST : port + 1;
+		if (!tcp_port_used(laddr, port, raddr, rport)) {
+			return port;
+		}
+	}
+	return 0;
+}
+
+static uint32_t tcp_new_iss(struct tcp_sock *tsk)
+{
+	/* the clock of RFC 793, 4us, offset by the 4-tuple */
+	return (uint32_t) (ktime_get_ns() / 4000)
+	    + hash32(tsk->raddr ^ tsk->laddr ^ (((uint32_t) tsk->rport << 16)
+						| tsk->lport), 32);
+}
+
+static uint32_t tcp_rcv_wnd(struct tcp_sock *tsk)
+{
+	return TCP_RCVBUF - tsk->rcv_bytes;
+}
+
+static bool tcp_sndq_room(struct tcp_sock *tsk)
+{
+	if (tsk->sndq_used < TCP_SNDQ_BUFS) {
+		return 1;
+	}
+	struct tcp_sndbuf *b = tsk->sndq +
+	    (tsk->sndq_head + tsk->sndq_used - 1) % TCP_SNDQ_BUFS;
+	return b->own && b->off + b->len < PGSIZE;
+}
+
+static void tcp_wakeup(struct tcp_sock *tsk, uint32_t events)
+{
+	if (!wait_queue_empty(&(tsk->wait))) {
+		wakeup_queue(&(tsk->wait), WT_SOCKET, 1);
+	}
+	poll_notify(&(tsk->poll), events);
+}
+
+// tcp_wait - sleep until tsk changes, its lock held and released meanwhile
+static int tcp_wait(struct tcp_sock *tsk, bool * intr_flag)
+{
+	wait_t __wait, *wait = &__wait;
+	wait_current_set(&(tsk->wait), wait, WT_SOCKET);
+	spin_unlock_irqrestore(&(tsk->lock), *intr_flag);
+	/* what it sent to the loopback may be what it waits for */
+	net_flush();
+	schedule();
+	spin_lock_irqsave(&(tsk->lock), *intr_flag);
+	wait_current_del(&(tsk->wait), wait);
+	return (wait->wakeup_flags == WT_SOCKET) ? 0 : -E_KILLED;
+}
+
+// tcp_timer_set - have the timer of tsk go off in ns, tsk locked
+static void tcp_timer_set(struct tcp_sock *tsk, uint64_t ns)
+{
+	uint64_t due = ktime_get_ns() + ns;
+	if (tsk->timer_armed) {
+		if (tsk->timer_due != 0 && tsk->timer_due <= due) {
+			/* it goes off early and is added again */
+			tsk->timer_due = due;
+			return;
+		}
+		/* the reference passes to the timer added again */
+		del_timer(&(tsk->timer));
+	} else {
+		tsk->timer_armed = 1;
+		atomic_inc(&(tsk->ref));
+	}
+	tsk->timer_due = due;
+	tsk->timer.expires = ns / TIMER_TICK_NSEC + 1;
+	add_timer(&(tsk->timer));
+}
+
+// tcp_done - tsk is CLOSED, tsk locked and referenced by the caller
+static void tcp_done(struct tcp_sock *tsk)
+{
+	struct tcp_sock *parent = tsk->parent;
+	if (tsk->state == TCP_CLOSED) {
+		return;
+	}
+	tsk->state = TCP_CLOSED;
+	tsk->timer_due = 0;
+	tcp_unhash(tsk);
+	tcp_wakeup(tsk, EPOLLIN | EPOLLOUT | EPOLLHUP);
+	if (parent != NULL) {
+		tsk->parent = NULL;
+		tcp_put(parent);
+	}
+}
+
+// tcp_parse_mss - the MSS option of the header th of hlen bytes, or 0
+static uint16_t tcp_parse_mss(struct tcp_hdr *th, size_t hlen)
+{
+	uint8_t *opt = (uint8_t *) (th + 1), *end = (uint8_t *) th + hlen;
+	while (opt < end && *opt != TCP_OPT_END) {
+		if (*opt == TCP_OPT_NOP) {
+			opt++;
+			continue;
+		}
+		if (opt + 1 >= end || opt[1] < 2 || opt + opt[1] > end) {
+			break;
+		}
+		if (opt[0] == TCP_OPT_MSS && opt[1] == 4) {
+			return (opt[2] << 8) | opt[3];
+		}
+		opt += opt[1];
+	}
+	return 0;
+}
+
+// tcp_xmit_seg - send s from laddr:lport to raddr:rport on the transmit
+//              - queue of cpu
+static void
+tcp_xmit_seg(uint32_t laddr, uint16_t lport, uint32_t raddr, uint16_t rport,
+	     struct tcp_seg *s, int cpu)
+{
+	size_t hlen = sizeof(struct tcp_hdr) + ((s->mss != 0) ? 4 : 0);
+	struct netbuf *nb;
+	if ((nb = netbuf_alloc()) == NULL) {
+		return;
+	}
+	struct tcp_hdr *th = netbuf_push(nb, hlen);
+	memset(th, 0, hlen);
+	th->sport = htons(lport), th->dport = htons(rport);
+	th->seq = htonl(s->seq), th->ack = htonl(s->ack);
+	th->off = (hlen / 4) << 4, th->flags = s->flags;
+	th->wnd = htons(s->wnd);
+	if (s->mss != 0) {
+		uint8_t *opt = (uint8_t *) (th + 1);
+		opt[0] = TCP_OPT_MSS, opt[1] = 4;
+		opt[2] = s->mss >> 8, opt[3] = s->mss & 0xFF;
+	}
+	uint32_t sum = inet_pseudo_csum(laddr, raddr, IPPROTO_TCP,
+					hlen + s->len);
+	sum = inet_csum_add(sum, th, hlen);
+	if (s->len != 0) {
+		page_ref_inc(s->page);
+		nb->page = s->page, nb->off = s->off, nb->plen = s->len;
+		sum = inet_csum_add(sum, (uint8_t *) page2kva(s->page) + s->off,
+				    s->len);
+	}
+	th->csum = htons(inet_csum_fold(sum));
+	ip_output(nb, laddr, raddr, IPPROTO_TCP, cpu);
+}
+
+// tcp_xmit - send a segment of tsk at seq with flags, and len bytes of page
+//          - at off; tsk locked
+static void
+tcp_xmit(struct tcp_sock *tsk, uint32_t seq, uint8_t flags,
+	 struct Page *page, size_t off, size_t len)
+{
+	struct tcp_seg s;
+	memset(&s, 0, sizeof(s));
+	s.seq = seq, s.flags = flags;
+	s.ack = (flags & TCP_ACK) ? tsk->rcv_nxt : 0;
+	s.wnd = tcp_rcv_wnd(tsk);
+	s.mss = (flags & TCP_SYN) ? TCP_MSS : 0;
+	s.page = page, s.off = off, s.len = len;
+	uint32_t end = seq + len + ((flags & TCP_SYN) ? 1 : 0)
+	    + ((flags & TCP_FIN) ? 1 : 0);
+	if (SEQ_GT(end, tsk->snd_max)) {
+		tsk->snd_max = end;
+	}
+	if (flags & TCP_ACK) {
+		tsk->rcv_adv = tsk->rcv_nxt + s.wnd;
+	}
+	tcp_xmit_seg(tsk->laddr, tsk->lport, tsk->raddr, tsk->rport, &s,
+		     tsk->cpu);
+}
+
+static void tcp_send_ack(struct tcp_sock *tsk)
+{
+	tcp_xmit(tsk, tsk->snd_nxt, TCP_ACK, NULL, 0, 0);
+}
+
+// tcp_reset_reply - answer s, from src:sport to dst:dport, with a RST
+static void
+tcp_reset_reply(uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport,
+		struct tcp_seg *s)
+{
+	struct tcp_seg r;
+	if (s->flags & TCP_RST) {
+		return;
+	}
+	memset(&r, 0, sizeof(r));
+	if (s->flags & TCP_ACK) {
+		r.seq = s->ack, r.flags = TCP_RST;
+	} else {
+		r.ack = s->seq + s->len + ((s->flags & TCP_SYN) ? 1 : 0)
+		    + ((s->flags & TCP_FIN) ? 1 : 0);
+		r.flags = TCP_RST | TCP_ACK;
+	}
+	tcp_xmit_seg(dst, dport, src, sport, &r, myid());
+}
+
+// tcp_abort - reset the connection of tsk, locked
+static void tcp_abort(struct tcp_sock *tsk)
+{
+	if (tsk->state != TCP_CLOSED && tsk->state != TCP_LISTEN
+	    && tsk->state != TCP_SYN_SENT) {
+		tcp_xmit(tsk, tsk->snd_nxt, TCP_RST | TCP_ACK, NULL, 0, 0);
+	}
+	tcp_done(tsk);
+}
+
+// tcp_sndq_find - the buffer of the send queue holding the byte off from
+//               - snd_una, with its offset in the buffer in *boff
+static struct tcp_sndbuf *tcp_sndq_find(struct tcp_sock *tsk, size_t off,
+					size_t * boff)
+{
+	int i;
+	for (i = 0; i < tsk->sndq_used; i++) {
+		struct tcp_sndbuf *b =
+		    tsk->sndq + (tsk->sndq_head + i) % TCP_SNDQ_BUFS;
+		if (off < b->len) {
+			*boff = off;
+			return b;
+		}
+		off -= b->len;
+	}
+	panic("tcp: byte %lu beyond the send queue.\n", (unsigned long)off);
+}
+
+// tcp_sndq_consume - n bytes from the head of the send queue are acked
+static void tcp_sndq_consume(struct tcp_sock *tsk, size_t n)
+{
+	tsk->sndq_bytes -= n;
+	while (n > 0) {
+		struct tcp_sndbuf *b = tsk->sndq + tsk->sndq_head;
+		size_t m = (n < b->len) ? n : b->len;
+		b->off += m, b->len -= m, n -= m;
+		if (b->len == 0) {
+			tcp_page_put(b->page);
+			tsk->sndq_head = (tsk->sndq_head + 1) % TCP_SNDQ_BUFS;
+			tsk->sndq_used--;
+		}
+	}
+}
+
+// tcp_send_data - send bytes of the queue at off from snd_una, up to n and
+//               - within a buffer; the bytes sent are returned
+static size_t tcp_send_data(struct tcp_sock *tsk, size_t off, size_t n)
+{
+	size_t boff;
+	struct tcp_sndbuf *b = tcp_sndq_find(tsk, off, &boff);
+	if (n > b->len - boff) {
+		n = b->len - boff;
+	}
+	if (n > tsk->mss) {
+		n = tsk->mss;
+	}
+	uint8_t flags = TCP_ACK | ((off + n == tsk->sndq_bytes) ? TCP_PSH : 0);
+	tcp_xmit(tsk, tsk->snd_una + off, flags, b->page, b->off + boff, n);
+	return n;
+}
+
+// tcp_output - send the queued data the windows allow, then the FIN; with
+//            - probe, a byte of it into a window closed by the peer
+static void tcp_output(struct tcp_sock *tsk, bool probe)
+{
+	switch (tsk->state) {
+	case TCP_ESTABLISHED:
+	case TCP_CLOSE_WAIT:
+	case TCP_FIN_WAIT_1:
+	case TCP_CLOSING:
+	case TCP_LAST_ACK:
+		break;
+	default:
+		return;
+	}
+	uint32_t wnd = (tsk->snd_wnd < tsk->cwnd) ? tsk->snd_wnd : tsk->cwnd;
+	if (probe && wnd == 0) {
+		wnd = 1;
+	}
+	while (1) {
+		size_t off = tsk->snd_nxt - tsk->snd_una;
+		if (off >= tsk->sndq_bytes) {
+			if (tsk->fin_queued && !tsk->fin_acked
+			    && off == tsk->sndq_bytes) {
+				tcp_xmit(tsk, tsk->snd_nxt, TCP_FIN | TCP_ACK,
+					 NULL, 0, 0);
+				tsk->fin_sent = 1;
+				tsk->snd_nxt++;
+			}
+			break;
+		}
+		if (off >= wnd) {
+			break;
+		}
+		/* Karn: only a segment sent the first time is timed */
+		if (!tsk->rtt_on && tsk->snd_nxt == tsk->snd_max) {
+			tsk->rtt_on = 1, tsk->rtt_seq = tsk->snd_nxt;
+			tsk->rtt_start = ktime_get_ns();
+		}
+		tsk->snd_nxt += tcp_send_data(tsk, off, wnd - off);
+	}
+	/* to retransmit, or to probe the window closed */
+	if (tsk->timer_due == 0 && (tsk->snd_una != tsk->snd_max
+				    || tsk->sndq_bytes != 0)) {
+		tcp_timer_set(tsk, tsk->rto);
+	}
+}
+
+// tcp_retransmit - send the first segment not acked again
+static void tcp_retransmit(struct tcp_sock *tsk)
+{
+	tsk->rtt_on = 0;
+	if (tsk->sndq_bytes != 0) {
+		tcp_send_data(tsk, 0, tsk->mss);
+	} else if (tsk->fin_sent && !tsk->fin_acked) {
+		tcp_xmit(tsk, tsk->snd_una, TCP_FIN | TCP_ACK, NULL, 0, 0);
+	}
+}
+
+// tcp_rtt_sample - a round trip of rtt ns, after RFC 6298
+static void tcp_rtt_sample(struct tcp_sock *tsk, uint64_t rtt)
+{
+	if (tsk->srtt == 0) {
+		tsk->srtt = rtt, tsk->rttvar = rtt / 2;
+	} else {
+		uint64_t delta = (tsk->srtt > rtt) ? tsk->srtt - rtt :
+		    rtt - tsk->srtt;
+		tsk->rttvar = (3 * tsk->rttvar + delta) / 4;
+		tsk->srtt = (7 * tsk->srtt + rtt) / 8;
+	}
+	tsk->rto = tsk->srtt + ((4 * tsk->rttvar > TIMER_TICK_NSEC) ?
+				4 * tsk->rttvar : TIMER_TICK_NSEC);
+	if (tsk->rto < TCP_RTO_MIN) {
+		tsk->rto = TCP_RTO_MIN;
+	} else if (tsk->rto > TCP_RTO_MAX) {
+		tsk->rto = TCP_RTO_MAX;
+	}
+}
+
+// tcp_ack - the peer acks new data up to ack
+static void tcp_ack(struct tcp_sock *tsk, uint32_t ack)
+{
+	uint32_t acked = ack - tsk->snd_una;
+	size_t n = (acked < tsk->sndq_bytes) ? acked : tsk->sndq_bytes;
+	tcp_sndq_consume(tsk, n);
+	if (acked > n && tsk->fin_sent) {
+		tsk->fin_acked = 1;
+	}
+	tsk->snd_una = ack;
+	if (SEQ_LT(tsk->snd_nxt, ack)) {
+		tsk->snd_nxt = ack;
+	}
+	if (tsk->rtt_on && SEQ_GT(ack, tsk->rtt_seq)) {
+		tsk->rtt_on = 0;
+		tcp_rtt_sample(tsk, ktime_get_ns() - tsk->rtt_start);
+	}
+	if (tsk->cwnd < tsk->ssthresh) {
+		tsk->cwnd += (acked < tsk->mss) ? acked : tsk->mss;
+	} else {
+		tsk->cwnd += tsk->mss * tsk->mss / tsk->cwnd + 1;
+	}
+	if (tsk->cwnd > TCP_MAX_CWND) {
+		tsk->cwnd = TCP_MAX_CWND;
+	}
+	tsk->dupacks = 0, tsk->retries = 0;
+	if (tsk->snd_una == tsk->snd_max) {
+		tsk->timer_due = 0;
+	} else {
+		tcp_timer_set(tsk, tsk->rto);
+	}
+	if (n != 0) {
+		tcp_wakeup(tsk, EPOLLOUT);
+	}
+}
+
+// tcp_established - tsk, connecting or accepted, is established
+static void tcp_established(struct tcp_sock *tsk, struct tcp_seg *s)
+{
+	tsk->state = TCP_ESTABLISHED;
+	tsk->connected = 1;
+	tsk->snd_una = s->ack;
+	tsk->snd_wnd = s->wnd, tsk->snd_wl1 = s->seq, tsk->snd_wl2 = s->ack;
+	tsk->cwnd = 2 * tsk->mss, tsk->ssthresh = TCP_MAX_CWND;
+	tsk->retries = 0, tsk->timer_due = 0;
+	if (tsk->rtt_on) {
+		tsk->rtt_on = 0;
+		tcp_rtt_sample(tsk, ktime_get_ns() - tsk->rtt_start);
+	}
+}
+
+// tcp_rcv_data - copy what fits of the len bytes of data to the ring
+static size_t tcp_rcv_data(struct tcp_sock *tsk, uint8_t * data, size_t len)
+{
+	size_t n = tcp_rcv_wnd(tsk), done = 0;
+	if (len < n) {
+		n = len;
+	}
+	while (done < n) {
+		size_t tail = (tsk->rcv_head + tsk->rcv_bytes) % TCP_RCVBUF;
+		size_t m = TCP_RCVBUF - tail;
+		if (m > n - done) {
+			m = n - done;
+		}
+		memcpy(tsk->rcvbuf + tail, data + done, m);
+		tsk->rcv_bytes += m, done += m;
+	}
+	return n;
+}
+
+// tcp_acceptable - s is within the receive window, RFC 793 p.69
+static bool tcp_acceptable(struct tcp_sock *tsk, struct tcp_seg *s)
+{
+	uint32_t wnd = tcp_rcv_wnd(tsk), seglen = s->len
+	    + ((s->flags & TCP_SYN) ? 1 : 0) + ((s->flags & TCP_FIN) ? 1 : 0);
+	uint32_t lo = tsk->rcv_nxt, hi = tsk->rcv_nxt + wnd;
+	if (seglen == 0) {
+		return (wnd == 0) ? s->seq == lo
+		    : SEQ_GEQ(s->seq, lo) && SEQ_LT(s->seq, hi);
+	}
+	return wnd != 0 && ((SEQ_GEQ(s->seq, lo) && SEQ_LT(s->seq, hi))
+			    || (SEQ_GEQ(s->seq + seglen - 1, lo)
+				&& SEQ_LT(s->seq + seglen - 1, hi)));
+}
+
+// tcp_rcv_syn_sent - s arrives at tsk in SYN_SENT
+static void tcp_rcv_syn_sent(struct tcp_sock *tsk, struct tcp_seg *s)
+{
+	bool ack_ok = (s->flags & TCP_ACK) && SEQ_GT(s->ack, tsk->iss)
+	    && SEQ_LEQ(s->ack, tsk->snd_max);
+	if ((s->flags & TCP_ACK) && !ack_ok) {
+		if (!(s->flags & TCP_RST)) {
+			tcp_xmit(tsk, s->ack, TCP_RST, NULL, 0, 0);
+		}
+		return;
+	}
+	if (s->flags & TCP_RST) {
+		if (ack_ok) {
+			tsk->err = -E_CONNREFUSED;
+			tcp_done(tsk);
+		}
+		return;
+	}
+	if (!(s->flags & TCP_SYN)) {
+		return;
+	}
+	tsk->irs = s->seq, tsk->rcv_nxt = s->seq + 1;
+	if (s->mss != 0 && s->mss < TCP_MSS) {
+		tsk->mss = s->mss;
+	} else {
+		tsk->mss = (s->mss != 0) ? TCP_MSS : TCP_DEFAULT_MSS;
+	}
+	if (ack_ok) {
+		tcp_established(tsk, s);
+		tcp_send_ack(tsk);
+		tcp_wakeup(tsk, EPOLLOUT);
+	} else {
+		/* a simultaneous open */
+		tsk->state = TCP_SYN_RCVD;
+		tcp_xmit(tsk, tsk->iss, TCP_SYN | TCP_ACK, NULL, 0, 0);
+	}
+}
+
+// tcp_rcv - s arrives at tsk, locked, past LISTEN and SYN_SENT, RFC 793
+//         - p.69; the listener a child just established goes to is
+//         - returned with the reference of the child to it
+static struct tcp_sock *tcp_rcv(struct tcp_sock *tsk, struct tcp_seg *s)
+{
+	struct tcp_sock *parent = NULL;
+	bool need_ack = 0;
+	if (!tcp_acceptable(tsk, s)) {
+		if (!(s->flags & TCP_RST)) {
+			tcp_send_ack(tsk);
+		}
+		return NULL;
+	}
+	if (s->flags & TCP_RST) {
+		/* a child reset is just forgotten by its listener */
+		if (tsk->state != TCP_SYN_RCVD) {
+			tsk->err = -E_CONNRESET;
+		}
+		tcp_done(tsk);
+		return NULL;
+	}
+	if (s->flags & TCP_SYN) {
+		tsk->err = -E_CONNRESET;
+		tcp_abort(tsk);
+		return NULL;
+	}
+	if (!(s->flags & TCP_ACK)) {
+		return NULL;
+	}
+	if (tsk->state == TCP_SYN_RCVD) {
+		if (SEQ_LEQ(s->ack, tsk->snd_una)
+		    || SEQ_GT(s->ack, tsk->snd_max)) {
+			tcp_xmit(tsk, s->ack, TCP_RST, NULL, 0, 0);
+			return NULL;
+		}
+		tcp_established(tsk, s);
+		parent = tsk->parent, tsk->parent = NULL;
+	} else if (SEQ_GT(s->ack, tsk->snd_max)) {
+		tcp_send_ack(tsk);
+		return NULL;
+	} else if (SEQ_GT(s->ack, tsk->snd_una)) {
+		tcp_ack(tsk, s->ack);
+	} else if (s->ack == tsk->snd_una && s->len == 0
+		   && !(s->flags & TCP_FIN) && s->wnd == tsk->snd_wnd
+		   && tsk->snd_una != tsk->snd_max && ++tsk->dupacks == 3) {
+		uint32_t flight = tsk->snd_max - tsk->snd_una;
+		tsk->ssthresh = (flight / 2 > 2 * tsk->mss) ? flight / 2 :
+		    2 * tsk->mss;
+		tsk->cwnd = tsk->ssthresh;
+		tcp_retransmit(tsk);
+	}
+	if (SEQ_LT(tsk->snd_wl1, s->seq)
+	    || (tsk->snd_wl1 == s->seq && SEQ_LEQ(tsk->snd_wl2, s->ack))) {
+		tsk->snd_wnd = s->wnd, tsk->snd_wl1 = s->seq;
+		tsk->snd_wl2 = s->ack;
+	}
+	if (tsk->fin_acked) {
+		switch (tsk->state) {
+		case TCP_FIN_WAIT_1:
+			tsk->state = TCP_FIN_WAIT_2;
+			tcp_timer_set(tsk, TCP_FIN_TIMEOUT);
+			break;
+		case TCP_CLOSING:
+			tsk->state = TCP_TIME_WAIT;
+			tcp_timer_set(tsk, TCP_2MSL);
+			break;
+		case TCP_LAST_ACK:
+			tcp_done(tsk);
+			return parent;
+		default:
+			break;
+		}
+	}
+	uint32_t seq = s->seq;
+	if (s->len != 0 && (tsk->state == TCP_ESTABLISHED
+			    || tsk->state == TCP_FIN_WAIT_1
+			    || tsk->state == TCP_FIN_WAIT_2)) {
+		if (tsk->orphan) {
+			/* nobody is left to read it */
+			tcp_abort(tsk);
+			return parent;
+		}
+		size_t skip = tsk->rcv_nxt - seq;
+		if (SEQ_LEQ(seq, tsk->rcv_nxt) && skip < s->len) {
+			size_t n = tcp_rcv_data(tsk, s->data + skip,
+						s->len - skip);
+			if (n != 0) {
+				tsk->rcv_nxt += n;
+				tcp_wakeup(tsk, EPOLLIN);
+			}
+		}
+		need_ack = 1;
+	}
+	/* a FIN sent again falls left of the window, and is ACKed above */
+	if ((s->flags & TCP_FIN) && !tsk->fin_rcvd
+	    && seq + s->len == tsk->rcv_nxt) {
+		tsk->rcv_nxt++, tsk->fin_rcvd = 1;
+		switch (tsk->state) {
+		case TCP_ESTABLISHED:
+			tsk->state = TCP_CLOSE_WAIT;
+			break;
+		case TCP_FIN_WAIT_1:
+			/* its FIN not acked, or it would be in FIN_WAIT_2 */
+			tsk->state = TCP_CLOSING;
+			break;
+		case TCP_FIN_WAIT_2:
+			tsk->state = TCP_TIME_WAIT;
+			tcp_timer_set(tsk, TCP_2MSL);
+			break;
+		default:
+			break;
+		}
+		tcp_wakeup(tsk, EPOLLIN);
+		need_ack = 1;
+	}
+	if (need_ack) {
+		tcp_send_ack(tsk);
+	}
+	tcp_output(tsk, 0);
+	return parent;
+}
+
+// tcp_child_queue - child, just established, goes to the accept queue of
+//                 - parent, with the reference it held on parent
+static void tcp_child_queue(struct tcp_sock *parent, struct tcp_sock *child)
+{
+	bool intr_flag, queued = 0;
+	spin_lock_irqsave(&(parent->lock), intr_flag);
+	if (parent->state == TCP_LISTEN) {
+		list_add_before(&(parent->accept_queue), &(child->accept_link));
+		parent->nr_queued++;
+		atomic_inc(&(child->ref));
+		tcp_wakeup(parent, EPOLLIN);
+		queued = 1;
+	}
+	spin_unlock_irqrestore(&(parent->lock), intr_flag);
+	if (!queued) {
+		spin_lock_irqsave(&(child->lock), intr_flag);
+		tcp_abort(child);
+		spin_unlock_irqrestore(&(child->lock), intr_flag);
+	}
+	tcp_put(parent);
+}
+
+// tcp_rcv_listen - s, from src:sport to dst:dport, arrives at the listener
+//                - lst; a SYN makes a child in SYN_RCVD
+static void
+tcp_rcv_listen(struct tcp_sock *lst, uint32_t src, uint16_t sport,
+	       uint32_t dst, uint16_t dport, struct tcp_seg *s)
+{
+	struct tcp_sock *child;
+	bool intr_flag, ok;
+	if (s->flags & TCP_RST) {
+		return;
+	}
+	if (s->flags & TCP_ACK) {
+		tcp_reset_reply(src, sport, dst, dport, s);
+		return;
+	}
+	if (!(s->flags & TCP_SYN)) {
+		return;
+	}
+	/* a SYN beyond the backlog is dropped, and sent again by the peer */
+	spin_lock_irqsave(&(lst->lock), intr_flag);
+	ok = (lst->state == TCP_LISTEN && lst->nr_queued < lst->backlog);
+	spin_unlock_irqrestore(&(lst->lock), intr_flag);
+	if (!ok || (child = tcp_alloc()) == NULL) {
+		return;
+	}
+	child->laddr = dst, child->lport = dport;
+	child->raddr = src, child->rport = sport;
+	child->irs = s->seq, child->rcv_nxt = s->seq + 1;
+	if (s->mss != 0) {
+		child->mss = (s->mss < TCP_MSS) ? s->mss : TCP_MSS;
+	}
+	child->snd_wnd = s->wnd;
+	child->iss = tcp_new_iss(child);
+	child->snd_una = child->snd_max = child->iss;
+	child->snd_nxt = child->iss + 1;
+	child->state = TCP_SYN_RCVD;
+	if (tcp_hash(child) != 0) {
+		/* a SYN sent again, to another cpu */
+		tcp_put(child);
+		return;
+	}
+	atomic_inc(&(lst->ref));
+	spin_lock_irqsave(&(child->lock), intr_flag);
+	child->parent = lst;
+	child->rtt_on = 1, child->rtt_seq = child->iss;
+	child->rtt_start = ktime_get_ns();
+	tcp_xmit(child, child->iss, TCP_SYN | TCP_ACK, NULL, 0, 0);
+	tcp_timer_set(child, child->rto);
+	spin_unlock_irqrestore(&(child->lock), intr_flag);
+	tcp_put(child);
+}
+
+// tcp_input - a segment of len bytes from src to dst, in the softirq
+void tcp_input(uint32_t src, uint32_t dst, uint8_t * seg, size_t len)
+{
+	struct tcp_hdr *th = (struct tcp_hdr *)seg;
+	struct tcp_sock *tsk, *parent = NULL;
+	struct tcp_seg s;
+	bool intr_flag;
+	size_t hlen;
+	if (len < sizeof(struct tcp_hdr)) {
+		return;
+	}
+	hlen = (th->off >> 4) * 4;
+	if (hlen < sizeof(struct tcp_hdr) || hlen > len
+	    || inet_csum_fold(inet_csum_add(inet_pseudo_csum(src, dst,
+							     IPPROTO_TCP, len),
+					    seg, len)) != 0) {
+		return;
+	}
+	memset(&s, 0, sizeof(s));
+	s.seq = ntohl(th->seq), s.ack = ntohl(th->ack);
+	s.flags = th->flags, s.wnd = ntohs(th->wnd);
+	s.mss = (th->flags & TCP_SYN) ? tcp_parse_mss(th, hlen) : 0;
+	s.data = seg + hlen, s.len = len - hlen;
+	uint16_t sport = ntohs(th->sport), dport = ntohs(th->dport);
+	if ((tsk = tcp_lookup(dst, dport, src, sport)) == NULL) {
+		if ((tsk = tcp_lookup_listener(dst, dport)) != NULL) {
+			tcp_rcv_listen(tsk, src, sport, dst, dport, &s);
+			tcp_put(tsk);
+		} else {
+			tcp_reset_reply(src, sport, dst, dport, &s);
+		}
+		return;
+	}
+	spin_lock_irqsave(&(tsk->lock), intr_flag);
+	switch (tsk->state) {
+	case TCP_CLOSED:
+		tcp_reset_reply(src, sport, dst, dport, &s);
+		break;
+	case TCP_SYN_SENT:
+		tcp_rcv_syn_sent(tsk, &s);
+		break;
+	default:
+		parent = tcp_rcv(tsk, &s);
+	}
+	spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+	if (parent != NULL) {
+		tcp_child_queue(parent, tsk);
+	}
+	tcp_put(tsk);
+}
+
+// tcp_timeout - the timer of tsk, locked, is due
+static void tcp_timeout(struct tcp_sock *tsk)
+{
+	switch (tsk->state) {
+	case TCP_CLOSED:
+	case TCP_LISTEN:
+		return;
+	case TCP_TIME_WAIT:
+	case TCP_FIN_WAIT_2:
+		tcp_done(tsk);
+		return;
+	default:
+		break;
+	}
+	bool probe = (tsk->snd_una == tsk->snd_max);
+	if (!probe && ++tsk->retries > TCP_MAX_RETRIES) {
+		tsk->err = -E_TIMEOUT;
+		tcp_abort(tsk);
+		return;
+	}
+	tsk->rto = (2 * tsk->rto < TCP_RTO_MAX) ? 2 * tsk->rto : TCP_RTO_MAX;
+	tsk->rtt_on = 0;
+	switch (tsk->state) {
+	case TCP_SYN_SENT:
+		tcp_xmit(tsk, tsk->iss, TCP_SYN, NULL, 0, 0);
+		break;
+	case TCP_SYN_RCVD:
+		tcp_xmit(tsk, tsk->iss, TCP_SYN | TCP_ACK, NULL, 0, 0);
+		break;
+	default:
+		if (!probe) {
+			uint32_t flight = tsk->snd_max - tsk->snd_una;
+			tsk->ssthresh = (flight / 2 > 2 * tsk->mss) ?
+			    flight / 2 : 2 * tsk->mss;
+			tsk->cwnd = tsk->mss;
+			tsk->snd_nxt = tsk->snd_una;
+		}
+		tcp_output(tsk, probe);
+		return;
+	}
+	tcp_timer_set(tsk, tsk->rto);
+}
+
+/* *
+ * tcp_timer - the timer of tsk goes off. It is armed lazily: the timer
+ * holds a reference while on a wheel, and timer_due says when it is
+ * really due; one that goes off early is added again for what is left,
+ * and one no longer due just drops its reference. One added again while
+ * this waited for the lock has taken over the reference.
+ * */
+static void tcp_timer(unsigned long data)
+{
+	struct tcp_sock *tsk = (struct tcp_sock *)data;
+	bool intr_flag;
+	spin_lock_irqsave(&(tsk->lock), intr_flag);
+	if (timer_pending(&(tsk->timer))) {
+		spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+		return;
+	}
+	uint64_t now = ktime_get_ns();
+	if (tsk->timer_due != 0 && tsk->timer_due > now) {
+		tsk->timer.expires =
+		    (tsk->timer_due - now) / TIMER_TICK_NSEC + 1;
+		add_timer(&(tsk->timer));
+		spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+		return;
+	}
+	tsk->timer_armed = 0;
+	if (tsk->timer_due != 0) {
+		tsk->timer_due = 0;
+		tcp_timeout(tsk);
+	}
+	spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+	tcp_put(tsk);
+}
+
+// tcp_create - a closed connection, referenced by its socket
+struct tcp_sock *tcp_create(void)
+{
+	struct tcp_sock *tsk;
+	if ((tsk = tcp_alloc()) != NULL) {
+		tsk->cwnd = 2 * TCP_DEFAULT_MSS;
+	}
+	return tsk;
+}
+
+// tcp_bind - bind tsk to addr:port, port 0 for any
+int tcp_bind(struct tcp_sock *tsk, uint32_t addr, uint16_t port)
+{
+	bool intr_flag;
+	int ret = 0;
+	if (addr != INADDR_ANY && !ip_is_local(addr)) {
+		return -E_INVAL;
+	}
+	spin_lock_irqsave(&(tsk->lock), intr_flag);
+	if (tsk->state != TCP_CLOSED || tsk->connected || tsk->lport != 0) {
+		ret = -E_INVAL;
+	} else {
+		spinlock_acquire(&tcp_bind_lock);
+		if (port == 0) {
+			port = tcp_pick_port(addr, 0, 0);
+		} else if (tcp_port_used(addr, port, 0, 0)) {
+			ret = -E_ADDRINUSE;
+		}
+		spinlock_release(&tcp_bind_lock);
+		if (ret == 0 && port == 0) {
+			ret = -E_ADDRINUSE;
+		}
+		if (ret == 0) {
+			tsk->laddr = addr, tsk->lport = port;
+		}
+	}
+	spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+	return ret;
+}
+
+int tcp_listen(struct tcp_sock *tsk, int backlog)
+{
+	bool intr_flag;
+	int ret = 0;
+	spin_lock_irqsave(&(tsk->lock), intr_flag);
+	if (tsk->state == TCP_LISTEN) {
+		tsk->backlog = (backlog > 0) ? backlog : 1;
+		goto out;
+	}
+	if (tsk->state != TCP_CLOSED || tsk->connected) {
+		ret = -E_INVAL;
+		goto out;
+	}
+	spinlock_acquire(&tcp_bind_lock);
+	if (tsk->lport == 0) {
+		tsk->lport = tcp_pick_port(tsk->laddr, 0, 0);
+	}
+	if (tsk->lport == 0 || tcp_port_used(tsk->laddr, tsk->lport, 0, 0)) {
+		ret = -E_ADDRINUSE;
+	} else {
+		spinlock_acquire(&(tcp_listeners.lock));
+		list_add(tcp_listeners.hash + tcp_listen_hashfn(tsk->lport),
+			 &(tsk->hash_link));
+		spinlock_release(&(tcp_listeners.lock));
+		tsk->table = &tcp_listeners;
+		atomic_inc(&(tsk->ref));
+		tsk->state = TCP_LISTEN;
+		tsk->backlog = (backlog > 0) ? backlog : 1;
+	}
+	spinlock_release(&tcp_bind_lock);
+out:
+	spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+	return ret;
+}
+
+// tcp_accept - wait for a connection established on the listener tsk; it
+//            - is stored in *child_store, with its peer
+int
+tcp_accept(struct tcp_sock *tsk, struct tcp_sock **child_store,
+	   uint32_t * addr_store, uint16_t * port_store)
+{
+	bool intr_flag;
+	int ret = 0;
+	spin_lock_irqsave(&(tsk->lock), intr_flag);
+	while (tsk->state == TCP_LISTEN && list_empty(&(tsk->accept_queue))) {
+		if ((ret = tcp_wait(tsk, &intr_flag)) != 0) {
+			goto out;
+		}
+	}
+	if (tsk->state != TCP_LISTEN) {
+		ret = -E_INVAL;
+		goto out;
+	}
+	list_entry_t *le = list_next(&(tsk->accept_queue));
+	list_del_init(le);
+	tsk->nr_queued--;
+	struct tcp_sock *child = le2tsk(le, accept_link);
+	*child_store = child;
+	*addr_store = child->raddr, *port_store = child->rport;
+out:
+	spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+	return ret;
+}
+
+int tcp_connect(struct tcp_sock *tsk, uint32_t addr, uint16_t port)
+{
+	bool intr_flag;
+	int ret = 0;
+	spin_lock_irqsave(&(tsk->lock), intr_flag);
+	if (tsk->state != TCP_CLOSED || tsk->connected || port == 0) {
+		ret = -E_INVAL;
+		goto out;
+	}
+	if (tsk->laddr == INADDR_ANY
+	    && (tsk->laddr = ip_route(addr)) == INADDR_ANY) {
+		ret = -E_NO_DEV;
+		goto out;
+	}
+	tsk->raddr = addr, tsk->rport = port;
+	spinlock_acquire(&tcp_bind_lock);
+	if (tsk->lport == 0) {
+		tsk->lport = tcp_pick_port(tsk->laddr, addr, port);
+	}
+	tsk->cpu = myid();
+	ret = (tsk->lport == 0) ? -E_ADDRINUSE : tcp_hash(tsk);
+	spinlock_release(&tcp_bind_lock);
+	if (ret != 0) {
+		tsk->raddr = 0, tsk->rport = 0;
+		goto out;
+	}
+	tsk->iss = tcp_new_iss(tsk);
+	tsk->snd_una = tsk->snd_max = tsk->iss;
+	tsk->snd_nxt = tsk->iss + 1;
+	tsk->state = TCP_SYN_SENT;
+	tsk->rtt_on = 1, tsk->rtt_seq = tsk->iss;
+	tsk->rtt_start = ktime_get_ns();
+	tcp_xmit(tsk, tsk->iss, TCP_SYN, NULL, 0, 0);
+	tcp_timer_set(tsk, tsk->rto);
+	while (tsk->state == TCP_SYN_SENT || tsk->state == TCP_SYN_RCVD) {
+		if ((ret = tcp_wait(tsk, &intr_flag)) != 0) {
+			goto out;
+		}
+	}
+	if (!tsk->connected) {
+		ret = (tsk->err != 0) ? tsk->err : -E_CONNREFUSED;
+	}
+out:
+	spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+	return ret;
+}
+
+// tcp_recv - wait for data of tsk and copy up to len bytes of it to buf,
+//          - the # in *copied_store; 0 and none copied at the end of it
+int
+tcp_recv(struct tcp_sock *tsk, void *buf, size_t len, size_t * copied_store)
+{
+	bool intr_flag;
+	size_t copied = 0;
+	int ret = 0;
+	spin_lock_irqsave(&(tsk->lock), intr_flag);
+	while (tsk->rcv_bytes == 0 && !tsk->fin_rcvd) {
+		switch (tsk->state) {
+		case TCP_SYN_SENT:
+		case TCP_SYN_RCVD:
+		case TCP_ESTABLISHED:
+		case TCP_FIN_WAIT_1:
+		case TCP_FIN_WAIT_2:
+			if ((ret = tcp_wait(tsk, &intr_flag)) != 0) {
+				goto out;
+			}
+			continue;
+		default:
+			break;
+		}
+		if (tsk->err != 0) {
+			ret = tsk->err;
+		} else if (!tsk->connected) {
+			ret = -E_NOTCONN;
+		}
+		goto out;
+	}
+	while (copied < len && tsk->rcv_bytes != 0) {
+		size_t m = TCP_RCVBUF - tsk->rcv_head;
+		if (m > tsk->rcv_bytes) {
+			m = tsk->rcv_bytes;
+		}
+		if (m > len - copied) {
+			m = len - copied;
+		}
+		memcpy((uint8_t *) buf + copied,
+		       tsk->rcvbuf + tsk->rcv_head, m);
+		tsk->rcv_head = (tsk->rcv_head + m) % TCP_RCVBUF;
+		tsk->rcv_bytes -= m, copied += m;
+	}
+	/* tell the peer of the room made, once it is worth a segment */
+	uint32_t edge = tsk->rcv_nxt + tcp_rcv_wnd(tsk);
+	if (copied != 0 && tsk->connected && tsk->state != TCP_CLOSED
+	    && edge - tsk->rcv_adv >= 2 * tsk->mss) {
+		tcp_send_ack(tsk);
+	}
+out:
+	spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+	*copied_store = copied;
+	return ret;
+}
+
+// tcp_can_send - tsk takes data to send, or the error why not
+static int tcp_can_send(struct tcp_sock *tsk)
+{
+	if (tsk->state == TCP_ESTABLISHED || tsk->state == TCP_CLOSE_WAIT) {
+		return 0;
+	}
+	if (tsk->err != 0) {
+		return tsk->err;
+	}
+	return tsk->connected ? -E_PIPE : -E_NOTCONN;
+}
+
+// tcp_send - queue len bytes of buf to send, waiting for room in the send
+//          - queue; the # queued in *copied_store
+int
+tcp_send(struct tcp_sock *tsk, const void *buf, size_t len,
+	 size_t * copied_store)
+{
+	struct Page *page = NULL;
+	bool intr_flag;
+	size_t copied = 0;
+	int ret = 0;
+	spin_lock_irqsave(&(tsk->lock), intr_flag);
+	while (copied < len && (ret = tcp_can_send(tsk)) == 0) {
+		struct tcp_sndbuf *b = tsk->sndq + (tsk->sndq_head
+						    + tsk->sndq_used +
+						    TCP_SNDQ_BUFS - 1)
+		    % TCP_SNDQ_BUFS;
+		if (tsk->sndq_used != 0 && b->own
+		    && b->off + b->len < PGSIZE) {
+			size_t n = PGSIZE - (b->off + b->len);
+			if (n > len - copied) {
+				n = len - copied;
+			}
+			memcpy((uint8_t *) page2kva(b->page) + b->off + b->len,
+			       (const uint8_t *)buf + copied, n);
+			b->len += n, tsk->sndq_bytes += n, copied += n;
+			tcp_output(tsk, 0);
+			continue;
+		}
+		if (tsk->sndq_used == TCP_SNDQ_BUFS) {
+			if ((ret = tcp_wait(tsk, &intr_flag)) != 0) {
+				break;
+			}
+			continue;
+		}
+		if (page == NULL) {
+			spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+			if ((page = alloc_page()) != NULL) {
+				set_page_ref(page, 1);
+			}
+			spin_lock_irqsave(&(tsk->lock), intr_flag);
+			if (page == NULL) {
+				ret = -E_NO_MEM;
+				break;
+			}
+			continue;
+		}
+		b = tsk->sndq + (tsk->sndq_head + tsk->sndq_used++)
+		    % TCP_SNDQ_BUFS;
+		b->page = page, b->off = b->len = 0, b->own = 1;
+		page = NULL;
+	}
+	spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+	if (page != NULL) {
+		tcp_page_put(page);
+	}
+	*copied_store = copied;
+	return (copied != 0) ? 0 : ret;
+}
+
+// tcp_sendpage - queue the first len bytes of page to send, the reference
+//              - of the caller passing to tsk unless an error is returned
+int tcp_sendpage(struct tcp_sock *tsk, struct Page *page, size_t len)
+{
+	bool intr_flag;
+	int ret;
+	assert(len <= PGSIZE);
+	spin_lock_irqsave(&(tsk->lock), intr_flag);
+	while ((ret = tcp_can_send(tsk)) == 0
+	       && tsk->sndq_used == TCP_SNDQ_BUFS) {
+		if ((ret = tcp_wait(tsk, &intr_flag)) != 0) {
+			break;
+		}
+	}
+	if (ret == 0) {
+		struct tcp_sndbuf *b = tsk->sndq +
+		    (tsk->sndq_head + tsk->sndq_used++) % TCP_SNDQ_BUFS;
+		b->page = page, b->off = 0, b->len = len, b->own = 0;
+		tsk->sndq_bytes += len;
+		tcp_output(tsk, 0);
+	}
+	spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+	return ret;
+}
+
+// tcp_close - the socket of tsk is closed: a listener resets the children
+//           - not accepted, a connection sends its FIN after the data
+//           - queued, or a RST if data received is left unread
+void tcp_close(struct tcp_sock *tsk)
+{
+	struct tcp_sock *child;
+	bool intr_flag;
+	spin_lock_irqsave(&(tsk->lock), intr_flag);
+	tsk->orphan = 1;
+	switch (tsk->state) {
+	case TCP_LISTEN:
+	case TCP_SYN_SENT:
+		tcp_done(tsk);
+		break;
+	case TCP_SYN_RCVD:
+	case TCP_ESTABLISHED:
+	case TCP_CLOSE_WAIT:
+		if (tsk->rcv_bytes != 0) {
+			tcp_abort(tsk);
+			break;
+		}
+		tsk->fin_queued = 1;
+		tsk->state = (tsk->state == TCP_CLOSE_WAIT) ? TCP_LAST_ACK :
+		    TCP_FIN_WAIT_1;
+		tcp_output(tsk, 0);
+		break;
+	default:
+		break;
+	}
+	while (!list_empty(&(tsk->accept_queue))) {
+		list_entry_t *le = list_next(&(tsk->accept_queue));
+		list_del_init(le);
+		tsk->nr_queued--;
+		spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+		child = le2tsk(le, accept_link);
+		spin_lock_irqsave(&(child->lock), intr_flag);
+		tcp_abort(child);
+		spin_unlock_irqrestore(&(child->lock), intr_flag);
+		tcp_put(child);
+		spin_lock_irqsave(&(tsk->lock), intr_flag);
+	}
+	spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+}
+
+// tcp_poll - IOCTL_POLL of the socket of tsk
+void tcp_poll(struct tcp_sock *tsk, struct poll_query *q)
+{
+	bool intr_flag;
+	uint32_t events = 0;
+	spin_lock_irqsave(&(tsk->lock), intr_flag);
+	if (tsk->state == TCP_LISTEN) {
+		if (!list_empty(&(tsk->accept_queue))) {
+			events |= EPOLLIN;
+		}
+	} else {
+		if (tsk->rcv_bytes != 0 || tsk->fin_rcvd) {
+			events |= EPOLLIN;
+		}
+		if (tcp_can_send(tsk) == 0 && tcp_sndq_room(tsk)) {
+			events |= EPOLLOUT;
+		}
+		if (tsk->state == TCP_CLOSED && (tsk->connected || tsk->err)) {
+			events |= EPOLLHUP | ((tsk->err != 0) ? EPOLLERR : 0);
+		}
+	}
+	q->events = events, q->head = &(tsk->poll);
+	spin_unlock_irqrestore(&(tsk->lock), intr_flag);
+}
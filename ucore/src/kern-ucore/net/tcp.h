@@ -0,0 +1,33 @@
+#ifndef __KERN_NET_TCP_H__
+#define __KERN_NET_TCP_H__
+
+#include <types.h>
+
+struct tcp_sock;
+struct Page;
+struct poll_query;
+
+/* *
+ * The TCP connections of the sockets, see tcp.c. The addresses and ports
+ * are in host order. The calls of a proc block as those of a pipe do, and
+ * are followed by net_flush once it has dropped its locks.
+ * */
+void tcp_init(void);
+void tcp_input(uint32_t src, uint32_t dst, uint8_t * seg, size_t len);
+
+struct tcp_sock *tcp_create(void);
+void tcp_put(struct tcp_sock *tsk);
+int tcp_bind(struct tcp_sock *tsk, uint32_t addr, uint16_t port);
+int tcp_listen(struct tcp_sock *tsk, int backlog);
+int tcp_accept(struct tcp_sock *tsk, struct tcp_sock **child_store,
+	       uint32_t * addr_store, uint16_t * port_store);
+int tcp_connect(struct tcp_sock *tsk, uint32_t addr, uint16_t port);
+int tcp_recv(struct tcp_sock *tsk, void *buf, size_t len,
+	     size_t * copied_store);
+int tcp_send(struct tcp_sock *tsk, const void *buf, size_t len,
+	     size_t * copied_store);
+int tcp_sendpage(struct tcp_sock *tsk, struct Page *page, size_t len);
+void tcp_close(struct tcp_sock *tsk);
+void tcp_poll(struct tcp_sock *tsk, struct poll_query *q);
+
+#endif /* !__KERN_NET_TCP_H__ */
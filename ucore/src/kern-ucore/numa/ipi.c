@@ -18,81 +18,108 @@
 
 #include "mp.h"
 #include <sysconf.h>
-
-#define le2ipicall(le, member) \
-	to_struct((le), struct ipi_call, member)
+#include <string.h>
+#include <slab.h>
+#include <error.h>
 
 DEFINE_PERCPU_NOINIT(struct ipi_queue, ipi_queues);
 
+#ifdef ARCH_ARM
+#define ipi_intr_enabled()          (!(read_psrflags() & PSR_I))
+#else
+#define ipi_intr_enabled()          (read_rflags() & FL_IF)
+#endif
+
 void ipi_init(void)
 {
 	struct ipi_queue *q = get_cpu_ptr(ipi_queues);
-	spinlock_init(&q->lock);
-	list_init(&q->head);
-	q->ipi_running = 0;
+	q->head = NULL;
+	q->doorbell = 0;
+}
+
+static void ipi_call_done(struct ipi_call *call)
+{
+	/* a waited call is gone as soon as waiting drops to 0 */
+	int flags = call->flags;
+	if (atomic_dec_test_zero(&call->waiting) && (flags & IPI_CALL_NOWAIT))
+		kfree(call);
 }
 
 void do_ipicall(void)
 {
-	assert(!(read_rflags() & FL_IF));
-	int id = myid();
+	assert(!ipi_intr_enabled());
 	struct ipi_queue *myq = get_cpu_ptr(ipi_queues);
+	struct ipi_node *node, *prev, *next;
 	while(1){
-		spinlock_acquire(&myq->lock);
-		if(list_empty(&myq->head)){
-			myq->ipi_running = 0;
-			spinlock_release(&myq->lock);
-			break;
+		node = __sync_lock_test_and_set(&myq->head, NULL);
+		if(node == NULL){
+			/* senders ring again once the doorbell is down */
+			myq->doorbell = 0;
+			__sync_synchronize();
+			if(myq->head == NULL || __sync_lock_test_and_set(&myq->doorbell, 1))
+				break;
+			continue;
+		}
+		/* newest first, turn it around */
+		for(prev = NULL; node != NULL; node = next){
+			next = node->next;
+			node->next = prev;
+			prev = node;
+		}
+		for(node = prev; node != NULL; node = next){
+			struct ipi_call *call = node->call;
+			next = node->next;
+			assert(call->callback != NULL);
+			call->callback(call);
+			ipi_call_done(call);
 		}
-		/* remove the first call */
-		list_entry_t *first = list_next(&myq->head);
-		list_del(first);
-		/* hack */
-		struct ipi_call *call = le2ipicall(first, call_queue_link[id]);
-		myq->ipi_running = 1;
-		spinlock_release(&myq->lock);
-		assert(call->callback != NULL);
-		call->callback(call);
-
-		atomic_dec(&call->waiting);
 	}
 }
 
-static void start_ipi(struct ipi_call* call, int cpuid)
+/* queue call on every cpu of cs but self, ring the ones that sleep */
+static void ipi_queue_call(struct ipi_call *call, const cpuset_t *cs, int self)
 {
-	bool need_ipi = 0;
-	struct ipi_queue *ipiq = per_cpu_ptr(ipi_queues, cpuid);
-	spinlock_acquire(&ipiq->lock);
-	if( !list_empty(&ipiq->head) && !ipiq->ipi_running)
-		need_ipi = 1;
-	list_add_before(&ipiq->head, &call->call_queue_link[cpuid]);
-	spinlock_release(&ipiq->lock);
-	if(need_ipi)
-		fire_ipi_one(cpuid);
+	cpuset_t bell;
+	int i;
+	memset(&bell, 0, sizeof(bell));
+	for(i=0;i<sysconf.lcpu_count;i++){
+		if(!cpuset_test(cs, i) || i == self)
+			continue;
+		struct ipi_queue *q = per_cpu_ptr(ipi_queues, i);
+		struct ipi_node *node = &call->nodes[i];
+		node->call = call;
+		do{
+			node->next = q->head;
+		}while(!atomic_compare_and_swap(&q->head, node->next, node));
+		if(__sync_lock_test_and_set(&q->doorbell, 1) == 0)
+			cpuset_set(&bell, i);
+	}
+	fire_ipi_mask(&bell);
 }
 
-void ipi_run_on_cpu(const cpuset_t *cs, void *data, void (*cb)(struct ipi_call*))
+static int ipi_prepare(struct ipi_call *call, const cpuset_t *cs, int self,
+		void *data, void (*cb)(struct ipi_call*))
 {
 	int ncpu = 0;
 	int i;
-	struct ipi_call call;
-	bool interruptable = read_rflags() & FL_IF;
-	int id = interruptable ? -1 : myid();
-	memset(&call, 0, sizeof(call));
 	for(i=0;i<sysconf.lcpu_count;i++)
 		if(cpuset_test(cs, i))
 			ncpu++;
-	ncpu -= (!interruptable && cpuset_test(cs, id));
-	atomic_set(&call.waiting, ncpu);
-	call.callback = cb;
-	call.private_data = data;
-	for(i=0;i<sysconf.lcpu_count;i++){
-		if(!cpuset_test(cs, i))
-			continue;
-		if(i == id)
-			continue;
-		start_ipi(&call, i);	
-	}
+	ncpu -= (self >= 0 && cpuset_test(cs, self));
+	atomic_set(&call->waiting, ncpu);
+	call->callback = cb;
+	call->private_data = data;
+	return ncpu;
+}
+
+void ipi_run_on_cpu(const cpuset_t *cs, void *data, void (*cb)(struct ipi_call*))
+{
+	struct ipi_call call;
+	bool interruptable = ipi_intr_enabled();
+	int id = interruptable ? -1 : myid();
+	memset(&call, 0, sizeof(call));
+	ipi_prepare(&call, cs, id, data, cb);
+	ipi_queue_call(&call, cs, id);
 	if(!interruptable && cpuset_test(cs, id))
 		cb(&call);
 	while(atomic_read(&call.waiting))
@@ -100,3 +127,30 @@ void ipi_run_on_cpu(const cpuset_t *cs, void *data, void (*cb)(struct ipi_call*)
 
 }
 
+/* *
+ * ipi_run_on_cpu_nowait - like ipi_run_on_cpu, but return once the call
+ * is queued. data must stay valid until every target has run it.
+ * */
+int ipi_run_on_cpu_nowait(const cpuset_t *cs, void *data, void (*cb)(struct ipi_call*))
+{
+	struct ipi_call *call;
+	bool interruptable = ipi_intr_enabled();
+	int id = interruptable ? -1 : myid();
+	if((call = kmalloc(sizeof(struct ipi_call))) == NULL)
+		return -E_NO_MEM;
+	call->flags = IPI_CALL_NOWAIT;
+	if(ipi_prepare(call, cs, id, data, cb) == 0){
+		if(!interruptable && cpuset_test(cs, id))
+			cb(call);
+		kfree(call);
+		return 0;
+	}
+	/* one extra count, so no target frees it while we still queue */
+	atomic_inc(&call->waiting);
+	ipi_queue_call(call, cs, id);
+	if(!interruptable && cpuset_test(cs, id))
+		cb(call);
+	ipi_call_done(call);
+	return 0;
+}
+
@@ -16,6 +16,9 @@
 struct cpu;
 struct numa_node;
 
+/* SLIT distances, those assumed without one */
+#define NUMA_LOCAL_DISTANCE	10
+#define NUMA_REMOTE_DISTANCE	20
 
 struct numa_node{
 	uint32_t id;
@@ -27,6 +30,10 @@ struct numa_node{
 		uint64_t  length;
 	}mems[MAX_NUMA_MEMS];
 	int cpu_ids[NCPU];
+	uint8_t distance[MAX_NUMA_NODES];	// to each node, by id
+	/* the other nodes, nearest first, where its pages are borrowed from */
+	int nr_fallback;
+	uint32_t fallback[MAX_NUMA_NODES];
 };
 
 struct proc_struct;
@@ -35,6 +42,8 @@ struct proc_struct;
 struct cpu {
 	uint32_t id;  //index of cpus[]
 	uint32_t hwid; //apic id
+	uint32_t core_id;	// shared by the smt threads of a core
+	uint32_t pkg_id;	// shared by the cores of a package, and its llc
 
 	struct numa_node *node;
 	__padout__;
@@ -60,6 +69,12 @@ DECLARE_PERCPU(struct cpu, cpus);
 extern struct numa_node numa_nodes[MAX_NUMA_NODES];
 extern struct numa_mem_zone numa_mem_zones[MAX_NUMA_MEM_ZONES];
 
+/* the SLIT distance from node from to node to, by id */
+static inline int numa_distance(uint32_t from, uint32_t to)
+{
+	return numa_nodes[from].distance[to];
+}
+
 #include <arch_mp.h>
 
 extern pgd_t *mpti_pgdir;
@@ -74,6 +89,13 @@ void mp_set_mm_pagetable(struct mm_struct *mm);
 void __mp_tlb_invalidate(pgd_t * pgdir, uintptr_t la);
 void mp_tlb_invalidate(pgd_t * pgdir, uintptr_t la);
 void mp_tlb_update(pgd_t * pgdir, uintptr_t la);
+/* above this many pages, a range flush may drop the whole tlb instead */
+#define TLB_FLUSH_ALL_PAGES 32
+void mp_tlb_flush_range(pgd_t * pgdir, uintptr_t start, uintptr_t end);
+/* drop the kernel mappings of every cpu, for vmalloc to reuse its addresses */
+void mp_tlb_flush_kernel(void);
+/* make cpu go through schedule() soon, its current has need_resched set */
+void mp_resched_cpu(int cpu);
 
 //we use gs to access percpu variable
 //setup in tls_init
@@ -85,23 +107,35 @@ void cpu_up(int id);
 
 #define myid() (mycpu()->id)
 
+struct ipi_call;
+
+struct ipi_node{
+	struct ipi_node *next;
+	struct ipi_call *call;
+};
+
+#define IPI_CALL_NOWAIT     0x1	/* freed by the last cpu to run it */
+
 struct ipi_call{
 	void *private_data;
 	void (*callback)(struct ipi_call *data);
 	atomic_t waiting;
-	list_entry_t call_queue_link[NCPU]; /* percpu call queue link */
+	int flags;
+	struct ipi_node nodes[NCPU]; /* percpu call queue link */
 };
 
+/* many senders push without a lock, the owner takes all at once */
 struct ipi_queue{
-	spinlock_s lock;
-	bool ipi_running;
-	list_entry_t head;
+	struct ipi_node *volatile head;
+	volatile int doorbell; /* an IPI is on its way, or being served */
 };
 DECLARE_PERCPU(struct ipi_queue, ipi_queues);
 
 void ipi_init(void);
 void do_ipicall(void);
 void ipi_run_on_cpu(const cpuset_t *cs, void *data, void (*cb)(struct ipi_call*));
+int ipi_run_on_cpu_nowait(const cpuset_t *cs, void *data, void (*cb)(struct ipi_call*));
 void fire_ipi_one(int cpuid);
+void fire_ipi_mask(const cpuset_t *cs);
 
 #endif
@@ -15,6 +15,7 @@
 
 #ifndef __PERCPU_H
 #define __PERCPU_H
+#include <types.h>
 #include <arch.h>
 
 // This is like DEFINE_PERCPU, but doesn't call the class's
@@ -39,16 +40,60 @@ extern char __percpu_end[];
 
 #define __my_cpu_offset (percpu_offsets[myid()])
 
-/* TODO: we should disable preempt if the kernel is preemptable,
- * because thread migration will render a percpu var invalid
- */
+/* The var of this cpu is only stable while the proc can't be preempted
+ * (and moved): with interrupts off, a spinlock held or preempt_disable().
+ * this_cpu_add/this_cpu_sub update one from anywhere. */
 #define get_cpu_var(var) (*(typeof(&__percpu_##var))((char*)(&__percpu_##var) - __percpu_start + __my_cpu_offset))
 #define get_cpu_ptr(var) (&get_cpu_var(var))
+#define this_cpu_add(var, n)                                    \
+    do { preempt_disable(); get_cpu_var(var) += (n); preempt_enable(); } while (0)
+#define this_cpu_sub(var, n)                                    \
+    do { preempt_disable(); get_cpu_var(var) -= (n); preempt_enable(); } while (0)
 
 /* helper to get other cpu's percpu var */
 #define per_cpu(var, id) (*(typeof(&__percpu_##var))((char*)(&__percpu_##var) - __percpu_start + percpu_offsets[id]))
 #define per_cpu_ptr(var, id) (&per_cpu(var,id))
 
+/* the same by the address of the var of the boot cpu, for the code that
+ * is handed one (see percpu_counter.h) */
+#define percpu_ptr(ptr, id) ((typeof(ptr))((char*)(ptr) - __percpu_start + percpu_offsets[id]))
+#define this_percpu_ptr(ptr) ((typeof(ptr))((char*)(ptr) - __percpu_start + __my_cpu_offset))
+
+// Per-CPU objects allocated at run time, see percpu_alloc.c
+
+// alloc_percpu gives each cpu a zeroed copy of the object, in a unit of
+// PERCPU_UNIT_SIZE bytes of that cpu, from a page of its node.  The
+// units of a chunk are found by percpu_chunk_base[chunk][cpu], and what
+// alloc_percpu returns is no address but the chunk and the offset in the
+// unit: it is never dereferenced, only handed to per_cpu_dyn_ptr.
+
+#define PERCPU_UNIT_SHIFT   14  // a unit of 4 pages
+#define PERCPU_UNIT_SIZE    (1 << PERCPU_UNIT_SHIFT)
+#define PERCPU_MAX_CHUNKS   64
+
+extern char *percpu_chunk_base[PERCPU_MAX_CHUNKS][NCPU];
+
+void *__alloc_percpu(size_t size, size_t align);
+void free_percpu(void *ptr);
+void percpu_alloc_init(void);
+
+// percpu_alloc_pages - n pages for the units of cpu, of its node; by the arch
+struct Page *percpu_alloc_pages(int cpu, size_t n);
+
+#define alloc_percpu(type) ((type *)__alloc_percpu(sizeof(type), __alignof__(type)))
+
+static inline void *percpu_dyn_addr(void *ptr, int id)
+{
+  uintptr_t p = (uintptr_t)ptr;
+  return percpu_chunk_base[(p >> PERCPU_UNIT_SHIFT) - 1][id]
+    + (p & (PERCPU_UNIT_SIZE - 1));
+}
+
+/* the copy of cpu id of ptr, given by alloc_percpu; this_cpu_dyn_ptr is
+ * only stable as get_cpu_var is */
+#define per_cpu_dyn_ptr(ptr, id) ((typeof(ptr))percpu_dyn_addr((ptr), (id)))
+#define this_cpu_dyn_ptr(ptr) per_cpu_dyn_ptr(ptr, myid())
+
 
 #endif
 
@@ -0,0 +1,196 @@
+#include <types.h>
+#include <string.h>
+#include <pmm.h>
+#include <slab.h>
+#include <sem.h>
+#include <mp.h>
+#include <sysconf.h>
+#include <findbit.h>
+#include <assert.h>
+#include <percpu.h>
+
+/* *
+ * The dynamic per-cpu allocator. A chunk is a unit of PERCPU_UNIT_SIZE
+ * bytes for each cpu, from pages of the node of the cpu, all units cut
+ * the same way: an object is at the same offset in the unit of every
+ * cpu. The units are cut in slots of PERCPU_SLOT bytes, free_map has
+ * the free slots and start_map the first slot of each object, whose end
+ * is the next first slot or free slot.
+ *
+ * Chunks are made as the ones there fill up, up to PERCPU_MAX_CHUNKS, and
+ * kept once empty. alloc_percpu and free_percpu may sleep, they are
+ * serialized by percpu_alloc_sem.
+ * */
+#define PERCPU_SLOT                 8
+#define PERCPU_UNIT_SLOTS           (PERCPU_UNIT_SIZE / PERCPU_SLOT)
+
+struct percpu_chunk {
+	size_t nr_free;		// # of free slots
+	uint32_t free_map[BITS_TO_WORDS(PERCPU_UNIT_SLOTS)];
+	uint32_t start_map[BITS_TO_WORDS(PERCPU_UNIT_SLOTS)];
+};
+
+char *percpu_chunk_base[PERCPU_MAX_CHUNKS][NCPU];
+
+static struct percpu_chunk *percpu_chunks[PERCPU_MAX_CHUNKS];
+static int percpu_nr_chunks;
+static semaphore_t percpu_alloc_sem;
+
+static void percpu_chunk_free_units(int idx)
+{
+	int cpu;
+	for (cpu = 0; cpu < NCPU; cpu++) {
+		if (percpu_chunk_base[idx][cpu] != NULL) {
+			free_pages(kva2page(percpu_chunk_base[idx][cpu]),
+				   PERCPU_UNIT_SIZE / PGSIZE);
+			percpu_chunk_base[idx][cpu] = NULL;
+		}
+	}
+}
+
+// percpu_chunk_create - a chunk of units of every cpu, as chunk idx
+static struct percpu_chunk *percpu_chunk_create(int idx)
+{
+	struct percpu_chunk *chunk;
+	struct Page *page;
+	int cpu;
+	if ((chunk = kmalloc(sizeof(struct percpu_chunk))) == NULL) {
+		return NULL;
+	}
+	for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+		page = percpu_alloc_pages(cpu, PERCPU_UNIT_SIZE / PGSIZE);
+		if (page == NULL) {
+			percpu_chunk_free_units(idx);
+			kfree(chunk);
+			return NULL;
+		}
+		percpu_chunk_base[idx][cpu] = page2kva(page);
+	}
+	memset(chunk, 0, sizeof(struct percpu_chunk));
+	bits_set_range(chunk->free_map, 0, PERCPU_UNIT_SLOTS);
+	chunk->nr_free = PERCPU_UNIT_SLOTS;
+	return chunk;
+}
+
+// percpu_chunk_alloc - the first slot of n free in a row from a multiple
+//                    - of align, taken, or PERCPU_UNIT_SLOTS
+static size_t percpu_chunk_alloc(struct percpu_chunk *chunk, size_t n,
+				 size_t align)
+{
+	size_t start = 0, slot, end;
+	if (chunk->nr_free < n) {
+		return PERCPU_UNIT_SLOTS;
+	}
+	while ((start = find_next_area(chunk->free_map, PERCPU_UNIT_SLOTS,
+				       start, n)) < PERCPU_UNIT_SLOTS) {
+		slot = ROUNDUP(start, align);
+		end = find_next_zero_bit(chunk->free_map, PERCPU_UNIT_SLOTS,
+					 start);
+		if (slot + n <= end) {
+			bits_clear_range(chunk->free_map, slot, n);
+			bits_set(chunk->start_map, slot);
+			chunk->nr_free -= n;
+			return slot;
+		}
+		start = end;
+	}
+	return PERCPU_UNIT_SLOTS;
+}
+
+// __alloc_percpu - a zeroed object of size for each cpu, aligned to align,
+//                - to be reached by per_cpu_dyn_ptr; NULL if out of memory
+void *__alloc_percpu(size_t size, size_t align)
+{
+	size_t n = ROUNDUP_DIV(size, PERCPU_SLOT), slot = PERCPU_UNIT_SLOTS;
+	uintptr_t ptr;
+	int idx, cpu;
+	if (size == 0 || size > PERCPU_UNIT_SIZE) {
+		return NULL;
+	}
+	align = (align > PERCPU_SLOT) ? align / PERCPU_SLOT : 1;
+	down(&percpu_alloc_sem);
+	for (idx = 0; idx < percpu_nr_chunks; idx++) {
+		slot = percpu_chunk_alloc(percpu_chunks[idx], n, align);
+		if (slot != PERCPU_UNIT_SLOTS) {
+			break;
+		}
+	}
+	if (slot == PERCPU_UNIT_SLOTS) {
+		if (idx == PERCPU_MAX_CHUNKS ||
+		    (percpu_chunks[idx] = percpu_chunk_create(idx)) == NULL) {
+			up(&percpu_alloc_sem);
+			return NULL;
+		}
+		percpu_nr_chunks++;
+		slot = percpu_chunk_alloc(percpu_chunks[idx], n, align);
+		assert(slot != PERCPU_UNIT_SLOTS);
+	}
+	ptr = ((uintptr_t) (idx + 1) << PERCPU_UNIT_SHIFT) + slot * PERCPU_SLOT;
+	for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+		memset(percpu_dyn_addr((void *)ptr, cpu), 0, size);
+	}
+	up(&percpu_alloc_sem);
+	return (void *)ptr;
+}
+
+void free_percpu(void *ptr)
+{
+	struct percpu_chunk *chunk;
+	uintptr_t p = (uintptr_t) ptr;
+	size_t slot, end, next;
+	int idx;
+	if (ptr == NULL) {
+		return;
+	}
+	idx = (p >> PERCPU_UNIT_SHIFT) - 1;
+	slot = (p & (PERCPU_UNIT_SIZE - 1)) / PERCPU_SLOT;
+	down(&percpu_alloc_sem);
+	assert(idx >= 0 && idx < percpu_nr_chunks);
+	chunk = percpu_chunks[idx];
+	assert(bits_test(chunk->start_map, slot));
+	end = find_next_bit(chunk->start_map, PERCPU_UNIT_SLOTS, slot + 1);
+	next = find_next_bit(chunk->free_map, PERCPU_UNIT_SLOTS, slot + 1);
+	if (next < end) {
+		end = next;
+	}
+	bits_clear(chunk->start_map, slot);
+	bits_set_range(chunk->free_map, slot, end - slot);
+	chunk->nr_free += end - slot;
+	up(&percpu_alloc_sem);
+}
+
+static void check_percpu_alloc(void)
+{
+	long *a, *c;
+	char *b;
+	int cpu;
+	size_t nr_free;
+	assert((a = alloc_percpu(long)) != NULL);
+	nr_free = percpu_chunks[0]->nr_free;
+	assert((b = __alloc_percpu(100, 64)) != NULL);
+	assert(((uintptr_t) b & 63) == 0);
+	assert((c = alloc_percpu(long)) != NULL);
+	assert(a != c && (char *)c != b);
+	for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+		assert(*per_cpu_dyn_ptr(a, cpu) == 0);
+		*per_cpu_dyn_ptr(a, cpu) = cpu + 1;
+		memset(per_cpu_dyn_ptr(b, cpu), 0xFF, 100);
+	}
+	for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+		assert(*per_cpu_dyn_ptr(a, cpu) == cpu + 1);
+		assert(*per_cpu_dyn_ptr(c, cpu) == 0);
+	}
+	free_percpu(b);
+	free_percpu(c);
+	assert(percpu_chunks[0]->nr_free == nr_free);
+	assert(__alloc_percpu(PERCPU_UNIT_SIZE + 1, 8) == NULL);
+	free_percpu(a);
+	assert(percpu_chunks[0]->nr_free == PERCPU_UNIT_SLOTS);
+}
+
+// percpu_alloc_init - once the procs can sleep, see sync_init
+void percpu_alloc_init(void)
+{
+	sem_init(&percpu_alloc_sem, 1);
+	check_percpu_alloc();
+}
@@ -0,0 +1,76 @@
+#include <types.h>
+#include <sync.h>
+#include <sysconf.h>
+#include <percpu_counter.h>
+
+void percpu_counter_init(struct percpu_counter *fbc, long value)
+{
+	int i;
+	spinlock_init(&fbc->lock);
+	fbc->count = value;
+	/* the areas of the other cpus are zeroed when percpu_init makes them */
+	for (i = 0; i < NCPU; i++) {
+		if (percpu_offsets[i] != NULL) {
+			*percpu_ptr(fbc->delta, i) = 0;
+		}
+	}
+}
+
+// percpu_counter_add - add amount to the delta of this cpu, folded into
+//                    - the count once it is a batch
+void percpu_counter_add(struct percpu_counter *fbc, long amount)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		long *delta = this_percpu_ptr(fbc->delta);
+		long d = *delta + amount;
+		if (d >= PERCPU_COUNTER_BATCH || d <= -PERCPU_COUNTER_BATCH) {
+			spinlock_acquire(&fbc->lock);
+			fbc->count += d;
+			spinlock_release(&fbc->lock);
+			d = 0;
+		}
+		*delta = d;
+	}
+	local_intr_restore(intr_flag);
+}
+
+// percpu_counter_sum - the count with the deltas of all cpus, exact while
+//                    - nobody changes it
+long percpu_counter_sum(struct percpu_counter *fbc)
+{
+	long count;
+	bool intr_flag;
+	int i;
+	local_intr_save(intr_flag);
+	spinlock_acquire(&fbc->lock);
+	{
+		count = fbc->count;
+		/* the cpus without an area yet have no delta */
+		for (i = 0; i < NCPU; i++) {
+			if (percpu_offsets[i] != NULL) {
+				count += *percpu_ptr(fbc->delta, i);
+			}
+		}
+	}
+	spinlock_release(&fbc->lock);
+	local_intr_restore(intr_flag);
+	return count;
+}
+
+// percpu_counter_compare - the count against rhs, like a comparison
+//                        - function; it only sums when they are close
+int percpu_counter_compare(struct percpu_counter *fbc, long rhs)
+{
+	long count = percpu_counter_read(fbc);
+	long error = (long)PERCPU_COUNTER_BATCH * sysconf.lcpu_count;
+	if (count - rhs > error) {
+		return 1;
+	}
+	if (rhs - count > error) {
+		return -1;
+	}
+	count = percpu_counter_sum(fbc);
+	return (count > rhs) - (count < rhs);
+}
@@ -0,0 +1,53 @@
+#ifndef __PERCPU_COUNTER_H
+#define __PERCPU_COUNTER_H
+
+#include <types.h>
+#include <spinlock.h>
+#include <mp.h>
+#include <percpu.h>
+
+/* *
+ * percpu_counter - a count changed often from every cpu and read seldom,
+ * like the pages in use. A change goes to the delta of this cpu, a percpu
+ * var, and is only folded into count, under lock, once the delta reaches
+ * PERCPU_COUNTER_BATCH either way: the cpus don't bounce the line of the
+ * count on every change. percpu_counter_read is off by less than a batch
+ * per cpu, percpu_counter_sum adds the deltas up.
+ * */
+struct percpu_counter {
+	spinlock_s lock;
+	long count;		// the deltas folded so far
+	long *delta;		// the delta of the boot cpu, see percpu_ptr
+};
+
+#define PERCPU_COUNTER_BATCH            32
+
+/* a counter with its delta, percpu_counter_init must still be called */
+#define DEFINE_PERCPU_COUNTER(name)                                 \
+    static DEFINE_PERCPU_NOINIT(long, name##_delta);                \
+    static struct percpu_counter name = {                           \
+        .delta = &__percpu_##name##_delta,                          \
+    }
+
+void percpu_counter_init(struct percpu_counter *fbc, long value);
+void percpu_counter_add(struct percpu_counter *fbc, long amount);
+long percpu_counter_sum(struct percpu_counter *fbc);
+int percpu_counter_compare(struct percpu_counter *fbc, long rhs);
+
+#define percpu_counter_inc(fbc)         percpu_counter_add(fbc, 1)
+#define percpu_counter_dec(fbc)         percpu_counter_add(fbc, -1)
+#define percpu_counter_sub(fbc, n)      percpu_counter_add(fbc, -(long)(n))
+
+static inline long percpu_counter_read(struct percpu_counter *fbc)
+{
+	return fbc->count;
+}
+
+/* the deltas not folded yet may take a count of things below 0 */
+static inline long percpu_counter_read_positive(struct percpu_counter *fbc)
+{
+	long count = fbc->count;
+	return (count > 0) ? count : 0;
+}
+
+#endif /* !__PERCPU_COUNTER_H */
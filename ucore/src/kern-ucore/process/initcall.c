@@ -0,0 +1,83 @@
+#include <types.h>
+#include <stdio.h>
+#include <kio.h>
+#include <assert.h>
+#include <mp.h>
+#include <sysconf.h>
+#include <proc.h>
+#include <sched.h>
+#include <initcall.h>
+#ifdef UCONFIG_BOOT_TIME
+#include <boottime.h>
+#endif
+
+#define ASYNC_INITCALLS_MAX         8
+
+struct async_initcall {
+	const char *name;
+	void (*fn) (void);
+	int pid;		// of the thread running it, 0 before
+};
+
+static struct async_initcall calls[ASYNC_INITCALLS_MAX];
+static int nr_calls;
+
+// async_initcall - queue fn to be run by async_initcalls_run
+void async_initcall(const char *name, void (*fn) (void))
+{
+	assert(nr_calls < ASYNC_INITCALLS_MAX);
+	calls[nr_calls].name = name;
+	calls[nr_calls].fn = fn;
+	nr_calls++;
+}
+
+static int async_initcall_main(void *arg)
+{
+	struct async_initcall *call = arg;
+#ifdef UCONFIG_BOOT_TIME
+	uint64_t start = rdtsc();
+#endif
+	call->fn();
+#ifdef UCONFIG_BOOT_TIME
+	boot_time_add(call->name, start);
+#endif
+	return 0;
+}
+
+// async_initcalls_run - start a kernel thread, child of current, for each
+//                     - initcall queued, pinned round robin to the cpus
+//                     - but this one and the isolated ones
+void async_initcalls_run(void)
+{
+	int i, j, cpu = myid();
+	for (i = 0; i < nr_calls; i++) {
+		struct async_initcall *call = calls + i;
+		if ((call->pid = ucore_kernel_thread(async_initcall_main, call,
+						     0)) <= 0) {
+			panic("async initcall %s failed.\n", call->name);
+		}
+		struct proc_struct *proc = find_proc(call->pid);
+		set_proc_name(proc, call->name);
+		/* the next cpu neither this one nor isolated, if any */
+		for (j = 0; j < sysconf.lcpu_count; j++) {
+			cpu = (cpu + 1) % sysconf.lcpu_count;
+			if (cpu != myid() && !sched_cpu_isolated(cpu)) {
+				sched_setaffinity(proc, cpu);
+				break;
+			}
+		}
+	}
+}
+
+// async_initcalls_wait - reap the threads of async_initcalls_run
+void async_initcalls_wait(void)
+{
+	int i;
+	for (i = 0; i < nr_calls; i++) {
+		if (calls[i].pid > 0) {
+			assert(do_wait(calls[i].pid, NULL) == 0);
+			calls[i].pid = 0;
+		}
+	}
+	nr_calls = 0;
+}
@@ -0,0 +1,16 @@
+#ifndef __KERN_PROCESS_INITCALL_H__
+#define __KERN_PROCESS_INITCALL_H__
+
+#include <types.h>
+
+/* *
+ * The async initcalls: kern_init queues the inits that nothing before
+ * init_main depends on, init_main runs them on kernel threads of their
+ * own, spread over the cpus, and waits for them before mounting the
+ * boot fs.
+ * */
+void async_initcall(const char *name, void (*fn) (void));
+void async_initcalls_run(void);
+void async_initcalls_wait(void);
+
+#endif /* !__KERN_PROCESS_INITCALL_H__ */
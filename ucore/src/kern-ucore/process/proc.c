@@ -16,6 +16,7 @@
 #include <elf.h>
 #include <fs.h>
 #include <vfs.h>
+#include <inode.h>
 #include <sysfile.h>
 #include <swap.h>
 #include <mbox.h>
@@ -26,6 +27,38 @@
 #include <sysconf.h>
 #include <refcache.h>
 #include <spinlock.h>
+#include <percpu_counter.h>
+#include <ksm.h>
+#include <compaction.h>
+#include <execmap.h>
+#include <vdso.h>
+#include <file.h>
+#include <trace.h>
+#include <initcall.h>
+#include <workqueue.h>
+#include <tlb.h>
+#include <memcg.h>
+#include <cpucg.h>
+#include <rtmutex.h>
+#include <findbit.h>
+#include <runqueue.h>
+#include <timekeeping.h>
+#include <hrtimer.h>
+#ifdef ARCH_AMD64
+#include <fpu.h>
+#endif
+#ifdef UCONFIG_PERF_EVENT
+#include <perf.h>
+#endif
+#ifdef UCONFIG_BOOT_TIME
+#include <boottime.h>
+#endif
+#ifdef UCONFIG_SFS_PAGE_CACHE
+#include <sfs.h>
+#endif
+#ifdef UCONFIG_VIRTIO_BALLOON
+#include <virtio_balloon.h>
+#endif
 
 /* ------------- process/thread mechanism design&implementation -------------
 (an simplified Linux process/thread mechanism )
@@ -74,6 +107,8 @@ SYS_getpid      : get the process's pid
 */
 
 struct proc_struct *initproc;
+/* dedicated cache for proc_struct, created in proc_init */
+kmem_cache_t *proc_cachep;
 #ifdef UCONFIG_SWAP
 struct proc_struct *kswapd;
 #endif
@@ -85,13 +120,16 @@ list_entry_t proc_list;
 // the process set's mm's list
 list_entry_t proc_mm_list;
 
-#define HASH_SHIFT          10
-#define HASH_LIST_SIZE      (1 << HASH_SHIFT)
-#define pid_hashfn(x)       (hash32(x, HASH_SHIFT))
-
-// has list for process set based on pid
-static list_entry_t hash_list[HASH_LIST_SIZE];
-static int nr_process = 0;
+/* *
+ * The pids of the process set: bit pid of pid_map is set while pid is
+ * taken, and pid_table maps it to its proc. A new pid is the next free one
+ * after the last given out, so a pid is not soon reused. The idle procs
+ * keep the pids below sysconf.lcpu_count, out of the tables.
+ * */
+static uint32_t pid_map[BITS_TO_WORDS(MAX_PID)];
+static struct proc_struct *pid_table[MAX_PID];
+static int last_pid = MAX_PID - 1;
+DEFINE_PERCPU_COUNTER(nr_process);
 
 ////////////////////////////////////////////////
 
@@ -124,13 +162,14 @@ static void set_links(struct proc_struct *proc)
 		proc->optr->yptr = proc;
 	}
 	proc->parent->cptr = proc;
-	nr_process++;
+	percpu_counter_inc(&nr_process);
 }
 
 // remove_links - clean the relation links of process
 static void remove_links(struct proc_struct *proc)
 {
 	list_del(&(proc->list_link));
+	list_del_init(&(proc->zombie_link));
 	if (proc->optr != NULL) {
 		proc->optr->yptr = proc->yptr;
 	}
@@ -139,42 +178,27 @@ static void remove_links(struct proc_struct *proc)
 	} else {
 		proc->parent->cptr = proc->optr;
 	}
-	nr_process--;
+	percpu_counter_dec(&nr_process);
+}
+
+// pid_map_find - the first free pid in [start, end), -1 if none
+static int pid_map_find(int start, int end)
+{
+	int pid = find_next_zero_bit(pid_map, end, start);
+	return (pid < end) ? pid : -1;
 }
 
-// get_pid - alloc a unique pid for process
+// get_pid - alloc a unique pid for process, called with proc_lock held
 static int get_pid(void)
 {
 	static_assert(MAX_PID > MAX_PROCESS);
-	struct proc_struct *proc;
-	list_entry_t *list = &proc_list, *le;
-	static int next_safe = MAX_PID, last_pid = MAX_PID;
-	if (++last_pid >= MAX_PID) {
-		last_pid = sysconf.lcpu_count;
-		goto inside;
-	}
-	if (last_pid >= next_safe) {
-inside:
-		next_safe = MAX_PID;
-repeat:
-		le = list;
-		while ((le = list_next(le)) != list) {
-			proc = le2proc(le, list_link);
-			if (proc->pid == last_pid) {
-				if (++last_pid >= next_safe) {
-					if (last_pid >= MAX_PID) {
-						last_pid = 1;
-					}
-					next_safe = MAX_PID;
-					goto repeat;
-				}
-			} else if (proc->pid > last_pid
-				   && next_safe > proc->pid) {
-				next_safe = proc->pid;
-			}
-		}
+	int pid;
+	if ((pid = pid_map_find(last_pid + 1, MAX_PID)) < 0) {
+		pid = pid_map_find(sysconf.lcpu_count, last_pid + 1);
 	}
-	return last_pid;
+	assert(pid > 0);
+	bits_set(pid_map, pid);
+	return last_pid = pid;
 }
 
 // proc_run - make process "proc" running on cpu
@@ -187,50 +211,135 @@ void proc_run(struct proc_struct *proc)
 		// kprintf("(%d) => %d\n", lapic_id, next->pid);
 		local_intr_save(intr_flag);
 		{
+			trace_event(TRACE_SCHED_SWITCH, prev->pid, next->pid);
 			current = proc;
 			load_rsp0(next->kstack + KSTACKSIZE);
-			mp_set_mm_pagetable(next->mm);
+#ifdef UCONFIG_LAZY_TLB
+			/* kernel threads never touch user space */
+			if (next->mm == NULL)
+				mp_lazy_tlb_enter();
+			else
+#endif
+				mp_set_mm_pagetable(next->mm);
 
-#ifdef UCONFIG_BIONIC_LIBC
-			// for tls switch
-			tls_switch(next);
-#endif //UCONFIG_BIONIC_LIBC
+			/* skipped when next runs with the tls of prev */
+			tls_switch(prev, next);
+#ifdef ARCH_AMD64
+			fpu_switch(prev, next);
+#endif
+#ifdef UCONFIG_PERF_EVENT
+			perf_switch(prev, next);
+#endif
 			switch_to(&(prev->context), &(next->context));
 		}
 		local_intr_restore(intr_flag);
 	}
 }
 
-// hash_proc - add proc into proc hash_list
+// hash_proc - add proc into pid_table, at the pid from get_pid
 static void hash_proc(struct proc_struct *proc)
 {
-	list_add(hash_list + pid_hashfn(proc->pid), &(proc->hash_link));
+	assert(pid_table[proc->pid] == NULL);
+	rcu_assign_pointer(pid_table[proc->pid], proc);
 }
 
-// unhash_proc - delete proc from proc hash_list
+// unhash_proc - delete proc from pid_table, its pid is free again
 static void unhash_proc(struct proc_struct *proc)
 {
-	list_del(&(proc->hash_link));
+	int pid = proc->pid;
+	assert(pid_table[pid] == proc);
+	pid_table[pid] = NULL;
+	bits_clear(pid_map, pid);
+}
+
+// proc_free_rcu - free a proc waited for, no find_proc may see it any more
+static void proc_free_rcu(struct rcu_head *head)
+{
+	struct proc_struct *proc = to_struct(head, struct proc_struct, rcu);
+#ifdef ARCH_AMD64
+	fpu_free(proc);
+#endif
+#ifdef UCONFIG_PERF_EVENT
+	perf_free(proc);
+#endif
+	kmem_cache_free(proc_cachep, proc);
 }
 
-// find_proc - find proc frome proc hash_list according to pid
+// find_proc - find proc by pid, a lookup in pid_table without a lock;
+//           - the proc stays until rcu_read_unlock, or until it is waited
+//           - for if it is current or a child of current
 struct proc_struct *find_proc(int pid)
 {
 	if (0 < pid && pid < MAX_PID) {
-		list_entry_t *list = hash_list + pid_hashfn(pid), *le = list;
-		while ((le = list_next(le)) != list) {
-			struct proc_struct *proc = le2proc(le, hash_link);
-			if (proc->pid == pid) {
-				return proc;
-			}
-		}
+		return rcu_dereference(pid_table[pid]);
 	}
 	return NULL;
 }
 
+/* *
+ * Each cpu keeps the last few kernel stacks and page directories freed on
+ * it, for the next forks there to take without the buddy allocator. A
+ * pgdir keeps its kernel half: the user half is empty again once exit_mmap
+ * is done, so only map_pgdir is left to do, unless the kernel half of
+ * boot_pgdir grew since, see kern_pgdir_gen. The proc_structs have the
+ * magazines of proc_cachep already. The lock of a cache is only contended
+ * by proc_cache_drain.
+ * */
+#define PROC_CACHE_DEPTH        4
+
+#ifdef ARCH_ARM
+#define PGDIR_ALLOC_PAGES       8	// a 16K pgdir, 16K aligned
+#define kern_pgdir_gen()        boot_pgdir_gen
+#else
+#define PGDIR_ALLOC_PAGES       1
+#define kern_pgdir_gen()        0
+#endif
+
+struct pgdir_cache_entry {
+	pgd_t *pgdir;
+	void *alloc_addr;	// the PGDIR_ALLOC_PAGES pgdir is in
+	uint32_t gen;		// kern_pgdir_gen() when it was made
+};
+
+struct proc_cache {
+	spinlock_s lock;
+	int nr_kstacks, nr_pgdirs;
+	uintptr_t kstacks[PROC_CACHE_DEPTH];
+	struct pgdir_cache_entry pgdirs[PROC_CACHE_DEPTH];
+};
+
+static DEFINE_PERCPU_NOINIT(struct proc_cache, proc_caches);
+
+static inline struct proc_cache *proc_cache_lock(bool * intr_flag)
+{
+	struct proc_cache *pc;
+	local_intr_save(*intr_flag);
+	pc = get_cpu_ptr(proc_caches);
+	spinlock_acquire(&(pc->lock));
+	return pc;
+}
+
+static inline void proc_cache_unlock(struct proc_cache *pc, bool intr_flag)
+{
+	spinlock_release(&(pc->lock));
+	local_intr_restore(intr_flag);
+}
+
 // setup_kstack - alloc pages with size KSTACKPAGE as process kernel stack
 static int setup_kstack(struct proc_struct *proc)
 {
+	struct proc_cache *pc;
+	bool intr_flag;
+	proc->kstack = 0;
+	pc = proc_cache_lock(&intr_flag);
+	if (pc->nr_kstacks > 0) {
+		proc->kstack = pc->kstacks[--pc->nr_kstacks];
+	}
+	proc_cache_unlock(pc, intr_flag);
+	if (proc->kstack != 0) {
+		return 0;
+	}
+
 	struct Page *page = alloc_pages(KSTACKPAGE);
 	if (page != NULL) {
 		proc->kstack = (uintptr_t) page2kva(page);
@@ -242,7 +351,85 @@ static int setup_kstack(struct proc_struct *proc)
 // put_kstack - free the memory space of process kernel stack
 static void put_kstack(struct proc_struct *proc)
 {
-	free_pages(kva2page((void *)(proc->kstack)), KSTACKPAGE);
+	struct proc_cache *pc;
+	bool intr_flag, cached = 0;
+	pc = proc_cache_lock(&intr_flag);
+	if (pc->nr_kstacks < PROC_CACHE_DEPTH) {
+		pc->kstacks[pc->nr_kstacks++] = proc->kstack;
+		cached = 1;
+	}
+	proc_cache_unlock(pc, intr_flag);
+	if (!cached) {
+		free_pages(kva2page((void *)(proc->kstack)), KSTACKPAGE);
+	}
+}
+
+// pgdir_cache_get - a cached pgdir for mm, NULL if none of this cpu is
+//                 - still current
+static pgd_t *pgdir_cache_get(struct mm_struct *mm)
+{
+	struct pgdir_cache_entry ent = { NULL, NULL, 0 }, stale = ent;
+	struct proc_cache *pc;
+	bool intr_flag;
+	pc = proc_cache_lock(&intr_flag);
+	if (pc->nr_pgdirs > 0) {
+		ent = pc->pgdirs[--pc->nr_pgdirs];
+		if (ent.gen != kern_pgdir_gen()) {
+			stale = ent, ent.pgdir = NULL;
+		}
+	}
+	proc_cache_unlock(pc, intr_flag);
+	if (stale.pgdir != NULL) {
+		free_pages(kva2page(stale.alloc_addr), PGDIR_ALLOC_PAGES);
+	}
+	if (ent.pgdir != NULL) {
+		map_pgdir(ent.pgdir);
+		mm->pgdir = ent.pgdir;
+#ifdef ARCH_ARM
+		mm->pgdir_alloc_addr = ent.alloc_addr;
+#endif
+	}
+	return ent.pgdir;
+}
+
+// pgdir_cache_put - cache the pgdir of mm, its user half empty; false if
+//                 - the cache of this cpu is full
+static bool pgdir_cache_put(struct mm_struct *mm, void *alloc_addr)
+{
+	struct proc_cache *pc;
+	bool intr_flag, cached = 0;
+	pc = proc_cache_lock(&intr_flag);
+	if (pc->nr_pgdirs < PROC_CACHE_DEPTH) {
+		struct pgdir_cache_entry *ent = pc->pgdirs + pc->nr_pgdirs++;
+		ent->pgdir = mm->pgdir, ent->alloc_addr = alloc_addr;
+		ent->gen = kern_pgdir_gen();
+		cached = 1;
+	}
+	proc_cache_unlock(pc, intr_flag);
+	return cached;
+}
+
+// proc_cache_drain - free what the caches of all cpus hold, so that
+//                  - nr_used_pages only counts the stacks & pgdirs in use
+static void proc_cache_drain(void)
+{
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct proc_cache *pc = per_cpu_ptr(proc_caches, i);
+		bool intr_flag;
+		local_intr_save(intr_flag);
+		spinlock_acquire(&(pc->lock));
+		while (pc->nr_kstacks > 0) {
+			uintptr_t kstack = pc->kstacks[--pc->nr_kstacks];
+			free_pages(kva2page((void *)kstack), KSTACKPAGE);
+		}
+		while (pc->nr_pgdirs > 0) {
+			void *alloc_addr = pc->pgdirs[--pc->nr_pgdirs].alloc_addr;
+			free_pages(kva2page(alloc_addr), PGDIR_ALLOC_PAGES);
+		}
+		spinlock_release(&(pc->lock));
+		local_intr_restore(intr_flag);
+	}
 }
 
 // setup_pgdir - alloc one page as PDT
@@ -251,6 +438,9 @@ static void put_kstack(struct proc_struct *proc)
 static int setup_pgdir(struct mm_struct *mm)
 {
 	struct Page *page;
+	if (pgdir_cache_get(mm) != NULL) {
+		return 0;
+	}
 	if ((page = alloc_page()) == NULL) {
 		return -E_NO_MEM;
 	}
@@ -264,16 +454,21 @@ static int setup_pgdir(struct mm_struct *mm)
 // put_pgdir - free the memory space of PDT
 static void put_pgdir(struct mm_struct *mm)
 {
-	free_page(kva2page(mm->pgdir));
+	if (!pgdir_cache_put(mm, mm->pgdir)) {
+		free_page(kva2page(mm->pgdir));
+	}
 }
 #else
 /* ARM PDT is 16k */
 static int setup_pgdir(struct mm_struct *mm)
 {
 	struct Page *page;
+	if (pgdir_cache_get(mm) != NULL) {
+		return 0;
+	}
 	/* 4 * 4K = 16K */
 	/* dirty hack */
-	if ((page = alloc_pages(8)) == NULL) {
+	if ((page = alloc_pages(PGDIR_ALLOC_PAGES)) == NULL) {
 		return -E_NO_MEM;
 	}
 	pgd_t *pgdir_start = page2kva(page);
@@ -290,9 +485,78 @@ static int setup_pgdir(struct mm_struct *mm)
 static void put_pgdir(struct mm_struct *mm)
 {
 	assert(mm->pgdir_alloc_addr);
-	free_pages(kva2page(mm->pgdir_alloc_addr), 8);
+	if (!pgdir_cache_put(mm, mm->pgdir_alloc_addr)) {
+		free_pages(kva2page(mm->pgdir_alloc_addr), PGDIR_ALLOC_PAGES);
+	}
+}
+#endif
+
+// mm_free - free mm, at zero and off proc_mm_list, with its memory
+static void mm_free(struct mm_struct *mm)
+{
+	exit_mmap(mm);
+	put_pgdir(mm);
+	mm_destroy(mm);
+}
+
+#ifdef UCONFIG_MM_REAP
+/* *
+ * An mm dropped for the last time waits on mm_reap_list, linked by its
+ * proc_mm_link, for mm_reap_work to free it from a kworker, so that exit
+ * and exec, and so the wait of the parent, do not take longer for a larger
+ * process. The pages of an mm still go after one shootdown, into the
+ * per-cpu lists of the cpu of the kworker.
+ * */
+static list_entry_t mm_reap_list;
+static spinlock_s mm_reap_lock;
+static struct work_struct mm_reap_work;
+
+static void mm_reap(struct work_struct *work)
+{
+	list_entry_t *le;
+	bool intr_flag;
+	while (1) {
+		spin_lock_irqsave(&mm_reap_lock, intr_flag);
+		if ((le = list_next(&mm_reap_list)) != &mm_reap_list) {
+			list_del(le);
+		}
+		spin_unlock_irqrestore(&mm_reap_lock, intr_flag);
+		if (le == &mm_reap_list) {
+			break;
+		}
+		mm_free(le2mm(le, proc_mm_link));
+	}
+}
+
+// mm_reap_drain - wait until the mms dropped by now are freed, for the
+//               - memory checks of init_main
+static void mm_reap_drain(void)
+{
+	flush_work(&mm_reap_work);
 }
+#endif /* UCONFIG_MM_REAP */
+
+// put_mm - drop a reference to mm, and free it with its memory if that was
+//        - the last one; with UCONFIG_MM_REAP that is left to mm_reap
+void put_mm(struct mm_struct *mm)
+{
+	if (mm_count_dec(mm) == 0) {
+		bool intr_flag;
+		local_intr_save(intr_flag);
+		{
+			list_del(&(mm->proc_mm_link));
+		}
+		local_intr_restore(intr_flag);
+#ifdef UCONFIG_MM_REAP
+		spin_lock_irqsave(&mm_reap_lock, intr_flag);
+		list_add_before(&mm_reap_list, &(mm->proc_mm_link));
+		spin_unlock_irqrestore(&mm_reap_lock, intr_flag);
+		schedule_work(&mm_reap_work);
+#else
+		mm_free(mm);
 #endif
+	}
+}
 
 // de_thread - delete this thread "proc" from thread_group list
 static void de_thread(struct proc_struct *proc)
@@ -315,6 +579,52 @@ struct proc_struct *next_thread(struct proc_struct *proc)
 	return le2proc(list_next(&(proc->thread_group)), thread_group);
 }
 
+/* *
+ * A child that exits is queued on the zombie_list of its parent, so that
+ * do_wait for any child takes the first one of the lists of its threads
+ * rather than going over all the children, and only the threads waiting
+ * for any child or for that one are woken.
+ * */
+static void proc_wait_init(struct proc_struct *proc)
+{
+	list_init(&(proc->zombie_list));
+	list_init(&(proc->zombie_link));
+	proc->wait_pid = 0;
+}
+
+#define le2zombie(le)               le2proc(le, zombie_link)
+
+// wakeup_waiters - wake the threads of the group of parent waiting for
+//                - child, called with the interrupts off
+static void wakeup_waiters(struct proc_struct *parent, struct proc_struct *child)
+{
+	struct proc_struct *proc = parent;
+	do {
+		if (proc->wait_state == WT_CHILD
+		    && (proc->wait_pid == 0 || proc->wait_pid == child->pid)) {
+			wakeup_proc(proc);
+		}
+		proc = next_thread(proc);
+	} while (proc != parent);
+}
+
+// first_zombie - the oldest exited child of the threads of current, with
+//              - *haskid telling if they have children at all
+static struct proc_struct *first_zombie(bool * haskid)
+{
+	struct proc_struct *cproc = current;
+	do {
+		if (cproc->cptr != NULL) {
+			*haskid = 1;
+			if (!list_empty(&(cproc->zombie_list))) {
+				return le2zombie(list_next(&(cproc->zombie_list)));
+			}
+		}
+		cproc = next_thread(cproc);
+	} while (cproc != current);
+	return NULL;
+}
+
 // copy_mm - process "proc" duplicate OR share process "current"'s mm according clone_flags
 //         - if clone_flags & CLONE_VM, then "share" ; else "duplicate"
 static int copy_mm(uint32_t clone_flags, struct proc_struct *proc)
@@ -334,6 +644,9 @@ static int copy_mm(uint32_t clone_flags, struct proc_struct *proc)
 	if ((mm = mm_create()) == NULL) {
 		goto bad_mm;
 	}
+#ifdef UCONFIG_MEMCG
+	mm->memcg = memcg_get(proc->memcg);
+#endif
 	if (setup_pgdir(mm) != 0) {
 		goto bad_pgdir_cleanup_mm;
 	}
@@ -344,14 +657,6 @@ static int copy_mm(uint32_t clone_flags, struct proc_struct *proc)
 	}
 	unlock_mm(oldmm);
 
-#ifdef UCONFIG_BIONIC_LIBC
-	lock_mm(mm);
-	{
-		ret = remapfile(mm, proc);
-	}
-	unlock_mm(mm);
-#endif //UCONFIG_BIONIC_LIBC
-
 	if (ret != 0) {
 		goto bad_dup_cleanup_mmap;
 	}
@@ -360,6 +665,11 @@ good_mm:
 	if (mm != oldmm) {
 		mm->brk_start = oldmm->brk_start;
 		mm->brk = oldmm->brk;
+		mm->vvar_addr = oldmm->vvar_addr;
+#ifdef UCONFIG_NUMA_POLICY
+		mm->mempolicy = oldmm->mempolicy;
+		mm->mempolicy_node = oldmm->mempolicy_node;
+#endif
 		bool intr_flag;
 		local_intr_save(intr_flag);
 		{
@@ -464,6 +774,7 @@ static void put_signal(struct proc_struct *proc)
 {
 	struct signal_struct *sig = proc->signal_info.signal;
 	if (sig != NULL) {
+		flush_sigqueue(&(proc->signal_info.pending));
 		if (signal_count_dec(sig) == 0) {
 			signal_destroy(sig);
 		}
@@ -558,16 +869,62 @@ void may_killed(void)
 	}
 }
 
+// vfork_release - let the vfork parent of current go on, the child has run
+//               - a new image or is exiting with exit_code then
+static void vfork_release(bool exited)
+{
+	struct vfork_done *vfork;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		if ((vfork = current->vfork_done) != NULL) {
+			current->vfork_done = NULL;
+			vfork->exited = exited;
+			vfork->exit_code = current->exit_code;
+			vfork->done = 1;
+			wakeup_queue(&(vfork->wait_queue), WT_VFORK, 1);
+		}
+	}
+	local_intr_restore(intr_flag);
+}
+
+// vfork_wait - sleep until the child of vfork releases it
+static void vfork_wait(struct vfork_done *vfork)
+{
+	wait_t __wait, *wait = &__wait;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	while (!vfork->done) {
+		wait_current_set(&(vfork->wait_queue), wait, WT_VFORK);
+		local_intr_restore(intr_flag);
+
+		schedule();
+
+		local_intr_save(intr_flag);
+		wait_current_del(&(vfork->wait_queue), wait);
+	}
+	local_intr_restore(intr_flag);
+}
+
+static void vfork_init(struct vfork_done *vfork)
+{
+	wait_queue_init(&(vfork->wait_queue));
+	vfork->done = vfork->exited = 0;
+	vfork->exit_code = 0;
+}
+
 // do_fork - parent process for a new child process
 //    1. call alloc_proc to allocate a proc_struct
 //    2. call setup_kstack to allocate a kernel stack for child process
 //    3. call copy_mm to dup OR share mm according clone_flag
 //    4. call wakup_proc to make the new child process RUNNABLE 
+//    5. with CLONE_VFORK, sleep until the child runs exec or exits
 int do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf)
 {
 	int ret = -E_NO_FREE_PROC;
 	struct proc_struct *proc;
-	if (nr_process >= MAX_PROCESS) {
+	struct vfork_done vfork;
+	if (percpu_counter_compare(&nr_process, MAX_PROCESS) >= 0) {
 		goto fork_out;
 	}
 
@@ -576,16 +933,45 @@ int do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf)
 	if ((proc = alloc_proc()) == NULL) {
 		goto fork_out;
 	}
-	if(clone_flags & __CLONE_PINCPU)
+	if(clone_flags & __CLONE_PINCPU) {
+		proc->flags |= PF_PINCPU;
+		cpuset_clear(&(proc->cpus_allowed));
+		cpuset_set(&(proc->cpus_allowed), proc->cpu_affinity);
+	} else if (current->mm != NULL && (current->flags & PF_PINCPU)) {
+		/* a user process keeps the affinity of its parent */
 		proc->flags |= PF_PINCPU;
+		proc->cpus_allowed = current->cpus_allowed;
+		proc->cpu_affinity = current->cpu_affinity;
+	}
+	/* a recorded proc has its children recorded too */
+	proc->flags |= (current->flags & PF_SYSREC);
+	proc->vfork_done = NULL;
+#ifdef UCONFIG_MEMCG
+	proc->memcg = memcg_get(current->memcg);
+#endif
+#ifdef UCONFIG_CPUCG
+	proc->cpucg = cpucg_get(current->cpucg);
+#endif
+	if (clone_flags & CLONE_VFORK) {
+		vfork_init(&vfork);
+		proc->vfork_done = &vfork;
+	}
 
 	proc->parent = current;
 	list_init(&(proc->thread_group));
+	proc_wait_init(proc);
 	assert(current->wait_state == 0);
 
 	assert(current->time_slice >= 0);
 	proc->time_slice = current->time_slice / 2;
 	current->time_slice -= proc->time_slice;
+	/* the child starts where its parent is, with the same weight */
+	proc->nice = current->nice;
+	proc->vruntime = current->vruntime;
+	proc->timer_slack = current->timer_slack;
+	/* not what current inherited, that is for the rt_mutexes it holds */
+	proc->policy = proc->normal_policy = current->normal_policy;
+	proc->rt_priority = proc->normal_prio = current->normal_prio;
 
 	if (setup_kstack(proc) != 0) {
 		goto bad_fork_cleanup_proc;
@@ -631,6 +1017,10 @@ int do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf)
 	wakeup_proc(proc);
 
 	ret = proc->pid;
+	if (clone_flags & CLONE_VFORK) {
+		/* the child is on our mm, maybe on our stack */
+		vfork_wait(&vfork);
+	}
 fork_out:
 	return ret;
 bad_fork_cleanup_sighand:
@@ -644,7 +1034,16 @@ bad_fork_cleanup_sem:
 bad_fork_cleanup_kstack:
 	put_kstack(proc);
 bad_fork_cleanup_proc:
-	kfree(proc);
+#ifdef UCONFIG_MEMCG
+	memcg_put(proc->memcg);
+#endif
+#ifdef UCONFIG_CPUCG
+	cpucg_put(proc->cpucg);
+#endif
+#ifdef ARCH_AMD64
+	fpu_free(proc);
+#endif
+	kmem_cache_free(proc_cachep, proc);
 	goto fork_out;
 }
 
@@ -664,36 +1063,36 @@ static int __do_exit(void)
 	struct mm_struct *mm = current->mm;
 	if (mm != NULL) {
 		mp_set_mm_pagetable(NULL);
-		if (mm_count_dec(mm) == 0) {
-			exit_mmap(mm);
-			put_pgdir(mm);
-			bool intr_flag;
-			local_intr_save(intr_flag);
-			{
-				list_del(&(mm->proc_mm_link));
-			}
-			local_intr_restore(intr_flag);
-			mm_destroy(mm);
-		}
+		put_mm(mm);
 		current->mm = NULL;
 	}
+#ifdef UCONFIG_MEMCG
+	memcg_put(current->memcg);
+	current->memcg = NULL;
+#endif
+#ifdef UCONFIG_CPUCG
+	{
+		/* off the group first, the tick may charge current meanwhile */
+		struct cpu_group *cg = current->cpucg;
+		current->cpucg = NULL;
+		cpucg_put(cg);
+	}
+#endif
+	vfork_release(1);
 	put_sighand(current);
 	put_signal(current);
 	put_fs(current);
 	put_sem_queue(current);
+	rt_mutex_proc_exit(current);
 	current->state = PROC_ZOMBIE;
 
 	bool intr_flag;
 	struct proc_struct *proc, *parent;
 	local_intr_save(intr_flag);
 	{
-		proc = parent = current->parent;
-		do {
-			if (proc->wait_state == WT_CHILD) {
-				wakeup_proc(proc);
-			}
-			proc = next_thread(proc);
-		} while (proc != parent);
+		list_add_before(&(current->parent->zombie_list),
+				&(current->zombie_link));
+		wakeup_waiters(current->parent, current);
 
 		if ((parent = next_thread(current)) == current) {
 			parent = initproc;
@@ -710,9 +1109,10 @@ static int __do_exit(void)
 			proc->parent = parent;
 			parent->cptr = proc;
 			if (proc->state == PROC_ZOMBIE) {
-				if (parent->wait_state == WT_CHILD) {
-					wakeup_proc(parent);
-				}
+				list_del(&(proc->zombie_link));
+				list_add_before(&(parent->zombie_list),
+						&(proc->zombie_link));
+				wakeup_waiters(parent, proc);
 			}
 		}
 	}
@@ -763,13 +1163,13 @@ static int load_icode_read(int fd, void *buf, size_t len, off_t offset)
 
 //#ifdef UCONFIG_BIONIC_LIBC
 static int
-map_ph(int fd, struct proghdr *ph, struct mm_struct *mm, uint32_t * pbias,
+map_ph(int fd, struct proghdr *ph, struct mm_struct *mm, uintptr_t * pbias,
        uint32_t linker)
 {
 	int ret = 0;
 	struct Page *page;
 	uint32_t vm_flags = 0;
-	uint32_t bias = 0;
+	uintptr_t bias = 0;
 	pte_perm_t perm = 0;
 	ptep_set_u_read(&perm);
 
@@ -793,8 +1193,9 @@ map_ph(int fd, struct proghdr *ph, struct mm_struct *mm, uint32_t * pbias,
 			*pbias = bias;
 	}
 
+	struct vma_struct *vma;
 	if ((ret =
-	     mm_map(mm, ph->p_va + bias, ph->p_memsz, vm_flags, NULL)) != 0) {
+	     mm_map(mm, ph->p_va + bias, ph->p_memsz, vm_flags, &vma)) != 0) {
 		goto bad_cleanup_mmap;
 	}
 
@@ -802,13 +1203,27 @@ map_ph(int fd, struct proghdr *ph, struct mm_struct *mm, uint32_t * pbias,
 		mm->brk_start = ph->p_va + bias + ph->p_memsz;
 	}
 
+#ifdef UCONFIG_DEMAND_EXEC
+	/* the faults read the file part in, the rest is anonymous memory */
+	if (ph->p_filesz != 0) {
+		struct inode *node;
+		if ((ret = file_getnode(fd, &node)) != 0) {
+			goto bad_cleanup_mmap;
+		}
+		vma_set_exec(vma, node, ph->p_va + bias, ph->p_filesz,
+			     ph->p_offset);
+		vop_ref_dec(node);
+	}
+	goto normal_exit;
+#endif
+
 	off_t offset = ph->p_offset;
 	size_t off, size;
 	uintptr_t start = ph->p_va + bias, end, la = ROUNDDOWN(start, PGSIZE);
 
 	end = ph->p_va + bias + ph->p_filesz;
 	while (start < end) {
-		if ((page = pgdir_alloc_page(mm->pgdir, la, perm)) == NULL) {
+		if ((page = mm_alloc_page(mm, la, perm)) == NULL) {
 			ret = -E_NO_MEM;
 			goto bad_cleanup_mmap;
 		}
@@ -841,7 +1256,7 @@ map_ph(int fd, struct proghdr *ph, struct mm_struct *mm, uint32_t * pbias,
 	}
 
 	while (start < end) {
-		if ((page = pgdir_alloc_page(mm->pgdir, la, perm)) == NULL) {
+		if ((page = mm_alloc_page(mm, la, perm)) == NULL) {
 			ret = -E_NO_MEM;
 			goto bad_cleanup_mmap;
 		}
@@ -860,6 +1275,93 @@ bad_cleanup_mmap:
 
 //#endif //UCONFIG_BIONIC_LIBC
 
+#ifdef UCONFIG_DYNAMIC_LINK
+// load_interp - map the interpreter named by the PT_INTERP ph of the program
+//             - at fd: an ET_EXEC one at its own addresses, an ET_DYN one
+//             - where there is room. Stores its entry and the bias added to
+//             - its addresses.
+static int
+load_interp(struct mm_struct *mm, int fd, struct proghdr *ph,
+	    uintptr_t * entry_store, uintptr_t * base_store)
+{
+	struct elfhdr __elf, *elf = &__elf;
+	struct proghdr __iph, *iph = &__iph;
+	uintptr_t va_min = ~(uintptr_t) 0, va_max = 0, bias = 0;
+	char *path;
+	int ifd, i, ret;
+
+	if (ph->p_filesz == 0 || ph->p_filesz > FS_MAX_FPATH_LEN) {
+		return -E_INVAL_ELF;
+	}
+	if ((path = kmalloc(ph->p_filesz + 1)) == NULL) {
+		return -E_NO_MEM;
+	}
+	ret = load_icode_read(fd, path, ph->p_filesz, ph->p_offset);
+	if (ret != 0) {
+		goto out_free;
+	}
+	path[ph->p_filesz] = '\0';
+	if ((ret = ifd = sysfile_open(path, O_RDONLY)) < 0) {
+		goto out_free;
+	}
+	if ((ret = load_icode_read(ifd, elf, sizeof(struct elfhdr), 0)) != 0) {
+		goto out_close;
+	}
+	ret = -E_INVAL_ELF;
+	if (elf->e_magic != ELF_MAGIC
+	    || (elf->e_type != ET_EXEC && elf->e_type != ET_DYN)) {
+		goto out_close;
+	}
+	for (i = 0; elf->e_type == ET_DYN && i < elf->e_phnum; i++) {
+		off_t phoff = elf->e_phoff + sizeof(struct proghdr) * i;
+		if ((ret = load_icode_read(ifd, iph, sizeof(struct proghdr),
+					   phoff)) != 0) {
+			goto out_close;
+		}
+		if (iph->p_type != ELF_PT_LOAD) {
+			continue;
+		}
+		if (va_min > iph->p_va)
+			va_min = iph->p_va;
+		if (va_max < iph->p_va + iph->p_memsz)
+			va_max = iph->p_va + iph->p_memsz;
+	}
+	if (elf->e_type == ET_DYN) {
+		size_t len = va_max - va_min + PGSIZE;
+		ret = -E_NO_MEM;
+		if (va_max <= va_min
+		    || (bias = get_unmapped_area(mm, len)) == 0) {
+			goto out_close;
+		}
+		bias -= ROUNDDOWN(va_min, PGSIZE);
+	}
+	for (i = 0; i < elf->e_phnum; i++) {
+		off_t phoff = elf->e_phoff + sizeof(struct proghdr) * i;
+		if ((ret = load_icode_read(ifd, iph, sizeof(struct proghdr),
+					   phoff)) != 0) {
+			goto out_close;
+		}
+		if (iph->p_type != ELF_PT_LOAD) {
+			continue;
+		}
+		if (iph->p_filesz > iph->p_memsz) {
+			ret = -E_INVAL_ELF;
+			goto out_close;
+		}
+		if ((ret = map_ph(ifd, iph, mm, &bias, 1)) != 0) {
+			goto out_close;
+		}
+	}
+	*entry_store = elf->e_entry + bias, *base_store = bias;
+	ret = 0;
+out_close:
+	sysfile_close(ifd);
+out_free:
+	kfree(path);
+	return ret;
+}
+#endif /* UCONFIG_DYNAMIC_LINK */
+
 static int load_icode(int fd, int argc, char **kargv, int envc, char **kenvp)
 {
 	assert(argc >= 0 && argc <= EXEC_MAX_ARG_NUM);
@@ -871,13 +1373,19 @@ static int load_icode(int fd, int argc, char **kargv, int envc, char **kenvp)
 	int ret = -E_NO_MEM;
 
 //#ifdef UCONFIG_BIONIC_LIBC
-	uint32_t real_entry;
+	uintptr_t real_entry;
 //#endif //UCONFIG_BIONIC_LIBC
+#ifdef UCONFIG_DYNAMIC_LINK
+	struct exec_auxv auxv = {.phdr = NULL };
+#endif
 
 	struct mm_struct *mm;
 	if ((mm = mm_create()) == NULL) {
 		goto bad_mm;
 	}
+#ifdef UCONFIG_MEMCG
+	mm->memcg = memcg_get(current->memcg);
+#endif
 
 	if (setup_pgdir(mm) != 0) {
 		goto bad_pgdir_cleanup_mm;
@@ -908,7 +1416,7 @@ static int load_icode(int fd, int argc, char **kargv, int envc, char **kenvp)
 
 //#ifdef UCONFIG_BIONIC_LIBC
 	uint32_t is_dynamic = 0, interp_idx;
-	uint32_t bias = 0;
+	uintptr_t bias = 0;
 //#endif //UCONFIG_BIONIC_LIBC
 	for (phnum = 0; phnum < elf->e_phnum; phnum++) {
 		off_t phoff = elf->e_phoff + sizeof(struct proghdr) * phnum;
@@ -1024,8 +1532,30 @@ static int load_icode(int fd, int argc, char **kargv, int envc, char **kenvp)
 		    NULL)) != 0) {
 		goto bad_cleanup_mmap;
 	}
+	if ((ret = vdso_map(mm)) != 0) {
+		goto bad_cleanup_mmap;
+	}
 
 	if (is_dynamic) {
+#ifdef UCONFIG_DYNAMIC_LINK
+		/* the interpreter finds the rest from the program headers */
+		size_t phsize = sizeof(struct proghdr) * elf->e_phnum;
+		ret = -E_INVAL_ELF;
+		if (elf->e_phnum > EXEC_MAX_PHNUM) {
+			goto bad_cleanup_mmap;
+		}
+		ret = -E_NO_MEM;
+		if ((auxv.phdr = kmalloc(phsize)) == NULL) {
+			goto bad_cleanup_mmap;
+		}
+		auxv.phnum = elf->e_phnum, auxv.entry = elf->e_entry + bias;
+		if ((ret = load_icode_read(fd, auxv.phdr, phsize,
+					   elf->e_phoff)) != 0
+		    || (ret = load_interp(mm, fd, auxv.phdr + interp_idx,
+					  &real_entry, &(auxv.base))) != 0) {
+			goto bad_cleanup_mmap;
+		}
+#else
 		elf->e_entry += bias;
 
 		bias = 0;
@@ -1094,6 +1624,7 @@ static int load_icode(int fd, int argc, char **kargv, int envc, char **kenvp)
 
 		sysfile_close(interp_fd);
 		kfree(interp_path);
+#endif
 	}
 
 	sysfile_close(fd);
@@ -1118,6 +1649,15 @@ static int load_icode(int fd, int argc, char **kargv, int envc, char **kenvp)
 				     bias) < 0)
 		goto bad_cleanup_mmap;
 #else
+#ifdef UCONFIG_DYNAMIC_LINK
+	if (is_dynamic) {
+		ret = init_new_context_interp(current, elf, argc, kargv, envc,
+					      kenvp, real_entry, &auxv);
+		kfree(auxv.phdr), auxv.phdr = NULL;
+		if (ret < 0)
+			goto bad_cleanup_mmap;
+	} else
+#endif
 	if (init_new_context(current, elf, argc, kargv, envc, kenvp) < 0)
 		goto bad_cleanup_mmap;
 #endif //UCONFIG_BIONIC_LIBC
@@ -1125,6 +1665,11 @@ static int load_icode(int fd, int argc, char **kargv, int envc, char **kenvp)
 out:
 	return ret;
 bad_cleanup_mmap:
+#ifdef UCONFIG_DYNAMIC_LINK
+	if (auxv.phdr != NULL) {
+		kfree(auxv.phdr);
+	}
+#endif
 	exit_mmap(mm);
 bad_elf_cleanup_pgdir:
 	put_pgdir(mm);
@@ -1247,17 +1792,7 @@ int do_execve(const char *filename, const char **argv, const char **envp)
 
 	if (mm != NULL) {
 		mp_set_mm_pagetable(NULL);
-		if (mm_count_dec(mm) == 0) {
-			exit_mmap(mm);
-			put_pgdir(mm);
-			bool intr_flag;
-			local_intr_save(intr_flag);
-			{
-				list_del(&(mm->proc_mm_link));
-			}
-			local_intr_restore(intr_flag);
-			mm_destroy(mm);
-		}
+		put_mm(mm);
 		current->mm = NULL;
 	}
 	put_sem_queue(current);
@@ -1289,6 +1824,9 @@ int do_execve(const char *filename, const char **argv, const char **envp)
 
 	if (do_execve_arch_hook(argc, kargv) < 0)
 		goto execve_exit;
+	do_settls(NULL);
+
+	vfork_release(0);
 
 	put_kargv(argc, kargv);
 	put_kargv(envc, kenvp);
@@ -1303,37 +1841,807 @@ execve_exit:
 	panic("already exit: %e.\n", ret);
 }
 
-// do_yield - ask the scheduler to reschedule
-int do_yield(void)
+/* what do_spawn hands to its child, on the kernel stack of the parent */
+struct spawn_args {
+	const char *name;
+	const char **argv;
+	const char **envp;
+	struct vfork_done vfork;
+};
+
+// spawn_main - the child of do_spawn: exec the image straight from the
+//            - borrowed mm of its parent, which waits meanwhile
+static int spawn_main(void *arg)
 {
-	current->need_resched = 1;
-	return 0;
+	struct spawn_args *args = arg;
+	current->vfork_done = &(args->vfork);
+	/* it is a user process from now on, with the affinity of its parent */
+	sched_setaffinity_mask(current, (current->parent->flags & PF_PINCPU) ?
+			       &(current->parent->cpus_allowed) : NULL);
+	return kernel_execve(args->name, args->argv, args->envp);
 }
 
-// do_wait - wait one OR any children with PROC_ZOMBIE state, and free memory space of kernel stack
-//         - proc struct of this child.
-// NOTE: only after do_wait function, all resources of the child proces are free.
-int do_wait(int pid, int *code_store)
+/*
+ * do_spawn - create a child running the program at name, as fork and exec
+ * would, without copying the address space: the child execs from the mm of
+ * current, which waits until it is done. Returns the pid of the child, or
+ * the error of the exec if it failed before running the program.
+ */
+int do_spawn(const char *name, const char **argv, const char **envp)
 {
-	struct mm_struct *mm = current->mm;
-	if (code_store != NULL) {
-		if (!user_mem_check(mm, (uintptr_t) code_store, sizeof(int), 1)) {
-			return -E_INVAL;
-		}
+	struct spawn_args args;
+	int pid, ret;
+	if (current->mm == NULL) {
+		return -E_INVAL;
+	}
+	args.name = name, args.argv = argv, args.envp = envp;
+	vfork_init(&(args.vfork));
+	if ((pid = ucore_kernel_thread(spawn_main, &args, 0)) <= 0) {
+		return pid;
 	}
+	vfork_wait(&(args.vfork));
+	if (args.vfork.exited) {
+		ret = args.vfork.exit_code;
+		do_wait(pid, NULL);
+		return (ret != 0) ? ret : -E_NOEXEC;
+	}
+	return pid;
+}
 
-	struct proc_struct *proc, *cproc;
-	bool intr_flag, haskid;
-repeat:
-	cproc = current;
-	haskid = 0;
-	if (pid != 0) {
-		proc = find_proc(pid);
-		if (proc != NULL) {
-			do {
-				if (proc->parent == cproc) {
-					haskid = 1;
-					if (proc->state == PROC_ZOMBIE) {
+#ifdef UCONFIG_CHECKPOINT
+/*
+ * A checkpoint image, written by do_checkpoint and mapped by do_restore:
+ *
+ *     ckpt_header     at 0
+ *     ckpt_vma        nr_vmas of them, by address
+ *     the pages       of the vmas with bytes, from a page boundary on
+ *     ckpt_file       nr_files of them from files_off, each followed by
+ *                     the path_len bytes of its path
+ *
+ * A vma is cut where its pages go from never touched to touched or back.
+ * The untouched parts are saved without bytes, as anonymous memory, so a
+ * large stack costs the pages in use only. The restore maps the bytes of
+ * the others from the image as exec maps a program, see execmap.c: each
+ * page is read by its first fault, into the exec cache shared by all the
+ * processes restored from the image, and copied by a write.
+ */
+#define CKPT_MAGIC                  0x54504b43	/* "CKPT" */
+#define CKPT_VERSION                1
+#define CKPT_MAX_VMAS               512
+
+struct ckpt_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nr_vmas;
+	uint32_t nr_files;
+	off_t files_off;
+	uintptr_t brk_start, brk;
+	uintptr_t vvar_addr;
+	void *tls;
+	struct trapframe tf;	// of the checkpoint syscall
+	sigset_t blocked, rt_blocked;
+	uintptr_t sas_ss_sp;
+	size_t sas_ss_size;
+	struct sigaction action[64];
+	char name[PROC_NAME_LEN + 1];
+};
+
+struct ckpt_vma {
+	uintptr_t start, end;
+	uint32_t flags;
+	off_t offset;		// of its bytes in the image, 0 if none
+};
+
+struct ckpt_file {
+	int fd;
+	uint32_t open_flags;	// the access mode only
+	off_t pos;
+	size_t path_len;
+};
+
+/* the flags a vma of an image may have */
+#define CKPT_VM_FLAGS               (VM_READ | VM_WRITE | VM_EXEC | VM_STACK \
+                                     | VM_ANONYMOUS | VM_HUGEPAGE           \
+                                     | VM_SEQ_READ | VM_RAND_READ | VM_IO)
+
+// ckpt_io - read or write the len bytes of buf at offset of the image at fd
+static int ckpt_io(int fd, void *buf, size_t len, off_t offset, bool write)
+{
+	size_t copied;
+	int ret;
+	if ((ret = file_seek(fd, offset, LSEEK_SET)) != 0) {
+		return ret;
+	}
+	ret = write ? file_write(fd, buf, len, &copied) :
+	    file_read(fd, buf, len, &copied);
+	if (ret == 0 && copied != len) {
+		/* a short image */
+		ret = -E_INVAL;
+	}
+	return ret;
+}
+
+// ckpt_touched - if the page at la of vma has bytes to save, those of
+//              - anonymous memory never touched aside; called with mm locked
+static bool
+ckpt_touched(struct mm_struct *mm, struct vma_struct *vma, uintptr_t la)
+{
+	/* the vvar page is mapped anew, nor can the rest be read */
+	if ((vma->vm_flags & VM_IO) || !(vma->vm_flags & VM_READ)) {
+		return 0;
+	}
+	if (vma->exec.node != NULL && la + PGSIZE > vma->exec.start
+	    && la < vma->exec.end) {
+		return 1;
+	}
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+	/* get_pte would split it */
+	pmd_t *pmdp = get_pmd(mm->pgdir, la, 0);
+	if (pmdp != NULL && pmd_huge(pmdp)) {
+		return 1;
+	}
+#endif
+	pte_t *ptep = get_pte(mm->pgdir, la, 0);
+	return ptep != NULL && !ptep_invalid(ptep);
+}
+
+/*
+ * ckpt_plan - the ckpt_vmas of mm into vmas, at most max, the ones with
+ * bytes marked by an offset of 1. Returns their #, or -E_INVAL for a vma
+ * that cannot be saved: shared memory, a device or a file mapped, and
+ * -E_BUSY for one mapping the image node itself. Called with mm locked.
+ */
+static int
+ckpt_plan(struct mm_struct *mm, struct inode *node, struct ckpt_vma *vmas,
+	  int max)
+{
+	list_entry_t *list = &(mm->mmap_list), *le = list;
+	int n = 0;
+	while ((le = list_next(le)) != list) {
+		struct vma_struct *vma = le2vma(le, list_link);
+		uintptr_t la = vma->vm_start, end;
+		bool touched;
+		if (vma->shmem != NULL || (vma->vm_flags & VM_SHARE)
+		    || (vma->vm_flags & ~CKPT_VM_FLAGS)
+		    || ((vma->vm_flags & VM_IO) && la != mm->vvar_addr)) {
+			return -E_INVAL;
+		}
+#ifdef UCONFIG_BIONIC_LIBC
+		if (vma->mfile.file != NULL) {
+			return -E_INVAL;
+		}
+#endif
+		if (vma->exec.node == node) {
+			return -E_BUSY;
+		}
+		while (la < vma->vm_end) {
+			touched = ckpt_touched(mm, vma, la);
+			end = la + PGSIZE;
+			while (end < vma->vm_end
+			       && ckpt_touched(mm, vma, end) == touched) {
+				end += PGSIZE;
+			}
+			if (n == max) {
+				return -E_NO_MEM;
+			}
+			vmas[n].start = la, vmas[n].end = end;
+			vmas[n].flags = vma->vm_flags;
+			vmas[n].offset = touched;
+			n++, la = end;
+		}
+	}
+	return n;
+}
+
+// ckpt_save_pages - the bytes of vmas into the image at fd, from off on;
+//                 - their offsets are set
+static int
+ckpt_save_pages(int fd, struct ckpt_vma *vmas, int n, off_t * off_store,
+		void *buf)
+{
+	struct mm_struct *mm = current->mm;
+	off_t off = *off_store;
+	uintptr_t la;
+	bool copied;
+	int i, ret;
+	for (i = 0; i < n; i++) {
+		if (vmas[i].offset == 0) {
+			continue;
+		}
+		vmas[i].offset = off;
+		for (la = vmas[i].start; la < vmas[i].end; la += PGSIZE) {
+			lock_mm_uaccess(mm);
+			copied = copy_from_user(mm, buf, (void *)la, PGSIZE, 0);
+			unlock_mm_uaccess(mm);
+			if (!copied) {
+				return -E_FAULT;
+			}
+			if ((ret = ckpt_io(fd, buf, PGSIZE, off, 1)) != 0) {
+				return ret;
+			}
+			off += PGSIZE;
+		}
+	}
+	*off_store = off;
+	return 0;
+}
+
+// ckpt_save_files - the regular files open in current but the image fd
+//                 - into the image at fd, from off on
+static int
+ckpt_save_files(int fd, struct ckpt_header *hdr, off_t off, char *path)
+{
+	struct ckpt_file rec;
+	int i, ret, max_fds = current->fs_struct->fdt->max_fds;
+	hdr->files_off = off, hdr->nr_files = 0;
+	for (i = 0; i < max_fds; i++) {
+		if (i == fd
+		    || file_describe(i, path, FS_MAX_FPATH_LEN + 1,
+				     &(rec.open_flags), &(rec.pos)) != 0) {
+			continue;
+		}
+		rec.fd = i, rec.path_len = strlen(path);
+		if ((ret = ckpt_io(fd, &rec, sizeof(rec), off, 1)) != 0
+		    || (ret = ckpt_io(fd, path, rec.path_len, off + sizeof(rec),
+				      1)) != 0) {
+			return ret;
+		}
+		off += sizeof(rec) + rec.path_len;
+		hdr->nr_files++;
+	}
+	return 0;
+}
+
+// do_checkpoint - save current, a process of a single thread, to an image
+//               - at path, see ckpt_header; returns 0 here, and 1 in the
+//               - processes restored from it
+int do_checkpoint(const char __user * path)
+{
+	static_assert(PGSIZE >= FS_MAX_FPATH_LEN + 1);
+	struct mm_struct *mm = current->mm;
+	struct ckpt_header *hdr = NULL;
+	struct ckpt_vma *vmas = NULL;
+	struct inode *node = NULL;
+	void *buf = NULL;
+	off_t off;
+	int fd, n, ret;
+	bool intr_flag;
+
+	if (mm == NULL || mm_count(mm) != 1
+	    || !list_empty(&(current->thread_group))) {
+		return -E_INVAL;
+	}
+	if ((fd = sysfile_open(path, O_WRONLY | O_CREAT)) < 0) {
+		return fd;
+	}
+	ret = -E_NO_MEM;
+	if ((hdr = kmalloc(sizeof(struct ckpt_header))) == NULL
+	    || (vmas = kmalloc(CKPT_MAX_VMAS * sizeof(struct ckpt_vma))) == NULL
+	    || (buf = kmalloc(PGSIZE)) == NULL) {
+		goto out;
+	}
+	if ((ret = file_getnode(fd, &node)) != 0) {
+		goto out;
+	}
+	memset(hdr, 0, sizeof(struct ckpt_header));
+
+	lock_mm(mm);
+	ret = n = ckpt_plan(mm, node, vmas, CKPT_MAX_VMAS);
+	unlock_mm(mm);
+	if (ret < 0 || (ret = vop_truncate(node, 0)) != 0) {
+		goto out;
+	}
+	off = ROUNDUP(sizeof(struct ckpt_header) + n * sizeof(struct ckpt_vma),
+		      PGSIZE);
+	if ((ret = ckpt_save_pages(fd, vmas, n, &off, buf)) != 0
+	    || (ret = ckpt_save_files(fd, hdr, off, buf)) != 0) {
+		goto out;
+	}
+
+	hdr->magic = CKPT_MAGIC, hdr->version = CKPT_VERSION;
+	hdr->nr_vmas = n;
+	hdr->brk_start = mm->brk_start, hdr->brk = mm->brk;
+	hdr->vvar_addr = mm->vvar_addr;
+	local_intr_save(intr_flag);
+	{
+		/* reads back a tls that user space may have moved itself */
+		tls_switch(current, current);
+		hdr->tls = current->tls_pointer;
+	}
+	local_intr_restore(intr_flag);
+	hdr->tf = *(current->tf);
+	hdr->blocked = current->signal_info.blocked;
+	hdr->rt_blocked = current->signal_info.rt_blocked;
+	hdr->sas_ss_sp = current->signal_info.sas_ss_sp;
+	hdr->sas_ss_size = current->signal_info.sas_ss_size;
+	memcpy(hdr->action, current->signal_info.sighand->action,
+	       sizeof(hdr->action));
+	memcpy(hdr->name, current->name, sizeof(hdr->name));
+	/* the header last, an image cut short has none */
+	if ((ret = ckpt_io(fd, vmas, n * sizeof(struct ckpt_vma),
+			   sizeof(struct ckpt_header), 1)) == 0) {
+		ret = ckpt_io(fd, hdr, sizeof(struct ckpt_header), 0, 1);
+	}
+
+out:
+	if (node != NULL) {
+		vop_ref_dec(node);
+	}
+	sysfile_close(fd);
+	kfree(buf);
+	kfree(vmas);
+	kfree(hdr);
+	return ret;
+}
+
+// ckpt_check - if the vmas of an image are sane, ordered, page aligned and
+//            - in user space
+static int ckpt_check(struct ckpt_header *hdr, struct ckpt_vma *vmas)
+{
+	uintptr_t last = 0;
+	int i;
+	for (i = 0; i < hdr->nr_vmas; i++) {
+		struct ckpt_vma *v = vmas + i;
+		if (v->start < last || v->start >= v->end
+		    || v->start % PGSIZE != 0 || v->end % PGSIZE != 0
+		    || v->offset % PGSIZE != 0 || !USER_ACCESS(v->start, v->end)
+		    || (v->flags & ~CKPT_VM_FLAGS)) {
+			return -E_INVAL;
+		}
+		if ((v->flags & VM_IO) && (v->start != hdr->vvar_addr
+					   || v->end != v->start + PGSIZE
+					   || v->offset != 0)) {
+			return -E_INVAL;
+		}
+		last = v->end;
+	}
+	return 0;
+}
+
+// ckpt_reopen - open the files of the image at *fd_store again at their
+//             - fds and positions; the image is moved to another fd first
+//             - if it is at one of them
+static int ckpt_reopen(int *fd_store, struct ckpt_header *hdr, char *path)
+{
+	struct ckpt_file rec;
+	off_t off = hdr->files_off;
+	int i, fd, ret;
+	for (i = 0; i < hdr->nr_files; i++) {
+		fd = *fd_store;
+		if ((ret = ckpt_io(fd, &rec, sizeof(rec), off, 0)) != 0) {
+			return ret;
+		}
+		if (rec.path_len > FS_MAX_FPATH_LEN) {
+			return -E_INVAL;
+		}
+		if ((ret = ckpt_io(fd, path, rec.path_len, off + sizeof(rec),
+				   0)) != 0) {
+			return ret;
+		}
+		path[rec.path_len] = '\0';
+		off += sizeof(rec) + rec.path_len;
+
+		if (rec.fd == *fd_store) {
+			if ((fd = file_dup(*fd_store, NO_FD)) < 0) {
+				return fd;
+			}
+			file_close(*fd_store);
+			*fd_store = fd;
+		}
+		if ((fd = file_open(path, rec.open_flags & O_ACCMODE)) < 0) {
+			return fd;
+		}
+		if (fd != rec.fd) {
+			file_close(rec.fd);
+			ret = file_dup(fd, rec.fd);
+			file_close(fd);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+		if ((ret = file_seek(rec.fd, rec.pos, LSEEK_SET)) != 0) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+// ckpt_load - a new mm for current of the vmas of the image node, as
+//           - load_icode does for a program
+static int
+ckpt_load(struct inode *node, struct ckpt_header *hdr, struct ckpt_vma *vmas)
+{
+	struct mm_struct *mm;
+	struct vma_struct *vma;
+	uint32_t vm_flags;
+	int i, ret = -E_NO_MEM;
+	assert(current->mm == NULL);
+	if ((mm = mm_create()) == NULL) {
+		return ret;
+	}
+#ifdef UCONFIG_MEMCG
+	mm->memcg = memcg_get(current->memcg);
+#endif
+	if ((ret = setup_pgdir(mm)) != 0) {
+		goto bad_pgdir_cleanup_mm;
+	}
+	for (i = 0; i < hdr->nr_vmas; i++) {
+		struct ckpt_vma *v = vmas + i;
+		if (v->flags & VM_IO) {
+			mm->vvar_addr = v->start;
+			ret = vdso_map(mm);
+		} else {
+			vm_flags = v->flags;
+			if (v->offset != 0) {
+				/* a huge page fault would skip its bytes */
+				vm_flags &= ~VM_HUGEPAGE;
+			}
+			ret = mm_map(mm, v->start, v->end - v->start, vm_flags,
+				     &vma);
+			if (ret == 0 && v->offset != 0) {
+				vma_set_exec(vma, node, v->start,
+					     v->end - v->start, v->offset);
+			}
+		}
+		if (ret != 0) {
+			goto bad_cleanup_mmap;
+		}
+	}
+	mm->brk_start = hdr->brk_start, mm->brk = hdr->brk;
+
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		list_add(&(proc_mm_list), &(mm->proc_mm_link));
+	}
+	local_intr_restore(intr_flag);
+	mm_count_inc(mm);
+	current->mm = mm;
+	set_pgdir(current, mm->pgdir);
+	mp_set_mm_pagetable(mm);
+	return 0;
+
+bad_cleanup_mmap:
+	exit_mmap(mm);
+	put_pgdir(mm);
+bad_pgdir_cleanup_mm:
+	mm_destroy(mm);
+	return ret;
+}
+
+/*
+ * do_restore - replace the image of current with the one saved at path by
+ * do_checkpoint, as exec does, and go on from the checkpoint, which
+ * returns 1. The regular files of the image are opened again at their
+ * fds and positions; the other fds, the console and the pipes, stay those
+ * of current. Returns an error if the image cannot be restored, or exits
+ * with it once current has been torn down.
+ */
+int do_restore(const char __user * path)
+{
+	struct ckpt_header *hdr = NULL;
+	struct ckpt_vma *vmas = NULL;
+	struct inode *node = NULL;
+	char *buf = NULL;
+	int fd, ret;
+
+	if (current->mm == NULL) {
+		return -E_INVAL;
+	}
+	if ((fd = sysfile_open(path, O_RDONLY)) < 0) {
+		return fd;
+	}
+	ret = -E_NO_MEM;
+	if ((hdr = kmalloc(sizeof(struct ckpt_header))) == NULL
+	    || (vmas = kmalloc(CKPT_MAX_VMAS * sizeof(struct ckpt_vma))) == NULL
+	    || (buf = kmalloc(FS_MAX_FPATH_LEN + 1)) == NULL) {
+		goto out;
+	}
+	if ((ret = ckpt_io(fd, hdr, sizeof(struct ckpt_header), 0, 0)) != 0) {
+		goto out;
+	}
+	ret = -E_INVAL;
+	if (hdr->magic != CKPT_MAGIC || hdr->version != CKPT_VERSION
+	    || hdr->nr_vmas > CKPT_MAX_VMAS) {
+		goto out;
+	}
+	if ((ret = ckpt_io(fd, vmas, hdr->nr_vmas * sizeof(struct ckpt_vma),
+			   sizeof(struct ckpt_header), 0)) != 0
+	    || (ret = ckpt_check(hdr, vmas)) != 0
+	    || (ret = ckpt_reopen(&fd, hdr, buf)) != 0
+	    || (ret = file_getnode(fd, &node)) != 0) {
+		goto out;
+	}
+
+	/* no way back from here on, as for exec */
+	mp_set_mm_pagetable(NULL);
+	put_mm(current->mm);
+	current->mm = NULL;
+	put_sem_queue(current);
+
+	ret = -E_NO_MEM;
+	put_sighand(current);
+	if ((current->signal_info.sighand = sighand_create()) == NULL) {
+		goto failed;
+	}
+	sighand_count_inc(current->signal_info.sighand);
+	memcpy(current->signal_info.sighand->action, hdr->action,
+	       sizeof(hdr->action));
+
+	put_signal(current);
+	if ((current->signal_info.signal = signal_create()) == NULL) {
+		goto failed;
+	}
+	signal_count_inc(current->signal_info.signal);
+
+	if ((current->sem_queue = sem_queue_create()) == NULL) {
+		goto failed;
+	}
+	sem_queue_count_inc(current->sem_queue);
+
+	if ((ret = ckpt_load(node, hdr, vmas)) != 0) {
+		goto failed;
+	}
+	current->signal_info.blocked = hdr->blocked;
+	current->signal_info.rt_blocked = hdr->rt_blocked;
+	current->signal_info.sas_ss_sp = hdr->sas_ss_sp;
+	current->signal_info.sas_ss_size = hdr->sas_ss_size;
+	hdr->name[PROC_NAME_LEN] = '\0';
+	set_proc_name(current, hdr->name);
+	if ((ret = do_execve_arch_hook(0, NULL)) < 0) {
+		goto failed;
+	}
+	restore_tf_arch_hook(current->tf, &(hdr->tf));
+	do_settls(hdr->tls);
+
+	vfork_release(0);
+	ret = 1;
+out:
+	if (node != NULL) {
+		vop_ref_dec(node);
+	}
+	sysfile_close(fd);
+	kfree(buf);
+	kfree(vmas);
+	kfree(hdr);
+	return ret;
+
+failed:
+	vop_ref_dec(node);
+	sysfile_close(fd);
+	kfree(buf);
+	kfree(vmas);
+	kfree(hdr);
+	do_exit(ret);
+	panic("already exit: %e.\n", ret);
+}
+#endif /* UCONFIG_CHECKPOINT */
+
+// do_yield - ask the scheduler to reschedule
+int do_yield(void)
+{
+	current->need_resched = 1;
+#ifdef UCONFIG_SCHED_RT
+	if (current->policy != SCHED_NORMAL) {
+		/* to the tail of its priority, see RT_enqueue */
+		current->time_slice = 0;
+	}
+#endif
+	return 0;
+}
+
+// do_sched_setscheduler - set the scheduling policy of pid, 0 for current,
+//                       - and its realtime priority, 0 for SCHED_NORMAL
+int do_sched_setscheduler(int pid, int policy, int prio)
+{
+	struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+	if (proc == NULL || proc->state == PROC_ZOMBIE) {
+		return -E_INVAL;
+	}
+	switch (policy) {
+	case SCHED_NORMAL:
+		if (prio != 0) {
+			return -E_INVAL;
+		}
+		break;
+#ifdef UCONFIG_SCHED_RT
+	case SCHED_FIFO:
+	case SCHED_RR:
+		if (prio < SCHED_RT_PRIO_MIN || prio > SCHED_RT_PRIO_MAX) {
+			return -E_INVAL;
+		}
+		break;
+#endif
+	default:
+		return -E_INVAL;
+	}
+	sched_setscheduler(proc, policy, prio);
+	return 0;
+}
+
+// do_sched_setaffinity - have pid, 0 for current, run on the cpus of the
+//                      - size bytes of mask only, a bit a cpu as cpuset_t,
+//                      - or on any cpu again if mask is NULL
+int do_sched_setaffinity(int pid, size_t size, const void __user * mask)
+{
+	struct mm_struct *mm = current->mm;
+	struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+	cpuset_t user, set;
+	bool ok;
+	int i;
+	if (proc == NULL || proc->state == PROC_ZOMBIE || proc->mm == NULL) {
+		return -E_INVAL;
+	}
+	if (mask == NULL) {
+		sched_setaffinity_mask(proc, NULL);
+		return 0;
+	}
+	/* the cpus past those of cpuset_t are none of this machine */
+	cpuset_clear(&user);
+	if (size > sizeof(cpuset_t)) {
+		size = sizeof(cpuset_t);
+	}
+	lock_mm(mm);
+	ok = copy_from_user(mm, &user, mask, size, 0);
+	unlock_mm(mm);
+	if (!ok) {
+		return -E_INVAL;
+	}
+	cpuset_clear(&set);
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (cpuset_test(&user, i)) {
+			cpuset_set(&set, i);
+		}
+	}
+	if (cpuset_first(&set, sysconf.lcpu_count) < 0) {
+		return -E_INVAL;
+	}
+	sched_setaffinity_mask(proc, &set);
+	return 0;
+}
+
+// do_sched_getaffinity - the cpus pid, 0 for current, may run on into the
+//                      - size bytes of mask, which hold all the cpus at least
+int do_sched_getaffinity(int pid, size_t size, void __user * mask)
+{
+	struct mm_struct *mm = current->mm;
+	struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+	cpuset_t set;
+	uint8_t zero = 0;
+	bool ok;
+	size_t n = __cpuset_bits_to_bytes(sysconf.lcpu_count), i;
+	if (proc == NULL || proc->state == PROC_ZOMBIE || size < n) {
+		return -E_INVAL;
+	}
+	sched_getaffinity(proc, &set);
+	lock_mm(mm);
+	ok = copy_to_user(mm, mask, &set, n);
+	/* the bytes past the cpus there are */
+	for (i = n; ok && i < size; i++) {
+		ok = copy_to_user(mm, (uint8_t *) mask + i, &zero, 1);
+	}
+	unlock_mm(mm);
+	return ok ? 0 : -E_INVAL;
+}
+
+// do_timerslack - the timer slack of pid, 0 for current, in ticks; set to
+//               - slack unless it is negative. Returns the previous one.
+int do_timerslack(int pid, int slack)
+{
+	int ret = -E_INVAL;
+	if (slack > TIMER_SLACK_MAX) {
+		return -E_INVAL;
+	}
+	rcu_read_lock();
+	struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+	if (proc != NULL && proc->state != PROC_ZOMBIE) {
+		ret = proc->timer_slack;
+		if (slack >= 0) {
+			proc->timer_slack = slack;
+		}
+	}
+	rcu_read_unlock();
+	return ret;
+}
+
+// do_sched_getscheduler - the scheduling policy of pid, 0 for current
+int do_sched_getscheduler(int pid)
+{
+	int ret = -E_INVAL;
+	rcu_read_lock();
+	struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+	if (proc != NULL) {
+		ret = proc->normal_policy;
+	}
+	rcu_read_unlock();
+	return ret;
+}
+
+// do_sched_getparam - the realtime priority of pid, 0 for current
+int do_sched_getparam(int pid)
+{
+	int ret = -E_INVAL;
+	rcu_read_lock();
+	struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+	if (proc != NULL) {
+		ret = proc->normal_prio;
+	}
+	rcu_read_unlock();
+	return ret;
+}
+
+// do_setpriority - set the nice value of pid, 0 for current, clamped to
+//                - NICE_MIN .. NICE_MAX as by Linux
+int do_setpriority(int pid, int nice)
+{
+	struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+	if (proc == NULL || proc->state == PROC_ZOMBIE) {
+		return -E_INVAL;
+	}
+	if (nice < PROC_NICE_MIN) {
+		nice = PROC_NICE_MIN;
+	} else if (nice > PROC_NICE_MAX) {
+		nice = PROC_NICE_MAX;
+	}
+	sched_setnice(proc, nice);
+	return 0;
+}
+
+// do_getpriority - the nice value of pid, 0 for current, in *nice_store
+int do_getpriority(int pid, int __user * nice_store)
+{
+	struct mm_struct *mm = current->mm;
+	int nice = 0, ret = -E_INVAL;
+	rcu_read_lock();
+	struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+	if (proc != NULL) {
+		nice = proc->nice, ret = 0;
+	}
+	rcu_read_unlock();
+	if (ret == 0) {
+		lock_mm(mm);
+		if (!copy_to_user(mm, nice_store, &nice, sizeof(int))) {
+			ret = -E_INVAL;
+		}
+		unlock_mm(mm);
+	}
+	return ret;
+}
+
+static void rusage_add(struct rusage *to, struct rusage *from)
+{
+	to->ru_utime += from->ru_utime;
+	to->ru_stime += from->ru_stime;
+	to->ru_nvcsw += from->ru_nvcsw;
+	to->ru_nivcsw += from->ru_nivcsw;
+	to->ru_minflt += from->ru_minflt;
+	to->ru_majflt += from->ru_majflt;
+}
+
+// do_wait - wait one OR any children with PROC_ZOMBIE state, and free memory space of kernel stack
+//         - proc struct of this child.
+// NOTE: only after do_wait function, all resources of the child proces are free.
+int do_wait(int pid, int *code_store)
+{
+	struct mm_struct *mm = current->mm;
+	if (code_store != NULL) {
+		if (!user_mem_check(mm, (uintptr_t) code_store, sizeof(int), 1)) {
+			return -E_INVAL;
+		}
+	}
+
+	struct proc_struct *proc, *cproc;
+	bool intr_flag, haskid;
+repeat:
+	cproc = current;
+	haskid = 0;
+	if (pid != 0) {
+		proc = find_proc(pid);
+		if (proc != NULL) {
+			do {
+				if (proc->parent == cproc) {
+					haskid = 1;
+					if (proc->state == PROC_ZOMBIE) {
 						goto found;
 					}
 					break;
@@ -1341,21 +2649,13 @@ repeat:
 				cproc = next_thread(cproc);
 			} while (cproc != current);
 		}
-	} else {
-		do {
-			proc = cproc->cptr;
-			for (; proc != NULL; proc = proc->optr) {
-				haskid = 1;
-				if (proc->state == PROC_ZOMBIE) {
-					goto found;
-				}
-			}
-			cproc = next_thread(cproc);
-		} while (cproc != current);
+	} else if ((proc = first_zombie(&haskid)) != NULL) {
+		goto found;
 	}
 	if (haskid) {
 		current->state = PROC_SLEEPING;
 		current->wait_state = WT_CHILD;
+		current->wait_pid = pid;
 		schedule();
 		may_killed();
 		goto repeat;
@@ -1367,6 +2667,8 @@ found:
 		panic("wait idleproc or initproc.\n");
 	}
 	int exit_code = proc->exit_code;
+	rusage_add(&(current->child_rusage), &(proc->rusage));
+	rusage_add(&(current->child_rusage), &(proc->child_rusage));
 	spin_lock_irqsave(&proc_lock, intr_flag);
 	{
 		unhash_proc(proc);
@@ -1374,7 +2676,7 @@ found:
 	}
 	spin_unlock_irqrestore(&proc_lock, intr_flag);
 	put_kstack(proc);
-	kfree(proc);
+	call_rcu(&(proc->rcu), proc_free_rcu);
 
 	int ret = 0;
 	if (code_store != NULL) {
@@ -1421,16 +2723,9 @@ repeat:
 	}
 	/* we do NOT have group id, so.. */
 	else if (pid == 0 || pid == -1) {	/* pid == 0 */
-		do {
-			proc = cproc->cptr;
-			for (; proc != NULL; proc = proc->optr) {
-				haskid = 1;
-				if (proc->state == PROC_ZOMBIE) {
-					goto found;
-				}
-			}
-			cproc = next_thread(cproc);
-		} while (cproc != current);
+		if ((proc = first_zombie(&haskid)) != NULL) {
+			goto found;
+		}
 	} else {		//pid<-1
 		//TODO
 		return -E_INVAL;
@@ -1438,6 +2733,7 @@ repeat:
 	if (haskid) {
 		current->state = PROC_SLEEPING;
 		current->wait_state = WT_CHILD;
+		current->wait_pid = (pid > 0) ? pid : 0;
 		schedule();
 		may_killed();
 		goto repeat;
@@ -1449,6 +2745,8 @@ found:
 		panic("wait idleproc or initproc.\n");
 	}
 	int exit_code = proc->exit_code;
+	rusage_add(&(current->child_rusage), &(proc->rusage));
+	rusage_add(&(current->child_rusage), &(proc->child_rusage));
 	int return_pid = proc->pid;
 	local_intr_save(intr_flag);
 	{
@@ -1457,7 +2755,7 @@ found:
 	}
 	local_intr_restore(intr_flag);
 	put_kstack(proc);
-	kfree(proc);
+	call_rcu(&(proc->rcu), proc_free_rcu);
 
 	int ret = 0;
 	if (code_store != NULL) {
@@ -1473,6 +2771,200 @@ found:
 	return (ret == 0) ? return_pid : ret;
 }
 
+// do_getrusage - the resources used by who, RUSAGE_xxx in rusage.h, stored
+//              - to the user usage
+int do_getrusage(int who, struct rusage __user * usage)
+{
+	struct mm_struct *mm = current->mm;
+	struct proc_struct *proc = current;
+	struct rusage kusage;
+	memset(&kusage, 0, sizeof(struct rusage));
+	if (who == RUSAGE_THREAD) {
+		kusage = current->rusage;
+	} else if (who == RUSAGE_SELF || who == RUSAGE_CHILDREN) {
+		bool intr_flag;
+		spin_lock_irqsave(&proc_lock, intr_flag);
+		do {
+			rusage_add(&kusage, (who == RUSAGE_SELF) ?
+				   &(proc->rusage) : &(proc->child_rusage));
+		} while ((proc = next_thread(proc)) != current);
+		spin_unlock_irqrestore(&proc_lock, intr_flag);
+	} else {
+		return -E_INVAL;
+	}
+	lock_mm(mm);
+	if (!copy_to_user(mm, usage, &kusage, sizeof(struct rusage))) {
+		unlock_mm(mm);
+		return -E_INVAL;
+	}
+	unlock_mm(mm);
+	return 0;
+}
+
+// do_settls - the tls pointer of current, its thread-local block: loaded
+//           - now, and again by proc_run when another tls ran meanwhile;
+//           - the fs base on amd64, TPIDRURO on arm
+int do_settls(void *tls)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		current->tls_pointer = tls;
+		tls_switch(NULL, current);
+	}
+	local_intr_restore(intr_flag);
+	return 0;
+}
+
+// do_gettls - for the archs where user space cannot read it back itself
+void *do_gettls(void)
+{
+	return current->tls_pointer;
+}
+
+static const char *proc_state_name(struct proc_struct *proc)
+{
+	switch (proc->state) {
+	case PROC_SLEEPING:
+		return "S";
+	case PROC_RUNNABLE:
+		return "R";
+	case PROC_ZOMBIE:
+		return "Z";
+	default:
+		return "U";
+	}
+}
+
+// proc_rusage_show - a line of the resources used by each proc, into buf
+//                  - of size bytes; the length is returned
+size_t proc_rusage_show(char *buf, size_t size)
+{
+	size_t len = 0;
+	bool intr_flag;
+	spin_lock_irqsave(&proc_lock, intr_flag);
+	{
+		list_entry_t *list = &proc_list, *le = list;
+		while ((le = list_next(le)) != list && len < size) {
+			struct proc_struct *proc = le2proc(le, list_link);
+			struct rusage *ru = &(proc->rusage);
+			len += snprintf(buf + len, size - len,
+					"%d %s %llu %llu %u %u %u %u %s\n",
+					proc->pid, proc_state_name(proc),
+					ru->ru_utime, ru->ru_stime,
+					ru->ru_nvcsw, ru->ru_nivcsw,
+					ru->ru_minflt, ru->ru_majflt,
+					proc->name);
+		}
+	}
+	spin_unlock_irqrestore(&proc_lock, intr_flag);
+	return (len < size) ? len : size;
+}
+
+// proc_clear_flags - clear flags on every proc
+void proc_clear_flags(uint32_t flags)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&proc_lock, intr_flag);
+	{
+		list_entry_t *list = &proc_list, *le = list;
+		while ((le = list_next(le)) != list) {
+			le2proc(le, list_link)->flags &= ~flags;
+		}
+	}
+	spin_unlock_irqrestore(&proc_lock, intr_flag);
+}
+
+// proc_next_pid - the first pid in use from pid on, -1 if none
+int proc_next_pid(int pid)
+{
+	if (pid < sysconf.lcpu_count) {
+		pid = sysconf.lcpu_count;
+	}
+	pid = find_next_bit(pid_map, MAX_PID, pid);
+	return (pid < MAX_PID) ? pid : -1;
+}
+
+// proc_status_show - the state, memory and files of pid into buf of size
+//                  - bytes; the length is returned, 0 if there is no pid.
+//                  - The mm and the files of the proc are read without
+//                  - their locks, as hints
+size_t proc_status_show(int pid, char *buf, size_t size)
+{
+	struct proc_struct *proc;
+	struct mm_struct *mm;
+	size_t len = 0;
+	bool intr_flag;
+	spin_lock_irqsave(&proc_lock, intr_flag);
+	if ((proc = find_proc(pid)) == NULL) {
+		goto out;
+	}
+	len += snprintf(buf + len, size - len,
+			"Name:\t%s\nState:\t%s\nPid:\t%d\nPPid:\t%d\n"
+			"Cpu:\t%d\nPolicy:\t%d\nPrio:\t%d\nNice:\t%d\n"
+			"Sched:\t%s\nRuntime:\t%llu\n",
+			proc->name, proc_state_name(proc), proc->pid,
+			(proc->parent != NULL) ? proc->parent->pid : 0,
+			(proc->rq != NULL) ? proc->rq->cpu : -1,
+			proc->policy, proc->rt_priority, proc->nice,
+			sched_class_name(proc), sched_runtime(proc));
+	if (proc->state == PROC_ZOMBIE) {
+		goto out;
+	}
+	if ((mm = proc->mm) != NULL && len < size) {
+		len += snprintf(buf + len, size - len,
+				"VmAreas:\t%d\nVmBrk:\t%lu kB\nMmUsers:\t%d\n",
+				mm->map_count,
+				(unsigned long)(mm->brk - mm->brk_start) / 1024,
+				mm_count(mm));
+	}
+	if (proc->fs_struct != NULL && len < size) {
+		len += snprintf(buf + len, size - len, "FDSize:\t%d\n",
+				proc->fs_struct->fdt->max_fds);
+	}
+out:
+	spin_unlock_irqrestore(&proc_lock, intr_flag);
+	return (len < size) ? len : size;
+}
+
+// proc_fd_show - a line for each fd pid has open into buf of size bytes,
+//              - see fd_show; the length is returned
+size_t proc_fd_show(int pid, char *buf, size_t size)
+{
+	struct proc_struct *proc;
+	size_t len = 0;
+	bool intr_flag;
+	spin_lock_irqsave(&proc_lock, intr_flag);
+	if ((proc = find_proc(pid)) != NULL && proc->state != PROC_ZOMBIE
+	    && proc->fs_struct != NULL) {
+		len = fd_show(proc->fs_struct, buf, size);
+	}
+	spin_unlock_irqrestore(&proc_lock, intr_flag);
+	return len;
+}
+
+#ifdef UCONFIG_SCHEDSTATS
+// proc_schedstat_show - the wait and run histograms of pid into buf of size
+//                     - bytes, see schedstat.h; the length is returned
+size_t proc_schedstat_show(int pid, char *buf, size_t size)
+{
+	struct proc_struct *proc;
+	struct sched_stat stat;
+	size_t len = 0;
+	bool intr_flag;
+	spin_lock_irqsave(&proc_lock, intr_flag);
+	if ((proc = find_proc(pid)) == NULL) {
+		spin_unlock_irqrestore(&proc_lock, intr_flag);
+		return 0;
+	}
+	stat = proc->sched_stat;
+	spin_unlock_irqrestore(&proc_lock, intr_flag);
+	len += log2_hist_show(&(stat.wait), "wait", buf + len, size - len);
+	len += log2_hist_show(&(stat.run), "run", buf + len, size - len);
+	return len;
+}
+#endif
+
 // __do_kill - kill a process with PCB by set this process's flags with PF_EXITING
 static int __do_kill(struct proc_struct *proc, int error_code)
 {
@@ -1632,12 +3124,15 @@ out_unlock:
 }
 */
 
-// do_sleep - set current process state to sleep and add timer with "time"
-//          - then call scheduler. if process run again, delete timer first.
-//      time is jiffies
-int do_sleep(unsigned int time)
+// __do_sleep - set current process state to sleep and add timer with "time"
+//            - then call scheduler. if process run again, delete timer first.
+//            - the ticks left are stored in left if woken up early.
+static int __do_sleep(unsigned int time, unsigned int *left)
 {
 	assert(!ucore_in_interrupt());
+	if (left != NULL) {
+		*left = 0;
+	}
 	if (time == 0) {
 		return 0;
 	}
@@ -1651,10 +3146,59 @@ int do_sleep(unsigned int time)
 
 	schedule();
 
+	if (left != NULL) {
+		*left = timer_remaining(timer);
+	}
 	del_timer(timer);
 	return 0;
 }
 
+// do_sleep - sleep for "time" jiffies
+int do_sleep(unsigned int time)
+{
+	return __do_sleep(time, NULL);
+}
+
+// do_nanosleep - sleep for at least the time in req, on an hrtimer due
+//              - at the ns it ends. the time left is stored in rem if not
+//              - NULL.
+int do_nanosleep(const struct linux_timespec *req, struct linux_timespec *rem)
+{
+	struct hrtimer timer;
+	uint64_t sec, ns, now;
+	bool intr_flag;
+	assert(!ucore_in_interrupt());
+	if (req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= NSEC_PER_SEC)
+		return -E_INVAL;
+	/* as long as the clock allows */
+	sec = ((unsigned long)req->tv_sec < ((unsigned int)-1 >> 1))
+	    ? req->tv_sec : ((unsigned int)-1 >> 1);
+	ns = sec * NSEC_PER_SEC + req->tv_nsec;
+	if (ns == 0) {
+		if (rem != NULL) {
+			rem->tv_sec = rem->tv_nsec = 0;
+		}
+		return 0;
+	}
+	hrtimer_init(&timer, current, ktime_get_ns() + ns);
+	local_intr_save(intr_flag);
+	current->state = PROC_SLEEPING;
+	current->wait_state = WT_TIMER;
+	hrtimer_start(&timer);
+	local_intr_restore(intr_flag);
+
+	schedule();
+
+	hrtimer_cancel(&timer);
+	if (rem != NULL) {
+		now = ktime_get_ns();
+		ns = (timer.expires > now) ? timer.expires - now : 0;
+		rem->tv_nsec = do_div(ns, NSEC_PER_SEC);
+		rem->tv_sec = ns;
+	}
+	return 0;
+}
+
 int do_linux_sleep(const struct linux_timespec __user * req,
 		   struct linux_timespec __user * rem)
 {
@@ -1666,18 +3210,8 @@ int do_linux_sleep(const struct linux_timespec __user * req,
 		return -E_INVAL;
 	}
 	unlock_mm(mm);
-	long msec = kts.tv_sec * 1000 + kts.tv_nsec / 1000000;
-	if (msec < 0)
-		return -E_INVAL;
-#ifdef UCONFIG_HAVE_LINUX_DDE_BASE
-	unsigned long j = msecs_to_jiffies(msec);
-#else
-	unsigned long j = msec / 10;
-#endif
-	//kprintf("do_linux_sleep: sleep %d msec, %d jiffies\n", msec, j);
-	int ret = do_sleep(j);
-	if (rem) {
-		memset(&kts, 0, sizeof(struct linux_timespec));
+	int ret = do_nanosleep(&kts, &kts);
+	if (ret == 0 && rem) {
 		lock_mm(mm);
 		if (!copy_to_user(mm, rem, &kts, sizeof(struct linux_timespec))) {
 			unlock_mm(mm);
@@ -1717,6 +3251,10 @@ __do_linux_mmap(uintptr_t __user * addr_store, size_t len, uint32_t mmap_flags)
 		vm_flags |= VM_WRITE;
 	if (mmap_flags & MMAP_STACK)
 		vm_flags |= VM_STACK;
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+	if ((vm_flags & (VM_WRITE | VM_STACK)) == VM_WRITE)
+		vm_flags |= VM_HUGEPAGE;
+#endif
 
 	ret = -E_NO_MEM;
 	if (addr == 0) {
@@ -1755,7 +3293,8 @@ int do_mmap(uintptr_t __user * addr_store, size_t len, uint32_t mmap_flags)
 	    ROUNDUP(addr + len, PGSIZE);
 	addr = start, len = end - start;
 
-	uint32_t vm_flags = VM_READ;
+	/* anonymous, so that it may merge with the maps next to it */
+	uint32_t vm_flags = VM_READ | VM_ANONYMOUS;
 	if (mmap_flags & MMAP_WRITE)
 		vm_flags |= VM_WRITE;
 	if (mmap_flags & MMAP_STACK)
@@ -1769,11 +3308,78 @@ int do_mmap(uintptr_t __user * addr_store, size_t len, uint32_t mmap_flags)
 	}
 	if ((ret = mm_map(mm, addr, len, vm_flags, NULL)) == 0) {
 		copy_to_user(mm, addr_store, &addr, sizeof(uintptr_t));
+		if (mmap_flags & MMAP_POPULATE) {
+			mm_populate(mm, addr, addr + len);
+		}
+	}
+out_unlock:
+	unlock_mm(mm);
+	return ret;
+}
+
+#ifdef UCONFIG_DYNAMIC_LINK
+/*
+ * do_mmap_file - map the filesz bytes of fd at offset from *addr_store on,
+ * and zeroes after them up to len, the way exec maps a segment: the pages
+ * are read by their first faults, and those wholly of the file come from
+ * the exec cache, shared by all the processes mapping them until written.
+ * The address is kept congruent to offset modulo PGSIZE; 0 picks one, and
+ * it is stored back.
+ */
+int
+do_mmap_file(uintptr_t __user * addr_store, size_t len, uint32_t mmap_flags,
+	     int fd, off_t offset, size_t filesz)
+{
+	struct mm_struct *mm = current->mm;
+	if (mm == NULL) {
+		panic("kernel thread call mmap_file!!.\n");
+	}
+	if (addr_store == NULL || len == 0 || filesz > len || offset < 0) {
+		return -E_INVAL;
+	}
+
+	struct inode *node;
+	struct vma_struct *vma;
+	uintptr_t addr, start, end;
+	int ret;
+	if ((ret = file_getnode(fd, &node)) != 0) {
+		return ret;
+	}
+
+	lock_mm(mm);
+	ret = -E_INVAL;
+	if (!copy_from_user(mm, &addr, addr_store, sizeof(uintptr_t), 1)) {
+		goto out_unlock;
+	}
+	if (addr == 0) {
+		ret = -E_NO_MEM;
+		if ((addr = get_unmapped_area(mm, len + PGSIZE)) == 0) {
+			goto out_unlock;
+		}
+		addr += offset % PGSIZE;
+	} else if ((addr - offset) % PGSIZE != 0) {
+		goto out_unlock;
+	}
+	start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+
+	uint32_t vm_flags = VM_READ;
+	if (mmap_flags & MMAP_WRITE)
+		vm_flags |= VM_WRITE;
+	if (mmap_flags & MMAP_EXEC)
+		vm_flags |= VM_EXEC;
+
+	if ((ret = mm_map(mm, start, end - start, vm_flags, &vma)) == 0) {
+		if (filesz != 0) {
+			vma_set_exec(vma, node, addr, filesz, offset);
+		}
+		copy_to_user(mm, addr_store, &addr, sizeof(uintptr_t));
 	}
 out_unlock:
 	unlock_mm(mm);
+	vop_ref_dec(node);
 	return ret;
 }
+#endif /* UCONFIG_DYNAMIC_LINK */
 
 // do_munmap - delete vma with addr & len
 int do_munmap(uintptr_t addr, size_t len)
@@ -1811,6 +3417,8 @@ int do_mprotect(void *addr, size_t len, int prot)
 	uintptr_t start = ROUNDDOWN(addr, PGSIZE);
 	uintptr_t end = ROUNDUP(addr + len, PGSIZE);
 
+	uintptr_t prot_start = start;
+
 	int ret = -E_INVAL;
 	lock_mm(mm);
 
@@ -1837,9 +3445,22 @@ int do_mprotect(void *addr, size_t len, int prot)
 			struct mapped_file_struct mfile = vma->mfile;
 			mfile.offset += this_start - vma->vm_start;
 			uint32_t flags = vma->vm_flags;
+#ifdef UCONFIG_DEMAND_EXEC
+			/* held across the unmap, which drops the one of vma */
+			struct vma_struct exec_hold;
+			vma_copy_exec(&exec_hold, vma);
+#endif
+#ifdef UCONFIG_TRANSPARENT_HUGEPAGE
+			/* the vma gets cut, no huge page may cross the cut */
+			split_huge_at(mm->pgdir, this_start);
+			split_huge_at(mm->pgdir, this_end);
+#endif
 			if ((ret =
 			     mm_unmap_keep_pages(mm, this_start,
 						 this_end - this_start)) != 0) {
+#ifdef UCONFIG_DEMAND_EXEC
+				vma_put_exec(&exec_hold);
+#endif
 				goto out;
 			}
 			if (prot & PROT_WRITE) {
@@ -1847,9 +3468,16 @@ int do_mprotect(void *addr, size_t len, int prot)
 			} else {
 				flags &= ~VM_WRITE;
 			}
-			if ((ret =
-			     mm_map(mm, this_start, this_end - this_start,
-				    flags, &vma)) != 0) {
+			ret =
+			    mm_map(mm, this_start, this_end - this_start,
+				   flags, &vma);
+#ifdef UCONFIG_DEMAND_EXEC
+			if (ret == 0) {
+				vma_copy_exec(vma, &exec_hold);
+			}
+			vma_put_exec(&exec_hold);
+#endif
+			if (ret != 0) {
 				goto out;
 			}
 			vma->mfile = mfile;
@@ -1865,6 +3493,15 @@ int do_mprotect(void *addr, size_t len, int prot)
 		start = last_end;
 	}
 
+	/* the ptes of the whole range lose write in one walk and one flush;
+	 * those gaining it get it back on their next write fault */
+	if (!(prot & PROT_WRITE)) {
+		struct tlb_gather tlb;
+		tlb_gather_init(&tlb, mm->pgdir);
+		wrprotect_range_gather(&tlb, prot_start, end);
+		tlb_gather_finish(&tlb);
+	}
+
 out:
 	unlock_mm(mm);
 	return ret;
@@ -1923,6 +3560,68 @@ out_unlock:
 	return ret;
 }
 
+// do_shm_open - map the shmem named name at *addr_store, or anywhere if it
+//             - is 0; with SHM_CREATE one of len bytes is made if none is
+//             - there, an existing one is mapped whole whatever len is
+int
+do_shm_open(const char __user * name, size_t len, uint32_t mmap_flags,
+	    uintptr_t __user * addr_store)
+{
+	struct mm_struct *mm = current->mm;
+	if (mm == NULL) {
+		panic("kernel thread call mmap!!.\n");
+	}
+	if (name == NULL || addr_store == NULL) {
+		return -E_INVAL;
+	}
+
+	int ret = -E_INVAL;
+	char kname[SHMEM_NAME_LEN + 1];
+	uintptr_t addr;
+
+	lock_mm(mm);
+	if (!copy_string(mm, kname, name, sizeof(kname))
+	    || !copy_from_user(mm, &addr, addr_store, sizeof(uintptr_t), 1)) {
+		goto out_unlock;
+	}
+
+	struct shmem_struct *shmem;
+	if ((ret = shmem_open(kname, ROUNDUP(len, PGSIZE),
+			      (mmap_flags & SHM_CREATE) != 0, &shmem)) != 0) {
+		goto out_unlock;
+	}
+
+	uint32_t vm_flags = VM_READ;
+	if (mmap_flags & MMAP_WRITE)
+		vm_flags |= VM_WRITE;
+
+	ret = -E_NO_MEM;
+	addr = ROUNDDOWN(addr, PGSIZE);
+	if (addr == 0 && (addr = get_unmapped_area(mm, shmem->len)) == 0) {
+		goto out_put;
+	}
+	if ((ret = mm_map_shmem(mm, addr, vm_flags, shmem, NULL)) == 0) {
+		copy_to_user(mm, addr_store, &addr, sizeof(uintptr_t));
+	}
+out_put:
+	shmem_put(shmem);
+out_unlock:
+	unlock_mm(mm);
+	return ret;
+}
+
+// do_shm_unlink - drop the name of a shmem, the maps of it stay
+int do_shm_unlink(const char __user * name)
+{
+	struct mm_struct *mm = current->mm;
+	char kname[SHMEM_NAME_LEN + 1];
+	bool copied;
+	lock_mm(mm);
+	copied = copy_string(mm, kname, name, sizeof(kname));
+	unlock_mm(mm);
+	return copied ? shmem_unlink(kname) : -E_INVAL;
+}
+
 #define __KERNEL_EXECVE(name, path, ...) ({                         \
             const char *argv[] = {path, ##__VA_ARGS__, NULL};       \
             const char *envp[] = {"PATH=/bin/", NULL};              \
@@ -1942,6 +3641,8 @@ out_unlock:
 // user_main - kernel thread used to exec a user program
 static int user_main(void *arg)
 {
+	/* the first user process, its children keep its affinity: any cpu */
+	sched_setaffinity_mask(current, NULL);
 	sysfile_open("stdin:", O_RDONLY);
 	sysfile_open("stdout:", O_WRONLY);
 	sysfile_open("stdout:", O_WRONLY);
@@ -1961,6 +3662,25 @@ static int user_main(void *arg)
 static int init_main(void *arg)
 {
 	int pid;
+	struct proc_struct *flusher = NULL;
+#ifdef UCONFIG_KLOG
+	klog_init();
+#endif
+	int nr_workers = workqueue_start();
+	async_initcalls_run();
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	if ((pid = ucore_kernel_thread(sfs_flusher_main, NULL, 0)) <= 0) {
+		panic("sfs flusher init failed.\n");
+	}
+	flusher = find_proc(pid);
+	set_proc_name(flusher, "sfsflush");
+#endif
+#ifdef UCONFIG_SFS_JOURNAL
+	if ((pid = ucore_kernel_thread(sfs_journal_main, NULL, 0)) <= 0) {
+		panic("sfs journal init failed.\n");
+	}
+	set_proc_name(find_proc(pid), "sfsjournal");
+#endif
 #ifdef UCONFIG_SWAP
 	if ((pid = ucore_kernel_thread(kswapd_main, NULL, 0)) <= 0) {
 		panic("kswapd init failed.\n");
@@ -1970,6 +3690,31 @@ static int init_main(void *arg)
 #else
 	kprintf("init_main:: swapping is disabled.\n");
 #endif
+#ifdef UCONFIG_KSM
+	if ((pid = ucore_kernel_thread(ksmd_main, NULL, 0)) <= 0) {
+		panic("ksmd init failed.\n");
+	}
+	set_proc_name(find_proc(pid), "ksmd");
+#endif
+#ifdef UCONFIG_COMPACTION
+	if ((pid = ucore_kernel_thread(kcompactd_main, NULL, 0)) <= 0) {
+		panic("kcompactd init failed.\n");
+	}
+	set_proc_name(find_proc(pid), "kcompactd");
+#endif
+#ifdef UCONFIG_VIRTIO_BALLOON
+	if (virtio_balloon_valid()) {
+		if ((pid = ucore_kernel_thread(vballoon_main, NULL, 0)) <= 0) {
+			panic("vballoon init failed.\n");
+		}
+		set_proc_name(find_proc(pid), "vballoon");
+	}
+#endif
+
+	async_initcalls_wait();
+#ifdef UCONFIG_BOOT_TIME
+	boot_time_print();
+#endif
 
 	int ret;
 	char root[] = "disk0:";
@@ -1977,10 +3722,23 @@ static int init_main(void *arg)
 		panic("set boot fs failed: %e.\n", ret);
 	}
 
+#ifdef UCONFIG_VFS_REFCACHE
+	/* the inodes dropped until now are reclaimed a few ticks later */
+	refcache_drain();
+#endif
+#ifdef UCONFIG_SFS_PAGE_CACHE
+	/* the pages cached until now would be freed by the unmount */
+	sfs_cache_drain();
+#endif
+	/* the procs waited for are freed a few ticks later */
+	rcu_drain();
+	/* objs cached in the magazines hold their slabs */
+	slab_drain();
+	proc_cache_drain();
 	size_t nr_used_pages_store = nr_used_pages();
 	size_t slab_allocated_store = slab_allocated();
 
-	unsigned int nr_process_store = nr_process;
+	long nr_process_store = percpu_counter_sum(&nr_process);
 
 	pid = ucore_kernel_thread(user_main, NULL, 0);
 	if (pid <= 0) {
@@ -1988,7 +3746,7 @@ static int init_main(void *arg)
 	}
 
 	while (do_wait(0, NULL) == 0) {
-		if (nr_process_store == nr_process) {
+		if (nr_process_store == percpu_counter_sum(&nr_process)) {
 			break;
 		}
 		schedule();
@@ -2005,6 +3763,9 @@ static int init_main(void *arg)
 #endif
 
 	mbox_cleanup();
+#ifdef UCONFIG_VFS_REFCACHE
+	refcache_drain();
+#endif
 	fs_cleanup();
 
 	kprintf("all user-mode processes have quit.\n");
@@ -2012,11 +3773,19 @@ static int init_main(void *arg)
 	assert(initproc->cptr == kswapd && initproc->yptr == NULL
 	       && initproc->optr == NULL);
 	assert(kswapd->cptr == NULL && kswapd->yptr == NULL
-	       && kswapd->optr == NULL);
-	assert(nr_process == 2 + sysconf.lcpu_count);
+	       && kswapd->optr == flusher);
+	assert(percpu_counter_sum(&nr_process) ==
+	       2 + sysconf.lcpu_count + (flusher != NULL) + nr_workers);
 #else
-	assert(nr_process == 1 + sysconf.lcpu_count);
+	assert(percpu_counter_sum(&nr_process) ==
+	       1 + sysconf.lcpu_count + (flusher != NULL) + nr_workers);
+#endif
+#ifdef UCONFIG_MM_REAP
+	mm_reap_drain();
 #endif
+	rcu_drain();
+	slab_drain();
+	proc_cache_drain();
 	assert(nr_used_pages_store == nr_used_pages());
 	assert(slab_allocated_store == slab_allocated());
 	kprintf("init check memory pass.\n");
@@ -2027,21 +3796,39 @@ static int init_main(void *arg)
 //           - create the second kernel thread init_main
 void proc_init(void)
 {
-	int i;
 	int cpuid = myid();
 	struct proc_struct *idle;
 
+	proc_cachep = kmem_cache_create("proc_struct",
+					sizeof(struct proc_struct),
+					KMEM_CACHE_LINE, NULL);
+	if (proc_cachep == NULL) {
+		panic("cannot create proc_struct cache.\n");
+	}
+
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct proc_cache *pc = per_cpu_ptr(proc_caches, i);
+		memset(pc, 0, sizeof(struct proc_cache));
+		spinlock_init(&(pc->lock));
+	}
+	workqueue_init();
+
 	spinlock_init(&proc_lock);
 	list_init(&proc_list);
 	list_init(&proc_mm_list);
-	for (i = 0; i < HASH_LIST_SIZE; i++) {
-		list_init(hash_list + i);
-	}
+#ifdef UCONFIG_MM_REAP
+	list_init(&mm_reap_list);
+	spinlock_init(&mm_reap_lock);
+	init_work(&mm_reap_work, mm_reap);
+#endif
+	percpu_counter_init(&nr_process, 0);
 
 	idle = alloc_proc();
 	if (idle == NULL) {
 		panic("cannot alloc idleproc.\n");
 	}
+	proc_wait_init(idle);
 
 	idle->pid = cpuid;
 	idle->state = PROC_RUNNABLE;
@@ -2058,7 +3845,7 @@ void proc_init(void)
 	snprintf(namebuf, 32, "idle/%d", cpuid);
 
 	set_proc_name(idle, namebuf);
-	nr_process++;
+	percpu_counter_inc(&nr_process);
 
 	idleproc = idle;
 	current = idle;
@@ -2084,6 +3871,7 @@ void proc_init_ap(void)
 	if (idle == NULL) {
 		panic("cannot alloc idleproc.\n");
 	}
+	proc_wait_init(idle);
 
 	idle->pid = cpuid;
 	idle->state = PROC_RUNNABLE;
@@ -2100,7 +3888,7 @@ void proc_init_ap(void)
 	snprintf(namebuf, 32, "idle/%d", cpuid);
 
 	set_proc_name(idle, namebuf);
-	nr_process++;
+	percpu_counter_inc(&nr_process);
 
 	idleproc = idle;
 	current = idle;
@@ -2114,7 +3902,7 @@ void proc_init_ap(void)
 	snprintf(proc_name, 32, "krefcache/%d", myid());
 	set_proc_name(cleaner, proc_name);
 	set_proc_cpu_affinity(cleaner, myid());
-	nr_process++;
+	percpu_counter_inc(&nr_process);
 #endif
 
 	assert(idleproc != NULL && idleproc->pid == cpuid);
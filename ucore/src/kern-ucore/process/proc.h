@@ -13,6 +13,11 @@
 #include <arch_proc.h>
 #include <signal.h>
 #include <spinlock.h>
+#include <rb_inline.h>
+#include <schedpolicy.h>
+#include <rusage.h>
+#include <schedstat.h>
+#include <rcu.h>
 
 // process's state in his life cycle
 enum proc_state {
@@ -50,17 +55,46 @@ struct proc_struct {
 	uint32_t flags;		// Process flag
 	char name[PROC_NAME_LEN + 1];	// Process name
 	list_entry_t list_link;	// Process link list 
-	list_entry_t hash_link;	// Process hash list
 	int exit_code;		// return value when exit
 	uint32_t wait_state;	// Process waiting state: the reason of sleeping
 	struct proc_struct *cptr, *yptr, *optr;	// Process's children, yonger sibling, Old sibling
 	list_entry_t thread_group;	// the threads list including this proc which share resource (mem/file/sem...)
+	list_entry_t zombie_list;	// the children exited and not yet waited for, oldest first
+	list_entry_t zombie_link;	// the entry linked in the zombie_list of parent
+	int wait_pid;		// the child waited for in WT_CHILD, 0 for any
+	struct rcu_head rcu;	// frees it once the readers of find_proc are gone
 
 	struct arch_proc_struct arch;	// Arch dependant info. See arch_proc.h
 
 	struct run_queue *rq;	// running queue contains Process
 	list_entry_t run_link;	// the entry linked in run queue
 	int time_slice;		// time slice for occupying the CPU
+	int mlfq_level;		// its MLFQ level, 0 picked first
+	struct rbi_node cfs_node;	// the node in the CFS run queue
+	uint64_t vruntime;	// CFS virtual runtime, weighted ticks
+	int nice;		// nice value, from -20 to 19, weights the vruntime
+	unsigned int timer_slack;	// ticks its timers may fire late by
+	uint64_t runtime;	// ns run to its last switch, see sched_runtime
+	uint64_t exec_start;	// the ns it last got the cpu at
+	unsigned int last_ran;	// the tick of its cpu it last left it at
+	struct rusage rusage;	// the resources used, see rusage.h
+	struct rusage child_rusage;	// those of the children waited for
+#ifdef UCONFIG_SCHEDSTATS
+	uint64_t sched_enqueued;	// ns it was queued at, 0 once it runs
+	uint64_t sched_ran;	// ns it last got its cpu at
+	struct sched_stat sched_stat;	// see schedstat.h
+#endif
+	int policy;		// SCHED_xxx in schedpolicy.h
+	int rt_priority;	// realtime priority, 0 for SCHED_NORMAL
+	int normal_policy;	// policy as set, before any inherited priority
+	int normal_prio;	// rt_priority as set
+	int pi_prio;		// inherited from the waiters of pi_held, see rtmutex.c
+	list_entry_t pi_held;	// the rt_mutexes it holds
+	struct rt_mutex_waiter *pi_blocked_on;	// the one it waits for
+	bool pi_exited;		// no rt_mutex may be held on its behalf any more
+#ifdef UCONFIG_PREEMPT
+	int preempt_count;	// preemption is disabled while not 0
+#endif
 	sem_queue_t *sem_queue;	// the user semaphore queue which process waits
 	event_t event_box;	// the event which process waits   
 	struct fs_struct *fs_struct;	// the file related info(pwd, files_count, files_array, fs_semaphore) of process
@@ -69,13 +103,37 @@ struct proc_struct {
 
 	void *tls_pointer;
 
-	int cpu_affinity;
+	int cpu_affinity;	// the cpu it last ran on with PF_PINCPU
+	cpuset_t cpus_allowed;	// the cpus it may run on with PF_PINCPU
 	spinlock_s lock;
+#ifdef UCONFIG_MEMCG
+	struct mem_group *memcg;	// the memory group it is in, see memcg.c
+#endif
+#ifdef UCONFIG_CPUCG
+	struct cpu_group *cpucg;	// the cpu group it is in, see cpucg.c
+	list_entry_t cg_link;	// held back on the throttled_list of a group
+#endif
+
+	struct vfork_done *vfork_done;	// the parent waits on it until exec or exit
+};
+
+/* a vfork parent sleeps on this, on its kernel stack, until the child lets
+ * go of the mm by an exec or its exit */
+struct vfork_done {
+	wait_queue_t wait_queue;
+	bool done;
+	bool exited;		// exit_code is valid, the child never ran the new image
+	int exit_code;
 };
 
+#define PROC_NICE_MIN               NICE_MIN
+#define PROC_NICE_MAX               NICE_MAX
+
 #define PROC_CPU_NO_AFFINITY (-1)
 #define set_proc_cpu_affinity(proc, cpuid) \
-	do{(proc)->cpu_affinity = cpuid;}while(0)
+	do{(proc)->cpu_affinity = cpuid; \
+	   cpuset_clear(&(proc)->cpus_allowed); \
+	   cpuset_set(&(proc)->cpus_allowed, cpuid);}while(0)
 
 struct linux_timespec {
 	long tv_sec;		/* seconds */
@@ -83,35 +141,51 @@ struct linux_timespec {
 };
 
 #define PF_EXITING                  0x00000001	// getting shutdown
-#define PF_PINCPU                   0x00000002
+#define PF_PINCPU                   0x00000002	// runs on cpus_allowed only
+#define PF_MM_SHARED                0x00000004	// holds its mm with lock_mm_shared
+#define PF_WQ_WORKER                0x00000008	// a worker of a workqueue, see workqueue.c
+#define PF_SYSREC                   0x00000010	// its syscalls are recorded, see sysrec.c
 
 //the wait state
 #define WT_CHILD                    (0x00000001 | WT_INTERRUPTED)	// wait child process
 #define WT_TIMER                    (0x00000002 | WT_INTERRUPTED)	// wait timer
 #define WT_KSWAPD                    0x00000003	// wait kswapd to free page
+#define WT_VFORK                     0x00000005	// wait a vfork child to exec or exit
 #define WT_KBD                      (0x00000004 | WT_INTERRUPTED)	// wait the input of keyboard
 #define WT_KSEM                      0x00000100	// wait kernel semaphore
+#define WT_KSEM_SHARED               0x00000102	// wait kernel rwsem, as a reader
 #define WT_USEM                     (0x00000101 | WT_INTERRUPTED)	// wait user semaphore
 #define WT_EVENT_SEND               (0x00000110 | WT_INTERRUPTED)	// wait the sending event
 #define WT_EVENT_RECV               (0x00000111 | WT_INTERRUPTED)	// wait the recving event
 #define WT_MBOX_SEND                (0x00000120 | WT_INTERRUPTED)	// wait the sending mbox
 #define WT_MBOX_RECV                (0x00000121 | WT_INTERRUPTED)	// wait the recving mbox
+#define WT_FUTEX                    (0x00000130 | WT_INTERRUPTED)	// wait a futex
+#define WT_EPOLL                    (0x00000140 | WT_INTERRUPTED)	// wait an epoll
+#define WT_PKTIO                    (0x00000150 | WT_INTERRUPTED)	// wait a packet to receive
+#define WT_SOCKET                   (0x00000160 | WT_INTERRUPTED)	// wait a socket
+#define WT_IO                        0x00000300	// wait block device I/O
 #define WT_PIPE                     (0x00000200 | WT_INTERRUPTED)	// wait the pipe
 #define WT_SIGNAL					          (0x00000400 | WT_INTERRUPTED)	// wait the signal
 #define WT_KERNEL_SIGNAL            (0x00000800| WT_INTERRUPTED)
+#define WT_WORKER                    0x00000500	// an idle worker of a workqueue
+#define WT_KLOG                      0x00000600	// klogd waits for kprintf
 #define WT_INTERRUPTED               0x80000000	// the wait state could be interrupted
 
-#define TIF_SIGPENDING				0x00010000
-
 #define le2proc(le, member)         \
   to_struct((le), struct proc_struct, member)
 
+#define le2proc_cfs(node)           \
+    to_struct((node), struct proc_struct, cfs_node)
+
 #define current (mycpu()->__current)
 #define idleproc (mycpu()->idleproc)
 
 extern struct proc_struct *initproc;
 extern struct proc_struct *kswapd;
 
+struct kmem_cache_s;
+extern struct kmem_cache_s *proc_cachep;
+
 void proc_init(void);
 void proc_init_ap(void);
 
@@ -124,30 +198,66 @@ void cpu_idle(void) __attribute__ ((noreturn));
 void kernel_thread_entry(void);
 
 struct proc_struct *find_proc(int pid);
+void put_mm(struct mm_struct *mm);
 void may_killed(void);
 int do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf);
 int do_exit(int error_code);
 int do_exit_thread(int error_code);
 //int do_execve(const char *name, int argc, const char **argv);
 int do_execve(const char *name, const char **argv, const char **envp);
+int do_spawn(const char *name, const char **argv, const char **envp);
 int do_yield(void);
+int do_sched_setscheduler(int pid, int policy, int prio);
+int do_sched_getscheduler(int pid);
+int do_sched_setaffinity(int pid, size_t size, const void __user * mask);
+int do_sched_getaffinity(int pid, size_t size, void __user * mask);
+int do_timerslack(int pid, int slack);
+int do_sched_getparam(int pid);
+int do_setpriority(int pid, int nice);
+int do_getpriority(int pid, int __user * nice_store);
 int do_wait(int pid, int *code_store);
 int do_kill(int pid, int error_code);
 int do_brk(uintptr_t * brk_store);
 int do_linux_brk(uintptr_t brk);
 int do_sleep(unsigned int time);
+int do_nanosleep(const struct linux_timespec *req, struct linux_timespec *rem);
+int do_linux_sleep(const struct linux_timespec __user * req,
+		   struct linux_timespec __user * rem);
 int do_mmap(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
 int do_munmap(uintptr_t addr, size_t len);
+#ifdef UCONFIG_DYNAMIC_LINK
+int do_mmap_file(uintptr_t __user * addr_store, size_t len, uint32_t mmap_flags,
+		 int fd, off_t offset, size_t filesz);
+#endif
 int do_shmem(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
+int do_shm_open(const char __user * name, size_t len, uint32_t mmap_flags,
+		uintptr_t __user * addr_store);
+int do_shm_unlink(const char __user * name);
 int do_linux_waitpid(int pid, int *code_store);
+int do_getrusage(int who, struct rusage __user * usage);
+int do_settls(void *tls);
+void *do_gettls(void);
+#ifdef UCONFIG_CHECKPOINT
+int do_checkpoint(const char __user * path);
+int do_restore(const char __user * path);
+#endif
+size_t proc_rusage_show(char *buf, size_t size);
+int proc_next_pid(int pid);
+void proc_clear_flags(uint32_t flags);
+size_t proc_status_show(int pid, char *buf, size_t size);
+size_t proc_fd_show(int pid, char *buf, size_t size);
+#ifdef UCONFIG_SCHEDSTATS
+size_t proc_schedstat_show(int pid, char *buf, size_t size);
+#endif
 
 /* Implemented by archs */
 struct proc_struct *alloc_proc(void);
 struct proc_struct *next_thread(struct proc_struct *proc);
 void switch_to(struct context *from, struct context *to);
 
-/* For TLS(Thread Local Storage */
-void tls_switch(struct proc_struct *proc);
+/* For TLS(Thread Local Storage), prev NULL to load a new tls_pointer of
+ * next, which is current, see do_settls */
+void tls_switch(struct proc_struct *prev, struct proc_struct *next);
 
 void de_thread_arch_hook(struct proc_struct *proc);
 int copy_thread(uint32_t clone_flags, struct proc_struct *proc,
@@ -160,9 +270,27 @@ int init_new_context_dynamic(struct proc_struct *proc, struct elfhdr *elf,
 			     uint32_t is_dynamic, uint32_t real_entry,
 			     uint32_t load_address, uint32_t linker_base);
 #endif //UCONFIG_BIONIC_LIBC
+#ifdef UCONFIG_DYNAMIC_LINK
+#define EXEC_MAX_PHNUM      64
+
+/* what exec passes to the interpreter of a dynamic program, see load_interp */
+struct exec_auxv {
+	struct proghdr *phdr;	// of the program, copied to its stack
+	int phnum;
+	uintptr_t entry;	// of the program
+	uintptr_t base;		// bias of the interpreter
+};
+
+int init_new_context_interp(struct proc_struct *proc, struct elfhdr *elf,
+			    int argc, char **kargv, int envc, char **kenvp,
+			    uintptr_t entry, struct exec_auxv *auxv);
+#endif
 
 int kernel_thread(int (*fn) (void *), void *arg, uint32_t clone_flags);
 int kernel_execve(const char *name, const char **argv, const char **kenvp);
 int do_execve_arch_hook(int argc, char **kargv);
+#ifdef UCONFIG_CHECKPOINT
+void restore_tf_arch_hook(struct trapframe *tf, const struct trapframe *saved);
+#endif
 
 #endif /* !__KERN_PROCESS_PROC_H__ */
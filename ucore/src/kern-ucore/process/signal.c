@@ -29,90 +29,106 @@ void unlock_sig(struct sighand_struct *sh)
 	}
 }
 
-// remove sign from the pending queue
+// remove sign from the pending queue, all of its sends, with lock_sig held
 static void remove_from_queue(int sign, struct sigpending *queue)
 {
 	if (!sigismember(queue->signal, sign))
 		return;
-	sigset_del(queue->signal, sign);
-#ifdef SIGQUEUE
-	list_entry_t *list = &(queue->list);
-	list_entry_t *le = list_next(list);
-	while (le != list) {
-		struct sigqueue *sig = le2sigqueue(le);
-		le = le->next;
-		if (sig->info.si_signo != sign) {
-			continue;
+	sigpending_del(queue->signal, sign);
+	if (sig_is_queued(sign)) {
+		list_entry_t *list = &(queue->list);
+		list_entry_t *le = list_next(list);
+		while (le != list) {
+			struct sigqueue *q = le2sigqueue(le);
+			le = list_next(le);
+			if (q->info.si_signo == sign) {
+				list_del(&(q->list));
+				kfree(q);
+			}
 		}
-		list_del(le->prev);
-		kfree(sig);
 	}
-#endif
 }
 
-// calculate is there a signal in proc
-void sig_recalc_pending(struct proc_struct *proc)
+// dequeue_sigqueue - take one send of the realtime sign off queue, the bit
+//                  - stays while more are queued. Return 0 if it is gone.
+static bool dequeue_sigqueue(int sign, struct sigpending *queue)
 {
-	if ((get_si(proc)->pending.signal & ~(get_si(proc)->blocked)) != 0
-	    || (get_si(proc)->signal->
-		shared_pending.signal & ~(get_si(proc)->blocked)) != 0) {
-		proc->flags |= TIF_SIGPENDING;
-	} else {
-		proc->flags &= ~TIF_SIGPENDING;
+	list_entry_t *list = &(queue->list), *le = list;
+	struct sigqueue *found = NULL;
+	bool more = 0;
+	if (!sigismember(queue->signal, sign)) {
+		return 0;
+	}
+	while ((le = list_next(le)) != list) {
+		struct sigqueue *q = le2sigqueue(le);
+		if (q->info.si_signo == sign) {
+			if (found != NULL) {
+				more = 1;
+				break;
+			}
+			found = q;
+		}
 	}
+	if (found != NULL) {
+		list_del(&(found->list));
+		kfree(found);
+	}
+	if (!more) {
+		sigpending_del(queue->signal, sign);
+	}
+	return 1;
 }
 
-// return a signal every time, until empty then return 0
-static int dequeue_signal(struct proc_struct *proc)
+// dequeue_from - take the first unblocked signal pending in queue
+static int dequeue_from(struct proc_struct *proc, struct sigpending *queue)
 {
-	int sign = 0;
-	if (get_si(proc)->pending.signal != 0) {
-		while (++sign < 64) {
-			if (!sigismember(get_si(proc)->blocked, sign)
-			    && sigismember(get_si(proc)->pending.signal, sign)) {
-				remove_from_queue(sign,
-						  &(get_si(proc)->pending));
-				sig_recalc_pending(proc);
-				return sign;
-			}
+	sigset_t ready = queue->signal & ~(get_si(proc)->blocked);
+	int sign;
+	for (sign = 1; ready != 0; sign++, ready >>= 1) {
+		if (!(ready & 1)) {
+			continue;
 		}
-	}
-	sign = 0;
-	if (get_si(proc)->signal->shared_pending.signal != 0) {
-		while (++sign < 64) {
-			if (!sigismember(get_si(proc)->blocked, sign)
-			    && sigismember(get_si(proc)->signal->
-					   shared_pending.signal, sign)) {
-				remove_from_queue(sign,
-						  &(get_si(proc)->
-						    signal->shared_pending));
-				sig_recalc_pending(proc);
+		if (sig_is_queued(sign)) {
+			bool ret;
+			lock_sig(get_si(proc)->sighand);
+			ret = dequeue_sigqueue(sign, queue);
+			unlock_sig(get_si(proc)->sighand);
+			if (ret) {
 				return sign;
 			}
+		} else if (sigpending_test_and_del(queue->signal, sign)) {
+			return sign;
 		}
 	}
 	return 0;
 }
 
+// return a signal every time, until empty then return 0
+static int dequeue_signal(struct proc_struct *proc)
+{
+	int sign;
+	if ((sign = dequeue_from(proc, &(get_si(proc)->pending))) != 0) {
+		return sign;
+	}
+	return dequeue_from(proc, &(get_si(proc)->signal->shared_pending));
+}
+
 // clean the pending queue
-static void flush_sigqueue(struct sigpending *queue)
+void flush_sigqueue(struct sigpending *queue)
 {
 	sigset_initwith(queue->signal, 0);
-#ifdef SIGQUEUE
 	list_entry_t *list = &(queue->list);
 	list_entry_t *le;
-	while ((le = list->next) != list) {
+	while ((le = list_next(list)) != list) {
 		list_del(le);
 		kfree(le2sigqueue(le));
 	}
-	list_init(list);
-#endif
 }
 
 // is there a signal pending in proc
 static inline bool signal_pending(struct proc_struct *proc)
 {
-	return proc->flags & TIF_SIGPENDING;
+	return proc_signal_pending(get_si(proc));
 }
 
 // create a signal_struct and init it
@@ -213,7 +229,6 @@ int do_sigaction(int sign, const struct sigaction *act, struct sigaction *old)
 		struct proc_struct *proc = current;
 		do {
 			remove_from_queue(sign, &(get_si(proc)->pending));
-			sig_recalc_pending(proc);
 			proc = next_thread(proc);
 		} while (proc != current);
 	}
@@ -280,7 +295,6 @@ int do_sigprocmask(int how, const sigset_t * set, sigset_t * old)
 	default:
 		ret = -E_INVAL;
 	}
-	sig_recalc_pending(current);
 out:
 	return ret;
 }
@@ -323,51 +337,39 @@ int do_sigsuspend(sigset_t __user * pmask)
 	}
 }
 
-// add a signal to pending queue
+// add a signal to pending queue, a realtime one with its info
 static int
 send_signal(int sign, struct siginfo_t *info, struct proc_struct *to,
 	    struct sigpending *pending)
 {
-#ifdef SIGQUEUE
-	if ((int)info == 2) {
-		goto still_do_it;
-	}
-	struct sigqueue *q =
-	    (struct sigqueue *)kmalloc(sizeof(struct sigqueue));
-	if (q == NULL) {
-		goto still_do_it;
-	}
-	q->sem = &(to->sighand->sig_sem);
-	q->flags = 0;
-	list_add_before(&(pending->list), &(q->list));
-	if ((int)info == 0) {
-		q->info.si_signo = sign;
-		q->info.si_errno = 0;
-		q->info.si_code = SI_USER;
-	} else if ((int)info == 1) {
-		q->info.si_signo = sign;
-		q->info.si_errno = 0;
-		q->info.si_code = SI_KERNEL;
-	} else {
-		memcpy(&(q->info), info, sizeof(struct siginfo_t));
-	}
-#endif
-	sigset_add(pending->signal, sign);
-	return 0;
-#ifdef SIGQUEUE
-still_do_it:
-	if (sign >= 32 && info && (int)info != 1 && info->si_code != SI_USER) {
-		return -EAGAIN;
+	if (sig_is_queued(sign)) {
+		struct sigqueue *q =
+		    (struct sigqueue *)kmalloc(sizeof(struct sigqueue));
+		if (q == NULL) {
+			/* the pending bit alone still delivers it once */
+			if (sigismember(pending->signal, sign)) {
+				return -E_AGAIN;
+			}
+		} else {
+			q->flags = 0;
+			if (info == NULL) {
+				q->info.si_signo = sign;
+				q->info.si_errno = 0;
+				q->info.si_code = SI_KERNEL;
+			} else {
+				memcpy(&(q->info), info,
+				       sizeof(struct siginfo_t));
+			}
+			list_add_before(&(pending->list), &(q->list));
+		}
 	}
-	sigset_add(pending->signal, sign);
+	sigpending_add(pending->signal, sign);
 	return 0;
-#endif
 }
 
-// wake up proc to handle its signal
+// wake up proc to handle its signal, the pending bit is already set
 static void signal_wakeup(int sign, struct proc_struct *proc)
 {
-	proc->flags |= TIF_SIGPENDING;
 	if (proc->state == PROC_SLEEPING
 	    && (proc->wait_state & WT_INTERRUPTED || sign == SIGKILL)) {
 		try_to_wakeup(proc);
@@ -388,8 +390,9 @@ specific_send_sig_info(int sign, struct siginfo_t *info, struct proc_struct *to)
 	    && ignore_sig(sign, to)) {
 		goto out;
 	}
-	if (sigismember(get_si(to)->pending.signal, sign)) {
-		goto out;;
+	if (!sig_is_queued(sign)
+	    && sigismember(get_si(to)->pending.signal, sign)) {
+		goto out;
 	}
 	if (send_signal(sign, info, to, &(get_si(to)->pending)) == 0
 	    && !sigismember(get_si(to)->blocked, sign)) {
@@ -412,7 +415,6 @@ static int handle_stop_signal(int sign, struct proc_struct *to)
 		struct proc_struct *proc = current;
 		do {
 			remove_from_queue(SIGCONT, &(get_si(proc)->pending));
-			sig_recalc_pending(proc);
 			proc = next_thread(proc);
 		} while (proc != current);
 	} else if (sign == SIGCONT) {
@@ -430,7 +432,6 @@ static int handle_stop_signal(int sign, struct proc_struct *to)
 			remove_from_queue(SIGTSTP, &(get_si(proc)->pending));
 			remove_from_queue(SIGTTIN, &(get_si(proc)->pending));
 			remove_from_queue(SIGTTOU, &(get_si(proc)->pending));
-			sig_recalc_pending(proc);
 			proc = next_thread(proc);
 		} while (proc != current);
 	}
@@ -487,7 +488,8 @@ group_send_sig_info(int sign, struct siginfo_t *info, struct proc_struct *to)
 	    && ignore_sig(sign, to)) {
 		goto out;
 	}
-	if (sigismember(get_si(to)->signal->shared_pending.signal, sign)) {
+	if (!sig_is_queued(sign)
+	    && sigismember(get_si(to)->signal->shared_pending.signal, sign)) {
 		goto out;
 	}
 	if ((ret = send_signal(sign, info, to,
@@ -517,7 +519,6 @@ handle_signal(int sign, struct sigaction *act, sigset_t oldset,
 		lock_sig(get_si(current)->sighand);
 		get_si(current)->blocked |= act->sa_mask;
 		sigset_add(get_si(current)->blocked, sign);
-		sig_recalc_pending(current);
 		unlock_sig(get_si(current)->sighand);
 	}
 	return ret;
@@ -29,6 +29,24 @@
 #define sigmask(nsig)	\
 	(1ull << ((nsig) - 1))
 
+/* the pending sets are changed by atomic bit ops on their 32-bit words,
+ * so that the trap return path can test them without lock_sig */
+#define sigpending_word(set, nsig)	\
+	((volatile uint32_t *)&(set) + ((nsig) - 1) / 32)
+
+#define sigpending_add(set, nsig)	\
+	set_bit(((nsig) - 1) % 32, sigpending_word(set, nsig))
+
+#define sigpending_del(set, nsig)	\
+	clear_bit(((nsig) - 1) % 32, sigpending_word(set, nsig))
+
+#define sigpending_test_and_del(set, nsig)	\
+	test_and_clear_bit(((nsig) - 1) % 32, sigpending_word(set, nsig))
+
+/* a realtime signal keeps a sigqueue per send, the others are one bit */
+#define sig_is_queued(nsig)	\
+	((nsig) >= __SIGRTMIN)
+
 struct sigpending {
 	list_entry_t list;
 	sigset_t signal;
@@ -36,7 +54,6 @@ struct sigpending {
 
 struct sigqueue {
 	list_entry_t list;
-	semaphore_t *sem;
 	uint32_t flags;
 	struct siginfo_t info;
 };
@@ -69,6 +86,18 @@ struct proc_signal {
 	size_t sas_ss_size;
 };
 
+// proc_signal_pending - is a signal pending and not blocked, own or shared.
+//                     - No lock is taken, for the trap return path.
+static inline bool proc_signal_pending(struct proc_signal *si)
+{
+	sigset_t pending;
+	if (si->signal == NULL) {
+		return 0;
+	}
+	pending = si->pending.signal | si->signal->shared_pending.signal;
+	return (pending & ~si->blocked) != 0;
+}
+
 static inline int signal_count(struct signal_struct *sig)
 {
 	return atomic_read(&(sig->count));
@@ -134,7 +163,7 @@ int raise_signal(struct proc_struct *proc, int sign, bool group);
 
 int do_signal(struct trapframe *tf, sigset_t * old);
 
-void sig_recalc_pending(struct proc_struct *proc);
+void flush_sigqueue(struct sigpending *queue);
 
 int __sig_setup_frame(int sign, struct sigaction *act, sigset_t oldset,
 		      struct trapframe *tf);
@@ -0,0 +1,258 @@
+#include <types.h>
+#include <list.h>
+#include <atomic.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <wait.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <proc.h>
+#include <sched.h>
+#include <stdio.h>
+#include <assert.h>
+#include <workqueue.h>
+
+/* *
+ * Each cpu has a pool of WQ_NR_WORKERS kernel threads, kworker/cpu.n,
+ * pinned to it, which run the works queued on it in order. The pool keeps
+ * one worker running at a time when it can: a work queued while a worker
+ * runs waits for it, and an idle worker is woken only when none runs. A
+ * worker blocking in a work is seen by schedule() (wq_worker_sleeping),
+ * which then wakes an idle one for the works behind, so a sleeping work
+ * only holds up the others while all the workers of the cpu sleep.
+ * */
+#define WQ_NR_WORKERS               2
+
+struct worker_pool;
+
+struct worker {
+	struct proc_struct *proc;
+	struct worker_pool *pool;
+	struct work_struct *current_work;	// running, NULL when idle
+	bool blocked;		// sleeping in current_work
+};
+
+struct worker_pool {
+	spinlock_s lock;
+	int cpu;
+	list_entry_t works;	// pending, oldest first
+	int nr_running;		// the workers in a work and not blocked
+	struct worker workers[WQ_NR_WORKERS];
+	wait_queue_t idle_queue;	// the idle workers
+};
+
+static DEFINE_PERCPU_NOINIT(struct worker_pool, worker_pools);
+
+#define le2work(le, member)         to_struct((le), struct work_struct, member)
+
+void workqueue_init(void)
+{
+	int i, j;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct worker_pool *pool = per_cpu_ptr(worker_pools, i);
+		spinlock_init(&(pool->lock));
+		pool->cpu = i;
+		list_init(&(pool->works));
+		pool->nr_running = 0;
+		for (j = 0; j < WQ_NR_WORKERS; j++) {
+			struct worker *w = pool->workers + j;
+			w->proc = NULL;
+			w->pool = pool;
+			w->current_work = NULL;
+			w->blocked = 0;
+		}
+		wait_queue_init(&(pool->idle_queue));
+	}
+}
+
+// wake_idle_worker_locked - have an idle worker take the works, when none
+//                         - of the pool runs
+static void wake_idle_worker_locked(struct worker_pool *pool)
+{
+	if (pool->nr_running == 0 && !list_empty(&(pool->works))) {
+		wakeup_first(&(pool->idle_queue), WT_WORKER, 1);
+	}
+}
+
+static struct worker *worker_of(struct worker_pool *pool,
+				struct proc_struct *proc)
+{
+	int i;
+	for (i = 0; i < WQ_NR_WORKERS; i++) {
+		if (pool->workers[i].proc == proc) {
+			return pool->workers + i;
+		}
+	}
+	return NULL;
+}
+
+// wq_worker_sleeping - worker proc is going to sleep, called by schedule()
+//                    - with interrupts disabled
+void wq_worker_sleeping(struct proc_struct *proc)
+{
+	struct worker_pool *pool = get_cpu_ptr(worker_pools);
+	spinlock_acquire(&(pool->lock));
+	struct worker *w = worker_of(pool, proc);
+	if (w != NULL && w->current_work != NULL && !w->blocked) {
+		w->blocked = 1;
+		pool->nr_running--;
+		wake_idle_worker_locked(pool);
+	}
+	spinlock_release(&(pool->lock));
+}
+
+// wq_worker_running - worker proc is back from schedule()
+void wq_worker_running(struct proc_struct *proc)
+{
+	struct worker_pool *pool = get_cpu_ptr(worker_pools);
+	spinlock_acquire(&(pool->lock));
+	struct worker *w = worker_of(pool, proc);
+	if (w != NULL && w->blocked) {
+		w->blocked = 0;
+		pool->nr_running++;
+	}
+	spinlock_release(&(pool->lock));
+}
+
+static int worker_main(void *arg)
+{
+	struct worker *w = arg;
+	struct worker_pool *pool = w->pool;
+	wait_t __wait, *wait = &__wait;
+	bool intr_flag;
+
+	sched_setaffinity(current, pool->cpu);
+	while (myid() != pool->cpu) {
+		schedule();
+	}
+	spin_lock_irqsave(&(pool->lock), intr_flag);
+	w->proc = current;
+	current->flags |= PF_WQ_WORKER;
+	spin_unlock_irqrestore(&(pool->lock), intr_flag);
+
+	while (1) {
+		spin_lock_irqsave(&(pool->lock), intr_flag);
+		list_entry_t *le = list_next(&(pool->works));
+		if (le == &(pool->works)) {
+			wait_current_set(&(pool->idle_queue), wait, WT_WORKER);
+			spin_unlock_irqrestore(&(pool->lock), intr_flag);
+			schedule();
+			wait_current_del(&(pool->idle_queue), wait);
+			continue;
+		}
+		struct work_struct *work = le2work(le, link);
+		list_del_init(le);
+		clear_bit(WORK_PENDING, &(work->flags));
+		w->current_work = work;
+		pool->nr_running++;
+		spin_unlock_irqrestore(&(pool->lock), intr_flag);
+
+		/* it may queue itself again, or free itself */
+		work->func(work);
+
+		spin_lock_irqsave(&(pool->lock), intr_flag);
+		w->current_work = NULL;
+		pool->nr_running--;
+		spin_unlock_irqrestore(&(pool->lock), intr_flag);
+	}
+	return 0;
+}
+
+// workqueue_start - start the workers of all the cpus, children of current,
+//                 - and return how many there are
+int workqueue_start(void)
+{
+	int i, j, pid;
+	char name[32];
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct worker_pool *pool = per_cpu_ptr(worker_pools, i);
+		for (j = 0; j < WQ_NR_WORKERS; j++) {
+			if ((pid = ucore_kernel_thread(worker_main,
+						       pool->workers + j,
+						       0)) <= 0) {
+				panic("kworker init failed.\n");
+			}
+			snprintf(name, sizeof(name), "kworker/%d.%d", i, j);
+			set_proc_name(find_proc(pid), name);
+		}
+	}
+	return sysconf.lcpu_count * WQ_NR_WORKERS;
+}
+
+void init_work(struct work_struct *work,
+	       void (*func) (struct work_struct * work))
+{
+	list_init(&(work->link));
+	work->flags = 0;
+	work->cpu = -1;
+	work->func = func;
+}
+
+// queue_work_on - have work run by the workers of cpu, from any context;
+//               - false if it was pending already
+bool queue_work_on(int cpu, struct work_struct *work)
+{
+	bool intr_flag;
+	if (test_and_set_bit(WORK_PENDING, &(work->flags))) {
+		return 0;
+	}
+	struct worker_pool *pool = per_cpu_ptr(worker_pools, cpu);
+	spin_lock_irqsave(&(pool->lock), intr_flag);
+	work->cpu = cpu;
+	list_add_before(&(pool->works), &(work->link));
+	wake_idle_worker_locked(pool);
+	spin_unlock_irqrestore(&(pool->lock), intr_flag);
+	return 1;
+}
+
+bool schedule_work(struct work_struct *work)
+{
+	return queue_work_on(myid(), work);
+}
+
+// cancel_work - take work off its pool if it has not started yet, true if
+//             - it was pending
+bool cancel_work(struct work_struct *work)
+{
+	bool intr_flag, ret = 0;
+	int cpu = work->cpu;
+	if (cpu < 0 || !test_bit(WORK_PENDING, &(work->flags))) {
+		return 0;
+	}
+	struct worker_pool *pool = per_cpu_ptr(worker_pools, cpu);
+	spin_lock_irqsave(&(pool->lock), intr_flag);
+	if (work->cpu == cpu && test_bit(WORK_PENDING, &(work->flags))) {
+		list_del_init(&(work->link));
+		clear_bit(WORK_PENDING, &(work->flags));
+		ret = 1;
+	}
+	spin_unlock_irqrestore(&(pool->lock), intr_flag);
+	return ret;
+}
+
+static bool work_running(struct work_struct *work)
+{
+	bool intr_flag, ret = 0;
+	int i, j;
+	for (i = 0; i < sysconf.lcpu_count && !ret; i++) {
+		struct worker_pool *pool = per_cpu_ptr(worker_pools, i);
+		spin_lock_irqsave(&(pool->lock), intr_flag);
+		for (j = 0; j < WQ_NR_WORKERS; j++) {
+			if (pool->workers[j].current_work == work) {
+				ret = 1;
+			}
+		}
+		spin_unlock_irqrestore(&(pool->lock), intr_flag);
+	}
+	return ret;
+}
+
+// flush_work - wait until work is neither pending nor running, from a proc
+//            - other than the workers running it
+void flush_work(struct work_struct *work)
+{
+	while (test_bit(WORK_PENDING, &(work->flags)) || work_running(work)) {
+		do_sleep(1);
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef __KERN_PROCESS_WORKQUEUE_H__
+#define __KERN_PROCESS_WORKQUEUE_H__
+
+#include <types.h>
+#include <list.h>
+
+struct proc_struct;
+
+/* *
+ * work_struct - a function deferred to the kernel threads of a cpu, for
+ * what may sleep; queued again while pending, it runs once. See
+ * workqueue.c.
+ * */
+struct work_struct {
+	list_entry_t link;	// in the pending works of a pool
+	uint32_t flags;		// WORK_xxx bits
+	int cpu;		// of the pool it is pending in
+	void (*func) (struct work_struct * work);
+};
+
+#define WORK_PENDING                0	// queued, not started yet
+
+void init_work(struct work_struct *work,
+	       void (*func) (struct work_struct * work));
+bool queue_work_on(int cpu, struct work_struct *work);
+bool schedule_work(struct work_struct *work);
+bool cancel_work(struct work_struct *work);
+void flush_work(struct work_struct *work);
+
+void workqueue_init(void);
+int workqueue_start(void);
+void wq_worker_sleeping(struct proc_struct *proc);
+void wq_worker_running(struct proc_struct *proc);
+
+#endif /* !__KERN_PROCESS_WORKQUEUE_H__ */
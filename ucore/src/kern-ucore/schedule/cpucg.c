@@ -0,0 +1,400 @@
+#include <types.h>
+#include <list.h>
+#include <atomic.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <proc.h>
+#include <sched.h>
+#include <vmm.h>
+#include <sysconf.h>
+#include <error.h>
+#include <assert.h>
+#include <string.h>
+#include <cpucg.h>
+
+#ifdef UCONFIG_CPUCG
+
+/*
+ * Cpu groups bound the cpu time of the processes in them, so that a batch
+ * tenant is capped rather than left to crowd everyone else out of the run
+ * queues, which treat all processes alike.
+ *
+ * A process is in the group of its parent unless moved by CPUCG_ATTACH.
+ * Each tick a proc runs is charged, in sched_class_proc_tick, to its group
+ * and all the parents, so a group accounts for its children too:
+ *   - the shares weight the procs of a group under CFS, whose vruntime
+ *     goes the slower the more shares, see cpucg_weight;
+ *   - a group of a quota may run that many ticks, on all the cpus
+ *     together, in every period. Once it is out of them it is throttled:
+ *     the running procs in it give their cpus up, and a proc of it (or of
+ *     a child) about to be queued or picked is held back on its
+ *     throttled_list instead, see cpucg_throttle. The first cpu refills
+ *     the quotas at the end of each period, and the procs held back are
+ *     queued again.
+ * The realtime procs are charged but never throttled.
+ *
+ * Lock order: proc->lock, then cpucg_lock; no run queue is locked under
+ * cpucg_lock. It is taken from the tick, so always with interrupts off.
+ */
+
+#define MAX_CPU_GROUPS                  64
+
+#define CPUCG_FREE                      0
+#define CPUCG_LIVE                      1
+#define CPUCG_DEAD                      2
+
+static struct cpu_group cpu_groups[MAX_CPU_GROUPS];
+static spinlock_s cpucg_lock;
+/* the groups throttled now, the tick of cpu 0 must not stop meanwhile */
+static int nr_throttled_groups;
+
+void cpucg_init(void)
+{
+	int i;
+	spinlock_init(&cpucg_lock);
+	for (i = 0; i < MAX_CPU_GROUPS; i++) {
+		memset(cpu_groups + i, 0, sizeof(struct cpu_group));
+		cpu_groups[i].id = i + 1;
+		cpu_groups[i].state = CPUCG_FREE;
+		list_init(&(cpu_groups[i].throttled_list));
+	}
+	nr_throttled_groups = 0;
+}
+
+// cpucg_lookup - the live group of id, cpucg_lock held
+static struct cpu_group *cpucg_lookup(int id)
+{
+	if (id > 0 && id <= MAX_CPU_GROUPS
+	    && cpu_groups[id - 1].state == CPUCG_LIVE) {
+		return cpu_groups + id - 1;
+	}
+	return NULL;
+}
+
+struct cpu_group *cpucg_get(struct cpu_group *g)
+{
+	if (g != NULL) {
+		atomic_inc(&(g->ref));
+	}
+	return g;
+}
+
+void cpucg_put(struct cpu_group *g)
+{
+	bool intr_flag;
+	while (g != NULL && atomic_dec_test_zero(&(g->ref))) {
+		struct cpu_group *parent;
+		spin_lock_irqsave(&cpucg_lock, intr_flag);
+		assert(g->state == CPUCG_DEAD
+		       && list_empty(&(g->throttled_list)));
+		if (g->throttled) {
+			g->throttled = 0;
+			nr_throttled_groups--;
+		}
+		g->state = CPUCG_FREE;
+		parent = g->parent, g->parent = NULL;
+		spin_unlock_irqrestore(&cpucg_lock, intr_flag);
+		g = parent;
+	}
+}
+
+// cpucg_charge_tick - charge the tick just run to g and its parents, return
+//                   - whether the proc running it has to give the cpu up
+//                   - as one of them is out of its quota
+bool cpucg_charge_tick(struct cpu_group *g)
+{
+	bool throttled = 0;
+	spinlock_acquire(&cpucg_lock);
+	for (; g != NULL; g = g->parent) {
+		g->usage++;
+		if (g->quota != 0 && ++g->runtime >= g->quota && !g->throttled) {
+			g->throttled = 1;
+			g->nr_throttled++;
+			nr_throttled_groups++;
+		}
+		throttled |= g->throttled;
+	}
+	spinlock_release(&cpucg_lock);
+	return throttled;
+}
+
+// cpucg_throttle - hold proc, about to be queued or picked, back if its
+//                - group or a parent is throttled, until the period ends.
+//                - Called with interrupts off.
+bool cpucg_throttle(struct proc_struct *proc)
+{
+	struct cpu_group *g = proc->cpucg;
+	if (g == NULL) {
+		return 0;
+	}
+	spinlock_acquire(&cpucg_lock);
+	for (; g != NULL; g = g->parent) {
+		if (g->throttled) {
+			assert(list_empty(&(proc->cg_link)));
+			list_add_before(&(g->throttled_list), &(proc->cg_link));
+			break;
+		}
+	}
+	spinlock_release(&cpucg_lock);
+	return g != NULL;
+}
+
+// cpucg_pop_unthrottled - take a proc held back by g off, if g is not
+//                       - throttled any more
+static struct proc_struct *cpucg_pop_unthrottled(struct cpu_group *g)
+{
+	struct proc_struct *proc = NULL;
+	spinlock_acquire(&cpucg_lock);
+	if (!g->throttled && !list_empty(&(g->throttled_list))) {
+		list_entry_t *le = list_next(&(g->throttled_list));
+		list_del_init(le);
+		proc = le2proc(le, cg_link);
+	}
+	spinlock_release(&cpucg_lock);
+	return proc;
+}
+
+// cpucg_release_held - queue the procs g held back again, it is not
+//                    - throttled any more
+static void cpucg_release_held(struct cpu_group *g)
+{
+	struct proc_struct *proc;
+	/* a child still throttled gets its procs back on its own list */
+	while ((proc = cpucg_pop_unthrottled(g)) != NULL) {
+		sched_unthrottle(proc);
+	}
+}
+
+// cpucg_period_tick - called on the first cpu for each of its ticks, end
+//                   - the periods due and queue the procs held back again.
+//                   - Called with interrupts off.
+void cpucg_period_tick(void)
+{
+	int i;
+	for (i = 0; i < MAX_CPU_GROUPS; i++) {
+		struct cpu_group *g = cpu_groups + i;
+		bool refilled = 0;
+		spinlock_acquire(&cpucg_lock);
+		if (g->state != CPUCG_FREE && g->quota != 0) {
+			if (g->throttled) {
+				g->throttled_time++;
+			}
+			if (++g->elapsed >= g->period) {
+				if (g->runtime != 0) {
+					g->nr_periods++;
+				}
+				g->elapsed = g->runtime = 0;
+				if (g->throttled) {
+					g->throttled = 0;
+					nr_throttled_groups--;
+					refilled = 1;
+				}
+			}
+		}
+		spinlock_release(&cpucg_lock);
+		if (refilled) {
+			cpucg_release_held(g);
+		}
+	}
+}
+
+bool cpucg_any_throttled(void)
+{
+	return nr_throttled_groups != 0;
+}
+
+static int cpucg_create(int parent_id, unsigned long shares)
+{
+	struct cpu_group *parent = NULL, *g = NULL;
+	int i, ret = -E_INVAL;
+	bool intr_flag;
+	if (shares == 0) {
+		shares = CPUCG_SHARES_DEFAULT;
+	}
+	if (shares < CPUCG_SHARES_MIN || shares > CPUCG_SHARES_MAX) {
+		return -E_INVAL;
+	}
+	spin_lock_irqsave(&cpucg_lock, intr_flag);
+	if (parent_id != 0 && (parent = cpucg_lookup(parent_id)) == NULL) {
+		goto out;
+	}
+	ret = -E_NO_MEM;
+	for (i = 0; i < MAX_CPU_GROUPS; i++) {
+		if (cpu_groups[i].state == CPUCG_FREE) {
+			g = cpu_groups + i;
+			break;
+		}
+	}
+	if (g != NULL) {
+		g->state = CPUCG_LIVE;
+		g->parent = cpucg_get(parent);
+		atomic_set(&(g->ref), 1);
+		g->shares = shares;
+		g->quota = 0, g->period = CPUCG_PERIOD_DEFAULT;
+		g->runtime = g->elapsed = 0;
+		g->throttled = 0;
+		g->usage = g->nr_periods = g->nr_throttled = g->throttled_time = 0;
+		ret = g->id;
+	}
+out:
+	spin_unlock_irqrestore(&cpucg_lock, intr_flag);
+	return ret;
+}
+
+// cpucg_destroy - destroy group id, in which there must be neither procs
+//               - nor children any more
+static int cpucg_destroy(int id)
+{
+	struct cpu_group *g;
+	int ret = 0;
+	bool intr_flag;
+	spin_lock_irqsave(&cpucg_lock, intr_flag);
+	if ((g = cpucg_lookup(id)) == NULL) {
+		ret = -E_INVAL;
+	} else if (atomic_read(&(g->ref)) != 1) {
+		ret = -E_BUSY;
+	} else {
+		g->state = CPUCG_DEAD;
+	}
+	spin_unlock_irqrestore(&cpucg_lock, intr_flag);
+	if (ret == 0) {
+		cpucg_put(g);
+	}
+	return ret;
+}
+
+static int cpucg_set_shares(int id, unsigned long shares)
+{
+	struct cpu_group *g;
+	int ret = 0;
+	bool intr_flag;
+	if (shares < CPUCG_SHARES_MIN || shares > CPUCG_SHARES_MAX) {
+		return -E_INVAL;
+	}
+	spin_lock_irqsave(&cpucg_lock, intr_flag);
+	if ((g = cpucg_lookup(id)) == NULL) {
+		ret = -E_INVAL;
+	} else {
+		g->shares = shares;
+	}
+	spin_unlock_irqrestore(&cpucg_lock, intr_flag);
+	return ret;
+}
+
+// cpucg_set_quota - cap group id at quota ticks every period, 0 for no
+//                 - cap; a throttled one the new quota allows more is
+//                 - let go at once
+static int cpucg_set_quota(int id, size_t quota, size_t period)
+{
+	struct cpu_group *g;
+	int ret = 0;
+	bool intr_flag, released = 0;
+	if (period == 0) {
+		period = CPUCG_PERIOD_DEFAULT;
+	}
+	spin_lock_irqsave(&cpucg_lock, intr_flag);
+	if ((g = cpucg_lookup(id)) == NULL) {
+		ret = -E_INVAL;
+	} else {
+		g->quota = quota, g->period = period;
+		if (g->elapsed >= period) {
+			g->elapsed = period - 1;
+		}
+		if (g->throttled && (quota == 0 || g->runtime < quota)) {
+			g->throttled = 0;
+			nr_throttled_groups--;
+			released = 1;
+		}
+	}
+	spinlock_release(&cpucg_lock);
+	if (released) {
+		cpucg_release_held(g);
+	}
+	local_intr_restore(intr_flag);
+	return ret;
+}
+
+// cpucg_attach - move proc pid, 0 for current, to group id, 0 for none;
+//              - a proc held back is queued again, to be judged by the
+//              - quota of its new group
+static int cpucg_attach(int id, int pid)
+{
+	struct proc_struct *proc = (pid == 0) ? current : find_proc(pid);
+	struct cpu_group *g = NULL, *old;
+	bool intr_flag, held = 0;
+	if (proc == NULL || proc->state == PROC_ZOMBIE
+	    || proc->pid < sysconf.lcpu_count) {
+		return -E_INVAL;
+	}
+	spin_lock_irqsave(&(proc->lock), intr_flag);
+	spinlock_acquire(&cpucg_lock);
+	if (id != 0 && (g = cpucg_get(cpucg_lookup(id))) == NULL) {
+		spinlock_release(&cpucg_lock);
+		spin_unlock_irqrestore(&(proc->lock), intr_flag);
+		return -E_INVAL;
+	}
+	if (!list_empty(&(proc->cg_link))) {
+		list_del_init(&(proc->cg_link));
+		held = 1;
+	}
+	old = proc->cpucg, proc->cpucg = g;
+	spinlock_release(&cpucg_lock);
+	spin_unlock_irqrestore(&(proc->lock), intr_flag);
+
+	cpucg_put(old);
+	if (held) {
+		sched_unthrottle(proc);
+	}
+	return 0;
+}
+
+static int cpucg_stat(int id, struct cpucg_stat *stat)
+{
+	struct mm_struct *mm = current->mm;
+	struct cpucg_stat kstat;
+	struct cpu_group *g;
+	bool intr_flag;
+	spin_lock_irqsave(&cpucg_lock, intr_flag);
+	if ((g = cpucg_lookup(id)) != NULL) {
+		kstat.usage = g->usage;
+		kstat.shares = g->shares;
+		kstat.quota = g->quota;
+		kstat.period = g->period;
+		kstat.nr_periods = g->nr_periods;
+		kstat.nr_throttled = g->nr_throttled;
+		kstat.throttled_time = g->throttled_time;
+	}
+	spin_unlock_irqrestore(&cpucg_lock, intr_flag);
+	if (g == NULL) {
+		return -E_INVAL;
+	}
+	lock_mm_shared(mm);
+	if (!copy_to_user(mm, stat, &kstat, sizeof(struct cpucg_stat))) {
+		unlock_mm_shared(mm);
+		return -E_INVAL;
+	}
+	unlock_mm_shared(mm);
+	return 0;
+}
+
+// do_cpucg - the CPUCG_xxx op of cpugroup.h on group id
+int do_cpucg(int op, int id, size_t arg0, uintptr_t arg1)
+{
+	switch (op) {
+	case CPUCG_CREATE:
+		return cpucg_create(id, arg0);
+	case CPUCG_DESTROY:
+		return cpucg_destroy(id);
+	case CPUCG_SET_SHARES:
+		return cpucg_set_shares(id, arg0);
+	case CPUCG_SET_QUOTA:
+		return cpucg_set_quota(id, arg0, arg1);
+	case CPUCG_ATTACH:
+		return cpucg_attach(id, (int)arg0);
+	case CPUCG_STAT:
+		return cpucg_stat(id, (struct cpucg_stat *)arg1);
+	}
+	return -E_INVAL;
+}
+
+#endif /* UCONFIG_CPUCG */
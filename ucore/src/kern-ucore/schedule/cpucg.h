@@ -0,0 +1,68 @@
+#ifndef __KERN_SCHEDULE_CPUCG_H__
+#define __KERN_SCHEDULE_CPUCG_H__
+
+#include <types.h>
+#include <list.h>
+#include <atomic.h>
+#include <cpugroup.h>
+
+struct proc_struct;
+
+#ifdef UCONFIG_CPUCG
+
+/* *
+ * cpu_group - a group of processes whose cpu time is weighted, capped and
+ * accounted together, see cpucg.c. All times are in clock ticks.
+ * */
+struct cpu_group {
+	int id;			// 1.. for user space, the slot + 1
+	int state;		// CPUCG_FREE, CPUCG_LIVE or CPUCG_DEAD
+	struct cpu_group *parent;	// NULL for a top one
+	atomic_t ref;		// procs, children and being live
+	unsigned long shares;	// the weight of its procs, CPUCG_SHARES_DEFAULT as nice 0
+	size_t quota;		// ticks it may run every period, 0 for no cap
+	size_t period;
+	size_t runtime;		// ticks run by it and its children this period
+	size_t elapsed;		// ticks into the period
+	bool throttled;		// out of quota until the period ends
+	list_entry_t throttled_list;	// the procs held back, by cg_link
+	size_t usage;		// ticks run by it and its children
+	size_t nr_periods;
+	size_t nr_throttled;
+	size_t throttled_time;
+};
+
+void cpucg_init(void);
+struct cpu_group *cpucg_get(struct cpu_group *g);
+void cpucg_put(struct cpu_group *g);
+bool cpucg_charge_tick(struct cpu_group *g);
+bool cpucg_throttle(struct proc_struct *proc);
+void cpucg_period_tick(void);
+bool cpucg_any_throttled(void);
+
+int do_cpucg(int op, int id, size_t arg0, uintptr_t arg1);
+
+// cpucg_weight - the weight of a proc of g, weight as a nice 0 one
+static inline unsigned long
+cpucg_weight(struct cpu_group *g, unsigned long weight)
+{
+	if (g != NULL && g->shares != CPUCG_SHARES_DEFAULT) {
+		weight = weight * g->shares / CPUCG_SHARES_DEFAULT;
+		if (weight == 0) {
+			weight = 1;
+		}
+	}
+	return weight;
+}
+
+#else
+
+struct cpu_group;
+
+#define cpucg_get(g)                        (g)
+#define cpucg_put(g)                        do { } while (0)
+#define cpucg_weight(g, weight)             (weight)
+
+#endif /* UCONFIG_CPUCG */
+
+#endif /* !__KERN_SCHEDULE_CPUCG_H__ */
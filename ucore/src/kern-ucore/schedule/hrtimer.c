@@ -0,0 +1,141 @@
+#include <types.h>
+#include <list.h>
+#include <sync.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <spinlock.h>
+#include <proc.h>
+#include <sched.h>
+#include <assert.h>
+#include <clock.h>
+#include <timekeeping.h>
+#include <hrtimer.h>
+
+/* the hrtimers started on a cpu, the first due first */
+struct hrtimer_base {
+	spinlock_s lock;
+	list_entry_t timers;
+};
+
+static DEFINE_PERCPU_NOINIT(struct hrtimer_base, hrtimer_bases);
+
+void hrtimers_init(void)
+{
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct hrtimer_base *base = per_cpu_ptr(hrtimer_bases, i);
+		spinlock_init(&(base->lock));
+		list_init(&(base->timers));
+	}
+}
+
+static inline uint64_t __hrtimer_next(struct hrtimer_base *base)
+{
+	list_entry_t *le = list_next(&(base->timers));
+	if (le == &(base->timers)) {
+		return HRTIMER_NONE;
+	}
+	return le2hrtimer(le, hrtimer_link)->expires;
+}
+
+// hrtimer_start - queue timer on this cpu, it must not be pending
+void hrtimer_start(struct hrtimer *timer)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		struct hrtimer_base *base = get_cpu_ptr(hrtimer_bases);
+		list_entry_t *le = &(base->timers);
+		bool first;
+		assert(timer->base == NULL && timer->proc != NULL);
+		spinlock_acquire(&(base->lock));
+		while ((le = list_next(le)) != &(base->timers)) {
+			if (le2hrtimer(le, hrtimer_link)->expires >
+			    timer->expires) {
+				break;
+			}
+		}
+		list_add_before(le, &(timer->hrtimer_link));
+		timer->base = base;
+		first = (list_prev(&(timer->hrtimer_link)) == &(base->timers));
+		spinlock_release(&(base->lock));
+		/* maybe due before the next tick */
+		if (first) {
+			clock_event_program(timer->expires);
+		}
+	}
+	local_intr_restore(intr_flag);
+}
+
+// hrtimer_cancel - take timer off its cpu if it is still pending there;
+//                - once it returns, the timer is not expiring either.
+// NOTE: a clock event programmed for it is left to fire for nothing
+void hrtimer_cancel(struct hrtimer *timer)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		struct hrtimer_base *base;
+		while ((base = timer->base) != NULL) {
+			spinlock_acquire(&(base->lock));
+			/* it may have expired meanwhile */
+			if (timer->base == base) {
+				list_del_init(&(timer->hrtimer_link));
+				timer->base = NULL;
+			}
+			spinlock_release(&(base->lock));
+		}
+	}
+	local_intr_restore(intr_flag);
+}
+
+// hrtimer_run_queue - wake up the procs of the timers of this cpu that are
+//                   - due, called by the tick and by the clock event
+void hrtimer_run_queue(void)
+{
+	bool intr_flag;
+	uint64_t now, next;
+	local_intr_save(intr_flag);
+	{
+		struct hrtimer_base *base = get_cpu_ptr(hrtimer_bases);
+		list_entry_t *le;
+		now = ktime_get_ns();
+		spinlock_acquire(&(base->lock));
+		while ((le = list_next(&(base->timers))) != &(base->timers)) {
+			struct hrtimer *timer = le2hrtimer(le, hrtimer_link);
+			if (timer->expires > now) {
+				break;
+			}
+			list_del_init(le);
+			timer->base = NULL;
+			/* unless something else woke it up first */
+			if (timer->proc->state == PROC_SLEEPING) {
+				wakeup_proc(timer->proc);
+			}
+		}
+		next = __hrtimer_next(base);
+		spinlock_release(&(base->lock));
+		if (next != HRTIMER_NONE) {
+			clock_event_program(next);
+		}
+	}
+	local_intr_restore(intr_flag);
+}
+
+// hrtimer_next_expiry - when the first timer of this cpu is due,
+//                     - HRTIMER_NONE if it has none
+uint64_t hrtimer_next_expiry(void)
+{
+	bool intr_flag;
+	uint64_t next;
+	local_intr_save(intr_flag);
+	{
+		struct hrtimer_base *base = get_cpu_ptr(hrtimer_bases);
+		spinlock_acquire(&(base->lock));
+		next = __hrtimer_next(base);
+		spinlock_release(&(base->lock));
+	}
+	local_intr_restore(intr_flag);
+	return next;
+}
@@ -0,0 +1,46 @@
+#ifndef __KERN_SCHEDULE_HRTIMER_H__
+#define __KERN_SCHEDULE_HRTIMER_H__
+
+#include <types.h>
+#include <list.h>
+
+struct proc_struct;
+struct hrtimer_base;
+
+/* *
+ * hrtimer - a timer due at a time in ns of ktime_get_ns, not at a tick of
+ * the wheel. Each cpu keeps the ones started on it in the order they are
+ * due; the tick expires them, and with UCONFIG_HIGH_RES_TIMERS the clock
+ * event of the cpu is programmed for the first one due before its next
+ * tick, see clock_event_program. Without it they are late by up to a tick.
+ * */
+struct hrtimer {
+	uint64_t expires;	// the ktime_get_ns it is due at
+	struct proc_struct *proc;	// woken up then
+	list_entry_t hrtimer_link;
+	struct hrtimer_base *base;	// the cpu holding it, NULL if none
+};
+
+#define le2hrtimer(le, member)          \
+    to_struct((le), struct hrtimer, member)
+
+static inline struct hrtimer *hrtimer_init(struct hrtimer *timer,
+					   struct proc_struct *proc,
+					   uint64_t expires)
+{
+	timer->expires = expires;
+	timer->proc = proc;
+	list_init(&(timer->hrtimer_link));
+	timer->base = NULL;
+	return timer;
+}
+
+void hrtimers_init(void);
+void hrtimer_start(struct hrtimer *timer);
+void hrtimer_cancel(struct hrtimer *timer);
+void hrtimer_run_queue(void);
+uint64_t hrtimer_next_expiry(void);
+
+#define HRTIMER_NONE                ((uint64_t)-1)
+
+#endif /* !__KERN_SCHEDULE_HRTIMER_H__ */
@@ -0,0 +1,98 @@
+#ifndef __KERN_SCHEDULE_RUNQUEUE_H__
+#define __KERN_SCHEDULE_RUNQUEUE_H__
+
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+#include <sched.h>
+#include <rb_inline.h>
+#include <schedpolicy.h>
+#include <rusage.h>
+#include <schedstat.h>
+
+/* struct run_queue lives here rather than in sched.h, since sched.h is
+ * pulled in by the arch sync.h, before spinlock_s is defined. */
+
+/* *
+ * sched_domain - a level of the cpu hierarchy around the cpu of a run queue,
+ * see sched_domains_init. The balancing pulls from the nearest level with
+ * an imbalance first, where a move costs least; the further the level, the
+ * rarer its periodic balancing and the bigger the imbalance it takes.
+ * */
+struct sched_domain {
+	int level;		// SD_xxx in sched.h
+	cpuset_t span;		// its cpus, those of the levels below too
+	unsigned int interval;	// ticks between two periodic balances
+	unsigned int imbalance;	// the procs the busiest has over this rq
+};
+
+/* the levels of the MLFQ class, see sched_MLFQ.c */
+#define MLFQ_NR_LEVELS              4
+
+// Every run queue is protected by its own lock, which must be held (with
+// local interrupts disabled) around any sched_class hook working on it.
+// When two queues have to be held at once, they are always locked in
+// ascending address order, see double_rq_lock_balance.
+struct run_queue {
+	spinlock_s lock;
+	list_entry_t run_list;
+	unsigned int proc_num;
+	int max_time_slice;
+	int cpu;		// whose run queue it is
+	list_entry_t rq_link;
+	struct sched_domain sd[SD_LEVELS];	// nearest first
+	int nr_sd;
+	unsigned int lb_levels;	// SD_xxx bits of the balancing in course
+	/* used by the MLFQ class only */
+	list_entry_t mlfq_queue[MLFQ_NR_LEVELS];	// a queue per level
+	/* used by the CFS class only */
+	struct rbi_root cfs_tree;	// runnable procs ordered by vruntime
+	uint64_t min_vruntime;	// monotonic lower bound of the vruntimes
+	unsigned long load_weight;	// sum of the weights of the queued procs
+	struct cpu_usage usage;	// the time of the cpu, see rusage.h
+#ifdef UCONFIG_SCHEDSTATS
+	struct sched_stat sched_stat;	// of the procs run here
+	struct log2_hist sched_idle;	// the runs of the idle proc
+#endif
+#ifdef UCONFIG_KVM_GUEST
+	uint64_t steal_clock;	// the steal time charged to usage, in ns
+#endif
+#ifdef UCONFIG_SCHED_RT
+	/* the realtime procs, picked before those of the class above */
+	uint32_t rt_bitmap[(SCHED_RT_PRIO_MAX + 32) / 32];	// set if rt_queue[prio] is not empty
+	list_entry_t rt_queue[SCHED_RT_PRIO_MAX + 1];
+	unsigned int rt_num;
+#endif
+};
+
+#define le2rq(le, member)           \
+    to_struct((le), struct run_queue, member)
+
+static inline void rq_lock(struct run_queue *rq)
+{
+	spinlock_acquire(&(rq->lock));
+}
+
+static inline void rq_unlock(struct run_queue *rq)
+{
+	spinlock_release(&(rq->lock));
+}
+
+// double_rq_lock_balance - lock busiest while this_rq is already held.
+// NOTE: to respect the lock order this_rq->lock may be dropped and retaken,
+//       so the caller must re-validate anything it read from this_rq.
+static inline void
+double_rq_lock_balance(struct run_queue *this_rq, struct run_queue *busiest)
+{
+	if (!spinlock_acquire_try(&(busiest->lock))) {
+		if (busiest < this_rq) {
+			rq_unlock(this_rq);
+			rq_lock(busiest);
+			rq_lock(this_rq);
+		} else {
+			rq_lock(busiest);
+		}
+	}
+}
+
+#endif /* !__KERN_SCHEDULE_RUNQUEUE_H__ */
@@ -2,132 +2,772 @@
 #include <sync.h>
 #include <proc.h>
 #include <sched.h>
+#include <runqueue.h>
 #include <stdio.h>
 #include <assert.h>
 #include <sched_RR.h>
 #include <sched_MLFQ.h>
 #include <sched_mpRR.h>
+#include <sched_CFS.h>
+#include <sched_RT.h>
 #include <kio.h>
 #include <mp.h>
 #include <trap.h>
 #include <sysconf.h>
 #include <spinlock.h>
+#include <slab.h>
+#include <string.h>
+#include <timekeeping.h>
+#include <trace.h>
+#include <cpucg.h>
+#include <rcu.h>
+#include <softirq.h>
+#include <workqueue.h>
+#include <vmm.h>
+#include <findbit.h>
+#include <hrtimer.h>
+
+#define TVN_BITS                    6
+#define TVR_BITS                    8
+#define TVN_SIZE                    (1 << TVN_BITS)
+#define TVR_SIZE                    (1 << TVR_BITS)
+#define TVN_MASK                    (TVN_SIZE - 1)
+#define TVR_MASK                    (TVR_SIZE - 1)
 
-/* we may use lock free list */
-struct __timer_list_t{
-	list_entry_t tl;
+/* the per-cpu timing wheel */
+struct tvec_base {
 	spinlock_s lock;
+	unsigned int timer_jiffies;	// the next tick to be processed
+	unsigned int ticks_due;	// taken, for the timer softirq to process
+	list_entry_t tv1[TVR_SIZE];
+	list_entry_t tv2[TVN_SIZE];
+	list_entry_t tv3[TVN_SIZE];
+	list_entry_t tv4[TVN_SIZE];
+	list_entry_t tv5[TVN_SIZE];
+	list_entry_t expired;	// the linux timers due, to call without the lock
+	timer_t *running_timer;	// the one being called, see del_timer_sync
+#ifdef UCONFIG_NO_HZ_IDLE
+	bool nohz_idle;		// the periodic tick of this cpu is stopped
+#endif
 };
-static struct __timer_list_t __timer_list;
-#define timer_list __timer_list.tl
+static DEFINE_PERCPU_NOINIT(struct tvec_base, tvec_bases);
+/* heap-allocated timers (linux timers) come from here, freed once fired;
+ * the embedded ones (timer_setup) belong to their owner */
+static kmem_cache_t *timer_cachep;
+static void run_timer_softirq(void);
 
 static struct sched_class *sched_class;
 static DEFINE_PERCPU_NOINIT(struct run_queue, runqueues);
 
-//static struct run_queue *rq;
+/* Locking rules:
+ *   proc->lock serializes the state changes of a proc (wakeup/stop), and
+ *   is taken before any rq->lock. A wakeup only takes the lock of the
+ *   destination run queue, so remote wakeups on different cpus never
+ *   contend with each other. All of it runs with local interrupts off.
+ */
 
-static inline void sched_class_enqueue(struct proc_struct *proc)
+// rq_lock_proc - lock the run queue proc is linked in, proc->rq may change
+//              - under us (load balancing), so retry until it is stable
+static struct run_queue *rq_lock_proc(struct proc_struct *proc)
 {
-	if (proc != idleproc) {
-		//TODO load balance
-		struct run_queue *rq = get_cpu_ptr(runqueues);
-		if(proc->flags & PF_PINCPU){
-			assert(proc->cpu_affinity >= 0 
-					&& proc->cpu_affinity < sysconf.lcpu_count);
-			rq = per_cpu_ptr(runqueues, proc->cpu_affinity);
+	struct run_queue *rq;
+	while (1) {
+		rq = proc->rq;
+		rq_lock(rq);
+		if (rq == proc->rq) {
+			return rq;
 		}
-		//XXX lock
-		sched_class->enqueue(rq, proc);
+		rq_unlock(rq);
 	}
 }
 
-static inline void sched_class_dequeue(struct proc_struct *proc)
+// proc_sched_class - the class proc is scheduled by, after its policy
+static inline struct sched_class *proc_sched_class(struct proc_struct *proc)
 {
-	struct run_queue *rq = get_cpu_ptr(runqueues);
-	sched_class->dequeue(rq, proc);
+#ifdef UCONFIG_SCHED_RT
+	if (proc->policy != SCHED_NORMAL) {
+		return &RT_sched_class;
+	}
+#endif
+	return sched_class;
+}
+
+/* *
+ * The isolated cpus, isolcpus= at boot: only the procs whose affinity
+ * names them run there, nothing else is placed there or pulled there by
+ * the balancing, so that those procs have the cpu to themselves. The
+ * unpinned procs woken there go to the least busy of the other cpus, the
+ * housekeeping ones, which cpu 0 is always one of.
+ * */
+static cpuset_t sched_isolated;
+
+void sched_isolate_cpus(const cpuset_t * set)
+{
+	int i;
+	cpuset_clear(&sched_isolated);
+	for (i = 1; i < sysconf.lcpu_count; i++) {
+		if (cpuset_test(set, i)) {
+			cpuset_set(&sched_isolated, i);
+			kprintf("sched: cpu %d isolated.\n", i);
+		}
+	}
+}
+
+bool sched_cpu_isolated(int cpu)
+{
+	return cpuset_test(&sched_isolated, cpu) != 0;
+}
+
+// sched_proc_allowed - proc may run on cpu: one of its affinity if it has
+//                    - one, else one that is not isolated
+bool sched_proc_allowed(struct proc_struct *proc, int cpu)
+{
+	if (proc->flags & PF_PINCPU) {
+		return cpuset_test(&(proc->cpus_allowed), cpu) != 0;
+	}
+	return !sched_cpu_isolated(cpu);
+}
+
+// sched_can_migrate - proc may be pulled from rq to cpu: it may run there,
+//                   - and the pull leaves the package of rq only once its
+//                   - cache there has gone cold, waiting is cheaper
+bool sched_can_migrate(struct proc_struct *proc, struct run_queue *rq, int cpu)
+{
+	if (!sched_proc_allowed(proc, cpu)) {
+		return 0;
+	}
+	if (per_cpu_ptr(cpus, cpu)->pkg_id != per_cpu_ptr(cpus, rq->cpu)->pkg_id
+	    && per_cpu_ptr(tvec_bases, rq->cpu)->timer_jiffies - proc->last_ran
+	    < SCHED_CACHE_HOT_TICKS) {
+		return 0;
+	}
+	return 1;
+}
+
+// sched_housekeeping_cpu - the cpu not isolated with the fewest procs
+// NOTE: proc_num is read without the locks, it is only a hint
+static int sched_housekeeping_cpu(void)
+{
+	int i, best = 0;
+	for (i = 1; i < sysconf.lcpu_count; i++) {
+		if (!sched_cpu_isolated(i)
+		    && per_cpu_ptr(runqueues, i)->proc_num <
+		    per_cpu_ptr(runqueues, best)->proc_num) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+#ifdef UCONFIG_SCHED_RT
+// sched_rt_select_cpu - a woken realtime proc goes where it runs first: this
+//                     - cpu if it preempts the current one here, else the
+//                     - first cpu whose current it preempts
+// NOTE: the currents are read without the locks, a stale choice only
+//       delays the proc until the next reschedule
+static int sched_rt_select_cpu(struct proc_struct *proc)
+{
+	int i;
+	if (!sched_cpu_isolated(myid()) && RT_preempts(proc, current)) {
+		return myid();
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct proc_struct *curr = per_cpu_ptr(cpus, i)->__current;
+		if (sched_cpu_isolated(i)) {
+			continue;
+		}
+		if (curr->pid < sysconf.lcpu_count || RT_preempts(proc, curr)) {
+			return i;
+		}
+	}
+	return sched_cpu_isolated(myid()) ? sched_housekeeping_cpu() : myid();
+}
+
+// sched_rt_preempt - the realtime proc has been queued, make the cpu of its
+//                  - run queue reschedule if its current is less urgent,
+//                  - at once or when batch is flushed
+static void sched_rt_preempt(struct proc_struct *proc,
+			     struct wakeup_batch *batch)
+{
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (per_cpu_ptr(runqueues, i) == proc->rq) {
+			/* the idle procs have the pids below lcpu_count */
+			struct proc_struct *curr = per_cpu_ptr(cpus, i)->__current;
+			if (curr->pid < sysconf.lcpu_count
+			    || RT_preempts(proc, curr)) {
+				curr->need_resched = 1;
+				if (i == myid()) {
+					/* nothing to kick */
+				} else if (batch != NULL) {
+					cpuset_set(&(batch->resched), i);
+				} else {
+					mp_resched_cpu(i);
+				}
+			}
+			break;
+		}
+	}
+}
+#endif
+
+// sched_cpu_idle - cpu runs its idle proc with nothing queued
+static inline bool sched_cpu_idle(int cpu)
+{
+	/* the idle procs have the pids below lcpu_count */
+	return per_cpu_ptr(runqueues, cpu)->proc_num == 0
+	    && per_cpu_ptr(cpus, cpu)->__current->pid < sysconf.lcpu_count;
 }
 
-static inline struct proc_struct *sched_class_pick_next(void)
+static inline int sched_cpu_node(int cpu)
 {
+	struct numa_node *node = per_cpu_ptr(cpus, cpu)->node;
+	return node != NULL ? node->id : 0;
+}
+
+// sched_preferred_node - the node the memory of proc is on, -1 if unknown
+static int sched_preferred_node(struct proc_struct *proc)
+{
+#ifdef UCONFIG_NUMA_POLICY
+	struct mm_struct *mm = proc->mm;
+	if (mm != NULL) {
+		return mm->numa_preferred;
+	}
+#endif
+	return -1;
+}
+
+// sched_idle_cpu_near - an idle cpu proc may run on, sharing the package of
+//                     - cpu if pkg, else in its node; -1 if there is none
+static int sched_idle_cpu_near(struct proc_struct *proc, int cpu, bool pkg)
+{
+	uint32_t pkg_id = per_cpu_ptr(cpus, cpu)->pkg_id;
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (pkg ? per_cpu_ptr(cpus, i)->pkg_id != pkg_id
+		    : sched_cpu_node(i) != sched_cpu_node(cpu)) {
+			continue;
+		}
+		if (sched_proc_allowed(proc, i) && sched_cpu_idle(i)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* *
+ * sched_wake_cpu - where a woken proc that is not pinned runs. The waker
+ * likely shares data with it, so it goes to the cpu of the waker (wake
+ * affine) unless that one is busier than the cpu the proc last ran on, or
+ * is off the node of its memory while that one is on it. If the cpu chosen
+ * is busy, an idle one sharing its cache does instead; if it is off the
+ * node of the memory, an idle one of that node does.
+ * NOTE: the loads are read without the locks, they are only hints
+ * */
+static int sched_wake_cpu(struct proc_struct *proc)
+{
+	int this = myid(), target = this, cpu, node;
+	int prev = (proc->rq != NULL) ? proc->rq->cpu : this;
+	if ((node = sched_preferred_node(proc)) < 0) {
+		node = sched_cpu_node(prev);
+	}
+	if (sched_cpu_isolated(this)
+	    || (sched_cpu_node(this) != node && sched_cpu_node(prev) == node)
+	    || per_cpu_ptr(runqueues, this)->proc_num >
+	    per_cpu_ptr(runqueues, prev)->proc_num) {
+		target = prev;
+	}
+	if (!sched_proc_allowed(proc, target)) {
+		return sched_housekeeping_cpu();
+	}
+	if (sched_cpu_node(target) != node && node < sysconf.lnuma_count) {
+		for (cpu = 0; cpu < sysconf.lcpu_count; cpu++) {
+			if (sched_cpu_node(cpu) == node) {
+				break;
+			}
+		}
+		if (cpu < sysconf.lcpu_count
+		    && (cpu = sched_idle_cpu_near(proc, cpu, 0)) >= 0) {
+			return cpu;
+		}
+	}
+	if (!sched_cpu_idle(target)
+	    && (cpu = sched_idle_cpu_near(proc, target, 1)) >= 0) {
+		return cpu;
+	}
+	return target;
+}
+
+static inline struct run_queue *sched_class_select_rq(struct proc_struct *proc)
+{
+	/* current goes back here, idle cpus will steal the surplus */
 	struct run_queue *rq = get_cpu_ptr(runqueues);
-	return sched_class->pick_next(rq);
+	if(proc->flags & PF_PINCPU){
+		assert(proc->cpu_affinity >= 0 
+				&& proc->cpu_affinity < sysconf.lcpu_count);
+		/* here if it may run here, else where it ran last */
+		if (cpuset_test(&(proc->cpus_allowed), myid())) {
+			proc->cpu_affinity = myid();
+		}
+		rq = per_cpu_ptr(runqueues, proc->cpu_affinity);
+	}
+#ifdef UCONFIG_SCHED_RT
+	/* realtime procs are not balanced, place them at once */
+	else if (proc->policy != SCHED_NORMAL && proc != current) {
+		rq = per_cpu_ptr(runqueues, sched_rt_select_cpu(proc));
+	}
+#endif
+	else if (proc != current) {
+		rq = per_cpu_ptr(runqueues, sched_wake_cpu(proc));
+	} else if (sched_cpu_isolated(myid())) {
+		rq = per_cpu_ptr(runqueues, sched_housekeeping_cpu());
+	}
+	return rq;
+}
+
+#ifdef UCONFIG_SCHEDSTATS
+// schedstat_enqueue - the wait of proc starts, unless it is waiting already
+static inline void schedstat_enqueue(struct proc_struct *proc)
+{
+	if (proc->sched_enqueued == 0) {
+		proc->sched_enqueued = ktime_get_ns();
+	}
+}
+
+// schedstat_switch - the run of prev on the cpu of rq ends, and the wait
+//                  - of next, called with interrupts disabled
+static void
+schedstat_switch(struct run_queue *rq, struct proc_struct *prev,
+		 struct proc_struct *next)
+{
+	uint64_t now = ktime_get_ns(), ns;
+	if (prev->sched_ran != 0) {
+		ns = now - prev->sched_ran;
+		if (prev == idleproc) {
+			log2_hist_add(&(rq->sched_idle), ns);
+		} else {
+			log2_hist_add(&(prev->sched_stat.run), ns);
+			log2_hist_add(&(rq->sched_stat.run), ns);
+		}
+	}
+	if (next->sched_enqueued != 0) {
+		ns = now - next->sched_enqueued;
+		log2_hist_add(&(next->sched_stat.wait), ns);
+		log2_hist_add(&(rq->sched_stat.wait), ns);
+		next->sched_enqueued = 0;
+	}
+	next->sched_ran = now;
+}
+#else
+#define schedstat_enqueue(proc)             do { } while (0)
+#define schedstat_switch(rq, prev, next)    do { } while (0)
+#endif
+
+static inline void sched_class_enqueue(struct proc_struct *proc)
+{
+	if (proc != idleproc) {
+#ifdef UCONFIG_CPUCG
+		/* out of the quota of its group, held back until the period ends */
+		if (proc->policy == SCHED_NORMAL && cpucg_throttle(proc)) {
+			return;
+		}
+#endif
+		struct run_queue *rq = sched_class_select_rq(proc);
+		schedstat_enqueue(proc);
+		rq_lock(rq);
+		proc_sched_class(proc)->enqueue(rq, proc);
+		rq_unlock(rq);
+	}
+}
+
+static inline void sched_class_dequeue(struct proc_struct *proc)
+{
+	struct run_queue *rq = rq_lock_proc(proc);
+	if (!list_empty(&(proc->run_link))) {
+		proc_sched_class(proc)->dequeue(rq, proc);
+	}
+	rq_unlock(rq);
 }
 
 static void sched_class_proc_tick(struct proc_struct *proc)
 {
 	if (proc != idleproc) {
 		struct run_queue *rq = get_cpu_ptr(runqueues);
-		sched_class->proc_tick(rq, proc);
+		proc_sched_class(proc)->proc_tick(rq, proc);
+#ifdef UCONFIG_CPUCG
+		struct cpu_group *cg = proc->cpucg;
+		/* give the cpu up if the group has run out of its quota */
+		if (cg != NULL && cpucg_charge_tick(cg)
+		    && proc->policy == SCHED_NORMAL) {
+			proc->need_resched = 1;
+		}
+#endif
 	} else {
 		proc->need_resched = 1;
 	}
 }
 
+// sched_class_load_balance - let rq pull work from the levels of its
+//                          - domains in the SD_xxx bits of levels
+static inline void
+sched_class_load_balance(struct run_queue *rq, unsigned int levels)
+{
+	/* an isolated cpu takes no work from the others */
+	if (sched_class->load_balance != NULL && !sched_cpu_isolated(rq->cpu)) {
+		rq->lb_levels = levels;
+		sched_class->load_balance(rq);
+	}
+}
+
+// rq_find_busiest - find the run queue with the most runnable procs in the
+//                 - nearest domain of rq being balanced that has one worth
+//                 - stealing from, NULL if none has
+// NOTE: proc_num is read without the locks, the caller re-checks it
+struct run_queue *rq_find_busiest(struct run_queue *rq)
+{
+	int l, i;
+	for (l = 0; l < rq->nr_sd; l++) {
+		struct sched_domain *sd = &(rq->sd[l]);
+		struct run_queue *busiest = NULL;
+		unsigned int max_num = rq->proc_num + sd->imbalance;
+		if (!(rq->lb_levels & (1 << sd->level))) {
+			continue;
+		}
+		for (i = 0; i < sysconf.lcpu_count; i++) {
+			struct run_queue *rqi = per_cpu_ptr(runqueues, i);
+			if (i != rq->cpu && cpuset_test(&(sd->span), i)
+			    && rqi->proc_num > max_num) {
+				busiest = rqi;
+				max_num = rqi->proc_num;
+			}
+		}
+		if (busiest != NULL) {
+			return busiest;
+		}
+	}
+	return NULL;
+}
+
+/* by level, the procs over those of this rq a busiest one takes, and the
+ * multiple of SCHED_LB_INTERVAL between two periodic balances */
+static const unsigned int sched_imbalance[SD_LEVELS] = { 1, 1, 1, 2 };
+static const unsigned int sched_interval[SD_LEVELS] = { 1, 1, 2, 4 };
+
+// sched_domain_has - other is at level of the cpu c
+static bool sched_domain_has(int level, struct cpu *c, struct cpu *other)
+{
+	switch (level) {
+	case SD_SMT:
+		return other->core_id == c->core_id;
+	case SD_PKG:
+		return other->pkg_id == c->pkg_id;
+	case SD_NUMA:
+		return other->node == c->node;
+	}
+	return 1;
+}
+
+// sched_domains_init - the levels around each cpu, from the cores, packages
+//                    - and nodes of the cpus; a level is left out if it
+//                    - spans no more cpus than the one below
+static void sched_domains_init(void)
+{
+	static const char *names[SD_LEVELS] = { "smt", "pkg", "numa", "all" };
+	int i, j, l;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct run_queue *rq = per_cpu_ptr(runqueues, i);
+		struct cpu *c = per_cpu_ptr(cpus, i);
+		cpuset_t span;
+		int n, last = 1;
+		cpuset_clear(&span);
+		cpuset_set(&span, i);
+		rq->nr_sd = 0;
+		for (l = 0; l < SD_LEVELS; l++) {
+			for (j = 0, n = 0; j < sysconf.lcpu_count; j++) {
+				struct cpu *other = per_cpu_ptr(cpus, j);
+				if (sched_domain_has(l, c, other)) {
+					cpuset_set(&span, j);
+				}
+				n += (cpuset_test(&span, j) != 0);
+			}
+			if (n <= last) {
+				continue;
+			}
+			struct sched_domain *sd = &(rq->sd[rq->nr_sd++]);
+			sd->level = l;
+			sd->span = span;
+			sd->interval = SCHED_LB_INTERVAL * sched_interval[l];
+			sd->imbalance = sched_imbalance[l];
+			last = n;
+			if (i == 0) {
+				kprintf("sched: cpu0 domain %s of %d cpus.\n",
+					names[l], n);
+			}
+		}
+	}
+}
+
+#ifdef UCONFIG_NO_HZ_IDLE
+// sched_nohz_kick - a cpu in tickless idle won't pull work by itself,
+//                 - kick one of them if this cpu has procs to spare
+static void sched_nohz_kick(struct run_queue *rq)
+{
+	int i;
+	if (rq->proc_num <= 1) {
+		return;
+	}
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		/* an isolated cpu would not take them */
+		if (i != myid() && !sched_cpu_isolated(i)
+		    && per_cpu_ptr(tvec_bases, i)->nohz_idle) {
+			tick_nohz_kick(i);
+			break;
+		}
+	}
+}
+#endif
+
+// sched_balance_tick - let the run queue of this cpu pull work from the
+//                    - busiest one of the domains whose interval is up
+static void sched_balance_tick(struct tvec_base *base)
+{
+	struct run_queue *rq = get_cpu_ptr(runqueues);
+	unsigned int levels = 0;
+	int l;
+	for (l = 0; l < rq->nr_sd; l++) {
+		if (base->timer_jiffies % rq->sd[l].interval == 0) {
+			levels |= (1 << rq->sd[l].level);
+		}
+	}
+	if (levels == 0) {
+		return;
+	}
+	rq_lock(rq);
+	sched_class_load_balance(rq, levels);
+	rq_unlock(rq);
+#ifdef UCONFIG_NO_HZ_IDLE
+	sched_nohz_kick(rq);
+#endif
+}
+
 //static struct run_queue __rq[NCPU];
 
 void sched_init(void)
 {
-	list_init(&timer_list);
 
 	//rq = __rq;
 	//list_init(&(__rq[0].rq_link));
 	struct run_queue *rq0 = get_cpu_ptr(runqueues);
 	list_init(&(rq0->rq_link));
+	spinlock_init(&(rq0->lock));
 	rq0->max_time_slice = 8;
+	rq0->cpu = 0;
+	memset(&(rq0->usage), 0, sizeof(struct cpu_usage));
+#ifdef UCONFIG_SCHEDSTATS
+	memset(&(rq0->sched_stat), 0, sizeof(struct sched_stat));
+	memset(&(rq0->sched_idle), 0, sizeof(struct log2_hist));
+#endif
 
 	int i;
 	for (i = 1; i < sysconf.lcpu_count; i++) {
 		struct run_queue *rqi = per_cpu_ptr(runqueues, i);
 		list_add_before(&(rq0->rq_link), 
 				&(rqi->rq_link));
+		spinlock_init(&(rqi->lock));
 		rqi->max_time_slice = rq0->max_time_slice;
+		rqi->cpu = i;
+		memset(&(rqi->usage), 0, sizeof(struct cpu_usage));
+#ifdef UCONFIG_SCHEDSTATS
+		memset(&(rqi->sched_stat), 0, sizeof(struct sched_stat));
+		memset(&(rqi->sched_idle), 0, sizeof(struct log2_hist));
+#endif
 	}
+#ifdef UCONFIG_LOCK_STAT
+	for (i = 0; i < sysconf.lcpu_count; i++)
+		lock_stat_register("rq", i, &per_cpu_ptr(runqueues, i)->lock.stat);
+#endif
 
 #ifdef UCONFIG_SCHEDULER_MLFQ
 	sched_class = &MLFQ_sched_class;
 #elif defined UCONFIG_SCHEDULER_RR
 	sched_class = &RR_sched_class;
+#elif defined UCONFIG_SCHEDULER_CFS
+	sched_class = &CFS_sched_class;
 #else
 	sched_class = &MPRR_sched_class;
 #endif
 	for (i = 0; i < sysconf.lcpu_count; i++) {
 		struct run_queue *rqi = per_cpu_ptr(runqueues, i);
 		sched_class->init(rqi);
+#ifdef UCONFIG_SCHED_RT
+		RT_sched_class.init(rqi);
+#endif
 	}
+	sched_domains_init();
+
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct tvec_base *base = per_cpu_ptr(tvec_bases, i);
+		int j;
+		spinlock_init(&(base->lock));
+#ifdef UCONFIG_LOCK_STAT
+		lock_stat_register("tvec", i, &(base->lock.stat));
+#endif
+		base->timer_jiffies = 0;
+		base->ticks_due = 0;
+		list_init(&(base->expired));
+		base->running_timer = NULL;
+#ifdef UCONFIG_NO_HZ_IDLE
+		base->nohz_idle = 0;
+#endif
+		for (j = 0; j < TVR_SIZE; j++) {
+			list_init(base->tv1 + j);
+		}
+		for (j = 0; j < TVN_SIZE; j++) {
+			list_init(base->tv2 + j);
+			list_init(base->tv3 + j);
+			list_init(base->tv4 + j);
+			list_init(base->tv5 + j);
+		}
+	}
+
+	timer_cachep = kmem_cache_create("timer", sizeof(timer_t), 0, NULL);
+	assert(timer_cachep != NULL);
+	softirq_init();
+	open_softirq(TIMER_SOFTIRQ, run_timer_softirq);
+	timekeeping_init();
+	hrtimers_init();
+#ifdef UCONFIG_CPUCG
+	cpucg_init();
+#endif
 
 	kprintf("sched class: %s\n", sched_class->name);
 }
 
+timer_t *timer_alloc(void)
+{
+	return kmem_cache_alloc(timer_cachep);
+}
+
 void stop_proc(struct proc_struct *proc, uint32_t wait)
 {
 	bool intr_flag;
-	local_intr_save(intr_flag);
+	spin_lock_irqsave(&(proc->lock), intr_flag);
 	proc->state = PROC_SLEEPING;
 	proc->wait_state = wait;
 	if (!list_empty(&(proc->run_link))) {
 		sched_class_dequeue(proc);
 	}
-	local_intr_restore(intr_flag);
+	spin_unlock_irqrestore(&(proc->lock), intr_flag);
+}
+
+// sched_wake_kick - proc was queued on another cpu, make it reschedule if
+//                 - it idles, at once or when batch is flushed
+static void
+sched_wake_kick(struct proc_struct *proc, struct wakeup_batch *batch)
+{
+	int cpu = proc->rq->cpu;
+	struct proc_struct *curr = per_cpu_ptr(cpus, cpu)->__current;
+	if (cpu == myid() || curr->pid >= sysconf.lcpu_count) {
+		return;
+	}
+	curr->need_resched = 1;
+	if (batch != NULL) {
+		cpuset_set(&(batch->resched), cpu);
+	} else {
+		mp_resched_cpu(cpu);
+	}
+}
+
+// __wakeup_proc - make proc runnable, called with proc->lock held. With a
+//               - batch the remote cpus to kick are only recorded in it
+static inline int
+__wakeup_proc(struct proc_struct *proc, struct wakeup_batch *batch)
+{
+	if (proc->state != PROC_RUNNABLE) {
+		trace_event(TRACE_SCHED_WAKEUP, proc->pid, proc->wait_state);
+		proc->state = PROC_RUNNABLE;
+		proc->wait_state = 0;
+		/* a proc preempted on its way to sleep is still queued */
+		if (proc != current && list_empty(&(proc->run_link))) {
+			sched_class_enqueue(proc);
+#ifdef UCONFIG_SCHED_RT
+			if (proc->policy != SCHED_NORMAL) {
+				sched_rt_preempt(proc, batch);
+			} else
+#endif
+			if (!list_empty(&(proc->run_link))) {
+				/* not held back by its cpu group */
+				sched_wake_kick(proc, batch);
+			}
+#ifdef UCONFIG_NO_HZ_IDLE
+			/* a pinned proc can't be stolen, wake its cpu up */
+			if ((proc->flags & PF_PINCPU)
+			    && proc->cpu_affinity != myid()
+			    && per_cpu_ptr(tvec_bases,
+					   proc->cpu_affinity)->nohz_idle) {
+				if (batch != NULL) {
+					cpuset_set(&(batch->nohz_kick),
+						   proc->cpu_affinity);
+				} else {
+					tick_nohz_kick(proc->cpu_affinity);
+				}
+			}
+#endif
+		}
+		return 1;
+	}
+	return 0;
+}
+
+void wakeup_batch_init(struct wakeup_batch *batch)
+{
+	memset(batch, 0, sizeof(struct wakeup_batch));
+}
+
+// wakeup_proc_batch - wakeup_proc for a proc that may be runnable already,
+//                   - the remote reschedules wait for wakeup_batch_flush.
+//                   - Called with local interrupts off.
+int wakeup_proc_batch(struct proc_struct *proc, struct wakeup_batch *batch)
+{
+	int ret;
+	assert(proc->state != PROC_ZOMBIE);
+	spinlock_acquire(&(proc->lock));
+	ret = __wakeup_proc(proc, batch);
+	spinlock_release(&(proc->lock));
+	return ret;
+}
+
+// wakeup_batch_flush - send each cpu recorded in batch a single kick, however
+//                    - many of the woken procs went to it
+void wakeup_batch_flush(struct wakeup_batch *batch)
+{
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (cpuset_test(&(batch->resched), i)) {
+			mp_resched_cpu(i);
+		}
+#ifdef UCONFIG_NO_HZ_IDLE
+		else if (cpuset_test(&(batch->nohz_kick), i)) {
+			tick_nohz_kick(i);
+		}
+#endif
+	}
 }
 
 void wakeup_proc(struct proc_struct *proc)
 {
 	assert(proc->state != PROC_ZOMBIE);
 	bool intr_flag;
-	local_intr_save(intr_flag);
+	spin_lock_irqsave(&(proc->lock), intr_flag);
 	{
 		if (proc->state != PROC_RUNNABLE) {
-			proc->state = PROC_RUNNABLE;
-			proc->wait_state = 0;
-			if (proc != current) {
-				assert(proc->pid >= sysconf.lcpu_count);
-				sched_class_enqueue(proc);
-			}
+			assert(proc->pid >= sysconf.lcpu_count);
+			__wakeup_proc(proc, NULL);
 		} else {
 			warn("wakeup runnable process.\n");
 		}
 	}
-	local_intr_restore(intr_flag);
+	spin_unlock_irqrestore(&(proc->lock), intr_flag);
 }
 
 int try_to_wakeup(struct proc_struct *proc)
@@ -135,36 +775,410 @@ int try_to_wakeup(struct proc_struct *proc)
 	assert(proc->state != PROC_ZOMBIE);
 	int ret;
 	bool intr_flag;
+	struct wakeup_batch batch;
+	wakeup_batch_init(&batch);
 	local_intr_save(intr_flag);
 	{
-		if (proc->state != PROC_RUNNABLE) {
-			proc->state = PROC_RUNNABLE;
-			proc->wait_state = 0;
-			if (proc != current) {
-				sched_class_enqueue(proc);
-			}
-			ret = 1;
-		} else {
-			ret = 0;
-		}
 		struct proc_struct *next = proc;
+		spinlock_acquire(&(proc->lock));
+		ret = __wakeup_proc(proc, &batch);
+		spinlock_release(&(proc->lock));
 		while ((next = next_thread(next)) != proc) {
+			spinlock_acquire(&(next->lock));
 			if (next->state == PROC_SLEEPING
 			    && next->wait_state == WT_SIGNAL) {
-				next->state = PROC_RUNNABLE;
-				next->wait_state = 0;
-				if (next != current) {
-					sched_class_enqueue(next);
-				}
+				__wakeup_proc(next, &batch);
 			}
+			spinlock_release(&(next->lock));
 		}
+		wakeup_batch_flush(&batch);
 	}
 	local_intr_restore(intr_flag);
 	return ret;
 }
 
+// sched_pick_next - take the next proc off rq, the realtime ones first,
+//                 - NULL if there is none. Called with rq->lock held.
+static struct proc_struct *sched_pick_next(struct run_queue *rq)
+{
+	struct proc_struct *next;
+#ifdef UCONFIG_SCHED_RT
+	if ((next = RT_sched_class.pick_next(rq)) != NULL) {
+		RT_sched_class.dequeue(rq, next);
+		return next;
+	}
+#endif
+#ifdef UCONFIG_CPUCG
+again:
+#endif
+	next = sched_class->pick_next(rq);
+	if (next == NULL) {
+		/* nothing to run here, try to steal from a busy cpu */
+		sched_class_load_balance(rq, (1 << SD_LEVELS) - 1);
+		next = sched_class->pick_next(rq);
+	}
+	if (next != NULL) {
+		sched_class->dequeue(rq, next);
+#ifdef UCONFIG_CPUCG
+		/* queued before its group ran out of its quota */
+		if (cpucg_throttle(next)) {
+			goto again;
+		}
+#endif
+	}
+	return next;
+}
+
+#ifdef UCONFIG_CPUCG
+// sched_unthrottle - queue proc again, held back while its cpu group was
+//                  - out of its quota
+void sched_unthrottle(struct proc_struct *proc)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&(proc->lock), intr_flag);
+	if (proc->state == PROC_RUNNABLE && list_empty(&(proc->run_link))
+	    && list_empty(&(proc->cg_link))) {
+		sched_class_enqueue(proc);
+	}
+	spin_unlock_irqrestore(&(proc->lock), intr_flag);
+}
+#endif
+
+// sched_apply_prio - schedule proc by its own policy, or as SCHED_FIFO at
+//                  - pi_prio if that is more urgent, with proc->lock held
+static void sched_apply_prio(struct proc_struct *proc)
+{
+	bool queued = 0;
+	struct run_queue *rq = NULL;
+	int policy = proc->normal_policy, prio = proc->normal_prio;
+	if (proc->pi_prio > prio) {
+		policy = SCHED_FIFO, prio = proc->pi_prio;
+	}
+	if (proc->rq != NULL) {
+		rq = rq_lock_proc(proc);
+		if ((queued = !list_empty(&(proc->run_link)))) {
+			proc_sched_class(proc)->dequeue(rq, proc);
+		}
+	}
+	proc->policy = policy;
+	proc->rt_priority = prio;
+	if (rq != NULL) {
+		if (queued) {
+			proc_sched_class(proc)->enqueue(rq, proc);
+		}
+		rq_unlock(rq);
+	}
+	if (proc == current) {
+		/* let a more urgent proc have the cpu if there is one, behind
+		 * those of its new priority */
+		proc->need_resched = 1;
+		if (policy != SCHED_NORMAL) {
+			proc->time_slice = 0;
+		}
+	}
+#ifdef UCONFIG_SCHED_RT
+	else if (queued && policy != SCHED_NORMAL) {
+		sched_rt_preempt(proc, NULL);
+	}
+#endif
+}
+
+// sched_setscheduler - switch proc to policy at prio, which are valid; a
+//                    - priority inherited meanwhile still applies
+void sched_setscheduler(struct proc_struct *proc, int policy, int prio)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&(proc->lock), intr_flag);
+	proc->normal_policy = policy;
+	proc->normal_prio = prio;
+	sched_apply_prio(proc);
+	spin_unlock_irqrestore(&(proc->lock), intr_flag);
+}
+
+// sched_set_pi_prio - have proc run at the realtime priority prio at least,
+//                   - inherited from the waiters of its rt_mutexes, 0 for
+//                   - none; called with the pi_lock of rtmutex.c held
+void sched_set_pi_prio(struct proc_struct *proc, int prio)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&(proc->lock), intr_flag);
+	proc->pi_prio = prio;
+	sched_apply_prio(proc);
+	spin_unlock_irqrestore(&(proc->lock), intr_flag);
+}
+
+// sched_setnice - weight proc by nice from now on, a valid one; queued, it
+//               - is queued again for the load of its run queue
+void sched_setnice(struct proc_struct *proc, int nice)
+{
+	bool intr_flag, queued = 0;
+	struct run_queue *rq = NULL;
+	spin_lock_irqsave(&(proc->lock), intr_flag);
+	if (proc->rq != NULL) {
+		rq = rq_lock_proc(proc);
+		if ((queued = !list_empty(&(proc->run_link)))) {
+			proc_sched_class(proc)->dequeue(rq, proc);
+		}
+	}
+	proc->nice = nice;
+	if (rq != NULL) {
+		if (queued) {
+			proc_sched_class(proc)->enqueue(rq, proc);
+		}
+		rq_unlock(rq);
+	}
+	if (proc == current) {
+		/* its slice was its share at the old weight */
+		proc->need_resched = 1;
+	}
+	spin_unlock_irqrestore(&(proc->lock), intr_flag);
+}
+
+// sched_class_name - the name of the class proc is scheduled by
+const char *sched_class_name(struct proc_struct *proc)
+{
+	return proc_sched_class(proc)->name;
+}
+
+// sched_setaffinity_mask - run proc on the cpus of mask only, or on any
+//                        - cpu again if mask is NULL; mask has one of the
+//                        - cpus at least. current moves at its next
+//                        - schedule()
+void sched_setaffinity_mask(struct proc_struct *proc, const cpuset_t * mask)
+{
+	bool intr_flag, queued = 0;
+	struct run_queue *rq;
+	spin_lock_irqsave(&(proc->lock), intr_flag);
+	if (proc->rq != NULL) {
+		rq = rq_lock_proc(proc);
+		if ((queued = !list_empty(&(proc->run_link)))) {
+			proc_sched_class(proc)->dequeue(rq, proc);
+		}
+		rq_unlock(rq);
+	}
+	if (mask == NULL) {
+		proc->flags &= ~PF_PINCPU;
+	} else {
+		proc->cpus_allowed = *mask;
+		if (proc->cpu_affinity < 0
+		    || proc->cpu_affinity >= sysconf.lcpu_count
+		    || !cpuset_test(mask, proc->cpu_affinity)) {
+			proc->cpu_affinity =
+			    cpuset_first(mask, sysconf.lcpu_count);
+		}
+		proc->flags |= PF_PINCPU;
+	}
+	if (queued) {
+		/* to the run queue of one of its cpus now */
+		sched_class_enqueue(proc);
+		if ((proc->flags & PF_PINCPU) && proc->cpu_affinity != myid()) {
+			mp_resched_cpu(proc->cpu_affinity);
+		}
+	} else if (proc == current && !sched_proc_allowed(proc, myid())) {
+		proc->need_resched = 1;
+	}
+	spin_unlock_irqrestore(&(proc->lock), intr_flag);
+}
+
+// sched_setaffinity - run proc on cpu only, or on any cpu again if cpu is -1,
+//                   - the cpu is valid
+void sched_setaffinity(struct proc_struct *proc, int cpu)
+{
+	cpuset_t mask;
+	if (cpu < 0) {
+		sched_setaffinity_mask(proc, NULL);
+		return;
+	}
+	cpuset_clear(&mask);
+	cpuset_set(&mask, cpu);
+	sched_setaffinity_mask(proc, &mask);
+}
+
+// sched_getaffinity - the cpus proc may run on into mask
+void sched_getaffinity(struct proc_struct *proc, cpuset_t * mask)
+{
+	bool intr_flag;
+	int i;
+	spin_lock_irqsave(&(proc->lock), intr_flag);
+	if (proc->flags & PF_PINCPU) {
+		*mask = proc->cpus_allowed;
+	} else {
+		cpuset_clear(mask);
+		for (i = 0; i < sysconf.lcpu_count; i++) {
+			if (!sched_cpu_isolated(i)) {
+				cpuset_set(mask, i);
+			}
+		}
+	}
+	spin_unlock_irqrestore(&(proc->lock), intr_flag);
+}
+
+#ifdef UCONFIG_PREEMPT
+/* added to preempt_count while the proc is switched away involuntarily */
+#define PREEMPT_ACTIVE              0x10000000
+
+void preempt_disable(void)
+{
+	if (current != NULL) {
+		current->preempt_count++;
+	}
+}
+
+void preempt_enable(void)
+{
+	if (current != NULL && --current->preempt_count == 0) {
+		preempt_check_resched();
+	}
+}
+
+// preempt_schedule_irq - give the cpu away from a kernel path, which was
+//                      - interrupted or has just turned interrupts back on.
+//                      - Called with interrupts disabled.
+void preempt_schedule_irq(void)
+{
+	if (current->preempt_count != 0 || !current->need_resched) {
+		return;
+	}
+	/* current stays runnable even if it is about to sleep, see schedule */
+	current->preempt_count += PREEMPT_ACTIVE;
+	schedule();
+	current->preempt_count -= PREEMPT_ACTIVE;
+}
+
+// preempt_check_resched - a preemption point, taken if interrupts are on
+void preempt_check_resched(void)
+{
+	bool intr_flag;
+	if (current == NULL || current->preempt_count != 0
+	    || !current->need_resched) {
+		return;
+	}
+	local_intr_save(intr_flag);
+	if (intr_flag) {
+		preempt_schedule_irq();
+	}
+	/* not local_intr_restore, which is a preemption point itself */
+	__intr_restore(intr_flag);
+}
+#endif
+
 #include <vmm.h>
 
+// account_switch - count the switch away from prev, voluntary if it sleeps,
+//                - and charge it the ns it ran since it got the cpu
+static void account_switch(struct run_queue *rq, struct proc_struct *prev,
+			   struct proc_struct *next)
+{
+	uint64_t now = ktime_get_ns();
+	prev->runtime += now - prev->exec_start;
+	next->exec_start = now;
+	if (prev->state == PROC_RUNNABLE
+#ifdef UCONFIG_PREEMPT
+	    || (prev->preempt_count & PREEMPT_ACTIVE)
+#endif
+	    ) {
+		prev->rusage.ru_nivcsw++;
+	} else {
+		prev->rusage.ru_nvcsw++;
+	}
+	rq->usage.nr_switches++;
+}
+
+#ifdef UCONFIG_KVM_GUEST
+// account_steal - charge the ticks the host took since the last one as
+//               - steal time, return whether there was one
+static bool account_steal(struct run_queue *rq)
+{
+	uint64_t steal = kvm_steal_clock(), n;
+	if (rq->steal_clock == 0) {
+		/* what was taken before the first tick is not counted */
+		rq->steal_clock = steal;
+		return 0;
+	}
+	n = (steal - rq->steal_clock) / TIMER_TICK_NSEC;
+	rq->steal_clock += n * TIMER_TICK_NSEC;
+	rq->usage.steal += n;
+	return n != 0;
+}
+#endif
+
+// account_tick - charge the tick to current and the cpu, in user mode or in
+//              - the kernel as the trap it interrupted; return 0 if it was
+//              - stolen by the host instead
+static bool account_tick(void)
+{
+	struct run_queue *rq = get_cpu_ptr(runqueues);
+	struct trapframe *tf = current->tf;
+#ifdef UCONFIG_KVM_GUEST
+	if (account_steal(rq)) {
+		return 0;
+	}
+#endif
+	if (current == idleproc) {
+		rq->usage.idle++;
+	} else if (tf != NULL && !trap_in_kernel(tf)) {
+		current->rusage.ru_utime++;
+		rq->usage.user++;
+	} else {
+		current->rusage.ru_stime++;
+		rq->usage.system++;
+	}
+	return 1;
+}
+
+// sched_runtime - the ns proc has run, with the time since it got the cpu
+//               - if it is current; that of another cpu counts from its
+//               - next switch
+uint64_t sched_runtime(struct proc_struct *proc)
+{
+	uint64_t runtime = proc->runtime;
+	if (proc == current) {
+		runtime += ktime_get_ns() - proc->exec_start;
+	}
+	return runtime;
+}
+
+// sched_cpu_usage - the time of cpu so far
+void sched_cpu_usage(int cpu, struct cpu_usage *usage)
+{
+	*usage = per_cpu_ptr(runqueues, cpu)->usage;
+}
+
+#ifdef UCONFIG_SCHEDSTATS
+// sched_stat_show - the wait, run and idle histograms of each cpu into buf
+//                 - of size bytes, see schedstat.h; the length is returned
+size_t sched_stat_show(char *buf, size_t size)
+{
+	char name[32];
+	size_t len = 0;
+	int cpu;
+	for (cpu = 0; cpu < sysconf.lcpu_count && len < size; cpu++) {
+		struct run_queue *rq = per_cpu_ptr(runqueues, cpu);
+		snprintf(name, sizeof(name), "cpu%d wait", cpu);
+		len += log2_hist_show(&(rq->sched_stat.wait), name,
+				       buf + len, size - len);
+		snprintf(name, sizeof(name), "cpu%d run", cpu);
+		len += log2_hist_show(&(rq->sched_stat.run), name,
+				       buf + len, size - len);
+		snprintf(name, sizeof(name), "cpu%d idle", cpu);
+		len += log2_hist_show(&(rq->sched_idle), name,
+				       buf + len, size - len);
+	}
+	return (len < size) ? len : size;
+}
+#endif
+
+// sched_nr_running - the procs queued on cpu, read without the lock
+unsigned int sched_nr_running(int cpu)
+{
+	struct run_queue *rq = per_cpu_ptr(runqueues, cpu);
+#ifdef UCONFIG_SCHED_RT
+	return rq->proc_num + rq->rt_num;
+#else
+	return rq->proc_num;
+#endif
+}
+
 void schedule(void)
 {
 	/* schedule in irq ctx is not allowed */
@@ -174,123 +1188,470 @@ void schedule(void)
 
 	local_intr_save(intr_flag);
 	int lcpu_count = sysconf.lcpu_count;
+	rcu_note_qs();
+	if ((current->flags & PF_WQ_WORKER) && current->state == PROC_SLEEPING) {
+		/* another worker may take the works behind */
+		wq_worker_sleeping(current);
+	}
 	{
+		struct run_queue *rq = get_cpu_ptr(runqueues);
 		current->need_resched = 0;
-		if (current->state == PROC_RUNNABLE
-		    && current->pid >= lcpu_count) {
+		if ((current->state == PROC_RUNNABLE
+#ifdef UCONFIG_PREEMPT
+		     /* preempted between setting its state and sleeping, it
+		      * must get back to its schedule(); a zombie is done */
+		     || (current->state == PROC_SLEEPING
+			 && (current->preempt_count & PREEMPT_ACTIVE))
+#endif
+		    ) && current->pid >= lcpu_count
+		    && list_empty(&(current->run_link))) {
 			sched_class_enqueue(current);
 		}
 
-		next = sched_class_pick_next();
-		if (next != NULL)
-			sched_class_dequeue(next);
-		else
+		rq_lock(rq);
+		if ((next = sched_pick_next(rq)) == NULL)
 			next = idleproc;
+		rq_unlock(rq);
 		next->runs++;
-		if (next != current)
+		if (next != current) {
+			struct tvec_base *base = get_cpu_ptr(tvec_bases);
+			current->last_ran = base->timer_jiffies;
+			account_switch(rq, current, next);
+			schedstat_switch(rq, current, next);
 			proc_run(next);
+		}
+	}
+	if (current->flags & PF_WQ_WORKER) {
+		wq_worker_running(current);
 	}
 	local_intr_restore(intr_flag);
 }
 
-static void __add_timer(timer_t * timer)
+// schedule_to - switch straight to proc, asleep in wait_state since it ran
+//             - last on this cpu, rather than wake it and go through the
+//             - run queue; current, going to sleep, gives it the rest of
+//             - its time slice. Return 0 if proc is not in that state, or
+//             - not to be run here, the caller then wakes it as usual.
+bool schedule_to(struct proc_struct *proc, uint32_t wait_state)
 {
-	assert(timer->expires > 0 && timer->proc != NULL);
-	assert(list_empty(&(timer->timer_link)));
-	list_entry_t *le = list_next(&timer_list);
-	while (le != &timer_list) {
-		timer_t *next = le2timer(le, timer_link);
-		if (timer->expires < next->expires) {
-			next->expires -= timer->expires;
-			break;
-		}
-		timer->expires -= next->expires;
-		le = list_next(le);
+	assert(!ucore_in_interrupt());
+	bool intr_flag;
+	struct run_queue *rq;
+	local_intr_save(intr_flag);
+	rq = get_cpu_ptr(runqueues);
+	spinlock_acquire(&(proc->lock));
+	/* it switched away here and is not queued, so off any cpu now */
+	if (proc->state != PROC_SLEEPING || proc->wait_state != wait_state
+	    || proc->rq != rq || !list_empty(&(proc->run_link))
+	    || !sched_proc_allowed(proc, rq->cpu)
+	    || (current->flags & PF_WQ_WORKER)
+#ifdef UCONFIG_CPUCG
+	    /* its group may be out of its quota */
+	    || proc->cpucg != NULL
+#endif
+	    ) {
+		spinlock_release(&(proc->lock));
+		local_intr_restore(intr_flag);
+		return 0;
+	}
+	trace_event(TRACE_SCHED_WAKEUP, proc->pid, proc->wait_state);
+	proc->state = PROC_RUNNABLE;
+	proc->wait_state = 0;
+	schedstat_enqueue(proc);
+	if (proc_sched_class(proc) == proc_sched_class(current)
+	    && current->time_slice > 0) {
+		proc->time_slice = current->time_slice;
+	}
+	spinlock_release(&(proc->lock));
+
+	rcu_note_qs();
+	current->need_resched = 0;
+	if (current->state == PROC_RUNNABLE
+	    && current->pid >= sysconf.lcpu_count
+	    && list_empty(&(current->run_link))) {
+		sched_class_enqueue(current);
+	}
+	proc->runs++;
+	current->last_ran = get_cpu_ptr(tvec_bases)->timer_jiffies;
+	account_switch(rq, current, proc);
+	schedstat_switch(rq, current, proc);
+	proc_run(proc);
+	local_intr_restore(intr_flag);
+	return 1;
+}
+
+/* The timers of a cpu hang in a hierarchical timing wheel (as in Linux):
+ * tv1 holds the timers due in the next TVR_SIZE ticks, tvN+1 covers
+ * TVN_SIZE times the range of tvN. Adding and deleting a timer are O(1),
+ * a slot of tvN+1 is cascaded down into the lower levels each time tvN
+ * wraps around. timer->expires is turned into an absolute expiry tick in
+ * __add_timer. */
+static inline void
+__internal_add_timer(struct tvec_base *base, timer_t * timer)
+{
+	unsigned int expires = timer->expires;
+	unsigned int idx = expires - base->timer_jiffies;
+	list_entry_t *vec;
+
+	if ((int)idx < 0) {
+		/* already due, run it in the next tick */
+		vec = base->tv1 + (base->timer_jiffies & TVR_MASK);
+	} else if (idx < TVR_SIZE) {
+		vec = base->tv1 + (expires & TVR_MASK);
+	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
+		vec = base->tv2 + ((expires >> TVR_BITS) & TVN_MASK);
+	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
+		vec = base->tv3 + ((expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK);
+	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
+		vec = base->tv4 +
+		    ((expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK);
+	} else {
+		vec = base->tv5 +
+		    ((expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK);
+	}
+	list_add_before(vec, &(timer->timer_link));
+}
+
+// timer_slack - the ticks timer, of expires ticks from now, may fire late
+//             - by: the slack of its proc, or 1/256 of the time as in Linux
+//             - for the linux timers
+static inline unsigned int timer_slack(timer_t * timer)
+{
+	if (timer->proc != NULL) {
+		return timer->proc->timer_slack;
+	}
+	return timer->expires >> 8;
+}
+
+// apply_slack - the tick in [expires, expires + slack] with the most low
+//             - zero bits, so that the timers due about the same time fire
+//             - in the same tick, a wakeup and an event of nohz idle for all
+static inline unsigned int apply_slack(unsigned int expires, unsigned int slack)
+{
+	unsigned int limit = expires + slack, mask;
+	if (slack == 0) {
+		return expires;
 	}
-	list_add_before(le, &(timer->timer_link));
+	mask = (1U << word_fls(limit ^ expires)) - 1;
+	return limit & ~mask;
+}
+
+static void __add_timer(struct tvec_base *base, timer_t * timer)
+{
+	assert(timer->expires > 0
+	       && (timer->proc != NULL || __ucore_is_linux_timer(timer)));
+	assert(list_empty(&(timer->timer_link)));
+	unsigned int slack = timer_slack(timer);
+	/* the first tick processed is base->timer_jiffies itself */
+	timer->expires += base->timer_jiffies - 1;
+	timer->expires = apply_slack(timer->expires, slack);
+	timer->base = base;
+	__internal_add_timer(base, timer);
 }
 
 void add_timer(timer_t * timer)
 {
 	bool intr_flag;
-	spin_lock_irqsave(&__timer_list.lock, intr_flag);
+	local_intr_save(intr_flag);
 	{
-		__add_timer(timer);
+		struct tvec_base *base = get_cpu_ptr(tvec_bases);
+		spinlock_acquire(&(base->lock));
+		__add_timer(base, timer);
+		spinlock_release(&(base->lock));
 	}
-	spin_unlock_irqrestore(&__timer_list.lock, intr_flag);
+	local_intr_restore(intr_flag);
 }
 
-static void __del_timer(timer_t * timer)
+static inline void __del_timer(timer_t * timer)
 {
-	if (!list_empty(&(timer->timer_link))) {
-		if (timer->expires != 0) {
-			list_entry_t *le =
-				list_next(&(timer->timer_link));
-			if (le != &timer_list) {
-				timer_t *next =
-					le2timer(le, timer_link);
-				next->expires += timer->expires;
-			}
+	list_del_init(&(timer->timer_link));
+	timer->base = NULL;
+}
+
+// lock_timer_base - lock the wheel holding timer, return NULL if it is not
+//                 - pending. The timer may be firing on another cpu, so
+//                 - recheck its base once locked.
+static struct tvec_base *lock_timer_base(timer_t * timer)
+{
+	struct tvec_base *base;
+	while ((base = timer->base) != NULL) {
+		spinlock_acquire(&(base->lock));
+		if (timer->base == base) {
+			return base;
 		}
-		list_del_init(&(timer->timer_link));
+		spinlock_release(&(base->lock));
 	}
+	return NULL;
 }
 
 void del_timer(timer_t * timer)
 {
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		struct tvec_base *base = lock_timer_base(timer);
+		if (base != NULL) {
+			__del_timer(timer);
+			spinlock_release(&(base->lock));
+		}
+	}
+	local_intr_restore(intr_flag);
+}
+
+// del_timer_sync - del_timer, and wait until its function has returned if
+//                - it is being called on another cpu, so that the owner of
+//                - an embedded timer may free it
+void del_timer_sync(timer_t * timer)
+{
+	bool intr_flag, running;
+	int i;
+	del_timer(timer);
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct tvec_base *base = per_cpu_ptr(tvec_bases, i);
+		if (i == myid()) {
+			/* from its own function, or not running here at all */
+			continue;
+		}
+		do {
+			local_intr_save(intr_flag);
+			spinlock_acquire(&(base->lock));
+			running = (base->running_timer == timer);
+			spinlock_release(&(base->lock));
+			local_intr_restore(intr_flag);
+		} while (running);
+	}
+}
 
+// timer_remaining - the number of ticks left before timer expires,
+//                 - 0 if it is not pending
+unsigned int timer_remaining(timer_t * timer)
+{
+	unsigned int left = 0;
 	bool intr_flag;
-	spin_lock_irqsave(&__timer_list.lock, intr_flag);
+	local_intr_save(intr_flag);
 	{
+		struct tvec_base *base = lock_timer_base(timer);
+		if (base != NULL) {
+			if ((int)(timer->expires - base->timer_jiffies) >= 0) {
+				left = timer->expires - base->timer_jiffies + 1;
+			}
+			spinlock_release(&(base->lock));
+		}
+	}
+	local_intr_restore(intr_flag);
+	return left;
+}
+
+// cascade - move all timers of tv[index] down to the lower levels
+static int cascade(struct tvec_base *base, list_entry_t * tv, int index)
+{
+	list_entry_t *list = tv + index, *le;
+	while ((le = list_next(list)) != list) {
+		timer_t *timer = le2timer(le, timer_link);
+		list_del_init(le);
+		__internal_add_timer(base, timer);
+	}
+	return index;
+}
+
+#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+
+// __run_timers - process the next tick of base, called with base->lock held;
+//              - the linux timers due are moved to base->expired, for
+//              - run_linux_timers to call once it has dropped the lock
+static void __run_timers(struct tvec_base *base)
+{
+	int index = base->timer_jiffies & TVR_MASK;
+	if (!index &&
+	    (!cascade(base, base->tv2, INDEX(0))) &&
+	    (!cascade(base, base->tv3, INDEX(1))) &&
+	    !cascade(base, base->tv4, INDEX(2))) {
+		cascade(base, base->tv5, INDEX(3));
+	}
+	base->timer_jiffies++;
+
+	list_entry_t *list = base->tv1 + index, *le;
+	while ((le = list_next(list)) != list) {
+		timer_t *timer = le2timer(le, timer_link);
+		if (__ucore_is_linux_timer(timer)) {
+			/* still pending, del_timer takes it off there too */
+			list_del(le);
+			list_add_before(&(base->expired), le);
+			continue;
+		}
 		__del_timer(timer);
+		struct proc_struct *proc = timer->proc;
+		if (proc->wait_state != 0) {
+			assert(proc->wait_state & WT_INTERRUPTED);
+		} else {
+			warn("process %d's wait_state == 0.\n", proc->pid);
+		}
+
+		wakeup_proc(proc);
 	}
-	spin_unlock_irqrestore(&__timer_list.lock, intr_flag);
 }
 
-void run_timer_list(void)
+// run_linux_timers - call the linux timers __run_timers took off the wheel,
+//                  - one at a time without the lock, and free those from
+//                  - timer_alloc
+static void run_linux_timers(struct tvec_base *base)
 {
 	bool intr_flag;
-	spin_lock_irqsave(&__timer_list.lock, intr_flag);
+	list_entry_t *le;
+	while (1) {
+		local_intr_save(intr_flag);
+		spinlock_acquire(&(base->lock));
+		base->running_timer = NULL;
+		if ((le = list_next(&(base->expired))) == &(base->expired)) {
+			spinlock_release(&(base->lock));
+			local_intr_restore(intr_flag);
+			break;
+		}
+		timer_t *timer = le2timer(le, timer_link);
+		struct __ucore_linux_timer lt = timer->linux_timer;
+		__del_timer(timer);
+		if (lt.embedded) {
+			base->running_timer = timer;
+		}
+		spinlock_release(&(base->lock));
+		local_intr_restore(intr_flag);
+
+		/* an embedded one may be added again from there */
+		if (lt.function)
+			(lt.function) (lt.data);
+		if (!lt.embedded) {
+			kmem_cache_free(timer_cachep, timer);
+		}
+	}
+}
+
+// run_timer_softirq - process the ticks this cpu has taken: the wheel a
+//                   - tick at a time with interrupts disabled, the linux
+//                   - timers due with interrupts enabled
+static void run_timer_softirq(void)
+{
+	struct tvec_base *base = get_cpu_ptr(tvec_bases);
+	bool intr_flag, more = 1;
+	while (more) {
+		local_intr_save(intr_flag);
+		spinlock_acquire(&(base->lock));
+		if ((more = (base->ticks_due > 0))) {
+			base->ticks_due--;
+			__run_timers(base);
+		}
+		spinlock_release(&(base->lock));
+		local_intr_restore(intr_flag);
+	}
+	run_linux_timers(base);
+}
+
+// run_timer_list - called on every cpu for each of its clock ticks; the
+//                - timers due are left to the timer softirq
+void run_timer_list(void)
+{
+	bool intr_flag, charged;
+	struct tvec_base *base;
+	local_intr_save(intr_flag);
+	if (myid() == 0) {
+		/* the cpu moving ticks */
+		timekeeping_tick();
+#ifdef UCONFIG_CPUCG
+		cpucg_period_tick();
+#endif
+	}
+	charged = account_tick();
+	rcu_tick();
+	base = get_cpu_ptr(tvec_bases);
+	spinlock_acquire(&(base->lock));
 	{
-		list_entry_t *le = list_next(&timer_list);
-		if (le != &timer_list) {
-			timer_t *timer = le2timer(le, timer_link);
-			assert(timer->expires != 0);
-			timer->expires--;
-			while (timer->expires == 0) {
-				le = list_next(le);
-				if (__ucore_is_linux_timer(timer)) {
-					struct __ucore_linux_timer *lt =
-					    &(timer->linux_timer);
-
-					spin_unlock_irqrestore(&__timer_list.lock, intr_flag);
-					if (lt->function)
-						(lt->function) (lt->data);
-					spin_lock_irqsave(&__timer_list.lock, intr_flag);
-
-					__del_timer(timer);
-					kfree(timer);
-					continue;
-				}
-				struct proc_struct *proc = timer->proc;
-				if (proc->wait_state != 0) {
-					assert(proc->wait_state &
-					       WT_INTERRUPTED);
-				} else {
-					warn("process %d's wait_state == 0.\n",
-					     proc->pid);
-				}
+		base->ticks_due++;
+		/* nor is a tick the host took off its time slice */
+		if (charged) {
+			sched_class_proc_tick(current);
+		}
+	}
+	spinlock_release(&(base->lock));
+	raise_softirq(TIMER_SOFTIRQ);
+	hrtimer_run_queue();
 
-				wakeup_proc(proc);
+	sched_balance_tick(base);
+	local_intr_restore(intr_flag);
+}
 
-				__del_timer(timer);
-				if (le == &timer_list) {
-					break;
-				}
-				timer = le2timer(le, timer_link);
-			}
+#ifdef UCONFIG_NO_HZ_IDLE
+// timer_nohz_enter - the idle cpu is going to stop its tick, return the
+//                  - number of ticks until the next event of its wheel,
+//                  - 0 if it has work to do and must keep its tick.
+// NOTE: the cascade point is reported as an event as well, so the result
+//       never exceeds TVR_SIZE. Called with interrupts disabled.
+unsigned int timer_nohz_enter(void)
+{
+	struct tvec_base *base = get_cpu_ptr(tvec_bases);
+	unsigned int index, j, nticks;
+	uint64_t next, now;
+	struct run_queue *rq = get_cpu_ptr(runqueues);
+	if (rq->proc_num > 0
+#ifdef UCONFIG_SCHED_RT
+	    || rq->rt_num > 0
+#endif
+	    ) {
+		/* raced with a wakeup, keep ticking */
+		return 0;
+	}
+#ifdef UCONFIG_CPUCG
+	if (myid() == 0 && cpucg_any_throttled()) {
+		/* the ends of the periods let the procs held back go */
+		return 0;
+	}
+#endif
+	now = ktime_get_ns();
+	if ((next = hrtimer_next_expiry()) != HRTIMER_NONE
+	    && next < now + TIMER_TICK_NSEC) {
+		/* due before the next tick */
+		return 0;
+	}
+	if (!rcu_idle_enter()) {
+		/* its callbacks run at its ticks */
+		return 0;
+	}
+	spinlock_acquire(&(base->lock));
+	if (base->ticks_due > 0) {
+		/* the softirq has yet to catch up with the wheel */
+		spinlock_release(&(base->lock));
+		return 0;
+	}
+	base->nohz_idle = 1;
+	index = base->timer_jiffies & TVR_MASK;
+	for (j = index; j < TVR_SIZE; j++) {
+		if (!list_empty(base->tv1 + j)) {
+			break;
+		}
+	}
+	spinlock_release(&(base->lock));
+	nticks = j - index + 1;
+	/* nor past the tick before the first hrtimer is due */
+	if (next != HRTIMER_NONE) {
+		next = (next > now) ? next - now : 0;
+		do_div(next, TIMER_TICK_NSEC);
+		if (next < nticks) {
+			nticks = (next > 0) ? next : 1;
 		}
-		sched_class_proc_tick(current);
 	}
-	spin_unlock_irqrestore(&__timer_list.lock, intr_flag);
+	return nticks;
 }
+
+// timer_nohz_exit - the tick is back, have the timer softirq process the
+//                 - nticks ticks which elapsed while it was stopped
+void timer_nohz_exit(unsigned int nticks)
+{
+	struct tvec_base *base = get_cpu_ptr(tvec_bases);
+	/* the cpu idled through them */
+	get_cpu_ptr(runqueues)->usage.idle += nticks;
+	rcu_idle_exit();
+	spinlock_acquire(&(base->lock));
+	base->nohz_idle = 0;
+	base->ticks_due += nticks;
+	spinlock_release(&(base->lock));
+	raise_softirq(TIMER_SOFTIRQ);
+}
+#endif
@@ -3,6 +3,7 @@
 
 #include <types.h>
 #include <list.h>
+#include <cpuset.h>
 
 struct proc_struct;
 
@@ -10,13 +11,21 @@ struct __ucore_linux_timer {
 	void *linux_timer;
 	unsigned long data;
 	void (*function) (unsigned long);
+	bool embedded;		// part of its owner, not freed once it ran
 };
 
+/* the clock tick of every cpu */
+#define TIMER_HZ                    100
+#define TIMER_TICK_NSEC             (1000000000 / TIMER_HZ)
+
+struct tvec_base;
+
 typedef struct {
-	unsigned int expires;
+	unsigned int expires;	// ticks to wait, the absolute expiry once added
 	struct proc_struct *proc;
 	struct __ucore_linux_timer linux_timer;
 	list_entry_t timer_link;
+	struct tvec_base *base;	// the timing wheel holding this timer
 } timer_t;
 
 #define le2timer(le, member)            \
@@ -28,15 +37,39 @@ static inline timer_t *timer_init(timer_t * timer, struct proc_struct *proc,
 	timer->expires = expires;
 	timer->proc = proc;
 	timer->linux_timer.linux_timer = NULL;
+	timer->linux_timer.embedded = 0;
 	list_init(&(timer->timer_link));
+	timer->base = NULL;
+	return timer;
+}
+
+// timer_setup - a timer calling function(data) in the timer softirq once
+//             - due, embedded in owner: added again at will, never freed
+//             - by the wheel, see del_timer_sync
+static inline timer_t *timer_setup(timer_t * timer, void *owner,
+				   void (*function) (unsigned long),
+				   unsigned long data)
+{
+	timer_init(timer, NULL, 0);
+	timer->linux_timer.linux_timer = owner;
+	timer->linux_timer.data = data;
+	timer->linux_timer.function = function;
+	timer->linux_timer.embedded = 1;
 	return timer;
 }
 
+// timer_pending - on the wheel of a cpu, or due and not called yet
+static inline bool timer_pending(timer_t * t)
+{
+	return t->base != NULL;
+}
+
 static inline int __ucore_is_linux_timer(timer_t * t)
 {
 	return (t->linux_timer.linux_timer != NULL);
 }
 
+/* defined in runqueue.h */
 struct run_queue;
 
 // The introduction of scheduling classes is borrrowed from Linux, and makes the 
@@ -55,32 +88,103 @@ struct sched_class {
 	struct proc_struct *(*pick_next) (struct run_queue * rq);
 	// dealer of the time-tick
 	void (*proc_tick) (struct run_queue * rq, struct proc_struct * proc);
-	/* for SMP support in the future
-	 *  load_balance
-	 *  void (*load_balance)(struct rq* rq);
-	 *  get some proc from this rq, used in load_balance,
-	 *  return value is the num of gotten proc
-	 *  int (*get_proc)(struct rq* rq, struct proc* procs_moved[]);
-	 */
+	/* for SMP support */
+	// pull runnable procs from the busiest run queue into rq,
+	// the victim queue is locked with double_rq_lock_balance
+	void (*load_balance) (struct run_queue * rq);
+	// get at most max procs out of this rq, used in load_balance,
+	// return value is the num of gotten proc
+	int (*get_proc) (struct run_queue * rq,
+			 struct proc_struct * procs_moved[], int max);
 };
 
-struct run_queue {
-	list_entry_t run_list;
-	unsigned int proc_num;
-	int max_time_slice;
-	list_entry_t rq_link;
-};
+/* ticks between two periodic load balancing passes of the nearest levels,
+ * the further ones wait longer, see sched_domains_init */
+#define SCHED_LB_INTERVAL           10
+/* a proc that ran that recently still has its cache on its cpu */
+#define SCHED_CACHE_HOT_TICKS       2
+
+/* the levels of the cpu hierarchy around a cpu, nearest first */
+#define SD_SMT                      0	// the threads of its core
+#define SD_PKG                      1	// the cores of its package
+#define SD_NUMA                     2	// the cpus of its numa node
+#define SD_ALL                      3	// the machine
+#define SD_LEVELS                   4
+/* max procs migrated by one load_balance call */
+#define SCHED_MAX_MOVE_PROC         8
 
-#define le2rq(le, member)           \
-    to_struct((le), struct run_queue, member)
+/* the remote cpus a run of wakeups has to kick, each is kicked once by
+ * wakeup_batch_flush rather than once per woken proc */
+struct wakeup_batch {
+	cpuset_t resched;
+#ifdef UCONFIG_NO_HZ_IDLE
+	cpuset_t nohz_kick;
+#endif
+};
 
 void sched_init(void);
 void wakeup_proc(struct proc_struct *proc);
+void wakeup_batch_init(struct wakeup_batch *batch);
+int wakeup_proc_batch(struct proc_struct *proc, struct wakeup_batch *batch);
+void wakeup_batch_flush(struct wakeup_batch *batch);
 void stop_proc(struct proc_struct *proc, uint32_t wait);
 int try_to_wakeup(struct proc_struct *proc);
 void schedule(void);
+bool schedule_to(struct proc_struct *proc, uint32_t wait_state);
+struct cpu_usage;
+void sched_cpu_usage(int cpu, struct cpu_usage *usage);
+uint64_t sched_runtime(struct proc_struct *proc);
+unsigned int sched_nr_running(int cpu);
+#ifdef UCONFIG_SCHEDSTATS
+size_t sched_stat_show(char *buf, size_t size);
+#endif
+#ifdef UCONFIG_KVM_GUEST
+/* the ns the host did not run this cpu while it could run, see kvm.c */
+uint64_t kvm_steal_clock(void);
+#endif
+void sched_setscheduler(struct proc_struct *proc, int policy, int prio);
+void sched_set_pi_prio(struct proc_struct *proc, int prio);
+void sched_setnice(struct proc_struct *proc, int nice);
+const char *sched_class_name(struct proc_struct *proc);
+void sched_setaffinity(struct proc_struct *proc, int cpu);
+void sched_setaffinity_mask(struct proc_struct *proc, const cpuset_t * mask);
+void sched_getaffinity(struct proc_struct *proc, cpuset_t * mask);
+void sched_isolate_cpus(const cpuset_t * set);
+bool sched_cpu_isolated(int cpu);
+bool sched_proc_allowed(struct proc_struct *proc, int cpu);
+bool sched_can_migrate(struct proc_struct *proc, struct run_queue *rq,
+		       int cpu);
+#ifdef UCONFIG_CPUCG
+void sched_unthrottle(struct proc_struct *proc);
+#endif
+#ifdef UCONFIG_PREEMPT
+/* the kernel may switch away from current on the way out of an interrupt,
+ * or when it turns interrupts back on, unless preempt_count says it is in
+ * a critical section: spinlocks and per-cpu data disable preemption */
+void preempt_disable(void);
+void preempt_enable(void);
+void preempt_check_resched(void);
+void preempt_schedule_irq(void);
+#else
+#define preempt_disable()           do { } while (0)
+#define preempt_enable()            do { } while (0)
+#define preempt_check_resched()     do { } while (0)
+#endif
+/* the most a process may let its timers be late by, see do_timerslack */
+#define TIMER_SLACK_MAX             256
+/* a timer that run_timer_list frees after firing, for linux timers */
+timer_t *timer_alloc(void);
 void add_timer(timer_t * timer);
 void del_timer(timer_t * timer);
+void del_timer_sync(timer_t * timer);
+unsigned int timer_remaining(timer_t * timer);
 void run_timer_list(void);
+#ifdef UCONFIG_NO_HZ_IDLE
+unsigned int timer_nohz_enter(void);
+void timer_nohz_exit(unsigned int nticks);
+/* provided by the arch, wake a cpu up from tickless idle */
+void tick_nohz_kick(int cpu);
+#endif
+struct run_queue *rq_find_busiest(struct run_queue *rq);
 
 #endif /* !__KERN_SCHEDULE_SCHED_H__ */
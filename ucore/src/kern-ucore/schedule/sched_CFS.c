@@ -0,0 +1,177 @@
+#include <types.h>
+#include <list.h>
+#include <proc.h>
+#include <assert.h>
+#include <rb_inline.h>
+#include <runqueue.h>
+#include <sched_CFS.h>
+#include <cpucg.h>
+
+/* *
+ * A completely fair scheduler in the spirit of Linux CFS. Every proc
+ * accumulates a virtual runtime, its real runtime scaled by the weight
+ * of its nice value, and the proc with the smallest vruntime runs next.
+ * The runnable procs of a run queue are kept in an rb tree ordered by
+ * vruntime; they are linked in rq->run_list as well, so the generic code
+ * can still tell whether a proc is queued.
+ *
+ * vruntime is counted in 1/CFS_NICE_0_LOAD ticks of a nice 0 proc. Each
+ * queued proc gets a share of the scheduling period (rq->max_time_slice
+ * ticks) proportional to its weight.
+ * */
+
+#define CFS_NICE_0_LOAD             1024
+
+/* the time a sleeper may lag behind min_vruntime when it wakes up */
+#define CFS_SLEEPER_CREDIT          (CFS_NICE_0_LOAD * 2)
+
+/* nice -20 .. 19 to weight, every nice level is worth ~10% cpu (as Linux) */
+static const unsigned long cfs_prio_to_weight[40] = {
+	/* -20 */ 88761, 71755, 56483, 46273, 36291,
+	/* -15 */ 29154, 23254, 18705, 14949, 11916,
+	/* -10 */ 9548, 7620, 6100, 4904, 3906,
+	/*  -5 */ 3121, 2501, 1991, 1586, 1277,
+	/*   0 */ 1024, 820, 655, 526, 423,
+	/*   5 */ 335, 272, 215, 172, 137,
+	/*  10 */ 110, 87, 70, 56, 45,
+	/*  15 */ 36, 29, 23, 18, 15,
+};
+
+static inline unsigned long cfs_weight(struct proc_struct *proc)
+{
+	return cfs_prio_to_weight[proc->nice - PROC_NICE_MIN];
+}
+
+#define cfs_less(p1, p2)            ((p1)->vruntime < (p2)->vruntime)
+
+RB_INLINE_GENERATE(cfs_rb, struct proc_struct, cfs_node, cfs_less,
+		   RBI_NO_AUGMENT);
+
+// cfs_leftmost - the proc of the smallest vruntime, kept by the tree
+static struct proc_struct *cfs_leftmost(struct run_queue *rq)
+{
+	struct rbi_node *node = rbi_first(&(rq->cfs_tree));
+	return (node != NULL) ? le2proc_cfs(node) : NULL;
+}
+
+static void CFS_init(struct run_queue *rq)
+{
+	list_init(&(rq->run_list));
+	rq->proc_num = 0;
+	rq->min_vruntime = 0;
+	rq->load_weight = 0;
+	rbi_root_init(&(rq->cfs_tree));
+}
+
+static void CFS_enqueue(struct run_queue *rq, struct proc_struct *proc)
+{
+	assert(list_empty(&(proc->run_link)));
+	/* don't let a long sleeper monopolize the cpu when it comes back */
+	if (proc->vruntime + CFS_SLEEPER_CREDIT < rq->min_vruntime) {
+		proc->vruntime = rq->min_vruntime - CFS_SLEEPER_CREDIT;
+	}
+	list_add_before(&(rq->run_list), &(proc->run_link));
+	cfs_rb_insert(&(rq->cfs_tree), proc);
+	proc->rq = rq;
+	rq->proc_num++;
+	rq->load_weight += cfs_weight(proc);
+}
+
+static void CFS_dequeue(struct run_queue *rq, struct proc_struct *proc)
+{
+	assert(!list_empty(&(proc->run_link)) && proc->rq == rq);
+	list_del_init(&(proc->run_link));
+	cfs_rb_remove(&(rq->cfs_tree), proc);
+	rq->proc_num--;
+	rq->load_weight -= cfs_weight(proc);
+}
+
+static struct proc_struct *CFS_pick_next(struct run_queue *rq)
+{
+	struct proc_struct *proc = cfs_leftmost(rq);
+	if (proc != NULL) {
+		/* its share of the period, the queue includes itself */
+		unsigned long weight = cfs_weight(proc);
+		proc->time_slice = rq->max_time_slice * weight / rq->load_weight;
+		if (proc->time_slice < 1) {
+			proc->time_slice = 1;
+		}
+		if (rq->min_vruntime < proc->vruntime) {
+			rq->min_vruntime = proc->vruntime;
+		}
+	}
+	return proc;
+}
+
+static void CFS_proc_tick(struct run_queue *rq, struct proc_struct *proc)
+{
+	/* the shares of its cpu group weight it as well, see cpucg.c */
+	unsigned long weight = cpucg_weight(proc->cpucg, cfs_weight(proc));
+	proc->vruntime += CFS_NICE_0_LOAD * CFS_NICE_0_LOAD / weight;
+	if (proc->time_slice > 0) {
+		proc->time_slice--;
+	}
+	if (proc->time_slice == 0) {
+		proc->need_resched = 1;
+	}
+}
+
+// CFS_get_proc - take at most max migratable procs, the ones with the
+//              - largest vruntime first, their vruntime is made relative
+//              - to the min_vruntime of rq
+static int
+CFS_get_proc(struct run_queue *rq, struct proc_struct *procs_moved[], int max)
+{
+	int num = 0;
+	struct rbi_node *node = rbi_last(&(rq->cfs_tree));
+	while (num < max && node != NULL) {
+		struct proc_struct *proc = le2proc_cfs(node);
+		node = rbi_prev(node);
+		if (!sched_can_migrate(proc, rq, myid())) {
+			continue;
+		}
+		CFS_dequeue(rq, proc);
+		if (proc->vruntime > rq->min_vruntime) {
+			proc->vruntime -= rq->min_vruntime;
+		} else {
+			proc->vruntime = 0;
+		}
+		procs_moved[num++] = proc;
+	}
+	return num;
+}
+
+// CFS_load_balance - pull half of the imbalance from the busiest run queue
+static void CFS_load_balance(struct run_queue *rq)
+{
+	struct run_queue *busiest = rq_find_busiest(rq);
+	if (busiest == NULL) {
+		return;
+	}
+	struct proc_struct *procs_moved[SCHED_MAX_MOVE_PROC];
+	int i, num = 0;
+	double_rq_lock_balance(rq, busiest);
+	if (busiest->proc_num > rq->proc_num + 1) {
+		int max = (busiest->proc_num - rq->proc_num) / 2;
+		if (max > SCHED_MAX_MOVE_PROC) {
+			max = SCHED_MAX_MOVE_PROC;
+		}
+		num = CFS_get_proc(busiest, procs_moved, max);
+	}
+	for (i = 0; i < num; i++) {
+		procs_moved[i]->vruntime += rq->min_vruntime;
+		CFS_enqueue(rq, procs_moved[i]);
+	}
+	rq_unlock(busiest);
+}
+
+struct sched_class CFS_sched_class = {
+	.name = "CFS_scheduler",
+	.init = CFS_init,
+	.enqueue = CFS_enqueue,
+	.dequeue = CFS_dequeue,
+	.pick_next = CFS_pick_next,
+	.proc_tick = CFS_proc_tick,
+	.load_balance = CFS_load_balance,
+	.get_proc = CFS_get_proc,
+};
@@ -3,56 +3,130 @@
 #include <proc.h>
 #include <assert.h>
 #include <sched.h>
-#include <sched_RR.h>
+#include <runqueue.h>
 #include <sched_MLFQ.h>
 
-static struct sched_class *sched_class;
+/* *
+ * Multi-level feedback queue: every run queue has MLFQ_NR_LEVELS queues of
+ * its own, the first picked first. A new proc starts in the first level, a
+ * proc that used up its time slice goes down a level, and the time slice
+ * doubles with each level down. The balancing moves procs between the same
+ * levels of two run queues, the lowest ones first.
+ * */
+
+static inline int MLFQ_time_slice(struct run_queue *rq, int level)
+{
+	return rq->max_time_slice << level;
+}
 
 static void MLFQ_init(struct run_queue *rq)
 {
-	sched_class = &RR_sched_class;
-	list_entry_t *list = &(rq->rq_link), *le = list;
-	do {
-		sched_class->init(le2rq(le, rq_link));
-		le = list_next(le);
-	} while (le != list);
+	int i;
+	list_init(&(rq->run_list));
+	for (i = 0; i < MLFQ_NR_LEVELS; i++) {
+		list_init(rq->mlfq_queue + i);
+	}
+	rq->proc_num = 0;
+}
+
+// __MLFQ_enqueue - queue proc in its level of rq, with a time slice of the
+//                - level if it has none left
+static void __MLFQ_enqueue(struct run_queue *rq, struct proc_struct *proc)
+{
+	int slice = MLFQ_time_slice(rq, proc->mlfq_level);
+	list_add_before(rq->mlfq_queue + proc->mlfq_level, &(proc->run_link));
+	if (proc->time_slice == 0 || proc->time_slice > slice) {
+		proc->time_slice = slice;
+	}
+	proc->rq = rq;
+	rq->proc_num++;
 }
 
 static void MLFQ_enqueue(struct run_queue *rq, struct proc_struct *proc)
 {
 	assert(list_empty(&(proc->run_link)));
-	struct run_queue *nrq = rq;
-	if (proc->rq != NULL && proc->time_slice == 0) {
-		nrq = le2rq(list_next(&(proc->rq->rq_link)), rq_link);
-		if (nrq == rq) {
-			nrq = proc->rq;
-		}
+	if (proc->rq == NULL) {
+		/* never queued yet */
+		proc->mlfq_level = 0;
+	} else if (proc->time_slice == 0
+		   && proc->mlfq_level < MLFQ_NR_LEVELS - 1) {
+		/* used up its time slice */
+		proc->mlfq_level++;
 	}
-	sched_class->enqueue(nrq, proc);
+	__MLFQ_enqueue(rq, proc);
 }
 
 static void MLFQ_dequeue(struct run_queue *rq, struct proc_struct *proc)
 {
-	assert(!list_empty(&(proc->run_link)));
-	sched_class->dequeue(proc->rq, proc);
+	assert(!list_empty(&(proc->run_link)) && proc->rq == rq);
+	list_del_init(&(proc->run_link));
+	rq->proc_num--;
 }
 
 static struct proc_struct *MLFQ_pick_next(struct run_queue *rq)
 {
-	struct proc_struct *next;
-	list_entry_t *list = &(rq->rq_link), *le = list;
-	do {
-		if ((next = sched_class->pick_next(le2rq(le, rq_link))) != NULL) {
-			break;
+	int i;
+	for (i = 0; i < MLFQ_NR_LEVELS; i++) {
+		list_entry_t *le = list_next(rq->mlfq_queue + i);
+		if (le != rq->mlfq_queue + i) {
+			return le2proc(le, run_link);
 		}
-		le = list_next(le);
-	} while (le != list);
-	return next;
+	}
+	return NULL;
 }
 
 static void MLFQ_proc_tick(struct run_queue *rq, struct proc_struct *proc)
 {
-	sched_class->proc_tick(proc->rq, proc);
+	if (proc->time_slice > 0) {
+		proc->time_slice--;
+	}
+	if (proc->time_slice == 0) {
+		proc->need_resched = 1;
+	}
+}
+
+// MLFQ_get_proc - take at most max migratable procs from rq, from the tail
+//               - of the last level up, each keeps its level
+static int
+MLFQ_get_proc(struct run_queue *rq, struct proc_struct *procs_moved[], int max)
+{
+	int i, num = 0;
+	for (i = MLFQ_NR_LEVELS - 1; i >= 0 && num < max; i--) {
+		list_entry_t *list = rq->mlfq_queue + i, *le = list_prev(list);
+		while (num < max && le != list) {
+			struct proc_struct *proc = le2proc(le, run_link);
+			le = list_prev(le);
+			if (!sched_can_migrate(proc, rq, myid())) {
+				continue;
+			}
+			MLFQ_dequeue(rq, proc);
+			procs_moved[num++] = proc;
+		}
+	}
+	return num;
+}
+
+// MLFQ_load_balance - pull half of the imbalance from the busiest run queue
+static void MLFQ_load_balance(struct run_queue *rq)
+{
+	struct run_queue *busiest = rq_find_busiest(rq);
+	if (busiest == NULL) {
+		return;
+	}
+	struct proc_struct *procs_moved[SCHED_MAX_MOVE_PROC];
+	int i, num = 0;
+	double_rq_lock_balance(rq, busiest);
+	if (busiest->proc_num > rq->proc_num + 1) {
+		int max = (busiest->proc_num - rq->proc_num) / 2;
+		if (max > SCHED_MAX_MOVE_PROC) {
+			max = SCHED_MAX_MOVE_PROC;
+		}
+		num = MLFQ_get_proc(busiest, procs_moved, max);
+	}
+	for (i = 0; i < num; i++) {
+		__MLFQ_enqueue(rq, procs_moved[i]);
+	}
+	rq_unlock(busiest);
 }
 
 struct sched_class MLFQ_sched_class = {
@@ -62,4 +136,6 @@ struct sched_class MLFQ_sched_class = {
 	.dequeue = MLFQ_dequeue,
 	.pick_next = MLFQ_pick_next,
 	.proc_tick = MLFQ_proc_tick,
+	.load_balance = MLFQ_load_balance,
+	.get_proc = MLFQ_get_proc,
 };
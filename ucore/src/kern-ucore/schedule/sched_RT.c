@@ -0,0 +1,115 @@
+#include <types.h>
+#include <list.h>
+#include <string.h>
+#include <proc.h>
+#include <assert.h>
+#include <runqueue.h>
+#include <sched_RT.h>
+
+/*
+ * The realtime class keeps a list of procs per priority in each run queue,
+ * and a bitmap of the non-empty lists, so that pick_next takes the first
+ * proc of the highest priority in O(1). The procs are not migrated by load
+ * balancing, sched_class_select_rq places them on a cpu they can run on
+ * right away when woken.
+ */
+
+// fls32 - the index of the highest bit set in x, which is not 0
+static inline int fls32(uint32_t x)
+{
+	int n = 0;
+	if (x & 0xFFFF0000) {
+		n += 16, x >>= 16;
+	}
+	if (x & 0xFF00) {
+		n += 8, x >>= 8;
+	}
+	if (x & 0xF0) {
+		n += 4, x >>= 4;
+	}
+	if (x & 0xC) {
+		n += 2, x >>= 2;
+	}
+	if (x & 0x2) {
+		n += 1;
+	}
+	return n;
+}
+
+static void RT_init(struct run_queue *rq)
+{
+	int i;
+	for (i = 0; i <= SCHED_RT_PRIO_MAX; i++) {
+		list_init(rq->rt_queue + i);
+	}
+	memset(rq->rt_bitmap, 0, sizeof(rq->rt_bitmap));
+	rq->rt_num = 0;
+}
+
+// RT_enqueue - a proc goes to the tail of its priority, unless it is
+//            - current preempted by a more urgent one: it goes on first then.
+//            - Its time_slice is 0 if it used it up or yielded.
+static void RT_enqueue(struct run_queue *rq, struct proc_struct *proc)
+{
+	assert(list_empty(&(proc->run_link)) && proc->policy != SCHED_NORMAL);
+	int prio = proc->rt_priority;
+	list_entry_t *queue = rq->rt_queue + prio;
+	if (proc == current && proc->time_slice != 0) {
+		list_add_after(queue, &(proc->run_link));
+	} else {
+		list_add_before(queue, &(proc->run_link));
+		proc->time_slice = SCHED_RT_TIME_SLICE;
+	}
+	rq->rt_bitmap[prio / 32] |= (1 << (prio % 32));
+	proc->rq = rq;
+	rq->rt_num++;
+}
+
+static void RT_dequeue(struct run_queue *rq, struct proc_struct *proc)
+{
+	assert(!list_empty(&(proc->run_link)) && proc->rq == rq);
+	int prio = proc->rt_priority;
+	list_del_init(&(proc->run_link));
+	if (list_empty(rq->rt_queue + prio)) {
+		rq->rt_bitmap[prio / 32] &= ~(1 << (prio % 32));
+	}
+	rq->rt_num--;
+}
+
+static struct proc_struct *RT_pick_next(struct run_queue *rq)
+{
+	int i = sizeof(rq->rt_bitmap) / sizeof(rq->rt_bitmap[0]);
+	while (--i >= 0) {
+		if (rq->rt_bitmap[i] != 0) {
+			int prio = i * 32 + fls32(rq->rt_bitmap[i]);
+			list_entry_t *le = list_next(rq->rt_queue + prio);
+			assert(le != rq->rt_queue + prio);
+			return le2proc(le, run_link);
+		}
+	}
+	return NULL;
+}
+
+// RT_proc_tick - a SCHED_FIFO proc runs as long as it likes, a SCHED_RR
+//              - one gives way to its equals once its slice is used up
+static void RT_proc_tick(struct run_queue *rq, struct proc_struct *proc)
+{
+	if (proc->policy != SCHED_RR) {
+		return;
+	}
+	if (proc->time_slice > 0) {
+		proc->time_slice--;
+	}
+	if (proc->time_slice == 0) {
+		proc->need_resched = 1;
+	}
+}
+
+struct sched_class RT_sched_class = {
+	.name = "RT_scheduler",
+	.init = RT_init,
+	.enqueue = RT_enqueue,
+	.dequeue = RT_dequeue,
+	.pick_next = RT_pick_next,
+	.proc_tick = RT_proc_tick,
+};
@@ -0,0 +1,20 @@
+#ifndef __KERN_SCHEDULE_SCHED_RT_H__
+#define __KERN_SCHEDULE_SCHED_RT_H__
+
+#include <sched.h>
+#include <proc.h>
+
+/* ticks a SCHED_RR proc runs before the next one of its priority */
+#define SCHED_RT_TIME_SLICE         10
+
+extern struct sched_class RT_sched_class;
+
+// RT_preempts - whether the realtime proc should run instead of curr
+static inline bool RT_preempts(struct proc_struct *proc,
+			       struct proc_struct *curr)
+{
+	return curr->policy == SCHED_NORMAL
+	    || proc->rt_priority > curr->rt_priority;
+}
+
+#endif /* !__KERN_SCHEDULE_SCHED_RT_H__ */
@@ -2,6 +2,7 @@
 #include <list.h>
 #include <proc.h>
 #include <assert.h>
+#include <runqueue.h>
 #include <sched_mpRR.h>
 
 static void MPRR_init(struct run_queue *rq)
@@ -47,6 +48,47 @@ static void MPRR_proc_tick(struct run_queue *rq, struct proc_struct *proc)
 	}
 }
 
+// MPRR_get_proc - take at most max migratable procs from the tail of rq
+static int
+MPRR_get_proc(struct run_queue *rq, struct proc_struct *procs_moved[], int max)
+{
+	int num = 0;
+	list_entry_t *le = list_prev(&(rq->run_list));
+	while (num < max && le != &(rq->run_list)) {
+		struct proc_struct *proc = le2proc(le, run_link);
+		le = list_prev(le);
+		if (!sched_can_migrate(proc, rq, myid())) {
+			continue;
+		}
+		MPRR_dequeue(rq, proc);
+		procs_moved[num++] = proc;
+	}
+	return num;
+}
+
+// MPRR_load_balance - pull half of the imbalance from the busiest run queue
+static void MPRR_load_balance(struct run_queue *rq)
+{
+	struct run_queue *busiest = rq_find_busiest(rq);
+	if (busiest == NULL) {
+		return;
+	}
+	struct proc_struct *procs_moved[SCHED_MAX_MOVE_PROC];
+	int i, num = 0;
+	double_rq_lock_balance(rq, busiest);
+	if (busiest->proc_num > rq->proc_num + 1) {
+		int max = (busiest->proc_num - rq->proc_num) / 2;
+		if (max > SCHED_MAX_MOVE_PROC) {
+			max = SCHED_MAX_MOVE_PROC;
+		}
+		num = MPRR_get_proc(busiest, procs_moved, max);
+	}
+	for (i = 0; i < num; i++) {
+		MPRR_enqueue(rq, procs_moved[i]);
+	}
+	rq_unlock(busiest);
+}
+
 struct sched_class MPRR_sched_class = {
 	.name = "MPRR_scheduler",
 	.init = MPRR_init,
@@ -54,4 +96,6 @@ struct sched_class MPRR_sched_class = {
 	.dequeue = MPRR_dequeue,
 	.pick_next = MPRR_pick_next,
 	.proc_tick = MPRR_proc_tick,
+	.load_balance = MPRR_load_balance,
+	.get_proc = MPRR_get_proc,
 };
@@ -0,0 +1,20 @@
+#ifndef __KERN_SCHEDULE_SCHEDSTAT_H__
+#define __KERN_SCHEDULE_SCHEDSTAT_H__
+
+#include <types.h>
+#include <loghist.h>
+
+/* *
+ * Latency histograms of the scheduler, kept with UCONFIG_SCHEDSTATS, see
+ * loghist.h for the buckets.
+ *
+ * A proc and a cpu keep the same two: wait, from the enqueue of a proc
+ * (its wakeup, or its preemption) until it runs, and run, from then until
+ * it is switched away. A cpu also keeps idle, the runs of its idle proc.
+ * */
+struct sched_stat {
+	struct log2_hist wait;
+	struct log2_hist run;
+};
+
+#endif /* !__KERN_SCHEDULE_SCHEDSTAT_H__ */
@@ -0,0 +1,199 @@
+#include <types.h>
+#include <atomic.h>
+#include <sync.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <trap.h>
+#include <proc.h>
+#include <assert.h>
+#include <softirq.h>
+
+/* *
+ * The softirqs raised on a cpu are run by the irq_exit of the outermost
+ * interrupt it takes, before it goes back to what was interrupted. They
+ * run with interrupts enabled, so an interrupt coming meanwhile only
+ * raises more, which the loop of __do_softirq picks up; after
+ * MAX_SOFTIRQ_RESTART rounds the rest waits for the next irq_exit, so that
+ * a storm cannot keep the cpu from the procs. A softirq raised outside an
+ * interrupt runs at the next one, a tick at the latest, or at do_softirq.
+ * */
+#define MAX_SOFTIRQ_RESTART         10
+
+struct softirq_cpu {
+	uint32_t pending;	// the softirqs raised, a bit each
+	bool active;		// running them, see __do_softirq
+	struct tasklet *tasklets;	// scheduled here, oldest first
+	struct tasklet **tasklet_tail;
+};
+
+static DEFINE_PERCPU_NOINIT(struct softirq_cpu, softirq_cpus);
+static void (*softirq_vec[NR_SOFTIRQS]) (void);
+
+static void tasklet_action(void);
+
+void softirq_init(void)
+{
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct softirq_cpu *sc = per_cpu_ptr(softirq_cpus, i);
+		sc->pending = 0;
+		sc->active = 0;
+		sc->tasklets = NULL;
+		sc->tasklet_tail = &(sc->tasklets);
+	}
+	open_softirq(TASKLET_SOFTIRQ, tasklet_action);
+}
+
+void open_softirq(int nr, void (*action) (void))
+{
+	assert(nr >= 0 && nr < NR_SOFTIRQS && softirq_vec[nr] == NULL);
+	softirq_vec[nr] = action;
+}
+
+// raise_softirq - have softirq nr run on this cpu, at the next irq_exit
+void raise_softirq(int nr)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	get_cpu_ptr(softirq_cpus)->pending |= (1 << nr);
+	local_intr_restore(intr_flag);
+}
+
+bool in_softirq(void)
+{
+	return get_cpu_ptr(softirq_cpus)->active;
+}
+
+// __do_softirq - run the softirqs pending on this cpu, called with
+//              - interrupts disabled
+static void __do_softirq(struct softirq_cpu *sc)
+{
+	int restart = MAX_SOFTIRQ_RESTART, nr;
+	uint32_t pending;
+	sc->active = 1;
+#ifdef UCONFIG_PREEMPT
+	/* the interrupts taken meanwhile must not switch away from here */
+	if (current != NULL) {
+		current->preempt_count++;
+	}
+#endif
+	while ((pending = sc->pending) != 0 && restart-- > 0) {
+		sc->pending = 0;
+		intr_enable();
+		for (nr = 0; pending != 0; nr++, pending >>= 1) {
+			if ((pending & 1) && softirq_vec[nr] != NULL) {
+				softirq_vec[nr] ();
+			}
+		}
+		intr_disable();
+	}
+#ifdef UCONFIG_PREEMPT
+	/* the way out of the interrupt reschedules if needed */
+	if (current != NULL) {
+		current->preempt_count--;
+	}
+#endif
+	sc->active = 0;
+}
+
+// irq_exit - an interrupt is done, called by the arch once it has left the
+//          - nesting of the interrupt, with interrupts disabled
+void irq_exit(void)
+{
+	struct softirq_cpu *sc = get_cpu_ptr(softirq_cpus);
+	if (sc->pending != 0 && !sc->active && !ucore_in_interrupt()) {
+		__do_softirq(sc);
+	}
+}
+
+// do_softirq - run the softirqs pending on this cpu now, for a proc that
+//            - raised them outside an interrupt and cannot wait for the
+//            - next one
+void do_softirq(void)
+{
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		struct softirq_cpu *sc = get_cpu_ptr(softirq_cpus);
+		if (sc->pending != 0 && !sc->active && !ucore_in_interrupt()) {
+			__do_softirq(sc);
+		}
+	}
+	local_intr_restore(intr_flag);
+}
+
+void tasklet_init(struct tasklet *t, void (*func) (unsigned long),
+		  unsigned long data)
+{
+	t->next = NULL;
+	t->state = 0;
+	t->func = func;
+	t->data = data;
+}
+
+static void __tasklet_queue(struct tasklet *t)
+{
+	struct softirq_cpu *sc = get_cpu_ptr(softirq_cpus);
+	t->next = NULL;
+	*(sc->tasklet_tail) = t;
+	sc->tasklet_tail = &(t->next);
+	sc->pending |= (1 << TASKLET_SOFTIRQ);
+}
+
+// tasklet_schedule - have t run in the softirq of this cpu, unless it is
+//                  - pending already
+void tasklet_schedule(struct tasklet *t)
+{
+	bool intr_flag;
+	if (test_and_set_bit(TASKLET_STATE_SCHED, &(t->state))) {
+		return;
+	}
+	local_intr_save(intr_flag);
+	__tasklet_queue(t);
+	local_intr_restore(intr_flag);
+}
+
+static void tasklet_action(void)
+{
+	struct tasklet *list;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		struct softirq_cpu *sc = get_cpu_ptr(softirq_cpus);
+		list = sc->tasklets;
+		sc->tasklets = NULL;
+		sc->tasklet_tail = &(sc->tasklets);
+	}
+	local_intr_restore(intr_flag);
+
+	while (list != NULL) {
+		struct tasklet *t = list;
+		list = list->next;
+		if (test_and_set_bit(TASKLET_STATE_RUN, &(t->state))) {
+			/* still running on another cpu, try again later */
+			local_intr_save(intr_flag);
+			__tasklet_queue(t);
+			local_intr_restore(intr_flag);
+			continue;
+		}
+		/* it may schedule itself again from here */
+		clear_bit(TASKLET_STATE_SCHED, &(t->state));
+		t->func(t->data);
+		clear_bit(TASKLET_STATE_RUN, &(t->state));
+	}
+}
+
+// tasklet_kill - wait until t is neither pending nor running, for it to be
+//              - freed; whoever schedules it must have stopped by then
+void tasklet_kill(struct tasklet *t)
+{
+	assert(!ucore_in_interrupt() && !in_softirq());
+	while (test_and_set_bit(TASKLET_STATE_SCHED, &(t->state))) {
+		do_sleep(1);
+	}
+	while (test_bit(TASKLET_STATE_RUN, &(t->state))) {
+		do_sleep(1);
+	}
+	clear_bit(TASKLET_STATE_SCHED, &(t->state));
+}
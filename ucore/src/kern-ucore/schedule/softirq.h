@@ -0,0 +1,47 @@
+#ifndef __KERN_SCHEDULE_SOFTIRQ_H__
+#define __KERN_SCHEDULE_SOFTIRQ_H__
+
+#include <types.h>
+
+/* *
+ * Softirqs: the part of the work of an interrupt which need not be done
+ * with interrupts disabled. A handler raises one, and it runs on the same
+ * cpu at irq_exit, with interrupts enabled but not preempted. A softirq
+ * action may not sleep; what has to sleep goes to a workqueue instead,
+ * see workqueue.h.
+ * */
+enum {
+	TIMER_SOFTIRQ,		// the timers of the wheel due, see run_timer_list
+	TASKLET_SOFTIRQ,
+	RCU_SOFTIRQ,		// the rcu callbacks due, see rcu_tick
+	NR_SOFTIRQS
+};
+
+void softirq_init(void);
+void open_softirq(int nr, void (*action) (void));
+void raise_softirq(int nr);
+void irq_exit(void);
+void do_softirq(void);
+bool in_softirq(void);
+
+/* *
+ * tasklet - a function a driver defers from its interrupt to the softirq
+ * of the cpu that schedules it; the same tasklet never runs on two cpus
+ * at once, and one scheduled again while pending runs once.
+ * */
+struct tasklet {
+	struct tasklet *next;
+	uint32_t state;		// TASKLET_STATE_xxx bits
+	void (*func) (unsigned long data);
+	unsigned long data;
+};
+
+#define TASKLET_STATE_SCHED         0	// pending on a cpu
+#define TASKLET_STATE_RUN           1	// running
+
+void tasklet_init(struct tasklet *t, void (*func) (unsigned long),
+		  unsigned long data);
+void tasklet_schedule(struct tasklet *t);
+void tasklet_kill(struct tasklet *t);
+
+#endif /* !__KERN_SCHEDULE_SOFTIRQ_H__ */
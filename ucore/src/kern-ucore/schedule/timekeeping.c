@@ -0,0 +1,221 @@
+#include <types.h>
+#include <list.h>
+#include <arch.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <seqlock.h>
+#include <clock.h>
+#include <sched.h>
+#include <stdio.h>
+#include <kio.h>
+#include <assert.h>
+#include <vvar.h>
+#include <vdso.h>
+#include <timekeeping.h>
+
+/*
+ * The monotonic clock counts the ns since boot by the clocksource of the
+ * highest rating, jiffies (the clock tick) until a better one registers:
+ *
+ *     mono = mono_base + cyc2ns(cs->read() - cycle_base)
+ *
+ * rebased only when the clocksource changes, so no fraction is lost.
+ *
+ * The realtime clock is the monotonic one plus real_offset, stepped by
+ * timekeeping_settime. timekeeping_adjtime slews it instead, running it
+ * SLEW_RATE_PPM faster or slower from slew_mono on until slew_left is
+ * made up, so that it neither jumps nor goes back. Each tick folds the
+ * slew done into real_offset.
+ *
+ * The readers go by the seqcount of tk_lock. The writers, the tick of
+ * cpu 0 and the syscalls, are serialized by its spinlock, under which
+ * they also publish the clocks to the vvar page.
+ */
+
+static struct timekeeper {
+	struct clocksource *cs;
+	uint64_t cycle_base;
+	uint64_t mono_base;
+	int64_t real_offset;
+	int64_t slew_left;
+	uint64_t slew_mono;
+} tk;
+
+static seqlock_t tk_lock;
+static list_entry_t clocksource_list;
+
+static uint64_t jiffies_read(void)
+{
+	return ticks;
+}
+
+static struct clocksource clocksource_jiffies = {
+	.name = "jiffies",
+	.rating = 1,
+	.freq = TIMER_HZ,
+	.user_tsc = 0,
+	.read = jiffies_read,
+};
+
+// clocksource_cyc2ns - the ns of cycles counts of cs, without overflowing
+uint64_t clocksource_cyc2ns(struct clocksource *cs, uint64_t cycles)
+{
+	uint64_t sec = cycles, nsec;
+	nsec = do_div(sec, cs->freq);
+	nsec *= NSEC_PER_SEC;
+	do_div(nsec, cs->freq);
+	return sec * NSEC_PER_SEC + nsec;
+}
+
+static inline uint64_t tk_mono(void)
+{
+	return tk.mono_base +
+	    clocksource_cyc2ns(tk.cs, tk.cs->read() - tk.cycle_base);
+}
+
+// tk_slew - the slew done by mono, see above
+static inline int64_t tk_slew(uint64_t mono)
+{
+	if (tk.slew_left == 0) {
+		return 0;
+	}
+	uint64_t left = (tk.slew_left < 0) ? -tk.slew_left : tk.slew_left;
+	uint64_t done = (mono - tk.slew_mono) * SLEW_RATE_PPM;
+	do_div(done, 1000000);
+	if (done > left) {
+		done = left;
+	}
+	return (tk.slew_left < 0) ? -(int64_t) done : (int64_t) done;
+}
+
+static inline void tk_write_begin(bool * intr_flag)
+{
+	write_seqlock_irqsave(&tk_lock, *intr_flag);
+}
+
+static inline void tk_write_end(bool intr_flag)
+{
+	vdso_update();
+	write_sequnlock_irqrestore(&tk_lock, intr_flag);
+}
+
+static inline uint32_t tk_read_begin(void)
+{
+	return read_seqbegin(&tk_lock);
+}
+
+static inline bool tk_read_retry(uint32_t seq)
+{
+	return read_seqretry(&tk_lock, seq);
+}
+
+// tk_fold - fold the slew done by mono into real_offset
+static void tk_fold(uint64_t mono)
+{
+	int64_t done = tk_slew(mono);
+	tk.real_offset += done;
+	tk.slew_left -= done;
+	tk.slew_mono = mono;
+}
+
+void timekeeping_init(void)
+{
+	seqlock_init(&tk_lock);
+	list_init(&clocksource_list);
+	tk.cs = &clocksource_jiffies;
+	tk.cycle_base = tk.cs->read();
+	tk.mono_base = clocksource_cyc2ns(tk.cs, tk.cycle_base);
+	list_add(&clocksource_list, &(clocksource_jiffies.link));
+}
+
+// clocksource_register - add cs, which keeps the time if the best rated
+void clocksource_register(struct clocksource *cs)
+{
+	bool intr_flag;
+	assert(cs->freq != 0);
+	tk_write_begin(&intr_flag);
+	list_add(&clocksource_list, &(cs->link));
+	if (cs->rating > tk.cs->rating) {
+		uint64_t mono = tk_mono();
+		tk_fold(mono);
+		tk.cs = cs;
+		tk.cycle_base = cs->read();
+		tk.mono_base = mono;
+	}
+	tk_write_end(intr_flag);
+	kprintf("clocksource %s: %llu Hz, rating %d\n", cs->name, cs->freq,
+		cs->rating);
+}
+
+// timekeeping_tick - called on each clock tick of cpu 0
+void timekeeping_tick(void)
+{
+	bool intr_flag;
+	tk_write_begin(&intr_flag);
+	tk_fold(tk_mono());
+	tk_write_end(intr_flag);
+}
+
+// timekeeping_snapshot - the clocks for the vvar page, called under tk_lock
+void timekeeping_snapshot(struct timekeeping_snapshot *snap)
+{
+	snap->cs = tk.cs;
+	snap->cycle_base = tk.cycle_base;
+	snap->mono_base = tk.mono_base;
+	snap->real_offset = tk.real_offset;
+	snap->slew_left = tk.slew_left;
+	snap->slew_mono = tk.slew_mono;
+}
+
+// ktime_get_ns - the monotonic clock, ns since boot
+uint64_t ktime_get_ns(void)
+{
+	uint32_t seq;
+	uint64_t mono;
+	do {
+		seq = tk_read_begin();
+		mono = tk_mono();
+	} while (tk_read_retry(seq));
+	return mono;
+}
+
+// ktime_get_real_ns - the realtime clock, ns since the epoch
+uint64_t ktime_get_real_ns(void)
+{
+	uint32_t seq;
+	uint64_t real;
+	do {
+		seq = tk_read_begin();
+		uint64_t mono = tk_mono();
+		real = mono + tk.real_offset + tk_slew(mono);
+	} while (tk_read_retry(seq));
+	return real;
+}
+
+// timekeeping_settime - step the realtime clock to real_ns
+void timekeeping_settime(uint64_t real_ns)
+{
+	bool intr_flag;
+	tk_write_begin(&intr_flag);
+	uint64_t mono = tk_mono();
+	tk.real_offset = real_ns - mono;
+	tk.slew_left = 0;
+	tk.slew_mono = mono;
+	tk_write_end(intr_flag);
+}
+
+// timekeeping_adjtime - slew the realtime clock by *delta ns if delta is
+//                     - not NULL, the slew left before in *old_delta
+void timekeeping_adjtime(const int64_t * delta, int64_t * old_delta)
+{
+	bool intr_flag;
+	tk_write_begin(&intr_flag);
+	tk_fold(tk_mono());
+	if (old_delta != NULL) {
+		*old_delta = tk.slew_left;
+	}
+	if (delta != NULL) {
+		tk.slew_left = *delta;
+	}
+	tk_write_end(intr_flag);
+}
@@ -0,0 +1,45 @@
+#ifndef __KERN_SCHEDULE_TIMEKEEPING_H__
+#define __KERN_SCHEDULE_TIMEKEEPING_H__
+
+#include <types.h>
+#include <list.h>
+
+#define NSEC_PER_SEC                1000000000ULL
+#define NSEC_PER_USEC               1000
+
+/* *
+ * clocksource - a free running counter of freq counts per second. The one
+ * of the highest rating keeps the time; user_tsc if the user library may
+ * read it by rdtsc, see vvar.h.
+ * */
+struct clocksource {
+	const char *name;
+	int rating;
+	uint64_t freq;
+	bool user_tsc;
+	uint64_t(*read) (void);
+	list_entry_t link;
+};
+
+/* the state of the clocks at an instant, for the vvar page */
+struct timekeeping_snapshot {
+	struct clocksource *cs;
+	uint64_t cycle_base;	// counts of cs at mono_base
+	uint64_t mono_base;
+	int64_t real_offset;	// realtime - monotonic, at slew_mono
+	int64_t slew_left;	// ns of slew still to do from slew_mono on
+	uint64_t slew_mono;
+};
+
+void timekeeping_init(void);
+void clocksource_register(struct clocksource *cs);
+void timekeeping_tick(void);
+void timekeeping_snapshot(struct timekeeping_snapshot *snap);
+
+uint64_t clocksource_cyc2ns(struct clocksource *cs, uint64_t cycles);
+uint64_t ktime_get_ns(void);
+uint64_t ktime_get_real_ns(void);
+void timekeeping_settime(uint64_t real_ns);
+void timekeeping_adjtime(const int64_t * delta, int64_t * old_delta);
+
+#endif /* !__KERN_SCHEDULE_TIMEKEEPING_H__ */
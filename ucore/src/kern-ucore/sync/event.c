@@ -9,11 +9,33 @@
 #include <clock.h>
 #include <event.h>
 
+/* *
+ * The sends are synchronous: the sender waits in the event box of the
+ * receiver until it takes the event. A receiver blocked in the box is not
+ * woken to be picked by the run queue some time later, the sender switches
+ * straight to it on its cpu and gives it the rest of its time slice, see
+ * schedule_to. A call is a send and then a receive of the reply from the
+ * same proc only: once the receiver takes the event of a caller it leaves
+ * the caller asleep, waiting for the reply now, so that the reply switches
+ * straight back to it. A round trip is then two switches and no pass over
+ * the run queue.
+ * */
+
 void event_box_init(event_t * event_box)
 {
+	event_box->recv_from = 0;
+	event_box->calling = 0;
 	wait_queue_init(&(event_box->wait_queue));
 }
 
+// event_recv_waits - proc is blocked in a receive current may send to
+static inline bool event_recv_waits(struct proc_struct *proc)
+{
+	return proc->wait_state == WT_EVENT_RECV
+	    && (proc->event_box.recv_from == 0
+		|| proc->event_box.recv_from == current->pid);
+}
+
 static uint32_t send_event(struct proc_struct *proc, timer_t * timer)
 {
 	bool intr_flag;
@@ -24,7 +46,13 @@ static uint32_t send_event(struct proc_struct *proc, timer_t * timer)
 	ipc_add_timer(timer);
 	local_intr_restore(intr_flag);
 
-	schedule();
+	/* queued before the receiver runs, so that it finds the event */
+	if (!event_recv_waits(proc) || !schedule_to(proc, WT_EVENT_RECV)) {
+		if (event_recv_waits(proc)) {
+			wakeup_proc(proc);
+		}
+		schedule();
+	}
 
 	local_intr_save(intr_flag);
 	ipc_del_timer(timer);
@@ -50,9 +78,6 @@ int ipc_event_send(int pid, int event, unsigned int timeout)
 	if(proc == kswapd)
 		return -E_INVAL;
 #endif
-	if (proc->wait_state == WT_EVENT_RECV) {
-		wakeup_proc(proc);
-	}
 	current->event_box.event = event;
 
 	unsigned long saved_ticks;
@@ -67,12 +92,47 @@ int ipc_event_send(int pid, int event, unsigned int timeout)
 	return ipc_check_timeout(timeout, saved_ticks);
 }
 
-static int recv_event(int *pid_store, int *event_store, timer_t * timer)
+// event_first_from - the first sender waiting in wait_queue, the first
+//                  - one of pid from unless that is 0
+static wait_t *event_first_from(wait_queue_t * wait_queue, int from)
+{
+	wait_t *wait = wait_queue_first(wait_queue);
+	while (wait != NULL && from != 0 && wait->proc->pid != from) {
+		wait = wait_queue_next(wait_queue, wait);
+	}
+	return wait;
+}
+
+// event_take - take the event of the sender waiting in wait; a caller is
+//            - not woken but left waiting for the reply
+static void event_take(wait_queue_t * wait_queue, wait_t * wait)
+{
+	struct proc_struct *proc = wait->proc;
+	if (!proc->event_box.calling) {
+		wakeup_wait(wait_queue, wait, WT_EVENT_SEND, 1);
+		return;
+	}
+	wait_queue_del(wait_queue, wait);
+	spinlock_acquire(&wait->lock);
+	wait->wakeup_flags = WT_EVENT_SEND;
+	spinlock_release(&wait->lock);
+	spinlock_acquire(&(proc->lock));
+	/* unless its timer has woken it meanwhile */
+	if (proc->state == PROC_SLEEPING && proc->wait_state == WT_EVENT_SEND) {
+		proc->wait_state = WT_EVENT_RECV;
+	}
+	spinlock_release(&(proc->lock));
+}
+
+static int recv_event(int from, int *pid_store, int *event_store,
+		      timer_t * timer)
 {
 	bool intr_flag;
 	local_intr_save(intr_flag);
 	wait_queue_t *wait_queue = &(current->event_box.wait_queue);
-	if (wait_queue_empty(wait_queue)) {
+	wait_t *wait;
+	current->event_box.recv_from = from;
+	if ((wait = event_first_from(wait_queue, from)) == NULL) {
 		current->state = PROC_SLEEPING;
 		current->wait_state = WT_EVENT_RECV;
 		ipc_add_timer(timer);
@@ -82,22 +142,26 @@ static int recv_event(int *pid_store, int *event_store, timer_t * timer)
 
 		local_intr_save(intr_flag);
 		ipc_del_timer(timer);
+		wait = event_first_from(wait_queue, from);
 	}
 
 	int ret = -1;
 
-	wait_t *wait;
-	if ((wait = wait_queue_first(wait_queue)) != NULL) {
+	if (wait != NULL) {
 		struct proc_struct *proc = wait->proc;
 		*pid_store = proc->pid, *event_store =
 		    proc->event_box.event, ret = 0;
-		wakeup_wait(wait_queue, wait, WT_EVENT_SEND, 1);
+		event_take(wait_queue, wait);
 	}
+	current->event_box.recv_from = 0;
 	local_intr_restore(intr_flag);
 	return ret;
 }
 
-int ipc_event_recv(int *pid_store, int *event_store, unsigned int timeout)
+// event_recv - receive an event, from pid from only unless that is 0,
+//            - to the user stores
+static int
+event_recv(int from, int *pid_store, int *event_store, unsigned int timeout)
 {
 	if (event_store == NULL) {
 		return -E_INVAL;
@@ -118,7 +182,7 @@ int ipc_event_recv(int *pid_store, int *event_store, unsigned int timeout)
 	    ipc_timer_init(timeout, &saved_ticks, &__timer);
 
 	int pid, event, ret;
-	if ((ret = recv_event(&pid, &event, timer)) == 0) {
+	if ((ret = recv_event(from, &pid, &event, timer)) == 0) {
 		lock_mm(mm);
 		{
 			ret = -E_INVAL;
@@ -135,3 +199,36 @@ int ipc_event_recv(int *pid_store, int *event_store, unsigned int timeout)
 	}
 	return ipc_check_timeout(timeout, saved_ticks);
 }
+
+int ipc_event_recv(int *pid_store, int *event_store, unsigned int timeout)
+{
+	return event_recv(0, pid_store, event_store, timeout);
+}
+
+// ipc_event_call - send event to pid and receive its reply in reply_store,
+//                - the timeout covering both
+int ipc_event_call(int pid, int event, int *reply_store, unsigned int timeout)
+{
+	if (reply_store == NULL
+	    || !user_mem_check(current->mm, (uintptr_t) reply_store,
+			       sizeof(int), 1)) {
+		return -E_INVAL;
+	}
+
+	unsigned long saved_ticks = ticks;
+	int ret;
+	current->event_box.recv_from = pid;
+	current->event_box.calling = 1;
+	ret = ipc_event_send(pid, event, timeout);
+	current->event_box.calling = 0;
+	current->event_box.recv_from = 0;
+	if (ret != 0) {
+		return ret;
+	}
+	if (timeout != 0) {
+		/* out of time, the reply may be there already all the same */
+		unsigned long delt = (unsigned long)(ticks - saved_ticks);
+		timeout = (delt < timeout) ? timeout - delt : 1;
+	}
+	return event_recv(pid, NULL, reply_store, timeout);
+}
@@ -6,6 +6,8 @@
 
 typedef struct {
 	int event;
+	int recv_from;		// the pid a receive waits for, 0 for any
+	bool calling;		// sending as part of ipc_event_call
 	wait_queue_t wait_queue;
 } event_t;
 
@@ -13,5 +15,6 @@ void event_box_init(event_t * event_box);
 
 int ipc_event_send(int pid, int event, unsigned int timeout);
 int ipc_event_recv(int *pid_store, int *event_store, unsigned int timeout);
+int ipc_event_call(int pid, int event, int *reply_store, unsigned int timeout);
 
 #endif /* !__KERN_SYNC_EVENT_H__ */
@@ -0,0 +1,703 @@
+#include <types.h>
+#include <list.h>
+#include <stdlib.h>
+#include <slab.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <proc.h>
+#include <sched.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <ipc.h>
+#include <clock.h>
+#include <error.h>
+#include <assert.h>
+#include <rtmutex.h>
+#include <futex.h>
+
+/*
+ * A futex is an int in user memory, the kernel only keeps the procs
+ * waiting on it. They hang in a global hash, keyed by (mm, uaddr) for a
+ * private futex, or by (page, offset) for one in a shared mapping, which
+ * the procs mapping it at different addresses agree on.
+ *
+ * A waiter checks the value of the futex under the lock of its bucket,
+ * where a waker has to get to remove it, so it can't miss a wakeup:
+ * the user changes the value before calling FUTEX_WAKE. The page is
+ * pinned for that, it can't be faulted in with the lock held.
+ *
+ * FUTEX_REQUEUE moves waiters to another futex without waking them, so
+ * that a condvar broadcast wakes a single proc, the others wait for the
+ * mutex. FUTEX_WAKE_OP updates a second futex and wakes the waiters of
+ * both in a single call.
+ *
+ * A pi futex is a lock whose value is the pid of its owner, taken and
+ * released in user space by a compare and swap when uncontended. The first
+ * proc to wait for it sets FUTEX_WAITERS, so that the unlock comes to the
+ * kernel, and gives the futex a pi state: an rt_mutex held on behalf of the
+ * owner, which the waiters queue on and so boost it. FUTEX_UNLOCK_PI hands
+ * the futex and the rt_mutex to the most urgent waiter together. The state
+ * goes away with its last waiter, FUTEX_WAITERS with it.
+ */
+
+#define FUTEX_HASH_SHIFT            8
+#define FUTEX_HASH_SIZE             (1 << FUTEX_HASH_SHIFT)
+
+struct futex_key {
+	uintptr_t base;		// the mm, or the page of a shared futex
+	uintptr_t addr;		// uaddr, or its offset in the page
+};
+
+struct futex_bucket {
+	spinlock_s lock;
+	list_entry_t chain;	// the futex_q of the waiters, oldest first
+	list_entry_t pi_states;	// the futex_pi_state of the futexes here
+};
+
+struct futex_q {
+	list_entry_t link;	// entry in the chain of bucket
+	struct futex_key key;
+	uint32_t bitset;
+	struct proc_struct *proc;
+	/* the bucket the waiter is queued in, NULL once woken */
+	struct futex_bucket *volatile bucket;
+};
+
+#define le2futexq(le, member)           \
+    to_struct((le), struct futex_q, member)
+
+struct futex_pi_state {
+	list_entry_t link;	// entry in the pi_states of bucket
+	struct futex_key key;
+	rt_mutex_t mutex;
+	int refs;		// the procs waiting, or about to, under the bucket lock
+};
+
+#define le2pistate(le, member)          \
+    to_struct((le), struct futex_pi_state, member)
+
+static struct futex_bucket futex_hash[FUTEX_HASH_SIZE];
+
+void futex_init(void)
+{
+	int i;
+	for (i = 0; i < FUTEX_HASH_SIZE; i++) {
+		spinlock_init(&(futex_hash[i].lock));
+		list_init(&(futex_hash[i].chain));
+		list_init(&(futex_hash[i].pi_states));
+	}
+}
+
+static inline struct futex_bucket *futex_bucket(struct futex_key *key)
+{
+	return futex_hash + hash32(key->base ^ key->addr, FUTEX_HASH_SHIFT);
+}
+
+static inline bool futex_match(struct futex_key *a, struct futex_key *b)
+{
+	return a->base == b->base && a->addr == b->addr;
+}
+
+// futex_get_key - the key of the futex at uaddr. With page_store, its page
+//               - is pinned writable, for the caller to access the value
+//               - through page_store and put_user_pages.
+static int
+futex_get_key(uintptr_t uaddr, bool private, struct futex_key *key,
+	      struct Page **page_store)
+{
+	struct mm_struct *mm = current->mm;
+	struct vma_struct *vma;
+	struct Page *page = NULL;
+	bool shared;
+	int ret = 0;
+
+	if (uaddr % sizeof(int) != 0) {
+		return -E_INVAL;
+	}
+	if (mm == NULL) {
+		return -E_FAULT;
+	}
+	lock_mm_shared(mm);
+	if ((vma = find_vma(mm, uaddr)) == NULL || vma->vm_start > uaddr) {
+		ret = -E_FAULT;
+		goto out;
+	}
+	shared = !private && (vma->vm_flags & VM_SHARE);
+	if ((shared || page_store != NULL)
+	    && get_user_pages(mm, uaddr, sizeof(int), 1, &page, 1) != 1) {
+		ret = -E_FAULT;
+		goto out;
+	}
+	if (shared) {
+		key->base = (uintptr_t) page, key->addr = uaddr % PGSIZE;
+	} else {
+		key->base = (uintptr_t) mm, key->addr = uaddr;
+	}
+	if (page_store != NULL) {
+		*page_store = page;
+	} else if (page != NULL) {
+		put_user_pages(&page, 1, 0);
+	}
+out:
+	unlock_mm_shared(mm);
+	return ret;
+}
+
+static inline volatile int *futex_kaddr(struct Page *page, uintptr_t uaddr)
+{
+	return (volatile int *)(page2kva(page) + uaddr % PGSIZE);
+}
+
+static void
+double_futex_lock(struct futex_bucket *hb1, struct futex_bucket *hb2,
+		  bool * intr_flag)
+{
+	local_intr_save(*intr_flag);
+	if (hb1 > hb2) {
+		struct futex_bucket *tmp = hb1;
+		hb1 = hb2, hb2 = tmp;
+	}
+	spinlock_acquire(&(hb1->lock));
+	if (hb1 != hb2) {
+		spinlock_acquire(&(hb2->lock));
+	}
+}
+
+static void
+double_futex_unlock(struct futex_bucket *hb1, struct futex_bucket *hb2,
+		    bool intr_flag)
+{
+	if (hb1 != hb2) {
+		spinlock_release(&(hb2->lock));
+	}
+	spinlock_release(&(hb1->lock));
+	local_intr_restore(intr_flag);
+}
+
+// futex_wake_q - wake the waiter of q up, with its bucket locked
+// NOTE: the waiter may return as soon as q->bucket is NULL, see
+//       futex_unqueue, so q is not touched afterwards
+static void futex_wake_q(struct futex_q *q)
+{
+	struct proc_struct *proc = q->proc;
+	list_del_init(&(q->link));
+	if (proc->state != PROC_RUNNABLE) {
+		/* not already woken by its timer or a signal */
+		wakeup_proc(proc);
+	}
+	q->bucket = NULL;
+}
+
+// futex_wake_key - wake up to nr waiters of key in hb, which is locked
+static int
+futex_wake_key(struct futex_bucket *hb, struct futex_key *key, int nr,
+	       uint32_t bitset)
+{
+	list_entry_t *le = list_next(&(hb->chain));
+	int woken = 0;
+	while (woken < nr && le != &(hb->chain)) {
+		struct futex_q *q = le2futexq(le, link);
+		le = list_next(le);
+		if (futex_match(&(q->key), key) && (q->bitset & bitset)) {
+			futex_wake_q(q);
+			woken++;
+		}
+	}
+	return woken;
+}
+
+// futex_unqueue - take q out of the bucket it is in, if a waker did not;
+//               - return whether it was still queued. A requeue may move
+//               - it meanwhile, so recheck its bucket once locked.
+static bool futex_unqueue(struct futex_q *q)
+{
+	struct futex_bucket *hb;
+	bool intr_flag;
+	while ((hb = q->bucket) != NULL) {
+		spin_lock_irqsave(&(hb->lock), intr_flag);
+		if (hb == q->bucket) {
+			list_del_init(&(q->link));
+			q->bucket = NULL;
+			spin_unlock_irqrestore(&(hb->lock), intr_flag);
+			return 1;
+		}
+		spin_unlock_irqrestore(&(hb->lock), intr_flag);
+	}
+	return 0;
+}
+
+static int
+futex_wait(uintptr_t uaddr, bool private, int val, unsigned int timeout,
+	   uint32_t bitset)
+{
+	struct futex_q q;
+	struct futex_bucket *hb;
+	struct Page *page;
+	unsigned long saved_ticks;
+	bool intr_flag;
+	int ret;
+
+	if (bitset == 0) {
+		return -E_INVAL;
+	}
+	if ((ret = futex_get_key(uaddr, private, &(q.key), &page)) != 0) {
+		return ret;
+	}
+	timer_t __timer, *timer = ipc_timer_init(timeout, &saved_ticks, &__timer);
+	q.bitset = bitset;
+	q.proc = current;
+	hb = futex_bucket(&(q.key));
+
+	spin_lock_irqsave(&(hb->lock), intr_flag);
+	if (*futex_kaddr(page, uaddr) != val) {
+		/* changed since the user looked, don't sleep on stale state */
+		spin_unlock_irqrestore(&(hb->lock), intr_flag);
+		put_user_pages(&page, 1, 0);
+		return -E_AGAIN;
+	}
+	list_add_before(&(hb->chain), &(q.link));
+	q.bucket = hb;
+	current->state = PROC_SLEEPING;
+	current->wait_state = WT_FUTEX;
+	ipc_add_timer(timer);
+	spin_unlock_irqrestore(&(hb->lock), intr_flag);
+
+	schedule();
+
+	ipc_del_timer(timer);
+	if (!futex_unqueue(&q)) {
+		ret = 0;
+	} else if ((ret = ipc_check_timeout(timeout, saved_ticks)) == -1) {
+		ret = -E_INTR;
+	}
+	put_user_pages(&page, 1, 0);
+	return ret;
+}
+
+static int futex_wake(uintptr_t uaddr, bool private, int nr, uint32_t bitset)
+{
+	struct futex_key key;
+	struct futex_bucket *hb;
+	bool intr_flag;
+	int ret;
+
+	if (bitset == 0) {
+		return -E_INVAL;
+	}
+	if ((ret = futex_get_key(uaddr, private, &key, NULL)) != 0) {
+		return ret;
+	}
+	hb = futex_bucket(&key);
+	spin_lock_irqsave(&(hb->lock), intr_flag);
+	ret = futex_wake_key(hb, &key, nr, bitset);
+	spin_unlock_irqrestore(&(hb->lock), intr_flag);
+	return ret;
+}
+
+// futex_requeue - wake nr_wake waiters of uaddr and move up to nr_requeue
+//               - of the others to uaddr2; with cmpval, only if the value
+//               - at uaddr still is *cmpval
+static int
+futex_requeue(uintptr_t uaddr, uintptr_t uaddr2, bool private, int nr_wake,
+	      int nr_requeue, int *cmpval)
+{
+	struct futex_key key1, key2;
+	struct futex_bucket *hb1, *hb2;
+	struct Page *page = NULL;
+	bool intr_flag;
+	int ret, woken = 0, requeued = 0;
+
+	if (nr_wake < 0 || nr_requeue < 0) {
+		return -E_INVAL;
+	}
+	if ((ret = futex_get_key(uaddr, private, &key1,
+				 (cmpval != NULL) ? &page : NULL)) != 0) {
+		return ret;
+	}
+	if ((ret = futex_get_key(uaddr2, private, &key2, NULL)) != 0) {
+		goto out;
+	}
+	hb1 = futex_bucket(&key1), hb2 = futex_bucket(&key2);
+
+	double_futex_lock(hb1, hb2, &intr_flag);
+	if (cmpval != NULL && *futex_kaddr(page, uaddr) != *cmpval) {
+		ret = -E_AGAIN;
+		goto out_unlock;
+	}
+	list_entry_t *le = list_next(&(hb1->chain));
+	while (le != &(hb1->chain)) {
+		struct futex_q *q = le2futexq(le, link);
+		le = list_next(le);
+		if (!futex_match(&(q->key), &key1)) {
+			continue;
+		}
+		if (woken < nr_wake) {
+			futex_wake_q(q);
+			woken++;
+		} else if (requeued < nr_requeue) {
+			list_del(&(q->link));
+			q->key = key2;
+			list_add_before(&(hb2->chain), &(q->link));
+			q->bucket = hb2;
+			requeued++;
+		} else {
+			break;
+		}
+	}
+	ret = woken + requeued;
+
+out_unlock:
+	double_futex_unlock(hb1, hb2, intr_flag);
+out:
+	if (page != NULL) {
+		put_user_pages(&page, 1, 0);
+	}
+	return ret;
+}
+
+// futex_op_sext12 - the signed 12 bits value at the bottom of x
+static inline int futex_op_sext12(uint32_t x)
+{
+	return (int)(x << 20) >> 20;
+}
+
+// futex_wake_op - apply the op of encoded_op to uaddr2, wake nr waiters of
+//               - uaddr, then nr2 of uaddr2 if its old value passes the
+//               - comparison of encoded_op
+// NOTE: the update is atomic as it is done with interrupts off, on a
+//       single cpu. The other ports get the syscall on a single cpu only.
+static int
+futex_wake_op(uintptr_t uaddr, uintptr_t uaddr2, bool private, int nr,
+	      int nr2, uint32_t encoded_op)
+{
+	struct futex_key key1, key2;
+	struct futex_bucket *hb1, *hb2;
+	struct Page *page;
+	bool intr_flag, wake2;
+	int op = (encoded_op >> 28) & 15, cmp = (encoded_op >> 24) & 15;
+	int oparg = futex_op_sext12(encoded_op >> 12);
+	int cmparg = futex_op_sext12(encoded_op);
+	int ret, oldval;
+
+	if (op & FUTEX_OP_OPARG_SHIFT) {
+		if (oparg < 0 || oparg > 31) {
+			return -E_INVAL;
+		}
+		op &= ~FUTEX_OP_OPARG_SHIFT, oparg = 1 << oparg;
+	}
+	if (op > FUTEX_OP_XOR || cmp > FUTEX_OP_CMP_GE) {
+		return -E_INVAL;
+	}
+	if ((ret = futex_get_key(uaddr, private, &key1, NULL)) != 0) {
+		return ret;
+	}
+	if ((ret = futex_get_key(uaddr2, private, &key2, &page)) != 0) {
+		return ret;
+	}
+	hb1 = futex_bucket(&key1), hb2 = futex_bucket(&key2);
+
+	double_futex_lock(hb1, hb2, &intr_flag);
+	volatile int *kaddr2 = futex_kaddr(page, uaddr2);
+	oldval = *kaddr2;
+	switch (op) {
+	case FUTEX_OP_SET:
+		*kaddr2 = oparg;
+		break;
+	case FUTEX_OP_ADD:
+		*kaddr2 = oldval + oparg;
+		break;
+	case FUTEX_OP_OR:
+		*kaddr2 = oldval | oparg;
+		break;
+	case FUTEX_OP_ANDN:
+		*kaddr2 = oldval & ~oparg;
+		break;
+	case FUTEX_OP_XOR:
+		*kaddr2 = oldval ^ oparg;
+		break;
+	}
+	switch (cmp) {
+	case FUTEX_OP_CMP_EQ:
+		wake2 = (oldval == cmparg);
+		break;
+	case FUTEX_OP_CMP_NE:
+		wake2 = (oldval != cmparg);
+		break;
+	case FUTEX_OP_CMP_LT:
+		wake2 = (oldval < cmparg);
+		break;
+	case FUTEX_OP_CMP_LE:
+		wake2 = (oldval <= cmparg);
+		break;
+	case FUTEX_OP_CMP_GT:
+		wake2 = (oldval > cmparg);
+		break;
+	default:
+		wake2 = (oldval >= cmparg);
+		break;
+	}
+	ret = futex_wake_key(hb1, &key1, nr, FUTEX_BITSET_MATCH_ANY);
+	if (wake2) {
+		ret += futex_wake_key(hb2, &key2, nr2, FUTEX_BITSET_MATCH_ANY);
+	}
+	double_futex_unlock(hb1, hb2, intr_flag);
+
+	put_user_pages(&page, 1, 1);
+	return ret;
+}
+
+static struct futex_pi_state *futex_pi_lookup(struct futex_bucket *hb,
+					      struct futex_key *key)
+{
+	list_entry_t *le = &(hb->pi_states);
+	while ((le = list_next(le)) != &(hb->pi_states)) {
+		struct futex_pi_state *pi = le2pistate(le, link);
+		if (futex_match(&(pi->key), key)) {
+			return pi;
+		}
+	}
+	return NULL;
+}
+
+// futex_pi_put - a waiter is done with pi, with its bucket locked; the last
+//              - one frees it, and clears FUTEX_WAITERS of a futex still held
+static void futex_pi_put(struct futex_pi_state *pi, volatile int *kaddr)
+{
+	int uval;
+	if (--pi->refs != 0) {
+		return;
+	}
+	list_del(&(pi->link));
+	if (pi->mutex.owner == current) {
+		rt_mutex_unlock(&(pi->mutex));
+	} else {
+		rt_mutex_proxy_unlock(&(pi->mutex));
+	}
+	do {
+		uval = *kaddr;
+	} while ((uval & FUTEX_TID_MASK) != 0
+		 && !__sync_bool_compare_and_swap(kaddr, uval,
+						  uval & ~FUTEX_WAITERS));
+	kfree(pi);
+}
+
+// futex_lock_pi - take the pi futex at uaddr, boosting its owner while
+//               - waiting for it; with trylock, -E_AGAIN if it is held
+static int
+futex_lock_pi(uintptr_t uaddr, bool private, unsigned int timeout,
+	      bool trylock)
+{
+	struct futex_key key;
+	struct futex_bucket *hb;
+	struct futex_pi_state *pi, *spare;
+	struct rt_mutex_waiter waiter;
+	struct proc_struct *owner;
+	struct Page *page;
+	volatile int *kaddr;
+	unsigned long saved_ticks;
+	bool intr_flag;
+	int ret, uval;
+
+	if ((ret = futex_get_key(uaddr, private, &key, &page)) != 0) {
+		return ret;
+	}
+	/* allocated before the lock, in case the futex has no pi state yet */
+	if ((spare = kmalloc(sizeof(struct futex_pi_state))) == NULL) {
+		put_user_pages(&page, 1, 0);
+		return -E_NO_MEM;
+	}
+	timer_t __timer, *timer = ipc_timer_init(timeout, &saved_ticks, &__timer);
+	kaddr = futex_kaddr(page, uaddr);
+	hb = futex_bucket(&key);
+
+	spin_lock_irqsave(&(hb->lock), intr_flag);
+	while (1) {
+		uval = *kaddr;
+		if ((uval & FUTEX_TID_MASK) == 0) {
+			/* free, the waiters of a dying pi state left it so */
+			if (__sync_bool_compare_and_swap(kaddr, uval,
+							 current->pid | uval)) {
+				ret = 0;
+				goto out_unlock;
+			}
+			continue;
+		}
+		if ((uval & FUTEX_TID_MASK) == current->pid) {
+			ret = -E_DEADLK;
+			goto out_unlock;
+		}
+		if (trylock) {
+			ret = -E_AGAIN;
+			goto out_unlock;
+		}
+		if ((uval & FUTEX_WAITERS)
+		    || __sync_bool_compare_and_swap(kaddr, uval,
+						    uval | FUTEX_WAITERS)) {
+			break;
+		}
+	}
+	if ((pi = futex_pi_lookup(hb, &key)) == NULL) {
+		pi = spare, spare = NULL;
+		pi->key = key;
+		pi->refs = 0;
+		rt_mutex_init(&(pi->mutex));
+		list_add_before(&(hb->pi_states), &(pi->link));
+	}
+	pi->refs++;
+	if (pi->mutex.owner == NULL) {
+		/* taken in user space: held on behalf of the owner from now */
+		rcu_read_lock();
+		owner = find_proc(uval & FUTEX_TID_MASK);
+		ret = (owner != NULL) ? rt_mutex_proxy_lock(&(pi->mutex), owner)
+		    : -E_SRCH;
+		rcu_read_unlock();
+		if (ret != 0) {
+			futex_pi_put(pi, kaddr);
+			goto out_unlock;
+		}
+	}
+	if ((ret = rt_mutex_start_wait(&(pi->mutex), &waiter)) == 0) {
+		/* the owner exited meanwhile, holding it: it is ours now */
+		*kaddr = current->pid | FUTEX_WAITERS;
+	} else if (ret == 1) {
+		spin_unlock_irqrestore(&(hb->lock), intr_flag);
+		ret = rt_mutex_finish_wait(&(pi->mutex), &waiter, timer, WT_FUTEX);
+		if (ret == -1 && (ret = ipc_check_timeout(timeout, saved_ticks))
+		    == -1) {
+			ret = -E_INTR;
+		}
+		spin_lock_irqsave(&(hb->lock), intr_flag);
+	}
+	/* FUTEX_UNLOCK_PI stored our pid when it handed us the rt_mutex */
+	futex_pi_put(pi, kaddr);
+
+out_unlock:
+	spin_unlock_irqrestore(&(hb->lock), intr_flag);
+	if (spare != NULL) {
+		kfree(spare);
+	}
+	put_user_pages(&page, 1, 1);
+	return ret;
+}
+
+// futex_unlock_pi - release the pi futex at uaddr, held by current, to the
+//                 - most urgent of its waiters if any
+static int futex_unlock_pi(uintptr_t uaddr, bool private)
+{
+	struct futex_key key;
+	struct futex_bucket *hb;
+	struct futex_pi_state *pi;
+	struct proc_struct *next;
+	struct Page *page;
+	volatile int *kaddr;
+	bool intr_flag;
+	int ret, uval;
+
+	if ((ret = futex_get_key(uaddr, private, &key, &page)) != 0) {
+		return ret;
+	}
+	kaddr = futex_kaddr(page, uaddr);
+	hb = futex_bucket(&key);
+
+	spin_lock_irqsave(&(hb->lock), intr_flag);
+	uval = *kaddr;
+	if ((uval & FUTEX_TID_MASK) != current->pid) {
+		ret = -E_PERM;
+		goto out_unlock;
+	}
+	if ((pi = futex_pi_lookup(hb, &key)) != NULL
+	    && pi->mutex.owner == current) {
+		rt_mutex_unlock(&(pi->mutex));
+		/* the one handed it needs hb to return, it stays the owner */
+		if ((next = pi->mutex.owner) != NULL) {
+			*kaddr = next->pid | FUTEX_WAITERS;
+			goto out_unlock;
+		}
+		/* the waiters left are on their way out, see futex_pi_put */
+	}
+	/* with current in here, no one else changes the value */
+	*kaddr = 0;
+
+out_unlock:
+	spin_unlock_irqrestore(&(hb->lock), intr_flag);
+	put_user_pages(&page, 1, 1);
+	return ret;
+}
+
+// futex_timeout - the ticks to wait for the timespec at utime, relative,
+//               - or absolute on the tick clock for FUTEX_WAIT_BITSET
+static int futex_timeout(uintptr_t utime, bool absolute, unsigned int *timeout)
+{
+	struct mm_struct *mm = current->mm;
+	struct linux_timespec ts;
+	unsigned long t;
+
+	lock_mm(mm);
+	if (!copy_from_user(mm, &ts, (void *)utime, sizeof(ts), 0)) {
+		unlock_mm(mm);
+		return -E_FAULT;
+	}
+	unlock_mm(mm);
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000
+	    || ts.tv_sec >= ((unsigned int)-1 >> 1) / TIMER_HZ - 1) {
+		return -E_INVAL;
+	}
+	t = ts.tv_sec * TIMER_HZ
+	    + (ts.tv_nsec + TIMER_TICK_NSEC - 1) / TIMER_TICK_NSEC;
+	if (absolute) {
+		if ((long)(t - ticks) <= 0) {
+			return -E_TIMEOUT;
+		}
+		t -= ticks;
+	}
+	/* 0 would be no timeout at all */
+	*timeout = (t != 0) ? t : 1;
+	return 0;
+}
+
+int do_futex(uintptr_t uaddr, int op, int val, uintptr_t utime,
+	     uintptr_t uaddr2, int val3)
+{
+	bool private = (op & FUTEX_PRIVATE_FLAG) != 0;
+	int cmd = op & FUTEX_CMD_MASK, ret;
+	unsigned int timeout = 0;
+
+	switch (cmd) {
+	case FUTEX_WAIT:
+		val3 = FUTEX_BITSET_MATCH_ANY;
+		/* fall through */
+	case FUTEX_WAIT_BITSET:
+		if (utime != 0
+		    && (ret = futex_timeout(utime, cmd == FUTEX_WAIT_BITSET,
+					    &timeout)) != 0) {
+			return ret;
+		}
+		return futex_wait(uaddr, private, val, timeout, val3);
+	case FUTEX_WAKE:
+		val3 = FUTEX_BITSET_MATCH_ANY;
+		/* fall through */
+	case FUTEX_WAKE_BITSET:
+		return futex_wake(uaddr, private, val, val3);
+	case FUTEX_REQUEUE:
+		return futex_requeue(uaddr, uaddr2, private, val, (int)utime,
+				     NULL);
+	case FUTEX_CMP_REQUEUE:
+		return futex_requeue(uaddr, uaddr2, private, val, (int)utime,
+				     &val3);
+	case FUTEX_WAKE_OP:
+		return futex_wake_op(uaddr, uaddr2, private, val, (int)utime,
+				     val3);
+	case FUTEX_LOCK_PI:
+		/* the timeout is absolute, as for FUTEX_WAIT_BITSET */
+		if (utime != 0
+		    && (ret = futex_timeout(utime, 1, &timeout)) != 0) {
+			return ret;
+		}
+		return futex_lock_pi(uaddr, private, timeout, 0);
+	case FUTEX_TRYLOCK_PI:
+		return futex_lock_pi(uaddr, private, 0, 1);
+	case FUTEX_UNLOCK_PI:
+		return futex_unlock_pi(uaddr, private);
+	}
+	return -E_UNIMP;
+}
@@ -0,0 +1,46 @@
+#ifndef __KERN_SYNC_FUTEX_H__
+#define __KERN_SYNC_FUTEX_H__
+
+#include <types.h>
+
+/* the ops of the linux futex syscall */
+#define FUTEX_WAIT                  0
+#define FUTEX_WAKE                  1
+#define FUTEX_REQUEUE               3
+#define FUTEX_CMP_REQUEUE           4
+#define FUTEX_WAKE_OP               5
+#define FUTEX_LOCK_PI               6
+#define FUTEX_UNLOCK_PI             7
+#define FUTEX_TRYLOCK_PI            8
+#define FUTEX_WAIT_BITSET           9
+#define FUTEX_WAKE_BITSET           10
+#define FUTEX_PRIVATE_FLAG          128	// only the threads of one mm use it
+#define FUTEX_CLOCK_REALTIME        256
+#define FUTEX_CMD_MASK              (~(FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME))
+
+#define FUTEX_BITSET_MATCH_ANY      0xFFFFFFFF
+
+/* a pi futex holds the pid of its owner, 0 when free */
+#define FUTEX_WAITERS               0x80000000	// the unlock has to enter the kernel
+#define FUTEX_TID_MASK              0x3FFFFFFF
+
+/* val3 of FUTEX_WAKE_OP: op << 28 | cmp << 24 | oparg << 12 | cmparg */
+#define FUTEX_OP_SET                0	// *uaddr2 = oparg
+#define FUTEX_OP_ADD                1	// *uaddr2 += oparg
+#define FUTEX_OP_OR                 2	// *uaddr2 |= oparg
+#define FUTEX_OP_ANDN               3	// *uaddr2 &= ~oparg
+#define FUTEX_OP_XOR                4	// *uaddr2 ^= oparg
+#define FUTEX_OP_OPARG_SHIFT        8	// with the op, oparg is 1 << oparg
+
+#define FUTEX_OP_CMP_EQ             0
+#define FUTEX_OP_CMP_NE             1
+#define FUTEX_OP_CMP_LT             2
+#define FUTEX_OP_CMP_LE             3
+#define FUTEX_OP_CMP_GT             4
+#define FUTEX_OP_CMP_GE             5
+
+void futex_init(void);
+int do_futex(uintptr_t uaddr, int op, int val, uintptr_t utime,
+	     uintptr_t uaddr2, int val3);
+
+#endif /* !__KERN_SYNC_FUTEX_H__ */
@@ -0,0 +1,171 @@
+#include <types.h>
+#include <wait.h>
+#include <kmutex.h>
+#include <proc.h>
+#include <sched.h>
+#include <sync.h>
+#include <mp.h>
+#include <sysconf.h>
+#include <assert.h>
+
+#ifdef ARCH_AMD64
+#define kmutex_relax()              nop_pause()
+#else
+#define kmutex_relax()              asm volatile ("" ::: "memory")
+#endif
+
+/* bounds a single spin, in case the owner holds on much longer than usual */
+#define KMUTEX_SPIN_MAX             4096
+
+/* only the mutexes given a class are counted, the sleep or spin as the wait */
+#ifdef UCONFIG_LOCK_STAT
+#define kmutex_stat_start()         lock_stat_spin_start()
+#define kmutex_stat_acquired(mutex, start, contended, site)             \
+    do {                                                                \
+        if ((mutex)->stat.name != NULL) {                               \
+            lock_stat_acquired(&(mutex)->stat, start, contended, site); \
+        }                                                               \
+    } while (0)
+#define kmutex_stat_released(mutex)                                     \
+    do {                                                                \
+        if ((mutex)->stat.name != NULL) {                               \
+            lock_stat_released(&(mutex)->stat);                         \
+        }                                                               \
+    } while (0)
+#else
+#define kmutex_stat_start()         0
+#define kmutex_stat_acquired(mutex, start, contended, site) do { } while (0)
+#define kmutex_stat_released(mutex)                         do { } while (0)
+#endif
+
+void kmutex_init(kmutex_t * mutex)
+{
+	mutex->locked = 0;
+	mutex->owner = NULL;
+	wait_queue_init(&(mutex->wait_queue));
+	spinlock_init(&mutex->lock);
+#ifdef UCONFIG_LOCK_STAT
+	lock_stat_clear(&mutex->stat);
+#endif
+}
+
+// kmutex_owner_running - whether owner is the current proc of another cpu
+// NOTE: read without any lock, owner is only compared, never dereferenced
+static bool kmutex_owner_running(struct proc_struct *owner)
+{
+	int i;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		if (i != myid() && per_cpu_ptr(cpus, i)->__current == owner) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// kmutex_spin - wait for the mutex to be released while its owner runs,
+//             - return 1 if it was seen free
+static bool kmutex_spin(kmutex_t * mutex)
+{
+	struct proc_struct *owner;
+	int spins = 0;
+	if (sysconf.lcpu_count == 1) {
+		return 0;
+	}
+	while (mutex->locked) {
+		owner = mutex->owner;
+		if (owner == NULL || !kmutex_owner_running(owner)
+		    || ++spins > KMUTEX_SPIN_MAX || current->need_resched) {
+			return 0;
+		}
+		kmutex_relax();
+	}
+	return 1;
+}
+
+// __kmutex_trylock - take the mutex if free, mutex->lock held
+static inline bool __kmutex_trylock(kmutex_t * mutex)
+{
+	if (!mutex->locked) {
+		mutex->locked = 1;
+		mutex->owner = current;
+		return 1;
+	}
+	return 0;
+}
+
+void kmutex_lock_site(kmutex_t * mutex, uintptr_t site)
+{
+	bool intr_flag, contended = 0;
+	uint64_t start = kmutex_stat_start();
+	while (1) {
+		spin_lock_irqsave(&mutex->lock, intr_flag);
+		/* the sleepers are handed the mutex, don't jump the queue */
+		if (wait_queue_empty(&(mutex->wait_queue))
+		    && __kmutex_trylock(mutex)) {
+			spin_unlock_irqrestore(&mutex->lock, intr_flag);
+			kmutex_stat_acquired(mutex, start, contended, site);
+			return;
+		}
+		contended = 1;
+		spin_unlock_irqrestore(&mutex->lock, intr_flag);
+		if (!kmutex_spin(mutex)) {
+			break;
+		}
+	}
+
+	spin_lock_irqsave(&mutex->lock, intr_flag);
+	if (__kmutex_trylock(mutex)) {
+		spin_unlock_irqrestore(&mutex->lock, intr_flag);
+		kmutex_stat_acquired(mutex, start, 1, site);
+		return;
+	}
+	wait_t __wait, *wait = &__wait;
+	wait_current_set_exclusive(&(mutex->wait_queue), wait, WT_KSEM);
+	spin_unlock_irqrestore(&mutex->lock, intr_flag);
+
+	schedule();
+
+	spin_lock_irqsave(&mutex->lock, intr_flag);
+	wait_current_del(&(mutex->wait_queue), wait);
+	assert(mutex->owner == current && wait->wakeup_flags == WT_KSEM);
+	spin_unlock_irqrestore(&mutex->lock, intr_flag);
+	kmutex_stat_acquired(mutex, start, 1, site);
+}
+
+void kmutex_lock(kmutex_t * mutex)
+{
+	kmutex_lock_site(mutex, (uintptr_t) __builtin_return_address(0));
+}
+
+bool kmutex_trylock(kmutex_t * mutex)
+{
+	bool intr_flag, ret;
+	spin_lock_irqsave(&mutex->lock, intr_flag);
+	ret = __kmutex_trylock(mutex);
+	spin_unlock_irqrestore(&mutex->lock, intr_flag);
+	if (ret) {
+		kmutex_stat_acquired(mutex, kmutex_stat_start(), 0,
+				     (uintptr_t) __builtin_return_address(0));
+	}
+	return ret;
+}
+
+void kmutex_unlock(kmutex_t * mutex)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&mutex->lock, intr_flag);
+	{
+		wait_t *wait;
+		assert(mutex->locked && mutex->owner == current);
+		kmutex_stat_released(mutex);
+		if ((wait = wait_queue_first(&(mutex->wait_queue))) != NULL) {
+			/* it stays locked, now by the sleeper */
+			mutex->owner = wait->proc;
+			wakeup_first(&(mutex->wait_queue), WT_KSEM, 1);
+		} else {
+			mutex->locked = 0;
+			mutex->owner = NULL;
+		}
+	}
+	spin_unlock_irqrestore(&mutex->lock, intr_flag);
+}
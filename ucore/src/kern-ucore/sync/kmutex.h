@@ -0,0 +1,40 @@
+#ifndef __KERN_SYNC_KMUTEX_H__
+#define __KERN_SYNC_KMUTEX_H__
+
+#include <types.h>
+#include <wait.h>
+#include <spinlock.h>
+
+struct proc_struct;
+
+/* *
+ * kmutex - a sleeping lock held by one proc at a time, for the paths that
+ * used a semaphore of value 1 as a mutex. owner is the holder. A locker
+ * finding it held keeps spinning as long as the owner runs on another
+ * cpu, the holds being short, and only sleeps once the owner sleeps or
+ * gets preempted itself. The unlock hands the mutex to the first sleeper,
+ * like up() does with a semaphore.
+ * */
+typedef struct kmutex {
+	bool locked;
+	struct proc_struct *owner;
+	wait_queue_t wait_queue;
+	spinlock_s lock;
+#ifdef UCONFIG_LOCK_STAT
+	struct lock_stat stat;	/* counted once given a class, lock_stat_class */
+#endif
+} kmutex_t;
+
+void kmutex_init(kmutex_t * mutex);
+void kmutex_lock(kmutex_t * mutex);
+// kmutex_lock_site - kmutex_lock, counted by lock statistics at site
+void kmutex_lock_site(kmutex_t * mutex, uintptr_t site);
+bool kmutex_trylock(kmutex_t * mutex);
+void kmutex_unlock(kmutex_t * mutex);
+
+static inline bool kmutex_is_locked(kmutex_t * mutex)
+{
+	return mutex->locked;
+}
+
+#endif /* !__KERN_SYNC_KMUTEX_H__ */
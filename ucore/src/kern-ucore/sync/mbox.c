@@ -5,15 +5,20 @@
 #include <ipc.h>
 #include <proc.h>
 #include <slab.h>
-#include <sem.h>
 #include <mbox.h>
 #include <mboxbuf.h>
 #include <wait.h>
+#include <poll.h>
 #include <list.h>
 #include <error.h>
 #include <assert.h>
 #include <clock.h>
 #include <string.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <spinlock.h>
+#include <rcu.h>
 
 struct msg_seg {
 	struct msg_seg *next;
@@ -22,7 +27,9 @@ struct msg_seg {
 struct msg_msg {
 	int pid;
 	unsigned int bytes;
-	struct msg_seg *next;
+	int npages;
+	struct Page **pages;	/* the first npages * PGSIZE bytes, not copied */
+	struct msg_seg *next;	/* the rest */
 	list_entry_t msg_link;
 };
 
@@ -35,27 +42,56 @@ enum mbox_state {
 	CLOSING = 2,
 };
 
+/* *
+ * An mbox is looked up by id with no lock but rcu_read_lock: the pages of
+ * mbox_map are published by rcu_assign_pointer and only freed, by
+ * mbox_cleanup, a grace period after they are taken out. All of an mbox
+ * but its id is under its own lock, which get_mbox takes. The closed ones
+ * wait on the free list of the cpu that closed them, with state set under
+ * the lock of that list; new_mbox takes from the list of its own cpu, then
+ * from a new page, and only steals from the other cpus when it is out of
+ * both, so that independent senders and receivers do not meet on a lock.
+ * */
 struct msg_mbox {
 	int id;
 	int inuse;
+	spinlock_s lock;
 	enum mbox_state state;
 	unsigned int max_slots, slots;
-	list_entry_t msg_link;
+	list_entry_t msg_link;	/* the messages, or in a free list if closed */
 	wait_queue_t senders;
 	wait_queue_t receivers;
+	poll_head_t poll;	/* EPOLLIN on sends, EPOLLOUT on receives */
 };
 
 #define le2mbox(le, member)             \
     to_struct((le), struct msg_mbox, member)
 
+struct mbox_cpu {
+	spinlock_s lock;
+	list_entry_t free_list;
+};
+
 #define MAX_MBOX_NUM                8192
 #define MBOX_P_PAGE                 (PGSIZE / sizeof(struct msg_mbox))
 #define MAX_MBOX_PAGES              ((MAX_MBOX_NUM + MBOX_P_PAGE - 1) / MBOX_P_PAGE)
-#define MAX_MSG_DATALEN             (512 - sizeof(struct msg_msg))
+#define MSG_OBJ_SIZE                512
+#define MAX_MSG_DATALEN             (MSG_OBJ_SIZE - sizeof(struct msg_msg))
+/* a message of up to MAX_MSG_SMALL_DATALEN bytes, most of those sent, is
+ * all in one smaller object of a cache of its own */
+#define MSG_SMALL_OBJ_SIZE          128
+#define MAX_MSG_SMALL_DATALEN \
+    (MSG_SMALL_OBJ_SIZE - sizeof(struct msg_msg))
+/* the whole pages of a message from a page-aligned buffer of at least
+ * MSG_ZCOPY_MIN bytes are shared with the receiver instead of copied */
+#define MSG_ZCOPY_MIN               PGSIZE
 
 static struct msg_mbox *mbox_map[MAX_MBOX_PAGES];
-static list_entry_t free_mbox_list;
-static semaphore_t sem_mbox_map;
+static spinlock_s mbox_map_lock;	/* the writes to mbox_map */
+static DEFINE_PERCPU_NOINIT(struct mbox_cpu, mbox_cpus);
+/* msg_msg and msg_seg both fit in MSG_OBJ_SIZE, so they share one cache */
+static kmem_cache_t *msg_cachep;
+static kmem_cache_t *msg_small_cachep;
 
 void mbox_init(void)
 {
@@ -63,109 +99,192 @@ void mbox_init(void)
 	for (i = 0; i < MAX_MBOX_PAGES; i++) {
 		mbox_map[i] = NULL;
 	}
-	sem_init(&sem_mbox_map, 1);
-	list_init(&free_mbox_list);
+	spinlock_init(&mbox_map_lock);
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct mbox_cpu *mc = per_cpu_ptr(mbox_cpus, i);
+		spinlock_init(&(mc->lock));
+		list_init(&(mc->free_list));
+	}
 	static_assert(MBOX_P_PAGE != 0);
+	msg_cachep = kmem_cache_create("msg_msg", MSG_OBJ_SIZE, 0, NULL);
+	msg_small_cachep =
+	    kmem_cache_create("msg_msg_small", MSG_SMALL_OBJ_SIZE, 0, NULL);
+	assert(msg_cachep != NULL && msg_small_cachep != NULL);
 }
 
-static struct msg_mbox *get_mbox(int id)
+// get_mbox - the opened mbox of id, returned with its lock held
+static struct msg_mbox *get_mbox(int id, bool * intr_flag)
 {
-	if (id >= 0 && id < MAX_MBOX_NUM) {
-		int i = id / MBOX_P_PAGE, j = id % MBOX_P_PAGE;
-		if (mbox_map[i] != NULL) {
-			struct msg_mbox *mbox = mbox_map[i] + j;
-			if (mbox->state == OPENED) {
-				return mbox;
-			}
+	struct msg_mbox *page, *mbox = NULL;
+	if (id < 0 || id >= MAX_MBOX_NUM) {
+		return NULL;
+	}
+	rcu_read_lock();
+	if ((page = rcu_dereference(mbox_map[id / MBOX_P_PAGE])) != NULL) {
+		mbox = page + id % MBOX_P_PAGE;
+		spin_lock_irqsave(&(mbox->lock), *intr_flag);
+		if (mbox->state != OPENED) {
+			spin_unlock_irqrestore(&(mbox->lock), *intr_flag);
+			mbox = NULL;
 		}
 	}
-	return NULL;
+	rcu_read_unlock();
+	return mbox;
 }
 
+static bool mbox_valid(int id)
+{
+	bool intr_flag;
+	struct msg_mbox *mbox;
+	if ((mbox = get_mbox(id, &intr_flag)) == NULL) {
+		return 0;
+	}
+	spin_unlock_irqrestore(&(mbox->lock), intr_flag);
+	return 1;
+}
+
+// mbox_free - put mbox on the free list of this cpu, with its lock held
 static void mbox_free(struct msg_mbox *mbox)
 {
 	assert(mbox->state == CLOSING && mbox->inuse == 0);
 	assert(list_empty(&(mbox->msg_link)));
 	assert(wait_queue_empty(&(mbox->senders)));
 	assert(wait_queue_empty(&(mbox->receivers)));
+	struct mbox_cpu *mc = get_cpu_ptr(mbox_cpus);
+	spinlock_acquire(&(mc->lock));
 	mbox->state = CLOSED;
 	mbox->max_slots = mbox->slots = 0;
-	list_add_before(&(free_mbox_list), &(mbox->msg_link));
+	list_add_before(&(mc->free_list), &(mbox->msg_link));
+	spinlock_release(&(mc->lock));
 }
 
-static void add_msg(struct msg_mbox *mbox, struct msg_msg *msg, bool append)
+// add_msgs - queue the n messages of msgs on mbox in their order, after the
+//          - others if append, else before them, and wake one receiver for
+//          - all of them: it wakes the next one if it leaves any behind
+static void
+add_msgs(struct msg_mbox *mbox, struct msg_msg **msgs, int n, bool append)
 {
-	assert(mbox->state == OPENED);
-	mbox->slots++;
-	list_entry_t *list = &(mbox->msg_link), *le = &(msg->msg_link);
-	if (append) {
-		list_add_before(list, le);
-	} else {
-		list_add_after(list, le);
+	assert(mbox->state == OPENED && n > 0);
+	list_entry_t *list = &(mbox->msg_link);
+	int i;
+	mbox->slots += n;
+	for (i = 0; i < n; i++) {
+		if (append) {
+			list_add_before(list, &(msgs[i]->msg_link));
+		} else {
+			list_add_after(list, &(msgs[n - 1 - i]->msg_link));
+		}
 	}
 	wakeup_first(&(mbox->receivers), WT_MBOX_RECV, 1);
+	poll_notify(&(mbox->poll), EPOLLIN);
 }
 
+// pick_msgs - take up to n messages of mbox into msgs, each no larger than
+//           - the size of its buf, and wake one sender for all the slots;
+//           - returns the # taken, -E_TOO_BIG if the first is too large
 static int
-pick_msg(struct msg_mbox *mbox, size_t max_bytes, struct msg_msg **msg_store)
+pick_msgs(struct msg_mbox *mbox, struct mboxbuf *bufs, int n,
+	  struct msg_msg **msgs)
 {
 	assert(mbox->state == OPENED && mbox->slots > 0);
-	assert(!list_empty(&(mbox->msg_link)));
-	struct msg_msg *msg = le2msg(list_next(&(mbox->msg_link)), msg_link);
-	if (max_bytes < msg->bytes) {
+	int i;
+	for (i = 0; i < n && mbox->slots > 0; i++) {
+		assert(!list_empty(&(mbox->msg_link)));
+		struct msg_msg *msg =
+		    le2msg(list_next(&(mbox->msg_link)), msg_link);
+		if (bufs[i].size < msg->bytes) {
+			break;
+		}
+		mbox->slots--, msgs[i] = msg;
+		list_del(&(msg->msg_link));
+	}
+	if (i == 0) {
 		return -E_TOO_BIG;
 	}
-	mbox->slots--, *msg_store = msg;
-	list_del(&(msg->msg_link));
 	wakeup_first(&(mbox->senders), WT_MBOX_SEND, 1);
-	return 0;
+	poll_notify(&(mbox->poll), EPOLLOUT);
+	return i;
 }
 
-static struct msg_mbox *new_mbox(unsigned int max_slots)
+// take_free_mbox - an mbox off the free list of cpu, NULL if it is empty
+static struct msg_mbox *take_free_mbox(int cpu)
 {
-	bool intr_flag;
+	struct mbox_cpu *mc = per_cpu_ptr(mbox_cpus, cpu);
 	struct msg_mbox *mbox = NULL;
-	local_intr_save(intr_flag);
-	if (list_empty(&free_mbox_list)) {
-		int i, id;
-		for (i = 0; i < MAX_MBOX_PAGES; i++) {
-			if (mbox_map[i] == NULL) {
-				break;
-			}
+	bool intr_flag;
+	spin_lock_irqsave(&(mc->lock), intr_flag);
+	if (!list_empty(&(mc->free_list))) {
+		mbox = le2mbox(list_next(&(mc->free_list)), msg_link);
+		list_del_init(&(mbox->msg_link));
+		assert(mbox->state == CLOSED);
+		/* not CLOSED any more, so that mbox_cleanup leaves its page */
+		mbox->state = CLOSING;
+	}
+	spin_unlock_irqrestore(&(mc->lock), intr_flag);
+	return mbox;
+}
+
+// new_mbox_page - publish a new page of mboxes, all but the first one put on
+//               - the free list of this cpu, and return the first one
+static struct msg_mbox *new_mbox_page(void)
+{
+	struct Page *page;
+	if ((page = alloc_page()) == NULL) {
+		return NULL;
+	}
+	struct msg_mbox *base = page2kva(page), *mbox;
+	bool intr_flag;
+	int i, j;
+	spin_lock_irqsave(&mbox_map_lock, intr_flag);
+	for (i = 0; i < MAX_MBOX_PAGES; i++) {
+		if (mbox_map[i] == NULL) {
+			break;
 		}
-		if (i == MAX_MBOX_PAGES) {
-			goto out;
+	}
+	if (i == MAX_MBOX_PAGES) {
+		spin_unlock_irqrestore(&mbox_map_lock, intr_flag);
+		free_page(page);
+		return NULL;
+	}
+	for (j = 0, mbox = base; j < MBOX_P_PAGE; j++, mbox++) {
+		mbox->id = i * MBOX_P_PAGE + j, mbox->inuse = 0;
+		spinlock_init(&(mbox->lock));
+		mbox->state = (j == 0) ? CLOSING : CLOSED;
+		mbox->max_slots = mbox->slots = 0;
+		list_init(&(mbox->msg_link));
+		wait_queue_init(&(mbox->senders));
+		wait_queue_init(&(mbox->receivers));
+		poll_head_init(&(mbox->poll));
+	}
+	struct mbox_cpu *mc = get_cpu_ptr(mbox_cpus);
+	spinlock_acquire(&(mc->lock));
+	for (j = 1, mbox = base + 1; j < MBOX_P_PAGE; j++, mbox++) {
+		list_add_before(&(mc->free_list), &(mbox->msg_link));
+	}
+	spinlock_release(&(mc->lock));
+	rcu_assign_pointer(mbox_map[i], base);
+	spin_unlock_irqrestore(&mbox_map_lock, intr_flag);
+	return base;
+}
+
+static struct msg_mbox *new_mbox(unsigned int max_slots)
+{
+	struct msg_mbox *mbox;
+	bool intr_flag;
+	int cpu = myid(), i;
+	if ((mbox = take_free_mbox(cpu)) == NULL
+	    && (mbox = new_mbox_page()) == NULL) {
+		for (i = 1; i < sysconf.lcpu_count && mbox == NULL; i++) {
+			mbox = take_free_mbox((cpu + i) % sysconf.lcpu_count);
 		}
-		local_intr_restore(intr_flag);
-
-		struct Page *page = alloc_page();
-
-		local_intr_save(intr_flag);
-		if (page != NULL) {
-			id = i * MBOX_P_PAGE;
-			mbox = mbox_map[i] = (struct msg_mbox *)page2kva(page);
-			for (i = 0; i < MBOX_P_PAGE; i++, id++, mbox++) {
-				mbox->id = id, mbox->inuse = 0;
-				mbox->state = CLOSED;
-				mbox->max_slots = mbox->slots = 0;
-				list_init(&(mbox->msg_link));
-				wait_queue_init(&(mbox->senders));
-				wait_queue_init(&(mbox->receivers));
-				list_add_before(&(free_mbox_list),
-						&(mbox->msg_link));
-			}
-		} else if (list_empty(&free_mbox_list)) {
-			goto out;
+		if (mbox == NULL) {
+			return NULL;
 		}
 	}
-	assert(!list_empty(&free_mbox_list));
-	mbox = le2mbox(list_next(&free_mbox_list), msg_link);
-	list_del_init(&(mbox->msg_link));
+	spin_lock_irqsave(&(mbox->lock), intr_flag);
 	mbox->state = OPENED;
 	mbox->max_slots = max_slots;
-
-out:
-	local_intr_restore(intr_flag);
+	spin_unlock_irqrestore(&(mbox->lock), intr_flag);
 	return mbox;
 }
 
@@ -174,14 +293,17 @@ int ipc_mbox_init(unsigned int max_slots)
 	if (max_slots == 0 || max_slots > MAX_MSG_SLOTS) {
 		return -E_INVAL;
 	}
-	int ret = -E_NO_MEM;
 	struct msg_mbox *mbox;
-	down(&sem_mbox_map);
-	if ((mbox = new_mbox(max_slots)) != NULL) {
-		ret = mbox->id;
+	if ((mbox = new_mbox(max_slots)) == NULL) {
+		return -E_NO_MEM;
 	}
-	up(&sem_mbox_map);
-	return ret;
+	return mbox->id;
+}
+
+// msg_cache - the cache of the msg_msg of a message of bytes bytes
+static inline kmem_cache_t *msg_cache(size_t bytes)
+{
+	return (bytes <= MAX_MSG_SMALL_DATALEN) ? msg_small_cachep : msg_cachep;
 }
 
 static void free_seg(struct msg_seg *seg)
@@ -189,28 +311,84 @@ static void free_seg(struct msg_seg *seg)
 	if (seg->next != NULL) {
 		free_seg(seg->next);
 	}
-	kfree(seg);
+	kmem_cache_free(msg_cachep, seg);
 }
 
 static void free_msg(struct msg_msg *msg)
 {
+	if (msg->pages != NULL) {
+		put_user_pages(msg->pages, msg->npages, 0);
+		kfree(msg->pages);
+	}
 	if (msg->next != NULL) {
 		free_seg(msg->next);
 	}
-	kfree(msg);
+	kmem_cache_free(msg_cache(msg->bytes), msg);
+}
+
+// msg_wrprotect - make the pte at la of mm read-only, so that a write of
+//               - the sender copies the page shared with the message
+static void msg_wrprotect(struct mm_struct *mm, uintptr_t la)
+{
+	pte_t *ptep = get_pte(mm->pgdir, la, 0);
+	assert(ptep != NULL && ptep_present(ptep));
+	spinlock_acquire(&(mm->pt_lock));
+	if (ptep_s_write(ptep) || ptep_u_write(ptep)) {
+		ptep_unset_s_write(ptep);
+		ptep_unset_u_write(ptep);
+		mp_tlb_invalidate(mm->pgdir, la);
+	}
+	spinlock_release(&(mm->pt_lock));
+}
+
+// load_msg_pages - pin up to npages pages at src for msg, cow-shared with
+//                - the sender; msg->npages is left 0 if none can be
+static void load_msg_pages(struct msg_msg *msg, uintptr_t src, int npages)
+{
+	struct mm_struct *mm = current->mm;
+	struct Page **pages;
+	if ((pages = kmalloc(npages * sizeof(struct Page *))) == NULL) {
+		return;
+	}
+	int i, n = get_user_pages(mm, src, npages * PGSIZE, 0, pages, npages);
+	for (i = 0; i < n; i++) {
+		/* shared memory is written in place, it cannot be cow */
+		struct vma_struct *vma = find_vma(mm, src + i * PGSIZE);
+		if (PageSwap(pages[i]) || (vma->vm_flags & VM_SHARE)) {
+			put_user_pages(pages + i, n - i, 0);
+			n = i;
+			break;
+		}
+	}
+	if (n == 0) {
+		kfree(pages);
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		msg_wrprotect(mm, src + i * PGSIZE);
+	}
+	msg->pages = pages, msg->npages = n;
 }
 
 static struct msg_msg *load_msg(const void *src, size_t len)
 {
 	size_t alen, bytes = len;
-	if ((alen = len) > MAX_MSG_DATALEN) {
-		alen = MAX_MSG_DATALEN;
-	}
 	struct msg_msg *msg;
-	if ((msg = kmalloc(sizeof(struct msg_msg) + alen)) == NULL) {
+	if ((msg = kmem_cache_alloc(msg_cache(len))) == NULL) {
 		return NULL;
 	}
 
+	msg->bytes = bytes;
+	msg->npages = 0, msg->pages = NULL;
+	if ((uintptr_t) src % PGSIZE == 0 && len >= MSG_ZCOPY_MIN) {
+		load_msg_pages(msg, (uintptr_t) src, len / PGSIZE);
+		len -= msg->npages * PGSIZE;
+		src = ((char *)src) + msg->npages * PGSIZE;
+	}
+
+	if ((alen = len) > MAX_MSG_DATALEN) {
+		alen = MAX_MSG_DATALEN;
+	}
 	struct msg_seg **segp = &(msg->next);
 
 	void *dst = msg + 1;
@@ -221,7 +399,7 @@ static struct msg_msg *load_msg(const void *src, size_t len)
 			alen = MAX_MSG_DATALEN;
 		}
 		struct msg_seg *seg;
-		if ((seg = kmalloc(sizeof(struct msg_seg) + alen)) == NULL) {
+		if ((seg = kmem_cache_alloc(msg_cachep)) == NULL) {
 			goto failed;
 		}
 		*segp = seg, segp = &(seg->next);
@@ -232,7 +410,6 @@ inside:
 		*segp = NULL;
 	}
 
-	msg->bytes = bytes;
 	msg->pid = current->pid;
 	return msg;
 
@@ -241,23 +418,27 @@ failed:
 	return NULL;
 }
 
+// send_msg - queue as many of the *np messages of msgs on mbox as it has
+//          - free slots for, waiting for the first one, and store the #
+//          - queued in *np; called with the lock of mbox held, which it
+//          - releases
 static uint32_t
-send_msg(struct msg_mbox *mbox, struct msg_msg *msg, timer_t * timer)
+send_msg(struct msg_mbox *mbox, struct msg_msg **msgs, int *np,
+	 timer_t * timer, bool intr_flag)
 {
 	uint32_t ret;
-	bool intr_flag;
-	local_intr_save(intr_flag);
 	mbox->inuse++;
 	wait_t __wait, *wait = &__wait;
 	while (mbox->max_slots <= mbox->slots) {
 		assert(mbox->state == OPENED);
-		wait_current_set(&(mbox->senders), wait, WT_MBOX_SEND);
+		wait_current_set_exclusive(&(mbox->senders), wait,
+					   WT_MBOX_SEND);
 		ipc_add_timer(timer);
-		local_intr_restore(intr_flag);
+		spin_unlock_irqrestore(&(mbox->lock), intr_flag);
 
 		schedule();
 
-		local_intr_save(intr_flag);
+		spin_lock_irqsave(&(mbox->lock), intr_flag);
 		ipc_del_timer(timer);
 		wait_current_del(&(mbox->senders), wait);
 		if (mbox->state != OPENED || wait->wakeup_flags != WT_MBOX_SEND) {
@@ -269,7 +450,14 @@ send_msg(struct msg_mbox *mbox, struct msg_msg *msg, timer_t * timer)
 	}
 	assert(mbox->state == OPENED && mbox->max_slots > mbox->slots);
 
-	ret = 0, add_msg(mbox, msg, 1);
+	if (*np > mbox->max_slots - mbox->slots) {
+		*np = mbox->max_slots - mbox->slots;
+	}
+	ret = 0, add_msgs(mbox, msgs, *np, 1);
+	/* one receive may have freed slots for several senders */
+	if (mbox->slots < mbox->max_slots) {
+		wakeup_first(&(mbox->senders), WT_MBOX_SEND, 1);
+	}
 
 out:
 	mbox->inuse--;
@@ -279,64 +467,120 @@ out:
 			mbox_free(mbox);
 		}
 	}
-	local_intr_restore(intr_flag);
+	spin_unlock_irqrestore(&(mbox->lock), intr_flag);
 	return ret;
 }
 
-int ipc_mbox_send(int id, struct mboxbuf *buf, unsigned int timeout)
+// ipc_mbox_sendm - send the n messages of bufs in order with one call: the
+//                - first waits for a slot, those after it are sent as long
+//                - as there are free ones, or up to a bad one. returns the
+//                - # sent, or the error of the first
+int ipc_mbox_sendm(int id, struct mboxbuf *bufs, int n, unsigned int timeout)
 {
-	if (get_mbox(id) == NULL) {
+	if (n <= 0 || n > MAX_MSG_BATCH || !mbox_valid(id)) {
 		return -E_INVAL;
 	}
 
-	struct msg_msg *msg;
+	struct msg_msg *msgs[MAX_MSG_BATCH];
 	struct msg_mbox *mbox;
 	struct mm_struct *mm = current->mm;
-	struct mboxbuf __local_buf, *local_buf = &__local_buf;
+	struct mboxbuf local_bufs[MAX_MSG_BATCH];
 
-	int ret = -E_INVAL;
+	int ret = -E_INVAL, nr = 0, sent = 0, i;
 
 	lock_mm(mm);
 	{
 		if (copy_from_user
-		    (mm, local_buf, buf, sizeof(struct mboxbuf), 0)) {
-			size_t len = local_buf->len;
-			if (0 < len && len <= MAX_MSG_BYTES) {
-				void *src = local_buf->data;
-				if (user_mem_check(mm, (uintptr_t) src, len, 0)) {
-					ret =
-					    ((msg =
-					      load_msg(src,
-						       len)) !=
-					     NULL) ? 0 : -E_NO_MEM;
+		    (mm, local_bufs, bufs, sizeof(struct mboxbuf) * n, 0)) {
+			for (; nr < n; nr++) {
+				size_t len = local_bufs[nr].len;
+				void *src = local_bufs[nr].data;
+				if (len == 0 || len > MAX_MSG_BYTES
+				    || !user_mem_check(mm, (uintptr_t) src, len,
+						       0)) {
+					break;
+				}
+				if ((msgs[nr] = load_msg(src, len)) == NULL) {
+					ret = -E_NO_MEM;
+					break;
 				}
 			}
 		}
 	}
 	unlock_mm(mm);
 
-	if (ret == 0) {
-		ret = -E_INVAL;
-		if ((mbox = get_mbox(id)) != NULL) {
-			unsigned long saved_ticks;
-			timer_t __timer, *timer =
-			    ipc_timer_init(timeout, &saved_ticks, &__timer);
-
-			uint32_t flags;
-			if ((flags = send_msg(mbox, msg, timer)) == 0) {
-				return 0;
-			}
+	if (nr == 0) {
+		return ret;
+	}
+	ret = -E_INVAL;
+	bool intr_flag;
+	unsigned long saved_ticks;
+	timer_t __timer, *timer =
+	    ipc_timer_init(timeout, &saved_ticks, &__timer);
+	if ((mbox = get_mbox(id, &intr_flag)) != NULL) {
+		uint32_t flags;
+		sent = nr;
+		if ((flags =
+		     send_msg(mbox, msgs, &sent, timer, intr_flag)) != 0) {
 			assert(flags == WT_INTERRUPTED);
-			ret = ipc_check_timeout(timeout, saved_ticks);
+			sent = 0, ret = ipc_check_timeout(timeout, saved_ticks);
 		}
-		free_msg(msg);
 	}
-	return ret;
+	for (i = sent; i < nr; i++) {
+		free_msg(msgs[i]);
+	}
+	return (sent != 0) ? sent : ret;
+}
+
+int ipc_mbox_send(int id, struct mboxbuf *buf, unsigned int timeout)
+{
+	int ret = ipc_mbox_sendm(id, buf, 1, timeout);
+	return (ret < 0) ? ret : 0;
+}
+
+// store_msg_page - map page of a message at la of mm read-only, the first
+//                - write of either side copies it; returns 0 if it cannot
+static bool store_msg_page(struct mm_struct *mm, uintptr_t la, struct Page *page)
+{
+	struct vma_struct *vma = find_vma(mm, la);
+	if (PageSwap(page) || vma == NULL || vma->vm_start > la
+	    || (vma->vm_flags & (VM_SHARE | VM_IO))) {
+		return 0;
+	}
+	/* fault in the page replaced, so that the pte carries its perm */
+	struct Page *old;
+	if (get_user_pages(mm, la, PGSIZE, 1, &old, 1) != 1) {
+		return 0;
+	}
+	pte_t *ptep = get_pte(mm->pgdir, la, 0);
+	spinlock_acquire(&(mm->pt_lock));
+	pte_perm_t perm = ptep_get_perm(ptep, PTE_USER);
+#ifdef ARCH_ARM
+	/* ARM9 software emulated PTE_xxx */
+	perm &= ~PTE_W;
+#else
+	ptep_unset_s_write(&perm);
+	ptep_unset_u_write(&perm);
+#endif
+	page_insert(mm->pgdir, page, la, perm);
+	spinlock_release(&(mm->pt_lock));
+	put_user_pages(&old, 1, 0);
+	return 1;
 }
 
 static void store_msg(struct msg_msg *msg, void *dst)
 {
 	size_t alen, len = msg->bytes;
+	int i;
+	for (i = 0; i < msg->npages; i++, dst = ((char *)dst) + PGSIZE) {
+		struct Page *page = msg->pages[i];
+		if ((uintptr_t) dst % PGSIZE != 0
+		    || !store_msg_page(current->mm, (uintptr_t) dst, page)) {
+			copy_to_user(current->mm, dst, page2kva(page), PGSIZE);
+		}
+	}
+	len -= msg->npages * PGSIZE;
+
 	if ((alen = len) > MAX_MSG_DATALEN) {
 		alen = MAX_MSG_DATALEN;
 	}
@@ -358,24 +602,26 @@ inside:
 	}
 }
 
+// recv_msg - take up to n messages of mbox into msgs, see pick_msgs, waiting
+//          - for one; called with the lock of mbox held, which it releases.
+//          - returns the # taken, -1 if woken up without one
 static int
-recv_msg(struct msg_mbox *mbox, size_t max_bytes, struct msg_msg **msg_store,
-	 timer_t * timer)
+recv_msg(struct msg_mbox *mbox, struct mboxbuf *bufs, int n,
+	 struct msg_msg **msgs, timer_t * timer, bool intr_flag)
 {
 	int ret = -1;
-	bool intr_flag;
-	local_intr_save(intr_flag);
 	mbox->inuse++;
 	wait_t __wait, *wait = &__wait;
 	while (mbox->slots == 0) {
 		assert(mbox->state == OPENED);
-		wait_current_set(&(mbox->receivers), wait, WT_MBOX_RECV);
+		wait_current_set_exclusive(&(mbox->receivers), wait,
+					   WT_MBOX_RECV);
 		ipc_add_timer(timer);
-		local_intr_restore(intr_flag);
+		spin_unlock_irqrestore(&(mbox->lock), intr_flag);
 
 		schedule();
 
-		local_intr_save(intr_flag);
+		spin_lock_irqsave(&(mbox->lock), intr_flag);
 		ipc_del_timer(timer);
 		wait_current_del(&(mbox->receivers), wait);
 		if (mbox->state != OPENED || wait->wakeup_flags != WT_MBOX_RECV) {
@@ -385,124 +631,167 @@ recv_msg(struct msg_mbox *mbox, size_t max_bytes, struct msg_msg **msg_store,
 	assert(mbox->state == OPENED && mbox->slots > 0);
 	assert(!list_empty(&(mbox->msg_link)));
 
-	if ((ret = pick_msg(mbox, max_bytes, msg_store)) != 0) {
+	/* the messages left are for another receiver */
+	if ((ret = pick_msgs(mbox, bufs, n, msgs)) < 0 || mbox->slots > 0) {
 		wakeup_first(&(mbox->receivers), WT_MBOX_RECV, 1);
 	}
 
 out:
 	mbox->inuse--;
 	if (mbox->state != OPENED) {
-		assert(ret != 0 && mbox->state == CLOSING);
+		assert(ret < 0 && mbox->state == CLOSING);
 		if (mbox->inuse == 0) {
 			mbox_free(mbox);
 		}
 	}
-	local_intr_restore(intr_flag);
+	spin_unlock_irqrestore(&(mbox->lock), intr_flag);
 	return ret;
 }
 
-int ipc_mbox_recv(int id, struct mboxbuf *buf, unsigned int timeout)
+// ipc_mbox_recvm - receive up to n messages into the buffers of bufs with
+//                - one call, waiting for the first one; the buffers from a
+//                - bad one or one too small for its message on are left.
+//                - returns the # received, or the error of the first
+int ipc_mbox_recvm(int id, struct mboxbuf *bufs, int n, unsigned int timeout)
 {
-	if (get_mbox(id) == NULL) {
+	if (n <= 0 || n > MAX_MSG_BATCH || !mbox_valid(id)) {
 		return -E_INVAL;
 	}
 
-	size_t size;
-	struct msg_msg *msg;
+	bool intr_flag;
+	struct msg_msg *msgs[MAX_MSG_BATCH];
 	struct msg_mbox *mbox;
 	struct mm_struct *mm = current->mm;
-	struct mboxbuf __local_buf, *local_buf = &__local_buf;
+	struct mboxbuf local_bufs[MAX_MSG_BATCH];
 
-	int ret = -E_INVAL;
+	int nr = 0, got, i, j;
 
 	lock_mm(mm);
 	{
 		if (copy_from_user
-		    (mm, local_buf, buf, sizeof(struct mboxbuf), 1)) {
-			if ((size = local_buf->size) > 0) {
-				void *dst = local_buf->data;
-				if (user_mem_check
-				    (mm, (uintptr_t) dst, size, 1)) {
-					ret = 0;
+		    (mm, local_bufs, bufs, sizeof(struct mboxbuf) * n, 1)) {
+			for (; nr < n; nr++) {
+				size_t size = local_bufs[nr].size;
+				void *dst = local_bufs[nr].data;
+				if (size == 0
+				    || !user_mem_check(mm, (uintptr_t) dst,
+						       size, 1)) {
+					break;
 				}
 			}
 		}
 	}
 	unlock_mm(mm);
 
-	if (ret != 0 || (mbox = get_mbox(id)) == NULL) {
+	if (nr == 0) {
 		return -E_INVAL;
 	}
 
 	unsigned long saved_ticks;
 	timer_t __timer, *timer =
 	    ipc_timer_init(timeout, &saved_ticks, &__timer);
-	if ((ret = recv_msg(mbox, size, &msg, timer)) != 0) {
-		if (ret == -1) {
+	if ((mbox = get_mbox(id, &intr_flag)) == NULL) {
+		return -E_INVAL;
+	}
+	if ((got =
+	     recv_msg(mbox, local_bufs, nr, msgs, timer, intr_flag)) < 0) {
+		if (got == -1) {
 			return ipc_check_timeout(timeout, saved_ticks);
 		}
-		return ret;
+		return got;
 	}
 
-	ret = -E_INVAL;
-
 	lock_mm(mm);
 	{
-		size_t len;
-		local_buf->len = len = msg->bytes, local_buf->from = msg->pid;
-		if (copy_to_user(mm, buf, local_buf, sizeof(struct mboxbuf))) {
-			void *dst = local_buf->data;
-			if (user_mem_check(mm, (uintptr_t) dst, len, 1)) {
-				ret = 0, store_msg(msg, dst);
+		for (i = 0; i < got; i++) {
+			struct mboxbuf *local_buf = local_bufs + i;
+			size_t len;
+			local_buf->len = len = msgs[i]->bytes;
+			local_buf->from = msgs[i]->pid;
+			if (!copy_to_user
+			    (mm, bufs + i, local_buf, sizeof(struct mboxbuf))
+			    || !user_mem_check(mm, (uintptr_t) local_buf->data,
+					       len, 1)) {
+				break;
 			}
+			store_msg(msgs[i], local_buf->data);
 		}
 	}
 	unlock_mm(mm);
 
-	if (ret != 0 && (mbox = get_mbox(id)) != NULL) {
-		bool local_intr;
-		local_intr_save(local_intr);
-		{
-			add_msg(mbox, msg, 0);
-		}
-		local_intr_restore(local_intr);
-		return ret;
+	j = got;
+	if (i < got && (mbox = get_mbox(id, &intr_flag)) != NULL) {
+		/* those not stored go back in front, in their order */
+		add_msgs(mbox, msgs + i, got - i, 0);
+		spin_unlock_irqrestore(&(mbox->lock), intr_flag);
+		j = i;
 	}
-	free_msg(msg);
-	return ret;
+	while (j > 0) {
+		free_msg(msgs[--j]);
+	}
+	return (i != 0) ? i : -E_INVAL;
+}
+
+int ipc_mbox_recv(int id, struct mboxbuf *buf, unsigned int timeout)
+{
+	int ret = ipc_mbox_recvm(id, buf, 1, timeout);
+	return (ret < 0) ? ret : 0;
 }
 
 int ipc_mbox_free(int id)
 {
 	struct msg_mbox *mbox;
-	if ((mbox = get_mbox(id)) == NULL) {
+	bool intr_flag;
+	if ((mbox = get_mbox(id, &intr_flag)) == NULL) {
 		return -E_INVAL;
 	}
-	bool intr_flag;
-	local_intr_save(intr_flag);
-	{
-		mbox->state = CLOSING;
+	list_entry_t msgs, *le;
+	list_init(&msgs);
 
-		list_entry_t *list = &(mbox->msg_link), *le;
-		while ((le = list_next(list)) != list) {
-			list_del(le);
-			free_msg(le2msg(le, msg_link));
-		}
-		wakeup_queue(&(mbox->senders), WT_INTERRUPTED, 1);
-		wakeup_queue(&(mbox->receivers), WT_INTERRUPTED, 1);
+	mbox->state = CLOSING;
+	mbox->slots = 0;
+	if (!list_empty(&(mbox->msg_link))) {
+		/* freed once the lock is released */
+		list_add(&(mbox->msg_link), &msgs);
+		list_del_init(&(mbox->msg_link));
+	}
+	wakeup_queue(&(mbox->senders), WT_INTERRUPTED, 1);
+	wakeup_queue(&(mbox->receivers), WT_INTERRUPTED, 1);
+	poll_head_kill(&(mbox->poll));
 
-		if (mbox->inuse == 0) {
-			mbox_free(mbox);
-		}
+	if (mbox->inuse == 0) {
+		mbox_free(mbox);
+	}
+	spin_unlock_irqrestore(&(mbox->lock), intr_flag);
+
+	while ((le = list_next(&msgs)) != &msgs) {
+		list_del(le);
+		free_msg(le2msg(le, msg_link));
 	}
-	local_intr_restore(intr_flag);
+	return 0;
+}
+
+// ipc_mbox_poll - IOCTL_POLL for an mbox: EPOLLIN if it holds a message,
+//               - EPOLLOUT if it has a free slot
+int ipc_mbox_poll(int id, struct poll_query *q)
+{
+	struct msg_mbox *mbox;
+	bool intr_flag;
+	if ((mbox = get_mbox(id, &intr_flag)) == NULL) {
+		return -E_INVAL;
+	}
+	q->events = ((mbox->slots != 0) ? EPOLLIN : 0)
+	    | ((mbox->slots < mbox->max_slots) ? EPOLLOUT : 0);
+	q->head = &(mbox->poll);
+	spin_unlock_irqrestore(&(mbox->lock), intr_flag);
 	return 0;
 }
 
 int ipc_mbox_info(int id, struct mboxinfo *info)
 {
 	struct msg_mbox *mbox;
-	if ((mbox = get_mbox(id)) == NULL) {
+	bool intr_flag;
+	if ((mbox = get_mbox(id, &intr_flag)) == NULL) {
 		return -E_INVAL;
 	}
 
@@ -514,6 +803,7 @@ int ipc_mbox_info(int id, struct mboxinfo *info)
 	local_info->inuse = (mbox->inuse != 0);
 	local_info->has_sender = !wait_queue_empty(&(mbox->senders));
 	local_info->has_receiver = !wait_queue_empty(&(mbox->receivers));
+	spin_unlock_irqrestore(&(mbox->lock), intr_flag);
 
 	int ret;
 
@@ -528,31 +818,49 @@ int ipc_mbox_info(int id, struct mboxinfo *info)
 	return ret;
 }
 
+// mbox_cleanup - free the pages whose mboxes are all closed, once the
+//              - lookups that may still see them are done
 void mbox_cleanup(void)
 {
+	list_entry_t dead, *le;
 	bool intr_flag;
-	local_intr_save(intr_flag);
-	{
-		int i, j;
-		for (i = 0; i < MAX_MBOX_PAGES; i++) {
-			struct msg_mbox *mbox;
-			if ((mbox = mbox_map[i]) != NULL) {
-				for (j = 0; j < MBOX_P_PAGE; j++, mbox++) {
-					if (mbox->state != CLOSED) {
-						break;
-					}
-				}
-				if (j != MBOX_P_PAGE) {
-					continue;
-				}
-				mbox = mbox_map[i];
-				for (j = 0; j < MBOX_P_PAGE; j++, mbox++) {
-					list_del(&(mbox->msg_link));
+	int i, j;
+	list_init(&dead);
+	spin_lock_irqsave(&mbox_map_lock, intr_flag);
+	/* the state of a closed mbox only changes under these */
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		spinlock_acquire(&(per_cpu_ptr(mbox_cpus, i)->lock));
+	}
+	for (i = 0; i < MAX_MBOX_PAGES; i++) {
+		struct msg_mbox *mbox;
+		if ((mbox = mbox_map[i]) != NULL) {
+			for (j = 0; j < MBOX_P_PAGE; j++, mbox++) {
+				if (mbox->state != CLOSED) {
+					break;
 				}
-				mbox = mbox_map[i], mbox_map[i] = NULL;
-				free_page(kva2page(mbox));
 			}
+			if (j != MBOX_P_PAGE) {
+				continue;
+			}
+			mbox = mbox_map[i];
+			for (j = 0; j < MBOX_P_PAGE; j++, mbox++) {
+				list_del(&(mbox->msg_link));
+			}
+			mbox = mbox_map[i], mbox_map[i] = NULL;
+			list_add(&dead, &(mbox->msg_link));
 		}
 	}
-	local_intr_restore(intr_flag);
+	for (i = sysconf.lcpu_count - 1; i >= 0; i--) {
+		spinlock_release(&(per_cpu_ptr(mbox_cpus, i)->lock));
+	}
+	spin_unlock_irqrestore(&mbox_map_lock, intr_flag);
+
+	if (list_empty(&dead)) {
+		return;
+	}
+	synchronize_rcu();
+	while ((le = list_next(&dead)) != &dead) {
+		list_del(le);
+		free_page(kva2page(le2mbox(le, msg_link)));
+	}
 }
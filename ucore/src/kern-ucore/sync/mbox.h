@@ -7,12 +7,16 @@ void mbox_init(void);
 
 struct mboxbuf;
 struct mboxinfo;
+struct poll_query;
 
 int ipc_mbox_init(unsigned int max_slots);
 int ipc_mbox_send(int id, struct mboxbuf *buf, unsigned int timeout);
 int ipc_mbox_recv(int id, struct mboxbuf *buf, unsigned int timeout);
+int ipc_mbox_sendm(int id, struct mboxbuf *bufs, int n, unsigned int timeout);
+int ipc_mbox_recvm(int id, struct mboxbuf *bufs, int n, unsigned int timeout);
 int ipc_mbox_free(int id);
 int ipc_mbox_info(int id, struct mboxinfo *info);
+int ipc_mbox_poll(int id, struct poll_query *q);
 
 void mbox_cleanup(void);
 
@@ -0,0 +1,72 @@
+#include <types.h>
+#include <list.h>
+#include <sync.h>
+#include <poll.h>
+#include <assert.h>
+
+#define le2pentry(le, member)           \
+    to_struct((le), poll_entry_t, member)
+
+void poll_head_init(poll_head_t * head)
+{
+	list_init(&(head->poll_list));
+	spinlock_init(&head->lock);
+}
+
+void poll_add(poll_head_t * head, poll_entry_t * entry, poll_notify_t notify)
+{
+	bool intr_flag;
+	entry->head = head, entry->notify = notify;
+	spin_lock_irqsave(&head->lock, intr_flag);
+	list_add_before(&(head->poll_list), &(entry->poll_link));
+	spin_unlock_irqrestore(&head->lock, intr_flag);
+}
+
+// poll_del - drop the interest of entry, if its source still exists
+// NOTE: the heads of the sources are never freed while an entry may still
+//       point to them, only killed, so head can be locked before the check
+void poll_del(poll_entry_t * entry)
+{
+	bool intr_flag;
+	poll_head_t *head;
+	if ((head = entry->head) != NULL) {
+		spin_lock_irqsave(&head->lock, intr_flag);
+		if (entry->head == head) {
+			list_del(&(entry->poll_link));
+			entry->head = NULL;
+		}
+		spin_unlock_irqrestore(&head->lock, intr_flag);
+	}
+}
+
+void poll_notify(poll_head_t * head, uint32_t events)
+{
+	bool intr_flag;
+	/* nobody polls most of the sources, don't lock for them */
+	if (list_empty(&(head->poll_list))) {
+		return;
+	}
+	spin_lock_irqsave(&head->lock, intr_flag);
+	list_entry_t *list = &(head->poll_list), *le = list;
+	while ((le = list_next(le)) != list) {
+		poll_entry_t *entry = le2pentry(le, poll_link);
+		entry->notify(entry, events);
+	}
+	spin_unlock_irqrestore(&head->lock, intr_flag);
+}
+
+// poll_head_kill - the source is going away: tell the pollers it hung up
+//                - and detach them
+void poll_head_kill(poll_head_t * head)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&head->lock, intr_flag);
+	list_entry_t *list = &(head->poll_list), *le;
+	while ((le = list_next(list)) != list) {
+		poll_entry_t *entry = le2pentry(le, poll_link);
+		list_del(le);
+		entry->head = NULL;
+		entry->notify(entry, EPOLLHUP);
+	}
+	spin_unlock_irqrestore(&head->lock, intr_flag);
+}
@@ -0,0 +1,46 @@
+#ifndef __KERN_SYNC_POLL_H__
+#define __KERN_SYNC_POLL_H__
+
+#include <types.h>
+#include <list.h>
+#include <spinlock.h>
+#include <epoll.h>
+
+/* *
+ * poll_head - where a source of events (a pipe, stdin, an mbox) tells its
+ * pollers that it may have turned ready. A poll_entry is the interest of
+ * a poller in one head: notify is called with the events that happened,
+ * from whatever context the source is in, interrupts included, so it must
+ * only take spinlocks. The poller asks the source what is really ready.
+ * */
+typedef struct poll_head {
+	list_entry_t poll_list;
+	spinlock_s lock;
+} poll_head_t;
+
+struct poll_entry;
+
+typedef void (*poll_notify_t) (struct poll_entry * entry, uint32_t events);
+
+typedef struct poll_entry {
+	poll_head_t *head;	/* NULL once the source is gone */
+	poll_notify_t notify;
+	list_entry_t poll_link;
+} poll_entry_t;
+
+/* vop_ioctl and dop_ioctl op for the sources: the events ready at once,
+ * and the head their changes are notified on, with struct poll_query */
+#define IOCTL_POLL                  0x7001
+
+struct poll_query {
+	uint32_t events;
+	poll_head_t *head;
+};
+
+void poll_head_init(poll_head_t * head);
+void poll_add(poll_head_t * head, poll_entry_t * entry, poll_notify_t notify);
+void poll_del(poll_entry_t * entry);
+void poll_notify(poll_head_t * head, uint32_t events);
+void poll_head_kill(poll_head_t * head);
+
+#endif /* !__KERN_SYNC_POLL_H__ */
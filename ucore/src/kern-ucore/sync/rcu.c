@@ -0,0 +1,226 @@
+#include <types.h>
+#include <list.h>
+#include <atomic.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <mp.h>
+#include <percpu.h>
+#include <sysconf.h>
+#include <proc.h>
+#include <assert.h>
+#include <softirq.h>
+#include <rcu.h>
+
+/* *
+ * Read-copy-update, detected by quiescent states: a reader walks a table
+ * or a list without a lock, under rcu_read_lock, and a writer takes an
+ * object off it under its own lock and frees it with call_rcu, which runs
+ * the free once every reader that may still see the object is gone.
+ *
+ * A cpu passes a quiescent state, where it holds no reference taken under
+ * rcu_read_lock, each time it switches procs in schedule() and each tick
+ * it idles. Time is cut into epochs: at its tick a cpu which has passed a
+ * quiescent state in the current epoch is counted, and the last counted
+ * starts the next epoch. A callback queued in epoch e is run in e + 2, for
+ * all the cpus have passed a quiescent state after it was queued then. The
+ * callbacks of a cpu run in its RCU_SOFTIRQ, and may not sleep.
+ *
+ * The epochs only move on while someone waits for them; a cpu stopping its
+ * tick to idle, see timer_nohz_enter, is counted in every epoch until it
+ * takes its tick back.
+ * */
+
+struct rcu_data {
+	unsigned int epoch;	// the last epoch this cpu was counted in
+	unsigned int qs_epoch;	// the epoch of its last quiescent state
+	bool idle;		// tickless, counted in every epoch
+	list_entry_t cbs;	// the callbacks queued here, oldest first
+	int nr_cbs;
+};
+
+static DEFINE_PERCPU_NOINIT(struct rcu_data, rcu_datas);
+
+static volatile unsigned int rcu_epoch;
+static int rcu_left;		// the cpus not yet counted in rcu_epoch
+static atomic_t rcu_pending;	// the callbacks and synchronize_rcu waiting
+static spinlock_s rcu_lock;
+
+#define le2rcu(le, member)          to_struct((le), struct rcu_head, member)
+
+static inline bool epoch_reached(unsigned int epoch)
+{
+	return (int)(rcu_epoch - epoch) >= 0;
+}
+
+static void rcu_process_callbacks(void);
+
+void rcu_init(void)
+{
+	int i;
+	spinlock_init(&rcu_lock);
+	rcu_epoch = 0;
+	rcu_left = sysconf.lcpu_count;
+	atomic_set(&rcu_pending, 0);
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct rcu_data *rd = per_cpu_ptr(rcu_datas, i);
+		rd->epoch = rd->qs_epoch = (unsigned int)-1;
+		rd->idle = 0;
+		list_init(&(rd->cbs));
+		rd->nr_cbs = 0;
+	}
+	open_softirq(RCU_SOFTIRQ, rcu_process_callbacks);
+}
+
+// rcu_advance_locked - start the next epoch, in which the idle cpus are
+//                    - counted already
+static void rcu_advance_locked(void)
+{
+	int i;
+	rcu_epoch++;
+	rcu_left = sysconf.lcpu_count;
+	for (i = 0; i < sysconf.lcpu_count; i++) {
+		struct rcu_data *rd = per_cpu_ptr(rcu_datas, i);
+		if (rd->idle) {
+			rd->epoch = rcu_epoch;
+			rcu_left--;
+		}
+	}
+}
+
+static void rcu_count_locked(struct rcu_data *rd)
+{
+	rd->epoch = rcu_epoch;
+	if (--rcu_left == 0) {
+		rcu_advance_locked();
+	}
+}
+
+// rcu_note_qs - this cpu is switching procs, called by schedule()
+void rcu_note_qs(void)
+{
+	get_cpu_ptr(rcu_datas)->qs_epoch = rcu_epoch;
+}
+
+// rcu_tick - count this cpu in the epoch and raise the softirq for its
+//          - callbacks due, called by run_timer_list with interrupts disabled
+void rcu_tick(void)
+{
+	struct rcu_data *rd = get_cpu_ptr(rcu_datas);
+	if (current == idleproc) {
+		rd->qs_epoch = rcu_epoch;
+	}
+	if (rd->epoch != rcu_epoch && rd->qs_epoch == rcu_epoch
+	    && atomic_read(&rcu_pending) != 0) {
+		spinlock_acquire(&rcu_lock);
+		if (rd->epoch != rcu_epoch && rd->qs_epoch == rcu_epoch) {
+			rcu_count_locked(rd);
+		}
+		spinlock_release(&rcu_lock);
+	}
+
+	list_entry_t *le = list_next(&(rd->cbs));
+	if (le != &(rd->cbs) && epoch_reached(le2rcu(le, link)->epoch)) {
+		raise_softirq(RCU_SOFTIRQ);
+	}
+}
+
+// rcu_process_callbacks - run the callbacks of this cpu which are due, one
+//                       - at a time with interrupts enabled
+static void rcu_process_callbacks(void)
+{
+	bool intr_flag;
+	while (1) {
+		struct rcu_head *head = NULL;
+		local_intr_save(intr_flag);
+		{
+			struct rcu_data *rd = get_cpu_ptr(rcu_datas);
+			list_entry_t *le = list_next(&(rd->cbs));
+			if (le != &(rd->cbs)
+			    && epoch_reached(le2rcu(le, link)->epoch)) {
+				head = le2rcu(le, link);
+				list_del(le);
+				rd->nr_cbs--;
+				atomic_dec(&rcu_pending);
+			}
+		}
+		local_intr_restore(intr_flag);
+		if (head == NULL) {
+			break;
+		}
+		head->func(head);
+	}
+}
+
+#ifdef UCONFIG_NO_HZ_IDLE
+// rcu_idle_enter - this cpu is stopping its tick to idle, so it is counted
+//                - in every epoch until rcu_idle_exit; false if it has
+//                - callbacks to run and must keep its tick.
+//                - Called with interrupts disabled.
+bool rcu_idle_enter(void)
+{
+	struct rcu_data *rd = get_cpu_ptr(rcu_datas);
+	if (rd->nr_cbs != 0) {
+		return 0;
+	}
+	spinlock_acquire(&rcu_lock);
+	rd->idle = 1;
+	if (rd->epoch != rcu_epoch) {
+		rcu_count_locked(rd);
+	}
+	spinlock_release(&rcu_lock);
+	return 1;
+}
+
+void rcu_idle_exit(void)
+{
+	struct rcu_data *rd = get_cpu_ptr(rcu_datas);
+	spinlock_acquire(&rcu_lock);
+	rd->idle = 0;
+	/* all the cpus idled through the end of the epoch */
+	if (rcu_left == 0) {
+		rcu_advance_locked();
+	}
+	spinlock_release(&rcu_lock);
+}
+#endif
+
+// call_rcu - run func(head) once the readers, which may still see the
+//          - object of head taken off its table, are gone
+void call_rcu(struct rcu_head *head, void (*func) (struct rcu_head * head))
+{
+	bool intr_flag;
+	head->func = func;
+	/* taken off before the epoch is read */
+	__sync_synchronize();
+	local_intr_save(intr_flag);
+	{
+		struct rcu_data *rd = get_cpu_ptr(rcu_datas);
+		head->epoch = rcu_epoch + 2;
+		list_add_before(&(rd->cbs), &(head->link));
+		rd->nr_cbs++;
+		atomic_inc(&rcu_pending);
+	}
+	local_intr_restore(intr_flag);
+}
+
+// synchronize_rcu - wait until the readers, which may see what has been
+//                 - taken off by now, are gone
+void synchronize_rcu(void)
+{
+	__sync_synchronize();
+	unsigned int epoch = rcu_epoch + 2;
+	atomic_inc(&rcu_pending);
+	while (!epoch_reached(epoch)) {
+		do_sleep(1);
+	}
+	atomic_dec(&rcu_pending);
+}
+
+// rcu_drain - wait until the callbacks queued by now have run, for the
+//           - memory checks of init_main
+void rcu_drain(void)
+{
+	synchronize_rcu();
+	/* and the cpus run them at their next softirqs */
+	do_sleep(2);
+}
@@ -0,0 +1,42 @@
+#ifndef __KERN_SYNC_RCU_H__
+#define __KERN_SYNC_RCU_H__
+
+#include <types.h>
+#include <list.h>
+#include <sched.h>
+#include <memorder.h>
+
+/* *
+ * rcu_head - embedded in an object whose freeing is deferred by call_rcu
+ * until the readers which may still see it are gone, see rcu.c
+ * */
+struct rcu_head {
+	list_entry_t link;	// in the callbacks of the cpu that queued it
+	unsigned int epoch;	// the epoch in which func may run
+	void (*func) (struct rcu_head * head);
+};
+
+/* *
+ * A read-side critical section may not sleep, nor switch away in any other
+ * way; with UCONFIG_PREEMPT it is not preempted either.
+ * */
+#define rcu_read_lock()             preempt_disable()
+#define rcu_read_unlock()           preempt_enable()
+
+/* a pointer read under rcu_read_lock, and one published to such readers:
+ * the object is initialized before it can be seen */
+#define rcu_dereference(p)          READ_ONCE(p)
+#define rcu_assign_pointer(p, v)    smp_store_release(&(p), (v))
+
+void rcu_init(void);
+void rcu_note_qs(void);
+void rcu_tick(void);
+#ifdef UCONFIG_NO_HZ_IDLE
+bool rcu_idle_enter(void);
+void rcu_idle_exit(void);
+#endif
+void call_rcu(struct rcu_head *head, void (*func) (struct rcu_head * head));
+void synchronize_rcu(void);
+void rcu_drain(void);
+
+#endif /* !__KERN_SYNC_RCU_H__ */
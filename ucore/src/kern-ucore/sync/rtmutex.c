@@ -0,0 +1,287 @@
+#include <types.h>
+#include <list.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <proc.h>
+#include <sched.h>
+#include <ipc.h>
+#include <error.h>
+#include <assert.h>
+#include <rtmutex.h>
+
+/* *
+ * All the rt_mutexes, and the pi_xxx of the procs, are under pi_lock: a
+ * change of a waiter may have to be carried down a whole chain of owners,
+ * each waiting for the next rt_mutex, and one lock keeps the chain still
+ * meanwhile. It nests inside the locks of the futex buckets and outside
+ * those of the procs and the run queues.
+ *
+ * The priority a waiter passes on is that of its realtime policy, boosts
+ * included, 0 for SCHED_NORMAL, so only realtime waiters boost an owner:
+ * pi_prio of the owner is the highest of its waiters, and sched_set_pi_prio
+ * schedules it as SCHED_FIFO at that priority if it is above its own.
+ * */
+
+/* bounds a chain walk, past it the waiters may be left unboosted */
+#define RT_MUTEX_CHAIN_MAX          1024
+
+static spinlock_s pi_lock;
+
+#define le2waiter(le, member)       to_struct((le), struct rt_mutex_waiter, member)
+#define le2rtmutex(le, member)      to_struct((le), struct rt_mutex, member)
+
+void rt_mutex_init(rt_mutex_t * mutex)
+{
+	mutex->owner = NULL;
+	list_init(&(mutex->waiters));
+	list_init(&(mutex->held_link));
+}
+
+static inline int rt_mutex_prio(struct proc_struct *proc)
+{
+	return (proc->policy != SCHED_NORMAL) ? proc->rt_priority : 0;
+}
+
+static inline int rt_mutex_top_prio(rt_mutex_t * mutex)
+{
+	if (list_empty(&(mutex->waiters))) {
+		return 0;
+	}
+	return le2waiter(list_next(&(mutex->waiters)), link)->prio;
+}
+
+// waiter_enqueue - behind the waiters of mutex as urgent as waiter at least
+static void waiter_enqueue(rt_mutex_t * mutex, struct rt_mutex_waiter *waiter)
+{
+	list_entry_t *list = &(mutex->waiters), *le = list;
+	while ((le = list_next(le)) != list) {
+		if (le2waiter(le, link)->prio < waiter->prio) {
+			break;
+		}
+	}
+	list_add_before(le, &(waiter->link));
+}
+
+// pi_adjust - pi_prio of proc after the waiters of what it holds, true if
+//           - it changed
+static bool pi_adjust(struct proc_struct *proc)
+{
+	list_entry_t *list = &(proc->pi_held), *le = list;
+	int prio = 0, top;
+	while ((le = list_next(le)) != list) {
+		if ((top = rt_mutex_top_prio(le2rtmutex(le, held_link))) > prio) {
+			prio = top;
+		}
+	}
+	if (prio == proc->pi_prio) {
+		return 0;
+	}
+	sched_set_pi_prio(proc, prio);
+	return 1;
+}
+
+// pi_chain_walk - the waiters of mutex changed, carry it to its owner, and
+//               - on to the owners it waits for while their priority changes
+static void pi_chain_walk(rt_mutex_t * mutex)
+{
+	struct proc_struct *owner;
+	struct rt_mutex_waiter *waiter;
+	int depth = 0;
+	while ((owner = mutex->owner) != NULL && depth++ < RT_MUTEX_CHAIN_MAX) {
+		if (!pi_adjust(owner) || (waiter = owner->pi_blocked_on) == NULL) {
+			break;
+		}
+		/* in the next rt_mutex by its new priority */
+		mutex = waiter->mutex;
+		list_del(&(waiter->link));
+		waiter->prio = rt_mutex_prio(owner);
+		waiter_enqueue(mutex, waiter);
+	}
+}
+
+// rt_mutex_deadlock - whether current waiting for mutex would close a cycle
+static bool rt_mutex_deadlock(rt_mutex_t * mutex)
+{
+	struct proc_struct *owner;
+	int depth = 0;
+	while ((owner = mutex->owner) != NULL && depth++ < RT_MUTEX_CHAIN_MAX) {
+		if (owner == current) {
+			return 1;
+		}
+		if (owner->pi_blocked_on == NULL) {
+			break;
+		}
+		mutex = owner->pi_blocked_on->mutex;
+	}
+	return 0;
+}
+
+static void __rt_mutex_take(rt_mutex_t * mutex, struct proc_struct *owner)
+{
+	mutex->owner = owner;
+	list_add(&(owner->pi_held), &(mutex->held_link));
+}
+
+// __rt_mutex_release - the owner lets mutex go, to its first waiter if any
+static void __rt_mutex_release(rt_mutex_t * mutex)
+{
+	struct proc_struct *owner = mutex->owner;
+	list_del_init(&(mutex->held_link));
+	mutex->owner = NULL;
+	if (!list_empty(&(mutex->waiters))) {
+		struct rt_mutex_waiter *waiter =
+		    le2waiter(list_next(&(mutex->waiters)), link);
+		struct proc_struct *proc = waiter->proc;
+		list_del_init(&(waiter->link));
+		proc->pi_blocked_on = NULL;
+		__rt_mutex_take(mutex, proc);
+		pi_adjust(proc);
+		if (proc->state != PROC_RUNNABLE) {
+			/* not already woken by its timer or a signal */
+			wakeup_proc(proc);
+		}
+	}
+	pi_adjust(owner);
+}
+
+// rt_mutex_start_wait - take mutex if it is free and return 0, else queue
+//                     - current as waiter and boost the owners, return 1;
+//                     - -E_DEADLK if current holds it down the chain
+int rt_mutex_start_wait(rt_mutex_t * mutex, struct rt_mutex_waiter *waiter)
+{
+	bool intr_flag;
+	int ret = 0;
+	spin_lock_irqsave(&pi_lock, intr_flag);
+	if (mutex->owner == NULL) {
+		__rt_mutex_take(mutex, current);
+	} else if (rt_mutex_deadlock(mutex)) {
+		ret = -E_DEADLK;
+	} else {
+		waiter->proc = current;
+		waiter->mutex = mutex;
+		waiter->prio = rt_mutex_prio(current);
+		waiter_enqueue(mutex, waiter);
+		current->pi_blocked_on = waiter;
+		pi_chain_walk(mutex);
+		ret = 1;
+	}
+	spin_unlock_irqrestore(&pi_lock, intr_flag);
+	return ret;
+}
+
+// rt_mutex_finish_wait - sleep in wait_state until waiter is handed mutex,
+//                      - return 0 then; -1 if woken by timer or a signal
+//                      - first, out of the waiters again
+int rt_mutex_finish_wait(rt_mutex_t * mutex, struct rt_mutex_waiter *waiter,
+			 timer_t * timer, uint32_t wait_state)
+{
+	bool intr_flag;
+	int ret = 0;
+	spin_lock_irqsave(&pi_lock, intr_flag);
+	while (mutex->owner != current) {
+		current->state = PROC_SLEEPING;
+		current->wait_state = wait_state;
+		ipc_add_timer(timer);
+		spin_unlock_irqrestore(&pi_lock, intr_flag);
+
+		schedule();
+
+		spin_lock_irqsave(&pi_lock, intr_flag);
+		ipc_del_timer(timer);
+		if (mutex->owner != current && (wait_state & WT_INTERRUPTED)) {
+			list_del_init(&(waiter->link));
+			current->pi_blocked_on = NULL;
+			/* the owner may not need the boost any more */
+			pi_chain_walk(mutex);
+			ret = -1;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&pi_lock, intr_flag);
+	return ret;
+}
+
+void rt_mutex_lock(rt_mutex_t * mutex)
+{
+	struct rt_mutex_waiter waiter;
+	int ret;
+	if ((ret = rt_mutex_start_wait(mutex, &waiter)) == 1) {
+		ret = rt_mutex_finish_wait(mutex, &waiter, NULL, WT_KSEM);
+	}
+	if (ret != 0) {
+		panic("rt_mutex deadlock.\n");
+	}
+}
+
+bool rt_mutex_trylock(rt_mutex_t * mutex)
+{
+	bool intr_flag, ret = 0;
+	spin_lock_irqsave(&pi_lock, intr_flag);
+	if (mutex->owner == NULL) {
+		__rt_mutex_take(mutex, current);
+		ret = 1;
+	}
+	spin_unlock_irqrestore(&pi_lock, intr_flag);
+	return ret;
+}
+
+void rt_mutex_unlock(rt_mutex_t * mutex)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&pi_lock, intr_flag);
+	assert(mutex->owner == current);
+	__rt_mutex_release(mutex);
+	spin_unlock_irqrestore(&pi_lock, intr_flag);
+}
+
+bool rt_mutex_has_waiters(rt_mutex_t * mutex)
+{
+	return !list_empty(&(mutex->waiters));
+}
+
+// rt_mutex_proxy_lock - have owner hold the free mutex on its behalf,
+//                     - -E_SRCH if it is exiting
+int rt_mutex_proxy_lock(rt_mutex_t * mutex, struct proc_struct *owner)
+{
+	bool intr_flag;
+	int ret = 0;
+	spin_lock_irqsave(&pi_lock, intr_flag);
+	assert(mutex->owner == NULL);
+	if (owner->pi_exited) {
+		ret = -E_SRCH;
+	} else {
+		__rt_mutex_take(mutex, owner);
+		pi_adjust(owner);
+	}
+	spin_unlock_irqrestore(&pi_lock, intr_flag);
+	return ret;
+}
+
+// rt_mutex_proxy_unlock - free mutex, without waiters, on behalf of its owner
+void rt_mutex_proxy_unlock(rt_mutex_t * mutex)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&pi_lock, intr_flag);
+	assert(list_empty(&(mutex->waiters)));
+	if (mutex->owner != NULL) {
+		__rt_mutex_release(mutex);
+	}
+	spin_unlock_irqrestore(&pi_lock, intr_flag);
+}
+
+// rt_mutex_proc_exit - proc is exiting: what it still holds is orphaned,
+//                    - its waiters stay asleep as they would on a lost lock,
+//                    - and nothing may be proxied to it any more
+void rt_mutex_proc_exit(struct proc_struct *proc)
+{
+	bool intr_flag;
+	list_entry_t *le;
+	spin_lock_irqsave(&pi_lock, intr_flag);
+	assert(proc->pi_blocked_on == NULL);
+	while ((le = list_next(&(proc->pi_held))) != &(proc->pi_held)) {
+		list_del_init(le);
+		le2rtmutex(le, held_link)->owner = NULL;
+	}
+	proc->pi_exited = 1;
+	spin_unlock_irqrestore(&pi_lock, intr_flag);
+}
@@ -0,0 +1,48 @@
+#ifndef __KERN_SYNC_RTMUTEX_H__
+#define __KERN_SYNC_RTMUTEX_H__
+
+#include <types.h>
+#include <list.h>
+#include <sched.h>
+
+struct proc_struct;
+
+/* *
+ * rt_mutex - a sleeping lock with priority inheritance, for the paths a
+ * realtime proc may wait on. Its owner runs at the priority of the most
+ * urgent proc waiting for any rt_mutex it holds, as SCHED_FIFO if that is
+ * above its own, and so does the owner of the rt_mutex that one waits for
+ * in turn, down the chain. The unlock hands it to the most urgent waiter,
+ * the first come among equals. See rtmutex.c.
+ * */
+typedef struct rt_mutex {
+	struct proc_struct *owner;	// NULL when free
+	list_entry_t waiters;	// rt_mutex_waiter, the most urgent first
+	list_entry_t held_link;	// in the pi_held of owner
+} rt_mutex_t;
+
+// rt_mutex_waiter - a proc waiting for an rt_mutex, on its kernel stack
+struct rt_mutex_waiter {
+	list_entry_t link;	// in the waiters of mutex
+	struct proc_struct *proc;
+	struct rt_mutex *mutex;
+	int prio;		// of proc when it was queued, see rt_mutex_prio
+};
+
+void rt_mutex_init(rt_mutex_t * mutex);
+void rt_mutex_lock(rt_mutex_t * mutex);
+bool rt_mutex_trylock(rt_mutex_t * mutex);
+void rt_mutex_unlock(rt_mutex_t * mutex);
+bool rt_mutex_has_waiters(rt_mutex_t * mutex);
+
+/* for the pi futexes, whose rt_mutex is held by a proc which took the
+ * futex in user space and does not know about it, see futex.c */
+int rt_mutex_proxy_lock(rt_mutex_t * mutex, struct proc_struct *owner);
+void rt_mutex_proxy_unlock(rt_mutex_t * mutex);
+int rt_mutex_start_wait(rt_mutex_t * mutex, struct rt_mutex_waiter *waiter);
+int rt_mutex_finish_wait(rt_mutex_t * mutex, struct rt_mutex_waiter *waiter,
+			 timer_t * timer, uint32_t wait_state);
+
+void rt_mutex_proc_exit(struct proc_struct *proc);
+
+#endif /* !__KERN_SYNC_RTMUTEX_H__ */
@@ -0,0 +1,185 @@
+#include <types.h>
+#include <wait.h>
+#include <rwsem.h>
+#include <proc.h>
+#include <sched.h>
+#include <sync.h>
+#include <assert.h>
+
+/* *
+ * Like the kernel semaphores, the lock is handed over: the releaser sets
+ * count for the procs it wakes up, so a woken waiter already owns the
+ * lock when it runs. wait_state tells the queued readers (WT_KSEM_SHARED)
+ * from the writers (WT_KSEM).
+ * */
+
+void rwsem_init(rwsem_t * rwsem)
+{
+	rwsem->count = 0;
+	spinlock_init(&rwsem->lock);
+	wait_queue_init(&(rwsem->wait_queue));
+#ifdef UCONFIG_LOCK_STAT
+	lock_stat_clear(&rwsem->stat);
+#endif
+}
+
+// rwsem_wake - hand a free rwsem to the head of its queue, rwsem->lock held
+static void rwsem_wake(rwsem_t * rwsem)
+{
+	wait_t *wait;
+	assert(rwsem->count == 0);
+	if ((wait = wait_queue_first(&(rwsem->wait_queue))) == NULL) {
+		return;
+	}
+	if (wait->proc->wait_state == WT_KSEM) {
+		rwsem->count = -1;
+		wakeup_wait(&(rwsem->wait_queue), wait, WT_KSEM, 1);
+		return;
+	}
+	do {
+		assert(wait->proc->wait_state == WT_KSEM_SHARED);
+		rwsem->count++;
+		wakeup_wait(&(rwsem->wait_queue), wait, WT_KSEM_SHARED, 1);
+	} while ((wait = wait_queue_first(&(rwsem->wait_queue))) != NULL
+		 && wait->proc->wait_state == WT_KSEM_SHARED);
+}
+
+// rwsem_sleep - queue current until a release hands it the lock, with
+//             - rwsem->lock held and intr_flag saved by the caller
+static void rwsem_sleep(rwsem_t * rwsem, uint32_t wait_state, bool intr_flag)
+{
+	wait_t __wait, *wait = &__wait;
+	wait_current_set(&(rwsem->wait_queue), wait, wait_state);
+	spin_unlock_irqrestore(&rwsem->lock, intr_flag);
+
+	schedule();
+
+	spin_lock_irqsave(&rwsem->lock, intr_flag);
+	wait_current_del(&(rwsem->wait_queue), wait);
+	spin_unlock_irqrestore(&rwsem->lock, intr_flag);
+	assert(wait->wakeup_flags == wait_state);
+}
+
+/* *
+ * Only the rwsems given a class are counted. A writer is timed from the
+ * down to the up, like a spinlock; the readers only count their waits,
+ * lock_stat_shared.
+ * */
+#ifdef UCONFIG_LOCK_STAT
+#define rwsem_stat_start()          lock_stat_spin_start()
+#define rwsem_stat_read(rwsem, start, contended, site)                  \
+    do {                                                                \
+        if ((rwsem)->stat.name != NULL) {                               \
+            lock_stat_shared(&(rwsem)->stat, start, contended, site);   \
+        }                                                               \
+    } while (0)
+#define rwsem_stat_write(rwsem, start, contended, site)                 \
+    do {                                                                \
+        if ((rwsem)->stat.name != NULL) {                               \
+            lock_stat_acquired(&(rwsem)->stat, start, contended, site); \
+        }                                                               \
+    } while (0)
+#define rwsem_stat_released(rwsem)                                      \
+    do {                                                                \
+        if ((rwsem)->stat.name != NULL) {                               \
+            lock_stat_released(&(rwsem)->stat);                         \
+        }                                                               \
+    } while (0)
+#else
+#define rwsem_stat_start()          0
+#define rwsem_stat_read(rwsem, start, contended, site)      do { } while (0)
+#define rwsem_stat_write(rwsem, start, contended, site)     do { } while (0)
+#define rwsem_stat_released(rwsem)                          do { } while (0)
+#endif
+
+void down_read_site(rwsem_t * rwsem, uintptr_t site)
+{
+	bool intr_flag;
+	uint64_t start = rwsem_stat_start();
+	spin_lock_irqsave(&rwsem->lock, intr_flag);
+	if (rwsem->count >= 0 && wait_queue_empty(&(rwsem->wait_queue))) {
+		rwsem->count++;
+		spin_unlock_irqrestore(&rwsem->lock, intr_flag);
+		rwsem_stat_read(rwsem, start, 0, site);
+		return;
+	}
+	rwsem_sleep(rwsem, WT_KSEM_SHARED, intr_flag);
+	rwsem_stat_read(rwsem, start, 1, site);
+}
+
+void down_read(rwsem_t * rwsem)
+{
+	down_read_site(rwsem, (uintptr_t) __builtin_return_address(0));
+}
+
+bool try_down_read(rwsem_t * rwsem)
+{
+	bool intr_flag, ret = 0;
+	spin_lock_irqsave(&rwsem->lock, intr_flag);
+	if (rwsem->count >= 0 && wait_queue_empty(&(rwsem->wait_queue))) {
+		rwsem->count++, ret = 1;
+	}
+	spin_unlock_irqrestore(&rwsem->lock, intr_flag);
+	if (ret) {
+		rwsem_stat_read(rwsem, rwsem_stat_start(), 0,
+				(uintptr_t) __builtin_return_address(0));
+	}
+	return ret;
+}
+
+void up_read(rwsem_t * rwsem)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&rwsem->lock, intr_flag);
+	assert(rwsem->count > 0);
+	if (--rwsem->count == 0) {
+		rwsem_wake(rwsem);
+	}
+	spin_unlock_irqrestore(&rwsem->lock, intr_flag);
+}
+
+void down_write_site(rwsem_t * rwsem, uintptr_t site)
+{
+	bool intr_flag;
+	uint64_t start = rwsem_stat_start();
+	spin_lock_irqsave(&rwsem->lock, intr_flag);
+	if (rwsem->count == 0) {
+		rwsem->count = -1;
+		spin_unlock_irqrestore(&rwsem->lock, intr_flag);
+		rwsem_stat_write(rwsem, start, 0, site);
+		return;
+	}
+	rwsem_sleep(rwsem, WT_KSEM, intr_flag);
+	rwsem_stat_write(rwsem, start, 1, site);
+}
+
+void down_write(rwsem_t * rwsem)
+{
+	down_write_site(rwsem, (uintptr_t) __builtin_return_address(0));
+}
+
+bool try_down_write(rwsem_t * rwsem)
+{
+	bool intr_flag, ret = 0;
+	spin_lock_irqsave(&rwsem->lock, intr_flag);
+	if (rwsem->count == 0) {
+		rwsem->count = -1, ret = 1;
+	}
+	spin_unlock_irqrestore(&rwsem->lock, intr_flag);
+	if (ret) {
+		rwsem_stat_write(rwsem, rwsem_stat_start(), 0,
+				 (uintptr_t) __builtin_return_address(0));
+	}
+	return ret;
+}
+
+void up_write(rwsem_t * rwsem)
+{
+	bool intr_flag;
+	spin_lock_irqsave(&rwsem->lock, intr_flag);
+	assert(rwsem->count == -1);
+	rwsem_stat_released(rwsem);
+	rwsem->count = 0;
+	rwsem_wake(rwsem);
+	spin_unlock_irqrestore(&rwsem->lock, intr_flag);
+}
@@ -0,0 +1,40 @@
+#ifndef __KERN_SYNC_RWSEM_H__
+#define __KERN_SYNC_RWSEM_H__
+
+#include <types.h>
+#include <wait.h>
+#include <spinlock.h>
+
+/* *
+ * rw_semaphore - a sleeping lock held by many readers or by one writer.
+ * count is the number of readers holding it, -1 when a writer does.
+ * Waiters queue in FIFO order: a reader arriving behind a waiting writer
+ * waits too, so a stream of readers cannot starve the writers; a release
+ * hands the lock to the first writer or to the whole run of readers at
+ * the head of the queue.
+ * */
+typedef struct rw_semaphore {
+	int count;
+	wait_queue_t wait_queue;
+	spinlock_s lock;
+#ifdef UCONFIG_LOCK_STAT
+	struct lock_stat stat;	/* counted once given a class, lock_stat_class */
+#endif
+} rwsem_t;
+
+void rwsem_init(rwsem_t * rwsem);
+void down_read(rwsem_t * rwsem);
+void up_read(rwsem_t * rwsem);
+bool try_down_read(rwsem_t * rwsem);
+void down_write(rwsem_t * rwsem);
+void up_write(rwsem_t * rwsem);
+bool try_down_write(rwsem_t * rwsem);
+
+/* *
+ * The same, counted by lock statistics at site instead of at the caller,
+ * for the wrappers of a lock such as lock_mm to give their own caller.
+ * */
+void down_read_site(rwsem_t * rwsem, uintptr_t site);
+void down_write_site(rwsem_t * rwsem, uintptr_t site);
+
+#endif /* !__KERN_SYNC_RWSEM_H__ */
@@ -10,6 +10,8 @@
 #include <assert.h>
 #include <error.h>
 #include <clock.h>
+#include <stdlib.h>
+#include <rcu.h>
 
 /*  ------------- semaphore mechanism design&implementation -------------
   ucore offers two kinds of semaphores: Kernel semaphores, which are used by kernel control paths; 
@@ -53,25 +55,13 @@ void sem_init(semaphore_t * sem, int value)
 	sem->value = value;
 	sem->valid = 1;
 	spinlock_init(&sem->lock);
-#ifdef UCONFIG_BIONIC_LIBC
-	sem->addr = 0;		//-1 : // Not for futex
-#endif //UCONFIG_BIONIC_LIBC
 	set_sem_count(sem, 0);
 	wait_queue_init(&(sem->wait_queue));
+#ifdef UCONFIG_LOCK_STAT
+	lock_stat_clear(&sem->stat);
+#endif
 }
 
-#ifdef UCONFIG_BIONIC_LIBC
-void sem_init_with_address(semaphore_t * sem, uintptr_t addr, int value)
-{
-	sem->value = value;
-	sem->addr = addr;
-	sem->valid = 1;
-	spinlock_init(&sem->lock);
-	set_sem_count(sem, 0);
-	wait_queue_init(&(sem->wait_queue));
-}
-#endif //UCONFIG_BIONIC_LIBC
-
 static void
     __attribute__ ((noinline)) __up(semaphore_t * sem, uint32_t wait_state)
 {
@@ -79,12 +69,9 @@ static void
 	bool intr_flag;
 	spin_lock_irqsave(&sem->lock, intr_flag);
 	{
-		wait_t *wait;
-		if ((wait = wait_queue_first(&(sem->wait_queue))) == NULL) {
+		/* the unit goes straight to the first waiter */
+		if (!wakeup_first(&(sem->wait_queue), wait_state, 1)) {
 			sem->value++;
-		} else {
-			assert(wait->proc->wait_state == wait_state);
-			wakeup_wait(&(sem->wait_queue), wait, wait_state, 1);
 		}
 	}
 	spin_unlock_irqrestore(&sem->lock, intr_flag);
@@ -103,7 +90,7 @@ static uint32_t
 		return 0;
 	}
 	wait_t __wait, *wait = &__wait;
-	wait_current_set(&(sem->wait_queue), wait, wait_state);
+	wait_current_set_exclusive(&(sem->wait_queue), wait, wait_state);
 	ipc_add_timer(timer);
 	spin_unlock_irqrestore(&sem->lock, intr_flag);
 
@@ -122,24 +109,57 @@ static uint32_t
 
 void up(semaphore_t * sem)
 {
+#ifdef UCONFIG_LOCK_STAT
+	if (sem->stat.name != NULL) {
+		lock_stat_released(&sem->stat);
+	}
+#endif
 	__up(sem, WT_KSEM);
 }
 
+static bool __try_down(semaphore_t * sem)
+{
+	bool intr_flag, ret = 0;
+	spin_lock_irqsave(&sem->lock, intr_flag);
+	if (sem->value > 0) {
+		sem->value--, ret = 1;
+	}
+	spin_unlock_irqrestore(&sem->lock, intr_flag);
+	return ret;
+}
+
 void down(semaphore_t * sem)
 {
+#ifdef UCONFIG_LOCK_STAT
+	if (sem->stat.name != NULL) {
+		/* contended if it has to sleep, the wait is the whole sleep */
+		uint64_t start = lock_stat_spin_start();
+		bool contended = !__try_down(sem);
+		if (contended) {
+			uint32_t flags = __down(sem, WT_KSEM, NULL);
+			assert(flags == 0);
+		}
+		lock_stat_acquired(&sem->stat, start, contended,
+				   (uintptr_t) __builtin_return_address(0));
+		return;
+	}
+#endif
 	uint32_t flags = __down(sem, WT_KSEM, NULL);
 	assert(flags == 0);
 }
 
 bool try_down(semaphore_t * sem)
 {
-	bool intr_flag, ret = 0;
-	spin_lock_irqsave(&sem->lock, intr_flag);
-	if (sem->value > 0) {
-		sem->value--, ret = 1;
+	if (!__try_down(sem)) {
+		return 0;
 	}
-	spin_unlock_irqrestore(&sem->lock, intr_flag);
-	return ret;
+#ifdef UCONFIG_LOCK_STAT
+	if (sem->stat.name != NULL) {
+		lock_stat_acquired(&sem->stat, lock_stat_spin_start(), 0,
+				   (uintptr_t) __builtin_return_address(0));
+	}
+#endif
+	return 1;
 }
 
 static int usem_up(semaphore_t * sem)
@@ -162,13 +182,42 @@ static int usem_down(semaphore_t * sem, unsigned int timeout)
 	return ipc_check_timeout(timeout, saved_ticks);
 }
 
+/* *
+ * The sem_undos of a process hang in the buckets of its sem_queue, by the
+ * hash of sem_id. They are added and taken off under sem_queue->sem, but
+ * looked up with no lock, under rcu_read_lock: a sem_undo is published
+ * once set up, and freed with call_rcu once off its bucket. The one found
+ * holds a reference on its semaphore, so the lookup can take one more for
+ * the caller before it is gone.
+ * */
+
+static inline list_entry_t *semu_hash_list(sem_queue_t * sem_queue,
+					   semaphore_t * sem)
+{
+	return sem_queue->semu_hash +
+	    hash32((uint32_t) sem2semid(sem), SEMU_HASH_SHIFT);
+}
+
+// semu_hash_add - publish semu in its bucket, with sem_queue->sem held
+static void semu_hash_add(sem_queue_t * sem_queue, sem_undo_t * semu)
+{
+	list_entry_t *list = semu_hash_list(sem_queue, semu->sem);
+	list_entry_t *le = &(semu->semu_link), *next = list_next(list);
+	le->prev = list, le->next = next;
+	rcu_assign_pointer(list->next, le);
+	next->prev = le;
+}
+
 sem_queue_t *sem_queue_create(void)
 {
 	sem_queue_t *sem_queue;
+	int i;
 	if ((sem_queue = kmalloc(sizeof(sem_queue_t))) != NULL) {
 		sem_init(&(sem_queue->sem), 1);
 		set_sem_queue_count(sem_queue, 0);
-		list_init(&(sem_queue->semu_list));
+		for (i = 0; i < SEMU_HASH_SIZE; i++) {
+			list_init(sem_queue->semu_hash + i);
+		}
 	}
 	return sem_queue;
 }
@@ -178,25 +227,13 @@ void sem_queue_destroy(sem_queue_t * sem_queue)
 	kfree(sem_queue);
 }
 
-#ifdef UCONFIG_BIONIC_LIBC
-sem_undo_t *semu_create_with_address(semaphore_t * sem, uintptr_t addr,
-				     int value)
+// sem_put - drop a reference to the user semaphore sem
+static void sem_put(semaphore_t * sem)
 {
-	sem_undo_t *semu;
-	if ((semu = kmalloc(sizeof(sem_undo_t))) != NULL) {
-		if (sem == NULL && (sem = kmalloc(sizeof(semaphore_t))) != NULL) {
-			sem_init_with_address(sem, addr, value);
-		}
-		if (sem != NULL) {
-			sem_count_inc(sem);
-			semu->sem = sem;
-			return semu;
-		}
-		kfree(semu);
+	if (sem_count_dec(sem) == 0) {
+		kfree(sem);
 	}
-	return NULL;
 }
-#endif //UCONFIG_BIONIC_LIBC
 
 sem_undo_t *semu_create(semaphore_t * sem, int value)
 {
@@ -217,23 +254,30 @@ sem_undo_t *semu_create(semaphore_t * sem, int value)
 
 void semu_destroy(sem_undo_t * semu)
 {
-	if (sem_count_dec(semu->sem) == 0) {
-		kfree(semu->sem);
-	}
+	sem_put(semu->sem);
 	kfree(semu);
 }
 
+static void semu_free_rcu(struct rcu_head *head)
+{
+	semu_destroy(to_struct(head, sem_undo_t, rcu));
+}
+
 int dup_sem_queue(sem_queue_t * to, sem_queue_t * from)
 {
 	assert(to != NULL && from != NULL);
-	list_entry_t *list = &(from->semu_list), *le = list;
-	while ((le = list_next(le)) != list) {
-		sem_undo_t *semu = le2semu(le, semu_link);
-		if (semu->sem->valid) {
-			if ((semu = semu_create(semu->sem, 0)) == NULL) {
-				return -E_NO_MEM;
+	int i;
+	for (i = 0; i < SEMU_HASH_SIZE; i++) {
+		list_entry_t *list = from->semu_hash + i, *le = list;
+		while ((le = list_next(le)) != list) {
+			semaphore_t *sem = le2semu(le, semu_link)->sem;
+			sem_undo_t *semu;
+			if (sem->valid) {
+				if ((semu = semu_create(sem, 0)) == NULL) {
+					return -E_NO_MEM;
+				}
+				semu_hash_add(to, semu);
 			}
-			list_add(&(to->semu_list), &(semu->semu_link));
 		}
 	}
 	return 0;
@@ -242,72 +286,75 @@ int dup_sem_queue(sem_queue_t * to, sem_queue_t * from)
 void exit_sem_queue(sem_queue_t * sem_queue)
 {
 	assert(sem_queue != NULL && sem_queue_count(sem_queue) == 0);
-	list_entry_t *list = &(sem_queue->semu_list), *le = list;
-	while ((le = list_next(list)) != list) {
-		list_del(le);
-		semu_destroy(le2semu(le, semu_link));
+	int i;
+	for (i = 0; i < SEMU_HASH_SIZE; i++) {
+		list_entry_t *list = sem_queue->semu_hash + i, *le;
+		while ((le = list_next(list)) != list) {
+			list_del(le);
+			semu_destroy(le2semu(le, semu_link));
+		}
 	}
 }
 
-static sem_undo_t *semu_list_search(list_entry_t * list, sem_t sem_id)
+// semu_lookup - the semaphore of sem_id if the process has it and it is
+//             - not freed, with a reference the caller drops by sem_put.
+//             - Takes no lock.
+static semaphore_t *semu_lookup(sem_queue_t * sem_queue, sem_t sem_id,
+				bool * stale)
 {
-	if (VALID_SEMID(sem_id)) {
-		semaphore_t *sem = semid2sem(sem_id);
-		list_entry_t *le = list;
-		while ((le = list_next(le)) != list) {
-			sem_undo_t *semu = le2semu(le, semu_link);
-			if (semu->sem == sem) {
-				list_del(le);
-				if (sem->valid) {
-					list_add_after(list, le);
-					return semu;
-				} else {
-					semu_destroy(semu);
-					return NULL;
-				}
+	semaphore_t *sem, *ret = NULL;
+	*stale = 0;
+	if (!VALID_SEMID(sem_id)) {
+		return NULL;
+	}
+	sem = semid2sem(sem_id);
+	list_entry_t *list = semu_hash_list(sem_queue, sem), *le = list;
+	rcu_read_lock();
+	while ((le = rcu_dereference(le->next)) != list) {
+		sem_undo_t *semu = le2semu(le, semu_link);
+		if (semu->sem == sem) {
+			if (sem->valid) {
+				sem_count_inc(sem);
+				ret = sem;
+			} else {
+				*stale = 1;
 			}
+			break;
 		}
 	}
-	return NULL;
+	rcu_read_unlock();
+	return ret;
 }
 
-#ifdef UCONFIG_BIONIC_LIBC
-static int semu_search_with_addr(list_entry_t * list, uintptr_t addr)
+// semu_reap - take the sem_undo of sem_id off, its semaphore freed
+static void semu_reap(sem_queue_t * sem_queue, sem_t sem_id)
 {
-	list_entry_t *le = list;
+	semaphore_t *sem = semid2sem(sem_id);
+	list_entry_t *list = semu_hash_list(sem_queue, sem), *le = list;
+	down(&(sem_queue->sem));
 	while ((le = list_next(le)) != list) {
 		sem_undo_t *semu = le2semu(le, semu_link);
-		if (semu->sem->addr == addr)
-			return sem2semid(semu->sem);
+		if (semu->sem == sem) {
+			if (!sem->valid) {
+				list_del(le);
+				call_rcu(&(semu->rcu), semu_free_rcu);
+			}
+			break;
+		}
 	}
-	return -1;
+	up(&(sem_queue->sem));
 }
 
-static int
-ipc_sem_find_or_init_with_address(uintptr_t addr, int value, int create)
+// semu_get - semu_lookup, the sem_undo of a freed semaphore is taken off
+static semaphore_t *semu_get(sem_queue_t * sem_queue, sem_t sem_id)
 {
-	assert(current->sem_queue != NULL);
-
-	sem_queue_t *sem_queue = current->sem_queue;
-	down(&(sem_queue->sem));
-	sem_t sem_id = semu_search_with_addr(&(sem_queue->semu_list), addr);
-	up(&(sem_queue->sem));
-	if (sem_id != -1)
-		return sem_id;
-
-	if (!create)
-		return -E_NO_MEM;
-	sem_undo_t *semu;
-	if ((semu = semu_create_with_address(NULL, addr, value)) == NULL) {
-		return -E_NO_MEM;
+	semaphore_t *sem;
+	bool stale;
+	if ((sem = semu_lookup(sem_queue, sem_id, &stale)) == NULL && stale) {
+		semu_reap(sem_queue, sem_id);
 	}
-
-	down(&(sem_queue->sem));
-	list_add_after(&(sem_queue->semu_list), &(semu->semu_link));
-	up(&(sem_queue->sem));
-	return sem2semid(semu->sem);
+	return sem;
 }
-#endif //UCONFIG_BIONIC_LIBC
 
 int ipc_sem_init(int value)
 {
@@ -320,7 +367,7 @@ int ipc_sem_init(int value)
 
 	sem_queue_t *sem_queue = current->sem_queue;
 	down(&(sem_queue->sem));
-	list_add_after(&(sem_queue->semu_list), &(semu->semu_link));
+	semu_hash_add(sem_queue, semu);
 	up(&(sem_queue->sem));
 	return sem2semid(semu->sem);
 }
@@ -329,79 +376,48 @@ int ipc_sem_post(sem_t sem_id)
 {
 	assert(current->sem_queue != NULL);
 
-	sem_undo_t *semu;
-	sem_queue_t *sem_queue = current->sem_queue;
-	down(&(sem_queue->sem));
-	semu = semu_list_search(&(sem_queue->semu_list), sem_id);
-	up(&(sem_queue->sem));
-	if (semu != NULL) {
-		return usem_up(semu->sem);
-	}
-	return -E_INVAL;
-}
-
-#ifdef UCONFIG_BIONIC_LIBC
-int ipc_sem_post_max(sem_t sem_id, int max)
-{
-	assert(current->sem_queue != NULL);
-
-	sem_undo_t *semu;
-	sem_queue_t *sem_queue = current->sem_queue;
-	down(&(sem_queue->sem));
-	semu = semu_list_search(&(sem_queue->semu_list), sem_id);
-	up(&(sem_queue->sem));
-	if (semu != NULL) {
-		int i;
-		int ret = 0;
-		for (i = 0; i < max; ++i) {
-			if (wait_queue_empty(&(semu->sem->wait_queue)))
-				break;
-			usem_up(semu->sem);
-			++ret;
-		}
-		return ret;
+	semaphore_t *sem;
+	int ret;
+	if ((sem = semu_get(current->sem_queue, sem_id)) == NULL) {
+		return -E_INVAL;
 	}
-	return -E_INVAL;
+	ret = usem_up(sem);
+	sem_put(sem);
+	return ret;
 }
-#endif //UCONFIG_BIONIC_LIBC
 
 int ipc_sem_wait(sem_t sem_id, unsigned int timeout)
 {
 	assert(current->sem_queue != NULL);
 
-	sem_undo_t *semu;
-	sem_queue_t *sem_queue = current->sem_queue;
-	down(&(sem_queue->sem));
-	semu = semu_list_search(&(sem_queue->semu_list), sem_id);
-	up(&(sem_queue->sem));
-	if (semu != NULL) {
-		return usem_down(semu->sem, timeout);
+	semaphore_t *sem;
+	int ret;
+	if ((sem = semu_get(current->sem_queue, sem_id)) == NULL) {
+		return -E_INVAL;
 	}
-	return -E_INVAL;
+	ret = usem_down(sem, timeout);
+	sem_put(sem);
+	return ret;
 }
 
 int ipc_sem_free(sem_t sem_id)
 {
 	assert(current->sem_queue != NULL);
 
-	sem_undo_t *semu;
-	sem_queue_t *sem_queue = current->sem_queue;
-	down(&(sem_queue->sem));
-	semu = semu_list_search(&(sem_queue->semu_list), sem_id);
-	up(&(sem_queue->sem));
-
-	int ret = -E_INVAL;
-	if (semu != NULL) {
-		bool intr_flag;
-		local_intr_save(intr_flag);
-		{
-			semaphore_t *sem = semu->sem;
-			sem->valid = 0, ret = 0;
-			wakeup_queue(&(sem->wait_queue), WT_INTERRUPTED, 1);
-		}
-		local_intr_restore(intr_flag);
+	semaphore_t *sem;
+	if ((sem = semu_get(current->sem_queue, sem_id)) == NULL) {
+		return -E_INVAL;
 	}
-	return ret;
+	bool intr_flag;
+	local_intr_save(intr_flag);
+	{
+		sem->valid = 0;
+		wakeup_queue(&(sem->wait_queue), WT_INTERRUPTED, 1);
+	}
+	local_intr_restore(intr_flag);
+	semu_reap(current->sem_queue, sem_id);
+	sem_put(sem);
+	return 0;
 }
 
 int ipc_sem_get_value(sem_t sem_id, int *value_store)
@@ -416,46 +432,20 @@ int ipc_sem_get_value(sem_t sem_id, int *value_store)
 		return -E_INVAL;
 	}
 
-	sem_undo_t *semu;
-	sem_queue_t *sem_queue = current->sem_queue;
-	down(&(sem_queue->sem));
-	semu = semu_list_search(&(sem_queue->semu_list), sem_id);
-	up(&(sem_queue->sem));
+	semaphore_t *sem;
+	if ((sem = semu_get(current->sem_queue, sem_id)) == NULL) {
+		return -E_INVAL;
+	}
 
-	int ret = -E_INVAL;
-	if (semu != NULL) {
-		int value = semu->sem->value;
-		lock_mm(mm);
-		{
-			if (copy_to_user(mm, value_store, &value, sizeof(int))) {
-				ret = 0;
-			}
+	int ret = -E_INVAL, value = sem->value;
+	sem_put(sem);
+	lock_mm(mm);
+	{
+		if (copy_to_user(mm, value_store, &value, sizeof(int))) {
+			ret = 0;
 		}
-		unlock_mm(mm);
 	}
+	unlock_mm(mm);
 	return ret;
 }
 
-#ifdef UCONFIG_BIONIC_LIBC
-int do_futex(uintptr_t uaddr, int op, int val)
-{
-	int ret = 0;
-	if (FUTEX_WAIT == op) {
-		if (*((int *)uaddr) != val) {
-			panic
-			    ("FUTEX_WAIT: unexpected val, *uaddr = %d, val = %d\n",
-			     *((int *)uaddr), val);
-		}
-		sem_t sem_id = ipc_sem_find_or_init_with_address(uaddr, 0, 1);
-		ret = ipc_sem_wait(sem_id, 100000);
-	} else if (FUTEX_WAKE == op) {
-		sem_t sem_id = ipc_sem_find_or_init_with_address(uaddr, val, 0);
-		if (-E_NO_MEM == sem_id) {
-		} else {
-			ret = ipc_sem_post_max(sem_id, val);
-		}
-	} else {
-		panic("unexpected futex op: %d\n", op);
-	}
-}
-#endif //UCONFIG_BIONIC_LIBC
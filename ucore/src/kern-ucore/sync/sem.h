@@ -5,6 +5,7 @@
 #include <atomic.h>
 #include <wait.h>
 #include <spinlock.h>
+#include <rcu.h>
 
 typedef struct semaphore {
 	int value;
@@ -12,9 +13,9 @@ typedef struct semaphore {
 	atomic_t count;
 	wait_queue_t wait_queue;
 	spinlock_s lock;
-#ifdef UCONFIG_BIONIC_LIBC
-	uintptr_t addr;
-#endif				//UCONFIG_BIONIC_LIBC
+#ifdef UCONFIG_LOCK_STAT
+	struct lock_stat stat;	/* counted once given a class, lock_stat_class */
+#endif
 } semaphore_t;
 
 // The sem_undo_t is used to permit semaphore manipulations that can be undone. If a process
@@ -25,21 +26,21 @@ typedef struct semaphore {
 // deadlocks.
 typedef struct sem_undo {
 	semaphore_t *sem;
-	list_entry_t semu_link;
+	list_entry_t semu_link;	// in the hash bucket of sem
+	struct rcu_head rcu;
 } sem_undo_t;
 
 #define le2semu(le, member)             \
     to_struct((le), sem_undo_t, member)
 
-#ifdef UCONFIG_BIONIC_LIBC
-#define FUTEX_WAIT 0
-#define FUTEX_WAKE 1
-#endif //UCONFIG_BIONIC_LIBC
+/* the sem_undos of a process, hashed by sem_id */
+#define SEMU_HASH_SHIFT                 6
+#define SEMU_HASH_SIZE                  (1 << SEMU_HASH_SHIFT)
 
 typedef struct sem_queue {
-	semaphore_t sem;
+	semaphore_t sem;	// serializes the changes, not the lookups
 	atomic_t count;
-	list_entry_t semu_list;
+	list_entry_t semu_hash[SEMU_HASH_SIZE];
 } sem_queue_t;
 
 void sem_init(semaphore_t * sem, int value);
@@ -61,10 +62,6 @@ int ipc_sem_wait(sem_t sem_id, unsigned int timeout);
 int ipc_sem_free(sem_t sem_id);
 int ipc_sem_get_value(sem_t sem_id, int *value_store);
 
-#ifdef UCONFIG_BIONIC_LIBC
-int do_futex(uintptr_t uaddr, int op, int val);
-#endif //UCONFIG_BIONIC_LIBC
-
 static inline int sem_count(semaphore_t * sem)
 {
 	return atomic_read(&(sem->count));
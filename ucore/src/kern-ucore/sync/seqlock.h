@@ -0,0 +1,53 @@
+#ifndef __KERN_SYNC_SEQLOCK_H__
+#define __KERN_SYNC_SEQLOCK_H__
+
+#include <types.h>
+#include <sync.h>
+#include <spinlock.h>
+#include <seqcount.h>
+
+/* *
+ * seqlock - a seqcount whose writers take a spinlock, for the fields read
+ * often and updated seldom: the readers neither wait for each other nor
+ * write the shared line, see seqcount.h. A writer that may run in an
+ * interrupt takes it with write_seqlock_irqsave.
+ * */
+typedef struct {
+	seqcount_t seqcount;
+	spinlock_s lock;
+} seqlock_t;
+
+static inline void seqlock_init(seqlock_t * sl)
+{
+	seqcount_init(&(sl->seqcount));
+	spinlock_init(&(sl->lock));
+}
+
+static inline uint32_t read_seqbegin(const seqlock_t * sl)
+{
+	return read_seqcount_begin(&(sl->seqcount));
+}
+
+static inline bool read_seqretry(const seqlock_t * sl, uint32_t seq)
+{
+	return read_seqcount_retry(&(sl->seqcount), seq);
+}
+
+static inline void write_seqlock(seqlock_t * sl)
+{
+	spinlock_acquire(&(sl->lock));
+	write_seqcount_begin(&(sl->seqcount));
+}
+
+static inline void write_sequnlock(seqlock_t * sl)
+{
+	write_seqcount_end(&(sl->seqcount));
+	spinlock_release(&(sl->lock));
+}
+
+#define write_seqlock_irqsave(sl, x)                \
+    do { local_intr_save(x); write_seqlock(sl); } while (0)
+#define write_sequnlock_irqrestore(sl, x)           \
+    do { write_sequnlock(sl); local_intr_restore(x); } while (0)
+
+#endif /* !__KERN_SYNC_SEQLOCK_H__ */
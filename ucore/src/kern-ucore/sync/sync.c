@@ -1,7 +1,11 @@
 #include <sync.h>
 #include <mbox.h>
+#include <futex.h>
+#include <rcu.h>
 
 void sync_init(void)
 {
 	mbox_init();
+	futex_init();
+	rcu_init();
 }
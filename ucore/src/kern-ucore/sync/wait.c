@@ -10,6 +10,7 @@ void wait_init(wait_t * wait, struct proc_struct *proc)
 {
 	wait->proc = proc;
 	wait->wakeup_flags = WT_INTERRUPTED;
+	wait->exclusive = 0;
 	list_init(&(wait->wait_link));
 	spinlock_init(&wait->lock);
 }
@@ -119,35 +120,96 @@ wakeup_wait(wait_queue_t * queue, wait_t * wait, uint32_t wakeup_flags,
 	wakeup_proc(wait->proc);
 }
 
-void wakeup_first(wait_queue_t * queue, uint32_t wakeup_flags, bool del)
+// __wakeup_one - wake up a waiter of the locked queue into batch
+static inline void
+__wakeup_one(wait_t * wait, uint32_t wakeup_flags, bool del,
+	     struct wakeup_batch *batch)
 {
-	wait_t *wait;
-	if ((wait = wait_queue_first(queue)) != NULL) {
-		wakeup_wait(queue, wait, wakeup_flags, del);
+	if (del) {
+		list_del_init(&(wait->wait_link));
 	}
+	spinlock_acquire(&wait->lock);
+	wait->wakeup_flags = wakeup_flags;
+	spinlock_release(&wait->lock);
+	wakeup_proc_batch(wait->proc, batch);
 }
 
-void wakeup_queue(wait_queue_t * queue, uint32_t wakeup_flags, bool del)
+// wakeup_first - wake up the first waiter only, return 0 if there is none.
+//              - With del the waiter gets what the caller releases, which
+//              - is handed over rather than left for it to fight for.
+bool wakeup_first(wait_queue_t * queue, uint32_t wakeup_flags, bool del)
 {
-	wait_t *wait;
-	if ((wait = wait_queue_first(queue)) != NULL) {
-		if (del) {
-			do {
-				wakeup_wait(queue, wait, wakeup_flags, 1);
-			} while ((wait = wait_queue_first(queue)) != NULL);
-		} else {
-			do {
-				wakeup_wait(queue, wait, wakeup_flags, 0);
-			} while ((wait = wait_queue_next(queue, wait)) != NULL);
+	struct wakeup_batch batch;
+	bool intr_flag, ret = 0;
+	wakeup_batch_init(&batch);
+	spin_lock_irqsave(&queue->lock, intr_flag);
+	list_entry_t *le = list_next(&(queue->wait_head));
+	if (le != &(queue->wait_head)) {
+		__wakeup_one(le2wait(le, wait_link), wakeup_flags, del, &batch);
+		ret = 1;
+	}
+	spin_unlock_irqrestore(&queue->lock, intr_flag);
+	wakeup_batch_flush(&batch);
+	return ret;
+}
+
+// wakeup_queue_nr - wake up the non-exclusive waiters, and the first
+//                 - nr_exclusive exclusive ones (all of them if 0), in a
+//                 - single pass under the queue lock. The remote cpus are
+//                 - kicked once each at the end. Return the number woken.
+int
+wakeup_queue_nr(wait_queue_t * queue, uint32_t wakeup_flags, bool del,
+		int nr_exclusive)
+{
+	struct wakeup_batch batch;
+	bool intr_flag;
+	int nr = 0;
+	wakeup_batch_init(&batch);
+	spin_lock_irqsave(&queue->lock, intr_flag);
+	list_entry_t *list = &(queue->wait_head), *le = list_next(list);
+	while (le != list) {
+		wait_t *wait = le2wait(le, wait_link);
+		bool exclusive = wait->exclusive;
+		le = list_next(le);
+		__wakeup_one(wait, wakeup_flags, del, &batch);
+		nr++;
+		if (exclusive && --nr_exclusive == 0) {
+			break;
 		}
 	}
+	spin_unlock_irqrestore(&queue->lock, intr_flag);
+	wakeup_batch_flush(&batch);
+	return nr;
 }
 
-void wait_current_set(wait_queue_t * queue, wait_t * wait, uint32_t wait_state)
+void wakeup_queue(wait_queue_t * queue, uint32_t wakeup_flags, bool del)
+{
+	wakeup_queue_nr(queue, wakeup_flags, del, 0);
+}
+
+static inline void
+__wait_current_set(wait_queue_t * queue, wait_t * wait, uint32_t wait_state,
+		   bool exclusive)
 {
 	assert(current != NULL);
 	wait_init(wait, current);
+	wait->exclusive = exclusive;
 	current->state = PROC_SLEEPING;
 	current->wait_state = wait_state;
 	wait_queue_add(queue, wait);
 }
+
+void wait_current_set(wait_queue_t * queue, wait_t * wait, uint32_t wait_state)
+{
+	__wait_current_set(queue, wait, wait_state, 0);
+}
+
+// wait_current_set_exclusive - wait_current_set for a waiter that takes
+//                            - what it is woken for, waking the others
+//                            - as well would only send them back to sleep
+void
+wait_current_set_exclusive(wait_queue_t * queue, wait_t * wait,
+			   uint32_t wait_state)
+{
+	__wait_current_set(queue, wait, wait_state, 1);
+}
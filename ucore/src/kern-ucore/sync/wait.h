@@ -18,6 +18,8 @@ typedef struct {
 	wait_queue_t *wait_queue;
 	list_entry_t wait_link;
 	spinlock_s lock;
+	/* an exclusive waiter is woken alone, see wakeup_queue_nr */
+	bool exclusive;
 } wait_t;
 
 #define le2wait(le, member)         \
@@ -37,10 +39,14 @@ bool wait_queue_empty(wait_queue_t * queue);
 bool wait_in_queue(wait_t * wait);
 void wakeup_wait(wait_queue_t * queue, wait_t * wait, uint32_t wakeup_flags,
 		 bool del);
-void wakeup_first(wait_queue_t * queue, uint32_t wakeup_flags, bool del);
+bool wakeup_first(wait_queue_t * queue, uint32_t wakeup_flags, bool del);
+int wakeup_queue_nr(wait_queue_t * queue, uint32_t wakeup_flags, bool del,
+		    int nr_exclusive);
 void wakeup_queue(wait_queue_t * queue, uint32_t wakeup_flags, bool del);
 
 void wait_current_set(wait_queue_t * queue, wait_t * wait, uint32_t wait_state);
+void wait_current_set_exclusive(wait_queue_t * queue, wait_t * wait,
+				uint32_t wait_state);
 
 #define wait_current_del(queue, wait)                                       \
     do {                                                                    \
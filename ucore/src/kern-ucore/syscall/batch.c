@@ -0,0 +1,78 @@
+#include <types.h>
+#include <unistd.h>
+#include <vmm.h>
+#include <proc.h>
+#include <error.h>
+#include <sysbatch.h>
+#include "batch.h"
+
+/* the system calls that leave through another frame or never come back */
+static bool batch_forbidden(uintptr_t num)
+{
+	switch (num) {
+	case SYS_exit:
+	case SYS_fork:
+	case SYS_exec:
+	case SYS_clone:
+	case SYS_exit_thread:
+	case SYS_batch:
+	case SYS_linux_sigsuspend:
+	case SYS_linux_sigreturn:
+		return 1;
+	}
+	return 0;
+}
+
+static inline bool batch_failed(uintptr_t ret)
+{
+	intptr_t err = (intptr_t) ret;
+	return err < 0 && err >= -MAXERROR;
+}
+
+// do_syscall_batch - run the n records at recs in order by dispatch, see
+//                  - sysbatch.h. The number of records run is returned,
+//                  - the last one failed if it is short of n.
+int do_syscall_batch(struct syscall_rec __user * recs, int n,
+		     syscall_dispatch_t dispatch)
+{
+	struct mm_struct *mm = current->mm;
+	struct syscall_rec rec;
+	uintptr_t rets[SYSBATCH_MAX];
+	int i, j;
+	if (n < 0 || n > SYSBATCH_MAX) {
+		return -E_INVAL;
+	}
+	for (i = 0; i < n; i++) {
+		lock_mm_uaccess(mm);
+		if (!copy_from_user(mm, &rec, recs + i, sizeof(rec), 0)) {
+			unlock_mm_uaccess(mm);
+			return -E_INVAL;
+		}
+		unlock_mm_uaccess(mm);
+		rec.ret = -E_INVAL;
+		if (!batch_forbidden(rec.num)) {
+			for (j = 0; j < 6; j++) {
+				if (!(rec.ref & SYSBATCH_REF(j))) {
+					continue;
+				}
+				if (rec.args[j] >= i) {
+					goto out;
+				}
+				rec.args[j] = rets[rec.args[j]];
+			}
+			rec.ret = dispatch(rec.num, rec.args);
+		}
+out:
+		rets[i] = rec.ret;
+		lock_mm_uaccess(mm);
+		if (!copy_to_user(mm, &(recs[i].ret), &(rec.ret), sizeof(rec.ret))) {
+			unlock_mm_uaccess(mm);
+			return -E_INVAL;
+		}
+		unlock_mm_uaccess(mm);
+		if (batch_failed(rec.ret) || (current->flags & PF_EXITING)) {
+			return i + 1;
+		}
+	}
+	return n;
+}
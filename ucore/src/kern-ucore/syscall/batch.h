@@ -0,0 +1,13 @@
+#ifndef __KERN_SYSCALL_BATCH_H__
+#define __KERN_SYSCALL_BATCH_H__
+
+#include <types.h>
+#include <sysbatch.h>
+
+/* runs a system call of the arch by its number, -E_INVAL if there is none */
+typedef uintptr_t(*syscall_dispatch_t) (uintptr_t num, uintptr_t args[]);
+
+int do_syscall_batch(struct syscall_rec __user * recs, int n,
+		     syscall_dispatch_t dispatch);
+
+#endif /* !__KERN_SYSCALL_BATCH_H__ */
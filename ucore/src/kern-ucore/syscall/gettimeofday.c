@@ -2,45 +2,127 @@
 #include <vmm.h>
 #include <proc.h>
 #include <string.h>
+#include <arch.h>
+#include <error.h>
+#include <vvar.h>
+#include <timekeeping.h>
+
+// ns_to_timeval - split ns into seconds and microseconds, both negative
+//               - for a negative ns
+static void ns_to_timeval(int64_t ns, struct linux_timeval *tv)
+{
+	uint64_t sec = (ns < 0) ? -ns : ns;
+	long usec = do_div(sec, NSEC_PER_SEC) / NSEC_PER_USEC;
+	tv->tv_sec = (ns < 0) ? -(long)sec : (long)sec;
+	tv->tv_usec = (ns < 0) ? -usec : usec;
+}
+
+static int64_t timeval_to_ns(const struct linux_timeval *tv)
+{
+	return (int64_t) tv->tv_sec * NSEC_PER_SEC +
+	    (int64_t) tv->tv_usec * NSEC_PER_USEC;
+}
 
-extern int ticks;
 int ucore_gettimeofday(struct linux_timeval __user * tv,
 		       struct linux_timezone __user * tz)
 {
 	struct mm_struct *mm = current->mm;
 	struct linux_timeval ktv;
-	ktv.tv_sec = ticks / 100;
-	ktv.tv_usec = (ticks % 100) * 10000;
-	lock_mm(mm);
+	ns_to_timeval(ktime_get_real_ns(), &ktv);
+	lock_mm_uaccess(mm);
 	if (!copy_to_user(mm, tv, &ktv, sizeof(struct linux_timeval))) {
-		unlock_mm(mm);
+		unlock_mm_uaccess(mm);
 		return -1;
 	}
-	unlock_mm(mm);
+	unlock_mm_uaccess(mm);
 	if (tz) {
 		struct linux_timezone ktz;
 		memset(&ktz, 0, sizeof(struct linux_timezone));
-		lock_mm(mm);
+		lock_mm_uaccess(mm);
 		if (!copy_to_user(mm, tz, &ktz, sizeof(struct linux_timezone))) {
-			unlock_mm(mm);
+			unlock_mm_uaccess(mm);
 			return -1;
 		}
-		unlock_mm(mm);
+		unlock_mm_uaccess(mm);
 	}
 	return 0;
 }
 
-int do_clock_gettime(struct linux_timespec __user * time)
+int do_clock_gettime(int clock_id, struct linux_timespec __user * time)
 {
 	struct mm_struct *mm = current->mm;
 	struct linux_timespec ktv;
-	ktv.tv_sec = ticks / 100;
-	ktv.tv_nsec = (ticks % 100) * 10000000;
-	lock_mm(mm);
+	uint64_t ns;
+	switch (clock_id) {
+	case CLOCK_REALTIME:
+		ns = ktime_get_real_ns();
+		break;
+	case CLOCK_MONOTONIC:
+		ns = ktime_get_ns();
+		break;
+	default:
+		return -E_INVAL;
+	}
+	ktv.tv_nsec = do_div(ns, NSEC_PER_SEC);
+	ktv.tv_sec = ns;
+	lock_mm_uaccess(mm);
 	if (!copy_to_user(mm, time, &ktv, sizeof(struct linux_timespec))) {
-		unlock_mm(mm);
+		unlock_mm_uaccess(mm);
 		return -1;
 	}
-	unlock_mm(mm);
+	unlock_mm_uaccess(mm);
+	return 0;
+}
+
+// do_settimeofday - step the realtime clock to tv
+int do_settimeofday(const struct linux_timeval __user * tv)
+{
+	struct mm_struct *mm = current->mm;
+	struct linux_timeval ktv;
+	lock_mm_uaccess(mm);
+	if (!copy_from_user(mm, &ktv, tv, sizeof(struct linux_timeval), 0)) {
+		unlock_mm_uaccess(mm);
+		return -E_INVAL;
+	}
+	unlock_mm_uaccess(mm);
+	if (ktv.tv_sec < 0 || ktv.tv_usec < 0 || ktv.tv_usec >= 1000000) {
+		return -E_INVAL;
+	}
+	timekeeping_settime(timeval_to_ns(&ktv));
+	return 0;
+}
+
+// do_adjtime - slew the realtime clock by delta if not NULL, the slew
+//            - left before is stored in olddelta if not NULL
+int do_adjtime(const struct linux_timeval __user * delta,
+	       struct linux_timeval __user * olddelta)
+{
+	struct mm_struct *mm = current->mm;
+	struct linux_timeval ktv;
+	int64_t ns, old_ns;
+	if (delta != NULL) {
+		lock_mm_uaccess(mm);
+		if (!copy_from_user
+		    (mm, &ktv, delta, sizeof(struct linux_timeval), 0)) {
+			unlock_mm_uaccess(mm);
+			return -E_INVAL;
+		}
+		unlock_mm_uaccess(mm);
+		if (ktv.tv_usec <= -1000000 || ktv.tv_usec >= 1000000) {
+			return -E_INVAL;
+		}
+		ns = timeval_to_ns(&ktv);
+	}
+	timekeeping_adjtime((delta != NULL) ? &ns : NULL, &old_ns);
+	if (olddelta != NULL) {
+		ns_to_timeval(old_ns, &ktv);
+		lock_mm_uaccess(mm);
+		if (!copy_to_user(mm, olddelta, &ktv,
+				  sizeof(struct linux_timeval))) {
+			unlock_mm_uaccess(mm);
+			return -E_INVAL;
+		}
+		unlock_mm_uaccess(mm);
+	}
 	return 0;
 }
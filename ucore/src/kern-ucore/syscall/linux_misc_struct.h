@@ -31,6 +31,12 @@ struct linux_timezone {
 	int tz_dsttime;		/* type of DST correction */
 };
 
+struct linux_timespec;
+
 int ucore_gettimeofday(struct linux_timeval *tv, struct linux_timezone *tz);
+int do_clock_gettime(int clock_id, struct linux_timespec *time);
+int do_settimeofday(const struct linux_timeval *tv);
+int do_adjtime(const struct linux_timeval *delta,
+	       struct linux_timeval *olddelta);
 
 #endif
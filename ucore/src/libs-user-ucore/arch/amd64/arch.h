@@ -5,6 +5,15 @@
 
 #define barrier() __asm__ __volatile__ ("" ::: "memory")
 
+/* x86 keeps the order of the loads, and of the stores, and no load passes
+ * a store before it to another place; only smp_mb needs an instruction, a
+ * locked op being cheaper than mfence. see memorder.h */
+#define smp_mb()    \
+    __asm__ __volatile__ ("lock; addl $0,-4(%%rsp)" ::: "memory", "cc")
+#define smp_rmb()   barrier()
+#define smp_wmb()   barrier()
+#define smp_acqrel() barrier()
+
 static inline uint8_t inb(uint16_t port) __attribute__ ((always_inline));
 static inline void insl(uint32_t port, void *addr, int cnt)
     __attribute__ ((always_inline));
@@ -160,6 +169,13 @@ static inline void write_rflags(uint64_t rflags)
 	asm volatile ("pushq %0; popfq"::"r" (rflags));
 }
 
+static inline uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+	asm volatile ("rdtsc":"=a" (lo), "=d"(hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+
 #else /* not __UCORE_64__ (only used for 32-bit libs) */
 
 #define do_div(n, base) ({                                          \
@@ -16,13 +16,18 @@ uint64_t syscall(int num, ...)
 	va_end(ap);
 
 	uint64_t ret;
+	/*
+	 * syscall/sysret: the kernel takes the 4th argument from r10, as rcx
+	 * and r11 hold the return rip and rflags; int T_SYSCALL still works
+	 */
 	asm volatile ("movq 0x00(%%rbx), %%rdi;"
 		      "movq 0x08(%%rbx), %%rsi;"
 		      "movq 0x10(%%rbx), %%rdx;"
-		      "movq 0x18(%%rbx), %%rcx;"
+		      "movq 0x18(%%rbx), %%r10;"
 		      "movq 0x20(%%rbx), %%r8;"
-		      "movq 0x28(%%rbx), %%r9;" "int %1":"=a" (ret)
-		      :"i"(T_SYSCALL), "a"(num), "b"(a)
-		      :"cc", "memory");
+		      "movq 0x28(%%rbx), %%r9;" "syscall":"=a" (ret)
+		      :"a"(num), "b"(a)
+		      :"rdi", "rsi", "rdx", "r8", "r9", "r10", "rcx", "r11",
+		      "cc", "memory");
 	return ret;
 }
@@ -20,4 +20,20 @@
 
 #include <arm.h>
 
+/* the smp barriers of memorder.h: dmb from armv7 on, the cp15 barrier
+ * operation on armv6; an older core is the only one */
+#if defined(__ARM_ARCH_7__) || defined(__ARM_ARCH_7A__)
+#define smp_mb()                    asm volatile ("dmb ish":::"memory")
+#define smp_wmb()                   asm volatile ("dmb ishst":::"memory")
+#elif defined(__ARM_ARCH_6__) || defined(__ARM_ARCH_6K__)
+#define smp_mb()                                    \
+    asm volatile ("mcr p15, 0, %0, c7, c10, 5"::"r" (0):"memory")
+#define smp_wmb()                   smp_mb()
+#else
+#define smp_mb()                    asm volatile ("":::"memory")
+#define smp_wmb()                   smp_mb()
+#endif
+#define smp_rmb()                   smp_mb()
+#define smp_acqrel()                smp_mb()
+
 #endif
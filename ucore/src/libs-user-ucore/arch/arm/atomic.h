@@ -287,7 +287,7 @@ static inline bool test_and_clear_bit(int nr, volatile uint32_t * addr)
 		c = 1;
 	*addr &= ~(1 << nr);
 	local_intr_restore(intr_flag);
-	return 0;
+	return c != 0;
 }
 
 /* *
@@ -284,7 +284,7 @@ static inline bool test_and_clear_bit(int nr, volatile void *addr)
 		c = 1;
 	*_addr &= ~(1 << nr);
 	local_intr_restore(intr_flag);
-	return 0;
+	return c != 0;
 }
 
 /* *
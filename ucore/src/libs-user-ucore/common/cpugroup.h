@@ -0,0 +1,32 @@
+#ifndef __LIBS_CPUGROUP_H__
+#define __LIBS_CPUGROUP_H__
+
+#include <types.h>
+
+/* SYS_cpucg ops, the times in clock ticks */
+#define CPUCG_CREATE                1	// a child of group id (0: top), of shares arg0
+#define CPUCG_DESTROY               2	// once nothing is in it
+#define CPUCG_SET_SHARES            3	// the weight arg0 against the other groups
+#define CPUCG_SET_QUOTA             4	// run at most arg0 (0: no cap) every arg1 ticks
+#define CPUCG_ATTACH                5	// move proc arg0 (0: current) to id (0: none)
+#define CPUCG_STAT                  6	// the struct cpucg_stat of id, into arg1
+
+/* the shares of a group if not told, those of a nice 0 proc */
+#define CPUCG_SHARES_DEFAULT        1024
+#define CPUCG_SHARES_MIN            2
+#define CPUCG_SHARES_MAX            (1 << 18)
+/* the bandwidth period if not told */
+#define CPUCG_PERIOD_DEFAULT        10
+
+/* the accounting of a cpu group and its children, read by CPUCG_STAT */
+struct cpucg_stat {
+	size_t usage;		// ticks run by the procs in it
+	size_t shares;
+	size_t quota;		// 0 for no cap
+	size_t period;
+	size_t nr_periods;	// the periods it used some of its quota in
+	size_t nr_throttled;	// the periods it ran out of its quota in
+	size_t throttled_time;	// ticks it was held back for
+};
+
+#endif /* !__LIBS_CPUGROUP_H__ */
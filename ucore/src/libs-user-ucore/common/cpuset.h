@@ -0,0 +1,54 @@
+#ifndef __LIBS_CPUSET_H__
+#define __LIBS_CPUSET_H__
+
+#include <types.h>
+
+/* *
+ * cpuset_t - the cpus of sched_setaffinity and sched_getaffinity, a bit a
+ * cpu, that of cpu n is bit n % 8 of byte n / 8, as the kernel reads it.
+ * */
+#define CPUSET_MAX_CPUS             64
+
+typedef struct {
+	uint8_t map[CPUSET_MAX_CPUS / 8];
+} cpuset_t;
+
+static inline void cpuset_clear(cpuset_t * s)
+{
+	int i;
+	for (i = 0; i < sizeof(s->map); i++) {
+		s->map[i] = 0;
+	}
+}
+
+static inline void cpuset_set(cpuset_t * s, int cpu)
+{
+	if (cpu >= 0 && cpu < CPUSET_MAX_CPUS) {
+		s->map[cpu >> 3] |= (1 << (cpu & 7));
+	}
+}
+
+static inline void cpuset_unset(cpuset_t * s, int cpu)
+{
+	if (cpu >= 0 && cpu < CPUSET_MAX_CPUS) {
+		s->map[cpu >> 3] &= ~(1 << (cpu & 7));
+	}
+}
+
+static inline bool cpuset_test(const cpuset_t * s, int cpu)
+{
+	return cpu >= 0 && cpu < CPUSET_MAX_CPUS
+	    && (s->map[cpu >> 3] & (1 << (cpu & 7))) != 0;
+}
+
+// cpuset_count - how many cpus s holds
+static inline int cpuset_count(const cpuset_t * s)
+{
+	int i, n = 0;
+	for (i = 0; i < CPUSET_MAX_CPUS; i++) {
+		n += cpuset_test(s, i);
+	}
+	return n;
+}
+
+#endif /* !__LIBS_CPUSET_H__ */
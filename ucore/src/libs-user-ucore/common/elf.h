@@ -72,12 +72,78 @@ struct proghdr {
 
 #endif /* __UCORE_64__ */
 
+/* values for Elfhdr::e_type */
+#define ET_EXEC                         2
+#define ET_DYN                          3
+
 /* values for Proghdr::p_type */
 #define ELF_PT_LOAD                     1
+#define ELF_PT_DYNAMIC                  2
+#define ELF_PT_INTERP                   3
 
 /* flag bits for Proghdr::p_flags */
 #define ELF_PF_X                        1
 #define ELF_PF_W                        2
 #define ELF_PF_R                        4
 
+/* types of the aux vector exec passes to the interpreter, see ld.so */
+#define ELF_AT_NULL                     0
+#define ELF_AT_PHDR                     3
+#define ELF_AT_PHENT                    4
+#define ELF_AT_PHNUM                    5
+#define ELF_AT_BASE                     7
+#define ELF_AT_ENTRY                    9
+
+#ifdef __UCORE_64__
+
+/* the dynamic section, symbols and relocations of a shared object */
+struct elf_dyn {
+	int64_t d_tag;
+	uint64_t d_val;
+};
+
+struct elf_sym {
+	uint32_t st_name;
+	uint8_t st_info;
+	uint8_t st_other;
+	uint16_t st_shndx;
+	uint64_t st_value;
+	uint64_t st_size;
+};
+
+struct elf_rela {
+	uint64_t r_offset;
+	uint64_t r_info;
+	int64_t r_addend;
+};
+
+#define ELF_R_SYM(i)                    ((i) >> 32)
+#define ELF_R_TYPE(i)                   ((i) & 0xffffffff)
+
+#define R_X86_64_NONE                   0
+#define R_X86_64_64                     1
+#define R_X86_64_COPY                   5
+#define R_X86_64_GLOB_DAT               6
+#define R_X86_64_JUMP_SLOT              7
+#define R_X86_64_RELATIVE               8
+
+#endif /* __UCORE_64__ */
+
+/* values for Dyn::d_tag */
+#define DT_NULL                         0
+#define DT_NEEDED                       1
+#define DT_PLTRELSZ                     2
+#define DT_HASH                         4
+#define DT_STRTAB                       5
+#define DT_SYMTAB                       6
+#define DT_RELA                         7
+#define DT_RELASZ                       8
+#define DT_PLTREL                       20
+#define DT_JMPREL                       23
+
+#define SHN_UNDEF                       0
+#define STB_LOCAL                       0
+#define STB_WEAK                        2
+#define ELF_ST_BIND(i)                  ((i) >> 4)
+
 #endif /* !__LIBS_ELF_H__ */
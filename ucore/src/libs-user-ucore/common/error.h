@@ -70,6 +70,11 @@
 #define E_KILLED  37
 #define E_UNSPECIFIED  38
 #define E_SWAP_FAULT   39
+#define E_DEADLK  40
+#define E_ADDRINUSE  41
+#define E_NOTCONN  42
+#define E_CONNREFUSED  43
+#define E_CONNRESET  44
 
 #define E_NO_MEM E_NOMEM
 #define E_INVAL_ELF E_NOEXEC
@@ -85,6 +90,6 @@
 #define E_SEEK    E_SPIPE
 
 /* the maximum allowed */
-#define MAXERROR            39
+#define MAXERROR            44
 
 #endif /* !__LIBS_ERROR_H__ */
@@ -0,0 +1,37 @@
+#ifndef __LIBS_PERF_EVENT_H__
+#define __LIBS_PERF_EVENT_H__
+
+#include <types.h>
+
+/* *
+ * The counters of the PMU a process opens with SYS_perf: one of the
+ * architectural events of the cpu, counted for a task wherever it runs,
+ * or for all that runs on a cpu. With a period, each period-th event
+ * also takes a sample for the profiler, dumped by SYS_profile.
+ * */
+enum {
+	PERF_EV_CYCLES,		// the unhalted core cycles
+	PERF_EV_INSTRUCTIONS,	// retired
+	PERF_EV_REF_CYCLES,	// the unhalted reference cycles
+	PERF_EV_LLC_REFERENCES,
+	PERF_EV_LLC_MISSES,
+	PERF_EV_BRANCHES,	// retired
+	PERF_EV_BRANCH_MISSES,	// the mispredicted ones retired
+	PERF_NR_EVENTS
+};
+
+/* the task itself, or no task but the cpu cpu */
+#define PERF_PID_SELF               0
+#define PERF_PID_CPU                (-1)
+
+#define PERF_EXCLUDE_KERNEL         0x1	// in user mode only
+
+struct perf_attr {
+	int event;		// PERF_EV_xxx
+	int pid;		// the task counted, or PERF_PID_xxx
+	int cpu;		// with PERF_PID_CPU
+	uint32_t flags;
+	uint64_t period;	// events between two samples, 0 for none
+};
+
+#endif /* !__LIBS_PERF_EVENT_H__ */
@@ -0,0 +1,61 @@
+#ifndef __LIBS_PKTIO_H__
+#define __LIBS_PKTIO_H__
+
+#include <types.h>
+
+/* *
+ * The packet rings of a queue pair of the network card, which SYS_pktio
+ * maps in the process: a page holding the receive ring, one holding the
+ * transmit ring, then the buffers of the receive slots and those of the
+ * transmit slots, one buffer per slot, the frame PKTIO_HEADROOM bytes in.
+ *
+ * The cursors run freely, the slot is cursor & (nr_slots - 1). On the
+ * receive ring the kernel moves tail past the packets it puts in [head,
+ * tail), each of len bytes, and the process moves head once it is done
+ * with them, which gives their buffers back to the card. On the transmit
+ * ring the process fills the slots from tail on, up to head + nr_slots,
+ * and moves tail; the kernel moves head once the card has sent them.
+ * PKTIO_RXSYNC and PKTIO_TXSYNC tell the kernel the cursors have moved
+ * and move its own, a syscall per batch of packets rather than per one.
+ * */
+#define PKTIO_PAGE_SIZE             4096
+#define PKTIO_NR_SLOTS              256
+#define PKTIO_BUF_SIZE              2048
+/* the room before the frame, for the header of the card */
+#define PKTIO_HEADROOM              16
+#define PKTIO_MAX_FRAME             (PKTIO_BUF_SIZE - PKTIO_HEADROOM)
+#define PKTIO_BUF_PAGES                                                 \
+    (PKTIO_NR_SLOTS * PKTIO_BUF_SIZE / PKTIO_PAGE_SIZE)
+#define PKTIO_MAP_PAGES             (2 + 2 * PKTIO_BUF_PAGES)
+#define PKTIO_MAP_SIZE              (PKTIO_MAP_PAGES * PKTIO_PAGE_SIZE)
+
+struct pktio_slot {
+	uint32_t len;		/* of the frame */
+};
+
+struct pktio_ring {
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	uint32_t nr_slots;	/* a power of 2 */
+	uint32_t buf_size;
+	uint32_t buf_offset;	/* of the buffer of slot 0, from the map */
+	struct pktio_slot slots[0];
+};
+
+struct pktio_info {
+	uint8_t mac[6];
+	uint16_t nr_queues;	/* the queue pairs there are to map */
+	uint32_t map_size;
+};
+
+#define PKTIO_RX_RING(map)          ((struct pktio_ring *)(map))
+#define PKTIO_TX_RING(map)                                              \
+    ((struct pktio_ring *)((char *)(map) + PKTIO_PAGE_SIZE))
+/* the frame of the slot of cursor of ring */
+#define PKTIO_BUF(map, ring, cursor)                                    \
+    ((char *)(map) + (ring)->buf_offset + PKTIO_HEADROOM                \
+     + ((cursor) & ((ring)->nr_slots - 1)) * (ring)->buf_size)
+#define PKTIO_SLOT(ring, cursor)                                        \
+    ((ring)->slots + ((cursor) & ((ring)->nr_slots - 1)))
+
+#endif /* !__LIBS_PKTIO_H__ */
@@ -0,0 +1,35 @@
+#ifndef __LIBS_RUSAGE_H__
+#define __LIBS_RUSAGE_H__
+
+#include <types.h>
+
+/* who for getrusage */
+#define RUSAGE_SELF                 0	// the process, all its threads
+#define RUSAGE_CHILDREN             (-1)	// its children waited for
+#define RUSAGE_THREAD               1	// the calling thread
+
+/* *
+ * The resources used, as getrusage returns them. The times are in clock
+ * ticks: each tick is charged to the proc it interrupts, in user mode or
+ * in the kernel. A switch is voluntary if the proc went to sleep, and
+ * involuntary if it was preempted or yielded while it could run on.
+ * */
+struct rusage {
+	uint64_t ru_utime;	// ticks in user mode
+	uint64_t ru_stime;	// ticks in the kernel
+	uint32_t ru_nvcsw;	// voluntary context switches
+	uint32_t ru_nivcsw;	// involuntary context switches
+	uint32_t ru_minflt;	// page faults served without I/O
+	uint32_t ru_majflt;	// page faults that read the page in
+};
+
+/* the time of a cpu, in clock ticks, and its context switches */
+struct cpu_usage {
+	uint64_t user;
+	uint64_t system;
+	uint64_t idle;
+	uint64_t nr_switches;
+	uint64_t steal;		// taken by the hypervisor, not above
+};
+
+#endif /* !__LIBS_RUSAGE_H__ */
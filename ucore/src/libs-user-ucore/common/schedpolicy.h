@@ -0,0 +1,18 @@
+#ifndef __LIBS_SCHEDPOLICY_H__
+#define __LIBS_SCHEDPOLICY_H__
+
+/* scheduling policies, set by SYS_sched_setscheduler */
+#define SCHED_NORMAL                0	// the fair class chosen at build time
+#define SCHED_FIFO                  1	// realtime, runs until it blocks or yields
+#define SCHED_RR                    2	// realtime, round robin within its priority
+
+/* realtime priorities, a higher one always runs first */
+#define SCHED_RT_PRIO_MIN           1
+#define SCHED_RT_PRIO_MAX           99
+
+/* nice values, set by SYS_setpriority; under CFS they weight the cpu time
+ * of the SCHED_NORMAL procs, about 10% a level */
+#define NICE_MIN                    -20
+#define NICE_MAX                    19
+
+#endif /* !__LIBS_SCHEDPOLICY_H__ */
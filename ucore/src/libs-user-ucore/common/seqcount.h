@@ -0,0 +1,60 @@
+#ifndef __LIBS_SEQCOUNT_H__
+#define __LIBS_SEQCOUNT_H__
+
+#include <types.h>
+#include <memorder.h>
+
+/* *
+ * A seqcount lets the readers of some fields go without a lock: the one
+ * writer makes the sequence odd while it updates them, and a reader takes
+ * them again if the sequence was odd or has moved meanwhile.
+ *
+ *     do {
+ *         seq = read_seqcount_begin(&s);
+ *         ... copy the fields ...
+ *     } while (read_seqcount_retry(&s, seq));
+ *
+ * The writers must exclude each other by other means, see seqlock.h in the
+ * kernel. A reader may see the fields torn, so it uses what it copied only
+ * after read_seqcount_retry said no.
+ * */
+typedef struct {
+	uint32_t sequence;
+} seqcount_t;
+
+#define SEQCNT_ZERO                 { 0 }
+
+static inline void seqcount_init(seqcount_t * s)
+{
+	s->sequence = 0;
+}
+
+// read_seqcount_begin - wait for the write in progress, the sequence to
+//                     - check against
+static inline uint32_t read_seqcount_begin(const seqcount_t * s)
+{
+	uint32_t seq;
+	while ((seq = READ_ONCE(s->sequence)) & 1) ;
+	smp_rmb();
+	return seq;
+}
+
+static inline bool read_seqcount_retry(const seqcount_t * s, uint32_t seq)
+{
+	smp_rmb();
+	return READ_ONCE(s->sequence) != seq;
+}
+
+static inline void write_seqcount_begin(seqcount_t * s)
+{
+	WRITE_ONCE(s->sequence, s->sequence + 1);
+	smp_wmb();
+}
+
+static inline void write_seqcount_end(seqcount_t * s)
+{
+	smp_wmb();
+	WRITE_ONCE(s->sequence, s->sequence + 1);
+}
+
+#endif /* !__LIBS_SEQCOUNT_H__ */
@@ -0,0 +1,53 @@
+#ifndef __LIBS_TRACEBUF_H__
+#define __LIBS_TRACEBUF_H__
+
+#include <types.h>
+
+/* *
+ * The event ring of a cpu, which SYS_trace maps read-only in the consumer:
+ * a page holding struct trace_ring, then TRACE_RING_PAGES of events. The
+ * kernel never waits for the reader, it overwrites the oldest event; head
+ * counts the events written, the one of slot s is at events[s % entries].
+ * An event is the one of slot s while its seq is s + 1: the reader copies
+ * it and checks seq again, and the events from s on are lost once
+ * head - s > entries.
+ * */
+#define TRACE_SCHED_SWITCH          0	/* prev pid, next pid */
+#define TRACE_SCHED_WAKEUP          1	/* pid, wait state */
+#define TRACE_PAGE_FAULT            2	/* address, error code */
+#define TRACE_BLOCK_SUBMIT          3	/* sector, # of sectors | write << 31 */
+#define TRACE_BLOCK_COMPLETE        4	/* sector, error */
+#define TRACE_SYSCALL_ENTER         5	/* syscall #, first argument */
+#define TRACE_SYSCALL_EXIT          6	/* syscall #, return value */
+#define TRACE_SWAP_OUT              7	/* swap entry, error */
+#define TRACE_SWAP_IN               8	/* swap entry, error */
+#define TRACE_IPI_SEND              9	/* cpu or -1 for all but self, vector */
+#define TRACE_NR_EVENTS             10
+
+#define TRACE_MASK(id)              (1U << (id))
+#define TRACE_MASK_ALL              (TRACE_MASK(TRACE_NR_EVENTS) - 1)
+
+#define TRACE_PAGE_SIZE             4096
+#define TRACE_RING_PAGES            16
+#define TRACE_RING_ENTRIES                                              \
+    (TRACE_RING_PAGES * TRACE_PAGE_SIZE / sizeof(struct trace_event))
+
+struct trace_event {
+	uint64_t ns;		/* monotonic clock */
+	volatile uint32_t seq;	/* slot + 1, 0 while written */
+	uint16_t id;
+	uint16_t pid;
+	uint64_t arg[2];
+};
+
+struct trace_ring {
+	volatile uint32_t head;
+	uint32_t entries;
+	uint32_t cpu;
+};
+
+#define TRACE_EVENTS(ring)                                              \
+    ((struct trace_event *)((char *)(ring) + TRACE_PAGE_SIZE))
+#define TRACE_MAP_SIZE              ((TRACE_RING_PAGES + 1) * TRACE_PAGE_SIZE)
+
+#endif /* !__LIBS_TRACEBUF_H__ */
@@ -9,23 +9,46 @@
 #define SYS_wait            3
 #define SYS_exec            4
 #define SYS_clone           5
+#define SYS_spawn           6
 #define SYS_exit_thread     9
 #define SYS_yield           10
 #define SYS_sleep           11
 #define SYS_kill            12
+#define SYS_sched_setscheduler 13
+#define SYS_sched_getscheduler 14
+#define SYS_sched_getparam  15
+#define SYS_futex           16
 #define SYS_gettime         17
 #define SYS_getpid          18
 #define SYS_brk             19
 #define SYS_mmap            20
 #define SYS_munmap          21
 #define SYS_shmem           22
+#define SYS_mempolicy       23
+#define SYS_numa_stat       24
+#define SYS_thp_stat        25
+#define SYS_epoll_create    26
+#define SYS_epoll_ctl       27
+#define SYS_epoll_wait      28
+#define SYS_uring_enter     29
 #define SYS_putc            30
 #define SYS_pgdir           31
+#define SYS_vvar            32
+#define SYS_settimeofday    33
+#define SYS_adjtime         34
+#define SYS_batch           35
+#define SYS_getrusage       36
+#define SYS_profile         37
+#define SYS_ftrace          38
+#define SYS_trace           39
 #define SYS_sem_init        40
 #define SYS_sem_post        41
 #define SYS_sem_wait        42
 #define SYS_sem_free        43
 #define SYS_sem_get_value   44
+#define SYS_lockstat        45
+#define SYS_sched_setaffinity 46
+#define SYS_kbench          47
 #define SYS_event_send      48
 #define SYS_event_recv      49
 #define SYS_mbox_init       50
@@ -33,11 +56,40 @@
 #define SYS_mbox_recv       52
 #define SYS_mbox_free       53
 #define SYS_mbox_info       54
+#define SYS_shm_open        55
+#define SYS_shm_unlink      56
+#define SYS_madvise         57
+#define SYS_memcg           58
+#define SYS_cpucg           59
+#define SYS_irqaffinity     60
+#define SYS_sched_getaffinity 61
+#define SYS_settls          62
+#define SYS_gettls          63
+#define SYS_numa_info       64
+#define SYS_pktio           65
+#define SYS_event_call      66
+#define SYS_checkpoint      67
+#define SYS_restore         68
+#define SYS_socket          69
+#define SYS_bind            70
+#define SYS_listen          71
+#define SYS_accept          72
+#define SYS_connect         73
+#define SYS_perf            74
+#define SYS_mmap_file       75
+#define SYS_timerslack      76
+#define SYS_mbox_sendm      77
+#define SYS_mbox_recvm      78
+#define SYS_sysrec          79
+#define SYS_setpriority     80
+#define SYS_getpriority     81
 #define SYS_open            100
 #define SYS_close           101
 #define SYS_read            102
 #define SYS_write           103
 #define SYS_seek            104
+#define SYS_preadv          105
+#define SYS_pwritev         106
 #define SYS_fstat           110
 #define SYS_fsync           111
 #define SYS_chdir           120
@@ -49,7 +101,14 @@
 #define SYS_symlink         126
 #define SYS_unlink          127
 #define SYS_getdirentry     128
+#define SYS_getdents        129
 #define SYS_dup             130
+#define SYS_fcntl           131
+#define SYS_splice          132
+#define SYS_tee             133
+#define SYS_sendfile        134
+#define SYS_copy_file_range 135
+#define SYS_fallocate       136
 #define SYS_pipe            140
 #define SYS_mkfifo          141
 
@@ -99,6 +158,17 @@
 /* SYS_mmap flags */
 #define MMAP_WRITE          0x00000100
 #define MMAP_STACK          0x00000200
+#define MMAP_POPULATE       0x00000400
+#define SHM_CREATE          0x00000800	// SYS_shm_open: make it if there is none
+#define MMAP_EXEC           0x00001000	// SYS_mmap_file: executable pages
+
+/* SYS_madvise advice, the same as Linux */
+#define MADV_NORMAL         0
+#define MADV_RANDOM         1	// read no more than faulted
+#define MADV_SEQUENTIAL     2	// read ahead far, reclaim soon after use
+#define MADV_WILLNEED       3	// read in now what is out
+#define MADV_DONTNEED       4	// drop now, zeros on the next touch
+#define MADV_FREE           8	// reclaim may drop it unless written again
 
 #if 0
 /* VFS flags */
@@ -134,6 +204,62 @@
 
 #define NO_FD               -0x9527	// invalid fd
 
+/* fcntl commands */
+#define F_SETPIPE_SZ        1031	// hold up to arg bytes, in pages
+#define F_GETPIPE_SZ        1032	// the bytes a pipe holds at most
+
+/* SYS_profile ops, see kprof.c of amd64 */
+#define PROFILE_START       1	// by the PMU, or the timer without one
+#define PROFILE_START_TIMER 2
+#define PROFILE_STOP        3
+#define PROFILE_TOP         4	// the hottest functions, into buf
+#define PROFILE_FOLDED      5	// the stacks folded for flamegraph.pl
+
+/* SYS_ftrace ops, see ftrace.c of amd64 */
+#define FTRACE_START        1
+#define FTRACE_STOP         2
+#define FTRACE_FILTER       3	// also trace the functions of buf, see there
+#define FTRACE_CLEAR        4	// no filters, trace all
+#define FTRACE_DUMP         5	// the entries of each cpu, into buf
+
+/* SYS_trace ops, see debug/trace.c and tracebuf.h */
+#define TRACE_ENABLE        1	// record the events of the mask arg
+#define TRACE_DISABLE       2
+#define TRACE_MAP           3	// map the ring of cpu arg, returns where
+
+/* SYS_sysrec ops, see debug/sysrec.c and sysrecbuf.h */
+#define SYSREC_START        1	// record the proc arg, current if 0
+#define SYSREC_STOP         2
+#define SYSREC_MAP          3	// map the ring of cpu arg, returns where
+
+/* SYS_lockstat ops, see spinlock.c of amd64 */
+#define LOCKSTAT_DUMP       1	// the locks and the sites of the classes, into buf
+#define LOCKSTAT_RESET      2
+
+/* SYS_kbench ops, see debug/kbench.c */
+#define KBENCH_KMALLOC      1	// kmalloc and kfree arg bytes
+
+/* SYS_irqaffinity ops, see irqbalance.c of amd64 */
+#define IRQ_AFFINITY_SET    1	// the IRQ may go to the cpus of the mask
+#define IRQ_AFFINITY_GET    2	// the cpus it may go to, into the mask
+#define IRQ_AFFINITY_CPU    3	// the cpu it goes to
+
+/* SYS_pktio ops, see virtio_net.c of amd64 and pktio.h */
+#define PKTIO_INFO          1	// the card, into the struct pktio_info
+#define PKTIO_MAP           2	// map the rings of a queue, returns where
+#define PKTIO_RXSYNC        3	// # of packets received, in the ring
+#define PKTIO_RXWAIT        4	// PKTIO_RXSYNC, sleeping until there is one
+#define PKTIO_TXSYNC        5	// send the packets, # of free slots
+
+/* SYS_perf ops, see perf.c of amd64 and perf_event.h */
+#define PERF_EVENTS         1	// the mask of the events the cpu counts
+#define PERF_OPEN           2	// a counter of the struct perf_attr, its id
+#define PERF_READ           3	// the count of a counter, into a uint64_t
+#define PERF_CLOSE          4
+
+/* SYS_fallocate modes */
+#define FALLOC_FL_KEEP_SIZE 1	// the size of the file stays as it is
+
 /* lseek codes */
 #define LSEEK_SET           0	// seek relative to beginning of file
 #define LSEEK_CUR           1	// seek relative to current position in file
@@ -0,0 +1,62 @@
+#ifndef __LIBS_URINGBUF_H__
+#define __LIBS_URINGBUF_H__
+
+#include <types.h>
+
+/* *
+ * The layout of an I/O ring in user memory, shared with the kernel: the
+ * state, then the entries submission entries, then 2 * entries completion
+ * entries. The submitter fills sqes and moves sq_tail, uring_enter moves
+ * sq_head as it runs them and posts their results at cq_tail; the reaper
+ * moves cq_head. The cursors run freely, the slot is cursor & (n - 1).
+ * */
+#define URING_OP_NOP                0
+#define URING_OP_READ               1
+#define URING_OP_WRITE              2
+#define URING_OP_FSYNC              3
+#define URING_OP_OPEN               4
+#define URING_OP_CLOSE              5
+
+/* off of a read or write that goes on from the file position */
+#define URING_OFF_CUR               ((off_t)-1)
+
+#define URING_MAX_ENTRIES           4096
+
+struct uring_sqe {
+	uint32_t opcode;
+	int fd;
+	uintptr_t addr;		/* the buffer, or the path to open */
+	size_t len;
+	off_t off;
+	uint32_t open_flags;
+	uintptr_t user_data;	/* handed back in the completion */
+};
+
+struct uring_cqe {
+	uintptr_t user_data;
+	int res;		/* what the syscall of the op would return */
+};
+
+struct uring_state {
+	volatile uint32_t sq_head;
+	volatile uint32_t sq_tail;
+	volatile uint32_t cq_head;
+	volatile uint32_t cq_tail;
+	uint32_t entries;	/* a power of 2 */
+	/* doorbells of the user side, rung as sq_tail, cq_tail and cq_head
+	 * move */
+	volatile uint32_t sq_bell;
+	volatile uint32_t cq_bell;
+	volatile uint32_t room_bell;
+	volatile bool isclosed;
+};
+
+#define URING_SQES(state)                                               \
+    ((struct uring_sqe *)((struct uring_state *)(state) + 1))
+#define URING_CQES(state)                                               \
+    ((struct uring_cqe *)(URING_SQES(state) + (state)->entries))
+#define URING_SIZE(entries)                                             \
+    (sizeof(struct uring_state) + (entries) * sizeof(struct uring_sqe)  \
+     + 2 * (entries) * sizeof(struct uring_cqe))
+
+#endif /* !__LIBS_URINGBUF_H__ */
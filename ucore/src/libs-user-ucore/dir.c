@@ -23,6 +23,7 @@ DIR *opendir(const char *path)
 		goto failed;
 	}
 	dirp->dirent.offset = 0;
+	dirp->pos = dirp->len = 0;
 	return dirp;
 
 failed:
@@ -32,10 +33,28 @@ failed:
 
 struct dirent *readdir(DIR * dirp)
 {
-	if (sys_getdirentry(dirp->fd, &(dirp->dirent)) == 0) {
-		return &(dirp->dirent);
+	if (dirp->pos == dirp->len) {
+		int ret = getdents(dirp->fd, (struct dirent64 *)dirp->buf,
+				   sizeof(dirp->buf));
+		if (ret <= 0) {
+			return NULL;
+		}
+		dirp->pos = 0, dirp->len = ret;
 	}
-	return NULL;
+	struct dirent64 *d = (struct dirent64 *)(dirp->buf + dirp->pos);
+	dirp->pos += d->d_reclen;
+	dirp->dirent.d_ino = d->d_ino;
+	dirp->dirent.offset = d->d_off;
+	dirp->dirent.d_reclen = sizeof(struct dirent);
+	strcpy(dirp->dirent.name, d->d_name);
+	return &(dirp->dirent);
+}
+
+// getdents - the entries of the directory fd after the last call, in the
+//          - dirent64 records of dirp; # bytes filled, 0 at the end
+int getdents(int fd, struct dirent64 *dirp, size_t len)
+{
+	return sys_getdents(fd, dirp, len);
 }
 
 void closedir(DIR * dirp)
@@ -4,14 +4,20 @@
 #include <types.h>
 #include <dirent.h>
 
+#define DIR_BUF_SIZE                1024
+
 typedef struct {
 	int fd;
 	struct dirent dirent;
+	/* the records of the last getdents, readdir hands them out in turn */
+	size_t pos, len;
+	char buf[DIR_BUF_SIZE];
 } DIR;
 
 DIR *opendir(const char *path);
 struct dirent *readdir(DIR * dirp);
 void closedir(DIR * dirp);
+int getdents(int fd, struct dirent64 *dirp, size_t len);
 int chdir(const char *path);
 int getcwd(char *buffer, size_t len);
 int mkdir(const char *path);
@@ -2,10 +2,12 @@
 #include <string.h>
 #include <syscall.h>
 #include <stdio.h>
+#include <ulib.h>
 #include <stat.h>
 #include <malloc.h>
 #include <error.h>
 #include <unistd.h>
+#include <file.h>
 
 int open(const char *path, uint32_t open_flags)
 {
@@ -19,6 +21,9 @@ int close(int fd)
 
 int read(int fd, void *base, size_t len)
 {
+	if (fd == 0) {
+		fflush(-1);
+	}
 	return sys_read(fd, base, len);
 }
 
@@ -32,6 +37,53 @@ int seek(int fd, off_t pos, int whence)
 	return sys_seek(fd, pos, whence);
 }
 
+/* *
+ * The positional calls read and write at off without moving the position
+ * of fd, so threads sharing it need not seek in turn. The vectored ones
+ * move the buffers of iov in order as one request; readv and writev go
+ * on from the position of fd, for which the kernel takes an off of -1.
+ * */
+int pread(int fd, void *base, size_t len, off_t off)
+{
+	struct iovec iov = {.iov_base = base,.iov_len = len };
+	return preadv(fd, &iov, 1, off);
+}
+
+int pwrite(int fd, void *base, size_t len, off_t off)
+{
+	struct iovec iov = {.iov_base = base,.iov_len = len };
+	return pwritev(fd, &iov, 1, off);
+}
+
+int readv(int fd, struct iovec *iov, int iovcnt)
+{
+	if (fd == 0) {
+		fflush(-1);
+	}
+	return sys_preadv(fd, iov, iovcnt, -1);
+}
+
+int writev(int fd, struct iovec *iov, int iovcnt)
+{
+	return sys_pwritev(fd, iov, iovcnt, -1);
+}
+
+int preadv(int fd, struct iovec *iov, int iovcnt, off_t off)
+{
+	if (off < 0) {
+		return -E_INVAL;
+	}
+	return sys_preadv(fd, iov, iovcnt, off);
+}
+
+int pwritev(int fd, struct iovec *iov, int iovcnt, off_t off)
+{
+	if (off < 0) {
+		return -E_INVAL;
+	}
+	return sys_pwritev(fd, iov, iovcnt, off);
+}
+
 int fstat(int fd, struct stat *stat)
 {
 	return sys_fstat(fd, stat);
@@ -42,6 +94,13 @@ int fsync(int fd)
 	return sys_fsync(fd);
 }
 
+// fallocate - give fd the blocks up to off + len ahead of the writes;
+//           - mode FALLOC_FL_KEEP_SIZE leaves its size as it is
+int fallocate(int fd, int mode, off_t off, off_t len)
+{
+	return sys_fallocate(fd, mode, off, len);
+}
+
 int dup(int fd)
 {
 	return sys_dup(fd, NO_FD);
@@ -52,16 +111,91 @@ int dup2(int fd1, int fd2)
 	return sys_dup(fd1, fd2);
 }
 
+int fcntl(int fd, int cmd, int arg)
+{
+	return sys_fcntl(fd, cmd, arg);
+}
+
+int splice(int fd_in, int fd_out, size_t len)
+{
+	return sys_splice(fd_in, fd_out, len);
+}
+
+int tee(int fd_in, int fd_out, size_t len)
+{
+	return sys_tee(fd_in, fd_out, len);
+}
+
+// sendfile - copy up to count bytes of in_fd, at *offset or else at its
+//          - position, to out_fd in the kernel; # bytes copied
+int sendfile(int out_fd, int in_fd, off_t * offset, size_t count)
+{
+	return sys_sendfile(out_fd, in_fd, offset, count);
+}
+
+// copy_file_range - sendfile with an offset for out_fd too, which is a
+//                 - file; a copy within one sfs goes by blocks
+int
+copy_file_range(int fd_in, off_t * off_in, int fd_out, off_t * off_out,
+		size_t len)
+{
+	return sys_copy_file_range(fd_in, off_in, fd_out, off_out, len);
+}
+
 int pipe(int *fd_store)
 {
 	return sys_pipe(fd_store);
 }
 
+int epoll_create(void)
+{
+	return sys_epoll_create();
+}
+
+int epoll_ctl(int epfd, int op, int type, int id, struct epoll_event *event)
+{
+	return sys_epoll_ctl(epfd, op, type, id, event);
+}
+
+int
+epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+	   unsigned int timeout)
+{
+	return sys_epoll_wait(epfd, events, maxevents, timeout);
+}
+
 int mkfifo(const char *name, uint32_t open_flags)
 {
 	return sys_mkfifo(name, open_flags);
 }
 
+int socket(int domain, int type, int protocol)
+{
+	return sys_socket(domain, type, protocol);
+}
+
+int bind(int fd, const struct sockaddr_in *addr)
+{
+	return sys_bind(fd, addr);
+}
+
+int listen(int fd, int backlog)
+{
+	return sys_listen(fd, backlog);
+}
+
+// accept - an fd for the next connection to fd, the address of its peer
+//        - stored in addr unless NULL
+int accept(int fd, struct sockaddr_in *addr)
+{
+	return sys_accept(fd, addr);
+}
+
+int connect(int fd, const struct sockaddr_in *addr)
+{
+	return sys_connect(fd, addr);
+}
+
 static char transmode(struct stat *stat)
 {
 	uint32_t mode = stat->st_mode;
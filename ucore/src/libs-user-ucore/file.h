@@ -2,20 +2,49 @@
 #define __USER_LIBS_FILE_H__
 
 #include <types.h>
+#include <epoll.h>
+#include <socket.h>
 
 struct stat;
 
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
 int open(const char *path, uint32_t open_flags);
 int close(int fd);
 int read(int fd, void *base, size_t len);
 int write(int fd, void *base, size_t len);
 int seek(int fd, off_t pos, int whence);
+int pread(int fd, void *base, size_t len, off_t off);
+int pwrite(int fd, void *base, size_t len, off_t off);
+int readv(int fd, struct iovec *iov, int iovcnt);
+int writev(int fd, struct iovec *iov, int iovcnt);
+int preadv(int fd, struct iovec *iov, int iovcnt, off_t off);
+int pwritev(int fd, struct iovec *iov, int iovcnt, off_t off);
 int fstat(int fd, struct stat *stat);
 int fsync(int fd);
+int fallocate(int fd, int mode, off_t off, off_t len);
 int dup(int fd);
 int dup2(int fd1, int fd2);
+int fcntl(int fd, int cmd, int arg);
+int splice(int fd_in, int fd_out, size_t len);
+int tee(int fd_in, int fd_out, size_t len);
+int sendfile(int out_fd, int in_fd, off_t * offset, size_t count);
+int copy_file_range(int fd_in, off_t * off_in, int fd_out, off_t * off_out,
+		    size_t len);
 int pipe(int *fd_store);
+int epoll_create(void);
+int epoll_ctl(int epfd, int op, int type, int id, struct epoll_event *event);
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+	       unsigned int timeout);
 int mkfifo(const char *name, uint32_t open_flags);
+int socket(int domain, int type, int protocol);
+int bind(int fd, const struct sockaddr_in *addr);
+int listen(int fd, int backlog);
+int accept(int fd, struct sockaddr_in *addr);
+int connect(int fd, const struct sockaddr_in *addr);
 
 void print_stat(const char *name, int fd, struct stat *stat);
 
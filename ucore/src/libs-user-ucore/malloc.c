@@ -2,15 +2,36 @@
 #include <ulib.h>
 #include <syscall.h>
 #include <malloc.h>
-#include <lock.h>
+#include <thread.h>
 #include <unistd.h>
+#include <stdlib.h>
 
-// A thread-awared memory allocator based on  the 
-// memory allocatorby Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+/* *
+ * A thread-awared memory allocator in three parts:
+ *   - the small sizes, up to SMALL_MAX, are size classes carved from slabs
+ *     of the heap, and kept in caches with a lock each; a thread takes the
+ *     cache of the region its stack is in, or the next one free, so that
+ *     threads seldom share one. The caches trade objects with the central
+ *     lists BATCH at a time, so the central lock is taken once per BATCH;
+ *   - the sizes from LARGE_MIN on are mmaped, and unmapped when freed;
+ *   - the ones between, and all of shmem_malloc, are the free list of
+ *     Kernighan and Ritchie, The C programming Language, 2nd ed. Section
+ *     8.7, under the central lock. The whole pages of a heap block of
+ *     LAZY_FREE_MIN on are given to the kernel with MADV_FREE when freed,
+ *     to be taken back if memory runs short before they are reused.
+ * Each block given out is preceded by a tag telling which part it is of.
+ * */
 
-void lock_fork(void);
-void unlock_fork(void);
+struct tag {
+	uint32_t kind;
+	uint32_t size;		// the class of TAG_SMALL, the bytes of TAG_LARGE
+	uint32_t pad[2];
+};
+
+#define TAG_SMALL               0x5a11
+#define TAG_HEAP                0x4ea9
+#define TAG_SHMEM               0x54e3
+#define TAG_LARGE               0x1a29
 
 union header {
 	struct {
@@ -18,28 +39,52 @@ union header {
 		size_t size;
 		bool type;	// 0: normal, sys_brk; 1: shared memory, shmem
 	} s;
+	struct {
+		uint32_t pad[12];
+		struct tag tag;	// right before the memory given out
+	} t;
 	uint32_t align[16];
 };
 
 typedef union header header_t;
 
+#define NR_CLASSES              8
+#define SMALL_MIN               16
+#define SMALL_MAX               (SMALL_MIN << (NR_CLASSES - 1))
+#define LARGE_MIN               (64 * 1024)
+#define SLAB_BYTES              (16 * 1024)
+#define BATCH                   32
+#define CACHE_HIGH              (BATCH * 2)
+#define CACHE_SHIFT             4
+#define NR_CACHES               (1 << CACHE_SHIFT)
+#define CACHE_REGION_SHIFT      16	// the stacks of the threads are apart
+#define HEAP_GROW               (64 * 1024)
+#define LAZY_FREE_MIN           (16 * 1024)
+#define PGSIZE                  4096
+
+struct object {
+	struct object *next;
+};
+
+struct cache {
+	mutex_t lock;
+	struct object *list[NR_CLASSES];
+	int count[NR_CLASSES];
+} __attribute__ ((aligned(64)));
+
+static struct cache caches[NR_CACHES];
+
 static header_t base;
 static header_t *freep = NULL;
 
-static lock_t mem_lock = INIT_LOCK;
+static mutex_t mem_lock = INIT_MUTEX;
+static struct object *central_list[NR_CLASSES];
 
 static void free_locked(void *ap);
 
-static inline void lock_malloc(void)
+static inline struct tag *tag_of(void *ap)
 {
-	lock_fork();
-	lock(&mem_lock);
-}
-
-static inline void unlock_malloc(void)
-{
-	unlock(&mem_lock);
-	unlock_fork();
+	return ((struct tag *)ap) - 1;
 }
 
 static bool morecore_brk_locked(size_t nu)
@@ -50,6 +95,10 @@ static bool morecore_brk_locked(size_t nu)
 			return 0;
 		}
 	}
+	/* a sliver at a time would take a syscall per few mallocs */
+	if (nu * sizeof(header_t) < HEAP_GROW) {
+		nu = HEAP_GROW / sizeof(header_t);
+	}
 	uintptr_t newbrk = brk + nu * sizeof(header_t);
 	if (sys_brk(&newbrk) != 0 || newbrk <= brk) {
 		return 0;
@@ -105,6 +154,7 @@ static void *malloc_locked(size_t size, bool type)
 				p->s.size = nunits;
 			}
 			freep = prevp;
+			p->t.tag.kind = (!type) ? TAG_HEAP : TAG_SHMEM;
 			return (void *)(p + 1);
 		}
 		if (p == freep) {
@@ -146,27 +196,197 @@ static void free_locked(void *ap)
 	freep = p;
 }
 
+static inline int size_class(size_t size)
+{
+	int cls = 0;
+	while ((SMALL_MIN << cls) < size) {
+		cls++;
+	}
+	return cls;
+}
+
+// slab_carve_locked - a slab of the heap cut into objects of class cls
+static bool slab_carve_locked(int cls)
+{
+	size_t stride = sizeof(struct tag) + (SMALL_MIN << cls);
+	char *slab = malloc_locked(SLAB_BYTES, 0), *p;
+	if (slab == NULL) {
+		return 0;
+	}
+	for (p = slab; p + stride <= slab + SLAB_BYTES; p += stride) {
+		struct tag *tag = (struct tag *)p;
+		struct object *obj = (struct object *)(tag + 1);
+		tag->kind = TAG_SMALL, tag->size = cls;
+		obj->next = central_list[cls];
+		central_list[cls] = obj;
+	}
+	return 1;
+}
+
+// cache_get - the cache of this thread, locked
+static struct cache *cache_get(void)
+{
+	uintptr_t sp = (uintptr_t) & sp;
+	int i, first = hash32(sp >> CACHE_REGION_SHIFT, CACHE_SHIFT);
+	for (i = 0; i < NR_CACHES; i++) {
+		struct cache *c = caches + ((first + i) & (NR_CACHES - 1));
+		if (mutex_trylock(&(c->lock))) {
+			return c;
+		}
+	}
+	mutex_lock(&(caches[first].lock));
+	return caches + first;
+}
+
+// cache_refill - take BATCH objects of cls from the central lists
+static bool cache_refill(struct cache *c, int cls)
+{
+	int n;
+	mutex_lock(&mem_lock);
+	for (n = 0; n < BATCH; n++) {
+		struct object *obj = central_list[cls];
+		if (obj == NULL) {
+			if (!slab_carve_locked(cls)) {
+				break;
+			}
+			obj = central_list[cls];
+		}
+		central_list[cls] = obj->next;
+		obj->next = c->list[cls];
+		c->list[cls] = obj;
+		c->count[cls]++;
+	}
+	mutex_unlock(&mem_lock);
+	return n > 0;
+}
+
+// cache_drain - give BATCH objects of cls back to the central lists
+static void cache_drain(struct cache *c, int cls)
+{
+	int n;
+	mutex_lock(&mem_lock);
+	for (n = 0; n < BATCH && c->list[cls] != NULL; n++) {
+		struct object *obj = c->list[cls];
+		c->list[cls] = obj->next;
+		c->count[cls]--;
+		obj->next = central_list[cls];
+		central_list[cls] = obj;
+	}
+	mutex_unlock(&mem_lock);
+}
+
+// lazy_free - let the kernel drop the pages of heap block bp, being freed,
+//           - unless they are written again first; bp is not free yet so
+//           - that no other thread may write them before
+static void lazy_free(header_t * bp)
+{
+	uintptr_t start = ((uintptr_t) (bp + 1) + PGSIZE - 1) & ~(PGSIZE - 1);
+	uintptr_t end = ((uintptr_t) (bp + bp->s.size)) & ~(PGSIZE - 1);
+	if (bp->s.type == 0 && bp->s.size * sizeof(header_t) >= LAZY_FREE_MIN
+	    && start < end) {
+		madvise(start, end - start, MADV_FREE);
+	}
+}
+
+static void *malloc_small(size_t size)
+{
+	int cls = size_class(size);
+	struct cache *c = cache_get();
+	struct object *obj = NULL;
+	if (c->list[cls] != NULL || cache_refill(c, cls)) {
+		obj = c->list[cls];
+		c->list[cls] = obj->next;
+		c->count[cls]--;
+	}
+	mutex_unlock(&(c->lock));
+	return obj;
+}
+
+static void free_small(struct object *obj, int cls)
+{
+	struct cache *c = cache_get();
+	obj->next = c->list[cls];
+	c->list[cls] = obj;
+	if (++c->count[cls] > CACHE_HIGH) {
+		cache_drain(c, cls);
+	}
+	mutex_unlock(&(c->lock));
+}
+
+static void *malloc_large(size_t size)
+{
+	uintptr_t addr = 0;
+	size_t len = (sizeof(struct tag) + size + PGSIZE - 1) & ~(PGSIZE - 1);
+	if (mmap(&addr, len, MMAP_WRITE) != 0 || addr == 0) {
+		return NULL;
+	}
+	struct tag *tag = (struct tag *)addr;
+	tag->kind = TAG_LARGE, tag->size = len;
+	return tag + 1;
+}
+
 void *malloc(size_t size)
 {
 	void *ret;
-	lock_malloc();
+	if (size <= SMALL_MAX) {
+		return malloc_small(size);
+	}
+	if (size >= LARGE_MIN) {
+		return malloc_large(size);
+	}
+	mutex_lock(&mem_lock);
 	ret = malloc_locked(size, 0);
-	unlock_malloc();
+	mutex_unlock(&mem_lock);
 	return ret;
 }
 
 void *shmem_malloc(size_t size)
 {
 	void *ret;
-	lock_malloc();
+	mutex_lock(&mem_lock);
 	ret = malloc_locked(size, 1);
-	unlock_malloc();
+	mutex_unlock(&mem_lock);
 	return ret;
 }
 
 void free(void *ap)
 {
-	lock_malloc();
-	free_locked(ap);
-	unlock_malloc();
+	struct tag *tag;
+	if (ap == NULL) {
+		return;
+	}
+	tag = tag_of(ap);
+	switch (tag->kind) {
+	case TAG_SMALL:
+		free_small(ap, tag->size);
+		break;
+	case TAG_LARGE:
+		munmap((uintptr_t) tag, tag->size);
+		break;
+	default:
+		lazy_free(((header_t *) ap) - 1);
+		mutex_lock(&mem_lock);
+		free_locked(ap);
+		mutex_unlock(&mem_lock);
+	}
+}
+
+// malloc_lock_all - hold every lock of malloc across a fork, so that the
+//                 - child gets none of them taken halfway
+void malloc_lock_all(void)
+{
+	int i;
+	for (i = 0; i < NR_CACHES; i++) {
+		mutex_lock(&(caches[i].lock));
+	}
+	mutex_lock(&mem_lock);
+}
+
+void malloc_unlock_all(void)
+{
+	int i;
+	mutex_unlock(&mem_lock);
+	for (i = 0; i < NR_CACHES; i++) {
+		mutex_unlock(&(caches[i].lock));
+	}
 }
@@ -0,0 +1,166 @@
+#include <types.h>
+#include <string.h>
+#include <unistd.h>
+#include <error.h>
+#include <atomic.h>
+#include <memorder.h>
+#include <ulib.h>
+#include <thread.h>
+#include <ring.h>
+
+#define RING_MIN_SIZE           64
+/* a message is its length and its bytes, padded to 4 bytes */
+#define RING_RECSIZE(len)       (sizeof(uint32_t) + ROUNDUP(len, sizeof(uint32_t)))
+
+int ring_create(ring_t * r, size_t size, bool mpsc)
+{
+	uint32_t rsize = RING_MIN_SIZE;
+	if (size == 0 || size > 0x40000000) {
+		return -E_INVAL;
+	}
+	while (rsize < size) {
+		rsize <<= 1;
+	}
+	int ret;
+	uintptr_t addr = 0;
+	size_t len = sizeof(__ring_state_t) + rsize;
+	if ((ret = shmem(&addr, len, MMAP_WRITE)) != 0) {
+		return ret;
+	}
+	r->addr = addr, r->len = len;
+	r->state = (__ring_state_t *) addr;
+	r->buf = (uint8_t *) (r->state + 1);
+
+	__ring_state_t *state = r->state;
+	state->head = state->tail = 0;
+	state->consumer_bell = state->producer_bell = 0;
+	state->isclosed = 0, state->mpsc = mpsc;
+	mutex_init(&(state->lock));
+	state->size = rsize;
+	return 0;
+}
+
+static void ring_put(ring_t * r, uint32_t pos, const void *src, size_t n)
+{
+	uint32_t size = r->state->size, off = pos & (size - 1);
+	size_t first = (n < size - off) ? n : size - off;
+	memcpy(r->buf + off, src, first);
+	memcpy(r->buf, (const uint8_t *)src + first, n - first);
+}
+
+static void ring_get(ring_t * r, uint32_t pos, void *dst, size_t n)
+{
+	uint32_t size = r->state->size, off = pos & (size - 1);
+	size_t first = (n < size - off) ? n : size - off;
+	memcpy(dst, r->buf + off, first);
+	memcpy((uint8_t *) dst + first, r->buf, n - first);
+}
+
+static int __ring_send(ring_t * r, const void *buf, size_t len, bool block)
+{
+	__ring_state_t *state = r->state;
+	uint32_t need = RING_RECSIZE(len);
+	if (len == 0 || need > state->size) {
+		return -E_INVAL;
+	}
+	if (state->mpsc) {
+		if (!block && !mutex_trylock(&(state->lock))) {
+			return -E_AGAIN;
+		} else if (block) {
+			mutex_lock(&(state->lock));
+		}
+	}
+
+	int ret = 0;
+	uint32_t head, tail = state->tail;
+	while (state->size - (tail - (head = state->head)) < need) {
+		if (state->isclosed) {
+			break;
+		}
+		if (!block) {
+			ret = -E_AGAIN;
+			goto out;
+		}
+		/* an mpsc producer sleeps holding the lock, so it is the only one */
+		doorbell_wait(&(state->producer_bell), &(state->head), head);
+	}
+	if (state->isclosed) {
+		ret = -E_PIPE;
+		goto out;
+	}
+
+	uint32_t len32 = len;
+	ring_put(r, tail, &len32, sizeof(uint32_t));
+	ring_put(r, tail + sizeof(uint32_t), buf, len);
+	smp_store_release(&(state->tail), tail + need);
+	doorbell_ring(&(state->consumer_bell));
+
+out:
+	if (state->mpsc) {
+		mutex_unlock(&(state->lock));
+	}
+	return ret;
+}
+
+static int __ring_recv(ring_t * r, void *buf, size_t size, bool block)
+{
+	__ring_state_t *state = r->state;
+	uint32_t len, head = state->head;
+	while (state->tail == head) {
+		if (state->isclosed) {
+			return 0;
+		}
+		if (!block) {
+			return -E_AGAIN;
+		}
+		doorbell_wait(&(state->consumer_bell), &(state->tail), head);
+	}
+	smp_rmb();
+
+	ring_get(r, head, &len, sizeof(uint32_t));
+	if (len > size) {
+		return -E_TOO_BIG;
+	}
+	ring_get(r, head + sizeof(uint32_t), buf, len);
+	smp_store_release(&(state->head), head + RING_RECSIZE(len));
+	doorbell_ring(&(state->producer_bell));
+	return len;
+}
+
+// ring_send - queue the len bytes at buf as one message, waiting for room
+int ring_send(ring_t * r, const void *buf, size_t len)
+{
+	return __ring_send(r, buf, len, 1);
+}
+
+// ring_recv - take the next message to buf, waiting for one; returns its
+//           - length, 0 once the ring is closed and drained
+int ring_recv(ring_t * r, void *buf, size_t size)
+{
+	return __ring_recv(r, buf, size, 1);
+}
+
+int ring_trysend(ring_t * r, const void *buf, size_t len)
+{
+	return __ring_send(r, buf, len, 0);
+}
+
+int ring_tryrecv(ring_t * r, void *buf, size_t size)
+{
+	return __ring_recv(r, buf, size, 0);
+}
+
+// ring_close - no more messages; the consumer still gets the queued ones
+void ring_close(ring_t * r)
+{
+	__ring_state_t *state = r->state;
+	state->isclosed = 1;
+	doorbell_close(&(state->consumer_bell));
+	doorbell_close(&(state->producer_bell));
+}
+
+// ring_destroy - unmap the ring from the caller, each process does it
+int ring_destroy(ring_t * r)
+{
+	return munmap(r->addr, r->len);
+}
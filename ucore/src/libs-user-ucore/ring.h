@@ -0,0 +1,41 @@
+#ifndef __USER_LIBS_RING_H__
+#define __USER_LIBS_RING_H__
+
+#include <types.h>
+#include <thread.h>
+
+/* *
+ * A message ring in shared memory, for processes forked after ring_create
+ * and for threads. The cursors are read and written in user space only;
+ * a side sleeps on its doorbell, see thread.h, when the ring is empty or
+ * full, and the other side enters the kernel to wake it only then. A ring
+ * has a single consumer, and a single producer unless it is created as
+ * mpsc, in which case the producers take turns on a mutex.
+ * */
+typedef struct {
+	volatile uint32_t head;	// bytes consumed, moved by the consumer
+	volatile uint32_t tail;	// bytes produced, moved by the producer
+	volatile uint32_t consumer_bell;	// rung as tail moves
+	volatile uint32_t producer_bell;	// rung as head moves
+	volatile bool isclosed;
+	bool mpsc;
+	mutex_t lock;		// taken by the producers of an mpsc ring
+	uint32_t size;		// bytes of buf, a power of 2
+} __ring_state_t;
+
+typedef struct {
+	uintptr_t addr;
+	size_t len;
+	__ring_state_t *state;
+	uint8_t *buf;
+} ring_t;
+
+int ring_create(ring_t * r, size_t size, bool mpsc);
+int ring_send(ring_t * r, const void *buf, size_t len);
+int ring_recv(ring_t * r, void *buf, size_t size);
+int ring_trysend(ring_t * r, const void *buf, size_t len);
+int ring_tryrecv(ring_t * r, void *buf, size_t size);
+void ring_close(ring_t * r);
+int ring_destroy(ring_t * r);
+
+#endif /* !__USER_LIBS_RING_H__ */
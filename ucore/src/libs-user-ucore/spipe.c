@@ -1,140 +1,157 @@
 #include <types.h>
+#include <string.h>
 #include <unistd.h>
+#include <error.h>
+#include <atomic.h>
+#include <memorder.h>
 #include <ulib.h>
+#include <thread.h>
 #include <spipe.h>
 
-#define SPIPE_SIZE      4096
-#define SPIPE_BUFSIZE   (SPIPE_SIZE - sizeof(__spipe_state_t))
+#define SPIPE_PGSIZE    4096
+#define SPIPE_MAX_SIZE  0x40000000
 
-static bool __spipeisclosed_nolock(spipe_t * p, bool read);
+static bool __spipeisclosed(spipe_t * p, bool read);
 
 int spipe(spipe_t * p)
 {
-	static_assert(SPIPE_SIZE > SPIPE_BUFSIZE);
+	return spipecreate(p, SPIPE_SIZE);
+}
+
+// spipecreate - a pipe whose buffer holds size bytes, rounded up to a
+//             - power of 2 of pages
+int spipecreate(spipe_t * p, size_t size)
+{
+	static_assert(sizeof(__spipe_state_t) % SPIPE_CACHELINE == 0);
+	uint32_t psize = SPIPE_PGSIZE;
+	if (size == 0 || size > SPIPE_MAX_SIZE) {
+		return -E_INVAL;
+	}
+	while (psize < size) {
+		psize <<= 1;
+	}
 	int ret;
-	sem_t spipe_sem;
 	uintptr_t addr = 0;
-	if ((ret = shmem(&addr, SPIPE_SIZE, MMAP_WRITE)) != 0) {
-		goto failed;
-	}
-	if ((spipe_sem = sem_init(1)) < 0) {
-		goto failed_cleanup_mem;
+	size_t len = sizeof(__spipe_state_t) + psize;
+	if ((ret = shmem(&addr, len, MMAP_WRITE)) != 0) {
+		return ret;
 	}
 	p->isclosed = 0;
-	p->spipe_sem = spipe_sem;
-	p->addr = addr;
+	p->addr = addr, p->len = len;
 	p->state = (__spipe_state_t *) addr;
 	p->buf = (uint8_t *) (p->state + 1);
-	p->state->p_rpos = p->state->p_wpos = 0;
-	p->state->isclosed = 0;
-out:
-	return ret;
 
-failed_cleanup_mem:
-	munmap(addr, SPIPE_BUFSIZE);
-failed:
-	goto out;
+	__spipe_state_t *state = p->state;
+	state->rpos = state->wpos = 0;
+	state->reader_bell = state->writer_bell = 0;
+	state->isclosed = 0;
+	state->size = psize;
+	return 0;
 }
 
+// spiperead - read up to n bytes, waiting for the first; 0 once the pipe
+//           - is closed and drained
 size_t spiperead(spipe_t * p, void *buf, size_t n)
 {
-	size_t ret = 0;
-	__spipe_state_t *state = p->state;
-try_again:
-	if (p->isclosed || sem_wait(p->spipe_sem) != 0) {
-		goto out;
-	}
-	if (__spipeisclosed_nolock(p, 1)) {
-		goto out_unlock;
-	}
-	if (state->p_rpos == state->p_wpos) {
-		sem_post(p->spipe_sem);
-		yield();
-		goto try_again;
+	if (p->isclosed || n == 0) {
+		return 0;
 	}
-	for (; ret < n; ret++, state->p_rpos++) {
-		if (state->p_rpos == state->p_wpos) {
-			break;
+	__spipe_state_t *state = p->state;
+	uint32_t size = state->size, rpos = state->rpos, wpos;
+	while ((wpos = state->wpos) == rpos) {
+		if (__spipeisclosed(p, 1)) {
+			return 0;
 		}
-		*(uint8_t *) (buf + ret) =
-		    p->buf[state->p_rpos % SPIPE_BUFSIZE];
+		doorbell_wait(&(state->reader_bell), &(state->wpos), rpos);
 	}
-out_unlock:
-	sem_post(p->spipe_sem);
-out:
+	smp_rmb();
+
+	uint32_t off = rpos & (size - 1);
+	size_t ret = wpos - rpos, first;
+	if (ret > n) {
+		ret = n;
+	}
+	first = (ret < size - off) ? ret : size - off;
+	memcpy(buf, p->buf + off, first);
+	memcpy((uint8_t *) buf + first, p->buf, ret - first);
+	smp_store_release(&(state->rpos), rpos + ret);
+	doorbell_ring(&(state->writer_bell));
 	return ret;
 }
 
+// spipewrite - write the n bytes, waiting for room; fewer if the pipe is
+//            - closed meanwhile
 size_t spipewrite(spipe_t * p, void *buf, size_t n)
 {
-	size_t ret = 0;
-	__spipe_state_t *state = p->state;
-try_again:
-	if (p->isclosed || sem_wait(p->spipe_sem) != 0) {
-		goto out;
-	}
-	if (__spipeisclosed_nolock(p, 0)) {
-		goto out_unlock;
+	if (p->isclosed) {
+		return 0;
 	}
-	for (; ret < n; ret++, state->p_wpos++) {
-		if (state->p_wpos - state->p_rpos >= SPIPE_BUFSIZE) {
-			sem_post(p->spipe_sem);
-			yield();
-			goto try_again;
+	__spipe_state_t *state = p->state;
+	uint32_t size = state->size, wpos = state->wpos, rpos;
+	size_t ret = 0;
+	while (ret < n) {
+		/* the bytes before rpos are written only once it is read */
+		while (wpos - (rpos = smp_load_acquire(&(state->rpos)))
+		       >= size) {
+			if (__spipeisclosed(p, 0)) {
+				return ret;
+			}
+			doorbell_wait(&(state->writer_bell), &(state->rpos),
+				      rpos);
 		}
-		p->buf[state->p_wpos % SPIPE_BUFSIZE] =
-		    *(uint8_t *) (buf + ret);
+		if (__spipeisclosed(p, 0)) {
+			break;
+		}
+		uint32_t off = wpos & (size - 1);
+		size_t chunk = size - (wpos - rpos), first;
+		if (chunk > n - ret) {
+			chunk = n - ret;
+		}
+		first = (chunk < size - off) ? chunk : size - off;
+		memcpy(p->buf + off, (uint8_t *) buf + ret, first);
+		memcpy(p->buf, (uint8_t *) buf + ret + first, chunk - first);
+		smp_store_release(&(state->wpos), wpos + chunk);
+		wpos += chunk;
+		doorbell_ring(&(state->reader_bell));
+		ret += chunk;
 	}
-out_unlock:
-	sem_post(p->spipe_sem);
-out:
 	return ret;
 }
 
-static int __spipeclose_nolock(spipe_t * p)
-{
-	if (!p->isclosed) {
-		p->isclosed = p->state->isclosed = 1;
-		munmap(p->addr, SPIPE_BUFSIZE);
-		return 0;
-	}
-	return -1;
-}
-
+// spipeclose - close the pipe for both sides and unmap it from the caller;
+//            - the reader still gets the bytes written
 int spipeclose(spipe_t * p)
 {
 	if (!p->isclosed) {
-		int ret;
-		sem_wait(p->spipe_sem);
-		ret = __spipeclose_nolock(p);
-		sem_post(p->spipe_sem);
-		return ret;
+		__spipe_state_t *state = p->state;
+		p->isclosed = state->isclosed = 1;
+		doorbell_close(&(state->reader_bell));
+		doorbell_close(&(state->writer_bell));
+		munmap(p->addr, p->len);
+		return 0;
 	}
 	return -1;
 }
 
-static bool __spipeisclosed_nolock(spipe_t * p, bool read)
+// __spipeisclosed - closed for the side, the reader once drained too, the
+//                 - caller's map is gone then
+static bool __spipeisclosed(spipe_t * p, bool read)
 {
 	if (!p->isclosed) {
-		if (!p->state->isclosed) {
+		__spipe_state_t *state = p->state;
+		if (!state->isclosed) {
 			return 0;
 		}
-		if (p->state->p_rpos < p->state->p_wpos) {
+		if (state->rpos != state->wpos) {
 			return !read;
 		}
-		__spipeclose_nolock(p);
+		p->isclosed = 1;
+		munmap(p->addr, p->len);
 	}
 	return 1;
 }
 
 bool spipeisclosed(spipe_t * p)
 {
-	if (!p->isclosed) {
-		bool isclosed;
-		sem_wait(p->spipe_sem);
-		isclosed = __spipeisclosed_nolock(p, 0);
-		sem_post(p->spipe_sem);
-		return isclosed;
-	}
-	return 1;
+	return __spipeisclosed(p, 0);
 }
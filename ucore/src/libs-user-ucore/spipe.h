@@ -3,21 +3,41 @@
 
 #include <types.h>
 
+#define SPIPE_CACHELINE     64
+/* the buffer of spipe, spipecreate takes any size */
+#define SPIPE_SIZE          4096
+
+/* *
+ * A byte pipe in shared memory, for processes forked after it is created
+ * and for threads: a single reader and a single writer at a time. It takes
+ * no lock, each cursor is moved by its own side only and sits on a cache
+ * line of its own. A side sleeps on its doorbell, see thread.h, only when
+ * the pipe is empty or full, which the other side rings once it moves the
+ * cursor; otherwise no syscall is made at all.
+ * */
 typedef struct {
-	off_t p_rpos;
-	off_t p_wpos;
-	bool isclosed;
+	volatile uint32_t rpos
+	    __attribute__ ((aligned(SPIPE_CACHELINE)));	// bytes read
+	volatile uint32_t wpos
+	    __attribute__ ((aligned(SPIPE_CACHELINE)));	// bytes written
+	/* rung as wpos moves */
+	volatile uint32_t reader_bell
+	    __attribute__ ((aligned(SPIPE_CACHELINE)));
+	volatile uint32_t writer_bell;	// rung as rpos moves
+	volatile bool isclosed;
+	uint32_t size;		// bytes of the buffer, a power of 2
 } __spipe_state_t;
 
 typedef struct {
 	volatile bool isclosed;
-	sem_t spipe_sem;
 	uintptr_t addr;
+	size_t len;
 	__spipe_state_t *state;
 	uint8_t *buf;
 } spipe_t;
 
 int spipe(spipe_t * p);
+int spipecreate(spipe_t * p, size_t size);
 size_t spiperead(spipe_t * p, void *buf, size_t n);
 size_t spipewrite(spipe_t * p, void *buf, size_t n);
 int spipeclose(spipe_t * p);
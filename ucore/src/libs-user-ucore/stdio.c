@@ -4,15 +4,104 @@
 #include <file.h>
 #include <syscall.h>
 #include <unistd.h>
+#include <thread.h>
 
 /* *
- * cputch - writes a single character @c to stdout, and it will
- * increace the value of counter pointed by @cnt.
+ * The output of the first NR_STREAMS fds goes through a buffer each, so
+ * that a formatted line is one write instead of one per character:
+ *   - _IOFBF writes the buffer when it is full;
+ *   - _IOLBF also at each newline, the default of stdout;
+ *   - _IONBF at the end of each call, the default of the others.
+ * All of them are flushed on exit, before fork and exec, and before a read
+ * of stdin, so that a prompt shows before the input it asks for.
  * */
-static void cputch(int c, int *cnt)
+#define NR_STREAMS              8
+#define STREAM_BUFSIZE          1024
+
+struct stream {
+	mutex_t lock;
+	int mode;
+	int len;
+	char buf[STREAM_BUFSIZE];
+};
+
+static struct stream streams[NR_STREAMS] = {
+	[1] = {INIT_MUTEX, _IOLBF},
+};
+
+static inline struct stream *stream_of(int fd)
+{
+	return (fd >= 0 && fd < NR_STREAMS) ? streams + fd : NULL;
+}
+
+// stream_flush_locked - write out the buffer of s; the console takes what
+//                     - stdout could not, e.g. when fd 1 is closed
+static void stream_flush_locked(struct stream *s, int fd)
+{
+	int off = 0, ret;
+	while (off < s->len) {
+		if ((ret = write(fd, s->buf + off, s->len - off)) <= 0) {
+			break;
+		}
+		off += ret;
+	}
+	if (fd == 1) {
+		for (; off < s->len; off++) {
+			sys_putc(s->buf[off]);
+		}
+	}
+	s->len = 0;
+}
+
+static void stream_putc_locked(struct stream *s, int fd, char c)
+{
+	s->buf[s->len++] = c;
+	if (s->len == STREAM_BUFSIZE || (c == '\n' && s->mode == _IOLBF)) {
+		stream_flush_locked(s, fd);
+	}
+}
+
+struct putdat {
+	struct stream *s;
+	int cnt;
+};
+
+static void sputch(int c, struct putdat *pd, int fd)
+{
+	if (pd->s != NULL) {
+		stream_putc_locked(pd->s, fd, c);
+	} else {
+		char ch = c;
+		write(fd, &ch, sizeof(char));
+	}
+	pd->cnt++;
+}
+
+int vfprintf(int fd, const char *fmt, va_list ap)
 {
-	sys_putc(c);
-	(*cnt)++;
+	struct putdat pd = { stream_of(fd), 0 };
+	if (pd.s != NULL) {
+		mutex_lock(&(pd.s->lock));
+	}
+	vprintfmt((void *)sputch, fd, &pd, fmt, ap);
+	if (pd.s != NULL) {
+		if (pd.s->mode == _IONBF) {
+			stream_flush_locked(pd.s, fd);
+		}
+		mutex_unlock(&(pd.s->lock));
+	}
+	return pd.cnt;
+}
+
+int fprintf(int fd, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	int cnt = vfprintf(fd, fmt, ap);
+	va_end(ap);
+
+	return cnt;
 }
 
 /* *
@@ -26,9 +115,7 @@ static void cputch(int c, int *cnt)
  * */
 int vcprintf(const char *fmt, va_list ap)
 {
-	int cnt = 0;
-	vprintfmt((void *)cputch, NO_FD, &cnt, fmt, ap);
-	return cnt;
+	return vfprintf(1, fmt, ap);
 }
 
 /* *
@@ -54,35 +141,64 @@ int cprintf(const char *fmt, ...)
  * */
 int cputs(const char *str)
 {
-	int cnt = 0;
-	char c;
-	while ((c = *str++) != '\0') {
-		cputch(c, &cnt);
-	}
-	cputch('\n', &cnt);
-	return cnt;
+	return cprintf("%s\n", str);
 }
 
-static void fputch(char c, int *cnt, int fd)
+/* *
+ * setvbuf - set the buffering of fd to _IOFBF, _IOLBF or _IONBF; what it
+ * has buffered is written first. Only the first NR_STREAMS fds are
+ * buffered, the others are always written at the end of each call.
+ * */
+int setvbuf(int fd, int mode)
 {
-	write(fd, &c, sizeof(char));
-	(*cnt)++;
+	struct stream *s = stream_of(fd);
+	if (s == NULL || (mode != _IOFBF && mode != _IOLBF && mode != _IONBF)) {
+		return -1;
+	}
+	mutex_lock(&(s->lock));
+	stream_flush_locked(s, fd);
+	s->mode = mode;
+	mutex_unlock(&(s->lock));
+	return 0;
 }
 
-int vfprintf(int fd, const char *fmt, va_list ap)
+// fflush - write out the buffer of fd, or of all fds if fd is -1
+int fflush(int fd)
 {
-	int cnt = 0;
-	vprintfmt((void *)fputch, fd, &cnt, fmt, ap);
-	return cnt;
+	struct stream *s;
+	if (fd == -1) {
+		for (fd = 0; fd < NR_STREAMS; fd++) {
+			fflush(fd);
+		}
+		return 0;
+	}
+	if ((s = stream_of(fd)) == NULL) {
+		return -1;
+	}
+	if (s->len != 0) {
+		mutex_lock(&(s->lock));
+		stream_flush_locked(s, fd);
+		mutex_unlock(&(s->lock));
+	}
+	return 0;
 }
 
-int fprintf(int fd, const char *fmt, ...)
+// stdio_lock_all - flush and hold every stream across a fork, so that the
+//                - child neither writes the output of the parent again
+//                - nor gets a stream locked halfway
+void stdio_lock_all(void)
 {
-	va_list ap;
-
-	va_start(ap, fmt);
-	int cnt = vfprintf(fd, fmt, ap);
-	va_end(ap);
+	int fd;
+	for (fd = 0; fd < NR_STREAMS; fd++) {
+		mutex_lock(&(streams[fd].lock));
+		stream_flush_locked(streams + fd, fd);
+	}
+}
 
-	return cnt;
+void stdio_unlock_all(void)
+{
+	int fd;
+	for (fd = NR_STREAMS - 1; fd >= 0; fd--) {
+		mutex_unlock(&(streams[fd].lock));
+	}
 }
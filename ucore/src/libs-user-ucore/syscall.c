@@ -3,9 +3,13 @@
 #include <stdarg.h>
 #include <syscall.h>
 #include <mboxbuf.h>
+#include <mempolicy.h>
+#include <hugepage.h>
 #include <stat.h>
 #include <dirent.h>
 #include <signal.h>
+#include <epoll.h>
+#include <uringbuf.h>
 
 #ifndef ARCH_ARM
 
@@ -31,6 +35,21 @@ int sys_exec(const char *filename, const char **argv, const char **envp)
 	return syscall(SYS_exec, filename, argv, envp);
 }
 
+int sys_spawn(const char *filename, const char **argv, const char **envp)
+{
+	return syscall(SYS_spawn, filename, argv, envp);
+}
+
+int sys_checkpoint(const char *path)
+{
+	return syscall(SYS_checkpoint, path);
+}
+
+int sys_restore(const char *path)
+{
+	return syscall(SYS_restore, path);
+}
+
 int sys_yield(void)
 {
 	return syscall(SYS_yield);
@@ -46,6 +65,62 @@ int sys_kill(int pid)
 	return syscall(SYS_kill, pid);
 }
 
+int sys_sched_setscheduler(int pid, int policy, int prio)
+{
+	return syscall(SYS_sched_setscheduler, pid, policy, prio);
+}
+
+int sys_sched_getscheduler(int pid)
+{
+	return syscall(SYS_sched_getscheduler, pid);
+}
+
+int sys_sched_getparam(int pid)
+{
+	return syscall(SYS_sched_getparam, pid);
+}
+
+int sys_setpriority(int pid, int nice)
+{
+	return syscall(SYS_setpriority, pid, nice);
+}
+
+int sys_getpriority(int pid, int *nice_store)
+{
+	return syscall(SYS_getpriority, pid, nice_store);
+}
+
+int sys_timerslack(int pid, int slack)
+{
+	return syscall(SYS_timerslack, pid, slack);
+}
+
+int sys_sched_setaffinity(int pid, size_t size, const void *mask)
+{
+	return syscall(SYS_sched_setaffinity, pid, size, mask);
+}
+
+int sys_sched_getaffinity(int pid, size_t size, void *mask)
+{
+	return syscall(SYS_sched_getaffinity, pid, size, mask);
+}
+
+int sys_settls(void *tls)
+{
+	return syscall(SYS_settls, tls);
+}
+
+void *sys_gettls(void)
+{
+	return (void *)syscall(SYS_gettls);
+}
+
+int sys_futex(volatile void *uaddr, int op, int val, uintptr_t timeout,
+	      volatile void *uaddr2)
+{
+	return syscall(SYS_futex, uaddr, op, val, timeout, uaddr2);
+}
+
 size_t sys_gettime(void)
 {
 	return (size_t) syscall(SYS_gettime);
@@ -56,6 +131,76 @@ int sys_getpid(void)
 	return syscall(SYS_getpid);
 }
 
+uintptr_t sys_vvar(void)
+{
+	return (uintptr_t) syscall(SYS_vvar);
+}
+
+int sys_settimeofday(const struct timeval *tv)
+{
+	return syscall(SYS_settimeofday, tv);
+}
+
+int sys_adjtime(const struct timeval *delta, struct timeval *olddelta)
+{
+	return syscall(SYS_adjtime, delta, olddelta);
+}
+
+int sys_batch(struct syscall_rec *recs, int n)
+{
+	return syscall(SYS_batch, recs, n);
+}
+
+int sys_getrusage(int who, struct rusage *usage)
+{
+	return syscall(SYS_getrusage, who, usage);
+}
+
+int sys_profile(int op, char *buf, size_t len)
+{
+	return syscall(SYS_profile, op, buf, len);
+}
+
+int sys_ftrace(int op, char *buf, size_t len)
+{
+	return syscall(SYS_ftrace, op, buf, len);
+}
+
+int sys_trace(int op, uint32_t arg, uintptr_t * addr_store)
+{
+	return syscall(SYS_trace, op, arg, addr_store);
+}
+
+int sys_sysrec(int op, uint32_t arg, uintptr_t * addr_store)
+{
+	return syscall(SYS_sysrec, op, arg, addr_store);
+}
+
+int sys_lockstat(int op, char *buf, size_t len)
+{
+	return syscall(SYS_lockstat, op, buf, len);
+}
+
+int sys_kbench(int op, size_t arg, int count)
+{
+	return syscall(SYS_kbench, op, arg, count);
+}
+
+int sys_irqaffinity(int op, int irq, uint64_t * mask)
+{
+	return syscall(SYS_irqaffinity, op, irq, mask);
+}
+
+int sys_pktio(int op, uint32_t queue, void *arg)
+{
+	return syscall(SYS_pktio, op, queue, arg);
+}
+
+int sys_perf(int op, int id, void *arg)
+{
+	return syscall(SYS_perf, op, id, arg);
+}
+
 int sys_brk(uintptr_t * brk_store)
 {
 	return syscall(SYS_brk, brk_store);
@@ -71,11 +216,65 @@ int sys_munmap(uintptr_t addr, size_t len)
 	return syscall(SYS_munmap, addr, len);
 }
 
+int
+sys_mmap_file(uintptr_t * addr_store, size_t len, uint32_t mmap_flags, int fd,
+	      off_t offset, size_t filesz)
+{
+	return syscall(SYS_mmap_file, addr_store, len, mmap_flags, fd, offset,
+		       filesz);
+}
+
 int sys_shmem(uintptr_t * addr_store, size_t len, uint32_t mmap_flags)
 {
 	return syscall(SYS_shmem, addr_store, len, mmap_flags);
 }
 
+int sys_shm_open(const char *name, size_t len, uint32_t mmap_flags,
+		 uintptr_t * addr_store)
+{
+	return syscall(SYS_shm_open, name, len, mmap_flags, addr_store);
+}
+
+int sys_shm_unlink(const char *name)
+{
+	return syscall(SYS_shm_unlink, name);
+}
+
+int sys_madvise(uintptr_t addr, size_t len, int advice)
+{
+	return syscall(SYS_madvise, addr, len, advice);
+}
+
+int sys_memcg(int op, int id, size_t arg0, uintptr_t arg1)
+{
+	return syscall(SYS_memcg, op, id, arg0, arg1);
+}
+
+int sys_cpucg(int op, int id, size_t arg0, uintptr_t arg1)
+{
+	return syscall(SYS_cpucg, op, id, arg0, arg1);
+}
+
+int sys_mempolicy(int policy, int node)
+{
+	return syscall(SYS_mempolicy, policy, node);
+}
+
+int sys_numa_stat(int node, struct numa_stat *stat)
+{
+	return syscall(SYS_numa_stat, node, stat);
+}
+
+int sys_numa_info(int node, struct numa_info *info)
+{
+	return syscall(SYS_numa_info, node, info);
+}
+
+int sys_thp_stat(struct thp_stat *stat)
+{
+	return syscall(SYS_thp_stat, stat);
+}
+
 int sys_putc(int c)
 {
 	return syscall(SYS_putc, c);
@@ -121,6 +320,12 @@ int sys_recv_event(int *pid_store, int *event_store, unsigned int timeout)
 	return syscall(SYS_event_recv, pid_store, event_store, timeout);
 }
 
+int
+sys_event_call(int pid, int event, int *reply_store, unsigned int timeout)
+{
+	return syscall(SYS_event_call, pid, event, reply_store, timeout);
+}
+
 int sys_mbox_init(unsigned int max_slots)
 {
 	return syscall(SYS_mbox_init, max_slots);
@@ -136,6 +341,16 @@ int sys_mbox_recv(int id, struct mboxbuf *buf, unsigned int timeout)
 	return syscall(SYS_mbox_recv, id, buf, timeout);
 }
 
+int sys_mbox_sendm(int id, struct mboxbuf *bufs, int n, unsigned int timeout)
+{
+	return syscall(SYS_mbox_sendm, id, bufs, n, timeout);
+}
+
+int sys_mbox_recvm(int id, struct mboxbuf *bufs, int n, unsigned int timeout)
+{
+	return syscall(SYS_mbox_recvm, id, bufs, n, timeout);
+}
+
 int sys_mbox_free(int id)
 {
 	return syscall(SYS_mbox_free, id);
@@ -171,6 +386,16 @@ int sys_seek(int fd, off_t pos, int whence)
 	return syscall(SYS_seek, fd, pos, whence);
 }
 
+int sys_preadv(int fd, struct iovec *iov, int iovcnt, off_t pos)
+{
+	return syscall(SYS_preadv, fd, iov, iovcnt, pos);
+}
+
+int sys_pwritev(int fd, struct iovec *iov, int iovcnt, off_t pos)
+{
+	return syscall(SYS_pwritev, fd, iov, iovcnt, pos);
+}
+
 int sys_fstat(int fd, struct stat *stat)
 {
 	return syscall(SYS_fstat, fd, stat);
@@ -181,6 +406,11 @@ int sys_fsync(int fd)
 	return syscall(SYS_fsync, fd);
 }
 
+int sys_fallocate(int fd, int mode, off_t off, off_t len)
+{
+	return syscall(SYS_fallocate, fd, mode, off, len);
+}
+
 int sys_chdir(const char *path)
 {
 	return syscall(SYS_chdir, path);
@@ -216,21 +446,102 @@ int sys_getdirentry(int fd, struct dirent *dirent)
 	return syscall(SYS_getdirentry, fd, dirent);
 }
 
+int sys_getdents(int fd, void *buf, size_t len)
+{
+	return syscall(SYS_getdents, fd, buf, len);
+}
+
 int sys_dup(int fd1, int fd2)
 {
 	return syscall(SYS_dup, fd1, fd2);
 }
 
+int sys_fcntl(int fd, int cmd, int arg)
+{
+	return syscall(SYS_fcntl, fd, cmd, arg);
+}
+
+int sys_splice(int fd_in, int fd_out, size_t len)
+{
+	return syscall(SYS_splice, fd_in, fd_out, len);
+}
+
+int sys_tee(int fd_in, int fd_out, size_t len)
+{
+	return syscall(SYS_tee, fd_in, fd_out, len);
+}
+
+int sys_sendfile(int out_fd, int in_fd, off_t * offset, size_t count)
+{
+	return syscall(SYS_sendfile, out_fd, in_fd, offset, count);
+}
+
+int
+sys_copy_file_range(int fd_in, off_t * off_in, int fd_out, off_t * off_out,
+		    size_t len)
+{
+	return syscall(SYS_copy_file_range, fd_in, off_in, fd_out, off_out,
+		       len);
+}
+
 int sys_pipe(int *fd_store)
 {
 	return syscall(SYS_pipe, fd_store);
 }
 
+int sys_epoll_create(void)
+{
+	return syscall(SYS_epoll_create);
+}
+
+int
+sys_epoll_ctl(int epfd, int op, int type, int id, struct epoll_event *event)
+{
+	return syscall(SYS_epoll_ctl, epfd, op, type, id, event);
+}
+
+int
+sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+	       unsigned int timeout)
+{
+	return syscall(SYS_epoll_wait, epfd, events, maxevents, timeout);
+}
+
+int sys_uring_enter(struct uring_state *state, unsigned int to_submit)
+{
+	return syscall(SYS_uring_enter, state, to_submit);
+}
+
 int sys_mkfifo(const char *name, uint32_t open_flags)
 {
 	return syscall(SYS_mkfifo, name, open_flags);
 }
 
+int sys_socket(int domain, int type, int protocol)
+{
+	return syscall(SYS_socket, domain, type, protocol);
+}
+
+int sys_bind(int fd, const struct sockaddr_in *addr)
+{
+	return syscall(SYS_bind, fd, addr);
+}
+
+int sys_listen(int fd, int backlog)
+{
+	return syscall(SYS_listen, fd, backlog);
+}
+
+int sys_accept(int fd, struct sockaddr_in *addr)
+{
+	return syscall(SYS_accept, fd, addr);
+}
+
+int sys_connect(int fd, const struct sockaddr_in *addr)
+{
+	return syscall(SYS_connect, fd, addr);
+}
+
 int sys_ioctl(int d, int request, unsigned long data)
 {
 	return syscall(SYS_ioctl, d, request, data);
@@ -374,20 +685,78 @@ type sys_##name(type1 arg1,type2 arg2,type3 arg3, type4 arg4) {
   __syscall_return(type,__res);                                                     \
 }
 
+#define _syscall5(type,name,type1,arg1,type2,arg2,type3,arg3,type4,arg4,type5,arg5) \
+type sys_##name(type1 arg1,type2 arg2,type3 arg3, type4 arg4, type5 arg5) {                   \
+  long __res;                                                                     \
+  __asm__ __volatile__ (                                                        \
+  "mov\tr0,%1\n\t"                                                                  \
+  "mov\tr1,%2\n\t"                                                                  \
+  "mov\tr2,%3\n\t"                                                                  \
+  "mov\tr3,%4\n\t"                                                                  \
+  "mov\tr4,%5\n\t"                                                                  \
+  __syscall(name)                                                            \
+  "mov\t%0,r0"                                                                         \
+        : "=r" (__res)                                                             \
+        : "r" ((long)(arg1)),"r" ((long)(arg2)),"r" ((long)(arg3)),"r"((long)(arg4)),"r"((long)(arg5)) \
+        : "r0","r1","r2","r3","r4","lr");                                                       \
+  __syscall_return(type,__res);                                                     \
+}
+
 _syscall1(int, exit, int, error);
 _syscall0(int, fork);
 _syscall2(int, wait, int, pid, int *, store);
 _syscall3(int, exec, const char *, filename, const char **, argv,
 	  const char **, envp);
+_syscall3(int, spawn, const char *, filename, const char **, argv,
+	  const char **, envp);
+_syscall1(int, checkpoint, const char *, path);
+_syscall1(int, restore, const char *, path);
 _syscall0(int, yield);
 _syscall1(int, sleep, unsigned int, time);
 _syscall1(int, kill, int, pid);
+_syscall3(int, sched_setscheduler, int, pid, int, policy, int, prio);
+_syscall1(int, sched_getscheduler, int, pid);
+_syscall1(int, sched_getparam, int, pid);
+_syscall2(int, setpriority, int, pid, int, nice);
+_syscall2(int, getpriority, int, pid, int *, nice_store);
+_syscall3(int, sched_setaffinity, int, pid, size_t, size, const void *,
+	  mask);
+_syscall3(int, sched_getaffinity, int, pid, size_t, size, void *, mask);
+_syscall1(int, settls, void *, tls);
+_syscall0(void *, gettls);
+_syscall5(int, futex, volatile void *, uaddr, int, op, int, val, uintptr_t,
+	  timeout, volatile void *, uaddr2);
 _syscall0(size_t, gettime);
 _syscall0(int, getpid);
+_syscall0(uintptr_t, vvar);
+_syscall1(int, settimeofday, const struct timeval *, tv);
+_syscall2(int, adjtime, const struct timeval *, delta, struct timeval *,
+	  olddelta);
+_syscall2(int, batch, struct syscall_rec *, recs, int, n);
+_syscall2(int, getrusage, int, who, struct rusage *, usage);
+_syscall3(int, profile, int, op, char *, buf, size_t, len);
+_syscall3(int, ftrace, int, op, char *, buf, size_t, len);
+_syscall3(int, trace, int, op, uint32_t, arg, uintptr_t *, addr_store);
+_syscall3(int, sysrec, int, op, uint32_t, arg, uintptr_t *, addr_store);
+_syscall3(int, lockstat, int, op, char *, buf, size_t, len);
+_syscall3(int, kbench, int, op, size_t, arg, int, count);
+_syscall3(int, irqaffinity, int, op, int, irq, uint64_t *, mask);
+_syscall3(int, pktio, int, op, uint32_t, queue, void *, arg);
+_syscall3(int, perf, int, op, int, id, void *, arg);
 _syscall1(int, brk, uintptr_t *, brk);
 _syscall3(int, mmap, uintptr_t *, addr, size_t, len, uint32_t, mmap);
 _syscall2(int, munmap, uintptr_t, addr, size_t, len);
 _syscall3(int, shmem, uintptr_t *, addr, size_t, len, uint32_t, mmap);
+_syscall4(int, shm_open, const char *, name, size_t, len, uint32_t, mmap,
+	  uintptr_t *, addr);
+_syscall1(int, shm_unlink, const char *, name);
+_syscall3(int, madvise, uintptr_t, addr, size_t, len, int, advice);
+_syscall4(int, memcg, int, op, int, id, size_t, arg0, uintptr_t, arg1);
+_syscall4(int, cpucg, int, op, int, id, size_t, arg0, uintptr_t, arg1);
+_syscall2(int, mempolicy, int, policy, int, node);
+_syscall2(int, numa_stat, int, node, struct numa_stat *, stat);
+_syscall2(int, numa_info, int, node, struct numa_info *, info);
+_syscall1(int, thp_stat, struct thp_stat *, stat);
 _syscall1(int, putc, int, c);
 _syscall0(int, pgdir);
 _syscall1(sem_t, sem_init, int, value);
@@ -397,11 +766,17 @@ _syscall1(int, sem_free, sem_t, sem);
 _syscall2(int, sem_get_value, sem_t, sem, int *, value);
 _syscall3(int, event_send, int, pid, int, event, unsigned int, timeout);
 _syscall3(int, event_recv, int *, pid, int *, event, unsigned int, timeout);
+_syscall4(int, event_call, int, pid, int, event, int *, reply, unsigned int,
+	  timeout);
 _syscall1(int, mbox_init, unsigned int, max);
 _syscall3(int, mbox_send, int, id, struct mboxbuf *, buf, unsigned int,
 	  timeout);
 _syscall3(int, mbox_recv, int, id, struct mboxbuf *, buf, unsigned int,
 	  timeout);
+_syscall4(int, mbox_sendm, int, id, struct mboxbuf *, bufs, int, n,
+	  unsigned int, timeout);
+_syscall4(int, mbox_recvm, int, id, struct mboxbuf *, bufs, int, n,
+	  unsigned int, timeout);
 _syscall1(int, mbox_free, int, id);
 _syscall2(int, mbox_info, int, id, struct mboxinfo *, info);
 _syscall2(int, open, const char *, path, uint32_t, open);
@@ -409,8 +784,13 @@ _syscall1(int, close, int, fd);
 _syscall3(int, read, int, fd, void *, base, size_t, len);
 _syscall3(int, write, int, fd, void *, base, size_t, len);
 _syscall3(int, seek, int, fd, off_t, pos, int, whence);
+_syscall4(int, preadv, int, fd, struct iovec *, iov, int, iovcnt, off_t,
+	  pos);
+_syscall4(int, pwritev, int, fd, struct iovec *, iov, int, iovcnt, off_t,
+	  pos);
 _syscall2(int, fstat, int, fd, struct stat *, stat);
 _syscall1(int, fsync, int, fd);
+_syscall4(int, fallocate, int, fd, int, mode, off_t, off, off_t, len);
 _syscall1(int, chdir, const char *, path);
 _syscall2(int, getcwd, char *, buffer, size_t, len);
 _syscall1(int, mkdir, const char *, path);
@@ -418,9 +798,29 @@ _syscall2(int, link, const char *, path1, const char *, path2);
 _syscall2(int, rename, const char *, path1, const char *, path2);
 _syscall1(int, unlink, const char *, path);
 _syscall2(int, getdirentry, int, fd, struct dirent *, dirent);
+_syscall3(int, getdents, int, fd, void *, buf, size_t, len);
 _syscall2(int, dup, int, fd1, int, fd2);
+_syscall3(int, fcntl, int, fd, int, cmd, int, arg);
+_syscall3(int, splice, int, fd_in, int, fd_out, size_t, len);
+_syscall3(int, tee, int, fd_in, int, fd_out, size_t, len);
+_syscall4(int, sendfile, int, out_fd, int, in_fd, off_t *, offset, size_t,
+	  count);
+_syscall5(int, copy_file_range, int, fd_in, off_t *, off_in, int, fd_out,
+	  off_t *, off_out, size_t, len);
 _syscall1(int, pipe, int *, fd);
+_syscall0(int, epoll_create);
+_syscall5(int, epoll_ctl, int, epfd, int, op, int, type, int, id,
+	  struct epoll_event *, event);
+_syscall4(int, epoll_wait, int, epfd, struct epoll_event *, events, int,
+	  maxevents, unsigned int, timeout);
+_syscall2(int, uring_enter, struct uring_state *, state, unsigned int,
+	  to_submit);
 _syscall2(int, mkfifo, const char *, name, uint32_t, open);
+_syscall3(int, socket, int, domain, int, type, int, protocol);
+_syscall2(int, bind, int, fd, const struct sockaddr_in *, addr);
+_syscall2(int, listen, int, fd, int, backlog);
+_syscall2(int, accept, int, fd, struct sockaddr_in *, addr);
+_syscall2(int, connect, int, fd, const struct sockaddr_in *, addr);
 _syscall3(int, ioctl, int, d, int, request, unsigned long, data);
 _syscall4(void *, linux_mmap, void *, addr, size_t, length, int, fd, size_t,
 	  offset);
@@ -10,15 +10,62 @@ int sys_exit(int error_code);
 int sys_fork(void);
 int sys_wait(int pid, int *store);
 int sys_exec(const char *filename, const char **argv, const char **envp);
+int sys_spawn(const char *filename, const char **argv, const char **envp);
+int sys_checkpoint(const char *path);
+int sys_restore(const char *path);
 int sys_yield(void);
 int sys_sleep(unsigned int time);
 int sys_kill(int pid);
+int sys_sched_setscheduler(int pid, int policy, int prio);
+int sys_sched_getscheduler(int pid);
+int sys_sched_getparam(int pid);
+int sys_setpriority(int pid, int nice);
+int sys_getpriority(int pid, int *nice_store);
+int sys_timerslack(int pid, int slack);
+int sys_sched_setaffinity(int pid, size_t size, const void *mask);
+int sys_sched_getaffinity(int pid, size_t size, void *mask);
+int sys_settls(void *tls);
+void *sys_gettls(void);
+int sys_futex(volatile void *uaddr, int op, int val, uintptr_t timeout,
+	      volatile void *uaddr2);
 size_t sys_gettime(void);
 int sys_getpid(void);
+uintptr_t sys_vvar(void);
+struct timeval;
+int sys_settimeofday(const struct timeval *tv);
+int sys_adjtime(const struct timeval *delta, struct timeval *olddelta);
+struct syscall_rec;
+int sys_batch(struct syscall_rec *recs, int n);
+struct rusage;
+int sys_getrusage(int who, struct rusage *usage);
+int sys_profile(int op, char *buf, size_t len);
+int sys_ftrace(int op, char *buf, size_t len);
+int sys_trace(int op, uint32_t arg, uintptr_t * addr_store);
+int sys_sysrec(int op, uint32_t arg, uintptr_t * addr_store);
+int sys_lockstat(int op, char *buf, size_t len);
+int sys_kbench(int op, size_t arg, int count);
+int sys_irqaffinity(int op, int irq, uint64_t * mask);
+int sys_pktio(int op, uint32_t queue, void *arg);
+int sys_perf(int op, int id, void *arg);
 int sys_brk(uintptr_t * brk_store);
 int sys_mmap(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
 int sys_munmap(uintptr_t addr, size_t len);
+int sys_mmap_file(uintptr_t * addr_store, size_t len, uint32_t mmap_flags,
+		  int fd, off_t offset, size_t filesz);
 int sys_shmem(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
+int sys_shm_open(const char *name, size_t len, uint32_t mmap_flags,
+		 uintptr_t * addr_store);
+int sys_shm_unlink(const char *name);
+int sys_madvise(uintptr_t addr, size_t len, int advice);
+int sys_memcg(int op, int id, size_t arg0, uintptr_t arg1);
+int sys_cpucg(int op, int id, size_t arg0, uintptr_t arg1);
+struct numa_stat;
+struct numa_info;
+int sys_mempolicy(int policy, int node);
+int sys_numa_stat(int node, struct numa_stat *stat);
+int sys_numa_info(int node, struct numa_info *info);
+struct thp_stat;
+int sys_thp_stat(struct thp_stat *stat);
 int sys_putc(int c);
 int sys_pgdir(void);
 sem_t sys_sem_init(int value);
@@ -28,6 +75,7 @@ int sys_sem_free(sem_t sem_id);
 int sys_sem_get_value(sem_t sem_id, int *value_store);
 int sys_send_event(int pid, int event, unsigned int timeout);
 int sys_recv_event(int *pid_store, int *event_store, unsigned int timeout);
+int sys_event_call(int pid, int event, int *reply_store, unsigned int timeout);
 
 //#define sys_event_send(x,y,z) sys_send_event(x,y,x)
 //#define sys_event_recv(x,y,z) sys_recv_event(x,y,x)
@@ -38,19 +86,25 @@ struct mboxinfo;
 int sys_mbox_init(unsigned int max_slots);
 int sys_mbox_send(int id, struct mboxbuf *buf, unsigned int timeout);
 int sys_mbox_recv(int id, struct mboxbuf *buf, unsigned int timeout);
+int sys_mbox_sendm(int id, struct mboxbuf *bufs, int n, unsigned int timeout);
+int sys_mbox_recvm(int id, struct mboxbuf *bufs, int n, unsigned int timeout);
 int sys_mbox_free(int id);
 int sys_mbox_info(int id, struct mboxinfo *info);
 
 struct stat;
 struct dirent;
+struct iovec;
 
 int sys_open(const char *path, uint32_t open_flags);
 int sys_close(int fd);
 int sys_read(int fd, void *base, size_t len);
 int sys_write(int fd, void *base, size_t len);
 int sys_seek(int fd, off_t pos, int whence);
+int sys_preadv(int fd, struct iovec *iov, int iovcnt, off_t pos);
+int sys_pwritev(int fd, struct iovec *iov, int iovcnt, off_t pos);
 int sys_fstat(int fd, struct stat *stat);
 int sys_fsync(int fd);
+int sys_fallocate(int fd, int mode, off_t off, off_t len);
 int sys_chdir(const char *path);
 int sys_getcwd(char *buffer, size_t len);
 int sys_mkdir(const char *path);
@@ -58,9 +112,30 @@ int sys_link(const char *path1, const char *path2);
 int sys_rename(const char *path1, const char *path2);
 int sys_unlink(const char *path);
 int sys_getdirentry(int fd, struct dirent *dirent);
+int sys_getdents(int fd, void *buf, size_t len);
 int sys_dup(int fd1, int fd2);
+int sys_fcntl(int fd, int cmd, int arg);
+int sys_splice(int fd_in, int fd_out, size_t len);
+int sys_tee(int fd_in, int fd_out, size_t len);
+int sys_sendfile(int out_fd, int in_fd, off_t * offset, size_t count);
+int sys_copy_file_range(int fd_in, off_t * off_in, int fd_out,
+			off_t * off_out, size_t len);
 int sys_pipe(int *fd_store);
+struct epoll_event;
+int sys_epoll_create(void);
+int sys_epoll_ctl(int epfd, int op, int type, int id,
+		  struct epoll_event *event);
+int sys_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+		   unsigned int timeout);
+struct uring_state;
+int sys_uring_enter(struct uring_state *state, unsigned int to_submit);
 int sys_mkfifo(const char *name, uint32_t open_flags);
+struct sockaddr_in;
+int sys_socket(int domain, int type, int protocol);
+int sys_bind(int fd, const struct sockaddr_in *addr);
+int sys_listen(int fd, int backlog);
+int sys_accept(int fd, struct sockaddr_in *addr);
+int sys_connect(int fd, const struct sockaddr_in *addr);
 
 int sys_init_module(void __user * umod, unsigned long len,
 		    const char __user * uargs);
@@ -1,8 +1,84 @@
 #include <types.h>
 #include <ulib.h>
+#include <string.h>
 #include <thread.h>
 #include <unistd.h>
 #include <error.h>
+#include <syscall.h>
+
+static thread_tls_t main_tls;
+static atomic_t tls_nkeys;
+
+/* *
+ * The stacks of the threads waited for are kept, up to THREAD_STACK_CACHE
+ * of them, and handed to the next threads: a short thread then costs a
+ * clone and a wait, not an mmap, the faults on a fresh stack and the
+ * munmap with its TLB shootdown.
+ * */
+static mutex_t stack_lock = INIT_MUTEX;
+static uintptr_t stack_cache[THREAD_STACK_CACHE];
+static int stack_cached;
+
+// stack_alloc - a stack of THREAD_STACKSIZE above its guard, 0 if there
+//             - is no memory
+static uintptr_t stack_alloc(void)
+{
+	uintptr_t base = 0, stack = 0;
+	mutex_lock(&stack_lock);
+	if (stack_cached > 0) {
+		stack = stack_cache[--stack_cached];
+	}
+	mutex_unlock(&stack_lock);
+	if (stack != 0) {
+		return stack;
+	}
+	/* all read-only first, then the stack above the guard writable */
+	if (mmap(&base, THREAD_GUARDSIZE + THREAD_STACKSIZE, 0) != 0) {
+		return 0;
+	}
+	stack = base + THREAD_GUARDSIZE;
+	if (munmap(stack, THREAD_STACKSIZE) != 0
+	    || mmap(&stack, THREAD_STACKSIZE, MMAP_WRITE | MMAP_STACK) != 0) {
+		munmap(base, THREAD_GUARDSIZE + THREAD_STACKSIZE);
+		return 0;
+	}
+	return stack;
+}
+
+static void stack_free(uintptr_t stack)
+{
+	mutex_lock(&stack_lock);
+	if (stack_cached < THREAD_STACK_CACHE) {
+		stack_cache[stack_cached++] = stack;
+		stack = 0;
+	}
+	mutex_unlock(&stack_lock);
+	if (stack != 0) {
+		munmap(stack - THREAD_GUARDSIZE,
+		       THREAD_GUARDSIZE + THREAD_STACKSIZE);
+	}
+}
+
+// thread_tls_setup - have the kernel load tls for the calling thread
+static void thread_tls_setup(thread_tls_t * tls)
+{
+	tls->self = tls;
+	sys_settls(tls);
+}
+
+// thread_tls_init - the block of the main thread, called by umain
+void thread_tls_init(void)
+{
+	thread_tls_setup(&main_tls);
+}
+
+// thread_start - the new thread starts here, on the stack below its block
+static int thread_start(void *arg)
+{
+	thread_tls_t *tls = arg;
+	thread_tls_setup(tls);
+	return tls->fn(tls->arg);
+}
 
 int thread(int (*fn) (void *), void *arg, thread_t * tidp)
 {
@@ -10,17 +86,20 @@ int thread(int (*fn) (void *), void *arg, thread_t * tidp)
 		return -E_INVAL;
 	}
 	int ret;
-	uintptr_t stack = 0;
-	if ((ret =
-	     mmap(&stack, THREAD_STACKSIZE, MMAP_WRITE | MMAP_STACK)) != 0) {
-		return ret;
+	uintptr_t stack;
+	if ((stack = stack_alloc()) == 0) {
+		return -E_NO_MEM;
 	}
-	assert(stack != 0);
+
+	thread_tls_t *tls = (thread_tls_t *)
+	    ((stack + THREAD_STACKSIZE - sizeof(thread_tls_t)) & ~(uintptr_t) 15);
+	memset(tls, 0, sizeof(thread_tls_t));
+	tls->fn = fn, tls->arg = arg;
 
 	if ((ret =
 	     clone(CLONE_VM | CLONE_THREAD | CLONE_SEM | CLONE_FS,
-		   stack + THREAD_STACKSIZE, fn, arg)) < 0) {
-		munmap(stack, THREAD_STACKSIZE);
+		   (uintptr_t) tls, thread_start, tls)) < 0) {
+		stack_free(stack);
 		return ret;
 	}
 
@@ -34,7 +113,7 @@ int thread_wait(thread_t * tidp, int *exit_code)
 	int ret = -E_INVAL;
 	if (tidp != NULL) {
 		if ((ret = waitpid(tidp->pid, exit_code)) == 0) {
-			munmap((uintptr_t) (tidp->stack), THREAD_STACKSIZE);
+			stack_free((uintptr_t) (tidp->stack));
 		}
 	}
 	return ret;
@@ -47,3 +126,292 @@ int thread_kill(thread_t * tidp)
 	}
 	return -E_INVAL;
 }
+
+#define FUTEX_WAIT              0
+#define FUTEX_WAKE              1
+#define FUTEX_REQUEUE           3
+#define FUTEX_LOCK_PI           6
+#define FUTEX_UNLOCK_PI         7
+#define FUTEX_TRYLOCK_PI        8
+
+#define MUTEX_LOCKED            0
+#define MUTEX_WAITERS           1
+
+int futex_wait(volatile void *uaddr, int val)
+{
+	return sys_futex(uaddr, FUTEX_WAIT, val, 0, NULL);
+}
+
+int futex_wake(volatile void *uaddr, int nr)
+{
+	return sys_futex(uaddr, FUTEX_WAKE, nr, 0, NULL);
+}
+
+/* *
+ * the locked bit op orders the flag before the reads of the word and the
+ * cursor, and the move of the cursor before the read of the flag
+ * */
+void doorbell_wait(volatile uint32_t * bell, volatile uint32_t * cursor,
+		   uint32_t val)
+{
+	set_bit(DOORBELL_WAITING, bell);
+	uint32_t word = *bell;
+	if (!(word & (1 << DOORBELL_CLOSED)) && *cursor == val) {
+		int ret = futex_wait(bell, word);
+		if (ret != 0 && ret != -E_AGAIN && ret != -E_INTR) {
+			/* no futex in the kernel */
+			yield();
+		}
+	}
+	clear_bit(DOORBELL_WAITING, bell);
+}
+
+void doorbell_ring(volatile uint32_t * bell)
+{
+	if (test_and_clear_bit(DOORBELL_WAITING, bell)) {
+		futex_wake(bell, 1);
+	}
+}
+
+void doorbell_close(volatile uint32_t * bell)
+{
+	set_bit(DOORBELL_CLOSED, bell);
+	futex_wake(bell, 0x7FFFFFFF);
+}
+
+void mutex_init(mutex_t * m)
+{
+	m->state = 0;
+}
+
+bool mutex_trylock(mutex_t * m)
+{
+#ifndef NO_LOCK
+	return !test_and_set_bit(MUTEX_LOCKED, &(m->state));
+#else
+	return 1;
+#endif
+}
+
+// mutex_sleep - sleep until the lock is free, the waiters bit is set meanwhile
+static void mutex_sleep(mutex_t * m)
+{
+	int ret = futex_wait(&(m->state),
+			     (1 << MUTEX_LOCKED) | (1 << MUTEX_WAITERS));
+	if (ret != 0 && ret != -E_AGAIN && ret != -E_INTR) {
+		/* no futex in the kernel */
+		yield();
+	}
+}
+
+// mutex_lock_contended - take the lock, leaving the waiters bit set so that
+//                      - the unlock wakes the others; for the ones requeued
+//                      - from a condvar, who were never counted as waiters
+static void mutex_lock_contended(mutex_t * m)
+{
+#ifndef NO_LOCK
+	while (1) {
+		set_bit(MUTEX_WAITERS, &(m->state));
+		if (!test_and_set_bit(MUTEX_LOCKED, &(m->state))) {
+			return;
+		}
+		mutex_sleep(m);
+	}
+#endif
+}
+
+void mutex_lock(mutex_t * m)
+{
+	if (!mutex_trylock(m)) {
+		mutex_lock_contended(m);
+	}
+}
+
+void mutex_unlock(mutex_t * m)
+{
+#ifndef NO_LOCK
+	clear_bit(MUTEX_LOCKED, &(m->state));
+	if (test_and_clear_bit(MUTEX_WAITERS, &(m->state))) {
+		futex_wake(&(m->state), 1);
+	}
+#endif
+}
+
+int thread_key_create(int *keyp)
+{
+	int key = atomic_add_return(&tls_nkeys, 1) - 1;
+	if (key >= THREAD_TLS_KEYS) {
+		return -E_NO_MEM;
+	}
+	*keyp = key;
+	return 0;
+}
+
+void *thread_getspecific(int key)
+{
+	if (key < 0 || key >= THREAD_TLS_KEYS) {
+		return NULL;
+	}
+	return thread_self()->values[key];
+}
+
+int thread_setspecific(int key, void *value)
+{
+	if (key < 0 || key >= THREAD_TLS_KEYS) {
+		return -E_INVAL;
+	}
+	thread_self()->values[key] = value;
+	return 0;
+}
+
+void pi_mutex_init(pi_mutex_t * m)
+{
+	m->owner = 0;
+}
+
+bool pi_mutex_trylock(pi_mutex_t * m)
+{
+#if defined(ARCH_X86) || defined(ARCH_AMD64)
+	if (__sync_bool_compare_and_swap(&(m->owner), 0, getpid())) {
+		return 1;
+	}
+#endif
+	return sys_futex(&(m->owner), FUTEX_TRYLOCK_PI, 0, 0, NULL) == 0;
+}
+
+int pi_mutex_lock(pi_mutex_t * m)
+{
+	int ret;
+#if defined(ARCH_X86) || defined(ARCH_AMD64)
+	if (__sync_bool_compare_and_swap(&(m->owner), 0, getpid())) {
+		return 0;
+	}
+#endif
+	do {
+		ret = sys_futex(&(m->owner), FUTEX_LOCK_PI, 0, 0, NULL);
+	} while (ret == -E_INTR);
+	return ret;
+}
+
+int pi_mutex_unlock(pi_mutex_t * m)
+{
+#if defined(ARCH_X86) || defined(ARCH_AMD64)
+	/* fails with waiters, FUTEX_WAITERS is set then */
+	if (__sync_bool_compare_and_swap(&(m->owner), getpid(), 0)) {
+		return 0;
+	}
+#endif
+	return sys_futex(&(m->owner), FUTEX_UNLOCK_PI, 0, 0, NULL);
+}
+
+void cond_init(cond_t * c)
+{
+	atomic_set(&(c->seq), 0);
+	c->mutex = NULL;
+}
+
+// cond_wait - m is held by the caller, and again on return; spurious
+//           - wakeups are possible, the caller rechecks its condition
+void cond_wait(cond_t * c, mutex_t * m)
+{
+	int seq = atomic_read(&(c->seq));
+	c->mutex = m;
+	mutex_unlock(m);
+	futex_wait(&(c->seq), seq);
+	mutex_lock_contended(m);
+}
+
+void cond_signal(cond_t * c)
+{
+	atomic_inc(&(c->seq));
+	futex_wake(&(c->seq), 1);
+}
+
+// cond_broadcast - wake one waiter and move the rest onto the mutex, they
+//                - would only contend for it one after another anyway
+void cond_broadcast(cond_t * c)
+{
+	mutex_t *m = c->mutex;
+	atomic_inc(&(c->seq));
+	if (m == NULL) {
+		return;
+	}
+	set_bit(MUTEX_WAITERS, &(m->state));
+	sys_futex(&(c->seq), FUTEX_REQUEUE, 1, 0x7FFFFFFF, &(m->state));
+}
+
+void rwlock_init(rwlock_t * rw)
+{
+	mutex_init(&(rw->lock));
+	cond_init(&(rw->readers));
+	cond_init(&(rw->writers));
+	rw->active = rw->writers_waiting = 0;
+}
+
+void rwlock_rdlock(rwlock_t * rw)
+{
+	mutex_lock(&(rw->lock));
+	while (rw->active < 0 || rw->writers_waiting > 0) {
+		cond_wait(&(rw->readers), &(rw->lock));
+	}
+	rw->active++;
+	mutex_unlock(&(rw->lock));
+}
+
+void rwlock_wrlock(rwlock_t * rw)
+{
+	mutex_lock(&(rw->lock));
+	rw->writers_waiting++;
+	while (rw->active != 0) {
+		cond_wait(&(rw->writers), &(rw->lock));
+	}
+	rw->writers_waiting--;
+	rw->active = -1;
+	mutex_unlock(&(rw->lock));
+}
+
+void rwlock_unlock(rwlock_t * rw)
+{
+	mutex_lock(&(rw->lock));
+	if (rw->active < 0) {
+		rw->active = 0;
+	} else if (rw->active > 0) {
+		rw->active--;
+	}
+	if (rw->active == 0) {
+		if (rw->writers_waiting > 0) {
+			cond_signal(&(rw->writers));
+		} else {
+			cond_broadcast(&(rw->readers));
+		}
+	}
+	mutex_unlock(&(rw->lock));
+}
+
+void barrier_init(barrier_t * b, unsigned int count)
+{
+	mutex_init(&(b->lock));
+	cond_init(&(b->cond));
+	b->count = count;
+	b->waiting = b->generation = 0;
+}
+
+// barrier_wait - wait for count threads to arrive, the last one gets 1
+int barrier_wait(barrier_t * b)
+{
+	int ret = 0;
+	mutex_lock(&(b->lock));
+	unsigned int generation = b->generation;
+	if (++b->waiting >= b->count) {
+		b->waiting = 0;
+		b->generation++;
+		cond_broadcast(&(b->cond));
+		ret = 1;
+	} else {
+		while (generation == b->generation) {
+			cond_wait(&(b->cond), &(b->lock));
+		}
+	}
+	mutex_unlock(&(b->lock));
+	return ret;
+}
@@ -1,15 +1,153 @@
 #ifndef __USER_LIBS_THREAD_H__
 #define __USER_LIBS_THREAD_H__
 
+#include <types.h>
+#include <atomic.h>
+#include <syscall.h>
+
 typedef struct {
 	int pid;
 	void *stack;
 } thread_t;
 
 #define THREAD_STACKSIZE        (4096 * 10)
+/* below each stack, read-only, an overflow faults on it */
+#define THREAD_GUARDSIZE        4096
+/* the stacks kept for the next threads once theirs are waited for */
+#define THREAD_STACK_CACHE      8
 
 int thread(int (*fn) (void *), void *arg, thread_t * tidp);
 int thread_wait(thread_t * tidp, int *exit_code);
 int thread_kill(thread_t * tidp);
 
+// futex_wait - sleep while *uaddr is val, -E_AGAIN if it is not
+int futex_wait(volatile void *uaddr, int val);
+int futex_wake(volatile void *uaddr, int nr);
+
+/* *
+ * A doorbell is the futex word a side of a ring in shared memory sleeps on
+ * until the other side moves its cursor: bit 0 is set while the side may
+ * sleep, bit 1 once the ring is closed. Both the ring and the close change
+ * the word, so that one between the recheck of the cursor and the sleep is
+ * not lost; a side that does not sleep is rung without a syscall.
+ * */
+#define DOORBELL_WAITING        0
+#define DOORBELL_CLOSED         1
+
+// doorbell_wait - sleep on bell until it rings, unless *cursor has moved
+//               - from val or the bell is closed by then
+void doorbell_wait(volatile uint32_t * bell, volatile uint32_t * cursor,
+		   uint32_t val);
+// doorbell_ring - the cursor has moved, wake the side if it sleeps
+void doorbell_ring(volatile uint32_t * bell);
+// doorbell_close - wake the side for good, it no longer sleeps on bell
+void doorbell_close(volatile uint32_t * bell);
+
+/* *
+ * mutex_t - a sleeping lock on a futex: bit 0 of state is the lock, bit 1
+ * is set while some thread may be sleeping on it. Taking and releasing a
+ * free lock is a single atomic op, the kernel is entered only on contention.
+ * */
+typedef struct {
+	volatile uint32_t state;
+} mutex_t;
+
+#define INIT_MUTEX          {0}
+
+void mutex_init(mutex_t * m);
+bool mutex_trylock(mutex_t * m);
+void mutex_lock(mutex_t * m);
+void mutex_unlock(mutex_t * m);
+
+/* *
+ * pi_mutex_t - a lock on a pi futex, which holds the pid of its owner:
+ * while a realtime thread waits for it, the owner runs at the priority of
+ * that thread at least. On x86, taking and releasing it uncontended does
+ * not enter the kernel.
+ * */
+typedef struct {
+	volatile uint32_t owner;
+} pi_mutex_t;
+
+#define INIT_PI_MUTEX       {0}
+
+void pi_mutex_init(pi_mutex_t * m);
+bool pi_mutex_trylock(pi_mutex_t * m);
+// pi_mutex_lock - 0 once taken, -E_DEADLK if the caller holds it already
+int pi_mutex_lock(pi_mutex_t * m);
+// pi_mutex_unlock - -E_PERM if the caller does not hold it
+int pi_mutex_unlock(pi_mutex_t * m);
+
+typedef struct {
+	atomic_t seq;
+	mutex_t *mutex;
+} cond_t;
+
+#define INIT_COND           {{0}, NULL}
+
+void cond_init(cond_t * c);
+void cond_wait(cond_t * c, mutex_t * m);
+void cond_signal(cond_t * c);
+void cond_broadcast(cond_t * c);
+
+// rwlock_t - readers share it, writers are preferred over new readers
+typedef struct {
+	mutex_t lock;
+	cond_t readers, writers;
+	int active;		// > 0: readers holding it, -1: a writer
+	int writers_waiting;
+} rwlock_t;
+
+#define INIT_RWLOCK         {INIT_MUTEX, INIT_COND, INIT_COND, 0, 0}
+
+void rwlock_init(rwlock_t * rw);
+void rwlock_rdlock(rwlock_t * rw);
+void rwlock_wrlock(rwlock_t * rw);
+void rwlock_unlock(rwlock_t * rw);
+
+typedef struct {
+	mutex_t lock;
+	cond_t cond;
+	unsigned int count, waiting, generation;
+} barrier_t;
+
+void barrier_init(barrier_t * b, unsigned int count);
+int barrier_wait(barrier_t * b);
+
+/* *
+ * thread_tls_t - the thread-local block of a thread, at the top of its
+ * stack, static for the main thread. The kernel keeps its address loaded
+ * while the thread runs, in the fs base on amd64 and TPIDRURO on arm, so
+ * thread_self is a single load there; self points back at the block for
+ * the %fs relative one. The other archs ask the kernel.
+ * */
+#define THREAD_TLS_KEYS         16
+
+typedef struct thread_tls {
+	struct thread_tls *self;
+	int (*fn) (void *);
+	void *arg;
+	void *values[THREAD_TLS_KEYS];
+} thread_tls_t;
+
+static inline thread_tls_t *thread_self(void)
+{
+	thread_tls_t *tls;
+#if defined(ARCH_AMD64)
+	asm volatile ("movq %%fs:0, %0":"=r" (tls));
+#elif defined(ARCH_ARM)
+	asm volatile ("mrc p15, 0, %0, c13, c0, 3":"=r" (tls));
+#else
+	tls = sys_gettls();
+#endif
+	return tls;
+}
+
+void thread_tls_init(void);
+// thread_key_create - a key for the values of all the threads, -E_NO_MEM
+//                   - past THREAD_TLS_KEYS
+int thread_key_create(int *keyp);
+void *thread_getspecific(int key);
+int thread_setspecific(int key, void *value);
+
 #endif /* !__USER_LIBS_THREAD_H__ */
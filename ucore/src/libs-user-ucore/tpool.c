@@ -0,0 +1,182 @@
+#include <types.h>
+#include <ulib.h>
+#include <error.h>
+#include <memorder.h>
+#include <thread.h>
+#include <tpool.h>
+
+#define TPOOL_DEQUE_MASK        (TPOOL_DEQUE_SIZE - 1)
+
+static void deque_init(tpool_deque_t * d)
+{
+	mutex_init(&(d->lock));
+	d->top = d->bottom = 0;
+}
+
+// deque_push - task at the bottom of d, false if d is full
+static bool deque_push(tpool_deque_t * d, tpool_task_t * task)
+{
+	bool ret = 0;
+	mutex_lock(&(d->lock));
+	if (d->bottom - d->top < TPOOL_DEQUE_SIZE) {
+		d->tasks[d->bottom++ & TPOOL_DEQUE_MASK] = task;
+		ret = 1;
+	}
+	mutex_unlock(&(d->lock));
+	return ret;
+}
+
+// deque_pop - the newest task of d, for its owner
+static tpool_task_t *deque_pop(tpool_deque_t * d)
+{
+	tpool_task_t *task = NULL;
+	mutex_lock(&(d->lock));
+	if (d->bottom != d->top) {
+		task = d->tasks[--d->bottom & TPOOL_DEQUE_MASK];
+	}
+	mutex_unlock(&(d->lock));
+	return task;
+}
+
+// deque_steal - the oldest task of d, for the others
+static tpool_task_t *deque_steal(tpool_deque_t * d)
+{
+	tpool_task_t *task = NULL;
+	mutex_lock(&(d->lock));
+	if (d->bottom != d->top) {
+		task = d->tasks[d->top++ & TPOOL_DEQUE_MASK];
+	}
+	mutex_unlock(&(d->lock));
+	return task;
+}
+
+// tpool_self - the deque of the calling thread
+static int tpool_self(tpool_t * pool)
+{
+	tpool_worker_t *w = thread_getspecific(pool->key);
+	return (w != NULL && w->pool == pool) ? w->id : pool->nthreads;
+}
+
+// tpool_take - a task of deque id, or else stolen from another deque
+static tpool_task_t *tpool_take(tpool_t * pool, int id)
+{
+	int n = pool->nthreads + 1, i;
+	tpool_task_t *task = deque_pop(pool->deques + id);
+	for (i = 1; task == NULL && i < n; i++) {
+		task = deque_steal(pool->deques + (id + i) % n);
+	}
+	if (task != NULL) {
+		atomic_dec(&(pool->pending));
+	}
+	return task;
+}
+
+static void tpool_run(tpool_task_t * task)
+{
+	task->ret = task->fn(task->arg);
+	smp_store_release(&(task->done), 1);
+}
+
+static int tpool_worker_main(void *arg)
+{
+	tpool_worker_t *w = arg;
+	tpool_t *pool = w->pool;
+	tpool_task_t *task;
+	bool stop;
+	thread_setspecific(pool->key, w);
+	while (1) {
+		if ((task = tpool_take(pool, w->id)) != NULL) {
+			tpool_run(task);
+			continue;
+		}
+		mutex_lock(&(pool->lock));
+		/* a spawn after the check sees idle, and signals */
+		atomic_inc(&(pool->idle));
+		while (atomic_read(&(pool->pending)) <= 0 && !pool->stop) {
+			cond_wait(&(pool->cond), &(pool->lock));
+		}
+		atomic_dec(&(pool->idle));
+		stop = (pool->stop && atomic_read(&(pool->pending)) <= 0);
+		mutex_unlock(&(pool->lock));
+		if (stop) {
+			break;
+		}
+	}
+	return 0;
+}
+
+int tpool_init(tpool_t * pool, int nthreads)
+{
+	int i, ret;
+	if (nthreads <= 0 || nthreads > TPOOL_MAX_THREADS) {
+		return -E_INVAL;
+	}
+	if ((ret = thread_key_create(&(pool->key))) != 0) {
+		return ret;
+	}
+	pool->nthreads = nthreads;
+	atomic_set(&(pool->pending), 0);
+	atomic_set(&(pool->idle), 0);
+	mutex_init(&(pool->lock));
+	cond_init(&(pool->cond));
+	pool->stop = 0;
+	for (i = 0; i <= nthreads; i++) {
+		deque_init(pool->deques + i);
+	}
+	for (i = 0; i < nthreads; i++) {
+		tpool_worker_t *w = pool->workers + i;
+		w->pool = pool, w->id = i;
+		if ((ret = thread(tpool_worker_main, w, &(w->tid))) != 0) {
+			pool->nthreads = i;
+			tpool_destroy(pool);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+void tpool_spawn(tpool_t * pool, tpool_task_t * task,
+		 int (*fn) (void *arg), void *arg)
+{
+	task->fn = fn, task->arg = arg;
+	task->done = 0;
+	if (!deque_push(pool->deques + tpool_self(pool), task)) {
+		/* full, it is as good to run it now */
+		tpool_run(task);
+		return;
+	}
+	atomic_inc(&(pool->pending));
+	if (atomic_read(&(pool->idle)) > 0) {
+		mutex_lock(&(pool->lock));
+		cond_signal(&(pool->cond));
+		mutex_unlock(&(pool->lock));
+	}
+}
+
+int tpool_join(tpool_t * pool, tpool_task_t * task)
+{
+	int id = tpool_self(pool);
+	tpool_task_t *other;
+	while (!task->done) {
+		if ((other = tpool_take(pool, id)) != NULL) {
+			tpool_run(other);
+		} else {
+			/* it runs on another worker */
+			yield();
+		}
+	}
+	smp_rmb();
+	return task->ret;
+}
+
+void tpool_destroy(tpool_t * pool)
+{
+	int i;
+	mutex_lock(&(pool->lock));
+	pool->stop = 1;
+	cond_broadcast(&(pool->cond));
+	mutex_unlock(&(pool->lock));
+	for (i = 0; i < pool->nthreads; i++) {
+		thread_wait(&(pool->workers[i].tid), NULL);
+	}
+}
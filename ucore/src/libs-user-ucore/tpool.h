@@ -0,0 +1,62 @@
+#ifndef __USER_LIBS_TPOOL_H__
+#define __USER_LIBS_TPOOL_H__
+
+#include <types.h>
+#include <atomic.h>
+#include <thread.h>
+
+/* *
+ * tpool_t - a pool of worker threads for fork-join work. tpool_spawn
+ * queues a task on the deque of the calling worker (or on the one shared
+ * by the threads outside the pool), tpool_join runs tasks until the one it
+ * waits for is done. A worker takes the newest task of its own deque, and
+ * when it has none steals the oldest one of another deque, so the tasks of
+ * a recursive split spread over the pool while each worker keeps to its
+ * own part. Idle workers sleep on a condvar.
+ * */
+#define TPOOL_MAX_THREADS       16
+#define TPOOL_DEQUE_SIZE        256	// a power of 2
+
+struct tpool;
+
+typedef struct tpool_task {
+	int (*fn) (void *arg);
+	void *arg;
+	int ret;		// of fn, once done
+	volatile bool done;
+} tpool_task_t;
+
+typedef struct {
+	mutex_t lock;
+	uint32_t top, bottom;	// steals from top, the owner at bottom
+	tpool_task_t *tasks[TPOOL_DEQUE_SIZE];
+} tpool_deque_t;
+
+typedef struct tpool_worker {
+	struct tpool *pool;
+	int id;			// its deque, nthreads for the outside one
+	thread_t tid;
+} tpool_worker_t;
+
+typedef struct tpool {
+	int nthreads;
+	int key;		// the tpool_worker_t of the calling thread
+	atomic_t pending;	// tasks queued and not taken yet
+	mutex_t lock;		// for the sleeping workers
+	cond_t cond;
+	atomic_t idle;		// workers about to sleep or asleep
+	volatile bool stop;
+	tpool_worker_t workers[TPOOL_MAX_THREADS];
+	tpool_deque_t deques[TPOOL_MAX_THREADS + 1];
+} tpool_t;
+
+int tpool_init(tpool_t * pool, int nthreads);
+void tpool_spawn(tpool_t * pool, tpool_task_t * task,
+		 int (*fn) (void *arg), void *arg);
+// tpool_join - the return of the fn of task, which the caller runs or
+//            - helps with other tasks meanwhile
+int tpool_join(tpool_t * pool, tpool_task_t * task);
+// tpool_destroy - stop the workers once the tasks queued are done
+void tpool_destroy(tpool_t * pool);
+
+#endif /* !__USER_LIBS_TPOOL_H__ */
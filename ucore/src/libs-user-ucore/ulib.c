@@ -4,22 +4,31 @@
 #include <stdio.h>
 #include <ulib.h>
 #include <stat.h>
-#include <lock.h>
+#include <thread.h>
+#include <vdso.h>
+#include <memgroup.h>
+#include <cpugroup.h>
 
-static lock_t fork_lock = INIT_LOCK;
+static mutex_t fork_lock = INIT_MUTEX;
 
 void lock_fork(void)
 {
-	lock(&fork_lock);
+	mutex_lock(&fork_lock);
 }
 
 void unlock_fork(void)
 {
-	unlock(&fork_lock);
+	mutex_unlock(&fork_lock);
 }
 
+void malloc_lock_all(void);
+void malloc_unlock_all(void);
+void stdio_lock_all(void);
+void stdio_unlock_all(void);
+
 void exit(int error_code)
 {
+	fflush(-1);
 	sys_exit(error_code);
 	cprintf("BUG: exit failed.\n");
 	while (1) ;
@@ -29,7 +38,11 @@ int fork(void)
 {
 	int ret;
 	lock_fork();
+	stdio_lock_all();
+	malloc_lock_all();
 	ret = sys_fork();
+	malloc_unlock_all();
+	stdio_unlock_all();
 	unlock_fork();
 	return ret;
 }
@@ -59,9 +72,44 @@ int kill(int pid)
 	return sys_kill(pid);
 }
 
+int sched_setscheduler(int pid, int policy, int prio)
+{
+	return sys_sched_setscheduler(pid, policy, prio);
+}
+
+int sched_getscheduler(int pid)
+{
+	return sys_sched_getscheduler(pid);
+}
+
+int sched_getparam(int pid)
+{
+	return sys_sched_getparam(pid);
+}
+
+int setpriority(int pid, int nice)
+{
+	return sys_setpriority(pid, nice);
+}
+
+int getpriority(int pid, int *nice_store)
+{
+	return sys_getpriority(pid, nice_store);
+}
+
+int sched_setaffinity(int pid, const cpuset_t * mask)
+{
+	return sys_sched_setaffinity(pid, sizeof(cpuset_t), mask);
+}
+
+int sched_getaffinity(int pid, cpuset_t * mask)
+{
+	return sys_sched_getaffinity(pid, sizeof(cpuset_t), mask);
+}
+
 unsigned int gettime_msec(void)
 {
-	return (unsigned int)sys_gettime();
+	return (unsigned int)vdso_ticks();
 }
 
 int getpid(void)
@@ -90,6 +138,102 @@ int shmem(uintptr_t * addr_store, size_t len, uint32_t mmap_flags)
 	return sys_shmem(addr_store, len, mmap_flags);
 }
 
+int shm_open(const char *name, size_t len, uint32_t mmap_flags,
+	     uintptr_t * addr_store)
+{
+	return sys_shm_open(name, len, mmap_flags, addr_store);
+}
+
+int shm_unlink(const char *name)
+{
+	return sys_shm_unlink(name);
+}
+
+int madvise(uintptr_t addr, size_t len, int advice)
+{
+	return sys_madvise(addr, len, advice);
+}
+
+int memcg_create(int parent, size_t limit, size_t soft_limit)
+{
+	return sys_memcg(MEMCG_CREATE, parent, limit, soft_limit);
+}
+
+int memcg_destroy(int id)
+{
+	return sys_memcg(MEMCG_DESTROY, id, 0, 0);
+}
+
+int memcg_set_limit(int id, size_t limit, size_t soft_limit)
+{
+	return sys_memcg(MEMCG_SET_LIMIT, id, limit, soft_limit);
+}
+
+int memcg_attach(int id, int pid)
+{
+	return sys_memcg(MEMCG_ATTACH, id, pid, 0);
+}
+
+int memcg_stat(int id, struct memcg_stat *stat)
+{
+	return sys_memcg(MEMCG_STAT, id, 0, (uintptr_t) stat);
+}
+
+int cpucg_create(int parent, size_t shares)
+{
+	return sys_cpucg(CPUCG_CREATE, parent, shares, 0);
+}
+
+int cpucg_destroy(int id)
+{
+	return sys_cpucg(CPUCG_DESTROY, id, 0, 0);
+}
+
+int cpucg_set_shares(int id, size_t shares)
+{
+	return sys_cpucg(CPUCG_SET_SHARES, id, shares, 0);
+}
+
+int cpucg_set_quota(int id, size_t quota, size_t period)
+{
+	return sys_cpucg(CPUCG_SET_QUOTA, id, quota, period);
+}
+
+int cpucg_attach(int id, int pid)
+{
+	return sys_cpucg(CPUCG_ATTACH, id, pid, 0);
+}
+
+int cpucg_stat(int id, struct cpucg_stat *stat)
+{
+	return sys_cpucg(CPUCG_STAT, id, 0, (uintptr_t) stat);
+}
+
+int mempolicy(int policy, int node)
+{
+	return sys_mempolicy(policy, node);
+}
+
+int numa_stat(int node, struct numa_stat *stat)
+{
+	return sys_numa_stat(node, stat);
+}
+
+int numa_info(int node, struct numa_info *info)
+{
+	return sys_numa_info(node, info);
+}
+
+int thp_stat(struct thp_stat *stat)
+{
+	return sys_thp_stat(stat);
+}
+
+int getrusage(int who, struct rusage *usage)
+{
+	return sys_getrusage(who, usage);
+}
+
 sem_t sem_init(int value)
 {
 	return sys_sem_init(value);
@@ -140,6 +284,17 @@ int recv_event_timeout(int *pid_store, int *event_store, unsigned int timeout)
 	return sys_recv_event(pid_store, event_store, timeout);
 }
 
+int call_event(int pid, int event, int *reply_store)
+{
+	return sys_event_call(pid, event, reply_store, 0);
+}
+
+int call_event_timeout(int pid, int event, int *reply_store,
+		       unsigned int timeout)
+{
+	return sys_event_call(pid, event, reply_store, timeout);
+}
+
 int mbox_init(unsigned int max_slots)
 {
 	return sys_mbox_init(max_slots);
@@ -165,6 +320,20 @@ int mbox_recv_timeout(int id, struct mboxbuf *buf, unsigned int timeout)
 	return sys_mbox_recv(id, buf, timeout);
 }
 
+// mbox_sendm - send up to n messages in one call, at most MAX_MSG_BATCH;
+//            - returns the # sent, which is less once the slots are full
+int mbox_sendm(int id, struct mboxbuf *bufs, int n, unsigned int timeout)
+{
+	return sys_mbox_sendm(id, bufs, n, timeout);
+}
+
+// mbox_recvm - receive up to n messages in one call, the length and sender
+//            - of each stored in its buf; returns the # received
+int mbox_recvm(int id, struct mboxbuf *bufs, int n, unsigned int timeout)
+{
+	return sys_mbox_recvm(id, bufs, n, timeout);
+}
+
 int mbox_free(int id)
 {
 	return sys_mbox_free(id);
@@ -181,9 +350,33 @@ int __exec(const char *name, const char **argv, const char **envp)
 	while (argv[argc] != NULL) {
 		argc++;
 	}
+	fflush(-1);
 	return sys_exec(argv[0], argv, envp);
 }
 
+// spawn - run argv[0] in a new child, as fork and exec without the copy of
+//       - the address space; returns its pid
+int spawn(const char **argv, const char **envp)
+{
+	fflush(-1);
+	return sys_spawn(argv[0], argv, envp);
+}
+
+// checkpoint - save the process to an image at path; returns 0, and 1 in
+//            - the processes restored from it
+int checkpoint(const char *path)
+{
+	fflush(-1);
+	return sys_checkpoint(path);
+}
+
+// restore - become the process saved at path, which goes on from its
+//         - checkpoint; returns only if that fails
+int restore(const char *path)
+{
+	return sys_restore(path);
+}
+
 int __clone(uint32_t clone_flags, uintptr_t stack, int (*fn) (void *),
 	    void *arg);
 
@@ -2,6 +2,8 @@
 #define __USER_LIBS_ULIB_H__
 
 #include <types.h>
+#include <schedpolicy.h>
+#include <cpuset.h>
 
 void __warn(const char *file, int line, const char *fmt, ...);
 void __panic(const char *file, int line, const char *fmt, ...)
@@ -26,6 +28,14 @@ void __panic(const char *file, int line, const char *fmt, ...)
 
 int fprintf(int fd, const char *fmt, ...);
 
+/* the buffering of the output to an fd, see setvbuf */
+#define _IOFBF                  0	// when the buffer is full
+#define _IOLBF                  1	// and at each newline
+#define _IONBF                  2	// at the end of each call
+
+int setvbuf(int fd, int mode);
+int fflush(int fd);
+
 void exit(int error_code) __attribute__ ((noreturn));
 int fork(void);
 int forks(void);
@@ -34,12 +44,51 @@ int waitpid(int pid, int *store);
 void yield(void);
 int sleep(unsigned int time);
 int kill(int pid);
+/* pid 0 is the caller, prio is 0 for SCHED_NORMAL */
+int sched_setscheduler(int pid, int policy, int prio);
+int sched_getscheduler(int pid);
+int sched_getparam(int pid);
+/* the nice value of pid, 0 for the caller, NICE_MIN .. NICE_MAX of
+ * schedpolicy.h, clamped to them when set */
+int setpriority(int pid, int nice);
+int getpriority(int pid, int *nice_store);
+/* run pid, 0 for the caller, on the cpus of mask only, or anywhere if mask
+ * is NULL */
+int sched_setaffinity(int pid, const cpuset_t * mask);
+int sched_getaffinity(int pid, cpuset_t * mask);
 unsigned int gettime_msec(void);
 int getpid(void);
 void print_pgdir(void);
 int mmap(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
 int munmap(uintptr_t addr, size_t len);
 int shmem(uintptr_t * addr_store, size_t len, uint32_t mmap_flags);
+/* map the shared memory named name, made with len bytes if SHM_CREATE */
+int shm_open(const char *name, size_t len, uint32_t mmap_flags,
+	     uintptr_t * addr_store);
+int shm_unlink(const char *name);
+int madvise(uintptr_t addr, size_t len, int advice);
+struct memcg_stat;
+int memcg_create(int parent, size_t limit, size_t soft_limit);
+int memcg_destroy(int id);
+int memcg_set_limit(int id, size_t limit, size_t soft_limit);
+int memcg_attach(int id, int pid);
+int memcg_stat(int id, struct memcg_stat *stat);
+struct cpucg_stat;
+int cpucg_create(int parent, size_t shares);
+int cpucg_destroy(int id);
+int cpucg_set_shares(int id, size_t shares);
+int cpucg_set_quota(int id, size_t quota, size_t period);
+int cpucg_attach(int id, int pid);
+int cpucg_stat(int id, struct cpucg_stat *stat);
+struct numa_stat;
+struct numa_info;
+int mempolicy(int policy, int node);
+int numa_stat(int node, struct numa_stat *stat);
+int numa_info(int node, struct numa_info *info);
+struct thp_stat;
+int thp_stat(struct thp_stat *stat);
+struct rusage;
+int getrusage(int who, struct rusage *usage);
 int clone(uint32_t clone_flags, uintptr_t stack, int (*fn) (void *), void *arg);
 sem_t sem_init(int value);
 int sem_post(sem_t sem_id);
@@ -51,6 +100,9 @@ int send_event(int pid, int event);
 int send_event_timeout(int pid, int event, unsigned int timeout);
 int recv_event(int *pid_store, int *event_store);
 int recv_event_timeout(int *pid_store, int *event_store, unsigned int timeout);
+int call_event(int pid, int event, int *reply_store);
+int call_event_timeout(int pid, int event, int *reply_store,
+		       unsigned int timeout);
 
 struct mboxbuf;
 struct mboxinfo;
@@ -60,10 +112,15 @@ int mbox_send(int id, struct mboxbuf *buf);
 int mbox_send_timeout(int id, struct mboxbuf *buf, unsigned int timeout);
 int mbox_recv(int id, struct mboxbuf *buf);
 int mbox_recv_timeout(int id, struct mboxbuf *buf, unsigned int timeout);
+int mbox_sendm(int id, struct mboxbuf *bufs, int n, unsigned int timeout);
+int mbox_recvm(int id, struct mboxbuf *bufs, int n, unsigned int timeout);
 int mbox_free(int id);
 int mbox_info(int id, struct mboxinfo *info);
 
 int __exec(const char *name, const char **argv, const char **envp);
+int spawn(const char **argv, const char **envp);
+int checkpoint(const char *path);
+int restore(const char *path);
 
 #define __exec0(name, path, ...)                \
     ({ const char *argv[] = {path, ##__VA_ARGS__, NULL}; __exec(name, argv, NULL); })
@@ -2,6 +2,7 @@
 #include <unistd.h>
 #include <file.h>
 #include <stat.h>
+#include <thread.h>
 
 int main(int argc, char **argv);
 
@@ -32,6 +33,7 @@ void umain(int argc, char **argv)
 	if ((fd = initfd(2, "stdout:", O_WRONLY)) < 0) {
 		warn("open <stderr> failed: %e.\n", fd);
 	}
+	thread_tls_init();
 	int ret = main(argc, argv);
 	exit(ret);
 }
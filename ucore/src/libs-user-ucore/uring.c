@@ -0,0 +1,159 @@
+#include <types.h>
+#include <string.h>
+#include <unistd.h>
+#include <error.h>
+#include <atomic.h>
+#include <memorder.h>
+#include <ulib.h>
+#include <syscall.h>
+#include <thread.h>
+#include <uring.h>
+
+// uring_sqthread - enter the kernel for the submitter whenever it queues
+static int uring_sqthread(void *arg)
+{
+	struct uring_state *state = arg;
+	while (!state->isclosed) {
+		uint32_t head = state->sq_head, tail = state->sq_tail;
+		if (head == tail) {
+			doorbell_wait(&(state->sq_bell), &(state->sq_tail),
+				      tail);
+			continue;
+		}
+		uint32_t cq_head = state->cq_head;
+		int ret = sys_uring_enter(state, tail - head);
+		if (ret < 0) {
+			return ret;
+		}
+		if (ret == 0) {
+			/* the completions are full, wait for the reaper */
+			doorbell_wait(&(state->room_bell), &(state->cq_head),
+				      cq_head);
+		}
+		doorbell_ring(&(state->cq_bell));
+	}
+	return 0;
+}
+
+// uring_create - map a ring of entries submissions, rounded up to a power
+//              - of 2, and start its submission thread if sqthread
+int uring_create(uring_t * u, unsigned int entries, bool sqthread)
+{
+	uint32_t n = 1;
+	if (entries == 0 || entries > URING_MAX_ENTRIES) {
+		return -E_INVAL;
+	}
+	while (n < entries) {
+		n <<= 1;
+	}
+	int ret;
+	uintptr_t addr = 0;
+	size_t len = URING_SIZE(n);
+	if ((ret = shmem(&addr, len, MMAP_WRITE)) != 0) {
+		return ret;
+	}
+	struct uring_state *state = (struct uring_state *)addr;
+	memset(state, 0, sizeof(struct uring_state));
+	state->entries = n;
+
+	u->addr = addr, u->len = len, u->state = state;
+	u->sqes = URING_SQES(state), u->cqes = URING_CQES(state);
+	u->sq_tail = 0, u->sqthread = sqthread;
+	if (sqthread
+	    && (ret = thread(uring_sqthread, state, &(u->tid))) != 0) {
+		munmap(addr, len);
+		return ret;
+	}
+	return 0;
+}
+
+// uring_get_sqe - the next free submission entry, NULL if all are queued
+struct uring_sqe *uring_get_sqe(uring_t * u)
+{
+	struct uring_state *state = u->state;
+	if (u->sq_tail - state->sq_head >= state->entries) {
+		return NULL;
+	}
+	struct uring_sqe *sqe =
+	    u->sqes + (u->sq_tail++ & (state->entries - 1));
+	memset(sqe, 0, sizeof(struct uring_sqe));
+	sqe->off = URING_OFF_CUR;
+	return sqe;
+}
+
+// uring_submit - queue the entries taken since the last call; without a
+//              - submission thread they are run before it returns.
+//              - returns the # of entries queued
+int uring_submit(uring_t * u)
+{
+	struct uring_state *state = u->state;
+	uint32_t nr = u->sq_tail - state->sq_tail;
+	smp_store_release(&(state->sq_tail), u->sq_tail);
+	if (u->sqthread) {
+		doorbell_ring(&(state->sq_bell));
+		return nr;
+	}
+	uint32_t head;
+	while ((head = state->sq_head) != state->sq_tail) {
+		int ret = sys_uring_enter(state, state->sq_tail - head);
+		if (ret < 0) {
+			return ret;
+		}
+		if (ret == 0) {
+			/* the completions are full, the rest go on the next call */
+			break;
+		}
+	}
+	return nr;
+}
+
+// uring_peek_cqe - take the oldest completion to cqe, -E_AGAIN if none
+int uring_peek_cqe(uring_t * u, struct uring_cqe *cqe)
+{
+	struct uring_state *state = u->state;
+	uint32_t head = state->cq_head;
+	if (state->cq_tail == head) {
+		if (!u->sqthread && state->sq_head != state->sq_tail) {
+			sys_uring_enter(state, state->sq_tail - state->sq_head);
+		}
+		if (state->cq_tail == head) {
+			return -E_AGAIN;
+		}
+	}
+	smp_rmb();
+	*cqe = u->cqes[head & (2 * state->entries - 1)];
+	smp_store_release(&(state->cq_head), head + 1);
+	if (u->sqthread) {
+		doorbell_ring(&(state->room_bell));
+	}
+	return 0;
+}
+
+// uring_wait_cqe - take the oldest completion to cqe, waiting for it if
+//                - some entry is still in flight; -E_AGAIN if none is
+int uring_wait_cqe(uring_t * u, struct uring_cqe *cqe)
+{
+	struct uring_state *state = u->state;
+	int ret;
+	while ((ret = uring_peek_cqe(u, cqe)) == -E_AGAIN) {
+		uint32_t tail = state->cq_tail;
+		if (!u->sqthread || tail == state->sq_tail || state->isclosed) {
+			break;
+		}
+		doorbell_wait(&(state->cq_bell), &(state->cq_tail), tail);
+	}
+	return ret;
+}
+
+// uring_destroy - stop the submission thread and unmap the ring
+int uring_destroy(uring_t * u)
+{
+	struct uring_state *state = u->state;
+	if (u->sqthread) {
+		state->isclosed = 1;
+		doorbell_close(&(state->sq_bell));
+		doorbell_close(&(state->room_bell));
+		thread_wait(&(u->tid), NULL);
+	}
+	return munmap(u->addr, u->len);
+}
@@ -0,0 +1,35 @@
+#ifndef __USER_LIBS_URING_H__
+#define __USER_LIBS_URING_H__
+
+#include <types.h>
+#include <thread.h>
+#include <uringbuf.h>
+
+/* *
+ * An I/O ring in shared memory, see common/uringbuf.h. Entries are taken by
+ * uring_get_sqe, filled and handed over by uring_submit, which runs them in
+ * one uring_enter. A ring created with sqthread instead has a thread that
+ * sleeps until the submission cursor moves and enters the kernel for the
+ * caller, so that uring_submit does not wait for the I/O; uring_wait_cqe
+ * then sleeps until the completion cursor moves. Both sleep on doorbells,
+ * see thread.h. A ring has one submitter and one reaper.
+ * */
+typedef struct {
+	uintptr_t addr;
+	size_t len;
+	struct uring_state *state;
+	struct uring_sqe *sqes;
+	struct uring_cqe *cqes;
+	uint32_t sq_tail;	// entries taken, published by uring_submit
+	bool sqthread;
+	thread_t tid;
+} uring_t;
+
+int uring_create(uring_t * u, unsigned int entries, bool sqthread);
+struct uring_sqe *uring_get_sqe(uring_t * u);
+int uring_submit(uring_t * u);
+int uring_peek_cqe(uring_t * u, struct uring_cqe *cqe);
+int uring_wait_cqe(uring_t * u, struct uring_cqe *cqe);
+int uring_destroy(uring_t * u);
+
+#endif /* !__USER_LIBS_URING_H__ */
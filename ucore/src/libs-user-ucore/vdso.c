@@ -0,0 +1,102 @@
+#include <types.h>
+#include <arch.h>
+#include <error.h>
+#include <syscall.h>
+#include <seqcount.h>
+#include <vvar.h>
+#include <vdso.h>
+
+#define NSEC_PER_SEC            1000000000
+
+static struct vvar_data *vvar;
+
+static inline struct vvar_data *vvar_get(void)
+{
+	if (vvar == NULL) {
+		vvar = (struct vvar_data *)sys_vvar();
+	}
+	return vvar;
+}
+
+#ifdef ARCH_AMD64
+// vvar_tsc_clock - the clock by the tsc, as ktime_get_ns and
+//                - ktime_get_real_ns in timekeeping.c
+static uint64_t vvar_tsc_clock(struct vvar_data *vd, int clock_id)
+{
+	uint64_t delta = rdtsc() - vd->tsc_stamp;
+	uint64_t mono = vd->tsc_nsec + delta / vd->tsc_hz * NSEC_PER_SEC
+	    + delta % vd->tsc_hz * NSEC_PER_SEC / vd->tsc_hz;
+	if (clock_id == CLOCK_MONOTONIC) {
+		return mono;
+	}
+	int64_t slew = 0;
+	if (vd->slew_left != 0) {
+		uint64_t left = (vd->slew_left < 0) ?
+		    -vd->slew_left : vd->slew_left;
+		uint64_t done = (mono - vd->slew_mono) * SLEW_RATE_PPM / 1000000;
+		if (done > left) {
+			done = left;
+		}
+		slew = (vd->slew_left < 0) ? -(int64_t) done : (int64_t) done;
+	}
+	return mono + vd->real_offset + slew;
+}
+#endif
+
+int clock_gettime(int clock_id, struct timespec *ts)
+{
+	struct vvar_data *vd = vvar_get();
+	uint32_t seq;
+	if (clock_id != CLOCK_REALTIME && clock_id != CLOCK_MONOTONIC) {
+		return -E_INVAL;
+	}
+	do {
+		seq = read_seqcount_begin(&(vd->seq));
+#ifdef ARCH_AMD64
+		if (vd->tsc_hz != 0) {
+			uint64_t nsec = vvar_tsc_clock(vd, clock_id);
+			ts->tv_sec = nsec / NSEC_PER_SEC;
+			ts->tv_nsec = nsec % NSEC_PER_SEC;
+			continue;
+		}
+#endif
+		/* by the clock tick, the slew is done a tick at a time */
+		ts->tv_sec = vd->ticks / vd->hz;
+		ts->tv_nsec = vd->ticks % vd->hz * (NSEC_PER_SEC / vd->hz);
+		if (clock_id == CLOCK_REALTIME) {
+			ts->tv_sec += vd->real_sec;
+			ts->tv_nsec += vd->real_nsec;
+			if (ts->tv_nsec >= NSEC_PER_SEC) {
+				ts->tv_sec++, ts->tv_nsec -= NSEC_PER_SEC;
+			}
+		}
+	} while (read_seqcount_retry(&(vd->seq), seq));
+	return 0;
+}
+
+int gettimeofday(struct timeval *tv)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	tv->tv_sec = ts.tv_sec;
+	tv->tv_usec = ts.tv_nsec / 1000;
+	return 0;
+}
+
+// vdso_ticks - the clock ticks since boot, as sys_gettime
+unsigned long vdso_ticks(void)
+{
+	struct vvar_data *vd = vvar_get();
+	return vd->ticks;
+}
+
+int settimeofday(const struct timeval *tv)
+{
+	return sys_settimeofday(tv);
+}
+
+// adjtime - slew the realtime clock by delta, 500us a second
+int adjtime(const struct timeval *delta, struct timeval *olddelta)
+{
+	return sys_adjtime(delta, olddelta);
+}
@@ -0,0 +1,31 @@
+#ifndef __USER_LIBS_VDSO_H__
+#define __USER_LIBS_VDSO_H__
+
+#include <types.h>
+#include <vvar.h>
+
+/* *
+ * The clocks read from the vvar page the kernel maps in every process, see
+ * common/vvar.h, with no system call but the first one that finds the
+ * page: CLOCK_MONOTONIC since boot, CLOCK_REALTIME since the epoch, to the
+ * ns of the tsc on amd64 and to the clock tick elsewhere.
+ * */
+struct timespec {
+	long tv_sec;
+	long tv_nsec;
+};
+
+struct timeval {
+	long tv_sec;
+	long tv_usec;
+};
+
+int clock_gettime(int clock_id, struct timespec *ts);
+int gettimeofday(struct timeval *tv);
+unsigned long vdso_ticks(void);
+
+/* these enter the kernel */
+int settimeofday(const struct timeval *tv);
+int adjtime(const struct timeval *delta, struct timeval *olddelta);
+
+#endif /* !__USER_LIBS_VDSO_H__ */
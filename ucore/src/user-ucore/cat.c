@@ -9,6 +9,11 @@ int cat(int fd)
 {
 	static char buffer[BUFSIZE];
 	int ret1, ret2;
+	/* a file goes to the output in the kernel, a pipe is read here */
+	while ((ret1 = sendfile(1, fd, NULL, BUFSIZE)) > 0) ;
+	if (ret1 == 0) {
+		return 0;
+	}
 	while ((ret1 = read(fd, buffer, sizeof(buffer))) > 0) {
 		if ((ret2 = write(1, buffer, ret1)) != ret1) {
 			return ret2;
@@ -12,6 +12,7 @@
 #define printf(...)                 fprintf(1, __VA_ARGS__)
 
 #define BUF_SIZE 4096
+#define COPY_SIZE (1024 * 1024)
 int main(int argc, char *argv[])
 {
 	if (argc != 3) {
@@ -32,6 +33,16 @@ int main(int argc, char *argv[])
 		return -E_INVAL;
 	}
 
+	/* the kernel copies, by blocks when both are on one sfs */
+	int copysize;
+	while ((copysize =
+		copy_file_range(fd1, NULL, fd2, NULL, COPY_SIZE)) > 0) ;
+	if (copysize == 0) {
+		close(fd1);
+		close(fd2);
+		return 0;
+	}
+
 	char *buf = (char *)malloc(BUF_SIZE);
 	if (!buf) {
 		printf("out of memory\n");
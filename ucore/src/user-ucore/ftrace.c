@@ -0,0 +1,51 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <file.h>
+#include <syscall.h>
+
+/* the entries of the kernel function tracer, see ftrace.c of amd64 */
+#define FTRACE_BUFSIZE              (64 * 1024)
+
+static char buf[FTRACE_BUFSIZE];
+
+static int usage(void)
+{
+	cprintf("usage: ftrace start | stop | filter <f>... | clear | dump\n");
+	cprintf("       <f> is name, module:name or [module]\n");
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	int i, ret;
+	if (argc < 2) {
+		return usage();
+	}
+	if (strcmp(argv[1], "start") == 0) {
+		ret = sys_ftrace(FTRACE_START, NULL, 0);
+	} else if (strcmp(argv[1], "stop") == 0) {
+		ret = sys_ftrace(FTRACE_STOP, NULL, 0);
+	} else if (strcmp(argv[1], "clear") == 0) {
+		ret = sys_ftrace(FTRACE_CLEAR, NULL, 0);
+	} else if (strcmp(argv[1], "filter") == 0 && argc > 2) {
+		for (i = 2, ret = 0; i < argc && ret == 0; i++) {
+			if ((ret = sys_ftrace(FTRACE_FILTER, argv[i],
+					      strlen(argv[i]))) != 0) {
+				cprintf("ftrace: no %s.\n", argv[i]);
+			}
+		}
+	} else if (strcmp(argv[1], "dump") == 0) {
+		if ((ret = sys_ftrace(FTRACE_DUMP, buf, sizeof(buf))) > 0) {
+			write(1, buf, ret);
+			ret = 0;
+		}
+	} else {
+		return usage();
+	}
+	if (ret < 0) {
+		cprintf("ftrace: %s failed, %e.\n", argv[1], ret);
+	}
+	return ret;
+}
@@ -0,0 +1,326 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <error.h>
+#include <elf.h>
+
+/* *
+ * ld.so - the interpreter of the dynamically linked programs on amd64.
+ *
+ * exec maps the program and this, linked at a fixed address, and starts
+ * here with an aux vector holding the program headers of the program. The
+ * objects the program needs, DT_NEEDED, are opened in /lib and mapped with
+ * SYS_mmap_file, the way exec maps a segment: their pages are read by the
+ * first faults into the exec cache of the kernel, so the text of a library
+ * is there once for all the processes, and a page is only copied when the
+ * relocations write it.
+ *
+ * All the relocations are done before the program starts, there is no lazy
+ * binding. A symbol is looked up in the program first and then in the
+ * objects in the order they were loaded, with their sysv hash tables.
+ * Constructors are not run, as for the static programs, and there is no
+ * dlopen or TLS.
+ * */
+
+#define PGSIZE                  4096
+#define LDSO_LIBDIR             "/lib/"
+#define LDSO_MAX_OBJS           8
+#define LDSO_MAX_PHNUM          16
+
+struct ldso_obj {
+	const char *name;
+	uintptr_t base;		// added to the addresses of the object
+	struct elf_dyn *dynamic;
+	struct elf_sym *symtab;
+	const char *strtab;
+	uint32_t *hash;		// nbucket, nchain, buckets, chains
+	struct elf_rela *rela, *jmprel;
+	size_t relasz, pltrelsz;
+};
+
+static struct ldso_obj objs[LDSO_MAX_OBJS];
+static int nr_objs;
+static char path[FS_MAX_FPATH_LEN + 1];
+static struct proghdr phdrs[LDSO_MAX_PHNUM];
+
+static void __attribute__ ((noreturn)) ldso_fail(const char *what, int err)
+{
+	cprintf("ld.so: %s: %e.\n", what, err);
+	exit(-E_INVAL_ELF);
+}
+
+static void ldso_parse(struct ldso_obj *obj)
+{
+	struct elf_dyn *dyn;
+	for (dyn = obj->dynamic; dyn->d_tag != DT_NULL; dyn++) {
+		uintptr_t ptr = obj->base + dyn->d_val;
+		switch (dyn->d_tag) {
+		case DT_HASH:
+			obj->hash = (uint32_t *) ptr;
+			break;
+		case DT_STRTAB:
+			obj->strtab = (const char *)ptr;
+			break;
+		case DT_SYMTAB:
+			obj->symtab = (struct elf_sym *)ptr;
+			break;
+		case DT_RELA:
+			obj->rela = (struct elf_rela *)ptr;
+			break;
+		case DT_RELASZ:
+			obj->relasz = dyn->d_val;
+			break;
+		case DT_JMPREL:
+			obj->jmprel = (struct elf_rela *)ptr;
+			break;
+		case DT_PLTRELSZ:
+			obj->pltrelsz = dyn->d_val;
+			break;
+		case DT_PLTREL:
+			if (dyn->d_val != DT_RELA) {
+				ldso_fail(obj->name, -E_INVAL_ELF);
+			}
+			break;
+		}
+	}
+	if (obj->hash == NULL || obj->strtab == NULL || obj->symtab == NULL) {
+		ldso_fail(obj->name, -E_INVAL_ELF);
+	}
+}
+
+// ldso_map - map the PT_LOAD segments of the ET_DYN object at fd at a free
+//          - place, returns the base added to their addresses
+static uintptr_t ldso_map(const char *name, int fd, struct elfhdr *elf)
+{
+	uintptr_t va_min = ~(uintptr_t) 0, va_max = 0, base = 0;
+	int i, ret;
+	if (elf->e_phnum > LDSO_MAX_PHNUM) {
+		ldso_fail(name, -E_INVAL_ELF);
+	}
+	size_t phsize = sizeof(struct proghdr) * elf->e_phnum;
+	if (seek(fd, elf->e_phoff, LSEEK_SET) != 0
+	    || read(fd, phdrs, phsize) != phsize) {
+		ldso_fail(name, -E_INVAL_ELF);
+	}
+	for (i = 0; i < elf->e_phnum; i++) {
+		if (phdrs[i].p_type != ELF_PT_LOAD) {
+			continue;
+		}
+		if (va_min > phdrs[i].p_va)
+			va_min = phdrs[i].p_va;
+		if (va_max < phdrs[i].p_va + phdrs[i].p_memsz)
+			va_max = phdrs[i].p_va + phdrs[i].p_memsz;
+	}
+	va_min = ROUNDDOWN(va_min, PGSIZE), va_max = ROUNDUP(va_max, PGSIZE);
+	if (va_max <= va_min) {
+		ldso_fail(name, -E_INVAL_ELF);
+	}
+
+	/* a place for the whole object, the segments keep their distances */
+	if ((ret = sys_mmap(&base, va_max - va_min, 0)) != 0
+	    || (ret = sys_munmap(base, va_max - va_min)) != 0) {
+		ldso_fail(name, ret);
+	}
+	base -= va_min;
+	for (i = 0; i < elf->e_phnum; i++) {
+		struct proghdr *ph = phdrs + i;
+		uintptr_t addr = base + ph->p_va;
+		uint32_t mmap_flags = 0;
+		if (ph->p_type != ELF_PT_LOAD) {
+			continue;
+		}
+		if (ph->p_flags & ELF_PF_W)
+			mmap_flags |= MMAP_WRITE;
+		if (ph->p_flags & ELF_PF_X)
+			mmap_flags |= MMAP_EXEC;
+		if ((ret = sys_mmap_file(&addr, ph->p_memsz, mmap_flags, fd,
+					 ph->p_offset, ph->p_filesz)) != 0) {
+			ldso_fail(name, ret);
+		}
+	}
+	for (i = 0; i < elf->e_phnum; i++) {
+		if (phdrs[i].p_type == ELF_PT_DYNAMIC) {
+			objs[nr_objs].dynamic =
+			    (struct elf_dyn *)(base + phdrs[i].p_va);
+		}
+	}
+	return base;
+}
+
+// ldso_load - open /lib/name, map it and add it to objs, unless it is there
+static void ldso_load(const char *name)
+{
+	struct elfhdr __elf, *elf = &__elf;
+	struct ldso_obj *obj;
+	int i, fd;
+	for (i = 1; i < nr_objs; i++) {
+		if (strcmp(objs[i].name, name) == 0) {
+			return;
+		}
+	}
+	if (nr_objs == LDSO_MAX_OBJS) {
+		ldso_fail(name, -E_NO_MEM);
+	}
+	if (strlen(LDSO_LIBDIR) + strlen(name) > FS_MAX_FPATH_LEN) {
+		ldso_fail(name, -E_INVAL);
+	}
+	strcpy(path, LDSO_LIBDIR), strcat(path, name);
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		ldso_fail(path, fd);
+	}
+	if (read(fd, elf, sizeof(struct elfhdr)) != sizeof(struct elfhdr)
+	    || elf->e_magic != ELF_MAGIC || elf->e_type != ET_DYN) {
+		ldso_fail(path, -E_INVAL_ELF);
+	}
+	obj = objs + nr_objs;
+	memset(obj, 0, sizeof(struct ldso_obj));
+	obj->name = name;
+	obj->base = ldso_map(name, fd, elf);
+	/* the maps hold the file */
+	close(fd);
+	if (obj->dynamic == NULL) {
+		ldso_fail(name, -E_INVAL_ELF);
+	}
+	ldso_parse(obj);
+	nr_objs++;
+}
+
+static uint32_t ldso_hash(const char *name)
+{
+	uint32_t h = 0, g;
+	while (*name != '\0') {
+		h = (h << 4) + (uint8_t) * name++;
+		if ((g = h & 0xf0000000) != 0) {
+			h ^= g >> 24;
+		}
+		h &= ~g;
+	}
+	return h;
+}
+
+// ldso_lookup - the definition of name in objs from index first on, the
+//             - object holding it in *obj_store
+static struct elf_sym *ldso_lookup(const char *name, int first,
+				   struct ldso_obj **obj_store)
+{
+	uint32_t h = ldso_hash(name);
+	int i;
+	for (i = first; i < nr_objs; i++) {
+		struct ldso_obj *obj = objs + i;
+		uint32_t nbucket = obj->hash[0];
+		uint32_t *chain = obj->hash + 2 + nbucket;
+		uint32_t idx = obj->hash[2 + h % nbucket];
+		for (; idx != 0; idx = chain[idx]) {
+			struct elf_sym *sym = obj->symtab + idx;
+			if (sym->st_shndx != SHN_UNDEF
+			    && ELF_ST_BIND(sym->st_info) != STB_LOCAL
+			    && strcmp(obj->strtab + sym->st_name, name) == 0) {
+				*obj_store = obj;
+				return sym;
+			}
+		}
+	}
+	return NULL;
+}
+
+static void
+ldso_relocate(struct ldso_obj *obj, struct elf_rela *rela, size_t size)
+{
+	struct elf_rela *end = (struct elf_rela *)((uintptr_t) rela + size);
+	for (; rela < end; rela++) {
+		uintptr_t *where = (uintptr_t *) (obj->base + rela->r_offset);
+		uint32_t type = ELF_R_TYPE(rela->r_info);
+		struct elf_sym *sym = obj->symtab + ELF_R_SYM(rela->r_info);
+		struct ldso_obj *def = NULL;
+		struct elf_sym *dsym = NULL;
+		uintptr_t value = 0;
+
+		if (type == R_X86_64_NONE) {
+			continue;
+		}
+		if (type == R_X86_64_RELATIVE) {
+			*where = obj->base + rela->r_addend;
+			continue;
+		}
+		if (ELF_R_SYM(rela->r_info) != 0) {
+			const char *name = obj->strtab + sym->st_name;
+			/* a copy is of the data of the object defining it */
+			int first = (type == R_X86_64_COPY) ? 1 : 0;
+			if ((dsym = ldso_lookup(name, first, &def)) != NULL) {
+				value = def->base + dsym->st_value;
+			} else if (ELF_ST_BIND(sym->st_info) != STB_WEAK) {
+				cprintf("ld.so: %s: undefined symbol %s.\n",
+					obj->name, name);
+				exit(-E_INVAL_ELF);
+			}
+		}
+		switch (type) {
+		case R_X86_64_64:
+			*where = value + rela->r_addend;
+			break;
+		case R_X86_64_GLOB_DAT:
+		case R_X86_64_JUMP_SLOT:
+			*where = value;
+			break;
+		case R_X86_64_COPY:
+			if (dsym != NULL) {
+				memcpy(where, (void *)value, dsym->st_size);
+			}
+			break;
+		default:
+			ldso_fail(obj->name, -E_INVAL_ELF);
+		}
+	}
+}
+
+// ldso_main - called by _start with the aux vector exec passed, returns the
+//           - entry of the program once everything is mapped and relocated
+uintptr_t ldso_main(uintptr_t * auxv)
+{
+	struct proghdr *phdr = NULL;
+	uintptr_t entry = 0, phnum = 0;
+	struct elf_dyn *dyn;
+	int i;
+
+	for (; auxv[0] != ELF_AT_NULL; auxv += 2) {
+		if (auxv[0] == ELF_AT_PHDR) {
+			phdr = (struct proghdr *)auxv[1];
+		} else if (auxv[0] == ELF_AT_PHNUM) {
+			phnum = auxv[1];
+		} else if (auxv[0] == ELF_AT_ENTRY) {
+			entry = auxv[1];
+		}
+	}
+
+	/* the program is ET_EXEC, at the addresses it was linked at */
+	objs[0].name = "<program>";
+	for (i = 0; i < phnum; i++) {
+		if (phdr[i].p_type == ELF_PT_DYNAMIC) {
+			objs[0].dynamic = (struct elf_dyn *)phdr[i].p_va;
+		}
+	}
+	if (phdr == NULL || entry == 0 || objs[0].dynamic == NULL) {
+		ldso_fail(objs[0].name, -E_INVAL_ELF);
+	}
+	ldso_parse(objs);
+	nr_objs = 1;
+
+	/* breadth first, the objects needed by those loaded come after them */
+	for (i = 0; i < nr_objs; i++) {
+		for (dyn = objs[i].dynamic; dyn->d_tag != DT_NULL; dyn++) {
+			if (dyn->d_tag == DT_NEEDED) {
+				ldso_load(objs[i].strtab + dyn->d_val);
+			}
+		}
+	}
+
+	/* the program last: its copies are of the relocated data */
+	for (i = nr_objs - 1; i >= 0; i--) {
+		ldso_relocate(objs + i, objs[i].rela, objs[i].relasz);
+		ldso_relocate(objs + i, objs[i].jmprel, objs[i].pltrelsz);
+	}
+	return entry;
+}
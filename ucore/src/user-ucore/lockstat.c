@@ -0,0 +1,36 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <file.h>
+#include <syscall.h>
+
+/* the lock statistics of the kernel, see spinlock.c of amd64 */
+#define LOCKSTAT_BUFSIZE            (64 * 1024)
+
+static char buf[LOCKSTAT_BUFSIZE];
+
+static int usage(void)
+{
+	cprintf("usage: lockstat [reset]\n");
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	int ret;
+	if (argc == 1) {
+		if ((ret = sys_lockstat(LOCKSTAT_DUMP, buf, sizeof(buf))) > 0) {
+			write(1, buf, ret);
+			ret = 0;
+		}
+	} else if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+		ret = sys_lockstat(LOCKSTAT_RESET, NULL, 0);
+	} else {
+		return usage();
+	}
+	if (ret < 0) {
+		cprintf("lockstat: failed, %e.\n", ret);
+	}
+	return ret;
+}
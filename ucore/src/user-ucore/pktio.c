@@ -0,0 +1,103 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <pktio.h>
+
+/* print the packets of a queue of the network card, see pktio.h; with -e
+ * send each back to where it came from */
+
+static int usage(void)
+{
+	cprintf("usage: pktio [-q queue] [-c count] [-e]\n");
+	return -1;
+}
+
+static void print_mac(const uint8_t * mac)
+{
+	cprintf("%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2],
+		mac[3], mac[4], mac[5]);
+}
+
+// echo - put frame of len, the addresses swapped, in the transmit ring
+static void
+echo(void *map, uint32_t queue, const uint8_t * mac, const char *frame,
+     size_t len)
+{
+	struct pktio_ring *tx = PKTIO_TX_RING(map);
+	uint32_t tail = tx->tail;
+	if (tail - tx->head >= tx->nr_slots
+	    && sys_pktio(PKTIO_TXSYNC, queue, NULL) <= 0) {
+		return;
+	}
+	char *buf = PKTIO_BUF(map, tx, tail);
+	memcpy(buf, frame + 6, 6);
+	memcpy(buf + 6, mac, 6);
+	memcpy(buf + 12, frame + 12, len - 12);
+	PKTIO_SLOT(tx, tail)->len = len;
+	tx->tail = tail + 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct pktio_info info;
+	uint32_t queue = 0, count = 0, seen = 0;
+	bool do_echo = 0;
+	uintptr_t addr;
+	int i, ret;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+			queue = strtol(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+			count = strtol(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-e") == 0) {
+			do_echo = 1;
+		} else {
+			return usage();
+		}
+	}
+	if ((ret = sys_pktio(PKTIO_INFO, 0, &info)) != 0) {
+		cprintf("pktio: no network card, %e.\n", ret);
+		return ret;
+	}
+	if ((ret = sys_pktio(PKTIO_MAP, queue, &addr)) != 0) {
+		cprintf("pktio: map of queue %u failed, %e.\n", queue, ret);
+		return ret;
+	}
+	cprintf("pktio: ");
+	print_mac(info.mac);
+	cprintf(", queue %u of %u.\n", queue, info.nr_queues);
+	void *map = (void *)addr;
+	struct pktio_ring *rx = PKTIO_RX_RING(map);
+	while (count == 0 || seen < count) {
+		if ((ret = sys_pktio(PKTIO_RXWAIT, queue, NULL)) < 0) {
+			return ret;
+		}
+		uint32_t head = rx->head, tail = rx->tail;
+		for (; head != tail && (count == 0 || seen < count); head++) {
+			const uint8_t *frame =
+			    (uint8_t *) PKTIO_BUF(map, rx, head);
+			uint32_t len = PKTIO_SLOT(rx, head)->len;
+			seen++;
+			if (len < 14) {
+				continue;
+			}
+			cprintf("%u ", len);
+			print_mac(frame + 6);
+			cprintf(" > ");
+			print_mac(frame);
+			cprintf(" %02x%02x\n", frame[12], frame[13]);
+			if (do_echo) {
+				echo(map, queue, info.mac, (const char *)frame,
+				     len);
+			}
+		}
+		/* the buffers go back to the card at the next sync */
+		rx->head = head;
+		if (do_echo) {
+			sys_pktio(PKTIO_TXSYNC, queue, NULL);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <file.h>
+#include <syscall.h>
+
+/* the dump of the kernel sampling profiler, see kprof.c of amd64 */
+#define PROFILE_BUFSIZE             (64 * 1024)
+
+static char buf[PROFILE_BUFSIZE];
+
+static int usage(void)
+{
+	cprintf("usage: profile start [timer] | stop | top | folded\n");
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	int ret, op;
+	if (argc < 2) {
+		return usage();
+	}
+	if (strcmp(argv[1], "start") == 0) {
+		op = (argc > 2 && strcmp(argv[2], "timer") == 0) ?
+		    PROFILE_START_TIMER : PROFILE_START;
+	} else if (strcmp(argv[1], "stop") == 0) {
+		op = PROFILE_STOP;
+	} else if (strcmp(argv[1], "top") == 0) {
+		op = PROFILE_TOP;
+	} else if (strcmp(argv[1], "folded") == 0) {
+		op = PROFILE_FOLDED;
+	} else {
+		return usage();
+	}
+	if ((ret = sys_profile(op, buf, sizeof(buf))) < 0) {
+		cprintf("profile: %s failed, %e.\n", argv[1], ret);
+		return ret;
+	}
+	if (op == PROFILE_TOP || op == PROFILE_FOLDED) {
+		write(1, buf, ret);
+	}
+	return 0;
+}
@@ -214,6 +214,42 @@ runit:
 	return __exec(NULL, argv, g_envp);
 }
 
+/*
+ * spawncmd - start cmd by spawn if it is a plain command, with no
+ * redirection, pipe or list, which saves the copy of the address space of
+ * sh that fork makes. Returns -E_INVAL, with cmd untouched, if it is not.
+ */
+int spawncmd(char *cmd)
+{
+	static char argv0[BUFSIZE];
+	const char *argv[EXEC_MAX_ARG_NUM + 1];
+	char *s = cmd, *t;
+	int argc = 0;
+	for (; *s != '\0'; s++) {
+		if (strchr(SYMBOLS, *s) != NULL) {
+			return -E_INVAL;
+		}
+	}
+	for (s = cmd; *s != '\0' && strchr(WHITESPACE, *s) != NULL; s++) ;
+	if (*s == '\0' || (strncmp(s, "cd", 2) == 0
+			   && (s[2] == '\0' || strchr(WHITESPACE, s[2]) != NULL))) {
+		return -E_INVAL;
+	}
+	while (gettoken(&cmd, &t) == 'w') {
+		if (argc == EXEC_MAX_ARG_NUM) {
+			printf("sh error: too many arguments\n");
+			return -E_INVAL;
+		}
+		argv[argc++] = t;
+	}
+	if (testfile(argv[0]) != 0) {
+		snprintf(argv0, sizeof(argv0), "/bin/%s", argv[0]);
+		argv[0] = argv0;
+	}
+	argv[argc] = NULL;
+	return spawn(argv, g_envp);
+}
+
 int main(int argc, char **argv)
 {
 	int ret, interactive = 1;
@@ -241,12 +277,14 @@ int main(int argc, char **argv)
 			__asm__ volatile (".long 0xe7f001f0");
 			continue;
 		}
-		if ((pid = fork()) == 0) {
+		if ((pid = spawncmd(buffer)) == -E_INVAL
+		    && (pid = fork()) == 0) {
 			ret = runcmd(buffer);
 			exit(ret);
 		}
-		assert(pid >= 0);
-		if (waitpid(pid, &ret) == 0) {
+		if (pid < 0) {
+			printf("error: %d - %e\n", pid, pid);
+		} else if (waitpid(pid, &ret) == 0) {
 			if (ret == 0 && shcwd[0] != '\0') {
 				ret = chdir(shcwd);
 			}
@@ -0,0 +1,161 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <thread.h>
+#include <sysrecbuf.h>
+
+/* *
+ * sysrec - run a command with its syscalls recorded, and write them to a
+ * file for sysreplay: the child is flagged before it execs the command,
+ * and a thread takes the records from the rings of the kernel, see
+ * sysrecbuf.h, until the command has exited.
+ * */
+#define SYSREC_MAX_CPUS             64
+#define SYSREC_POLL_TICKS           10
+#define SYSREC_OUT_RECORDS          128
+
+static struct sysrec_ring *rings[SYSREC_MAX_CPUS];
+static uint32_t pos[SYSREC_MAX_CPUS];
+static int ncpus;
+
+static struct sysrec_header header;
+static struct sysrec_record outbuf[SYSREC_OUT_RECORDS];
+static int nout, outfd;
+static volatile bool done;
+
+#define sysrec_barrier()        __asm__ __volatile__ ("" ::: "memory")
+
+static int usage(void)
+{
+	cprintf("usage: sysrec [-o file] <cmd> [args...]\n");
+	return -1;
+}
+
+static void flush(void)
+{
+	size_t len = nout * sizeof(struct sysrec_record);
+	if (nout != 0 && write(outfd, outbuf, len) != len) {
+		cprintf("sysrec: write failed, %d records dropped.\n", nout);
+		header.lost += nout;
+		header.nr_records -= nout;
+	}
+	nout = 0;
+}
+
+// drain - write the records of ring since the last call
+static void drain(int cpu)
+{
+	struct sysrec_ring *ring = rings[cpu];
+	struct sysrec_record *records = SYSREC_RECORDS(ring);
+	uint32_t head = ring->head;
+	if (head - pos[cpu] > ring->entries) {
+		header.lost += head - pos[cpu] - ring->entries;
+		pos[cpu] = head - ring->entries;
+	}
+	for (; pos[cpu] != head; pos[cpu]++) {
+		struct sysrec_record *slot = records + pos[cpu] % ring->entries;
+		if (slot->seq != pos[cpu] + 1) {
+			header.lost++;
+			continue;
+		}
+		sysrec_barrier();
+		outbuf[nout] = *slot;
+		sysrec_barrier();
+		/* overwritten while copied */
+		if (slot->seq != pos[cpu] + 1) {
+			header.lost++;
+			continue;
+		}
+		header.nr_records++;
+		if (++nout == SYSREC_OUT_RECORDS) {
+			flush();
+		}
+	}
+}
+
+static void drain_all(void)
+{
+	int i;
+	for (i = 0; i < ncpus; i++) {
+		drain(i);
+	}
+	flush();
+}
+
+static int drainer(void *arg)
+{
+	while (!done) {
+		sleep(SYSREC_POLL_TICKS);
+		drain_all();
+	}
+	return 0;
+}
+
+int main(int argc, const char **argv)
+{
+	const char *out = "sysrec.out";
+	int i = 1, pid, ret, from, event, exit_code;
+	thread_t tid;
+	if (argc > 2 && strcmp(argv[1], "-o") == 0) {
+		out = argv[2], i = 3;
+	}
+	if (i >= argc) {
+		return usage();
+	}
+	argv[argc] = NULL;
+	if ((outfd = open(out, O_WRONLY | O_CREAT | O_TRUNC)) < 0) {
+		cprintf("sysrec: cannot open %s, %e.\n", out, outfd);
+		return outfd;
+	}
+	header.magic = SYSREC_MAGIC, header.version = SYSREC_VERSION;
+	write(outfd, &header, sizeof(header));
+
+	if ((pid = fork()) == 0) {
+		/* flagged and let go by the parent */
+		recv_event(&from, &event);
+		__exec(NULL, argv + i, NULL);
+		exit(-1);
+	}
+	if (pid < 0) {
+		cprintf("sysrec: fork failed, %e.\n", pid);
+		return pid;
+	}
+	if ((ret = sys_sysrec(SYSREC_START, pid, NULL)) != 0) {
+		cprintf("sysrec: start failed, %e.\n", ret);
+		kill(pid);
+		return ret;
+	}
+	for (ncpus = 0; ncpus < SYSREC_MAX_CPUS; ncpus++) {
+		uintptr_t addr;
+		if (sys_sysrec(SYSREC_MAP, ncpus, &addr) != 0) {
+			break;
+		}
+		rings[ncpus] = (struct sysrec_ring *)addr;
+		pos[ncpus] = rings[ncpus]->head;
+	}
+	if ((ret = thread(drainer, NULL, &tid)) != 0) {
+		cprintf("sysrec: no drainer thread, %e.\n", ret);
+		sys_sysrec(SYSREC_STOP, 0, NULL);
+		kill(pid);
+		return ret;
+	}
+	send_event(pid, 0);
+	waitpid(pid, &exit_code);
+
+	sys_sysrec(SYSREC_STOP, 0, NULL);
+	done = 1;
+	thread_wait(&tid, NULL);
+	drain_all();
+	seek(outfd, 0, LSEEK_SET);
+	write(outfd, &header, sizeof(header));
+	close(outfd);
+	cprintf("sysrec: %u records to %s", header.nr_records, out);
+	if (header.lost != 0) {
+		cprintf(", %u lost", header.lost);
+	}
+	cprintf(", exit code %d.\n", exit_code);
+	return 0;
+}
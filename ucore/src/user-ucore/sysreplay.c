@@ -0,0 +1,375 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <dir.h>
+#include <stat.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <vdso.h>
+#include <sysrecbuf.h>
+
+/* *
+ * sysreplay - issue again the syscalls of a recording of sysrec, in the
+ * order they were entered, and print the latency of each kind as recorded
+ * and as replayed. The file and sched syscalls below are replayed, the
+ * others are skipped: the fds of the recording are mapped to those the
+ * replay opened, by the pid and the fd recorded, a buffer is replaced by
+ * one of the recorded length, at most REPLAY_BUFSIZE, and the procs of
+ * the recording are all replayed by this one.
+ * */
+#define REPLAY_BUFSIZE              (64 * 1024)
+#define REPLAY_MAX_FDS              128
+#define REPLAY_NR_BUCKETS           64
+
+struct replay_op {
+	struct sysrec_record rec;
+	char path[SYSREC_PATH_MAX];
+};
+
+struct replay_fd {
+	int pid, recfd, fd;
+};
+
+struct replay_stat {
+	const char *name;
+	int num;
+	uint32_t count;
+	uint64_t max[2];
+	uint32_t hist[2][REPLAY_NR_BUCKETS];
+};
+
+static struct replay_stat stats[] = {
+	{"open", SYS_open}, {"close", SYS_close}, {"read", SYS_read},
+	{"write", SYS_write}, {"seek", SYS_seek}, {"fstat", SYS_fstat},
+	{"fsync", SYS_fsync}, {"dup", SYS_dup}, {"mkdir", SYS_mkdir},
+	{"unlink", SYS_unlink}, {"chdir", SYS_chdir}, {"yield", SYS_yield},
+	{"getpid", SYS_getpid}, {"gettime", SYS_gettime},
+	{"sleep", SYS_sleep},
+};
+
+#define NR_STATS                    (sizeof(stats) / sizeof(stats[0]))
+
+static struct replay_fd fds[REPLAY_MAX_FDS];
+static char buf[REPLAY_BUFSIZE];
+static uint32_t skipped;
+
+static int usage(void)
+{
+	cprintf("usage: sysreplay [file]\n");
+	return -1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct replay_stat *stat_find(int num)
+{
+	int i;
+	for (i = 0; i < NR_STATS; i++) {
+		if (stats[i].num == num) {
+			return stats + i;
+		}
+	}
+	return NULL;
+}
+
+static int bucket(uint64_t ns)
+{
+	int b = 0;
+	while (ns > 1 && b < REPLAY_NR_BUCKETS - 1) {
+		ns >>= 1, b++;
+	}
+	return b;
+}
+
+static void stat_add(struct replay_stat *s, int which, uint64_t ns)
+{
+	s->hist[which][bucket(ns)]++;
+	if (ns > s->max[which]) {
+		s->max[which] = ns;
+	}
+}
+
+// stat_pct - the upper bound of the bucket holding the pct-th percentile
+static uint64_t stat_pct(struct replay_stat *s, int which, int pct)
+{
+	uint32_t seen = 0, want = (s->count * pct + 99) / 100;
+	int b;
+	for (b = 0; b < REPLAY_NR_BUCKETS; b++) {
+		if ((seen += s->hist[which][b]) >= want) {
+			break;
+		}
+	}
+	return (b >= REPLAY_NR_BUCKETS - 1) ? s->max[which] : (2ULL << b);
+}
+
+// fd_find - the replay fd of fd of pid in the recording, NULL if none
+static struct replay_fd *fd_find(int pid, int recfd)
+{
+	int i;
+	for (i = 0; i < REPLAY_MAX_FDS; i++) {
+		if (fds[i].fd >= 0 && fds[i].pid == pid
+		    && fds[i].recfd == recfd) {
+			return fds + i;
+		}
+	}
+	return NULL;
+}
+
+static void fd_add(int pid, int recfd, int fd)
+{
+	int i;
+	for (i = 0; i < REPLAY_MAX_FDS; i++) {
+		if (fds[i].fd < 0) {
+			fds[i].pid = pid, fds[i].recfd = recfd, fds[i].fd = fd;
+			return;
+		}
+	}
+	close(fd);
+}
+
+// mapped - the replay fd of arg, or -1 if the recording did not open it
+static int mapped(struct sysrec_record *r, int i)
+{
+	struct replay_fd *f = fd_find(r->pid, (int)r->arg[i]);
+	return (f != NULL) ? f->fd : -1;
+}
+
+static size_t buflen(struct sysrec_record *r)
+{
+	size_t len = (size_t) r->arg[2];
+	return (len < REPLAY_BUFSIZE) ? len : REPLAY_BUFSIZE;
+}
+
+// replay - issue op again, or return -1 if it is not replayed
+static int replay(struct replay_op *op)
+{
+	struct sysrec_record *r = &(op->rec);
+	struct stat __stat;
+	struct replay_fd *f;
+	int fd = -1, ret;
+	switch (r->num) {
+	case SYS_open:
+	case SYS_chdir:
+	case SYS_mkdir:
+	case SYS_unlink:
+		if (op->path[0] == '\0') {
+			return -1;
+		}
+		break;
+	case SYS_close:
+	case SYS_read:
+	case SYS_write:
+	case SYS_seek:
+	case SYS_fstat:
+	case SYS_fsync:
+	case SYS_dup:
+		if ((fd = mapped(r, 0)) < 0) {
+			return -1;
+		}
+		break;
+	}
+	switch (r->num) {
+	case SYS_open:
+		if ((ret = open(op->path, (uint32_t) r->arg[1])) >= 0) {
+			if (r->ret >= 0) {
+				fd_add(r->pid, (int)r->ret, ret);
+			} else {
+				close(ret);
+			}
+		}
+		break;
+	case SYS_close:
+		f = fd_find(r->pid, (int)r->arg[0]);
+		f->fd = -1;
+		close(fd);
+		break;
+	case SYS_read:
+		read(fd, buf, buflen(r));
+		break;
+	case SYS_write:
+		write(fd, buf, buflen(r));
+		break;
+	case SYS_seek:
+		seek(fd, (off_t) r->arg[1], (int)r->arg[2]);
+		break;
+	case SYS_fstat:
+		fstat(fd, &__stat);
+		break;
+	case SYS_fsync:
+		fsync(fd);
+		break;
+	case SYS_dup:
+		/* only a dup to a new fd, not a dup2 */
+		if ((int)r->arg[1] != NO_FD) {
+			return -1;
+		}
+		if ((ret = dup(fd)) >= 0 && r->ret >= 0) {
+			fd_add(r->pid, (int)r->ret, ret);
+		}
+		break;
+	case SYS_mkdir:
+		mkdir(op->path);
+		break;
+	case SYS_unlink:
+		unlink(op->path);
+		break;
+	case SYS_chdir:
+		chdir(op->path);
+		break;
+	case SYS_yield:
+		yield();
+		break;
+	case SYS_getpid:
+		getpid();
+		break;
+	case SYS_gettime:
+		sys_gettime();
+		break;
+	case SYS_sleep:
+		sleep((unsigned int)r->arg[0]);
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+// load - the ops of the recording in file, each with its path; the
+//      - number of them in *nops
+static struct replay_op *load(const char *file, int *nops)
+{
+	struct sysrec_header header;
+	struct sysrec_record r;
+	struct replay_op *ops;
+	int fd, n = 0;
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		cprintf("sysreplay: cannot open %s, %e.\n", file, fd);
+		return NULL;
+	}
+	if (read(fd, &header, sizeof(header)) != sizeof(header)
+	    || header.magic != SYSREC_MAGIC
+	    || header.version != SYSREC_VERSION) {
+		cprintf("sysreplay: %s is not a recording.\n", file);
+		close(fd);
+		return NULL;
+	}
+	if ((ops = malloc(sizeof(struct replay_op) *
+			  (header.nr_records + 1))) == NULL) {
+		cprintf("sysreplay: no memory for %u records.\n",
+			header.nr_records);
+		close(fd);
+		return NULL;
+	}
+	while (read(fd, &r, sizeof(r)) == sizeof(r)) {
+		if (r.num == SYSREC_PATH) {
+			/* lost with its syscall if that one was */
+			if (n > 0 && sysrec_has_path(ops[n - 1].rec.num)
+			    && ops[n - 1].rec.pid == r.pid
+			    && ops[n - 1].rec.ns == r.ns) {
+				memcpy(ops[n - 1].path, r.arg,
+				       SYSREC_PATH_MAX - 1);
+			}
+			continue;
+		}
+		if (n == header.nr_records) {
+			break;
+		}
+		ops[n].rec = r;
+		memset(ops[n].path, 0, SYSREC_PATH_MAX);
+		n++;
+	}
+	close(fd);
+	if (header.lost != 0) {
+		cprintf("sysreplay: %u records were lost.\n", header.lost);
+	}
+	*nops = n;
+	return ops;
+}
+
+// sort - ops by the time they were entered, the rings having them by the
+//      - time they returned
+static void sort(struct replay_op *ops, int n)
+{
+	struct replay_op tmp;
+	int gap, i, j;
+	for (gap = n / 2; gap > 0; gap /= 2) {
+		for (i = gap; i < n; i++) {
+			tmp = ops[i];
+			for (j = i; j >= gap; j -= gap) {
+				if (ops[j - gap].rec.ns <= tmp.rec.ns) {
+					break;
+				}
+				ops[j] = ops[j - gap];
+			}
+			ops[j] = tmp;
+		}
+	}
+}
+
+static void report(void)
+{
+	int i, w;
+	cprintf("%-8s %8s %-4s %10s %10s %10s %10s  (ns)\n", "syscall",
+		"count", "", "p50", "p90", "p99", "max");
+	for (i = 0; i < NR_STATS; i++) {
+		struct replay_stat *s = stats + i;
+		if (s->count == 0) {
+			continue;
+		}
+		for (w = 0; w < 2; w++) {
+			cprintf("%-8s %8u %-4s %10llu %10llu %10llu %10llu\n",
+				(w == 0) ? s->name : "", s->count,
+				(w == 0) ? "rec" : "rep", stat_pct(s, w, 50),
+				stat_pct(s, w, 90), stat_pct(s, w, 99),
+				s->max[w]);
+		}
+	}
+	cprintf("%u syscalls skipped.\n", skipped);
+}
+
+int main(int argc, char **argv)
+{
+	const char *file = "sysrec.out";
+	struct replay_op *ops;
+	int i, n;
+	if (argc > 2) {
+		return usage();
+	}
+	if (argc == 2) {
+		file = argv[1];
+	}
+	if ((ops = load(file, &n)) == NULL) {
+		return -1;
+	}
+	sort(ops, n);
+	for (i = 0; i < REPLAY_MAX_FDS; i++) {
+		fds[i].fd = -1;
+	}
+	for (i = 0; i < n; i++) {
+		struct replay_stat *s = stat_find(ops[i].rec.num);
+		uint64_t begin = now_ns(), end;
+		if (s == NULL || replay(ops + i) != 0) {
+			skipped++;
+			continue;
+		}
+		end = now_ns();
+		s->count++;
+		stat_add(s, 0, ops[i].rec.lat_ns);
+		stat_add(s, 1, end - begin);
+	}
+	for (i = 0; i < REPLAY_MAX_FDS; i++) {
+		if (fds[i].fd >= 0) {
+			close(fds[i].fd);
+		}
+	}
+	free(ops);
+	report();
+	return 0;
+}
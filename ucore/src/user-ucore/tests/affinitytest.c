@@ -0,0 +1,48 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <cpuset.h>
+#include <error.h>
+
+/* *
+ * The affinity of a process: the cpus sched_getaffinity gives back are
+ * those sched_setaffinity set, a child forked meanwhile keeps them, a mask
+ * with no cpu of the machine is refused, and a NULL one lets it run
+ * anywhere again.
+ * */
+int main(void)
+{
+	cpuset_t all, mask;
+	int pid, exit_code;
+	assert(sched_getaffinity(0, &all) == 0 && cpuset_test(&all, 0));
+
+	cpuset_clear(&mask);
+	cpuset_set(&mask, 0);
+	assert(sched_setaffinity(0, &mask) == 0);
+	memset(&mask, 0xff, sizeof(mask));
+	assert(sched_getaffinity(0, &mask) == 0);
+	assert(cpuset_test(&mask, 0) && cpuset_count(&mask) == 1);
+
+	if ((pid = fork()) == 0) {
+		cpuset_t child;
+		assert(sched_getaffinity(0, &child) == 0);
+		exit(cpuset_test(&child, 0) && cpuset_count(&child) == 1 ?
+		     0 : -1);
+	}
+	assert(pid > 0 && waitpid(pid, &exit_code) == 0 && exit_code == 0);
+
+	/* no cpu at all, or only cpus past those there are */
+	cpuset_clear(&mask);
+	assert(sched_setaffinity(0, &mask) == -E_INVAL);
+	if (!cpuset_test(&all, CPUSET_MAX_CPUS - 1)) {
+		cpuset_set(&mask, CPUSET_MAX_CPUS - 1);
+		assert(sched_setaffinity(0, &mask) == -E_INVAL);
+	}
+
+	assert(sched_setaffinity(0, NULL) == 0);
+	assert(sched_getaffinity(0, &mask) == 0);
+	assert(memcmp(&mask, &all, sizeof(mask)) == 0);
+	cprintf("affinitytest pass.\n");
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <error.h>
+
+/* *
+ * The process saves itself with state in its data, heap and stack and a
+ * file open at an offset, then changes them all. The children restored
+ * from the image find the state of the checkpoint, the file reopened at
+ * its offset; a restore from a file that is no image returns an error.
+ * */
+#define IMAGE               "ckpttest.img"
+#define DATAFILE            "ckpttest.dat"
+#define NR_WORDS            2048
+#define NR_CHILDREN         2
+
+static volatile int data = 0x1234;
+
+static void check(int *heap, int stack, int fd)
+{
+	char c;
+	int i;
+	assert(data == 0x1234 && stack == 0x5678);
+	for (i = 0; i < NR_WORDS; i++) {
+		assert(heap[i] == i * 3);
+	}
+	assert(read(fd, &c, 1) == 1 && c == 'c');
+	exit(0xc1);
+}
+
+int main(void)
+{
+	volatile int stack = 0x5678;
+	int *heap, fd, pid, exit_code, ret, i;
+	assert((heap = malloc(NR_WORDS * sizeof(int))) != NULL);
+	for (i = 0; i < NR_WORDS; i++) {
+		heap[i] = i * 3;
+	}
+	assert((fd = open(DATAFILE, O_CREAT | O_RDWR | O_TRUNC)) >= 0);
+	assert(write(fd, "abcd", 4) == 4 && seek(fd, 2, LSEEK_SET) == 0);
+
+	if ((ret = checkpoint(IMAGE)) == -E_UNIMP) {
+		cprintf("ckpttest pass.\n");
+		return 0;
+	}
+	if (ret == 1) {
+		check(heap, stack, fd);
+	}
+	assert(ret == 0);
+	cprintf("ckpttest checkpoint pass.\n");
+
+	data = 0, stack = 0, heap[0] = heap[NR_WORDS - 1] = -1;
+	assert(seek(fd, 0, LSEEK_SET) == 0);
+	for (i = 0; i < NR_CHILDREN; i++) {
+		if ((pid = fork()) == 0) {
+			close(fd);
+			restore(IMAGE);
+			exit(-1);
+		}
+		assert(pid > 0);
+		assert(waitpid(pid, &exit_code) == 0 && exit_code == 0xc1);
+	}
+	cprintf("ckpttest restore pass.\n");
+
+	assert(restore(DATAFILE) < 0 && restore("nosuchfile") < 0);
+	assert(data == 0 && stack == 0);
+	close(fd);
+	cprintf("ckpttest pass.\n");
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <error.h>
+
+/* *
+ * The maps of SYS_mmap_file that ld.so loads the libraries with: a map of
+ * this program reads as the file does, at any offset in a page; a fixed
+ * address at another offset in its page than the file offset is refused;
+ * a private map written to leaves the file as it was. Passes as is without
+ * DYNAMIC_LINK.
+ * */
+#define PGSIZE              4096
+#define MAP_LEN             (2 * PGSIZE)
+#define MAP_OFF             100
+
+static char buf[MAP_LEN];
+
+int main(void)
+{
+	uintptr_t addr = 0;
+	int fd, ret, n;
+
+	assert((fd = open("/testbin/dynlinktest", O_RDONLY)) >= 0);
+	ret = sys_mmap_file(&addr, PGSIZE, 0, fd, 0, PGSIZE);
+	if (ret == -E_UNIMP) {
+		cprintf("dynlinktest pass.\n");
+		return 0;
+	}
+	assert(ret == 0 && addr != 0 && addr % PGSIZE == 0);
+	assert((n = read(fd, buf, MAP_LEN)) > MAP_OFF);
+	assert(memcmp((void *)addr, buf, PGSIZE) == 0);
+	assert(sys_munmap(addr, PGSIZE) == 0);
+
+	/* the address keeps the offset of the file in the page */
+	addr = 0;
+	ret = sys_mmap_file(&addr, n, 0, fd, MAP_OFF, n - MAP_OFF);
+	assert(ret == 0 && addr % PGSIZE == MAP_OFF);
+	assert(memcmp((void *)addr, buf + MAP_OFF, n - MAP_OFF) == 0);
+	assert(sys_munmap(addr - MAP_OFF, MAP_OFF + n) == 0);
+
+	addr = 0x20000000 + MAP_OFF + 1;
+	ret = sys_mmap_file(&addr, PGSIZE, 0, fd, MAP_OFF, PGSIZE);
+	assert(ret == -E_INVAL);
+
+	/* a write to a private map is its own, and the rest of it zero */
+	addr = 0;
+	ret = sys_mmap_file(&addr, MAP_LEN, MMAP_WRITE, fd, 0, MAP_OFF);
+	assert(ret == 0);
+	assert(((char *)addr)[MAP_OFF] == 0 && ((char *)addr)[PGSIZE] == 0);
+	((char *)addr)[0] = ~buf[0];
+	assert(seek(fd, 0, LSEEK_SET) == 0 && read(fd, buf + PGSIZE, 1) == 1);
+	assert(buf[PGSIZE] == buf[0] && ((char *)addr)[0] == (char)~buf[0]);
+	assert(sys_munmap(addr, MAP_LEN) == 0);
+
+	close(fd);
+	cprintf("dynlinktest pass.\n");
+	return 0;
+}
@@ -0,0 +1,55 @@
+#include <ulib.h>
+#include <stdio.h>
+
+/* each process keeps its own xmm registers across the switches, and a
+ * child starts with those of its parent at the fork */
+const int nchild = 4;
+const int nround = 50;
+
+static inline void set_xmm0(uint64_t v)
+{
+	asm volatile ("movq %0, %%xmm0"::"r" (v):"xmm0");
+}
+
+static inline uint64_t get_xmm0(void)
+{
+	uint64_t v;
+	asm volatile ("movq %%xmm0, %0":"=r" (v));
+	return v;
+}
+
+static void check(uint64_t v)
+{
+	int i;
+	for (i = 0; i < nround; i++) {
+		set_xmm0(v + i);
+		yield();
+		if (get_xmm0() != v + i) {
+			panic("xmm0 of %d lost in round %d.\n", getpid(), i);
+		}
+	}
+}
+
+int main(void)
+{
+	int n, pid;
+	set_xmm0(0x5a5a5a5a5a5a5a5aULL);
+	for (n = 0; n < nchild; n++) {
+		if ((pid = fork()) == 0) {
+			if (get_xmm0() != 0x5a5a5a5a5a5a5a5aULL) {
+				panic("xmm0 not inherited.\n");
+			}
+			check(0x1000000000ULL * (n + 1));
+			exit(0);
+		}
+		assert(pid > 0);
+	}
+	check(0xfedcba9800000000ULL);
+	for (; n > 0; n--) {
+		if (wait() != 0) {
+			panic("wait stopped early\n");
+		}
+	}
+	cprintf("fputest pass.\n");
+	return 0;
+}
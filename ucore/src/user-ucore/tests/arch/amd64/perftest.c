@@ -0,0 +1,101 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <perf_event.h>
+#include <error.h>
+
+/* *
+ * The counters of SYS_perf: those of this task count its loop, across the
+ * switches a yield makes, and keep going up; one on a child counts what it
+ * ran once it is gone; one of cpu 0 and one sampling on a period open and
+ * close. Passes as is with no PMU, or with the counters left out.
+ * */
+#define NR_LOOP             100000
+
+static volatile uint64_t sink;
+
+static void spin(void)
+{
+	int i;
+	for (i = 0; i < NR_LOOP; i++) {
+		sink += i;
+	}
+}
+
+static int open_counter(int event, int pid, int cpu, uint64_t period)
+{
+	struct perf_attr attr;
+	attr.event = event, attr.pid = pid, attr.cpu = cpu;
+	attr.flags = PERF_EXCLUDE_KERNEL, attr.period = period;
+	return sys_perf(PERF_OPEN, 0, &attr);
+}
+
+static uint64_t read_counter(int id)
+{
+	uint64_t val;
+	assert(sys_perf(PERF_READ, id, &val) == 0);
+	return val;
+}
+
+int main(void)
+{
+	int events, ev, insn, cyc, id, pid, exit_code;
+	uint64_t v1, v2;
+	events = sys_perf(PERF_EVENTS, 0, NULL);
+	if (events == -E_UNIMP || events == -E_NO_DEV) {
+		cprintf("perftest pass.\n");
+		return 0;
+	}
+	assert(events > 0);
+	ev = (events & (1 << PERF_EV_INSTRUCTIONS)) ? PERF_EV_INSTRUCTIONS
+	    : PERF_EV_CYCLES;
+	assert(events & (1 << ev));
+
+	assert((insn = open_counter(ev, PERF_PID_SELF, 0, 0)) >= 0);
+	cyc = open_counter(PERF_EV_CYCLES, PERF_PID_SELF, 0, 0);
+	assert(cyc >= 0 || cyc == -E_BUSY);
+	spin();
+	v1 = read_counter(insn);
+	assert(v1 >= NR_LOOP);
+	yield();
+	spin();
+	v2 = read_counter(insn);
+	assert(v2 >= v1 + NR_LOOP);
+	if (cyc >= 0) {
+		assert(read_counter(cyc) > 0);
+		assert(sys_perf(PERF_CLOSE, cyc, NULL) == 0);
+		assert(sys_perf(PERF_READ, cyc, &v1) == -E_INVAL);
+	}
+	cprintf("perftest self pass.\n");
+
+	if ((pid = fork()) == 0) {
+		sleep(10);
+		spin();
+		exit(0);
+	}
+	assert(pid > 0);
+	assert((id = open_counter(ev, pid, 0, 0)) >= 0);
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	assert(read_counter(id) >= NR_LOOP);
+	assert(sys_perf(PERF_CLOSE, id, NULL) == 0);
+	cprintf("perftest child pass.\n");
+
+	if ((id = open_counter(ev, PERF_PID_CPU, 0, 0)) >= 0) {
+		assert(sys_perf(PERF_CLOSE, id, NULL) == 0);
+	} else {
+		assert(id == -E_BUSY);
+	}
+	assert(open_counter(ev, PERF_PID_CPU, -1, 0) == -E_INVAL);
+	assert(open_counter(PERF_NR_EVENTS, PERF_PID_SELF, 0, 0) == -E_INVAL);
+	if ((id = open_counter(ev, PERF_PID_SELF, 0, 10000)) >= 0) {
+		spin();
+		assert(read_counter(id) >= NR_LOOP);
+		assert(sys_perf(PERF_CLOSE, id, NULL) == 0);
+	} else {
+		assert(id == -E_BUSY);
+	}
+	assert(sys_perf(PERF_CLOSE, insn, NULL) == 0);
+	cprintf("perftest pass.\n");
+	return 0;
+}
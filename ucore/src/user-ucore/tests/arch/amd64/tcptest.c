@@ -0,0 +1,129 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <dir.h>
+#include <unistd.h>
+#include <error.h>
+
+/* *
+ * A server and a client over the loopback: the client connects, the
+ * listener turns readable in epoll, and the server echoes what the client
+ * writes, more than a window of it, then sendfiles a file to it and
+ * closes; the client sees the end of the stream. A connect to a port no
+ * one listens on is refused, and a port bound twice is in use.
+ * */
+#define PORT                5555
+#define DATAFILE            "tcptest.dat"
+#define NR_ECHO             (40 * 1024)
+#define NR_FILE             (3 * 4096 + 100)
+
+static char buf[4096];
+
+static void addr_init(struct sockaddr_in *addr, uint16_t port)
+{
+	memset(addr, 0, sizeof(struct sockaddr_in));
+	addr->sin_family = AF_INET;
+	addr->sin_port = htons(port);
+	addr->sin_addr = htonl(INADDR_LOOPBACK);
+}
+
+static void read_all(int fd, char *p, int len)
+{
+	int n;
+	while (len > 0) {
+		assert((n = read(fd, p, len)) > 0);
+		p += n, len -= n;
+	}
+}
+
+static void client(void)
+{
+	struct sockaddr_in addr;
+	int fd, i, n;
+	addr_init(&addr, PORT);
+	assert((fd = socket(AF_INET, SOCK_STREAM, 0)) >= 0);
+	assert(connect(fd, &addr) == 0);
+	for (i = 0; i < NR_ECHO; i += n) {
+		n = (NR_ECHO - i < sizeof(buf)) ? NR_ECHO - i : sizeof(buf);
+		memset(buf, 'a' + (i / sizeof(buf)) % 26, n);
+		assert(write(fd, buf, n) == n);
+		read_all(fd, buf, n);
+		assert(buf[0] == 'a' + (i / sizeof(buf)) % 26
+		       && buf[n - 1] == buf[0]);
+	}
+	for (i = 0; i < NR_FILE; i += n) {
+		n = (NR_FILE - i < sizeof(buf)) ? NR_FILE - i : sizeof(buf);
+		read_all(fd, buf, n);
+		assert(buf[0] == '0' + (i / sizeof(buf)) % 10);
+	}
+	assert(read(fd, buf, sizeof(buf)) == 0);
+	close(fd);
+	exit(0);
+}
+
+static int make_file(void)
+{
+	int fd, i, n;
+	assert((fd = open(DATAFILE, O_CREAT | O_RDWR | O_TRUNC)) >= 0);
+	for (i = 0; i < NR_FILE; i += n) {
+		n = (NR_FILE - i < sizeof(buf)) ? NR_FILE - i : sizeof(buf);
+		memset(buf, '0' + (i / sizeof(buf)) % 10, n);
+		assert(write(fd, buf, n) == n);
+	}
+	assert(seek(fd, 0, LSEEK_SET) == 0);
+	return fd;
+}
+
+int main(void)
+{
+	struct sockaddr_in addr, peer;
+	struct epoll_event ev, events[1];
+	int s, s2, ep, conn, file, pid, exit_code, i, n;
+	if ((s = socket(AF_INET, SOCK_STREAM, 0)) == -E_UNIMP) {
+		cprintf("tcptest pass.\n");
+		return 0;
+	}
+	assert(s >= 0);
+	addr_init(&addr, PORT);
+	assert(bind(s, &addr) == 0 && listen(s, 4) == 0);
+	assert((s2 = socket(AF_INET, SOCK_STREAM, 0)) >= 0);
+	assert(bind(s2, &addr) == -E_ADDRINUSE);
+	addr_init(&addr, PORT + 1);
+	assert(connect(s2, &addr) == -E_CONNREFUSED);
+	close(s2);
+	cprintf("tcptest refused pass.\n");
+
+	assert((ep = epoll_create()) >= 0);
+	ev.events = EPOLLIN, ev.data = s;
+	assert(epoll_ctl(ep, EPOLL_CTL_ADD, EPOLL_SRC_FD, s, &ev) == 0);
+	assert(epoll_wait(ep, events, 1, 10) == -E_TIMEOUT);
+	if ((pid = fork()) == 0) {
+		client();
+	}
+	assert(pid > 0);
+	assert(epoll_wait(ep, events, 1, 1000) == 1 && events[0].data == s);
+	assert((conn = accept(s, &peer)) >= 0);
+	assert(peer.sin_family == AF_INET
+	       && peer.sin_addr == htonl(INADDR_LOOPBACK));
+	close(ep);
+
+	for (i = 0; i < NR_ECHO; i += n) {
+		assert((n = read(conn, buf, sizeof(buf))) > 0);
+		assert(write(conn, buf, n) == n);
+	}
+	cprintf("tcptest echo pass.\n");
+
+	file = make_file();
+	for (i = 0; i < NR_FILE; i += n) {
+		assert((n = sendfile(conn, file, NULL, NR_FILE - i)) > 0);
+	}
+	close(file), close(conn);
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	cprintf("tcptest sendfile pass.\n");
+
+	close(s);
+	unlink(DATAFILE);
+	cprintf("tcptest pass.\n");
+	return 0;
+}
@@ -0,0 +1,57 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <error.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <sysbatch.h>
+
+static const char *path = "/testbin/batchtest";
+
+int main(void)
+{
+	struct syscall_rec recs[4];
+	char magic[4];
+	memset(recs, 0, sizeof(recs));
+
+	/* open, read and close in one entry, the fd by reference */
+	recs[0].num = SYS_open;
+	recs[0].args[0] = (uintptr_t) path;
+	recs[0].args[1] = O_RDONLY;
+	recs[1].num = SYS_read;
+	recs[1].ref = SYSBATCH_REF(0);
+	recs[1].args[0] = 0;
+	recs[1].args[1] = (uintptr_t) magic;
+	recs[1].args[2] = sizeof(magic);
+	recs[2].num = SYS_close;
+	recs[2].ref = SYSBATCH_REF(0);
+	recs[2].args[0] = 0;
+	recs[3].num = SYS_getpid;
+	assert(sys_batch(recs, 4) == 4);
+	assert((int)recs[0].ret >= 0);
+	assert((int)recs[1].ret == sizeof(magic));
+	assert(memcmp(magic, "\177ELF", 4) == 0);
+	assert((int)recs[2].ret == 0);
+	assert((int)recs[3].ret == getpid());
+	cprintf("batchtest chain pass.\n");
+
+	/* stops after the first that fails */
+	recs[0].args[0] = (uintptr_t) "/testbin/no such file";
+	recs[3].ret = 0;
+	assert(sys_batch(recs, 4) == 1);
+	assert((int)recs[0].ret < 0);
+	assert(recs[3].ret == 0);
+
+	/* neither fork nor a reference forward may be batched */
+	recs[0].num = SYS_fork;
+	assert(sys_batch(recs, 1) == 1 && (int)recs[0].ret == -E_INVAL);
+	recs[0].num = SYS_close;
+	recs[0].ref = SYSBATCH_REF(0);
+	recs[0].args[0] = 0;
+	assert(sys_batch(recs, 1) == 1 && (int)recs[0].ret == -E_INVAL);
+	assert(sys_batch(recs, SYSBATCH_MAX + 1) == -E_INVAL);
+	cprintf("batchtest error pass.\n");
+
+	cprintf("batchtest pass.\n");
+	return 0;
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <string.h>
+#include <file.h>
+#include <dir.h>
+#include <unistd.h>
+#include <error.h>
+
+/* whole blocks and a tail, so both paths of sfs_io_nolock are taken */
+#define FILESIZE        (3 * 4096 + 100)
+
+static char buf[FILESIZE], buf2[FILESIZE];
+
+static void check_file(int fd, off_t pos, const char *data, size_t len)
+{
+	size_t n = 0;
+	assert(seek(fd, pos, LSEEK_SET) == 0);
+	while (n < len) {
+		int ret = read(fd, buf2 + n, len - n);
+		assert(ret > 0);
+		n += ret;
+	}
+	assert(memcmp(buf2, data, len) == 0);
+}
+
+static int make_source(void)
+{
+	int fd, i;
+	for (i = 0; i < FILESIZE; i++) {
+		buf[i] = (char)(i * 7);
+	}
+	assert((fd = open("src", O_CREAT | O_RDWR | O_TRUNC)) >= 0);
+	assert(write(fd, buf, FILESIZE) == FILESIZE);
+	assert(seek(fd, 0, LSEEK_SET) == 0);
+	return fd;
+}
+
+static void test_copy(int src)
+{
+	int dst, n, len = 0;
+	assert((dst = open("dst", O_CREAT | O_RDWR | O_TRUNC)) >= 0);
+	/* at the positions, which move on */
+	while ((n = copy_file_range(src, NULL, dst, NULL, 4096 + 1)) > 0) {
+		len += n;
+	}
+	assert(n == 0 && len == FILESIZE);
+	check_file(dst, 0, buf, FILESIZE);
+
+	/* at offsets, the positions stay */
+	off_t off_in = 100, off_out = FILESIZE + 100;
+	assert(seek(src, 0, LSEEK_SET) == 0);
+	assert(copy_file_range(src, &off_in, dst, &off_out, 5000) == 5000);
+	assert(off_in == 5100 && off_out == FILESIZE + 5100);
+	assert(copy_file_range(src, NULL, dst, NULL, 10) == 10);
+	check_file(dst, FILESIZE, buf, 10);
+	check_file(dst, FILESIZE + 100, buf + 100, 5000);
+
+	/* within one file, not onto itself */
+	off_in = 0, off_out = 50;
+	assert(copy_file_range(dst, &off_in, dst, &off_out, 100) == -E_INVAL);
+	off_out = 2 * FILESIZE;
+	assert(copy_file_range(dst, &off_in, dst, &off_out, 100) == 100);
+	check_file(dst, 2 * FILESIZE, buf, 100);
+	close(dst);
+	assert(unlink("dst") == 0);
+	cprintf("copyfiletest copy_file_range pass.\n");
+}
+
+static void test_sendfile(int src)
+{
+	int fd[2];
+	off_t off = 4000;
+	assert(pipe(fd) == 0);
+	assert(sendfile(fd[1], src, &off, 200) == 200 && off == 4200);
+	assert(read(fd[0], buf2, sizeof(buf2)) == 200);
+	assert(memcmp(buf2, buf + 4000, 200) == 0);
+	/* a pipe has no offset, and is no source */
+	assert(copy_file_range(src, NULL, fd[1], &off, 10) == -E_INVAL);
+	assert(sendfile(src, fd[0], NULL, 10) == -E_INVAL);
+	close(fd[0]), close(fd[1]);
+
+	const char *msg = "sendfile to stdout ok.\n";
+	off = 0;
+	assert(seek(src, 0, LSEEK_SET) == 0);
+	assert(write(src, (void *)msg, strlen(msg)) == strlen(msg));
+	assert(sendfile(1, src, &off, strlen(msg)) == strlen(msg));
+	cprintf("copyfiletest sendfile pass.\n");
+}
+
+int main(void)
+{
+	int src;
+	assert(chdir("/testdir/test") == 0);
+	src = make_source();
+	test_copy(src);
+	test_sendfile(src);
+	close(src);
+	assert(unlink("src") == 0);
+	cprintf("copyfiletest pass.\n");
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <cpugroup.h>
+#include <error.h>
+
+/* *
+ * A child spinning in a cpu group of QUOTA ticks every PERIOD is held to
+ * that share of the time: the ticks it runs are accounted to the group,
+ * which is throttled every period. Then the rules of the groups: nesting,
+ * shares, destroying and attaching.
+ * */
+#define QUOTA               2
+#define PERIOD              10
+#define NR_TICKS            100
+
+static void child(int id)
+{
+	volatile int spin = 0;
+	assert(cpucg_attach(id, 0) == 0);
+	while (1) {
+		spin++;
+	}
+}
+
+int main(void)
+{
+	struct cpucg_stat stat;
+	int id, parent, pid, exit_code;
+	unsigned int start, ticks;
+	if ((id = cpucg_create(0, 0)) == -E_UNIMP) {
+		cprintf("cpucgtest pass.\n");
+		return 0;
+	}
+	assert(id > 0);
+	assert(cpucg_stat(id, &stat) == 0 && stat.usage == 0
+	       && stat.shares == CPUCG_SHARES_DEFAULT && stat.quota == 0);
+	assert(cpucg_set_quota(id, QUOTA, PERIOD) == 0);
+
+	/* held to QUOTA ticks of each PERIOD */
+	if ((pid = fork()) == 0) {
+		child(id);
+	}
+	assert(pid > 0);
+	start = gettime_msec();
+	sleep(NR_TICKS);
+	assert(cpucg_stat(id, &stat) == 0);
+	ticks = (gettime_msec() - start) / 10;
+	assert(kill(pid) == 0 && waitpid(pid, &exit_code) == 0);
+	cprintf("cpucg: usage %d in %d ticks, throttled %d times for %d\n",
+		(int)stat.usage, ticks, (int)stat.nr_throttled,
+		(int)stat.throttled_time);
+	assert(stat.usage > 0 && stat.nr_throttled > 0
+	       && stat.throttled_time > 0);
+	assert(stat.usage <= (ticks / PERIOD + 2) * (QUOTA + 1));
+
+	/* a group with a child or a proc in it stays */
+	assert((parent = cpucg_create(0, 2 * CPUCG_SHARES_DEFAULT)) > 0);
+	int sub = cpucg_create(parent, 0);
+	assert(sub > 0 && cpucg_destroy(parent) == -E_BUSY);
+	assert(cpucg_set_shares(sub, CPUCG_SHARES_DEFAULT / 2) == 0);
+	assert(cpucg_attach(sub, 0) == 0 && cpucg_destroy(sub) == -E_BUSY);
+	assert(cpucg_stat(sub, &stat) == 0
+	       && stat.shares == CPUCG_SHARES_DEFAULT / 2);
+	assert(cpucg_attach(0, 0) == 0);
+	assert(cpucg_destroy(sub) == 0 && cpucg_destroy(parent) == 0);
+
+	/* the bad ones */
+	assert(cpucg_destroy(sub) == -E_INVAL);
+	assert(cpucg_stat(sub, &stat) == -E_INVAL);
+	assert(cpucg_create(sub, 0) == -E_INVAL);
+	assert(cpucg_attach(sub, 0) == -E_INVAL);
+	assert(cpucg_create(0, 1) == -E_INVAL);
+	assert(cpucg_set_shares(id, CPUCG_SHARES_MAX + 1) == -E_INVAL);
+	assert(cpucg_destroy(id) == 0);
+	cprintf("cpucgtest pass.\n");
+	return 0;
+}
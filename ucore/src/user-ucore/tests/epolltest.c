@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <string.h>
+#include <file.h>
+#include <mboxbuf.h>
+#include <error.h>
+
+#define NPIPES          32
+
+static char buf[64];
+
+static void test_level(void)
+{
+	struct epoll_event ev, events[4];
+	int ep, fd[2];
+	assert((ep = epoll_create()) >= 0 && pipe(fd) == 0);
+	ev.events = EPOLLIN, ev.data = 7;
+	assert(epoll_ctl(ep, EPOLL_CTL_ADD, EPOLL_SRC_FD, fd[0], &ev) == 0);
+	assert(epoll_ctl(ep, EPOLL_CTL_ADD, EPOLL_SRC_FD, fd[0], &ev) ==
+	       -E_EXISTS);
+	assert(epoll_wait(ep, events, 4, 10) == -E_TIMEOUT);
+
+	assert(write(fd[1], "ab", 2) == 2);
+	assert(epoll_wait(ep, events, 4, 0) == 1);
+	assert(events[0].events == EPOLLIN && events[0].data == 7);
+	/* still readable */
+	assert(epoll_wait(ep, events, 4, 0) == 1);
+	assert(read(fd[0], buf, sizeof(buf)) == 2);
+	assert(epoll_wait(ep, events, 4, 10) == -E_TIMEOUT);
+
+	close(fd[1]);
+	assert(epoll_wait(ep, events, 4, 0) == 1);
+	assert(events[0].events & EPOLLHUP);
+	assert(epoll_ctl(ep, EPOLL_CTL_DEL, EPOLL_SRC_FD, fd[0], NULL) == 0);
+	assert(epoll_ctl(ep, EPOLL_CTL_DEL, EPOLL_SRC_FD, fd[0], NULL) ==
+	       -E_NOENT);
+	close(fd[0]), close(ep);
+	cprintf("epolltest level pass.\n");
+}
+
+static void test_edge(void)
+{
+	struct epoll_event ev, events[4];
+	int ep, fd[2];
+	assert((ep = epoll_create()) >= 0 && pipe(fd) == 0);
+	ev.events = EPOLLIN | EPOLLET, ev.data = 1;
+	assert(epoll_ctl(ep, EPOLL_CTL_ADD, EPOLL_SRC_FD, fd[0], &ev) == 0);
+	assert(write(fd[1], "a", 1) == 1);
+	assert(epoll_wait(ep, events, 4, 0) == 1);
+	/* reported once until more data comes */
+	assert(epoll_wait(ep, events, 4, 10) == -E_TIMEOUT);
+	assert(write(fd[1], "b", 1) == 1);
+	assert(epoll_wait(ep, events, 4, 0) == 1);
+	close(fd[0]), close(fd[1]), close(ep);
+	cprintf("epolltest edge pass.\n");
+}
+
+static void test_many(void)
+{
+	struct epoll_event ev, events[NPIPES];
+	int ep, fd[NPIPES][2], i, pid;
+	assert((ep = epoll_create()) >= 0);
+	for (i = 0; i < NPIPES; i++) {
+		assert(pipe(fd[i]) == 0);
+		ev.events = EPOLLIN, ev.data = i;
+		assert(epoll_ctl(ep, EPOLL_CTL_ADD, EPOLL_SRC_FD, fd[i][0], &ev)
+		       == 0);
+	}
+	if ((pid = fork()) == 0) {
+		sleep(10);
+		assert(write(fd[NPIPES / 2][1], "x", 1) == 1);
+		exit(0);
+	}
+	assert(pid > 0);
+	assert(epoll_wait(ep, events, NPIPES, 0) == 1);
+	assert(events[0].data == NPIPES / 2);
+	assert(waitpid(pid, NULL) == 0);
+	for (i = 0; i < NPIPES; i++) {
+		close(fd[i][0]), close(fd[i][1]);
+	}
+	close(ep);
+	cprintf("epolltest many pass.\n");
+}
+
+static void test_mbox(void)
+{
+	struct epoll_event ev, events[4];
+	struct mboxbuf mbuf;
+	int ep, id;
+	assert((ep = epoll_create()) >= 0 && (id = mbox_init(1)) >= 0);
+	ev.events = EPOLLIN | EPOLLOUT, ev.data = id;
+	assert(epoll_ctl(ep, EPOLL_CTL_ADD, EPOLL_SRC_MBOX, id, &ev) == 0);
+	assert(epoll_wait(ep, events, 4, 0) == 1
+	       && events[0].events == EPOLLOUT);
+	mbuf.data = buf, mbuf.len = mbuf.size = sizeof(buf);
+	assert(mbox_send(id, &mbuf) == 0);
+	assert(epoll_wait(ep, events, 4, 0) == 1
+	       && events[0].events == EPOLLIN);
+	assert(mbox_free(id) == 0);
+	assert(epoll_wait(ep, events, 4, 0) == 1
+	       && (events[0].events & EPOLLHUP));
+	close(ep);
+	cprintf("epolltest mbox pass.\n");
+}
+
+int main(void)
+{
+	test_level();
+	test_edge();
+	test_many();
+	test_mbox();
+	cprintf("epolltest pass.\n");
+	return 0;
+}
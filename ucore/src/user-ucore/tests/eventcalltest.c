@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <error.h>
+
+#define NR_CALLS        1000
+
+// server - reply to each event with event + 1, until it gets -1
+static void server(void)
+{
+	int pid, event;
+	while (recv_event(&pid, &event) == 0) {
+		if (event == -1) {
+			exit(0);
+		}
+		assert(send_event(pid, event + 1) == 0);
+	}
+	panic("FAIL: server recv\n");
+}
+
+static void test_roundtrip(void)
+{
+	int pid, i, reply;
+	if ((pid = fork()) == 0) {
+		server();
+	}
+	assert(pid > 0);
+	for (i = 0; i < NR_CALLS; i++) {
+		assert(call_event(pid, i, &reply) == 0 && reply == i + 1);
+	}
+	assert(send_event(pid, -1) == 0);
+	assert(waitpid(pid, NULL) == 0);
+	cprintf("eventcalltest roundtrip pass.\n");
+}
+
+// test_closed - the reply of a call is taken from the callee only, the
+//             - events of the others wait for a later receive
+static void test_closed(void)
+{
+	int parent = getpid(), srv, other, pid, event, reply;
+	if ((srv = fork()) == 0) {
+		/* answer once the other has sent to the parent */
+		assert(recv_event(&pid, &event) == 0 && pid == parent);
+		sleep(20);
+		assert(send_event(pid, event + 1) == 0);
+		exit(0);
+	}
+	if ((other = fork()) == 0) {
+		assert(send_event(parent, 0xbee) == 0);
+		exit(0);
+	}
+	assert(srv > 0 && other > 0);
+	assert(call_event(srv, 41, &reply) == 0 && reply == 42);
+	assert(recv_event(&pid, &event) == 0);
+	assert(pid == other && event == 0xbee);
+	assert(waitpid(srv, NULL) == 0 && waitpid(other, NULL) == 0);
+	cprintf("eventcalltest closed pass.\n");
+}
+
+static void test_timeout(void)
+{
+	int pid, reply;
+	if ((pid = fork()) == 0) {
+		int event;
+		/* take the event but never reply */
+		recv_event(NULL, &event);
+		while (1) ;
+	}
+	assert(pid > 0);
+	assert(call_event_timeout(pid, 1, &reply, 50) == -E_TIMEOUT);
+	assert(call_event(getpid(), 1, &reply) == -E_INVAL);
+	assert(call_event(pid, 1, NULL) == -E_INVAL);
+	kill(pid);
+	assert(waitpid(pid, NULL) == 0);
+	cprintf("eventcalltest timeout pass.\n");
+}
+
+int main(void)
+{
+	test_roundtrip();
+	test_closed();
+	test_timeout();
+	cprintf("eventcalltest pass.\n");
+	return 0;
+}
@@ -0,0 +1,100 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <dir.h>
+#include <stat.h>
+#include <unistd.h>
+#include <error.h>
+
+#define BLKSIZE         4096
+#define NBLKS           10
+
+static char buf[BLKSIZE];
+
+static void check_stat(int fd, off_t size, size_t blocks)
+{
+	struct stat stat;
+	assert(fstat(fd, &stat) == 0);
+	assert(stat.st_size == size && stat.st_blocks == blocks);
+}
+
+static void check_zeros(int fd, off_t pos, size_t len)
+{
+	int i, n;
+	assert(seek(fd, pos, LSEEK_SET) == 0);
+	while (len != 0) {
+		n = read(fd, buf, (len < BLKSIZE) ? len : BLKSIZE);
+		assert(n > 0);
+		for (i = 0; i < n; i++) {
+			assert(buf[i] == 0);
+		}
+		len -= n;
+	}
+}
+
+static void test_extend(void)
+{
+	int fd;
+	assert((fd = open("falloc", O_CREAT | O_RDWR | O_TRUNC)) >= 0);
+	assert(fallocate(fd, 0, 0, NBLKS * BLKSIZE) == 0);
+	check_stat(fd, NBLKS * BLKSIZE, NBLKS);
+	check_zeros(fd, 0, NBLKS * BLKSIZE);
+	/* within the blocks there already, nothing changes */
+	assert(fallocate(fd, 0, BLKSIZE, 100) == 0);
+	check_stat(fd, NBLKS * BLKSIZE, NBLKS);
+	close(fd);
+	/* a shrink gives the blocks back */
+	assert((fd = open("falloc", O_RDWR | O_TRUNC)) >= 0);
+	check_stat(fd, 0, 0);
+	close(fd);
+	cprintf("fallocatetest extend pass.\n");
+}
+
+static void test_keep_size(void)
+{
+	int fd;
+	memset(buf, 'a', 100);
+	assert((fd = open("falloc", O_CREAT | O_RDWR | O_TRUNC)) >= 0);
+	assert(write(fd, buf, 100) == 100);
+	assert(fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, NBLKS * BLKSIZE) == 0);
+	check_stat(fd, 100, NBLKS);
+	/* the writes after go to the blocks allocated */
+	memset(buf, 'b', 100);
+	assert(seek(fd, 5000, LSEEK_SET) == 0);
+	assert(write(fd, buf, 100) == 100);
+	check_stat(fd, 5100, NBLKS);
+	check_zeros(fd, 100, 4900);
+	/* a seek past the end keeps them too */
+	assert(seek(fd, 3 * BLKSIZE, LSEEK_SET) == 0);
+	check_stat(fd, 3 * BLKSIZE, NBLKS);
+	check_zeros(fd, 5100, 3 * BLKSIZE - 5100);
+	close(fd);
+	assert(unlink("falloc") == 0);
+	cprintf("fallocatetest keep size pass.\n");
+}
+
+static void test_errors(void)
+{
+	int fd;
+	assert((fd = open("falloc", O_CREAT | O_RDWR | O_TRUNC)) >= 0);
+	assert(fallocate(fd, 0, 0, 0) == -E_INVAL);
+	assert(fallocate(fd, 0, -1, 10) == -E_INVAL);
+	assert(fallocate(fd, 4, 0, 10) == -E_INVAL);
+	close(fd);
+	assert((fd = open("falloc", O_RDONLY)) >= 0);
+	assert(fallocate(fd, 0, 0, 10) == -E_INVAL);
+	close(fd);
+	assert(unlink("falloc") == 0);
+	cprintf("fallocatetest errors pass.\n");
+}
+
+int main(void)
+{
+	assert(chdir("/testdir/test") == 0);
+	test_extend();
+	test_keep_size();
+	test_errors();
+	cprintf("fallocatetest pass.\n");
+	return 0;
+}
@@ -0,0 +1,51 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+
+#define NPIPES                      40
+
+static const char *path = "/testbin/fdtabletest";
+
+int main(void)
+{
+	int fds[NPIPES][2], i;
+
+	/* twice the fds of a new table, which grows for them */
+	for (i = 0; i < NPIPES; i++) {
+		assert(pipe(fds[i]) == 0);
+	}
+	for (i = 0; i < NPIPES; i++) {
+		assert(write(fds[i][1], &i, sizeof(int)) == sizeof(int));
+	}
+	for (i = 0; i < NPIPES; i++) {
+		int j;
+		assert(read(fds[i][0], &j, sizeof(int)) == sizeof(int) && j == i);
+	}
+	/* the lowest free fd is taken first */
+	int fd = fds[NPIPES / 2][0];
+	assert(close(fd) == 0);
+	assert(dup(fds[0][0]) == fd);
+	assert(dup2(fds[0][0], 1000) == 1000);
+	for (i = 0; i < NPIPES; i++) {
+		close(fds[i][0]), close(fds[i][1]);
+	}
+	assert(close(1000) == 0 && close(1000) != 0);
+	cprintf("fdtabletest grow pass.\n");
+
+	/* a dup'd fd shares the position */
+	char buf[4];
+	assert((fd = open(path, O_RDONLY)) >= 0);
+	int fd2 = dup(fd);
+	assert(fd2 >= 0);
+	assert(read(fd, buf, 4) == 4 && memcmp(buf, "\177ELF", 4) == 0);
+	assert(read(fd2, buf, 4) == 4 && memcmp(buf, "\177ELF", 4) != 0);
+	assert(close(fd) == 0);
+	assert(read(fd2, buf, 4) == 4);
+	assert(close(fd2) == 0);
+	cprintf("fdtabletest dup pass.\n");
+
+	cprintf("fdtabletest pass.\n");
+	return 0;
+}
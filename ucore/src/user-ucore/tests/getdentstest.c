@@ -0,0 +1,139 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <dir.h>
+#include <unistd.h>
+
+#define printf(...)                 fprintf(1, __VA_ARGS__)
+
+#define NR_FILES                    100
+/* a few records per call, so that the listing resumes many times */
+#define SMALL_BUF                   128
+
+static char *name(int i)
+{
+	static char buffer[32];
+	snprintf(buffer, sizeof(buffer), "dent%d", i);
+	return buffer;
+}
+
+static bool seen[NR_FILES];
+static int nr_dots;
+
+// see - count the entry of d_name; false if it was seen before
+static bool see(const char *d_name)
+{
+	int i;
+	if (strcmp(d_name, ".") == 0 || strcmp(d_name, "..") == 0) {
+		nr_dots++;
+		return 1;
+	}
+	assert(strncmp(d_name, "dent", 4) == 0);
+	i = strtol(d_name + 4, NULL, 10);
+	assert(i >= 0 && i < NR_FILES);
+	if (seen[i]) {
+		return 0;
+	}
+	seen[i] = 1;
+	return 1;
+}
+
+// list - all the entries of fd from its cursor on; # of records read.
+//      - unlink_unseen removes the files not seen yet halfway through
+static int list(int fd, bool unlink_unseen)
+{
+	static char buf[SMALL_BUF];
+	int ret, nr = 0, pos, i;
+	memset(seen, 0, sizeof(seen));
+	nr_dots = 0;
+	while ((ret = getdents(fd, (struct dirent64 *)buf, sizeof(buf))) > 0) {
+		for (pos = 0; pos < ret;) {
+			struct dirent64 *d = (struct dirent64 *)(buf + pos);
+			assert(d->d_reclen != 0 && pos + d->d_reclen <= ret);
+			assert(see(d->d_name));
+			pos += d->d_reclen, nr++;
+		}
+		if (unlink_unseen && nr >= NR_FILES / 2) {
+			for (i = 0; i < NR_FILES; i++) {
+				if (!seen[i] && i % 2 == 0) {
+					assert(unlink(name(i)) == 0);
+				}
+			}
+			unlink_unseen = 0;
+		}
+	}
+	assert(ret == 0);
+	return nr;
+}
+
+int main(void)
+{
+	static char buf[SMALL_BUF];
+	int i, ret, fd, nr;
+
+	ret = mkdir("/testdir/test/dents");
+	assert(ret == 0);
+	ret = chdir("/testdir/test/dents");
+	assert(ret == 0);
+
+	for (i = 0; i < NR_FILES; i++) {
+		fd = open(name(i), O_CREAT | O_RDWR | O_EXCL);
+		assert(fd >= 0);
+		close(fd);
+	}
+
+	fd = open(".", O_RDONLY);
+	assert(fd >= 0);
+	nr = list(fd, 0);
+	assert(nr == NR_FILES + 2 && nr_dots == 2);
+	for (i = 0; i < NR_FILES; i++) {
+		assert(seen[i]);
+	}
+	printf("listed %d entries\n", nr);
+
+	/* the cursor of a record takes the listing back after it */
+	ret = seek(fd, 0, LSEEK_SET);
+	assert(ret == 0);
+	ret = getdents(fd, (struct dirent64 *)buf, sizeof(buf));
+	assert(ret > 0);
+	struct dirent64 *d = (struct dirent64 *)buf;
+	ret = seek(fd, d->d_off, LSEEK_SET);
+	assert(ret == 0);
+	nr = list(fd, 0);
+	assert(nr == NR_FILES + 1);
+	printf("resumed at a cursor\n");
+
+	/* the entries removed meanwhile shift none of the others */
+	ret = seek(fd, 0, LSEEK_SET);
+	assert(ret == 0);
+	nr = list(fd, 1);
+	assert(nr_dots == 2);
+	for (i = 1; i < NR_FILES; i += 2) {
+		assert(seen[i]);
+	}
+	close(fd);
+
+	DIR *dirp = opendir(".");
+	assert(dirp != NULL);
+	nr = 0;
+	while (readdir(dirp) != NULL) {
+		nr++;
+	}
+	closedir(dirp);
+	for (i = 0; i < NR_FILES; i++) {
+		if (unlink(name(i)) == 0) {
+			nr--;
+		}
+	}
+	assert(nr == 2);
+	printf("removed while listing\n");
+
+	ret = chdir("/testdir/test");
+	assert(ret == 0);
+	ret = unlink("dents");
+	assert(ret == 0);
+
+	printf("getdentstest pass.\n");
+	return 0;
+}
@@ -0,0 +1,304 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stat.h>
+#include <file.h>
+#include <dir.h>
+#include <unistd.h>
+#include <mboxbuf.h>
+#include <arch.h>
+#ifdef ARCH_ARM
+#include <div64.h>
+#endif
+
+#define printf(...)                     fprintf(1, __VA_ARGS__)
+
+/* *
+ * The microbenchmarks of the hot paths of the kernel. Each prints one line
+ *     bench <name> <ops> <total> <per op> <unit>
+ * which uCore_test collects, with the commit, into bench.log of the build
+ * dir. The unit is tsc cycles on x86; arm has no cycle counter readable
+ * from user mode and reports microseconds of gettime_msec instead.
+ * */
+#define NR_SYSCALLS                     100000
+#define NR_EXECS                        50
+#define NR_SWITCHES                     5000
+#define NR_MSGS                         5000
+#define MSG_BYTES                       64
+#define NR_FAULT_PAGES                  1024
+#define NR_MMAPS                        2000
+#define NR_FILES                        100
+#define NR_FILE_BLOCKS                  64
+
+#define PGSIZE                          4096
+#define FILE_DIR                        "/testdir/test"
+
+#if defined(ARCH_X86) || defined(ARCH_AMD64)
+#define BENCH_UNIT                      "cycles"
+static inline uint64_t bench_now(void)
+{
+	uint32_t lo, hi;
+	asm volatile ("rdtsc":"=a" (lo), "=d"(hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+#else
+#define BENCH_UNIT                      "us"
+static inline uint64_t bench_now(void)
+{
+	return (uint64_t) gettime_msec() * 1000;
+}
+#endif
+
+static char msg[MSG_BYTES];
+static char block[PGSIZE];
+
+static void report(const char *name, uint32_t ops, uint64_t total)
+{
+	uint64_t per_op = total;
+	do_div(per_op, ops);
+	printf("bench %s %u %llu %llu %s\n", name, ops, total, per_op,
+	       BENCH_UNIT);
+}
+
+static void wait_child(int pid)
+{
+	int exit_code;
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+}
+
+static void bench_null_syscall(void)
+{
+	int i;
+	uint64_t start = bench_now();
+	for (i = 0; i < NR_SYSCALLS; i++) {
+		getpid();
+	}
+	report("null_syscall", NR_SYSCALLS, bench_now() - start);
+}
+
+static void bench_fork_exec_wait(void)
+{
+	int i, pid;
+	uint64_t start = bench_now();
+	for (i = 0; i < NR_EXECS; i++) {
+		if ((pid = fork()) == 0) {
+			exec("/testbin/kbench", "exit");
+			exit(-1);
+		}
+		assert(pid > 0);
+		wait_child(pid);
+	}
+	report("fork_exec_wait", NR_EXECS, bench_now() - start);
+}
+
+// bench_sem_pingpong - a round trip is two switches, posting the other side
+static void bench_sem_pingpong(void)
+{
+	sem_t ping = sem_init(0), pong = sem_init(0);
+	int i, pid;
+	assert(ping > 0 && pong > 0);
+	if ((pid = fork()) == 0) {
+		for (i = 0; i < NR_SWITCHES; i++) {
+			assert(sem_wait(ping) == 0);
+			assert(sem_post(pong) == 0);
+		}
+		exit(0);
+	}
+	assert(pid > 0);
+	uint64_t start = bench_now();
+	for (i = 0; i < NR_SWITCHES; i++) {
+		assert(sem_post(ping) == 0);
+		assert(sem_wait(pong) == 0);
+	}
+	uint64_t total = bench_now() - start;
+	wait_child(pid);
+	assert(sem_free(ping) == 0 && sem_free(pong) == 0);
+	report("sem_pingpong", NR_SWITCHES * 2, total);
+}
+
+static void bench_event_pingpong(void)
+{
+	int i, pid, from, event;
+	int parent = getpid();
+	if ((pid = fork()) == 0) {
+		for (i = 0; i < NR_SWITCHES; i++) {
+			assert(recv_event(&from, &event) == 0 && event == i);
+			assert(send_event(parent, i) == 0);
+		}
+		exit(0);
+	}
+	assert(pid > 0);
+	uint64_t start = bench_now();
+	for (i = 0; i < NR_SWITCHES; i++) {
+		assert(send_event(pid, i) == 0);
+		assert(recv_event(&from, &event) == 0 && from == pid
+		       && event == i);
+	}
+	uint64_t total = bench_now() - start;
+	wait_child(pid);
+	report("event_pingpong", NR_SWITCHES * 2, total);
+}
+
+// bench_pipe - the throughput of a stream, then the latency of a round trip
+static void bench_pipe(void)
+{
+	int to[2], from[2], i, pid, n, len;
+	assert(pipe(to) == 0 && pipe(from) == 0);
+	if ((pid = fork()) == 0) {
+		close(to[1]), close(from[0]);
+		for (i = 0; i < NR_MSGS; i++) {
+			for (len = 0; len < MSG_BYTES; len += n) {
+				assert((n = read(to[0], msg + len,
+						 MSG_BYTES - len)) > 0);
+			}
+		}
+		for (i = 0; i < NR_SWITCHES; i++) {
+			assert(read(to[0], msg, 1) == 1);
+			assert(write(from[1], msg, 1) == 1);
+		}
+		exit(0);
+	}
+	assert(pid > 0);
+	close(to[0]), close(from[1]);
+	uint64_t start = bench_now();
+	for (i = 0; i < NR_MSGS; i++) {
+		assert(write(to[1], msg, MSG_BYTES) == MSG_BYTES);
+	}
+	report("pipe_throughput", NR_MSGS, bench_now() - start);
+	start = bench_now();
+	for (i = 0; i < NR_SWITCHES; i++) {
+		assert(write(to[1], msg, 1) == 1);
+		assert(read(from[0], msg, 1) == 1);
+	}
+	report("pipe_latency", NR_SWITCHES, bench_now() - start);
+	close(to[1]), close(from[0]);
+	wait_child(pid);
+}
+
+static void bench_mbox(void)
+{
+	int to = mbox_init(64), from = mbox_init(1), i, pid;
+	struct mboxbuf buf;
+	assert(to >= 0 && from >= 0);
+	if ((pid = fork()) == 0) {
+		for (i = 0; i < NR_MSGS + NR_SWITCHES; i++) {
+			buf.data = msg, buf.size = MSG_BYTES;
+			assert(mbox_recv(to, &buf) == 0);
+			if (i >= NR_MSGS) {
+				buf.len = 1;
+				assert(mbox_send(from, &buf) == 0);
+			}
+		}
+		exit(0);
+	}
+	assert(pid > 0);
+	uint64_t start = bench_now();
+	for (i = 0; i < NR_MSGS; i++) {
+		buf.data = msg, buf.len = buf.size = MSG_BYTES;
+		assert(mbox_send(to, &buf) == 0);
+	}
+	report("mbox_throughput", NR_MSGS, bench_now() - start);
+	start = bench_now();
+	for (i = 0; i < NR_SWITCHES; i++) {
+		buf.data = msg, buf.len = buf.size = 1;
+		assert(mbox_send(to, &buf) == 0);
+		buf.size = MSG_BYTES;
+		assert(mbox_recv(from, &buf) == 0 && buf.len == 1);
+	}
+	report("mbox_latency", NR_SWITCHES, bench_now() - start);
+	wait_child(pid);
+	assert(mbox_free(to) == 0 && mbox_free(from) == 0);
+}
+
+// bench_page_fault - the first touch of each page of an anonymous mapping
+static void bench_page_fault(void)
+{
+	uintptr_t addr = 0;
+	int i;
+	assert(mmap(&addr, NR_FAULT_PAGES * PGSIZE, MMAP_WRITE) == 0);
+	uint64_t start = bench_now();
+	for (i = 0; i < NR_FAULT_PAGES; i++) {
+		*(volatile char *)(addr + i * PGSIZE) = (char)i;
+	}
+	report("page_fault", NR_FAULT_PAGES, bench_now() - start);
+	assert(munmap(addr, NR_FAULT_PAGES * PGSIZE) == 0);
+}
+
+static void bench_mmap(void)
+{
+	uintptr_t addr;
+	int i;
+	uint64_t start = bench_now();
+	for (i = 0; i < NR_MMAPS; i++) {
+		addr = 0;
+		assert(mmap(&addr, PGSIZE, MMAP_WRITE) == 0);
+		assert(munmap(addr, PGSIZE) == 0);
+	}
+	report("mmap_munmap", NR_MMAPS, bench_now() - start);
+}
+
+static char *name(int i)
+{
+	static char path[32];
+	snprintf(path, sizeof(path), FILE_DIR "/bench%d", i);
+	return path;
+}
+
+static void bench_sfs(void)
+{
+	struct stat __stat, *stat = &__stat;
+	int i, fd;
+	uint64_t start = bench_now();
+	for (i = 0; i < NR_FILES; i++) {
+		assert((fd = open(name(i), O_CREAT | O_RDWR | O_TRUNC)) >= 0);
+		close(fd);
+	}
+	report("sfs_create", NR_FILES, bench_now() - start);
+
+	start = bench_now();
+	for (i = 0; i < NR_FILES; i++) {
+		assert((fd = open(name(i), O_RDONLY)) >= 0);
+		assert(fstat(fd, stat) == 0);
+		close(fd);
+	}
+	report("sfs_open_stat", NR_FILES, bench_now() - start);
+
+	memset(block, 0x5a, PGSIZE);
+	assert((fd = open(name(0), O_RDWR)) >= 0);
+	start = bench_now();
+	for (i = 0; i < NR_FILE_BLOCKS; i++) {
+		assert(write(fd, block, PGSIZE) == PGSIZE);
+	}
+	assert(fsync(fd) == 0);
+	report("sfs_write_4k", NR_FILE_BLOCKS, bench_now() - start);
+
+	assert(seek(fd, 0, LSEEK_SET) == 0);
+	start = bench_now();
+	for (i = 0; i < NR_FILE_BLOCKS; i++) {
+		assert(read(fd, block, PGSIZE) == PGSIZE);
+	}
+	report("sfs_read_4k", NR_FILE_BLOCKS, bench_now() - start);
+	close(fd);
+
+	for (i = 0; i < NR_FILES; i++) {
+		assert(unlink(name(i)) == 0);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc == 2 && strcmp(argv[1], "exit") == 0) {
+		return 0;
+	}
+	bench_null_syscall();
+	bench_fork_exec_wait();
+	bench_sem_pingpong();
+	bench_event_pingpong();
+	bench_pipe();
+	bench_mbox();
+	bench_page_fault();
+	bench_mmap();
+	bench_sfs();
+	printf("kbench pass.\n");
+	return 0;
+}
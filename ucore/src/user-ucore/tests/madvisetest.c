@@ -0,0 +1,85 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <error.h>
+
+/* *
+ * The advice of madvise on anonymous memory: MADV_DONTNEED drops the pages
+ * at once, MADV_FREE leaves each page either as it was or zeroed until it
+ * is written again, and the others keep the contents as they are.
+ * */
+#define NR_PAGES            16
+#define PGSIZE              4096
+
+static void fill(uintptr_t addr, int from, int to)
+{
+	int i;
+	for (i = from; i < to; i++) {
+		*(int *)(addr + i * PGSIZE) = i + 1;
+	}
+}
+
+static void check(uintptr_t addr, int from, int to, bool zeroed)
+{
+	int i;
+	for (i = from; i < to; i++) {
+		assert(*(int *)(addr + i * PGSIZE) == (zeroed ? 0 : i + 1));
+	}
+}
+
+int main(void)
+{
+	uintptr_t addr = 0, shm = 0;
+	size_t len = NR_PAGES * PGSIZE;
+	int i;
+	assert(mmap(&addr, len, MMAP_WRITE) == 0 && addr != 0);
+	fill(addr, 0, NR_PAGES);
+
+	/* the hints keep the contents */
+	assert(madvise(addr, len, MADV_SEQUENTIAL) == 0);
+	assert(madvise(addr, len, MADV_RANDOM) == 0);
+	assert(madvise(addr, len, MADV_WILLNEED) == 0);
+	assert(madvise(addr, len, MADV_NORMAL) == 0);
+	check(addr, 0, NR_PAGES, 0);
+
+	/* the middle is dropped, the touch after finds zeros */
+	assert(madvise(addr + 4 * PGSIZE, 8 * PGSIZE, MADV_DONTNEED) == 0);
+	check(addr, 0, 4, 0);
+	check(addr, 4, 12, 1);
+	check(addr, 12, NR_PAGES, 0);
+
+	/* freed, then one page written again: that one stays */
+	fill(addr, 0, NR_PAGES);
+	assert(madvise(addr, len, MADV_FREE) == 0);
+	*(int *)(addr + 3 * PGSIZE) = -3;
+	for (i = 0; i < NR_PAGES; i++) {
+		int v = *(int *)(addr + i * PGSIZE);
+		assert((i == 3) ? v == -3 : (v == i + 1 || v == 0));
+	}
+
+	/* the bad ones */
+	assert(madvise(addr + 1, PGSIZE, MADV_DONTNEED) == -E_INVAL);
+	assert(madvise(addr, len, 5) == -E_INVAL);
+	assert(munmap(addr + 8 * PGSIZE, PGSIZE) == 0);
+	assert(madvise(addr, len, MADV_WILLNEED) == -E_NO_MEM);
+	assert(shmem(&shm, PGSIZE, MMAP_WRITE) == 0 && shm != 0);
+	assert(madvise(shm, PGSIZE, MADV_FREE) == -E_INVAL);
+	assert(munmap(shm, PGSIZE) == 0);
+	assert(munmap(addr, len) == 0);
+
+	/* malloc hands out the pages of a freed block again */
+	char *p = malloc(32 * 1024), *q;
+	assert(p != NULL);
+	memset(p, 0x5a, 32 * 1024);
+	free(p);
+	assert((q = malloc(32 * 1024)) != NULL);
+	memset(q, 0xa5, 32 * 1024);
+	for (i = 0; i < 32 * 1024; i++) {
+		assert((unsigned char)q[i] == 0xa5);
+	}
+	free(q);
+	cprintf("madvisetest pass.\n");
+	return 0;
+}
@@ -0,0 +1,117 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include <thread.h>
+#include <arch.h>
+#ifdef ARCH_ARM
+#include <div64.h>
+#endif
+
+#define printf(...)                     fprintf(1, __VA_ARGS__)
+
+/* *
+ * malloc and free from 1, 2, 4... threads at once, each keeping a window
+ * of blocks of sizes in turn small, mid-sized and large and checking them
+ * as they are freed. Each point prints
+ *     bench malloc_<threads> <ops> <total> <per op> <unit>
+ * as tests/kbench.c does, the total being the wall time of all threads.
+ * */
+#define MAX_THREADS                     8
+#define NR_OPS                          20000
+#define WINDOW                          64
+
+#if defined(ARCH_X86) || defined(ARCH_AMD64)
+#define BENCH_UNIT                      "cycles"
+static inline uint64_t bench_now(void)
+{
+	uint32_t lo, hi;
+	asm volatile ("rdtsc":"=a" (lo), "=d"(hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+#else
+#define BENCH_UNIT                      "us"
+static inline uint64_t bench_now(void)
+{
+	return (uint64_t) gettime_msec() * 1000;
+}
+#endif
+
+static barrier_t start;
+
+// block_size - mostly small, one in 16 mid-sized, one in 256 large
+static size_t block_size(int i)
+{
+	if (i % 256 == 255) {
+		return 80 * 1024;
+	}
+	if (i % 16 == 15) {
+		return 3000 + i % 1000;
+	}
+	return 8 + (i * 37) % 500;
+}
+
+static int worker(void *arg)
+{
+	int id = (int)(uintptr_t) arg, i;
+	char *window[WINDOW];
+	size_t sizes[WINDOW];
+	memset(window, 0, sizeof(window));
+	barrier_wait(&start);
+	for (i = 0; i < NR_OPS; i++) {
+		int slot = i % WINDOW;
+		if (window[slot] != NULL) {
+			assert(window[slot][0] == (char)id
+			       && window[slot][sizes[slot] - 1] == (char)slot);
+			free(window[slot]);
+		}
+		sizes[slot] = block_size(i);
+		assert((window[slot] = malloc(sizes[slot])) != NULL);
+		window[slot][0] = (char)id;
+		window[slot][sizes[slot] - 1] = (char)slot;
+	}
+	for (i = 0; i < WINDOW; i++) {
+		free(window[i]);
+	}
+	return 0;
+}
+
+static uint64_t run(int n)
+{
+	thread_t tids[MAX_THREADS];
+	int i, exit_code;
+	barrier_init(&start, n + 1);
+	for (i = 0; i < n; i++) {
+		assert(thread(worker, (void *)(uintptr_t) (i + 1), tids + i) == 0);
+	}
+	uint64_t begin = bench_now();
+	barrier_wait(&start);
+	for (i = 0; i < n; i++) {
+		assert(thread_wait(tids + i, &exit_code) == 0 && exit_code == 0);
+	}
+	return bench_now() - begin;
+}
+
+int main(void)
+{
+	char name[32];
+	int n;
+	/* free(NULL) and the sizes at the edges of each part */
+	free(NULL);
+	size_t edges[] = { 0, 1, 16, 17, 2048, 2049, 65535, 65536 };
+	for (n = 0; n < sizeof(edges) / sizeof(edges[0]); n++) {
+		char *p = malloc(edges[n]);
+		assert(p != NULL && ((uintptr_t) p & 15) == 0);
+		memset(p, 0x5a, edges[n]);
+		free(p);
+	}
+	for (n = 1; n <= MAX_THREADS; n <<= 1) {
+		uint64_t total = run(n), per_op = total;
+		do_div(per_op, (uint32_t) (NR_OPS * n));
+		snprintf(name, sizeof(name), "malloc_%d", n);
+		printf("bench %s %d %llu %llu %s\n", name, NR_OPS * n, total,
+		       per_op, BENCH_UNIT);
+	}
+	printf("mallocbench pass.\n");
+	return 0;
+}
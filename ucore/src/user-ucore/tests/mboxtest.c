@@ -61,6 +61,79 @@ void mbox_test(void)
 	exit(0);
 }
 
+#define BATCH_ROUNDS    20
+
+static char msgs[MAX_MSG_BATCH][16];
+
+static void fill_bufs(struct mboxbuf *bufs, int first, int n, size_t size)
+{
+	int i;
+	for (i = first; i < n; i++) {
+		bufs[i].data = msgs[i], bufs[i].size = size;
+		bufs[i].len = 0;
+	}
+}
+
+void mbox_batch_test(void)
+{
+	struct mboxbuf bufs[MAX_MSG_BATCH];
+	int mbox_id = mbox_init(8), i, j, pid, ret;
+	assert(mbox_id >= 0);
+
+	for (i = 0; i < MAX_MSG_BATCH; i++) {
+		snprintf(msgs[i], sizeof(msgs[i]), "msg %d", i);
+		bufs[i].data = msgs[i], bufs[i].len = strlen(msgs[i]) + 1;
+	}
+	/* as many as there are slots for */
+	assert(mbox_sendm(mbox_id, bufs, MAX_MSG_BATCH, 0) == 8);
+	assert(mbox_sendm(mbox_id, bufs, 1, 10) == -E_TIMEOUT);
+	assert(mbox_sendm(mbox_id, bufs, MAX_MSG_BATCH + 1, 0) == -E_INVAL);
+
+	/* those after a buffer too small stay */
+	memset(msgs, 0, sizeof(msgs));
+	fill_bufs(bufs, 0, 3, sizeof(msgs[0]));
+	bufs[2].size = 2;
+	assert(mbox_recvm(mbox_id, bufs, 3, 0) == 2);
+	assert(mbox_recvm(mbox_id, bufs + 2, 1, 0) == -E_TOO_BIG);
+	fill_bufs(bufs, 2, MAX_MSG_BATCH, sizeof(msgs[0]));
+	assert(mbox_recvm(mbox_id, bufs + 2, MAX_MSG_BATCH - 2, 0) == 6);
+	for (i = 0; i < 8; i++) {
+		char expected[16];
+		snprintf(expected, sizeof(expected), "msg %d", i);
+		assert(strcmp(msgs[i], expected) == 0);
+		assert(bufs[i].len == strlen(expected) + 1);
+		assert(bufs[i].from == getpid());
+	}
+
+	/* a batch across processes, received in batches of another size */
+	if ((pid = fork()) == 0) {
+		for (i = 0; i < BATCH_ROUNDS; i++) {
+			for (j = 0; j < MAX_MSG_BATCH; j++) {
+				msgs[j][0] = (char)(i * MAX_MSG_BATCH + j);
+				bufs[j].data = msgs[j], bufs[j].len = 1;
+			}
+			for (j = 0; j < MAX_MSG_BATCH; j += ret) {
+				ret = mbox_sendm(mbox_id, bufs + j,
+						 MAX_MSG_BATCH - j, 0);
+				assert(ret > 0);
+			}
+		}
+		exit(0);
+	}
+	assert(pid > 0);
+	for (i = 0; i < BATCH_ROUNDS * MAX_MSG_BATCH; i += ret) {
+		fill_bufs(bufs, 0, 5, 1);
+		assert((ret = mbox_recvm(mbox_id, bufs, 5, 0)) > 0);
+		for (j = 0; j < ret; j++) {
+			assert(msgs[j][0] == (char)(i + j));
+			assert(bufs[j].from == pid);
+		}
+	}
+	assert(waitpid(pid, &ret) == 0 && ret == 0);
+	assert(mbox_free(mbox_id) == 0);
+	cprintf("mboxtest batch pass.\n");
+}
+
 int main(void)
 {
 	int pid, ret;
@@ -68,6 +141,7 @@ int main(void)
 		mbox_test();
 	}
 	assert(pid > 0 && waitpid(pid, &ret) == 0 && ret == 0);
+	mbox_batch_test();
 	cprintf("mboxtest pass.\n");
 	return 0;
 }
@@ -0,0 +1,73 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <memgroup.h>
+#include <error.h>
+
+/* *
+ * A child in a memory group of LIMIT_PAGES touches twice as many pages:
+ * the group is reclaimed from instead of failing, never goes over its
+ * limit, and the pages come back intact. Then the rules of the groups:
+ * nesting, destroying and attaching.
+ * */
+#define LIMIT_PAGES         64
+#define NR_PAGES            (LIMIT_PAGES * 2)
+#define PGSIZE              4096
+
+static void child(int id)
+{
+	uintptr_t addr = 0;
+	int i;
+	assert(memcg_attach(id, 0) == 0);
+	assert(mmap(&addr, NR_PAGES * PGSIZE, MMAP_WRITE) == 0 && addr != 0);
+	for (i = 0; i < NR_PAGES; i++) {
+		*(int *)(addr + i * PGSIZE) = i * 7;
+	}
+	for (i = 0; i < NR_PAGES; i++) {
+		assert(*(int *)(addr + i * PGSIZE) == i * 7);
+	}
+	exit(0);
+}
+
+int main(void)
+{
+	struct memcg_stat stat;
+	int id, parent, pid, exit_code;
+	if ((id = memcg_create(0, LIMIT_PAGES * PGSIZE, 0)) == -E_UNIMP) {
+		cprintf("memcgtest pass.\n");
+		return 0;
+	}
+	assert(id > 0);
+	assert(memcg_stat(id, &stat) == 0 && stat.usage == 0
+	       && stat.limit == LIMIT_PAGES * PGSIZE);
+
+	/* held at the limit by reclaim from the group itself */
+	if ((pid = fork()) == 0) {
+		child(id);
+	}
+	assert(pid > 0);
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	assert(memcg_stat(id, &stat) == 0);
+	assert(stat.max_usage <= LIMIT_PAGES * PGSIZE && stat.reclaimed > 0);
+	cprintf("memcg: max_usage %d reclaimed %d failcnt %d\n",
+		(int)stat.max_usage, (int)stat.reclaimed, (int)stat.failcnt);
+
+	/* a group with a child or a proc in it stays */
+	assert((parent = memcg_create(0, 0, 0)) > 0);
+	assert(memcg_set_limit(parent, 2 * LIMIT_PAGES * PGSIZE, PGSIZE) == 0);
+	int sub = memcg_create(parent, 0, 0);
+	assert(sub > 0 && memcg_destroy(parent) == -E_BUSY);
+	assert(memcg_attach(sub, 0) == 0 && memcg_destroy(sub) == -E_BUSY);
+	assert(memcg_attach(0, 0) == 0);
+	assert(memcg_destroy(sub) == 0 && memcg_destroy(parent) == 0);
+
+	/* the bad ones */
+	assert(memcg_destroy(sub) == -E_INVAL);
+	assert(memcg_stat(sub, &stat) == -E_INVAL);
+	assert(memcg_create(sub, 0, 0) == -E_INVAL);
+	assert(memcg_attach(sub, 0) == -E_INVAL);
+	assert(memcg_destroy(id) == 0);
+	cprintf("memcgtest pass.\n");
+	return 0;
+}
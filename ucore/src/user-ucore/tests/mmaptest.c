@@ -57,6 +57,22 @@ int main(void)
 		assert(buffer[i] == (char)(i * i));
 	}
 
+	/* prefaulted pages read as zero and take writes like lazy ones */
+	addr = 0;
+	assert(mmap(&addr, size * 4, MMAP_WRITE | MMAP_POPULATE) == 0
+	       && addr != 0);
+	buffer = (char *)addr;
+	for (i = 0; i < size * 4; i += 512) {
+		assert(buffer[i] == 0);
+		buffer[i] = (char)i;
+	}
+	for (i = 0; i < size * 4; i += 512) {
+		assert(buffer[i] == (char)i);
+	}
+	assert(munmap(addr, size * 4) == 0);
+
+	cprintf("mmap populate ok.\n");
+
 	cprintf("mmaptest pass.\n");
 	return 0;
 }
@@ -0,0 +1,133 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <cpuset.h>
+#include <error.h>
+
+/* *
+ * The nice value of a process: getpriority gives back what setpriority
+ * set, clamped to NICE_MIN .. NICE_MAX, and a child inherits it. The run
+ * time of a process grows while it spins, as proc:<pid>/status reports
+ * it, and under CFS two children spinning on one cpu share it in the
+ * ratio of the weights of their nice values, ~3 to 1 for nice 0 and 5.
+ * */
+#define NR_TICKS            100
+#define NICE_LOW            5
+
+static char buf[1024];
+
+// status - the value of field in proc:<pid>/status, NULL if none
+static const char *status(int pid, const char *field)
+{
+	char path[32], *p;
+	int fd, n;
+	snprintf(path, sizeof(path), "proc:%d/status", pid);
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return NULL;
+	}
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	buf[(n > 0) ? n : 0] = '\0';
+	for (p = buf; *p != '\0'; p = strchr(p, '\n') + 1) {
+		if (strncmp(p, field, strlen(field)) == 0) {
+			return p + strlen(field);
+		}
+		if (strchr(p, '\n') == NULL) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+static uint64_t runtime(int pid)
+{
+	const char *p = status(pid, "Runtime:\t");
+	uint64_t ns = 0;
+	assert(p != NULL);
+	for (; *p >= '0' && *p <= '9'; p++) {
+		ns = ns * 10 + (*p - '0');
+	}
+	return ns;
+}
+
+static void spin(int nice)
+{
+	volatile int n = 0;
+	assert(setpriority(0, nice) == 0);
+	while (1) {
+		n++;
+	}
+}
+
+static void test_nice(void)
+{
+	int nice, pid, exit_code;
+	assert(getpriority(0, &nice) == 0 && nice == 0);
+	assert(setpriority(0, 3) == 0);
+	assert(getpriority(0, &nice) == 0 && nice == 3);
+	if ((pid = fork()) == 0) {
+		exit((getpriority(0, &nice) == 0 && nice == 3) ? 0 : -1);
+	}
+	assert(pid > 0 && waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	assert(setpriority(0, NICE_MAX + 10) == 0);
+	assert(getpriority(0, &nice) == 0 && nice == NICE_MAX);
+	assert(setpriority(0, NICE_MIN - 10) == 0);
+	assert(getpriority(0, &nice) == 0 && nice == NICE_MIN);
+	assert(setpriority(0, 0) == 0);
+	assert(setpriority(-1, 0) == -E_INVAL);
+	assert(getpriority(-1, &nice) == -E_INVAL);
+	cprintf("nicetest nice pass.\n");
+}
+
+static void test_runtime(void)
+{
+	uint64_t before = runtime(getpid());
+	unsigned int start = gettime_msec();
+	while (gettime_msec() - start < 50) ;
+	assert(runtime(getpid()) > before);
+	cprintf("nicetest runtime pass.\n");
+}
+
+static void test_shares(void)
+{
+	cpuset_t mask;
+	const char *sched;
+	int pid0, pid1, exit_code;
+	uint64_t rt0, rt1;
+	cpuset_clear(&mask);
+	cpuset_set(&mask, 0);
+	assert(sched_setaffinity(0, &mask) == 0);
+	if ((pid0 = fork()) == 0) {
+		spin(0);
+	}
+	if ((pid1 = fork()) == 0) {
+		spin(NICE_LOW);
+	}
+	assert(pid0 > 0 && pid1 > 0);
+	sleep(NR_TICKS);
+	rt0 = runtime(pid0), rt1 = runtime(pid1);
+	sched = status(pid0, "Sched:\t");
+	assert(sched != NULL);
+	cprintf("nicetest: nice 0 ran %d ms, nice %d ran %d ms\n",
+		(int)(rt0 / 1000000), NICE_LOW, (int)(rt1 / 1000000));
+	assert(rt0 > 0 && rt1 > 0);
+	/* the other schedulers do not weight by nice */
+	if (strncmp(sched, "CFS", 3) == 0) {
+		assert(rt0 > 2 * rt1 && rt0 < 4 * rt1);
+	}
+	assert(kill(pid0) == 0 && waitpid(pid0, &exit_code) == 0);
+	assert(kill(pid1) == 0 && waitpid(pid1, &exit_code) == 0);
+	assert(sched_setaffinity(0, NULL) == 0);
+	cprintf("nicetest shares pass.\n");
+}
+
+int main(void)
+{
+	test_nice();
+	test_runtime();
+	test_shares();
+	cprintf("nicetest pass.\n");
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <thread.h>
+#include <error.h>
+
+/* *
+ * A pi mutex: the threads contending for it, yielding while they hold it
+ * so that the others sleep in the kernel for it, never lose an increment;
+ * the owner taking it again is told so, and no one else may release it.
+ * */
+#define NTHREADS                4
+#define ROUNDS                  200
+
+static pi_mutex_t lock = INIT_PI_MUTEX;
+static volatile int counter;
+
+static int worker(void *arg)
+{
+	int i, v;
+	for (i = 0; i < ROUNDS; i++) {
+		assert(pi_mutex_lock(&lock) == 0);
+		v = counter;
+		yield();
+		counter = v + 1;
+		assert(pi_mutex_unlock(&lock) == 0);
+	}
+	return 0;
+}
+
+static int stranger(void *arg)
+{
+	return pi_mutex_unlock(&lock);
+}
+
+int main(void)
+{
+	thread_t tids[NTHREADS], tid;
+	int i, exit_code;
+
+	assert(pi_mutex_lock(&lock) == 0);
+	assert(!pi_mutex_trylock(&lock));
+	assert(pi_mutex_lock(&lock) == -E_DEADLK);
+	assert(thread(stranger, NULL, &tid) == 0);
+	assert(thread_wait(&tid, &exit_code) == 0 && exit_code == -E_PERM);
+	assert(pi_mutex_unlock(&lock) == 0);
+	assert(pi_mutex_trylock(&lock));
+	assert(pi_mutex_unlock(&lock) == 0);
+
+	for (i = 0; i < NTHREADS; i++) {
+		assert(thread(worker, NULL, tids + i) == 0);
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		assert(thread_wait(tids + i, &exit_code) == 0 && exit_code == 0);
+	}
+	assert(counter == NTHREADS * ROUNDS && lock.owner == 0);
+	cprintf("pimutextest pass.\n");
+	return 0;
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <string.h>
+#include <file.h>
+#include <dir.h>
+#include <stat.h>
+#include <thread.h>
+#include <unistd.h>
+#include <error.h>
+
+/* a tail after whole blocks, and segments that cross the pages */
+#define FILESIZE        (4 * 4096 + 300)
+#define NR_THREADS      4
+#define ROUNDS          50
+
+static char buf[FILESIZE], buf2[FILESIZE];
+static int shared_fd;
+
+static void check_pos(int fd, off_t pos)
+{
+	/* a read from the position of fd finds what is there */
+	char c;
+	assert(read(fd, &c, 1) == 1 && c == buf[pos]);
+	assert(seek(fd, pos, LSEEK_SET) == 0);
+}
+
+static void test_pread(int fd)
+{
+	struct stat __stat, *stat = &__stat;
+	assert(pread(fd, buf2, 5000, 3000) == 5000);
+	assert(memcmp(buf2, buf + 3000, 5000) == 0);
+	check_pos(fd, 0);
+
+	memset(buf + 100, 'x', 200);
+	assert(pwrite(fd, buf + 100, 200, 100) == 200);
+	check_pos(fd, 0);
+	assert(pread(fd, buf2, FILESIZE, 0) == FILESIZE);
+	assert(memcmp(buf2, buf, FILESIZE) == 0);
+
+	/* past the end nothing is read, and the file does not grow */
+	assert(pread(fd, buf2, 10, FILESIZE + 4096) == 0);
+	assert(fstat(fd, stat) == 0 && stat->st_size == FILESIZE);
+	assert(pread(fd, buf2, 10, -1) == -E_INVAL);
+	cprintf("preadtest pread pass.\n");
+}
+
+static void test_readv(int fd)
+{
+	static char a[100], b[3 * 4096], c[500];
+	struct iovec iov[4] = {
+		{a, sizeof(a)}, {NULL, 0}, {b, sizeof(b)}, {c, sizeof(c)},
+	};
+	size_t total = sizeof(a) + sizeof(b) + sizeof(c);
+
+	assert(seek(fd, 10, LSEEK_SET) == 0);
+	assert(readv(fd, iov, 4) == total);
+	assert(memcmp(a, buf + 10, sizeof(a)) == 0);
+	assert(memcmp(b, buf + 10 + sizeof(a), sizeof(b)) == 0);
+	assert(memcmp(c, buf + 10 + sizeof(a) + sizeof(b), sizeof(c)) == 0);
+	/* readv moves the position past the data, preadv does not */
+	check_pos(fd, 10 + total);
+
+	memset(a, 'a', sizeof(a)), memset(b, 'b', sizeof(b));
+	memset(c, 'c', sizeof(c));
+	assert(pwritev(fd, iov, 4, 2000) == total);
+	memcpy(buf + 2000, a, sizeof(a));
+	memcpy(buf + 2000 + sizeof(a), b, sizeof(b));
+	memcpy(buf + 2000 + sizeof(a) + sizeof(b), c, sizeof(c));
+	check_pos(fd, 10 + total);
+	memset(b, 0, sizeof(b));
+	assert(preadv(fd, iov + 2, 1, 2000 + sizeof(a)) == sizeof(b));
+	assert(memcmp(b, buf + 2000 + sizeof(a), sizeof(b)) == 0);
+
+	assert(seek(fd, 0, LSEEK_SET) == 0);
+	assert(writev(fd, iov, 1) == sizeof(a));
+	memcpy(buf, a, sizeof(a));
+	check_pos(fd, sizeof(a));
+	assert(read(fd, buf2, FILESIZE) == FILESIZE - sizeof(a));
+	assert(memcmp(buf2, buf + sizeof(a), FILESIZE - sizeof(a)) == 0);
+	assert(readv(fd, iov, 0) == -E_INVAL);
+	cprintf("preadtest readv pass.\n");
+}
+
+static int reader(void *arg)
+{
+	int id = (long)arg, i;
+	static char bufs[NR_THREADS][1000];
+	char *mine = bufs[id];
+	for (i = 0; i < ROUNDS; i++) {
+		off_t off = (id * 4096 + i * 37) % (FILESIZE - 1000);
+		if (pread(shared_fd, mine, 1000, off) != 1000
+		    || memcmp(mine, buf + off, 1000) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void test_threads(int fd)
+{
+	thread_t tids[NR_THREADS];
+	int i, exit_code;
+	shared_fd = fd;
+	for (i = 0; i < NR_THREADS; i++) {
+		assert(thread(reader, (void *)(long)i, tids + i) == 0);
+	}
+	for (i = 0; i < NR_THREADS; i++) {
+		assert(thread_wait(tids + i, &exit_code) == 0 && exit_code == 0);
+	}
+	cprintf("preadtest threads pass.\n");
+}
+
+static void test_pipe(void)
+{
+	int fd[2];
+	struct iovec iov[3] = {
+		{"gathered ", 9}, {"into ", 5}, {"one write", 9},
+	};
+	assert(pipe(fd) == 0);
+	/* a pipe has no offset */
+	assert(pwrite(fd[1], "x", 1, 0) == -E_INVAL);
+	assert(writev(fd[1], iov, 3) == 23);
+	memset(buf2, 0, 24);
+	assert(read(fd[0], buf2, 23) == 23);
+	assert(strcmp(buf2, "gathered into one write") == 0);
+	close(fd[0]), close(fd[1]);
+	cprintf("preadtest pipe pass.\n");
+}
+
+int main(void)
+{
+	int fd, i;
+	assert(chdir("/testdir/test") == 0);
+	for (i = 0; i < FILESIZE; i++) {
+		buf[i] = (char)(i * 13);
+	}
+	assert((fd = open("pread", O_CREAT | O_RDWR | O_TRUNC)) >= 0);
+	assert(write(fd, buf, FILESIZE) == FILESIZE);
+	assert(seek(fd, 0, LSEEK_SET) == 0);
+	test_pread(fd);
+	test_readv(fd);
+	test_threads(fd);
+	close(fd);
+	assert(unlink("pread") == 0);
+	test_pipe();
+	cprintf("preadtest pass.\n");
+	return 0;
+}
@@ -0,0 +1,76 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <dir.h>
+
+static char buf[4096];
+
+static int read_file(const char *path)
+{
+	int fd, n;
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return fd;
+	}
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	buf[(n > 0) ? n : 0] = '\0';
+	return n;
+}
+
+int main(void)
+{
+	char path[32], line[32];
+	int pid = getpid();
+
+	assert(read_file("proc:meminfo") > 0);
+	assert(strncmp(buf, "MemFree:", 8) == 0);
+	assert(read_file("proc:slabinfo") > 0);
+	assert(read_file("proc:sched") > 0);
+	assert(strncmp(buf, "cpu0 ", 5) == 0);
+	/* sfs on disk0 has read its superblock at least */
+	assert(read_file("proc:iostat") > 0);
+	char *p;
+	for (p = buf; strncmp(p, "disk0 ", 6) != 0; p = strchr(p, '\n') + 1) {
+		assert(strchr(p, '\n') != NULL);
+	}
+	assert(strncmp(p, "disk0 0 ", 8) != 0);
+	assert(open("proc:meminfo", O_WRONLY) < 0);
+	assert(open("proc:nosuchfile", O_RDONLY) < 0);
+	cprintf("proctest kernel pass.\n");
+
+	snprintf(path, sizeof(path), "proc:%d/status", pid);
+	assert(read_file(path) > 0);
+	assert(strncmp(buf, "Name:\t", 6) == 0);
+	snprintf(line, sizeof(line), "Pid:\t%d\n", pid);
+	for (p = buf; *p != '\0'; p++) {
+		if (strncmp(p, line, strlen(line)) == 0) {
+			break;
+		}
+	}
+	assert(*p != '\0');
+	snprintf(path, sizeof(path), "proc:/%d/fd", pid);
+	assert(read_file(path) >= 0);
+	snprintf(path, sizeof(path), "proc:%d/status/x", pid);
+	assert(open(path, O_RDONLY) < 0);
+	cprintf("proctest process pass.\n");
+
+	DIR *dirp = opendir("proc:");
+	struct dirent *d;
+	int found = 0;
+	assert(dirp != NULL);
+	snprintf(line, sizeof(line), "%d", pid);
+	while ((d = readdir(dirp)) != NULL) {
+		if (strcmp(d->name, "meminfo") == 0
+		    || strcmp(d->name, line) == 0) {
+			found++;
+		}
+	}
+	closedir(dirp);
+	assert(found == 2);
+	cprintf("proctest readdir pass.\n");
+
+	cprintf("proctest pass.\n");
+	return 0;
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+
+/* the page tables fork shares are copied when either side writes, maps or
+ * unmaps, and dropped by whoever exits */
+#define PAGE        4096
+#define NPAGES      2048	// a few pte pages, wholly inside the map
+
+static uintptr_t *base;
+
+static uintptr_t *slot(int i)
+{
+	return (uintptr_t *) ((uintptr_t) base + i * PAGE);
+}
+
+static void check(uintptr_t tag, int from, int to)
+{
+	int i;
+	for (i = from; i < to; i++) {
+		assert(*slot(i) == i + tag);
+	}
+}
+
+static void fill(uintptr_t tag, int from, int to)
+{
+	int i;
+	for (i = from; i < to; i++) {
+		*slot(i) = i + tag;
+	}
+}
+
+int main(void)
+{
+	uintptr_t addr = 0;
+	int pid, pid2, exit_code;
+
+	assert(mmap(&addr, NPAGES * PAGE, MMAP_WRITE) == 0);
+	base = (uintptr_t *) addr;
+	fill(0, 0, NPAGES);
+
+	if ((pid = fork()) == 0) {
+		check(0, 0, NPAGES);
+		/* a grandchild on the same pte pages */
+		if ((pid2 = fork()) == 0) {
+			check(0, 0, NPAGES);
+			fill(2, NPAGES / 2, NPAGES);
+			check(0, 0, NPAGES / 2);
+			exit(0);
+		}
+		assert(waitpid(pid2, &exit_code) == 0 && exit_code == 0);
+		check(0, 0, NPAGES);
+		assert(munmap((uintptr_t) slot(NPAGES / 4), PAGE) == 0);
+		fill(1, 0, NPAGES / 4);
+		exit(0);
+	}
+	assert(pid > 0);
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	check(0, 0, NPAGES);
+	cprintf("fork share ok.\n");
+
+	fill(3, 0, NPAGES);
+	check(3, 0, NPAGES);
+	assert(munmap(addr, NPAGES * PAGE) == 0);
+	cprintf("ptsharetest pass.\n");
+	return 0;
+}
@@ -0,0 +1,190 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <error.h>
+#include <mboxbuf.h>
+#include <ring.h>
+
+#define NR_MSGS         20000
+#define MSG_BYTES       64
+#define NR_PRODUCERS    3
+#define NR_CLOSES       50
+
+static char msg[MSG_BYTES];
+
+static void fill(int i)
+{
+	memset(msg, (char)i, MSG_BYTES);
+	*(int *)msg = i;
+}
+
+static void check(int i)
+{
+	assert(*(int *)msg == i && msg[MSG_BYTES - 1] == (char)i);
+}
+
+static void wait_child(int pid)
+{
+	int exit_code;
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+}
+
+static unsigned int bench_ring(void)
+{
+	ring_t r;
+	assert(ring_create(&r, 4096, 0) == 0);
+	unsigned int start = gettime_msec();
+	int i, pid;
+	if ((pid = fork()) == 0) {
+		for (i = 0; i < NR_MSGS; i++) {
+			fill(i);
+			assert(ring_send(&r, msg, MSG_BYTES) == 0);
+		}
+		ring_close(&r);
+		exit(0);
+	}
+	assert(pid > 0);
+	for (i = 0; i < NR_MSGS; i++) {
+		assert(ring_recv(&r, msg, MSG_BYTES) == MSG_BYTES);
+		check(i);
+	}
+	assert(ring_recv(&r, msg, MSG_BYTES) == 0);
+	wait_child(pid);
+	assert(ring_destroy(&r) == 0);
+	return gettime_msec() - start;
+}
+
+static unsigned int bench_pipe(void)
+{
+	int fd[2];
+	assert(pipe(fd) == 0);
+	unsigned int start = gettime_msec();
+	int i, pid;
+	if ((pid = fork()) == 0) {
+		close(fd[0]);
+		for (i = 0; i < NR_MSGS; i++) {
+			fill(i);
+			assert(write(fd[1], msg, MSG_BYTES) == MSG_BYTES);
+		}
+		exit(0);
+	}
+	assert(pid > 0);
+	close(fd[1]);
+	for (i = 0; i < NR_MSGS; i++) {
+		int n, len = 0;
+		while (len < MSG_BYTES) {
+			assert((n = read(fd[0], msg + len, MSG_BYTES - len)) > 0);
+			len += n;
+		}
+		check(i);
+	}
+	close(fd[0]);
+	wait_child(pid);
+	return gettime_msec() - start;
+}
+
+static unsigned int bench_mbox(void)
+{
+	int id = mbox_init(64);
+	assert(id >= 0);
+	struct mboxbuf buf;
+	unsigned int start = gettime_msec();
+	int i, pid;
+	if ((pid = fork()) == 0) {
+		for (i = 0; i < NR_MSGS; i++) {
+			fill(i);
+			buf.data = msg, buf.len = buf.size = MSG_BYTES;
+			assert(mbox_send(id, &buf) == 0);
+		}
+		exit(0);
+	}
+	assert(pid > 0);
+	for (i = 0; i < NR_MSGS; i++) {
+		buf.data = msg, buf.size = MSG_BYTES;
+		assert(mbox_recv(id, &buf) == 0 && buf.len == MSG_BYTES);
+		check(i);
+	}
+	wait_child(pid);
+	assert(mbox_free(id) == 0);
+	return gettime_msec() - start;
+}
+
+static void test_mpsc(void)
+{
+	ring_t r;
+	assert(ring_create(&r, 256, 1) == 0);
+	int i, j, pids[NR_PRODUCERS], next[NR_PRODUCERS];
+	for (j = 0; j < NR_PRODUCERS; j++) {
+		if ((pids[j] = fork()) == 0) {
+			for (i = 0; i < NR_MSGS / 10; i++) {
+				int m[2] = { j, i };
+				assert(ring_send(&r, m, sizeof(m)) == 0);
+			}
+			exit(0);
+		}
+		assert(pids[j] > 0);
+		next[j] = 0;
+	}
+	for (i = 0; i < NR_PRODUCERS * (NR_MSGS / 10); i++) {
+		int m[2];
+		assert(ring_recv(&r, m, sizeof(m)) == sizeof(m));
+		assert(m[0] >= 0 && m[0] < NR_PRODUCERS && m[1] == next[m[0]]++);
+	}
+	assert(ring_tryrecv(&r, msg, MSG_BYTES) == -E_AGAIN);
+	for (j = 0; j < NR_PRODUCERS; j++) {
+		wait_child(pids[j]);
+	}
+	assert(ring_destroy(&r) == 0);
+}
+
+// test_close - close the ring while the other side waits on it, with the
+//            - child going first or not: the consumer gets 0, and the
+//            - producer of a full ring -E_PIPE
+static void test_close(void)
+{
+	ring_t r;
+	int i, pid;
+	for (i = 0; i < NR_CLOSES; i++) {
+		assert(ring_create(&r, 64, 0) == 0);
+		if ((pid = fork()) == 0) {
+			if (i & 1) {
+				yield();
+			}
+			ring_close(&r);
+			exit(0);
+		}
+		assert(pid > 0);
+		assert(ring_recv(&r, msg, MSG_BYTES) == 0);
+		wait_child(pid);
+		assert(ring_destroy(&r) == 0);
+
+		assert(ring_create(&r, 64, 0) == 0);
+		while (ring_trysend(&r, msg, 16) == 0)
+			/* fill it up */ ;
+		if ((pid = fork()) == 0) {
+			if (i & 1) {
+				yield();
+			}
+			ring_close(&r);
+			exit(0);
+		}
+		assert(pid > 0);
+		assert(ring_send(&r, msg, 16) == -E_PIPE);
+		wait_child(pid);
+		assert(ring_destroy(&r) == 0);
+	}
+}
+
+int main(void)
+{
+	unsigned int ring_msec = bench_ring();
+	unsigned int pipe_msec = bench_pipe();
+	unsigned int mbox_msec = bench_mbox();
+	cprintf("%d messages of %d bytes: ring %d ms, pipe %d ms, mbox %d ms\n",
+		NR_MSGS, MSG_BYTES, ring_msec, pipe_msec, mbox_msec);
+	test_mpsc();
+	test_close();
+	cprintf("ringbench pass.\n");
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <string.h>
+
+/* *
+ * The children share the private pages of the parent, copy-on-write, and
+ * a shmem with it. A large buffer then pushes the shared pages out, each
+ * from all its mappings at once, and they must come back intact in every
+ * process.
+ * */
+#define NR_CHILDREN         4
+#define PRIV_SIZE           (4 * 1024 * 1024)
+#define SHMEM_SIZE          (1024 * 1024)
+#define PUSH_SIZE           (8 * 1024 * 1024)
+
+char *priv, *shared;
+
+static void check(const char *what)
+{
+	int i;
+	for (i = 0; i < PRIV_SIZE; i++) {
+		assert(priv[i] == (char)(i * 7));
+	}
+	for (i = 0; i < SHMEM_SIZE; i++) {
+		assert(shared[i] == (char)(i * 13));
+	}
+	if (what != NULL) {
+		cprintf("%s check ok.\n", what);
+	}
+}
+
+int main(void)
+{
+	int pid[NR_CHILDREN], i, exit_code;
+	assert((priv = malloc(PRIV_SIZE)) != NULL);
+	assert((shared = shmem_malloc(SHMEM_SIZE)) != NULL);
+	for (i = 0; i < PRIV_SIZE; i++) {
+		priv[i] = (char)(i * 7);
+	}
+	for (i = 0; i < SHMEM_SIZE; i++) {
+		shared[i] = (char)(i * 13);
+	}
+
+	for (i = 0; i < NR_CHILDREN; i++) {
+		if ((pid[i] = fork()) == 0) {
+			sleep(100);
+			check(i == 0 ? "child" : NULL);
+			exit(0);
+		}
+		assert(pid[i] > 0);
+	}
+
+	char *push = malloc(PUSH_SIZE);
+	assert(push != NULL);
+	memset(push, 0x5a, PUSH_SIZE);
+	free(push);
+
+	for (i = 0; i < NR_CHILDREN; i++) {
+		assert(waitpid(pid[i], &exit_code) == 0 && exit_code == 0);
+	}
+	check("parent");
+	free(shared);
+	free(priv);
+	cprintf("rmaptest pass.\n");
+	return 0;
+}
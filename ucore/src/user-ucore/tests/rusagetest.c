@@ -0,0 +1,59 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <rusage.h>
+
+#define NPAGES                      16
+
+static void spin(unsigned int msec)
+{
+	unsigned int start = gettime_msec();
+	while (gettime_msec() - start < msec) ;
+}
+
+int main(void)
+{
+	struct rusage before, after;
+	assert(getrusage(RUSAGE_SELF, &before) == 0);
+	spin(50);
+	assert(getrusage(RUSAGE_SELF, &after) == 0);
+	assert(after.ru_utime > before.ru_utime);
+	cprintf("rusagetest utime pass.\n");
+
+	sleep(2);
+	assert(getrusage(RUSAGE_THREAD, &after) == 0);
+	assert(after.ru_nvcsw > before.ru_nvcsw);
+	before = after;
+	char *buf = malloc(NPAGES * 4096);
+	assert(buf != NULL);
+	memset(buf, 1, NPAGES * 4096);
+	assert(getrusage(RUSAGE_SELF, &after) == 0);
+	assert(after.ru_minflt > before.ru_minflt);
+	free(buf);
+	cprintf("rusagetest switch and fault pass.\n");
+
+	int pid;
+	if ((pid = fork()) == 0) {
+		spin(50);
+		exit(0);
+	}
+	assert(pid > 0 && waitpid(pid, NULL) == 0);
+	assert(getrusage(RUSAGE_CHILDREN, &after) == 0 && after.ru_utime > 0);
+	assert(getrusage(42, &after) != 0);
+	cprintf("rusagetest children pass.\n");
+
+	char line[64];
+	int fd = open("stat:", O_RDONLY), n;
+	assert(fd >= 0);
+	assert((n = read(fd, line, sizeof(line) - 1)) > 0);
+	line[n] = '\0';
+	assert(strncmp(line, "cpu0 ", 5) == 0);
+	close(fd);
+	cprintf("rusagetest stat pass.\n");
+
+	cprintf("rusagetest pass.\n");
+	return 0;
+}
@@ -0,0 +1,262 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <error.h>
+#include <thread.h>
+#include <syscall.h>
+#include <arch.h>
+#ifdef ARCH_ARM
+#include <div64.h>
+#endif
+
+#define printf(...)                     fprintf(1, __VA_ARGS__)
+
+/* *
+ * The scalability of the kernel: each workload runs on 1, 2, 4... cpus at
+ * once, one worker pinned to each (sched_setaffinity), and each worker does
+ * the same amount of work. A worker is a process of its own, or a thread
+ * of one shared mm for fault_shared. Each point prints
+ *     bench <workload>_<cpus> <ops> <total> <per op> <unit>
+ * as tests/kbench.c does, the total being the wall time of all workers;
+ * the table at the end gives the throughput relative to one cpu, x100. A
+ * subsystem that scales keeps the per op time falling as 1/cpus.
+ * */
+#define MAX_CPUS                        32
+#define NR_FORKS                        50
+#define NR_FAULT_PAGES                  256
+#define NR_FAULT_ROUNDS                 4
+#define NR_OPENS                        500
+#define NR_KMALLOCS                     20000
+#define KMALLOC_BYTES                   256
+
+#define PGSIZE                          4096
+#define PATH                            "/testbin/scalebench"
+
+#if defined(ARCH_X86) || defined(ARCH_AMD64)
+#define BENCH_UNIT                      "cycles"
+static inline uint64_t bench_now(void)
+{
+	uint32_t lo, hi;
+	asm volatile ("rdtsc":"=a" (lo), "=d"(hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+#else
+#define BENCH_UNIT                      "us"
+static inline uint64_t bench_now(void)
+{
+	return (uint64_t) gettime_msec() * 1000;
+}
+#endif
+
+struct workload {
+	const char *name;
+	int ops;		// by each worker
+	void (*work) (int id);
+	bool threads;		// the workers share the mm of the harness
+	bool skip;
+	uint32_t per_op[MAX_CPUS + 1];
+};
+
+static int ncpus;
+static int start_fd[2];
+static uintptr_t shared_region;
+
+static void work_fork(int id)
+{
+	int i, pid, exit_code;
+	for (i = 0; i < NR_FORKS; i++) {
+		if ((pid = fork()) == 0) {
+			exit(0);
+		}
+		assert(pid > 0);
+		assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	}
+}
+
+static void touch(uintptr_t addr, int npages)
+{
+	int i;
+	for (i = 0; i < npages; i++) {
+		*(volatile char *)(addr + i * PGSIZE) = (char)i;
+	}
+}
+
+static void work_fault_private(int id)
+{
+	uintptr_t addr;
+	int i;
+	for (i = 0; i < NR_FAULT_ROUNDS; i++) {
+		addr = 0;
+		assert(mmap(&addr, NR_FAULT_PAGES * PGSIZE, MMAP_WRITE) == 0);
+		touch(addr, NR_FAULT_PAGES);
+		assert(munmap(addr, NR_FAULT_PAGES * PGSIZE) == 0);
+	}
+}
+
+// work_fault_shared - the faults of the threads of one mm, each in a part
+//                   - of its own of the region mapped by the harness
+static void work_fault_shared(int id)
+{
+	touch(shared_region + id * NR_FAULT_PAGES * NR_FAULT_ROUNDS * PGSIZE,
+	      NR_FAULT_PAGES * NR_FAULT_ROUNDS);
+}
+
+static void work_open_close(int id)
+{
+	int i, fd;
+	for (i = 0; i < NR_OPENS; i++) {
+		assert((fd = open(PATH, O_RDONLY)) >= 0);
+		close(fd);
+	}
+}
+
+static void work_kmalloc(int id)
+{
+	assert(sys_kbench(KBENCH_KMALLOC, KMALLOC_BYTES, NR_KMALLOCS) == 0);
+}
+
+static struct workload workloads[] = {
+	{"fork", NR_FORKS, work_fork, 0},
+	{"fault_private", NR_FAULT_PAGES * NR_FAULT_ROUNDS, work_fault_private,
+	 0},
+	{"fault_shared", NR_FAULT_PAGES * NR_FAULT_ROUNDS, work_fault_shared,
+	 1},
+	{"open_close", NR_OPENS, work_open_close, 0},
+	{"kmalloc", NR_KMALLOCS, work_kmalloc, 0},
+};
+
+#define NR_WORKLOADS    (sizeof(workloads) / sizeof(workloads[0]))
+
+static struct workload *current_work;
+
+// pin - run the caller on cpu only, or anywhere if cpu is -1
+static int pin(int cpu)
+{
+	cpuset_t mask;
+	if (cpu < 0) {
+		return sched_setaffinity(0, NULL);
+	}
+	cpuset_clear(&mask);
+	cpuset_set(&mask, cpu);
+	return sched_setaffinity(0, &mask);
+}
+
+// worker - pin to cpu id, wait for the start and work
+static int worker(void *arg)
+{
+	int id = (int)(uintptr_t) arg;
+	char c;
+	assert(pin(id) == 0);
+	assert(read(start_fd[0], &c, 1) == 1);
+	current_work->work(id);
+	return 0;
+}
+
+// run - the wall time of n workers of w, started at once
+static uint64_t run(struct workload *w, int n)
+{
+	thread_t tids[MAX_CPUS];
+	int pids[MAX_CPUS], i, exit_code;
+	char go[MAX_CPUS];
+	size_t size = n * NR_FAULT_PAGES * NR_FAULT_ROUNDS * PGSIZE;
+	current_work = w;
+	if (w->threads) {
+		shared_region = 0;
+		assert(mmap(&shared_region, size, MMAP_WRITE) == 0);
+	}
+	assert(pipe(start_fd) == 0);
+	for (i = 0; i < n; i++) {
+		if (w->threads) {
+			assert(thread(worker, (void *)(uintptr_t) i, tids + i)
+			       == 0);
+		} else if ((pids[i] = fork()) == 0) {
+			exit(worker((void *)(uintptr_t) i));
+		} else {
+			assert(pids[i] > 0);
+		}
+	}
+	memset(go, 0, sizeof(go));
+	uint64_t start = bench_now();
+	assert(write(start_fd[1], go, n) == n);
+	for (i = 0; i < n; i++) {
+		if (w->threads) {
+			assert(thread_wait(tids + i, &exit_code) == 0);
+		} else {
+			assert(waitpid(pids[i], &exit_code) == 0);
+		}
+		assert(exit_code == 0);
+	}
+	uint64_t total = bench_now() - start;
+	close(start_fd[0]), close(start_fd[1]);
+	if (w->threads) {
+		assert(munmap(shared_region, size) == 0);
+	}
+	return total;
+}
+
+// count_cpus - the cpus the harness can be pinned to
+static int count_cpus(void)
+{
+	int n = 0;
+	while (n < MAX_CPUS && pin(n) == 0) {
+		n++;
+	}
+	return n;
+}
+
+static void print_table(void)
+{
+	int i, n;
+	printf("%-14s", "cpus");
+	for (n = 1; n <= ncpus; n <<= 1) {
+		printf(" %6d", n);
+	}
+	printf("\n");
+	for (i = 0; i < NR_WORKLOADS; i++) {
+		struct workload *w = workloads + i;
+		if (w->skip) {
+			printf("%-14s skipped\n", w->name);
+			continue;
+		}
+		printf("%-14s", w->name);
+		for (n = 1; n <= ncpus; n <<= 1) {
+			uint64_t speedup = (uint64_t) w->per_op[1] * 100;
+			do_div(speedup, w->per_op[n] ? w->per_op[n] : 1);
+			printf(" %6llu", speedup);
+		}
+		printf("\n");
+	}
+}
+
+int main(void)
+{
+	char name[32];
+	int i, n;
+	assert((ncpus = count_cpus()) > 0);
+	/* the harness stays off the way of the workers but on cpu 0 */
+	assert(pin(0) == 0);
+	printf("scalebench on %d cpus\n", ncpus);
+	if (sys_kbench(KBENCH_KMALLOC, KMALLOC_BYTES, 0) == -E_UNIMP) {
+		workloads[NR_WORKLOADS - 1].skip = 1;
+	}
+	for (i = 0; i < NR_WORKLOADS; i++) {
+		struct workload *w = workloads + i;
+		if (w->skip) {
+			continue;
+		}
+		for (n = 1; n <= ncpus; n <<= 1) {
+			uint64_t total = run(w, n), per_op = total;
+			do_div(per_op, (uint32_t) (w->ops * n));
+			w->per_op[n] = (uint32_t) per_op;
+			snprintf(name, sizeof(name), "%s_%d", w->name, n);
+			printf("bench %s %d %llu %llu %s\n", name, w->ops * n,
+			       total, per_op, BENCH_UNIT);
+		}
+	}
+	print_table();
+	assert(pin(-1) == 0);
+	printf("scalebench pass.\n");
+	return 0;
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <error.h>
+
+/* more semaphores than the buckets of the hash of a process */
+#define NR_SEMS         300
+
+static sem_t sems[NR_SEMS];
+
+int main(void)
+{
+	int i, value, pid;
+	for (i = 0; i < NR_SEMS; i++) {
+		assert((sems[i] = sem_init(i)) > 0);
+	}
+	for (i = 0; i < NR_SEMS; i++) {
+		assert(sem_post(sems[i]) == 0);
+		assert(sem_get_value(sems[i], &value) == 0 && value == i + 1);
+	}
+	cprintf("semmanytest lookup pass.\n");
+
+	/* freed ones are gone, the others are not disturbed */
+	for (i = 0; i < NR_SEMS; i += 2) {
+		assert(sem_free(sems[i]) == 0);
+		assert(sem_post(sems[i]) == -E_INVAL);
+	}
+	for (i = 1; i < NR_SEMS; i += 2) {
+		assert(sem_wait(sems[i]) == 0);
+		assert(sem_get_value(sems[i], &value) == 0 && value == i);
+	}
+	assert(sem_post(sems[1] + 1) == -E_INVAL);
+	cprintf("semmanytest free pass.\n");
+
+	if ((pid = fork()) == 0) {
+		for (i = 0; i < NR_SEMS; i++) {
+			assert(sem_get_value(sems[i], &value)
+			       == ((i % 2) ? 0 : -E_INVAL));
+		}
+		for (i = 1; i < NR_SEMS; i += 2) {
+			assert(sem_post(sems[i]) == 0);
+		}
+		exit(0);
+	}
+	assert(pid > 0 && waitpid(pid, NULL) == 0);
+	for (i = 1; i < NR_SEMS; i += 2) {
+		assert(sem_get_value(sems[i], &value) == 0 && value == i + 1);
+	}
+	cprintf("semmanytest fork pass.\n");
+	cprintf("semmanytest pass.\n");
+	return 0;
+}
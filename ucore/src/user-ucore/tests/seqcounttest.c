@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <thread.h>
+#include <memorder.h>
+#include <seqcount.h>
+
+#define NR_READERS      3
+#define ROUNDS          20000
+
+static seqcount_t seq = SEQCNT_ZERO;
+static struct {
+	long a, b;		// b == -a but while written
+} pair;
+static volatile bool stop;
+
+static int reader(void *arg)
+{
+	long reads = 0;
+	while (!READ_ONCE(stop)) {
+		uint32_t s;
+		long a, b;
+		do {
+			s = read_seqcount_begin(&seq);
+			a = pair.a, b = pair.b;
+		} while (read_seqcount_retry(&seq, s));
+		if (a != -b) {
+			return -1;
+		}
+		reads++;
+	}
+	return reads > 0 ? 0 : -1;
+}
+
+static void test_seqcount(void)
+{
+	thread_t tids[NR_READERS];
+	int i, exit_code;
+	for (i = 0; i < NR_READERS; i++) {
+		assert(thread(reader, NULL, tids + i) == 0);
+	}
+	for (i = 1; i <= ROUNDS; i++) {
+		write_seqcount_begin(&seq);
+		pair.a = i;
+		if (i % 64 == 0) {
+			/* let a reader find the write in progress */
+			yield();
+		}
+		pair.b = -i;
+		write_seqcount_end(&seq);
+	}
+	assert(seq.sequence == 2 * ROUNDS);
+	WRITE_ONCE(stop, 1);
+	for (i = 0; i < NR_READERS; i++) {
+		assert(thread_wait(tids + i, &exit_code) == 0 && exit_code == 0);
+	}
+	cprintf("seqcounttest seqcount pass.\n");
+}
+
+static int data[64];
+static int ready;
+
+static int consumer(void *arg)
+{
+	int i;
+	while (smp_load_acquire(&ready) == 0) ;
+	for (i = 0; i < 64; i++) {
+		if (data[i] != i * 7) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void test_acquire_release(void)
+{
+	thread_t tid;
+	int i, exit_code;
+	assert(thread(consumer, NULL, &tid) == 0);
+	for (i = 0; i < 64; i++) {
+		data[i] = i * 7;
+	}
+	smp_store_release(&ready, 1);
+	assert(thread_wait(&tid, &exit_code) == 0 && exit_code == 0);
+	cprintf("seqcounttest release pass.\n");
+}
+
+int main(void)
+{
+	test_seqcount();
+	test_acquire_release();
+	cprintf("seqcounttest pass.\n");
+	return 0;
+}
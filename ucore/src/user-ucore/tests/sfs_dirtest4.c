@@ -0,0 +1,99 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stat.h>
+#include <file.h>
+#include <dir.h>
+#include <unistd.h>
+
+#define printf(...)                 fprintf(1, __VA_ARGS__)
+
+/* enough names to share the buckets of a hashed directory */
+#define NR_FILES                    1200
+
+static char *name(const char *prefix, int i)
+{
+	static char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%s%d", prefix, i);
+	return buffer;
+}
+
+static void create_files(const char *prefix)
+{
+	int i, fd;
+	for (i = 0; i < NR_FILES; i++) {
+		fd = open(name(prefix, i), O_CREAT | O_RDWR | O_EXCL);
+		assert(fd >= 0);
+		close(fd);
+	}
+}
+
+static void check_files(const char *prefix, bool exist)
+{
+	int i, fd;
+	for (i = 0; i < NR_FILES; i++) {
+		fd = open(name(prefix, i), O_RDONLY);
+		assert((fd >= 0) == exist);
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+}
+
+int main(void)
+{
+	static char newname[32];
+	struct stat __stat, *stat = &__stat;
+	int i, ret, fd;
+
+	ret = mkdir("/testdir/test/big");
+	assert(ret == 0);
+	ret = chdir("/testdir/test/big");
+	assert(ret == 0);
+
+	create_files("file");
+	check_files("file", 1);
+	printf("created %d files\n", NR_FILES);
+
+	/* every other name moves, the slots of the rest stay */
+	for (i = 0; i < NR_FILES; i += 2) {
+		strcpy(newname, name("moved", i));
+		ret = rename(name("file", i), newname);
+		assert(ret == 0);
+	}
+	for (i = 0; i < NR_FILES; i++) {
+		fd = open(name((i % 2 == 0) ? "moved" : "file", i), O_RDONLY);
+		assert(fd >= 0);
+		close(fd);
+		fd = open(name((i % 2 == 0) ? "file" : "moved", i), O_RDONLY);
+		assert(fd < 0);
+	}
+	printf("renamed %d files\n", NR_FILES / 2);
+
+	for (i = 0; i < NR_FILES; i++) {
+		ret = unlink(name((i % 2 == 0) ? "moved" : "file", i));
+		assert(ret == 0);
+	}
+	check_files("file", 0);
+
+	/* the freed slots are used again */
+	create_files("again");
+	fd = open(".", O_RDONLY);
+	assert(fd >= 0 && fstat(fd, stat) == 0);
+	close(fd);
+	assert(stat->st_blocks == NR_FILES);
+	check_files("again", 1);
+	for (i = 0; i < NR_FILES; i++) {
+		ret = unlink(name("again", i));
+		assert(ret == 0);
+	}
+	printf("removed %d files\n", NR_FILES * 2);
+
+	ret = chdir("/testdir/test");
+	assert(ret == 0);
+	ret = unlink("big");
+	assert(ret == 0);
+
+	printf("sfs_dirtest4 pass.\n");
+	return 0;
+}
@@ -0,0 +1,97 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stat.h>
+#include <file.h>
+#include <dir.h>
+#include <unistd.h>
+
+#define printf(...)                 fprintf(1, __VA_ARGS__)
+
+/* processes writing and reading back files of their own at the same time,
+ * the blocks they allocate and the inodes they load are shared state */
+#define NR_PROCS                    4
+#define NR_BLOCKS                   64
+#define NR_ROUNDS                   4
+#define BLKSIZE                     4096
+
+static char buffer[BLKSIZE];
+
+static char *name(int i)
+{
+	static char path[32];
+	snprintf(path, sizeof(path), "/testdir/test/io%d", i);
+	return path;
+}
+
+static void fill(int id, int blk)
+{
+	int i;
+	for (i = 0; i < BLKSIZE; i++) {
+		buffer[i] = (char)(id * 31 + blk * 7 + i);
+	}
+}
+
+static bool check(int id, int blk)
+{
+	int i;
+	for (i = 0; i < BLKSIZE; i++) {
+		if (buffer[i] != (char)(id * 31 + blk * 7 + i)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void worker(int id)
+{
+	struct stat __stat, *stat = &__stat;
+	int round, blk, fd;
+	for (round = 0; round < NR_ROUNDS; round++) {
+		if ((fd = open(name(id), O_CREAT | O_RDWR | O_TRUNC)) < 0) {
+			exit(-1);
+		}
+		for (blk = 0; blk < NR_BLOCKS; blk++) {
+			fill(id, blk);
+			if (write(fd, buffer, BLKSIZE) != BLKSIZE) {
+				exit(-2);
+			}
+		}
+		if (fstat(fd, stat) != 0 || stat->st_size != NR_BLOCKS * BLKSIZE) {
+			exit(-3);
+		}
+		close(fd);
+		if ((fd = open(name(id), O_RDONLY)) < 0) {
+			exit(-4);
+		}
+		for (blk = 0; blk < NR_BLOCKS; blk++) {
+			memset(buffer, 0, BLKSIZE);
+			if (read(fd, buffer, BLKSIZE) != BLKSIZE || !check(id, blk)) {
+				exit(-5);
+			}
+		}
+		close(fd);
+	}
+	if (unlink(name(id)) != 0) {
+		exit(-6);
+	}
+}
+
+int main(void)
+{
+	int pids[NR_PROCS], i, exit_code;
+	for (i = 0; i < NR_PROCS; i++) {
+		if ((pids[i] = fork()) == 0) {
+			worker(i);
+			exit(0);
+		}
+		assert(pids[i] > 0);
+	}
+	for (i = 0; i < NR_PROCS; i++) {
+		assert(waitpid(pids[i], &exit_code) == 0 && exit_code == 0);
+	}
+	printf("%d procs wrote and read back %d blocks\n", NR_PROCS,
+	       NR_PROCS * NR_ROUNDS * NR_BLOCKS);
+	printf("sfs_filetest4 pass.\n");
+	return 0;
+}
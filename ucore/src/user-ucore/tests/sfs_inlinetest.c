@@ -0,0 +1,136 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <dir.h>
+#include <unistd.h>
+#include <stat.h>
+
+#define printf(...)                 fprintf(1, __VA_ARGS__)
+
+/* the most an inode block holds of a file, and past it */
+#define INLINE_MAX                  (4096 - 128)
+#define FILESIZE                    (INLINE_MAX + 500)
+/* a directory holds 7 entries inline, . and .. aside */
+#define NR_FILES                    12
+
+static char buf[FILESIZE], buf2[FILESIZE];
+
+static void check_file(int fd, off_t pos, const char *data, size_t len)
+{
+	size_t n = 0;
+	assert(seek(fd, pos, LSEEK_SET) == 0);
+	while (n < len) {
+		int ret = read(fd, buf2 + n, len - n);
+		assert(ret > 0);
+		n += ret;
+	}
+	assert(memcmp(buf2, data, len) == 0);
+}
+
+static void write_at(int fd, off_t pos, const char *data, size_t len)
+{
+	assert(seek(fd, pos, LSEEK_SET) == 0);
+	assert(write(fd, (void *)data, len) == len);
+}
+
+static void test_file(void)
+{
+	struct stat stat;
+	int fd, i;
+	for (i = 0; i < FILESIZE; i++) {
+		buf[i] = (char)(i * 13 + 1);
+	}
+	assert((fd = open("small", O_CREAT | O_RDWR | O_TRUNC)) >= 0);
+	write_at(fd, 0, buf, 1000);
+	write_at(fd, 3000, buf + 3000, 500);
+	check_file(fd, 0, buf, 1000);
+	check_file(fd, 3000, buf + 3000, 500);
+	/* the hole between reads back as zeros */
+	memset(buf + 1000, 0, 2000);
+	check_file(fd, 0, buf, 3500);
+	assert(fstat(fd, &stat) == 0 && stat.st_size == 3500);
+
+	/* across the end of the inode block, the data moves out whole */
+	write_at(fd, INLINE_MAX - 100, buf + INLINE_MAX - 100, 600);
+	memset(buf + 3500, 0, INLINE_MAX - 100 - 3500);
+	check_file(fd, 0, buf, FILESIZE);
+	assert(fstat(fd, &stat) == 0 && stat.st_size == FILESIZE
+	       && stat.st_blocks == 2);
+	close(fd);
+
+	/* a shrink leaves no stale bytes behind for the next growth */
+	assert((fd = open("small2", O_CREAT | O_RDWR | O_TRUNC)) >= 0);
+	write_at(fd, 0, buf, 2000);
+	close(fd);
+	assert((fd = open("small2", O_RDWR | O_TRUNC)) >= 0);
+	write_at(fd, 1500, buf + 1500, 10);
+	assert(seek(fd, 0, LSEEK_SET) == 0 && read(fd, buf2, 1510) == 1510);
+	for (i = 0; i < 1500; i++) {
+		assert(buf2[i] == 0);
+	}
+	assert(memcmp(buf2 + 1500, buf + 1500, 10) == 0);
+	close(fd);
+	assert(unlink("small") == 0 && unlink("small2") == 0);
+	printf("sfs_inlinetest file pass.\n");
+}
+
+static char *name(int i)
+{
+	static char buffer[32];
+	snprintf(buffer, sizeof(buffer), "inl%d", i);
+	return buffer;
+}
+
+static int count_entries(void)
+{
+	DIR *dirp;
+	struct dirent *direntp;
+	int n = 0;
+	assert((dirp = opendir(".")) != NULL);
+	while ((direntp = readdir(dirp)) != NULL) {
+		n++;
+	}
+	closedir(dirp);
+	return n;
+}
+
+static void test_dir(void)
+{
+	int fd, i, len;
+	assert(mkdir("inline") == 0 && chdir("inline") == 0);
+	for (i = 0; i < NR_FILES; i++) {
+		assert((fd = open(name(i), O_CREAT | O_RDWR)) >= 0);
+		len = strlen(name(i));
+		assert(write(fd, name(i), len) == len);
+		close(fd);
+		/* the ones inline are found all the way past the spill */
+		assert(count_entries() == i + 3);
+	}
+	for (i = 0; i < NR_FILES; i++) {
+		assert((fd = open(name(i), O_RDONLY)) >= 0);
+		len = strlen(name(i));
+		assert(read(fd, buf, sizeof(buf)) == len);
+		assert(memcmp(buf, name(i), len) == 0);
+		close(fd);
+	}
+	for (i = 0; i < NR_FILES; i += 2) {
+		assert(unlink(name(i)) == 0);
+	}
+	assert(count_entries() == NR_FILES / 2 + 2);
+	for (i = 1; i < NR_FILES; i += 2) {
+		assert(unlink(name(i)) == 0);
+	}
+	assert(count_entries() == 2);
+	assert(chdir("..") == 0 && unlink("inline") == 0);
+	printf("sfs_inlinetest dir pass.\n");
+}
+
+int main(void)
+{
+	assert(chdir("/testdir/test") == 0);
+	test_file();
+	test_dir();
+	printf("sfs_inlinetest pass.\n");
+	return 0;
+}
@@ -0,0 +1,59 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <error.h>
+
+/* *
+ * Two processes with no map in common, the second exec'ed, share pages of
+ * a shared memory by its name; the pages outlive the name until the last
+ * map of them goes.
+ * */
+#define NAME                "shmopentest"
+#define SIZE                (64 * 4096)
+#define PGSIZE              4096
+
+static void child(void)
+{
+	uintptr_t addr = 0;
+	int i;
+	assert(shm_open(NAME, 0, MMAP_WRITE, &addr) == 0 && addr != 0);
+	for (i = 0; i < SIZE; i += PGSIZE) {
+		assert(*(int *)(addr + i) == i);
+		*(int *)(addr + i) = -i;
+	}
+	exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	uintptr_t addr = 0, again = 0;
+	int i, pid, exit_code;
+	if (argc == 2 && strcmp(argv[1], "child") == 0) {
+		child();
+	}
+
+	assert(shm_open(NAME, SIZE, MMAP_WRITE, &addr) == -E_NOENT);
+	assert(shm_open(NAME, SIZE, MMAP_WRITE | SHM_CREATE, &addr) == 0);
+	for (i = 0; i < SIZE; i += PGSIZE) {
+		*(int *)(addr + i) = i;
+	}
+	if ((pid = fork()) == 0) {
+		exec("/testbin/shmopentest", "child");
+		exit(-1);
+	}
+	assert(pid > 0 && waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	for (i = 0; i < SIZE; i += PGSIZE) {
+		assert(*(int *)(addr + i) == -i);
+	}
+
+	/* a second map of it shares the pages too */
+	assert(shm_open(NAME, 0, MMAP_WRITE, &again) == 0 && again != addr);
+	assert(*(int *)(again + PGSIZE) == -PGSIZE);
+
+	assert(shm_unlink(NAME) == 0 && shm_unlink(NAME) == -E_NOENT);
+	assert(*(int *)(addr + PGSIZE) == -PGSIZE);
+	assert(munmap(addr, SIZE) == 0 && munmap(again, SIZE) == 0);
+	cprintf("shmopentest pass.\n");
+	return 0;
+}
@@ -0,0 +1,46 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <error.h>
+
+#define STACKSIZE                       (4096 * 4)
+
+static volatile int shared = 0;
+
+int vfork_child(void *arg)
+{
+	/* the parent is asleep on this mm until the exec */
+	shared = 1;
+	exec("/testbin/spawntest", "vfork");
+	return 0xdead;
+}
+
+int main(int argc, char **argv)
+{
+	int pid, exit_code;
+	if (argc == 2) {
+		cprintf("child %s ok.\n", argv[1]);
+		return 0xbee;
+	}
+
+	const char *args[] = { "/testbin/spawntest", "spawn", NULL };
+	assert((pid = spawn(args, NULL)) > 0);
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0xbee);
+	cprintf("spawn ok.\n");
+
+	const char *bad[] = { "/testbin/nosuchfile", NULL };
+	assert(spawn(bad, NULL) < 0);
+	cprintf("spawn bad path ok.\n");
+
+	uintptr_t stack = 0;
+	assert(mmap(&stack, STACKSIZE, MMAP_WRITE | MMAP_STACK) == 0);
+	pid = clone(CLONE_VM | CLONE_VFORK, stack + STACKSIZE, vfork_child, NULL);
+	assert(pid > 0 && shared == 1);
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0xbee);
+	assert(munmap(stack, STACKSIZE) == 0);
+	cprintf("vfork ok.\n");
+
+	cprintf("spawntest pass.\n");
+	return 0;
+}
@@ -2,33 +2,102 @@
 #include <ulib.h>
 #include <string.h>
 #include <spipe.h>
-#include <malloc.h>
+
+/* the throughput of a spipe of the default size between two processes */
+
+#define TOTAL_BYTES     (4 << 20)
+#define CHUNK           1000
+#define NR_CLOSES       50
+
+static char buf[CHUNK];
+
+static void fill(size_t pos, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++) {
+		buf[i] = (char)((pos + i) % 251);
+	}
+}
+
+// close_in_child - fork a child that closes p, yielding first on odd i
+static int close_in_child(spipe_t * p, int i)
+{
+	int pid;
+	if ((pid = fork()) == 0) {
+		if (i & 1) {
+			yield();
+		}
+		spipeclose(p);
+		exit(0);
+	}
+	assert(pid > 0);
+	return pid;
+}
+
+// test_close - close the pipe while the other side waits on it, with the
+//            - child going first or not: the reader gets 0, and the writer
+//            - of a full pipe writes nothing
+static void test_close(void)
+{
+	spipe_t p;
+	size_t pos;
+	int i, pid, exit_code;
+	for (i = 0; i < NR_CLOSES; i++) {
+		assert(spipe(&p) == 0);
+		pid = close_in_child(&p, i);
+		assert(spiperead(&p, buf, sizeof(buf)) == 0);
+		assert(spipeisclosed(&p));
+		assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+
+		assert(spipe(&p) == 0);
+		for (pos = 0; pos < SPIPE_SIZE;) {
+			size_t n = SPIPE_SIZE - pos;
+			pos += spipewrite(&p, buf, (n < CHUNK) ? n : CHUNK);
+		}
+		pid = close_in_child(&p, i);
+		assert(spipewrite(&p, buf, 1) == 0);
+		assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
+		assert(spipeclose(&p) == 0);
+	}
+	cprintf("spipe close ok\n");
+}
 
 int main(void)
 {
 	spipe_t pipe;
 	assert(spipe(&pipe) == 0);
 
-	int i, pid;
+	size_t pos, n;
+	int pid, exit_code;
 	if ((pid = fork()) == 0) {
-		for (i = 0; i < 10; i++) {
-			yield();
-		}
-		if (spipewrite(&pipe, "A", 1) == 1) {
-			cprintf("child write ok\n");
+		for (pos = 0; pos < TOTAL_BYTES; pos += n) {
+			n = TOTAL_BYTES - pos;
+			if (n > CHUNK) {
+				n = CHUNK;
+			}
+			fill(pos, n);
+			assert(spipewrite(&pipe, buf, n) == n);
 		}
+		cprintf("child write ok\n");
 		spipeclose(&pipe);
 		exit(0);
 	}
 	assert(pid > 0);
 
-	sleep(100);
-	int len;
-	char buf[100];
-	assert((len = spiperead(&pipe, buf, sizeof(buf))) == 1
-	       && buf[0] == 'A');
-	assert(spipeclose(&pipe) == 0);
+	unsigned int start = gettime_msec(), msec;
+	for (pos = 0; (n = spiperead(&pipe, buf, sizeof(buf))) != 0; pos += n) {
+		size_t i;
+		for (i = 0; i < n; i++) {
+			assert(buf[i] == (char)((pos + i) % 251));
+		}
+	}
+	msec = gettime_msec() - start;
+	assert(pos == TOTAL_BYTES && spipeisclosed(&pipe));
+	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
 	cprintf("parent read ok\n");
+	cprintf("%d bytes in %d ms, %d KB/s\n", TOTAL_BYTES, msec,
+		(msec != 0) ? (TOTAL_BYTES / 1024) * 1000 / msec : 0);
+	test_close();
 	cprintf("spipetest pass\n");
 	return 0;
 }
@@ -2,109 +2,65 @@
 #include <ulib.h>
 #include <string.h>
 #include <spipe.h>
-#include <malloc.h>
-#include <string.h>
 #include <thread.h>
 
-static spipe_t pipe;
-
-thread_t tids[10];
-int total = sizeof(tids) / sizeof(tids[0]);
-
-int thread_main(void *arg)
-{
-	long id = (long)arg;
-	cprintf("this is %d\n", id);
+/* the throughput of spipes of several sizes between two threads, for
+ * several sizes of writes */
 
-	size_t n = 10000;
-	char *buf = malloc(sizeof(char) * n);
-	if (buf == NULL) {
-		return -1;
-	}
+#define TOTAL_BYTES     (8 << 20)
+#define MAX_CHUNK       16384
 
-	memset(buf, (char)id, n);
+static spipe_t pipe;
+static size_t chunk;
+static char wbuf[MAX_CHUNK], rbuf[MAX_CHUNK];
 
-	int i, rounds = 20;
-	for (i = 0; i < rounds; i++) {
-		size_t ret = spipewrite(&pipe, buf, n);
-		if (ret != n) {
+int writer_main(void *arg)
+{
+	size_t pos, n;
+	for (pos = 0; pos < TOTAL_BYTES; pos += n) {
+		n = (TOTAL_BYTES - pos < chunk) ? TOTAL_BYTES - pos : chunk;
+		wbuf[0] = (char)pos;
+		if (spipewrite(&pipe, wbuf, n) != n) {
 			cprintf("pipe is closed, too early.\n");
 			return -1;
 		}
-		if (id == 0) {
-			cprintf("send %d/%d\n", i, rounds);
-		}
 	}
 	return 0;
 }
 
-void process_main(void)
+static void bench(size_t size, size_t csize)
 {
-	int counts[total], i;
-	for (i = 0; i < total; i++) {
-		counts[i] = 0;
+	thread_t tid;
+	size_t total = 0, n;
+	int exit_code;
+	assert(spipecreate(&pipe, size) == 0);
+	chunk = csize;
+	unsigned int start = gettime_msec(), msec;
+	assert(thread(writer_main, NULL, &tid) == 0);
+	while (total < TOTAL_BYTES) {
+		assert((n = spiperead(&pipe, rbuf, sizeof(rbuf))) != 0);
+		total += n;
 	}
-
-	char buf[128];
-	size_t n = sizeof(buf);
-
-	while (1) {
-		size_t ret = spiperead(&pipe, buf, n);
-		if (ret == 0) {
-			break;
-		}
-		for (i = 0; i < ret; i++) {
-			counts[((unsigned int)buf[i]) % total]++;
-		}
+	assert(thread_wait(&tid, &exit_code) == 0 && exit_code == 0);
+	msec = gettime_msec() - start;
+	if (spipeclose(&pipe) != 0) {
+		cprintf("spipe close failed.\n");
 	}
-	if (spipeisclosed(&pipe)) {
-		for (i = 0; i < total; i++) {
-			cprintf("%d reads %d\n", i, counts[i]);
-		}
-		exit(0);
-	}
-	exit(0xbad);
+	cprintf("%6d byte pipe, %5d byte writes: %4d ms, %6d KB/s\n",
+		(int)size, (int)csize, msec,
+		(msec != 0) ? (TOTAL_BYTES / 1024) * 1000 / msec : 0);
 }
 
 int main(void)
 {
-	int pid, i;
-	assert(spipe(&pipe) == 0);
-
-	if ((pid = fork()) == 0) {
-		process_main();
-	}
-	assert(pid > 0);
-
-	memset(tids, 0, sizeof(thread_t) * total);
-	for (i = 0; i < total; i++) {
-		if (thread(thread_main, (void *)(long)i, tids + i) != 0) {
-			goto failed;
-		}
-	}
-
-	int exit_code;
-	for (i = 0; i < total; i++) {
-		if (thread_wait(tids + i, &exit_code) != 0 || exit_code != 0) {
-			goto failed;
+	static const size_t sizes[] = { 4096, 16384, 65536 };
+	static const size_t chunks[] = { 64, 1024, MAX_CHUNK };
+	int i, j;
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		for (j = 0; j < sizeof(chunks) / sizeof(chunks[0]); j++) {
+			bench(sizes[i], chunks[j]);
 		}
 	}
-
-	for (i = 0; i < total; i++) {
-		yield();
-	}
-
-	assert(spipeclose(&pipe) == 0);
-	assert(waitpid(pid, &exit_code) == 0 && exit_code == 0);
 	cprintf("spipetest2 pass.\n");
 	return 0;
-
-failed:
-	for (i = 0; i < total; i++) {
-		if (tids[i].pid > 0) {
-			kill(tids[i].pid);
-		}
-	}
-	kill(pid);
-	panic("FAIL: T.T\n");
 }
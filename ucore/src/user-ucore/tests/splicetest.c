@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <error.h>
+
+#define BIGSIZE         (64 * 1024)
+
+static char buf[BIGSIZE], buf2[4096];
+
+static void test_pipe_size(void)
+{
+	int fd[2], i, len;
+	assert(pipe(fd) == 0);
+	assert(fcntl(fd[0], F_GETPIPE_SZ, 0) == 4 * 4096);
+	assert(fcntl(fd[1], F_SETPIPE_SZ, 0) == -E_INVAL);
+	assert(fcntl(fd[1], F_SETPIPE_SZ, BIGSIZE - 100) == BIGSIZE);
+
+	/* fits without a reader */
+	for (i = 0; i < BIGSIZE; i++) {
+		buf[i] = (char)i;
+	}
+	assert(write(fd[1], buf, BIGSIZE) == BIGSIZE);
+	assert(fcntl(fd[1], F_SETPIPE_SZ, 4096) == -E_BUSY);
+
+	memset(buf, 0, BIGSIZE);
+	for (len = 0; len < BIGSIZE;) {
+		int n = read(fd[0], buf + len, BIGSIZE - len);
+		assert(n > 0);
+		len += n;
+	}
+	for (i = 0; i < BIGSIZE; i++) {
+		assert(buf[i] == (char)i);
+	}
+	assert(fcntl(fd[1], F_SETPIPE_SZ, 4096) == 4096);
+	close(fd[0]), close(fd[1]);
+	cprintf("splicetest pipe size pass.\n");
+}
+
+static void test_tee(void)
+{
+	int p1[2], p2[2], p3[2];
+	assert(pipe(p1) == 0 && pipe(p2) == 0 && pipe(p3) == 0);
+	assert(write(p1[1], "hello", 5) == 5);
+	assert(tee(p1[0], p2[1], 100) == 5);
+	assert(tee(p1[0], p2[0], 100) == -E_INVAL);
+	assert(splice(p1[0], p3[1], 3) == 3);
+	assert(read(p2[0], buf2, sizeof(buf2)) == 5
+	       && memcmp(buf2, "hello", 5) == 0);
+	assert(read(p3[0], buf2, sizeof(buf2)) == 3
+	       && memcmp(buf2, "hel", 3) == 0);
+	assert(read(p1[0], buf2, sizeof(buf2)) == 2
+	       && memcmp(buf2, "lo", 2) == 0);
+	close(p1[0]), close(p1[1]), close(p2[0]), close(p2[1]);
+	close(p3[0]), close(p3[1]);
+	cprintf("splicetest tee pass.\n");
+}
+
+static void test_file(void)
+{
+	int fd[2], file, n, len = 0;
+	assert(pipe(fd) == 0);
+	assert((file = open("/testbin/splicetest", O_RDONLY)) >= 0);
+	assert((n = splice(file, fd[1], sizeof(buf2))) > 0);
+	assert(read(fd[0], buf2, sizeof(buf2)) == n);
+	assert(seek(file, 0, LSEEK_SET) == 0);
+	while (len < n) {
+		int ret = read(file, buf + len, n - len);
+		assert(ret > 0);
+		len += ret;
+	}
+	assert(memcmp(buf, buf2, n) == 0);
+	close(file);
+
+	const char *msg = "splice to stdout ok.\n";
+	assert(write(fd[1], (void *)msg, strlen(msg)) == strlen(msg));
+	assert(splice(fd[0], 1, strlen(msg)) == strlen(msg));
+	close(fd[0]), close(fd[1]);
+	cprintf("splicetest file pass.\n");
+}
+
+int main(void)
+{
+	test_pipe_size();
+	test_tee();
+	test_file();
+	cprintf("splicetest pass.\n");
+	return 0;
+}
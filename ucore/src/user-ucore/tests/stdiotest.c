@@ -0,0 +1,58 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+
+/* *
+ * The buffering of fds: what a pipe gets is read back, so that each mode
+ * is seen writing when it should and no later; the output buffered
+ * before a fork is written once, by the parent.
+ * */
+static int p[2];
+
+static int pending(void)
+{
+	char buf[64];
+	int n = 0, ret;
+	assert(fprintf(p[1], "$") == 1 && fflush(p[1]) == 0);
+	while ((ret = read(p[0], buf, sizeof(buf))) > 0) {
+		n += ret;
+		if (buf[ret - 1] == '$') {
+			break;
+		}
+	}
+	return n - 1;
+}
+
+int main(void)
+{
+	int pid, exit_code;
+	assert(pipe(p) == 0 && p[1] < 8);
+
+	/* the others are unbuffered by default, one write per call */
+	fprintf(p[1], "abc");
+	assert(pending() == 3);
+
+	assert(setvbuf(p[1], _IOLBF) == 0);
+	fprintf(p[1], "abc");
+	fprintf(p[1], "de");
+	assert(setvbuf(p[1], _IOFBF) == 0);
+	assert(pending() == 5);
+
+	fprintf(p[1], "line\n");
+	assert(setvbuf(p[1], _IONBF) == 0);
+	assert(pending() == 5);
+
+	assert(setvbuf(p[1], 42) != 0 && setvbuf(1000, _IONBF) != 0);
+
+	/* the stdout line a fork must not write twice */
+	assert(setvbuf(1, _IOFBF) == 0);
+	cprintf("stdiotest before fork.\n");
+	if ((pid = fork()) == 0) {
+		exit(0);
+	}
+	assert(pid > 0 && waitpid(pid, &exit_code) == 0 && exit_code == 0);
+	assert(setvbuf(1, _IOLBF) == 0);
+	cprintf("stdiotest pass.\n");
+	return 0;
+}
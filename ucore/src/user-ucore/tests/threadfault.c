@@ -0,0 +1,76 @@
+#include <ulib.h>
+#include <thread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* *
+ * All threads fault on the same fresh pages at once, each one writing its
+ * own slot of every page. A fault that mapped a second page over the one
+ * another thread already wrote to would lose slots.
+ * */
+
+#define PGSIZE          4096
+#define NPAGES          64
+#define NTHREADS        8
+
+volatile char *region;
+thread_t tids[NTHREADS];
+
+int work(void *arg)
+{
+	long n = (long)arg;
+	int i, sum = 0;
+	yield();
+	for (i = 0; i < NPAGES; i++) {
+		volatile int *slot = (volatile int *)(region + i * PGSIZE) + n;
+		sum += *slot;
+		*slot = (int)(n << 16 | i);
+	}
+	return (sum == 0) ? 0xbee : 0;
+}
+
+int main(void)
+{
+	uintptr_t addr = 0;
+	int i, n, ret;
+	assert(mmap(&addr, NPAGES * PGSIZE, MMAP_WRITE) == 0 && addr != 0);
+	region = (volatile char *)addr;
+
+	memset(tids, 0, sizeof(tids));
+	for (n = 0; n < NTHREADS; n++) {
+		if ((ret = thread(work, (void *)(long)n, tids + n)) != 0) {
+			cprintf("thread %d failed, returns %d\n", n, ret);
+			goto failed;
+		}
+	}
+	cprintf("thread ok.\n");
+
+	for (n = 0; n < NTHREADS; n++) {
+		int exit_code = 0;
+		if (thread_wait(tids + n, &exit_code) != 0 || exit_code != 0xbee) {
+			cprintf("thread %d exit failed, %d\n", n, exit_code);
+			goto failed;
+		}
+	}
+	cprintf("thread wait ok.\n");
+
+	for (i = 0; i < NPAGES; i++) {
+		for (n = 0; n < NTHREADS; n++) {
+			volatile int *slot = (volatile int *)(region + i * PGSIZE) + n;
+			assert(*slot == (int)(n << 16 | i));
+		}
+	}
+	assert(munmap(addr, NPAGES * PGSIZE) == 0);
+
+	cprintf("threadfault pass.\n");
+	return 0;
+
+failed:
+	for (n = 0; n < NTHREADS; n++) {
+		if (tids[n].pid > 0) {
+			kill(tids[n].pid);
+		}
+	}
+	panic("FAIL: T.T\n");
+}
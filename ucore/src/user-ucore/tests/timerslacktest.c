@@ -0,0 +1,50 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <error.h>
+
+/* *
+ * The timer slack of a process: set and read back with SYS_timerslack, kept
+ * by a child forked, refused past the most there may be; the children sleep
+ * no less than they asked and no later than the slack allows, and with no
+ * slack no later than asked. One more tick is allowed for the tick the
+ * sleep starts in.
+ * */
+#define SLACK               32
+#define NR_CHILD            4
+
+static void check_sleep(unsigned int ticks, unsigned int slack)
+{
+	unsigned int start = gettime_msec(), slept;
+	sleep(ticks);
+	slept = gettime_msec() - start;
+	assert(slept >= ticks && slept <= ticks + slack + 1);
+}
+
+int main(void)
+{
+	int i, pids[NR_CHILD], exit_code;
+	assert(sys_timerslack(0, -1) == 0);
+	assert(sys_timerslack(0, SLACK) == 0);
+	assert(sys_timerslack(0, -1) == SLACK);
+	assert(sys_timerslack(0, 100000) == -E_INVAL);
+	assert(sys_timerslack(0, -1) == SLACK);
+
+	for (i = 0; i < NR_CHILD; i++) {
+		if ((pids[i] = fork()) == 0) {
+			assert(sys_timerslack(0, -1) == SLACK);
+			check_sleep(10 + i, SLACK);
+			exit(0);
+		}
+		assert(pids[i] > 0);
+	}
+	for (i = 0; i < NR_CHILD; i++) {
+		assert(waitpid(pids[i], &exit_code) == 0 && exit_code == 0);
+	}
+
+	assert(sys_timerslack(0, 0) == SLACK);
+	check_sleep(10, 0);
+	cprintf("timerslacktest pass.\n");
+	return 0;
+}
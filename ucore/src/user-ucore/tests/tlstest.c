@@ -0,0 +1,44 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <thread.h>
+
+/* each thread sees its own block and values under the same key */
+#define NTHREADS    4
+
+static int key;
+
+int test(void *arg)
+{
+	int i;
+	thread_tls_t *tls = thread_self();
+	assert(tls != NULL && tls->self == tls);
+	assert(thread_getspecific(key) == NULL);
+	for (i = 0; i < 10; i++) {
+		assert(thread_setspecific(key, (char *)arg + i) == 0);
+		yield();
+		if (thread_getspecific(key) != (char *)arg + i) {
+			panic("tls value of thread %d lost.\n", (int)(uintptr_t) arg);
+		}
+	}
+	assert(thread_self() == tls);
+	return (int)(uintptr_t) arg;
+}
+
+int main(void)
+{
+	thread_t tids[NTHREADS];
+	int i, exit_code;
+	assert(thread_self()->self == thread_self());
+	assert(thread_key_create(&key) == 0);
+	assert(thread_setspecific(key, main) == 0);
+	for (i = 0; i < NTHREADS; i++) {
+		assert(thread(test, (void *)(uintptr_t) (i + 1), tids + i) == 0);
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		assert(thread_wait(tids + i, &exit_code) == 0
+		       && exit_code == i + 1);
+	}
+	assert(thread_getspecific(key) == main);
+	cprintf("tlstest pass.\n");
+	return 0;
+}
@@ -0,0 +1,56 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <thread.h>
+#include <tpool.h>
+
+/* fork-join fib on a pool, then short threads on the cached stacks */
+#define NWORKERS    4
+#define FIB_N       20
+#define FIB_CUTOFF  8
+
+static tpool_t pool;
+
+static int fib_serial(int n)
+{
+	return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+static int fib(void *arg)
+{
+	int n = (int)(uintptr_t) arg, x;
+	tpool_task_t task;
+	if (n < FIB_CUTOFF) {
+		return fib_serial(n);
+	}
+	tpool_spawn(&pool, &task, fib, (void *)(uintptr_t) (n - 1));
+	x = fib((void *)(uintptr_t) (n - 2));
+	return x + tpool_join(&pool, &task);
+}
+
+static int child(void *arg)
+{
+	/* deep enough to touch the whole reused stack top */
+	volatile char buf[1024];
+	buf[0] = (char)(uintptr_t) arg;
+	return buf[0];
+}
+
+int main(void)
+{
+	tpool_task_t task;
+	thread_t tid;
+	int i, exit_code;
+
+	assert(tpool_init(&pool, NWORKERS) == 0);
+	tpool_spawn(&pool, &task, fib, (void *)FIB_N);
+	assert(tpool_join(&pool, &task) == fib_serial(FIB_N));
+	tpool_destroy(&pool);
+	cprintf("fork-join ok.\n");
+
+	for (i = 0; i < 100; i++) {
+		assert(thread(child, (void *)(uintptr_t) i, &tid) == 0);
+		assert(thread_wait(&tid, &exit_code) == 0 && exit_code == i);
+	}
+	cprintf("tpooltest pass.\n");
+	return 0;
+}
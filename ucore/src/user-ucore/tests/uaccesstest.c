@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <unistd.h>
+#include <stat.h>
+#include <file.h>
+
+/* syscalls copying to and from a buffer running into an unmapped page fail
+ * with an error, a mapped one not touched yet is faulted in by the copy */
+#define PAGE        4096
+
+int main(void)
+{
+	uintptr_t addr = 0;
+	struct stat *stat;
+	char *edge;
+
+	assert(mmap(&addr, 2 * PAGE, MMAP_WRITE) == 0 && addr != 0);
+	assert(munmap(addr + PAGE, PAGE) == 0);
+	edge = (char *)addr + PAGE;
+
+	stat = (struct stat *)(edge - sizeof(struct stat));
+	assert(fstat(1, stat) == 0);
+	stat = (struct stat *)(edge - sizeof(struct stat) / 2);
+	assert(fstat(1, stat) != 0);
+	cprintf("copy to user ok.\n");
+
+	edge[-2] = '.', edge[-1] = '\n';
+	assert(write(1, edge - 2, 2) == 2);
+	assert(write(1, edge - 2, 4) < 0);
+	cprintf("copy from user ok.\n");
+
+	assert(munmap(addr, PAGE) == 0);
+	cprintf("uaccesstest pass.\n");
+	return 0;
+}
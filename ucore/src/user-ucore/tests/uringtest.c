@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <string.h>
+#include <file.h>
+#include <unistd.h>
+#include <uring.h>
+#include <error.h>
+
+#define NREQS           16
+#define NR_DESTROYS     50
+
+static char buf[NREQS][64];
+
+static void test_ring(bool sqthread)
+{
+	struct uring_sqe *sqe;
+	struct uring_cqe cqe;
+	uring_t u;
+	int fd[2], i;
+	assert(uring_create(&u, 8, sqthread) == 0 && pipe(fd) == 0);
+
+	/* more than the ring holds: submit in two batches */
+	for (i = 0; i < NREQS; i++) {
+		if ((sqe = uring_get_sqe(&u)) == NULL) {
+			assert(i == 8);
+			assert(uring_submit(&u) == 8);
+			assert(uring_wait_cqe(&u, &cqe) == 0 && cqe.res == 3);
+			assert(cqe.user_data == 0);
+			int j;
+			for (j = 1; j < 8; j++) {
+				assert(uring_wait_cqe(&u, &cqe) == 0);
+				assert(cqe.user_data == j && cqe.res == 3);
+			}
+			assert((sqe = uring_get_sqe(&u)) != NULL);
+		}
+		snprintf(buf[i], sizeof(buf[i]), "%03d", i);
+		sqe->opcode = URING_OP_WRITE, sqe->fd = fd[1];
+		sqe->addr = (uintptr_t) buf[i], sqe->len = 3;
+		sqe->user_data = i;
+	}
+	assert(uring_submit(&u) == NREQS - 8);
+	for (i = 8; i < NREQS; i++) {
+		assert(uring_wait_cqe(&u, &cqe) == 0);
+		assert(cqe.user_data == i && cqe.res == 3);
+	}
+	assert(uring_peek_cqe(&u, &cqe) == -E_AGAIN);
+
+	assert((sqe = uring_get_sqe(&u)) != NULL);
+	sqe->opcode = URING_OP_READ, sqe->fd = fd[0];
+	sqe->addr = (uintptr_t) buf[0], sqe->len = NREQS * 3;
+	assert((sqe = uring_get_sqe(&u)) != NULL);
+	sqe->opcode = URING_OP_CLOSE, sqe->fd = fd[1];
+	assert((sqe = uring_get_sqe(&u)) != NULL);
+	sqe->opcode = 100;
+	assert(uring_submit(&u) == 3);
+	assert(uring_wait_cqe(&u, &cqe) == 0 && cqe.res == NREQS * 3);
+	assert(memcmp(buf[0], "000001002", 9) == 0);
+	assert(uring_wait_cqe(&u, &cqe) == 0 && cqe.res == 0);
+	assert(uring_wait_cqe(&u, &cqe) == 0 && cqe.res == -E_INVAL);
+	assert(uring_wait_cqe(&u, &cqe) == -E_AGAIN);
+
+	close(fd[0]);
+	assert(uring_destroy(&u) == 0);
+	cprintf("uringtest %s pass.\n", sqthread ? "sqthread" : "enter");
+}
+
+// test_destroy - destroy rings while the submission thread goes to sleep
+//              - or sleeps already, it has to stop every time
+static void test_destroy(void)
+{
+	uring_t u;
+	int i;
+	for (i = 0; i < NR_DESTROYS; i++) {
+		assert(uring_create(&u, 8, 1) == 0);
+		if (i & 1) {
+			yield();
+		}
+		assert(uring_destroy(&u) == 0);
+	}
+	cprintf("uringtest destroy pass.\n");
+}
+
+int main(void)
+{
+	test_ring(0);
+	test_ring(1);
+	test_destroy();
+	cprintf("uringtest pass.\n");
+	return 0;
+}
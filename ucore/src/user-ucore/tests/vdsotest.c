@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <ulib.h>
+#include <vdso.h>
+
+static long long nsec_of(struct timespec *ts)
+{
+	return (long long)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+int main(void)
+{
+	struct timespec a, b;
+	int i;
+	assert(clock_gettime(CLOCK_MONOTONIC, &a) == 0);
+	for (i = 0; i < 100000; i++) {
+		assert(clock_gettime(CLOCK_MONOTONIC, &b) == 0);
+		assert(b.tv_nsec >= 0 && b.tv_nsec < 1000000000);
+		assert(nsec_of(&b) >= nsec_of(&a));
+		a = b;
+	}
+	cprintf("vdsotest monotonic pass.\n");
+
+	/* the page follows the clock tick */
+	unsigned int start = gettime_msec();
+	sleep(10);
+	assert(clock_gettime(CLOCK_MONOTONIC, &b) == 0);
+	assert(gettime_msec() - start >= 10);
+	assert(nsec_of(&b) - nsec_of(&a) >= 90000000LL);
+	cprintf("vdsotest tick pass.\n");
+
+	/* step, then slew the realtime clock */
+	struct timeval tv = { 1000000000, 0 }, delta = { 1, 0 }, old;
+	assert(settimeofday(&tv) == 0);
+	assert(gettimeofday(&tv) == 0 && tv.tv_sec == 1000000000);
+	assert(clock_gettime(CLOCK_REALTIME, &b) == 0
+	       && b.tv_sec == 1000000000);
+	assert(adjtime(&delta, NULL) == 0);
+	sleep(10);
+	delta.tv_sec = 0;
+	assert(adjtime(&delta, &old) == 0);
+	/* 500us a second */
+	assert(old.tv_sec == 0 && old.tv_usec > 900000
+	       && old.tv_usec < 1000000);
+	cprintf("vdsotest realtime pass.\n");
+
+	assert(clock_gettime(CLOCK_MONOTONIC, &a) == 0);
+	if (fork() == 0) {
+		assert(clock_gettime(CLOCK_MONOTONIC, &b) == 0
+		       && nsec_of(&b) >= nsec_of(&a));
+		exit(0);
+	}
+	assert(wait() == 0);
+	cprintf("vdsotest pass.\n");
+	return 0;
+}
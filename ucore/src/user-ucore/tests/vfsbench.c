@@ -0,0 +1,57 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <stat.h>
+#include <file.h>
+#include <unistd.h>
+
+#define printf(...)                     fprintf(1, __VA_ARGS__)
+
+/* open/fstat/close of one path from a growing number of processes, the
+ * lookups all go through the same root and testbin directories */
+#define NR_LOOPS        2000
+#define MAX_PROCS       8
+#define PATH            "/testbin/vfsbench"
+
+static void bench(void)
+{
+	struct stat __stat, *stat = &__stat;
+	int i, fd;
+	for (i = 0; i < NR_LOOPS; i++) {
+		if ((fd = open(PATH, O_RDONLY)) < 0) {
+			exit(-1);
+		}
+		if (fstat(fd, stat) != 0) {
+			exit(-2);
+		}
+		close(fd);
+	}
+}
+
+static unsigned int run(int nprocs)
+{
+	int pids[MAX_PROCS], i, exit_code;
+	unsigned int start = gettime_msec();
+	for (i = 0; i < nprocs; i++) {
+		if ((pids[i] = fork()) == 0) {
+			bench();
+			exit(0);
+		}
+		assert(pids[i] > 0);
+	}
+	for (i = 0; i < nprocs; i++) {
+		assert(waitpid(pids[i], &exit_code) == 0 && exit_code == 0);
+	}
+	return gettime_msec() - start;
+}
+
+int main(void)
+{
+	int nprocs;
+	for (nprocs = 1; nprocs <= MAX_PROCS; nprocs <<= 1) {
+		unsigned int msec = run(nprocs);
+		printf("%d procs: %d lookups in %d msec\n", nprocs,
+		       nprocs * NR_LOOPS, msec);
+	}
+	printf("vfsbench pass.\n");
+	return 0;
+}
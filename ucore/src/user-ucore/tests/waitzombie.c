@@ -0,0 +1,31 @@
+#include <ulib.h>
+#include <stdio.h>
+
+/* *
+ * The exited children are waited for oldest first, and a wait for one pid
+ * takes that one whatever exited before it.
+ * */
+#define NR_CHILD            8
+
+int main(void)
+{
+	int pids[NR_CHILD], i, code;
+	for (i = 0; i < NR_CHILD; i++) {
+		if ((pids[i] = fork()) == 0) {
+			/* the last forked exits first */
+			sleep(5 * (NR_CHILD - i));
+			exit(i);
+		}
+		assert(pids[i] > 0);
+	}
+
+	/* the first forked exits last, after all the others are zombies */
+	assert(waitpid(pids[0], &code) == 0 && code == 0);
+
+	for (i = NR_CHILD - 1; i > 0; i--) {
+		assert(waitpid(0, &code) == 0 && code == i);
+	}
+	assert(wait() != 0);
+	cprintf("waitzombie pass.\n");
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <syscall.h>
+#include <tracebuf.h>
+
+/* the consumer of the kernel event rings, see tracebuf.h */
+#define TRACE_MAX_CPUS              64
+#define TRACE_POLL_TICKS            10
+
+static const char *event_names[TRACE_NR_EVENTS] = {
+	[TRACE_SCHED_SWITCH] "switch",
+	[TRACE_SCHED_WAKEUP] "wakeup",
+	[TRACE_PAGE_FAULT] "fault",
+	[TRACE_BLOCK_SUBMIT] "blk_submit",
+	[TRACE_BLOCK_COMPLETE] "blk_complete",
+	[TRACE_SYSCALL_ENTER] "sys_enter",
+	[TRACE_SYSCALL_EXIT] "sys_exit",
+	[TRACE_SWAP_OUT] "swap_out",
+	[TRACE_SWAP_IN] "swap_in",
+	[TRACE_IPI_SEND] "ipi",
+};
+
+static struct trace_ring *rings[TRACE_MAX_CPUS];
+static uint32_t pos[TRACE_MAX_CPUS];
+static uint32_t lost;
+
+#define trace_barrier()         __asm__ __volatile__ ("" ::: "memory")
+
+static int usage(void)
+{
+	int i;
+	cprintf("usage: trace [-t msec] all | <event>...\n");
+	cprintf("       <event> is");
+	for (i = 0; i < TRACE_NR_EVENTS; i++) {
+		cprintf(" %s", event_names[i]);
+	}
+	cprintf("\n");
+	return -1;
+}
+
+// drain - print the events of ring since the last call
+static void drain(int cpu)
+{
+	struct trace_ring *ring = rings[cpu];
+	struct trace_event *events = TRACE_EVENTS(ring), e;
+	uint32_t head = ring->head;
+	if (head - pos[cpu] > ring->entries) {
+		lost += head - pos[cpu] - ring->entries;
+		pos[cpu] = head - ring->entries;
+	}
+	for (; pos[cpu] != head; pos[cpu]++) {
+		struct trace_event *slot = events + pos[cpu] % ring->entries;
+		if (slot->seq != pos[cpu] + 1) {
+			lost++;
+			continue;
+		}
+		trace_barrier();
+		e = *slot;
+		trace_barrier();
+		/* overwritten while copied */
+		if (slot->seq != pos[cpu] + 1) {
+			lost++;
+			continue;
+		}
+		cprintf("%d %llu %d %s %llx %lld\n", cpu, e.ns, e.pid,
+			(e.id < TRACE_NR_EVENTS) ? event_names[e.id] : "?",
+			e.arg[0], (int64_t) e.arg[1]);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t mask = 0;
+	unsigned int msec = 1000, start;
+	int i, j, ncpus, ret;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			msec = strtol(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "all") == 0) {
+			mask = TRACE_MASK_ALL;
+		} else {
+			for (j = 0; j < TRACE_NR_EVENTS; j++) {
+				if (strcmp(argv[i], event_names[j]) == 0) {
+					mask |= TRACE_MASK(j);
+					break;
+				}
+			}
+			if (j == TRACE_NR_EVENTS) {
+				return usage();
+			}
+		}
+	}
+	if (mask == 0) {
+		return usage();
+	}
+	if ((ret = sys_trace(TRACE_ENABLE, mask, NULL)) != 0) {
+		cprintf("trace: enable failed, %e.\n", ret);
+		return ret;
+	}
+	for (ncpus = 0; ncpus < TRACE_MAX_CPUS; ncpus++) {
+		uintptr_t addr;
+		if (sys_trace(TRACE_MAP, ncpus, &addr) != 0) {
+			break;
+		}
+		rings[ncpus] = (struct trace_ring *)addr;
+		pos[ncpus] = rings[ncpus]->head;
+	}
+	start = gettime_msec();
+	do {
+		sleep(TRACE_POLL_TICKS);
+		for (i = 0; i < ncpus; i++) {
+			drain(i);
+		}
+	} while (gettime_msec() - start < msec);
+	sys_trace(TRACE_DISABLE, 0, NULL);
+	for (i = 0; i < ncpus; i++) {
+		drain(i);
+	}
+	if (lost != 0) {
+		cprintf("trace: %u events lost.\n", lost);
+	}
+	return 0;
+}